@@ -19,9 +19,20 @@ caffe_layers = {
     'convolution'   : 1,
     'relu'          : 2,
     'pooling'       : 3,
-    'innerproduct'  : 4
+    'innerproduct'  : 4,
+    'depthwise'     : 5,
+    'pointwise'     : 6
 }
 
+def get_conv_type(caffe_model, layer):
+    # Convolutions with one group per output channel are depthwise, 1x1 kernels are pointwise.
+    shape = caffe_model.layer_shape[layer]
+    if caffe_model.group[layer] > 1 and caffe_model.group[layer] == shape[1]:
+        return 'depthwise'
+    if caffe_model.kernel_size[layer] == 1:
+        return 'pointwise'
+    return 'convolution'
+
 def get_mean_values(mean_file):
     mean_vals = [0, 0, 0]
     if (mean_file):
@@ -110,7 +121,8 @@ def dump_network(caffe_model, file_name):
             prev_layer = caffe_model.layer[layer_no-1]
 
         # Write layer type code
-        fout.write(struct.pack('i', caffe_layers[layer_type]))
+        conv_type = get_conv_type(caffe_model, layer) if layer_type == 'convolution' else layer_type
+        fout.write(struct.pack('i', caffe_layers[conv_type]))
 
         # Write layer shape (n, c, h, w)
         shape = [x for x in caffe_model.layer_shape[layer]]
@@ -146,8 +158,12 @@ def dump_network(caffe_model, file_name):
             net.params[layer][0].data[:] = np.round(net.params[layer][0].data*(2**caffe_model.wt_dec_bits[layer]))
             net.params[layer][1].data[:] = np.round(net.params[layer][1].data*(2**caffe_model.bias_dec_bits[layer]))
 
-            #CHW to HWC layout conversion
-            reordered_wts = np.swapaxes(np.swapaxes(net.params[layer][0].data, 1, 2), 2, 3).flatten()
+            if conv_type == 'depthwise':
+                # (C, 1, H, W) to HWC layout conversion
+                reordered_wts = np.swapaxes(np.swapaxes(net.params[layer][0].data, 0, 2), 1, 3).flatten()
+            else:
+                #CHW to HWC layout conversion
+                reordered_wts = np.swapaxes(np.swapaxes(net.params[layer][0].data, 1, 2), 2, 3).flatten()
 
             # Write weights size and array
             fout.write(struct.pack('i', len(reordered_wts)))
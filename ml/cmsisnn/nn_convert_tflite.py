@@ -0,0 +1,160 @@
+# This file is part of the OpenMV project.
+#
+# Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+# Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+#
+# This work is licensed under the MIT license, see the file LICENSE for details.
+#
+# TFLite int8 (per-channel quantized) to OpenMV NN binary converter.
+#
+# The model must be fully int8 quantized with an input scale of 1/255 and a zero point of -128,
+# so the data layer can feed it pixels as (p - 128), and use NHWC tensors (the TFLite default).
+
+import numpy as np
+import struct, sys, argparse
+import tensorflow as tf
+
+nn_layers = {
+    'data'          : 0,
+    'pooling'       : 3,
+    'qconv'         : 7,
+    'qip'           : 8
+}
+
+POOL_MAX = 0
+POOL_AVE = 1
+
+def quantize_multiplier(scale):
+    # Split the real multiplier into a Q31 multiplier and a power of two (like TFLite).
+    if scale == 0.0: return 0, 0
+    m, e = np.frexp(scale)
+    q = int(round(m * (1 << 31)))
+    if q == (1 << 31):
+        q //= 2
+        e += 1
+    return q, int(e)
+
+def get_quant(tensor):
+    q = tensor['quantization_parameters']
+    return np.array(q['scales'], dtype=np.float64), np.array(q['zero_points'], dtype=np.int64)
+
+def get_stride_pad(in_t, out_t, k):
+    # The interpreter doesn't expose the op options, so stride and padding are derived from the
+    # tensor shapes: SAME gives ceil(in / stride) outputs and VALID ceil((in - k + 1) / stride).
+    in_h, out_h = in_t['shape'][1], out_t['shape'][1]
+    for stride in range(1, in_h + 1):
+        if out_h == -(-in_h // stride):
+            return stride, (k - 1) // 2
+        if out_h == -(-(in_h - k + 1) // stride):
+            return stride, 0
+    return 1, 0
+
+def write_shape(fout, shape):
+    # (n, c, h, w) from NHWC or NC
+    shape = list(shape)
+    if len(shape) == 2:
+        shape = [shape[0], 1, 1, shape[1]]
+    n, h, w, c = shape
+    fout.write(struct.pack('4i', n, c, h, w))
+    return [n, c, h, w]
+
+def write_params(fout, in_t, w_t, b_t, out_t, interpreter, krn=None):
+    in_scale, in_zp = get_quant(in_t)
+    w_scale, _ = get_quant(w_t)
+    out_scale, out_zp = get_quant(out_t)
+
+    weights = interpreter.get_tensor(w_t['index']).astype(np.int8)
+    bias = interpreter.get_tensor(b_t['index']).astype(np.int32)
+    channels = weights.shape[0]
+    if len(w_scale) == 1: w_scale = np.repeat(w_scale, channels)
+
+    mult, shift = zip(*[quantize_multiplier(in_scale[0] * w_scale[c] / out_scale[0]) for c in range(channels)])
+
+    # Write in_offset, out_offset and activation range. Fused ReLUs are already folded into the
+    # output quantization range by the TFLite converter, so the int8 range is enough here.
+    fout.write(struct.pack('4i', -int(in_zp[0]), int(out_zp[0]), -128, 127))
+
+    if krn is not None:
+        # Write kernel size, padding and stride
+        fout.write(struct.pack('3i', *krn))
+
+    # Write weights (OHWI)
+    fout.write(struct.pack('i', weights.size))
+    fout.write(weights.tobytes())
+
+    # Write bias, multipliers and shifts
+    fout.write(struct.pack('i', bias.size * 4))
+    fout.write(bias.tobytes())
+    fout.write(np.array(mult, dtype=np.int32).tobytes())
+    fout.write(np.array(shift, dtype=np.int32).tobytes())
+
+def dump_network(model_file, file_name):
+    interpreter = tf.lite.Interpreter(model_path=model_file)
+    interpreter.allocate_tensors()
+    tensors = {t['index']: t for t in interpreter.get_tensor_details()}
+    ops = interpreter._get_ops_details()
+
+    for op in ops:
+        if op['op_name'] not in ('CONV_2D', 'FULLY_CONNECTED', 'MAX_POOL_2D', 'AVERAGE_POOL_2D', 'RESHAPE'):
+            print("Op %s is not supported, can't convert this network."%(op['op_name']))
+            sys.exit(1)
+
+    input_t = interpreter.get_input_details()[0]
+    in_scale, in_zp = get_quant(tensors[input_t['index']])
+    if input_t['dtype'] != np.int8 or abs(in_scale[0] * 255 - 1) > 1e-3 or in_zp[0] != -128:
+        print("The input must be int8 with a scale of 1/255 and a zero point of -128.")
+        sys.exit(1)
+
+    layers = [op for op in ops if op['op_name'] != 'RESHAPE']
+    fout = open(file_name, 'wb')
+
+    # Write network type
+    fout.write(struct.pack('4c', b'T', b'F', b'L', b'8'))
+
+    # Write number of layers (+ data layer)
+    fout.write(struct.pack('i', len(layers) + 1))
+
+    # Write the data layer, pixels are mapped to (p - 128)
+    fout.write(struct.pack('i', nn_layers['data']))
+    shape = write_shape(fout, input_t['shape'])
+    fout.write(struct.pack('3i', 128, 128, 128))
+    fout.write(struct.pack('i', 7))
+    print('Layer: {0: <8} Type: {1: <15}Shape: {2: <20}'.format('data', 'data', str(shape)))
+
+    for op in layers:
+        name = op['op_name']
+        in_t = tensors[op['inputs'][0]]
+        out_t = tensors[op['outputs'][0]]
+
+        if name == 'CONV_2D':
+            w_t, b_t = tensors[op['inputs'][1]], tensors[op['inputs'][2]]
+            k = w_t['shape'][1]
+            stride, pad = get_stride_pad(in_t, out_t, k)
+            fout.write(struct.pack('i', nn_layers['qconv']))
+            shape = write_shape(fout, out_t['shape'])
+            write_params(fout, in_t, w_t, b_t, out_t, interpreter, (k, pad, stride))
+        elif name == 'FULLY_CONNECTED':
+            w_t, b_t = tensors[op['inputs'][1]], tensors[op['inputs'][2]]
+            fout.write(struct.pack('i', nn_layers['qip']))
+            shape = write_shape(fout, out_t['shape'])
+            write_params(fout, in_t, w_t, b_t, out_t, interpreter)
+        else:
+            # Pooling is assumed to be non-overlapping (kernel == stride).
+            k = stride = max(1, in_t['shape'][1] // out_t['shape'][1])
+            fout.write(struct.pack('i', nn_layers['pooling']))
+            shape = write_shape(fout, out_t['shape'])
+            # Write pool type, kernel size, padding and stride
+            fout.write(struct.pack('i', POOL_MAX if name == 'MAX_POOL_2D' else POOL_AVE))
+            fout.write(struct.pack('3i', k, 0, stride))
+
+        print('Layer: {0: <8} Type: {1: <15}Shape: {2: <20}'.format(op['index'], name, str(shape)))
+
+    fout.close()
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--model', type=str, help='tflite model file')
+    parser.add_argument('--output',type=str, default="model.network", help='output file')
+
+    args, _ = parser.parse_known_args()
+    dump_network(args.model, args.output)
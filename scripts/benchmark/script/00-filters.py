@@ -0,0 +1,22 @@
+# Filter benchmarks, each entry is (name, reference image, function run on the image).
+def benchmarks(data_path):
+    return [
+        ("histeq",          "blobs.ppm",    lambda img: img.histeq()),
+        ("gamma_corr",      "blobs.ppm",    lambda img: img.gamma_corr(gamma=0.5, contrast=1.0, brightness=0.0)),
+        ("negate",          "blobs.ppm",    lambda img: img.negate()),
+        ("mean",            "blobs.ppm",    lambda img: img.mean(1)),
+        ("median",          "blobs.ppm",    lambda img: img.median(1, percentile=0.5)),
+        ("mode",            "blobs.ppm",    lambda img: img.mode(1)),
+        ("midpoint",        "blobs.ppm",    lambda img: img.midpoint(1, bias=0.5)),
+        ("gaussian",        "blobs.ppm",    lambda img: img.gaussian(1)),
+        ("laplacian",       "blobs.ppm",    lambda img: img.laplacian(1)),
+        ("morph",           "blobs.ppm",    lambda img: img.morph(1, [-1, -1, -1, -1, 8, -1, -1, -1, -1])),
+        ("bilateral",       "blobs.ppm",    lambda img: img.bilateral(1, color_sigma=0.1, space_sigma=1)),
+        ("cartoon",         "blobs.ppm",    lambda img: img.cartoon(seed_threshold=0.05, floating_threshold=0.05)),
+        ("lens_corr",       "blobs.ppm",    lambda img: img.lens_corr(1.8)),
+        ("rotation_corr",   "blobs.ppm",    lambda img: img.rotation_corr(x_rotation=10, y_rotation=10, z_rotation=10)),
+        ("linpolar",        "blobs.ppm",    lambda img: img.linpolar()),
+        ("logpolar",        "blobs.ppm",    lambda img: img.logpolar()),
+        ("get_histogram",   "blobs.ppm",    lambda img: img.get_histogram()),
+        ("get_statistics",  "blobs.ppm",    lambda img: img.get_statistics()),
+    ]
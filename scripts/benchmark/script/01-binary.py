@@ -0,0 +1,14 @@
+# Binary op benchmarks, each entry is (name, reference image, function run on the image).
+def benchmarks(data_path):
+    thresholds = [(0, 100, 56, 95, 41, 74), (0, 100, -128, -22, -128, 99), (0, 100, -128, 98, -128, -16)]
+    return [
+        ("binary",          "blobs.ppm",    lambda img: img.binary(thresholds)),
+        ("erode",           "blobs.ppm",    lambda img: img.binary(thresholds).erode(1)),
+        ("dilate",          "blobs.ppm",    lambda img: img.binary(thresholds).dilate(1)),
+        ("open",            "blobs.ppm",    lambda img: img.binary(thresholds).open(1)),
+        ("close",           "blobs.ppm",    lambda img: img.binary(thresholds).close(1)),
+        ("invert",          "blobs.ppm",    lambda img: img.invert()),
+        ("b_xor",           "blobs.ppm",    lambda img: img.b_xor(img)),
+        ("difference",      "blobs.ppm",    lambda img: img.difference(img)),
+        ("blend",           "blobs.ppm",    lambda img: img.blend(img, alpha=128)),
+    ]
@@ -0,0 +1,15 @@
+# find_* benchmarks, each entry is (name, reference image, function run on the image).
+def benchmarks(data_path):
+    import image
+    thresholds = [(0, 100, 56, 95, 41, 74), (0, 100, -128, -22, -128, 99), (0, 100, -128, 98, -128, -16)]
+    return [
+        ("find_blobs",          "blobs.ppm",    lambda img: img.find_blobs(thresholds, pixels_threshold=200, area_threshold=200)),
+        ("find_lines",          "shapes.ppm",   lambda img: img.find_lines(threshold=10000)),
+        ("find_line_segments",  "shapes.ppm",   lambda img: img.find_line_segments(merge_distance=5)),
+        ("find_circles",        "shapes.ppm",   lambda img: img.find_circles(threshold=5000)),
+        ("find_rects",          "shapes.ppm",   lambda img: img.find_rects(threshold=10000)),
+        ("find_edges",          "shapes.ppm",   lambda img: img.find_edges(image.EDGE_CANNY, threshold=(50, 80))),
+        ("find_keypoints",      "graffiti.pgm", lambda img: img.find_keypoints(max_keypoints=100, threshold=20)),
+        ("find_lbp",            "dennis.pgm",   lambda img: img.find_lbp((0, 0, img.width(), img.height()))),
+        ("find_displacement",   "template.pgm", lambda img: img.find_displacement(img)),
+    ]
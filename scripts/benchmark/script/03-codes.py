@@ -0,0 +1,8 @@
+# Code finder benchmarks, each entry is (name, reference image, function run on the image).
+def benchmarks(data_path):
+    return [
+        ("find_qrcodes",        "qrcode.pgm",       lambda img: img.find_qrcodes()),
+        ("find_apriltags",      "apriltags.pgm",    lambda img: img.find_apriltags()),
+        ("find_datamatrices",   "datamatrix.pgm",   lambda img: img.find_datamatrices()),
+        ("find_barcodes",       "barcode.pgm",      lambda img: img.find_barcodes()),
+    ]
@@ -0,0 +1,9 @@
+# Image format benchmarks, each entry is (name, reference image, function run on the image).
+def benchmarks(data_path):
+    return [
+        ("compress",        "blobs.ppm",    lambda img: img.compress(quality=90)),
+        ("compressed",      "blobs.ppm",    lambda img: img.compressed(quality=50)),
+        ("mean_pooled",     "blobs.ppm",    lambda img: img.mean_pooled(2, 2)),
+        ("scale",           "blobs.ppm",    lambda img: img.scale(x_scale=0.5, y_scale=0.5, hint=1)),
+        ("draw_image",      "blobs.ppm",    lambda img: img.draw_image(img, 0, 0, x_scale=0.5, y_scale=0.5, alpha=128)),
+    ]
@@ -0,0 +1,8 @@
+# Neural network benchmarks, each entry is (name, reference image, function run on the image).
+def benchmarks(data_path):
+    import nn
+    net = nn.load(data_path + "/cifar10_fast.network")
+    return [
+        ("nn_forward",      "blobs.ppm",    lambda img: net.forward(img)),
+        ("nn_search",       "blobs.ppm",    lambda img: net.search(img, threshold=0.8, min_scale=0.5, scale_mul=0.5)),
+    ]
@@ -0,0 +1,26 @@
+# IMU FIFO example.
+#
+# This example shows how to batch the IMU samples in its FIFO and integrate the gyro
+# between frames. The samples are timestamped with the same clock as the frames.
+
+import sensor, image, time, imu
+
+sensor.reset()                      # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.RGB565) # Set pixel format to RGB565 (or GRAYSCALE)
+sensor.set_framesize(sensor.QVGA)   # Set frame size to QVGA (320x240)
+sensor.skip_frames(time = 2000)     # Wait for settings take effect.
+
+# Batch the gyro and accel at 416Hz, the samples are buffered on each snapshot.
+imu.fifo_enable(True, rate=416)
+
+clock = time.clock()                # Create a clock object to track the FPS.
+last = sensor.snapshot().timestamp()
+
+while(True):
+    clock.tick()                    # Update the FPS clock.
+    img = sensor.snapshot()         # Take a picture and return the image.
+    now = img.timestamp()
+    # The camera rotation (in degrees) since the last frame.
+    x, y, z = imu.fifo_rotation(last, now)
+    last = now
+    print("rotation %f %f %f" % (x, y, z), clock.fps())
@@ -0,0 +1,29 @@
+# Image Replay Example
+#
+# USE THIS EXAMPLE WITH A USD CARD!
+#
+# This example shows how to replay a stream recorded by the Image Writer object with index=True.
+# The next frames are read ahead while the reader waits for the recorded frame time, so frames
+# are returned with the same timing they were recorded with. Set real_time=False to replay the
+# frames as fast as possible instead.
+
+import sensor, image, time
+
+sensor.reset()
+sensor.set_pixformat(sensor.RGB565)
+sensor.set_framesize(sensor.QQVGA)
+sensor.skip_frames(time = 2000)
+clock = time.clock()
+
+img_reader = image.ImageReader("/stream.bin", buffer_size=32768, real_time=True)
+print("%d frames" % img_reader.count())
+
+# Start replaying from the middle of the stream.
+img_reader.seek(img_reader.count() // 2)
+
+while(True):
+    clock.tick()
+    img = img_reader.next_frame(copy_to_fb=True, loop=True)
+    # Do machine vision algorithms on the image here.
+
+    print(img_reader.tell(), clock.fps())
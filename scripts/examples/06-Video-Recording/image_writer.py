@@ -16,7 +16,8 @@ sensor.set_framesize(sensor.QQVGA)
 sensor.skip_frames(time = 2000)
 clock = time.clock()
 
-img_writer = image.ImageWriter("/stream.bin")
+# index=True appends a frame index on close so the Image Reader can seek in the stream.
+img_writer = image.ImageWriter("/stream.bin", index=True)
 
 # Red LED on means we are capturing frames.
 red_led = pyb.LED(1)
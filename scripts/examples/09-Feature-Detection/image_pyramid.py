@@ -0,0 +1,31 @@
+# Image Pyramid Example
+#
+# This example shows off building the image pyramid of each frame once and sharing
+# it between several multi-scale detectors instead of each of them scaling the frame
+# again. The levels of the pyramid are also images that can be passed to any method.
+import sensor, time, image
+
+sensor.reset()
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time = 2000)
+clock = time.clock()
+
+# 4 levels, each one half the size of the one above (scale=2 is the fastest).
+pyramid = image.ImagePyramid(levels=4, scale=2)
+tracker = image.LKTracker(max_points=64)
+
+while(True):
+    clock.tick()
+    img = sensor.snapshot()
+
+    # Level 0 is the frame itself, so update the pyramid after each snapshot.
+    pyramid.update(img)
+
+    kpts = img.find_keypoints(max_keypoints=50, pyramid=pyramid)
+    points = img.track_keypoints(tracker, pyramid=pyramid)
+
+    for x, y, dx, dy, i in points:
+        img.draw_line(int(x), int(y), int(x - dx), int(y - dy), color = 255)
+
+    print(len(points), "tracked,", len(kpts) if kpts else 0, "keypoints,", clock.fps(), "FPS")
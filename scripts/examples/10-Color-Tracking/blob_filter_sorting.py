@@ -0,0 +1,32 @@
+# Blob Filter Sorting Example
+#
+# This example shows how to sort objects with the native find_blobs() filters. The ranges are
+# tested before any blob object is created, so rejected blobs cost nothing in Python. A range is
+# (min, max) and None leaves that side open.
+
+import sensor, image, time
+
+# Color Tracking Thresholds (L Min, L Max, A Min, A Max, B Min, B Max)
+thresholds = [(30, 100, 15, 127, 15, 127)] # generic_red_thresholds
+
+sensor.reset()
+sensor.set_pixformat(sensor.RGB565)
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time = 2000)
+sensor.set_auto_gain(False) # must be turned off for color tracking
+sensor.set_auto_whitebal(False) # must be turned off for color tracking
+clock = time.clock()
+
+# Score weights for (area, pixels, density, elongation, roundness, rotation, aspect_ratio).
+weights = (0, 0, 1, 0, 1, 0, 0)
+
+while(True):
+    clock.tick()
+    img = sensor.snapshot()
+    # Round and solid objects between 200 and 5000 pixels.
+    for blob in img.find_blobs(thresholds, pixels_threshold=100, area_threshold=100,
+                               pixels_range=(200, 5000), density_range=(0.6, None),
+                               aspect_ratio_range=(0.5, 2.0), score_weights=weights, score_range=(1.2, None)):
+        img.draw_rectangle(blob.rect())
+        img.draw_cross(blob.cx(), blob.cy())
+    print(clock.fps())
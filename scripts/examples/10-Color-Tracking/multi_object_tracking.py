@@ -0,0 +1,39 @@
+# Multi Object Tracking Example
+#
+# This example shows off giving the blobs found in each frame stable ids with an
+# ObjectTracker. The tracker predicts where each object moves (constant velocity
+# Kalman filters) and assigns the new detections to the tracks in C, so this stays
+# fast with many objects. ObjectTracker.update() also takes apriltags, tf
+# classifications or (x, y, w, h) tuples.
+
+import sensor, image, time
+
+# Color Tracking Thresholds (L Min, L Max, A Min, A Max, B Min, B Max)
+thresholds = [(30, 100, 15, 127, 15, 127), # generic_red_thresholds
+              (30, 100, -64, -8, -32, 32)] # generic_green_thresholds
+
+sensor.reset()
+sensor.set_pixformat(sensor.RGB565)
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time = 2000)
+sensor.set_auto_gain(False) # must be turned off for color tracking
+sensor.set_auto_whitebal(False) # must be turned off for color tracking
+clock = time.clock()
+
+# Tracks get an id after being detected in 3 frames and are dropped after
+# missing 5 frames. Blobs are only matched to tracks of the same color code.
+tracker = image.ObjectTracker(max_tracks=32, min_hits=3, max_misses=5)
+
+while(True):
+    clock.tick()
+    img = sensor.snapshot()
+    blobs = img.find_blobs(thresholds, pixels_threshold=100, area_threshold=100)
+    ids = tracker.update(blobs)
+
+    for blob, i in zip(blobs, ids):
+        if i:
+            img.draw_rectangle(blob.rect())
+            img.draw_string(blob.x(), blob.y() - 10, str(i))
+
+    # The tracks (x, y, w, h, vx, vy, id) include the objects missed this frame.
+    print(len(tracker.tracks()), "tracks,", clock.fps(), "FPS")
@@ -0,0 +1,81 @@
+# MJPEG Streaming with send_image()
+#
+# This example shows off how to do MJPEG streaming to a FIREFOX webrowser with
+# wlan.send_image(), which compresses each frame to a scratch buffer and sends
+# it without creating a compressed image object (the frame isn't changed).
+# The parts are delimited by the boundary only as the size isn't known before.
+# Connect to the IP address/port printed out from ifconfig to view the stream.
+
+import sensor, image, time, network, usocket, sys
+
+SSID =''     # Network SSID
+KEY  =''     # Network key
+HOST =''     # Use first available interface
+PORT = 8080  # Arbitrary non-privileged port
+
+# Reset sensor
+sensor.reset()
+
+# Set sensor settings
+sensor.set_contrast(1)
+sensor.set_brightness(1)
+sensor.set_saturation(1)
+sensor.set_gainceiling(16)
+sensor.set_framesize(sensor.QQVGA)
+sensor.set_pixformat(sensor.GRAYSCALE)
+
+# Init wlan module and connect to network
+print("Trying to connect... (may take a while)...")
+wlan = network.WINC()
+wlan.connect(SSID, key=KEY, security=wlan.WPA_PSK)
+
+# We should have a valid IP now via DHCP
+print(wlan.ifconfig())
+
+# Create server socket
+s = usocket.socket(usocket.AF_INET, usocket.SOCK_STREAM)
+
+# Bind and listen
+s.bind([HOST, PORT])
+s.listen(5)
+
+# Set server socket to blocking
+s.setblocking(True)
+
+def start_streaming(s):
+    print ('Waiting for connections..')
+    client, addr = s.accept()
+    # set client socket timeout to 2s
+    client.settimeout(2.0)
+    print ('Connected to ' + addr[0] + ':' + str(addr[1]))
+
+    # Read request from client
+    data = client.recv(1024)
+    # Should parse client request here
+
+    # Send multipart header
+    client.send("HTTP/1.1 200 OK\r\n" \
+                "Server: OpenMV\r\n" \
+                "Content-Type: multipart/x-mixed-replace;boundary=openmv\r\n" \
+                "Cache-Control: no-cache\r\n" \
+                "Pragma: no-cache\r\n\r\n")
+
+    # FPS clock
+    clock = time.clock()
+
+    # Start streaming images
+    # NOTE: Disable IDE preview to increase streaming FPS.
+    while (True):
+        clock.tick() # Track elapsed milliseconds between snapshots().
+        frame = sensor.snapshot()
+        client.send("\r\n--openmv\r\n" \
+                    "Content-Type: image/jpeg\r\n\r\n")
+        wlan.send_image(client, frame, quality=35)
+        print(clock.fps())
+
+while (True):
+    try:
+        start_streaming(s)
+    except OSError as e:
+        print("socket error: ", e)
+        #sys.print_exception(e)
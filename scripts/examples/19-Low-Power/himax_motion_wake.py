@@ -0,0 +1,45 @@
+# Himax Motion Wake Example
+#
+# This example shows how to use the HM01B0 motion detection to wake up the MCU from
+# stop mode. The sensor keeps running from its internal oscillator and asserts its
+# INT pin when motion is detected in the window, which wakes up the MCU.
+
+import sensor, image, time, pyb, machine
+
+sensor.reset()
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time = 2000)
+
+# Motion detection window (x, y, w, h) and threshold.
+sensor.ioctl(sensor.IOCTL_HIMAX_MD_WINDOW, (0, 0, 320, 240))
+sensor.ioctl(sensor.IOCTL_HIMAX_MD_THRESHOLD, 0x01)
+sensor.ioctl(sensor.IOCTL_HIMAX_MD_CLEAR)
+sensor.ioctl(sensor.IOCTL_HIMAX_MD_ENABLE, True)
+
+motion_detected = False
+def on_motion(line):
+    global motion_detected
+    motion_detected = True
+
+# The motion interrupt pin (PC15 on the Portenta Vision Shield).
+ext = pyb.ExtInt(pyb.Pin("PC15"), pyb.ExtInt.IRQ_RISING, pyb.Pin.PULL_DOWN, on_motion)
+
+led = pyb.LED(1)
+
+while(True):
+    # Keep motion detection running with the MCU clock off.
+    sensor.ioctl(sensor.IOCTL_HIMAX_OSC_ENABLE, True)
+
+    # Enter Stop Mode until motion is detected.
+    # Note the IDE will disconnect.
+    machine.sleep()
+
+    sensor.ioctl(sensor.IOCTL_HIMAX_OSC_ENABLE, False)
+    if motion_detected:
+        img = sensor.snapshot()
+        led.on()
+        time.sleep(100)
+        led.off()
+        motion_detected = False
+        sensor.ioctl(sensor.IOCTL_HIMAX_MD_CLEAR)
@@ -0,0 +1,39 @@
+# In Memory Compressed Frame Differencing Example
+#
+# This example demonstrates frame differencing against a background image that
+# is kept losslessly compressed in the MicroPython heap instead of in an extra
+# frame buffer. The image operations decode the compressed background one row
+# at a time so the background only costs a fraction of the RAM of a frame.
+#
+# Compressed images are grayscale (or binary) only.
+
+import sensor, image, pyb, os, time
+
+TRIGGER_THRESHOLD = 5
+
+sensor.reset() # Initialize the camera sensor.
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QVGA) # or sensor.QQVGA (or others)
+sensor.skip_frames(time = 2000) # Let new settings take affect.
+sensor.set_auto_whitebal(False) # Turn off white balance.
+clock = time.clock() # Tracks FPS.
+
+print("About to save background image...")
+sensor.skip_frames(time = 2000) # Give the user time to get ready.
+background = image.CompressedImage(sensor.snapshot())
+print("Saved background image (%d bytes) - Now frame differencing!" % background.size())
+
+while(True):
+    clock.tick() # Track elapsed milliseconds between snapshots().
+    img = sensor.snapshot() # Take a picture and return the image.
+
+    # Replace the image with the "abs(NEW-OLD)" frame difference.
+    img.difference(background)
+
+    hist = img.get_histogram()
+    # See the basic frame differencing example for how this works.
+    diff = hist.get_percentile(0.99).l_value() - hist.get_percentile(0.90).l_value()
+    triggered = diff > TRIGGER_THRESHOLD
+
+    print(clock.fps(), triggered) # Note: Your OpenMV Cam runs about half as fast while
+    # connected to your computer. The FPS should increase once disconnected.
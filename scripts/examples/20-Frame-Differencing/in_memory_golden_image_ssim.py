@@ -0,0 +1,32 @@
+# Golden Image SSIM Inspection Example
+#
+# This example compares every frame against a golden image of a good part with
+# the SSIM algorithm. The windows overlap (step less than block_size) so a
+# small defect can't fall between them and threshold stops the comparison as
+# soon as the mean similarity can no longer reach it, so bad parts are
+# rejected quickly.
+
+import sensor, image, pyb, os, time
+
+# The part is bad if the mean similarity is lower than this.
+MEAN_THRESHOLD = 0.8
+
+sensor.reset() # Initialize the camera sensor.
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QVGA) # or sensor.QQVGA (or others)
+sensor.skip_frames(time = 2000) # Let new settings take affect.
+sensor.set_auto_gain(False) # Turn off so the exposure doesn't change.
+clock = time.clock() # Tracks FPS.
+
+print("About to save the golden image...")
+sensor.skip_frames(time = 2000) # Give the user time to get ready.
+golden = image.CompressedImage(sensor.snapshot())
+print("Saved the golden image!")
+
+while(True):
+    clock.tick() # Track elapsed milliseconds between snapshots().
+    img = sensor.snapshot() # Take a picture and return the image.
+    sim = img.get_similarity(golden, block_size=16, step=8, threshold=MEAN_THRESHOLD)
+    result = "- Good -" if sim.mean() >= MEAN_THRESHOLD else "- Bad -"
+
+    print(clock.fps(), result, sim)
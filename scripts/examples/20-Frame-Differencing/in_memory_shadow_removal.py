@@ -6,6 +6,7 @@
 import sensor, image, pyb, os, time
 
 TRIGGER_THRESHOLD = 5
+BACKGROUND_UPDATE = 8
 
 sensor.reset() # Initialize the camera sensor.
 sensor.set_pixformat(sensor.RGB565) # or sensor.GRAYSCALE
@@ -38,8 +39,10 @@ while(True):
     # shadow free and have the same lighting as the latest image. Unlike max()
     # shadow removal won't remove all dark objects unless they were shadows...
 
-    # Replace the image with the "abs(NEW-OLD)" frame difference.
-    img.remove_shadows(extra_fb).difference(extra_fb)
+    # Replace the image with the "abs(NEW-OLD)" frame difference in one pass.
+    # update slowly blends the shadow free image into the background (0-256)
+    # so it follows lighting changes, use 0 to keep the saved background.
+    img.remove_shadows(extra_fb, update=BACKGROUND_UPDATE, difference=True)
 
     hist = img.get_histogram()
     # This code below works by comparing the 99th percentile value (e.g. the
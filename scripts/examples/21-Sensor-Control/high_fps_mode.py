@@ -0,0 +1,19 @@
+# High FPS Mode Example
+#
+# This example shows how to use the high FPS mode of the OV7725/OV7690. At QVGA and below
+# the sensor runs its sub-sampled readout with a fixed frame timing for the highest FPS.
+
+import sensor, image, time
+
+sensor.reset()                      # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QQVGA)
+sensor.ioctl(sensor.IOCTL_SET_HIGH_FPS_MODE, True)
+sensor.skip_frames(time = 2000)     # Wait for settings take effect.
+clock = time.clock()                # Create a clock object to track the FPS.
+
+while(True):
+    clock.tick()                    # Update the FPS clock.
+    img = sensor.snapshot()         # Take a picture and return the image.
+    print(clock.fps())              # Note: OpenMV Cam runs about half as fast when connected
+                                    # to the IDE. The FPS should increase once disconnected.
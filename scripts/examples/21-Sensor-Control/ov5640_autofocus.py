@@ -0,0 +1,27 @@
+# OV5640 Auto Focus Example
+#
+# This example shows how to use the auto focus of OV5640 AF modules. The AF firmware is
+# supplied by OmniVision with the module and must be copied to the SD card first, it has
+# to be loaded again after each sensor.reset().
+
+import sensor, image, time
+
+sensor.reset()                      # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.RGB565) # Set pixel format to RGB565 (or GRAYSCALE)
+sensor.set_framesize(sensor.VGA)    # Set frame size to VGA (640x480)
+sensor.skip_frames(time = 2000)     # Wait for settings take effect.
+
+with open("/ov5640_af.bin", "rb") as f:
+    sensor.ioctl(sensor.IOCTL_OV5640_AF_LOAD_FIRMWARE, f.read())
+
+# Focus on the center of the image and keep refocusing when the scene changes.
+sensor.ioctl(sensor.IOCTL_OV5640_AF_ZONE, (320, 240))
+sensor.ioctl(sensor.IOCTL_OV5640_AF_CONTINUOUS, True)
+
+clock = time.clock()                # Create a clock object to track the FPS.
+
+while(True):
+    clock.tick()                    # Update the FPS clock.
+    img = sensor.snapshot()         # Take a picture and return the image.
+    state, zones = sensor.ioctl(sensor.IOCTL_OV5640_AF_STATUS)
+    print("focused" if state == sensor.OV5640_AF_FOCUSED else "focusing", zones, clock.fps())
@@ -0,0 +1,25 @@
+# Sensor Native Auto Exposure
+#
+# This example shows how to use the native auto exposure, which replaces the sensor's
+# own auto exposure on sensors where it's weak or missing (e.g. the MT9V034 and HM01B0).
+# A decimated histogram of each frame is collected while it's captured and the exposure
+# and gain are written between frames, so there's no per frame cost in Python.
+
+import sensor, image, time
+
+sensor.reset()                      # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.GRAYSCALE) # Set pixel format to RGB565 (or GRAYSCALE)
+sensor.set_framesize(sensor.QVGA)   # Set frame size to QVGA (320x240)
+
+# Bring the mean luminance to 96 with half of the error corrected per frame, raising the
+# exposure up to 20 ms before raising the gain. Set awb=True to also balance the colors
+# of RGB565 frames on color sensors.
+sensor.set_native_ae(True, target=96, speed=0.5, max_exposure_us=20000, max_gain_db=18, awb=False)
+
+clock = time.clock()                # Create a clock object to track the FPS.
+
+while(True):
+    clock.tick()                    # Update the FPS clock.
+    img = sensor.snapshot()         # Take a picture and return the image.
+    mean, exposure_us, gain_db = sensor.get_native_ae()
+    print("mean %d exposure %d us gain %.1f dB" % (mean, exposure_us, gain_db), clock.fps())
@@ -0,0 +1,34 @@
+# Block Motion Vectors
+#
+# This example shows off using your OpenMV Cam to find how each 16x16
+# block of the image moved since the previous frame. Blocks that didn't
+# change aren't searched and aren't returned, so the number of vectors
+# is also a cheap measure of the activity in the scene.
+
+import sensor, image, time
+
+sensor.reset()                         # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.GRAYSCALE) # Set pixel format to GRAYSCALE (required).
+sensor.set_framesize(sensor.QVGA)      # Set frame size to QVGA (320x240).
+sensor.skip_frames(time = 2000)        # Wait for settings take effect.
+clock = time.clock()                   # Create a clock object to track the FPS.
+
+# Take from the main frame buffer's RAM to allocate a second frame buffer
+# to hold the previous frame.
+extra_fb = sensor.alloc_extra_fb(sensor.width(), sensor.height(), sensor.GRAYSCALE)
+extra_fb.replace(sensor.snapshot())
+
+while(True):
+    clock.tick() # Track elapsed milliseconds between snapshots().
+    img = sensor.snapshot() # Take a picture and return the image.
+
+    # Blocks whose mean absolute difference to the previous frame is at most
+    # threshold are static. search_range is the largest motion found in pixels.
+    vectors = img.find_motion_vectors(extra_fb, block_size=16, search_range=8, threshold=4)
+
+    extra_fb.replace(img)
+
+    for x, y, dx, dy, sad in vectors:
+        img.draw_line(x + 8, y + 8, x + 8 - dx, y + 8 - dy, color = 255)
+
+    print("%d moving blocks, %f FPS" % (len(vectors), clock.fps()))
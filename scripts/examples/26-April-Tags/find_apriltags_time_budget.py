@@ -0,0 +1,25 @@
+# AprilTags Time Budget Example
+#
+# This example shows how to bound the time find_apriltags() takes so a control loop keeps a
+# fixed rate. Once time_budget_us runs out the tags found so far are returned and
+# image.truncated() returns True. The same option works for find_qrcodes(), find_datamatrices(),
+# find_keypoints(), selective_search() and tf.classify()/tf.detect().
+
+import sensor, image, time
+
+sensor.reset()
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QQVGA)
+sensor.skip_frames(time = 2000)
+sensor.set_auto_gain(False)  # must turn this off to prevent image washout...
+sensor.set_auto_whitebal(False)  # must turn this off to prevent image washout...
+clock = time.clock()
+
+while(True):
+    clock.tick()
+    img = sensor.snapshot()
+    tags = img.find_apriltags(time_budget_us=20000)
+    for tag in tags:
+        img.draw_rectangle(tag.rect(), color = 255)
+        img.draw_cross(tag.cx(), tag.cy(), color = 255)
+    print(len(tags), "tags", "(truncated)" if image.truncated() else "", clock.fps())
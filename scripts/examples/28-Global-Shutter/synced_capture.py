@@ -0,0 +1,31 @@
+# Synced Capture Example
+#
+# This example shows how to capture exposure aligned frames with several cameras. One camera (the
+# master) outputs its VSYNC on a pin which is wired to the sync input pin of the other cameras
+# (and their grounds connected). The other cameras put the global shutter camera into triggered
+# mode and start the exposure on each master frame, without any software polling.
+#
+# Frames are numbered by trigger, so img.frame_count() matches across the cameras as long as the
+# slaves are set up before the master starts its output. img.timestamp() is the trigger time.
+
+import sensor, image, time
+from pyb import Pin
+
+MASTER = False # Set to True on the master camera.
+
+sensor.reset()                      # Reset and initialize the sensor.
+sensor.set_pixformat(sensor.GRAYSCALE) # Set pixel format to GRAYSCALE
+sensor.set_framesize(sensor.VGA)    # Set frame size to VGA (640x480)
+sensor.skip_frames(time = 2000)     # Wait for settings take effect.
+
+if MASTER:
+    sensor.set_vsync_output(Pin('P4', Pin.OUT_PP, Pin.PULL_NONE))
+else:
+    sensor.set_sync_input(Pin('P4', Pin.IN, Pin.PULL_NONE))
+
+clock = time.clock()                # Create a clock object to track the FPS.
+
+while(True):
+    clock.tick()                    # Update the FPS clock.
+    img = sensor.snapshot()         # Take a picture and return the image.
+    print(img.frame_count(), img.timestamp(), clock.fps())
@@ -7,7 +7,7 @@ sensor.reset()
 sensor.set_pixformat(sensor.GRAYSCALE)
 sensor.set_framesize(sensor.QQVGA) # we run out of memory if the resolution is much bigger...
 
-uart = UART(3,115200, parity=None, stop=2, timeout=1, timeout_char=4)
+uart = UART(3,115200, parity=None, stop=2, timeout=1, timeout_char=4, rxbuf=256)
 modbus = ModbusRTU(uart, register_num=9999)
 
 sensor.skip_frames(time = 2000)
@@ -0,0 +1,39 @@
+# Native Modbus RTU Slave Example
+#
+# This example shows how to serve blob results to a PLC with the native Modbus slave. Requests
+# are answered from the UART interrupt, so the response time doesn't depend on the vision loop.
+#
+# Registers: 0 = blob count, then cx, cy, pixels for up to 8 blobs (largest first).
+#            40 = threshold low (written by the PLC).
+
+import sensor, image, time, omv
+from pyb import UART
+
+sensor.reset()
+sensor.set_pixformat(sensor.GRAYSCALE)
+sensor.set_framesize(sensor.QVGA)
+sensor.skip_frames(time = 2000)
+
+# The RX buffer must hold the longest request (256 bytes for a full write multiple registers).
+uart = UART(3, 115200, parity=None, stop=2, timeout=1, timeout_char=4, rxbuf=256)
+modbus = omv.ModbusSlave(uart, slave_id=1, register_num=64)
+modbus[40] = 200
+
+clock = time.clock()
+
+while(True):
+    clock.tick()
+    img = sensor.snapshot()
+    blobs = img.find_blobs([(modbus[40], 255)], pixels_threshold=100, area_threshold=100, merge=True)
+    blobs = sorted(blobs, key=lambda b: -b.pixels())[:8]
+
+    values = [len(blobs)]
+    for b in blobs:
+        img.draw_rectangle(b.rect())
+        values += [b.cx(), b.cy(), b.pixels()]
+    values += [0] * (25 - len(values))
+
+    # All the results are updated at once, the PLC never reads half of a frame's results.
+    modbus.set(0, values)
+    # (requests, crc_errors, exceptions, writes, max_us)
+    print(modbus.stats(), clock.fps())
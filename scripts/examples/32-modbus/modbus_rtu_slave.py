@@ -1,7 +1,7 @@
 import time
 from pyb import UART
 from modbus import ModbusRTU
-uart = UART(3,115200, parity=None, stop=2, timeout=1, timeout_char=4)
+uart = UART(3,115200, parity=None, stop=2, timeout=1, timeout_char=4, rxbuf=256)
 modbus = ModbusRTU(uart, register_num=9999)
 
 while(True):
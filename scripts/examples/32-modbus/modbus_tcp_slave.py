@@ -0,0 +1,41 @@
+# Modbus TCP Slave Example
+#
+# This example shows how to serve the native Modbus registers over TCP with the WiFi shield.
+# The socket is read from the script, the requests are decoded and answered in C.
+
+import pyb, network, usocket, omv
+
+SSID =''     # Network SSID
+KEY  =''     # Network key
+HOST =''     # Use first available interface
+PORT = 502   # Modbus TCP port
+
+# No UART, the slave only answers the requests passed to tcp().
+modbus = omv.ModbusSlave(None, register_num=32)
+
+# Init wlan module and connect to network
+print("Trying to connect... (may take a while)...")
+wlan = network.WINC()
+wlan.connect(SSID, key=KEY, security=wlan.WPA_PSK)
+print(wlan.ifconfig())
+
+s = usocket.socket(usocket.AF_INET, usocket.SOCK_STREAM)
+s.bind([HOST, PORT])
+s.listen(1)
+
+while (True):
+    client, addr = s.accept()
+    client.settimeout(5.0)
+    print("Connected to " + addr[0] + ":" + str(addr[1]))
+    try:
+        while (True):
+            modbus[0] = pyb.millis() & 0x7FFF # uptime counter
+            request = client.recv(260)
+            if not request:
+                break
+            response = modbus.tcp(request)
+            if response:
+                client.send(response)
+    except OSError as e:
+        print("socket error: ", e)
+    client.close()
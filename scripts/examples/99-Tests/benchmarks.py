@@ -0,0 +1,71 @@
+# OpenMV Benchmarks.
+#
+# Runs every benchmark script on its reference image at each pixformat and resolution and prints
+# one line per run: "Benchmark <script>/<name>/<pixformat>/<resolution> <cycles> <fb peak> <heap>".
+# The heap column is the number of bytes allocated by the run (gc is disabled while it runs).
+# tools/pyopenmv_test.py --benchmark runs this script and compares the results to a baseline.
+import os, sensor, image, gc, omv
+
+BENCH_DIR   = "benchmark"
+DATA_DIR    = "unittest/data"
+SCRIPT_DIR  = "benchmark/script"
+PIXFORMATS  = (("GRAYSCALE", sensor.GRAYSCALE), ("RGB565", sensor.RGB565))
+RESOLUTIONS = (("QQVGA", 160, 120), ("QVGA", 320, 240))
+
+if not (BENCH_DIR in os.listdir("")):
+    raise Exception('Benchmark dir not found!')
+
+def load_image(name, pixformat, w, h):
+    img = image.Image("/".join((DATA_DIR, name)), copy_to_fb=True)
+    if img.format() != pixformat:
+        if pixformat == sensor.GRAYSCALE:
+            img.to_grayscale()
+        else:
+            img.to_rgb565()
+    return img.scale(x_scale=w/img.width(), y_scale=h/img.height())
+
+def run(func, img):
+    gc.collect()
+    gc.disable()
+    omv.fb_alloc_profile(True)
+    heap = gc.mem_alloc()
+    cycles = omv.cycles()
+    func(img)
+    cycles = (omv.cycles() - cycles) & 0xFFFFFFFF
+    heap = gc.mem_alloc() - heap
+    peak = omv.fb_alloc_peak()
+    omv.fb_alloc_profile(False)
+    gc.enable()
+    return (cycles, peak, heap)
+
+print("")
+bench_failed = False
+
+for script in sorted(os.listdir(SCRIPT_DIR)):
+    if script.endswith(".py"):
+        script_path = "/".join((SCRIPT_DIR, script))
+        try:
+            exec(open(script_path).read())
+            entries = benchmarks(DATA_DIR)
+        except Exception as e:
+            bench_failed = True
+            print("Benchmark %s FAILED (%s)" % (script, e))
+            continue
+        for name, data, func in entries:
+            for pixformat_name, pixformat in PIXFORMATS:
+                for resolution_name, w, h in RESOLUTIONS:
+                    key = "/".join((script[:-3], name, pixformat_name, resolution_name))
+                    try:
+                        result = run(func, load_image(data, pixformat, w, h))
+                        print("Benchmark %s %d %d %d" % ((key,) + result))
+                    except Exception as e:
+                        gc.enable()
+                        bench_failed = True
+                        print("Benchmark %s FAILED (%s)" % (key, e))
+        entries = None
+        gc.collect()
+
+if bench_failed:
+    print("\nSome benchmarks have FAILED!!!\n\n")
+else:
+    print("\nAll benchmarks DONE.\n\n")
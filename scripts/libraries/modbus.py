@@ -1,11 +1,20 @@
 import struct
 
+try:
+    from omv import ModbusSlave
+except ImportError:
+    ModbusSlave = None
+
 class ModbusRTU():
-    def __init__(self, uart, slave_id=0x01, register_num=30):
+    # With native=True (and firmware support) requests are answered from the UART interrupt,
+    # any() is always 0 and REGISTER is the native register table. Create the UART with an
+    # rxbuf that holds the longest request (e.g. rxbuf=256).
+    def __init__(self, uart, slave_id=0x01, register_num=30, native=True):
         self.SLAVE_ID = slave_id
         self.uart = uart
         self.register_num = register_num
-        self.REGISTER = [0]*self.register_num
+        self.native = ModbusSlave(uart, slave_id, register_num) if (native and ModbusSlave) else None
+        self.REGISTER = self.native if self.native else [0]*self.register_num
         self.CRC16_TABLE = [
             0x0000,0xC0C1,0xC181,0x0140,0xC301,0x03C0,0x0280,0xC241,0xC601,
             0x06C0,0x0780,0xC741,0x0500,0xC5C1,0xC481,0x0440,0xCC01,0x0CC0,
@@ -37,15 +46,22 @@ class ModbusRTU():
             0x4540,0x8701,0x47C0,0x4680,0x8641,0x8201,0x42C0,0x4380,0x8341,
             0x4100,0x81C1,0x8081,0x4040]
     def any(self):
+        if self.native:
+            return 0
         return self.uart.any()
     def clear(self):
-        self.REGISTER = [0]*self.register_num
+        if self.native:
+            self.native.clear()
+        else:
+            self.REGISTER = [0]*self.register_num
     def crc16(self, data):
         crc = 0xFFFF
         for char in data:
             crc = (crc >> 8) ^ self.CRC16_TABLE[((crc) ^ char) & 0xFF]
         return struct.pack('<H',crc)
     def handle(self, debug = False):
+        if self.native:
+            return 0 # served by the firmware
         REQUEST = self.uart.read()
         if debug:
             print("GOT REQUEST: ", REQUEST)
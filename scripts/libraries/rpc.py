@@ -59,7 +59,11 @@ class rpc:
 
     def __init__(self): # private
         self.__crc_16 = self.__def_crc_16
-        if omv.board_type() == "H7":
+        self._put_packet_in_parts = False
+        if hasattr(omv, "crc16"):
+            # Native CRC (done by the CRC unit on the F7/H7) that reads images in place.
+            self.__crc_16 = omv.crc16
+        elif omv.board_type() == "H7":
             stm.mem32[stm.RCC + stm.RCC_AHB4ENR] = stm.mem32[stm.RCC + stm.RCC_AHB4ENR] | (1 << 19)
             stm.mem32[stm.CRC + stm.CRC_POL] = 0x1021
             self.__crc_16 = self.__stm_crc_16
@@ -89,6 +93,18 @@ class rpc:
         new_payload[-2:] = struct.pack("<H", self.__crc_16(new_payload, len(payload) + 2))
         return new_payload
 
+    # Returns the packet as buffers to send back to back. If the interface allows it
+    # the payload (e.g. a compressed image) is sent in place instead of being copied.
+    def _set_packet_parts(self, magic_value, payload=bytes()): # private
+        if not self._put_packet_in_parts: return (self._set_packet(magic_value, payload),)
+        payload = memoryview(payload)
+        header = struct.pack("<H", magic_value)
+        crc = self.__crc_16(payload, len(payload), self.__crc_16(header, 2))
+        return (header, payload, struct.pack("<H", crc))
+
+    def _put_packet_parts(self, parts, timeout_ms): # private
+        for part in parts: self.put_bytes(part, timeout_ms)
+
     def _flush(self): # protected
         pass
 
@@ -162,7 +178,7 @@ class rpc_master(rpc):
         self._put_short_timeout = self._put_short_timeout_reset
         self._get_short_timeout = self._get_short_timeout_reset
         out_header = self._set_packet(self._COMMAND_HEADER_PACKET_MAGIC, struct.pack("<II", command, len(data)))
-        out_data = self._set_packet(self._COMMAND_DATA_PACKET_MAGIC, data)
+        out_data = self._set_packet_parts(self._COMMAND_DATA_PACKET_MAGIC, data)
         start = pyb.millis()
         while pyb.elapsed_millis(start) < timeout:
             gc.collect() # Avoid collection during the transfer.
@@ -171,7 +187,7 @@ class rpc_master(rpc):
             self._flush()
             self.put_bytes(out_header, self._put_short_timeout)
             if self._get_packet(self._COMMAND_HEADER_PACKET_MAGIC, self.__in_command_header_buf, self._get_short_timeout) is not None:
-                self.put_bytes(out_data, self._put_long_timeout)
+                self._put_packet_parts(out_data, self._put_long_timeout)
                 if self._get_packet(self._COMMAND_DATA_PACKET_MAGIC, self.__in_command_data_buf, self._get_short_timeout) is not None:
                     return True
             # Avoid timeout livelocking.
@@ -246,7 +262,7 @@ class rpc_slave(rpc):
         self._put_short_timeout = self._put_short_timeout_reset
         self._get_short_timeout = self._get_short_timeout_reset
         out_header = self._set_packet(self._RESULT_HEADER_PACKET_MAGIC, struct.pack("<I", len(data)))
-        out_data = self._set_packet(self._RESULT_DATA_PACKET_MAGIC, data)
+        out_data = self._set_packet_parts(self._RESULT_DATA_PACKET_MAGIC, data)
         start = pyb.millis()
         while pyb.elapsed_millis(start) < timeout:
             gc.collect() # Avoid collection during the transfer.
@@ -256,7 +272,7 @@ class rpc_slave(rpc):
             if self._get_packet(self._RESULT_HEADER_PACKET_MAGIC, self.__in_response_header_buf, self._get_short_timeout) is not None:
                 self.put_bytes(out_header, self._put_short_timeout)
                 if self._get_packet(self._RESULT_DATA_PACKET_MAGIC, self.__in_response_data_buf, self._get_short_timeout) is not None:
-                    self.put_bytes(out_data, self._put_long_timeout)
+                    self._put_packet_parts(out_data, self._put_long_timeout)
                     return True
             # Avoid timeout livelocking.
             self._put_short_timeout = min(self._put_short_timeout + 1, timeout)
@@ -480,6 +496,7 @@ class rpc_uart_master(rpc_master):
     def __init__(self, baudrate=9600): # private
         self.__uart = pyb.UART(3, baudrate, timeout=2, timeout_char=2)
         rpc_master.__init__(self)
+        self._put_packet_in_parts = hasattr(omv, "crc16")
 
     def _flush(self): # protected
         self.__uart.read(self.__uart.any())
@@ -504,6 +521,7 @@ class rpc_uart_slave(rpc_slave):
     def __init__(self, baudrate=9600): # private
         self.__uart = pyb.UART(3, baudrate, timeout=2, timeout_char=2)
         rpc_slave.__init__(self)
+        self._put_packet_in_parts = hasattr(omv, "crc16")
 
     def _flush(self): # protected
         self.__uart.read(self.__uart.any())
@@ -528,6 +546,7 @@ class rpc_usb_vcp_master(rpc_master):
         if self.__usb_vcp.debug_mode_enabled(): raise OSError("You cannot use the USB VCP while the IDE is connected!")
         self.__usb_vcp.setinterrupt(-1)
         rpc_master.__init__(self)
+        self._put_packet_in_parts = hasattr(omv, "crc16")
 
     def _flush(self): # protected
         self.__usb_vcp.read()
@@ -546,6 +565,7 @@ class rpc_usb_vcp_slave(rpc_slave):
         if self.__usb_vcp.debug_mode_enabled(): raise OSError("You cannot use the USB VCP while the IDE is connected!")
         self.__usb_vcp.setinterrupt(-1)
         rpc_slave.__init__(self)
+        self._put_packet_in_parts = hasattr(omv, "crc16")
 
     def _flush(self): # protected
         self.__usb_vcp.read()
@@ -654,12 +674,13 @@ class rpc_wifi_master(rpc_master):
     def put_bytes(self, data, timeout_ms): # protected
         i = 0
         l = len(data)
+        view = memoryview(data)
         if l <= self._udp_limit:
             if self.__valid_udp_socket():
                 try:
                     self.__udp__socket.settimeout(self._put_short_timeout * 0.001 * self._timeout_scale)
                     while l:
-                        data_len = self.__udp__socket.sendto(data[i:i+min(l, 1400)], self.__slave_addr)
+                        data_len = self.__udp__socket.sendto(view[i:i+min(l, 1400)], self.__slave_addr)
                         if not data_len: break
                         i += data_len
                         l -= data_len
@@ -669,7 +690,7 @@ class rpc_wifi_master(rpc_master):
             try:
                 self.__tcp__socket.settimeout(timeout_ms * 0.001)
                 while l:
-                    data_len = self.__tcp__socket.send(data[i:i+min(l, 1400)])
+                    data_len = self.__tcp__socket.send(view[i:i+min(l, 1400)])
                     if not data_len: break
                     i += data_len
                     l -= data_len
@@ -696,11 +717,12 @@ class rpc_wifi_master(rpc_master):
     def _stream_put_bytes(self, data, timeout_ms): # protected
         i = 0
         l = len(data)
+        view = memoryview(data)
         if self.__valid_tcp_socket():
             try:
                 self.__tcp__socket.settimeout(timeout_ms * 0.001)
                 while l:
-                    data_len = self.__tcp__socket.send(data[i:i+min(l, 1400)])
+                    data_len = self.__tcp__socket.send(view[i:i+min(l, 1400)])
                     if not data_len: break
                     i += data_len
                     l -= data_len
@@ -802,12 +824,13 @@ class rpc_wifi_slave(rpc_slave):
     def put_bytes(self, data, timeout_ms): # protected
         i = 0
         l = len(data)
+        view = memoryview(data)
         if l <= self._udp_limit:
             if self.__valid_udp_socket():
                 try:
                     self.__udp__socket.settimeout(self._put_short_timeout * 0.001 * self._timeout_scale)
                     while l:
-                        data_len = self.__udp__socket.sendto(data[i:i+min(l, 1400)], self.__master_addr)
+                        data_len = self.__udp__socket.sendto(view[i:i+min(l, 1400)], self.__master_addr)
                         if not data_len: break
                         i += data_len
                         l -= data_len
@@ -817,7 +840,7 @@ class rpc_wifi_slave(rpc_slave):
             try:
                 self.__tcp__socket.settimeout(timeout_ms * 0.001)
                 while l:
-                    data_len = self.__tcp__socket.send(data[i:i+min(l, 1400)])
+                    data_len = self.__tcp__socket.send(view[i:i+min(l, 1400)])
                     if not data_len: break
                     i += data_len
                     l -= data_len
@@ -844,11 +867,12 @@ class rpc_wifi_slave(rpc_slave):
     def _stream_put_bytes(self, data, timeout_ms): # protected
         i = 0
         l = len(data)
+        view = memoryview(data)
         if self.__valid_tcp_socket():
             try:
                 self.__tcp__socket.settimeout(timeout_ms * 0.001)
                 while l:
-                    data_len = self.__tcp__socket.send(data[i:i+min(l, 1400)])
+                    data_len = self.__tcp__socket.send(view[i:i+min(l, 1400)])
                     if not data_len: break
                     i += data_len
                     l -= data_len
@@ -24,5 +24,8 @@
  * THE SOFTWARE.
  */
 
+uint32_t flash_sector_size(uint32_t sector);
+uint32_t flash_sector_addr(uint32_t sector);
+int flash_sector_blank(uint32_t sector);
 void flash_erase(uint32_t sector);
 void flash_write(const uint32_t *src, uint32_t dst, uint32_t size);
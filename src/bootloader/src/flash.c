@@ -33,6 +33,43 @@
 
 extern void __fatal_error();
 
+uint32_t flash_sector_size(uint32_t sector)
+{
+    #if defined(MCU_SERIES_H7)
+    return 128 * 1024;
+    #else
+    // Sectors 0-3 are the smallest, sector 4 is 4 times bigger and the rest are 8 times
+    // bigger (F4 bank 2 repeats the same layout from sector 12).
+    #if defined(MCU_SERIES_F4)
+    const uint32_t size = 16 * 1024;
+    #else
+    const uint32_t size = 32 * 1024;
+    #endif
+    sector %= 12;
+    return (sector < 4) ? size : (sector == 4) ? (size * 4) : (size * 8);
+    #endif
+}
+
+uint32_t flash_sector_addr(uint32_t sector)
+{
+    uint32_t addr = FLASH_BASE;
+    for (uint32_t i=0; i<sector; i++) {
+        addr += flash_sector_size(i);
+    }
+    return addr;
+}
+
+int flash_sector_blank(uint32_t sector)
+{
+    const uint32_t *ptr = (const uint32_t *) flash_sector_addr(sector);
+    for (uint32_t i=0; i<flash_sector_size(sector)/4; i++) {
+        if (ptr[i] != 0xFFFFFFFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 void flash_erase(uint32_t sector)
 {
     // unlock
@@ -27,6 +27,19 @@ void __flash_led()
     HAL_Delay(100);
 }
 
+// Processes the received commands while blinking the LED.
+static void __process_cmds()
+{
+    static uint32_t led_tick = 0;
+
+    CDC_Process();
+
+    if ((HAL_GetTick() - led_tick) >= 100) {
+        HAL_GPIO_TogglePin(OMV_BOOTLDR_LED_PORT, OMV_BOOTLDR_LED_PIN);
+        led_tick = HAL_GetTick();
+    }
+}
+
 void __attribute__((noreturn)) __fatal_error()
 {
     while (1) {
@@ -89,12 +102,12 @@ int main()
             uint32_t start = HAL_GetTick();
             while (!USBD_IDE_Connected()
                     && (HAL_GetTick() - start) < IDE_TIMEOUT) {
-                __flash_led();
+                __process_cmds();
             }
 
             // Wait for new firmware image if the IDE is connected
             while (USBD_IDE_Connected()) {
-                __flash_led();
+                __process_cmds();
             }
         }
     }
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <string.h>
 #include "flash.h"
 #include "usbdev/usbd_cdc.h"
 #include "omv_boardconfig.h"
@@ -20,16 +21,45 @@ uint32_t UserTxBufPtrIn = 0;    /* Increment this pointer or roll it back to
                                    start address when data are received over USART */
 uint32_t UserTxBufPtrOut = 0;   /* Increment this pointer or roll it back to
                                    start address when data are sent over USB */
-uint8_t UserRxBuffer[APP_RX_DATA_SIZE];/* Received Data over USB are stored in this buffer */
 uint8_t UserTxBuffer[APP_TX_DATA_SIZE];/* Received Data over UART (CDC interface) are stored in this buffer */
 
 static volatile uint8_t ide_connected = 0;
 static volatile uint8_t vcp_connected = 0;
 
-#define FLASH_BUF_SIZE  (64)
+#define FLASH_BUF_SIZE  (512)
 static volatile uint32_t flash_buf_idx=0;
 static volatile uint8_t  flash_buf[FLASH_BUF_SIZE];
+static volatile uint32_t flash_offset;
 static const    uint32_t flash_layout[3] = OMV_FLASH_LAYOUT;
+
+// Received packets are queued and processed by CDC_Process() in the main loop, so the host
+// keeps sending while the flash is being erased or written (until the queue is full).
+#define RX_QUEUE_SIZE   (16)
+#define RX_PACKET_SIZE  (CDC_DATA_HS_MAX_PACKET_SIZE)
+static uint8_t  rx_queue[RX_QUEUE_SIZE][RX_PACKET_SIZE];
+static volatile uint32_t rx_queue_len[RX_QUEUE_SIZE];
+static volatile uint32_t rx_head=0;
+static volatile uint32_t rx_tail=0;
+static volatile uint8_t  rx_stalled=0;
+
+// Firmware stream state (see BOOTLDR_FLASH_STREAM).
+#define STREAM_FLAG_LZ4 (1 << 0)
+enum stream_state {
+    STREAM_TOKEN,
+    STREAM_LITERAL_LEN,
+    STREAM_LITERALS,
+    STREAM_OFFSET_LO,
+    STREAM_OFFSET_HI,
+    STREAM_MATCH_LEN,
+};
+static uint32_t stream_bytes=0;     // Stream bytes left to receive.
+static uint32_t stream_flags=0;
+static uint32_t stream_sector=0;    // Next sector to erase.
+static uint32_t stream_erased=0;    // End of the erased flash.
+static uint32_t stream_state;
+static uint32_t stream_len;
+static uint32_t stream_match_len;
+static uint32_t stream_match_offset;
 #if defined(OMV_QSPIF_LAYOUT)
 #define QSPIF_BUF_SIZE  QSPIF_PAGE_SIZE
 static volatile uint32_t qspif_buf_idx=0;
@@ -38,7 +68,7 @@ static const    uint32_t qspif_layout[3] = OMV_QSPIF_LAYOUT;
 #else
 static const    uint32_t qspif_layout[3] = {0, 0, 0};
 #endif
-static const    uint32_t bootloader_version = 0xABCD0003;
+static const    uint32_t bootloader_version = 0xABCD0004;
 
 /* USB handler declaration */
 extern USBD_HandleTypeDef  USBD_Device;
@@ -55,6 +85,7 @@ enum bootldr_cmd {
     BOOTLDR_FLASH_ERASE     = 0xABCD0004,
     BOOTLDR_FLASH_WRITE     = 0xABCD0008,
     BOOTLDR_FLASH_LAYOUT    = 0xABCD0010,
+    BOOTLDR_FLASH_STREAM    = 0xABCD0020,
     BOOTLDR_QSPIF_ERASE     = 0xABCD1004,
     BOOTLDR_QSPIF_WRITE     = 0xABCD1008,
     BOOTLDR_QSPIF_LAYOUT    = 0xABCD1010,
@@ -78,8 +109,9 @@ USBD_CDC_ItfTypeDef USBD_CDC_fops =
 static int8_t CDC_Itf_Init(void)
 {
     // Set Application Buffers
+    rx_head = rx_tail = rx_stalled = 0;
     USBD_CDC_SetTxBuffer(&USBD_Device, UserTxBuffer, 0);
-    USBD_CDC_SetRxBuffer(&USBD_Device, UserRxBuffer);
+    USBD_CDC_SetRxBuffer(&USBD_Device, rx_queue[0]);
 
     return (USBD_OK);
 }
@@ -198,21 +230,116 @@ void CDC_Tx(uint8_t *buf, uint32_t len)
     }
 }
 
-/**
- * @brief  CDC_Itf_DataRx
- *         Data received over USB OUT endpoint are sent over CDC interface
- *         through this function.
- * @param  Buf: Buffer of data to be transmitted
- * @param  Len: Number of data received (in bytes)
- * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL
- */
-static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
+static void flash_flush()
+{
+    if (stream_erased) {
+        // Erase the sectors as the stream reaches them (unless they're already blank).
+        while (flash_offset + FLASH_BUF_SIZE > stream_erased) {
+            if (!flash_sector_blank(stream_sector)) {
+                flash_erase(stream_sector);
+            }
+            stream_erased += flash_sector_size(stream_sector++);
+        }
+    }
+
+    flash_write((uint32_t*)flash_buf, flash_offset, FLASH_BUF_SIZE);
+    flash_offset += FLASH_BUF_SIZE;
+    flash_buf_idx = 0;
+}
+
+static void stream_put(uint8_t c)
+{
+    flash_buf[flash_buf_idx++] = c;
+    if (flash_buf_idx == FLASH_BUF_SIZE) {
+        flash_flush();
+    }
+}
+
+static void stream_copy_match()
+{
+    // Matches are copied from the output, which is either still in the flash buffer or
+    // already written to the (memory mapped) flash.
+    uint32_t addr = flash_offset + flash_buf_idx - stream_match_offset;
+    for (uint32_t i=0; i<stream_match_len; i++, addr++) {
+        stream_put((addr >= flash_offset) ? flash_buf[addr - flash_offset] : *((uint8_t *) addr));
+    }
+}
+
+static void stream_write(uint8_t *buf, uint32_t len)
+{
+    if (!(stream_flags & STREAM_FLAG_LZ4)) {
+        for (uint32_t i=0; i<len; i++) {
+            stream_put(buf[i]);
+        }
+        return;
+    }
+
+    // LZ4 block decoder, the sequences can be split across packets so it's a state machine.
+    for (uint32_t i=0; i<len; i++) {
+        uint8_t c = buf[i];
+        switch (stream_state) {
+            case STREAM_TOKEN:
+                stream_len = c >> 4;
+                stream_match_len = (c & 0xF) + 4;
+                stream_state = (stream_len == 15) ? STREAM_LITERAL_LEN :
+                               (stream_len) ? STREAM_LITERALS : STREAM_OFFSET_LO;
+                break;
+            case STREAM_LITERAL_LEN:
+                stream_len += c;
+                if (c != 255) {
+                    stream_state = STREAM_LITERALS;
+                }
+                break;
+            case STREAM_LITERALS:
+                stream_put(c);
+                if (--stream_len == 0) {
+                    stream_state = STREAM_OFFSET_LO;
+                }
+                break;
+            case STREAM_OFFSET_LO:
+                stream_match_offset = c;
+                stream_state = STREAM_OFFSET_HI;
+                break;
+            case STREAM_OFFSET_HI:
+                stream_match_offset |= c << 8;
+                if (stream_match_len == (15 + 4)) {
+                    stream_state = STREAM_MATCH_LEN;
+                } else {
+                    stream_copy_match();
+                    stream_state = STREAM_TOKEN;
+                }
+                break;
+            case STREAM_MATCH_LEN:
+                stream_match_len += c;
+                if (c != 255) {
+                    stream_copy_match();
+                    stream_state = STREAM_TOKEN;
+                }
+                break;
+        }
+    }
+}
+
+static void CDC_Process_Packet(uint8_t *Buf, uint32_t Len)
 {
-    static volatile uint32_t flash_offset;
     #if defined(OMV_QSPIF_LAYOUT)
     static volatile uint32_t qspif_offset=0;
     #endif
 
+    if (stream_bytes) {
+        uint32_t len = (Len < stream_bytes) ? Len : stream_bytes;
+        stream_bytes -= len;
+        stream_write(Buf, len);
+        if (Len == len) {
+            return;
+        }
+        // A command follows the end of the stream in the same packet, copied so it's aligned.
+        uint32_t cmd_copy[RX_PACKET_SIZE / 4];
+        memcpy(cmd_copy, Buf + len, Len - len);
+        CDC_Process_Packet((uint8_t *) cmd_copy, Len - len);
+        return;
+    }
+
     uint32_t *cmd_buf = (uint32_t*) Buf;
     uint32_t cmd = *cmd_buf++;
 
@@ -224,6 +351,8 @@ static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
             #endif
             ide_connected = 1;
             flash_offset = MAIN_APP_ADDR;
+            stream_bytes = 0;
+            stream_erased = 0;
             // Send back the bootloader version.
             CDC_Tx((uint8_t *) &bootloader_version, 4);
             break;
@@ -241,18 +370,34 @@ static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
 
         case BOOTLDR_FLASH_WRITE: {
             uint8_t *buf =  Buf + 4;
-            uint32_t len = *Len - 4;
+            uint32_t len = Len - 4;
             for (int i=0; i<len; i++) {
                 flash_buf[flash_buf_idx++] = buf[i];
                 if (flash_buf_idx == FLASH_BUF_SIZE) {
-                    flash_buf_idx = 0;
-                    flash_write((uint32_t*)flash_buf, flash_offset, FLASH_BUF_SIZE);
-                    flash_offset += FLASH_BUF_SIZE;
+                    flash_flush();
                 }
             }
             break; 
         }
 
+        case BOOTLDR_FLASH_STREAM: {
+            // The next bytes received are a firmware image written from the start of the app,
+            // optionally LZ4 compressed (block format). Sectors are erased as they're reached
+            // so there's no need to send BOOTLDR_FLASH_ERASE first.
+            stream_flags = cmd_buf[0];
+            stream_bytes = cmd_buf[1];
+            stream_state = STREAM_TOKEN;
+            stream_sector = flash_layout[1];
+            stream_erased = flash_sector_addr(stream_sector);
+            flash_buf_idx = 0;
+            flash_offset = MAIN_APP_ADDR;
+            if (Len > 12) {
+                // Stream data sent in the same packet.
+                CDC_Process_Packet(Buf + 12, Len - 12);
+            }
+            break;
+        }
+
         case BOOTLDR_QSPIF_LAYOUT:
             CDC_Tx((uint8_t*) qspif_layout, 12);
             break;
@@ -268,7 +413,7 @@ static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
         case BOOTLDR_QSPIF_WRITE: {
             #if defined(OMV_QSPIF_LAYOUT)
             uint8_t *buf =  Buf + 4;
-            uint32_t len = *Len - 4;
+            uint32_t len = Len - 4;
             for (int i=0; i<len; i++) {
                 qspif_buf[qspif_buf_idx++] = buf[i];
                 if (qspif_buf_idx == QSPIF_BUF_SIZE) {
@@ -297,7 +442,7 @@ static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
                 for (int i=flash_buf_idx; i<FLASH_BUF_SIZE; i++) {
                     flash_buf[i] = 0xFF;
                 }
-                flash_write((uint32_t*)flash_buf, flash_offset, FLASH_BUF_SIZE);
+                flash_flush();
             }
             #if defined(OMV_QSPIF_LAYOUT)
             if (qspif_buf_idx) {
@@ -312,11 +457,45 @@ static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
         }
     }
 
-    // Initiate next USB packet transfer
-    USBD_CDC_ReceivePacket(&USBD_Device);
+}
+
+/**
+ * @brief  CDC_Itf_DataRx
+ *         Data received over USB OUT endpoint are queued for CDC_Process().
+ * @param  Buf: Buffer of data to be transmitted
+ * @param  Len: Number of data received (in bytes)
+ * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL
+ */
+static int8_t CDC_Itf_Receive(uint8_t *Buf, uint32_t *Len)
+{
+    rx_queue_len[rx_head % RX_QUEUE_SIZE] = *Len;
+    rx_head++;
+
+    if ((rx_head - rx_tail) < RX_QUEUE_SIZE) {
+        // Initiate next USB packet transfer
+        USBD_CDC_SetRxBuffer(&USBD_Device, rx_queue[rx_head % RX_QUEUE_SIZE]);
+        USBD_CDC_ReceivePacket(&USBD_Device);
+    } else {
+        // The queue is full, the next packet is NAKed until CDC_Process() frees a slot.
+        rx_stalled = 1;
+    }
     return USBD_OK;
 }
 
+void CDC_Process(void)
+{
+    while (rx_tail != rx_head) {
+        uint32_t idx = rx_tail % RX_QUEUE_SIZE;
+        CDC_Process_Packet(rx_queue[idx], rx_queue_len[idx]);
+        rx_tail++;
+
+        if (rx_stalled) {
+            rx_stalled = 0;
+            USBD_CDC_SetRxBuffer(&USBD_Device, rx_queue[rx_head % RX_QUEUE_SIZE]);
+            USBD_CDC_ReceivePacket(&USBD_Device);
+        }
+    }
+}
 
 uint8_t USBD_VCP_Connected(void)
 {
@@ -74,11 +74,11 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
-#define _USE_FASTSEEK   0
+#define _USE_FASTSEEK   1
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define _USE_EXPAND     0
+#define _USE_EXPAND     1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
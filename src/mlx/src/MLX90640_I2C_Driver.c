@@ -17,7 +17,13 @@
 #include <stdio.h>
 #include STM32_HAL_H
 #include "cambus.h"
+#include "omv_boardconfig.h"
 #include "MLX90640_I2C_Driver.h"
+#if defined(FIR_I2C_RX_DMA)
+#include "dma.h"
+// Larger reads use DMA, the words of a chunk are swapped while the next one is read.
+#define MLX90640_DMA_MIN_SIZE   (32)
+#endif
 
 static I2C_HandleTypeDef *hi2c;
 
@@ -38,11 +44,46 @@ int MLX90640_I2CGeneralReset()
 int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
 {
 	uint8_t* p = (uint8_t*) data;
-    if (cambus_readw_bytes(hi2c, (slaveAddr<<1), startAddress, p, nMemAddressRead*2) != 0) {
+    int size = nMemAddressRead*2;
+#if defined(FIR_I2C_RX_DMA)
+    if (size >= MLX90640_DMA_MIN_SIZE) {
+        int len = (size < CAMBUS_DMA_BUF_SIZE) ? size : CAMBUS_DMA_BUF_SIZE;
+        if (cambus_readw_bytes_dma_start(hi2c, FIR_I2C_RX_DMA, (slaveAddr<<1), startAddress, p, len) != 0) {
+            return -1;
+        }
+
+        for (int offset = 0; offset < size; ) {
+            if (cambus_dma_wait(hi2c) != 0) {
+                return -1;
+            }
+
+            int next = offset + len;
+            int next_len = ((size - next) < CAMBUS_DMA_BUF_SIZE) ? (size - next) : CAMBUS_DMA_BUF_SIZE;
+            // The register addresses are word addresses.
+            if ((next < size) && (cambus_readw_bytes_dma_start(hi2c, FIR_I2C_RX_DMA,
+                            (slaveAddr<<1), startAddress + (next/2), p + next, next_len) != 0)) {
+                return -1;
+            }
+
+            for(int cnt=offset; cnt < next; cnt+=2) {
+                uint8_t tempBuffer = p[cnt+1];
+                p[cnt+1] = p[cnt];
+                p[cnt] = tempBuffer;
+            }
+
+            offset = next;
+            len = next_len;
+        }
+
+        return 0;
+    }
+#endif
+
+    if (cambus_readw_bytes(hi2c, (slaveAddr<<1), startAddress, p, size) != 0) {
         return -1;
 	}
 
-	for(int cnt=0; cnt < nMemAddressRead*2; cnt+=2) {
+	for(int cnt=0; cnt < size; cnt+=2) {
 		uint8_t tempBuffer = p[cnt+1];
 		p[cnt+1] = p[cnt];
 		p[cnt] = tempBuffer;
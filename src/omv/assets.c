@@ -0,0 +1,72 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Read-only asset store (memory-mapped QSPI flash).
+ */
+#include STM32_HAL_H
+#include <string.h>
+#include "omv_boardconfig.h"
+#include "qspif.h"
+#include "assets.h"
+
+#if defined(OMV_QSPIF_LAYOUT)
+#define ASSETS_BASE     ((const uint8_t *) QSPI_BASE)
+#define ASSETS_MAX_SIZE (1 << QSPIF_SIZE_BITS)
+
+static const uint32_t *assets_header = NULL;
+
+void assets_init()
+{
+    assets_header = NULL;
+
+    if (qspif_init() != 0 || qspif_memory_map() != 0) {
+        qspif_deinit();
+        return;
+    }
+
+    const uint32_t *header = (const uint32_t *) ASSETS_BASE;
+    if (header[0] != ASSETS_MAGIC || header[1] != ASSETS_VERSION
+            || header[3] > ASSETS_MAX_SIZE
+            || (16 + (header[2] * sizeof(assets_entry_t))) > header[3]) {
+        // Erased or invalid store.
+        return;
+    }
+
+    assets_header = header;
+}
+
+bool assets_find(const char *name, const void **data, uint32_t *size)
+{
+    if (assets_header == NULL) {
+        return false;
+    }
+
+    const assets_entry_t *entries = (const assets_entry_t *) (assets_header + 4);
+    for (uint32_t i=0; i<assets_header[2]; i++) {
+        const assets_entry_t *entry = &entries[i];
+        if (strncmp(entry->name, name, ASSETS_NAME_SIZE) == 0
+                && entry->offset <= assets_header[3]
+                && entry->size <= (assets_header[3] - entry->offset)) {
+            *data = ASSETS_BASE + entry->offset;
+            *size = entry->size;
+            return true;
+        }
+    }
+
+    return false;
+}
+#else
+void assets_init()
+{
+}
+
+bool assets_find(const char *name, const void **data, uint32_t *size)
+{
+    return false;
+}
+#endif // OMV_QSPIF_LAYOUT
@@ -0,0 +1,38 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Read-only asset store (memory-mapped QSPI flash).
+ *
+ * The store is packed on the host by tools/mkassets.py and written to the
+ * start of the QSPI flash by the bootloader. It starts with a header and
+ * an entry table, followed by the asset data aligned to ASSETS_ALIGN bytes:
+ *
+ *  uint32_t magic;   // ASSETS_MAGIC
+ *  uint32_t version; // ASSETS_VERSION
+ *  uint32_t count;   // Number of entries.
+ *  uint32_t size;    // Total size of the store in bytes.
+ *  assets_entry_t entries[count];
+ */
+#ifndef __ASSETS_H__
+#define __ASSETS_H__
+#include <stdint.h>
+#include <stdbool.h>
+#define ASSETS_MAGIC        (0x41564D4F) // "OMVA"
+#define ASSETS_VERSION      (1)
+#define ASSETS_ALIGN        (32)
+#define ASSETS_NAME_SIZE    (32)
+
+typedef struct assets_entry {
+    char name[ASSETS_NAME_SIZE];    // NULL padded asset name.
+    uint32_t offset;                // Data offset from the start of the store.
+    uint32_t size;                  // Data size in bytes.
+} assets_entry_t;
+
+void assets_init();
+bool assets_find(const char *name, const void **data, uint32_t *size);
+#endif // __ASSETS_H__
@@ -14,12 +14,18 @@
 // Enable LAB LUT
 //#define IMLIB_ENABLE_LAB_LUT
 
+// Enable the compact LAB LUT (about 3KB) when the LAB LUT is disabled
+#define IMLIB_ENABLE_LAB_COMPACT_LUT
+
 // Enable YUV LUT
 //#define IMLIB_ENABLE_YUV_LUT
 
 // Enable remove_shadows()
 //#define IMLIB_ENABLE_REMOVE_SHADOWS
 
+// Enable BackgroundModel()
+//#define IMLIB_ENABLE_BACKGROUND_MODEL
+
 // Enable linpolar()
 //#define IMLIB_ENABLE_LINPOLAR
 
@@ -50,6 +56,9 @@
     #define IMLIB_ENABLE_ROTATION_CORR
 #endif
 
+// Enable Remap() (precomputed lens_corr() and rotation_corr())
+//#define IMLIB_ENABLE_REMAP
+
 // Enable get_similarity()
 //#define IMLIB_ENABLE_GET_SIMILARITY
 
@@ -112,6 +112,8 @@
 /* uSD */
 #define SD_SPI                  (SPI2)
 #define SD_SPI_AF               (GPIO_AF5_SPI2)
+#define SD_SPI_TX_DMA           (&dma_SPI_2_TX)
+#define SD_SPI_RX_DMA           (&dma_SPI_2_RX)
 #define SD_CD_PIN               (GPIO_PIN_0)
 #define SD_CS_PIN               (GPIO_PIN_1)
 #define SD_SCLK_PIN             (GPIO_PIN_13)
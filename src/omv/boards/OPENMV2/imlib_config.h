@@ -14,6 +14,9 @@
 // Enable LAB LUT
 #define IMLIB_ENABLE_LAB_LUT
 
+// Enable the compact LAB LUT (about 3KB) when the LAB LUT is disabled
+//#define IMLIB_ENABLE_LAB_COMPACT_LUT
+
 // Enable YUV LUT
 //#define IMLIB_ENABLE_YUV_LUT
 
@@ -29,6 +32,9 @@
 // Enable math ops
 #define IMLIB_ENABLE_MATH_OPS
 
+// Enable the 64K entry RGB565 table for gamma_corr() on large images
+//#define IMLIB_ENABLE_GAMMA_LUT_RGB565
+
 // Enable flood_fill()
 //#define IMLIB_ENABLE_FLOOD_FILL
 
@@ -59,6 +65,9 @@
 // Enable remove_shadows()
 //#define IMLIB_ENABLE_REMOVE_SHADOWS
 
+// Enable BackgroundModel()
+//#define IMLIB_ENABLE_BACKGROUND_MODEL
+
 // Enable linpolar()
 //#define IMLIB_ENABLE_LINPOLAR
 
@@ -89,6 +98,9 @@
     #define IMLIB_ENABLE_ROTATION_CORR
 #endif
 
+// Enable Remap() (precomputed lens_corr() and rotation_corr())
+//#define IMLIB_ENABLE_REMAP
+
 // Enable get_similarity()
 //#define IMLIB_ENABLE_GET_SIMILARITY
 
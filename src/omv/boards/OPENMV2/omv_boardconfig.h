@@ -87,6 +87,7 @@
 #define OMV_VFS_BUF_SIZE    (1K)    // VFS sturct + FATFS file buffer (624 bytes)
 #define OMV_FFS_BUF_SIZE    (16K)   // Flash filesystem cache
 #define OMV_JPEG_BUF_SIZE   (8 * 1024)  // IDE JPEG buffer size (header + data).
+#define OMV_JPEG_BUF_SLOTS  (1)         // Too small to split, the IDE and the camera share the buffer.
 
 #define OMV_BOOT_ORIGIN     0x08000000
 #define OMV_BOOT_LENGTH     16K
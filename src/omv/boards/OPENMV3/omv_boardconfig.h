@@ -87,6 +87,7 @@
 #define OMV_VFS_BUF_SIZE    (1K)    // VFS sturct + FATFS file buffer (624 bytes)
 #define OMV_FFS_BUF_SIZE    (32K)   // Flash filesystem cache
 #define OMV_JPEG_BUF_SIZE   (22 * 1024) // IDE JPEG buffer (header + data).
+#define OMV_JPEG_BUF_SLOTS  (2)         // IDE JPEG buffer slots (the camera writes one while the IDE reads another).
 
 #define OMV_BOOT_ORIGIN     0x08000000
 #define OMV_BOOT_LENGTH     32K
@@ -118,6 +119,8 @@
 #define FIR_I2C_SCL_PIN         (GPIO_PIN_10)
 #define FIR_I2C_SDA_PIN         (GPIO_PIN_11)
 #define FIR_I2C_TIMING          (I2C_TIMING_FULL)
+#define FIR_I2C_HANDLE          I2CHandle2   // MicroPython I2C(2) handle, for the DMA reads.
+#define FIR_I2C_RX_DMA          (&dma_I2C_2_RX)
 #define FIR_I2C_FORCE_RESET()   __HAL_RCC_I2C2_FORCE_RESET()
 #define FIR_I2C_RELEASE_RESET() __HAL_RCC_I2C2_RELEASE_RESET()
 
@@ -167,6 +167,8 @@
 #define FIR_I2C_SCL_PIN         (GPIO_PIN_10)
 #define FIR_I2C_SDA_PIN         (GPIO_PIN_11)
 #define FIR_I2C_TIMING          (I2C_TIMING_FULL)
+#define FIR_I2C_HANDLE          I2CHandle2   // MicroPython I2C(2) handle, for the DMA reads.
+#define FIR_I2C_RX_DMA          (&dma_I2C_2_RX)
 #define FIR_I2C_FORCE_RESET()   __HAL_RCC_I2C2_FORCE_RESET()
 #define FIR_I2C_RELEASE_RESET() __HAL_RCC_I2C2_RELEASE_RESET()
 
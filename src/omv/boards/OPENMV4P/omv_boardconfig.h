@@ -117,12 +117,19 @@
 #define OMV_FB_MEMORY           DRAM        // Framebuffer, fb_alloc
 #define OMV_JPEG_MEMORY         DRAM        // JPEG buffer memory buffer.
 #define OMV_JPEG_MEMORY_OFFSET  (31M)       // JPEG buffer is placed after FB/fballoc memory.
+#define OMV_INVARIANT_MEMORY    DRAM        // illuminvar() table, generated on first use.
+#define OMV_INVARIANT_MEMORY_OFFSET (32640K) // 128K table placed after the JPEG buffer.
+#define OMV_XALLOC_LARGE_MEMORY DRAM        // xalloc_data() large buffers heap.
+#define OMV_XALLOC_LARGE_MEMORY_OFFSET  (27M) // Large heap is placed after FB/fballoc memory.
 #define OMV_VOSPI_MEMORY        SRAM4       // VoSPI buffer memory.
 #define OMV_FB_OVERLAY_MEMORY   AXI_SRAM    // _fballoc_overlay memory.
 #define OMV_FB_OVERLAY_MEMORY_OFFSET    (480*1024)  // _fballoc_overlay
+#define OMV_FB_ALLOC_EXTRA_MEMORY   SRAM3       // fb_alloc FB_ALLOC_PREFER_SPEED memory.
 
-#define OMV_FB_SIZE             (30M)       // FB memory: header + VGA/GS image
+#define OMV_FB_SIZE             (26M)       // FB memory: header + VGA/GS image
 #define OMV_FB_ALLOC_SIZE       (1M)        // minimum fb alloc size
+#define OMV_XALLOC_LARGE_SIZE   (4M)        // Large heap size.
+#define OMV_XALLOC_LARGE_THRESHOLD  (4096)  // xalloc_data() buffers this size or larger use the large heap.
 #define OMV_STACK_SIZE          (15K)
 #define OMV_HEAP_SIZE           (229K)
 #define OMV_SDRAM_SIZE          (32 * 1024 * 1024) // This needs to be here for UVC firmware.
@@ -131,7 +138,7 @@
 #define OMV_LINE_BUF_SIZE       (11K)       // Image line buffer round(2592 * 2BPP * 2 buffers).
 #define OMV_MSC_BUF_SIZE        (12K)       // USB MSC bot data
 #define OMV_VFS_BUF_SIZE        (1K)        // VFS sturct + FATFS file buffer (624 bytes)
-#define OMV_JPEG_BUF_SIZE       (1024*1024) // IDE JPEG buffer (header + data).
+#define OMV_JPEG_BUF_SIZE       (896*1024)  // IDE JPEG buffer (header + data).
 
 #define OMV_BOOT_ORIGIN         0x08000000
 #define OMV_BOOT_LENGTH         128K
@@ -176,6 +183,8 @@
 #define FIR_I2C_SCL_PIN         (GPIO_PIN_10)
 #define FIR_I2C_SDA_PIN         (GPIO_PIN_11)
 #define FIR_I2C_TIMING          (I2C_TIMING_FULL)
+#define FIR_I2C_HANDLE          I2CHandle2   // MicroPython I2C(2) handle, for the DMA reads.
+#define FIR_I2C_RX_DMA          (&dma_I2C_2_RX)
 #define FIR_I2C_FORCE_RESET()   __HAL_RCC_I2C2_FORCE_RESET()
 #define FIR_I2C_RELEASE_RESET() __HAL_RCC_I2C2_RELEASE_RESET()
 
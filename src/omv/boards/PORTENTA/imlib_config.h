@@ -14,6 +14,9 @@
 // Enable LAB LUT
 #define IMLIB_ENABLE_LAB_LUT
 
+// Enable the compact LAB LUT (about 3KB) when the LAB LUT is disabled
+//#define IMLIB_ENABLE_LAB_COMPACT_LUT
+
 // Enable YUV LUT
 //#define IMLIB_ENABLE_YUV_LUT
 
@@ -29,6 +32,9 @@
 // Enable math ops
 #define IMLIB_ENABLE_MATH_OPS
 
+// Enable the 64K entry RGB565 table for gamma_corr() on large images
+#define IMLIB_ENABLE_GAMMA_LUT_RGB565
+
 // Enable flood_fill()
 #define IMLIB_ENABLE_FLOOD_FILL
 
@@ -62,6 +68,9 @@
 // Enable remove_shadows()
 #define IMLIB_ENABLE_REMOVE_SHADOWS
 
+// Enable BackgroundModel()
+#define IMLIB_ENABLE_BACKGROUND_MODEL
+
 // Enable linpolar()
 #define IMLIB_ENABLE_LINPOLAR
 
@@ -92,6 +101,9 @@
     #define IMLIB_ENABLE_ROTATION_CORR
 #endif
 
+// Enable Remap() (precomputed lens_corr() and rotation_corr())
+#define IMLIB_ENABLE_REMAP
+
 // Enable get_similarity()
 #define IMLIB_ENABLE_GET_SIMILARITY
 
@@ -152,6 +164,18 @@
 // Enable find_keypoints()
 #define IMLIB_ENABLE_FIND_KEYPOINTS
 
+// Enable LKTracker()
+#define IMLIB_ENABLE_LK_TRACKER
+
+// Enable find_motion_vectors()
+#define IMLIB_ENABLE_FIND_MOTION_VECTORS
+
+// Enable ObjectTracker()
+#define IMLIB_ENABLE_OBJECT_TRACKER
+
+// Enable CompressedImage()
+#define IMLIB_ENABLE_COMPRESSED_IMAGES
+
 #if defined(IMLIB_ENABLE_FIND_LBP) || defined(IMLIB_ENABLE_FIND_KEYPOINTS)
     #define IMLIB_ENABLE_DESCRIPTOR
 #endif
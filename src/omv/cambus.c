@@ -10,7 +10,10 @@
  */
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 #include STM32_HAL_H
+#include "irq.h"
+#include "dma.h"
 #include "systick.h"
 #include "omv_boardconfig.h"
 #include "cambus.h"
@@ -85,6 +88,18 @@ int cambus_scan(I2C_HandleTypeDef *i2c)
     return 0;
 }
 
+// Returns 0 if a device answers at slv_addr.
+int cambus_probe(I2C_HandleTypeDef *i2c, uint8_t slv_addr)
+{
+    int ret = 0;
+    __disable_irq();
+    if (HAL_I2C_IsDeviceReady(i2c, slv_addr, 10, I2C_TIMEOUT) != HAL_OK) {
+        ret = -1;
+    }
+    __enable_irq();
+    return ret;
+}
+
 int cambus_gencall(I2C_HandleTypeDef *i2c, uint8_t cmd)
 {
     if (HAL_I2C_Master_Transmit(i2c, 0x00, &cmd, 1, I2C_TIMEOUT) != HAL_OK) {
@@ -230,3 +245,115 @@ int cambus_writew_bytes(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint16_t reg_a
     }
     return 0;
 }
+
+#if !defined(STM32F4)
+// The DMA read in flight, the data is copied out of the DMA buffer when it's done.
+static DMA_HandleTypeDef cambus_rx_dma;
+static const dma_descr_t *cambus_rx_dma_descr = NULL;
+static uint8_t *cambus_rx_buf;
+static int cambus_rx_len;
+static uint8_t cambus_dma_buf[CAMBUS_DMA_BUF_SIZE] __attribute__((aligned(32), section(".dma_buffer")));
+
+static IRQn_Type cambus_ev_irqn(I2C_TypeDef *instance)
+{
+    if (instance == I2C1) {
+        return I2C1_EV_IRQn;
+    } else if (instance == I2C2) {
+        return I2C2_EV_IRQn;
+    } else if (instance == I2C3) {
+        return I2C3_EV_IRQn;
+    } else {
+        return I2C4_EV_IRQn;
+    }
+}
+
+static void cambus_dma_end(I2C_HandleTypeDef *i2c)
+{
+    IRQn_Type irqn = cambus_ev_irqn(i2c->Instance);
+    HAL_NVIC_DisableIRQ(irqn);
+    HAL_NVIC_DisableIRQ(irqn + 1); // ER
+    dma_deinit(cambus_rx_dma_descr);
+    i2c->hdmarx = NULL;
+    cambus_rx_dma_descr = NULL;
+}
+
+int cambus_readw_bytes_dma_start(I2C_HandleTypeDef *i2c, const void *dma_descr,
+        uint8_t slv_addr, uint16_t reg_addr, uint8_t *buf, int len)
+{
+    if ((len > CAMBUS_DMA_BUF_SIZE) || cambus_rx_dma_descr) {
+        return -1;
+    }
+
+    cambus_rx_dma_descr = dma_descr;
+    cambus_rx_buf = buf;
+    cambus_rx_len = len;
+
+    dma_init(&cambus_rx_dma, cambus_rx_dma_descr, DMA_PERIPH_TO_MEMORY, i2c);
+    i2c->hdmarx = &cambus_rx_dma;
+
+    // The end of the transfer (the STOP) is handled by the I2C event interrupt.
+    IRQn_Type irqn = cambus_ev_irqn(i2c->Instance);
+    NVIC_SetPriority(irqn, IRQ_PRI_I2C);
+    NVIC_SetPriority(irqn + 1, IRQ_PRI_I2C);
+    HAL_NVIC_EnableIRQ(irqn);
+    HAL_NVIC_EnableIRQ(irqn + 1);
+
+    if (HAL_I2C_Mem_Read_DMA(i2c, slv_addr, reg_addr,
+                I2C_MEMADD_SIZE_16BIT, cambus_dma_buf, len) != HAL_OK) {
+        cambus_dma_end(i2c);
+        return -1;
+    }
+    return 0;
+}
+
+int cambus_dma_wait(I2C_HandleTypeDef *i2c)
+{
+    int ret = 0;
+
+    if (!cambus_rx_dma_descr) {
+        return -1;
+    }
+
+    for (uint32_t tick_start = HAL_GetTick(); HAL_I2C_GetState(i2c) != HAL_I2C_STATE_READY; __WFI()) {
+        if ((HAL_GetTick() - tick_start) >= I2C_TIMEOUT) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if ((ret == 0) && (i2c->ErrorCode == HAL_I2C_ERROR_NONE)) {
+        memcpy(cambus_rx_buf, cambus_dma_buf, cambus_rx_len);
+    } else {
+        ret = -1;
+    }
+
+    cambus_dma_end(i2c);
+
+    if (ret != 0) {
+        // Reset the bus state after a timeout or an error.
+        HAL_I2C_DeInit(i2c);
+        HAL_I2C_Init(i2c);
+    }
+    return ret;
+}
+#endif // !defined(STM32F4)
+
+int cambus_writeb2_table(I2C_HandleTypeDef *i2c, uint8_t slv_addr, const uint8_t (*regs)[3])
+{
+    int ret = 0;
+    uint8_t buf[CAMBUS_MAX_BURST];
+
+    for (int i = 0; regs[i][0]; ) {
+        // Coalesce contiguous registers into a single burst.
+        int len = 0;
+        uint16_t reg_addr = (regs[i][0] << 8) | regs[i][1];
+        do {
+            buf[len++] = regs[i++][2];
+        } while (regs[i][0] && (len < CAMBUS_MAX_BURST)
+                && (((regs[i][0] << 8) | regs[i][1]) == (reg_addr + len)));
+
+        ret |= cambus_writew_bytes(i2c, slv_addr, reg_addr, buf, len);
+    }
+
+    return ret;
+}
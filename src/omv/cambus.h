@@ -30,9 +30,13 @@
 #error "no I2C timings for this MCU"
 #endif
 
+// Max number of registers written in a single burst.
+#define CAMBUS_MAX_BURST        (32)
+
 int cambus_init(I2C_HandleTypeDef *i2c, I2C_TypeDef *instance, uint32_t timing);
 int cambus_deinit(I2C_HandleTypeDef *i2c);
 int cambus_scan(I2C_HandleTypeDef *i2c);
+int cambus_probe(I2C_HandleTypeDef *i2c, uint8_t slv_addr);
 int cambus_gencall(I2C_HandleTypeDef *i2c, uint8_t cmd);
 int cambus_readb(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint8_t reg_addr,  uint8_t *reg_data);
 int cambus_writeb(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint8_t reg_addr, uint8_t reg_data);
@@ -46,4 +50,16 @@ int cambus_read_bytes(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint8_t reg_addr
 int cambus_write_bytes(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint8_t reg_addr, uint8_t *buf, int len);
 int cambus_readw_bytes(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint16_t reg_addr, uint8_t *buf, int len);
 int cambus_writew_bytes(I2C_HandleTypeDef *i2c, uint8_t slv_addr, uint16_t reg_addr, uint8_t *buf, int len);
+#if !defined(STM32F4)
+// Non-blocking register read with DMA through a DMA buffer (len <= CAMBUS_DMA_BUF_SIZE), only one
+// read can be in flight. The I2C interrupts must reach the handle, so it must be the MicroPython
+// handle of the bus. cambus_dma_wait() sleeps until the read is done and copies the data to buf.
+#define CAMBUS_DMA_BUF_SIZE     (256)
+int cambus_readw_bytes_dma_start(I2C_HandleTypeDef *i2c, const void *dma_descr,
+        uint8_t slv_addr, uint16_t reg_addr, uint8_t *buf, int len);
+int cambus_dma_wait(I2C_HandleTypeDef *i2c);
+#endif
+// Write a {reg_addr_hi, reg_addr_lo, reg_data} table terminated with a zero entry, registers with
+// contiguous addresses are written in a single burst (the sensor must auto-increment the address).
+int cambus_writeb2_table(I2C_HandleTypeDef *i2c, uint8_t slv_addr, const uint8_t (*regs)[3]);
 #endif // __CAMBUS_H__
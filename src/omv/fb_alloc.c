@@ -7,8 +7,10 @@
  *
  */
 #include <mp.h>
+#include "py/mphal.h"
 #include "fb_alloc.h"
 #include "framebuffer.h"
+#include "trace.h"
 #include "omv_boardconfig.h"
 
 extern char _fballoc;
@@ -18,12 +20,55 @@ static int marks = 0;
 static uint32_t alloc_bytes;
 static uint32_t alloc_bytes_peak;
 #endif
+
+// Profiler state, each active mark scope (up to FB_ALLOC_PROFILE_DEPTH) is accounted to its call site.
+#define FB_ALLOC_PROFILE_DEPTH (8)
+typedef struct {
+    int marks;          // The marks count when the scope was opened.
+    fb_alloc_profile_t *entry;
+    uint32_t base;      // Bytes allocated when the scope was opened.
+    uint32_t peak;
+    uint32_t allocs;
+    uint32_t ticks;
+} fb_alloc_scope_t;
+
+static bool profile_enabled = false;
+static int profile_depth = 0;
+static uint32_t profile_bytes = 0; // Bytes allocated (always tracked).
+static uint32_t profile_peak = 0;
+static fb_alloc_profile_t profile_entries[FB_ALLOC_PROFILE_ENTRIES];
+static fb_alloc_scope_t profile_scopes[FB_ALLOC_PROFILE_DEPTH];
+
+// Secondary memory pools. Allocations from a pool only keep their size on the main stack, with
+// the pool index (starting from 1) in the low bits (sizes are multiples of 4), so the pools are
+// unwound by the same marks.
+#define FB_POOL_MASK    (0x3)
+typedef struct {
+    char *origin;       // Lowest address of the pool (the pool grows down).
+    char *top;          // Highest address of the pool.
+    char *pointer;
+    bool speed_only;    // Only used by FB_ALLOC_PREFER_SPEED allocations.
+} fb_pool_t;
+
 #if defined(OMV_FB_OVERLAY_MEMORY)
-#define FB_OVERLAY_MEMORY_FLAG 0x1
 extern char _fballoc_overlay;
-static char *pointer_overlay = &_fballoc_overlay;
+#endif
+#if defined(OMV_FB_ALLOC_EXTRA_MEMORY)
+extern char _fballoc_extra_start;
+extern char _fballoc_extra;
 #endif
 
+// Pools in the order they're tried.
+static fb_pool_t pools[] = {
+    #if defined(OMV_FB_OVERLAY_MEMORY)
+    { (char *) OMV_FB_OVERLAY_MEMORY_ORIGIN, &_fballoc_overlay, &_fballoc_overlay, false },
+    #endif
+    #if defined(OMV_FB_ALLOC_EXTRA_MEMORY)
+    { &_fballoc_extra_start, &_fballoc_extra, &_fballoc_extra, true },
+    #endif
+};
+#define FB_POOL_COUNT   (sizeof(pools) / sizeof(pools[0]))
+
 __weak NORETURN void fb_alloc_fail()
 {
     nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError,
@@ -35,9 +80,126 @@ void fb_alloc_init0()
 {
     pointer = &_fballoc;
     marks = 0;
-    #if defined(OMV_FB_OVERLAY_MEMORY)
-    pointer_overlay = &_fballoc_overlay;
-    #endif
+    profile_depth = 0;
+    profile_bytes = 0;
+    for (int i = 0; i < FB_POOL_COUNT; i++) {
+        pools[i].pointer = pools[i].top;
+    }
+}
+
+// Returns the first pool that can hold size bytes for these hints, or NULL.
+static fb_pool_t *fb_pool_find(uint32_t size, int hints)
+{
+    if (hints & FB_ALLOC_PREFER_SIZE) {
+        return NULL;
+    }
+
+    for (int i = 0; i < FB_POOL_COUNT; i++) {
+        if ((!pools[i].speed_only || (hints & FB_ALLOC_PREFER_SPEED))
+                && (((uint32_t) (pools[i].pointer - pools[i].origin)) >= size)) {
+            return &pools[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void fb_alloc_profile_alloc()
+{
+    profile_peak = IM_MAX(profile_peak, profile_bytes);
+
+    for (int i = 0; i < profile_depth; i++) {
+        profile_scopes[i].allocs += 1;
+        profile_scopes[i].peak = IM_MAX(profile_scopes[i].peak, profile_bytes - profile_scopes[i].base);
+    }
+}
+
+static void fb_alloc_profile_mark(uint32_t caller)
+{
+    if (profile_depth == FB_ALLOC_PROFILE_DEPTH) {
+        return;
+    }
+
+    fb_alloc_profile_t *entry = NULL;
+    for (int i = 0; i < FB_ALLOC_PROFILE_ENTRIES; i++) {
+        if (profile_entries[i].caller == caller || profile_entries[i].caller == 0) {
+            entry = &profile_entries[i];
+            entry->caller = caller;
+            break;
+        }
+    }
+
+    fb_alloc_scope_t *scope = &profile_scopes[profile_depth++];
+    scope->marks = marks;
+    scope->entry = entry; // NULL if the table is full.
+    scope->base = profile_bytes;
+    scope->peak = 0;
+    scope->allocs = 0;
+    scope->ticks = mp_hal_ticks_us();
+}
+
+static void fb_alloc_profile_free_till_mark()
+{
+    if (profile_depth == 0 || profile_scopes[profile_depth - 1].marks != marks) {
+        // The scope was opened while the profiler was disabled.
+        return;
+    }
+
+    fb_alloc_scope_t *scope = &profile_scopes[--profile_depth];
+    if (scope->entry != NULL) {
+        scope->entry->calls += 1;
+        scope->entry->allocs += scope->allocs;
+        scope->entry->peak = IM_MAX(scope->entry->peak, scope->peak);
+        scope->entry->time_us += mp_hal_ticks_us() - scope->ticks;
+    }
+}
+
+void fb_alloc_profile_enable(bool enable)
+{
+    profile_enabled = enable;
+    profile_depth = 0;
+    profile_peak = 0;
+    memset(profile_entries, 0, sizeof(profile_entries));
+}
+
+bool fb_alloc_profile_enabled()
+{
+    return profile_enabled;
+}
+
+const fb_alloc_profile_t *fb_alloc_profile_entries()
+{
+    return profile_entries;
+}
+
+uint32_t fb_alloc_profile_peak()
+{
+    return profile_peak;
+}
+
+// Pops the last allocation and returns its saved size (a size of 4 is a marker).
+static uint32_t fb_pop()
+{
+    uint32_t size = *((uint32_t *) pointer);
+    uint32_t pool = size & FB_POOL_MASK;
+
+    size &= ~FB_POOL_MASK;
+    if (size != sizeof(uint32_t)) {
+        #if defined(FB_ALLOC_STATS)
+        alloc_bytes -= size - sizeof(uint32_t);
+        #endif
+        profile_bytes -= size - sizeof(uint32_t);
+    }
+
+    if (pool) {
+        // Only the size is on the main stack.
+        pools[pool - 1].pointer += size - sizeof(uint32_t);
+        pointer += sizeof(uint32_t);
+    } else {
+        pointer += size;
+    }
+
+    return size;
 }
 
 uint32_t fb_avail()
@@ -68,23 +230,23 @@ void fb_alloc_mark()
     alloc_bytes = 0;
     alloc_bytes_peak = 0;
     #endif
+    if (profile_enabled) {
+        fb_alloc_profile_mark((uint32_t) __builtin_return_address(0));
+    }
+    TRACE_BEGIN(TRACE_EVENT_FB_ALLOC, (uint32_t) __builtin_return_address(0));
 }
 
 void fb_alloc_free_till_mark()
 {
     if (!marks) return;
     while (pointer < &_fballoc) {
-        uint32_t size = *((uint32_t *) pointer);
-        #if defined(OMV_FB_OVERLAY_MEMORY)
-        if (size & FB_OVERLAY_MEMORY_FLAG) { // Check for fast flag.
-            size &= ~FB_OVERLAY_MEMORY_FLAG; // Remove it.
-            pointer_overlay += size - sizeof(uint32_t);
-        }
-        #endif
-        pointer += size; // Get size and pop.
-        if (size == sizeof(uint32_t)) break; // Break on first marker.
+        if (fb_pop() == sizeof(uint32_t)) break; // Break on first marker.
+    }
+    if (profile_enabled) {
+        fb_alloc_profile_free_till_mark();
     }
     marks -= 1;
+    TRACE_END(TRACE_EVENT_FB_ALLOC, marks);
     #if defined(FB_ALLOC_STATS)
     printf("fb_alloc peak memory: %lu\n", alloc_bytes_peak);
     #endif
@@ -98,8 +260,9 @@ void *fb_alloc(uint32_t size, int hints)
     }
 
     size=((size+sizeof(uint32_t)-1)/sizeof(uint32_t))*sizeof(uint32_t);// Round Up
-    char *result = pointer - size;
-    char *new_pointer = result - sizeof(uint32_t);
+    fb_pool_t *pool = fb_pool_find(size, hints);
+    char *result = pool ? (pool->pointer - size) : (pointer - size);
+    char *new_pointer = (pool ? pointer : result) - sizeof(uint32_t);
 
     // Check if allocation overwrites the framebuffer pixels
     if (new_pointer < (char *) MAIN_FB_PIXELS()) {
@@ -109,6 +272,10 @@ void *fb_alloc(uint32_t size, int hints)
     // size is always 4/8/12/etc. so the value below must be 8 or more.
     *((uint32_t *) new_pointer) = size + sizeof(uint32_t); // Save size.
     pointer = new_pointer;
+    if (pool) {
+        pool->pointer = result;
+        *((uint32_t *) new_pointer) |= (pool - pools) + 1; // Add pool index.
+    }
     #if defined(FB_ALLOC_STATS)
     alloc_bytes += size;
     if (alloc_bytes > alloc_bytes_peak) {
@@ -116,15 +283,10 @@ void *fb_alloc(uint32_t size, int hints)
     }
     printf("fb_alloc %lu bytes\n", size);
     #endif
-    #if defined(OMV_FB_OVERLAY_MEMORY)
-    if ((!(hints & FB_ALLOC_PREFER_SIZE))
-    && (((uint32_t) (pointer_overlay - OMV_FB_OVERLAY_MEMORY_ORIGIN)) >= size)) {
-        // Return overlay memory instead.
-        pointer_overlay -= size;
-        result = pointer_overlay;
-        *new_pointer |= FB_OVERLAY_MEMORY_FLAG; // Add flag.
+    profile_bytes += size;
+    if (profile_enabled) {
+        fb_alloc_profile_alloc();
     }
-    #endif
     return result;
 }
 
@@ -145,19 +307,23 @@ void *fb_alloc_all(uint32_t *size, int hints)
         return NULL;
     }
 
-    #if defined(OMV_FB_OVERLAY_MEMORY)
-    if (!(hints & FB_ALLOC_PREFER_SIZE)) {
-        *size = (uint32_t) (pointer_overlay - OMV_FB_OVERLAY_MEMORY_ORIGIN);
-        temp = IM_MIN(temp, *size);
+    // Use the whole of the first pool with free memory, the main stack only needs to hold the size.
+    fb_pool_t *pool = fb_pool_find(sizeof(uint32_t), hints);
+    if (pool) {
+        temp = (uint32_t) (pool->pointer - pool->origin);
     }
-    #endif
+
     *size = (temp / sizeof(uint32_t)) * sizeof(uint32_t); // Round Down
-    char *result = pointer - *size;
-    char *new_pointer = result - sizeof(uint32_t);
+    char *result = pool ? (pool->pointer - *size) : (pointer - *size);
+    char *new_pointer = (pool ? pointer : result) - sizeof(uint32_t);
 
     // size is always 4/8/12/etc. so the value below must be 8 or more.
     *((uint32_t *) new_pointer) = *size + sizeof(uint32_t); // Save size.
     pointer = new_pointer;
+    if (pool) {
+        pool->pointer = result;
+        *((uint32_t *) new_pointer) |= (pool - pools) + 1; // Add pool index.
+    }
     #if defined(FB_ALLOC_STATS)
     alloc_bytes += *size;
     if (alloc_bytes > alloc_bytes_peak) {
@@ -165,14 +331,10 @@ void *fb_alloc_all(uint32_t *size, int hints)
     }
     printf("fb_alloc_all %lu bytes\n", *size);
     #endif
-    #if defined(OMV_FB_OVERLAY_MEMORY)
-    if (!(hints & FB_ALLOC_PREFER_SIZE)) {
-        // Return overlay memory instead.
-        pointer_overlay -= *size;
-        result = pointer_overlay;
-        *new_pointer |= FB_OVERLAY_MEMORY_FLAG; // Add flag.
+    profile_bytes += *size;
+    if (profile_enabled) {
+        fb_alloc_profile_alloc();
     }
-    #endif
     return result;
 }
 
@@ -187,34 +349,15 @@ void *fb_alloc0_all(uint32_t *size, int hints)
 void fb_free()
 {
     if (pointer < &_fballoc) {
-        uint32_t size = *((uint32_t *) pointer);
-        #if defined(OMV_FB_OVERLAY_MEMORY)
-        if (size & FB_OVERLAY_MEMORY_FLAG) { // Check for fast flag.
-            size &= ~FB_OVERLAY_MEMORY_FLAG; // Remove it.
-            pointer_overlay += size - sizeof(uint32_t);
-        }
-        #endif
-        #if defined(FB_ALLOC_STATS)
-        alloc_bytes -= size;
-        #endif
-        pointer += size; // Get size and pop.
+        fb_pop();
     }
 }
 
 void fb_free_all()
 {
     while (pointer < &_fballoc) {
-        uint32_t size = *((uint32_t *) pointer);
-        #if defined(OMV_FB_OVERLAY_MEMORY)
-        if (size & FB_OVERLAY_MEMORY_FLAG) { // Check for fast flag.
-            size &= ~FB_OVERLAY_MEMORY_FLAG; // Remove it.
-            pointer_overlay += size - sizeof(uint32_t);
-        }
-        #endif
-        #if defined(FB_ALLOC_STATS)
-        alloc_bytes -= size;
-        #endif
-        pointer += size; // Get size and pop.
+        fb_pop();
     }
     marks = 0;
+    profile_depth = 0;
 }
@@ -9,9 +9,19 @@
 #ifndef __FB_ALLOC_H__
 #define __FB_ALLOC_H__
 #include <stdint.h>
-#define FB_ALLOC_NO_HINT 0
-#define FB_ALLOC_PREFER_SPEED 1
-#define FB_ALLOC_PREFER_SIZE 2
+#include <stdbool.h>
+#define FB_ALLOC_NO_HINT 0      // Overlay memory if available, otherwise the main stack.
+#define FB_ALLOC_PREFER_SPEED 1 // Like FB_ALLOC_NO_HINT, then the extra memory pool (for hot scratch buffers).
+#define FB_ALLOC_PREFER_SIZE 2  // Main stack only (for large buffers).
+// fb_alloc profiler entry, one per fb_alloc_mark call site.
+#define FB_ALLOC_PROFILE_ENTRIES (16)
+typedef struct {
+    uint32_t caller;    // Return address of the fb_alloc_mark call.
+    uint32_t calls;     // Number of marked scopes.
+    uint32_t allocs;    // Number of allocations in all scopes.
+    uint32_t peak;      // Peak bytes allocated in a scope.
+    uint32_t time_us;   // Total time spent in all scopes.
+} fb_alloc_profile_t;
 void fb_alloc_fail();
 void fb_alloc_init0();
 uint32_t fb_avail();
@@ -23,4 +33,8 @@ void *fb_alloc_all(uint32_t *size, int hints); // returns pointer and sets size
 void *fb_alloc0_all(uint32_t *size, int hints); // returns pointer and sets size
 void fb_free();
 void fb_free_all();
+void fb_alloc_profile_enable(bool enable); // Enables/disables the profiler and clears the entries.
+bool fb_alloc_profile_enabled();
+const fb_alloc_profile_t *fb_alloc_profile_entries(); // Returns FB_ALLOC_PROFILE_ENTRIES entries.
+uint32_t fb_alloc_profile_peak(); // Returns the peak bytes allocated since the profiler was enabled.
 #endif /* __FF_ALLOC_H__ */
@@ -9,8 +9,10 @@
 #include <mp.h>
 #include "common.h"
 #include "fb_alloc.h"
+#include "xalloc.h"
 #include "ff_wrapper.h"
 #define FF_MIN(x,y) (((x)<(y))?(x):(y))
+#define FF_MAX(x,y) (((x)>(y))?(x):(y))
 
 NORETURN static void ff_fail(FIL *fp, FRESULT res)
 {
@@ -75,6 +77,12 @@ void file_write_open(FIL *fp, const char *path)
 void file_close(FIL *fp)
 {
     FRESULT res = f_close(fp);
+    #if _USE_FASTSEEK
+    if (fp->cltbl) {
+        xfree(fp->cltbl);
+        fp->cltbl = NULL;
+    }
+    #endif
     if (res != FR_OK) ff_fail(fp, res);
 }
 
@@ -90,12 +98,48 @@ void file_truncate(FIL *fp)
     if (res != FR_OK) ff_fail(fp, res);
 }
 
+// Returns false if there's no contiguous free space large enough.
+bool file_expand(FIL *fp, UINT size)
+{
+    FRESULT res = f_expand(fp, size, 1);
+    if (res == FR_DENIED) return false;
+    if (res != FR_OK) ff_fail(fp, res);
+    return true;
+}
+
 void file_sync(FIL *fp)
 {
     FRESULT res = f_sync(fp);
     if (res != FR_OK) ff_fail(fp, res);
 }
 
+// Maps the cluster chain of a read-only file into a heap table so that seeks and
+// cluster crossings don't have to walk the FAT. Silently does nothing if the table
+// can't be allocated (the file is just accessed the slow way).
+void file_fast_seek_on(FIL *fp)
+{
+    #if _USE_FASTSEEK
+    if (fp->cltbl || (fp->flag & FA_WRITE)) {
+        return;
+    }
+
+    DWORD size = FILE_CLMT_SIZE;
+    for (int i = 0; i < 2; i++) {
+        DWORD *tbl = xalloc_try_alloc(size * sizeof(DWORD));
+        if (!tbl) return;
+        tbl[0] = size;
+        fp->cltbl = tbl;
+        FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+        if (res == FR_OK) return;
+        // On FR_NOT_ENOUGH_CORE the required table size is returned in tbl[0].
+        fp->cltbl = NULL;
+        size = tbl[0];
+        xfree(tbl);
+        if (res != FR_NOT_ENOUGH_CORE) ff_fail(fp, res);
+    }
+    #endif
+}
+
 // These wrapper functions are used for backward compatibility with
 // OpenMV code using vanilla FatFS. Note: Extracted from cc3200 ftp.c
 
@@ -365,6 +409,18 @@ void read_data(FIL *fp, void *data, UINT size)
         // via massive reads. So much so that the time wasted by
         // all these operations does not cost us.
         while (size) {
+            // Large reads go straight to the caller's buffer once the file buffer
+            // is drained (FatFs then does multi-block reads into it), as long as
+            // the destination has the same 4-byte alignment as the file position.
+            if ((file_buffer_index == file_buffer_size)
+                    && (size >= FF_MIN(file_buffer_size, FILE_BULK_SIZE))
+                    && ((((uint32_t) data) - f_tell(fp)) % 4 == 0)) {
+                UINT bytes;
+                FRESULT res = f_read(fp, data, size, &bytes);
+                if (res != FR_OK) ff_fail(fp, res);
+                if (bytes != size) ff_read_fail(fp);
+                break;
+            }
             file_fill(fp);
             uint32_t file_buffer_space_left = file_buffer_size - file_buffer_index;
             uint32_t can_do = FF_MIN(size, file_buffer_space_left);
@@ -442,6 +498,16 @@ void write_data(FIL *fp, const void *data, UINT size)
         // before a write to the SD card. So much so that the time wasted by
         // all these operations does not cost us.
         while (size) {
+            // Same as read_data(), large aligned writes bypass the empty file buffer.
+            if ((!file_buffer_index)
+                    && (size >= FF_MIN(file_buffer_size, FILE_BULK_SIZE))
+                    && ((((uint32_t) data) - f_tell(fp)) % 4 == 0)) {
+                UINT bytes;
+                FRESULT res = f_write(fp, data, size, &bytes);
+                if (res != FR_OK) ff_fail(fp, res);
+                if (bytes != size) ff_write_fail(fp);
+                break;
+            }
             uint32_t file_buffer_space_left = file_buffer_size - file_buffer_index;
             uint32_t can_do = FF_MIN(size, file_buffer_space_left);
             memcpy(file_buffer_pointer+file_buffer_index, data, can_do);
@@ -457,3 +523,236 @@ void write_data(FIL *fp, const void *data, UINT size)
         if (bytes != size) ff_write_fail(fp);
     }
 }
+
+// Open deferred writers, file_ring_poll() services them round robin.
+static file_ring_t *file_ring_list = NULL;
+static file_ring_t *file_ring_next = NULL;
+
+void file_ring_init0()
+{
+    file_ring_list = NULL;
+    file_ring_next = NULL;
+}
+
+static void file_ring_unlink(file_ring_t *ring)
+{
+    for (file_ring_t **p = &file_ring_list; *p; p = &(*p)->next) {
+        if (*p == ring) {
+            *p = ring->next;
+            break;
+        }
+    }
+
+    file_ring_next = NULL;
+}
+
+// Writes the oldest queued chunk, the head is always chunk aligned so it's contiguous.
+static FRESULT file_ring_write_chunk(file_ring_t *ring, UINT size)
+{
+    UINT bytes;
+    FRESULT res = f_write(ring->fp, ring->buf + ring->head, size, &bytes);
+    if ((res == FR_OK) && (bytes != size)) res = FR_DISK_ERR;
+    ring->head = (ring->head + size) % ring->size;
+    ring->count -= size;
+    return res;
+}
+
+static void file_ring_check(file_ring_t *ring)
+{
+    if (!ring->buf) {
+        // Closed (or aborted), the file may be closed as well so it's left alone.
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "File closed!"));
+    }
+
+    if (ring->res != FR_OK) {
+        FRESULT res = ring->res;
+        ring->res = FR_OK;
+        ff_fail(ring->fp, res);
+    }
+}
+
+static void file_ring_alloc(file_ring_t *ring, FIL *fp, uint32_t size, bool read)
+{
+    // Round up to whole chunks and halve the ring until it fits in the heap.
+    size = FF_MAX((size + FILE_RING_CHUNK_SIZE - 1) / FILE_RING_CHUNK_SIZE, 1) * FILE_RING_CHUNK_SIZE;
+    ring->buf = xalloc_try_alloc(size);
+    while ((!ring->buf) && (size > FILE_RING_CHUNK_SIZE)) {
+        size = FF_MAX((size / 2) / FILE_RING_CHUNK_SIZE, 1) * FILE_RING_CHUNK_SIZE;
+        ring->buf = xalloc_try_alloc(size);
+    }
+
+    if (!ring->buf) {
+        ring->buf = xalloc(size);
+    }
+
+    ring->fp = fp;
+    ring->size = size;
+    ring->head = 0;
+    ring->count = 0;
+    ring->res = FR_OK;
+    ring->read = read;
+    ring->next = file_ring_list;
+    file_ring_list = ring;
+}
+
+void file_ring_open(file_ring_t *ring, FIL *fp, uint32_t size)
+{
+    file_ring_alloc(ring, fp, size, false);
+}
+
+void file_ring_write(file_ring_t *ring, const void *data, UINT size)
+{
+    file_ring_check(ring);
+
+    if (size >= ring->size) {
+        // Too big to queue (e.g. a sensor JPEG frame), written in place after the queued data.
+        file_ring_flush(ring);
+        ring->head = 0;
+        UINT bytes;
+        FRESULT res = f_write(ring->fp, data, size, &bytes);
+        if (res != FR_OK) ff_fail(ring->fp, res);
+        if (bytes != size) ff_write_fail(ring->fp);
+        return;
+    }
+
+    while (size) {
+        if (ring->count == ring->size) {
+            // The card fell behind, write out the oldest chunk now to make room.
+            FRESULT res = file_ring_write_chunk(ring, FILE_RING_CHUNK_SIZE);
+            if (res != FR_OK) ff_fail(ring->fp, res);
+        }
+
+        uint32_t tail = (ring->head + ring->count) % ring->size;
+        uint32_t can_do = FF_MIN(size, FF_MIN(ring->size - tail, ring->size - ring->count));
+        memcpy(ring->buf + tail, data, can_do);
+        ring->count += can_do;
+        data = ((const uint8_t *) data) + can_do;
+        size -= can_do;
+    }
+}
+
+uint32_t file_ring_tell(file_ring_t *ring)
+{
+    return ring->read ? (f_tell(ring->fp) - ring->count) : (f_tell(ring->fp) + ring->count);
+}
+
+// Reads ahead up to the next chunk boundary of the file, or less if the free space at the tail is
+// smaller. The file position is aligned after the first read following a seek.
+static FRESULT file_ring_read_chunk(file_ring_t *ring)
+{
+    uint32_t tail = (ring->head + ring->count) % ring->size;
+    UINT size = FILE_RING_CHUNK_SIZE - (f_tell(ring->fp) % FILE_RING_CHUNK_SIZE);
+    size = FF_MIN(size, FF_MIN(ring->size - tail, ring->size - ring->count));
+    UINT bytes;
+    FRESULT res = f_read(ring->fp, ring->buf + tail, size, &bytes);
+    ring->count += bytes;
+    return res;
+}
+
+bool file_ring_poll()
+{
+    // Start after the ring serviced last so one busy writer can't starve the others.
+    file_ring_t *ring = (file_ring_next) ? file_ring_next : file_ring_list;
+
+    for (file_ring_t *end = ring; ring; ) {
+        file_ring_t *next = (ring->next) ? ring->next : file_ring_list;
+
+        if (ring->read) {
+            if ((ring->res == FR_OK) && ((ring->size - ring->count) >= FILE_RING_CHUNK_SIZE) && (!f_eof(ring->fp))) {
+                ring->res = file_ring_read_chunk(ring);
+                file_ring_next = next;
+                return true;
+            }
+        } else if ((ring->res == FR_OK) && (ring->count >= FILE_RING_CHUNK_SIZE)) {
+            // Errors are reported by the next call on the Python side.
+            ring->res = file_ring_write_chunk(ring, FILE_RING_CHUNK_SIZE);
+            file_ring_next = next;
+            return true;
+        }
+
+        ring = (next != end) ? next : NULL;
+    }
+
+    return false;
+}
+
+void file_ring_flush(file_ring_t *ring)
+{
+    file_ring_check(ring);
+
+    while (ring->count) {
+        FRESULT res = file_ring_write_chunk(ring, FF_MIN(ring->count, FILE_RING_CHUNK_SIZE));
+        if (res != FR_OK) ff_fail(ring->fp, res);
+    }
+}
+
+void file_ring_close(file_ring_t *ring)
+{
+    file_ring_check(ring);
+    // Unlinked first so a failed write can't leave a dangling writer behind.
+    file_ring_unlink(ring);
+    if (!ring->read) file_ring_flush(ring);
+    xfree(ring->buf);
+    ring->buf = NULL;
+}
+
+void file_ring_abort(file_ring_t *ring)
+{
+    file_ring_unlink(ring);
+    ring->buf = NULL;
+    ring->count = 0;
+}
+
+void file_ring_open_read(file_ring_t *ring, FIL *fp, uint32_t size)
+{
+    file_ring_alloc(ring, fp, size, true);
+}
+
+// Copies out (or drops when data is NULL) size bytes, reading in what isn't buffered yet.
+static void file_ring_take(file_ring_t *ring, void *data, UINT size)
+{
+    file_ring_check(ring);
+
+    if ((!ring->count) && data && (size >= ring->size)) {
+        // Too big to buffer (e.g. a large frame), read in place.
+        read_data(ring->fp, data, size);
+        return;
+    }
+
+    while (size) {
+        if (!ring->count) {
+            if (f_eof(ring->fp)) ff_read_fail(ring->fp);
+            ring->head = 0;
+            FRESULT res = file_ring_read_chunk(ring);
+            if (res != FR_OK) ff_fail(ring->fp, res);
+            continue;
+        }
+
+        uint32_t can_do = FF_MIN(size, FF_MIN(ring->count, ring->size - ring->head));
+        if (data) {
+            memcpy(data, ring->buf + ring->head, can_do);
+            data += can_do;
+        }
+        ring->head = (ring->head + can_do) % ring->size;
+        ring->count -= can_do;
+        size -= can_do;
+    }
+}
+
+void file_ring_read(file_ring_t *ring, void *data, UINT size)
+{
+    file_ring_take(ring, data, size);
+}
+
+void file_ring_skip(file_ring_t *ring, UINT size)
+{
+    file_ring_take(ring, NULL, size);
+}
+
+void file_ring_seek(file_ring_t *ring, uint32_t offset)
+{
+    file_ring_check(ring);
+    ring->head = 0;
+    ring->count = 0;
+    file_seek(ring->fp, offset);
+}
@@ -9,6 +9,7 @@
 #ifndef __FF_WRAPPER_H__
 #define __FF_WRAPPER_H__
 #include <stdint.h>
+#include <stdbool.h>
 #include <ff.h>
 extern const char *ffs_strerror(FRESULT res);
 
@@ -29,7 +30,13 @@ void file_write_open(FIL *fp, const char *path);
 void file_close(FIL *fp);
 void file_seek(FIL *fp, UINT offset);
 void file_truncate(FIL *fp);
+bool file_expand(FIL *fp, UINT size);
 void file_sync(FIL *fp);
+#define FILE_CLMT_SIZE (32) // initial fast seek table size in DWORDs (15 fragments)
+void file_fast_seek_on(FIL *fp); // does xalloc, freed by file_close
+
+// Reads/writes of at least this many bytes bypass the file buffer.
+#define FILE_BULK_SIZE (32*1024)
 
 // File buffer functions.
 void file_buffer_init0();
@@ -51,4 +58,34 @@ void write_byte(FIL *fp, uint8_t value);
 void write_word(FIL *fp, uint16_t value);
 void write_long(FIL *fp, uint32_t value);
 void write_data(FIL *fp, const void *data, UINT size);
+
+// Deferred writer functions, data is queued in a heap ring buffer and written out in
+// aligned FILE_RING_CHUNK_SIZE chunks by file_ring_poll() (called while waiting for frames).
+// Using a ring after file_ring_close() or file_ring_abort() raises OSError.
+#define FILE_RING_CHUNK_SIZE (32*1024)
+typedef struct file_ring {
+    struct file_ring *next;
+    FIL *fp;
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;
+    uint32_t count;
+    FRESULT res; // Result of the last deferred write (or read-ahead).
+    bool read;
+} file_ring_t;
+void file_ring_init0();
+void file_ring_open(file_ring_t *ring, FIL *fp, uint32_t size); // does xalloc
+void file_ring_write(file_ring_t *ring, const void *data, UINT size);
+uint32_t file_ring_tell(file_ring_t *ring); // file position including queued (or minus read-ahead) data
+bool file_ring_poll(); // writes at most one chunk, returns false if idle
+void file_ring_flush(file_ring_t *ring); // writes everything, including a partial chunk
+void file_ring_close(file_ring_t *ring); // flushes (writers) and does xfree (doesn't close the file)
+void file_ring_abort(file_ring_t *ring); // drops queued data (for finalizers)
+
+// Read-ahead functions, the ring is filled from the file position by file_ring_poll() in aligned
+// FILE_RING_CHUNK_SIZE chunks (so FatFS reads straight into it) and drained by the reader.
+void file_ring_open_read(file_ring_t *ring, FIL *fp, uint32_t size); // does xalloc, close with file_ring_close
+void file_ring_read(file_ring_t *ring, void *data, UINT size);
+void file_ring_skip(file_ring_t *ring, UINT size);
+void file_ring_seek(file_ring_t *ring, uint32_t offset); // drops the read-ahead data
 #endif /* __FF_WRAPPER_H__ */
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Per-frame timing breakdown.
+ *
+ * Counters accumulate DWT cycles during a frame, converted to 1/16 us when they're added so
+ * that the CPU clock can change between them. Python time is what's left of the frame.
+ */
+#include <string.h>
+#include STM32_HAL_H
+#include "py/mphal.h"
+#include "frame_stats.h"
+
+#define FRAME_STATS_SHIFT   (4)
+
+static uint32_t frame_start;
+static uint32_t frame_lines;
+static uint32_t counters[FRAME_STATS_COUNTERS];
+static frame_stats_t frame_stats;
+
+void frame_stats_init0()
+{
+    // Enable the cycle counter.
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        #if (__CORTEX_M == 7U)
+        DWT->LAR = 0xC5ACCE55;
+        #endif
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    memset(counters, 0, sizeof(counters));
+    memset(&frame_stats, 0, sizeof(frame_stats));
+    frame_lines = 0;
+    frame_start = mp_hal_ticks_us();
+}
+
+uint32_t frame_stats_start()
+{
+    return DWT->CYCCNT;
+}
+
+void frame_stats_add(frame_stats_counter_t counter, uint32_t start)
+{
+    counters[counter] += ((DWT->CYCCNT - start) << FRAME_STATS_SHIFT) / (SystemCoreClock / 1000000);
+    if (counter == FRAME_STATS_LINE) {
+        frame_lines += 1;
+    }
+}
+
+void frame_stats_add_us(frame_stats_counter_t counter, uint32_t us)
+{
+    counters[counter] += us << FRAME_STATS_SHIFT;
+}
+
+uint32_t frame_stats_us(frame_stats_counter_t counter)
+{
+    return counters[counter] >> FRAME_STATS_SHIFT;
+}
+
+void frame_stats_frame()
+{
+    uint32_t now = mp_hal_ticks_us();
+
+    // The line ISRs may run during capture or in the background, they're not subtracted.
+    uint32_t frame = now - frame_start;
+    uint32_t other = (counters[FRAME_STATS_CAPTURE] + counters[FRAME_STATS_JPEG] + counters[FRAME_STATS_GC]) >> FRAME_STATS_SHIFT;
+
+    frame_stats.frame_us = frame;
+    frame_stats.capture_us = counters[FRAME_STATS_CAPTURE] >> FRAME_STATS_SHIFT;
+    frame_stats.line_us = counters[FRAME_STATS_LINE] >> FRAME_STATS_SHIFT;
+    frame_stats.jpeg_us = counters[FRAME_STATS_JPEG] >> FRAME_STATS_SHIFT;
+    frame_stats.gc_us = counters[FRAME_STATS_GC] >> FRAME_STATS_SHIFT;
+    frame_stats.python_us = (frame > other) ? (frame - other) : 0;
+    frame_stats.lines = frame_lines;
+
+    memset(counters, 0, sizeof(counters));
+    frame_lines = 0;
+    frame_start = now;
+}
+
+const frame_stats_t *frame_stats_get()
+{
+    return &frame_stats;
+}
@@ -0,0 +1,42 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Per-frame timing breakdown.
+ */
+#ifndef __FRAME_STATS_H__
+#define __FRAME_STATS_H__
+#include <stdint.h>
+typedef enum {
+    FRAME_STATS_CAPTURE,    // Waiting for the sensor in sensor_snapshot() (exposure and readout).
+    FRAME_STATS_LINE,       // DCMI line ISRs (these run while waiting for the sensor).
+    FRAME_STATS_JPEG,       // IDE preview compression.
+    FRAME_STATS_GC,         // Garbage collection.
+    FRAME_STATS_COUNTERS
+} frame_stats_counter_t;
+typedef struct frame_stats {
+    uint32_t frame_us;      // Time between the last two frames.
+    uint32_t capture_us;
+    uint32_t line_us;
+    uint32_t jpeg_us;
+    uint32_t gc_us;
+    uint32_t python_us;     // Everything else (frame - capture - jpeg - gc).
+    uint32_t lines;         // Number of line ISRs.
+} frame_stats_t;
+void frame_stats_init0();
+// Returns the cycle counter, pass it to frame_stats_add() to add the time since to a counter.
+// The CPU clock must not change in between, use frame_stats_add_us() otherwise.
+uint32_t frame_stats_start();
+void frame_stats_add(frame_stats_counter_t counter, uint32_t start);
+void frame_stats_add_us(frame_stats_counter_t counter, uint32_t us);
+// Time added to a counter during the current frame.
+uint32_t frame_stats_us(frame_stats_counter_t counter);
+// Called once per frame, before the next frame is captured.
+void frame_stats_frame();
+// Returns the breakdown of the last frame.
+const frame_stats_t *frame_stats_get();
+#endif // __FRAME_STATS_H__
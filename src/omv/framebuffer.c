@@ -8,10 +8,27 @@
  *
  * Framebuffer functions.
  */
+#include STM32_HAL_H
 #include "mpprint.h"
 #include "framebuffer.h"
+#include "fb_alloc.h"
+#include "trace.h"
+#include "frame_stats.h"
 #include "omv_boardconfig.h"
 
+// With a bandwidth budget set the preview is rate limited to the budget, and its
+// quality and then resolution are lowered until a frame fits in 1/FB_PREVIEW_MIN_FPS
+// of the budget.
+#define FB_PREVIEW_MIN_FPS      (10)
+#define FB_PREVIEW_MIN_QUALITY  (20)
+#define FB_PREVIEW_MAX_SCALE    (8)
+
+// Max preview FPS when the preview is compressed while waiting for the sensor.
+#define FB_PREVIEW_MAX_FPS      (20)
+
+// Characters printed at once by fb_print_for_ide().
+#define FB_PRINT_FOR_IDE_CHUNK  (256)
+
 extern char _fb_base;
 framebuffer_t *fb_framebuffer = (framebuffer_t *) &_fb_base;
 
@@ -33,38 +50,47 @@ int fb_encode_for_ide_new_size(image_t *img)
     return (((img->bpp * 8) + 5) / 6) + 2;
 }
 
+// Encodes 3 bytes as 4 characters of 6 bits (2 bytes as 3 and 1 byte as 2), returns the count.
+static int fb_encode_for_ide_bytes(uint8_t *ptr, const uint8_t *data, int n)
+{
+    int x = data[0] | ((n > 1) ? (data[1] << 8) : 0) | ((n > 2) ? (data[2] << 16) : 0);
+
+    for (int i = 0; i <= n; i++, x >>= 6) {
+        *ptr++ = 0x80 | (x & 0x3F);
+    }
+
+    return n + 1;
+}
+
 void fb_encode_for_ide(uint8_t *ptr, image_t *img)
 {
     *ptr++ = 0xFE;
 
-    for(int i = 0, j = (img->bpp / 3) * 3; i < j; i += 3) {
-        int x = 0;
-        x |= img->data[i + 0] << 0;
-        x |= img->data[i + 1] << 8;
-        x |= img->data[i + 2] << 16;
-        *ptr++ = 0x80 | ((x >> 0) & 0x3F);
-        *ptr++ = 0x80 | ((x >> 6) & 0x3F);
-        *ptr++ = 0x80 | ((x >> 12) & 0x3F);
-        *ptr++ = 0x80 | ((x >> 18) & 0x3F);
+    for (int i = 0; i < img->bpp; i += 3) {
+        ptr += fb_encode_for_ide_bytes(ptr, img->data + i, IM_MIN(img->bpp - i, 3));
     }
 
-    if((img->bpp % 3) == 2) { // 2 bytes -> 16-bits -> 24-bits sent
-        int x = 0;
-        x |= img->data[img->bpp - 2] << 0;
-        x |= img->data[img->bpp - 1] << 8;
-        *ptr++ = 0x80 | ((x >> 0) & 0x3F);
-        *ptr++ = 0x80 | ((x >> 6) & 0x3F);
-        *ptr++ = 0x80 | ((x >> 12) & 0x3F);
-    }
+    *ptr++ = 0xFE;
+}
 
-    if((img->bpp % 3) == 1) { // 1 byte -> 8-bits -> 16-bits sent
-        int x = 0;
-        x |= img->data[img->bpp - 1] << 0;
-        *ptr++ = 0x80 | ((x >> 0) & 0x3F);
-        *ptr++ = 0x80 | ((x >> 6) & 0x3F);
+void fb_print_for_ide(image_t *img)
+{
+    uint8_t buf[FB_PRINT_FOR_IDE_CHUNK];
+    int len = 0;
+    buf[len++] = 0xFE;
+
+    for (int i = 0; i < img->bpp; i += 3) {
+        len += fb_encode_for_ide_bytes(buf + len, img->data + i, IM_MIN(img->bpp - i, 3));
+
+        // Room for 4 more characters (or the end marker).
+        if (len > (FB_PRINT_FOR_IDE_CHUNK - 5)) {
+            (MP_PYTHON_PRINTER)->print_strn((MP_PYTHON_PRINTER)->data, (const char *) buf, len);
+            len = 0;
+        }
     }
 
-    *ptr++ = 0xFE;
+    buf[len++] = 0xFE;
+    (MP_PYTHON_PRINTER)->print_strn((MP_PYTHON_PRINTER)->data, (const char *) buf, len);
 }
 
 uint32_t fb_buffer_size()
@@ -88,70 +114,357 @@ uint32_t fb_buffer_size()
     }
 }
 
-void fb_update_jpeg_buffer()
+uint32_t fb_buffers_size()
+{
+    uint32_t size = fb_buffer_size();
+
+    if (MAIN_FB()->buf_size) {
+        // All buffers in the ring are reserved while multi-buffering is active, the
+        // current frame may also have been grown in place past its own buffer.
+        size = IM_MAX(size + (MAIN_FB()->head * MAIN_FB()->buf_size),
+                      MAIN_FB()->n_buffers * MAIN_FB()->buf_size);
+    }
+
+    return size;
+}
+
+// Nearest neighbour decimation for the IDE preview.
+static void fb_downscale(image_t *src, image_t *dst, int scale)
+{
+    for (int y = 0; y < dst->h; y++) {
+        if (src->bpp == IMAGE_BPP_GRAYSCALE) {
+            uint8_t *src_row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y * scale);
+            uint8_t *dst_row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y);
+            for (int x = 0; x < dst->w; x++) {
+                dst_row[x] = src_row[x * scale];
+            }
+        } else {
+            uint16_t *src_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y * scale);
+            uint16_t *dst_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y);
+            for (int x = 0; x < dst->w; x++) {
+                dst_row[x] = src_row[x * scale];
+            }
+        }
+    }
+}
+
+static int overflow_count = 0;
+static int preview_scale = 1;
+static uint32_t credit = 0, credit_ticks = 0, preview_size = 0;
+static uint32_t preview_ticks = 0;
+
+// Deferred preview state, the staged frame is stored at the end of the slot being written.
+static bool staged = false;
+static image_t staged_image;
+static uint32_t staged_size; // Frame buffer size of the frame before downscaling.
+
+// The slot being written (index + 1, 0 == none), the number of the last published frame and
+// of the last frame taken by each reader.
+static int writing = 0;
+static uint32_t frame_seq = 0;
+static uint32_t seen_seq[JPEG_FB_READERS];
+
+void fb_init0()
+{
+    // A script interrupted while writing or staging a frame leaves the slot taken.
+    staged = false;
+    writing = 0;
+}
+
+static bool fb_jpeg_slot_held(int slot)
+{
+    for (int i = 0; i < JPEG_FB_READERS; i++) {
+        if (JPEG_FB()->held[i] == slot) {
+            return true;
+        }
+    }
+    return false;
+}
+
+jpegbuffer_frame_t *fb_begin_jpeg_frame()
+{
+    if (writing) {
+        return NULL;
+    }
+
+    for (int slot = 1; slot <= OMV_JPEG_BUF_SLOTS; slot++) {
+        if ((slot != JPEG_FB()->published) && (!fb_jpeg_slot_held(slot))) {
+            writing = slot;
+            return JPEG_FB_FRAME(slot - 1);
+        }
+    }
+
+    // With fewer slots than readers + 2 only the published slot may be free, it's taken back
+    // unless a reader takes it first (readers can't take it once it's not published).
+    int slot = JPEG_FB()->published;
+    if (slot && (!fb_jpeg_slot_held(slot))) {
+        JPEG_FB()->published = 0;
+        __DMB();
+        if (!fb_jpeg_slot_held(slot)) {
+            writing = slot;
+            return JPEG_FB_FRAME(slot - 1);
+        }
+        JPEG_FB()->published = slot;
+    }
+
+    return NULL;
+}
+
+void fb_end_jpeg_frame(jpegbuffer_frame_t *frame)
+{
+    if (frame->size) {
+        frame->seq = ++frame_seq;
+        // The frame must be complete before it's published.
+        __DMB();
+        JPEG_FB()->published = writing;
+    }
+    writing = 0;
+}
+
+jpegbuffer_frame_t *fb_acquire_jpeg_frame(jpeg_fb_reader_t reader)
 {
-    static int overflow_count = 0;
+    fb_release_jpeg_frame(reader);
+
+    int slot = JPEG_FB()->published;
+    if (!slot) {
+        return NULL;
+    }
+
+    // The writer skips the slot from now on (the IDE reader runs from the USB IRQ).
+    JPEG_FB()->held[reader] = slot;
+    __DMB();
+
+    jpegbuffer_frame_t *frame = JPEG_FB_FRAME(slot - 1);
+    if (frame->seq == seen_seq[reader]) {
+        fb_release_jpeg_frame(reader);
+        return NULL;
+    }
+
+    seen_seq[reader] = frame->seq;
+    return frame;
+}
 
+void fb_release_jpeg_frame(jpeg_fb_reader_t reader)
+{
+    __DMB();
+    JPEG_FB()->held[reader] = 0;
+}
+
+// Returns the slot to write the current frame to, the staged frame's slot is reused.
+static jpegbuffer_frame_t *fb_writer_jpeg_frame()
+{
+    if (staged) {
+        // This frame replaces the staged one.
+        staged = false;
+        return JPEG_FB_FRAME(writing - 1);
+    }
+    return fb_begin_jpeg_frame();
+}
+
+// Returns false if the bandwidth budget can't pay for another frame yet.
+static bool fb_preview_credit()
+{
+    uint32_t budget = JPEG_FB()->budget;
+    if (budget) {
+        // Refill the budget (at most one second worth of it), and don't spend any
+        // time compressing frames that the budget can't pay for yet.
+        uint32_t ticks = HAL_GetTick();
+        credit = IM_MIN(budget, credit + ((uint64_t) budget * (ticks - credit_ticks) / 1000));
+        credit_ticks = ticks;
+        if (credit < IM_MIN(preview_size, budget)) {
+            return false;
+        }
+    } else {
+        preview_scale = 1;
+    }
+    return true;
+}
+
+// Compresses src to the start of the frame (which is then published), and adapts
+// the quality and preview scale for the next frame.
+static void fb_compress_jpeg_buffer(jpegbuffer_frame_t *frame, image_t *src, uint32_t dst_size, uint32_t src_size)
+{
+    uint32_t budget = JPEG_FB()->budget;
+    image_t dst = {.w=src->w, .h=src->h, .bpp=dst_size, .pixels=frame->pixels};
+
+    // Note: lower quality saves USB bandwidth and results in a faster IDE FPS.
+    TRACE_BEGIN(TRACE_EVENT_JPEG, 0);
+    uint32_t start = frame_stats_start();
+    bool overflow = jpeg_compress(src, &dst, JPEG_FB()->quality, false);
+    frame_stats_add(FRAME_STATS_JPEG, start);
+    TRACE_END(TRACE_EVENT_JPEG, overflow ? 0 : dst.bpp);
+
+    if (overflow == true) {
+        // JPEG buffer overflowed, reduce JPEG quality for the next frame
+        // and skip the current frame. The IDE doesn't receive this frame.
+        if (JPEG_FB()->quality > 1) {
+            // Keep this quality for the next n frames
+            overflow_count = 60;
+            JPEG_FB()->quality = IM_MAX(1, (JPEG_FB()->quality/2));
+        }
+        frame->w = 0; frame->h = 0; frame->size = 0;
+    } else {
+        if (overflow_count) {
+            overflow_count--;
+        }
+        if (budget) {
+            uint32_t target = budget / FB_PREVIEW_MIN_FPS;
+            credit -= IM_MIN(credit, dst.bpp);
+            preview_size = dst.bpp;
+            if (dst.bpp > target) {
+                // Too big for the budget, first drop the quality then the resolution.
+                if (JPEG_FB()->quality > FB_PREVIEW_MIN_QUALITY) {
+                    JPEG_FB()->quality = IM_MAX(FB_PREVIEW_MIN_QUALITY, ((JPEG_FB()->quality*3)/4));
+                } else if (preview_scale < FB_PREVIEW_MAX_SCALE) {
+                    preview_scale *= 2;
+                }
+                overflow_count = 60;
+            } else if ((dst.bpp < (target / 4)) && (preview_scale > 1) && (overflow_count == 0)) {
+                // Doubling the resolution would still fit, restore it.
+                preview_scale /= 2;
+                overflow_count = 60;
+            }
+        }
+        // No buffer overflow, increase quality up to max quality based on frame size
+        if (overflow_count == 0 && JPEG_FB()->quality
+               < ((src_size > JPEG_QUALITY_THRESH) ? JPEG_QUALITY_LOW:JPEG_QUALITY_HIGH)) {
+            JPEG_FB()->quality++;
+        }
+        // Set FB from JPEG image
+        frame->w = dst.w; frame->h = dst.h; frame->size = dst.bpp;
+        frame->bpp = 0;
+    }
+
+    fb_end_jpeg_frame(frame);
+}
+
+void fb_update_jpeg_buffer()
+{
     if (MAIN_FB()->streaming_enabled && JPEG_FB()->enabled) {
         if (MAIN_FB()->bpp > 3) {
-            bool does_not_fit = false;
-            // Lock FB
-            if (mutex_try_lock(&JPEG_FB()->lock, MUTEX_TID_OMV)) {
-                if((OMV_JPEG_BUF_SIZE-64) < MAIN_FB()->bpp) {
+            if (JPEG_FB_FRAME_SIZE < MAIN_FB()->bpp) {
+                // Sent from the frame buffer as is, sensor JPEG frames can be megabytes.
+                image_t out = { .w=MAIN_FB()->w, .h=MAIN_FB()->h, .bpp=MAIN_FB()->bpp, .data=MAIN_FB_BUFFER() };
+                fb_print_for_ide(&out);
+                return;
+            }
+
+            jpegbuffer_frame_t *frame = fb_writer_jpeg_frame();
+            if (frame) {
+                memcpy(frame->pixels, MAIN_FB_BUFFER(), MAIN_FB()->bpp);
+                frame->w = MAIN_FB()->w; frame->h = MAIN_FB()->h; frame->size = MAIN_FB()->bpp;
+                frame->bpp = 0;
+                fb_end_jpeg_frame(frame);
+            }
+        } else if (JPEG_FB()->raw && (MAIN_FB()->bpp >= IMAGE_BPP_GRAYSCALE)) {
+            // Lossless frames, copied as is (no rate limit or budget).
+            uint32_t size = fb_buffer_size();
+            jpegbuffer_frame_t *frame = fb_writer_jpeg_frame();
+            if (frame) {
+                if (JPEG_FB_FRAME_SIZE < size) {
                     // image won't fit. so don't copy.
-                    JPEG_FB()->w = 0; JPEG_FB()->h = 0; JPEG_FB()->size = 0;
-                    does_not_fit = true;
+                    frame->w = 0; frame->h = 0; frame->size = 0;
                 } else {
-                    memcpy(JPEG_FB()->pixels, MAIN_FB()->pixels, MAIN_FB()->bpp);
-                    JPEG_FB()->w = MAIN_FB()->w; JPEG_FB()->h = MAIN_FB()->h; JPEG_FB()->size = MAIN_FB()->bpp;
+                    memcpy(frame->pixels, MAIN_FB_BUFFER(), size);
+                    frame->w = MAIN_FB()->w; frame->h = MAIN_FB()->h; frame->size = size;
+                    frame->bpp = MAIN_FB()->bpp;
                 }
-
-                // Unlock the framebuffer mutex
-                mutex_unlock(&JPEG_FB()->lock, MUTEX_TID_OMV);
-            }
-            if (does_not_fit) {
-                image_t out = { .w=MAIN_FB()->w, .h=MAIN_FB()->h, .bpp=MAIN_FB()->bpp, .data=MAIN_FB()->pixels };
-                int new_size = fb_encode_for_ide_new_size(&out);
-                fb_alloc_mark();
-                uint8_t *temp = fb_alloc(new_size, FB_ALLOC_NO_HINT);
-                fb_encode_for_ide(temp, &out);
-                (MP_PYTHON_PRINTER)->print_strn((MP_PYTHON_PRINTER)->data, (const char *) temp, new_size);
-                fb_alloc_free_till_mark();
+                fb_end_jpeg_frame(frame);
             }
         } else if (MAIN_FB()->bpp >= 0) {
-            // Lock FB
-            if (mutex_try_lock(&JPEG_FB()->lock, MUTEX_TID_OMV)) {
-                // Set JPEG src and dst images.
-                image_t src = {.w=MAIN_FB()->w, .h=MAIN_FB()->h, .bpp=MAIN_FB()->bpp,     .pixels=MAIN_FB()->pixels};
-                image_t dst = {.w=MAIN_FB()->w, .h=MAIN_FB()->h, .bpp=(OMV_JPEG_BUF_SIZE-64),  .pixels=JPEG_FB()->pixels};
-
-                // Note: lower quality saves USB bandwidth and results in a faster IDE FPS.
-                bool overflow = jpeg_compress(&src, &dst, JPEG_FB()->quality, false);
-                if (overflow == true) {
-                    // JPEG buffer overflowed, reduce JPEG quality for the next frame
-                    // and skip the current frame. The IDE doesn't receive this frame.
-                    if (JPEG_FB()->quality > 1) {
-                        // Keep this quality for the next n frames
-                        overflow_count = 60;
-                        JPEG_FB()->quality = IM_MAX(1, (JPEG_FB()->quality/2));
-                    }
-                    JPEG_FB()->w = 0; JPEG_FB()->h = 0; JPEG_FB()->size = 0;
-                } else {
-                    if (overflow_count) {
-                        overflow_count--;
-                    }
-                    // No buffer overflow, increase quality up to max quality based on frame size
-                    if (overflow_count == 0 && JPEG_FB()->quality
-                           < ((fb_buffer_size() > JPEG_QUALITY_THRESH) ? JPEG_QUALITY_LOW:JPEG_QUALITY_HIGH)) {
-                        JPEG_FB()->quality++;
+            if (!fb_preview_credit()) {
+                return;
+            }
+
+            jpegbuffer_frame_t *frame = fb_writer_jpeg_frame();
+            if (frame) {
+                // Set JPEG src image.
+                image_t src = {.w=MAIN_FB()->w, .h=MAIN_FB()->h, .bpp=MAIN_FB()->bpp, .pixels=MAIN_FB_BUFFER()};
+
+                // Only downscale if fb_alloc() can't fail.
+                bool downscaled = false;
+                if ((preview_scale > 1) && ((src.bpp == IMAGE_BPP_GRAYSCALE) || (src.bpp == IMAGE_BPP_RGB565))) {
+                    image_t preview = {.w=src.w/preview_scale, .h=src.h/preview_scale, .bpp=src.bpp};
+                    if ((image_size(&preview) + (2 * sizeof(uint32_t))) < fb_avail()) {
+                        fb_alloc_mark();
+                        preview.pixels = fb_alloc(image_size(&preview), FB_ALLOC_NO_HINT);
+                        fb_downscale(&src, &preview, preview_scale);
+                        src = preview;
+                        downscaled = true;
                     }
-                    // Set FB from JPEG image
-                    JPEG_FB()->w = dst.w; JPEG_FB()->h = dst.h; JPEG_FB()->size = dst.bpp;
                 }
 
-                // Unlock the framebuffer mutex
-                mutex_unlock(&JPEG_FB()->lock, MUTEX_TID_OMV);
+                fb_compress_jpeg_buffer(frame, &src, JPEG_FB_FRAME_SIZE, fb_buffer_size());
+
+                if (downscaled) {
+                    fb_alloc_free_till_mark();
+                }
             }
         }
     }
 }
+
+void fb_defer_jpeg_buffer()
+{
+    if (!(MAIN_FB()->streaming_enabled && JPEG_FB()->enabled)) {
+        return;
+    }
+
+    // JPEG and raw frames are only copied, and binary/bayer frames are never downscaled.
+    if (JPEG_FB()->raw || ((MAIN_FB()->bpp != IMAGE_BPP_GRAYSCALE) && (MAIN_FB()->bpp != IMAGE_BPP_RGB565))) {
+        fb_update_jpeg_buffer();
+        return;
+    }
+
+    // Rate limit the preview, frames in between are not sent to the IDE.
+    uint32_t ticks = HAL_GetTick();
+    if ((ticks - preview_ticks) < (1000 / FB_PREVIEW_MAX_FPS)) {
+        return;
+    }
+
+    if (!fb_preview_credit()) {
+        return;
+    }
+
+    // Compress the last staged frame if it wasn't compressed yet.
+    fb_poll_jpeg_buffer();
+
+    image_t src = {.w=MAIN_FB()->w, .h=MAIN_FB()->h, .bpp=MAIN_FB()->bpp, .pixels=MAIN_FB_BUFFER()};
+    image_t preview = {.w=src.w/preview_scale, .h=src.h/preview_scale, .bpp=src.bpp};
+
+    // Leave at least as much space for the JPEG image as for the staged frame,
+    // otherwise compress the frame right away.
+    uint32_t size = (image_size(&preview) + 31) & ~31;
+    if ((size * 2) > (JPEG_FB_FRAME_SIZE & ~31)) {
+        fb_update_jpeg_buffer();
+        return;
+    }
+
+    // The slot is kept (not published) until the staged frame is compressed.
+    jpegbuffer_frame_t *frame = fb_begin_jpeg_frame();
+    if (frame) {
+        preview.pixels = frame->pixels + (JPEG_FB_FRAME_SIZE & ~31) - size;
+        if (preview_scale > 1) {
+            fb_downscale(&src, &preview, preview_scale);
+        } else {
+            memcpy(preview.pixels, src.pixels, image_size(&preview));
+        }
+
+        staged_image = preview;
+        staged_size = image_size(&src);
+        staged = true;
+        preview_ticks = ticks;
+    }
+}
+
+bool fb_poll_jpeg_buffer()
+{
+    if (!staged) {
+        return false;
+    }
+
+    staged = false;
+    jpegbuffer_frame_t *frame = JPEG_FB_FRAME(writing - 1);
+    fb_compress_jpeg_buffer(frame, &staged_image, staged_image.pixels - frame->pixels, staged_size);
+    return true;
+}
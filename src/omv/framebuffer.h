@@ -12,7 +12,7 @@
 #define __FRAMEBUFFER_H__
 #include <stdint.h>
 #include "imlib.h"
-#include "mutex.h"
+#include "omv_boardconfig.h"
 
 typedef struct framebuffer {
     int32_t x,y;
@@ -20,18 +20,47 @@ typedef struct framebuffer {
     int32_t u,v;
     int32_t bpp;
     int32_t streaming_enabled;
+    int32_t n_buffers;  // Number of frame buffers (0 or 1 == single buffer mode).
+    int32_t buf_size;   // Size of each frame buffer, non-zero only when multi-buffering is active.
+    int32_t head;       // Index of the frame buffer owned by the user (returned by snapshot).
+    int32_t tail;       // Index of the frame buffer the DMA is writing to (-1 when none is free).
+    uint32_t timestamp; // Frame start (VSYNC) time in microseconds, same clock as utime.ticks_us().
+    uint32_t frame_count; // Frame sequence number, counts all the frames sent by the sensor.
+    int32_t reserved[2];
     // NOTE: This buffer must be aligned on a 16 byte boundary
     uint8_t pixels[];
 } framebuffer_t;
 
 extern framebuffer_t *fb_framebuffer;
 
-typedef struct jpegbuffer {
+// An IDE preview frame, each slot of the JPEG frame buffer starts with one.
+typedef struct jpegbuffer_frame {
     int32_t w,h;
     int32_t size;
+    int32_t bpp;    // Frame format, 0 for JPEG otherwise the raw frame bpp.
+    uint32_t seq;   // Frame number, readers skip the frames they've already seen.
+    int32_t reserved[3];
+    uint8_t pixels[];
+} jpegbuffer_frame_t;
+
+// The readers of the preview frames.
+typedef enum {
+    JPEG_FB_READER_IDE,
+    JPEG_FB_READER_NET,
+    JPEG_FB_READERS,
+} jpeg_fb_reader_t;
+
+// The preview is handed off through OMV_JPEG_BUF_SLOTS slots without locks: the script writes
+// to a slot that's neither published nor held by a reader and then publishes it, and a reader
+// takes the published (newest complete) slot and holds it until it's done with it. With three
+// slots and one reader the script never waits and the reader always gets the newest frame.
+typedef struct jpegbuffer {
     int32_t enabled;
     int32_t quality;
-    mutex_t lock;
+    int32_t budget; // IDE bandwidth budget in bytes per second (0 == unlimited).
+    int32_t raw;    // Send uncompressed grayscale/RGB565/bayer frames to the IDE.
+    volatile int32_t published; // Slot index + 1 of the newest frame (0 == none).
+    volatile int32_t held[JPEG_FB_READERS]; // Slot index + 1 held by each reader (0 == none).
     uint8_t pixels[];
 } jpegbuffer_t;
 
@@ -41,11 +70,23 @@ extern jpegbuffer_t *jpeg_fb_framebuffer;
 #define MAIN_FB()           (fb_framebuffer)
 #define JPEG_FB()           (jpeg_fb_framebuffer)
 
-// Use this macro to get a pointer to the free SRAM area located after the framebuffer.
-#define MAIN_FB_PIXELS()    (MAIN_FB()->pixels + fb_buffer_size())
+// Use this macro to get a pointer to the frame buffer that holds the current (user) frame.
+#define MAIN_FB_BUFFER()    (MAIN_FB()->pixels + (MAIN_FB()->head * MAIN_FB()->buf_size))
 
 // Use this macro to get a pointer to the free SRAM area located after the framebuffer.
-#define JPEG_FB_PIXELS()    (JPEG_FB()->pixels + JPEG_FB()->size)
+#define MAIN_FB_PIXELS()    (MAIN_FB()->pixels + fb_buffers_size())
+
+#ifndef OMV_JPEG_BUF_SLOTS
+#define OMV_JPEG_BUF_SLOTS  (3)
+#endif
+
+// The JPEG frame buffer slots, and the largest frame that fits in one.
+#define JPEG_FB_SLOT_SIZE   ((((OMV_JPEG_BUF_SIZE-64) / OMV_JPEG_BUF_SLOTS) & ~31))
+#define JPEG_FB_FRAME(i)    ((jpegbuffer_frame_t *) (JPEG_FB()->pixels + ((i) * JPEG_FB_SLOT_SIZE)))
+#define JPEG_FB_FRAME_SIZE  (JPEG_FB_SLOT_SIZE - sizeof(jpegbuffer_frame_t))
+
+// Resets the preview writer state on soft reset.
+void fb_init0();
 
 // Force fb streaming to the IDE off.
 void fb_set_streaming_enabled(bool enable);
@@ -54,10 +95,30 @@ bool fb_get_streaming_enabled();
 // Encode jpeg data for transmission over a text channel.
 int fb_encode_for_ide_new_size(image_t *img);
 void fb_encode_for_ide(uint8_t *ptr, image_t *img);
+// Same as above but printed to the terminal in small pieces, without a buffer for the whole image.
+void fb_print_for_ide(image_t *img);
 
 // Returns the main frame buffer size, factoring in pixel formats.
 uint32_t fb_buffer_size();
 
-// Transfers the frame buffer to the jpeg frame buffer if not locked.
+// Returns the size of the memory reserved for all frame buffers (multi-buffer mode).
+uint32_t fb_buffers_size();
+
+// Returns a free slot to write a frame to, or NULL if there's none (or one is being written),
+// the script is the only writer. fb_end_jpeg_frame() publishes it, or frees it if size is 0.
+jpegbuffer_frame_t *fb_begin_jpeg_frame();
+void fb_end_jpeg_frame(jpegbuffer_frame_t *frame);
+
+// Returns the newest frame the reader hasn't seen yet, or NULL. The frame is held until it's
+// released (or another one is acquired), a reader holds at most one frame.
+jpegbuffer_frame_t *fb_acquire_jpeg_frame(jpeg_fb_reader_t reader);
+void fb_release_jpeg_frame(jpeg_fb_reader_t reader);
+
+// Transfers the frame buffer to the jpeg frame buffer if there's a free slot.
 void fb_update_jpeg_buffer();
+
+// Same as above but rate limited, and the frame is only copied to the end of the
+// jpeg frame buffer, fb_poll_jpeg_buffer() compresses it later (when idle).
+void fb_defer_jpeg_buffer();
+bool fb_poll_jpeg_buffer(); // returns false if there's nothing to compress
 #endif /* __FRAMEBUFFER_H__ */
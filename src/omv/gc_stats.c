@@ -0,0 +1,111 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * GC pause statistics and between-frame collections.
+ *
+ * The firmware is linked with --wrap=gc_collect so that the collections started by the port and
+ * by OpenMV code go through __wrap_gc_collect(). The linker only redirects references that are
+ * resolved across objects, a collection MicroPython starts internally (e.g. on a failed gc_alloc()
+ * with LTO or when gc_collect() is in the same object) isn't counted here and doesn't run the
+ * large heap sweep, which then happens on the next wrapped collection.
+ */
+#include <string.h>
+#include "mp.h"
+#include "py/mphal.h"
+#include "gc_stats.h"
+#include "xalloc.h"
+#include "trace.h"
+#include "frame_stats.h"
+
+static gc_stats_t gc_stats;
+static uint32_t frame_us;
+static uint32_t budget_us;
+static uint32_t budget_threshold;
+static const uint32_t bin_limits[GC_STATS_BINS] = GC_STATS_BIN_LIMITS;
+static void *roots[GC_STATS_ROOTS];
+
+void __real_gc_collect(void);
+
+static int gc_stats_bin(uint32_t us)
+{
+    int i = 0;
+    while (us >= bin_limits[i]) {
+        i++;
+    }
+    return i;
+}
+
+void __wrap_gc_collect(void)
+{
+    TRACE_BEGIN(TRACE_EVENT_GC, 0);
+    uint32_t cycles = frame_stats_start();
+    uint32_t start = mp_hal_ticks_us();
+    // The marks are kept until the sweep, so the roots can be marked before the collection.
+    gc_collect_root(roots, GC_STATS_ROOTS);
+    __real_gc_collect();
+    xalloc_large_collect();
+    uint32_t us = mp_hal_ticks_us() - start;
+    frame_stats_add(FRAME_STATS_GC, cycles);
+    TRACE_END(TRACE_EVENT_GC, us);
+
+    gc_stats.count += 1;
+    gc_stats.total_us += us;
+    gc_stats.last_us = us;
+    gc_stats.max_us = (us > gc_stats.max_us) ? us : gc_stats.max_us;
+    gc_stats.pause_hist[gc_stats_bin(us)] += 1;
+    frame_us += us;
+}
+
+void gc_stats_init0()
+{
+    gc_stats_reset();
+    memset(roots, 0, sizeof(roots));
+    budget_us = 0;
+    budget_threshold = 0;
+}
+
+void gc_stats_reset()
+{
+    memset(&gc_stats, 0, sizeof(gc_stats));
+    frame_us = 0;
+}
+
+const gc_stats_t *gc_stats_get()
+{
+    return &gc_stats;
+}
+
+void gc_stats_set_root(gc_stats_root_t root, void *ptr)
+{
+    roots[root] = ptr;
+}
+
+void gc_stats_set_budget(uint32_t us, uint32_t threshold)
+{
+    budget_us = us;
+    budget_threshold = threshold;
+}
+
+void gc_stats_frame()
+{
+    if (budget_us) {
+        gc_info_t info;
+        gc_info(&info);
+
+        // A collection is skipped if the worst pause seen so far doesn't fit in the budget,
+        // unless the heap is nearly exhausted and one is about to happen anyway.
+        if (((info.free * 100) < (info.total * budget_threshold))
+        && ((gc_stats.max_us <= budget_us) || ((info.free * 100) < (info.total * 5)))) {
+            gc_collect();
+            gc_stats.frame_count += 1;
+        }
+    }
+
+    gc_stats.frame_hist[gc_stats_bin(frame_us)] += 1;
+    frame_us = 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * GC pause statistics and between-frame collections.
+ */
+#ifndef __GC_STATS_H__
+#define __GC_STATS_H__
+#include <stdint.h>
+#include <stdbool.h>
+// Histogram bins, upper bounds in microseconds (the last bin is open ended).
+#define GC_STATS_BINS       (6)
+#define GC_STATS_BIN_LIMITS {1000, 2000, 5000, 10000, 20000, UINT32_MAX}
+typedef struct gc_stats {
+    uint32_t count;     // Number of collections.
+    uint32_t frame_count;   // Number of collections run between frames.
+    uint32_t total_us;  // Total time spent collecting.
+    uint32_t max_us;    // Longest pause.
+    uint32_t last_us;   // Most recent pause.
+    uint32_t pause_hist[GC_STATS_BINS]; // Pause durations.
+    uint32_t frame_hist[GC_STATS_BINS]; // GC time per frame.
+} gc_stats_t;
+// Objects that are only referenced from C state the GC doesn't scan, like a buffer an interrupt
+// handler writes to. They're marked by every collection that goes through __wrap_gc_collect().
+typedef enum gc_stats_root {
+    GC_STATS_ROOT_SENSOR_PLANE,
+    GC_STATS_ROOTS,
+} gc_stats_root_t;
+void gc_stats_init0();
+// Sets (or clears with NULL) a root, the roots are cleared on soft reset.
+void gc_stats_set_root(gc_stats_root_t root, void *ptr);
+void gc_stats_reset();
+const gc_stats_t *gc_stats_get();
+// Runs a collection between frames when the free heap drops below threshold percent and the
+// expected pause (the longest seen so far) fits within budget_us. A budget of 0 disables it.
+void gc_stats_set_budget(uint32_t budget_us, uint32_t threshold);
+// Called once per frame, before the next frame is captured.
+void gc_stats_frame();
+#endif // __GC_STATS_H__
@@ -18,6 +18,10 @@
 #include "systick.h"
 #include "omv_boardconfig.h"
 #define HIMAX_BOOT_RETRY        (10)
+#define HIMAX_LINE_LEN_PCK      (0x178) // LINE_LEN_PCK of the register table.
+#define HIMAX_FRAME_LEN_LINES   (0x216) // FRAME_LEN_LINES of the register table.
+#define HIMAX_PCLK_MHZ          (OMV_XCLK_FREQUENCY / 1000000)
+#define HIMAX_MAX_AGAIN         (3)     // 2^3 = 8x analog gain.
 
 #if (OMV_ENABLE_HM01B0 == 1)
 static const uint16_t default_regs[][2] = {
@@ -198,6 +202,125 @@ static int set_vflip(sensor_t *sensor, int enable)
     return ret;
 }
 
+static int set_auto_gain(sensor_t *sensor, int enable, float gain_db, float gain_db_ceiling)
+{
+    // The AE controls both the integration time and the gain (bit 0 enables it).
+    return cambus_writeb2(&sensor->i2c, sensor->slv_addr, AE_CTRL, (enable != 0));
+}
+
+static int get_gain_db(sensor_t *sensor, float *gain_db)
+{
+    uint8_t again, dgain_h, dgain_l;
+    int ret = cambus_readb2(&sensor->i2c, sensor->slv_addr, ANALOG_GAIN, &again);
+    ret |= cambus_readb2(&sensor->i2c, sensor->slv_addr, DIGITAL_GAIN_H, &dgain_h);
+    ret |= cambus_readb2(&sensor->i2c, sensor->slv_addr, DIGITAL_GAIN_L, &dgain_l);
+
+    // Analog gain 2^again, digital gain in 2.6 fixed point.
+    float gain = (1 << ((again >> 4) & 0x7)) * ((((dgain_h & 0x3) << 6) | (dgain_l >> 2)) / 64.0f);
+    *gain_db = 20.0 * (fast_log(IM_MAX(gain, 1.0f / 64.0f)) / fast_log(10.0));
+    return ret;
+}
+
+static int set_auto_exposure(sensor_t *sensor, int enable, int exposure_us)
+{
+    int ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, AE_CTRL, (enable != 0));
+
+    if ((enable == 0) && (exposure_us >= 0)) {
+        int lines = IM_MAX(IM_MIN((exposure_us * HIMAX_PCLK_MHZ) / HIMAX_LINE_LEN_PCK, HIMAX_FRAME_LEN_LINES - 2), 2);
+        ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, INTEGRATION_H, (lines >> 8));
+        ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, INTEGRATION_L, (lines & 0xff));
+        ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, GRP_PARAM_HOLD, 0x01);
+    }
+
+    return ret;
+}
+
+static int get_exposure_us(sensor_t *sensor, int *exposure_us)
+{
+    uint8_t lines_h, lines_l;
+    int ret = cambus_readb2(&sensor->i2c, sensor->slv_addr, INTEGRATION_H, &lines_h);
+    ret |= cambus_readb2(&sensor->i2c, sensor->slv_addr, INTEGRATION_L, &lines_l);
+
+    *exposure_us = (((lines_h << 8) | lines_l) * HIMAX_LINE_LEN_PCK) / HIMAX_PCLK_MHZ;
+    return ret;
+}
+
+// Native AE, the new values are latched together at the start of the next frame.
+static int set_exposure_gain(sensor_t *sensor, int exposure_us, float gain_db)
+{
+    int lines = IM_MAX(IM_MIN((exposure_us * HIMAX_PCLK_MHZ) / HIMAX_LINE_LEN_PCK, HIMAX_FRAME_LEN_LINES - 2), 2);
+
+    // Analog gain first (in powers of 2), the rest is digital gain (up to 4x in 2.6 fixed point).
+    float gain = fast_expf((gain_db / 20.0) * fast_log(10.0));
+    int again = IM_MAX(IM_MIN(fast_floorf(fast_log2(IM_MAX(gain, 1.0f))), HIMAX_MAX_AGAIN), 0);
+    int dgain = IM_MAX(IM_MIN(fast_roundf((gain / (1 << again)) * 64.0f), 0xFF), 0x40);
+
+    int ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, INTEGRATION_H, (lines >> 8));
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, INTEGRATION_L, (lines & 0xff));
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, ANALOG_GAIN, (again << 4));
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, DIGITAL_GAIN_H, (dgain >> 6));
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, DIGITAL_GAIN_L, ((dgain & 0x3F) << 2));
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, GRP_PARAM_HOLD, 0x01);
+    return ret;
+}
+
+static int ioctl(sensor_t *sensor, int request, va_list ap)
+{
+    int ret = 0;
+    uint8_t reg;
+
+    switch (request) {
+        case IOCTL_HIMAX_MD_ENABLE: {
+            uint32_t enable = va_arg(ap, uint32_t);
+            ret  = cambus_readb2(&sensor->i2c, sensor->slv_addr, MD_CTRL, &reg);
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_CTRL, HIMAX_SET_MD_ENABLE(reg, (enable != 0)));
+            break;
+        }
+        case IOCTL_HIMAX_MD_WINDOW: {
+            // The window is given as x, y, w, h and programmed as start/end coordinates.
+            int x1 = va_arg(ap, int);
+            int y1 = va_arg(ap, int);
+            int x2 = x1 + va_arg(ap, int) - 1;
+            int y2 = y1 + va_arg(ap, int) - 1;
+            if (x1 < 0 || y1 < 0 || x2 < x1 || y2 < y1) {
+                return -1;
+            }
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_X_START_H, (x1 >> 8));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_X_START_L, (x1 & 0xff));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_Y_START_H, (y1 >> 8));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_Y_START_L, (y1 & 0xff));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_X_END_H,   (x2 >> 8));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_X_END_L,   (x2 & 0xff));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_Y_END_H,   (y2 >> 8));
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_LROI_Y_END_L,   (y2 & 0xff));
+            break;
+        }
+        case IOCTL_HIMAX_MD_THRESHOLD: {
+            uint32_t threshold = va_arg(ap, uint32_t);
+            ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, MD_THL, (threshold & 0xff));
+            break;
+        }
+        case IOCTL_HIMAX_MD_CLEAR: {
+            // Clears the motion detected flag and releases the INT pin.
+            ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, I2C_CLEAR, HIMAX_MD_CLEAR);
+            break;
+        }
+        case IOCTL_HIMAX_OSC_ENABLE: {
+            // Run from the internal oscillator, motion detection keeps running with
+            // the MCU in stop mode and the external clock off.
+            uint32_t enable = va_arg(ap, uint32_t);
+            ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, ANA_Register_17, (enable != 0));
+            break;
+        }
+        default: {
+            ret = -1;
+            break;
+        }
+    }
+
+    return ret;
+}
+
 int hm01b0_init(sensor_t *sensor)
 {
     // Initialize sensor structure.
@@ -209,6 +332,12 @@ int hm01b0_init(sensor_t *sensor)
     sensor->set_framesize       = set_framesize;
     sensor->set_hmirror         = set_hmirror;
     sensor->set_vflip           = set_vflip;
+    sensor->set_auto_gain       = set_auto_gain;
+    sensor->get_gain_db         = get_gain_db;
+    sensor->set_auto_exposure   = set_auto_exposure;
+    sensor->get_exposure_us     = get_exposure_us;
+    sensor->set_exposure_gain   = set_exposure_gain;
+    sensor->ioctl               = ioctl;
 
     // Set sensor flags
     SENSOR_HW_FLAGS_SET(sensor, SENSOR_HW_FLAGS_VSYNC, 0);
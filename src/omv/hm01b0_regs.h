@@ -49,6 +49,15 @@
 #define         SINGLE_THR_COLD                 0x100C
 // VSYNC,HSYNC and pixel shift register
 #define         VSYNC_HSYNC_PIXEL_SHIFT_EN      0x1012
+// Motion detection window (ROI)
+#define         MD_LROI_X_START_H               0x2011
+#define         MD_LROI_X_START_L               0x2012
+#define         MD_LROI_Y_START_H               0x2013
+#define         MD_LROI_Y_START_L               0x2014
+#define         MD_LROI_X_END_H                 0x2015
+#define         MD_LROI_X_END_L                 0x2016
+#define         MD_LROI_Y_END_H                 0x2017
+#define         MD_LROI_Y_END_L                 0x2018
 // Automatic exposure gain control
 #define         AE_CTRL                         0x2100
 #define         AE_TARGET_MEAN                  0x2101
@@ -112,5 +121,7 @@
 #define         PCLK_FALLING_EDGE               0x01
 #define         AE_CTRL_ENABLE                  0x00
 #define         AE_CTRL_DISABLE                 0x01
+#define         HIMAX_SET_MD_ENABLE(r, x)       ((r&0xFE)|((x&1)<<0))
+#define         HIMAX_MD_CLEAR                  0x01     // Clear the motion interrupt
 
 #endif //__REG_REGS_H__
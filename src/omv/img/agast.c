@@ -5,15 +5,7 @@
 #include "fb_alloc.h"
 #include "gc.h"
 
-#define MAX_ROW         (480)
 #define MAX_CORNERS     (2000)
-#define Compare(X, Y) ((X)>=(Y))
-
-typedef struct {
-    uint16_t x;
-    uint16_t y;
-    uint16_t score;
-} corner_t;
 
 static int s_width=-1;
 static int_fast16_t s_offset0;
@@ -25,19 +17,8 @@ static int_fast16_t s_offset5;
 static int_fast16_t s_offset6;
 static int_fast16_t s_offset7;
 
-static corner_t *agast58_detect(image_t *img, int b, int* num_corners, rectangle_t *roi);
+static corner_t *agast58_detect(image_t *img, int b, int* num_corners, rectangle_t *roi, uint32_t *mask);
 static int agast58_score(const unsigned char* p, int bstart);
-static void nonmax_suppression(corner_t *corners, int num_corners, array_t *keypoints);
-
-static kp_t *alloc_keypoint(uint16_t x, uint16_t y, uint16_t score)
-{
-    // Note must set keypoint descriptor to zeros
-    kp_t *kpt = xalloc0(sizeof*kpt);
-    kpt->x = x;
-    kpt->y = y;
-    kpt->score = score;
-    return kpt;
-}
 
 static void init5_8_pattern(int image_width)
 {
@@ -56,128 +37,35 @@ static void init5_8_pattern(int image_width)
 	s_offset7=(-1)+(1)*s_width;
 }
 
-void agast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi)
+void agast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi, int cell_size, int cell_max)
 {
     int num_corners=0;
 	init5_8_pattern(image->w);
 
+    // Pretest results of a row.
+    uint32_t *mask = fb_alloc(((roi->w + 31) / 32) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
     // Find corners
-    corner_t *corners = agast58_detect(image, threshold, &num_corners, roi);
+    corner_t *corners = agast58_detect(image, threshold, &num_corners, roi, mask);
     if (num_corners) {
         // Score corners
         for(int i=0; i<num_corners; i++) {
             corners[i].score = agast58_score(image->pixels + (corners[i].y*image->w + corners[i].x), threshold);
         }
         // Non-max suppression
-        nonmax_suppression(corners, num_corners, keypoints);
+        corner_t *maxima = fb_alloc(num_corners * sizeof(corner_t), FB_ALLOC_NO_HINT);
+        int num_maxima = corner_nonmax_suppression(corners, num_corners, maxima);
+        num_maxima = corner_grid_select(maxima, num_maxima, roi, cell_size, cell_max);
+        corner_push_keypoints(maxima, num_maxima, keypoints);
+        fb_free(); // maxima
     }
 
     // Free corners;
     fb_free();
+    fb_free(); // mask
 }
 
-static void nonmax_suppression(corner_t *corners, int num_corners, array_t *keypoints)
-{
-    gc_info_t info;
-
-	int last_row;
-	int16_t row_start[MAX_ROW+1];
-	const int sz = num_corners;
-
-	/* Point above points (roughly) to the pixel above
-       the one of interest, if there is a feature there.*/
-	int point_above = 0;
-	int point_below = 0;
-
-	/* Find where each row begins (the corners are output in raster scan order).
-       A beginning of -1 signifies that there are no corners on that row. */
-	last_row  = corners[sz-1].y;
-
-	for(int i=0; i<last_row+1; i++) {
-		row_start[i] = -1;
-    }
-
-    for (int i=0, prev_row=-1; i<sz; i++) {
-        corner_t *c = &corners[i];
-        if (c->y != prev_row) {
-            row_start[c->y] = i;
-            prev_row = c->y;
-        }
-    }
-
-    for(int i=0; i<sz; i++) {
-        corner_t pos = corners[i];
-        uint16_t score = pos.score;
-
-        /*Check left */
-        if (i > 0) {
-            if (corners[i-1].x == pos.x-1 && corners[i-1].y == pos.y && Compare(corners[i-1].score, score)) {
-                goto nonmax;
-            }
-        }
-
-        /*Check right*/
-        if (i < (sz - 1)) {
-            if (corners[i+1].x == pos.x+1 && corners[i+1].y == pos.y && Compare(corners[i+1].score, score)) {
-                goto nonmax;
-            }
-        }
-
-        /*Check above (if there is a valid row above)*/
-        if (pos.y != 0 && row_start[pos.y - 1] != -1)  {
-            /*Make sure that current point_above is one row above.*/
-            if(corners[point_above].y < pos.y - 1)
-                point_above = row_start[pos.y-1];
-
-            /*Make point_above point to the first of the pixels above the current point, if it exists.*/
-            for (; corners[point_above].y < pos.y && corners[point_above].x < pos.x - 1; point_above++) {
-
-            }
-
-            for (int j=point_above; corners[j].y < pos.y && corners[j].x <= pos.x + 1; j++) {
-                int x = corners[j].x;
-                if( (x == pos.x - 1 || x ==pos.x || x == pos.x+1) && Compare(corners[j].score, score))
-                    goto nonmax;
-            }
-        }
-
-        /*Check below (if there is anything below)*/
-        if (pos.y != last_row && row_start[pos.y + 1] != -1 && point_below < sz) /*Nothing below*/ {
-            if (corners[point_below].y < pos.y + 1)
-                point_below = row_start[pos.y+1];
-
-            /* Make point below point to one of the pixels belowthe current point, if it exists.*/
-            for (; point_below < sz && corners[point_below].y == pos.y+1 && corners[point_below].x < pos.x - 1; point_below++) {
-            }
-
-            for (int j=point_below; j < sz && corners[j].y == pos.y+1 && corners[j].x <= pos.x + 1; j++) {
-                int x = corners[j].x;
-                if( (x == pos.x - 1 || x ==pos.x || x == pos.x+1) && Compare(corners[j].score, score))
-                    goto nonmax;
-            }
-        }
-
-        gc_info(&info);
-        #define MIN_MEM (10*1024)
-        // Allocate keypoints until we're almost out of memory
-        if (info.free < MIN_MEM) {
-            // Try collecting memory
-            gc_collect();
-            // If it didn't work break
-            gc_info(&info);
-            if (info.free < MIN_MEM) {
-                break;
-            }
-        }
-
-        #undef MIN_MEM
-        array_push_back(keypoints, alloc_keypoint(pos.x, pos.y, pos.score));
-        nonmax:
-        ;
-    }
-}
-
-static corner_t *agast58_detect(image_t *img, int b, int* num_corners, rectangle_t *roi)
+static corner_t *agast58_detect(image_t *img, int b, int* num_corners, rectangle_t *roi, uint32_t *mask)
 {
 	int total=0;
 	register int x, y;
@@ -196,12 +84,15 @@ static corner_t *agast58_detect(image_t *img, int b, int* num_corners, rectangle
 	offset7=s_offset7;
 	width=s_width;
 
-    // Try to alloc MAX_CORNERS or the actual max corners we can alloc.
-    int max_corners = IM_MIN(MAX_CORNERS, (fb_avail() / sizeof(corner_t)));
+    // Try to alloc MAX_CORNERS or the actual max corners we can alloc (keeping room for the maxima).
+    int max_corners = IM_MIN(MAX_CORNERS, (fb_avail() / (2 * sizeof(corner_t))) - 1);
     corner_t *corners = (corner_t*) fb_alloc(max_corners * sizeof(corner_t), FB_ALLOC_NO_HINT);
+    const int compass[4] = {offset0, offset2, offset4, offset6};
 
 	for(y=roi->y+1; y < ysizeB; y++)
 	{										
+		// Only the pixels passing the pretest go through the decision trees.
+		corner_pretest(img->pixels + y*width + roi->x + 1, xsizeB - roi->x, compass, b, mask);
 		x=roi->x;
 		while(1)							
 		{									
@@ -212,6 +103,9 @@ homogeneous:
 				break;
 			else
 			{
+				const int i = x - (roi->x + 1);
+				if(!(mask[i / 32] & (1 << (i % 32))))
+					goto homogeneous;
 				register const unsigned char* const p = img->pixels + y*width + x;
 				register const int cb = *p + b;
 				register const int c_b = *p - b;
@@ -548,6 +442,9 @@ structured:
 				break;
 			else
 			{
+				const int i = x - (roi->x + 1);
+				if(!(mask[i / 32] & (1 << (i % 32))))
+					goto homogeneous;
 				register const unsigned char* const p = img->pixels + y*width + x;
 				register const int cb = *p + b;
 				register const int c_b = *p - b;
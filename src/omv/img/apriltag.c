@@ -51,11 +51,152 @@ The views and conclusions contained in the software and documentation are those
 of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of the Regents of The University of Michigan.
 */
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////// "arena.h"
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Two-ended stack allocator for the detector (replaces umm_malloc). Blocks are carved from the
+// bottom of an fb_alloc region, or from the top while in scratch mode. Freeing a block only marks
+// it dead; each side then rolls back over its dead blocks, so LIFO temporaries are reclaimed at
+// once and everything else when the stage that owns it ends (see arena_scratch_reset()). The last
+// block on either side is resized in place by realloc().
+
+typedef struct arena_hdr {
+    struct arena_hdr *prev;
+    uint32_t size; // payload size, bit 0 set when dead
+} arena_hdr_t;
+
+#define ARENA_ALIGN(size) (((size) + 7) & ~7)
+#define ARENA_DEAD (1)
+
+static char *arena_end, *arena_low_top, *arena_high_bottom;
+static arena_hdr_t *arena_low_last, *arena_high_last;
+static bool arena_high;
+
+static void arena_init(size_t size)
+{
+    if (size < 1024) fb_alloc_fail();
+    char *base = (char *) fb_alloc(size, FB_ALLOC_NO_HINT);
+    arena_low_top = (char *) ARENA_ALIGN((uintptr_t) base);
+    arena_end = arena_high_bottom = arena_low_top + ((size - (arena_low_top - base)) & ~7);
+    arena_low_last = arena_high_last = NULL;
+    arena_high = false;
+}
+
+static void *arena_alloc_side(size_t size, bool high)
+{
+    size = ARENA_ALIGN(size);
+    size_t need = sizeof(arena_hdr_t) + size;
+    if ((size_t) (arena_high_bottom - arena_low_top) < need) return NULL;
+
+    arena_hdr_t *hdr;
+    if (high) {
+        arena_high_bottom -= need;
+        hdr = (arena_hdr_t *) arena_high_bottom;
+        hdr->prev = arena_high_last;
+        arena_high_last = hdr;
+    } else {
+        hdr = (arena_hdr_t *) arena_low_top;
+        arena_low_top += need;
+        hdr->prev = arena_low_last;
+        arena_low_last = hdr;
+    }
+
+    hdr->size = size;
+    return hdr + 1;
+}
+
+static void *arena_malloc(size_t size)
+{
+    return arena_alloc_side(size, arena_high);
+}
+
+static void *arena_calloc(size_t num, size_t item_size)
+{
+    void *ptr = arena_malloc(num * item_size);
+    if (ptr) memset(ptr, 0, num * item_size);
+    return ptr;
+}
+
+static void arena_free(void *ptr)
+{
+    if (!ptr) return;
+    arena_hdr_t *hdr = ((arena_hdr_t *) ptr) - 1;
+    hdr->size |= ARENA_DEAD;
+
+    if (((char *) hdr) < arena_low_top) {
+        while (arena_low_last && (arena_low_last->size & ARENA_DEAD)) {
+            arena_low_top = (char *) arena_low_last;
+            arena_low_last = arena_low_last->prev;
+        }
+    } else {
+        while (arena_high_last && (arena_high_last->size & ARENA_DEAD)) {
+            arena_high_bottom = ((char *) (arena_high_last + 1)) + (arena_high_last->size & ~ARENA_DEAD);
+            arena_high_last = arena_high_last->prev;
+        }
+    }
+}
+
+static bool arena_is_last(void *ptr)
+{
+    return ptr && (((((arena_hdr_t *) ptr) - 1) == arena_low_last) || ((((arena_hdr_t *) ptr) - 1) == arena_high_last));
+}
+
+static void *arena_realloc(void *ptr, size_t size)
+{
+    if (!ptr) return arena_malloc(size);
+    arena_hdr_t *hdr = ((arena_hdr_t *) ptr) - 1;
+    size_t old_size = hdr->size;
+    size = ARENA_ALIGN(size);
+    if (size <= old_size) return ptr;
+
+    if (hdr == arena_low_last) {
+        if ((size_t) (arena_high_bottom - ((char *) ptr)) < size) return NULL;
+        hdr->size = size;
+        arena_low_top = ((char *) ptr) + size;
+        return ptr;
+    }
+
+    bool high = ((char *) hdr) >= arena_high_bottom;
+
+    if (hdr == arena_high_last) {
+        // Grows downwards, the payload has to move with the header.
+        size_t delta = size - old_size;
+        if ((size_t) (arena_high_bottom - arena_low_top) < delta) return NULL;
+        arena_high_bottom -= delta;
+        memmove(arena_high_bottom, hdr, sizeof(arena_hdr_t) + old_size);
+        arena_high_last = (arena_hdr_t *) arena_high_bottom;
+        arena_high_last->size = size;
+        return arena_high_last + 1;
+    }
+
+    void *new_ptr = arena_alloc_side(size, high);
+    if (!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    arena_free(ptr);
+    return new_ptr;
+}
+
+// Routes new allocations to the top (scratch) side of the arena.
+static void arena_scratch(bool enable)
+{
+    arena_high = enable;
+}
+
+// Releases every scratch block at once, live or not.
+static void arena_scratch_reset()
+{
+    arena_high_bottom = arena_end;
+    arena_high_last = NULL;
+    arena_high = false;
+}
+
 #define fprintf(format, ...)
-#define free(ptr) ({ umm_free(ptr); })
-#define malloc(size) ({ void *_r = umm_malloc(size); if(!_r) umm_alloc_fail(); _r; })
-#define realloc(ptr, size) ({ void *_r = umm_realloc((ptr), (size)); if(!_r) umm_alloc_fail(); _r; })
-#define calloc(num, item_size) ({ void *_r = umm_calloc((num), (item_size)); if(!_r) umm_alloc_fail(); _r; })
+#define free(ptr) ({ arena_free(ptr); })
+#define malloc(size) ({ void *_r = arena_malloc(size); if(!_r) fb_alloc_fail(); _r; })
+#define realloc(ptr, size) ({ void *_r = arena_realloc((ptr), (size)); if(!_r) fb_alloc_fail(); _r; })
+#define calloc(num, item_size) ({ void *_r = arena_calloc((num), (item_size)); if(!_r) fb_alloc_fail(); _r; })
 #define assert(expression)
 #define sqrt(x) fast_sqrtf(x)
 #define sqrtf(x) fast_sqrtf(x)
@@ -128,7 +269,7 @@ static inline zarray_t *zarray_create_fail_ok(size_t el_sz)
 {
     assert(el_sz > 0);
 
-    zarray_t *za = (zarray_t*) umm_calloc(1, sizeof(zarray_t));
+    zarray_t *za = (zarray_t*) arena_calloc(1, sizeof(zarray_t));
     if (za) za->el_sz = el_sz;
     return za;
 }
@@ -233,9 +374,9 @@ static inline void zarray_ensure_capacity(zarray_t *za, int capacity)
         return;
 
     while (za->alloc < capacity) {
-        za->alloc += 8; // use less memory // *= 2;
-        if (za->alloc < 8)
-            za->alloc = 8;
+        // grow in place at the top of the arena, otherwise by half (the old block stays dead
+        // until its stage ends)
+        za->alloc += (arena_is_last(za->data) || (za->alloc < 16)) ? 8 : (za->alloc / 2);
     }
 
     za->data = (char*) realloc(za->data, za->alloc * za->el_sz);
@@ -273,12 +414,10 @@ static inline void zarray_add_fail_ok(zarray_t *za, const void *p)
         int old_alloc = za->alloc;
 
         while (za->alloc < (za->size + 1)) {
-            za->alloc += 8; // use less memory // *= 2;
-            if (za->alloc < 8)
-                za->alloc = 8;
+            za->alloc += (arena_is_last(za->data) || (za->alloc < 16)) ? 8 : (za->alloc / 2);
         }
 
-        za->data = (char*) umm_realloc(za->data, za->alloc * za->el_sz);
+        za->data = (char*) arena_realloc(za->data, za->alloc * za->el_sz);
 
         if (!za->data) {
             za->data = old_data;
@@ -5191,6 +5330,16 @@ struct apriltag_detector
     ///////////////////////////////////////////////////////////////
     // User-configurable parameters.
 
+    // detection of quads can be done on a lower-resolution image,
+    // improving speed at a cost of pose accuracy and a slight
+    // decrease in detection rate. Decoding the binary payload is
+    // still done at full resolution. Supported values are 1 to 4.
+    int quad_decimate;
+
+    // when non-zero, decoding stops once this many tags have been
+    // found (before duplicates are reconciled).
+    int max_detections;
+
     // When non-zero, the edges of the each quad are adjusted to "snap
     // to" strong gradients nearby. This is useful when decimation is
     // employed, as it can increase the quality of the initial quad
@@ -46654,6 +46803,9 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im, bool ove
         do_unionfind_line(uf, threshim, h, w, ts, y);
     }
 
+    // The cluster map and clusters only live until the quads are fit.
+    arena_scratch(true);
+
     uint32_t nclustermap;
     struct uint32_zarray_entry **clustermap = fb_alloc0_all(&nclustermap, FB_ALLOC_PREFER_SPEED);
     nclustermap /= sizeof(struct uint32_zarray_entry*);
@@ -46709,7 +46861,7 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im, bool ove
                     }                                                   \
                                                                         \
                     if (!entry) {                                       \
-                        entry = umm_calloc(1, sizeof(struct uint32_zarray_entry)); \
+                        entry = arena_calloc(1, sizeof(struct uint32_zarray_entry)); \
                         if (!entry) break;                              \
                         entry->id = clusterid;                          \
                         entry->cluster = zarray_create_fail_ok(sizeof(struct pt)); \
@@ -46781,6 +46933,8 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im, bool ove
     fb_free(); // threshim->buf
     fb_free(); // threshim
 
+    arena_scratch(false);
+
     zarray_t *quads = zarray_create_fail_ok(sizeof(struct quad));
 
     if (quads) {
@@ -46792,6 +46946,10 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im, bool ove
             if (zarray_size(cluster) < td->qtp.min_cluster_pixels)
                 continue;
 
+            // Out of time, the tags of the previous bands are returned.
+            if (imlib_deadline_expired())
+                break;
+
             // a cluster should contain only boundary points around the
             // tag. it cannot be bigger than the whole screen. (Reject
             // large connected blobs that will be prohibitively slow to
@@ -46822,6 +46980,7 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im, bool ove
 
     if (clusters) zarray_destroy(clusters);
 
+    arena_scratch_reset();
 
     if (!quads) {
         // we should have enough memory now
@@ -46894,12 +47053,24 @@ struct quick_decode_entry
     bool vflip;
 };
 
+// Index of the codes of a family for decoding with bit errors. A code with at most threshold
+// errors matches at least one of threshold+1 disjoint chunks of its bits exactly, so only the
+// codes sharing the value of one of the chunks need their hamming distance checked.
+#define QUICK_DECODE_MAX_CHUNK_BITS 8
+#define QUICK_DECODE_MAX_FAMILIES 8
+
 struct quick_decode
 {
-    int nentries;
-    struct quick_decode_entry *entries;
+    apriltag_family_t *family;
+    int threshold;
+    int nchunks, chunk_bits;
+    uint16_t *offsets; // nchunks * ((1 << chunk_bits) + 1), bucket starts in ids
+    uint16_t *ids;     // nchunks * ncodes, codes sorted by chunk value
 };
 
+static struct quick_decode quick_decode_cache[QUICK_DECODE_MAX_FAMILIES];
+static int quick_decode_cache_len;
+
 /** if the bits in w were arranged in a d*d grid and that grid was
  * rotated, what would the new bits in w be?
  * The bits are organized like this (for d = 3):
@@ -47035,88 +47206,127 @@ int popcount64c(uint64_t x)
     return (x * h01) >> 56;  //returns left 8 bits of x + (x<<8) + (x<<16) + (x<<24) + ...
 }
 
-// returns an entry with hamming set to 255 if no decode was found.
-static void quick_decode_codeword(apriltag_family_t *tf, uint64_t rcode,
-                                  struct quick_decode_entry *entry)
+static void quick_decode_init(struct quick_decode *qd, apriltag_family_t *tf)
 {
-    int threshold = imax(tf->h - tf->d - 1, 0);
+    int nbuckets;
+
+    qd->family = tf;
+    qd->threshold = imax(tf->h - tf->d - 1, 0);
+    qd->nchunks = qd->threshold + 1;
+    qd->chunk_bits = imin((tf->d * tf->d) / qd->nchunks, QUICK_DECODE_MAX_CHUNK_BITS);
+    nbuckets = 1 << qd->chunk_bits;
+    qd->offsets = calloc(qd->nchunks * (nbuckets + 1), sizeof(uint16_t));
+    qd->ids = malloc(qd->nchunks * tf->ncodes * sizeof(uint16_t));
+
+    // Counting sort of the codes by the value of each chunk.
+    for (int c = 0; c < qd->nchunks; c++) {
+        uint16_t *offsets = qd->offsets + (c * (nbuckets + 1));
+        uint16_t *ids = qd->ids + (c * tf->ncodes);
+        int shift = c * qd->chunk_bits;
+
+        for (int i = 0; i < tf->ncodes; i++) {
+            offsets[((tf->codes[i] >> shift) & (nbuckets - 1)) + 1] += 1;
+        }
 
-    for (int ridx = 0; ridx < 4; ridx++) {
+        for (int i = 0; i < nbuckets; i++) {
+            offsets[i + 1] += offsets[i];
+        }
 
-        for (int i = 0, j = tf->ncodes; i < j; i++) {
-            int hamming = popcount64c(tf->codes[i] ^ rcode);
-            if(hamming <= threshold) {
-                entry->rcode = rcode;
-                entry->id = i;
-                entry->hamming = hamming;
-                entry->rotation = ridx;
-                entry->hmirror = false;
-                entry->vflip = false;
-                return;
-            }
+        for (int i = 0; i < tf->ncodes; i++) {
+            ids[offsets[(tf->codes[i] >> shift) & (nbuckets - 1)]++] = i;
+        }
+
+        // The fill above moved each start to the next bucket.
+        for (int i = nbuckets; i > 0; i--) {
+            offsets[i] = offsets[i - 1];
         }
 
-        rcode = rotate90(rcode, tf->d);
+        offsets[0] = 0;
     }
+}
 
-    rcode = hmirror_code(rcode, tf->d); // handle hmirror
+static struct quick_decode *quick_decode_get(apriltag_family_t *tf)
+{
+    for (int i = 0; i < quick_decode_cache_len; i++) {
+        if (quick_decode_cache[i].family == tf) {
+            return &quick_decode_cache[i];
+        }
+    }
 
-    for (int ridx = 0; ridx < 4; ridx++) {
+    return NULL;
+}
 
-        for (int i = 0, j = tf->ncodes; i < j; i++) {
-            int hamming = popcount64c(tf->codes[i] ^ rcode);
-            if(hamming <= threshold) {
-                entry->rcode = rcode;
-                entry->id = i;
-                entry->hamming = hamming;
-                entry->rotation = ridx;
-                entry->hmirror = true;
-                entry->vflip = false;
-                return;
-            }
-        }
+// Returns the lowest id within the decode threshold of rcode (or -1).
+static int quick_decode_lookup(struct quick_decode *qd, uint64_t rcode, int *hamming)
+{
+    apriltag_family_t *tf = qd->family;
+    int nbuckets = 1 << qd->chunk_bits;
+    int best_id = -1;
 
-        rcode = rotate90(rcode, tf->d);
-    }
+    for (int c = 0; c < qd->nchunks; c++) {
+        uint16_t *offsets = qd->offsets + (c * (nbuckets + 1));
+        uint16_t *ids = qd->ids + (c * tf->ncodes);
+        int value = (rcode >> (c * qd->chunk_bits)) & (nbuckets - 1);
 
-    rcode = vflip_code(rcode, tf->d); // handle hmirror+vflip
+        for (int i = offsets[value], j = offsets[value + 1]; i < j; i++) {
+            int id = ids[i];
 
-    for (int ridx = 0; ridx < 4; ridx++) {
+            if ((best_id < 0) || (id < best_id)) {
+                int h = popcount64c(tf->codes[id] ^ rcode);
 
-        for (int i = 0, j = tf->ncodes; i < j; i++) {
-            int hamming = popcount64c(tf->codes[i] ^ rcode);
-            if(hamming <= threshold) {
-                entry->rcode = rcode;
-                entry->id = i;
-                entry->hamming = hamming;
-                entry->rotation = ridx;
-                entry->hmirror = true;
-                entry->vflip = true;
-                return;
+                if (h <= qd->threshold) {
+                    best_id = id;
+                    *hamming = h;
+                }
             }
         }
-
-        rcode = rotate90(rcode, tf->d);
     }
 
-    rcode = hmirror_code(rcode, tf->d); // handle vflip
+    return best_id;
+}
 
-    for (int ridx = 0; ridx < 4; ridx++) {
+// returns an entry with hamming set to 255 if no decode was found.
+//
+// Only the rotations of the code and of its mirror image are tried. Flipping a code vertically
+// and horizontally is a 180 degree rotation, so the vflip and hmirror+vflip orientations are
+// the same set of codes again.
+static void quick_decode_codeword(apriltag_family_t *tf, uint64_t rcode,
+                                  struct quick_decode_entry *entry)
+{
+    struct quick_decode *qd = quick_decode_get(tf);
+    int threshold = imax(tf->h - tf->d - 1, 0);
 
-        for (int i = 0, j = tf->ncodes; i < j; i++) {
-            int hamming = popcount64c(tf->codes[i] ^ rcode);
-            if(hamming <= threshold) {
+    for (int mirror = 0; mirror < 2; mirror++) {
+
+        for (int ridx = 0; ridx < 4; ridx++) {
+            int id = -1, hamming = 0;
+
+            if (qd) {
+                id = quick_decode_lookup(qd, rcode, &hamming);
+            } else {
+                for (int i = 0, j = tf->ncodes; i < j; i++) {
+                    hamming = popcount64c(tf->codes[i] ^ rcode);
+                    if (hamming <= threshold) {
+                        id = i;
+                        break;
+                    }
+                }
+            }
+
+            if (id >= 0) {
                 entry->rcode = rcode;
-                entry->id = i;
+                entry->id = id;
                 entry->hamming = hamming;
                 entry->rotation = ridx;
-                entry->hmirror = false;
-                entry->vflip = true;
+                entry->hmirror = mirror;
+                entry->vflip = false;
                 return;
             }
+
+            rcode = rotate90(rcode, tf->d);
         }
 
-        rcode = rotate90(rcode, tf->d);
+        rcode = hmirror_code(rcode, tf->d); // handle hmirror
     }
 
     entry->rcode = 0;
@@ -47140,13 +47350,25 @@ void apriltag_detector_remove_family(apriltag_detector_t *td, apriltag_family_t
     zarray_remove_value(td->tag_families, &fam, 0);
 }
 
+// The decode index of each family is built once per detector (in the arena, its cost is a
+// fraction of decoding a single frame) and shared by all the quads decoded.
 void apriltag_detector_add_family_bits(apriltag_detector_t *td, apriltag_family_t *fam, int bits_corrected)
 {
     zarray_add(td->tag_families, &fam);
+
+    if ((!quick_decode_get(fam)) && (quick_decode_cache_len < QUICK_DECODE_MAX_FAMILIES)) {
+        quick_decode_init(&quick_decode_cache[quick_decode_cache_len++], fam);
+    }
 }
 
 void apriltag_detector_clear_families(apriltag_detector_t *td)
 {
+    for (int i = 0; i < quick_decode_cache_len; i++) {
+        free(quick_decode_cache[i].ids);
+        free(quick_decode_cache[i].offsets);
+    }
+
+    quick_decode_cache_len = 0;
     zarray_clear(td->tag_families);
 }
 
@@ -47164,6 +47386,9 @@ apriltag_detector_t *apriltag_detector_create()
 
     td->tag_families = zarray_create(sizeof(apriltag_family_t*));
 
+    td->quad_decimate = 1;
+    td->max_detections = 0;
+
     td->refine_edges = 1;
     td->refine_pose = 0;
     td->refine_decode = 0;
@@ -47634,7 +47859,7 @@ static void refine_edges(apriltag_detector_t *td, image_u8_t *im_orig, struct qu
             // search on another pixel in the first place. Likewise,
             // for very small tags, we don't want the range to be too
             // big.
-            float range = 1.0 + 1;
+            float range = td->quad_decimate + 1;
 
             // XXX tunable step size.
             for (float n = -range; n <= range; n +=  0.25) {
@@ -47755,6 +47980,169 @@ int prefer_smaller(int pref, float q0, float q1)
     return 0;
 }
 
+// Box filters im by factor x factor into a new fb_alloc'd image (free with two fb_free() calls).
+static image_u8_t *apriltag_decimate(image_u8_t *im, int factor)
+{
+    image_u8_t *decim = fb_alloc(sizeof(image_u8_t), FB_ALLOC_NO_HINT);
+    decim->width = im->width / factor;
+    decim->height = im->height / factor;
+    decim->stride = decim->width;
+    decim->buf = fb_alloc(decim->width * decim->height, FB_ALLOC_PREFER_SPEED);
+
+    int area = factor * factor;
+
+    for (int y = 0; y < decim->height; y++) {
+        uint8_t *dst = decim->buf + (y * decim->stride);
+        uint8_t *src = im->buf + (y * factor * im->stride);
+
+        for (int x = 0; x < decim->width; x++, src += factor) {
+            int acc = 0;
+
+            for (int j = 0; j < factor; j++) {
+                for (int i = 0; i < factor; i++) {
+                    acc += src[(j * im->stride) + i];
+                }
+            }
+
+            dst[x] = (acc + (area / 2)) / area;
+        }
+    }
+
+    return decim;
+}
+
+// Don't report the same tag more than once. (Allow non-overlapping
+// duplicate detections.)
+static void apriltag_reconcile_detections(zarray_t *detections)
+{
+    zarray_t *poly0 = g2d_polygon_create_zeros(4);
+    zarray_t *poly1 = g2d_polygon_create_zeros(4);
+
+    for (int i0 = 0; i0 < zarray_size(detections); i0++) {
+
+        apriltag_detection_t *det0;
+        zarray_get(detections, i0, &det0);
+
+        for (int k = 0; k < 4; k++)
+            zarray_set(poly0, k, det0->p[k], NULL);
+
+        for (int i1 = i0+1; i1 < zarray_size(detections); i1++) {
+
+            apriltag_detection_t *det1;
+            zarray_get(detections, i1, &det1);
+
+            if (det0->id != det1->id || det0->family != det1->family)
+                continue;
+
+            for (int k = 0; k < 4; k++)
+                zarray_set(poly1, k, det1->p[k], NULL);
+
+            if (g2d_polygon_overlaps_polygon(poly0, poly1)) {
+                // the tags overlap. Delete one, keep the other.
+
+                int pref = 0; // 0 means undecided which one we'll keep.
+                pref = prefer_smaller(pref, det0->hamming, det1->hamming);     // want small hamming
+                pref = prefer_smaller(pref, -det0->decision_margin, -det1->decision_margin);      // want bigger margins
+                pref = prefer_smaller(pref, -det0->goodness, -det1->goodness); // want bigger goodness
+
+                // if we STILL don't prefer one detection over the other, then pick
+                // any deterministic criterion.
+                for (int i = 0; i < 4; i++) {
+                    pref = prefer_smaller(pref, det0->p[i][0], det1->p[i][0]);
+                    pref = prefer_smaller(pref, det0->p[i][1], det1->p[i][1]);
+                }
+
+                if (pref == 0) {
+                    // at this point, we should only be undecided if the tag detections
+                    // are *exactly* the same. How would that happen?
+                    printf("uh oh, no preference for overlappingdetection\n");
+                }
+
+                if (pref < 0) {
+                    // keep det0, destroy det1
+                    apriltag_detection_destroy(det1);
+                    zarray_remove_index(detections, i1, 1);
+                    i1--; // retry the same index
+                    goto retry1;
+                } else {
+                    // keep det1, destroy det0
+                    apriltag_detection_destroy(det0);
+                    zarray_remove_index(detections, i0, 1);
+                    i0--; // retry the same index.
+                    goto retry0;
+                }
+            }
+
+          retry1: ;
+        }
+
+      retry0: ;
+    }
+
+    zarray_destroy(poly0);
+    zarray_destroy(poly1);
+}
+
+// Builds the detection of a decoded quad, with the homography rotated to the orientation of the tag.
+static apriltag_detection_t *apriltag_make_detection(apriltag_family_t *family, struct quad *quad,
+                                                     struct quick_decode_entry *entry, float goodness, float decision_margin)
+{
+    apriltag_detection_t *det = calloc(1, sizeof(apriltag_detection_t));
+
+    det->family = family;
+    det->id = entry->id;
+    det->hamming = entry->hamming;
+    det->goodness = goodness;
+    det->decision_margin = decision_margin;
+
+    float theta = -entry->rotation * M_PI / 2.0;
+    float c = cos(theta), s = sin(theta);
+
+    // Fix the rotation of our homography to properly orient the tag
+    matd_t *R = matd_create(3,3);
+    MATD_EL(R, 0, 0) = c;
+    MATD_EL(R, 0, 1) = -s;
+    MATD_EL(R, 1, 0) = s;
+    MATD_EL(R, 1, 1) = c;
+    MATD_EL(R, 2, 2) = 1;
+
+    matd_t *RHMirror = matd_create(3,3);
+    MATD_EL(RHMirror, 0, 0) = entry->hmirror ? -1 : 1;
+    MATD_EL(RHMirror, 1, 1) = 1;
+    MATD_EL(RHMirror, 2, 2) = entry->hmirror ? -1 : 1;
+
+    matd_t *RVFlip = matd_create(3,3);
+    MATD_EL(RVFlip, 0, 0) = 1;
+    MATD_EL(RVFlip, 1, 1) = entry->vflip ? -1 : 1;
+    MATD_EL(RVFlip, 2, 2) = entry->vflip ? -1 : 1;
+
+    det->H = matd_op("M*M*M*M", quad->H, R, RHMirror, RVFlip);
+
+    matd_destroy(R);
+    matd_destroy(RHMirror);
+    matd_destroy(RVFlip);
+
+    homography_project(det->H, 0, 0, &det->c[0], &det->c[1]);
+
+    // [-1, -1], [1, -1], [1, 1], [-1, 1], Desired points
+    // [-1, 1], [1, 1], [1, -1], [-1, -1], FLIP Y
+    // adjust the points in det->p so that they correspond to
+    // counter-clockwise around the quad, starting at -1,-1.
+    for (int i = 0; i < 4; i++) {
+        int tcx = (i == 1 || i == 2) ? 1 : -1;
+        int tcy = (i < 2) ? 1 : -1;
+
+        float p[2];
+
+        homography_project(det->H, tcx, tcy, &p[0], &p[1]);
+
+        det->p[i][0] = p[0];
+        det->p[i][1] = p[1];
+    }
+
+    return det;
+}
+
 zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
 {
     if (zarray_size(td->tag_families) == 0) {
@@ -47768,7 +48156,28 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
     // and blurring parameters.
 
 //    zarray_t *quads = apriltag_quad_gradient(td, im_orig);
-    zarray_t *quads = apriltag_quad_thresh(td, im_orig, false);
+    zarray_t *quads;
+
+    if (td->quad_decimate > 1) {
+        image_u8_t *quad_im = apriltag_decimate(im_orig, td->quad_decimate);
+        quads = apriltag_quad_thresh(td, quad_im, false);
+        fb_free(); // quad_im->buf
+        fb_free(); // quad_im
+
+        // adjust centers of pixels so that they correspond to the
+        // original full-resolution image.
+        for (int i = 0; i < zarray_size(quads); i++) {
+            struct quad *q;
+            zarray_get_volatile(quads, i, &q);
+
+            for (int j = 0; j < 4; j++) {
+                q->p[j][0] = (q->p[j][0] - 0.5) * td->quad_decimate + 0.5;
+                q->p[j][1] = (q->p[j][1] - 0.5) * td->quad_decimate + 0.5;
+            }
+        }
+    } else {
+        quads = apriltag_quad_thresh(td, im_orig, false);
+    }
 
     zarray_t *detections = zarray_create(sizeof(apriltag_detection_t*));
 
@@ -47778,12 +48187,18 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
     // Step 2. Decode tags from each quad.
     if (1) {
         for (int i = 0; i < zarray_size(quads); i++) {
+            if (td->max_detections && (zarray_size(detections) >= td->max_detections))
+                break;
+
+            if (imlib_deadline_expired())
+                break;
+
             struct quad *quad_original;
             zarray_get_volatile(quads, i, &quad_original);
 
             // refine edges is not dependent upon the tag family, thus
-            // apply this optimization BEFORE the other work.
-            //if (td->quad_decimate > 1 && td->refine_edges) {
+            // apply this optimization BEFORE the other work. It also
+            // snaps the decimated quads back to the full-resolution edges.
             if (td->refine_edges) {
                 refine_edges(td, im_orig, quad_original);
             }
@@ -47833,59 +48248,7 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
                 float decision_margin = quad_decode(family, im_orig, quad, &entry, NULL);
 
                 if (entry.hamming < 255 && decision_margin >= 0) {
-                    apriltag_detection_t *det = calloc(1, sizeof(apriltag_detection_t));
-
-                    det->family = family;
-                    det->id = entry.id;
-                    det->hamming = entry.hamming;
-                    det->goodness = goodness;
-                    det->decision_margin = decision_margin;
-
-                    float theta = -entry.rotation * M_PI / 2.0;
-                    float c = cos(theta), s = sin(theta);
-
-                    // Fix the rotation of our homography to properly orient the tag
-                    matd_t *R = matd_create(3,3);
-                    MATD_EL(R, 0, 0) = c;
-                    MATD_EL(R, 0, 1) = -s;
-                    MATD_EL(R, 1, 0) = s;
-                    MATD_EL(R, 1, 1) = c;
-                    MATD_EL(R, 2, 2) = 1;
-
-                    matd_t *RHMirror = matd_create(3,3);
-                    MATD_EL(RHMirror, 0, 0) = entry.hmirror ? -1 : 1;
-                    MATD_EL(RHMirror, 1, 1) = 1;
-                    MATD_EL(RHMirror, 2, 2) = entry.hmirror ? -1 : 1;
-
-                    matd_t *RVFlip = matd_create(3,3);
-                    MATD_EL(RVFlip, 0, 0) = 1;
-                    MATD_EL(RVFlip, 1, 1) = entry.vflip ? -1 : 1;
-                    MATD_EL(RVFlip, 2, 2) = entry.vflip ? -1 : 1;
-
-                    det->H = matd_op("M*M*M*M", quad->H, R, RHMirror, RVFlip);
-
-                    matd_destroy(R);
-                    matd_destroy(RHMirror);
-                    matd_destroy(RVFlip);
-
-                    homography_project(det->H, 0, 0, &det->c[0], &det->c[1]);
-
-                    // [-1, -1], [1, -1], [1, 1], [-1, 1], Desired points
-                    // [-1, 1], [1, 1], [1, -1], [-1, -1], FLIP Y
-                    // adjust the points in det->p so that they correspond to
-                    // counter-clockwise around the quad, starting at -1,-1.
-                    for (int i = 0; i < 4; i++) {
-                        int tcx = (i == 1 || i == 2) ? 1 : -1;
-                        int tcy = (i < 2) ? 1 : -1;
-
-                        float p[2];
-
-                        homography_project(det->H, tcx, tcy, &p[0], &p[1]);
-
-                        det->p[i][0] = p[0];
-                        det->p[i][1] = p[1];
-                    }
-
+                    apriltag_detection_t *det = apriltag_make_detection(family, quad, &entry, goodness, decision_margin);
                     zarray_add(detections, &det);
                 }
 
@@ -47897,74 +48260,7 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
     ////////////////////////////////////////////////////////////////
     // Step 3. Reconcile detections--- don't report the same tag more
     // than once. (Allow non-overlapping duplicate detections.)
-    if (1) {
-        zarray_t *poly0 = g2d_polygon_create_zeros(4);
-        zarray_t *poly1 = g2d_polygon_create_zeros(4);
-
-        for (int i0 = 0; i0 < zarray_size(detections); i0++) {
-
-            apriltag_detection_t *det0;
-            zarray_get(detections, i0, &det0);
-
-            for (int k = 0; k < 4; k++)
-                zarray_set(poly0, k, det0->p[k], NULL);
-
-            for (int i1 = i0+1; i1 < zarray_size(detections); i1++) {
-
-                apriltag_detection_t *det1;
-                zarray_get(detections, i1, &det1);
-
-                if (det0->id != det1->id || det0->family != det1->family)
-                    continue;
-
-                for (int k = 0; k < 4; k++)
-                    zarray_set(poly1, k, det1->p[k], NULL);
-
-                if (g2d_polygon_overlaps_polygon(poly0, poly1)) {
-                    // the tags overlap. Delete one, keep the other.
-
-                    int pref = 0; // 0 means undecided which one we'll keep.
-                    pref = prefer_smaller(pref, det0->hamming, det1->hamming);     // want small hamming
-                    pref = prefer_smaller(pref, -det0->decision_margin, -det1->decision_margin);      // want bigger margins
-                    pref = prefer_smaller(pref, -det0->goodness, -det1->goodness); // want bigger goodness
-
-                    // if we STILL don't prefer one detection over the other, then pick
-                    // any deterministic criterion.
-                    for (int i = 0; i < 4; i++) {
-                        pref = prefer_smaller(pref, det0->p[i][0], det1->p[i][0]);
-                        pref = prefer_smaller(pref, det0->p[i][1], det1->p[i][1]);
-                    }
-
-                    if (pref == 0) {
-                        // at this point, we should only be undecided if the tag detections
-                        // are *exactly* the same. How would that happen?
-                        printf("uh oh, no preference for overlappingdetection\n");
-                    }
-
-                    if (pref < 0) {
-                        // keep det0, destroy det1
-                        apriltag_detection_destroy(det1);
-                        zarray_remove_index(detections, i1, 1);
-                        i1--; // retry the same index
-                        goto retry1;
-                    } else {
-                        // keep det1, destroy det0
-                        apriltag_detection_destroy(det0);
-                        zarray_remove_index(detections, i0, 1);
-                        i0--; // retry the same index.
-                        goto retry0;
-                    }
-                }
-
-              retry1: ;
-            }
-
-          retry0: ;
-        }
-
-        zarray_destroy(poly0);
-        zarray_destroy(poly1);
-    }
+    apriltag_reconcile_detections(detections);
 
     for (int i = 0; i < zarray_size(quads); i++) {
         struct quad *quad;
@@ -47998,18 +48294,8 @@ void apriltag_detections_destroy(zarray_t *detections)
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_families_t families,
-                          float fx, float fy, float cx, float cy)
+static void apriltag_add_families(apriltag_detector_t *td, apriltag_families_t families)
 {
-    // Frame Buffer Memory Usage...
-    // -> GRAYSCALE Input Image = w*h*1
-    // -> GRAYSCALE Threhsolded Image = w*h*1
-    // -> UnionFind = w*h*2 (+w*h*1 for hash table)
-    size_t resolution = roi->w * roi->h;
-    size_t fb_alloc_need = resolution * (1 + 1 + 2 + 1); // read above...
-    umm_init_x(((fb_avail() - fb_alloc_need) / resolution) * resolution);
-    apriltag_detector_t *td = apriltag_detector_create();
-
     if (families & TAG16H5) {
         apriltag_detector_add_family(td, (apriltag_family_t *) &tag16h5);
     }
@@ -48037,21 +48323,16 @@ void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_
     if (families & ARTOOLKIT) {
         apriltag_detector_add_family(td, (apriltag_family_t *) &artoolkit);
     }
+}
 
-    uint8_t *grayscale_image = fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
-
-    image_u8_t im;
-    im.width = roi->w;
-    im.height = roi->h;
-    im.stride = roi->w;
-    im.buf = grayscale_image;
-
+static void apriltag_copy_grayscale(image_t *ptr, rectangle_t *roi, uint8_t *buf)
+{
     switch(ptr->bpp) {
         case IMAGE_BPP_BINARY: {
             for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
                 uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
                 for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                    *(buf++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
                 }
             }
             break;
@@ -48060,7 +48341,7 @@ void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_
             for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
                 uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
                 for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                    *(buf++) = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
                 }
             }
             break;
@@ -48069,18 +48350,188 @@ void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_
             for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
                 for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                    *(buf++) = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
                 }
             }
             break;
         }
         default: {
-            memset(grayscale_image, 0, roi->w * roi->h);
+            memset(buf, 0, roi->w * roi->h);
+            break;
+        }
+    }
+}
+
+// Moves a detection by (x, y) pixels. The homography is translated too so the pose stays right.
+static void apriltag_detection_translate(apriltag_detection_t *det, float x, float y)
+{
+    for (int i = 0; i < 4; i++) {
+        det->p[i][0] += x;
+        det->p[i][1] += y;
+    }
+
+    det->c[0] += x;
+    det->c[1] += y;
+
+    for (int i = 0; i < 3; i++) {
+        MATD_EL(det->H, 0, i) += x * MATD_EL(det->H, 2, i);
+        MATD_EL(det->H, 1, i) += y * MATD_EL(det->H, 2, i);
+    }
+}
+
+static void apriltag_detection_to_lnk(find_apriltags_list_lnk_data_t *lnk_data, apriltag_detection_t *det, rectangle_t *roi,
+                                      float fx, float fy, float cx, float cy)
+{
+    rectangle_init(&(lnk_data->rect), fast_roundf(det->p[0][0]) + roi->x, fast_roundf(det->p[0][1]) + roi->y, 0, 0);
+
+    for (size_t k = 1, l = (sizeof(det->p) / sizeof(det->p[0])); k < l; k++) {
+        rectangle_t temp;
+        rectangle_init(&temp, fast_roundf(det->p[k][0]) + roi->x, fast_roundf(det->p[k][1]) + roi->y, 0, 0);
+        rectangle_united(&(lnk_data->rect), &temp);
+    }
+
+    // Add corners...
+    lnk_data->corners[0].x = fast_roundf(det->p[3][0]) + roi->x; // top-left
+    lnk_data->corners[0].y = fast_roundf(det->p[3][1]) + roi->y; // top-left
+    lnk_data->corners[1].x = fast_roundf(det->p[2][0]) + roi->x; // top-right
+    lnk_data->corners[1].y = fast_roundf(det->p[2][1]) + roi->y; // top-right
+    lnk_data->corners[2].x = fast_roundf(det->p[1][0]) + roi->x; // bottom-right
+    lnk_data->corners[2].y = fast_roundf(det->p[1][1]) + roi->y; // bottom-right
+    lnk_data->corners[3].x = fast_roundf(det->p[0][0]) + roi->x; // bottom-left
+    lnk_data->corners[3].y = fast_roundf(det->p[0][1]) + roi->y; // bottom-left
+
+    lnk_data->id = det->id;
+    lnk_data->family = 0;
+
+    if(det->family == &tag16h5) {
+        lnk_data->family |= TAG16H5;
+    }
+
+    if(det->family == &tag25h7) {
+        lnk_data->family |= TAG25H7;
+    }
+
+    if(det->family == &tag25h9) {
+        lnk_data->family |= TAG25H9;
+    }
+
+    if(det->family == &tag36h8) {
+        lnk_data->family |= TAG36H8;
+    }
+
+    if(det->family == &tag36h10) {
+        lnk_data->family |= TAG36H10;
+    }
+
+    if(det->family == &tag36h11) {
+        lnk_data->family |= TAG36H11;
+    }
+
+    if(det->family == &artoolkit) {
+        lnk_data->family |= ARTOOLKIT;
+    }
+
+    lnk_data->hamming = det->hamming;
+    lnk_data->centroid.x = fast_roundf(det->c[0]) + roi->x;
+    lnk_data->centroid.y = fast_roundf(det->c[1]) + roi->y;
+    lnk_data->goodness = det->goodness / 255.0; // scale to [0:1]
+    lnk_data->decision_margin = det->decision_margin / 255.0; // scale to [0:1]
+
+    matd_t *pose = homography_to_pose(det->H, -fx, fy, cx, cy);
+
+    lnk_data->x_translation = MATD_EL(pose, 0, 3);
+    lnk_data->y_translation = MATD_EL(pose, 1, 3);
+    lnk_data->z_translation = MATD_EL(pose, 2, 3);
+    lnk_data->x_rotation = fast_atan2f(MATD_EL(pose, 2, 1), MATD_EL(pose, 2, 2));
+    lnk_data->y_rotation = fast_atan2f(-MATD_EL(pose, 2, 0), fast_sqrtf(sq(MATD_EL(pose, 2, 1)) + sq(MATD_EL(pose, 2, 2))));
+    lnk_data->z_rotation = fast_atan2f(MATD_EL(pose, 1, 0), MATD_EL(pose, 0, 0));
+
+    matd_destroy(pose);
+}
+
+void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_families_t families,
+                          float fx, float fy, float cx, float cy, int quad_decimate, int max_tags)
+{
+    // Frame Buffer Memory Usage...
+    // -> GRAYSCALE Input Image = w*h*1
+    // -> GRAYSCALE Decimated Image = (w/d)*(h/d)*1 (d > 1 only)
+    // -> GRAYSCALE Threhsolded Image = (w/d)*(h/d)*1
+    // -> UnionFind = (w/d)*(h/d)*2 (*4 for high res) (+(w/d)*(h/d)*1 for hash table)
+    //
+    // Everything but the input image only exists for the band being thresholded. The roi is
+    // split into horizontal bands overlapping by half a band when it doesn't fit in memory (or
+    // in the 16-bit union find without high res support). Tags must then be shorter than half
+    // a band to be found.
+    size_t resolution = roi->w * roi->h;
+    quad_decimate = IM_MAX(IM_MIN(quad_decimate, 4), 1);
+    int quad_w = roi->w / quad_decimate, quad_h = roi->h / quad_decimate;
+    size_t quad_row_need = quad_w * (((quad_decimate > 1) ? 1 : 0) + 1 + sizeof(struct ufrec) + 1);
+    if (fb_avail() <= (resolution + (quad_row_need * 8))) fb_alloc_fail();
+    int quad_rows = (fb_avail() - resolution) / quad_row_need;
+    // Bands leave at least half of the remaining memory to the detector.
+    if (quad_rows < quad_h) quad_rows /= 2;
+#ifndef IMLIB_ENABLE_HIGH_RES_APRILTAGS
+    quad_rows = IM_MIN(quad_rows, 65535 / quad_w);
+#endif
+    if (quad_rows < 8) fb_alloc_fail();
+    int band_h = (quad_rows < quad_h) ? (quad_rows * quad_decimate) : roi->h;
+    int band_step = (band_h < roi->h) ? (band_h / 2) : band_h;
+
+    size_t fb_alloc_need = resolution + (IM_MIN(quad_rows, quad_h) * quad_row_need); // read above...
+    arena_init(((fb_avail() - fb_alloc_need) / resolution) * resolution);
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = quad_decimate;
+
+    apriltag_add_families(td, families);
+
+    uint8_t *grayscale_image = fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
+
+    image_u8_t im;
+    im.width = roi->w;
+    im.height = roi->h;
+    im.stride = roi->w;
+    im.buf = grayscale_image;
+
+    apriltag_copy_grayscale(ptr, roi, grayscale_image);
+
+    zarray_t *detections = NULL;
+
+    for (int y = 0; ; y += band_step) {
+        image_u8_t band;
+        band.width = im.width;
+        band.height = IM_MIN(band_h, roi->h - y);
+        band.stride = im.stride;
+        band.buf = im.buf + (y * im.stride);
+
+        if (max_tags) {
+            td->max_detections = max_tags - (detections ? zarray_size(detections) : 0);
+        }
+
+        zarray_t *band_detections = apriltag_detector_detect(td, &band);
+
+        if (!detections) {
+            detections = band_detections;
+        } else {
+            // Move the band detections into roi coordinates.
+            for (int i = 0, j = zarray_size(band_detections); i < j; i++) {
+                apriltag_detection_t *det;
+                zarray_get(band_detections, i, &det);
+                apriltag_detection_translate(det, 0, y);
+                zarray_add(detections, &det);
+            }
+
+            zarray_destroy(band_detections);
+
+            // Tags in the overlap are found by both bands.
+            apriltag_reconcile_detections(detections);
+            zarray_sort(detections, detection_compare_function);
+        }
+
+        if (((y + band_h) >= roi->h) || (max_tags && (zarray_size(detections) >= max_tags)) || imlib_deadline_expired()) {
             break;
         }
     }
 
-    zarray_t *detections = apriltag_detector_detect(td, &im);
     list_init(out, sizeof(find_apriltags_list_lnk_data_t));
 
     for (int i = 0, j = zarray_size(detections); i < j; i++) {
@@ -48088,79 +48539,281 @@ void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_
         zarray_get(detections, i, &det);
 
         find_apriltags_list_lnk_data_t lnk_data;
-        rectangle_init(&(lnk_data.rect), fast_roundf(det->p[0][0]) + roi->x, fast_roundf(det->p[0][1]) + roi->y, 0, 0);
+        apriltag_detection_to_lnk(&lnk_data, det, roi, fx, fy, cx, cy);
+        list_push_back(out, &lnk_data);
+    }
 
-        for (size_t k = 1, l = (sizeof(det->p) / sizeof(det->p[0])); k < l; k++) {
-            rectangle_t temp;
-            rectangle_init(&temp, fast_roundf(det->p[k][0]) + roi->x, fast_roundf(det->p[k][1]) + roi->y, 0, 0);
-            rectangle_united(&(lnk_data.rect), &temp);
-        }
+    apriltag_detections_destroy(detections);
+    fb_free(); // grayscale_image;
+    apriltag_detector_destroy(td);
+    fb_free(); // arena_init();
+}
 
-        // Add corners...
-        lnk_data.corners[0].x = fast_roundf(det->p[3][0]) + roi->x; // top-left
-        lnk_data.corners[0].y = fast_roundf(det->p[3][1]) + roi->y; // top-left
-        lnk_data.corners[1].x = fast_roundf(det->p[2][0]) + roi->x; // top-right
-        lnk_data.corners[1].y = fast_roundf(det->p[2][1]) + roi->y; // top-right
-        lnk_data.corners[2].x = fast_roundf(det->p[1][0]) + roi->x; // bottom-right
-        lnk_data.corners[2].y = fast_roundf(det->p[1][1]) + roi->y; // bottom-right
-        lnk_data.corners[3].x = fast_roundf(det->p[0][0]) + roi->x; // bottom-left
-        lnk_data.corners[3].y = fast_roundf(det->p[0][1]) + roi->y; // bottom-left
+static apriltag_family_t *apriltag_family_from_bits(apriltag_families_t family)
+{
+    switch (family) {
+        case TAG16H5: return (apriltag_family_t *) &tag16h5;
+        case TAG25H7: return (apriltag_family_t *) &tag25h7;
+        case TAG25H9: return (apriltag_family_t *) &tag25h9;
+        case TAG36H8: return (apriltag_family_t *) &tag36h8;
+        case TAG36H10: return (apriltag_family_t *) &tag36h10;
+        case TAG36H11: return (apriltag_family_t *) &tag36h11;
+        case ARTOOLKIT: return (apriltag_family_t *) &artoolkit;
+        default: return NULL;
+    }
+}
 
-        lnk_data.id = det->id;
-        lnk_data.family = 0;
+void imlib_apriltag_tracker_alloc(apriltag_tracker_t *tracker, size_t tracks_max, int margin, int rescan)
+{
+    tracker->tracks = xalloc(tracks_max * sizeof(apriltag_track_t));
+    tracker->tracks_max = tracks_max;
+    tracker->margin = margin;
+    tracker->rescan = rescan;
+    imlib_apriltag_tracker_reset(tracker);
+}
 
-        if(det->family == &tag16h5) {
-            lnk_data.family |= TAG16H5;
-        }
+void imlib_apriltag_tracker_free(apriltag_tracker_t *tracker)
+{
+    xfree(tracker->tracks);
+}
 
-        if(det->family == &tag25h7) {
-            lnk_data.family |= TAG25H7;
+void imlib_apriltag_tracker_reset(apriltag_tracker_t *tracker)
+{
+    tracker->tracks_len = 0;
+    tracker->frames = 0;
+    tracker->lost = false;
+}
+
+// Between full searches each tag is looked for where its corners are predicted to be (moving as
+// much as they did over the last frame). The predicted quad is snapped to the tag edges and
+// decoded directly, without thresholding or segmentation. If that fails the normal pipeline is
+// run on the area around the prediction only. A tag lost by both forces a full search.
+void imlib_apriltag_tracker_update(apriltag_tracker_t *tracker, list_t *out, image_t *ptr, rectangle_t *roi,
+                                   apriltag_families_t families, float fx, float fy, float cx, float cy, int quad_decimate)
+{
+    size_t old_len = tracker->tracks_len;
+    bool rescan = tracker->lost || (!old_len) || (!(tracker->frames % tracker->rescan));
+    tracker->frames += 1;
+    tracker->lost = false;
+
+    if (rescan) {
+        imlib_find_apriltags(out, ptr, roi, families, fx, fy, cx, cy, quad_decimate, tracker->tracks_max);
+    } else {
+        list_init(out, sizeof(find_apriltags_list_lnk_data_t));
+
+        float (*quads)[4][2] = fb_alloc(old_len * sizeof(float [4][2]), FB_ALLOC_NO_HINT);
+        rectangle_t *areas = fb_alloc(old_len * sizeof(rectangle_t), FB_ALLOC_NO_HINT);
+        size_t area_max = 0;
+
+        for (size_t i = 0; i < old_len; i++) {
+            apriltag_track_t *track = &tracker->tracks[i];
+            float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+
+            for (int j = 0; j < 4; j++) {
+                quads[i][j][0] = track->p[j][0] + track->v[j][0];
+                quads[i][j][1] = track->p[j][1] + track->v[j][1];
+                min_x = IM_MIN(min_x, quads[i][j][0]);
+                min_y = IM_MIN(min_y, quads[i][j][1]);
+                max_x = IM_MAX(max_x, quads[i][j][0]);
+                max_y = IM_MAX(max_y, quads[i][j][1]);
+            }
+
+            rectangle_t *area = &areas[i];
+            rectangle_init(area, fast_floorf(min_x) - tracker->margin, fast_floorf(min_y) - tracker->margin,
+                           fast_ceilf(max_x - min_x) + 1 + (tracker->margin * 2),
+                           fast_ceilf(max_y - min_y) + 1 + (tracker->margin * 2));
+
+            if (rectangle_overlap(area, roi)) {
+                rectangle_intersected(area, roi);
+                area_max = IM_MAX(area_max, area->w * area->h);
+            } else {
+                area->w = area->h = 0;
+            }
         }
 
-        if(det->family == &tag25h9) {
-            lnk_data.family |= TAG25H9;
+        if (area_max) {
+            // Frame Buffer Memory Usage...
+            // -> GRAYSCALE Area Image = w*h*1
+            // -> GRAYSCALE Threhsolded Image = w*h*1
+            // -> UnionFind = w*h*2 (*4 for high res) (+w*h*1 for hash table)
+            size_t fb_alloc_need = area_max * (1 + 1 + sizeof(struct ufrec) + 1); // read above...
+            if (fb_avail() <= fb_alloc_need) fb_alloc_fail();
+            arena_init(((fb_avail() - fb_alloc_need) / area_max) * area_max);
+            apriltag_detector_t *td = apriltag_detector_create();
+            apriltag_add_families(td, families);
+
+            for (size_t i = 0; i < old_len; i++) {
+                apriltag_track_t *track = &tracker->tracks[i];
+                apriltag_family_t *family = apriltag_family_from_bits(track->family);
+                rectangle_t *area = &areas[i];
+
+                if ((!area->w) || (!area->h) || (!family)) {
+                    tracker->lost = true;
+                    continue;
+                }
+
+                image_u8_t im;
+                im.width = area->w;
+                im.height = area->h;
+                im.stride = area->w;
+                im.buf = fb_alloc(area->w * area->h, FB_ALLOC_NO_HINT);
+                apriltag_copy_grayscale(ptr, area, im.buf);
+
+                struct quad quad;
+                memset(&quad, 0, sizeof(struct quad));
+
+                for (int j = 0; j < 4; j++) {
+                    quad.p[j][0] = quads[i][j][0] - area->x;
+                    quad.p[j][1] = quads[i][j][1] - area->y;
+                }
+
+                apriltag_detection_t *det = NULL;
+                zarray_t *detections = NULL;
+
+                if (td->refine_edges) {
+                    refine_edges(td, &im, &quad);
+                }
+
+                if (!quad_update_homographies(&quad)) {
+                    struct quick_decode_entry entry;
+                    float decision_margin = quad_decode(family, &im, &quad, &entry, NULL);
+
+                    if ((entry.hamming < 255) && (decision_margin >= 0) && (entry.id == track->id)) {
+                        det = apriltag_make_detection(family, &quad, &entry, 0, decision_margin);
+                    }
+                }
+
+                matd_destroy(quad.H);
+                matd_destroy(quad.Hinv);
+
+                if (!det) {
+                    // The tag moved too far (or turned too much) for the prediction to be snapped
+                    // back onto it, look for the closest tag with the same id in the area.
+                    float pred_x = 0, pred_y = 0, best_d = FLT_MAX;
+
+                    for (int j = 0; j < 4; j++) {
+                        pred_x += (quads[i][j][0] - area->x) / 4;
+                        pred_y += (quads[i][j][1] - area->y) / 4;
+                    }
+
+                    detections = apriltag_detector_detect(td, &im);
+
+                    for (int j = 0, jj = zarray_size(detections); j < jj; j++) {
+                        apriltag_detection_t *d;
+                        zarray_get(detections, j, &d);
+
+                        float dist = sq(d->c[0] - pred_x) + sq(d->c[1] - pred_y);
+
+                        if ((d->family == family) && (d->id == track->id) && (dist < best_d)) {
+                            det = d;
+                            best_d = dist;
+                        }
+                    }
+                }
+
+                if (det) {
+                    apriltag_detection_translate(det, area->x - roi->x, area->y - roi->y);
+                    find_apriltags_list_lnk_data_t lnk_data;
+                    apriltag_detection_to_lnk(&lnk_data, det, roi, fx, fy, cx, cy);
+                    list_push_back(out, &lnk_data);
+                } else {
+                    tracker->lost = true;
+                }
+
+                if (detections) {
+                    apriltag_detections_destroy(detections);
+                } else {
+                    apriltag_detection_destroy(det);
+                }
+
+                fb_free(); // im.buf
+            }
+
+            apriltag_detector_destroy(td);
+            fb_free(); // arena_init();
+        } else {
+            tracker->lost = true;
         }
 
-        if(det->family == &tag36h8) {
-            lnk_data.family |= TAG36H8;
+        fb_free(); // areas
+        fb_free(); // quads
+    }
+
+    apriltag_track_t *old_tracks = fb_alloc(old_len * sizeof(apriltag_track_t), FB_ALLOC_NO_HINT);
+    memcpy(old_tracks, tracker->tracks, old_len * sizeof(apriltag_track_t));
+
+    size_t new_len = 0;
+    for (list_lnk_t *it = iterator_start_from_head(out); it && (new_len < tracker->tracks_max); it = iterator_next(it)) {
+        find_apriltags_list_lnk_data_t lnk_data;
+        iterator_get(out, it, &lnk_data);
+        apriltag_track_t *track = &tracker->tracks[new_len++];
+        track->id = lnk_data.id;
+        track->family = lnk_data.family;
+
+        for (int j = 0; j < 4; j++) {
+            track->p[j][0] = lnk_data.corners[j].x;
+            track->p[j][1] = lnk_data.corners[j].y;
         }
 
-        if(det->family == &tag36h10) {
-            lnk_data.family |= TAG36H10;
+        // refine_edges() searches outwards from the border of the tag, which depends on the
+        // winding of the quad (the corners of mirrored tags wind the other way).
+        float area = 0;
+
+        for (int j = 0; j < 4; j++) {
+            area += (track->p[j][0] * track->p[(j + 1) & 3][1]) - (track->p[(j + 1) & 3][0] * track->p[j][1]);
         }
 
-        if(det->family == &tag36h11) {
-            lnk_data.family |= TAG36H11;
+        if (area < 0) {
+            for (int k = 0; k < 2; k++) {
+                float tmp = track->p[1][k];
+                track->p[1][k] = track->p[3][k];
+                track->p[3][k] = tmp;
+            }
         }
 
-        if(det->family == &artoolkit) {
-            lnk_data.family |= ARTOOLKIT;
+        // Corners are matched to the previous ones (which may be in any order) closest first
+        // to get their motion.
+        apriltag_track_t *old_track = NULL;
+        float old_d = FLT_MAX;
+
+        for (size_t j = 0; j < old_len; j++) {
+            float dist = sq(old_tracks[j].p[0][0] - track->p[0][0]) + sq(old_tracks[j].p[0][1] - track->p[0][1]);
+
+            if ((old_tracks[j].id == track->id) && (old_tracks[j].family == track->family) && (dist < old_d)) {
+                old_track = &old_tracks[j];
+                old_d = dist;
+            }
         }
 
-        lnk_data.hamming = det->hamming;
-        lnk_data.centroid.x = fast_roundf(det->c[0]) + roi->x;
-        lnk_data.centroid.y = fast_roundf(det->c[1]) + roi->y;
-        lnk_data.goodness = det->goodness / 255.0; // scale to [0:1]
-        lnk_data.decision_margin = det->decision_margin / 255.0; // scale to [0:1]
+        memset(track->v, 0, sizeof(track->v));
 
-        matd_t *pose = homography_to_pose(det->H, -fx, fy, cx, cy);
+        if (old_track) {
+            int shift = 0;
+            float shift_d = FLT_MAX;
 
-        lnk_data.x_translation = MATD_EL(pose, 0, 3);
-        lnk_data.y_translation = MATD_EL(pose, 1, 3);
-        lnk_data.z_translation = MATD_EL(pose, 2, 3);
-        lnk_data.x_rotation = fast_atan2f(MATD_EL(pose, 2, 1), MATD_EL(pose, 2, 2));
-        lnk_data.y_rotation = fast_atan2f(-MATD_EL(pose, 2, 0), fast_sqrtf(sq(MATD_EL(pose, 2, 1)) + sq(MATD_EL(pose, 2, 2))));
-        lnk_data.z_rotation = fast_atan2f(MATD_EL(pose, 1, 0), MATD_EL(pose, 0, 0));
+            for (int k = 0; k < 4; k++) {
+                float dist = 0;
 
-        matd_destroy(pose);
+                for (int j = 0; j < 4; j++) {
+                    dist += sq(old_track->p[(j + k) & 3][0] - track->p[j][0]) + sq(old_track->p[(j + k) & 3][1] - track->p[j][1]);
+                }
 
-        list_push_back(out, &lnk_data);
+                if (dist < shift_d) {
+                    shift = k;
+                    shift_d = dist;
+                }
+            }
+
+            for (int j = 0; j < 4; j++) {
+                track->v[j][0] = track->p[j][0] - old_track->p[(j + shift) & 3][0];
+                track->v[j][1] = track->p[j][1] - old_track->p[(j + shift) & 3][1];
+            }
+        }
     }
 
-    apriltag_detections_destroy(detections);
-    fb_free(); // grayscale_image;
-    apriltag_detector_destroy(td);
-    fb_free(); // umm_init_x();
+    fb_free(); // old_tracks
+
+    tracker->tracks_len = new_len;
 }
 
 #ifdef IMLIB_ENABLE_FIND_RECTS
@@ -48172,7 +48825,7 @@ void imlib_find_rects(list_t *out, image_t *ptr, rectangle_t *roi, uint32_t thre
     // -> UnionFind = w*h*4 (+w*h*2 for hash table)
     size_t resolution = roi->w * roi->h;
     size_t fb_alloc_need = resolution * (1 + 1 + 4 + 2); // read above...
-    umm_init_x(((fb_avail() - fb_alloc_need) / resolution) * resolution);
+    arena_init(((fb_avail() - fb_alloc_need) / resolution) * resolution);
     apriltag_detector_t *td = apriltag_detector_create();
 
     uint8_t *grayscale_image = fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
@@ -48384,26 +49037,19 @@ void imlib_find_rects(list_t *out, image_t *ptr, rectangle_t *roi, uint32_t thre
     zarray_destroy(detections);
     fb_free(); // grayscale_image;
     apriltag_detector_destroy(td);
-    fb_free(); // umm_init_x();
+    fb_free(); // arena_init();
 }
 #endif //IMLIB_ENABLE_FIND_RECTS
 
 #ifdef IMLIB_ENABLE_ROTATION_CORR
 // http://jepsonsblog.blogspot.com/2012/11/rotation-in-3d-using-opencvs.html
-void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float z_rotation,
-                         float x_translation, float y_translation,
-                         float zoom, float fov, float *corners)
+// Computes the 3x3 (row major) matrix mapping output pixels to source pixels.
+bool imlib_rotation_corr_transform(int w, int h, float x_rotation, float y_rotation, float z_rotation,
+                                   float x_translation, float y_translation,
+                                   float zoom, float fov, float *corners, float *transform)
 {
-    // Create a tmp copy of the image to pull pixels from.
-    size_t size = image_size(img);
-    void *data = fb_alloc(size, FB_ALLOC_NO_HINT);
-    memcpy(data, img->data, size);
-    memset(img->data, 0, size);
-
-    umm_init_x(fb_avail());
+    arena_init(fb_avail());
 
-    int w = img->w;
-    int h = img->h;
     float z = (fast_sqrtf((w * w) + (h * h)) / 2) / tanf(fov / 2);
     float z_z = z * zoom;
 
@@ -48493,10 +49139,52 @@ void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float
         zarray_destroy(correspondences);
     }
 
-    if (T4) {
-        float T4_00 = MATD_EL(T4, 0, 0), T4_01 = MATD_EL(T4, 0, 1), T4_02 = MATD_EL(T4, 0, 2);
-        float T4_10 = MATD_EL(T4, 1, 0), T4_11 = MATD_EL(T4, 1, 1), T4_12 = MATD_EL(T4, 1, 2);
-        float T4_20 = MATD_EL(T4, 2, 0), T4_21 = MATD_EL(T4, 2, 1), T4_22 = MATD_EL(T4, 2, 2);
+    bool valid = T4 != NULL;
+
+    if (valid) {
+        for (int i = 0; i < 9; i++) {
+            transform[i] = MATD_EL(T4, i / 3, i % 3);
+        }
+
+        matd_destroy(T4);
+    }
+
+    matd_destroy(T3);
+    matd_destroy(T2);
+    matd_destroy(T1);
+    matd_destroy(A2);
+    matd_destroy(T);
+    matd_destroy(R);
+    matd_destroy(RZ);
+    matd_destroy(RY);
+    matd_destroy(RX);
+    matd_destroy(A1);
+
+    fb_free(); // arena_init();
+
+    return valid;
+}
+
+void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float z_rotation,
+                         float x_translation, float y_translation,
+                         float zoom, float fov, float *corners)
+{
+    int w = img->w;
+    int h = img->h;
+    float T4[9];
+    bool valid = imlib_rotation_corr_transform(w, h, x_rotation, y_rotation, z_rotation,
+                                               x_translation, y_translation, zoom, fov, corners, T4);
+
+    // Create a tmp copy of the image to pull pixels from.
+    size_t size = image_size(img);
+    void *data = fb_alloc(size, FB_ALLOC_NO_HINT);
+    memcpy(data, img->data, size);
+    memset(img->data, 0, size);
+
+    if (valid) {
+        float T4_00 = T4[0], T4_01 = T4[1], T4_02 = T4[2];
+        float T4_10 = T4[3], T4_11 = T4[4], T4_12 = T4[5];
+        float T4_20 = T4[6], T4_21 = T4[7], T4_22 = T4[8];
 
         if ((fast_fabsf(T4_20) < MATD_EPS) && (fast_fabsf(T4_21) < MATD_EPS)) { // warp affine
             T4_00 /= T4_22;
@@ -48634,23 +49322,8 @@ void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float
                 }
             }
         }
-
-        matd_destroy(T4);
     }
 
-    matd_destroy(T3);
-    matd_destroy(T2);
-    matd_destroy(T1);
-    matd_destroy(A2);
-    matd_destroy(T);
-    matd_destroy(R);
-    matd_destroy(RZ);
-    matd_destroy(RY);
-    matd_destroy(RX);
-    matd_destroy(A1);
-
-    fb_free(); // umm_init_x();
-
     fb_free();
 }
 #endif //IMLIB_ENABLE_ROTATION_CORR
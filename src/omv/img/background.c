@@ -0,0 +1,122 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Background model for foreground extraction.
+ */
+#include "imlib.h"
+
+#ifdef IMLIB_ENABLE_BACKGROUND_MODEL
+// The model keeps the background intensity of each pixel as a running average in 8.8 fixed
+// point. The gaussian model also keeps a running variance (in 8.8 fixed point gray levels^2)
+// and marks a pixel as foreground when it's more than threshold standard deviations away from
+// the mean, otherwise threshold is in gray levels. The first frames use a higher rate (the
+// cumulative average) so that the model settles quickly after a reset.
+#define BACKGROUND_MODEL_VAR_MIN    (4 << 8)
+#define BACKGROUND_MODEL_VAR_INIT   (64 << 8)
+#define BACKGROUND_MODEL_VAR_MAX    UINT16_MAX
+
+void imlib_background_model_alloc(background_model_t *model, int w, int h, bool gaussian)
+{
+    model->w = w;
+    model->h = h;
+    model->gaussian = gaussian;
+    model->mean = xalloc(w * h * sizeof(uint16_t));
+    model->var = gaussian ? xalloc(w * h * sizeof(uint16_t)) : NULL;
+    imlib_background_model_reset(model);
+}
+
+void imlib_background_model_free(background_model_t *model)
+{
+    if (model->var) {
+        xfree(model->var);
+    }
+
+    xfree(model->mean);
+}
+
+void imlib_background_model_reset(background_model_t *model)
+{
+    model->frames = 0;
+}
+
+static void background_model_line(image_t *img, int y, uint8_t *line)
+{
+    switch(img->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                line[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            memcpy(line, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y), img->w);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                line[x] = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void imlib_background_model_update(background_model_t *model, image_t *img, image_t *out, float alpha, float threshold)
+{
+    // Rate in 1/256ths, starting with 1/1, 1/2, 1/3... until it gets down to alpha.
+    bool init = !model->frames;
+    int a = IM_MAX(IM_MIN(fast_roundf(alpha * 256), 256), 1);
+    a = IM_MAX(a, 256 / (model->frames + 1));
+    model->frames = IM_MIN(model->frames + 1, 256);
+
+    // Gaussian: (d^2 << 4) > (var * t^2) with t^2 in 12.4 fixed point, average: |d| > t.
+    threshold = IM_MAX(threshold, 0);
+    uint32_t t = model->gaussian
+        ? fast_roundf(IM_MIN(threshold, 16) * IM_MIN(threshold, 16) * 16)
+        : fast_roundf(IM_MIN(threshold, COLOR_GRAYSCALE_MAX) * 256);
+
+    uint8_t *line = fb_alloc(img->w, FB_ALLOC_NO_HINT);
+
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
+        uint16_t *mean = model->mean + (y * img->w);
+        uint16_t *var = model->gaussian ? (model->var + (y * img->w)) : NULL;
+        background_model_line(img, y, line);
+
+        for (int x = 0, xx = img->w; x < xx; x += 32) {
+            uint32_t bits = 0;
+            for (int i = 0, ii = IM_MIN(32, xx - x); i < ii; i++) {
+                int pixel = line[x + i] << 8;
+                int m = init ? pixel : mean[x + i];
+                int d = pixel - m;
+                mean[x + i] = m + ((d * a) / 256);
+
+                if (init && var) {
+                    var[x + i] = BACKGROUND_MODEL_VAR_INIT;
+                } else if (var) {
+                    uint32_t d2 = (((uint32_t) abs(d)) * abs(d)) >> 8;
+                    int v = var[x + i];
+                    bits |= ((uint32_t) ((d2 << 4) > (v * t))) << i;
+                    v += ((((int) IM_MIN(d2, BACKGROUND_MODEL_VAR_MAX)) - v) * a) / 256;
+                    var[x + i] = IM_MAX(v, BACKGROUND_MODEL_VAR_MIN);
+                } else {
+                    bits |= ((uint32_t) (abs(d) > t)) << i;
+                }
+            }
+            out_row_ptr[x >> UINT32_T_SHIFT] = bits;
+        }
+    }
+
+    fb_free();
+}
+#endif //IMLIB_ENABLE_BACKGROUND_MODEL
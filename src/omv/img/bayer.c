@@ -0,0 +1,254 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Bayer demosaicing.
+ *
+ * The Bayer pattern from the sensor looks like this:
+ * +---+---+---+---+
+ * | B | G | B | G | Even rows
+ * +---+---+---+---+
+ * | G | R | G | R | Odd rows
+ * +---+---+---+---+
+ *
+ * Each row is converted from the 5 source rows around it (3 are used by the bilinear mode), the
+ * rows past the top and bottom edges are mirrored which keeps the Bayer phase. Pixels are done in
+ * pairs (an even and an odd column) so each loop has the formulas of a single phase. The pixels
+ * next to the left and right edges mirror their columns and are converted one by one.
+ *
+ * The edge-aware mode is "High-Quality Linear Interpolation for Demosaicing of Bayer-Patterned
+ * Color Images" (Malvar, He and Cutler), which corrects the bilinear estimates with the gradient
+ * of the color present at the pixel.
+ */
+#include "imlib.h"
+
+#define DEBAYER_Y(r, g, b)  ((((r) * 9770) + ((g) * 19182) + ((b) * 3736)) >> 15) // .299*r + .587*g + .114*b
+#define DEBAYER_CLAMP(v)    IM_MIN(IM_MAX((v), 0), 255)
+
+// Phases, ((y & 1) << 1) | (x & 1).
+#define DEBAYER_B           (0)
+#define DEBAYER_GB          (1) // Green on a blue row.
+#define DEBAYER_GR          (2) // Green on a red row.
+#define DEBAYER_R           (3)
+
+static void debayer_rows(image_t *img, int y, const uint8_t **rows)
+{
+    for (int i = -2; i <= 2; i++) {
+        int yy = y + i;
+        yy = (yy < 0) ? -yy : yy;
+        yy = (yy >= img->h) ? ((2 * img->h) - 2 - yy) : yy;
+        rows[i + 2] = img->pixels + (IM_MIN(IM_MAX(yy, 0), img->h - 1) * img->w);
+    }
+}
+
+static inline int debayer_mirror(int x, int w)
+{
+    x = (x < 0) ? -x : x;
+    x = (x >= w) ? ((2 * w) - 2 - x) : x;
+    return IM_MIN(IM_MAX(x, 0), w - 1);
+}
+
+static inline __attribute__((always_inline))
+void debayer_pixel(const uint8_t **rows, int xm2, int xm1, int x, int xp1, int xp2,
+                   int phase, bool edge_aware, int *r, int *g, int *b)
+{
+    const uint8_t *n2 = rows[0], *n1 = rows[1], *c0 = rows[2], *s1 = rows[3], *s2 = rows[4];
+    int c = c0[x];
+    int hor = c0[xm1] + c0[xp1];
+    int ver = n1[x] + s1[x];
+    int diag = n1[xm1] + n1[xp1] + s1[xm1] + s1[xp1];
+
+    if (!edge_aware) {
+        switch (phase) {
+            case DEBAYER_B: *b = c; *g = (hor + ver) >> 2; *r = diag >> 2; break;
+            case DEBAYER_GB: *g = c; *b = hor >> 1; *r = ver >> 1; break;
+            case DEBAYER_GR: *g = c; *r = hor >> 1; *b = ver >> 1; break;
+            default: *r = c; *g = (hor + ver) >> 2; *b = diag >> 2; break;
+        }
+    } else {
+        int hor2 = c0[xm2] + c0[xp2];
+        int ver2 = n2[x] + s2[x];
+        // The Malvar, He and Cutler filters scaled by 16.
+        int cross = (c << 3) + ((hor + ver) << 2) - ((hor2 + ver2) << 1);
+        int from_hor = (c * 10) + (hor << 3) - (hor2 << 1) - (diag << 1) + ver2;
+        int from_ver = (c * 10) + (ver << 3) - (ver2 << 1) - (diag << 1) + hor2;
+        int from_diag = (c * 12) + (diag << 2) - ((hor2 + ver2) * 3);
+
+        switch (phase) {
+            case DEBAYER_B: {
+                *b = c;
+                *g = DEBAYER_CLAMP((cross + 8) >> 4);
+                *r = DEBAYER_CLAMP((from_diag + 8) >> 4);
+                break;
+            }
+            case DEBAYER_GB: {
+                *g = c;
+                *b = DEBAYER_CLAMP((from_hor + 8) >> 4);
+                *r = DEBAYER_CLAMP((from_ver + 8) >> 4);
+                break;
+            }
+            case DEBAYER_GR: {
+                *g = c;
+                *r = DEBAYER_CLAMP((from_hor + 8) >> 4);
+                *b = DEBAYER_CLAMP((from_ver + 8) >> 4);
+                break;
+            }
+            default: {
+                *r = c;
+                *g = DEBAYER_CLAMP((cross + 8) >> 4);
+                *b = DEBAYER_CLAMP((from_diag + 8) >> 4);
+                break;
+            }
+        }
+    }
+}
+
+static inline __attribute__((always_inline))
+void debayer_put(image_bpp_t bpp, void *dst, int i, int r, int g, int b)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) dst, i, DEBAYER_Y(r, g, b) >> 7);
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            ((uint8_t *) dst)[i] = DEBAYER_Y(r, g, b);
+            break;
+        }
+        default: {
+            ((uint16_t *) dst)[i] = COLOR_R8_G8_B8_TO_RGB565(r, g, b);
+            break;
+        }
+    }
+}
+
+// Converts the pixels next to the left and right edges (or of images too small for the pairs).
+static void debayer_edge(image_t *img, const uint8_t **rows, int y, int x_offset, int x, int xx,
+                         bool edge_aware, image_bpp_t bpp, void *dst)
+{
+    int phase = (y & 1) << 1;
+
+    for (; x < xx; x++) {
+        int r, g, b;
+        debayer_pixel(rows, debayer_mirror(x - 2, img->w), debayer_mirror(x - 1, img->w), x,
+                      debayer_mirror(x + 1, img->w), debayer_mirror(x + 2, img->w),
+                      phase | (x & 1), edge_aware, &r, &g, &b);
+        debayer_put(bpp, dst, x - x_offset, r, g, b);
+    }
+}
+
+// Converts the pairs of pixels starting at x (even) while the pair is before x_stop, returns the
+// first column not converted.
+static inline __attribute__((always_inline))
+int debayer_pairs(const uint8_t **rows, int x_offset, int x, int x_stop, int phase, bool edge_aware,
+                  image_bpp_t bpp, bool packed, void *dst)
+{
+    for (; (x + 1) < x_stop; x += 2) {
+        int r0, g0, b0, r1, g1, b1;
+        debayer_pixel(rows, x - 2, x - 1, x, x + 1, x + 2, phase, edge_aware, &r0, &g0, &b0);
+        debayer_pixel(rows, x - 1, x, x + 1, x + 2, x + 3, phase + 1, edge_aware, &r1, &g1, &b1);
+
+        if ((bpp == IMAGE_BPP_RGB565) && packed) {
+            ((uint32_t *) dst)[(x - x_offset) >> 1] = COLOR_R8_G8_B8_TO_RGB565(r0, g0, b0)
+                                                   | (COLOR_R8_G8_B8_TO_RGB565(r1, g1, b1) << 16);
+        } else {
+            debayer_put(bpp, dst, x - x_offset, r0, g0, b0);
+            debayer_put(bpp, dst, x - x_offset + 1, r1, g1, b1);
+        }
+    }
+
+    return x;
+}
+
+static inline __attribute__((always_inline))
+void debayer_line(image_t *img, int x_offset, int y, int width, bool edge_aware, image_bpp_t bpp, void *dst)
+{
+    const uint8_t *rows[5];
+    debayer_rows(img, y, rows);
+
+    int xx = x_offset + width;
+    // The pairs start on an even column and need 2 columns on either side.
+    int x = IM_MIN(IM_MAX((x_offset + 1) & ~1, 2), xx);
+    int x_stop = IM_MIN(xx, img->w - 2);
+    // Two RGB565 pixels are written at once when the pairs are word aligned in the output.
+    bool packed = (!(x_offset & 1)) && (!(((uintptr_t) dst) & 3));
+
+    debayer_edge(img, rows, y, x_offset, x_offset, x, edge_aware, bpp, dst);
+
+    if (y & 1) {
+        x = edge_aware ? debayer_pairs(rows, x_offset, x, x_stop, DEBAYER_GR, true, bpp, packed, dst)
+                       : debayer_pairs(rows, x_offset, x, x_stop, DEBAYER_GR, false, bpp, packed, dst);
+    } else {
+        x = edge_aware ? debayer_pairs(rows, x_offset, x, x_stop, DEBAYER_B, true, bpp, packed, dst)
+                       : debayer_pairs(rows, x_offset, x, x_stop, DEBAYER_B, false, bpp, packed, dst);
+    }
+
+    debayer_edge(img, rows, y, x_offset, x, xx, edge_aware, bpp, dst);
+}
+
+static void debayer_line_rgb565(image_t *img, int x_offset, int y, int width, bool edge_aware, void *dst)
+{
+    debayer_line(img, x_offset, y, width, edge_aware, IMAGE_BPP_RGB565, dst);
+}
+
+static void debayer_line_grayscale(image_t *img, int x_offset, int y, int width, bool edge_aware, void *dst)
+{
+    debayer_line(img, x_offset, y, width, edge_aware, IMAGE_BPP_GRAYSCALE, dst);
+}
+
+static void debayer_line_binary(image_t *img, int x_offset, int y, int width, bool edge_aware, void *dst)
+{
+    debayer_line(img, x_offset, y, width, edge_aware, IMAGE_BPP_BINARY, dst);
+}
+
+void imlib_debayer_line(image_t *img, int x_offset, int y, int width, bool edge_aware, image_bpp_t bpp, void *dst)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            debayer_line_binary(img, x_offset, y, width, edge_aware, dst);
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            debayer_line_grayscale(img, x_offset, y, width, edge_aware, dst);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            debayer_line_rgb565(img, x_offset, y, width, edge_aware, dst);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void imlib_debayer_image(image_t *dst, image_t *src, bool edge_aware)
+{
+    for (int y = 0, yy = src->h; y < yy; y++) {
+        void *row_ptr = (dst->bpp == IMAGE_BPP_BINARY) ? ((void *) IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y))
+                      : (dst->bpp == IMAGE_BPP_RGB565) ? ((void *) IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y))
+                      : ((void *) IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y));
+        imlib_debayer_line(src, 0, y, src->w, edge_aware, dst->bpp, row_ptr);
+    }
+}
+
+void imlib_bayer_to_rgb565(image_t *img, int w, int h, int xoffs, int yoffs, uint16_t *rgbbuf)
+{
+    for (int y = yoffs; y < (yoffs + h); y++, rgbbuf += w) {
+        debayer_line_rgb565(img, xoffs, y, w, false, rgbbuf);
+    }
+}
+
+void imlib_bayer_to_y(image_t *img, int x_offset, int y_offset, int width, uint8_t *Y)
+{
+    debayer_line_grayscale(img, x_offset, y_offset, width, false, Y);
+}
+
+void imlib_bayer_to_binary(image_t *img, int x_offset, int y_offset, int width, uint8_t *binary)
+{
+    debayer_line_binary(img, x_offset, y_offset, width, false, binary);
+}
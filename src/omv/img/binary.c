@@ -11,66 +11,16 @@
 #include "imlib.h"
 
 #ifdef IMLIB_ENABLE_BINARY_OPS
-void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, bool zero, image_t *mask)
+// Writes the thresholded bitmap to out, keeping the source pixels outside of the mask, or zeroes
+// the source pixels set in the bitmap.
+static void binary_output(image_t *out, image_t *img, image_t *bmp, bool zero, image_t *mask)
 {
-    image_t bmp;
-    bmp.w = img->w;
-    bmp.h = img->h;
-    bmp.bpp = IMAGE_BPP_BINARY;
-    bmp.data = fb_alloc0(image_size(&bmp), FB_ALLOC_NO_HINT);
-
-    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-        color_thresholds_list_lnk_data_t lnk_data;
-        iterator_get(thresholds, it, &lnk_data);
-        switch(img->bpp) {
-            case IMAGE_BPP_BINARY: {
-                for (int y = 0, yy = img->h; y < yy; y++) {
-                    uint32_t *old_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
-                    for (int x = 0, xx = img->w; x < xx; x++) {
-                        if (COLOR_THRESHOLD_BINARY(IMAGE_GET_BINARY_PIXEL_FAST(old_row_ptr, x), &lnk_data, invert)) {
-                            IMAGE_SET_BINARY_PIXEL_FAST(bmp_row_ptr, x);
-                        }
-                    }
-                }
-                break;
-            }
-            case IMAGE_BPP_GRAYSCALE: {
-                for (int y = 0, yy = img->h; y < yy; y++) {
-                    uint8_t *old_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
-                    for (int x = 0, xx = img->w; x < xx; x++) {
-                        if (COLOR_THRESHOLD_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(old_row_ptr, x), &lnk_data, invert)) {
-                            IMAGE_SET_BINARY_PIXEL_FAST(bmp_row_ptr, x);
-                        }
-                    }
-                }
-                break;
-            }
-            case IMAGE_BPP_RGB565: {
-                for (int y = 0, yy = img->h; y < yy; y++) {
-                    uint16_t *old_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
-                    for (int x = 0, xx = img->w; x < xx; x++) {
-                        if (COLOR_THRESHOLD_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(old_row_ptr, x), &lnk_data, invert)) {
-                            IMAGE_SET_BINARY_PIXEL_FAST(bmp_row_ptr, x);
-                        }
-                    }
-                }
-                break;
-            }
-            default: {
-                break;
-            }
-        }
-    }
-
     switch(img->bpp) {
         case IMAGE_BPP_BINARY: {
             if (!zero) {
                 for (int y = 0, yy = img->h; y < yy; y++) {
                     uint32_t *old_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                     uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
                     for (int x = 0, xx = img->w; x < xx; x++) {
                         int pixel = ((!mask) || image_get_mask_pixel(mask, x, y))
@@ -82,7 +32,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
             } else {
                 for (int y = 0, yy = img->h; y < yy; y++) {
                     uint32_t *old_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                     uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
                     for (int x = 0, xx = img->w; x < xx; x++) {
                         int pixel = IMAGE_GET_BINARY_PIXEL_FAST(old_row_ptr, x);
@@ -99,7 +49,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 if (!zero) {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint8_t *old_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = ((!mask) || image_get_mask_pixel(mask, x, y))
@@ -111,7 +61,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 } else {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint8_t *old_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = COLOR_GRAYSCALE_TO_BINARY(IMAGE_GET_GRAYSCALE_PIXEL_FAST(old_row_ptr, x));
@@ -125,7 +75,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 if (!zero) {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint8_t *old_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint8_t *out_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = ((!mask) || image_get_mask_pixel(mask, x, y))
@@ -137,7 +87,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 } else {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint8_t *old_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint8_t *out_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(old_row_ptr, x);
@@ -155,7 +105,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 if (!zero) {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint16_t *old_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = ((!mask) || image_get_mask_pixel(mask, x, y))
@@ -167,7 +117,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 } else {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint16_t *old_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = COLOR_RGB565_TO_BINARY(IMAGE_GET_RGB565_PIXEL_FAST(old_row_ptr, x));
@@ -181,7 +131,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 if (!zero) {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint16_t *old_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint16_t *out_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = ((!mask) || image_get_mask_pixel(mask, x, y))
@@ -193,7 +143,7 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
                 } else {
                     for (int y = 0, yy = img->h; y < yy; y++) {
                         uint16_t *old_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(bmp, y);
                         uint16_t *out_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(out, y);
                         for (int x = 0, xx = img->w; x < xx; x++) {
                             int pixel = IMAGE_GET_RGB565_PIXEL_FAST(old_row_ptr, x);
@@ -210,6 +160,154 @@ void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, b
             break;
         }
     }
+}
+
+void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, bool zero, image_t *mask)
+{
+    image_t bmp;
+    bmp.w = img->w;
+    bmp.h = img->h;
+    bmp.bpp = IMAGE_BPP_BINARY;
+    bmp.data = fb_alloc0(image_size(&bmp), FB_ALLOC_NO_HINT);
+
+    // All thresholds are tested in one pass. Binary and grayscale pixels index a LUT of the union of
+    // the thresholds. RGB565 pixels index a bit mask of the thresholds each L, A and B value is in
+    // for up to 32 thresholds at a time, a pixel being in a threshold if its bit is set in all
+    // three. Bits are packed into words as they're computed.
+    switch(img->bpp) {
+        case IMAGE_BPP_BINARY:
+        case IMAGE_BPP_GRAYSCALE: {
+            uint8_t *lut = fb_alloc0(COLOR_GRAYSCALE_MAX + 1, FB_ALLOC_NO_HINT);
+
+            for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
+                color_thresholds_list_lnk_data_t lnk_data;
+                iterator_get(thresholds, it, &lnk_data);
+                for (int i = 0; i <= COLOR_GRAYSCALE_MAX; i++) {
+                    lut[i] |= (img->bpp == IMAGE_BPP_BINARY)
+                        ? ((i <= COLOR_BINARY_MAX) && COLOR_THRESHOLD_BINARY(i, &lnk_data, invert))
+                        : COLOR_THRESHOLD_GRAYSCALE(i, &lnk_data, invert);
+                }
+            }
+
+            for (int y = 0, yy = img->h; y < yy; y++) {
+                uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                uint32_t *old_binary_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                uint8_t *old_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+                for (int x = 0, xx = img->w; x < xx; x += 32) {
+                    uint32_t bits = 0;
+                    for (int i = 0, ii = IM_MIN(32, xx - x); i < ii; i++) {
+                        int pixel = (img->bpp == IMAGE_BPP_BINARY)
+                            ? IMAGE_GET_BINARY_PIXEL_FAST(old_binary_row_ptr, x + i)
+                            : old_row_ptr[x + i];
+                        bits |= ((uint32_t) lut[pixel]) << i;
+                    }
+                    bmp_row_ptr[x >> UINT32_T_SHIFT] = bits;
+                }
+            }
+
+            fb_free();
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint32_t *l_lut = fb_alloc(256 * 3 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+            uint32_t *a_lut = l_lut + 256 + 128; // A and B are signed
+            uint32_t *b_lut = a_lut + 256;
+
+            for (list_lnk_t *it = iterator_start_from_head(thresholds); it;) {
+                memset(l_lut, 0, 256 * 3 * sizeof(uint32_t));
+                uint32_t all = 0;
+
+                for (int t = 0; it && (t < 32); t++, it = iterator_next(it)) {
+                    color_thresholds_list_lnk_data_t lnk_data;
+                    iterator_get(thresholds, it, &lnk_data);
+                    for (int i = lnk_data.LMin; i <= lnk_data.LMax; i++) l_lut[i] |= 1U << t;
+                    for (int i = lnk_data.AMin; i <= lnk_data.AMax; i++) a_lut[i] |= 1U << t;
+                    for (int i = lnk_data.BMin; i <= lnk_data.BMax; i++) b_lut[i] |= 1U << t;
+                    all |= 1U << t;
+                }
+
+                // With invert a pixel is set if it's outside of any threshold.
+                uint32_t match = invert ? all : 0;
+
+                for (int y = 0, yy = img->h; y < yy; y++) {
+                    uint16_t *old_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+                    uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+                    for (int x = 0, xx = img->w; x < xx; x += 32) {
+                        uint32_t bits = 0;
+                        for (int i = 0, ii = IM_MIN(32, xx - x); i < ii; i++) {
+                            int pixel = old_row_ptr[x + i];
+                            uint32_t in = l_lut[COLOR_RGB565_TO_L(pixel)]
+                                        & a_lut[COLOR_RGB565_TO_A(pixel)]
+                                        & b_lut[COLOR_RGB565_TO_B(pixel)];
+                            bits |= ((uint32_t) (in != match)) << i;
+                        }
+                        bmp_row_ptr[x >> UINT32_T_SHIFT] |= bits;
+                    }
+                }
+            }
+
+            fb_free();
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+
+    binary_output(out, img, &bmp, zero, mask);
+
+    fb_free();
+}
+
+// Sets the pixels brighter than the mean of their (ksize*2+1)^2 window minus offset, like
+// mean(threshold=True) but in O(1) per pixel. The window sums come from a moving window integral
+// image that holds ksize*2+2 lines, and the window is cropped to the image at the borders.
+void imlib_adaptive_binary(image_t *out, image_t *img, int ksize, int offset, bool invert, bool zero, image_t *mask)
+{
+    image_t bmp;
+    bmp.w = img->w;
+    bmp.h = img->h;
+    bmp.bpp = IMAGE_BPP_BINARY;
+    bmp.data = fb_alloc0(image_size(&bmp), FB_ALLOC_NO_HINT);
+
+    mw_image_t sum;
+    imlib_integral_mw_alloc(&sum, img->w, IM_MIN((ksize * 2) + 2, img->h));
+    imlib_integral_mw(img, &sum);
+
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        int y0 = IM_MAX(y - ksize, 0);
+        int y1 = IM_MIN(y + ksize, img->h - 1);
+
+        while (sum.y_offs <= y1) {
+            imlib_integral_mw_shift(img, &sum, 1);
+        }
+
+        // The window holds image lines y_offs - h to y_offs - 1.
+        uint32_t *top_row_ptr = y0 ? sum.data[y0 - 1 - (sum.y_offs - sum.h)] : NULL;
+        uint32_t *bot_row_ptr = sum.data[y1 - (sum.y_offs - sum.h)];
+        uint32_t *bmp_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&bmp, y);
+        int rows = y1 - y0 + 1;
+
+        for (int x = 0, xx = img->w; x < xx; x++) {
+            int x0 = IM_MAX(x - ksize, 0);
+            int x1 = IM_MIN(x + ksize, img->w - 1);
+            int32_t acc = bot_row_ptr[x1] - (x0 ? bot_row_ptr[x0 - 1] : 0);
+
+            if (top_row_ptr) {
+                acc -= top_row_ptr[x1] - (x0 ? top_row_ptr[x0 - 1] : 0);
+            }
+
+            // floor(mean) - offset < pixel without the divide.
+            int32_t count = rows * (x1 - x0 + 1);
+            if ((acc < ((IM_TO_GS_PIXEL(img, x, y) + offset) * count)) ^ invert) {
+                IMAGE_SET_BINARY_PIXEL_FAST(bmp_row_ptr, x);
+            }
+        }
+    }
+
+    imlib_integral_mw_free(&sum);
+
+    binary_output(out, img, &bmp, zero, mask);
 
     fb_free();
 }
@@ -667,8 +765,154 @@ void imlib_b_xnor(image_t *img, const char *path, image_t *other, int scalar, im
     imlib_image_operation(img, path, other, scalar, imlib_b_xnor_line_op, mask);
 }
 
+// Bit parallel erode/dilate for unmasked binary images with the default thresholds, where erode is
+// the AND and dilate the OR of the window. Replicating the border pixels gives the same result as
+// leaving out the pixels outside of the image, so those are filled with the identity (ones for
+// the AND, zeros for the OR). Rows are first reduced horizontally by doubling shifted copies of
+// the padded row (log2(ksize * 2 + 1) steps), then the columns of words are reduced vertically with the
+// van Herk/Gil-Werman algorithm (3 operations per word for any ksize).
+static void erode_dilate_shift(uint32_t *dst, const uint32_t *src, int words, int shift, uint32_t fill)
+{
+    // dst bit x = src bit x + shift.
+    for (int i = 0; i < words; i++) {
+        int bit = (i * 32) + shift;
+        int q = (bit >= 0) ? (bit / 32) : -((31 - bit) / 32);
+        int r = bit - (q * 32);
+        uint32_t lo = ((q >= 0) && (q < words)) ? src[q] : fill;
+
+        if (r) {
+            uint32_t hi = (((q + 1) >= 0) && ((q + 1) < words)) ? src[q + 1] : fill;
+            lo = (lo >> r) | (hi << (32 - r));
+        }
+
+        dst[i] = lo;
+    }
+}
+
+static void erode_dilate_binary(image_t *img, int ksize, int e_or_d)
+{
+    int n = (ksize * 2) + 1;
+    int words = IMAGE_BINARY_LINE_LEN(img);
+    int padded_words = (img->w + (ksize * 2) + UINT32_T_MASK) >> UINT32_T_SHIFT;
+    int tail = img->w % 32;
+    int len = img->h + (ksize * 2);
+    uint32_t fill = e_or_d ? 0 : 0xFFFFFFFF;
+
+    uint32_t *rows = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * img->h, FB_ALLOC_NO_HINT);
+    uint32_t *cur = fb_alloc(padded_words * sizeof(uint32_t) * 2, FB_ALLOC_NO_HINT);
+    uint32_t *tmp = cur + padded_words;
+    uint32_t *g = fb_alloc(len * sizeof(uint32_t) * 2, FB_ALLOC_NO_HINT);
+    uint32_t *h = g + len;
+
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+        memcpy(tmp, row_ptr, IMAGE_BINARY_LINE_LEN_BYTES(img));
+
+        if (tail) {
+            uint32_t pad = 0xFFFFFFFF << tail;
+            tmp[words - 1] = e_or_d ? (tmp[words - 1] & ~pad) : (tmp[words - 1] | pad);
+        }
+
+        for (int i = words; i < padded_words; i++) {
+            tmp[i] = fill;
+        }
+
+        // Pixel x moves to bit x + ksize so that bit x of the result reduces the window of pixel x.
+        erode_dilate_shift(cur, tmp, padded_words, -ksize, fill);
+
+        // cur bit x reduces the padded bits x to x + m - 1.
+        int m = 1;
+
+        for (; (m * 2) <= n; m *= 2) {
+            erode_dilate_shift(tmp, cur, padded_words, m, fill);
+            for (int i = 0; i < padded_words; i++) {
+                cur[i] = e_or_d ? (cur[i] | tmp[i]) : (cur[i] & tmp[i]);
+            }
+        }
+
+        if (m < n) {
+            erode_dilate_shift(tmp, cur, padded_words, n - m, fill);
+            for (int i = 0; i < padded_words; i++) {
+                cur[i] = e_or_d ? (cur[i] | tmp[i]) : (cur[i] & tmp[i]);
+            }
+        }
+
+        memcpy(rows + (y * words), cur, IMAGE_BINARY_LINE_LEN_BYTES(img));
+    }
+
+    for (int i = 0; i < words; i++) {
+        // g is the reduction from the start of each n line block and h to its end.
+        for (int t = 0; t < len; t++) {
+            int y = t - ksize;
+            uint32_t a = ((y >= 0) && (y < img->h)) ? rows[(y * words) + i] : fill;
+            g[t] = (t % n) ? (e_or_d ? (g[t - 1] | a) : (g[t - 1] & a)) : a;
+        }
+
+        for (int t = len - 1; t >= 0; t--) {
+            int y = t - ksize;
+            uint32_t a = ((y >= 0) && (y < img->h)) ? rows[(y * words) + i] : fill;
+            h[t] = (((t % n) == (n - 1)) || (t == (len - 1))) ? a : (e_or_d ? (h[t + 1] | a) : (h[t + 1] & a));
+        }
+
+        for (int y = 0, yy = img->h; y < yy; y++) {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+            row_ptr[i] = e_or_d ? (h[y] | g[y + n - 1]) : (h[y] & g[y + n - 1]);
+        }
+    }
+
+    fb_free(); // g/h
+    fb_free(); // cur/tmp
+    fb_free(); // rows
+}
+
+// Grayscale pixels count as set when >= 128 (like the generic code below) so the normal erode
+// clears the pixels with a window min < 128 and the normal dilate sets the pixels with a window
+// max >= 128, the window extremums come from imlib_sliding_min_max() for any ksize. Returns false
+// if there isn't enough memory.
+static bool erode_dilate_grayscale(image_t *img, int ksize, int e_or_d, image_t *mask)
+{
+    int size = img->w * img->h;
+
+    if (fb_avail() < (size + ((IM_MAX(img->w, img->h) + (ksize * 2)) * 2) + 64)) {
+        return false;
+    }
+
+    uint8_t *extremum = fb_alloc(size, FB_ALLOC_NO_HINT);
+    imlib_sliding_min_max(img->pixels, img->w, img->h, ksize, e_or_d ? NULL : extremum, e_or_d ? extremum : NULL);
+
+    for (int y = 0, i = 0, yy = img->h; y < yy; y++) {
+        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+
+        for (int x = 0, xx = img->w; x < xx; x++, i++) {
+            if (mask && (!image_get_mask_pixel(mask, x, y))) {
+                continue; // Short circuit.
+            }
+
+            if (e_or_d && (extremum[i] >> 7)) {
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, COLOR_GRAYSCALE_BINARY_MAX);
+            } else if ((!e_or_d) && (!(extremum[i] >> 7))) {
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, COLOR_GRAYSCALE_BINARY_MIN);
+            }
+        }
+    }
+
+    fb_free();
+    return true;
+}
+
 static void imlib_erode_dilate(image_t *img, int ksize, int threshold, int e_or_d, image_t *mask)
 {
+    bool normal = threshold == (e_or_d ? 0 : ((((ksize * 2) + 1) * ((ksize * 2) + 1)) - 1));
+
+    if ((!mask) && (img->bpp == IMAGE_BPP_BINARY) && normal) {
+        erode_dilate_binary(img, ksize, e_or_d);
+        return;
+    }
+
+    if ((img->bpp == IMAGE_BPP_GRAYSCALE) && normal && erode_dilate_grayscale(img, ksize, e_or_d, mask)) {
+        return;
+    }
+
     int brows = ksize + 1;
     image_t buf;
     buf.w = img->w;
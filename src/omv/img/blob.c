@@ -8,6 +8,7 @@
  *
  * Blob detection code.
  */
+#include <stdlib.h>
 #include "imlib.h"
 
 typedef struct xylr {
@@ -129,12 +130,10 @@ static float calc_roundness(float blob_a, float blob_b, float blob_c)
     return IM_DIV(roundness_min, roundness_max);
 }
 
-void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
-                      list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold,
-                      bool merge, int margin,
-                      bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg,
-                      bool (*merge_cb)(void*,find_blobs_list_lnk_data_t*,find_blobs_list_lnk_data_t*), void *merge_cb_arg,
-                      unsigned int x_hist_bins_max, unsigned int y_hist_bins_max)
+static void find_blobs_flood_fill(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
+                                  list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold,
+                                  bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg,
+                                  unsigned int x_hist_bins_max, unsigned int y_hist_bins_max)
 {
     // Same size as the image so we don't have to translate.
     image_t bmp;
@@ -153,7 +152,6 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
     size_t lifo_len;
     lifo_alloc_all(&lifo, &lifo_len, sizeof(xylr_t));
 
-    list_init(out, sizeof(find_blobs_list_lnk_data_t));
 
     size_t code = 0;
     for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
@@ -383,6 +381,7 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
                                 lnk_blob.perimeter = blob_perimeter;
                                 lnk_blob.code = 1 << code;
                                 lnk_blob.count = 1;
+                                lnk_blob.id = 0;
                                 lnk_blob.centroid_x = b_mx;
                                 lnk_blob.centroid_y = b_my;
                                 lnk_blob.rotation = (small_blob_a != small_blob_c) ? (fast_atan2f(2 * small_blob_b, small_blob_a - small_blob_c) / 2.0f) : 0.0f;
@@ -643,6 +642,7 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
                                 lnk_blob.perimeter = blob_perimeter;
                                 lnk_blob.code = 1 << code;
                                 lnk_blob.count = 1;
+                                lnk_blob.id = 0;
                                 lnk_blob.centroid_x = b_mx;
                                 lnk_blob.centroid_y = b_my;
                                 lnk_blob.rotation = (small_blob_a != small_blob_c) ? (fast_atan2f(2 * small_blob_b, small_blob_a - small_blob_c) / 2.0f) : 0.0f;
@@ -903,6 +903,7 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
                                 lnk_blob.perimeter = blob_perimeter;
                                 lnk_blob.code = 1 << code;
                                 lnk_blob.count = 1;
+                                lnk_blob.id = 0;
                                 lnk_blob.centroid_x = b_mx;
                                 lnk_blob.centroid_y = b_my;
                                 lnk_blob.rotation = (small_blob_a != small_blob_c) ? (fast_atan2f(2 * small_blob_b, small_blob_a - small_blob_c) / 2.0f) : 0.0f;
@@ -953,84 +954,861 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
     if (y_hist_bins) fb_free();
     if (x_hist_bins) fb_free();
     fb_free(); // bitmap
+}
+
+// Run length engine: every row is thresholded once for all thresholds, split into runs of pixels
+// matching the same threshold and the runs are labeled with union-find against the runs of the
+// row above. Labels keep the blob accumulators and are emitted as soon as a row doesn't extend
+// them anymore, so only the labels of the blobs crossing the current row are live at a time.
+typedef struct find_blobs_rle_run {
+    int16_t l, r;
+    uint16_t label;
+} find_blobs_rle_run_t;
+
+typedef struct find_blobs_rle_label {
+    uint16_t parent; // Itself for roots, the label merged into otherwise (or the next free label).
+    int16_t y; // Last row extending the blob.
+    uint8_t code;
+    bool seeded; // Contains a pixel the flood fill engine would have started from (x/y_stride).
+    uint32_t pixels, perimeter;
+    int32_t cx, cy;
+    long long a, b, c;
+    float corners_acc[FIND_BLOBS_CORNERS_RESOLUTION];
+    point_t corners[FIND_BLOBS_CORNERS_RESOLUTION];
+    uint16_t corners_n[FIND_BLOBS_CORNERS_RESOLUTION];
+} find_blobs_rle_label_t;
+
+typedef struct find_blobs_rle {
+    find_blobs_rle_label_t *labels;
+    uint16_t *active;
+    size_t active_len;
+    int free_head;
+} find_blobs_rle_t;
+
+// Returns the index + 1 of the first threshold the pixel matches (or 0). Like the flood fill engine,
+// which doesn't visit pixels twice, pixels only go to the first matching threshold.
+static int find_blobs_rle_code(image_t *ptr, int x, int y, color_thresholds_list_lnk_data_t *thresholds,
+                               size_t thresholds_len, bool invert)
+{
+    switch(ptr->bpp) {
+        case IMAGE_BPP_BINARY: {
+            int pixel = IMAGE_GET_BINARY_PIXEL_FAST(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y), x);
+            for (size_t i = 0; i < thresholds_len; i++) {
+                if (COLOR_THRESHOLD_BINARY(pixel, &thresholds[i], invert)) {
+                    return i + 1;
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y), x);
+            for (size_t i = 0; i < thresholds_len; i++) {
+                if (COLOR_THRESHOLD_GRAYSCALE(pixel, &thresholds[i], invert)) {
+                    return i + 1;
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            int pixel = IMAGE_GET_RGB565_PIXEL_FAST(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y), x);
+            for (size_t i = 0; i < thresholds_len; i++) {
+                if (COLOR_THRESHOLD_RGB565(pixel, &thresholds[i], invert)) {
+                    return i + 1;
+                }
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void find_blobs_rle_codes(image_t *ptr, rectangle_t *roi, int y, uint8_t *codes,
+                                 color_thresholds_list_lnk_data_t *thresholds, size_t thresholds_len, bool invert)
+{
+    for (int x = 0, xx = roi->w; x < xx; x++) {
+        codes[x] = find_blobs_rle_code(ptr, roi->x + x, y, thresholds, thresholds_len, invert);
+    }
+}
+
+static int find_blobs_rle_find(find_blobs_rle_t *rle, int label)
+{
+    while (rle->labels[label].parent != label) {
+        rle->labels[label].parent = rle->labels[rle->labels[label].parent].parent;
+        label = rle->labels[label].parent;
+    }
+
+    return label;
+}
+
+static int find_blobs_rle_new_label(find_blobs_rle_t *rle, int y, int code)
+{
+    int label = rle->free_head;
+
+    if (label >= 0) {
+        find_blobs_rle_label_t *l = &rle->labels[label];
+        rle->free_head = (l->parent != label) ? l->parent : -1;
+        memset(l, 0, sizeof(find_blobs_rle_label_t));
+        l->parent = label;
+        l->y = y;
+        l->code = code;
+        rle->active[rle->active_len++] = label;
+    }
+
+    return label;
+}
+
+static void find_blobs_rle_free_label(find_blobs_rle_t *rle, int label)
+{
+    rle->labels[label].parent = (rle->free_head >= 0) ? rle->free_head : label;
+    rle->free_head = label;
+}
+
+static void find_blobs_rle_add_run(find_blobs_rle_label_t *l, int left, int right, int y, int perimeter, bool seeded)
+{
+    int sum = sum_m_to_n(left, right);
+    int cnt = right - left + 1;
+    int avg = sum / cnt;
+
+    for (int i = 0; i < FIND_BLOBS_CORNERS_RESOLUTION; i++) {
+        int x_new = (cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i] > 0) ? left :
+                    ((cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i] == 0) ? avg :
+                                                                      right);
+        float z = (x_new * cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i]) +
+                  (y * sin_table[FIND_BLOBS_ANGLE_RESOLUTION*i]);
+        if ((!l->pixels) || (z < l->corners_acc[i])) {
+            l->corners_acc[i] = z;
+            l->corners[i].x = x_new;
+            l->corners[i].y = y;
+            l->corners_n[i] = 1;
+        } else if (z == l->corners_acc[i]) {
+            l->corners[i].x = cumulative_moving_average(l->corners[i].x, x_new, l->corners_n[i]);
+            l->corners[i].y = cumulative_moving_average(l->corners[i].y, y, l->corners_n[i]);
+            l->corners_n[i] += 1;
+        }
+    }
+
+    l->pixels += cnt;
+    l->perimeter += perimeter;
+    l->cx += sum;
+    l->cy += y * cnt;
+    l->a += sum_2_m_to_n(left, right);
+    l->b += y * sum;
+    l->c += y * y * cnt;
+    l->seeded |= seeded;
+}
+
+static void find_blobs_rle_merge(find_blobs_rle_label_t *dst, find_blobs_rle_label_t *src)
+{
+    for (int i = 0; i < FIND_BLOBS_CORNERS_RESOLUTION; i++) {
+        if (src->corners_acc[i] < dst->corners_acc[i]) {
+            dst->corners_acc[i] = src->corners_acc[i];
+            dst->corners[i] = src->corners[i];
+            dst->corners_n[i] = src->corners_n[i];
+        } else if (src->corners_acc[i] == dst->corners_acc[i]) {
+            int n = dst->corners_n[i] + src->corners_n[i];
+            dst->corners[i].x = ((dst->corners[i].x * dst->corners_n[i]) + (src->corners[i].x * src->corners_n[i])) / n;
+            dst->corners[i].y = ((dst->corners[i].y * dst->corners_n[i]) + (src->corners[i].y * src->corners_n[i])) / n;
+            dst->corners_n[i] = n;
+        }
+    }
+
+    dst->pixels += src->pixels;
+    dst->perimeter += src->perimeter;
+    dst->cx += src->cx;
+    dst->cy += src->cy;
+    dst->a += src->a;
+    dst->b += src->b;
+    dst->c += src->c;
+    dst->seeded |= src->seeded;
+}
+
+static void find_blobs_rle_emit(list_t *out, find_blobs_rle_label_t *l,
+                                unsigned int area_threshold, unsigned int pixels_threshold,
+                                bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg)
+{
+    rectangle_t rect;
+    rect.x = l->corners[(FIND_BLOBS_CORNERS_RESOLUTION*0)/4].x; // l
+    rect.y = l->corners[(FIND_BLOBS_CORNERS_RESOLUTION*1)/4].y; // t
+    rect.w = l->corners[(FIND_BLOBS_CORNERS_RESOLUTION*2)/4].x - l->corners[(FIND_BLOBS_CORNERS_RESOLUTION*0)/4].x + 1; // r - l + 1
+    rect.h = l->corners[(FIND_BLOBS_CORNERS_RESOLUTION*3)/4].y - l->corners[(FIND_BLOBS_CORNERS_RESOLUTION*1)/4].y + 1; // b - t + 1
+
+    if ((!l->seeded) || ((rect.w * rect.h) < area_threshold) || (l->pixels < pixels_threshold)) {
+        return;
+    }
+
+    // Same moments as the flood fill engine.
+    float b_mx = l->cx / ((float) l->pixels);
+    float b_my = l->cy / ((float) l->pixels);
+    int mx = fast_roundf(b_mx); // x centroid
+    int my = fast_roundf(b_my); // y centroid
+    int small_blob_a = l->a - ((mx * l->cx) + (mx * l->cx)) + (l->pixels * mx * mx);
+    int small_blob_b = l->b - ((mx * l->cy) + (my * l->cx)) + (l->pixels * mx * my);
+    int small_blob_c = l->c - ((my * l->cy) + (my * l->cy)) + (l->pixels * my * my);
+
+    find_blobs_list_lnk_data_t lnk_blob;
+    memcpy(lnk_blob.corners, l->corners, FIND_BLOBS_CORNERS_RESOLUTION * sizeof(point_t));
+    memcpy(&lnk_blob.rect, &rect, sizeof(rectangle_t));
+    lnk_blob.pixels = l->pixels;
+    lnk_blob.perimeter = l->perimeter;
+    lnk_blob.code = 1 << l->code;
+    lnk_blob.count = 1;
+    lnk_blob.id = 0;
+    lnk_blob.centroid_x = b_mx;
+    lnk_blob.centroid_y = b_my;
+    lnk_blob.rotation = (small_blob_a != small_blob_c) ? (fast_atan2f(2 * small_blob_b, small_blob_a - small_blob_c) / 2.0f) : 0.0f;
+    lnk_blob.roundness = calc_roundness(small_blob_a, small_blob_b, small_blob_c);
+    lnk_blob.x_hist_bins_count = 0;
+    lnk_blob.x_hist_bins = NULL;
+    lnk_blob.y_hist_bins_count = 0;
+    lnk_blob.y_hist_bins = NULL;
+    // These store the current average accumulation.
+    lnk_blob.centroid_x_acc = lnk_blob.centroid_x * lnk_blob.pixels;
+    lnk_blob.centroid_y_acc = lnk_blob.centroid_y * lnk_blob.pixels;
+    lnk_blob.rotation_acc_x = cosf(lnk_blob.rotation) * lnk_blob.pixels;
+    lnk_blob.rotation_acc_y = sinf(lnk_blob.rotation) * lnk_blob.pixels;
+    lnk_blob.roundness_acc = lnk_blob.roundness * lnk_blob.pixels;
+
+    if (((threshold_cb_arg == NULL) || threshold_cb(threshold_cb_arg, &lnk_blob))) {
+        list_push_back(out, &lnk_blob);
+    }
+}
+
+// Frees the labels merged into others and emits the blobs not extended by row y.
+static void find_blobs_rle_sweep(list_t *out, find_blobs_rle_t *rle, int y,
+                                 unsigned int area_threshold, unsigned int pixels_threshold,
+                                 bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < rle->active_len; i++) {
+        int label = rle->active[i];
+        find_blobs_rle_label_t *l = &rle->labels[label];
+
+        if (l->parent != label) {
+            find_blobs_rle_free_label(rle, label);
+        } else if (l->y != y) {
+            find_blobs_rle_emit(out, l, area_threshold, pixels_threshold, threshold_cb, threshold_cb_arg);
+            find_blobs_rle_free_label(rle, label);
+        } else {
+            rle->active[n++] = label;
+        }
+    }
+
+    rle->active_len = n;
+}
+
+// Returns false if there isn't enough memory for the labels, then out is left empty.
+static bool find_blobs_rle(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
+                           list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold,
+                           bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg)
+{
+    size_t thresholds_len = list_size(thresholds);
+    if (thresholds_len > 32) {
+        return false;
+    }
+
+    color_thresholds_list_lnk_data_t *thresholds_array =
+        fb_alloc(thresholds_len * sizeof(color_thresholds_list_lnk_data_t), FB_ALLOC_NO_HINT);
+    size_t i = 0;
+    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it), i++) {
+        iterator_get(thresholds, it, &thresholds_array[i]);
+    }
+
+    // Rows above, current and below.
+    uint8_t *codes = fb_alloc(roi->w * 3 * sizeof(uint8_t), FB_ALLOC_NO_HINT);
+    uint8_t *above = codes, *row = codes + roi->w, *below = codes + (roi->w * 2);
+
+    // Previous and current row runs of each threshold.
+    size_t runs_max = (roi->w + 1) / 2;
+    find_blobs_rle_run_t *runs = fb_alloc(thresholds_len * runs_max * 2 * sizeof(find_blobs_rle_run_t), FB_ALLOC_NO_HINT);
+    size_t prev_len[thresholds_len], curr_len[thresholds_len], prev_i[thresholds_len];
+    find_blobs_rle_run_t *prev[thresholds_len], *curr[thresholds_len];
+
+    for (size_t t = 0; t < thresholds_len; t++) {
+        prev[t] = runs + (t * runs_max * 2);
+        curr[t] = prev[t] + runs_max;
+        curr_len[t] = 0;
+    }
+
+    uint32_t labels_size;
+    find_blobs_rle_t rle;
+    rle.labels = fb_alloc_all(&labels_size, FB_ALLOC_NO_HINT);
+    size_t labels_max = IM_MIN(labels_size / (sizeof(find_blobs_rle_label_t) + sizeof(uint16_t)), UINT16_MAX);
+    rle.active = (uint16_t *) (rle.labels + labels_max);
+    rle.active_len = 0;
+    rle.free_head = -1;
+    for (int label = labels_max - 1; label >= 0; label--) {
+        find_blobs_rle_free_label(&rle, label);
+    }
+
+    bool ok = true;
+    find_blobs_rle_codes(ptr, roi, roi->y, below, thresholds_array, thresholds_len, invert);
+
+    for (int y = roi->y, yy = roi->y + roi->h; ok && (y < yy); y++) {
+        uint8_t *tmp = above;
+        above = row;
+        row = below;
+        below = tmp;
+
+        if ((y + 1) < yy) {
+            find_blobs_rle_codes(ptr, roi, y + 1, below, thresholds_array, thresholds_len, invert);
+        }
+
+        for (size_t t = 0; t < thresholds_len; t++) {
+            find_blobs_rle_run_t *tmp_runs = prev[t];
+            prev[t] = curr[t];
+            curr[t] = tmp_runs;
+            prev_len[t] = curr_len[t];
+            curr_len[t] = 0;
+            prev_i[t] = 0;
+        }
+
+        bool seed_row = !((y - roi->y) % y_stride);
+        int seed_x = roi->x + (y % x_stride);
+
+        for (int x = 0, xx = roi->w; x < xx; x++) {
+            int code = row[x];
+            if (!code) {
+                continue;
+            }
+
+            int left = x;
+            while (((x + 1) < xx) && (row[x + 1] == code)) {
+                x++;
+            }
+            int right = x;
+
+            // Like the flood fill engine: the ends of the run, the pixels above and below the
+            // run that aren't in the blob and the whole run on the edges of the roi.
+            int perimeter = 2;
+            if (y == roi->y) {
+                perimeter += right - left + 1;
+            } else {
+                for (int e = left + 1; e < right; e++) {
+                    perimeter += above[e] != code;
+                }
+            }
+
+            if ((y + 1) == yy) {
+                perimeter += right - left + 1;
+            } else {
+                for (int e = left + 1; e < right; e++) {
+                    perimeter += below[e] != code;
+                }
+            }
+
+            // First seed pixel at or after the run start.
+            int abs_left = roi->x + left, abs_right = roi->x + right;
+            int first = (abs_left <= seed_x) ? seed_x : (seed_x + ((((abs_left - seed_x) + x_stride - 1) / x_stride) * x_stride));
+            bool seeded = seed_row && (first <= abs_right);
+
+            // Union the labels of the overlapping runs of the row above.
+            int t = code - 1, label = -1;
+            find_blobs_rle_run_t *p = prev[t];
+            size_t j = prev_i[t];
+            while ((j < prev_len[t]) && (p[j].r < left)) {
+                j++;
+            }
+            prev_i[t] = j;
+
+            for (; (j < prev_len[t]) && (p[j].l <= right); j++) {
+                int root = find_blobs_rle_find(&rle, p[j].label);
+                if (label < 0) {
+                    label = root;
+                } else if (root != label) {
+                    find_blobs_rle_merge(&rle.labels[label], &rle.labels[root]);
+                    rle.labels[root].parent = label;
+                }
+            }
+
+            if ((label < 0) && ((label = find_blobs_rle_new_label(&rle, y, t)) < 0)) {
+                ok = false;
+                break;
+            }
+
+            find_blobs_rle_add_run(&rle.labels[label], abs_left, abs_right, y, perimeter, seeded);
+            find_blobs_rle_run_t *c = &curr[t][curr_len[t]++];
+            c->l = left;
+            c->r = right;
+            c->label = label;
+        }
+
+        if (ok) {
+            for (size_t t = 0; t < thresholds_len; t++) {
+                for (size_t k = 0; k < curr_len[t]; k++) {
+                    curr[t][k].label = find_blobs_rle_find(&rle, curr[t][k].label);
+                    rle.labels[curr[t][k].label].y = y;
+                }
+            }
+
+            find_blobs_rle_sweep(out, &rle, y, area_threshold, pixels_threshold, threshold_cb, threshold_cb_arg);
+        }
+    }
+
+    if (ok) {
+        find_blobs_rle_sweep(out, &rle, roi->y - 1, area_threshold, pixels_threshold, threshold_cb, threshold_cb_arg);
+    } else {
+        list_clear(out);
+    }
+
+    fb_free(); // labels
+    fb_free(); // runs
+    fb_free(); // codes
+    fb_free(); // thresholds_array
+    return ok;
+}
+
+void imlib_find_blobs_filter_init(find_blobs_filter_t *filter,
+                                  bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg)
+{
+    memset(filter, 0, sizeof(find_blobs_filter_t));
+    filter->threshold_cb = threshold_cb;
+    filter->threshold_cb_arg = threshold_cb_arg;
+}
+
+void imlib_find_blobs_filter_range(find_blobs_filter_t *filter, find_blobs_filter_property_t property, float min, float max)
+{
+    filter->mask |= 1 << property;
+    filter->min[property] = min;
+    filter->max[property] = max;
+}
+
+bool imlib_find_blobs_filter(void *filter, find_blobs_list_lnk_data_t *blob)
+{
+    find_blobs_filter_t *f = (find_blobs_filter_t *) filter;
+
+    if (f->mask) {
+        float p[FIND_BLOBS_FILTER_PROPERTIES];
+        int area = blob->rect.w * blob->rect.h;
+        p[FIND_BLOBS_FILTER_AREA] = area;
+        p[FIND_BLOBS_FILTER_PIXELS] = blob->pixels;
+        p[FIND_BLOBS_FILTER_DENSITY] = blob->pixels / ((float) area);
+        p[FIND_BLOBS_FILTER_ELONGATION] = 1 - blob->roundness;
+        p[FIND_BLOBS_FILTER_ROUNDNESS] = blob->roundness;
+        p[FIND_BLOBS_FILTER_ROTATION] = blob->rotation;
+        p[FIND_BLOBS_FILTER_ASPECT_RATIO] = blob->rect.w / ((float) blob->rect.h);
+        p[FIND_BLOBS_FILTER_SCORE] = 0;
+
+        if (f->mask & (1 << FIND_BLOBS_FILTER_SCORE)) {
+            for (int i = 0; i < FIND_BLOBS_FILTER_SCORE; i++) {
+                p[FIND_BLOBS_FILTER_SCORE] += f->weights[i] * p[i];
+            }
+        }
+
+        for (int i = 0; i < FIND_BLOBS_FILTER_PROPERTIES; i++) {
+            if ((f->mask & (1 << i)) && ((p[i] < f->min[i]) || (f->max[i] < p[i]))) {
+                return false;
+            }
+        }
+    }
+
+    return (f->threshold_cb_arg == NULL) || f->threshold_cb(f->threshold_cb_arg, blob);
+}
+
+typedef struct find_blobs_merge {
+    find_blobs_list_lnk_data_t **blobs;
+    bool (*merge_cb)(void*,find_blobs_list_lnk_data_t*,find_blobs_list_lnk_data_t*);
+    void *merge_cb_arg;
+    unsigned int x_hist_bins_max, y_hist_bins_max;
+} find_blobs_merge_t;
+
+// Merges blob b into blob a when they may be merged (see rectangle_cluster).
+static bool find_blobs_merge_cb(void *arg, int a, int b)
+{
+    find_blobs_merge_t *m = (find_blobs_merge_t *) arg;
+    find_blobs_list_lnk_data_t *dst = m->blobs[a];
+    find_blobs_list_lnk_data_t *src = m->blobs[b];
+    unsigned int x_hist_bins_max = m->x_hist_bins_max;
+    unsigned int y_hist_bins_max = m->y_hist_bins_max;
+
+    if ((m->merge_cb_arg != NULL) && (!m->merge_cb(m->merge_cb_arg, dst, src))) {
+        return false;
+    }
+
+    // Have to merge these first before merging rects.
+    if (x_hist_bins_max) merge_bins(dst->rect.x, dst->rect.x + dst->rect.w - 1, &dst->x_hist_bins, &dst->x_hist_bins_count,
+                                    src->rect.x, src->rect.x + src->rect.w - 1, &src->x_hist_bins, &src->x_hist_bins_count,
+                                    x_hist_bins_max);
+    if (y_hist_bins_max) merge_bins(dst->rect.y, dst->rect.y + dst->rect.h - 1, &dst->y_hist_bins, &dst->y_hist_bins_count,
+                                    src->rect.y, src->rect.y + src->rect.h - 1, &src->y_hist_bins, &src->y_hist_bins_count,
+                                    y_hist_bins_max);
+    // Merge corners...
+    for (int i = 0; i < FIND_BLOBS_CORNERS_RESOLUTION; i++) {
+        float z_dst = (dst->corners[i].x * cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i]) +
+                      (dst->corners[i].y * sin_table[FIND_BLOBS_ANGLE_RESOLUTION*i]);
+        float z_src = (src->corners[i].x * cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i]) +
+                      (src->corners[i].y * sin_table[FIND_BLOBS_ANGLE_RESOLUTION*i]);
+        if (z_src < z_dst) {
+            dst->corners[i].x = src->corners[i].x;
+            dst->corners[i].y = src->corners[i].y;
+        }
+    }
+    // Merge rects...
+    rectangle_united(&(dst->rect), &(src->rect));
+    // Merge counters...
+    dst->pixels += src->pixels; // won't overflow
+    dst->perimeter += src->perimeter; // won't overflow
+    dst->code |= src->code; // won't overflow
+    dst->count += src->count; // won't overflow
+    // Merge accumulators...
+    dst->centroid_x_acc += src->centroid_x_acc;
+    dst->centroid_y_acc += src->centroid_y_acc;
+    dst->rotation_acc_x += src->rotation_acc_x;
+    dst->rotation_acc_y += src->rotation_acc_y;
+    dst->roundness_acc += src->roundness_acc;
+    // Compute current values...
+    dst->centroid_x = dst->centroid_x_acc / dst->pixels;
+    dst->centroid_y = dst->centroid_y_acc / dst->pixels;
+    dst->rotation = fast_atan2f(dst->rotation_acc_y / dst->pixels,
+                                dst->rotation_acc_x / dst->pixels);
+    dst->roundness = dst->roundness_acc / dst->pixels;
+    return true;
+}
+
+void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
+                      list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold,
+                      bool merge, int margin,
+                      bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg,
+                      bool (*merge_cb)(void*,find_blobs_list_lnk_data_t*,find_blobs_list_lnk_data_t*), void *merge_cb_arg,
+                      unsigned int x_hist_bins_max, unsigned int y_hist_bins_max, bool rle)
+{
+    // Blob nodes come from a GC heap pool, their histogram bins are GC heap blocks as well.
+    list_pool_t *pool = list_pool_alloc(sizeof(find_blobs_list_lnk_data_t), 64);
+    list_init_pool(out, sizeof(find_blobs_list_lnk_data_t), pool);
+
+    // The run length engine doesn't keep the pixels of each blob for the histograms, and falls
+    // back to the flood fill engine if it runs out of labels.
+    if ((!rle) || x_hist_bins_max || y_hist_bins_max
+    || (!find_blobs_rle(out, ptr, roi, x_stride, y_stride, thresholds, invert, area_threshold, pixels_threshold,
+                        threshold_cb, threshold_cb_arg))) {
+        find_blobs_flood_fill(out, ptr, roi, x_stride, y_stride, thresholds, invert, area_threshold, pixels_threshold,
+                              threshold_cb, threshold_cb_arg, x_hist_bins_max, y_hist_bins_max);
+    }
 
-    if (merge) {
-        for(;;) {
-            bool merge_occured = false;
+    if (merge && (list_size(out) > 1)) {
+        find_blobs_merge_t m;
+        m.merge_cb = merge_cb;
+        m.merge_cb_arg = merge_cb_arg;
+        m.x_hist_bins_max = x_hist_bins_max;
+        m.y_hist_bins_max = y_hist_bins_max;
+
+        // Merged blobs grow and may overlap others they didn't before, so repeat until nothing merges.
+        for (size_t n = list_size(out); n > 1; n = list_size(out)) {
+            m.blobs = fb_alloc(n * sizeof(find_blobs_list_lnk_data_t *), FB_ALLOC_NO_HINT);
+            rectangle_t *rects = fb_alloc(n * sizeof(rectangle_t), FB_ALLOC_NO_HINT);
+            int *set = fb_alloc(n * sizeof(int), FB_ALLOC_NO_HINT);
+
+            size_t i = 0;
+            for (list_lnk_t *it = iterator_start_from_head(out); it; it = iterator_next(it), i++) {
+                m.blobs[i] = (find_blobs_list_lnk_data_t *) it->data;
+                rects[i] = m.blobs[i]->rect;
+            }
 
-            list_t out_temp;
-            list_init(&out_temp, sizeof(find_blobs_list_lnk_data_t));
+            int joins = rectangle_cluster(rects, n, margin, set, find_blobs_merge_cb, &m);
 
-            while(list_size(out)) {
+            // Keep the first blob of each group (the others were merged into it), in order.
+            for (i = 0; i < n; i++) {
                 find_blobs_list_lnk_data_t lnk_blob;
                 list_pop_front(out, &lnk_blob);
+                if (set[i] == i) {
+                    list_push_back(out, &lnk_blob);
+                }
+            }
 
-                for (size_t k = 0, l = list_size(out); k < l; k++) {
-                    find_blobs_list_lnk_data_t tmp_blob;
-                    list_pop_front(out, &tmp_blob);
-
-                    rectangle_t temp;
-                    temp.x = IM_MAX(IM_MIN(tmp_blob.rect.x - margin, INT16_MAX), INT16_MIN);
-                    temp.y = IM_MAX(IM_MIN(tmp_blob.rect.y - margin, INT16_MAX), INT16_MIN);
-                    temp.w = IM_MAX(IM_MIN(tmp_blob.rect.w + (margin * 2), INT16_MAX), 0);
-                    temp.h = IM_MAX(IM_MIN(tmp_blob.rect.h + (margin * 2), INT16_MAX), 0);
-
-                    if (rectangle_overlap(&(lnk_blob.rect), &temp)
-                    && ((merge_cb_arg == NULL) || merge_cb(merge_cb_arg, &lnk_blob, &tmp_blob))) {
-                        // Have to merge these first before merging rects.
-                        if (x_hist_bins_max) merge_bins(lnk_blob.rect.x, lnk_blob.rect.x + lnk_blob.rect.w - 1, &lnk_blob.x_hist_bins, &lnk_blob.x_hist_bins_count,
-                                                        tmp_blob.rect.x, tmp_blob.rect.x + tmp_blob.rect.w - 1, &tmp_blob.x_hist_bins, &tmp_blob.x_hist_bins_count,
-                                                        x_hist_bins_max);
-                        if (y_hist_bins_max) merge_bins(lnk_blob.rect.y, lnk_blob.rect.y + lnk_blob.rect.h - 1, &lnk_blob.y_hist_bins, &lnk_blob.y_hist_bins_count,
-                                                        tmp_blob.rect.y, tmp_blob.rect.y + tmp_blob.rect.h - 1, &tmp_blob.y_hist_bins, &tmp_blob.y_hist_bins_count,
-                                                        y_hist_bins_max);
-                        // Merge corners...
-                        for (int i = 0; i < FIND_BLOBS_CORNERS_RESOLUTION; i++) {
-                            float z_dst = (lnk_blob.corners[i].x * cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i]) +
-                                          (lnk_blob.corners[i].y * sin_table[FIND_BLOBS_ANGLE_RESOLUTION*i]);
-                            float z_src = (tmp_blob.corners[i].x * cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i]) +
-                                          (tmp_blob.corners[i].y * cos_table[FIND_BLOBS_ANGLE_RESOLUTION*i]);
-                            if (z_src < z_dst) {
-                                lnk_blob.corners[i].x = tmp_blob.corners[i].x;
-                                lnk_blob.corners[i].y = tmp_blob.corners[i].y;
-                            }
-                        }
-                        // Merge rects...
-                        rectangle_united(&(lnk_blob.rect), &(tmp_blob.rect));
-                        // Merge counters...
-                        lnk_blob.pixels += tmp_blob.pixels; // won't overflow
-                        lnk_blob.perimeter += tmp_blob.perimeter; // won't overflow
-                        lnk_blob.code |= tmp_blob.code; // won't overflow
-                        lnk_blob.count += tmp_blob.count; // won't overflow
-                        // Merge accumulators...
-                        lnk_blob.centroid_x_acc += tmp_blob.centroid_x_acc;
-                        lnk_blob.centroid_y_acc += tmp_blob.centroid_y_acc;
-                        lnk_blob.rotation_acc_x += tmp_blob.rotation_acc_x;
-                        lnk_blob.rotation_acc_y += tmp_blob.rotation_acc_y;
-                        lnk_blob.roundness_acc += tmp_blob.roundness_acc;
-                        // Compute current values...
-                        lnk_blob.centroid_x = lnk_blob.centroid_x_acc / lnk_blob.pixels;
-                        lnk_blob.centroid_y = lnk_blob.centroid_y_acc / lnk_blob.pixels;
-                        lnk_blob.rotation = fast_atan2f(lnk_blob.rotation_acc_y / lnk_blob.pixels,
-                                                        lnk_blob.rotation_acc_x / lnk_blob.pixels);
-                        lnk_blob.roundness = lnk_blob.roundness_acc / lnk_blob.pixels;
-                        merge_occured = true;
-                    } else {
-                        list_push_back(out, &tmp_blob);
+            fb_free(); // set
+            fb_free(); // rects
+            fb_free(); // blobs
+
+            if (!joins) {
+                break;
+            }
+        }
+    }
+}
+
+// Blob tracker: between the full scans (every rescan frames, or when nothing is tracked) only the
+// areas around the tracked blobs are searched. The rects of the tracked blobs are grown by margin
+// and united when they overlap so that a blob is only found once. Blobs are matched to the closest
+// tracked blob of the same color whose grown rect contains their centroid and get its id, others
+// get a new id. Tracks that aren't matched are dropped.
+typedef struct blob_tracker_match {
+    float d;
+    uint16_t i, j;
+} blob_tracker_match_t;
+
+static int blob_tracker_match_cmp(const void *a, const void *b)
+{
+    float d0 = ((blob_tracker_match_t *) a)->d;
+    float d1 = ((blob_tracker_match_t *) b)->d;
+    return (d0 > d1) - (d0 < d1);
+}
+
+static bool blob_tracker_area(rectangle_t *area, rectangle_t *rect, int margin, rectangle_t *roi)
+{
+    area->x = rect->x - margin;
+    area->y = rect->y - margin;
+    area->w = rect->w + (margin * 2);
+    area->h = rect->h + (margin * 2);
+
+    if (roi) {
+        if (!rectangle_overlap(area, roi)) {
+            return false;
+        }
+
+        rectangle_intersected(area, roi);
+    }
+
+    return true;
+}
+
+static bool blob_tracker_contains(rectangle_t *r, float x, float y)
+{
+    return (r->x <= x) && (x < (r->x + r->w)) && (r->y <= y) && (y < (r->y + r->h));
+}
+
+void imlib_blob_tracker_alloc(blob_tracker_t *tracker, size_t tracks_max, int margin, int rescan)
+{
+    tracker->tracks = xalloc(tracks_max * sizeof(blob_track_t));
+    tracker->tracks_max = tracks_max;
+    tracker->margin = margin;
+    tracker->rescan = rescan;
+    imlib_blob_tracker_reset(tracker);
+}
+
+void imlib_blob_tracker_free(blob_tracker_t *tracker)
+{
+    xfree(tracker->tracks);
+}
+
+void imlib_blob_tracker_reset(blob_tracker_t *tracker)
+{
+    tracker->tracks_len = 0;
+    tracker->frames = 0;
+    tracker->next_id = 1;
+}
+
+// Like imlib_find_blobs() the results are in a GC heap node pool (out->pool), the caller may
+// xfree() it once the results have been used.
+void imlib_blob_tracker_update(blob_tracker_t *tracker, list_t *out, image_t *ptr, rectangle_t *roi,
+                               unsigned int x_stride, unsigned int y_stride,
+                               list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold,
+                               bool merge, int margin,
+                               bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg,
+                               bool (*merge_cb)(void*,find_blobs_list_lnk_data_t*,find_blobs_list_lnk_data_t*), void *merge_cb_arg,
+                               unsigned int x_hist_bins_max, unsigned int y_hist_bins_max, bool rle)
+{
+    size_t old_len = tracker->tracks_len;
+    bool rescan = (!old_len) || (!(tracker->frames % tracker->rescan));
+    tracker->frames += 1;
+
+    if (rescan) {
+        imlib_find_blobs(out, ptr, roi, x_stride, y_stride, thresholds, invert, area_threshold, pixels_threshold,
+                         merge, margin, threshold_cb, threshold_cb_arg, merge_cb, merge_cb_arg,
+                         x_hist_bins_max, y_hist_bins_max, rle);
+    } else {
+        list_init_pool(out, sizeof(find_blobs_list_lnk_data_t),
+                       list_pool_alloc(sizeof(find_blobs_list_lnk_data_t), tracker->tracks_max));
+
+        rectangle_t *areas = fb_alloc(old_len * sizeof(rectangle_t), FB_ALLOC_NO_HINT);
+        size_t areas_len = 0;
+
+        for (size_t i = 0; i < old_len; i++) {
+            rectangle_t area;
+            if (!blob_tracker_area(&area, &tracker->tracks[i].rect, tracker->margin, roi)) {
+                continue;
+            }
+
+            // Uniting two areas can make the result overlap another one.
+            for (bool united = true; united;) {
+                united = false;
+                for (size_t j = 0; j < areas_len; j++) {
+                    if (rectangle_overlap(&area, &areas[j])) {
+                        rectangle_united(&area, &areas[j]);
+                        areas[j] = areas[--areas_len];
+                        united = true;
+                        break;
                     }
                 }
+            }
+
+            areas[areas_len++] = area;
+        }
+
+        for (size_t i = 0; i < areas_len; i++) {
+            list_t area_out;
+            imlib_find_blobs(&area_out, ptr, &areas[i], x_stride, y_stride, thresholds, invert, area_threshold, pixels_threshold,
+                             merge, margin, threshold_cb, threshold_cb_arg, merge_cb, merge_cb_arg,
+                             x_hist_bins_max, y_hist_bins_max, rle);
+
+            while (list_size(&area_out)) {
+                find_blobs_list_lnk_data_t lnk_blob;
+                list_pop_front(&area_out, &lnk_blob);
+                list_push_back(out, &lnk_blob);
+            }
+        }
+    }
+
+    while (list_size(out) > tracker->tracks_max) {
+        find_blobs_list_lnk_data_t lnk_blob;
+        list_pop_back(out, &lnk_blob);
+        if (lnk_blob.x_hist_bins) xfree(lnk_blob.x_hist_bins);
+        if (lnk_blob.y_hist_bins) xfree(lnk_blob.y_hist_bins);
+    }
+
+    blob_track_t *old_tracks = fb_alloc(old_len * sizeof(blob_track_t), FB_ALLOC_NO_HINT);
+    memcpy(old_tracks, tracker->tracks, old_len * sizeof(blob_track_t));
+
+    size_t new_len = 0;
+    for (list_lnk_t *it = iterator_start_from_head(out); it; it = iterator_next(it)) {
+        find_blobs_list_lnk_data_t lnk_blob;
+        iterator_get(out, it, &lnk_blob);
+        blob_track_t *track = &tracker->tracks[new_len++];
+        track->rect = lnk_blob.rect;
+        track->cx = lnk_blob.centroid_x;
+        track->cy = lnk_blob.centroid_y;
+        track->code = lnk_blob.code;
+        track->id = 0;
+    }
 
-                list_push_back(&out_temp, &lnk_blob);
+    // Count the candidate matches first, then fill them in and assign them closest first.
+    blob_tracker_match_t *matches = NULL;
+    size_t matches_len = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        size_t n = 0;
+        for (size_t i = 0; i < new_len; i++) {
+            blob_track_t *track = &tracker->tracks[i];
+            for (size_t j = 0; j < old_len; j++) {
+                rectangle_t area;
+                blob_tracker_area(&area, &old_tracks[j].rect, tracker->margin, NULL);
+
+                if ((track->code & old_tracks[j].code) && blob_tracker_contains(&area, track->cx, track->cy)) {
+                    if (matches) {
+                        float dx = track->cx - old_tracks[j].cx;
+                        float dy = track->cy - old_tracks[j].cy;
+                        matches[n].d = (dx * dx) + (dy * dy);
+                        matches[n].i = i;
+                        matches[n].j = j;
+                    }
+                    n++;
+                }
             }
+        }
+
+        if (!matches) {
+            matches_len = n;
+            matches = fb_alloc(matches_len * sizeof(blob_tracker_match_t), FB_ALLOC_NO_HINT);
+        }
+    }
 
-            list_copy(out, &out_temp);
+    bool *old_matched = fb_alloc0(old_len * sizeof(bool), FB_ALLOC_NO_HINT);
+    qsort(matches, matches_len, sizeof(blob_tracker_match_t), blob_tracker_match_cmp);
 
-            if (!merge_occured) {
-                break;
+    for (size_t k = 0; k < matches_len; k++) {
+        blob_track_t *track = &tracker->tracks[matches[k].i];
+        if ((!track->id) && (!old_matched[matches[k].j])) {
+            track->id = old_tracks[matches[k].j].id;
+            old_matched[matches[k].j] = true;
+        }
+    }
+
+    fb_free(); // old_matched
+    fb_free(); // matches
+    fb_free(); // old_tracks
+
+    size_t i = 0;
+    for (list_lnk_t *it = iterator_start_from_head(out); it; it = iterator_next(it), i++) {
+        blob_track_t *track = &tracker->tracks[i];
+        if (!track->id) {
+            track->id = tracker->next_id++;
+            // 0 means untracked.
+            if (!tracker->next_id) {
+                tracker->next_id = 1;
             }
         }
+
+        find_blobs_list_lnk_data_t lnk_blob;
+        iterator_get(out, it, &lnk_blob);
+        lnk_blob.id = track->id;
+        iterator_set(out, it, &lnk_blob);
+    }
+
+    tracker->tracks_len = new_len;
+}
+
+// Sets the bits [left, right] of a binary row, the middle of the span a word at a time.
+static void flood_fill_set_span(uint32_t *row, int left, int right)
+{
+    int l = left >> UINT32_T_SHIFT, r = right >> UINT32_T_SHIFT;
+    uint32_t l_mask = 0xFFFFFFFF << (left & UINT32_T_MASK);
+    uint32_t r_mask = 0xFFFFFFFF >> (UINT32_T_MASK - (right & UINT32_T_MASK));
+
+    if (l == r) {
+        row[l] |= l_mask & r_mask;
+        return;
+    }
+
+    row[l] |= l_mask;
+
+    for (int i = l + 1; i < r; i++) {
+        row[i] = 0xFFFFFFFF;
+    }
+
+    row[r] |= r_mask;
+}
+
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+// Returns the n (<= 4) bits of a binary row starting at x, x + n - 1 must be in the row.
+static inline uint32_t flood_fill_get_bits(const uint32_t *row, int x, int n)
+{
+    int i = x >> UINT32_T_SHIFT, s = x & UINT32_T_MASK;
+    uint32_t bits = row[i] >> s;
+
+    if (s > (32 - n)) {
+        bits |= row[i + 1] << (32 - s);
     }
+
+    return bits & ((1 << n) - 1);
+}
+
+// True if all the byte lanes of a are within the lanes of t of the lanes of b.
+static inline bool flood_fill_bound8(uint32_t a, uint32_t b, uint32_t t)
+{
+    return !__UQSUB8(__UQSUB8(a, b) | __UQSUB8(b, a), t);
+}
+
+// Two RGB565 pixels as the bytes R0 G0 R1 G1, and as the bytes B0 0 B1 0.
+static inline uint32_t flood_fill_rg(uint32_t p)
+{
+    return ((p >> 11) & 0x001F001F) | (((p >> 5) & 0x003F003F) << 8);
+}
+
+static inline uint32_t flood_fill_b(uint32_t p)
+{
+    return p & 0x001F001F;
+}
+
+// Tests 4 grayscale pixels (p) against the seed and their neighbors (n) at once.
+static inline bool flood_fill_grayscale4(uint32_t p, uint32_t n,
+                                         uint32_t seed, uint32_t seed_threshold, uint32_t floating_threshold)
+{
+    return flood_fill_bound8(p, seed, seed_threshold) && flood_fill_bound8(p, n, floating_threshold);
+}
+
+// Tests 2 RGB565 pixels (p) against the seed and their neighbors (n) at once, seed and the
+// thresholds are in the flood_fill_rg() and flood_fill_b() layouts.
+static inline bool flood_fill_rgb565_2(uint32_t p, uint32_t n, const uint32_t *seed,
+                                       const uint32_t *seed_threshold, const uint32_t *floating_threshold)
+{
+    uint32_t p_rg = flood_fill_rg(p), p_b = flood_fill_b(p);
+    uint32_t n_rg = flood_fill_rg(n), n_b = flood_fill_b(n);
+    return flood_fill_bound8(p_rg, seed[0], seed_threshold[0]) && flood_fill_bound8(p_b, seed[1], seed_threshold[1])
+        && flood_fill_bound8(p_rg, n_rg, floating_threshold[0]) && flood_fill_bound8(p_b, n_b, floating_threshold[1]);
 }
+#endif
 
 void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
                           int seed_threshold, int floating_threshold,
@@ -1063,9 +1841,7 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
                     right++;
                 }
 
-                for (int i = left; i <= right; i++) {
-                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, i);
-                }
+                flood_fill_set_span(out_row, left, right);
 
                 int top_left = left;
                 int bot_left = left;
@@ -1157,11 +1933,25 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
             break;
         }
         case IMAGE_BPP_GRAYSCALE: {
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+            uint32_t seed = IMAGE_GET_GRAYSCALE_PIXEL(img, x, y) * 0x01010101;
+            uint32_t seed_threshold4 = IM_MIN(IM_MAX(seed_threshold, 0), 255) * 0x01010101;
+            uint32_t floating_threshold4 = IM_MIN(IM_MAX(floating_threshold, 0), 255) * 0x01010101;
+#endif
             for(int seed_pixel = IMAGE_GET_GRAYSCALE_PIXEL(img, x, y);;) {
                 int left = x, right = x;
                 uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
                 uint32_t *out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
 
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+                // 4 pixels at a time, the pixels on the left of p are its neighbors.
+                for (; ((left - 4) >= 0) && (!flood_fill_get_bits(out_row, left - 4, 4)); left -= 4) {
+                    uint32_t p = *((uint32_t *) (row + left - 4));
+                    if (!flood_fill_grayscale4(p, (p >> 8) | (row[left] << 24), seed, seed_threshold4, floating_threshold4)) {
+                        break;
+                    }
+                }
+#endif
                 while ((left > 0)
                 && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, left - 1))
                 && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, left - 1), seed_pixel, seed_threshold)
@@ -1170,6 +1960,14 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
                     left--;
                 }
 
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+                for (; ((right + 4) < img->w) && (!flood_fill_get_bits(out_row, right + 1, 4)); right += 4) {
+                    uint32_t p = *((uint32_t *) (row + right + 1));
+                    if (!flood_fill_grayscale4(p, (p << 8) | row[right], seed, seed_threshold4, floating_threshold4)) {
+                        break;
+                    }
+                }
+#endif
                 while ((right < (img->w - 1))
                 && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, right + 1))
                 && COLOR_BOUND_GRAYSCALE(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row, right + 1), seed_pixel, seed_threshold)
@@ -1178,9 +1976,7 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
                     right++;
                 }
 
-                for (int i = left; i <= right; i++) {
-                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, i);
-                }
+                flood_fill_set_span(out_row, left, right);
 
                 int top_left = left;
                 int bot_left = left;
@@ -1272,11 +2068,28 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
             break;
         }
         case IMAGE_BPP_RGB565: {
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+            uint32_t seed2 = IMAGE_GET_RGB565_PIXEL(img, x, y) * 0x00010001;
+            uint32_t seed_threshold2 = (seed_threshold & 0xFFFF) * 0x00010001;
+            uint32_t floating_threshold2 = (floating_threshold & 0xFFFF) * 0x00010001;
+            uint32_t seed[2] = { flood_fill_rg(seed2), flood_fill_b(seed2) };
+            uint32_t seed_thresholds[2] = { flood_fill_rg(seed_threshold2), flood_fill_b(seed_threshold2) };
+            uint32_t floating_thresholds[2] = { flood_fill_rg(floating_threshold2), flood_fill_b(floating_threshold2) };
+#endif
             for(int seed_pixel = IMAGE_GET_RGB565_PIXEL(img, x, y);;) {
                 int left = x, right = x;
                 uint16_t *row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
                 uint32_t *out_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
 
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+                // 2 pixels at a time, the pixels on the left of p are its neighbors.
+                for (; ((left - 2) >= 0) && (!flood_fill_get_bits(out_row, left - 2, 2)); left -= 2) {
+                    uint32_t p = *((uint32_t *) (row + left - 2));
+                    if (!flood_fill_rgb565_2(p, (p >> 16) | (row[left] << 16), seed, seed_thresholds, floating_thresholds)) {
+                        break;
+                    }
+                }
+#endif
                 while ((left > 0)
                 && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, left - 1))
                 && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, left - 1), seed_pixel, seed_threshold)
@@ -1285,6 +2098,14 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
                     left--;
                 }
 
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+                for (; ((right + 2) < img->w) && (!flood_fill_get_bits(out_row, right + 1, 2)); right += 2) {
+                    uint32_t p = *((uint32_t *) (row + right + 1));
+                    if (!flood_fill_rgb565_2(p, (p << 16) | row[right], seed, seed_thresholds, floating_thresholds)) {
+                        break;
+                    }
+                }
+#endif
                 while ((right < (img->w - 1))
                 && (!IMAGE_GET_BINARY_PIXEL_FAST(out_row, right + 1))
                 && COLOR_BOUND_RGB565(IMAGE_GET_RGB565_PIXEL_FAST(row, right + 1), seed_pixel, seed_threshold)
@@ -1293,9 +2114,7 @@ void imlib_flood_fill_int(image_t *out, image_t *img, int x, int y,
                     right++;
                 }
 
-                for (int i = left; i <= right; i++) {
-                    IMAGE_SET_BINARY_PIXEL_FAST(out_row, i);
-                }
+                flood_fill_set_span(out_row, left, right);
 
                 int top_left = left;
                 int bot_left = left;
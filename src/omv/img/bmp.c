@@ -208,7 +208,7 @@ void bmp_read(image_t *img, const char *path)
     file_read_open(&fp, path);
     file_buffer_on(&fp);
     bmp_read_geometry(&fp, img, path, &rs);
-    if (!img->pixels) img->pixels = xalloc(img->w * img->h * img->bpp);
+    if (!img->pixels) img->pixels = xalloc_data(img->w * img->h * img->bpp);
     bmp_read_pixels(&fp, img, img->h, &rs);
     file_buffer_off(&fp);
     file_close(&fp);
@@ -0,0 +1,142 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Combined QR Code, Data Matrix, barcode and AprilTag search.
+ */
+#include "imlib.h"
+
+#if defined(IMLIB_ENABLE_QRCODES) || defined(IMLIB_ENABLE_DATAMATRICES) || \
+    defined(IMLIB_ENABLE_BARCODES) || defined(IMLIB_ENABLE_APRILTAGS)
+// Moves results found in the grayscale copy of the roi back to image coordinates.
+static void find_codes_translate(point_t *corners, rectangle_t *rect, int x, int y)
+{
+    for (int i = 0; i < 4; i++) {
+        corners[i].x += x;
+        corners[i].y += y;
+    }
+
+    rect->x += x;
+    rect->y += y;
+}
+
+void imlib_find_codes(image_t *ptr, rectangle_t *roi, list_t *qrcodes, list_t *datamatrices, int effort,
+                      list_t *barcodes, list_t *apriltags, apriltag_families_t families,
+                      float fx, float fy, float cx, float cy)
+{
+    // The decoders all work on grayscale (the grayscale paths of find_qrcodes(), find_datamatrices()
+    // and find_barcodes() don't copy the image). Other formats are converted once for all of them.
+    // Each decoder may leave fb_alloc()s behind, they are freed before the next one runs.
+    image_t img = *ptr;
+    rectangle_t img_roi = *roi;
+    int x_offset = 0, y_offset = 0;
+
+    if (ptr->bpp != IMAGE_BPP_GRAYSCALE) {
+        img.w = roi->w;
+        img.h = roi->h;
+        img.bpp = IMAGE_BPP_GRAYSCALE;
+        img.data = fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
+        rectangle_init(&img_roi, 0, 0, roi->w, roi->h);
+        x_offset = roi->x;
+        y_offset = roi->y;
+
+        uint8_t *grayscale_image = img.data;
+
+        switch (ptr->bpp) {
+            case IMAGE_BPP_BINARY: {
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                        *(grayscale_image++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                    }
+                }
+                break;
+            }
+            case IMAGE_BPP_RGB565: {
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                        *(grayscale_image++) = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                    }
+                }
+                break;
+            }
+            default: {
+                memset(grayscale_image, 0, roi->w * roi->h);
+                break;
+            }
+        }
+    }
+
+    #ifdef IMLIB_ENABLE_QRCODES
+    if (qrcodes) {
+        fb_alloc_mark();
+        imlib_find_qrcodes(qrcodes, &img, &img_roi);
+        fb_alloc_free_till_mark();
+
+        for (list_lnk_t *it = iterator_start_from_head(qrcodes); it; it = iterator_next(it)) {
+            find_qrcodes_list_lnk_data_t lnk_data;
+            iterator_get(qrcodes, it, &lnk_data);
+            find_codes_translate(lnk_data.corners, &lnk_data.rect, x_offset, y_offset);
+            iterator_set(qrcodes, it, &lnk_data);
+        }
+    }
+    #endif
+
+    #ifdef IMLIB_ENABLE_DATAMATRICES
+    if (datamatrices) {
+        fb_alloc_mark();
+        imlib_find_datamatrices(datamatrices, &img, &img_roi, effort);
+        fb_alloc_free_till_mark();
+
+        for (list_lnk_t *it = iterator_start_from_head(datamatrices); it; it = iterator_next(it)) {
+            find_datamatrices_list_lnk_data_t lnk_data;
+            iterator_get(datamatrices, it, &lnk_data);
+            find_codes_translate(lnk_data.corners, &lnk_data.rect, x_offset, y_offset);
+            iterator_set(datamatrices, it, &lnk_data);
+        }
+    }
+    #endif
+
+    #ifdef IMLIB_ENABLE_BARCODES
+    if (barcodes) {
+        fb_alloc_mark();
+        imlib_find_barcodes(barcodes, &img, &img_roi, 1, 1, false);
+        fb_alloc_free_till_mark();
+
+        for (list_lnk_t *it = iterator_start_from_head(barcodes); it; it = iterator_next(it)) {
+            find_barcodes_list_lnk_data_t lnk_data;
+            iterator_get(barcodes, it, &lnk_data);
+            find_codes_translate(lnk_data.corners, &lnk_data.rect, x_offset, y_offset);
+            iterator_set(barcodes, it, &lnk_data);
+        }
+    }
+    #endif
+
+    #ifdef IMLIB_ENABLE_APRILTAGS
+    if (apriltags) {
+        // The camera center moves with the grayscale copy so the pose doesn't change.
+        fb_alloc_mark();
+        imlib_find_apriltags(apriltags, &img, &img_roi, families, fx, fy, cx - x_offset, cy - y_offset, 1, 0);
+        fb_alloc_free_till_mark();
+
+        for (list_lnk_t *it = iterator_start_from_head(apriltags); it; it = iterator_next(it)) {
+            find_apriltags_list_lnk_data_t lnk_data;
+            iterator_get(apriltags, it, &lnk_data);
+            find_codes_translate(lnk_data.corners, &lnk_data.rect, x_offset, y_offset);
+            lnk_data.centroid.x += x_offset;
+            lnk_data.centroid.y += y_offset;
+            iterator_set(apriltags, it, &lnk_data);
+        }
+    }
+    #endif
+
+    if (ptr->bpp != IMAGE_BPP_GRAYSCALE) {
+        fb_free(); // img.data
+    }
+}
+#endif // IMLIB_ENABLE_QRCODES || IMLIB_ENABLE_DATAMATRICES || IMLIB_ENABLE_BARCODES || IMLIB_ENABLE_APRILTAGS
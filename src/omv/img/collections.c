@@ -219,12 +219,70 @@ void fifo_peek(fifo_t *ptr, void *data)
 // list //
 //////////
 
+// Allocates a pool for up to count nodes in one GC heap block. The pool is found by the GC
+// through the lists attached to it, so the xalloc() nodes and buffers that are only referenced
+// from its nodes stay alive. Returns NULL (plain xalloc() nodes) if the heap can't fit it.
+list_pool_t *list_pool_alloc(size_t data_len, size_t count)
+{
+    size_t lnk_len = (sizeof(list_lnk_t) + data_len + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    size_t size = lnk_len * count;
+
+    list_pool_t *pool = (list_pool_t *) xalloc_try_alloc(sizeof(list_pool_t) + size);
+    if (pool) {
+        pool->free_ptr = NULL;
+        pool->data = (char *) (pool + 1);
+        pool->size = size;
+        pool->used = 0;
+        pool->lnk_len = lnk_len;
+    }
+    return pool;
+}
+
+static list_lnk_t *list_lnk_alloc(list_t *ptr)
+{
+    list_pool_t *pool = ptr->pool;
+
+    if (pool) {
+        if (pool->free_ptr) {
+            list_lnk_t *tmp = pool->free_ptr;
+            pool->free_ptr = tmp->next_ptr;
+            return tmp;
+        }
+
+        if ((pool->used + pool->lnk_len) <= pool->size) {
+            list_lnk_t *tmp = (list_lnk_t *) (pool->data + pool->used);
+            pool->used += pool->lnk_len;
+            return tmp;
+        }
+    }
+
+    return (list_lnk_t *) xalloc(sizeof(list_lnk_t) + ptr->data_len);
+}
+
+static void list_lnk_free(list_t *ptr, list_lnk_t *lnk)
+{
+    list_pool_t *pool = ptr->pool;
+
+    if (pool && (((char *) lnk) >= pool->data) && (((char *) lnk) < (pool->data + pool->size))) {
+        lnk->next_ptr = pool->free_ptr;
+        pool->free_ptr = lnk;
+    } else {
+        xfree(lnk);
+    }
+}
+
 void list_init(list_t *ptr, size_t data_len)
+{
+    list_init_pool(ptr, data_len, NULL);
+}
+
+void list_init_pool(list_t *ptr, size_t data_len, list_pool_t *pool)
 {
     ptr->head_ptr = NULL;
     ptr->tail_ptr = NULL;
     ptr->size = 0;
     ptr->data_len = data_len;
+    ptr->pool = pool;
 }
 
 void list_copy(list_t *dst, list_t *src)
@@ -236,7 +294,7 @@ void list_free(list_t *ptr)
 {
     for (list_lnk_t *i = ptr->head_ptr; i; ) {
         list_lnk_t *j = i->next_ptr;
-        xfree(i);
+        list_lnk_free(ptr, i);
         i = j;
     }
 }
@@ -257,7 +315,7 @@ size_t list_size(list_t *ptr)
 
 void list_push_front(list_t *ptr, void *data)
 {
-    list_lnk_t *tmp = (list_lnk_t *) xalloc(sizeof(list_lnk_t) + ptr->data_len);
+    list_lnk_t *tmp = list_lnk_alloc(ptr);
     memcpy(tmp->data, data, ptr->data_len);
 
     if (ptr->size++) {
@@ -275,7 +333,7 @@ void list_push_front(list_t *ptr, void *data)
 
 void list_push_back(list_t *ptr, void *data)
 {
-    list_lnk_t *tmp = (list_lnk_t *) xalloc(sizeof(list_lnk_t) + ptr->data_len);
+    list_lnk_t *tmp = list_lnk_alloc(ptr);
     memcpy(tmp->data, data, ptr->data_len);
 
     if (ptr->size++) {
@@ -304,7 +362,7 @@ void list_pop_front(list_t *ptr, void *data)
     }
     ptr->head_ptr = tmp->next_ptr;
     ptr->size -= 1;
-    xfree(tmp);
+    list_lnk_free(ptr, tmp);
 }
 
 void list_pop_back(list_t *ptr, void *data)
@@ -318,7 +376,7 @@ void list_pop_back(list_t *ptr, void *data)
     tmp->prev_ptr->next_ptr = NULL;
     ptr->tail_ptr = tmp->prev_ptr;
     ptr->size -= 1;
-    xfree(tmp);
+    list_lnk_free(ptr, tmp);
 }
 
 void list_get_front(list_t *ptr, void *data)
@@ -356,7 +414,7 @@ void list_insert(list_t *ptr, void *data, size_t index)
             index -= 1;
         }
 
-        list_lnk_t *tmp = (list_lnk_t *) xalloc(sizeof(list_lnk_t) + ptr->data_len);
+        list_lnk_t *tmp = list_lnk_alloc(ptr);
         memcpy(tmp->data, data, ptr->data_len);
 
         tmp->next_ptr = i;
@@ -375,7 +433,7 @@ void list_insert(list_t *ptr, void *data, size_t index)
             index -= 1;
         }
 
-        list_lnk_t *tmp = (list_lnk_t *) xalloc(sizeof(list_lnk_t) + ptr->data_len);
+        list_lnk_t *tmp = list_lnk_alloc(ptr);
         memcpy(tmp->data, data, ptr->data_len);
 
         tmp->next_ptr = i;
@@ -408,7 +466,7 @@ void list_remove(list_t *ptr, void *data, size_t index)
         i->prev_ptr->next_ptr = i->next_ptr;
         i->next_ptr->prev_ptr = i->prev_ptr;
         ptr->size -= 1;
-        xfree(i);
+        list_lnk_free(ptr, i);
 
     } else {
 
@@ -427,7 +485,7 @@ void list_remove(list_t *ptr, void *data, size_t index)
         i->prev_ptr->next_ptr = i->next_ptr;
         i->next_ptr->prev_ptr = i->prev_ptr;
         ptr->size -= 1;
-        xfree(i);
+        list_lnk_free(ptr, i);
     }
 }
 
@@ -89,14 +89,29 @@ typedef struct list_lnk
 }
 list_lnk_t;
 
+// Node pool allocated in one GC heap block. Lists attached to a pool take their nodes from it
+// (recycling removed nodes) and fall back to xalloc() once the pool is exhausted. The pool is
+// released in bulk with xfree() (or by the GC) once no list uses it anymore. It must not live in
+// fb_alloc memory, the GC doesn't scan it and the nodes may point to GC heap blocks.
+typedef struct list_pool
+{
+    list_lnk_t *free_ptr;
+    char *data;
+    size_t size, used, lnk_len;
+}
+list_pool_t;
+
 typedef struct list
 {
     list_lnk_t *head_ptr, *tail_ptr;
     size_t size, data_len;
+    list_pool_t *pool;
 }
 list_t;
 
+list_pool_t *list_pool_alloc(size_t data_len, size_t count);
 void list_init(list_t *ptr, size_t data_len);
+void list_init_pool(list_t *ptr, size_t data_len, list_pool_t *pool);
 void list_copy(list_t *dst, list_t *src);
 void list_free(list_t *ptr);
 void list_clear(list_t *ptr);
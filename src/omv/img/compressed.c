@@ -0,0 +1,266 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Lossless in-memory image compression, images are decoded a row at a time in order.
+ *
+ * Binary images are coded as the lengths of the alternating runs of 0s and 1s of each row (starting
+ * with 0s) with order 0 Exp-Golomb codes. Grayscale images use the LOCO-I median edge detector to
+ * predict each pixel from its left, above and above left neighbors, the residuals (modulo 256) are
+ * Rice coded with a parameter picked per row and an escape to 8 raw bits for the outliers.
+ */
+#include "imlib.h"
+#include "fb_alloc.h"
+
+#ifdef IMLIB_ENABLE_COMPRESSED_IMAGES
+#define COMPRESSED_RICE_K_BITS      (3)
+#define COMPRESSED_RICE_ESCAPE      (8) // Residuals with a quotient of 8 or more are stored raw.
+
+typedef struct compressed_writer {
+    uint8_t *buf;
+    size_t size;
+    uint32_t acc;
+    int bits;
+} compressed_writer_t;
+
+// Bits are written MSB first, n <= 24. Only counts the bytes when buf is NULL.
+static void compressed_put_bits(compressed_writer_t *w, uint32_t value, int n)
+{
+    w->acc = (w->acc << n) | value;
+    w->bits += n;
+
+    while (w->bits >= 8) {
+        w->bits -= 8;
+
+        if (w->buf) {
+            w->buf[w->size] = w->acc >> w->bits;
+        }
+
+        w->size += 1;
+    }
+
+    w->acc &= (1 << w->bits) - 1;
+}
+
+static void compressed_flush(compressed_writer_t *w)
+{
+    if (w->bits) {
+        compressed_put_bits(w, 0, 8 - w->bits);
+    }
+}
+
+static inline uint32_t compressed_get_bits(compressed_reader_t *r, int n)
+{
+    while (r->bits < n) {
+        r->acc = (r->acc << 8) | *r->buf++;
+        r->bits += 8;
+    }
+
+    r->bits -= n;
+    return (r->acc >> r->bits) & ((1 << n) - 1);
+}
+
+// v >= 0
+static void compressed_put_exp_golomb(compressed_writer_t *w, uint32_t v)
+{
+    int n = 32 - __builtin_clz(v + 1);
+    compressed_put_bits(w, 0, n - 1);
+    compressed_put_bits(w, v + 1, n);
+}
+
+static uint32_t compressed_get_exp_golomb(compressed_reader_t *r)
+{
+    int n = 0;
+
+    while (!compressed_get_bits(r, 1)) {
+        n++;
+    }
+
+    return ((1 << n) | compressed_get_bits(r, n)) - 1;
+}
+
+static inline int compressed_med(int a, int b, int c)
+{
+    int lo = IM_MIN(a, b), hi = IM_MAX(a, b);
+    return (c >= hi) ? lo : ((c <= lo) ? hi : (a + b - c));
+}
+
+// Residual of the prediction mapped to 0-255: 0, -1, 1, -2, 2...
+static inline int compressed_zigzag(int pixel, int prediction)
+{
+    int e = (int8_t) (pixel - prediction);
+    return ((e << 1) ^ (e >> 7)) & 0xFF;
+}
+
+static inline int compressed_unzigzag(int u, int prediction)
+{
+    return (prediction + ((u >> 1) ^ (-(u & 1)))) & 0xFF;
+}
+
+static inline int compressed_prediction(const uint8_t *row, const uint8_t *prev, int x)
+{
+    if (!prev) {
+        return x ? row[x - 1] : 128;
+    }
+
+    return x ? compressed_med(row[x - 1], prev[x], prev[x - 1]) : prev[x];
+}
+
+static void compressed_binary_row(compressed_writer_t *w, image_t *img, int y)
+{
+    uint32_t *row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+
+    for (int x = 0, value = 0; x < img->w; value ^= 1) {
+        int run = x;
+
+        while ((run < img->w) && (IMAGE_GET_BINARY_PIXEL_FAST(row, run) == value)) {
+            run++;
+        }
+
+        compressed_put_exp_golomb(w, run - x);
+        x = run;
+    }
+}
+
+static void compressed_grayscale_row(compressed_writer_t *w, image_t *img, int y)
+{
+    uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+    uint8_t *prev = y ? IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y - 1) : NULL;
+    uint32_t sum = 0;
+    int k = 0;
+
+    for (int x = 0; x < img->w; x++) {
+        sum += compressed_zigzag(row[x], compressed_prediction(row, prev, x));
+    }
+
+    // The best Rice parameter is about log2 of the mean residual.
+    while ((k < ((1 << COMPRESSED_RICE_K_BITS) - 1)) && ((((uint32_t) img->w) << (k + 1)) <= sum)) {
+        k++;
+    }
+
+    compressed_put_bits(w, k, COMPRESSED_RICE_K_BITS);
+
+    for (int x = 0; x < img->w; x++) {
+        int u = compressed_zigzag(row[x], compressed_prediction(row, prev, x));
+        int q = u >> k;
+
+        if (q < COMPRESSED_RICE_ESCAPE) {
+            compressed_put_bits(w, ((1 << (q + 1)) - 2), q + 1); // q 1s and a 0.
+            compressed_put_bits(w, u & ((1 << k) - 1), k);
+        } else {
+            compressed_put_bits(w, (1 << COMPRESSED_RICE_ESCAPE) - 1, COMPRESSED_RICE_ESCAPE);
+            compressed_put_bits(w, u, 8);
+        }
+    }
+}
+
+size_t imlib_compress_image(image_t *img, uint8_t *buf)
+{
+    compressed_writer_t w = { .buf = buf, .size = 0, .acc = 0, .bits = 0 };
+
+    for (int y = 0; y < img->h; y++) {
+        if (img->bpp == IMAGE_BPP_BINARY) {
+            compressed_binary_row(&w, img, y);
+        } else {
+            compressed_grayscale_row(&w, img, y);
+        }
+    }
+
+    compressed_flush(&w);
+    return w.size;
+}
+
+void imlib_compressed_reader_init(compressed_reader_t *r, image_t *img)
+{
+    r->img = img;
+    r->buf = img->data;
+    r->acc = 0;
+    r->bits = 0;
+
+    if (img->bpp == IMAGE_BPP_RLE_BINARY) {
+        r->line = fb_alloc(((img->w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        r->prev = NULL;
+    } else {
+        r->line = fb_alloc(img->w, FB_ALLOC_NO_HINT);
+        r->prev = fb_alloc(img->w, FB_ALLOC_NO_HINT);
+    }
+
+    r->y = 0;
+}
+
+void imlib_compressed_reader_close(compressed_reader_t *r)
+{
+    if (r->prev) {
+        fb_free();
+    }
+
+    fb_free();
+}
+
+void *imlib_compressed_reader_next(compressed_reader_t *r)
+{
+    int w = r->img->w;
+
+    if (r->img->bpp == IMAGE_BPP_RLE_BINARY) {
+        uint32_t *row = r->line;
+        memset(row, 0, ((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sizeof(uint32_t));
+
+        for (int x = 0, value = 0; x < w; value ^= 1) {
+            int run = compressed_get_exp_golomb(r);
+            run = IM_MIN(run, w - x);
+
+            if (value) {
+                for (int i = x, ii = x + run; i < ii; ) {
+                    // Set up to the end of the word at once.
+                    int n = IM_MIN(ii - i, UINT32_T_BITS - (i & UINT32_T_MASK));
+                    uint32_t mask = (n == UINT32_T_BITS) ? 0xFFFFFFFF : (((1 << n) - 1) << (i & UINT32_T_MASK));
+                    row[i >> UINT32_T_SHIFT] |= mask;
+                    i += n;
+                }
+            }
+
+            x += run;
+        }
+    } else {
+        uint8_t *row = r->line, *prev = r->y ? r->prev : NULL;
+        int k = compressed_get_bits(r, COMPRESSED_RICE_K_BITS);
+
+        for (int x = 0; x < w; x++) {
+            int q = 0;
+
+            while ((q < COMPRESSED_RICE_ESCAPE) && compressed_get_bits(r, 1)) {
+                q++;
+            }
+
+            int u = (q < COMPRESSED_RICE_ESCAPE) ? ((q << k) | compressed_get_bits(r, k)) : compressed_get_bits(r, 8);
+            row[x] = compressed_unzigzag(u, compressed_prediction(row, prev, x));
+        }
+
+        // The row is the prediction of the next one.
+        r->line = r->prev;
+        r->prev = row;
+    }
+
+    r->y += 1;
+    return (r->img->bpp == IMAGE_BPP_RLE_BINARY) ? r->line : r->prev;
+}
+
+void imlib_decompress_image(image_t *dst, image_t *src)
+{
+    compressed_reader_t r;
+    imlib_compressed_reader_init(&r, src);
+    size_t len = (src->bpp == IMAGE_BPP_RLE_BINARY) ? IMAGE_BINARY_LINE_LEN_BYTES(dst) : IMAGE_GRAYSCALE_LINE_LEN_BYTES(dst);
+
+    for (int y = 0; y < src->h; y++) {
+        void *row = imlib_compressed_reader_next(&r);
+        memcpy((src->bpp == IMAGE_BPP_RLE_BINARY) ? ((void *) IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y))
+                                                  : ((void *) IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y)), row, len);
+    }
+
+    imlib_compressed_reader_close(&r);
+}
+#endif // IMLIB_ENABLE_COMPRESSED_IMAGES
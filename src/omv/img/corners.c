@@ -0,0 +1,229 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Helpers shared by the FAST and AGAST corner detectors.
+ */
+#include <stdlib.h>
+#include <stddef.h>
+#include "imlib.h"
+#include "fsort.h"
+#include "xalloc.h"
+#include "gc.h"
+
+#define MAX_ROW         (480)
+#define Compare(X, Y) ((X)>=(Y))
+
+// An arc of at least half the circle (9 of 16 for FAST, 5 of 8 for AGAST) always covers two
+// adjacent compass pixels, so pixels where no two adjacent compass pixels are both brighter
+// (or both darker) can't be corners. Four pixels are tested at once.
+void corner_pretest(const uint8_t *p, int n, const int *compass, int b, uint32_t *mask)
+{
+    if (n <= 0) {
+        return;
+    }
+
+    uint32_t b4 = IM_MIN(IM_MAX(b, 0), 255) * 0x01010101;
+
+    memset(mask, 0, ((n + 31) / 32) * sizeof(uint32_t));
+
+    int i = 0;
+
+    for (; (i + 4) <= n; i += 4) {
+        uint32_t c = *((uint32_t *) (p + i));
+        uint32_t cb = __UQADD8(c, b4), c_b = __UQSUB8(c, b4);
+        uint32_t brighter[4], darker[4];
+
+        for (int k = 0; k < 4; k++) {
+            uint32_t q = *((uint32_t *) (p + i + compass[k]));
+            __USUB8(cb, q); // GE set where q <= cb.
+            brighter[k] = __SEL(0, 0xFFFFFFFF);
+            __USUB8(q, c_b); // GE set where q >= c_b.
+            darker[k] = __SEL(0, 0xFFFFFFFF);
+        }
+
+        uint32_t m = (brighter[0] & brighter[1]) | (brighter[1] & brighter[2])
+                   | (brighter[2] & brighter[3]) | (brighter[3] & brighter[0])
+                   | (darker[0] & darker[1]) | (darker[1] & darker[2])
+                   | (darker[2] & darker[3]) | (darker[3] & darker[0]);
+
+        if (m) {
+            // One bit per byte (i is a multiple of 4 so the 4 bits are in the same word).
+            m &= 0x01010101;
+            m = (m | (m >> 7) | (m >> 14) | (m >> 21)) & 0xF;
+            mask[i / 32] |= m << (i % 32);
+        }
+    }
+
+    for (; i < n; i++) {
+        int cb = p[i] + b, c_b = p[i] - b;
+        bool brighter[4], darker[4];
+
+        for (int k = 0; k < 4; k++) {
+            brighter[k] = p[i + compass[k]] > cb;
+            darker[k] = p[i + compass[k]] < c_b;
+        }
+
+        for (int k = 0; k < 4; k++) {
+            if ((brighter[k] && brighter[(k + 1) % 4]) || (darker[k] && darker[(k + 1) % 4])) {
+                mask[i / 32] |= 1 << (i % 32);
+                break;
+            }
+        }
+    }
+}
+
+// 3x3 non-max suppression of corners found in raster scan order, the maxima are copied out.
+int corner_nonmax_suppression(corner_t *corners, int num_corners, corner_t *maxima)
+{
+    int num_maxima = 0;
+
+	int last_row;
+	int16_t row_start[MAX_ROW+1];
+	const int sz = num_corners;
+
+	/* Point above points (roughly) to the pixel above
+       the one of interest, if there is a feature there.*/
+	int point_above = 0;
+	int point_below = 0;
+
+	/* Find where each row begins (the corners are output in raster scan order).
+       A beginning of -1 signifies that there are no corners on that row. */
+	last_row  = corners[sz-1].y;
+
+	for(int i=0; i<last_row+1; i++) {
+		row_start[i] = -1;
+    }
+
+    for (int i=0, prev_row=-1; i<sz; i++) {
+        corner_t *c = &corners[i];
+        if (c->y != prev_row) {
+            row_start[c->y] = i;
+            prev_row = c->y;
+        }
+    }
+
+    for(int i=0; i<sz; i++) {
+        corner_t pos = corners[i];
+        uint16_t score = pos.score;
+
+        /*Check left */
+        if (i > 0) {
+            if (corners[i-1].x == pos.x-1 && corners[i-1].y == pos.y && Compare(corners[i-1].score, score)) {
+                goto nonmax;
+            }
+        }
+
+        /*Check right*/
+        if (i < (sz - 1)) {
+            if (corners[i+1].x == pos.x+1 && corners[i+1].y == pos.y && Compare(corners[i+1].score, score)) {
+                goto nonmax;
+            }
+        }
+
+        /*Check above (if there is a valid row above)*/
+        if (pos.y != 0 && row_start[pos.y - 1] != -1)  {
+            /*Make sure that current point_above is one row above.*/
+            if(corners[point_above].y < pos.y - 1)
+                point_above = row_start[pos.y-1];
+
+            /*Make point_above point to the first of the pixels above the current point, if it exists.*/
+            for (; corners[point_above].y < pos.y && corners[point_above].x < pos.x - 1; point_above++) {
+
+            }
+
+            for (int j=point_above; corners[j].y < pos.y && corners[j].x <= pos.x + 1; j++) {
+                int x = corners[j].x;
+                if( (x == pos.x - 1 || x ==pos.x || x == pos.x+1) && Compare(corners[j].score, score))
+                    goto nonmax;
+            }
+        }
+
+        /*Check below (if there is anything below)*/
+        if (pos.y != last_row && row_start[pos.y + 1] != -1 && point_below < sz) /*Nothing below*/ {
+            if (corners[point_below].y < pos.y + 1)
+                point_below = row_start[pos.y+1];
+
+            /* Make point below point to one of the pixels belowthe current point, if it exists.*/
+            for (; point_below < sz && corners[point_below].y == pos.y+1 && corners[point_below].x < pos.x - 1; point_below++) {
+            }
+
+            for (int j=point_below; j < sz && corners[j].y == pos.y+1 && corners[j].x <= pos.x + 1; j++) {
+                int x = corners[j].x;
+                if( (x == pos.x - 1 || x ==pos.x || x == pos.x+1) && Compare(corners[j].score, score))
+                    goto nonmax;
+            }
+        }
+
+        maxima[num_maxima++] = pos;
+        nonmax:
+        ;
+    }
+
+    return num_maxima;
+}
+
+int corner_grid_select(corner_t *corners, int num_corners, rectangle_t *roi, int cell_size, int cell_max)
+{
+    if ((cell_size <= 0) || (cell_max <= 0) || (num_corners <= cell_max)) {
+        return num_corners;
+    }
+
+    int cells_w = (roi->w + cell_size - 1) / cell_size;
+    int cells_h = (roi->h + cell_size - 1) / cell_size;
+
+    // Strongest first so each cell keeps its best corners.
+    corner_t *tmp = fb_alloc(num_corners * sizeof(corner_t), FB_ALLOC_NO_HINT);
+    fsort_radix16(corners, tmp, num_corners, sizeof(corner_t), offsetof(corner_t, score), true);
+    fb_free(); // tmp
+
+    uint16_t *counts = fb_alloc0(cells_w * cells_h * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    int len = 0;
+
+    for (int i = 0; i < num_corners; i++) {
+        int cx = IM_MIN(IM_MAX(corners[i].x - roi->x, 0) / cell_size, cells_w - 1);
+        int cy = IM_MIN(IM_MAX(corners[i].y - roi->y, 0) / cell_size, cells_h - 1);
+        uint16_t *count = counts + (cy * cells_w) + cx;
+
+        if (*count < cell_max) {
+            (*count)++;
+            corners[len++] = corners[i];
+        }
+    }
+
+    fb_free(); // counts
+    return len;
+}
+
+void corner_push_keypoints(corner_t *corners, int num_corners, array_t *keypoints)
+{
+    gc_info_t info;
+
+    for (int i = 0; i < num_corners; i++) {
+        gc_info(&info);
+        #define MIN_MEM (10*1024)
+        // Allocate keypoints until we're almost out of memory
+        if (info.free < MIN_MEM) {
+            // Try collecting memory
+            gc_collect();
+            // If it didn't work break
+            gc_info(&info);
+            if (info.free < MIN_MEM) {
+                break;
+            }
+        }
+
+        #undef MIN_MEM
+        // Note must set keypoint descriptor to zeros
+        kp_t *kpt = xalloc0(sizeof(kp_t));
+        kpt->x = corners[i].x;
+        kpt->y = corners[i].y;
+        kpt->score = corners[i].score;
+        array_push_back(keypoints, kpt);
+    }
+}
@@ -444,6 +444,12 @@ typedef struct DmtxScanGrid_struct {
    int             yCenter;       /* Y center of current cross pattern */
 } DmtxScanGrid;
 
+/* Candidate map tiles are (1 << DMTX_CANDIDATE_SHIFT) pixels square */
+#define DMTX_CANDIDATE_SHIFT           3
+#define DMTX_CANDIDATE_EDGE_X       0x01
+#define DMTX_CANDIDATE_EDGE_Y       0x02
+#define DMTX_CANDIDATE              0x04
+
 /**
  * @struct DmtxDecode
  * @brief DmtxDecode
@@ -469,6 +475,13 @@ typedef struct DmtxDecode_struct {
    unsigned char  *cache;
    DmtxImage      *image;
    DmtxScanGrid    grid;
+
+   /* Scan pruning (OpenMV) */
+   unsigned char  *candidates;    /* tile map, bit DMTX_CANDIDATE set where a region may start */
+   int             candidatesX;   /* image x of the first tile */
+   int             candidatesY;   /* image row (top-down) of the first tile */
+   int             candidatesCols;
+   int             candidatesRows;
 } DmtxDecode;
 
 /* dmtxdecode.c */
@@ -675,6 +688,7 @@ typedef struct C40TextState_struct {
 } C40TextState;
 
 /* dmtxregion.c */
+static DmtxBoolean RegionCandidate(DmtxDecode *dec, DmtxPixelLoc loc);
 static float RightAngleTrueness(DmtxVector2 c0, DmtxVector2 c1, DmtxVector2 c2, float angle);
 static DmtxPointFlow MatrixRegionSeekEdge(DmtxDecode *dec, DmtxPixelLoc loc0);
 static DmtxPassFail MatrixRegionOrientation(DmtxDecode *dec, DmtxRegion *reg, DmtxPointFlow flowBegin);
@@ -2239,6 +2253,31 @@ dmtxRegionDestroy(DmtxRegion **reg)
    return DmtxPass;
 }
 
+/**
+ * \brief  Test the candidate map (if any) at a scan location
+ * \param  dec Pointer to DmtxDecode information struct
+ * \param  loc Pixel location
+ * \return DmtxTrue if a region may start at loc
+ */
+static DmtxBoolean
+RegionCandidate(DmtxDecode *dec, DmtxPixelLoc loc)
+{
+   int col, row;
+
+   if(dec->candidates == NULL)
+      return DmtxTrue;
+
+   col = (loc.X - dec->candidatesX) >> DMTX_CANDIDATE_SHIFT;
+   row = (dec->image->height - 1 - loc.Y - dec->candidatesY) >> DMTX_CANDIDATE_SHIFT;
+
+   /* Outside of the map is not pruned */
+   if(loc.X < dec->candidatesX || col >= dec->candidatesCols ||
+      (dec->image->height - 1 - loc.Y) < dec->candidatesY || row >= dec->candidatesRows)
+      return DmtxTrue;
+
+   return (dec->candidates[(row * dec->candidatesCols) + col] & DMTX_CANDIDATE) ? DmtxTrue : DmtxFalse;
+}
+
 /**
  * \brief  Find next barcode region
  * \param  dec Pointer to DmtxDecode information struct
@@ -2257,6 +2296,15 @@ dmtxRegionFindNext(DmtxDecode *dec, int max_iterations, int *current_iterations)
       if(locStatus == DmtxRangeEnd)
          break;
 
+      /* Pruned locations don't count against max_iterations */
+      if(!RegionCandidate(dec, loc)) {
+         *current_iterations -= 1;
+         continue;
+      }
+
+      if(imlib_deadline_expired())
+         break;
+
       /* Scan location for presence of valid barcode region */
       reg = dmtxRegionScanPixel(dec, loc.X, loc.Y);
       if(reg != NULL)
@@ -6307,27 +6355,67 @@ dmtxMatrix3Print(DmtxMatrix3 m)
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Marks the tiles of the candidate map a Data Matrix region can be found from: tiles with an
+// edge that have both horizontal and vertical edges around them (the solid L of the finder
+// pattern and the modules always do). Flat areas and straight single edges are skipped by
+// dmtxRegionFindNext() without costing effort. Edges are sampled every other pixel/row, a step
+// edge at least as strong as the one MatrixRegionSeekEdge() requires is never missed.
+static void datamatrix_candidates(uint8_t *map, int cols, int rows, uint8_t *data, int stride, int w, int h, int edge_thresh)
+{
+    // MatrixRegionSeekEdge() wants a Sobel magnitude of edge_thresh * 7.65, 4x the contrast of
+    // a step edge, which is what the central differences below measure.
+    int thresh = IM_MAX(((edge_thresh * 765) + 200) / 400, 1);
+    memset(map, 0, cols * rows);
+
+    for (int y = 1, yy = h - 1; y < yy; y += 2) {
+        uint8_t *row = data + (y * stride);
+        uint8_t *map_row = map + ((y >> DMTX_CANDIDATE_SHIFT) * cols);
+
+        for (int x = 1, xx = w - 1; x < xx; x += 2) {
+            uint8_t *tile = map_row + (x >> DMTX_CANDIDATE_SHIFT);
+
+            if (abs(row[x + 1] - row[x - 1]) >= thresh) {
+                *tile |= DMTX_CANDIDATE_EDGE_X;
+            }
+
+            if (abs(row[x + stride] - row[x - stride]) >= thresh) {
+                *tile |= DMTX_CANDIDATE_EDGE_Y;
+            }
+        }
+    }
+
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < cols; x++) {
+            if (!map[(y * cols) + x]) {
+                continue;
+            }
+
+            int edges = 0;
+
+            for (int j = IM_MAX(y - 1, 0), jj = IM_MIN(y + 2, rows); j < jj; j++) {
+                for (int i = IM_MAX(x - 1, 0), ii = IM_MIN(x + 2, cols); i < ii; i++) {
+                    edges |= map[(j * cols) + i];
+                }
+            }
+
+            if ((edges & (DMTX_CANDIDATE_EDGE_X | DMTX_CANDIDATE_EDGE_Y)) == (DMTX_CANDIDATE_EDGE_X | DMTX_CANDIDATE_EDGE_Y)) {
+                map[(y * cols) + x] |= DMTX_CANDIDATE;
+            }
+        }
+    }
+}
+
 void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int effort)
 {
     uint8_t *grayscale_image = (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? ptr->data : fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
-    umm_init_x(fb_avail());
-
-    DmtxImage *image = dmtxImageCreate(grayscale_image,
-                                       (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? ptr->w : roi->w,
-                                       (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? ptr->h : roi->h,
-                                       DmtxPack8bppK);
-    DmtxDecode *decode = dmtxDecodeCreate(image, 1);
-    dmtxDecodeSetProp(decode, DmtxPropXmin, (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->x : 0);
-    dmtxDecodeSetProp(decode, DmtxPropYmin, (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->y : 0);
-    dmtxDecodeSetProp(decode, DmtxPropXmax, ((ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->x : 0) + (roi->w - 1));
-    dmtxDecodeSetProp(decode, DmtxPropYmax, ((ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->y : 0) + (roi->h - 1));
 
     switch (ptr->bpp) {
         case IMAGE_BPP_BINARY: {
+            uint8_t *grayscale_row = grayscale_image;
             for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
                 uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
                 for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                    *(grayscale_row++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
                 }
             }
             break;
@@ -6336,10 +6424,11 @@ void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int ef
             break;
         }
         case IMAGE_BPP_RGB565: {
+            uint8_t *grayscale_row = grayscale_image;
             for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
                 for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                    *(grayscale_row++) = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
                 }
             }
             break;
@@ -6350,6 +6439,37 @@ void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int ef
         }
     }
 
+    int candidates_cols = (roi->w + (1 << DMTX_CANDIDATE_SHIFT) - 1) >> DMTX_CANDIDATE_SHIFT;
+    int candidates_rows = (roi->h + (1 << DMTX_CANDIDATE_SHIFT) - 1) >> DMTX_CANDIDATE_SHIFT;
+    uint8_t *candidates = fb_alloc(candidates_cols * candidates_rows, FB_ALLOC_NO_HINT);
+    int edge_thresh = 10; // dmtxDecodeCreate() default
+
+    if (ptr->bpp == IMAGE_BPP_GRAYSCALE) {
+        datamatrix_candidates(candidates, candidates_cols, candidates_rows,
+                              IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, roi->y) + roi->x, ptr->w, roi->w, roi->h, edge_thresh);
+    } else {
+        datamatrix_candidates(candidates, candidates_cols, candidates_rows,
+                              grayscale_image, roi->w, roi->w, roi->h, edge_thresh);
+    }
+
+    umm_init_x(fb_avail());
+
+    DmtxImage *image = dmtxImageCreate(grayscale_image,
+                                       (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? ptr->w : roi->w,
+                                       (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? ptr->h : roi->h,
+                                       DmtxPack8bppK);
+    DmtxDecode *decode = dmtxDecodeCreate(image, 1);
+    dmtxDecodeSetProp(decode, DmtxPropXmin, (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->x : 0);
+    dmtxDecodeSetProp(decode, DmtxPropYmin, (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->y : 0);
+    dmtxDecodeSetProp(decode, DmtxPropXmax, ((ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->x : 0) + (roi->w - 1));
+    dmtxDecodeSetProp(decode, DmtxPropYmax, ((ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->y : 0) + (roi->h - 1));
+
+    decode->candidates = candidates;
+    decode->candidatesX = (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->x : 0;
+    decode->candidatesY = (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? roi->y : 0;
+    decode->candidatesCols = candidates_cols;
+    decode->candidatesRows = candidates_rows;
+
     list_init(out, sizeof(find_datamatrices_list_lnk_data_t));
 
     int max_iterations = effort;
@@ -6424,6 +6544,7 @@ void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int ef
     dmtxImageDestroy(&image);
 
     fb_free(); // umm_init_x();
+    fb_free(); // candidates
     if (ptr->bpp != IMAGE_BPP_GRAYSCALE) fb_free(); // grayscale_image;
 }
 
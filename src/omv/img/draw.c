@@ -72,18 +72,98 @@ void imlib_set_pixel(image_t *img, int x, int y, int p)
     }
 }
 
-// https://stackoverflow.com/questions/1201200/fast-algorithm-for-drawing-filled-circles
-static void point_fill(image_t *img, int cx, int cy, int r0, int r1, int c)
+// Draws the clipped horizontal run [x1, x2] of row y straight into the row.
+static void draw_span(image_t *img, int x1, int x2, int y, int c)
 {
-    for (int y = r0; y <= r1; y++) {
-        for (int x = r0; x <= r1; x++) {
-            if (((x * x) + (y * y)) <= (r0 * r0)) {
-                imlib_set_pixel(img, cx + x, cy + y, c);
+    if ((y < 0) || (y >= img->h)) {
+        return;
+    }
+
+    x1 = IM_MAX(x1, 0);
+    x2 = IM_MIN(x2, img->w - 1);
+
+    switch(img->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+            for (int x = x1; x <= x2; x++) {
+                IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, c);
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            if (x1 <= x2) {
+                memset(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + x1, c, x2 - x1 + 1);
             }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+            for (int x = x1; x <= x2; x++) {
+                IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, c);
+            }
+            break;
+        }
+        default: {
+            break;
         }
     }
 }
 
+// Draws the clipped vertical run [y1, y2] of column x.
+static void draw_vspan(image_t *img, int x, int y1, int y2, int c)
+{
+    if ((x < 0) || (x >= img->w)) {
+        return;
+    }
+
+    y1 = IM_MAX(y1, 0);
+    y2 = IM_MIN(y2, img->h - 1);
+
+    switch(img->bpp) {
+        case IMAGE_BPP_BINARY: {
+            for (int y = y1; y <= y2; y++) {
+                IMAGE_PUT_BINARY_PIXEL_FAST(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y), x, c);
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            for (int y = y1; y <= y2; y++) {
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y), x, c);
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            for (int y = y1; y <= y2; y++) {
+                IMAGE_PUT_RGB565_PIXEL_FAST(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y), x, c);
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// https://stackoverflow.com/questions/1201200/fast-algorithm-for-drawing-filled-circles
+// Each row of the disk is one span, x * x <= (r0 * r0) - (y * y) bounds it.
+static void point_fill(image_t *img, int cx, int cy, int r0, int r1, int c)
+{
+    if (r0 == r1) {
+        imlib_set_pixel(img, cx + r0, cy + r0, c);
+        return;
+    }
+
+    int r_squared = r0 * r0;
+
+    for (int y = IM_MAX(r0, -cy), yy = IM_MIN(r1, img->h - 1 - cy); y <= yy; y++) {
+        int rem = r_squared - (y * y);
+        int xm = fast_floorf(fast_sqrtf(rem));
+        while (((xm + 1) * (xm + 1)) <= rem) xm++;
+        while ((xm * xm) > rem) xm--;
+        draw_span(img, cx + IM_MAX(-xm, r0), cx + IM_MIN(xm, r1), cy + y, c);
+    }
+}
+
 // https://rosettacode.org/wiki/Bitmap/Bresenham%27s_line_algorithm#C
 void imlib_draw_line(image_t *img, int x0, int y0, int x1, int y1, int c, int thickness)
 {
@@ -106,33 +186,33 @@ void imlib_draw_line(image_t *img, int x0, int y0, int x1, int y1, int c, int th
 
 static void xLine(image_t *img, int x1, int x2, int y, int c)
 {
-    while (x1 <= x2) imlib_set_pixel(img, x1++, y, c);
+    draw_span(img, x1, x2, y, c);
 }
 
 static void yLine(image_t *img, int x, int y1, int y2, int c)
 {
-    while (y1 <= y2) imlib_set_pixel(img, x, y1++, c);
+    draw_vspan(img, x, y1, y2, c);
 }
 
 void imlib_draw_rectangle(image_t *img, int rx, int ry, int rw, int rh, int c, int thickness, bool fill)
 {
     if (fill) {
 
-        for (int y = ry, yy = ry + rh; y < yy; y++) {
-            for (int x = rx, xx = rx + rw; x < xx; x++) {
-                imlib_set_pixel(img, x, y, c);
-            }
+        for (int y = IM_MAX(ry, 0), yy = IM_MIN(ry + rh, img->h); y < yy; y++) {
+            xLine(img, rx, rx + rw - 1, y, c);
         }
 
     } else if (thickness > 0) {
         int thickness0 = (thickness - 0) / 2;
         int thickness1 = (thickness - 1) / 2;
 
-        for (int i = rx - thickness0, j = rx + rw + thickness1, k = ry + rh - 1; i < j; i++) {
-            yLine(img, i, ry - thickness0, ry + thickness1, c);
-            yLine(img, i, k - thickness0, k + thickness1, c);
+        // Top and bottom edges.
+        for (int i = ry - thickness0, j = ry + thickness1, k = rh - 1; i <= j; i++) {
+            xLine(img, rx - thickness0, rx + rw + thickness1 - 1, i, c);
+            xLine(img, rx - thickness0, rx + rw + thickness1 - 1, i + k, c);
         }
 
+        // Left and right edges.
         for (int i = ry - thickness0, j = ry + rh + thickness1, k = rx + rw - 1; i < j; i++) {
             xLine(img, rx - thickness0, rx + thickness1, i, c);
             xLine(img, k - thickness0, k + thickness1, i, c);
@@ -330,6 +410,29 @@ void imlib_draw_string(image_t *img, int x_off, int y_off, const char *str, int
     int org_y_off = y_off;
     const int anchor = x_off;
 
+    // Unrotated text is drawn in horizontal runs (rotating by 0 degrees doesn't move pixels).
+    bool fast_path = (!char_rotation) && (!string_rotation);
+
+    // Source glyph column/row of each scaled pixel, shared by all glyphs of the string.
+    int max_w = 0, max_h = 0;
+    for (int i = 0; i < 95; i++) {
+        max_w = IM_MAX(max_w, font[i].w);
+        max_h = IM_MAX(max_h, font[i].h);
+    }
+
+    int x_src_len = fast_floorf(max_w * scale), y_src_len = fast_floorf(max_h * scale);
+    fb_alloc_mark();
+    int *x_src = fb_alloc((x_src_len + y_src_len + 2) * sizeof(int), FB_ALLOC_NO_HINT);
+    int *y_src = x_src + x_src_len + 1;
+
+    for (int x = 0; x < x_src_len; x++) {
+        x_src[x] = fast_floorf(x / scale);
+    }
+
+    for (int y = 0; y < y_src_len; y++) {
+        y_src[y] = fast_floorf(y / scale);
+    }
+
     for(char ch, last = '\0'; (ch = *str); str++, last = ch) {
 
         if ((last == '\r') && (ch == '\n')) { // handle "\r\n" strings
@@ -381,13 +484,40 @@ void imlib_draw_string(image_t *img, int x_off, int y_off, const char *str, int
             }
         }
 
-        for (int y = 0, yy = fast_floorf(g->h * scale); y < yy; y++) {
-            for (int x = 0, xx = fast_floorf(g->w * scale); x < xx; x++) {
-                if (g->data[fast_floorf(y / scale)] & (1 << (g->w - 1 - fast_floorf(x / scale)))) {
-                    int16_t x_tmp = x_off + (char_hmirror ? (xx - x - 1) : x), y_tmp = y_off + (char_vflip ? (yy - y - 1) : y);
-                    point_rotate(x_tmp, y_tmp, IM_DEG2RAD(char_rotation), x_off + (xx / 2), y_off + (yy / 2), &x_tmp, &y_tmp);
-                    point_rotate(x_tmp, y_tmp, IM_DEG2RAD(string_rotation), org_x_off, org_y_off, &x_tmp, &y_tmp);
-                    imlib_set_pixel(img, x_tmp, y_tmp, c);
+        int yy = fast_floorf(g->h * scale), xx = fast_floorf(g->w * scale);
+
+        for (int y = 0; y < yy; y++) {
+            uint32_t row = g->data[y_src[y]];
+
+            if (fast_path) {
+                // Runs of set pixels are drawn as spans.
+                for (int x = 0; x < xx; x++) {
+                    if (!(row & (1 << (g->w - 1 - x_src[x])))) {
+                        continue;
+                    }
+
+                    int x_end = x;
+                    while (((x_end + 1) < xx) && (row & (1 << (g->w - 1 - x_src[x_end + 1])))) {
+                        x_end++;
+                    }
+
+                    int y_tmp = y_off + (char_vflip ? (yy - y - 1) : y);
+                    if (char_hmirror) {
+                        draw_span(img, x_off + (xx - x_end - 1), x_off + (xx - x - 1), y_tmp, c);
+                    } else {
+                        draw_span(img, x_off + x, x_off + x_end, y_tmp, c);
+                    }
+
+                    x = x_end;
+                }
+            } else {
+                for (int x = 0; x < xx; x++) {
+                    if (row & (1 << (g->w - 1 - x_src[x]))) {
+                        int16_t x_tmp = x_off + (char_hmirror ? (xx - x - 1) : x), y_tmp = y_off + (char_vflip ? (yy - y - 1) : y);
+                        point_rotate(x_tmp, y_tmp, IM_DEG2RAD(char_rotation), x_off + (xx / 2), y_off + (yy / 2), &x_tmp, &y_tmp);
+                        point_rotate(x_tmp, y_tmp, IM_DEG2RAD(string_rotation), org_x_off, org_y_off, &x_tmp, &y_tmp);
+                        imlib_set_pixel(img, x_tmp, y_tmp, c);
+                    }
                 }
             }
         }
@@ -429,6 +559,8 @@ void imlib_draw_string(image_t *img, int x_off, int y_off, const char *str, int
             if (!exit) x_off += (string_hmirror ? -1 : +1) * fast_floorf(scale * 3); // space char
         }
     }
+
+    fb_alloc_free_till_mark();
 }
 
 static int safe_map_pixel(int dst_bpp, int src_bpp, int pixel)
@@ -577,14 +709,13 @@ inline bool pixel_to_binary(int bpp, uint32_t pixel) {
  * @param mask_bpp Mask image bits per pixel.
  * @param other_x_start Start x pixel location in source/mask image.
  * @param other_x_end End x pixel (exclusive) location in source/mask image.
- * @param over_x_scale Scale from other scale to image scale.
+ * @param x_table Source x pixel and weight of each drawn pixel, see draw_image_x_table().
  */
-static void int_generate_cache_line_grayscale(uint16_t *cache_line, int alpha, uint8_t *other_row_ptr, int other_bpp, void *mask_row_ptr, int mask_bpp, int other_x_start, int other_x_end, float over_xscale, const uint8_t *alpha_palette)
+static void int_generate_cache_line_grayscale(uint16_t *cache_line, int alpha, uint8_t *other_row_ptr, int other_bpp, void *mask_row_ptr, int mask_bpp, int other_x_start, int other_x_end, const uint32_t *x_table, const uint8_t *alpha_palette)
 {
     for (int i = 0, x = other_x_start; x < other_x_end; x++, i++) {
-        float other_x_float = (x + 0.5) * over_xscale;
-        uint32_t other_x = fast_floorf(other_x_float);
-        uint32_t weight_x = fast_floorf((other_x_float - other_x) * alpha);
+        uint32_t other_x = x_table[i] >> 8;
+        uint32_t weight_x = x_table[i] & 0xFF;
         bool mask1 = true, mask2 = true;
 
         if (mask_row_ptr) {
@@ -626,15 +757,14 @@ static void int_generate_cache_line_grayscale(uint16_t *cache_line, int alpha, u
  * @param mask_bpp Mask image bits per pixel.
  * @param other_x_start Start x pixel location in source/mask image.
  * @param other_x_end End x pixel (exclusive) location in source/mask image.
- * @param over_x_scale Scale from other scale to image scale.
+ * @param x_table Source x pixel and weight of each drawn pixel, see draw_image_x_table().
  */
-static void int_generate_cache_line_rgb565(uint32_t *cache_line, int alpha, const uint16_t *other_row_ptr, int other_bpp, const void *mask_row_ptr, int mask_bpp, int other_x_start, int other_x_end, float over_xscale, const uint16_t *color_palette, const uint8_t *alpha_palette)
+static void int_generate_cache_line_rgb565(uint32_t *cache_line, int alpha, const uint16_t *other_row_ptr, int other_bpp, const void *mask_row_ptr, int mask_bpp, int other_x_start, int other_x_end, const uint32_t *x_table, const uint16_t *color_palette, const uint8_t *alpha_palette)
 {
     // generate line
     for (int i = 0, x = other_x_start; x < other_x_end; x++, i++) {
-        float other_x_float = (x + 0.5) * over_xscale;
-        uint32_t other_x = fast_floorf(other_x_float);
-        uint32_t weight_x = fast_floorf((other_x_float - other_x) * alpha);
+        uint32_t other_x = x_table[i] >> 8;
+        uint32_t weight_x = x_table[i] & 0xFF;
         bool mask1 = true, mask2 = true;
 
         if (mask_row_ptr) {
@@ -664,6 +794,106 @@ static void int_generate_cache_line_rgb565(uint32_t *cache_line, int alpha, cons
     }
 }
 
+/**
+ * Precomputes the source x pixel of each drawn pixel, so the float math is done once per call
+ * instead of once per line. Bilinear entries also hold the weight (0->alpha) of the next pixel
+ * in the low byte. The table is allocated with fb_alloc().
+ *
+ * @param other_x_start Start x pixel location in source/mask image.
+ * @param other_x_end End x pixel (exclusive) location in source/mask image.
+ * @param over_x_scale Scale from other scale to image scale.
+ * @param bilinear Compute the bilinear weights.
+ * @param alpha Bilinear weight scale.
+ */
+static uint32_t *draw_image_x_table(int other_x_start, int other_x_end, float over_xscale, bool bilinear, int alpha)
+{
+    uint32_t *x_table = fb_alloc((other_x_end - other_x_start) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (int i = 0, x = other_x_start; x < other_x_end; x++, i++) {
+        if (bilinear) {
+            float other_x_float = (x + 0.5) * over_xscale;
+            uint32_t other_x = fast_floorf(other_x_float);
+            uint32_t weight_x = fast_floorf((other_x_float - other_x) * alpha);
+            x_table[i] = (other_x << 8) | weight_x;
+        } else {
+            x_table[i] = fast_floorf(x * over_xscale);
+        }
+    }
+
+    return x_table;
+}
+
+/**
+ * Blends rows of an unscaled image of the same format with a constant alpha. Gives the same
+ * result as the general nearest neighbor path without the per pixel lookups.
+ *
+ * @param img The image to draw onto.
+ * @param other The image to draw.
+ * @param x_off X offset in destination.
+ * @param y_off Y offset in destination.
+ * @param other_x_start Start x pixel location in other.
+ * @param other_x_end End x pixel (exclusive) location in other.
+ * @param other_y_start Start y pixel location in other.
+ * @param other_y_end End y pixel (exclusive) location in other.
+ * @param alpha Alpha, between 0 and 256 inclusive.
+ */
+static void draw_image_direct(image_t *img, image_t *other, int x_off, int y_off, int other_x_start, int other_x_end, int other_y_start, int other_y_end, int alpha)
+{
+    int n = other_x_end - other_x_start;
+
+    switch(img->bpp) {
+        case IMAGE_BPP_GRAYSCALE: {
+            uint32_t packed_alpha = (alpha << 16) + (256 - alpha);
+
+            for (int y = other_y_start; y < other_y_end; y++) {
+                uint8_t *img_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_off + y) + x_off + other_x_start;
+                uint8_t *other_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y) + other_x_start;
+
+                if (!(packed_alpha & 0x1ff)) {
+                    memmove(img_row_ptr, other_row_ptr, n);
+                    continue;
+                }
+
+                for (int x = 0; x < n; x++) {
+                    uint32_t vgs = (other_row_ptr[x] << 16) + img_row_ptr[x];
+                    img_row_ptr[x] = __SMUAD(packed_alpha, vgs) >> 8;
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            // Alpha is 0->128
+            alpha >>= 1;
+            uint32_t alpha_complement = 128 - alpha;
+
+            for (int y = other_y_start; y < other_y_end; y++) {
+                uint16_t *img_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y_off + y) + x_off + other_x_start;
+                uint16_t *other_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y) + other_x_start;
+
+                if (!alpha_complement) {
+                    memmove(img_row_ptr, other_row_ptr, n * sizeof(uint16_t));
+                    continue;
+                }
+
+                for (int x = 0; x < n; x++) {
+                    uint32_t other_pixel = other_row_ptr[x];
+                    uint32_t img_pixel = img_row_ptr[x];
+                    // Red and blue are blended together in separate 16-bit lanes (5 + 7 bits never carry).
+                    uint32_t other_rb = COLOR_RGB565_TO_R5(other_pixel) | (COLOR_RGB565_TO_B5(other_pixel) << 16);
+                    uint32_t img_rb = COLOR_RGB565_TO_R5(img_pixel) | (COLOR_RGB565_TO_B5(img_pixel) << 16);
+                    uint32_t rb = (other_rb * alpha) + (img_rb * alpha_complement);
+                    uint32_t g = (COLOR_RGB565_TO_G6(other_pixel) * alpha) + (COLOR_RGB565_TO_G6(img_pixel) * alpha_complement);
+                    img_row_ptr[x] = COLOR_R5_G6_B5_TO_RGB565((rb & 0xFFFF) >> 7, g >> 7, rb >> 23);
+                }
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
 /**
  * Draw an image onto another image converting format if necessary.
  * 
@@ -724,18 +954,29 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
     const int other_bpp = other->bpp;
     const int mask_bpp = mask ? mask->bpp : 0;
 
+    // Unscaled same format images with a constant alpha are blended row to row.
+    if ((x_scale == 1.0f) && (y_scale == 1.0f) && (!(hint & IMAGE_HINT_BILINEAR)) && (img_bpp == other_bpp)
+    && (!mask) && (!color_palette) && (!alpha_palette)
+    && ((img_bpp == IMAGE_BPP_GRAYSCALE) || (img_bpp == IMAGE_BPP_RGB565))) {
+        draw_image_direct(img, other, x_off, y_off, other_x_start, other_x_end, other_y_start, other_y_end, alpha);
+        return;
+    }
+
     switch(img_bpp) {
         case IMAGE_BPP_BINARY: {
             // If alpha is less that 128 on a bitmap we're just copying the image back to the image, so do nothing
             if (alpha >= 128) {
+                fb_alloc_mark();
+                uint32_t *x_table = draw_image_x_table(other_x_start, other_x_end, over_xscale, false, 0);
+
                 // Iterate the img area to be updated
                 for (int y = other_y_start; y < other_y_end; y++) {
                     uint32_t *img_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y_off + y);
                     const int other_y = fast_floorf(y * over_yscale);
                     void *other_row_ptr = imlib_compute_row_ptr(other, other_y);
 
-                    for (int x = other_x_start; x < other_x_end; x++) {
-                        const int other_x = fast_floorf(x * over_xscale);
+                    for (int i = 0, x = other_x_start; x < other_x_end; x++, i++) {
+                        const int other_x = x_table[i];
 
                         if (!mask || image_get_mask_pixel(mask, other_x, other_y)) {
                             uint32_t result_pixel = safe_map_pixel(IMAGE_BPP_BINARY, other_bpp, imlib_get_pixel_fast(other_bpp, other_row_ptr, other_x));
@@ -744,6 +985,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                         }
                     }
                 }
+
+                fb_alloc_free_till_mark();
             }
             break;
         }
@@ -757,13 +1000,14 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                 uint16_t *cache_line_2 = fb_alloc(bytes_per_img_line, FB_ALLOC_NO_HINT);
                 uint16_t *cache_line_top = cache_line_2;
                 uint16_t *cache_line_bottom = cache_line_1;
+                uint32_t *x_table = draw_image_x_table(other_x_start, other_x_end, over_xscale, true, alpha);
 
                 // Pre-fill cache for first drawn line
                 int temp_other_y = fast_floorf(other_y_start * over_yscale);
                 uint8_t *other_row_ptr = imlib_compute_row_ptr(other, temp_other_y);
                 void *mask_row_ptr = mask ? imlib_compute_row_ptr(mask, temp_other_y) : NULL;
 
-                int_generate_cache_line_grayscale(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, over_xscale, alpha_palette);
+                int_generate_cache_line_grayscale(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, x_table, alpha_palette);
 
                 // Used to detect when other starts rendering from the next line
                 int last_other_y = -1;
@@ -793,7 +1037,7 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                         // And generate a new y+1
                         other_row_ptr = imlib_compute_row_ptr(other, other_y + 1);
                         mask_row_ptr = mask ? imlib_compute_row_ptr(mask, other_y + 1) : NULL;
-                        int_generate_cache_line_grayscale(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, over_xscale, alpha_palette);
+                        int_generate_cache_line_grayscale(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, x_table, alpha_palette);
                     }
 
                     // Draw the line to img
@@ -828,6 +1072,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
             } else {
                 // 00000000otheralph00000000imgalpha
                 uint32_t packed_alpha = (alpha << 16) + (256 - alpha);
+                fb_alloc_mark();
+                uint32_t *x_table = draw_image_x_table(other_x_start, other_x_end, over_xscale, false, 0);
 
                 // Iterate the img area to be updated
                 for (int y = other_y_start; y < other_y_end; y++) {
@@ -836,8 +1082,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                     int other_y = fast_floorf(y * over_yscale);
                     uint16_t *other_row_ptr = imlib_compute_row_ptr(other, other_y);
 
-                    for (int x = other_x_start; x < other_x_end; x++) {
-                        int other_x = fast_floorf(x * over_xscale);
+                    for (int i = 0, x = other_x_start; x < other_x_end; x++, i++) {
+                        int other_x = x_table[i];
 
                         if (!mask || image_get_mask_pixel(mask, other_x, other_y)) {
                             uint8_t result_pixel = safe_map_pixel(IMAGE_BPP_GRAYSCALE, other_bpp, imlib_get_pixel_fast(other_bpp, other_row_ptr, other_x));
@@ -859,6 +1105,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                         }
                     }
                 }
+
+                fb_alloc_free_till_mark();
             }
             break;
         }
@@ -875,13 +1123,14 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                 uint32_t *cache_line_2 = fb_alloc(bytes_per_img_line, FB_ALLOC_NO_HINT);
                 uint32_t *cache_line_top = cache_line_2;
                 uint32_t *cache_line_bottom = cache_line_1;
+                uint32_t *x_table = draw_image_x_table(other_x_start, other_x_end, over_xscale, true, alpha);
 
                 // Pre-fill cache for first drawn line
                 int temp_other_y = fast_floorf(other_y_start * over_yscale);
                 uint16_t *other_row_ptr = imlib_compute_row_ptr(other, temp_other_y);
                 void *mask_row_ptr = mask ? imlib_compute_row_ptr(mask, temp_other_y) : NULL;
 
-                int_generate_cache_line_rgb565(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, over_xscale, color_palette, alpha_palette);
+                int_generate_cache_line_rgb565(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, x_table, color_palette, alpha_palette);
 
                 // Used to detect when other starts rendering from the next line
                 int last_other_y = -1;
@@ -912,7 +1161,7 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                         
                         other_row_ptr = imlib_compute_row_ptr(other, other_y + 1);
                         mask_row_ptr = mask ? imlib_compute_row_ptr(mask, other_y + 1) : NULL;
-                        int_generate_cache_line_rgb565(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, over_xscale, color_palette, alpha_palette);
+                        int_generate_cache_line_rgb565(cache_line_bottom, alpha, other_row_ptr, other_bpp, mask_row_ptr, mask_bpp, other_x_start, other_x_end, x_table, color_palette, alpha_palette);
 
                         last_other_y = other_y;
                     }
@@ -952,6 +1201,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                 fb_alloc_free_till_mark();
             } else {
                 uint32_t va = __PKHBT((128 - alpha), alpha, 16);
+                fb_alloc_mark();
+                uint32_t *x_table = draw_image_x_table(other_x_start, other_x_end, over_xscale, false, 0);
 
                 // Iterate the img area to be updated
                 for (int y = other_y_start; y < other_y_end; y++) {
@@ -961,8 +1212,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                     int other_y = fast_floorf(other_y_float);
                     uint16_t *other_row_ptr = imlib_compute_row_ptr(other, other_y);
                     
-                    for (int x = other_x_start; x < other_x_end; x++) {
-                        int other_x = fast_floorf(x * over_xscale);
+                    for (int i = 0, x = other_x_start; x < other_x_end; x++, i++) {
+                        int other_x = x_table[i];
 
                         if (!mask || image_get_mask_pixel(mask, other_x, other_y)) {
                             uint32_t result_pixel = imlib_get_pixel_fast(other_bpp, other_row_ptr, other_x);
@@ -993,6 +1244,8 @@ void imlib_draw_image(image_t *img, image_t *other, int x_off, int y_off, float
                         }
                     }
                 }
+
+                fb_alloc_free_till_mark();
             }
             break;
         }
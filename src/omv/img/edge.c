@@ -15,11 +15,6 @@
 #include "fb_alloc.h"
 #ifdef IMLIB_ENABLE_BINARY_OPS
 
-typedef struct gvec {
-    uint16_t t;
-    uint16_t g;
-} gvec_t;
-
 void imlib_edge_simple(image_t *src, rectangle_t *roi, int low_thresh, int high_thresh)
 {
     imlib_morph(src, 1, kernel_high_pass_3, 1.0f, 0.0f, false, 0, false, NULL);
@@ -34,124 +29,213 @@ void imlib_edge_simple(image_t *src, rectangle_t *roi, int low_thresh, int high_
     imlib_erode(src, 1, 2, NULL);
 }
 
+// Gradient direction sectors, the magnitude is only kept if it's larger than the magnitudes of
+// the two neighbours along the gradient. The sector comes from comparing |vy| with |vx| scaled
+// by tan(22.5) and tan(67.5) in Q8, so there's no atan2 per pixel.
+#define CANNY_TAN_22_5      (106)
+#define CANNY_TAN_67_5      (618)
+#define CANNY_SECTOR_0      (0) // horizontal gradient
+#define CANNY_SECTOR_45     (1) // gradient along x == y (down right)
+#define CANNY_SECTOR_90     (2) // vertical gradient
+#define CANNY_SECTOR_135    (3) // gradient along x == -y (down left)
+
+#define CANNY_NONE          (0)
+#define CANNY_WEAK          (1)
+#define CANNY_STRONG        (2)
+
+// Neighbour (dx, dy) offsets compared along the gradient for each sector.
+static const int8_t canny_sector_dx[4] = {1, 1, 0, -1};
+static const int8_t canny_sector_dy[4] = {0, 1, 1, 1};
+
+// Run of weak/strong edge pixels, merged with the runs they touch on the previous row.
+typedef struct canny_run {
+    uint16_t x0, x1;
+    uint32_t parent : 31;
+    uint32_t strong : 1;
+} canny_run_t;
+
+static uint32_t canny_find(canny_run_t *runs, uint32_t i)
+{
+    while (runs[i].parent != i) {
+        runs[i].parent = runs[runs[i].parent].parent; // path halving
+        i = runs[i].parent;
+    }
+
+    return i;
+}
+
+// Blurs image row y (clamped to the image) with the 3x3 Gaussian [1 2 1] x [1 2 1] / 16 over the
+// roi columns. The columns left and right of the roi are read from the image when they exist.
+static void canny_blur_row(image_t *src, rectangle_t *roi, int y, uint16_t *col_buf, uint8_t *out)
+{
+    uint8_t *row_0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, IM_MAX(y - 1, 0));
+    uint8_t *row_1 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y);
+    uint8_t *row_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, IM_MIN(y + 1, src->h - 1));
+
+    for (int i = 0, ii = roi->w + 2; i < ii; i++) {
+        int x = IM_MIN(IM_MAX(roi->x + i - 1, 0), src->w - 1);
+        col_buf[i] = row_0[x] + (row_1[x] << 1) + row_2[x];
+    }
+
+    for (int i = 0, ii = roi->w; i < ii; i++) {
+        out[i] = (col_buf[i] + (col_buf[i + 1] << 1) + col_buf[i + 2] + 8) >> 4;
+    }
+}
+
+// Sobel on the blurred rows, stores the squared magnitude (compared against the squared
+// thresholds, so there's no sqrt either) and the direction sector of each pixel.
+static void canny_gradient_row(int w, uint8_t *row_0, uint8_t *row_1, uint8_t *row_2, uint32_t *mag, uint8_t *sector)
+{
+    mag[0] = mag[w - 1] = 0;
+    sector[0] = sector[w - 1] = CANNY_SECTOR_0;
+
+    for (int x = 1, xx = w - 1; x < xx; x++) {
+        int vx = (row_0[x - 1] - row_0[x + 1]) + ((row_1[x - 1] - row_1[x + 1]) << 1) + (row_2[x - 1] - row_2[x + 1]);
+        int vy = (row_0[x - 1] + (row_0[x] << 1) + row_0[x + 1]) - (row_2[x - 1] + (row_2[x] << 1) + row_2[x + 1]);
+        int ax = abs(vx), ay = abs(vy) << 8;
+
+        mag[x] = (vx * vx) + (vy * vy);
+
+        if (ay <= (ax * CANNY_TAN_22_5)) {
+            sector[x] = CANNY_SECTOR_0;
+        } else if (ay >= (ax * CANNY_TAN_67_5)) {
+            sector[x] = CANNY_SECTOR_90;
+        } else {
+            sector[x] = ((vx ^ vy) >= 0) ? CANNY_SECTOR_45 : CANNY_SECTOR_135;
+        }
+    }
+}
+
 void imlib_edge_canny(image_t *src, rectangle_t *roi, int low_thresh, int high_thresh)
 {
-    int w = src->w;
-
-    gvec_t *gm = fb_alloc0(roi->w*roi->h*sizeof*gm, FB_ALLOC_NO_HINT);
-
-    //1. Noise Reduction with a Gaussian filter
-    imlib_sepconv3(src, kernel_gauss_3, 1.0f/16.0f, 0.0f);
-
-    //2. Finding Image Gradients
-    for (int gy=1, y=roi->y+1; y<roi->y+roi->h-1; y++, gy++) {
-        for (int gx=1, x=roi->x+1; x<roi->x+roi->w-1; x++, gx++) {
-            int vx=0, vy=0;
-            // sobel kernel in the horizontal direction
-            vx  = src->data [(y-1)*w+x-1]
-                - src->data [(y-1)*w+x+1]
-                + (src->data[(y+0)*w+x-1]<<1)
-                - (src->data[(y+0)*w+x+1]<<1)
-                + src->data [(y+1)*w+x-1]
-                - src->data [(y+1)*w+x+1];
-
-            // sobel kernel in the vertical direction
-            vy  = src->data [(y-1)*w+x-1]
-                + (src->data[(y-1)*w+x+0]<<1)
-                + src->data [(y-1)*w+x+1]
-                - src->data [(y+1)*w+x-1]
-                - (src->data[(y+1)*w+x+0]<<1)
-                - src->data [(y+1)*w+x+1];
-
-            // Find magnitude
-            int g = (int) fast_sqrtf(vx*vx + vy*vy);
-            // Find the direction and round angle to 0, 45, 90 or 135
-            int t = (int) fast_fabsf((atan2f(vy, vx)*180.0f/M_PI));
-            if (t < 22) {
-                t = 0;
-            } else if (t < 67) {
-                t = 45;
-            } else if (t < 112) {
-                t = 90;
-            } else if (t < 160) {
-                t = 135;
-            } else if (t <= 180) {
-                t = 0;
-            }
+    int w = roi->w;
+    int h = roi->h;
 
-            gm[gy*roi->w+gx].t = t;
-            gm[gy*roi->w+gx].g = g;
+    if ((w < 3) || (h < 3)) {
+        for (int y = roi->y, yy = roi->y + h; y < yy; y++) {
+            memset(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y) + roi->x, 0, w);
         }
+        return;
     }
 
-    // 3. Hysteresis Thresholding
-    // 4. Non-maximum Suppression and output
-    for (int gy=0, y=roi->y; y<roi->y+roi->h; y++, gy++) {
-        for (int gx=0, x=roi->x; x<roi->x+roi->w; x++, gx++) {
-            int i = y*w+x;
-            gvec_t *va=NULL, *vb=NULL, *vc = &gm[gy*roi->w+gx];
-
-            // Clear the borders
-            if (y == (roi->y) || y == (roi->y+roi->h-1) ||
-                x == (roi->x) || x == (roi->x+roi->w-1)) {
-                src->data[i] = 0;
-                continue;
+    uint32_t low = IM_MAX(low_thresh, 0) * IM_MAX(low_thresh, 0);
+    uint32_t high = IM_MAX(high_thresh, 0) * IM_MAX(high_thresh, 0);
+
+    // Rows are streamed through rings of 3 blurred rows and 3 gradient rows. The edge class of
+    // roi row j is written back to the image once row j + 3 has been read, when row j isn't
+    // needed anymore, so no full size gradient buffer is needed.
+    uint16_t *col_buf = fb_alloc((w + 2) * sizeof(uint16_t), FB_ALLOC_PREFER_SPEED);
+    uint8_t *blur = fb_alloc(w * 3, FB_ALLOC_PREFER_SPEED);
+    uint32_t *mag = fb_alloc(w * 3 * sizeof(uint32_t), FB_ALLOC_PREFER_SPEED);
+    uint8_t *sector = fb_alloc(w * 3, FB_ALLOC_PREFER_SPEED);
+    uint32_t n_runs = 0;
+
+    canny_blur_row(src, roi, roi->y, col_buf, blur);
+    canny_blur_row(src, roi, roi->y + 1, col_buf, blur + w);
+    memset(mag, 0, w * sizeof(uint32_t)); // row 0 is the border
+
+    for (int j = 1; j < h; j++) {
+        uint32_t *mag_row = mag + ((j % 3) * w);
+        uint8_t *sector_row = sector + ((j % 3) * w);
+
+        if (j < (h - 1)) {
+            canny_blur_row(src, roi, roi->y + j + 1, col_buf, blur + (((j + 1) % 3) * w));
+            canny_gradient_row(w, blur + (((j - 1) % 3) * w), blur + ((j % 3) * w), blur + (((j + 1) % 3) * w),
+                               mag_row, sector_row);
+        } else {
+            memset(mag_row, 0, w * sizeof(uint32_t)); // row h - 1 is the border
+        }
+
+        // Non-maximum suppression and thresholding of row j - 1.
+        uint8_t *out = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + j - 1) + roi->x;
+        memset(out, CANNY_NONE, w);
+
+        if (j > 1) {
+            uint32_t *m[3] = {mag + (((j - 2) % 3) * w), mag + (((j - 1) % 3) * w), mag_row};
+            uint8_t *s = sector + (((j - 1) % 3) * w);
+
+            for (int x = 1, xx = w - 1, prev = CANNY_NONE; x < xx; x++) {
+                uint32_t g = m[1][x];
+
+                if (g >= low) {
+                    int dx = canny_sector_dx[s[x]];
+                    int dy = canny_sector_dy[s[x]];
+
+                    if ((g > m[1 + dy][x + dx]) && (g > m[1 - dy][x - dx])) {
+                        out[x] = (g >= high) ? CANNY_STRONG : CANNY_WEAK;
+                    }
+                }
+
+                n_runs += (out[x] != CANNY_NONE) && (prev == CANNY_NONE);
+                prev = out[x];
             }
+        }
+    }
 
-            if (vc->g < low_thresh) {
-                // Not an edge
-                src->data[i] = 0;
-                continue;
-            // Check if strong or weak edge
-            } else if (vc->g >= high_thresh ||
-                       gm[(gy-1)*roi->w+(gx-1)].g >= high_thresh ||
-                       gm[(gy-1)*roi->w+(gx+0)].g >= high_thresh ||
-                       gm[(gy-1)*roi->w+(gx+1)].g >= high_thresh ||
-                       gm[(gy+0)*roi->w+(gx-1)].g >= high_thresh ||
-                       gm[(gy+0)*roi->w+(gx+1)].g >= high_thresh ||
-                       gm[(gy+1)*roi->w+(gx-1)].g >= high_thresh ||
-                       gm[(gy+1)*roi->w+(gx+0)].g >= high_thresh ||
-                       gm[(gy+1)*roi->w+(gx+1)].g >= high_thresh) {
-                vc->g = vc->g;
-            } else { // Not an edge
-                src->data[i] = 0;
+    memset(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + h - 1) + roi->x, CANNY_NONE, w);
+
+    fb_free(); // sector
+    fb_free(); // mag
+    fb_free(); // blur
+    fb_free(); // col_buf
+
+    // Hysteresis: weak edges are kept if they are 8-connected to a strong edge. The runs of edge
+    // pixels are merged with a union-find in one scan instead of flood filling from each strong
+    // edge, then a second scan writes the runs out.
+    canny_run_t *runs = fb_alloc(IM_MAX(n_runs, 1) * sizeof(canny_run_t), FB_ALLOC_NO_HINT);
+    uint32_t *row_runs = fb_alloc((h + 1) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t n = 0;
+
+    for (int j = 0; j < h; j++) {
+        uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + j) + roi->x;
+        uint32_t prev_run = j ? row_runs[j - 1] : 0;
+        uint32_t prev_end = n;
+        row_runs[j] = n;
+
+        for (int x = 0; x < w; x++) {
+            if (row[x] == CANNY_NONE) {
                 continue;
             }
 
-            switch (vc->t) {
-                case 0: {
-                    va = &gm[(gy+0)*roi->w+(gx-1)];
-                    vb = &gm[(gy+0)*roi->w+(gx+1)];
-                    break;
-                }
+            canny_run_t *run = runs + n;
+            run->x0 = x;
+            run->parent = n;
+            run->strong = false;
 
-                case 45: {
-                    va = &gm[(gy+1)*roi->w+(gx-1)];
-                    vb = &gm[(gy-1)*roi->w+(gx+1)];
-                    break;
-                }
+            for (; (x < w) && (row[x] != CANNY_NONE); x++) {
+                run->strong |= (row[x] == CANNY_STRONG);
+            }
 
-                case 90: {
-                    va = &gm[(gy+1)*roi->w+(gx+0)];
-                    vb = &gm[(gy-1)*roi->w+(gx+0)];
-                    break;
-                }
+            run->x1 = x - 1;
 
-                case 135: {
-                    va = &gm[(gy+1)*roi->w+(gx+1)];
-                    vb = &gm[(gy-1)*roi->w+(gx-1)];
-                    break;
+            // Runs on the previous row touching [x0 - 1, x1 + 1].
+            for (; (prev_run < prev_end) && ((runs[prev_run].x1 + 1) < run->x0); prev_run++);
+
+            for (uint32_t k = prev_run; (k < prev_end) && (runs[k].x0 <= (run->x1 + 1)); k++) {
+                uint32_t a = canny_find(runs, n), b = canny_find(runs, k);
+
+                if (a != b) {
+                    runs[a].parent = b;
+                    runs[b].strong |= runs[a].strong;
                 }
             }
 
-            if (!(vc->g > va->g && vc->g > vb->g)) {
-                src->data[i] = 0;
-            } else {
-                src->data[i] = 255;
-            }
+            n++;
+        }
+    }
+
+    row_runs[h] = n;
+
+    for (int j = 0; j < h; j++) {
+        uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + j) + roi->x;
+
+        for (uint32_t k = row_runs[j], kk = row_runs[j + 1]; k < kk; k++) {
+            memset(row + runs[k].x0, runs[canny_find(runs, k)].strong ? COLOR_GRAYSCALE_MAX : 0,
+                   runs[k].x1 - runs[k].x0 + 1);
         }
     }
 
-    fb_free();
+    fb_free(); // row_runs
+    fb_free(); // runs
 }
 #endif
@@ -7,107 +7,174 @@
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
  * Pupil localization using image gradients. See Fabian Timm's paper for details.
+ *
+ * The center is where the most gradients point away from, weighted by how dark it is. Gradients
+ * are kept as Q15 unit vectors and the displacement from a gradient to a center is normalized
+ * with a table of 1/|d| in Q15, so the voting is integer only. Centers are searched on a coarse
+ * grid first, then at every pixel around the best coarse centers.
  */
 #include "imlib.h"
-#include "xalloc.h"
+#include "fb_alloc.h"
 #include "fmath.h"
 
-static void find_gradients(image_t *src, array_t *gradients, int x_off, int y_off, int box_w, int box_h)
+#define IRIS_GRADIENT_THRESHOLD (200) // Minimum gradient magnitude.
+#define IRIS_GRADIENT_MAX_DIFF  (100) // Maximum difference from the average magnitude.
+#define IRIS_COARSE_STEP        (4)
+#define IRIS_CANDIDATES         (8)   // Coarse centers refined.
+
+typedef struct iris_gradient {
+    int16_t x, y;
+    int16_t gx, gy; // Unit vector in Q15.
+    uint16_t m;
+} iris_gradient_t;
+
+typedef struct iris_candidate {
+    uint64_t score;
+    int x, y;
+} iris_candidate_t;
+
+static int find_gradients(image_t *src, iris_gradient_t *gradients, int x_off, int y_off, int box_w, int box_h)
 {
+    int n = 0;
+
     for (int y=y_off; y<y_off+box_h-3; y++) {
-        for (int x=x_off; x<x_off+box_w-3; x++) {
-            int vx=0, vy=0, w=src->w;
-            // sobel_kernel
-            vx  = src->data[(y+0)*w+x+0]
-                - src->data[(y+0)*w+x+2]
-                + (src->data[(y+1)*w+x+0]<<1)
-                - (src->data[(y+1)*w+x+2]<<1)
-                + src->data[(y+2)*w+x+0]
-                - src->data[(y+2)*w+x+2];
+        uint8_t *row_0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y);
+        uint8_t *row_1 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y+1);
+        uint8_t *row_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y+2);
 
+        for (int x=x_off; x<x_off+box_w-3; x++) {
             // sobel_kernel
-            vy  = src->data[(y+0)*w+x+0]
-                + (src->data[(y+0)*w+x+1]<<1)
-                + src->data[(y+0)*w+x+2]
-                - src->data[(y+2)*w+x+0]
-                - (src->data[(y+2)*w+x+1]<<1)
-                - src->data[(y+2)*w+x+2];
-
-            float m = fast_sqrtf(vx*vx+vy*vy);
-            if (m>200) {
-                vec_t *v = xalloc(sizeof(vec_t));
-                v->m = m;
-                v->x = vx/m;
-                v->y = vy/m;
-                v->cx = x+1;
-                v->cy = y+1;
-                array_push_back(gradients, v);
+            int vx = row_0[x] - row_0[x+2] + ((row_1[x] - row_1[x+2]) << 1) + row_2[x] - row_2[x+2];
+            int vy = row_0[x] + (row_0[x+1] << 1) + row_0[x+2] - row_2[x] - (row_2[x+1] << 1) - row_2[x+2];
+            int m2 = (vx * vx) + (vy * vy);
+
+            if (m2 > (IRIS_GRADIENT_THRESHOLD * IRIS_GRADIENT_THRESHOLD)) {
+                float m = fast_sqrtf(m2);
+                iris_gradient_t *g = gradients + n++;
+                g->x = x+1;
+                g->y = y+1;
+                g->gx = fast_roundf((vx * 32767) / m);
+                g->gy = fast_roundf((vy * 32767) / m);
+                g->m = fast_roundf(m);
             }
         }
     }
+
+    return n;
 }
 
-// TODO use the gradients median not average
-static void filter_gradients(array_t *gradients)
+// Drops the gradients too far from the average magnitude. The gradient after a dropped one is
+// kept without being checked, as the previous array_erase() loop did, to give the same results.
+static int filter_gradients(iris_gradient_t *gradients, int n)
 {
-    float total_m=0.0f;
-    for (int i=0; i<array_length(gradients); i++) {
-        vec_t *v = (vec_t *) array_at(gradients, i);
-        total_m += v->m;
+    uint32_t total_m = 0;
+    for (int i=0; i<n; i++) {
+        total_m += gradients[i].m;
     }
 
-    float avg_m = total_m/array_length(gradients);
+    int avg_m = total_m / n;
+    int j = 0;
 
-    for (int i=0; i<array_length(gradients); i++) {
-        vec_t *v = (vec_t *) array_at(gradients, i);
-        float diff =(v->m-avg_m) * (v->m-avg_m);
-        if (fast_sqrtf(diff)>100) {
-            array_erase(gradients, i);
+    for (int i=0; i<n; i++) {
+        if (abs(gradients[i].m - avg_m) <= IRIS_GRADIENT_MAX_DIFF) {
+            gradients[j++] = gradients[i];
+        } else if ((i + 1) < n) {
+            gradients[j++] = gradients[++i];
         }
     }
+
+    return j;
 }
 
-static void find_iris(image_t *src, array_t *gradients, int x_off, int y_off, int box_w, int box_h, point_t *e)
+// Sum of the squared (positive) dot products between the gradients and the unit vectors from
+// the gradients to (x, y), times the darkness of (x, y).
+static uint64_t score_center(image_t *src, iris_gradient_t *gradients, int n, uint16_t *inv_norm, int inv_w, int x, int y)
 {
-    int max_x=0;
-    int max_y=0;
-    float max_dot = 0.0f;
-
-    for (int y=y_off; y<y_off+box_h; y++) {
-        for (int x=x_off; x<x_off+box_w; x++) {
-            float sum_dot=0.0f;
-            for (int i=0; i<array_length(gradients); i++) {
-                // get gradient vector  g
-                vec_t *v = (vec_t *) array_at(gradients, i);
-
-                // get vector from gradient to centor d
-                vec_t d ={x-v->cx, y-v->cy};
-
-                // normalize d vector
-                float m = fast_sqrtf(d.x*d.x+d.y*d.y);
-                d.x = d.x/m;
-                d.y = d.y/m;
-
-                // compute the dot product d.g
-                float t = (d.x*v->x)+(d.y*v->y);
-
-                // d,g should point the same direction
-                if (t>0.0) {
-                    // dark centres are more likely to be pupils than
-                    // bright centres, so we use the grayscale value as weight.
-                    sum_dot += t*t*(255-src->data[y*src->w+x]);
-                }
-            }
-            sum_dot=sum_dot/array_length(gradients);
+    int weight = COLOR_GRAYSCALE_MAX - IMAGE_GET_GRAYSCALE_PIXEL(src, x, y);
+
+    if (!weight) {
+        return 0;
+    }
+
+    uint64_t sum = 0;
+
+    for (int i=0; i<n; i++) {
+        iris_gradient_t *g = gradients + i;
+        int dx = x - g->x;
+        int dy = y - g->y;
+        int t = (dx * g->gx) + (dy * g->gy);
+
+        // d,g should point the same direction
+        if (t > 0) {
+            // |t| <= |d| * 32767 and inv_norm <= 32768 / |d|, so this fits in 32-bits.
+            uint32_t t_q15 = (((uint32_t) t) * inv_norm[(abs(dy) * inv_w) + abs(dx)]) >> 15;
+            sum += (t_q15 * t_q15) >> 15;
+        }
+    }
+
+    return sum * weight;
+}
 
-            if (sum_dot > max_dot) {
-                max_dot = sum_dot;
-                max_x = x;
-                max_y = y;
+static void add_candidate(iris_candidate_t *candidates, uint64_t score, int x, int y)
+{
+    // Sorted by decreasing score, ties keep the first center found.
+    for (int i=0; i<IRIS_CANDIDATES; i++) {
+        if (score > candidates[i].score) {
+            memmove(candidates + i + 1, candidates + i, (IRIS_CANDIDATES - i - 1) * sizeof(iris_candidate_t));
+            candidates[i].score = score;
+            candidates[i].x = x;
+            candidates[i].y = y;
+            break;
+        }
+    }
+}
+
+static void find_iris(image_t *src, iris_gradient_t *gradients, int n, int x_off, int y_off, int box_w, int box_h, point_t *e)
+{
+    // 1/|d| in Q15 for every displacement within the box, (0, 0) gets 0 so it never votes.
+    int inv_w = box_w + 1;
+    int inv_h = box_h + 1;
+    uint16_t *inv_norm = fb_alloc(inv_w * inv_h * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    for (int dy=0; dy<inv_h; dy++) {
+        for (int dx=0; dx<inv_w; dx++) {
+            inv_norm[(dy * inv_w) + dx] = (dx || dy) ? fast_roundf(32768 / fast_sqrtf((dx * dx) + (dy * dy))) : 0;
+        }
+    }
+
+    iris_candidate_t candidates[IRIS_CANDIDATES] = {0};
+    int step = IM_MAX(IM_MIN(IRIS_COARSE_STEP, IM_MIN(box_w, box_h) / 4), 1);
+
+    for (int y=y_off+(step/2); y<y_off+box_h; y+=step) {
+        for (int x=x_off+(step/2); x<x_off+box_w; x+=step) {
+            add_candidate(candidates, score_center(src, gradients, n, inv_norm, inv_w, x, y), x, y);
+        }
+    }
+
+    int max_x = 0;
+    int max_y = 0;
+    uint64_t max_score = 0;
+
+    for (int i=0; (i<IRIS_CANDIDATES) && candidates[i].score; i++) {
+        int y_start = IM_MAX(candidates[i].y - step + 1, y_off);
+        int y_end = IM_MIN(candidates[i].y + step, y_off + box_h);
+        int x_start = IM_MAX(candidates[i].x - step + 1, x_off);
+        int x_end = IM_MIN(candidates[i].x + step, x_off + box_w);
+
+        for (int y=y_start; y<y_end; y++) {
+            for (int x=x_start; x<x_end; x++) {
+                uint64_t score = score_center(src, gradients, n, inv_norm, inv_w, x, y);
+                if ((score > max_score) || ((score == max_score) && ((y < max_y) || ((y == max_y) && (x < max_x))))) {
+                    max_score = score;
+                    max_x = x;
+                    max_y = y;
+                }
             }
         }
     }
 
+    fb_free(); // inv_norm
+
     e->x = max_x;
     e->y = max_y;
 }
@@ -115,23 +182,31 @@ static void find_iris(image_t *src, array_t *gradients, int x_off, int y_off, in
 // This function should be called on an ROI detected with the eye Haar cascade.
 void imlib_find_iris(image_t *src, point_t *iris, rectangle_t *roi)
 {
-    array_t *iris_gradients;
-    array_alloc(&iris_gradients, xfree);
-
     // Tune these offsets to skip eyebrows and reduce window size
     int box_w = roi->w-((int)(0.15f*roi->w));
     int box_h = roi->h-((int)(0.40f*roi->h));
     int x_off = roi->x+((int)(0.15f*roi->w));
     int y_off = roi->y+((int)(0.40f*roi->h));
 
+    iris->x = 0;
+    iris->y = 0;
+
+    if ((box_w <= 3) || (box_h <= 3)) {
+        return;
+    }
+
+    iris_gradient_t *gradients = fb_alloc((box_w-3) * (box_h-3) * sizeof(iris_gradient_t), FB_ALLOC_NO_HINT);
+
     // find gradients with strong magnitudes
-    find_gradients(src, iris_gradients,  x_off, y_off, box_w, box_h);
+    int n = find_gradients(src, gradients, x_off, y_off, box_w, box_h);
 
-    // filter gradients
-    filter_gradients(iris_gradients);
+    if (n) {
+        // filter gradients
+        n = filter_gradients(gradients, n);
 
-    // search for iriss
-    find_iris(src, iris_gradients, x_off, y_off, box_w, box_h, iris);
+        // search for iriss
+        find_iris(src, gradients, n, x_off, y_off, box_w, box_h, iris);
+    }
 
-    array_free(iris_gradients);
+    fb_free(); // gradients
 }
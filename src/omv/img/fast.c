@@ -6,30 +6,11 @@
 
 #ifdef IMLIB_ENABLE_FAST
 
-#define MAX_ROW         (480)
 #define MAX_CORNERS     (2000)
-#define Compare(X, Y) ((X)>=(Y))
-
-typedef struct {
-    uint16_t x;
-    uint16_t y;
-    uint16_t score;
-} corner_t;
 
 static int pixel[16];
-static corner_t *fast9_detect(image_t *image, rectangle_t *roi, int *n_corners, int b);
+static corner_t *fast9_detect(image_t *image, rectangle_t *roi, int *n_corners, int b, uint32_t *mask);
 static void fast9_score(image_t *image, corner_t *corners, int num_corners, int b);
-static void nonmax_suppression(corner_t *corners, int num_corners, array_t *keypoints);
-
-static kp_t *alloc_keypoint(uint16_t x, uint16_t y, uint16_t score)
-{
-    // Note must set keypoint descriptor to zeros
-    kp_t *kpt = xalloc0(sizeof*kpt);
-    kpt->x = x;
-    kpt->y = y;
-    kpt->score = score;
-    return kpt;
-}
 
 static void make_offsets(int pixel[], int row_stride)
 {
@@ -51,123 +32,30 @@ static void make_offsets(int pixel[], int row_stride)
         pixel[15] = -1 + row_stride * 3;
 }
 
-void fast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi)
+void fast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi, int cell_size, int cell_max)
 {
     int num_corners=0;
     make_offsets(pixel, image->w);
 
+    // Pretest results of a row.
+    uint32_t *mask = fb_alloc(((roi->w + 31) / 32) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
     // Find corners
-    corner_t *corners = fast9_detect(image, roi, &num_corners, threshold);
+    corner_t *corners = fast9_detect(image, roi, &num_corners, threshold, mask);
     if (num_corners) {
         // Score corners
         fast9_score(image, corners, num_corners, threshold);
         // Non-max suppression
-        nonmax_suppression(corners, num_corners, keypoints);
+        corner_t *maxima = fb_alloc(num_corners * sizeof(corner_t), FB_ALLOC_NO_HINT);
+        int num_maxima = corner_nonmax_suppression(corners, num_corners, maxima);
+        num_maxima = corner_grid_select(maxima, num_maxima, roi, cell_size, cell_max);
+        corner_push_keypoints(maxima, num_maxima, keypoints);
+        fb_free(); // maxima
     }
 
     // Free corners;
     fb_free();
-}
-
-static void nonmax_suppression(corner_t *corners, int num_corners, array_t *keypoints)
-{
-    gc_info_t info;
-
-	int last_row;
-	int16_t row_start[MAX_ROW+1];
-	const int sz = num_corners;
-
-	/* Point above points (roughly) to the pixel above
-       the one of interest, if there is a feature there.*/
-	int point_above = 0;
-	int point_below = 0;
-
-	/* Find where each row begins (the corners are output in raster scan order).
-       A beginning of -1 signifies that there are no corners on that row. */
-	last_row  = corners[sz-1].y;
-
-	for(int i=0; i<last_row+1; i++) {
-		row_start[i] = -1;
-    }
-
-    for (int i=0, prev_row=-1; i<sz; i++) {
-        corner_t *c = &corners[i];
-        if (c->y != prev_row) {
-            row_start[c->y] = i;
-            prev_row = c->y;
-        }
-    }
-
-    for(int i=0; i<sz; i++) {
-        corner_t pos = corners[i];
-        uint16_t score = pos.score;
-
-        /*Check left */
-        if (i > 0) {
-            if (corners[i-1].x == pos.x-1 && corners[i-1].y == pos.y && Compare(corners[i-1].score, score)) {
-                goto nonmax;
-            }
-        }
-
-        /*Check right*/
-        if (i < (sz - 1)) {
-            if (corners[i+1].x == pos.x+1 && corners[i+1].y == pos.y && Compare(corners[i+1].score, score)) {
-                goto nonmax;
-            }
-        }
-
-        /*Check above (if there is a valid row above)*/
-        if (pos.y != 0 && row_start[pos.y - 1] != -1)  {
-            /*Make sure that current point_above is one row above.*/
-            if(corners[point_above].y < pos.y - 1)
-                point_above = row_start[pos.y-1];
-
-            /*Make point_above point to the first of the pixels above the current point, if it exists.*/
-            for (; corners[point_above].y < pos.y && corners[point_above].x < pos.x - 1; point_above++) {
-
-            }
-
-            for (int j=point_above; corners[j].y < pos.y && corners[j].x <= pos.x + 1; j++) {
-                int x = corners[j].x;
-                if( (x == pos.x - 1 || x ==pos.x || x == pos.x+1) && Compare(corners[j].score, score))
-                    goto nonmax;
-            }
-        }
-
-        /*Check below (if there is anything below)*/
-        if (pos.y != last_row && row_start[pos.y + 1] != -1 && point_below < sz) /*Nothing below*/ {
-            if (corners[point_below].y < pos.y + 1)
-                point_below = row_start[pos.y+1];
-
-            /* Make point below point to one of the pixels belowthe current point, if it exists.*/
-            for (; point_below < sz && corners[point_below].y == pos.y+1 && corners[point_below].x < pos.x - 1; point_below++) {
-            }
-
-            for (int j=point_below; j < sz && corners[j].y == pos.y+1 && corners[j].x <= pos.x + 1; j++) {
-                int x = corners[j].x;
-                if( (x == pos.x - 1 || x ==pos.x || x == pos.x+1) && Compare(corners[j].score, score))
-                    goto nonmax;
-            }
-        }
-
-        gc_info(&info);
-        #define MIN_MEM (10*1024)
-        // Allocate keypoints until we're almost out of memory
-        if (info.free < MIN_MEM) {
-            // Try collecting memory
-            gc_collect();
-            // If it didn't work break
-            gc_info(&info);
-            if (info.free < MIN_MEM) {
-                break;
-            }
-        }
-
-        #undef MIN_MEM
-        array_push_back(keypoints, alloc_keypoint(pos.x, pos.y, pos.score));
-        nonmax:
-        ;
-    }
+    fb_free(); // mask
 }
 
 static int fast9_corner_score(const byte* p, int bstart)
@@ -3109,15 +2997,31 @@ static void fast9_score(image_t *image, corner_t *corners, int num_corners, int
     }
 }
 
-static corner_t *fast9_detect(image_t *image, rectangle_t *roi, int *n_corners, int b)
+static corner_t *fast9_detect(image_t *image, rectangle_t *roi, int *n_corners, int b, uint32_t *mask)
 {
     int num_corners = 0;
-    // Try to alloc MAX_CORNERS or the actual max corners we can alloc.
-    int max_corners = IM_MIN(MAX_CORNERS, (fb_avail() / sizeof(corner_t)));
+    // Try to alloc MAX_CORNERS or the actual max corners we can alloc (keeping room for the maxima).
+    int max_corners = IM_MIN(MAX_CORNERS, (fb_avail() / (2 * sizeof(corner_t))) - 1);
     corner_t *corners = (corner_t*) fb_alloc(max_corners * sizeof(corner_t), FB_ALLOC_NO_HINT);
+    const int compass[4] = {pixel[0], pixel[4], pixel[8], pixel[12]};
 
     for(int y=roi->y+3; y<roi->y+roi->h-3; y++) {
+        // Only the pixels passing the pretest go through the decision tree.
+        corner_pretest(image->pixels + (y * image->w) + roi->x + 3, roi->w - 6, compass, b, mask);
+
         for(int x=roi->x+3; x<roi->x+roi->w-3; x++) {
+            int i = x - (roi->x + 3);
+            uint32_t m = mask[i / 32] >> (i % 32);
+
+            if (!m) {
+                x += 31 - (i % 32); // Nothing left in this word.
+                continue;
+            }
+
+            if (!(m & 1)) {
+                continue;
+            }
+
             const uint8_t *p = image->pixels+(y * image->w + x);
 			int cb = *p + b;
 			int c_b= *p - b;
@@ -7,6 +7,7 @@
  *
  */
 #include <arm_math.h>
+#include <arm_const_structs.h>
 #include "fb_alloc.h"
 #include "ff_wrapper.h"
 #include "common.h"
@@ -769,3 +770,167 @@ void fft2d_run_again(fft2d_controller_t *controller)
         do_fft(p, controller->h_pow2, (1 << controller->w_pow2));
     }
 }
+
+///////////////////////////////////////////////////////////////////////////////
+
+// The CMSIS-DSP fft plans (twiddle factors and bit reversal tables) are const
+// tables so they are shared by every frame of the same size.
+
+static const arm_cfft_instance_f32 *fft_plan(int pow2)
+{
+    switch (pow2) {
+        case 4: return &arm_cfft_sR_f32_len16;
+        case 5: return &arm_cfft_sR_f32_len32;
+        case 6: return &arm_cfft_sR_f32_len64;
+        case 7: return &arm_cfft_sR_f32_len128;
+        case 8: return &arm_cfft_sR_f32_len256;
+        case 9: return &arm_cfft_sR_f32_len512;
+        case 10: return &arm_cfft_sR_f32_len1024;
+        case 11: return &arm_cfft_sR_f32_len2048;
+        default: return &arm_cfft_sR_f32_len4096;
+    }
+}
+
+int fft2d_fast_pow2(int len)
+{
+    return IM_MIN(IM_MAX(int_clog2(len), FFT2D_FAST_MIN_POW2), FFT2D_FAST_MAX_POW2);
+}
+
+// Converts one row of the rect to floats in the real (or imaginary) parts of out and pads it with zeros.
+static void fft2d_fast_row(image_t *img, rectangle_t *r, int y, int len, float *out)
+{
+    int x = 0;
+
+    if (y < r->h) {
+        switch (img->bpp) {
+            case IMAGE_BPP_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, r->y + y);
+                for (; x < r->w; x++) {
+                    out[x * 2] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, r->x + x));
+                }
+                break;
+            }
+            case IMAGE_BPP_GRAYSCALE: {
+                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, r->y + y) + r->x;
+                for (; x < r->w; x++) {
+                    out[x * 2] = row_ptr[x];
+                }
+                break;
+            }
+            case IMAGE_BPP_RGB565: {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, r->y + y) + r->x;
+                for (; x < r->w; x++) {
+                    out[x * 2] = COLOR_RGB565_TO_GRAYSCALE(row_ptr[x]);
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    for (; x < len; x++) {
+        out[x * 2] = 0;
+    }
+}
+
+void fft2d_fast_run(image_t *img, rectangle_t *r, int w_pow2, int h_pow2, float *data)
+{
+    int w = 1 << w_pow2;
+    int h = 1 << h_pow2;
+    const arm_cfft_instance_f32 *row_plan = fft_plan(w_pow2);
+    const arm_cfft_instance_f32 *col_plan = fft_plan(h_pow2);
+    float *tmp = fb_alloc(2 * IM_MAX(w, h) * sizeof(float), FB_ALLOC_NO_HINT);
+
+    // Two real rows are transformed at once as the real and imaginary parts of one complex row,
+    // the spectra are then separated using their conjugate symmetry.
+    for (int y = 0; y < h; y += 2) {
+        float *row_0 = data + (y * w * 2);
+        float *row_1 = row_0 + (w * 2);
+
+        if (y >= r->h) {
+            memset(row_0, 0, (h - y) * w * 2 * sizeof(float));
+            break;
+        }
+
+        fft2d_fast_row(img, r, y, w, tmp);
+        fft2d_fast_row(img, r, y + 1, w, tmp + 1);
+        arm_cfft_f32(row_plan, tmp, 0, 1);
+
+        for (int k = 0; k < w; k++) {
+            int l = (w - k) & (w - 1);
+            float z_r = tmp[(k * 2) + 0], z_i = tmp[(k * 2) + 1];
+            float c_r = tmp[(l * 2) + 0], c_i = tmp[(l * 2) + 1];
+            row_0[(k * 2) + 0] = (z_r + c_r) * 0.5f;
+            row_0[(k * 2) + 1] = (z_i - c_i) * 0.5f;
+            row_1[(k * 2) + 0] = (z_i + c_i) * 0.5f;
+            row_1[(k * 2) + 1] = (c_r - z_r) * 0.5f;
+        }
+    }
+
+    // The columns are copied out so that the fft works on contiguous data.
+    for (int x = 0; x < w; x++) {
+        float *col = data + (x * 2);
+
+        for (int y = 0; y < h; y++) {
+            tmp[(y * 2) + 0] = col[(y * w * 2) + 0];
+            tmp[(y * 2) + 1] = col[(y * w * 2) + 1];
+        }
+
+        arm_cfft_f32(col_plan, tmp, 0, 1);
+
+        for (int y = 0; y < h; y++) {
+            col[(y * w * 2) + 0] = tmp[(y * 2) + 0];
+            col[(y * w * 2) + 1] = tmp[(y * 2) + 1];
+        }
+    }
+
+    fb_free(); // tmp
+}
+
+// The output is real, like ifft2d_run() it is stored in the first (1 << w_pow2) floats of each row.
+void ifft2d_fast_run(int w_pow2, int h_pow2, float *data)
+{
+    int w = 1 << w_pow2;
+    int h = 1 << h_pow2;
+    const arm_cfft_instance_f32 *row_plan = fft_plan(w_pow2);
+    const arm_cfft_instance_f32 *col_plan = fft_plan(h_pow2);
+    float *tmp = fb_alloc(2 * IM_MAX(w, h) * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int x = 0; x < w; x++) {
+        float *col = data + (x * 2);
+
+        for (int y = 0; y < h; y++) {
+            tmp[(y * 2) + 0] = col[(y * w * 2) + 0];
+            tmp[(y * 2) + 1] = col[(y * w * 2) + 1];
+        }
+
+        arm_cfft_f32(col_plan, tmp, 1, 1);
+
+        for (int y = 0; y < h; y++) {
+            col[(y * w * 2) + 0] = tmp[(y * 2) + 0];
+            col[(y * w * 2) + 1] = tmp[(y * 2) + 1];
+        }
+    }
+
+    // Both rows are real so row_0 + (i * row_1) transforms back to row_0 and row_1.
+    for (int y = 0; y < h; y += 2) {
+        float *row_0 = data + (y * w * 2);
+        float *row_1 = row_0 + (w * 2);
+
+        for (int k = 0; k < w; k++) {
+            tmp[(k * 2) + 0] = row_0[(k * 2) + 0] - row_1[(k * 2) + 1];
+            tmp[(k * 2) + 1] = row_0[(k * 2) + 1] + row_1[(k * 2) + 0];
+        }
+
+        arm_cfft_f32(row_plan, tmp, 1, 1);
+
+        for (int k = 0; k < w; k++) {
+            row_0[k] = tmp[(k * 2) + 0];
+            row_1[k] = tmp[(k * 2) + 1];
+        }
+    }
+
+    fb_free(); // tmp
+}
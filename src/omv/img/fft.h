@@ -44,5 +44,12 @@ void fft2d_swap(fft2d_controller_t *controller); // a.k.a MATLAB fftshift
 void fft2d_linpolar(fft2d_controller_t *controller);
 void fft2d_logpolar(fft2d_controller_t *controller);
 void fft2d_run_again(fft2d_controller_t *controller); // Do FFT again on real mag/phase of the FFT.
+// 2D fft of a real image area using the CMSIS-DSP fft, the output is in the same layout as fft2d_run()
+// with (1 << h_pow2) rows of (1 << w_pow2) complex values. The sizes are clamped by fft2d_fast_pow2().
+#define FFT2D_FAST_MIN_POW2 (4)
+#define FFT2D_FAST_MAX_POW2 (12)
+int fft2d_fast_pow2(int len);
+void fft2d_fast_run(image_t *img, rectangle_t *r, int w_pow2, int h_pow2, float *data);
+void ifft2d_fast_run(int w_pow2, int h_pow2, float *data);
 // END
 #endif /* __FFT_H__ */
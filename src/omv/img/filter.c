@@ -10,6 +10,7 @@
  */
 #include "fsort.h"
 #include "imlib.h"
+#include "common.h"
 
 void imlib_histeq(image_t *img, image_t *mask)
 {
@@ -131,8 +132,185 @@ void imlib_histeq(image_t *img, image_t *mask)
 //   much change in performance.
 //
 #ifdef IMLIB_ENABLE_MEAN
+// Without a mask the filter is separable: a column sum per pixel is updated with one row added
+// and one row removed per line, and a running sum over the column sums gives each pixel in O(1).
+// The column sums are 16-bit, which holds up to 257 rows of grayscale pixels.
+#define MEAN_FILTER_COLUMN_MAX_KSIZE (128)
+
+static void mean_filter_gs_column_update(uint16_t *sum, const uint8_t *add, const uint8_t *sub, int w)
+{
+    int x = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    for (; x < (w - 3); x += 4) {
+        uint32_t a = *((uint32_t *) (add + x)), s = *((uint32_t *) (sub + x));
+        uint32_t a_even = __UXTB16(a), a_odd = __UXTB16(__ROR(a, 8));
+        uint32_t s_even = __UXTB16(s), s_odd = __UXTB16(__ROR(s, 8));
+        uint32_t *sum32 = (uint32_t *) (sum + x);
+        sum32[0] = __USUB16(__UADD16(sum32[0], __PKHBT(a_even, a_odd, 16)), __PKHBT(s_even, s_odd, 16));
+        sum32[1] = __USUB16(__UADD16(sum32[1], __PKHTB(a_odd, a_even, 16)), __PKHTB(s_odd, s_even, 16));
+    }
+#endif
+    for (; x < w; x++) {
+        sum[x] += add[x] - sub[x];
+    }
+}
+
+static void mean_filter_rgb565_column_update(uint16_t *r_sum, uint16_t *g_sum, uint16_t *b_sum,
+                                             const uint16_t *add, const uint16_t *sub, int w)
+{
+    int x = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    for (; x < (w - 1); x += 2) {
+        uint32_t a = *((uint32_t *) (add + x)), s = *((uint32_t *) (sub + x));
+        uint32_t *r32 = (uint32_t *) (r_sum + x), *g32 = (uint32_t *) (g_sum + x), *b32 = (uint32_t *) (b_sum + x);
+        // Two byte swapped pixels, see COLOR_RGB565_TO_R5() and friends.
+        uint32_t a_g = ((a & 0x00070007) << 3) | ((a >> 13) & 0x00070007);
+        uint32_t s_g = ((s & 0x00070007) << 3) | ((s >> 13) & 0x00070007);
+        *r32 = __USUB16(__UADD16(*r32, (a >> 3) & 0x001F001F), (s >> 3) & 0x001F001F);
+        *g32 = __USUB16(__UADD16(*g32, a_g), s_g);
+        *b32 = __USUB16(__UADD16(*b32, (a >> 8) & 0x001F001F), (s >> 8) & 0x001F001F);
+    }
+#endif
+    for (; x < w; x++) {
+        r_sum[x] += COLOR_RGB565_TO_R5(add[x]) - COLOR_RGB565_TO_R5(sub[x]);
+        g_sum[x] += COLOR_RGB565_TO_G6(add[x]) - COLOR_RGB565_TO_G6(sub[x]);
+        b_sum[x] += COLOR_RGB565_TO_B5(add[x]) - COLOR_RGB565_TO_B5(sub[x]);
+    }
+}
+
+// Produces the same output as the generic code below (the window is clamped at the edges).
+static void mean_filter_column(image_t *img, const int ksize, bool threshold, int offset, bool invert)
+{
+    int w = img->w, h = img->h;
+    int32_t over32_n = 65536 / (((ksize*2)+1)*((ksize*2)+1));
+    int line_len = (img->bpp == IMAGE_BPP_GRAYSCALE) ? IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) : IMAGE_RGB565_LINE_LEN_BYTES(img);
+    int channels = (img->bpp == IMAGE_BPP_GRAYSCALE) ? 1 : 3;
+    int sum_len = (w + 1) & ~1; // Keeps each channel word aligned.
+
+    // Row y-ksize-1 is removed from the column sums after row y, so the output
+    // is written back one row later than in the generic code.
+    int brows = ksize + 2;
+    uint8_t *buf = fb_alloc(line_len * brows, FB_ALLOC_NO_HINT);
+    uint16_t *sum = fb_alloc0(sum_len * channels * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *r_sum = sum, *g_sum = sum + sum_len, *b_sum = sum + (sum_len * 2);
+
+    for (int j = -ksize; j <= ksize; j++) {
+        int row = IM_MIN(IM_MAX(j, 0), (h - 1));
+        if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, row);
+            for (int x = 0; x < w; x++) {
+                sum[x] += row_ptr[x];
+            }
+        } else {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, row);
+            for (int x = 0; x < w; x++) {
+                r_sum[x] += COLOR_RGB565_TO_R5(row_ptr[x]);
+                g_sum[x] += COLOR_RGB565_TO_G6(row_ptr[x]);
+                b_sum[x] += COLOR_RGB565_TO_B5(row_ptr[x]);
+            }
+        }
+    }
+
+    for (int y = 0; y < h; y++) {
+        int add_row = IM_MIN(y + ksize, (h - 1));
+        int sub_row = IM_MAX(y - ksize - 1, 0);
+        uint8_t *buf_row_ptr = buf + (line_len * (y % brows));
+
+        if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+
+            if (y) {
+                mean_filter_gs_column_update(sum,
+                        IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, add_row),
+                        IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, sub_row), w);
+            }
+
+            int acc = 0;
+            for (int k = -ksize; k <= ksize; k++) {
+                acc += sum[IM_MIN(IM_MAX(k, 0), (w - 1))];
+            }
+
+            for (int x = 0; x < w; x++) {
+                if (x) {
+                    acc += sum[IM_MIN(x + ksize, (w - 1))] - sum[IM_MAX(x - ksize - 1, 0)];
+                }
+
+                int pixel = (int)((acc * over32_n)>>16);
+
+                if (threshold) {
+                    if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
+            }
+        } else {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+            if (y) {
+                mean_filter_rgb565_column_update(r_sum, g_sum, b_sum,
+                        IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, add_row),
+                        IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, sub_row), w);
+            }
+
+            int r_acc = 0, g_acc = 0, b_acc = 0;
+            for (int k = -ksize; k <= ksize; k++) {
+                int i = IM_MIN(IM_MAX(k, 0), (w - 1));
+                r_acc += r_sum[i];
+                g_acc += g_sum[i];
+                b_acc += b_sum[i];
+            }
+
+            for (int x = 0; x < w; x++) {
+                if (x) {
+                    int i = IM_MIN(x + ksize, (w - 1)), j = IM_MAX(x - ksize - 1, 0);
+                    r_acc += r_sum[i] - r_sum[j];
+                    g_acc += g_sum[i] - g_sum[j];
+                    b_acc += b_sum[i] - b_sum[j];
+                }
+
+                int r = (int)((r_acc * over32_n)>>16);
+                int g = (int)((g_acc * over32_n)>>16);
+                int b = (int)((b_acc * over32_n)>>16);
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+
+                if (threshold) {
+                    if (((COLOR_RGB565_TO_Y(pixel) - offset) < COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
+                        pixel = COLOR_RGB565_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_RGB565_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) buf_row_ptr, x, pixel);
+            }
+        }
+
+        if (y > ksize) { // Transfer buffer lines...
+            memcpy(img->data + (line_len * (y - ksize - 1)), buf + (line_len * ((y - ksize - 1) % brows)), line_len);
+        }
+    }
+
+    // Copy any remaining lines from the buffer image...
+    for (int y = IM_MAX(h - ksize - 1, 0); y < h; y++) {
+        memcpy(img->data + (line_len * y), buf + (line_len * (y % brows)), line_len);
+    }
+
+    fb_free();
+    fb_free();
+}
+
 void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask)
 {
+    if ((!mask) && (ksize <= MEAN_FILTER_COLUMN_MAX_KSIZE)
+            && ((img->bpp == IMAGE_BPP_GRAYSCALE) || (img->bpp == IMAGE_BPP_RGB565))) {
+        mean_filter_column(img, ksize, threshold, offset, invert);
+        return;
+    }
+
     int brows = ksize + 1;
     image_t buf;
     buf.w = img->w;
@@ -352,6 +530,60 @@ void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset
 }
 #endif // IMLIB_ENABLE_MEAN
 
+#if defined(IMLIB_ENABLE_MEDIAN) || defined(IMLIB_ENABLE_MODE)
+// Column histograms for the constant time median and mode filters (Perreault and Hebert): a
+// histogram per column is updated with one row added and one row removed per line, and the window
+// histogram slides by adding the entering column and removing the leaving one. The histograms have
+// 8-bit bins like the generic code, which limits the window to 255 pixels. Grayscale pixels go to
+// bin (pixel - base) >> shift, RGB565 pixels to R5, G6 and B5 histograms back to back (128 bins).
+#define COLUMN_HIST_MAX_KSIZE (7)
+
+static void column_hist_update(uint8_t *hist, const uint8_t *add, const uint8_t *sub, int len)
+{
+    int i = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    for (; i < len; i += 4) { // len is a multiple of 4.
+        uint32_t *hist32 = (uint32_t *) (hist + i);
+        *hist32 = __USUB8(__UADD8(*hist32, *((uint32_t *) (add + i))), *((uint32_t *) (sub + i)));
+    }
+#endif
+    for (; i < len; i++) {
+        hist[i] += add[i] - sub[i];
+    }
+}
+
+// Adds (delta 1) or removes (delta -1) a row of pixels to/from the column histograms.
+static void column_hist_row(image_t *img, uint8_t *cols, int bins, int row, int delta, int base, int shift)
+{
+    if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, row);
+        for (int x = 0, xx = img->w; x < xx; x++, cols += bins) {
+            cols[(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x) - base) >> shift] += delta;
+        }
+    } else {
+        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, row);
+        for (int x = 0, xx = img->w; x < xx; x++, cols += bins) {
+            int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
+            cols[COLOR_RGB565_TO_R5(pixel)] += delta;
+            cols[32 + COLOR_RGB565_TO_G6(pixel)] += delta;
+            cols[96 + COLOR_RGB565_TO_B5(pixel)] += delta;
+        }
+    }
+}
+
+// The window histogram of the first pixel of a row (the window is clamped at the edges).
+static void column_hist_window(uint8_t *hist, const uint8_t *cols, int bins, int w, int ksize)
+{
+    memset(hist, 0, bins);
+    for (int k = -ksize; k <= ksize; k++) {
+        const uint8_t *col = cols + (IM_MIN(IM_MAX(k, 0), (w - 1)) * bins);
+        for (int i = 0; i < bins; i++) {
+            hist[i] += col[i];
+        }
+    }
+}
+#endif // IMLIB_ENABLE_MEDIAN || IMLIB_ENABLE_MODE
+
 #ifdef IMLIB_ENABLE_MEDIAN
 static uint8_t hist_median(uint8_t *data, int len, const int cutoff)
 {
@@ -377,6 +609,97 @@ int sum = 0;
     return i-1;
 } /* hist_median() */
 
+// Without a mask the constant time median (Perreault and Hebert) is used, see the column
+// histograms above.
+// Produces the same output as the generic code below (the window is clamped at the edges),
+// returns false if there's not enough memory for the column histograms.
+static bool median_filter_column(image_t *img, const int ksize, const int median_cutoff, bool threshold, int offset, bool invert)
+{
+    int w = img->w, h = img->h;
+    bool grayscale = (img->bpp == IMAGE_BPP_GRAYSCALE);
+    int line_len = grayscale ? IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) : IMAGE_RGB565_LINE_LEN_BYTES(img);
+    int bins = grayscale ? 64 : (32 + 64 + 32); // R5, G6 and B5 histograms back to back for RGB565.
+
+    // Row y-ksize-1 is removed from the column histograms after row y, so the output
+    // is written back one row later than in the generic code.
+    int brows = ksize + 2;
+    if (fb_avail() < ((line_len * brows) + ((w + 1) * bins) + 256)) {
+        return false;
+    }
+
+    uint8_t *buf = fb_alloc(line_len * brows, FB_ALLOC_NO_HINT);
+    uint8_t *cols = fb_alloc0(w * bins, FB_ALLOC_NO_HINT);
+    uint8_t *hist = fb_alloc(bins, FB_ALLOC_PREFER_SPEED);
+
+    for (int j = -ksize; j <= ksize; j++) {
+        column_hist_row(img, cols, bins, IM_MIN(IM_MAX(j, 0), (h - 1)), 1, 0, 2);
+    }
+
+    for (int y = 0; y < h; y++) {
+        uint8_t *buf_row_ptr = buf + (line_len * (y % brows));
+
+        if (y) {
+            column_hist_row(img, cols, bins, IM_MIN(y + ksize, (h - 1)), 1, 0, 2);
+            column_hist_row(img, cols, bins, IM_MAX(y - ksize - 1, 0), -1, 0, 2);
+        }
+
+        column_hist_window(hist, cols, bins, w, ksize);
+
+        for (int x = 0; x < w; x++) {
+            if (x) {
+                column_hist_update(hist,
+                        cols + (IM_MIN(x + ksize, (w - 1)) * bins),
+                        cols + (IM_MAX(x - ksize - 1, 0) * bins), bins);
+            }
+
+            if (grayscale) {
+                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+                int pixel = hist_median(hist, 64, median_cutoff) << 2;
+
+                if (threshold) {
+                    if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
+            } else {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+                uint8_t r = hist_median(hist, 32, median_cutoff);
+                uint8_t g = hist_median(hist + 32, 64, median_cutoff);
+                uint8_t b = hist_median(hist + 96, 32, median_cutoff);
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+
+                if (threshold) {
+                    if (((COLOR_RGB565_TO_Y(pixel) - offset) < COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
+                        pixel = COLOR_RGB565_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_RGB565_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) buf_row_ptr, x, pixel);
+            }
+        }
+
+        if (y > ksize) { // Transfer buffer lines...
+            memcpy(img->data + (line_len * (y - ksize - 1)), buf + (line_len * ((y - ksize - 1) % brows)), line_len);
+        }
+    }
+
+    // Copy any remaining lines from the buffer image...
+    for (int y = IM_MAX(h - ksize - 1, 0); y < h; y++) {
+        memcpy(img->data + (line_len * y), buf + (line_len * (y % brows)), line_len);
+    }
+
+    fb_free();
+    fb_free();
+    fb_free();
+    return true;
+}
+
 void imlib_median_filter(image_t *img, const int ksize, float percentile, bool threshold, int offset, bool invert, image_t *mask)
 {
     int brows = ksize + 1;
@@ -388,6 +711,12 @@ void imlib_median_filter(image_t *img, const int ksize, float percentile, bool t
     const int n = ((ksize*2)+1)*((ksize*2)+1);
     const int median_cutoff = fast_floorf(percentile * (float)n);
 
+    if ((!mask) && (ksize <= COLUMN_HIST_MAX_KSIZE)
+            && ((img->bpp == IMAGE_BPP_GRAYSCALE) || (img->bpp == IMAGE_BPP_RGB565))
+            && median_filter_column(img, ksize, median_cutoff, threshold, offset, invert)) {
+        return;
+    }
+
     switch(img->bpp) {
         case IMAGE_BPP_BINARY: {
             buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
@@ -452,7 +781,7 @@ void imlib_median_filter(image_t *img, const int ksize, float percentile, bool t
         }
         case IMAGE_BPP_GRAYSCALE: {
             buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *data = fb_alloc(64, FB_ALLOC_NO_HINT);
+            uint8_t *data = fb_alloc(64, FB_ALLOC_PREFER_SPEED);
             uint8_t pixel;
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
@@ -520,9 +849,9 @@ void imlib_median_filter(image_t *img, const int ksize, float percentile, bool t
         }
         case IMAGE_BPP_RGB565: {
             buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *r_data = fb_alloc(32, FB_ALLOC_NO_HINT);
-            uint8_t *g_data = fb_alloc(64, FB_ALLOC_NO_HINT);
-            uint8_t *b_data = fb_alloc(32, FB_ALLOC_NO_HINT);
+            uint8_t *r_data = fb_alloc(32, FB_ALLOC_PREFER_SPEED);
+            uint8_t *g_data = fb_alloc(64, FB_ALLOC_PREFER_SPEED);
+            uint8_t *b_data = fb_alloc(32, FB_ALLOC_PREFER_SPEED);
             uint8_t r, g, b;
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
@@ -625,8 +954,169 @@ uint8_t mode = 0, mcount = 0;
     return mode;
 } /* find_mode() */
 
+// Slides the window histogram like column_hist_update() and returns its largest bin.
+static int mode_filter_hist_update(uint8_t *hist, const uint8_t *add, const uint8_t *sub, int len)
+{
+    int i = 0, mcount = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    uint32_t max32 = 0;
+    for (; i < len; i += 4) { // len is a multiple of 4.
+        uint32_t *hist32 = (uint32_t *) (hist + i);
+        uint32_t h = __USUB8(__UADD8(*hist32, *((uint32_t *) (add + i))), *((uint32_t *) (sub + i)));
+        *hist32 = h;
+        __USUB8(h, max32); max32 = __SEL(h, max32); // Max per byte lane.
+    }
+    mcount = IM_MAX(IM_MAX(max32 & 0xFF, (max32 >> 8) & 0xFF), IM_MAX((max32 >> 16) & 0xFF, max32 >> 24));
+#endif
+    for (; i < len; i++) {
+        hist[i] += add[i] - sub[i];
+        mcount = IM_MAX(mcount, hist[i]);
+    }
+    return mcount;
+}
+
+static int mode_filter_hist_max(const uint8_t *hist, int len)
+{
+    int mcount = 0;
+    for (int i = 0; i < len; i++) {
+        mcount = IM_MAX(mcount, hist[i]);
+    }
+    return mcount;
+}
+
+// The first (lowest) bin with mcount pixels, words without it are skipped.
+static int mode_filter_hist_find(const uint8_t *hist, int len, int mcount)
+{
+    uint32_t m32 = ((uint32_t) mcount) * 0x01010101;
+    int i = 0;
+    for (; i < len; i += 4) {
+        uint32_t x = *((uint32_t *) (hist + i)) ^ m32;
+        if ((x - 0x01010101) & ~x & 0x80808080) { // Has a zero byte.
+            break;
+        }
+    }
+    while (hist[i] != mcount) {
+        i++;
+    }
+    return i;
+}
+
+// The window histogram slides over the column histograms (see above) and its largest bin is
+// found with the histogram update, without a mask and for ksize <= COLUMN_HIST_MAX_KSIZE.
+// Grayscale bins only span the range of the image so label images have tiny histograms. Ties
+// go to the lowest value. Returns false if there's not enough memory for the column histograms.
+static bool mode_filter_column(image_t *img, const int ksize, bool threshold, int offset, bool invert)
+{
+    int w = img->w, h = img->h;
+    bool grayscale = (img->bpp == IMAGE_BPP_GRAYSCALE);
+    int line_len = grayscale ? IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) : IMAGE_RGB565_LINE_LEN_BYTES(img);
+    int lo = 0, bins = 32 + 64 + 32; // R5, G6 and B5 histograms back to back for RGB565.
+
+    if (grayscale) {
+        int hi = COLOR_GRAYSCALE_MIN;
+        lo = COLOR_GRAYSCALE_MAX;
+        for (int i = 0, ii = w * h; i < ii; i++) {
+            lo = IM_MIN(lo, img->pixels[i]);
+            hi = IM_MAX(hi, img->pixels[i]);
+        }
+        bins = ((hi - lo) + 4) & ~3; // Multiple of 4 for SIMD.
+    }
+
+    // Row y-ksize-1 is removed from the column histograms after row y, so the output
+    // is written back one row later than in the generic code.
+    int brows = ksize + 2;
+    if (fb_avail() < ((line_len * brows) + ((w + 1) * bins) + 256)) {
+        return false;
+    }
+
+    uint8_t *buf = fb_alloc(line_len * brows, FB_ALLOC_NO_HINT);
+    uint8_t *cols = fb_alloc0(w * bins, FB_ALLOC_NO_HINT);
+    uint8_t *hist = fb_alloc(bins, FB_ALLOC_PREFER_SPEED);
+
+    for (int j = -ksize; j <= ksize; j++) {
+        column_hist_row(img, cols, bins, IM_MIN(IM_MAX(j, 0), (h - 1)), 1, lo, 0);
+    }
+
+    for (int y = 0; y < h; y++) {
+        uint8_t *buf_row_ptr = buf + (line_len * (y % brows));
+
+        if (y) {
+            column_hist_row(img, cols, bins, IM_MIN(y + ksize, (h - 1)), 1, lo, 0);
+            column_hist_row(img, cols, bins, IM_MAX(y - ksize - 1, 0), -1, lo, 0);
+        }
+
+        column_hist_window(hist, cols, bins, w, ksize);
+
+        for (int x = 0; x < w; x++) {
+            if (grayscale) {
+                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+                int mcount = x ? mode_filter_hist_update(hist,
+                                        cols + (IM_MIN(x + ksize, (w - 1)) * bins),
+                                        cols + (IM_MAX(x - ksize - 1, 0) * bins), bins)
+                               : mode_filter_hist_max(hist, bins);
+                int pixel = mode_filter_hist_find(hist, bins, mcount) + lo;
+
+                if (threshold) {
+                    if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
+            } else {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+                if (x) {
+                    column_hist_update(hist,
+                            cols + (IM_MIN(x + ksize, (w - 1)) * bins),
+                            cols + (IM_MAX(x - ksize - 1, 0) * bins), bins);
+                }
+
+                // Every channel has all the pixels of the window, so the largest bin of each is
+                // found separately.
+                int r = mode_filter_hist_find(hist, 32, mode_filter_hist_max(hist, 32));
+                int g = mode_filter_hist_find(hist + 32, 64, mode_filter_hist_max(hist + 32, 64));
+                int b = mode_filter_hist_find(hist + 96, 32, mode_filter_hist_max(hist + 96, 32));
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+
+                if (threshold) {
+                    if (((COLOR_RGB565_TO_Y(pixel) - offset) < COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
+                        pixel = COLOR_RGB565_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_RGB565_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) buf_row_ptr, x, pixel);
+            }
+        }
+
+        if (y > ksize) { // Transfer buffer lines...
+            memcpy(img->data + (line_len * (y - ksize - 1)), buf + (line_len * ((y - ksize - 1) % brows)), line_len);
+        }
+    }
+
+    // Copy any remaining lines from the buffer image...
+    for (int y = IM_MAX(h - ksize - 1, 0); y < h; y++) {
+        memcpy(img->data + (line_len * y), buf + (line_len * (y % brows)), line_len);
+    }
+
+    fb_free();
+    fb_free();
+    fb_free();
+    return true;
+}
+
 void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask)
 {
+    if ((!mask) && (ksize <= COLUMN_HIST_MAX_KSIZE)
+            && ((img->bpp == IMAGE_BPP_GRAYSCALE) || (img->bpp == IMAGE_BPP_RGB565))
+            && mode_filter_column(img, ksize, threshold, offset, invert)) {
+        return;
+    }
+
     int brows = ksize + 1;
     image_t buf;
     buf.w = img->w;
@@ -698,7 +1188,7 @@ void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset
         }
         case IMAGE_BPP_GRAYSCALE: {
             buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *bins = fb_alloc((COLOR_GRAYSCALE_MAX-COLOR_GRAYSCALE_MIN+1), FB_ALLOC_NO_HINT);
+            uint8_t *bins = fb_alloc((COLOR_GRAYSCALE_MAX-COLOR_GRAYSCALE_MIN+1), FB_ALLOC_PREFER_SPEED);
 
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
@@ -784,9 +1274,9 @@ void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset
         }
         case IMAGE_BPP_RGB565: {
             buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *r_bins = fb_alloc((COLOR_R5_MAX-COLOR_R5_MIN+1), FB_ALLOC_NO_HINT);
-            uint8_t *g_bins = fb_alloc((COLOR_G6_MAX-COLOR_G6_MIN+1), FB_ALLOC_NO_HINT);
-            uint8_t *b_bins = fb_alloc((COLOR_B5_MAX-COLOR_B5_MIN+1), FB_ALLOC_NO_HINT);
+            uint8_t *r_bins = fb_alloc((COLOR_R5_MAX-COLOR_R5_MIN+1), FB_ALLOC_PREFER_SPEED);
+            uint8_t *g_bins = fb_alloc((COLOR_G6_MAX-COLOR_G6_MIN+1), FB_ALLOC_PREFER_SPEED);
+            uint8_t *b_bins = fb_alloc((COLOR_B5_MAX-COLOR_B5_MIN+1), FB_ALLOC_PREFER_SPEED);
             int r_pixel, g_pixel, b_pixel;
 
             for (int y = 0, yy = img->h; y < yy; y++) {
@@ -862,7 +1352,7 @@ void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset
                     }
                     if (b_mcount == 256) { // need to find max
                         b_mode = find_mode(b_bins, 32);
-                        b_mcount = r_bins[b_mode];
+                        b_mcount = b_bins[b_mode];
                     }
                 } else { // slower way 
                     memset(r_bins, 0, (COLOR_R5_MAX-COLOR_R5_MIN+1));
@@ -931,7 +1421,139 @@ void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset
 }
 #endif // IMLIB_ENABLE_MODE
 
+#if defined(IMLIB_ENABLE_MIDPOINT) || defined(IMLIB_ENABLE_BINARY_OPS)
+// van Herk/Gil-Werman sliding minimum or maximum of a line. The line is padded on both sides with
+// ksize identities (so the windows are clipped at the edges) and cut into blocks of n = ksize * 2 + 1
+// pixels: g is the running extremum from the start of each block and h to its end, so the window
+// starting at padded index i, which spans two blocks, is op(h[i], g[i + n - 1]). That's 3 compares
+// per pixel for any ksize. out may be in.
+static inline __attribute__((always_inline))
+void sliding_extremum_line(const uint8_t *in, uint8_t *out, int stride, int len, int ksize, bool max,
+                           uint8_t *g, uint8_t *h)
+{
+    int n = (ksize * 2) + 1, plen = len + (ksize * 2);
+    uint8_t identity = max ? COLOR_GRAYSCALE_MIN : COLOR_GRAYSCALE_MAX;
+
+    for (int t = 0, b = 0; t < plen; t++, b = (b == (n - 1)) ? 0 : (b + 1)) {
+        int i = t - ksize;
+        uint8_t a = ((i >= 0) && (i < len)) ? in[i * stride] : identity;
+        g[t] = b ? (max ? IM_MAX(g[t - 1], a) : IM_MIN(g[t - 1], a)) : a;
+    }
+
+    for (int t = plen - 1, b = (plen - 1) % n; t >= 0; t--, b = b ? (b - 1) : (n - 1)) {
+        int i = t - ksize;
+        uint8_t a = ((i >= 0) && (i < len)) ? in[i * stride] : identity;
+        h[t] = ((b == (n - 1)) || (t == (plen - 1))) ? a : (max ? IM_MAX(h[t + 1], a) : IM_MIN(h[t + 1], a));
+    }
+
+    for (int i = 0; i < len; i++) {
+        out[i * stride] = max ? IM_MAX(h[i], g[i + n - 1]) : IM_MIN(h[i], g[i + n - 1]);
+    }
+}
+
+void imlib_sliding_min_max(const uint8_t *src, int w, int h, int ksize, uint8_t *min, uint8_t *max)
+{
+    int len = IM_MAX(w, h) + (ksize * 2);
+    uint8_t *g = fb_alloc(len * 2, FB_ALLOC_NO_HINT), *hb = g + len;
+
+    // The rows first, the max before the min which may be done in place.
+    for (int y = 0; y < h; y++) {
+        if (max) {
+            sliding_extremum_line(src + (y * w), max + (y * w), 1, w, ksize, true, g, hb);
+        }
+
+        if (min) {
+            sliding_extremum_line(src + (y * w), min + (y * w), 1, w, ksize, false, g, hb);
+        }
+    }
+
+    for (int x = 0; x < w; x++) {
+        if (max) {
+            sliding_extremum_line(max + x, max + x, w, h, ksize, true, g, hb);
+        }
+
+        if (min) {
+            sliding_extremum_line(min + x, min + x, w, h, ksize, false, g, hb);
+        }
+    }
+
+    fb_free();
+}
+#endif // IMLIB_ENABLE_MIDPOINT || IMLIB_ENABLE_BINARY_OPS
+
 #ifdef IMLIB_ENABLE_MIDPOINT
+// The min and max of each window come from imlib_sliding_min_max() in O(1) per pixel. RGB565 images
+// are done a channel at a time, the result of each channel is written into its bits of the pixels
+// which leaves the other channels intact, so the threshold (which needs the source pixel) isn't
+// supported there. Returns false if there isn't enough memory for the min and max images.
+static bool midpoint_filter_sliding(image_t *img, const int ksize, const uint8_t *bias_table,
+                                    bool threshold, int offset, bool invert, image_t *mask)
+{
+    int w = img->w, h = img->h, size = w * h;
+
+    if (fb_avail() < ((size * 2) + ((IM_MAX(w, h) + (ksize * 2)) * 2) + 64)) {
+        return false;
+    }
+
+    uint8_t *min = fb_alloc(size, FB_ALLOC_NO_HINT);
+    uint8_t *max = fb_alloc(size, FB_ALLOC_NO_HINT);
+
+    if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+        imlib_sliding_min_max(img->pixels, w, h, ksize, min, max);
+
+        for (int y = 0, i = 0; y < h; y++) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0; x < w; x++, i++) {
+                if (mask && (!image_get_mask_pixel(mask, x, y))) {
+                    continue; // Short circuit.
+                }
+
+                int pixel = min[i] + bias_table[max[i] - min[i]];
+
+                if (threshold) {
+                    if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, pixel);
+            }
+        }
+    } else {
+        for (int c = 0; c < 3; c++) {
+            uint16_t *pixels = (uint16_t *) img->pixels;
+
+            for (int i = 0; i < size; i++) {
+                min[i] = (c == 0) ? COLOR_RGB565_TO_R5(pixels[i])
+                       : ((c == 1) ? COLOR_RGB565_TO_G6(pixels[i]) : COLOR_RGB565_TO_B5(pixels[i]));
+            }
+
+            imlib_sliding_min_max(min, w, h, ksize, min, max);
+
+            for (int y = 0, i = 0; y < h; y++) {
+                for (int x = 0; x < w; x++, i++) {
+                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
+                        continue; // Short circuit.
+                    }
+
+                    int pixel = pixels[i], value = min[i] + bias_table[max[i] - min[i]];
+                    int r = (c == 0) ? value : COLOR_RGB565_TO_R5(pixel);
+                    int g = (c == 1) ? value : COLOR_RGB565_TO_G6(pixel);
+                    int b = (c == 2) ? value : COLOR_RGB565_TO_B5(pixel);
+                    pixels[i] = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+                }
+            }
+        }
+    }
+
+    fb_free(); // max
+    fb_free(); // min
+    return true;
+}
+
 void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool threshold, int offset, bool invert, image_t *mask)
 {
     int brows = ksize + 1;
@@ -947,6 +1569,12 @@ void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool thres
         u8BiasTable[i] = (uint8_t)fast_floorf((float)i * bias);
     }
 
+    if (((img->bpp == IMAGE_BPP_GRAYSCALE) || ((img->bpp == IMAGE_BPP_RGB565) && (!threshold)))
+            && midpoint_filter_sliding(img, ksize, u8BiasTable, threshold, offset, invert, mask)) {
+        fb_free();
+        return;
+    }
+
     switch(img->bpp) {
         case IMAGE_BPP_BINARY: {
             buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
@@ -1177,6 +1805,309 @@ void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool thres
 }
 #endif // IMLIB_ENABLE_MIDPOINT
 
+// Splits the kernel into the outer product of a column and a row plus an extra center tap. This
+// covers the gaussian, unsharp, laplacian and sharpen kernels (and any box kernel).
+static bool morph_separate(const int ksize, const int *krn, int *col, int *row, int *center)
+{
+    int n = (ksize * 2) + 1, g = 0;
+
+    for (int i = 0, ii = n * n; i < ii; i++) {
+        if (abs(krn[i]) > INT16_MAX) {
+            return false;
+        }
+    }
+
+    for (int j = 0; j < n; j++) { // The first row never has the center tap.
+        int a = abs(krn[j]);
+        while (a) {
+            int t = g % a;
+            g = a;
+            a = t;
+        }
+    }
+
+    if (!g) {
+        return false;
+    }
+
+    for (int j = 0; j < n; j++) {
+        row[j] = krn[j] / g;
+    }
+
+    col[0] = g;
+
+    for (int i = 1; i < n; i++) {
+        col[i] = 0;
+
+        for (int j = 0; j < n; j++) {
+            if (row[j] && ((i != ksize) || (j != ksize))) {
+                if (krn[(i * n) + j] % row[j]) {
+                    return false;
+                }
+
+                col[i] = krn[(i * n) + j] / row[j];
+                break;
+            }
+        }
+    }
+
+    *center = krn[(ksize * n) + ksize] - (col[ksize] * row[ksize]);
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            int t = (col[i] * row[j]) + (((i == ksize) && (j == ksize)) ? *center : 0);
+            if (krn[(i * n) + j] != t) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Sums the 2*ksize+1 taps of the row starting at v. Pairs of taps are packed for __SMLAD.
+ALWAYS_INLINE static int32_t morph_separable_acc(const int16_t *v, const uint32_t *krn_pairs, const int *row, const int ksize)
+{
+    int n = ksize * 2;
+    int32_t acc = row[n] * v[n];
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    for (int j = 0; j < n; j += 2) {
+        acc = __SMLAD(krn_pairs[j / 2], *((uint32_t *) (v + j)), acc);
+    }
+#else
+    (void) krn_pairs;
+    for (int j = 0; j < n; j++) {
+        acc += row[j] * v[j];
+    }
+#endif
+    return acc;
+}
+
+ALWAYS_INLINE static void morph_separable_gs_line(uint8_t *out, const uint8_t *in, const int16_t *v,
+                                                  const uint32_t *krn_pairs, const int *row, int center,
+                                                  int32_t m_int, int b, bool threshold, int offset, bool invert,
+                                                  int w, const int ksize)
+{
+    for (int x = 0; x < w; x++) {
+        int32_t acc = morph_separable_acc(v + x, krn_pairs, row, ksize) + (center * in[x]);
+        int32_t tmp = (acc * m_int) >> 16;
+        int pixel = tmp + b;
+        if (pixel > COLOR_GRAYSCALE_MAX) pixel = COLOR_GRAYSCALE_MAX;
+        else if (pixel < 0) pixel = 0;
+
+        if (threshold) {
+            if (((pixel - offset) < in[x]) ^ invert) {
+                pixel = COLOR_GRAYSCALE_BINARY_MAX;
+            } else {
+                pixel = COLOR_GRAYSCALE_BINARY_MIN;
+            }
+        }
+
+        out[x] = pixel;
+    }
+}
+
+ALWAYS_INLINE static void morph_separable_rgb565_line(uint16_t *out, const uint16_t *in,
+                                                      const int16_t *r_v, const int16_t *g_v, const int16_t *b_v,
+                                                      const uint32_t *krn_pairs, const int *row, int center,
+                                                      int32_t m_int, int b, bool threshold, int offset, bool invert,
+                                                      int w, const int ksize)
+{
+    for (int x = 0; x < w; x++) {
+        int in_pixel = in[x];
+        int32_t tmp, r_acc, g_acc, b_acc;
+        r_acc = morph_separable_acc(r_v + x, krn_pairs, row, ksize) + (center * COLOR_RGB565_TO_R5(in_pixel));
+        g_acc = morph_separable_acc(g_v + x, krn_pairs, row, ksize) + (center * COLOR_RGB565_TO_G6(in_pixel));
+        b_acc = morph_separable_acc(b_v + x, krn_pairs, row, ksize) + (center * COLOR_RGB565_TO_B5(in_pixel));
+
+        tmp = (r_acc * m_int) >> 16;
+        r_acc = tmp + b;
+        if (r_acc > COLOR_R5_MAX) r_acc = COLOR_R5_MAX;
+        else if (r_acc < 0) r_acc = 0;
+        tmp = (g_acc * m_int) >> 16;
+        g_acc = tmp + b;
+        if (g_acc > COLOR_G6_MAX) g_acc = COLOR_G6_MAX;
+        else if (g_acc < 0) g_acc = 0;
+        tmp = (b_acc * m_int) >> 16;
+        b_acc = tmp + b;
+        if (b_acc > COLOR_B5_MAX) b_acc = COLOR_B5_MAX;
+        else if (b_acc < 0) b_acc = 0;
+
+        int pixel = COLOR_R5_G6_B5_TO_RGB565(r_acc, g_acc, b_acc);
+
+        if (threshold) {
+            if (((COLOR_RGB565_TO_Y(pixel) - offset) < COLOR_RGB565_TO_Y(in_pixel)) ^ invert) {
+                pixel = COLOR_RGB565_BINARY_MAX;
+            } else {
+                pixel = COLOR_RGB565_BINARY_MIN;
+            }
+        }
+
+        out[x] = pixel;
+    }
+}
+
+// Repeats the edge columns of a vertical pass line into its ksize wide borders.
+static void morph_separable_pad(int16_t *v, int w, int ksize)
+{
+    for (int j = 0; j < ksize; j++) {
+        v[j] = v[ksize];
+        v[ksize + w + j] = v[ksize + w - 1];
+    }
+}
+
+// Unmasked grayscale/RGB565 morph for separable kernels. The column is applied first into 16-bit
+// line sums and then the row with dual 16-bit MACs, which takes 2*(2k+1) MACs per pixel instead
+// of (2k+1)^2 and gives the same result as the generic code. Returns false if the kernel isn't
+// separable, the line sums could overflow 16 bits, or there isn't enough memory.
+static bool morph_separable(image_t *img, const int ksize, const int *krn, const int32_t m_int, const int b,
+                            bool threshold, int offset, bool invert)
+{
+    int n = (ksize * 2) + 1;
+    int brows = ksize + 1;
+    int channels = (img->bpp == IMAGE_BPP_RGB565) ? 3 : 1;
+    int line_len = (img->bpp == IMAGE_BPP_RGB565) ? IMAGE_RGB565_LINE_LEN_BYTES(img) : IMAGE_GRAYSCALE_LINE_LEN_BYTES(img);
+    int v_len = (img->w + (ksize * 2) + 1) & ~1;
+
+    if ((ksize < 1) || (fb_avail() < ((line_len * brows) + (channels * v_len * sizeof(int16_t))
+                                      + (n * 2 * sizeof(int)) + (ksize * sizeof(uint32_t)) + 64))) {
+        return false;
+    }
+
+    int *col = fb_alloc(n * 2 * sizeof(int), FB_ALLOC_NO_HINT);
+    int *row = col + n, center, col_sum = 0;
+
+    if (!morph_separate(ksize, krn, col, row, &center)) {
+        fb_free();
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        col_sum += abs(col[i]);
+    }
+
+    if ((col_sum * ((img->bpp == IMAGE_BPP_RGB565) ? COLOR_G6_MAX : COLOR_GRAYSCALE_MAX)) > INT16_MAX) {
+        fb_free();
+        return false;
+    }
+
+    uint32_t *krn_pairs = fb_alloc(ksize * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (int j = 0; j < ksize; j++) {
+        krn_pairs[j] = (row[j * 2] & 0xFFFF) | (((uint32_t) row[(j * 2) + 1]) << 16);
+    }
+
+    image_t buf;
+    buf.w = img->w;
+    buf.h = brows;
+    buf.bpp = img->bpp;
+    buf.data = fb_alloc(line_len * brows, FB_ALLOC_NO_HINT);
+    int16_t *v = fb_alloc(channels * v_len * sizeof(int16_t), FB_ALLOC_PREFER_SPEED);
+
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+            int16_t *v_row = v + ksize;
+
+            for (int i = 0; i < n; i++) {
+                uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img,
+                    IM_MIN(IM_MAX(y + i - ksize, 0), (img->h - 1)));
+                int k = col[i];
+
+                if (!i) {
+                    for (int x = 0, xx = img->w; x < xx; x++) {
+                        v_row[x] = k * k_row_ptr[x];
+                    }
+                } else {
+                    for (int x = 0, xx = img->w; x < xx; x++) {
+                        v_row[x] += k * k_row_ptr[x];
+                    }
+                }
+            }
+
+            morph_separable_pad(v, img->w, ksize);
+
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+            uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
+
+            switch (ksize) { // Specialized 3x3 and 5x5 kernels.
+                case 1:
+                    morph_separable_gs_line(buf_row_ptr, row_ptr, v, krn_pairs, row, center,
+                                            m_int, b, threshold, offset, invert, img->w, 1);
+                    break;
+                case 2:
+                    morph_separable_gs_line(buf_row_ptr, row_ptr, v, krn_pairs, row, center,
+                                            m_int, b, threshold, offset, invert, img->w, 2);
+                    break;
+                default:
+                    morph_separable_gs_line(buf_row_ptr, row_ptr, v, krn_pairs, row, center,
+                                            m_int, b, threshold, offset, invert, img->w, ksize);
+                    break;
+            }
+        } else {
+            int16_t *r_v = v, *g_v = v + v_len, *b_v = v + (v_len * 2);
+
+            for (int i = 0; i < n; i++) {
+                uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img,
+                    IM_MIN(IM_MAX(y + i - ksize, 0), (img->h - 1)));
+                int k = col[i];
+
+                if (!i) {
+                    for (int x = 0, xx = img->w; x < xx; x++) {
+                        int pixel = k_row_ptr[x];
+                        r_v[ksize + x] = k * COLOR_RGB565_TO_R5(pixel);
+                        g_v[ksize + x] = k * COLOR_RGB565_TO_G6(pixel);
+                        b_v[ksize + x] = k * COLOR_RGB565_TO_B5(pixel);
+                    }
+                } else {
+                    for (int x = 0, xx = img->w; x < xx; x++) {
+                        int pixel = k_row_ptr[x];
+                        r_v[ksize + x] += k * COLOR_RGB565_TO_R5(pixel);
+                        g_v[ksize + x] += k * COLOR_RGB565_TO_G6(pixel);
+                        b_v[ksize + x] += k * COLOR_RGB565_TO_B5(pixel);
+                    }
+                }
+            }
+
+            morph_separable_pad(r_v, img->w, ksize);
+            morph_separable_pad(g_v, img->w, ksize);
+            morph_separable_pad(b_v, img->w, ksize);
+
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+            uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
+
+            switch (ksize) { // Specialized 3x3 and 5x5 kernels.
+                case 1:
+                    morph_separable_rgb565_line(buf_row_ptr, row_ptr, r_v, g_v, b_v, krn_pairs, row, center,
+                                                m_int, b, threshold, offset, invert, img->w, 1);
+                    break;
+                case 2:
+                    morph_separable_rgb565_line(buf_row_ptr, row_ptr, r_v, g_v, b_v, krn_pairs, row, center,
+                                                m_int, b, threshold, offset, invert, img->w, 2);
+                    break;
+                default:
+                    morph_separable_rgb565_line(buf_row_ptr, row_ptr, r_v, g_v, b_v, krn_pairs, row, center,
+                                                m_int, b, threshold, offset, invert, img->w, ksize);
+                    break;
+            }
+        }
+
+        if (y >= ksize) { // Transfer buffer lines...
+            memcpy(img->data + ((y - ksize) * line_len), buf.data + (((y - ksize) % brows) * line_len), line_len);
+        }
+    }
+
+    // Copy any remaining lines from the buffer image...
+    for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
+        memcpy(img->data + (y * line_len), buf.data + ((y % brows) * line_len), line_len);
+    }
+
+    fb_free(); // v
+    fb_free(); // buf
+    fb_free(); // krn_pairs
+    fb_free(); // col/row
+    return true;
+}
+
 // http://www.fmwconcepts.com/imagemagick/digital_image_filtering.pdf
 
 void imlib_morph(image_t *img, const int ksize, const int *krn, const float m, const int b, bool threshold, int offset, bool invert, image_t *mask)
@@ -1188,6 +2119,11 @@ void imlib_morph(image_t *img, const int ksize, const int *krn, const float m, c
     buf.bpp = img->bpp;
     const int32_t m_int = (int32_t)(65536.0 * m); // m is 1/kernel_weight
 
+    if ((!mask) && ((img->bpp == IMAGE_BPP_GRAYSCALE) || (img->bpp == IMAGE_BPP_RGB565))
+            && morph_separable(img, ksize, krn, m_int, b, threshold, offset, invert)) {
+        return;
+    }
+
     switch(img->bpp) {
         case IMAGE_BPP_BINARY: {
             buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
@@ -1419,8 +2355,216 @@ static float distance(int x, int y)
     return fast_sqrtf((x * x) + (y * y));
 }
 
+// Fixed point weights for the unmasked path: the spatial and range LUTs are scaled so that their
+// peak is 65535 and a tap weighs (gs * gi) >> shift, with the shift picked so that the weighted
+// sum of the window can't overflow 32 bits.
+static void bilateral_filter_lut(uint16_t *lut, int len, float max, float sigma)
+{
+    float peak = gaussian(0.0f, sigma);
+
+    for (int i = 0; i < len; i++) {
+        lut[-i] = lut[i] = fast_roundf(IM_MIN(IM_DIV(gaussian(i * max, sigma), peak), 1.0f) * 65535.0f);
+    }
+}
+
+static int bilateral_filter_shift(int n, int max_pixel)
+{
+    int shift = 16;
+
+    while ((((uint64_t) (n * n)) * max_pixel * (65535 >> (shift - 16))) > UINT32_MAX) {
+        shift++;
+    }
+
+    return shift;
+}
+
+static void bilateral_filter_fixed(image_t *img, const int ksize, float color_sigma, float space_sigma, bool threshold, int offset, bool invert)
+{
+    int brows = ksize + 1;
+    int n = (ksize * 2) + 1;
+    image_t buf;
+    buf.w = img->w;
+    buf.h = brows;
+    buf.bpp = img->bpp;
+
+    uint16_t *gs_lut = fb_alloc(n * n * sizeof(uint16_t), FB_ALLOC_PREFER_SPEED);
+
+    float max_space = IM_DIV(1.0f, distance(ksize, ksize));
+    float peak = gaussian(0.0f, space_sigma);
+    for (int y = -ksize; y <= ksize; y++) {
+        for (int x = -ksize; x <= ksize; x++) {
+            float w = IM_DIV(gaussian(distance(x, y) * max_space, space_sigma), peak);
+            gs_lut[(n * (y + ksize)) + (x + ksize)] = fast_roundf(IM_MIN(w, 1.0f) * 65535.0f);
+        }
+    }
+
+    uint8_t **rows = fb_alloc(n * sizeof(uint8_t *), FB_ALLOC_NO_HINT);
+
+    if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+        buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+        uint16_t *gi_lut_ptr = fb_alloc((COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1) * sizeof(uint16_t) * 2, FB_ALLOC_PREFER_SPEED);
+        uint16_t *gi_lut = &gi_lut_ptr[256]; // point to the middle
+        bilateral_filter_lut(gi_lut, COLOR_GRAYSCALE_MAX + 1, IM_DIV(1.0f, COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN), color_sigma);
+        int shift = bilateral_filter_shift(n, COLOR_GRAYSCALE_MAX);
+
+        for (int y = 0, yy = img->h; y < yy; y++) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+            uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
+
+            for (int j = 0; j < n; j++) {
+                rows[j] = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, IM_MIN(IM_MAX(y + j - ksize, 0), (img->h - 1)));
+            }
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int this_pixel = row_ptr[x];
+                uint16_t *gi_this = gi_lut + this_pixel;
+                uint16_t *gs = gs_lut;
+                uint32_t i_acc = 0, w_acc = 0;
+
+                if (x >= ksize && x < img->w - ksize) {
+                    for (int j = 0; j < n; j++) {
+                        uint8_t *k_row_ptr = rows[j] + x - ksize;
+                        for (int k = 0; k < n; k++) {
+                            int pixel = k_row_ptr[k];
+                            uint32_t w = (((uint32_t) *gs++) * gi_this[-pixel]) >> shift;
+                            i_acc += pixel * w;
+                            w_acc += w;
+                        }
+                    }
+                } else {
+                    for (int j = 0; j < n; j++) {
+                        uint8_t *k_row_ptr = rows[j];
+                        for (int k = -ksize; k <= ksize; k++) {
+                            int pixel = k_row_ptr[IM_MIN(IM_MAX(x + k, 0), (img->w - 1))];
+                            uint32_t w = (((uint32_t) *gs++) * gi_this[-pixel]) >> shift;
+                            i_acc += pixel * w;
+                            w_acc += w;
+                        }
+                    }
+                }
+
+                int pixel = i_acc / w_acc; // The center tap always has a non-zero weight.
+
+                if (threshold) {
+                    if (((pixel - offset) < this_pixel) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                buf_row_ptr[x] = pixel;
+            }
+
+            if (y >= ksize) { // Transfer buffer lines...
+                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - ksize)),
+                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
+                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
+            }
+        }
+
+        // Copy any remaining lines from the buffer image...
+        for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
+            memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y),
+                   IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows)),
+                   IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
+        }
+
+        fb_free();
+        fb_free();
+    } else {
+        buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+        uint16_t *rb_gi_ptr = fb_alloc((COLOR_R5_MAX - COLOR_R5_MIN + 1) * sizeof(uint16_t) * 2, FB_ALLOC_PREFER_SPEED);
+        uint16_t *g_gi_ptr = fb_alloc((COLOR_G6_MAX - COLOR_G6_MIN + 1) * sizeof(uint16_t) * 2, FB_ALLOC_PREFER_SPEED);
+        uint16_t *rb_gi_lut = &rb_gi_ptr[32]; // center
+        uint16_t *g_gi_lut = &g_gi_ptr[64];
+        bilateral_filter_lut(rb_gi_lut, COLOR_R5_MAX + 1, IM_DIV(1.0f, COLOR_R5_MAX - COLOR_R5_MIN), color_sigma);
+        bilateral_filter_lut(g_gi_lut, COLOR_G6_MAX + 1, IM_DIV(1.0f, COLOR_G6_MAX - COLOR_G6_MIN), color_sigma);
+        int shift = bilateral_filter_shift(n, COLOR_G6_MAX);
+
+        for (int y = 0, yy = img->h; y < yy; y++) {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+            uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
+
+            for (int j = 0; j < n; j++) {
+                rows[j] = (uint8_t *) IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, IM_MIN(IM_MAX(y + j - ksize, 0), (img->h - 1)));
+            }
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int this_pixel = row_ptr[x];
+                uint16_t *r_gi_this = rb_gi_lut + COLOR_RGB565_TO_R5(this_pixel);
+                uint16_t *g_gi_this = g_gi_lut + COLOR_RGB565_TO_G6(this_pixel);
+                uint16_t *b_gi_this = rb_gi_lut + COLOR_RGB565_TO_B5(this_pixel);
+                uint16_t *gs = gs_lut;
+                uint32_t r_i_acc = 0, r_w_acc = 0;
+                uint32_t g_i_acc = 0, g_w_acc = 0;
+                uint32_t b_i_acc = 0, b_w_acc = 0;
+                bool inside = (x >= ksize) && (x < (img->w - ksize));
+
+                for (int j = 0; j < n; j++) {
+                    uint16_t *k_row_ptr = (uint16_t *) rows[j];
+                    for (int k = -ksize; k <= ksize; k++) {
+                        int pixel = k_row_ptr[inside ? (x + k) : IM_MIN(IM_MAX(x + k, 0), (img->w - 1))];
+                        int r_pixel = COLOR_RGB565_TO_R5(pixel);
+                        int g_pixel = COLOR_RGB565_TO_G6(pixel);
+                        int b_pixel = COLOR_RGB565_TO_B5(pixel);
+                        uint32_t s = *gs++;
+                        uint32_t r_w = (s * r_gi_this[-r_pixel]) >> shift;
+                        uint32_t g_w = (s * g_gi_this[-g_pixel]) >> shift;
+                        uint32_t b_w = (s * b_gi_this[-b_pixel]) >> shift;
+                        r_i_acc += r_pixel * r_w;
+                        r_w_acc += r_w;
+                        g_i_acc += g_pixel * g_w;
+                        g_w_acc += g_w;
+                        b_i_acc += b_pixel * b_w;
+                        b_w_acc += b_w;
+                    }
+                }
+
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r_i_acc / r_w_acc, g_i_acc / g_w_acc, b_i_acc / b_w_acc);
+
+                if (threshold) {
+                    if (((COLOR_RGB565_TO_Y(pixel) - offset) < COLOR_RGB565_TO_Y(this_pixel)) ^ invert) {
+                        pixel = COLOR_RGB565_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_RGB565_BINARY_MIN;
+                    }
+                }
+
+                buf_row_ptr[x] = pixel;
+            }
+
+            if (y >= ksize) { // Transfer buffer lines...
+                memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, (y - ksize)),
+                       IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
+                       IMAGE_RGB565_LINE_LEN_BYTES(img));
+            }
+        }
+
+        // Copy any remaining lines from the buffer image...
+        for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
+            memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y),
+                   IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows)),
+                   IMAGE_RGB565_LINE_LEN_BYTES(img));
+        }
+
+        fb_free();
+        fb_free();
+        fb_free();
+    }
+
+    fb_free(); // rows
+    fb_free(); // gs_lut
+}
+
 void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, float space_sigma, bool threshold, int offset, bool invert, image_t *mask)
 {
+    if ((!mask) && ((img->bpp == IMAGE_BPP_GRAYSCALE) || (img->bpp == IMAGE_BPP_RGB565))
+            && (color_sigma != 0.0f) && (space_sigma != 0.0f)) {
+        bilateral_filter_fixed(img, ksize, color_sigma, space_sigma, threshold, offset, invert);
+        return;
+    }
+
     int brows = ksize + 1;
     image_t buf;
     buf.w = img->w;
@@ -1430,7 +2574,7 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
     switch(img->bpp) {
         case IMAGE_BPP_BINARY: {
             buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            float *gi_lut_ptr = fb_alloc((COLOR_BINARY_MAX - COLOR_BINARY_MIN + 1) * sizeof(float) *2, FB_ALLOC_NO_HINT);
+            float *gi_lut_ptr = fb_alloc((COLOR_BINARY_MAX - COLOR_BINARY_MIN + 1) * sizeof(float) *2, FB_ALLOC_PREFER_SPEED);
             float *gi_lut = &gi_lut_ptr[1];
             float max_color = IM_DIV(1.0f, COLOR_BINARY_MAX - COLOR_BINARY_MIN);
             for (int i = COLOR_BINARY_MIN; i <= COLOR_BINARY_MAX; i++) {
@@ -1438,7 +2582,7 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
             }
 
             int n = (ksize * 2) + 1;
-            float *gs_lut = fb_alloc(n * n * sizeof(float), FB_ALLOC_NO_HINT);
+            float *gs_lut = fb_alloc(n * n * sizeof(float), FB_ALLOC_PREFER_SPEED);
 
             float max_space = IM_DIV(1.0f, distance(ksize, ksize));
             for (int y = -ksize; y <= ksize; y++) {
@@ -1507,7 +2651,7 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
         }
         case IMAGE_BPP_GRAYSCALE: {
             buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            float *gi_lut_ptr = fb_alloc((COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1) * sizeof(float) * 2, FB_ALLOC_NO_HINT);
+            float *gi_lut_ptr = fb_alloc((COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1) * sizeof(float) * 2, FB_ALLOC_PREFER_SPEED);
             float *gi_lut = &gi_lut_ptr[256]; // point to the middle
             float max_color = IM_DIV(1.0f, COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN);
             for (int i = COLOR_GRAYSCALE_MIN; i <= COLOR_GRAYSCALE_MAX; i++) {
@@ -1515,7 +2659,7 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
             }
 
             int n = (ksize * 2) + 1;
-            float *gs_lut = fb_alloc(n * n * sizeof(float), FB_ALLOC_NO_HINT);
+            float *gs_lut = fb_alloc(n * n * sizeof(float), FB_ALLOC_PREFER_SPEED);
 
             float max_space = IM_DIV(1.0f, distance(ksize, ksize));
             for (int y = -ksize; y <= ksize; y++) {
@@ -1596,8 +2740,8 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
         }
         case IMAGE_BPP_RGB565: {
             buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            float *rb_gi_ptr = fb_alloc((COLOR_R5_MAX - COLOR_R5_MIN + 1) * sizeof(float) *2, FB_ALLOC_NO_HINT);
-            float *g_gi_ptr = fb_alloc((COLOR_G6_MAX - COLOR_G6_MIN + 1) * sizeof(float) *2, FB_ALLOC_NO_HINT);
+            float *rb_gi_ptr = fb_alloc((COLOR_R5_MAX - COLOR_R5_MIN + 1) * sizeof(float) *2, FB_ALLOC_PREFER_SPEED);
+            float *g_gi_ptr = fb_alloc((COLOR_G6_MAX - COLOR_G6_MIN + 1) * sizeof(float) *2, FB_ALLOC_PREFER_SPEED);
             float *rb_gi_lut = &rb_gi_ptr[32]; // center
             float *g_gi_lut = &g_gi_ptr[64];
 
@@ -1612,7 +2756,7 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
             }
 
             int n = (ksize * 2) + 1;
-            float *gs_lut = fb_alloc(n * n * sizeof(float), FB_ALLOC_NO_HINT);
+            float *gs_lut = fb_alloc(n * n * sizeof(float), FB_ALLOC_PREFER_SPEED);
 
             float max_space = IM_DIV(1.0f, distance(ksize, ksize));
             for (int y = -ksize; y <= ksize; y++) {
@@ -1724,6 +2868,210 @@ void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, fl
         }
     }
 }
+
+// Bilateral grid (Chen, Paris and Durand): pixels are splatted into a grid with one cell per
+// s x s pixels and per r gray levels, the grid is blurred with [1 2 1] along each axis, and
+// every pixel is read back by trilinear interpolation at its position and gray level. Only
+// three splatted and two blurred grid rows are kept, so memory grows with the width only.
+static void bilateral_grid_splat(image_t *img, float *slab, int g, int s, int r, int gw, int gd, int ch)
+{
+    memset(slab, 0, gw * gd * ch * sizeof(float));
+
+    for (int y = IM_MAX((g * s) - (s / 2), 0), yy = IM_MIN((g * s) - (s / 2) + s, img->h); y < yy; y++) {
+        if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int pixel = row_ptr[x];
+                float *cell = slab + (((((x + (s / 2)) / s) * gd) + ((pixel + (r / 2)) / r)) * ch);
+                cell[0] += pixel;
+                cell[1] += 1.0f;
+            }
+        } else {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int pixel = row_ptr[x];
+                int y_pixel = COLOR_RGB565_TO_GRAYSCALE(pixel);
+                float *cell = slab + (((((x + (s / 2)) / s) * gd) + ((y_pixel + (r / 2)) / r)) * ch);
+                cell[0] += COLOR_RGB565_TO_R5(pixel);
+                cell[1] += COLOR_RGB565_TO_G6(pixel);
+                cell[2] += COLOR_RGB565_TO_B5(pixel);
+                cell[3] += 1.0f;
+            }
+        }
+    }
+}
+
+static void bilateral_grid_blur_line(float *line, int len, int stride)
+{
+    float prev = 0.0f;
+
+    for (int i = 0; i < len; i++) {
+        float cur = line[i * stride];
+        float next = ((i + 1) < len) ? line[(i + 1) * stride] : 0.0f;
+        line[i * stride] = prev + (cur * 2.0f) + next;
+        prev = cur;
+    }
+}
+
+static void bilateral_grid_blur(float *out, float *prev, float *cur, float *next, int gw, int gd, int ch)
+{
+    for (int i = 0, ii = gw * gd * ch; i < ii; i++) {
+        out[i] = (prev ? prev[i] : 0.0f) + (cur[i] * 2.0f) + (next ? next[i] : 0.0f);
+    }
+
+    for (int x = 0; x < gw; x++) {
+        for (int c = 0; c < ch; c++) {
+            bilateral_grid_blur_line(out + (x * gd * ch) + c, gd, ch);
+        }
+    }
+
+    for (int z = 0; z < gd; z++) {
+        for (int c = 0; c < ch; c++) {
+            bilateral_grid_blur_line(out + (z * ch) + c, gw, gd * ch);
+        }
+    }
+}
+
+typedef struct bilateral_grid_lut {
+    int offset;
+    float frac;
+} bilateral_grid_lut_t;
+
+// Trilinear interpolation of one channel between the two blurred grid rows.
+static inline float bilateral_grid_sample(float *b0, float *b1, int i, int x_step, int z_step,
+                                          float fx, float fy, float fz)
+{
+    float z00 = b0[i] + ((b0[i + z_step] - b0[i]) * fz);
+    float z10 = b0[i + x_step] + ((b0[i + x_step + z_step] - b0[i + x_step]) * fz);
+    float z01 = b1[i] + ((b1[i + z_step] - b1[i]) * fz);
+    float z11 = b1[i + x_step] + ((b1[i + x_step + z_step] - b1[i + x_step]) * fz);
+    float y0 = z00 + ((z10 - z00) * fx);
+    float y1 = z01 + ((z11 - z01) * fx);
+    return y0 + ((y1 - y0) * fy);
+}
+
+// The cell offsets and fractions along x and along the gray levels are looked up from x_lut and
+// z_lut, which each hold an (int, float) pair per entry.
+static void bilateral_grid_slice(image_t *img, float *b0, float *b1, int g, int s, int gd, int ch,
+                                 bilateral_grid_lut_t *x_lut, bilateral_grid_lut_t *z_lut,
+                                 bool threshold, int offset, bool invert)
+{
+    float s_inv = 1.0f / s;
+    int x_step = gd * ch;
+
+    for (int y = g * s, yy = IM_MIN((g + 1) * s, img->h); y < yy; y++) {
+        float fy = (y - (g * s)) * s_inv;
+
+        if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int this_pixel = row_ptr[x];
+                int i = x_lut[x].offset + z_lut[this_pixel].offset;
+                float fx = x_lut[x].frac, fz = z_lut[this_pixel].frac;
+                float i_acc = bilateral_grid_sample(b0, b1, i, x_step, ch, fx, fy, fz);
+                float w_acc = bilateral_grid_sample(b0, b1, i + 1, x_step, ch, fx, fy, fz);
+                int pixel = fast_floorf(IM_MIN(IM_DIV(i_acc, w_acc), COLOR_GRAYSCALE_MAX));
+
+                if (threshold) {
+                    if (((pixel - offset) < this_pixel) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                row_ptr[x] = pixel;
+            }
+        } else {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int this_pixel = row_ptr[x];
+                int y_pixel = COLOR_RGB565_TO_GRAYSCALE(this_pixel);
+                int i = x_lut[x].offset + z_lut[y_pixel].offset;
+                float fx = x_lut[x].frac, fz = z_lut[y_pixel].frac;
+                float r_acc = bilateral_grid_sample(b0, b1, i, x_step, ch, fx, fy, fz);
+                float g_acc = bilateral_grid_sample(b0, b1, i + 1, x_step, ch, fx, fy, fz);
+                float b_acc = bilateral_grid_sample(b0, b1, i + 2, x_step, ch, fx, fy, fz);
+                float w_acc = bilateral_grid_sample(b0, b1, i + 3, x_step, ch, fx, fy, fz);
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(fast_floorf(IM_MIN(IM_DIV(r_acc, w_acc), COLOR_R5_MAX)),
+                                                     fast_floorf(IM_MIN(IM_DIV(g_acc, w_acc), COLOR_G6_MAX)),
+                                                     fast_floorf(IM_MIN(IM_DIV(b_acc, w_acc), COLOR_B5_MAX)));
+
+                if (threshold) {
+                    if (((COLOR_RGB565_TO_Y(pixel) - offset) < COLOR_RGB565_TO_Y(this_pixel)) ^ invert) {
+                        pixel = COLOR_RGB565_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_RGB565_BINARY_MIN;
+                    }
+                }
+
+                row_ptr[x] = pixel;
+            }
+        }
+    }
+}
+
+void imlib_bilateral_grid_filter(image_t *img, const int ksize, float color_sigma, float space_sigma, bool threshold, int offset, bool invert, image_t *mask)
+{
+    if (mask || ((img->bpp != IMAGE_BPP_GRAYSCALE) && (img->bpp != IMAGE_BPP_RGB565))) {
+        imlib_bilateral_filter(img, ksize, color_sigma, space_sigma, threshold, offset, invert, mask);
+        return;
+    }
+
+    // Same units as the kernel filter: space_sigma is relative to the kernel radius and
+    // color_sigma to the full gray range.
+    int s = IM_MIN(IM_MAX(fast_roundf(fabsf(space_sigma) * distance(ksize, ksize)), 1), 64);
+    int r = IM_MAX(fast_roundf(fabsf(color_sigma) * COLOR_GRAYSCALE_MAX), 1);
+    int gw = ((img->w - 1) / s) + 2;
+    int gh = ((img->h - 1) / s) + 2;
+    int gd = (COLOR_GRAYSCALE_MAX / r) + 2;
+    int ch = (img->bpp == IMAGE_BPP_GRAYSCALE) ? 2 : 4; // sums and weight
+    int slab = gw * gd * ch;
+
+    float *splat = fb_alloc(slab * 3 * sizeof(float), FB_ALLOC_PREFER_SPEED);
+    float *blur = fb_alloc(slab * 2 * sizeof(float), FB_ALLOC_PREFER_SPEED);
+    bilateral_grid_lut_t *x_lut = fb_alloc(img->w * sizeof(bilateral_grid_lut_t), FB_ALLOC_PREFER_SPEED);
+    bilateral_grid_lut_t *z_lut = fb_alloc((COLOR_GRAYSCALE_MAX + 1) * sizeof(bilateral_grid_lut_t), FB_ALLOC_PREFER_SPEED);
+
+    for (int x = 0, xx = img->w; x < xx; x++) {
+        x_lut[x].offset = (x / s) * gd * ch;
+        x_lut[x].frac = (x % s) / ((float) s);
+    }
+
+    for (int z = 0; z <= COLOR_GRAYSCALE_MAX; z++) {
+        z_lut[z].offset = (z / r) * ch;
+        z_lut[z].frac = (z % r) / ((float) r);
+    }
+
+    bilateral_grid_splat(img, splat, 0, s, r, gw, gd, ch);
+    bilateral_grid_splat(img, splat + slab, 1, s, r, gw, gd, ch);
+    bilateral_grid_blur(blur, NULL, splat, splat + slab, gw, gd, ch);
+
+    // The splat of row g + 2 starts at pixel row (g + 1.5) * s, past band g, so each band can be
+    // written back in place once it's sliced.
+    for (int g = 0; g < (gh - 1); g++) {
+        float *next = NULL;
+
+        if ((g + 2) < gh) {
+            next = splat + (((g + 2) % 3) * slab);
+            bilateral_grid_splat(img, next, g + 2, s, r, gw, gd, ch);
+        }
+
+        bilateral_grid_blur(blur + (((g + 1) % 2) * slab),
+                            splat + ((g % 3) * slab), splat + (((g + 1) % 3) * slab), next, gw, gd, ch);
+        bilateral_grid_slice(img, blur + ((g % 2) * slab), blur + (((g + 1) % 2) * slab),
+                             g, s, gd, ch, x_lut, z_lut, threshold, offset, invert);
+    }
+
+    fb_free(); // z_lut
+    fb_free(); // x_lut
+    fb_free(); // blur
+    fb_free(); // splat
+}
 #endif // IMLIB_ENABLE_BILATERAL
 
 #ifdef IMLIB_ENABLE_CARTOON
@@ -22,6 +22,7 @@ const float __atanf_lut[4] = {
     +0.9997878412794807f     //p1
 };
 
+#if defined(__arm__)
 float ALWAYS_INLINE fast_sqrtf(float x)
 {
     asm volatile (
@@ -61,6 +62,28 @@ int ALWAYS_INLINE fast_roundf(float x)
             : [x] "t"  (x));
     return i;
 }
+#else
+// Host builds, same results as the VFP conversions (vcvt truncates, vcvtr rounds to nearest even).
+float ALWAYS_INLINE fast_sqrtf(float x)
+{
+    return __builtin_sqrtf(x);
+}
+
+int ALWAYS_INLINE fast_floorf(float x)
+{
+    return (int) x;
+}
+
+int ALWAYS_INLINE fast_ceilf(float x)
+{
+    return (int) (x + 0.9999f);
+}
+
+int ALWAYS_INLINE fast_roundf(float x)
+{
+    return (int) __builtin_lrintf(x);
+}
+#endif
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
@@ -105,11 +128,15 @@ float fast_cbrtf(float x)
 
 float ALWAYS_INLINE fast_fabsf(float x)
 {
+#if defined(__arm__)
     asm volatile (
             "vabs.f32  %[r], %[x]\n"
             : [r] "=t" (x)
             : [x] "t"  (x));
     return x;
+#else
+    return __builtin_fabsf(x);
+#endif
 }
 
 inline float fast_atanf(float xx)
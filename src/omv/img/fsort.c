@@ -3,10 +3,11 @@
  * Copyright (c) 2013-2016 Kwabena W. Agyeman <kwagyeman@openmv.io>
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * Fast 9 and 25 bin sort.
+ * Fast 9 and 25 bin sort and 16-bit key radix sort.
  *
  */
 #include <stdlib.h>
+#include <string.h>
 #include "fsort.h"
 
 // http://pages.ripco.net/~jgamble/nw.html
@@ -307,3 +308,51 @@ void fsort(int *data, int n)
         default: qsort(data, n, sizeof(int), fsort_compare);
     }
 }
+
+// Stable LSD radix sort (two 8-bit passes) of n elements of size bytes on the uint16_t key at
+// key_offset in each element. tmp must hold n elements.
+void fsort_radix16(void *data, void *tmp, int n, size_t size, size_t key_offset, bool descending)
+{
+    uint8_t *src = data, *dst = tmp;
+    uint16_t flip = descending ? 0xFFFF : 0, first;
+
+    if (n < 2) {
+        return;
+    }
+
+    for (int shift = 0; shift < 16; shift += 8) {
+        int count[256] = {0};
+
+        for (int i = 0; i < n; i++) {
+            uint16_t key;
+            memcpy(&key, src + (i * size) + key_offset, sizeof(uint16_t));
+            count[((key ^ flip) >> shift) & 0xFF]++;
+        }
+
+        // All keys share this digit, the pass wouldn't move anything.
+        memcpy(&first, src + key_offset, sizeof(uint16_t));
+        if (count[((first ^ flip) >> shift) & 0xFF] == n) {
+            continue;
+        }
+
+        for (int i = 0, sum = 0; i < 256; i++) {
+            int c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint16_t key;
+            memcpy(&key, src + (i * size) + key_offset, sizeof(uint16_t));
+            memcpy(dst + (count[((key ^ flip) >> shift) & 0xFF]++ * size), src + (i * size), size);
+        }
+
+        uint8_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != data) {
+        memcpy(data, src, n * size);
+    }
+}
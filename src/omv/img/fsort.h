@@ -3,11 +3,14 @@
  * Copyright (c) 2013-2016 Kwabena W. Agyeman <kwagyeman@openmv.io>
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * Fast 9 and 25 bin sort.
+ * Fast 9 and 25 bin sort and 16-bit key radix sort.
  *
  */
 #ifndef __FSORT_H__
 #define __FSORT_H__
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 void fsort(int *data, int n);
+void fsort_radix16(void *data, void *tmp, int n, size_t size, size_t key_offset, bool descending);
 #endif /* __FSORT_H__ */
@@ -12,16 +12,31 @@
 #include "fb_alloc.h"
 #include "ff_wrapper.h"
 #include "imlib.h"
-#define BLOCK_SIZE (126) // (2^7) - 2 // (DO NOT CHANGE!)
+#define GIF_TRANSPARENT     (128) // First free palette entry when frame differencing is enabled.
+#define LZW_MAX_CODE        (4096)
+#define LZW_HASH_SIZE       (5003) // Prime, ~80% occupancy when the code table is full.
 
-void gif_open(FIL *fp, int width, int height, bool color, bool loop)
+typedef struct gif_lzw {
+    FIL *fp;
+    int32_t *keys;  // (prefix << 8) | pixel, -1 if free.
+    uint16_t *codes;
+    uint32_t bitbuf;
+    int bitcnt;
+    int min_bits;
+    int bits;
+    int next;
+    uint8_t block[256]; // Sub-block, block[0] is the length.
+} gif_lzw_t;
+
+void gif_open(FIL *fp, int width, int height, bool color, bool loop, bool diff)
 {
     file_buffer_on(fp);
 
     write_data(fp, "GIF89a", 6);
     write_word(fp, width);
     write_word(fp, height);
-    write_data(fp, (uint8_t []) {0xF6, 0x00, 0x00}, 3);
+    // Frame differencing needs a free palette entry for the transparent color.
+    write_data(fp, (uint8_t []) {diff ? 0xF7 : 0xF6, 0x00, 0x00}, 3);
 
     if (color) {
         for (int i=0; i<128; i++) {
@@ -37,6 +52,12 @@ void gif_open(FIL *fp, int width, int height, bool color, bool loop)
         }
     }
 
+    if (diff) {
+        for (int i=128; i<256; i++) {
+            write_data(fp, (uint8_t []) {0, 0, 0}, 3);
+        }
+    }
+
     if (loop) {
         write_data(fp, (uint8_t []) {'!', 0xFF, 0x0B}, 3);
         write_data(fp, "NETSCAPE2.0", 11);
@@ -46,69 +67,212 @@ void gif_open(FIL *fp, int width, int height, bool color, bool loop)
     file_buffer_off(fp);
 }
 
-void gif_add_frame(FIL *fp, image_t *img, uint16_t delay)
+// Converts a (decimated) frame to 7-bit palette indices.
+static void gif_get_indices(image_t *img, uint8_t *out, int w, int h, int decimate)
 {
-    file_buffer_on(fp);
-
-    if (delay) {
-        write_data(fp, (uint8_t []) {'!', 0xF9, 0x04, 0x04}, 4);
-        write_word(fp, delay);
-        write_word(fp, 0); // end
-    }
-
-    write_byte(fp, 0x2C);
-    write_long(fp, 0);
-    write_word(fp, img->w);
-    write_word(fp, img->h);
-    write_data(fp, (uint8_t []) {0x00, 0x07}, 2); // 7-bits
-
-    int bytes  = img->h * img->w;
-    int blocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
     if (IM_IS_GS(img)) {
-        for (int y=0; y<blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y*BLOCK_SIZE));
-            write_byte(fp, 1 + block_size);
-            write_byte(fp, 0x80); // clear code
-            for (int x=0; x<block_size; x++) {
-                write_byte(fp, img->pixels[(y*BLOCK_SIZE)+x]>>1);
+        for (int y=0; y<h; y++) {
+            uint8_t *row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y * decimate);
+            for (int x=0; x<w; x++) {
+                *out++ = row[x * decimate] >> 1;
             }
         }
     } else if (IM_IS_RGB565(img)) {
-        for (int y=0; y<blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y*BLOCK_SIZE));
-            write_byte(fp, 1 + block_size);
-            write_byte(fp, 0x80); // clear code
-            for (int x=0; x<block_size; x++) {
-                int pixel = ((uint16_t *) img->pixels)[(y*BLOCK_SIZE)+x];
+        for (int y=0; y<h; y++) {
+            uint16_t *row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y * decimate);
+            for (int x=0; x<w; x++) {
+                int pixel = row[x * decimate];
                 int red = IM_R565(pixel)>>3;
                 int green = IM_G565(pixel)>>3;
                 int blue = IM_B565(pixel)>>3;
-                write_byte(fp, (red<<5) | (green<<2) | blue);
+                *out++ = (red<<5) | (green<<2) | blue;
             }
         }
     } else if (IM_IS_BAYER(img)) {
-        for (int y=0; y<blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y*BLOCK_SIZE));
-            write_byte(fp, 1 + block_size);
-            write_byte(fp, 0x80); // clear code
-            for (int x=0; x<block_size; x++) {
+        for (int y=0; y<h; y++) {
+            int y_offs = y * decimate;
+            for (int x=0; x<w; x++) {
                 int r=0, g=0, b=0;
-                int x_offs = ((y*BLOCK_SIZE) + x) % img->w;
-                int y_offs = (y*BLOCK_SIZE) / img->w;
+                int x_offs = x * decimate;
                 if (x_offs > 0 && y_offs > 0 && x_offs < img->w-1 && y_offs < img->h-1) {
                     COLOR_BAYER_TO_RGB565(img, x_offs, y_offs, r, g, b);
                 }
                 r >>=3; g >>=3; b >>=3;
-                write_byte(fp, (r<<5) | (g<<2) | b);
+                *out++ = (r<<5) | (g<<2) | b;
+            }
+        }
+    }
+}
+
+static void gif_lzw_reset(gif_lzw_t *lzw)
+{
+    memset(lzw->keys, 0xFF, LZW_HASH_SIZE * sizeof(int32_t));
+    lzw->bits = lzw->min_bits + 1;
+    lzw->next = (1 << lzw->min_bits) + 2;
+}
+
+static void gif_lzw_put(gif_lzw_t *lzw, int code)
+{
+    lzw->bitbuf |= code << lzw->bitcnt;
+    lzw->bitcnt += lzw->bits;
+
+    while (lzw->bitcnt >= 8) {
+        lzw->block[++lzw->block[0]] = lzw->bitbuf;
+        lzw->bitbuf >>= 8;
+        lzw->bitcnt -= 8;
+
+        if (lzw->block[0] == 255) {
+            write_data(lzw->fp, lzw->block, 256);
+            lzw->block[0] = 0;
+        }
+    }
+
+    // The decoder adds its entry one code later, so the width grows after the
+    // code that is written when next reaches the current width limit.
+    if ((lzw->next >= (1 << lzw->bits)) && (lzw->bits < 12)) {
+        lzw->bits += 1;
+    }
+}
+
+// LZW encodes a w*h rect of palette indices with a hashed string table.
+static void gif_lzw_encode(gif_lzw_t *lzw, const uint8_t *data, int stride, int w, int h, int min_bits)
+{
+    lzw->bitbuf = 0;
+    lzw->bitcnt = 0;
+    lzw->min_bits = min_bits;
+    lzw->block[0] = 0;
+
+    int clear = 1 << min_bits;
+    write_byte(lzw->fp, min_bits);
+    gif_lzw_reset(lzw);
+    gif_lzw_put(lzw, clear);
+
+    int prefix = data[0];
+    for (int y=0; y<h; y++) {
+        const uint8_t *row = data + (y * stride);
+        for (int x=(y ? 0 : 1); x<w; x++) {
+            int pixel = row[x];
+            int32_t key = (prefix << 8) | pixel;
+            int i = ((pixel << 4) ^ prefix) % LZW_HASH_SIZE;
+            int disp = i ? (LZW_HASH_SIZE - i) : 1;
+
+            for (;;) {
+                int32_t k = lzw->keys[i];
+                if ((k == key) || (k < 0)) break;
+                if ((i -= disp) < 0) i += LZW_HASH_SIZE;
+            }
+
+            if (lzw->keys[i] == key) {
+                prefix = lzw->codes[i];
+                continue;
+            }
+
+            gif_lzw_put(lzw, prefix);
+
+            if (lzw->next < LZW_MAX_CODE) {
+                lzw->keys[i] = key;
+                lzw->codes[i] = lzw->next++;
+            } else {
+                gif_lzw_put(lzw, clear);
+                gif_lzw_reset(lzw);
+            }
+
+            prefix = pixel;
+        }
+    }
+
+    gif_lzw_put(lzw, prefix);
+    gif_lzw_put(lzw, clear + 1); // end code
+
+    if (lzw->bitcnt) {
+        lzw->block[++lzw->block[0]] = lzw->bitbuf;
+    }
+
+    if (lzw->block[0]) {
+        write_data(lzw->fp, lzw->block, lzw->block[0] + 1);
+    }
+
+    write_byte(lzw->fp, 0x00); // block terminator
+}
+
+void gif_add_frame(FIL *fp, image_t *img, uint16_t delay, int decimate, uint8_t *prev)
+{
+    int w = img->w / decimate;
+    int h = img->h / decimate;
+    uint8_t *data = fb_alloc(w * h, FB_ALLOC_NO_HINT);
+    gif_get_indices(img, data, w, h, decimate);
+
+    // Allocated before the file buffer, which takes the rest of the frame buffer.
+    gif_lzw_t lzw;
+    lzw.fp = fp;
+    lzw.keys = fb_alloc(LZW_HASH_SIZE * sizeof(int32_t), FB_ALLOC_PREFER_SPEED);
+    lzw.codes = fb_alloc(LZW_HASH_SIZE * sizeof(uint16_t), FB_ALLOC_PREFER_SPEED);
+
+    rectangle_t rect = { 0, 0, w, h };
+
+    if (prev) {
+        // Only emit the bounding box of pixels that changed since the last frame,
+        // unchanged pixels inside it become transparent (the last frame is kept).
+        int x_min = w, x_max = -1, y_min = h, y_max = -1;
+        for (int y=0; y<h; y++) {
+            uint8_t *cur_row = data + (y * w);
+            uint8_t *prev_row = prev + (y * w);
+            for (int x=0; x<w; x++) {
+                if (cur_row[x] != prev_row[x]) {
+                    x_min = IM_MIN(x_min, x);
+                    x_max = IM_MAX(x_max, x);
+                    y_min = IM_MIN(y_min, y);
+                    y_max = IM_MAX(y_max, y);
+                }
             }
         }
+
+        if (x_max < 0) {
+            // Nothing changed, a single transparent pixel keeps the delay.
+            x_min = x_max = y_min = y_max = 0;
+        }
+
+        rect.x = x_min;
+        rect.y = y_min;
+        rect.w = x_max - x_min + 1;
+        rect.h = y_max - y_min + 1;
+
+        for (int y=rect.y; y<(rect.y+rect.h); y++) {
+            uint8_t *cur_row = data + (y * w);
+            uint8_t *prev_row = prev + (y * w);
+            for (int x=rect.x; x<(rect.x+rect.w); x++) {
+                int pixel = cur_row[x];
+                if (pixel == prev_row[x]) {
+                    cur_row[x] = GIF_TRANSPARENT;
+                } else {
+                    prev_row[x] = pixel;
+                }
+            }
+        }
+    }
+
+    file_buffer_on(fp);
+
+    if (delay || prev) {
+        write_data(fp, (uint8_t []) {'!', 0xF9, 0x04, prev ? 0x05 : 0x04}, 4);
+        write_word(fp, delay);
+        write_data(fp, (uint8_t []) {prev ? GIF_TRANSPARENT : 0x00, 0x00}, 2); // end
     }
 
+    write_byte(fp, 0x2C);
+    write_word(fp, rect.x);
+    write_word(fp, rect.y);
+    write_word(fp, rect.w);
+    write_word(fp, rect.h);
+    write_byte(fp, 0x00);
 
-    write_data(fp, (uint8_t []) {0x01, 0x81, 0x00}, 3); // end code
+    // 7-bit indices, 8-bit with the transparent color.
+    gif_lzw_encode(&lzw, data + (rect.y * w) + rect.x, w, rect.w, rect.h, prev ? 8 : 7);
 
     file_buffer_off(fp);
+    fb_free(); // lzw.codes
+    fb_free(); // lzw.keys
+    fb_free(); // data
 }
 
 void gif_close(FIL *fp)
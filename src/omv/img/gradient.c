@@ -0,0 +1,131 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Sobel gradient map shared by the Hough detectors.
+ */
+#include "imlib.h"
+
+#if defined(IMLIB_ENABLE_FIND_LINES) || defined(IMLIB_ENABLE_FIND_CIRCLES)
+static void gradient_map_row(image_t *ptr, rectangle_t *roi, int y, uint8_t *row)
+{
+    switch (ptr->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+            for (int x = 0, xx = roi->w; x < xx; x++) {
+                row[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, roi->x + x));
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            memcpy(row, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y) + roi->x, roi->w);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+            for (int x = 0, xx = roi->w; x < xx; x++) {
+                row[x] = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, roi->x + x));
+            }
+            break;
+        }
+        default: {
+            memset(row, 0, roi->w);
+            break;
+        }
+    }
+}
+
+void imlib_gradient_map_alloc(gradient_map_t *map)
+{
+    memset(map, 0, sizeof(gradient_map_t));
+}
+
+void imlib_gradient_map_free(gradient_map_t *map)
+{
+    if (map->magnitude) {
+        xfree(map->magnitude);
+    }
+
+    memset(map, 0, sizeof(gradient_map_t));
+}
+
+void imlib_gradient_map_reset(gradient_map_t *map)
+{
+    map->valid = false;
+}
+
+void imlib_gradient_map_update(gradient_map_t *map, image_t *ptr, rectangle_t *roi)
+{
+    uint32_t hash = image_rows_hash(ptr, roi->y, roi->h);
+
+    if (map->valid
+    && (map->hash == hash)
+    && (map->img.data == ptr->data)
+    && (map->img.w == ptr->w)
+    && (map->img.h == ptr->h)
+    && (map->img.bpp == ptr->bpp)
+    && rectangle_equal_fast(&map->roi, roi)) {
+        return;
+    }
+
+    map->valid = false;
+    size_t size = roi->w * roi->h;
+
+    if (map->size < size) {
+        if (map->magnitude) {
+            xfree(map->magnitude);
+        }
+
+        map->magnitude = NULL; // in case xalloc fails
+        map->size = 0;
+        map->magnitude = xalloc(size * 2 * sizeof(uint16_t));
+        map->size = size;
+    }
+
+    map->theta = map->magnitude + size;
+    memset(map->magnitude, 0, size * 2 * sizeof(uint16_t));
+
+    if ((roi->w >= 3) && (roi->h >= 3)) { // the border is left at 0
+        // Sliding window of 3 grayscale rows.
+        uint8_t *rows = fb_alloc(roi->w * 3, FB_ALLOC_PREFER_SPEED);
+        uint8_t *row_0 = rows, *row_1 = rows + roi->w, *row_2 = rows + (roi->w * 2);
+        gradient_map_row(ptr, roi, roi->y, row_1);
+        gradient_map_row(ptr, roi, roi->y + 1, row_2);
+
+        for (int y = 1, yy = roi->h - 1; y < yy; y++) {
+            uint8_t *tmp = row_0;
+            row_0 = row_1;
+            row_1 = row_2;
+            row_2 = tmp;
+            gradient_map_row(ptr, roi, roi->y + y + 1, row_2);
+
+            uint16_t *magnitude_row = map->magnitude + (roi->w * y);
+            uint16_t *theta_row = map->theta + (roi->w * y);
+
+            for (int x = 1, xx = roi->w - 1; x < xx; x++) {
+                // Same Sobel kernels and angle convention as find_lines()/find_circles().
+                int x_acc = (row_0[x - 1] - row_0[x + 1]) + ((row_1[x - 1] - row_1[x + 1]) * 2) + (row_2[x - 1] - row_2[x + 1]);
+                int y_acc = (row_0[x - 1] + (row_0[x] * 2) + row_0[x + 1]) - (row_2[x - 1] + (row_2[x] * 2) + row_2[x + 1]);
+
+                if (x_acc | y_acc) {
+                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
+                    if (theta < 0) theta += 360;
+                    theta_row[x] = theta;
+                    magnitude_row[x] = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
+                }
+            }
+        }
+
+        fb_free(); // rows
+    }
+
+    map->img = *ptr;
+    map->roi = *roi;
+    map->hash = hash;
+    map->valid = true;
+}
+#endif // IMLIB_ENABLE_FIND_LINES || IMLIB_ENABLE_FIND_CIRCLES
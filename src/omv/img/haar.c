@@ -15,40 +15,23 @@
 #include "ff_wrapper.h"
 #include "xalloc.h"
 #include "imlib.h"
+#include "assets.h"
 // built-in cascades
 #include "cascade.h"
 
-static int eval_weak_classifier(cascade_t *cascade, point_t pt, int t_idx, int w_idx, int r_idx)
-{
-    int32_t sumw=0;
-    mw_image_t *sum = cascade->sum;
-
-    /* The node threshold is multiplied by the standard deviation of the sub window */
-    int32_t t = cascade->tree_thresh_array[t_idx] * cascade->std;
-
-    for (int i=0; i<cascade->num_rectangles_array[t_idx]; i++) {
-        int x = cascade->rectangles_array[r_idx + (i<<2) + 0];
-        int y = cascade->rectangles_array[r_idx + (i<<2) + 1];
-        int w = cascade->rectangles_array[r_idx + (i<<2) + 2];
-        int h = cascade->rectangles_array[r_idx + (i<<2) + 3];
-        // Lookup the feature
-        sumw += imlib_integral_mw_lookup(sum, pt.x+x, y, w, h) * (cascade->weights_array[w_idx + i]<<12);
-    }
+// Same as imlib_integral_mw_lookup() on the rows of the moving window.
+#define MW_LOOKUP(rows, x, y, w, h) \
+    ((int32_t) ((rows)[(y)+(h)][(x)+(w)] + (rows)[(y)][(x)] - (rows)[(y)][(x)+(w)] - (rows)[(y)+(h)][(x)]))
 
-    if (sumw >= t) {
-        return cascade->alpha2_array[t_idx];
-    }
-
-    return cascade->alpha1_array[t_idx];
-}
-
-static int run_cascade_classifier(cascade_t* cascade, point_t pt)
+// Runs the cascade on the window at x, everything but the standard deviation is in fixed point.
+// The stage thresholds (float in the cascade) are converted once per call by the caller.
+static int run_cascade_classifier(cascade_t* cascade, const int32_t *stage_thresh, int x)
 {
     int win_w = cascade->window.w;
     int win_h = cascade->window.h;
     uint32_t n = (win_w * win_h);
-    uint32_t i_s = imlib_integral_mw_lookup (cascade->sum, pt.x, 0, win_w, win_h);
-    uint32_t i_sq = imlib_integral_mw_lookup(cascade->ssq, pt.x, 0, win_w, win_h);
+    uint32_t i_s = imlib_integral_mw_lookup (cascade->sum, x, 0, win_w, win_h);
+    uint32_t i_sq = imlib_integral_mw_lookup(cascade->ssq, x, 0, win_w, win_h);
     uint32_t m = i_s/n;
     uint32_t v = i_sq/n-(m*m);
 
@@ -57,17 +40,31 @@ static int run_cascade_classifier(cascade_t* cascade, point_t pt)
         return 0;
     }
 
-    cascade->std = fast_sqrtf(i_sq*n-(i_s*i_s));
-    for (int i=0, w_idx=0, r_idx=0, t_idx=0; i<cascade->n_stages; i++) {
+    /* The node thresholds are multiplied by the standard deviation of the sub window */
+    int32_t std = cascade->std = fast_sqrtf(i_sq*n-(i_s*i_s));
+
+    uint32_t **rows = cascade->sum->data;
+    const int8_t *rect = cascade->rectangles_array;
+    const int8_t *weight = cascade->weights_array;
+    const int8_t *num_rectangles = cascade->num_rectangles_array;
+    const int16_t *tree_thresh = cascade->tree_thresh_array;
+    const int16_t *alpha1 = cascade->alpha1_array;
+    const int16_t *alpha2 = cascade->alpha2_array;
+
+    for (int i=0; i<cascade->n_stages; i++) {
         int stage_sum = 0;
-        for (int j=0; j<cascade->stages_array[i]; j++, t_idx++) {
+        for (int j=0; j<cascade->stages_array[i]; j++) {
             // Send the shifted window to a haar filter
-            stage_sum += eval_weak_classifier(cascade, pt, t_idx, w_idx, r_idx);
-            w_idx += cascade->num_rectangles_array[t_idx];
-            r_idx += cascade->num_rectangles_array[t_idx] * 4;
+            int32_t sumw = 0;
+            for (int k=0; k<*num_rectangles; k++, rect+=4, weight++) {
+                sumw += MW_LOOKUP(rows, x+rect[0], rect[1], rect[2], rect[3]) * (*weight<<12);
+            }
+
+            stage_sum += (sumw >= (*tree_thresh * std)) ? *alpha2 : *alpha1;
+            num_rectangles++, tree_thresh++, alpha1++, alpha2++;
         }
         // If the sum is below the stage threshold, no objects were detected
-        if (stage_sum < (cascade->threshold * cascade->stages_thresh_array[i])) {
+        if (stage_sum < stage_thresh[i]) {
             return 0;
         }
     }
@@ -94,12 +91,21 @@ array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *r
     // Set scanning step.
     // Viola and Jones achieved best results using a scaling factor
     // of 1.25 and a scanning factor proportional to the current scale.
-    // Start with a step of 5% of the image width and reduce at each scaling step
-    cascade->step = (roi->w*50)/1000;
+    // Start with a step of 5% of the image width, the step is scaled with each scaling step so
+    // that it stays the same in image pixels (the windows grow with the scale).
+    int step = (roi->w*50)/1000;
 
     // Make sure step is less than window height + 1
-    if (cascade->step > cascade->window.h) {
-        cascade->step = cascade->window.h;
+    if (step > cascade->window.h) {
+        step = cascade->window.h;
+    }
+
+    // stage_sum < (threshold * stage_thresh) is the same as stage_sum < ceil(threshold * stage_thresh)
+    int32_t *stage_thresh = fb_alloc(cascade->n_stages * sizeof(int32_t), FB_ALLOC_NO_HINT);
+    for (int i=0; i<cascade->n_stages; i++) {
+        float t = cascade->threshold * cascade->stages_thresh_array[i];
+        stage_thresh[i] = t; // truncates towards zero
+        stage_thresh[i] += (stage_thresh[i] < t);
     }
 
     // Allocate integral images
@@ -125,7 +131,7 @@ array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *r
         imlib_integral_mw_ss(image, &sum, &ssq, roi);
 
         // Scale the scanning step
-        cascade->step = cascade->step/factor;
+        cascade->step = fast_roundf(step/factor);
         cascade->step = (cascade->step == 0) ? 1 : cascade->step;
 
         // Process image at the current scale
@@ -136,9 +142,8 @@ array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *r
         // Shift the filter window over the image.
         for (int y=0; y<y2; y+=cascade->step) {
             for (int x=0; x<x2; x+=cascade->step) {
-                point_t p = {x, y};
                 // If an object is detected, record the coordinates of the filter window
-                if (run_cascade_classifier(cascade, p) > 0) {
+                if (run_cascade_classifier(cascade, stage_thresh, x) > 0) {
                     array_push_back(objects,
                         rectangle_alloc(fast_roundf(x*factor) + roi->x, fast_roundf(y*factor) + roi->y,
                         fast_roundf(cascade->window.w*factor), fast_roundf(cascade->window.h*factor)));
@@ -154,6 +159,7 @@ array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *r
 
     imlib_integral_mw_free(&ssq);
     imlib_integral_mw_free(&sum);
+    fb_free(); // stage_thresh
 
     if (array_length(objects) > 1)   {
         // Merge objects detected at different scales
@@ -170,6 +176,7 @@ int imlib_load_cascade_from_file(cascade_t *cascade, const char *path)
     FRESULT res=FR_OK;
 
     file_read_open(&fp, path);
+    file_fast_seek_on(&fp);
     file_buffer_on(&fp);
 
     /* read detection window size */
@@ -249,8 +256,67 @@ error:
     return res;
 }
 
+// Same layout as the binary cascade file, the arrays are referenced in place.
+static int imlib_load_cascade_from_asset(cascade_t *cascade, const uint8_t *data, uint32_t size)
+{
+    const uint8_t *end = data + size;
+
+    if (size < (sizeof(cascade->window) + sizeof(cascade->n_stages))) {
+        return FR_INVALID_OBJECT;
+    }
+
+    memcpy(&cascade->window, data, sizeof(cascade->window));
+    data += sizeof(cascade->window);
+    memcpy(&cascade->n_stages, data, sizeof(cascade->n_stages));
+    data += sizeof(cascade->n_stages);
+
+    if (cascade->n_stages < 0 || ((end - data) / 3) < cascade->n_stages) {
+        return FR_INVALID_OBJECT;
+    }
+
+    cascade->stages_array = (uint8_t *) data;
+    data += sizeof(*cascade->stages_array) * cascade->n_stages;
+    cascade->stages_thresh_array = (int16_t *) data;
+    data += sizeof(*cascade->stages_thresh_array) * cascade->n_stages;
+
+    cascade->n_features = 0;
+    for (int i=0; i<cascade->n_stages; i++) {
+        cascade->n_features += cascade->stages_array[i];
+    }
+
+    if (((end - data) / 7) < cascade->n_features) {
+        return FR_INVALID_OBJECT;
+    }
+
+    cascade->tree_thresh_array = (int16_t *) data;
+    data += sizeof(*cascade->tree_thresh_array) * cascade->n_features;
+    cascade->alpha1_array = (int16_t *) data;
+    data += sizeof(*cascade->alpha1_array) * cascade->n_features;
+    cascade->alpha2_array = (int16_t *) data;
+    data += sizeof(*cascade->alpha2_array) * cascade->n_features;
+    cascade->num_rectangles_array = (int8_t *) data;
+    data += sizeof(*cascade->num_rectangles_array) * cascade->n_features;
+
+    cascade->n_rectangles = 0;
+    for (int i=0; i<cascade->n_features; i++) {
+        cascade->n_rectangles += cascade->num_rectangles_array[i];
+    }
+
+    if (cascade->n_rectangles < 0 || ((end - data) / 5) < cascade->n_rectangles) {
+        return FR_INVALID_OBJECT;
+    }
+
+    cascade->weights_array = (int8_t *) data;
+    data += sizeof(*cascade->weights_array) * cascade->n_rectangles;
+    cascade->rectangles_array = (int8_t *) data;
+    return FR_OK;
+}
+
 int imlib_load_cascade(cascade_t *cascade, const char *path)
 {
+    const void *asset_data;
+    uint32_t asset_size;
+
     // built-in cascade
     if (strcmp(path, "frontalface") == 0) {
         cascade->window.w            = frontalface_window_w;
@@ -276,6 +342,9 @@ int imlib_load_cascade(cascade_t *cascade, const char *path)
         cascade->num_rectangles_array= (int8_t  *)eye_num_rectangles_array;
         cascade->weights_array       = (int8_t  *)eye_weights_array;
         cascade->rectangles_array    = (int8_t  *)eye_rectangles_array;
+    } else if (assets_find(path, &asset_data, &asset_size)) {
+        // asset store cascade
+        return imlib_load_cascade_from_asset(cascade, asset_data, asset_size);
     } else {
         // xml cascade
         return imlib_load_cascade_from_file(cascade, path);
@@ -11,29 +11,15 @@
  */
 #include <stdio.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include "imlib.h"
 #include "fb_alloc.h"
+#include "fsort.h"
 #include "xalloc.h"
 
 #ifdef IMLIB_ENABLE_HOG
 #define N_BINS      (9)
-typedef struct bin {
-    int d;
-    int m;
-} bin_t;
-
-int bin_array_comp(const void *obj0, const void *obj1)
-{
-    const bin_t *b0 = obj0;
-    const bin_t *b1 = obj1;
-    if (b0->m < b1->m)
-        return -1;
-    if (b0->m > b1->m)
-        return 1;
-
-    return 0;
-}
 
 void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size)
 {
@@ -86,21 +72,14 @@ void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size)
 
     memset(src->pixels, 0, src->w*src->h);
 
-    array_t *gds;
-    bin_t bins[9];
-    array_alloc(&gds, NULL);
-
-    for (int i=0; i<N_BINS; i++) {
-        array_push_back(gds, &bins[i]);
-    }
-
     int l = cell_size/2;
     // Note cells are not ordered histograms of 4 cells
     for (int by=0, hog_index=0; by<y_cells; by+=2) {
         for (int bx=0; bx<x_cells; bx+=2) {
             for (int y=0; y<2; y++) {
                 for (int x=0; x<2; x++) {
-                    // Sort and draw bins
+                    // Sort and draw bins, the magnitude is the key and the bin is packed below it.
+                    int bins[N_BINS];
                     for (int i=hog_index; i<hog_index+N_BINS; i++) {
                         int m = (int)(hog[i]*255);
                         if (m > 255) {
@@ -108,20 +87,18 @@ void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size)
                         } else if (m < 0) {
                             m = 0;
                         }
-                        bin_t *bin = array_at(gds, (i%N_BINS));
-                        bin->m = m;
-                        bin->d = ((i%N_BINS)*20);
+                        bins[i%N_BINS] = (m << 4) | (i%N_BINS);
                     }
 
-                    array_sort(gds, bin_array_comp);
+                    fsort(bins, N_BINS);
 
                     int x1 = (x+bx) * cell_size + l;
                     int y1 = (y+by) * cell_size + l;
                     for (int i=0; i<N_BINS; i++) {
-                        bin_t *bin = array_at(gds, i);
-                        int x2 = l * cos_table[bin->d];
-                        int y2 = l * sin_table[bin->d];
-                        imlib_draw_line(src, (x1 - x2), (y1 + y2), (x1 + x2), (y1 - y2), bin->m, 1);
+                        int d = (bins[i] & 0xF) * 20;
+                        int x2 = l * cos_table[d];
+                        int y2 = l * sin_table[d];
+                        imlib_draw_line(src, (x1 - x2), (y1 + y2), (x1 + x2), (y1 - y2), bins[i] >> 4, 1);
                     }
 
                     hog_index += N_BINS;
@@ -130,7 +107,199 @@ void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size)
         }
     }
 
-    xfree(gds);
     fb_free();
 }
+// tan(20), tan(40), tan(60) and tan(80) degrees in Q8: the bin boundaries within one quadrant.
+static const uint16_t hog_tan_table[4] = {93, 215, 443, 1452};
+
+// Grayscale row with the first and last pixels replicated once on each side.
+static void hog_row(image_t *ptr, rectangle_t *roi, int y, uint8_t *row)
+{
+    switch (ptr->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+            for (int x = 0, xx = roi->w; x < xx; x++) {
+                row[x + 1] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, roi->x + x));
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            memcpy(row + 1, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y) + roi->x, roi->w);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+            for (int x = 0, xx = roi->w; x < xx; x++) {
+                row[x + 1] = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, roi->x + x));
+            }
+            break;
+        }
+        default: {
+            memset(row + 1, 0, roi->w);
+            break;
+        }
+    }
+
+    row[0] = row[1];
+    row[roi->w + 1] = row[roi->w];
+}
+
+// Allocates the histograms on the fb_alloc stack (freed by imlib_hog_cells_free()) and fills them.
+// Pixels are binned into 9 unsigned orientation bins of 20 degrees with integer math only.
+void imlib_hog_cells_init(hog_cells_t *cells, image_t *ptr, rectangle_t *roi, int cell_size)
+{
+    cells->roi = *roi;
+    cells->cell_size = cell_size;
+    cells->cells_w = roi->w / cell_size;
+    cells->cells_h = roi->h / cell_size;
+
+    int blocks = IM_MAX(cells->cells_w - 1, 0) * IM_MAX(cells->cells_h - 1, 0);
+    cells->hist = fb_alloc0(cells->cells_w * cells->cells_h * HOG_BINS * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    cells->block_norm = fb_alloc(IM_MAX(blocks, 1) * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int i = 0; i < blocks; i++) {
+        cells->block_norm[i] = -1.0f;
+    }
+
+    if ((cells->cells_w <= 0) || (cells->cells_h <= 0)) {
+        return;
+    }
+
+    // Sliding window of 3 grayscale rows, rows outside of the roi are clamped.
+    int row_len = roi->w + 2;
+    uint8_t *rows = fb_alloc(row_len * 3, FB_ALLOC_PREFER_SPEED);
+    uint8_t *row_0 = rows, *row_1 = rows + row_len, *row_2 = rows + (row_len * 2);
+    hog_row(ptr, roi, roi->y, row_1);
+    hog_row(ptr, roi, roi->y + IM_MIN(1, roi->h - 1), row_2);
+    memcpy(row_0, row_1, row_len);
+
+    for (int y = 0, yy = cells->cells_h * cell_size; y < yy; y++) {
+        if (y) {
+            uint8_t *tmp = row_0;
+            row_0 = row_1;
+            row_1 = row_2;
+            row_2 = tmp;
+            hog_row(ptr, roi, roi->y + IM_MIN(y + 1, roi->h - 1), row_2);
+        }
+
+        uint32_t *hist = cells->hist + ((y / cell_size) * cells->cells_w * HOG_BINS);
+
+        for (int cx = 0, x = 0; cx < cells->cells_w; cx++, hist += HOG_BINS) {
+            for (int xx = x + cell_size; x < xx; x++) {
+                int dx = row_1[x + 2] - row_1[x];
+                int dy = row_2[x + 1] - row_0[x + 1];
+
+                if (!(dx | dy)) {
+                    continue;
+                }
+
+                int adx = abs(dx), ady = abs(dy);
+                int q = 0;
+
+                for (int ady_q8 = ady << 8; (q < 4) && (ady_q8 >= (adx * hog_tan_table[q])); q++);
+
+                // Bins 0-3 are in the quadrant where dx and dy have the same sign, 5-8 are
+                // mirrored in the other one, and bin 4 (80-100 degrees) straddles both.
+                int bin = (dy && ((dx ^ dy) < 0) && (q < 4)) ? (8 - q) : q;
+
+                // Alpha max plus beta min magnitude (within 4% of the euclidean one).
+                hist[bin] += ((IM_MAX(adx, ady) * 123) + (IM_MIN(adx, ady) * 51)) >> 7;
+            }
+        }
+    }
+
+    fb_free(); // rows
+}
+
+void imlib_hog_cells_free(hog_cells_t *cells)
+{
+    fb_free(); // block_norm
+    fb_free(); // hist
+}
+
+// Inverse L2 norm of the 2x2 cell block at (bx, by), computed on the first use.
+float imlib_hog_block_norm(hog_cells_t *cells, int bx, int by)
+{
+    float *norm = cells->block_norm + (by * (cells->cells_w - 1)) + bx;
+
+    if (*norm < 0) {
+        uint32_t *hist_0 = cells->hist + (((by * cells->cells_w) + bx) * HOG_BINS);
+        uint32_t *hist_1 = hist_0 + (cells->cells_w * HOG_BINS);
+        float sum = 0;
+
+        for (int i = 0; i < (HOG_BINS * 2); i++) {
+            sum += ((float) hist_0[i] * hist_0[i]) + ((float) hist_1[i] * hist_1[i]);
+        }
+
+        *norm = 1.0f / (fast_sqrtf(sum) + 1.0f);
+    }
+
+    return *norm;
+}
+
+// Length of the descriptor of a window of win_w x win_h cells.
+int imlib_hog_descriptor_len(hog_cells_t *cells, int win_w, int win_h)
+{
+    return (win_w - 1) * (win_h - 1) * HOG_BLOCK_LEN;
+}
+
+// Normalized blocks of the window at cell (x, y) in raster order, each block is the bins of its
+// top-left, top-right, bottom-left and bottom-right cells.
+void imlib_hog_descriptor(hog_cells_t *cells, int x, int y, int win_w, int win_h, float *desc)
+{
+    for (int by = y, byy = y + win_h - 1; by < byy; by++) {
+        for (int bx = x, bxx = x + win_w - 1; bx < bxx; bx++) {
+            float norm = imlib_hog_block_norm(cells, bx, by);
+            uint32_t *hist_0 = cells->hist + (((by * cells->cells_w) + bx) * HOG_BINS);
+            uint32_t *hist_1 = hist_0 + (cells->cells_w * HOG_BINS);
+
+            for (int i = 0; i < (HOG_BINS * 2); i++) {
+                desc[i] = hist_0[i] * norm;
+                desc[i + (HOG_BINS * 2)] = hist_1[i] * norm;
+            }
+
+            desc += HOG_BLOCK_LEN;
+        }
+    }
+}
+
+// Linear SVM over all windows of win_w x win_h cells moved by stride cells. The weights are in
+// imlib_hog_descriptor() order. Overlapping windows share the cell histograms and block norms,
+// so each window only costs one multiply-accumulate per descriptor element.
+void imlib_find_hog_objects(list_t *out, hog_cells_t *cells, int win_w, int win_h, int stride,
+                            const float *weights, float bias, float threshold)
+{
+    list_init(out, sizeof(find_hog_objects_list_lnk_data_t));
+
+    for (int y = 0; (y + win_h) <= cells->cells_h; y += stride) {
+        for (int x = 0; (x + win_w) <= cells->cells_w; x += stride) {
+            const float *w = weights;
+            float score = bias;
+
+            for (int by = y, byy = y + win_h - 1; by < byy; by++) {
+                for (int bx = x, bxx = x + win_w - 1; bx < bxx; bx++, w += HOG_BLOCK_LEN) {
+                    uint32_t *hist_0 = cells->hist + (((by * cells->cells_w) + bx) * HOG_BINS);
+                    uint32_t *hist_1 = hist_0 + (cells->cells_w * HOG_BINS);
+                    float dot = 0;
+
+                    for (int i = 0; i < (HOG_BINS * 2); i++) {
+                        dot += (w[i] * hist_0[i]) + (w[i + (HOG_BINS * 2)] * hist_1[i]);
+                    }
+
+                    score += dot * imlib_hog_block_norm(cells, bx, by);
+                }
+            }
+
+            if (score >= threshold) {
+                find_hog_objects_list_lnk_data_t lnk_data;
+                rectangle_init(&lnk_data.rect,
+                               cells->roi.x + (x * cells->cell_size),
+                               cells->roi.y + (y * cells->cell_size),
+                               win_w * cells->cell_size, win_h * cells->cell_size);
+                lnk_data.score = score;
+                list_push_back(out, &lnk_data);
+            }
+        }
+    }
+}
 #endif // IMLIB_ENABLE_HOG
@@ -0,0 +1,81 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build CMSIS-DSP functions, plain C with libm (not bit exact with CMSIS-DSP).
+ */
+#include "arm_math.h"
+#include "arm_const_structs.h"
+
+uint32_t host_apsr_ge = 0;
+
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len16 = { 16 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len32 = { 32 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len64 = { 64 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len128 = { 128 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len256 = { 256 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len512 = { 512 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len1024 = { 1024 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len2048 = { 2048 };
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len4096 = { 4096 };
+
+float32_t arm_sin_f32(float32_t x)
+{
+    return sinf(x);
+}
+
+float32_t arm_cos_f32(float32_t x)
+{
+    return cosf(x);
+}
+
+// Iterative radix-2 decimation in time, fftLen is a power of 2.
+void arm_cfft_f32(const arm_cfft_instance_f32 *S, float32_t *p1, uint8_t ifftFlag, uint8_t bitReverseFlag)
+{
+    int n = S->fftLen;
+
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j) {
+            float32_t re = p1[2 * i], im = p1[(2 * i) + 1];
+            p1[2 * i] = p1[2 * j];
+            p1[(2 * i) + 1] = p1[(2 * j) + 1];
+            p1[2 * j] = re;
+            p1[(2 * j) + 1] = im;
+        }
+    }
+
+    for (int len = 2; len <= n; len <<= 1) {
+        double angle = (ifftFlag ? 2.0 : -2.0) * M_PI / len;
+
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < (len / 2); k++) {
+                float32_t w_re = cos(angle * k), w_im = sin(angle * k);
+                float32_t *a = p1 + (2 * (i + k)), *b = p1 + (2 * (i + k + (len / 2)));
+                float32_t t_re = (b[0] * w_re) - (b[1] * w_im);
+                float32_t t_im = (b[0] * w_im) + (b[1] * w_re);
+                b[0] = a[0] - t_re;
+                b[1] = a[1] - t_im;
+                a[0] += t_re;
+                a[1] += t_im;
+            }
+        }
+    }
+
+    if (ifftFlag) {
+        for (int i = 0; i < (2 * n); i++) {
+            p1[i] /= n;
+        }
+    }
+}
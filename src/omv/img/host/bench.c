@@ -0,0 +1,491 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host benchmark and regression runner for imlib.
+ *
+ * Usage: bench <data dir> [-n iterations] [-f filter]
+ *
+ * Each test loads one of the unittest images, runs an imlib function on a copy of it and
+ * prints the best time and a checksum of the result (the output pixels and/or the objects
+ * found). The checksums are stable between runs, diff the output of two builds to find the
+ * functions whose results changed. Tests fail on exceptions and on fb_alloc leaks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp.h"
+#include "py/mphal.h"
+#include "imlib.h"
+
+#define BENCH_PATH_SIZE     (256)
+#define BENCH_HASH_INIT     (2166136261UL) // FNV-1a
+#define BENCH_HASH_PRIME    (16777619UL)
+
+uint32_t host_fb_alloc_used();
+
+typedef struct bench {
+    const char *name;
+    const char *file;
+    bool mark;  // Wrapped in fb_alloc_mark/fb_alloc_free_till_mark like in py_image.c.
+    uint32_t (*run)(image_t *img);
+} bench_t;
+
+static uint32_t hash_data(uint32_t hash, const void *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ ((const uint8_t *) data)[i]) * BENCH_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+static uint32_t hash_image(image_t *img)
+{
+    return hash_data(BENCH_HASH_INIT, img->data, image_size(img));
+}
+
+static void roi_full(image_t *img, rectangle_t *roi)
+{
+    rectangle_init(roi, 0, 0, img->w, img->h);
+}
+
+// Hashes the fixed size part of each list element, size is the bytes before any pointers.
+static uint32_t hash_list(list_t *list, size_t len, size_t size)
+{
+    uint32_t hash = hash_data(BENCH_HASH_INIT, &len, sizeof(len));
+    uint8_t data[list->data_len];
+
+    while (list_size(list)) {
+        list_pop_front(list, data);
+        hash = hash_data(hash, data, size);
+    }
+
+    return hash;
+}
+
+static uint32_t run_mean_filter(image_t *img)
+{
+    imlib_mean_filter(img, 2, false, 0, false, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_median_filter(image_t *img)
+{
+    imlib_median_filter(img, 1, 0.5f, false, 0, false, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_midpoint_filter(image_t *img)
+{
+    imlib_midpoint_filter(img, 2, 0.5f, false, 0, false, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_gaussian(image_t *img)
+{
+    const int krn[9] = { 1, 2, 1, 2, 4, 2, 1, 2, 1 };
+    imlib_morph(img, 1, krn, 1.0f / 16.0f, 0, false, 0, false, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_erode(image_t *img)
+{
+    imlib_erode(img, 1, 4, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_histeq(image_t *img)
+{
+    imlib_histeq(img, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_lens_corr(image_t *img)
+{
+    imlib_lens_corr(img, 1.8f, 1.0f, 0.0f, 0.0f);
+    return hash_image(img);
+}
+
+static uint32_t run_edge_canny(image_t *img)
+{
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_edge_canny(img, &roi, 50, 80);
+    return hash_image(img);
+}
+
+static uint32_t run_binary(image_t *img)
+{
+    list_t thresholds;
+    list_init(&thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    color_thresholds_list_lnk_data_t lnk = { .LMin = 0, .LMax = 128, .AMin = -128, .AMax = 127, .BMin = -128, .BMax = 127 };
+    list_push_back(&thresholds, &lnk);
+    imlib_binary(img, img, &thresholds, false, false, NULL);
+    list_free(&thresholds);
+    return hash_image(img);
+}
+
+// The other image of the math ops is the negated image, so all pixel values are exercised.
+static image_t *bench_other(image_t *img)
+{
+    static image_t other;
+    other = *img;
+    other.data = fb_alloc(image_size(img), FB_ALLOC_NO_HINT);
+    memcpy(other.data, img->data, image_size(img));
+    imlib_negate(&other);
+    return &other;
+}
+
+static uint32_t run_add(image_t *img)
+{
+    imlib_add(img, NULL, NULL, 64, NULL);
+    return hash_image(img);
+}
+
+static uint32_t run_sub(image_t *img)
+{
+    imlib_sub(img, NULL, bench_other(img), 0, false, NULL);
+    fb_free();
+    return hash_image(img);
+}
+
+static uint32_t run_sub_reverse_masked(image_t *img)
+{
+    image_t *other = bench_other(img);
+    imlib_sub(img, NULL, other, 0, true, other);
+    fb_free();
+    return hash_image(img);
+}
+
+static uint32_t run_min(image_t *img)
+{
+    imlib_min(img, NULL, bench_other(img), 0, NULL);
+    fb_free();
+    return hash_image(img);
+}
+
+static uint32_t run_max(image_t *img)
+{
+    imlib_max(img, NULL, bench_other(img), 0, NULL);
+    fb_free();
+    return hash_image(img);
+}
+
+static uint32_t run_difference(image_t *img)
+{
+    imlib_difference(img, NULL, bench_other(img), 0, NULL);
+    fb_free();
+    return hash_image(img);
+}
+
+static uint32_t run_jpeg_compress(image_t *img)
+{
+    uint32_t size;
+    uint8_t *buf = fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE);
+    image_t dst = { .w = img->w, .h = img->h, .bpp = size, .data = buf };
+
+    if (jpeg_compress(img, &dst, 90, false)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, "Out of memory!"));
+    }
+
+    uint32_t hash = hash_data(BENCH_HASH_INIT, dst.data, dst.bpp);
+    fb_free();
+    return hash;
+}
+
+static uint32_t run_find_blobs(image_t *img)
+{
+    list_t out, thresholds;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    list_init(&thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    color_thresholds_list_lnk_data_t lnk = { .LMin = 30, .LMax = 100, .AMin = 15, .AMax = 127, .BMin = 15, .BMax = 127 };
+    list_push_back(&thresholds, &lnk);
+    imlib_find_blobs(&out, img, &roi, 1, 1, &thresholds, false, 10, 10, false, 0,
+                     NULL, NULL, NULL, NULL, 0, 0, false);
+    list_free(&thresholds);
+    return hash_list(&out, list_size(&out), offsetof(find_blobs_list_lnk_data_t, x_hist_bins_count));
+}
+
+static uint32_t run_find_blobs_merge(image_t *img)
+{
+    list_t out, thresholds;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    list_init(&thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    // Grain (hundreds of small blobs) of the grayscale image or the colored blobs of the RGB565 image.
+    color_thresholds_list_lnk_data_t lnk = { .LMin = 40, .LMax = 60, .AMin = -128, .AMax = 127, .BMin = -128, .BMax = 127 };
+    if (img->bpp == IMAGE_BPP_RGB565) {
+        lnk = (color_thresholds_list_lnk_data_t) { .LMin = 30, .LMax = 100, .AMin = 15, .AMax = 127, .BMin = 15, .BMax = 127 };
+    }
+    list_push_back(&thresholds, &lnk);
+    imlib_find_blobs(&out, img, &roi, 1, 1, &thresholds, false, 1, 1, true, 4,
+                     NULL, NULL, NULL, NULL, 0, 0, false);
+    list_free(&thresholds);
+    return hash_list(&out, list_size(&out), offsetof(find_blobs_list_lnk_data_t, x_hist_bins_count));
+}
+
+// The grain of the grayscale image kept by the native filter.
+static uint32_t run_find_blobs_filter(image_t *img)
+{
+    list_t out, thresholds;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    list_init(&thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    color_thresholds_list_lnk_data_t lnk = { .LMin = 40, .LMax = 60, .AMin = -128, .AMax = 127, .BMin = -128, .BMax = 127 };
+    list_push_back(&thresholds, &lnk);
+    find_blobs_filter_t filter;
+    imlib_find_blobs_filter_init(&filter, NULL, NULL);
+    imlib_find_blobs_filter_range(&filter, FIND_BLOBS_FILTER_DENSITY, 0.3f, 1.0f);
+    imlib_find_blobs_filter_range(&filter, FIND_BLOBS_FILTER_ASPECT_RATIO, 0.5f, 2.0f);
+    filter.weights[FIND_BLOBS_FILTER_PIXELS] = 1.0f;
+    filter.weights[FIND_BLOBS_FILTER_ROUNDNESS] = 10.0f;
+    imlib_find_blobs_filter_range(&filter, FIND_BLOBS_FILTER_SCORE, 8.0f, INFINITY);
+    imlib_find_blobs(&out, img, &roi, 1, 1, &thresholds, false, 1, 1, false, 0,
+                     imlib_find_blobs_filter, &filter, NULL, NULL, 0, 0, false);
+    list_free(&thresholds);
+    return hash_list(&out, list_size(&out), offsetof(find_blobs_list_lnk_data_t, x_hist_bins_count));
+}
+
+// Overlapping rectangles placed with the pixel values (like the detections of a Haar cascade).
+static uint32_t run_rectangle_merge(image_t *img)
+{
+    array_t *rects;
+    array_alloc(&rects, xfree);
+
+    for (int i = 0; i < 512; i++) {
+        uint8_t *p = img->data + ((i * 7919) % (img->w * img->h));
+        array_push_back(rects, rectangle_alloc((p[0] * img->w) / 256, (p[1] * img->h) / 256, 8 + (p[2] % 16), 8 + (p[3] % 16)));
+    }
+
+    rects = rectangle_merge(rects);
+    uint32_t len = array_length(rects);
+    uint32_t hash = hash_data(BENCH_HASH_INIT, &len, sizeof(len));
+
+    for (int i = 0; i < len; i++) {
+        hash = hash_data(hash, array_at(rects, i), sizeof(rectangle_t));
+    }
+
+    array_free(rects);
+    return hash;
+}
+
+static uint32_t run_find_lines(image_t *img)
+{
+    list_t out;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_find_lines(&out, img, &roi, 2, 1, 1000, 25, 25, NULL);
+    return hash_list(&out, list_size(&out), sizeof(find_lines_list_lnk_data_t));
+}
+
+static uint32_t run_find_rects(image_t *img)
+{
+    list_t out;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_find_rects(&out, img, &roi, 10000);
+    return hash_list(&out, list_size(&out), sizeof(find_rects_list_lnk_data_t));
+}
+
+static uint32_t run_find_eye(image_t *img)
+{
+    // The roi of the unittest, the iris is at (159, 114).
+    point_t iris;
+    rectangle_t roi = { 100, 70, 250, 100 };
+    imlib_find_iris(img, &iris, &roi);
+    return hash_data(BENCH_HASH_INIT, &iris, sizeof(iris));
+}
+
+static uint32_t run_find_qrcodes(image_t *img)
+{
+    list_t out;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_find_qrcodes(&out, img, &roi);
+    return hash_list(&out, list_size(&out), offsetof(find_qrcodes_list_lnk_data_t, payload_len));
+}
+
+static uint32_t run_find_apriltags(image_t *img)
+{
+    list_t out;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_find_apriltags(&out, img, &roi, TAG36H11, (2.8f / 3.984f) * img->w, (2.8f / 2.952f) * img->h,
+                         img->w * 0.5f, img->h * 0.5f, 1, 0);
+    return hash_list(&out, list_size(&out), offsetof(find_apriltags_list_lnk_data_t, centroid));
+}
+
+static uint32_t run_find_datamatrices(image_t *img)
+{
+    list_t out;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_find_datamatrices(&out, img, &roi, 200);
+    return hash_list(&out, list_size(&out), offsetof(find_datamatrices_list_lnk_data_t, payload_len));
+}
+
+static uint32_t run_find_barcodes(image_t *img)
+{
+    list_t out;
+    rectangle_t roi;
+    roi_full(img, &roi);
+    imlib_find_barcodes(&out, img, &roi, 1, 1, false);
+    return hash_list(&out, list_size(&out), offsetof(find_barcodes_list_lnk_data_t, payload_len));
+}
+
+static const bench_t benches[] = {
+    { "mean_filter",        "cat.pgm",          false,  run_mean_filter         },
+    { "median_filter",      "cat.pgm",          false,  run_median_filter       },
+    { "midpoint_filter",    "cat.pgm",          false,  run_midpoint_filter     },
+    { "gaussian",           "cat.pgm",          false,  run_gaussian            },
+    { "erode",              "cat.pgm",          false,  run_erode               },
+    { "histeq",             "cat.pgm",          false,  run_histeq              },
+    { "lens_corr",          "cat.pgm",          false,  run_lens_corr           },
+    { "edge_canny",         "cat.pgm",          false,  run_edge_canny          },
+    { "binary",             "cat.pgm",          false,  run_binary              },
+    { "jpeg_compress",      "cat.pgm",          false,  run_jpeg_compress       },
+    { "add",                "cat.pgm",          false,  run_add                 },
+    { "sub",                "cat.pgm",          false,  run_sub                 },
+    { "sub_masked",         "cat.pgm",          false,  run_sub_reverse_masked  },
+    { "min",                "cat.pgm",          false,  run_min                 },
+    { "max",                "cat.pgm",          false,  run_max                 },
+    { "difference",         "cat.pgm",          false,  run_difference          },
+    { "gaussian_rgb565",    "blobs.ppm",        false,  run_gaussian            },
+    { "histeq_rgb565",      "blobs.ppm",        false,  run_histeq              },
+    { "jpeg_rgb565",        "blobs.ppm",        false,  run_jpeg_compress       },
+    { "add_rgb565",         "blobs.ppm",        false,  run_add                 },
+    { "sub_rgb565",         "blobs.ppm",        false,  run_sub                 },
+    { "sub_masked_rgb565",  "blobs.ppm",        false,  run_sub_reverse_masked  },
+    { "min_rgb565",         "blobs.ppm",        false,  run_min                 },
+    { "max_rgb565",         "blobs.ppm",        false,  run_max                 },
+    { "difference_rgb565",  "blobs.ppm",        false,  run_difference          },
+    { "find_blobs",         "blobs.ppm",        true,   run_find_blobs          },
+    { "find_blobs_merge",   "cat.pgm",          true,   run_find_blobs_merge    },
+    { "find_blobs_merge_rgb565", "blobs.ppm",   true,   run_find_blobs_merge    },
+    { "find_blobs_filter",  "cat.pgm",          true,   run_find_blobs_filter   },
+    { "rectangle_merge",    "cat.pgm",          true,   run_rectangle_merge     },
+    { "find_lines",         "shapes.ppm",       true,   run_find_lines          },
+    { "find_rects",         "shapes.ppm",       true,   run_find_rects          },
+    { "find_eye",           "eye.pgm",          true,   run_find_eye            },
+    { "find_qrcodes",       "qrcode.pgm",       true,   run_find_qrcodes        },
+    { "find_apriltags",     "apriltags.pgm",    true,   run_find_apriltags      },
+    { "find_datamatrices",  "datamatrix.pgm",   true,   run_find_datamatrices   },
+    { "find_barcodes",      "barcode.pgm",      true,   run_find_barcodes       },
+};
+
+// Returns false on an exception or if fb_alloc memory is left allocated.
+static bool bench_run(const bench_t *bench, image_t *src, int iterations, uint32_t *best, uint32_t *hash)
+{
+    size_t size = image_size(src);
+    image_t img = *src;
+    img.data = xalloc(size);
+    *best = UINT32_MAX;
+
+    for (int i = 0; i < iterations; i++) {
+        memcpy(img.data, src->data, size);
+        nlr_buf_t nlr;
+
+        if (nlr_push(&nlr) == 0) {
+            if (bench->mark) {
+                fb_alloc_mark();
+            }
+
+            uint32_t start = mp_hal_ticks_us();
+            *hash = bench->run(&img);
+            uint32_t elapsed = mp_hal_ticks_us() - start;
+
+            if (bench->mark) {
+                fb_alloc_free_till_mark();
+            }
+
+            nlr_pop();
+            *best = IM_MIN(*best, elapsed);
+        } else {
+            printf("%-20s %s: %s\n", bench->name, nlr.ret_val->type->name, nlr.ret_val->msg);
+            fb_free_all();
+            xfree(img.data);
+            return false;
+        }
+
+        if (host_fb_alloc_used()) {
+            printf("%-20s fb_alloc leaked %u bytes\n", bench->name, (unsigned) host_fb_alloc_used());
+            fb_free_all();
+            xfree(img.data);
+            return false;
+        }
+    }
+
+    xfree(img.data);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *data = NULL, *filter = NULL;
+    int iterations = 5, failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if ((!strcmp(argv[i], "-n")) && ((i + 1) < argc)) {
+            iterations = IM_MAX(atoi(argv[++i]), 1);
+        } else if ((!strcmp(argv[i], "-f")) && ((i + 1) < argc)) {
+            filter = argv[++i];
+        } else {
+            data = argv[i];
+        }
+    }
+
+    if (!data) {
+        fprintf(stderr, "Usage: %s <data dir> [-n iterations] [-f filter]\n", argv[0]);
+        return 2;
+    }
+
+    fb_alloc_init0();
+    file_buffer_init0();
+
+    for (int i = 0; i < (sizeof(benches) / sizeof(benches[0])); i++) {
+        const bench_t *bench = &benches[i];
+
+        if (filter && (!strstr(bench->name, filter))) {
+            continue;
+        }
+
+        char path[BENCH_PATH_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", data, bench->file);
+
+        image_t src = { .w = 0, .h = 0, .bpp = 0, .data = NULL };
+        nlr_buf_t nlr;
+
+        if (nlr_push(&nlr) == 0) {
+            imlib_load_image(&src, path);
+            nlr_pop();
+        } else {
+            printf("%-20s %s: %s (%s)\n", bench->name, nlr.ret_val->type->name, nlr.ret_val->msg, path);
+            fb_free_all();
+            failed += 1;
+            continue;
+        }
+
+        uint32_t best, hash;
+
+        if (bench_run(bench, &src, iterations, &best, &hash)) {
+            printf("%-20s %-16s %3dx%-3d %8u us  %08x\n", bench->name, bench->file, src.w, src.h,
+                   (unsigned) best, (unsigned) hash);
+        } else {
+            failed += 1;
+        }
+
+        xfree(src.data);
+    }
+
+    if (failed) {
+        printf("%d test(s) failed\n", failed);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build fb_alloc, the same downward growing stack as on the MCU in a static arena of
+ * HOST_FB_ALLOC_SIZE bytes (the frame buffer memory left with no image in it). The extra
+ * memory pools and the profiler are not emulated.
+ */
+#include <string.h>
+#include "mp.h"
+#include "fb_alloc.h"
+
+#ifndef HOST_FB_ALLOC_SIZE
+#define HOST_FB_ALLOC_SIZE  (496 * 1024) // OPENMV4 OMV_FB_SIZE + OMV_FB_ALLOC_SIZE.
+#endif
+
+static char arena[HOST_FB_ALLOC_SIZE] __attribute__((aligned(32)));
+#define ARENA_END   (arena + sizeof(arena))
+
+static char *pointer = ARENA_END;
+static int marks = 0;
+
+NORETURN void fb_alloc_fail()
+{
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError,
+        "Out of fast Frame Buffer Stack Memory!"
+        " Please reduce the resolution of the image you are running this algorithm on to bypass this issue!"));
+}
+
+void fb_alloc_init0()
+{
+    pointer = ARENA_END;
+    marks = 0;
+}
+
+uint32_t fb_avail()
+{
+    uint32_t temp = pointer - arena - sizeof(uint32_t);
+
+    return (temp < sizeof(uint32_t)) ? 0 : temp;
+}
+
+void fb_alloc_mark()
+{
+    char *new_pointer = pointer - sizeof(uint32_t);
+
+    if (new_pointer < arena) {
+        fb_alloc_fail();
+    }
+
+    // A size of 4 marks the stack (allocations are always 8 bytes or more).
+    *((uint32_t *) new_pointer) = sizeof(uint32_t);
+    pointer = new_pointer;
+    marks += 1;
+}
+
+static uint32_t fb_pop()
+{
+    uint32_t size = *((uint32_t *) pointer);
+    pointer += size;
+    return size;
+}
+
+void fb_alloc_free_till_mark()
+{
+    if (!marks) return;
+    while (pointer < ARENA_END) {
+        if (fb_pop() == sizeof(uint32_t)) break; // Break on first marker.
+    }
+    marks -= 1;
+}
+
+void *fb_alloc(uint32_t size, int hints)
+{
+    if (!size) {
+        return NULL;
+    }
+
+    size = ((size + sizeof(uint32_t) - 1) / sizeof(uint32_t)) * sizeof(uint32_t); // Round Up
+    char *result = pointer - size;
+    char *new_pointer = result - sizeof(uint32_t);
+
+    if ((result < arena) || (new_pointer < arena)) {
+        fb_alloc_fail();
+    }
+
+    *((uint32_t *) new_pointer) = size + sizeof(uint32_t); // Save size.
+    pointer = new_pointer;
+    return result;
+}
+
+void *fb_alloc0(uint32_t size, int hints)
+{
+    void *mem = fb_alloc(size, hints);
+    memset(mem, 0, size); // does nothing if size is zero.
+    return mem;
+}
+
+void *fb_alloc_all(uint32_t *size, int hints)
+{
+    uint32_t temp = pointer - arena - sizeof(uint32_t);
+
+    if ((pointer - arena) < (2 * sizeof(uint32_t))) {
+        *size = 0;
+        return NULL;
+    }
+
+    *size = (temp / sizeof(uint32_t)) * sizeof(uint32_t); // Round Down
+    char *result = pointer - *size;
+    char *new_pointer = result - sizeof(uint32_t);
+
+    *((uint32_t *) new_pointer) = *size + sizeof(uint32_t); // Save size.
+    pointer = new_pointer;
+    return result;
+}
+
+void *fb_alloc0_all(uint32_t *size, int hints)
+{
+    void *mem = fb_alloc_all(size, hints);
+    memset(mem, 0, *size); // does nothing if size is zero.
+    return mem;
+}
+
+void fb_free()
+{
+    if (pointer < ARENA_END) {
+        fb_pop();
+    }
+}
+
+void fb_free_all()
+{
+    pointer = ARENA_END;
+    marks = 0;
+}
+
+void fb_alloc_profile_enable(bool enable)
+{
+}
+
+bool fb_alloc_profile_enabled()
+{
+    return false;
+}
+
+const fb_alloc_profile_t *fb_alloc_profile_entries()
+{
+    return NULL;
+}
+
+uint32_t fb_alloc_profile_peak()
+{
+    return 0;
+}
+
+// Bytes still allocated, the benchmark runner checks that every test frees what it allocates.
+uint32_t host_fb_alloc_used()
+{
+    return ARENA_END - pointer;
+}
@@ -0,0 +1,406 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build FatFS and file helper functions over stdio. Paths are host paths. The file
+ * buffer still takes the rest of the fb_alloc memory like on the MCU, but stdio does the
+ * buffering, and the deferred writer writes through.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mp.h"
+#include "fb_alloc.h"
+#include "xalloc.h"
+#include "ff_wrapper.h"
+
+const char *ffs_strerror(FRESULT res)
+{
+    static const char *ffs_errors[] = {
+        "Succeeded",
+        "A hard error occurred in the low level disk I/O layer",
+        "Assertion failed",
+        "The physical drive cannot work",
+        "Could not find the file",
+        "Could not find the path",
+        "The path name format is invalid",
+        "Access denied due to prohibited access or directory full",
+        "Access denied due to prohibited access",
+        "The file/directory object is invalid",
+        "The physical drive is write protected",
+        "The logical drive number is invalid",
+        "The volume has no work area",
+        "There is no valid FAT volume",
+        "The f_mkfs() aborted due to any parameter error",
+        "Could not get a grant to access the volume within defined period",
+        "The operation is rejected according to the file sharing policy",
+        "LFN working buffer could not be allocated",
+        "Number of open files > _FS_SHARE",
+        "Given parameter is invalid",
+    };
+
+    return (res < (sizeof(ffs_errors) / sizeof(ffs_errors[0]))) ? ffs_errors[res] : "Unknown error";
+}
+
+FRESULT f_open_helper(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    fp->file = fopen(path, (mode & FA_WRITE) ? "wb" : "rb");
+    fp->flag = mode & (FA_READ | FA_WRITE);
+    fp->fptr = 0;
+    fp->objsize = 0;
+
+    if (!fp->file) {
+        return FR_NO_FILE;
+    }
+
+    if (mode & FA_READ) {
+        fseek(fp->file, 0, SEEK_END);
+        fp->objsize = ftell(fp->file);
+        fseek(fp->file, 0, SEEK_SET);
+    }
+
+    return FR_OK;
+}
+
+FRESULT f_opendir_helper(FF_DIR *dp, const TCHAR *path)
+{
+    return FR_NOT_ENABLED;
+}
+
+FRESULT f_stat_helper(const TCHAR *path, FILINFO *fno)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        return FR_NO_FILE;
+    }
+
+    fno->fsize = st.st_size;
+    strncpy(fno->fname, path, sizeof(fno->fname) - 1);
+    fno->fname[sizeof(fno->fname) - 1] = 0;
+    return FR_OK;
+}
+
+FRESULT f_mkdir_helper(const TCHAR *path)
+{
+    return mkdir(path, 0755) ? FR_DENIED : FR_OK;
+}
+
+FRESULT f_unlink_helper(const TCHAR *path)
+{
+    return unlink(path) ? FR_NO_FILE : FR_OK;
+}
+
+FRESULT f_rename_helper(const TCHAR *path_old, const TCHAR *path_new)
+{
+    return rename(path_old, path_new) ? FR_DENIED : FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    if (!fp->file) {
+        return FR_INVALID_OBJECT;
+    }
+
+    int ret = fclose(fp->file);
+    fp->file = NULL;
+    return ret ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    *br = fread(buff, 1, btr, fp->file);
+    fp->fptr += *br;
+    return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    *bw = fwrite(buff, 1, btw, fp->file);
+    fp->fptr += *bw;
+    if (fp->fptr > fp->objsize) {
+        fp->objsize = fp->fptr;
+    }
+    return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+    if (fseek(fp->file, ofs, SEEK_SET) != 0) {
+        return FR_DISK_ERR;
+    }
+
+    fp->fptr = ofs;
+    if (fp->fptr > fp->objsize) {
+        fp->objsize = fp->fptr;
+    }
+    return FR_OK;
+}
+
+FRESULT f_truncate(FIL *fp)
+{
+    fflush(fp->file);
+    if (ftruncate(fileno(fp->file), fp->fptr) != 0) {
+        return FR_DISK_ERR;
+    }
+
+    fp->objsize = fp->fptr;
+    return FR_OK;
+}
+
+FRESULT f_sync(FIL *fp)
+{
+    return fflush(fp->file) ? FR_DISK_ERR : FR_OK;
+}
+
+NORETURN static void ff_fail(FIL *fp, FRESULT res)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, ffs_strerror(res)));
+}
+
+NORETURN static void ff_read_fail(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Failed to read requested bytes!"));
+}
+
+NORETURN static void ff_write_fail(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Failed to write requested bytes!"));
+}
+
+NORETURN static void ff_expect_fail(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Unexpected value read!"));
+}
+
+NORETURN void ff_unsupported_format(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Unsupported format!"));
+}
+
+NORETURN void ff_file_corrupted(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "File corrupted!"));
+}
+
+NORETURN void ff_not_equal(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Images not equal!"));
+}
+
+NORETURN void ff_no_intersection(FIL *fp)
+{
+    if (fp) f_close(fp);
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "No intersection!"));
+}
+
+void file_read_open(FIL *fp, const char *path)
+{
+    FRESULT res = f_open_helper(fp, path, FA_READ|FA_OPEN_EXISTING);
+    if (res != FR_OK) ff_fail(NULL, res);
+}
+
+void file_write_open(FIL *fp, const char *path)
+{
+    FRESULT res = f_open_helper(fp, path, FA_WRITE|FA_CREATE_ALWAYS);
+    if (res != FR_OK) ff_fail(NULL, res);
+}
+
+void file_close(FIL *fp)
+{
+    FRESULT res = f_close(fp);
+    if (res != FR_OK) ff_fail(NULL, res);
+}
+
+void file_seek(FIL *fp, UINT offset)
+{
+    FRESULT res = f_lseek(fp, offset);
+    if (res != FR_OK) ff_fail(fp, res);
+}
+
+void file_truncate(FIL *fp)
+{
+    FRESULT res = f_truncate(fp);
+    if (res != FR_OK) ff_fail(fp, res);
+}
+
+bool file_expand(FIL *fp, UINT size)
+{
+    return true;
+}
+
+void file_sync(FIL *fp)
+{
+    FRESULT res = f_sync(fp);
+    if (res != FR_OK) ff_fail(fp, res);
+}
+
+void file_fast_seek_on(FIL *fp)
+{
+}
+
+void file_buffer_init0()
+{
+}
+
+void file_buffer_on(FIL *fp)
+{
+    uint32_t size;
+    if (!fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE) || (!size)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, "No memory!"));
+    }
+}
+
+uint32_t file_tell_w_buf(FIL *fp)
+{
+    return f_tell(fp);
+}
+
+uint32_t file_size_w_buf(FIL *fp)
+{
+    return f_size(fp);
+}
+
+void file_buffer_off(FIL *fp)
+{
+    fb_free();
+}
+
+void read_data(FIL *fp, void *data, UINT size)
+{
+    UINT bytes;
+    FRESULT res = f_read(fp, data, size, &bytes);
+    if (res != FR_OK) ff_fail(fp, res);
+    if (bytes != size) ff_read_fail(fp);
+}
+
+void read_byte(FIL *fp, uint8_t *value)
+{
+    read_data(fp, value, sizeof(*value));
+}
+
+void read_byte_expect(FIL *fp, uint8_t value)
+{
+    uint8_t compare;
+    read_byte(fp, &compare);
+    if (value != compare) ff_expect_fail(fp);
+}
+
+void read_byte_ignore(FIL *fp)
+{
+    uint8_t trash;
+    read_byte(fp, &trash);
+}
+
+void read_word(FIL *fp, uint16_t *value)
+{
+    read_data(fp, value, sizeof(*value));
+}
+
+void read_word_expect(FIL *fp, uint16_t value)
+{
+    uint16_t compare;
+    read_word(fp, &compare);
+    if (value != compare) ff_expect_fail(fp);
+}
+
+void read_word_ignore(FIL *fp)
+{
+    uint16_t trash;
+    read_word(fp, &trash);
+}
+
+void read_long(FIL *fp, uint32_t *value)
+{
+    read_data(fp, value, sizeof(*value));
+}
+
+void read_long_expect(FIL *fp, uint32_t value)
+{
+    uint32_t compare;
+    read_long(fp, &compare);
+    if (value != compare) ff_expect_fail(fp);
+}
+
+void read_long_ignore(FIL *fp)
+{
+    uint32_t trash;
+    read_long(fp, &trash);
+}
+
+void write_data(FIL *fp, const void *data, UINT size)
+{
+    UINT bytes;
+    FRESULT res = f_write(fp, data, size, &bytes);
+    if (res != FR_OK) ff_fail(fp, res);
+    if (bytes != size) ff_write_fail(fp);
+}
+
+void write_byte(FIL *fp, uint8_t value)
+{
+    write_data(fp, &value, sizeof(value));
+}
+
+void write_word(FIL *fp, uint16_t value)
+{
+    write_data(fp, &value, sizeof(value));
+}
+
+void write_long(FIL *fp, uint32_t value)
+{
+    write_data(fp, &value, sizeof(value));
+}
+
+void file_ring_init0()
+{
+}
+
+void file_ring_open(file_ring_t *ring, FIL *fp, uint32_t size)
+{
+    ring->fp = fp;
+    ring->buf = NULL;
+    ring->size = 0;
+    ring->head = 0;
+    ring->count = 0;
+    ring->res = FR_OK;
+    ring->next = NULL;
+}
+
+void file_ring_write(file_ring_t *ring, const void *data, UINT size)
+{
+    write_data(ring->fp, data, size);
+}
+
+uint32_t file_ring_tell(file_ring_t *ring)
+{
+    return f_tell(ring->fp);
+}
+
+bool file_ring_poll()
+{
+    return false;
+}
+
+void file_ring_flush(file_ring_t *ring)
+{
+}
+
+void file_ring_close(file_ring_t *ring)
+{
+}
+
+void file_ring_abort(file_ring_t *ring)
+{
+}
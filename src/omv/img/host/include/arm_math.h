@@ -0,0 +1,196 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build CMSIS shim, portable C versions of the Cortex-M SIMD intrinsics and the CMSIS-DSP
+ * functions used by imlib. The results are bit exact with the MCU, only the speed differs.
+ */
+#ifndef __HOST_ARM_MATH_H__
+#define __HOST_ARM_MATH_H__
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+typedef float float32_t;
+
+#define PI  3.14159265358979f
+
+// APSR.GE flags of the last parallel add/subtract, used by __SEL.
+extern uint32_t host_apsr_ge;
+
+#define __STATIC_FORCEINLINE    static inline __attribute__((always_inline))
+
+#define __WFI()
+#define __DSB()
+#define __ISB()
+#define __disable_irq()
+#define __enable_irq()
+
+#define __UNALIGNED_UINT32_READ(addr)           ({ uint32_t _v; memcpy(&_v, (const void *) (addr), 4); _v; })
+#define __UNALIGNED_UINT32_WRITE(addr, val)     do { uint32_t _v = (val); memcpy((void *) (addr), &_v, 4); } while (0)
+
+#define __PKHBT(a, b, s)    ((((uint32_t) (a)) & 0x0000FFFFUL) | ((((uint32_t) (b)) << (s)) & 0xFFFF0000UL))
+#define __PKHTB(a, b, s)    ((((uint32_t) (a)) & 0xFFFF0000UL) | ((((uint32_t) (b)) >> (s)) & 0x0000FFFFUL))
+
+__STATIC_FORCEINLINE uint32_t __ROR(uint32_t x, uint32_t n)
+{
+    n &= 31;
+    return n ? ((x >> n) | (x << (32 - n))) : x;
+}
+
+__STATIC_FORCEINLINE uint32_t __CLZ(uint32_t x)
+{
+    return x ? __builtin_clz(x) : 32;
+}
+
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t x)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i++, x >>= 1) {
+        r = (r << 1) | (x & 1);
+    }
+    return r;
+}
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t x)
+{
+    return __builtin_bswap32(x);
+}
+
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t x)
+{
+    return ((x & 0xFF00FF00UL) >> 8) | ((x & 0x00FF00FFUL) << 8);
+}
+
+__STATIC_FORCEINLINE int32_t __SSAT(int32_t x, uint32_t n)
+{
+    int32_t max = (1 << (n - 1)) - 1, min = -1 - max;
+    return (x > max) ? max : ((x < min) ? min : x);
+}
+
+__STATIC_FORCEINLINE uint32_t __USAT(int32_t x, uint32_t n)
+{
+    int32_t max = (1 << n) - 1;
+    return (x > max) ? max : ((x < 0) ? 0 : x);
+}
+
+__STATIC_FORCEINLINE uint32_t __UXTB16(uint32_t x)
+{
+    return x & 0x00FF00FFUL;
+}
+
+__STATIC_FORCEINLINE uint32_t __UXTAB16(uint32_t a, uint32_t b)
+{
+    return (((a & 0xFFFF) + (b & 0xFF)) & 0xFFFF) | ((((a >> 16) + ((b >> 16) & 0xFF)) & 0xFFFF) << 16);
+}
+
+__STATIC_FORCEINLINE uint32_t __SMUAD(uint32_t a, uint32_t b)
+{
+    return (((int16_t) a) * ((int16_t) b)) + (((int16_t) (a >> 16)) * ((int16_t) (b >> 16)));
+}
+
+__STATIC_FORCEINLINE uint32_t __SMLAD(uint32_t a, uint32_t b, uint32_t acc)
+{
+    return acc + __SMUAD(a, b);
+}
+
+__STATIC_FORCEINLINE uint32_t __USADA8(uint32_t a, uint32_t b, uint32_t acc)
+{
+    for (int i = 0; i < 32; i += 8) {
+        int d = ((a >> i) & 0xFF) - ((b >> i) & 0xFF);
+        acc += (d < 0) ? -d : d;
+    }
+    return acc;
+}
+
+__STATIC_FORCEINLINE uint32_t __USUB8(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    host_apsr_ge = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = ((a >> (i * 8)) & 0xFF) - ((b >> (i * 8)) & 0xFF);
+        host_apsr_ge |= (d >= 0) << i;
+        r |= (d & 0xFF) << (i * 8);
+    }
+    return r;
+}
+
+__STATIC_FORCEINLINE uint32_t __UADD8(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    host_apsr_ge = 0;
+    for (int i = 0; i < 4; i++) {
+        int s = ((a >> (i * 8)) & 0xFF) + ((b >> (i * 8)) & 0xFF);
+        host_apsr_ge |= (s > 0xFF) << i;
+        r |= (s & 0xFF) << (i * 8);
+    }
+    return r;
+}
+
+__STATIC_FORCEINLINE uint32_t __USUB16(uint32_t a, uint32_t b)
+{
+    int lo = (a & 0xFFFF) - (b & 0xFFFF), hi = (a >> 16) - (b >> 16);
+    host_apsr_ge = ((lo >= 0) ? 0x3 : 0) | ((hi >= 0) ? 0xC : 0);
+    return (lo & 0xFFFF) | ((hi & 0xFFFF) << 16);
+}
+
+__STATIC_FORCEINLINE uint32_t __UADD16(uint32_t a, uint32_t b)
+{
+    int lo = (a & 0xFFFF) + (b & 0xFFFF), hi = (a >> 16) + (b >> 16);
+    host_apsr_ge = ((lo > 0xFFFF) ? 0x3 : 0) | ((hi > 0xFFFF) ? 0xC : 0);
+    return (lo & 0xFFFF) | ((hi & 0xFFFF) << 16);
+}
+
+__STATIC_FORCEINLINE uint32_t __SEL(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < 4; i++) {
+        r |= (((host_apsr_ge >> i) & 1) ? a : b) & (0xFFUL << (i * 8));
+    }
+    return r;
+}
+
+__STATIC_FORCEINLINE uint32_t __UQADD8(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i += 8) {
+        int s = ((a >> i) & 0xFF) + ((b >> i) & 0xFF);
+        r |= ((s > 0xFF) ? 0xFF : s) << i;
+    }
+    return r;
+}
+
+__STATIC_FORCEINLINE uint32_t __UQSUB8(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i += 8) {
+        int d = ((a >> i) & 0xFF) - ((b >> i) & 0xFF);
+        r |= ((d < 0) ? 0 : d) << i;
+    }
+    return r;
+}
+
+__STATIC_FORCEINLINE uint32_t __UHADD8(uint32_t a, uint32_t b)
+{
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i += 8) {
+        r |= ((((a >> i) & 0xFF) + ((b >> i) & 0xFF)) >> 1) << i;
+    }
+    return r;
+}
+
+// CMSIS-DSP
+typedef struct {
+    uint16_t fftLen;
+} arm_cfft_instance_f32;
+
+float32_t arm_sin_f32(float32_t x);
+float32_t arm_cos_f32(float32_t x);
+// In-place interleaved complex FFT, the inverse is scaled by 1/fftLen like CMSIS-DSP.
+void arm_cfft_f32(const arm_cfft_instance_f32 *S, float32_t *p1, uint8_t ifftFlag, uint8_t bitReverseFlag);
+
+#endif // __HOST_ARM_MATH_H__
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build FatFS shim, files are stdio streams.
+ */
+#ifndef __HOST_FF_H__
+#define __HOST_FF_H__
+#include <stdio.h>
+#include <stdint.h>
+
+typedef unsigned int    UINT;
+typedef unsigned char   BYTE;
+typedef uint16_t        WORD;
+typedef uint32_t        DWORD;
+typedef uint64_t        QWORD;
+typedef char            TCHAR;
+typedef DWORD           FSIZE_t;
+
+typedef enum {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+    FR_DENIED,
+    FR_EXIST,
+    FR_INVALID_OBJECT,
+    FR_WRITE_PROTECTED,
+    FR_INVALID_DRIVE,
+    FR_NOT_ENABLED,
+    FR_NO_FILESYSTEM,
+    FR_MKFS_ABORTED,
+    FR_TIMEOUT,
+    FR_LOCKED,
+    FR_NOT_ENOUGH_CORE,
+    FR_TOO_MANY_OPEN_FILES,
+    FR_INVALID_PARAMETER
+} FRESULT;
+
+#define FA_READ             0x01
+#define FA_WRITE            0x02
+#define FA_OPEN_EXISTING    0x00
+#define FA_CREATE_NEW       0x04
+#define FA_CREATE_ALWAYS    0x08
+#define FA_OPEN_ALWAYS      0x10
+#define FA_OPEN_APPEND      0x30
+
+typedef struct {
+    FILE *file;
+    BYTE flag;
+    FSIZE_t fptr;
+    FSIZE_t objsize;
+} FIL;
+
+typedef struct {
+    FSIZE_t fsize;
+    TCHAR fname[256];
+} FILINFO;
+
+typedef struct {
+    void *dir;
+} FF_DIR;
+
+#define f_size(fp)  ((fp)->objsize)
+#define f_tell(fp)  ((fp)->fptr)
+#define f_eof(fp)   ((int) ((fp)->fptr == (fp)->objsize))
+
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_truncate(FIL *fp);
+FRESULT f_sync(FIL *fp);
+
+#endif // __HOST_FF_H__
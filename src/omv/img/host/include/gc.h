@@ -0,0 +1,29 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build GC shim, the heap never runs out.
+ */
+#ifndef __HOST_GC_H__
+#define __HOST_GC_H__
+#include <stddef.h>
+
+typedef unsigned char byte;
+
+typedef struct _gc_info_t {
+    size_t total;
+    size_t used;
+    size_t free;
+    size_t max_free;
+    size_t num_1block;
+    size_t num_2block;
+    size_t max_block;
+} gc_info_t;
+
+void gc_info(gc_info_t *info);
+void gc_collect();
+#endif // __HOST_GC_H__
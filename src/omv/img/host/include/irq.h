@@ -0,0 +1,13 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build IRQ priorities shim.
+ */
+#ifndef __HOST_IRQ_H__
+#define __HOST_IRQ_H__
+#endif // __HOST_IRQ_H__
@@ -0,0 +1,57 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build MicroPython shim, exceptions raised by imlib unwind to the benchmark runner.
+ */
+#ifndef __HOST_MP_H__
+#define __HOST_MP_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <setjmp.h>
+
+#define NORETURN            __attribute__((noreturn))
+#define MP_STACK_CHECK()
+
+typedef struct _mp_obj_type_t {
+    const char *name;
+} mp_obj_type_t;
+
+typedef struct _host_exception {
+    const mp_obj_type_t *type;
+    const char *msg;
+} host_exception_t;
+
+typedef host_exception_t *mp_obj_t;
+
+// The innermost nlr_push() context, see host_nlr_push().
+typedef struct _nlr_buf_t {
+    struct _nlr_buf_t *prev;
+    jmp_buf jmpbuf;
+    mp_obj_t ret_val;
+} nlr_buf_t;
+
+extern const mp_obj_type_t mp_type_OSError;
+extern const mp_obj_type_t mp_type_MemoryError;
+extern const mp_obj_type_t mp_type_ValueError;
+extern const mp_obj_type_t mp_type_RuntimeError;
+
+mp_obj_t mp_obj_new_exception_msg(const mp_obj_type_t *type, const char *msg);
+NORETURN void nlr_raise(mp_obj_t exc);
+void host_nlr_push(nlr_buf_t *buf);
+void nlr_pop();
+
+// The MicroPython heap is the host heap.
+void *gc_alloc(size_t n_bytes, unsigned int alloc_flags);
+void gc_free(void *ptr);
+void *gc_realloc(void *ptr, size_t n_bytes, bool allow_move);
+
+#define nlr_push(buf)   (host_nlr_push(buf), setjmp((buf)->jmpbuf))
+
+#endif // __HOST_MP_H__
@@ -0,0 +1,16 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build HAL shim.
+ */
+#ifndef __HOST_MPHAL_H__
+#define __HOST_MPHAL_H__
+#include <stdint.h>
+uint32_t mp_hal_ticks_ms();
+uint32_t mp_hal_ticks_us();
+#endif // __HOST_MPHAL_H__
@@ -0,0 +1,33 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build STM32 HAL shim (only the CMSIS core intrinsics and the DWT cycle counter are used by
+ * imlib). The cycle counter counts nanoseconds.
+ */
+#ifndef __HOST_STM32_HAL_H__
+#define __HOST_STM32_HAL_H__
+#include "arm_math.h"
+
+typedef struct {
+    uint32_t CTRL, CYCCNT, LAR;
+} host_dwt_t;
+
+typedef struct {
+    uint32_t DEMCR;
+} host_core_debug_t;
+
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+#define DWT                         (host_dwt())
+#define CoreDebug                   (&host_core_debug)
+
+extern uint32_t SystemCoreClock;
+extern host_core_debug_t host_core_debug;
+// Returns the DWT registers with CYCCNT set to the current time.
+host_dwt_t *host_dwt();
+#endif // __HOST_STM32_HAL_H__
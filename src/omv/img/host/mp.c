@@ -0,0 +1,128 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Host build MicroPython and HAL shims.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include "mp.h"
+#include "gc.h"
+#include "py/mphal.h"
+#include "stm32_hal.h"
+#include "assets.h"
+
+const mp_obj_type_t mp_type_OSError = { "OSError" };
+const mp_obj_type_t mp_type_MemoryError = { "MemoryError" };
+const mp_obj_type_t mp_type_ValueError = { "ValueError" };
+const mp_obj_type_t mp_type_RuntimeError = { "RuntimeError" };
+
+static host_exception_t exception;
+static nlr_buf_t *nlr_top = NULL;
+
+mp_obj_t mp_obj_new_exception_msg(const mp_obj_type_t *type, const char *msg)
+{
+    exception.type = type;
+    exception.msg = msg;
+    return &exception;
+}
+
+void host_nlr_push(nlr_buf_t *buf)
+{
+    buf->prev = nlr_top;
+    nlr_top = buf;
+}
+
+void nlr_pop()
+{
+    nlr_top = nlr_top->prev;
+}
+
+NORETURN void nlr_raise(mp_obj_t exc)
+{
+    nlr_buf_t *top = nlr_top;
+
+    if (!top) {
+        fprintf(stderr, "Uncaught %s: %s\n", exc->type->name, exc->msg);
+        exit(1);
+    }
+
+    nlr_top = top->prev;
+    top->ret_val = exc;
+    longjmp(top->jmpbuf, 1);
+}
+
+void *gc_alloc(size_t n_bytes, unsigned int alloc_flags)
+{
+    return n_bytes ? calloc(1, n_bytes) : NULL;
+}
+
+void gc_free(void *ptr)
+{
+    free(ptr);
+}
+
+void *gc_realloc(void *ptr, size_t n_bytes, bool allow_move)
+{
+    return realloc(ptr, n_bytes);
+}
+
+void gc_info(gc_info_t *info)
+{
+    memset(info, 0, sizeof(gc_info_t));
+    info->total = info->free = info->max_free = SIZE_MAX / 2;
+}
+
+void gc_collect()
+{
+}
+
+static uint64_t ticks_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+uint32_t mp_hal_ticks_ms()
+{
+    return ticks_ns() / 1000000;
+}
+
+uint32_t mp_hal_ticks_us()
+{
+    return ticks_ns() / 1000;
+}
+
+uint32_t SystemCoreClock = 1000000000;
+host_core_debug_t host_core_debug;
+
+host_dwt_t *host_dwt()
+{
+    static host_dwt_t dwt = { .CTRL = DWT_CTRL_CYCCNTENA_Msk };
+    dwt.CYCCNT = ticks_ns();
+    return &dwt;
+}
+
+// Fixed seed, so the results are the same on every run.
+static uint32_t rng_state = 2463534242UL;
+
+uint32_t rng_randint(uint32_t min, uint32_t max)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (min == max) ? min : (min + (rng_state % (max - min + 1)));
+}
+
+bool assets_find(const char *name, const void **data, uint32_t *size)
+{
+    return false;
+}
@@ -11,9 +11,41 @@
 #include "imlib.h"
 
 #ifdef IMLIB_ENABLE_FIND_LINES
+// cos/sin pairs in Q14 packed for __SMLAD (cos in the bottom half).
+#define HOUGH_Q14_SHIFT (14)
+#define HOUGH_Q14_ROUND (1 << (HOUGH_Q14_SHIFT - 1))
+
+// Votes for the line through (x, y) (relative to the roi) normal to the gradient direction theta.
+static inline void hough_vote_theta(uint32_t *acc, uint32_t *cos_sin, int x, int y, int theta, int magnitude,
+                                    int theta_size, int r_diag_len_div, int hough_divide)
+{
+    int rho = ((((int32_t) __SMLAD(cos_sin[theta], __PKHBT(x, y, 16), HOUGH_Q14_ROUND)) >> HOUGH_Q14_SHIFT)
+               / hough_divide) + r_diag_len_div;
+    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
+
+    acc[acc_index] += magnitude;
+}
+
+// Votes for the line through (x, y) (relative to the roi) normal to the gradient. Pixels without
+// a gradient can't vote for anything so they're skipped before the atan2/sqrt.
+static inline void hough_vote(uint32_t *acc, uint32_t *cos_sin, int x, int y, int x_acc, int y_acc,
+                              int theta_size, int r_diag_len_div, int hough_divide)
+{
+    if (!(x_acc | y_acc)) {
+        return;
+    }
+
+    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
+    if (theta < 0) theta += 180;
+
+    hough_vote_theta(acc, cos_sin, x, y, theta, fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc))),
+                     theta_size, r_diag_len_div, hough_divide);
+}
+
 void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
-                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin)
+                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin, gradient_map_t *map)
 {
+    list_pool_t *pool = list_pool_alloc(sizeof(find_lines_list_lnk_data_t), 64);
     int r_diag_len, r_diag_len_div, theta_size, r_size, hough_divide = 1; // divides theta and rho accumulators
 
     for (;;) { // shrink to fit...
@@ -21,212 +53,213 @@ void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
         r_diag_len_div = (r_diag_len + hough_divide - 1) / hough_divide;
         theta_size = 1 + ((180 + hough_divide - 1) / hough_divide) + 1; // left & right padding
         r_size = (r_diag_len_div * 2) + 1; // -r_diag_len to +r_diag_len
-        if ((sizeof(uint32_t) * theta_size * r_size) <= fb_avail()) break;
+        if ((sizeof(uint32_t) * ((theta_size * r_size) + 180)) <= fb_avail()) break; // acc + cos_sin
         hough_divide = hough_divide << 1; // powers of 2...
         if (hough_divide > 4) fb_alloc_fail(); // support 1, 2, 4
     }
 
     uint32_t *acc = fb_alloc0(sizeof(uint32_t) * theta_size * r_size, FB_ALLOC_NO_HINT);
+    uint32_t *cos_sin = fb_alloc(sizeof(uint32_t) * 180, FB_ALLOC_NO_HINT);
 
-    switch (ptr->bpp) {
-        case IMAGE_BPP_BINARY: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
+    for (int i = 0; i < 180; i++) {
+        cos_sin[i] = __PKHBT(fast_roundf(cos_table[i] * (1 << HOUGH_Q14_SHIFT)),
+                             fast_roundf(sin_table[i] * (1 << HOUGH_Q14_SHIFT)), 16);
+    }
 
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+    if (map) {
+        imlib_gradient_map_update(map, ptr, roi);
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+        for (int y = 1, yy = roi->h - 1; y < yy; y += y_stride) {
+            uint16_t *magnitude_row = map->magnitude + (roi->w * y);
+            uint16_t *theta_row = map->theta + (roi->w * y);
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                                         // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+            for (int x = ((roi->y + y) % x_stride) + 1, xx = roi->w - 1; x < xx; x += x_stride) {
+                if (magnitude_row[x]) {
+                    hough_vote_theta(acc, cos_sin, x, y, theta_row[x] % 180, magnitude_row[x],
+                                     theta_size, r_diag_len_div, hough_divide);
+                }
+            }
+        }
+    } else {
+        switch (ptr->bpp) {
+            case IMAGE_BPP_BINARY: {
+                for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+                        int pixel; // Sobel Algorithm Below
+                        int x_acc = 0;
+                        int y_acc = 0;
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+                        row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[0,0] -> pixel * +1
+                        y_acc += pixel * +1; // y[0,0] -> pixel * +1
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                                             // x[0,1] -> pixel * 0
+                        y_acc += pixel * +2; // y[0,1] -> pixel * +2
 
-                    // pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[0,2] -> pixel * -1
+                        y_acc += pixel * +1; // y[0,2] -> pixel * +1
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+                        row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +2; // x[1,0] -> pixel * +2
+                                             // y[1,0] -> pixel * 0
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+                        // pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                        // x[1,1] -> pixel * 0
+                        // y[1,1] -> pixel * 0
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                                         // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -2; // x[1,2] -> pixel * -2
+                                             // y[1,2] -> pixel * 0
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+                        row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[2,0] -> pixel * +1
+                        y_acc += pixel * -1; // y[2,0] -> pixel * -1
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
-                    if (theta < 0) theta += 180;
-                    int rho = (fast_roundf(((x - roi->x) * cos_table[theta]) +
-                                ((y - roi->y) * sin_table[theta])) / hough_divide) + r_diag_len_div;
-                    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                                             // x[2,1] -> pixel * 0
+                        y_acc += pixel * -2; // y[2,1] -> pixel * -2
 
-                    int acc_value = acc[acc_index] + fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    acc[acc_index] = acc_value;
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[2,2] -> pixel * -1
+                        y_acc += pixel * -1; // y[2,2] -> pixel * -1
+
+                        row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+
+                        hough_vote(acc, cos_sin, x - roi->x, y - roi->y, x_acc, y_acc, theta_size, r_diag_len_div, hough_divide);
+                    }
                 }
+                break;
             }
-            break;
-        }
-        case IMAGE_BPP_GRAYSCALE: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
-
-                    row_ptr -= ptr->w;
+            case IMAGE_BPP_GRAYSCALE: {
+                for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+                        int pixel; // Sobel Algorithm Below
+                        int x_acc = 0;
+                        int y_acc = 0;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+                        row_ptr -= ptr->w;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                                         // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
+                        x_acc += pixel * +1; // x[0,0] -> pixel * +1
+                        y_acc += pixel * +1; // y[0,0] -> pixel * +1
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                                             // x[0,1] -> pixel * 0
+                        y_acc += pixel * +2; // y[0,1] -> pixel * +2
 
-                    row_ptr += ptr->w;
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
+                        x_acc += pixel * -1; // x[0,2] -> pixel * -1
+                        y_acc += pixel * +1; // y[0,2] -> pixel * +1
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+                        row_ptr += ptr->w;
 
-                    // pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
+                        x_acc += pixel * +2; // x[1,0] -> pixel * +2
+                                             // y[1,0] -> pixel * 0
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+                        // pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                        // x[1,1] -> pixel * 0
+                        // y[1,1] -> pixel * 0
 
-                    row_ptr += ptr->w;
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
+                        x_acc += pixel * -2; // x[1,2] -> pixel * -2
+                                             // y[1,2] -> pixel * 0
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+                        row_ptr += ptr->w;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                                         // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
+                        x_acc += pixel * +1; // x[2,0] -> pixel * +1
+                        y_acc += pixel * -1; // y[2,0] -> pixel * -1
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                                             // x[2,1] -> pixel * 0
+                        y_acc += pixel * -2; // y[2,1] -> pixel * -2
 
-                    row_ptr -= ptr->w;
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
+                        x_acc += pixel * -1; // x[2,2] -> pixel * -1
+                        y_acc += pixel * -1; // y[2,2] -> pixel * -1
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
-                    if (theta < 0) theta += 180;
-                    int rho = (fast_roundf(((x - roi->x) * cos_table[theta])
-                                + ((y - roi->y) * sin_table[theta])) / hough_divide) + r_diag_len_div;
-                    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
+                        row_ptr -= ptr->w;
 
-                    int acc_value = acc[acc_index] + fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    acc[acc_index] = acc_value;
+                        hough_vote(acc, cos_sin, x - roi->x, y - roi->y, x_acc, y_acc, theta_size, r_diag_len_div, hough_divide);
+                    }
                 }
+                break;
             }
-            break;
-        }
-        case IMAGE_BPP_RGB565: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
+            case IMAGE_BPP_RGB565: {
+                for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+                        int pixel; // Sobel Algorithm Below
+                        int x_acc = 0;
+                        int y_acc = 0;
 
-                    row_ptr -= ptr->w;
+                        row_ptr -= ptr->w;
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[0,0] -> pixel * +1
+                        y_acc += pixel * +1; // y[0,0] -> pixel * +1
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                                         // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                                             // x[0,1] -> pixel * 0
+                        y_acc += pixel * +2; // y[0,1] -> pixel * +2
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[0,2] -> pixel * -1
+                        y_acc += pixel * +1; // y[0,2] -> pixel * +1
 
-                    row_ptr += ptr->w;
+                        row_ptr += ptr->w;
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +2; // x[1,0] -> pixel * +2
+                                             // y[1,0] -> pixel * 0
 
-                    // pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+                        // pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                        // x[1,1] -> pixel * 0
+                        // y[1,1] -> pixel * 0
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -2; // x[1,2] -> pixel * -2
+                                             // y[1,2] -> pixel * 0
 
-                    row_ptr += ptr->w;
+                        row_ptr += ptr->w;
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[2,0] -> pixel * +1
+                        y_acc += pixel * -1; // y[2,0] -> pixel * -1
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                                         // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                                             // x[2,1] -> pixel * 0
+                        y_acc += pixel * -2; // y[2,1] -> pixel * -2
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[2,2] -> pixel * -1
+                        y_acc += pixel * -1; // y[2,2] -> pixel * -1
 
-                    row_ptr -= ptr->w;
+                        row_ptr -= ptr->w;
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
-                    if (theta < 0) theta += 180;
-                    int rho = (fast_roundf(((x - roi->x) * cos_table[theta])
-                                + ((y - roi->y) * sin_table[theta])) / hough_divide) + r_diag_len_div;
-                    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
-
-                    int acc_value = acc[acc_index] + fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    acc[acc_index] = acc_value;
+                        hough_vote(acc, cos_sin, x - roi->x, y - roi->y, x_acc, y_acc, theta_size, r_diag_len_div, hough_divide);
+                    }
                 }
+                break;
+            }
+            default: {
+                break;
             }
-            break;
-        }
-        default: {
-            break;
         }
     }
 
-    list_init(out, sizeof(find_lines_list_lnk_data_t));
+    list_init_pool(out, sizeof(find_lines_list_lnk_data_t), pool);
 
     for (int y = 1, yy = r_size - 1; y < yy; y++) {
         uint32_t *row_ptr = acc + (theta_size * y);
@@ -254,13 +287,14 @@ void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
         }
     }
 
+    fb_free(); // cos_sin
     fb_free(); // acc
 
     for (;;) { // Merge overlapping.
         bool merge_occured = false;
 
         list_t out_temp;
-        list_init(&out_temp, sizeof(find_lines_list_lnk_data_t));
+        list_init_pool(&out_temp, sizeof(find_lines_list_lnk_data_t), pool);
 
         while (list_size(out)) {
             find_lines_list_lnk_data_t lnk_line;
@@ -366,7 +400,7 @@ void imlib_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsig
     const unsigned int max_gap_pixels = 5;
 
     list_t temp_out;
-    imlib_find_lines(&temp_out, ptr, roi, x_stride, y_stride, threshold, theta_margin, rho_margin);
+    imlib_find_lines(&temp_out, ptr, roi, x_stride, y_stride, threshold, theta_margin, rho_margin, NULL);
     list_init(out, sizeof(find_lines_list_lnk_data_t));
 
     const int r_diag_len = fast_roundf(fast_sqrtf((roi->w * roi->w) + (roi->h * roi->h))) * 2;
@@ -457,217 +491,391 @@ void imlib_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsig
 #endif //IMLIB_ENABLE_FIND_LINE_SEGMENTS
 
 #ifdef IMLIB_ENABLE_FIND_CIRCLES
+// Two stage search: every edge votes for the centers along its gradient line between r_min and
+// r_max in one 2D accumulator, then the radius of each center peak comes from a histogram of the
+// distances of the edges whose gradient line passes through it. Memory doesn't depend on the
+// radius range and every edge is only visited once in the first stage.
+#define CIRCLES_Q16_SHIFT (16)
+#define CIRCLES_LINE_DIST (1.0f) // Max distance of a center from the gradient line of an edge...
+#define CIRCLES_LINE_SLOPE (0.05f) // ...plus ~3 degrees of gradient direction error.
+
+static void find_circles_two_stage(list_t *out, rectangle_t *roi, uint16_t *theta_acc, uint16_t *magnitude_acc,
+                                   uint32_t threshold, int r_min, int r_max, int r_step)
+{
+    int r_count = (r_max - r_min + r_step - 1) / r_step;
+    if (r_count <= 0) return;
+
+    int a_size, b_size, hough_divide = 1; // divides a and b accumulators
+    int hough_shift = 0;
+
+    for (;;) { // shrink to fit...
+        a_size = 1 + ((roi->w + hough_divide - 1) / hough_divide) + 1; // left & right padding
+        b_size = 1 + ((roi->h + hough_divide - 1) / hough_divide) + 1; // top & bottom padding
+        if ((sizeof(uint32_t) * ((a_size * b_size) + (a_size * 2) + r_count + 1)) <= fb_avail()) break; // acc + row_buf + r_acc
+        hough_divide = hough_divide << 1; // powers of 2...
+        hough_shift++;
+        if (hough_divide > 4) fb_alloc_fail(); // support 1, 2, 4
+    }
+
+    uint32_t *acc = fb_alloc0(sizeof(uint32_t) * a_size * b_size, FB_ALLOC_NO_HINT);
+    uint32_t *r_acc = fb_alloc(sizeof(uint32_t) * (r_count + 1), FB_ALLOC_NO_HINT);
+
+    for (int y = 0, yy = roi->h; y < yy; y++) {
+        for (int x = 0, xx = roi->w; x < xx; x++) {
+            int index = (roi->w * y) + x;
+            int theta = theta_acc[index];
+            int magnitude = magnitude_acc[index];
+            if (!magnitude) continue;
+
+            int c = fast_roundf(cos_table[theta] * (1 << CIRCLES_Q16_SHIFT));
+            int s = fast_roundf(sin_table[theta] * (1 << CIRCLES_Q16_SHIFT));
+
+            // The gradient may be pointing inside or outside the circle so both directions are voted.
+            for (int dir = 1; dir >= -1; dir -= 2) {
+                int a = (x << CIRCLES_Q16_SHIFT) + (dir * r_min * c) + (1 << (CIRCLES_Q16_SHIFT - 1));
+                int b = (y << CIRCLES_Q16_SHIFT) + (dir * r_min * s) + (1 << (CIRCLES_Q16_SHIFT - 1));
+
+                // The distance to the roi edges only shrinks with r so the first circle that doesn't
+                // fit ends the line.
+                for (int i = 0, r = r_min; i < r_count; i++, r += r_step,
+                     a += dir * r_step * c, b += dir * r_step * s) {
+                    int ca = a >> CIRCLES_Q16_SHIFT, cb = b >> CIRCLES_Q16_SHIFT;
+                    if ((ca < r) || ((roi->w - r) <= ca) || (cb < r) || ((roi->h - r) <= cb)) break;
+                    acc[(((cb >> hough_shift) + 1) * a_size) + ((ca >> hough_shift) + 1)] += magnitude; // add offset
+                }
+            }
+        }
+    }
+
+    // The votes of a circle spread over a few pixels (the edges are pixelated), so the centers are
+    // found on the 3x3 sums of the accumulator.
+    uint32_t *row_buf = fb_alloc(sizeof(uint32_t) * a_size * 2, FB_ALLOC_NO_HINT);
+    uint32_t *prev_row = row_buf, *this_row = row_buf + a_size;
+    memset(prev_row, 0, sizeof(uint32_t) * a_size);
+
+    for (int y = 1, yy = b_size - 1; y < yy; y++) {
+        uint32_t *row_ptr = acc + (a_size * y);
+        memcpy(this_row, row_ptr, sizeof(uint32_t) * a_size);
+
+        for (int x = 1, xx = a_size - 1; x < xx; x++) {
+            row_ptr[x] = prev_row[x] + this_row[x] + row_ptr[x + a_size];
+        }
+
+        uint32_t *tmp = prev_row;
+        prev_row = this_row;
+        this_row = tmp;
+    }
+
+    for (int y = 1, yy = b_size - 1; y < yy; y++) {
+        uint32_t *row_ptr = acc + (a_size * y);
+        uint32_t prev = 0;
+
+        for (int x = 1, xx = a_size - 1; x < xx; x++) {
+            uint32_t val = row_ptr[x];
+            row_ptr[x] = prev + val + row_ptr[x + 1];
+            prev = val;
+        }
+    }
+
+    fb_free(); // row_buf
+
+    for (int y = 1, yy = b_size - 1; y < yy; y++) {
+        uint32_t *row_ptr = acc + (a_size * y);
+        for (int x = 1, xx = a_size - 1; x < xx; x++) {
+            uint32_t val = row_ptr[x];
+            // Strict on one side so that flat runs (the votes of straight edges) only give one peak.
+            if ((val >= threshold)
+            &&  (val > row_ptr[x-a_size-1])
+            &&  (val > row_ptr[x-a_size])
+            &&  (val > row_ptr[x-a_size+1])
+            &&  (val > row_ptr[x-1])
+            &&  (val >= row_ptr[x+1])
+            &&  (val >= row_ptr[x+a_size-1])
+            &&  (val >= row_ptr[x+a_size])
+            &&  (val >= row_ptr[x+a_size+1])) {
+                int ca = ((x - 1) << hough_shift) + (hough_divide / 2); // remove offset
+                int cb = ((y - 1) << hough_shift) + (hough_divide / 2); // remove offset
+                memset(r_acc, 0, sizeof(uint32_t) * (r_count + 1));
+
+                for (int j = IM_MAX(cb - r_max, 0), jj = IM_MIN(cb + r_max, roi->h - 1); j <= jj; j++) {
+                    for (int i = IM_MAX(ca - r_max, 0), ii = IM_MIN(ca + r_max, roi->w - 1); i <= ii; i++) {
+                        int index = (roi->w * j) + i;
+                        int magnitude = magnitude_acc[index];
+                        if (!magnitude) continue;
+
+                        int theta = theta_acc[index];
+                        float dx = ca - i, dy = cb - j;
+                        float dist = fast_sqrtf((dx * dx) + (dy * dy));
+                        float line_dist = (CIRCLES_LINE_DIST * hough_divide) + (CIRCLES_LINE_SLOPE * dist);
+                        if (fast_fabsf((dx * sin_table[theta]) - (dy * cos_table[theta])) > line_dist) continue;
+
+                        // Split between the two closest radii so that edges between radii aren't lost.
+                        float pos = (dist - r_min) / r_step;
+                        if ((pos < 0) || (r_count <= pos)) continue;
+                        int k = fast_floorf(pos);
+                        int w = fast_roundf((pos - k) * 256);
+                        r_acc[k] += (magnitude * (256 - w)) >> 8;
+                        r_acc[k + 1] += (magnitude * w) >> 8;
+                    }
+                }
+
+                int best = -1;
+                for (int k = 0; k < r_count; k++) {
+                    int r = r_min + (k * r_step);
+                    if ((ca < r) || ((roi->w - r) <= ca) || (cb < r) || ((roi->h - r) <= cb)) break;
+                    if ((r_acc[k] >= threshold) && ((best < 0) || (r_acc[k] > r_acc[best]))) best = k;
+                }
+
+                if (best >= 0) {
+                    find_circles_list_lnk_data_t lnk_data;
+                    lnk_data.magnitude = IM_MIN(r_acc[best], UINT16_MAX);
+                    lnk_data.p.x = ca + roi->x;
+                    lnk_data.p.y = cb + roi->y;
+                    lnk_data.r = r_min + (best * r_step);
+                    list_push_back(out, &lnk_data);
+                }
+
+                if (val > row_ptr[x+1])
+                   x++; // can skip the next pixel
+            }
+        }
+    }
+
+    fb_free(); // r_acc
+    fb_free(); // acc
+}
+
 void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
                         uint32_t threshold, unsigned int x_margin, unsigned int y_margin, unsigned int r_margin,
-                        unsigned int r_min, unsigned int r_max, unsigned int r_step)
+                        unsigned int r_min, unsigned int r_max, unsigned int r_step, bool two_stage,
+                        gradient_map_t *map)
 {
-    uint16_t *theta_acc = fb_alloc0(sizeof(uint16_t) * roi->w * roi->h, FB_ALLOC_NO_HINT);
-    uint16_t *magnitude_acc = fb_alloc0(sizeof(uint16_t) * roi->w * roi->h, FB_ALLOC_NO_HINT);
+    list_pool_t *pool = list_pool_alloc(sizeof(find_circles_list_lnk_data_t), 64);
+
+    if (map) {
+        imlib_gradient_map_update(map, ptr, roi);
+    }
 
-    switch (ptr->bpp) {
-        case IMAGE_BPP_BINARY: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
+    // The map is used in place when every pixel is sampled.
+    bool use_map = map && (x_stride == 1) && (y_stride == 1);
+    uint16_t *theta_acc = use_map ? map->theta : fb_alloc0(sizeof(uint16_t) * roi->w * roi->h, FB_ALLOC_NO_HINT);
+    uint16_t *magnitude_acc = use_map ? map->magnitude : fb_alloc0(sizeof(uint16_t) * roi->w * roi->h, FB_ALLOC_NO_HINT);
 
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+    if (map) {
+        // Only the pixels the strides select vote, like without a map.
+        for (int y = 1, yy = roi->h - 1; (!use_map) && (y < yy); y += y_stride) {
+            for (int x = ((roi->y + y) % x_stride) + 1, xx = roi->w - 1; x < xx; x += x_stride) {
+                int index = (roi->w * y) + x;
+                theta_acc[index] = map->theta[index];
+                magnitude_acc[index] = map->magnitude[index];
+            }
+        }
+    } else {
+        switch (ptr->bpp) {
+            case IMAGE_BPP_BINARY: {
+                for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+                        int pixel; // Sobel Algorithm Below
+                        int x_acc = 0;
+                        int y_acc = 0;
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+                        row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                                         // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[0,0] -> pixel * +1
+                        y_acc += pixel * +1; // y[0,0] -> pixel * +1
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                                             // x[0,1] -> pixel * 0
+                        y_acc += pixel * +2; // y[0,1] -> pixel * +2
 
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[0,2] -> pixel * -1
+                        y_acc += pixel * +1; // y[0,2] -> pixel * +1
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+                        row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    // pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +2; // x[1,0] -> pixel * +2
+                                             // y[1,0] -> pixel * 0
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+                        // pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                        // x[1,1] -> pixel * 0
+                        // y[1,1] -> pixel * 0
 
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -2; // x[1,2] -> pixel * -2
+                                             // y[1,2] -> pixel * 0
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+                        row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                                         // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[2,0] -> pixel * +1
+                        y_acc += pixel * -1; // y[2,0] -> pixel * -1
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                                             // x[2,1] -> pixel * 0
+                        y_acc += pixel * -2; // y[2,1] -> pixel * -2
 
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+                        pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[2,2] -> pixel * -1
+                        y_acc += pixel * -1; // y[2,2] -> pixel * -1
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
-                    if (theta < 0) theta += 360;
-                    int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    int index = (roi->w * (y - roi->y)) + (x - roi->x);
+                        row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
 
-                    theta_acc[index] = theta;
-                    magnitude_acc[index] = magnitude;
+                        int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
+                        if (theta < 0) theta += 360;
+                        int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
+                        int index = (roi->w * (y - roi->y)) + (x - roi->x);
+
+                        theta_acc[index] = theta;
+                        magnitude_acc[index] = magnitude;
+                    }
                 }
+                break;
             }
-            break;
-        }
-        case IMAGE_BPP_GRAYSCALE: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
+            case IMAGE_BPP_GRAYSCALE: {
+                for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+                        int pixel; // Sobel Algorithm Below
+                        int x_acc = 0;
+                        int y_acc = 0;
 
-                    row_ptr -= ptr->w;
+                        row_ptr -= ptr->w;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
+                        x_acc += pixel * +1; // x[0,0] -> pixel * +1
+                        y_acc += pixel * +1; // y[0,0] -> pixel * +1
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                                         // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                                             // x[0,1] -> pixel * 0
+                        y_acc += pixel * +2; // y[0,1] -> pixel * +2
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
+                        x_acc += pixel * -1; // x[0,2] -> pixel * -1
+                        y_acc += pixel * +1; // y[0,2] -> pixel * +1
 
-                    row_ptr += ptr->w;
+                        row_ptr += ptr->w;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
+                        x_acc += pixel * +2; // x[1,0] -> pixel * +2
+                                             // y[1,0] -> pixel * 0
 
-                    // pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+                        // pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                        // x[1,1] -> pixel * 0
+                        // y[1,1] -> pixel * 0
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
+                        x_acc += pixel * -2; // x[1,2] -> pixel * -2
+                                             // y[1,2] -> pixel * 0
 
-                    row_ptr += ptr->w;
+                        row_ptr += ptr->w;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
+                        x_acc += pixel * +1; // x[2,0] -> pixel * +1
+                        y_acc += pixel * -1; // y[2,0] -> pixel * -1
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                                         // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
+                                             // x[2,1] -> pixel * 0
+                        y_acc += pixel * -2; // y[2,1] -> pixel * -2
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+                        pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
+                        x_acc += pixel * -1; // x[2,2] -> pixel * -1
+                        y_acc += pixel * -1; // y[2,2] -> pixel * -1
 
-                    row_ptr -= ptr->w;
+                        row_ptr -= ptr->w;
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
-                    if (theta < 0) theta += 360;
-                    int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    int index = (roi->w * (y - roi->y)) + (x - roi->x);
+                        int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
+                        if (theta < 0) theta += 360;
+                        int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
+                        int index = (roi->w * (y - roi->y)) + (x - roi->x);
 
-                    theta_acc[index] = theta;
-                    magnitude_acc[index] = magnitude;
+                        theta_acc[index] = theta;
+                        magnitude_acc[index] = magnitude;
+                    }
                 }
+                break;
             }
-            break;
-        }
-        case IMAGE_BPP_RGB565: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
+            case IMAGE_BPP_RGB565: {
+                for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+                    for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+                        int pixel; // Sobel Algorithm Below
+                        int x_acc = 0;
+                        int y_acc = 0;
 
-                    row_ptr -= ptr->w;
+                        row_ptr -= ptr->w;
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[0,0] -> pixel * +1
+                        y_acc += pixel * +1; // y[0,0] -> pixel * +1
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                                         // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                                             // x[0,1] -> pixel * 0
+                        y_acc += pixel * +2; // y[0,1] -> pixel * +2
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[0,2] -> pixel * -1
+                        y_acc += pixel * +1; // y[0,2] -> pixel * +1
 
-                    row_ptr += ptr->w;
+                        row_ptr += ptr->w;
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +2; // x[1,0] -> pixel * +2
+                                             // y[1,0] -> pixel * 0
 
-                    // pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+                        // pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                        // x[1,1] -> pixel * 0
+                        // y[1,1] -> pixel * 0
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -2; // x[1,2] -> pixel * -2
+                                             // y[1,2] -> pixel * 0
 
-                    row_ptr += ptr->w;
+                        row_ptr += ptr->w;
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
+                        x_acc += pixel * +1; // x[2,0] -> pixel * +1
+                        y_acc += pixel * -1; // y[2,0] -> pixel * -1
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                                         // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                                             // x[2,1] -> pixel * 0
+                        y_acc += pixel * -2; // y[2,1] -> pixel * -2
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+                        pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
+                        x_acc += pixel * -1; // x[2,2] -> pixel * -1
+                        y_acc += pixel * -1; // y[2,2] -> pixel * -1
 
-                    row_ptr -= ptr->w;
+                        row_ptr -= ptr->w;
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
-                    if (theta < 0) theta += 360;
-                    int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    int index = (roi->w * (y - roi->y)) + (x - roi->x);
+                        int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
+                        if (theta < 0) theta += 360;
+                        int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
+                        int index = (roi->w * (y - roi->y)) + (x - roi->x);
 
-                    theta_acc[index] = theta;
-                    magnitude_acc[index] = magnitude;
+                        theta_acc[index] = theta;
+                        magnitude_acc[index] = magnitude;
+                    }
                 }
+                break;
+            }
+            default: {
+                break;
             }
-            break;
-        }
-        default: {
-            break;
         }
-    }
 
-    // Theta Direction (% 180)
-    //
-    // 0,0         X_MAX
-    //
-    //     090
-    // 000     000
-    //     090
-    //
-    // Y_MAX
+        // Theta Direction (% 180)
+        //
+        // 0,0         X_MAX
+        //
+        //     090
+        // 000     000
+        //     090
+        //
+        // Y_MAX
+    }
 
     // Theta Direction (% 360)
     //
@@ -679,108 +887,114 @@ void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned in
     //
     // Y_MAX
 
-    list_init(out, sizeof(find_circles_list_lnk_data_t));
-
-    for (int r = r_min, rr = r_max; r < rr; r += r_step) { // ignore r = 0/1
-        int a_size, b_size, hough_divide = 1; // divides a and b accumulators
-        int hough_shift = 0;
-        int w_size = roi->w - (2 * r);
-        int h_size = roi->h - (2 * r);
-
-        for (;;) { // shrink to fit...
-            a_size = 1 + ((w_size + hough_divide - 1) / hough_divide) + 1; // left & right padding
-            b_size = 1 + ((h_size + hough_divide - 1) / hough_divide) + 1; // top & bottom padding
-            if ((sizeof(uint32_t) * a_size * b_size) <= fb_avail()) break;
-            hough_divide = hough_divide << 1; // powers of 2...
-            hough_shift++;
-            if (hough_divide > 4) fb_alloc_fail(); // support 1, 2, 4
-        }
+    list_init_pool(out, sizeof(find_circles_list_lnk_data_t), pool);
+
+    if (two_stage) {
+        find_circles_two_stage(out, roi, theta_acc, magnitude_acc, threshold, r_min, r_max, r_step);
+    } else {
+        for (int r = r_min, rr = r_max; r < rr; r += r_step) { // ignore r = 0/1
+            int a_size, b_size, hough_divide = 1; // divides a and b accumulators
+            int hough_shift = 0;
+            int w_size = roi->w - (2 * r);
+            int h_size = roi->h - (2 * r);
+
+            for (;;) { // shrink to fit...
+                a_size = 1 + ((w_size + hough_divide - 1) / hough_divide) + 1; // left & right padding
+                b_size = 1 + ((h_size + hough_divide - 1) / hough_divide) + 1; // top & bottom padding
+                if ((sizeof(uint32_t) * a_size * b_size) <= fb_avail()) break;
+                hough_divide = hough_divide << 1; // powers of 2...
+                hough_shift++;
+                if (hough_divide > 4) fb_alloc_fail(); // support 1, 2, 4
+            }
 
-        uint32_t *acc = fb_alloc0(sizeof(uint32_t) * a_size * b_size, FB_ALLOC_NO_HINT);
-        int16_t *rcos = fb_alloc(sizeof(int16_t)*360, FB_ALLOC_NO_HINT);
-        int16_t *rsin = fb_alloc(sizeof(int16_t)*360, FB_ALLOC_NO_HINT);
-        for (int i=0; i<360; i++)
-        {
-            rcos[i] = (int16_t)roundf(r * cos_table[i]);
-            rsin[i] = (int16_t)roundf(r * sin_table[i]);
-        }
+            uint32_t *acc = fb_alloc0(sizeof(uint32_t) * a_size * b_size, FB_ALLOC_NO_HINT);
+            int16_t *rcos = fb_alloc(sizeof(int16_t)*360, FB_ALLOC_NO_HINT);
+            int16_t *rsin = fb_alloc(sizeof(int16_t)*360, FB_ALLOC_NO_HINT);
+            for (int i=0; i<360; i++)
+            {
+                rcos[i] = (int16_t)roundf(r * cos_table[i]);
+                rsin[i] = (int16_t)roundf(r * sin_table[i]);
+            }
 
-        for (int y = 0, yy = roi->h; y < yy; y++) {
-            for (int x = 0, xx = roi->w; x < xx; x++) {
-                int index = (roi->w * y) + x;
-                int theta = theta_acc[index];
-                int magnitude = magnitude_acc[index];
-                if (!magnitude) continue;
-
-                // We have to do the below step twice because the gradient may be pointing inside or outside the circle.
-                // Only graidents pointing inside of the circle sum up to produce a large magnitude.
-                for (;;) { // Hi to lo edge direction
-                    int a = x + rcos[theta] - r;
-                    if ((a < 0) || (w_size <= a)) break; // circle doesn't fit in the window
-                    int b = y + rsin[theta] - r;
-                    if ((b < 0) || (h_size <= b)) break; // circle doesn't fit in the window
-                    int acc_index = (((b >> hough_shift) + 1) * a_size) + ((a >> hough_shift) + 1); // add offset
-
-                    int acc_value = acc[acc_index] += magnitude;
-                    acc[acc_index] = acc_value;
-                    break;
-                }
+            for (int y = 0, yy = roi->h; y < yy; y++) {
+                for (int x = 0, xx = roi->w; x < xx; x++) {
+                    int index = (roi->w * y) + x;
+                    int theta = theta_acc[index];
+                    int magnitude = magnitude_acc[index];
+                    if (!magnitude) continue;
+
+                    // We have to do the below step twice because the gradient may be pointing inside or outside the circle.
+                    // Only graidents pointing inside of the circle sum up to produce a large magnitude.
+                    for (;;) { // Hi to lo edge direction
+                        int a = x + rcos[theta] - r;
+                        if ((a < 0) || (w_size <= a)) break; // circle doesn't fit in the window
+                        int b = y + rsin[theta] - r;
+                        if ((b < 0) || (h_size <= b)) break; // circle doesn't fit in the window
+                        int acc_index = (((b >> hough_shift) + 1) * a_size) + ((a >> hough_shift) + 1); // add offset
+
+                        int acc_value = acc[acc_index] += magnitude;
+                        acc[acc_index] = acc_value;
+                        break;
+                    }
 
-                for (;;) { // Lo to hi edge direction
-                    int a = x - rcos[theta] - r;
-                    if ((a < 0) || (w_size <= a)) break; // circle doesn't fit in the window
-                    int b = y - rsin[theta] - r;
-                    if ((b < 0) || (h_size <= b)) break; // circle doesn't fit in the window
-                    int acc_index = (((b >> hough_shift) + 1) * a_size) + ((a >> hough_shift) + 1); // add offset
+                    for (;;) { // Lo to hi edge direction
+                        int a = x - rcos[theta] - r;
+                        if ((a < 0) || (w_size <= a)) break; // circle doesn't fit in the window
+                        int b = y - rsin[theta] - r;
+                        if ((b < 0) || (h_size <= b)) break; // circle doesn't fit in the window
+                        int acc_index = (((b >> hough_shift) + 1) * a_size) + ((a >> hough_shift) + 1); // add offset
 
-                    int acc_value = acc[acc_index] += magnitude;
-                    acc[acc_index] = acc_value;
-                    break;
+                        int acc_value = acc[acc_index] += magnitude;
+                        acc[acc_index] = acc_value;
+                        break;
+                    }
                 }
             }
-        }
-
-        for (int y = 1, yy = b_size - 1; y < yy; y++) {
-            uint32_t *row_ptr = acc + (a_size * y);
-            uint32_t val;
-            for (int x = 1, xx = a_size - 1; x < xx; x++) {
-                val = row_ptr[x];
-                if ((val >= threshold)
-                &&  (val >= row_ptr[x-a_size-1])
-                &&  (val >= row_ptr[x-a_size])
-                &&  (val >= row_ptr[x-a_size+1])
-                &&  (val >= row_ptr[x-1])
-                &&  (val >= row_ptr[x+1])
-                &&  (val >= row_ptr[x+a_size-1])
-                &&  (val >= row_ptr[x+a_size])
-                &&  (val >= row_ptr[x+a_size+1])) {
 
-                    find_circles_list_lnk_data_t lnk_data;
-                    lnk_data.magnitude = val;
-                    lnk_data.p.x = ((x - 1) << hough_shift) + r + roi->x; // remove offset
-                    lnk_data.p.y = ((y - 1) << hough_shift) + r + roi->y; // remove offset
-                    lnk_data.r = r;
-
-                    list_push_back(out, &lnk_data);
-                    if (val > row_ptr[x+1])
-                       x++; // can skip the next pixel
+            for (int y = 1, yy = b_size - 1; y < yy; y++) {
+                uint32_t *row_ptr = acc + (a_size * y);
+                uint32_t val;
+                for (int x = 1, xx = a_size - 1; x < xx; x++) {
+                    val = row_ptr[x];
+                    if ((val >= threshold)
+                    &&  (val >= row_ptr[x-a_size-1])
+                    &&  (val >= row_ptr[x-a_size])
+                    &&  (val >= row_ptr[x-a_size+1])
+                    &&  (val >= row_ptr[x-1])
+                    &&  (val >= row_ptr[x+1])
+                    &&  (val >= row_ptr[x+a_size-1])
+                    &&  (val >= row_ptr[x+a_size])
+                    &&  (val >= row_ptr[x+a_size+1])) {
+
+                        find_circles_list_lnk_data_t lnk_data;
+                        lnk_data.magnitude = val;
+                        lnk_data.p.x = ((x - 1) << hough_shift) + r + roi->x; // remove offset
+                        lnk_data.p.y = ((y - 1) << hough_shift) + r + roi->y; // remove offset
+                        lnk_data.r = r;
+
+                        list_push_back(out, &lnk_data);
+                        if (val > row_ptr[x+1])
+                           x++; // can skip the next pixel
+                    }
                 }
             }
-        }
 
-        fb_free(); // rsin
-        fb_free(); // rcos
-        fb_free(); // acc
+            fb_free(); // rsin
+            fb_free(); // rcos
+            fb_free(); // acc
+        }
     }
 
-    fb_free(); // magnitude_acc
-    fb_free(); // theta_acc
+    if (!use_map) {
+        fb_free(); // magnitude_acc
+        fb_free(); // theta_acc
+    }
 
     for (;;) { // Merge overlapping.
         bool merge_occured = false;
 
         list_t out_temp;
-        list_init(&out_temp, sizeof(find_circles_list_lnk_data_t));
+        list_init_pool(&out_temp, sizeof(find_circles_list_lnk_data_t), pool);
 
         while (list_size(out)) {
             find_circles_list_lnk_data_t lnk_data;
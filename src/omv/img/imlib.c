@@ -10,6 +10,7 @@
  */
 #include <stdlib.h>
 #include <mp.h>
+#include STM32_HAL_H
 #include "font.h"
 #include "array.h"
 #include "ff_wrapper.h"
@@ -217,6 +218,45 @@ void rectangle_united(rectangle_t *dst, rectangle_t *src)
     dst->h = bottomY - topY;
 }
 
+////////////////////
+// Deadline Stuff //
+////////////////////
+
+static uint32_t deadline_start, deadline_cycles;
+static bool deadline_truncated;
+
+void imlib_deadline_init(uint32_t budget_us)
+{
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        #if (__CORTEX_M == 7U)
+        DWT->LAR = 0xC5ACCE55;
+        #endif
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    // The cycle counter wraps around every 2^32 cycles, longer budgets are clamped to half of that.
+    uint64_t cycles = ((uint64_t) budget_us) * (SystemCoreClock / 1000000);
+    deadline_cycles = IM_MIN(cycles, (uint64_t) (UINT32_MAX / 2));
+    deadline_start = DWT->CYCCNT;
+    deadline_truncated = false;
+}
+
+bool imlib_deadline_expired()
+{
+    if ((!deadline_truncated) && deadline_cycles && ((DWT->CYCCNT - deadline_start) >= deadline_cycles)) {
+        deadline_truncated = true;
+    }
+
+    return deadline_truncated;
+}
+
+bool imlib_deadline_truncated()
+{
+    return deadline_truncated;
+}
+
 /////////////////
 // Image Stuff //
 /////////////////
@@ -255,6 +295,53 @@ size_t image_size(image_t *ptr)
     }
 }
 
+// FNV-1a over the h rows starting at row y. This is a fraction of the cost of most algorithms
+// reading these rows and catches any modification of the image (drawing, a new snapshot in the
+// same buffer, etc.) without the image having to track it. Used to validate cached maps.
+#define IMAGE_ROWS_HASH_INIT    (2166136261u)
+#define IMAGE_ROWS_HASH_PRIME   (16777619u)
+
+uint32_t image_rows_hash(image_t *ptr, int y, int h)
+{
+    size_t row_size = 0;
+
+    switch (ptr->bpp) {
+        case IMAGE_BPP_BINARY: {
+            row_size = IMAGE_BINARY_LINE_LEN_BYTES(ptr);
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            row_size = IMAGE_GRAYSCALE_LINE_LEN_BYTES(ptr);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            row_size = IMAGE_RGB565_LINE_LEN_BYTES(ptr);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+
+    uint8_t *data = ptr->data + (y * row_size);
+    uint8_t *end = data + (h * row_size);
+    uint32_t hash = IMAGE_ROWS_HASH_INIT;
+
+    for (; (data < end) && (((uintptr_t) data) & 3); data++) {
+        hash = (hash ^ *data) * IMAGE_ROWS_HASH_PRIME;
+    }
+
+    for (; (data + 4) <= end; data += 4) {
+        hash = (hash ^ *((uint32_t *) data)) * IMAGE_ROWS_HASH_PRIME;
+    }
+
+    for (; data < end; data++) {
+        hash = (hash ^ *data) * IMAGE_ROWS_HASH_PRIME;
+    }
+
+    return hash;
+}
+
 bool image_get_mask_pixel(image_t *ptr, int x, int y)
 {
     if ((0 <= x) && (x < ptr->w) && (0 <= y) && (y < ptr->h)) {
@@ -416,458 +503,6 @@ uint16_t imlib_yuv_to_rgb(uint8_t y, int8_t u, int8_t v)
     return COLOR_R8_G8_B8_TO_RGB565(r, g, b);
 }
 
-void imlib_bayer_to_rgb565(image_t *img, int w, int h, int xoffs, int yoffs, uint16_t *rgbbuf)
-{
-    int r, g, b;
-    for (int y=yoffs; y<yoffs+h; y++) {
-// The faster routine needs to start on an even column
-// and not next to the top or bottom edge to avoid boundary checks on each pixel
-    if (xoffs & 1 || y == 0 || y >= yoffs+h-1) {
-        for (int x=xoffs; x<xoffs+w; x++) {
-            if ((y % 2) == 0) { // Even row
-                if ((x % 2) == 0) { // Even col
-                    r = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x-1, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x+1, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x-1, y+1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x+1, y+1)) >> 2;
-
-                    g = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y+1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x-1, y)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x+1, y)) >> 2;
-
-                    b = IM_GET_RAW_PIXEL(img,  x, y);
-                } else { // Odd col
-                    r = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y+1)) >> 1;
-
-                    b = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x-1, y)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x+1, y)) >> 1;
-
-                    g =  IM_GET_RAW_PIXEL(img, x, y);
-                }
-            } else { // Odd row
-                if ((x % 2) == 0) { // Even Col
-                    r = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x-1, y)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x+1, y)) >> 1;
-
-                    g =  IM_GET_RAW_PIXEL(img, x, y);
-
-                    b = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y+1)) >> 1;
-                } else { // Odd col
-                    r = IM_GET_RAW_PIXEL(img,  x, y);
-
-                    g = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_Y(img, x, y+1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x-1, y)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_X(img, x+1, y)) >> 2;
-
-                    b = (IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x-1, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x+1, y-1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x-1, y+1)  +
-                         IM_GET_RAW_PIXEL_CHECK_BOUNDS_XY(img, x+1, y+1)) >> 2;
-                }
-
-            }
-            r = IM_R825(r);
-            g = IM_G826(g);
-            b = IM_B825(b);
-            *rgbbuf++ = IM_RGB565(r, g, b);
-        } // for x
-    } else { // faster way
-//
-// Theory of operation:
-// The Bayer pattern from the sensor looks like this:
-// +---+---+---+---+---+---+
-// | B | G | B | G | B | G |
-// +---+---+---+---+---+---+
-// | G |*R*|*G*| R | G | R | * = Example of current pair of pixels being processed
-// +---+---+---+---+---+---+ Each iteration below will advance 2 pixels to the right
-// | B | G | B | G | B | G |
-// +---+---+---+---+---+---+
-// | G | R | G | R | G | R |
-// +---+---+---+---+---+---+
-// Each of the color stimuli above is stored as 1 byte
-// The slower algorithm above reads each byte around the current pixel individually to
-// average the colors together to simulate the colors not present at the current pixel
-// e.g. At location 0,0, only the blue value is present; red and green must be estimated from
-// neighboring pixels
-//
-// The optimized algorithm below minimizes memory accesses by reading 2 bytes at a time
-// and re-using the last pair as it progresses from left to right. Since the ARM CPU enforces a
-// memory policy of generating an exception on unaligned reads, we read 16-bits at a time and
-// OR them into a 32-bit variable to hold on to the pixels left and right of the current pair.
-// This way we can work on 2 pixels at a time from 3 32-bit variables containing 3 lines of 4 pixels.
-// The variables l0,l1,l2 hold the 4 pixels (left, current left, current_right, right)
-// in lines above the current (l0), current (l1) and below (l2)
-// This algorithm assumes that the starting x is 0 (it doesn't have to be).
-// The starting and ending pixel are treated like absolute sensor edges, so they are less accurate
-// than the middle pixels.
-//
-        uint32_t l0,l1,l2; // 3 lines we're working with
-        uint16_t *s = (uint16_t *)&img->pixels[(y * img->w) + xoffs];
-        uint32_t r, g, b, w2 = img->w/2;
-        l0 = s[-w2]; l1 = s[0]; l2 = s[w2];
-        s++;
-// For each pixel, the R8 G8 B8 values are directly shifted into R5 G6 B5
-// to save a step when creating the RGB565 output
-        if (y & 1) { // odd lines (G R G R G R)
-            b = ((l0 & 0xff) + (l2 & 0xff)) >> 4; // left edge pixel
-            g = (l1 & 0xff) >> 2;
-            r = (l1 & 0xff00) >> 11;
-            *rgbbuf++ = IM_RGB565(r, g, b); // first col is treated differently
-            for (int x = xoffs+1; x < xoffs+w-1; x+=2) { // 'middle' pixels can use neighbors from 3x3 grid
-                l0 |= (s[-w2] << 16); // shift last pixel pairs into upper 16 bits
-                l1 |= (s[0] << 16);   // of the 3 line variables
-                l2 |= (s[w2] << 16);
-                s++; // advance source pointer one pair of pixels
-                r = (l1 & 0xff00) >> 11; // (1, 0) red pixel at current-left
-                g = (((l1 >> 16) & 0xff) + (l1 & 0xff) + ((l0 >> 8) & 0xff) + ((l2 >> 8) & 0xff)) >> 4;
-                b = ((l0 & 0xff) + (l2 & 0xff) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 5;
-                *rgbbuf++ = IM_RGB565(r, g, b);
-                g = (l1 & 0xff0000) >> 18; // (0,0) green pixel at current-right
-                b = (((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 4;
-                r = (((l1 >> 8) & 0xff) + (l1 >> 24)) >> 4;
-                *rgbbuf++ = IM_RGB565(r, g, b);
-                // prepare for the next set of source pixels
-                l0 >>= 16; l1 >>= 16; l2 >>= 16; // L-CL-CR-R becomes L-CL-0-0
-            } // for x
-            // last col
-            g = ((l0 >> 8) + (l2 >> 8)) >> 3; // re-use blue from last pixel in loop
-            r = (l1 >> 11);
-            *rgbbuf++ = IM_RGB565(r, g, b);
-        } else { // even lines (B G B G B G)
-            b = (l1 & 0xff) >> 3;
-            g = ((l0 & 0xff) + (l2 & 0xff)) >> 3;
-            r = ((l0 & 0xff00) + (l2 & 0xff00)) >> 12; // first pixel is different
-            *rgbbuf++ = IM_RGB565(r, g, b);
-            for (int x = xoffs+1; x < xoffs+w-1; x+=2) { // middle part
-                l0 |= (s[-w2] << 16); // grab 3 more pairs of pixels and put in upper 16-bits 
-                l1 |= (s[0] << 16);
-                l2 |= (s[w2] << 16);
-                s++;
-                g = (l1 & 0xff00) >> 10; // (1, 0) green pixel at current-left
-                b = ((l1 & 0xff) + ((l1 >> 16) & 0xff)) >> 4;
-                r = ((l0 & 0xff00) + (l2 & 0xff00)) >> 12;
-                *rgbbuf++ = IM_RGB565(r, g, b);
-                b = (l1 & 0xff0000) >> 19; // (0,0) blue pixel at current-right
-                g = (((l1 >> 8) & 0xff) + (l1 >> 24) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 4;
-                r = (((l0 >> 8) & 0xff) + (l0 >> 24) + ((l2 >> 8) & 0xff) + (l2 >> 24)) >> 5;
-                *rgbbuf++ = IM_RGB565(r, g, b);
-                // prepare for the next set of source pixels
-                l0 >>= 16; l1 >>= 16; l2 >>= 16; // L-CL-CR-R becomes L-CL-0-0
-            } // for x
-            // last col
-            g = (l1 >> 10); // re-use blue pixel from last column of loop
-            r = ((l0 >> 8) + (l2 >> 8)) >> 4;
-            *rgbbuf++ = IM_RGB565(r, g, b); // last pixel
-        } // even lines
-    } // faster way
-    } // for y
-}
-
-//
-// Convert a row of Bayer pixels into grayscale output
-//
-void imlib_bayer_to_y(image_t *img, int x_offset, int y_offset, int width, uint8_t *Y)
-{
-            uint16_t *s;
-            uint32_t l0, l1, l2; // current, prev and next lines of current pixel(s)
-            int x, xx, r, g, b = 0;
-            int pitch = img->w; // keep in local var
-            int w2 = pitch/2; // pitch for a uint16_t pointer
-            x = x_offset; xx = x_offset+width;
-            if (y_offset < 1 || y_offset >= img->h-1) { // top or bottom lines
-                uint8_t *s8 = (uint8_t *)&img->pixels[(y_offset * pitch) + x_offset];
-                if (y_offset & 1) { // odd line (y == img->h-1)
-                    int bLastPixel = 0;
-                    if (((x_offset+width) & 1) == 0 && x_offset+width >= img->w) { // flag to not read past the bottom-right edge
-                        xx--; // make the loop stop on an even pixel
-                        bLastPixel = 1;
-                    }
-                    if (x == 0) { // special case of starting from left edge
-                        g = s8[0];
-                        b = s8[-pitch];
-                        r = s8[1];
-                        *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        x++;
-                    } // x == 0
-                    for (; x<xx; x++) {
-                        if (x & 1) { // odd pixels
-                            g = (s8[-1] + s8[1]) >>1;
-                            r = s8[0];
-                            b = (s8[-pitch-1] + s8[-pitch+1]) >> 1;
-                        } else { // even pixels
-                            g = s8[0];
-                            b = s8[-pitch];
-                            r = (s8[-1] + s8[1]) >> 1;
-                        }
-                        *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    } // for x
-                    if (bLastPixel) { // 1 more pixel to process
-                        r = s8[0]; // on a red pixel
-                        g = (s8[-pitch] + s8[-1]) >> 1; // and re-use the previous blue
-                        *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    }
-                } else { // even line (y==0)
-                    if (x == 0) { // left edge special case
-                        b = s8[0];
-                        g = s8[pitch];
-                        r = s8[pitch+1];
-                        *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        x++;
-                    }
-                    for (; x<xx; x++) {
-                        if (x & 1) { // odd pixels
-                            b = (s8[-1] + s8[1]) >>1;
-                            g = s8[0];
-                            r = s8[pitch];
-                        } else { // even pixels
-                            b = s8[0];
-                            g = (s8[1] + s8[-1]) >> 1;
-                            r = s8[pitch];
-                        }
-                        *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    } // for x
-                } // even line
-                return;
-            } // edge case; need to check boundary conditions
-// middle of image can be converted without checking boundary conditions on each pixel
-            s = (uint16_t*)&img->pixels[(y_offset * pitch) + (x_offset & 0xfffe)];
-            if (x_offset == 0) { // don't read past left edge; repeat pixels instead
-                l0 = s[-w2] | (s[-w2] << 16); // prep current and left pixels
-                l1 = s[0] | (s[0] << 16);
-                l2 = s[w2] | (s[w2] << 16);
-            } else {
-                l0 = s[-w2-1] | (s[-w2] << 16); // prep current and left pixels
-                l1 = s[-1] | (s[0] << 16);
-                l2 = s[w2-1] | (s[w2] << 16);
-            }
-            x = x_offset; xx = x_offset+width;
-            s++;
-            if (y_offset & 1) { // odd line
-                if (x_offset & 1) // starting on an odd pixel, capture it differently
-                {
-                    r = (l1 >> 24); // (1, 0) red pixel
-                    g = ((l0 >> 24) + (l2 >> 24)) >> 1;
-                    b = ((l0 & 0xff0000) + (l2 & 0xff0000)) >> 17;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    x++; // advance to next pixel
-                }
-                for (; x<xx-1; x+=2) {
-                    g = (l1 & 0xff0000) >> 16; // (0,0) green pixel
-                    b = ((l0 & 0xff0000) + (l2 & 0xff0000)) >> 17;
-                    r = (((l1 >> 8) & 0xff) + (l1 >> 24)) >> 1;
-                    // faster to keep all calculations in integer math with 15-bit fractions
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    l0 >>= 16; l1 >>= 16; l2 >>= 16; // L-CL-CR-R becomes L-CL-0-0
-                    l0 |= (s[-w2] << 16); // grab 3 more pairs of pixels and put in upper 16-bits
-                    l1 |= (s[0] << 16);
-                    l2 |= (s[w2] << 16);
-                    s++;
-                    r = (l1 & 0xff00) >> 8; // (1, 0) red pixel
-                    g = (((l1 >> 16) & 0xff) + (l1 & 0xff) + ((l0 >> 8) & 0xff) + ((l2 >> 8) & 0xff)) >> 2;
-                    b = ((l0 & 0xff) + (l2 & 0xff) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 2;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                } // for x
-                if (x < xx) { // one final pixel to do
-                    g = (l1 >> 16) & 0xff; // (0, 0) green pixel
-                    b = ((l0 & 0xff0000) + (l2 & 0xff0000)) >> 17;
-                    r = (((l1 >> 8) & 0xff) + (l1 >> 24)) >> 1;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g
-                }
-            } else { // even line
-                if (x_offset & 1) // starting on an odd pixel, capture it differently
-                {
-                    g = (l1 >> 8) & 0xff; // (1, 0) green pixel
-                    r = (((l0 >> 8) & 0xff) + ((l2 >> 8) && 0xff)) >> 1;
-                    b = (((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 1;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    x++; // advance to next pixel
-                }
-                for (; x<xx-1; x+=2) {
-                    b = (l1 & 0xff0000) >> 16; // (0,0) blue pixel
-                    g = (((l1 >> 8) & 0xff) + (l1 >> 24) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 2;
-                    r = (((l0 >> 8) & 0xff) + (l0 >> 24) + ((l2 >> 8) & 0xff) + (l2 >> 24)) >> 2;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    // prepare for the next set of source pixels
-                    l0 >>= 16; l1 >>= 16; l2 >>= 16; // L-CL-CR-R becomes L-CL-0-0
-                    l0 |= (s[-w2] << 16); // grab 3 more pairs of pixels and put in upper 16-bits
-                    l1 |= (s[0] << 16);
-                    l2 |= (s[w2] << 16);
-                    s++;
-                    g = (l1 & 0xff00) >> 8; // (1, 0) green pixel
-                    b = ((l1 & 0xff) + ((l1 >> 16) & 0xff)) >> 1;
-                    r = ((l0 & 0xff00) + (l2 & 0xff00)) >> 9;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                } // for x
-                if (x < xx) { // one final pixel to do
-                    b = (l1 & 0xff0000) >> 16; // (0,0) blue pixel
-                    g = (((l1 >> 8) & 0xff) + (l1 >> 24) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 2;
-                    r = (((l0 >> 8) & 0xff) + (l0 >> 24) + ((l2 >> 8) & 0xff) + (l2 >> 24)) >> 2;
-                    *Y++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                }
-            } // even line
-} /* imlib_bayer_to_y() */
-//
-// Convert a row of Bayer pixels into binary output
-//
-void imlib_bayer_to_binary(image_t *img, int x_offset, int y_offset, int width, uint8_t *binary)
-{
-            uint16_t *s;
-            uint32_t l0, l1, l2; // current, prev and next lines of current pixel(s)
-            int x, xx, r, g, b = 0;
-            uint8_t pixel;
-            int pitch = img->w; // keep in local var
-            int w2 = pitch/2; // pitch for a uint16_t pointer
-            x = x_offset; xx = x_offset+width;
-            if (y_offset < 1 || y_offset >= img->h-1) { // top or bottom lines
-                uint8_t *s8 = (uint8_t *)&img->pixels[(y_offset * pitch) + x_offset];
-                if (y_offset & 1) { // odd line (y == img->h-1)
-                    int bLastPixel = 0;
-                    if (((x_offset+width) & 1) == 0 && x_offset+width >= img->w) { // flag to not read past the bottom-right edge
-                        xx--; // make the loop stop on an even pixel
-                        bLastPixel = 1;
-                    }
-                    if (x == 0) { // special case of starting from left edge
-                        g = s8[0];
-                        b = s8[-pitch];
-                        r = s8[1];
-                        pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                        x++;
-                    }
-                    for (; x<xx; x++) {
-                        if (x & 1) { // odd pixels
-                            g = (s8[-1] + s8[1]) >>1;
-                            r = s8[0];
-                            b = (s8[-pitch-1] + s8[-pitch+1]) >> 1;
-                        } else { // even pixels
-                            g = s8[0];
-                            b = s8[-pitch];
-                            r = (s8[-1] + s8[1]) >> 1;
-                        }
-                        pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    } // for x
-                    if (bLastPixel) { // 1 more pixel to process
-                        r = s8[0]; // on a red pixel
-                        g = (s8[-pitch] + s8[-1]) >> 1; // and re-use the previous blue
-                        pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    }
-                } else { // even line (y==0)
-                    if (x == 0) { // left edge special case
-                        b = s8[0];
-                        g = s8[pitch];
-                        r = s8[pitch+1];
-                        pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                        x++;
-                    }
-                    for (; x<xx; x++) {
-                        if (x & 1) { // odd pixels
-                            b = (s8[-1] + s8[1]) >>1;
-                            g = s8[0];
-                            r = s8[pitch];
-                        } else { // even pixels
-                            b = s8[0];
-                            g = (s8[1] + s8[-1]) >> 1;
-                            r = s8[pitch];
-                        }
-                        pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                        IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    } // for x
-                } // even line
-                return;
-            } // edge case; need to check boundary conditions
-// middle of image can be converted without checking boundary conditions on each pixel
-            s = (uint16_t*)&img->pixels[(y_offset * pitch) + (x_offset & 0xfffe)];
-            if (x_offset == 0) { // don't read past left edge; repeat pixels instead
-                l0 = s[-w2] | (s[-w2] << 16); // prep current and left pixels
-                l1 = s[0] | (s[0] << 16);
-                l2 = s[w2] | (s[w2] << 16);
-            } else {
-                l0 = s[-w2-1] | (s[-w2] << 16); // prep current and left pixels
-                l1 = s[-1] | (s[0] << 16);
-                l2 = s[w2-1] | (s[w2] << 16);
-            }
-            x = x_offset; xx = x_offset+width;
-            s++;
-            if (y_offset & 1) { // odd line
-                if (x_offset & 1) // starting on an odd pixel, capture it differently
-                {
-                    r = (l1 >> 24); // (1, 0) red pixel
-                    g = ((l0 >> 24) + (l2 >> 24)) >> 1;
-                    b = ((l0 & 0xff0000) + (l2 & 0xff0000)) >> 17;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    x++; // advance to next pixel
-                }
-                for (; x<xx-1; x+=2) {
-                    g = (l1 & 0xff0000) >> 16; // (0,0) green pixel
-                    b = ((l0 & 0xff0000) + (l2 & 0xff0000)) >> 17;
-                    r = (((l1 >> 8) & 0xff) + (l1 >> 24)) >> 1;
-                    // faster to keep all calculations in integer math with 15-bit fractions
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    l0 >>= 16; l1 >>= 16; l2 >>= 16; // L-CL-CR-R becomes L-CL-0-0
-                    l0 |= (s[-w2] << 16); // grab 3 more pairs of pixels and put in upper 16-bits
-                    l1 |= (s[0] << 16);
-                    l2 |= (s[w2] << 16);
-                    s++;
-                    r = (l1 & 0xff00) >> 8; // (1, 0) red pixel
-                    g = (((l1 >> 16) & 0xff) + (l1 & 0xff) + ((l0 >> 8) & 0xff) + ((l2 >> 8) & 0xff)) >> 2;
-                    b = ((l0 & 0xff) + (l2 & 0xff) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 2;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x+1, (pixel >> 7));
-                } // for x
-                if (x < xx) { // one final pixel to do
-                    g = (l1 >> 16) & 0xff; // (0, 0) green pixel
-                    b = ((l0 & 0xff0000) + (l2 & 0xff0000)) >> 17;
-                    r = (((l1 >> 8) & 0xff) + (l1 >> 24)) >> 1;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x+1, (pixel >> 7));
-                }
-            } else { // even line
-                if (x_offset & 1) // starting on an odd pixel, capture it differently
-                {
-                    g = (l1 >> 8) & 0xff; // (1, 0) green pixel
-                    r = (((l0 >> 8) & 0xff) + ((l2 >> 8) && 0xff)) >> 1;
-                    b = (((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 1;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    x++; // advance to next pixel
-                }
-                for (; x<xx-1; x+=2) {
-                    b = (l1 & 0xff0000) >> 16; // (0,0) blue pixel
-                    g = (((l1 >> 8) & 0xff) + (l1 >> 24) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 2;
-                    r = (((l0 >> 8) & 0xff) + (l0 >> 24) + ((l2 >> 8) & 0xff) + (l2 >> 24)) >> 2;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                    // prepare for the next set of source pixels
-                    l0 >>= 16; l1 >>= 16; l2 >>= 16; // L-CL-CR-R becomes L-CL-0-0
-                    l0 |= (s[-w2] << 16); // grab 3 more pairs of pixels and put in upper 16-bits
-                    l1 |= (s[0] << 16);
-                    l2 |= (s[w2] << 16);
-                    s++;
-                    g = (l1 & 0xff00) >> 8; // (1, 0) green pixel
-                    b = ((l1 & 0xff) + ((l1 >> 16) & 0xff)) >> 1;
-                    r = ((l0 & 0xff00) + (l2 & 0xff00)) >> 9;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x+1, (pixel >> 7));
-                } // for x
-                if (x < xx) { // one final pixel to do
-                    b = (l1 & 0xff0000) >> 16; // (0,0) blue pixel
-                    g = (((l1 >> 8) & 0xff) + (l1 >> 24) + ((l0 >> 16) & 0xff) + ((l2 >> 16) & 0xff)) >> 2;
-                    r = (((l0 >> 8) & 0xff) + (l0 >> 24) + ((l2 >> 8) & 0xff) + (l2 >> 24)) >> 2;
-                    pixel = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15); // .299*r + .587*g + .114*b
-                    IMAGE_PUT_BINARY_PIXEL_FAST(binary, x, (pixel >> 7));
-                }
-            } // even line
-} /* imlib_bayer_to_binary() */
-
 ////////////////////////////////////////////////////////////////////////////////
 
 static save_image_format_t imblib_parse_extension(image_t *img, const char *path)
@@ -942,11 +577,13 @@ bool imlib_read_geometry(FIL *fp, image_t *img, const char *path, img_read_setti
     ||  (magic[1]=='5') || (magic[1]=='6'))) { // PPM
         rs->format = FORMAT_PNM;
         file_read_open(fp, path);
+        file_fast_seek_on(fp);
         file_buffer_on(fp); // REMEMBER TO TURN THIS OFF LATER!
         ppm_read_geometry(fp, img, path, &rs->ppm_rs);
     } else if ((magic[0]=='B') && (magic[1]=='M')) { // BMP
         rs->format = FORMAT_BMP;
         file_read_open(fp, path);
+        file_fast_seek_on(fp);
         file_buffer_on(fp); // REMEMBER TO TURN THIS OFF LATER!
         vflipped = bmp_read_geometry(fp, img, path, &rs->bmp_rs);
     } else {
@@ -970,48 +607,80 @@ static void imlib_read_pixels(FIL *fp, image_t *img, int n_lines, img_read_setti
     }
 }
 
+void imlib_band_reader_open(img_band_reader_t *br, const char *path, uint32_t size)
+{
+    if (!size) {
+        size = fb_avail() / 2;
+    }
+
+    void *alloc = fb_alloc(size, FB_ALLOC_NO_HINT); // We have to do this before the read.
+    // The vflipped part is here because BMP files can be saved vertically
+    // flipped resulting in us reading the image backwards.
+    br->vflipped = imlib_read_geometry(&br->fp, &br->img, path, &br->rs);
+    // When reading vertically flipped images the read function will fill
+    // the band up from the bottom. The read function assumes that the
+    // band is equal to an image in size. However, since this is not the
+    // case we shrink the band size to how many lines we're buffering.
+    br->h = br->img.h;
+    br->img.pixels = alloc;
+    // Set the max band height to image height.
+    br->img.h = IM_MIN(br->h, (size / (br->img.w * br->img.bpp)));
+    br->lines = 0;
+    // This should never happen unless someone forgot to free.
+    if ((!br->img.pixels) || (!br->img.h)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError,
+                                           "Not enough memory available!"));
+    }
+}
+
+int imlib_band_reader_read(img_band_reader_t *br, int *y)
+{
+    int lines = IM_MIN(br->img.h, br->h - br->lines);
+    if (lines > 0) {
+        imlib_read_pixels(&br->fp, &br->img, lines, &br->rs);
+        *y = (!br->vflipped) ? br->lines : (br->h - br->lines - lines);
+        br->lines += lines;
+    }
+    return lines;
+}
+
+void imlib_band_reader_close(img_band_reader_t *br)
+{
+    file_buffer_off(&br->fp);
+    file_close(&br->fp);
+    fb_free();
+}
+
 void imlib_image_operation(image_t *img, const char *path, image_t *other, int scalar, line_op_t op, void *data)
 {
     if (path) {
-        uint32_t size = fb_avail() / 2;
-        void *alloc = fb_alloc(size, FB_ALLOC_NO_HINT); // We have to do this before the read.
-        // This code reads a window of an image in at a time and then executes
-        // the line operation on each line in that window before moving to the
-        // next window. The vflipped part is here because BMP files can be saved
-        // vertically flipped resulting in us reading the image backwards.
-        FIL fp;
-        image_t temp;
-        img_read_settings_t rs;
-        bool vflipped = imlib_read_geometry(&fp, &temp, path, &rs);
-        if (!IM_EQUAL(img, &temp)) {
-            ff_not_equal(&fp);
+        // This code reads a band of an image in at a time and then executes
+        // the line operation on each line in that band before moving to the
+        // next band.
+        img_band_reader_t br;
+        imlib_band_reader_open(&br, path, 0);
+        if ((img->w != br.img.w) || (img->h != br.h) || (img->bpp != br.img.bpp)) {
+            ff_not_equal(&br.fp);
         }
-        // When processing vertically flipped images the read function will fill
-        // the window up from the bottom. The read function assumes that the
-        // window is equal to an image in size. However, since this is not the
-        // case we shrink the window size to how many lines we're buffering.
-        temp.pixels = alloc;
-        // Set the max buffer height to image height.
-        temp.h = IM_MIN(img->h, (size / (temp.w * temp.bpp)));
-        // This should never happen unless someone forgot to free.
-        if ((!temp.pixels) || (!temp.h)) {
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError,
-                                               "Not enough memory available!"));
-        }
-        for (int i=0; i<img->h; i+=temp.h) { // goes past end
-            int lines = IM_MIN(temp.h, img->h-i);
-            imlib_read_pixels(&fp, &temp, lines, &rs);
+        for (int y, lines; (lines = imlib_band_reader_read(&br, &y)); ) {
             for (int j=0; j<lines; j++) {
-                if (!vflipped) {
-                    op(img, i+j, temp.pixels+(temp.w*temp.bpp*j), data, false);
-                } else {
-                    op(img, (img->h-i-lines)+j, temp.pixels+(temp.w*temp.bpp*j), data, true);
-                }
+                op(img, y+j, br.img.pixels+(br.img.w*br.img.bpp*j), data, br.vflipped);
             }
         }
-        file_buffer_off(&fp);
-        file_close(&fp);
-        fb_free();
+        imlib_band_reader_close(&br);
+#ifdef IMLIB_ENABLE_COMPRESSED_IMAGES
+    } else if (other && IMAGE_IS_COMPRESSED(other)) {
+        int bpp = (other->bpp == IMAGE_BPP_RLE_BINARY) ? IMAGE_BPP_BINARY : IMAGE_BPP_GRAYSCALE;
+        if ((img->w != other->w) || (img->h != other->h) || (img->bpp != bpp)) {
+            ff_not_equal(NULL);
+        }
+        compressed_reader_t r;
+        imlib_compressed_reader_init(&r, other);
+        for (int i=0, ii=img->h; i<ii; i++) {
+            op(img, i, imlib_compressed_reader_next(&r), data, false);
+        }
+        imlib_compressed_reader_close(&r);
+#endif
     } else if (other) {
         if (!IM_EQUAL(img, other)) {
             ff_not_equal(NULL);
@@ -20,6 +20,7 @@
 #include <math.h>
 #include <arm_math.h>
 #include <ff.h>
+#include "ff_wrapper.h"
 #include "fb_alloc.h"
 #include "umm_malloc.h"
 #include "xalloc.h"
@@ -122,6 +123,26 @@ bool rectangle_overlap(rectangle_t *ptr0, rectangle_t *ptr1);
 void rectangle_intersected(rectangle_t *dst, rectangle_t *src);
 void rectangle_united(rectangle_t *dst, rectangle_t *src);
 
+// Scored detection box for rectangle_nms(), data is left to the caller.
+typedef struct rectangle_score {
+    rectangle_t rect;
+    int index;
+    float score;
+    void *data;
+} rectangle_score_t;
+
+////////////////////
+// Deadline Stuff //
+////////////////////
+
+// Time budget of the expensive detectors. imlib_deadline_init() starts the budget (0 for none)
+// and the detectors poll imlib_deadline_expired() in their inner loops, returning what they found
+// so far once it expired. The budget is counted with the DWT cycle counter.
+void imlib_deadline_init(uint32_t budget_us);
+bool imlib_deadline_expired();
+// True if a detector stopped early since imlib_deadline_init().
+bool imlib_deadline_truncated();
+
 /////////////////
 // Color Stuff //
 /////////////////
@@ -271,6 +292,38 @@ extern const int8_t yuv_table[196608];
 #define COLOR_RGB565_TO_L(pixel) lab_table[(pixel) * 3]
 #define COLOR_RGB565_TO_A(pixel) lab_table[((pixel) * 3) + 1]
 #define COLOR_RGB565_TO_B(pixel) lab_table[((pixel) * 3) + 2]
+#elif defined(IMLIB_ENABLE_LAB_COMPACT_LUT)
+// X/Xn, Y/Yn and Z/Zn (Q15) are summed from per channel tables and f() is interpolated from
+// 1025 points. About 3KB of tables instead of 192KB, results may differ by 1 from lab_table.
+extern const uint16_t lab_compact_r_table[96];
+extern const uint16_t lab_compact_g_table[192];
+extern const uint16_t lab_compact_b_table[96];
+extern const uint16_t lab_compact_f_table[1025];
+
+#define COLOR_RGB565_TO_LAB_COMPACT_F(pixel, xyz) \
+({ \
+    __typeof__ (pixel) _lab_pixel = (pixel); \
+    int _t = IM_MIN(lab_compact_r_table[(COLOR_RGB565_TO_R5(_lab_pixel) * 3) + (xyz)] \
+                  + lab_compact_g_table[(COLOR_RGB565_TO_G6(_lab_pixel) * 3) + (xyz)] \
+                  + lab_compact_b_table[(COLOR_RGB565_TO_B5(_lab_pixel) * 3) + (xyz)], 32767); \
+    const uint16_t *_f = lab_compact_f_table + (_t >> 5); \
+    _f[0] + (((_f[1] - _f[0]) * (_t & 31)) >> 5); \
+})
+
+#define COLOR_RGB565_TO_L(pixel) \
+    ((int8_t) ((((COLOR_RGB565_TO_LAB_COMPACT_F((pixel), 1) * 116) + 16384) >> 15) - 16))
+#define COLOR_RGB565_TO_A(pixel) \
+({ \
+    __typeof__ (pixel) _lab_a_pixel = (pixel); \
+    (int8_t) ((((COLOR_RGB565_TO_LAB_COMPACT_F(_lab_a_pixel, 0) - \
+                 COLOR_RGB565_TO_LAB_COMPACT_F(_lab_a_pixel, 1)) * 500) + 16384) >> 15); \
+})
+#define COLOR_RGB565_TO_B(pixel) \
+({ \
+    __typeof__ (pixel) _lab_b_pixel = (pixel); \
+    (int8_t) ((((COLOR_RGB565_TO_LAB_COMPACT_F(_lab_b_pixel, 1) - \
+                 COLOR_RGB565_TO_LAB_COMPACT_F(_lab_b_pixel, 2)) * 200) + 16384) >> 15); \
+})
 #else
 #define COLOR_RGB565_TO_L(pixel) imlib_rgb565_to_l(pixel)
 #define COLOR_RGB565_TO_A(pixel) imlib_rgb565_to_a(pixel)
@@ -387,8 +440,21 @@ typedef struct image {
 void image_init(image_t *ptr, int w, int h, int bpp, void *data);
 void image_copy(image_t *dst, image_t *src);
 size_t image_size(image_t *ptr);
+uint32_t image_rows_hash(image_t *ptr, int y, int h);
 bool image_get_mask_pixel(image_t *ptr, int x, int y);
 
+// Lossless compressed images (see compressed.c) keep the w and h of the image with these bpps,
+// data is the compressed stream.
+#define IMAGE_BPP_RLE_BINARY        (-1)
+#define IMAGE_BPP_RICE_GRAYSCALE    (-2)
+
+#define IMAGE_IS_COMPRESSED(image) \
+({ \
+    __typeof__ (image) _image = (image); \
+    (_image->bpp == IMAGE_BPP_RLE_BINARY) || \
+    (_image->bpp == IMAGE_BPP_RICE_GRAYSCALE); \
+})
+
 #define IMAGE_IS_MUTABLE(image) \
 ({ \
     __typeof__ (image) _image = (image); \
@@ -904,20 +970,129 @@ typedef struct {
     uint32_t **swap;
 } mw_image_t;
 
-typedef struct _vector {
-    float x;
-    float y;
-    float m;
-    uint16_t cx,cy;
-} vec_t;
+// Summed area tables (modulo 2^32) of the grayscale values of an image area. Any rectangle sum, mean
+// or variance in the area is then a few lookups.
+typedef struct integral_map {
+    uint32_t *sum;          // (h + 1) x (w + 1) cumulative sums, the first row and column are 0.
+    uint32_t *sum_sq;       // Same for the squared values, NULL if not requested.
+    size_t size;            // Entries allocated per table.
+    rectangle_t roi;        // Image area the tables cover.
+} integral_map_t;
+
+typedef struct background_model {
+    int w, h;
+    bool gaussian;
+    int frames; // Frames seen since the last reset.
+    uint16_t *mean; // 8.8 fixed point.
+    uint16_t *var; // 8.8 fixed point, gaussian only.
+} background_model_t;
+
+typedef struct gamma_lut {
+    float gamma, contrast, brightness; // Settings the tables were built for.
+    uint8_t binary[COLOR_BINARY_MAX + 1];
+    uint8_t grayscale[COLOR_GRAYSCALE_MAX + 1];
+    uint8_t r5[COLOR_R5_MAX + 1];
+    uint8_t g6[COLOR_G6_MAX + 1];
+    uint8_t b5[COLOR_B5_MAX + 1];
+} gamma_lut_t;
+
+#define REMAP_GRID_SHIFT    (3) // One grid point every 8 pixels.
+
+typedef struct remap {
+    int w, h;
+    int grid_w, grid_h;
+    int32_t *grid; // Source x, y pairs in 16.16 fixed point.
+} remap_t;
+
+// A recorded chain of image ops with their arguments parsed once. Consecutive per pixel ops
+// (gamma_corr(), negate()) are fused into one pass over each row.
+#define PIPELINE_MAX_OPS    (16)
+
+typedef enum pipeline_op_type {
+    PIPELINE_OP_LENS_CORR,
+    PIPELINE_OP_GAMMA_CORR,
+    PIPELINE_OP_NEGATE,
+    PIPELINE_OP_BINARY,
+    PIPELINE_OP_ERODE,
+    PIPELINE_OP_DILATE,
+    PIPELINE_OP_MEAN,
+    PIPELINE_OP_MEDIAN,
+    PIPELINE_OP_MORPH,
+} pipeline_op_type_t;
+
+typedef struct pipeline_op {
+    pipeline_op_type_t type;
+    int ksize;
+    int threshold;          // Binary threshold of erode()/dilate(), adaptive threshold flag of the filters.
+    int offset;
+    bool invert, zero;
+    float args[4];          // lens_corr() strength/zoom/x_corr/y_corr, median() percentile, morph() mul/add.
+    int *krn;               // morph() kernel.
+    list_t thresholds;      // binary() thresholds.
+    gamma_lut_t *gamma_lut;
+    remap_t remap;          // lens_corr() source coordinates, built on the first run.
+} pipeline_op_t;
+
+typedef struct pipeline {
+    int n;
+    pipeline_op_t ops[PIPELINE_MAX_OPS];
+} pipeline_t;
+
+// Integral histograms of the LBP codes of a grayscale image sampled every cell_size pixels, the LBP
+// descriptor of any rectangle then only takes a few lookups per bin. Rebuilt when the image changes.
+typedef struct lbp_map {
+    uint16_t *hist;         // (cells_h + 1) x (cells_w + 1) cumulative histograms (modulo 2^16).
+    size_t size;            // Entries allocated.
+    int cell_size, cells_w, cells_h;
+    image_t img;            // Image the map was built from (geometry and data pointer).
+    uint32_t hash;          // Hash of the image when the map was built.
+    bool valid;
+} lbp_map_t;
+
+// Sobel gradients of an image area. find_lines() and find_circles() build it on their first call
+// and reuse it on the next calls on the same roi until the image is modified.
+typedef struct gradient_map {
+    uint16_t *magnitude;    // Rounded Sobel magnitude (0 on the roi border and for flat pixels).
+    uint16_t *theta;        // Gradient direction in degrees [0, 360).
+    size_t size;            // Pixels allocated.
+    image_t img;            // Image the map was built from (geometry and data pointer).
+    rectangle_t roi;
+    uint32_t hash;          // Hash of the roi rows of the image when the map was built.
+    bool valid;
+} gradient_map_t;
+
+// HoG cell histograms of an image area. The histograms are computed once, the 2x2 cell blocks
+// (which overlap by one cell) are only normalized when a descriptor or detector window uses them.
+#define HOG_BINS        (9)
+#define HOG_BLOCK_LEN   (HOG_BINS * 4)
+typedef struct hog_cells {
+    rectangle_t roi;
+    int cell_size;
+    int cells_w, cells_h;
+    uint32_t *hist;         // cells_w * cells_h * HOG_BINS gradient magnitude sums.
+    float *block_norm;      // (cells_w - 1) * (cells_h - 1) inverse L2 norms, < 0 until computed.
+} hog_cells_t;
+
+// Spectrum of the template area of find_displacement(), it can be computed once and reused for
+// every frame when only the translation is needed.
+typedef struct phasecorrelate_template {
+    rectangle_t roi;
+    int w_pow2, h_pow2;
+    float *spectrum;        // (1 << h_pow2) rows of (1 << w_pow2) complex values.
+} phasecorrelate_template_t;
 
 typedef struct cluster {
     int x, y, w, h;
     array_t *points;
 } cluster_t;
 
-// Return the distance between a cluster centroid and some object.
-typedef float (*cluster_dist_t)(int cx, int cy, void *obj);
+// Fixed capacity k-means result, the points are passed in as separate x and y arrays.
+#define KMEANS_MAX_K (16)
+typedef struct kmeans {
+    int k;
+    int x[KMEANS_MAX_K], y[KMEANS_MAX_K], w[KMEANS_MAX_K], h[KMEANS_MAX_K];
+    int count[KMEANS_MAX_K];
+} kmeans_t;
 
 /* Keypoint */
 typedef struct kp {
@@ -930,6 +1105,13 @@ typedef struct kp {
     uint8_t desc[32];
 } kp_t;
 
+// Corner found by fast_detect()/agast_detect() before it becomes a keypoint.
+typedef struct corner {
+    uint16_t x;
+    uint16_t y;
+    uint16_t score;
+} corner_t;
+
 typedef struct size {
     int w;
     int h;
@@ -989,7 +1171,36 @@ typedef struct img_read_settings {
     save_image_format_t format;
 } img_read_settings_t;
 
+// Reads an image file a band of lines at a time (see imlib_band_reader_open).
+typedef struct img_band_reader {
+    FIL fp;
+    image_t img; // Band geometry, pixels points to the band buffer.
+    img_read_settings_t rs;
+    bool vflipped;
+    int h; // Image height.
+    int lines; // Lines read so far.
+} img_band_reader_t;
+
 typedef void (*line_op_t)(image_t*, int, void*, void*, bool);
+
+typedef enum imlib_math_op_type {
+    IMLIB_MATH_OP_ADD,
+    IMLIB_MATH_OP_SUB,
+    IMLIB_MATH_OP_MUL,
+    IMLIB_MATH_OP_DIFFERENCE,
+    IMLIB_MATH_OP_BLEND,
+    IMLIB_MATH_OP_BINARY,
+} imlib_math_op_type_t;
+
+// One step of an imlib_math_ops() chain, the operand is other or scalar when other is NULL.
+typedef struct imlib_math_op {
+    imlib_math_op_type_t type;
+    image_t *other;
+    int scalar;
+    int alpha; // Blend weight (0-256) of the image.
+    bool invert; // Reverse sub, invert mul and binary.
+    list_t *thresholds; // Binary thresholds.
+} imlib_math_op_t;
 typedef void (*flood_fill_call_back_t)(image_t *, int, int, int, void *);
 
 typedef enum descriptor_type {
@@ -1005,8 +1216,32 @@ typedef enum edge_detector_type {
 typedef enum template_match {
     SEARCH_EX,  // Exhaustive search
     SEARCH_DS,  // Diamond search
+    SEARCH_PYR, // Coarse-to-fine pyramid search
 } template_match_t;
 
+#define TEMPLATE_PYRAMID_LEVELS 4
+
+// A template mean pooled by 2 per level with the statistics of each level, computed once and
+// reused for every frame searched. Level 0 is a copy of the template.
+typedef struct template_pyramid {
+    image_t levels[TEMPLATE_PYRAMID_LEVELS];
+    uint32_t sum[TEMPLATE_PYRAMID_LEVELS];
+    int64_t den[TEMPLATE_PYRAMID_LEVELS]; // (n * sum(t^2)) - (sum(t)^2)
+    int levels_len;
+} template_pyramid_t;
+
+#define IMAGE_PYRAMID_MAX_LEVELS    8
+#define IMAGE_PYRAMID_MIN_SIZE      8
+
+// A frame scaled down by scale per level, built once and shared by the multi-scale detectors.
+// Level 0 is the frame itself (not a copy), the levels are 2x2 box filtered when scale is 2
+// and area resampled from the level above otherwise.
+typedef struct image_pyramid {
+    image_t levels[IMAGE_PYRAMID_MAX_LEVELS];
+    float scale;
+    int levels_len;
+} image_pyramid_t;
+
 typedef enum  jpeg_subsample {
     JPEG_SUBSAMPLE_1x1 = 0x11,  // 1x1 chroma subsampling (No subsampling)
     JPEG_SUBSAMPLE_2x1 = 0x21,  // 2x2 chroma subsampling
@@ -1055,8 +1290,105 @@ typedef struct find_blobs_list_lnk_data {
     float centroid_x, centroid_y, rotation, roundness;
     uint16_t x_hist_bins_count, y_hist_bins_count, *x_hist_bins, *y_hist_bins;
     float centroid_x_acc, centroid_y_acc, rotation_acc_x, rotation_acc_y, roundness_acc;
+    uint32_t id; // Set by the blob tracker, 0 otherwise.
 } find_blobs_list_lnk_data_t;
 
+// Blob properties tested by the native find_blobs() filter.
+typedef enum find_blobs_filter_property {
+    FIND_BLOBS_FILTER_AREA,
+    FIND_BLOBS_FILTER_PIXELS,
+    FIND_BLOBS_FILTER_DENSITY,
+    FIND_BLOBS_FILTER_ELONGATION,
+    FIND_BLOBS_FILTER_ROUNDNESS,
+    FIND_BLOBS_FILTER_ROTATION,
+    FIND_BLOBS_FILTER_ASPECT_RATIO, // w / h
+    FIND_BLOBS_FILTER_SCORE, // sum of weights[i] * property i
+    FIND_BLOBS_FILTER_PROPERTIES
+} find_blobs_filter_property_t;
+
+// A blob passes when min[i] <= property i <= max[i] for each property set in mask, the chained
+// threshold_cb is only called for the blobs that passed.
+typedef struct find_blobs_filter {
+    uint32_t mask;
+    float min[FIND_BLOBS_FILTER_PROPERTIES], max[FIND_BLOBS_FILTER_PROPERTIES];
+    float weights[FIND_BLOBS_FILTER_SCORE];
+    bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*);
+    void *threshold_cb_arg;
+} find_blobs_filter_t;
+
+typedef struct blob_track {
+    rectangle_t rect;
+    float cx, cy;
+    uint32_t code, id;
+} blob_track_t;
+
+typedef struct blob_tracker {
+    blob_track_t *tracks; // Tracks of the blobs returned by the last update, in the same order.
+    size_t tracks_len, tracks_max;
+    uint32_t frames, next_id;
+    int margin, rescan;
+} blob_tracker_t;
+
+#define LK_TRACKER_MAX_LEVELS   (4)
+#define LK_TRACKER_MAX_WINDOW   (7)
+
+typedef struct lk_point {
+    float x, y;
+    float dx, dy; // Motion since the previous frame (0 for new points).
+    uint32_t id;
+} lk_point_t;
+
+typedef struct lk_tracker {
+    lk_point_t *points; // Points tracked into (or found in) the last frame.
+    size_t points_len, points_max;
+    int levels, window, cell_size;
+    uint32_t next_id;
+    image_t pyramid[LK_TRACKER_MAX_LEVELS]; // Pyramid of the last frame, in pyramid_data.
+    int pyramid_levels;
+    uint8_t *pyramid_data;
+    size_t pyramid_size;
+    bool valid;
+} lk_tracker_t;
+
+// Motion of a block_size x block_size block at (x, y) from the previous frame, the block came
+// from (x + dx, y + dy). sad is the sum of absolute differences of the match.
+typedef struct motion_vector {
+    uint16_t x, y;
+    int8_t dx, dy;
+    uint32_t sad;
+} motion_vector_t;
+
+// Decodes the rows of a compressed image in order.
+typedef struct compressed_reader {
+    image_t *img;
+    const uint8_t *buf;
+    uint32_t acc;
+    int bits, y;
+    void *line, *prev;
+} compressed_reader_t;
+
+typedef struct object_detection {
+    rectangle_t rect;
+    int32_t code; // Detections are only assigned the tracks of the same code (color, tag id, class...).
+} object_detection_t;
+
+typedef struct object_track {
+    float x, y, vx, vy; // Center and its velocity in pixels per update.
+    float w, h;
+    float p[2][3]; // Kalman covariance (p00, p01, p11) of the x and y axes.
+    int32_t code;
+    uint32_t id; // 0 until the track was confirmed.
+    uint16_t hits, misses;
+} object_track_t;
+
+typedef struct object_tracker {
+    object_track_t *tracks;
+    size_t tracks_len, tracks_max;
+    uint32_t next_id;
+    int min_hits, max_misses;
+    float iou_threshold, max_distance;
+} object_tracker_t;
+
 typedef struct find_lines_list_lnk_data {
     line_t line;
     uint32_t magnitude;
@@ -1104,6 +1436,20 @@ typedef struct find_apriltags_list_lnk_data {
     float x_rotation, y_rotation, z_rotation;
 } find_apriltags_list_lnk_data_t;
 
+typedef struct apriltag_track {
+    float p[4][2], v[4][2]; // Corners and how much they moved over the last frame.
+    uint16_t id;
+    uint8_t family;
+} apriltag_track_t;
+
+typedef struct apriltag_tracker {
+    apriltag_track_t *tracks; // Tracks of the tags returned by the last update, in the same order.
+    size_t tracks_len, tracks_max;
+    uint32_t frames;
+    int margin, rescan;
+    bool lost; // A tag was lost, the next update is a full search.
+} apriltag_tracker_t;
+
 typedef struct find_datamatrices_list_lnk_data {
     point_t corners[4];
     rectangle_t rect;
@@ -1142,11 +1488,29 @@ typedef struct find_barcodes_list_lnk_data {
     int quality;
 } find_barcodes_list_lnk_data_t;
 
+typedef struct find_hog_objects_list_lnk_data {
+    rectangle_t rect;
+    float score;
+} find_hog_objects_list_lnk_data_t;
+
 typedef enum image_hint {
     IMAGE_HINT_BILINEAR = 1,
+    IMAGE_HINT_AREA = 2,
     IMAGE_HINT_CENTER = 128
 } image_hint_t;
 
+typedef struct resample_tap {
+    uint16_t i0, i1; // Nearest: i0, bilinear: both pixels, area: first and last pixel.
+    uint16_t w; // Bilinear weight (0-256) of i1.
+} resample_tap_t;
+
+typedef struct resample {
+    image_t *src;
+    int w, h, hint;
+    bool transpose; // Output rows are source columns (90/270 degree rotation).
+    resample_tap_t *x_taps, *y_taps;
+} resample_t;
+
 
 /* Color space functions */
 int8_t imlib_rgb565_to_l(uint16_t pixel);
@@ -1160,6 +1524,9 @@ uint16_t imlib_yuv_to_rgb(uint8_t y, int8_t u, int8_t v);
 void imlib_bayer_to_rgb565(image_t *img, int w, int h, int xoffs, int yoffs, uint16_t *rgbbuf);
 void imlib_bayer_to_y(image_t *img, int x_offset, int y_offset, int width, uint8_t *Y);
 void imlib_bayer_to_binary(image_t *img, int x_offset, int y_offset, int width, uint8_t *binary);
+// Demosaics width pixels of row y to a binary, grayscale or RGB565 row, edge_aware uses Malvar-He-Cutler.
+void imlib_debayer_line(image_t *img, int x_offset, int y, int width, bool edge_aware, image_bpp_t bpp, void *dst);
+void imlib_debayer_image(image_t *dst, image_t *src, bool edge_aware);
 
 /* Image file functions */
 void ppm_read_geometry(FIL *fp, image_t *img, const char *path, ppm_read_settings_t *rs);
@@ -1171,24 +1538,47 @@ void bmp_read_pixels(FIL *fp, image_t *img, int n_lines, bmp_read_settings_t *rs
 void bmp_read(image_t *img, const char *path);
 void bmp_write_subimg(image_t *img, const char *path, rectangle_t *r);
 bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc);
+// Hardware JPEG only: decompresses src to dst (grayscale or RGB565) reduced by scale (1, 2, 4 or 8),
+// dst must be the size of src divided by scale (rounded up). Returns true on error.
+bool jpeg_decompress(image_t *src, image_t *dst, int scale);
+// Hardware JPEG only: compresses src while it's being captured, each call to jpeg_stream_band
+// feeds the encoder the MCUs of the lines captured so far, and jpeg_stream_end waits for the rest.
+bool jpeg_stream_start(image_t *src, image_t *dst, int quality);
+void jpeg_stream_band(int lines);
+bool jpeg_stream_end(image_t *dst, uint32_t timeout);
+void jpeg_stream_abort();
 void jpeg_read_geometry(FIL *fp, image_t *img, const char *path);
 void jpeg_read_pixels(FIL *fp, image_t *img);
 void jpeg_read(image_t *img, const char *path);
 void jpeg_write(image_t *img, const char *path, int quality);
 bool imlib_read_geometry(FIL *fp, image_t *img, const char *path, img_read_settings_t *rs);
+// The band buffer (size bytes, fb_avail() / 2 if 0) and the file buffer are fb_alloc'ed,
+// so nothing else can be fb_alloc'ed between open and close.
+void imlib_band_reader_open(img_band_reader_t *br, const char *path, uint32_t size);
+// Returns the number of lines read (0 when done), y is set to the image line of the first one.
+int imlib_band_reader_read(img_band_reader_t *br, int *y);
+void imlib_band_reader_close(img_band_reader_t *br);
 void imlib_image_operation(image_t *img, const char *path, image_t *other, int scalar, line_op_t op, void *data);
 void imlib_load_image(image_t *img, const char *path);
 void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality);
 
 /* GIF functions */
-void gif_open(FIL *fp, int width, int height, bool color, bool loop);
-void gif_add_frame(FIL *fp, image_t *img, uint16_t delay);
+void gif_open(FIL *fp, int width, int height, bool color, bool loop, bool diff);
+void gif_add_frame(FIL *fp, image_t *img, uint16_t delay, int decimate, uint8_t *prev);
 void gif_close(FIL *fp);
 
 /* MJPEG functions */
-void mjpeg_open(FIL *fp, int width, int height);
-void mjpeg_add_frame(FIL *fp, uint32_t *frames, uint32_t *bytes, image_t *img, int quality);
-void mjpeg_close(FIL *fp, uint32_t *frames, uint32_t *bytes, float fps);
+typedef struct mjpeg {
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t *index;        // Padded size of each frame, idx1 is built from it on close.
+    uint32_t index_size;
+    file_ring_t ring;
+} mjpeg_t;
+
+void mjpeg_open(FIL *fp, mjpeg_t *mjpeg, int width, int height, uint32_t prealloc, uint32_t buf_size);
+void mjpeg_add_frame(FIL *fp, mjpeg_t *mjpeg, image_t *img, int quality);
+void mjpeg_close(FIL *fp, mjpeg_t *mjpeg, float fps);
 
 /* Point functions */
 point_t *point_alloc(int16_t x, int16_t y);
@@ -1200,7 +1590,10 @@ rectangle_t *rectangle_alloc(int16_t x, int16_t y, int16_t w, int16_t h);
 bool rectangle_equal(rectangle_t *r1, rectangle_t *r2);
 bool rectangle_intersects(rectangle_t *r1, rectangle_t *r2);
 bool rectangle_subimg(image_t *img, rectangle_t *r, rectangle_t *r_out);
+int rectangle_cluster(rectangle_t *rects, int n, int margin, int *set, bool (*merge)(void *, int, int), void *arg);
 array_t *rectangle_merge(array_t *rectangles);
+float rectangle_iou(rectangle_t *r0, rectangle_t *r1);
+int rectangle_nms(rectangle_score_t *boxes, int n, float iou_threshold);
 void rectangle_expand(rectangle_t *r, int x, int y);
 
 /* Separable 2D convolution */
@@ -1213,11 +1606,37 @@ int imlib_image_std(image_t *src); // grayscale only
 /* Template Matching */
 void imlib_midpoint_pool(image_t *img_i, image_t *img_o, int x_div, int y_div, const int bias);
 void imlib_mean_pool(image_t *img_i, image_t *img_o, int x_div, int y_div);
+// Resampling roi of src to w x h (in the format of src), the taps are fb_alloc()ed.
+void imlib_resample_init(resample_t *r, image_t *src, rectangle_t *roi, int w, int h, int hint);
+void imlib_resample_init_rotated(resample_t *r, image_t *src, rectangle_t *roi, int w, int h, int hint, int rotation);
+void imlib_resample_line(resample_t *r, int y, void *line);
+void imlib_resample(image_t *dst, image_t *src, rectangle_t *roi, int hint);
+void imlib_decimate2(image_t *src, image_t *dst);
+// The levels after the first are stored in a buffer of imlib_image_pyramid_size() bytes owned by the caller.
+size_t imlib_image_pyramid_size(image_t *img, int levels, float scale);
+void imlib_image_pyramid_init(image_pyramid_t *pyr, image_t *img, int levels, float scale, uint8_t *buf);
+// True if the pyramid was built from img's buffer, the caller must check the buffer wasn't rewritten since.
+bool imlib_image_pyramid_of(image_pyramid_t *pyr, image_t *img);
 float imlib_template_match_ds(image_t *image, image_t *template, rectangle_t *r);
 float imlib_template_match_ex(image_t *image, image_t *template, rectangle_t *roi, int step, rectangle_t *r);
+float imlib_template_match_ex_file(image_t *image, const char *path, rectangle_t *roi, int step, rectangle_t *r);
+// The pyramid is stored in a buffer of imlib_template_pyramid_size() bytes owned by the caller.
+size_t imlib_template_pyramid_size(image_t *template);
+void imlib_template_pyramid_init(template_pyramid_t *pyr, image_t *template, uint8_t *buf);
+// f_pyr (optional) is a pyramid of image to take the levels from.
+float imlib_template_match_pyr(image_t *image, image_pyramid_t *f_pyr, template_pyramid_t *pyr, rectangle_t *roi,
+                              rectangle_t *r);
+// Diamond search block matching of the grayscale img against prev (the same size) within
+// +/-range pixels. Blocks of roi whose mean absolute difference to prev is at most threshold
+// aren't searched, vectors (one per block) gets the others. Returns the number of vectors.
+int imlib_find_motion_vectors(image_t *img, image_t *prev, rectangle_t *roi, int block_size, int range,
+                              int threshold, motion_vector_t *vectors);
 
 /* Clustering functions */
-array_t *cluster_kmeans(array_t *points, int k, cluster_dist_t dist_func);
+// labels and d2 are n entry scratch buffers owned by the caller, labels holds the cluster of each point.
+int imlib_kmeans(kmeans_t *km, const uint16_t *x, const uint16_t *y, int n, int k, int max_iter,
+                 uint8_t *labels, uint32_t *d2);
+array_t *cluster_kmeans(array_t *points, int k);
 
 /* Integral image functions */
 void imlib_integral_image_alloc(struct integral_image *sum, int w, int h);
@@ -1227,6 +1646,21 @@ void imlib_integral_image_sq(struct image *src, struct integral_image *sum);
 void imlib_integral_image_scaled(struct image *src, struct integral_image *sum);
 uint32_t imlib_integral_lookup(struct integral_image *src, int x, int y, int w, int h);
 
+// Pipeline
+void imlib_pipeline_init(pipeline_t *p);
+pipeline_op_t *imlib_pipeline_add(pipeline_t *p, pipeline_op_type_t type); // NULL if full
+void imlib_pipeline_run(pipeline_t *p, image_t *img);
+
+// Integral map
+void imlib_integral_map_alloc(integral_map_t *map);
+void imlib_integral_map_free(integral_map_t *map);
+void imlib_integral_map_update(integral_map_t *map, image_t *ptr, rectangle_t *roi, bool squared);
+// r must be inside map->roi (image coordinates).
+uint32_t imlib_integral_map_sum(integral_map_t *map, rectangle_t *r);
+uint64_t imlib_integral_map_sum_sq(integral_map_t *map, rectangle_t *r);
+float imlib_integral_map_mean(integral_map_t *map, rectangle_t *r);
+float imlib_integral_map_variance(integral_map_t *map, rectangle_t *r);
+
 // Integral moving window
 void imlib_integral_mw_alloc(mw_image_t *sum, int w, int h);
 void imlib_integral_mw_free(mw_image_t *sum);
@@ -1244,13 +1678,24 @@ int imlib_load_cascade(struct cascade* cascade, const char *path);
 array_t *imlib_detect_objects(struct image *image, struct cascade *cascade, struct rectangle *roi);
 
 /* Corner detectors */
-void fast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi);
-void agast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi);
+// When cell_size > 0 at most cell_max corners (the strongest) are kept per cell_size square.
+void fast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi, int cell_size, int cell_max);
+void agast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi, int cell_size, int cell_max);
+// Sets bit i of mask for the pixels p[i] (i < n) that pass the segment test pretest on the 4
+// compass offsets (in circular order) with threshold b.
+void corner_pretest(const uint8_t *p, int n, const int *compass, int b, uint32_t *mask);
+int corner_nonmax_suppression(corner_t *corners, int num_corners, corner_t *maxima);
+int corner_grid_select(corner_t *corners, int num_corners, rectangle_t *roi, int cell_size, int cell_max);
+void corner_push_keypoints(corner_t *corners, int num_corners, array_t *keypoints);
 
 /* ORB descriptor */
-array_t *orb_find_keypoints(image_t *image, bool normalized, int threshold,
-        float scale_factor, int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi);
-int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshold, rectangle_t *r, point_t *c, int *angle);
+// pyr (optional) is a grayscale pyramid of image used for the scales instead of scale_factor.
+array_t *orb_find_keypoints(image_t *image, image_pyramid_t *pyr, bool normalized, int threshold,
+        float scale_factor, int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi,
+        int cell_size, int cell_max);
+// radius > 0 only matches keypoints at most radius pixels apart (in x and y).
+int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshold, int radius,
+                        rectangle_t *r, point_t *c, int *angle);
 int orb_filter_keypoints(array_t *kpts, rectangle_t *r, point_t *c);
 int orb_save_descriptor(FIL *fp, array_t *kpts);
 int orb_load_descriptor(FIL *fp, array_t *kpts);
@@ -1259,6 +1704,11 @@ float orb_cluster_dist(int cx, int cy, void *kp);
 /* LBP Operator */
 uint8_t *imlib_lbp_desc(image_t *image, rectangle_t *roi);
 int imlib_lbp_desc_distance(uint8_t *d0, uint8_t *d1);
+void imlib_lbp_map_alloc(lbp_map_t *map, int cell_size);
+void imlib_lbp_map_free(lbp_map_t *map);
+void imlib_lbp_map_reset(lbp_map_t *map);
+void imlib_lbp_map_update(lbp_map_t *map, image_t *ptr);
+uint8_t *imlib_lbp_map_desc(lbp_map_t *map, rectangle_t *roi);
 int imlib_lbp_desc_save(FIL *fp, uint8_t *desc);
 int imlib_lbp_desc_load(FIL *fp, uint8_t **desc);
 
@@ -1275,6 +1725,13 @@ void imlib_edge_canny(image_t *src, rectangle_t *roi, int low_thresh, int high_t
 
 // HoG
 void imlib_find_hog(image_t *src, rectangle_t *roi, int cell_size);
+void imlib_hog_cells_init(hog_cells_t *cells, image_t *ptr, rectangle_t *roi, int cell_size);
+void imlib_hog_cells_free(hog_cells_t *cells);
+float imlib_hog_block_norm(hog_cells_t *cells, int bx, int by);
+int imlib_hog_descriptor_len(hog_cells_t *cells, int win_w, int win_h);
+void imlib_hog_descriptor(hog_cells_t *cells, int x, int y, int win_w, int win_h, float *desc);
+void imlib_find_hog_objects(list_t *out, hog_cells_t *cells, int win_w, int win_h, int stride,
+                            const float *weights, float bias, float threshold);
 
 // Helper Functions
 void imlib_zero(image_t *img, image_t *mask, bool invert);
@@ -1297,6 +1754,7 @@ void imlib_flood_fill(image_t *img, int x, int y,
                       int c, bool invert, bool clear_background, image_t *mask);
 // Binary Functions
 void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, bool zero, image_t *mask);
+void imlib_adaptive_binary(image_t *out, image_t *img, int ksize, int offset, bool invert, bool zero, image_t *mask);
 void imlib_invert(image_t *img);
 void imlib_b_and(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
 void imlib_b_nand(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
@@ -1312,6 +1770,8 @@ void imlib_top_hat(image_t *img, int ksize, int threshold, image_t *mask);
 void imlib_black_hat(image_t *img, int ksize, int threshold, image_t *mask);
 // Math Functions
 void imlib_gamma_corr(image_t *img, float gamma, float scale, float offset);
+const gamma_lut_t *imlib_gamma_lut(float gamma, float contrast, float brightness);
+void imlib_gamma_lut_line(const gamma_lut_t *lut, int bpp, void *line, int w);
 void imlib_negate(image_t *img);
 void imlib_replace(image_t *img, const char *path, image_t *other, int scalar, bool hmirror, bool vflip, bool transpose, image_t *mask);
 void imlib_add(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
@@ -1322,7 +1782,11 @@ void imlib_min(image_t *img, const char *path, image_t *other, int scalar, image
 void imlib_max(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
 void imlib_difference(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
 void imlib_blend(image_t *img, const char *path, image_t *other, int scalar, float alpha, image_t *mask);
+void imlib_math_ops(image_t *img, imlib_math_op_t *ops, int ops_len);
 // Filtering Functions
+// Minimum and maximum of the (ksize * 2 + 1)^2 windows (clipped at the edges) of a w x h plane in
+// O(1) per pixel, either output may be NULL and min may be src.
+void imlib_sliding_min_max(const uint8_t *src, int w, int h, int ksize, uint8_t *min, uint8_t *max);
 void imlib_histeq(image_t *img, image_t *mask);
 void imlib_clahe_histeq(image_t *img, float clip_limit, image_t *mask);
 void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask);
@@ -1331,11 +1795,18 @@ void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset
 void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool threshold, int offset, bool invert, image_t *mask);
 void imlib_morph(image_t *img, const int ksize, const int *krn, const float m, const int b, bool threshold, int offset, bool invert, image_t *mask);
 void imlib_bilateral_filter(image_t *img, const int ksize, float color_sigma, float space_sigma, bool threshold, int offset, bool invert, image_t *mask);
+void imlib_bilateral_grid_filter(image_t *img, const int ksize, float color_sigma, float space_sigma, bool threshold, int offset, bool invert, image_t *mask);
 void imlib_cartoon_filter(image_t *img, float seed_threshold, float floating_threshold, image_t *mask);
 // Image Correction
 void imlib_logpolar_int(image_t *dst, image_t *src, rectangle_t *roi, bool linear, bool reverse); // helper/internal
 void imlib_logpolar(image_t *img, bool linear, bool reverse);
-void imlib_remove_shadows(image_t *img, const char *path, image_t *other, int scalar, bool single);
+// update blends the shadow free image into other (0-256), difference replaces img with |img - other|.
+void imlib_remove_shadows(image_t *img, const char *path, image_t *other, int scalar, bool single, int update, bool difference);
+// Background Model
+void imlib_background_model_alloc(background_model_t *model, int w, int h, bool gaussian);
+void imlib_background_model_free(background_model_t *model);
+void imlib_background_model_reset(background_model_t *model);
+void imlib_background_model_update(background_model_t *model, image_t *img, image_t *out, float alpha, float threshold);
 void imlib_chrominvar(image_t *img);
 void imlib_illuminvar(image_t *img);
 // Lens/Rotation Correction
@@ -1343,9 +1814,24 @@ void imlib_lens_corr(image_t *img, float strength, float zoom, float x_corr, flo
 void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation,
                          float z_rotation, float x_translation, float y_translation,
                          float zoom, float fov, float *corners);
+bool imlib_rotation_corr_transform(int w, int h, float x_rotation, float y_rotation, float z_rotation,
+                                   float x_translation, float y_translation,
+                                   float zoom, float fov, float *corners, float *transform);
+void imlib_remap_alloc(remap_t *map, int w, int h);
+void imlib_remap_free(remap_t *map);
+void imlib_remap_lens_corr(remap_t *map, float strength, float zoom, float x_corr, float y_corr);
+void imlib_remap_rotation_corr(remap_t *map, float x_rotation, float y_rotation,
+                               float z_rotation, float x_translation, float y_translation,
+                               float zoom, float fov, float *corners);
+void imlib_remap(image_t *img, remap_t *map);
 // Statistics
-void imlib_get_similarity(image_t *img, const char *path, image_t *other, int scalar, float *avg, float *std, float *min, float *max);
+// SSIM of block_size windows every step pixels, stops once the mean can't reach threshold anymore
+// (-1 never stops) and then returns the best mean the image could have had.
+void imlib_get_similarity(image_t *img, const char *path, image_t *other, int scalar, int block_size, int step,
+                          float threshold, float *avg, float *std, float *min, float *max);
 void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_t *thresholds, bool invert, image_t *other);
+// Histograms of n rois in one pass over the image, thresholds[i] (or thresholds) may be NULL.
+void imlib_get_histograms(histogram_t *out, image_t *ptr, rectangle_t *rois, list_t **thresholds, int n, bool invert);
 void imlib_get_percentile(percentile_t *out, image_bpp_t bpp, histogram_t *ptr, float percentile);
 void imlib_get_threshold(threshold_t *out, image_bpp_t bpp, histogram_t *ptr);
 void imlib_get_statistics(statistics_t *out, image_bpp_t bpp, histogram_t *ptr);
@@ -1357,30 +1843,90 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
                       bool merge, int margin,
                       bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg,
                       bool (*merge_cb)(void*,find_blobs_list_lnk_data_t*,find_blobs_list_lnk_data_t*), void *merge_cb_arg,
-                      unsigned int x_hist_bins_max, unsigned int y_hist_bins_max);
+                      unsigned int x_hist_bins_max, unsigned int y_hist_bins_max, bool rle);
+void imlib_find_blobs_filter_init(find_blobs_filter_t *filter,
+                                  bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg);
+void imlib_find_blobs_filter_range(find_blobs_filter_t *filter, find_blobs_filter_property_t property, float min, float max);
+// Threshold callback taking a find_blobs_filter_t as the argument.
+bool imlib_find_blobs_filter(void *filter, find_blobs_list_lnk_data_t *blob);
+void imlib_blob_tracker_alloc(blob_tracker_t *tracker, size_t tracks_max, int margin, int rescan);
+void imlib_blob_tracker_free(blob_tracker_t *tracker);
+void imlib_blob_tracker_reset(blob_tracker_t *tracker);
+void imlib_blob_tracker_update(blob_tracker_t *tracker, list_t *out, image_t *ptr, rectangle_t *roi,
+                               unsigned int x_stride, unsigned int y_stride,
+                               list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold,
+                               bool merge, int margin,
+                               bool (*threshold_cb)(void*,find_blobs_list_lnk_data_t*), void *threshold_cb_arg,
+                               bool (*merge_cb)(void*,find_blobs_list_lnk_data_t*,find_blobs_list_lnk_data_t*), void *merge_cb_arg,
+                               unsigned int x_hist_bins_max, unsigned int y_hist_bins_max, bool rle);
+// Lossless image compression
+// Compresses a binary or grayscale image into buf and returns the size, only the size is computed
+// when buf is NULL.
+size_t imlib_compress_image(image_t *img, uint8_t *buf);
+// The reader uses frame buffer memory (1 row for binary images, 2 for grayscale) until closed.
+void imlib_compressed_reader_init(compressed_reader_t *r, image_t *img);
+void imlib_compressed_reader_close(compressed_reader_t *r);
+// Returns the next row, valid until the following call.
+void *imlib_compressed_reader_next(compressed_reader_t *r);
+void imlib_decompress_image(image_t *dst, image_t *src);
+// Multi-object tracking
+void imlib_object_tracker_alloc(object_tracker_t *tracker, size_t tracks_max, int min_hits, int max_misses,
+                                float iou_threshold, float max_distance);
+void imlib_object_tracker_free(object_tracker_t *tracker);
+void imlib_object_tracker_reset(object_tracker_t *tracker);
+// Assigns the len detections (at most tracks_max) to the tracks, ids[i] gets the id of the track
+// of detections[i] or 0 if it isn't confirmed yet.
+void imlib_object_tracker_update(object_tracker_t *tracker, object_detection_t *detections, size_t len,
+                                 uint32_t *ids);
+// Optical Flow
+void imlib_lk_tracker_alloc(lk_tracker_t *tracker, size_t points_max, int levels, int window, int cell_size);
+void imlib_lk_tracker_free(lk_tracker_t *tracker);
+void imlib_lk_tracker_reset(lk_tracker_t *tracker);
+// Tracks the points into the grayscale img and adds corners found in roi when a quarter of them
+// were lost. Returns the number of tracked points, they are the first ones of tracker->points.
+// pyr (optional) is a pyramid of img to take the levels from.
+int imlib_lk_tracker_update(lk_tracker_t *tracker, image_t *img, image_pyramid_t *pyr, rectangle_t *roi,
+                            int threshold, corner_detector_t corner_detector);
 // Shape Detection
+void imlib_gradient_map_alloc(gradient_map_t *map);
+void imlib_gradient_map_free(gradient_map_t *map);
+void imlib_gradient_map_reset(gradient_map_t *map);
+void imlib_gradient_map_update(gradient_map_t *map, image_t *ptr, rectangle_t *roi);
 size_t trace_line(image_t *ptr, line_t *l, int *theta_buffer, uint32_t *mag_buffer, point_t *point_buffer); // helper/internal
 void merge_alot(list_t *out, int threshold, int theta_threshold); // helper/internal
 void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
-                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin);
+                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin, gradient_map_t *map);
 void imlib_lsd_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int merge_distance, unsigned int max_theta_diff);
 void imlib_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
                               uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin,
                               uint32_t segment_threshold);
 void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
                         uint32_t threshold, unsigned int x_margin, unsigned int y_margin, unsigned int r_margin,
-                        unsigned int r_min, unsigned int r_max, unsigned int r_step);
+                        unsigned int r_min, unsigned int r_max, unsigned int r_step, bool two_stage,
+                        gradient_map_t *map);
 void imlib_find_rects(list_t *out, image_t *ptr, rectangle_t *roi,
                       uint32_t threshold);
 // 1/2D Bar Codes
 void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi);
 void imlib_find_apriltags(list_t *out, image_t *ptr, rectangle_t *roi, apriltag_families_t families,
-                          float fx, float fy, float cx, float cy);
+                          float fx, float fy, float cx, float cy, int quad_decimate, int max_tags);
+void imlib_apriltag_tracker_alloc(apriltag_tracker_t *tracker, size_t tracks_max, int margin, int rescan);
+void imlib_apriltag_tracker_free(apriltag_tracker_t *tracker);
+void imlib_apriltag_tracker_reset(apriltag_tracker_t *tracker);
+void imlib_apriltag_tracker_update(apriltag_tracker_t *tracker, list_t *out, image_t *ptr, rectangle_t *roi,
+                                   apriltag_families_t families, float fx, float fy, float cx, float cy, int quad_decimate);
 void imlib_find_datamatrices(list_t *out, image_t *ptr, rectangle_t *roi, int effort);
-void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi);
+void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi, int x_stride, int y_stride, bool first_only);
+void imlib_find_codes(image_t *ptr, rectangle_t *roi, list_t *qrcodes, list_t *datamatrices, int effort,
+                      list_t *barcodes, list_t *apriltags, apriltag_families_t families,
+                      float fx, float fy, float cx, float cy);
 // Template Matching
 void imlib_phasecorrelate(image_t *img0, image_t *img1, rectangle_t *roi0, rectangle_t *roi1, bool logpolar, bool fix_rotation_scale,
                           float *x_translation, float *y_translation, float *rotation, float *scale, float *response);
+size_t imlib_phasecorrelate_template_size(rectangle_t *roi);
+void imlib_phasecorrelate_template_init(phasecorrelate_template_t *t, image_t *img, rectangle_t *roi, float *buf);
+void imlib_phasecorrelate_template(image_t *img, rectangle_t *roi, phasecorrelate_template_t *t,
+                                   float *x_translation, float *y_translation, float *response);
 
 array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, float a2, float a3);
 #endif //__IMLIB_H__
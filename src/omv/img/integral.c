@@ -13,6 +13,7 @@
 #include <arm_math.h>
 #include "imlib.h"
 #include "fb_alloc.h"
+#include "xalloc.h"
 
 void imlib_integral_image_alloc(i_image_t *sum, int w, int h)
 {
@@ -116,3 +117,153 @@ uint32_t imlib_integral_lookup(i_image_t *sum, int x, int y, int w, int h)
     }
 #undef  PIXEL_AT
 }
+
+// The largest area whose squared values always sum to less than 2^32 (255 * 255 * 66051 < 2^32).
+#define INTEGRAL_MAP_SQ_MAX_AREA    (66051)
+
+static void integral_map_row(image_t *ptr, rectangle_t *roi, int y, uint8_t *row)
+{
+    switch (ptr->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+            for (int x = 0, xx = roi->w; x < xx; x++) {
+                row[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, roi->x + x));
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+            for (int x = 0, xx = roi->w; x < xx; x++) {
+                row[x] = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, roi->x + x));
+            }
+            break;
+        }
+        default: {
+            memset(row, 0, roi->w);
+            break;
+        }
+    }
+}
+
+void imlib_integral_map_alloc(integral_map_t *map)
+{
+    memset(map, 0, sizeof(integral_map_t));
+}
+
+void imlib_integral_map_free(integral_map_t *map)
+{
+    if (map->sum) {
+        xfree(map->sum);
+    }
+
+    if (map->sum_sq) {
+        xfree(map->sum_sq);
+    }
+
+    memset(map, 0, sizeof(integral_map_t));
+}
+
+void imlib_integral_map_update(integral_map_t *map, image_t *ptr, rectangle_t *roi, bool squared)
+{
+    size_t stride = roi->w + 1;
+    size_t size = stride * (roi->h + 1);
+
+    if (map->size < size) {
+        imlib_integral_map_free(map); // in case xalloc fails
+        map->sum = xalloc(size * sizeof(uint32_t));
+        map->size = size;
+    }
+
+    if (squared && (!map->sum_sq)) {
+        map->sum_sq = xalloc(map->size * sizeof(uint32_t));
+    } else if ((!squared) && map->sum_sq) {
+        xfree(map->sum_sq);
+        map->sum_sq = NULL;
+    }
+
+    map->roi = *roi;
+    memset(map->sum, 0, stride * sizeof(uint32_t));
+
+    if (map->sum_sq) {
+        memset(map->sum_sq, 0, stride * sizeof(uint32_t));
+    }
+
+    uint8_t *row = (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? NULL : fb_alloc(roi->w, FB_ALLOC_PREFER_SPEED);
+
+    // Each entry is the entry above plus the running sum of the row (both modulo 2^32).
+    for (int y = 0, yy = roi->h; y < yy; y++) {
+        uint8_t *row_ptr = row;
+
+        if (row) {
+            integral_map_row(ptr, roi, roi->y + y, row);
+        } else {
+            row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, roi->y + y) + roi->x;
+        }
+
+        uint32_t *sum_prev = map->sum + (stride * y), *sum_row = sum_prev + stride;
+        sum_row[0] = 0;
+
+        if (map->sum_sq) {
+            uint32_t *sq_prev = map->sum_sq + (stride * y), *sq_row = sq_prev + stride;
+            sq_row[0] = 0;
+
+            for (uint32_t x = 0, xx = roi->w, s = 0, ss = 0; x < xx; x++) {
+                uint32_t p = row_ptr[x];
+                s += p;
+                ss += p * p;
+                sum_row[x + 1] = sum_prev[x + 1] + s;
+                sq_row[x + 1] = sq_prev[x + 1] + ss;
+            }
+        } else {
+            for (uint32_t x = 0, xx = roi->w, s = 0; x < xx; x++) {
+                s += row_ptr[x];
+                sum_row[x + 1] = sum_prev[x + 1] + s;
+            }
+        }
+    }
+
+    if (row) {
+        fb_free(); // row
+    }
+}
+
+static uint32_t integral_map_lookup(uint32_t *table, size_t stride, int x, int y, int w, int h)
+{
+    uint32_t *top = table + (stride * y) + x, *bottom = top + (stride * h);
+    return bottom[w] - bottom[0] - top[w] + top[0];
+}
+
+uint32_t imlib_integral_map_sum(integral_map_t *map, rectangle_t *r)
+{
+    // 255 * area never reaches 2^32 so the modulo arithmetic is exact.
+    return integral_map_lookup(map->sum, map->roi.w + 1, r->x - map->roi.x, r->y - map->roi.y, r->w, r->h);
+}
+
+uint64_t imlib_integral_map_sum_sq(integral_map_t *map, rectangle_t *r)
+{
+    // Squared sums of large rectangles wrap around, they are summed in bands small enough not to.
+    size_t stride = map->roi.w + 1;
+    int x = r->x - map->roi.x, y = r->y - map->roi.y;
+    int band_h = IM_MAX(INTEGRAL_MAP_SQ_MAX_AREA / IM_MAX(r->w, 1), 1);
+    uint64_t sum = 0;
+
+    for (int i = 0; i < r->h; i += band_h) {
+        sum += integral_map_lookup(map->sum_sq, stride, x, y + i, r->w, IM_MIN(band_h, r->h - i));
+    }
+
+    return sum;
+}
+
+float imlib_integral_map_mean(integral_map_t *map, rectangle_t *r)
+{
+    return imlib_integral_map_sum(map, r) / ((float) (r->w * r->h));
+}
+
+float imlib_integral_map_variance(integral_map_t *map, rectangle_t *r)
+{
+    // (n * sum(x^2) - sum(x)^2) / n^2 with an exact numerator.
+    uint64_t n = r->w * r->h;
+    uint64_t sum = imlib_integral_map_sum(map, r);
+    uint64_t num = (n * imlib_integral_map_sum_sq(map, r)) - (sum * sum);
+    return num / (((float) n) * n);
+}
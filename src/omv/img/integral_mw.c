@@ -226,6 +226,41 @@ void imlib_integral_mw_shift_sq(image_t *src, mw_image_t *sum, int n)
     }
 }
 
+// Sums (and squares) one resampled source row, the source row pointer and the pixel format are
+// resolved once per row instead of once per pixel (prev rows are NULL for the first row).
+static void integral_mw_ss_row(image_t *src, rectangle_t *roi, int x_ratio, int w, int sy,
+                               uint32_t *sum_row, uint32_t *ssq_row, uint32_t *sum_prev, uint32_t *ssq_prev)
+{
+    uint32_t s = 0, sq = 0;
+
+    if (src->bpp == 1) {
+        uint8_t *row_ptr = src->pixels + (sy * src->w) + roi->x;
+        for (int x = 0; x < w; x++) {
+            uint32_t p = row_ptr[(x * x_ratio) >> 16];
+            s += p;
+            sq += p * p;
+            sum_row[x] = s;
+            ssq_row[x] = sq;
+        }
+    } else {
+        uint16_t *row_ptr = ((uint16_t *) src->pixels) + (sy * src->w) + roi->x;
+        for (int x = 0; x < w; x++) {
+            uint32_t p = COLOR_RGB565_TO_Y(row_ptr[(x * x_ratio) >> 16]) + 128;
+            s += p;
+            sq += p * p;
+            sum_row[x] = s;
+            ssq_row[x] = sq;
+        }
+    }
+
+    if (sum_prev) {
+        for (int x = 0; x < w; x++) {
+            sum_row[x] += sum_prev[x];
+            ssq_row[x] += ssq_prev[x];
+        }
+    }
+}
+
 void imlib_integral_mw_ss(image_t *src, mw_image_t *sum, mw_image_t *ssq, rectangle_t *roi)
 {
     // Image data pointers
@@ -233,35 +268,13 @@ void imlib_integral_mw_ss(image_t *src, mw_image_t *sum, mw_image_t *ssq, rectan
     typeof(*sum->data) *ssq_data = ssq->data;
 
     // Compute the first row to avoid branching
-    for (int sx, s=0, sq=0, x=0; x<sum->w; x++) {
-        // X offset
-        sx = roi->x+((x*sum->x_ratio)>>16);
-
-        // Accumulate row data
-        s  += IM_TO_GS_PIXEL(src, sx, roi->y);
-        sq += IM_TO_GS_PIXEL(src, sx, roi->y) * IM_TO_GS_PIXEL(src, sx, roi->y);
-
-        sum_data[0][x] = s;
-        ssq_data[0][x] = sq;
-    }
+    integral_mw_ss_row(src, roi, sum->x_ratio, sum->w, roi->y, sum_data[0], ssq_data[0], NULL, NULL);
 
     // Compute the last n lines
     for (int sy, y=1; y<sum->h; y++) {
         // Y offset
         sy = roi->y+((y*sum->y_ratio)>>16);
-
-        // Sum the current row
-        for (int sx, s=0, sq=0, x=0; x<sum->w; x++) {
-            // X offset
-            sx = roi->x+((x*sum->x_ratio)>>16);
-
-            // Accumulate row data
-            s  += IM_TO_GS_PIXEL(src, sx, sy);
-            sq += IM_TO_GS_PIXEL(src, sx, sy) * IM_TO_GS_PIXEL(src, sx, sy);
-
-            sum_data[y][x] = s + sum_data[y-1][x];
-            ssq_data[y][x] = sq + ssq_data[y-1][x];
-        }
+        integral_mw_ss_row(src, roi, sum->x_ratio, sum->w, sy, sum_data[y], ssq_data[y], sum_data[y-1], ssq_data[y-1]);
     }
 
     sum->y_offs = sum->h;
@@ -288,19 +301,7 @@ void imlib_integral_mw_shift_ss(image_t *src, mw_image_t *sum, mw_image_t *ssq,
     for (int sy, y=(sum->h - n); y<sum->h; y++, sum->y_offs++, ssq->y_offs++) {
         // The y offset is set to the last line + 1
         sy = roi->y+((sum->y_offs*sum->y_ratio)>>16);
-
-        // Sum of the current row
-        for (int sx, s=0, sq=0, x=0; x<sum->w; x++) {
-            // X offset
-            sx = roi->x+((x*sum->x_ratio)>>16);
-
-            // Accumulate row data
-            s  += IM_TO_GS_PIXEL(src, sx, sy);
-            sq += IM_TO_GS_PIXEL(src, sx, sy) * IM_TO_GS_PIXEL(src, sx, sy);
-
-            sum_data[y][x] = s  + sum_data[y-1][x];
-            ssq_data[y][x] = sq + ssq_data[y-1][x];
-        }
+        integral_mw_ss_row(src, roi, sum->x_ratio, sum->w, sy, sum_data[y], ssq_data[y], sum_data[y-1], ssq_data[y-1]);
     }
 }
 
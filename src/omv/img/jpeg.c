@@ -19,6 +19,7 @@
 #include "ff_wrapper.h"
 #include "imlib.h"
 #include "omv_boardconfig.h"
+#include "irq.h"
 
 #define TIME_JPEG   (0)
 
@@ -158,7 +159,14 @@ typedef struct _jpeg_enc {
     int out_size;
     int x_offset;
     int y_offset;
+    int lines;      // Number of source lines available (less than img_h while streaming).
     bool overflow;
+    bool waiting;   // The encoder input is paused until the next band of lines is available.
+    bool started;
+    bool streaming;
+    volatile bool done;
+    uint8_t *out_buf;
+    uint32_t out_len;
     image_t *img;
     union {
         uint8_t  *pixels8;
@@ -166,8 +174,37 @@ typedef struct _jpeg_enc {
     };
 } jpeg_enc_t;
 
+// The decoder output buffer holds a whole number of MCUs of any size.
+#define JPEG_DEC_BUF_SIZE           (JPEG_420_YCBCR_MCU_SIZE * 8)
+
+typedef struct _jpeg_dec {
+    bool decoding;
+    bool error;
+    bool color;     // The image has chroma components.
+    int scale;      // Output downscale factor (1, 2, 4 or 8).
+    int img_w;
+    int img_h;
+    int mcu_w;      // MCU size in pixels.
+    int mcu_h;
+    int mcu_size;   // MCU size in bytes.
+    int hs, vs;     // Chroma subsampling (shifts).
+    int x_offset;   // Position of the next MCU.
+    int y_offset;
+    uint8_t *in_ptr;
+    uint32_t in_len;
+    image_t *img;
+} jpeg_dec_t;
+
 static uint8_t mcubuf[512];
 static jpeg_enc_t jpeg_enc;
+static jpeg_dec_t jpeg_dec;
+static JPEG_HandleTypeDef JPEG_Stream_Handle;
+
+// Returns true if the next row of MCUs is available (a full row or the last partial row).
+static bool mcu_row_ready()
+{
+    return ((jpeg_enc.y_offset + MCU_H) <= jpeg_enc.lines) || (jpeg_enc.lines >= jpeg_enc.img_h);
+}
 
 static uint8_t *get_mcu()
 {
@@ -266,8 +303,106 @@ static uint8_t *get_mcu()
     return mcubuf;
 }
 
+// Returns the average of a w x h box of 8x8 block samples.
+static inline int get_dec_box(uint8_t *p, int w, int h)
+{
+    if (w == 1 && h == 1) {
+        return p[0];
+    }
+
+    int acc = 0;
+    for (int y = 0; y < h; y++, p += 8) {
+        for (int x = 0; x < w; x++) {
+            acc += p[x];
+        }
+    }
+    return acc / (w * h);
+}
+
+// Converts a decoded MCU to the output image, downscaled by averaging each scale x scale box.
+// Note: The boxes never cross block boundaries since 8 is a multiple of the scale.
+static void put_dec_mcu(uint8_t *mcu)
+{
+    image_t *img = jpeg_dec.img;
+    int s = jpeg_dec.scale;
+    int x0 = jpeg_dec.x_offset / s;
+    int y0 = jpeg_dec.y_offset / s;
+    int w = IM_MIN(jpeg_dec.mcu_w / s, img->w - x0);
+    int h = IM_MIN(jpeg_dec.mcu_h / s, img->h - y0);
+    int c_w = IM_MAX(s >> jpeg_dec.hs, 1);
+    int c_h = IM_MAX(s >> jpeg_dec.vs, 1);
+    uint8_t *cb = mcu + jpeg_dec.mcu_size - 128;
+    uint8_t *cr = mcu + jpeg_dec.mcu_size - 64;
+
+    for (int y = 0; y < h; y++) {
+        int py = y * s;
+        for (int x = 0; x < w; x++) {
+            int px = x * s;
+            // Y blocks are stored left to right, top to bottom.
+            uint8_t *yb = mcu + ((((py >> 3) * (jpeg_dec.mcu_w >> 3)) + (px >> 3)) * 64) + ((py & 7) * 8) + (px & 7);
+            int Y = get_dec_box(yb, s, s);
+
+            if (IM_IS_GS(img)) {
+                IMAGE_PUT_GRAYSCALE_PIXEL(img, x0 + x, y0 + y, Y);
+            } else if (!jpeg_dec.color) {
+                IMAGE_PUT_RGB565_PIXEL(img, x0 + x, y0 + y, imlib_yuv_to_rgb(Y, 0, 0));
+            } else {
+                int c_offset = ((py >> jpeg_dec.vs) * 8) + (px >> jpeg_dec.hs);
+                int u = get_dec_box(cb + c_offset, c_w, c_h) - 128;
+                int v = get_dec_box(cr + c_offset, c_w, c_h) - 128;
+                IMAGE_PUT_RGB565_PIXEL(img, x0 + x, y0 + y, imlib_yuv_to_rgb(Y, u, v));
+            }
+        }
+    }
+
+    jpeg_dec.x_offset += jpeg_dec.mcu_w;
+    if (jpeg_dec.x_offset >= jpeg_dec.img_w) {
+        jpeg_dec.x_offset = 0;
+        jpeg_dec.y_offset += jpeg_dec.mcu_h;
+    }
+}
+
+void HAL_JPEG_InfoReadyCallback(JPEG_HandleTypeDef *hjpeg, JPEG_ConfTypeDef *pInfo)
+{
+    jpeg_dec.color = true;
+    jpeg_dec.hs = jpeg_dec.vs = 0;
+    jpeg_dec.mcu_w = jpeg_dec.mcu_h = 8;
+
+    if (pInfo->ColorSpace == JPEG_GRAYSCALE_COLORSPACE) {
+        jpeg_dec.color = false;
+        jpeg_dec.mcu_size = JPEG_444_GS_MCU_SIZE;
+    } else if (pInfo->ColorSpace != JPEG_YCBCR_COLORSPACE) {
+        // CMYK is not supported.
+        jpeg_dec.error = true;
+    } else if (pInfo->ChromaSubsampling == JPEG_420_SUBSAMPLING) {
+        jpeg_dec.hs = jpeg_dec.vs = 1;
+        jpeg_dec.mcu_w = jpeg_dec.mcu_h = 16;
+        jpeg_dec.mcu_size = JPEG_420_YCBCR_MCU_SIZE;
+    } else if (pInfo->ChromaSubsampling == JPEG_422_SUBSAMPLING) {
+        jpeg_dec.hs = 1;
+        jpeg_dec.mcu_w = 16;
+        jpeg_dec.mcu_size = JPEG_422_YCBCR_MCU_SIZE;
+    } else {
+        jpeg_dec.mcu_size = JPEG_444_YCBCR_MCU_SIZE;
+    }
+
+    // The output image size is computed from the geometry read from the file.
+    if (pInfo->ImageWidth != jpeg_dec.img_w || pInfo->ImageHeight != jpeg_dec.img_h) {
+        jpeg_dec.error = true;
+    }
+}
+
 void HAL_JPEG_GetDataCallback(JPEG_HandleTypeDef *hjpeg, uint32_t NbDecodedData)
 {
+    if (jpeg_dec.decoding) {
+        // Continue with the rest of the input.
+        NbDecodedData = IM_MIN(NbDecodedData, jpeg_dec.in_len);
+        jpeg_dec.in_ptr += NbDecodedData;
+        jpeg_dec.in_len -= NbDecodedData;
+        HAL_JPEG_ConfigInputBuffer(hjpeg, jpeg_dec.in_ptr, jpeg_dec.in_len);
+        return;
+    }
+
     HAL_JPEG_Pause(hjpeg, JPEG_PAUSE_RESUME_INPUT);
     if ((hjpeg->JpegOutCount+1024) > hjpeg->OutDataLength) {
         // JPEG buffer overflow.
@@ -278,6 +413,9 @@ void HAL_JPEG_GetDataCallback(JPEG_HandleTypeDef *hjpeg, uint32_t NbDecodedData)
         // Compression is done.
         HAL_JPEG_ConfigInputBuffer(hjpeg, NULL, 0);
         HAL_JPEG_Resume(hjpeg, JPEG_PAUSE_RESUME_INPUT);
+    } else if (!mcu_row_ready()) {
+        // Streaming, the input stays paused until the lines are captured (see jpeg_stream_band).
+        jpeg_enc.waiting = true;
     } else {
         // Set the next MCU.
         HAL_JPEG_ConfigInputBuffer(hjpeg, get_mcu(), jpeg_enc.mcu_size);
@@ -287,25 +425,37 @@ void HAL_JPEG_GetDataCallback(JPEG_HandleTypeDef *hjpeg, uint32_t NbDecodedData)
 
 void HAL_JPEG_DataReadyCallback (JPEG_HandleTypeDef *hjpeg, uint8_t *pDataOut, uint32_t OutDataLength)
 {
+    if (jpeg_dec.decoding) {
+        // Convert the decoded MCUs and reuse the output buffer.
+        for (uint32_t i = 0; !jpeg_dec.error && jpeg_dec.mcu_size && (i + jpeg_dec.mcu_size) <= OutDataLength
+                && jpeg_dec.y_offset < jpeg_dec.img_h; i += jpeg_dec.mcu_size) {
+            put_dec_mcu(pDataOut + i);
+        }
+        HAL_JPEG_ConfigOutputBuffer(hjpeg, pDataOut, JPEG_DEC_BUF_SIZE);
+        return;
+    }
+
     jpeg_enc.out_size = OutDataLength;
 }
 
+void HAL_JPEG_EncodeCpltCallback(JPEG_HandleTypeDef *hjpeg)
+{
+    jpeg_enc.done = true;
+}
+
 void HAL_JPEG_ErrorCallback(JPEG_HandleTypeDef *hjpeg)
 {
     printf("JPEG decode/encode error\n");
 }
 
-bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
+void JPEG_IRQHandler(void)
 {
-#if (TIME_JPEG==1)
-    uint32_t start = HAL_GetTick();
-#endif
-
-    // Init the HAL JPEG driver
-    JPEG_HandleTypeDef JPEG_Handle = {0};
-    JPEG_Handle.Instance = JPEG;
-    HAL_JPEG_Init(&JPEG_Handle);
+    HAL_JPEG_IRQHandler(&JPEG_Stream_Handle);
+}
 
+// Sets up the encoder state and the HAL configuration to compress src.
+static void jpeg_enc_config(image_t *src, int quality, JPEG_ConfTypeDef *JPEG_Info)
+{
     uint32_t pad_w = src->w;
     if (pad_w % 8 != 0) {
         pad_w += (8 - (pad_w % 8));
@@ -319,29 +469,50 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
     jpeg_enc.out_size = 0;
     jpeg_enc.x_offset = 0;
     jpeg_enc.y_offset = 0;
+    jpeg_enc.lines    = src->h;
     jpeg_enc.overflow = false;
+    jpeg_enc.waiting  = false;
+    jpeg_enc.started  = false;
+    jpeg_enc.done     = false;
     jpeg_enc.pixels8  = (uint8_t *) src->pixels;
     jpeg_enc.pixels16 = (uint16_t*) src->pixels;
 
-    JPEG_ConfTypeDef JPEG_Info;
-    JPEG_Info.ImageWidth    = src->w;
-    JPEG_Info.ImageHeight   = src->h;
-    JPEG_Info.ImageQuality  = quality;
+    JPEG_Info->ImageWidth    = src->w;
+    JPEG_Info->ImageHeight   = src->h;
+    JPEG_Info->ImageQuality  = quality;
 
     switch (src->bpp) {
         case 0:
         case 1:
-            jpeg_enc.mcu_size           = JPEG_444_GS_MCU_SIZE;
-            JPEG_Info.ColorSpace        = JPEG_GRAYSCALE_COLORSPACE;
-            JPEG_Info.ChromaSubsampling = JPEG_444_SUBSAMPLING;
+            jpeg_enc.mcu_size            = JPEG_444_GS_MCU_SIZE;
+            JPEG_Info->ColorSpace        = JPEG_GRAYSCALE_COLORSPACE;
+            JPEG_Info->ChromaSubsampling = JPEG_444_SUBSAMPLING;
             break;
         case 2:
         case 3:
-            jpeg_enc.mcu_size           = JPEG_444_YCBCR_MCU_SIZE;
-            JPEG_Info.ColorSpace        = JPEG_YCBCR_COLORSPACE;
-            JPEG_Info.ChromaSubsampling = JPEG_444_SUBSAMPLING;
+            jpeg_enc.mcu_size            = JPEG_444_YCBCR_MCU_SIZE;
+            JPEG_Info->ColorSpace        = JPEG_YCBCR_COLORSPACE;
+            JPEG_Info->ChromaSubsampling = JPEG_444_SUBSAMPLING;
             break;
     }
+}
+
+bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
+{
+#if (TIME_JPEG==1)
+    uint32_t start = HAL_GetTick();
+#endif
+
+    // The encoder is shared, a frame that's being compressed while captured is dropped.
+    jpeg_stream_abort();
+
+    // Init the HAL JPEG driver
+    JPEG_HandleTypeDef JPEG_Handle = {0};
+    JPEG_Handle.Instance = JPEG;
+    HAL_JPEG_Init(&JPEG_Handle);
+
+    JPEG_ConfTypeDef JPEG_Info;
+    jpeg_enc_config(src, quality, &JPEG_Info);
 
     if (HAL_JPEG_ConfigEncoding(&JPEG_Handle, &JPEG_Info) != HAL_OK) {
         // Initialization error
@@ -366,6 +537,133 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
     return jpeg_enc.overflow;
 }
 
+bool jpeg_decompress(image_t *src, image_t *dst, int scale)
+{
+    // The codec is shared, a frame that's being compressed while captured is dropped.
+    jpeg_stream_abort();
+
+    uint8_t *buf = fb_alloc(JPEG_DEC_BUF_SIZE, FB_ALLOC_NO_HINT);
+
+    JPEG_HandleTypeDef JPEG_Handle = {0};
+    JPEG_Handle.Instance = JPEG;
+    HAL_JPEG_Init(&JPEG_Handle);
+
+    // NOTE: The size of the compressed data is stored in src->bpp
+    jpeg_dec = (jpeg_dec_t) {
+        .decoding = true,
+        .scale    = scale,
+        .img_w    = src->w,
+        .img_h    = src->h,
+        .in_ptr   = src->pixels,
+        .in_len   = src->bpp,
+        .img      = dst,
+    };
+
+    if (HAL_JPEG_Decode(&JPEG_Handle, src->pixels, src->bpp, buf, JPEG_DEC_BUF_SIZE, 3000) != HAL_OK) {
+        jpeg_dec.error = true;
+    }
+    fb_free();
+
+    HAL_JPEG_DeInit(&JPEG_Handle);
+    jpeg_dec.decoding = false;
+
+    // Check that all the MCUs were decoded.
+    return jpeg_dec.error || (jpeg_dec.y_offset < jpeg_dec.img_h);
+}
+
+bool jpeg_stream_start(image_t *src, image_t *dst, int quality)
+{
+    jpeg_stream_abort();
+
+    JPEG_Stream_Handle = (JPEG_HandleTypeDef) {0};
+    JPEG_Stream_Handle.Instance = JPEG;
+    HAL_JPEG_Init(&JPEG_Stream_Handle);
+
+    JPEG_ConfTypeDef JPEG_Info;
+    jpeg_enc_config(src, quality, &JPEG_Info);
+
+    // No lines are captured yet, the encoder is started by the first band.
+    jpeg_enc.lines    = 0;
+    jpeg_enc.waiting  = true;
+    // NOTE: output buffer size is stored in dst->bpp
+    jpeg_enc.out_buf  = dst->pixels;
+    jpeg_enc.out_len  = dst->bpp;
+
+    if (HAL_JPEG_ConfigEncoding(&JPEG_Stream_Handle, &JPEG_Info) != HAL_OK) {
+        HAL_JPEG_DeInit(&JPEG_Stream_Handle);
+        return true;
+    }
+
+    // Same priority as the DCMI DMA, so the line callback and the encoder callbacks don't preempt each other.
+    NVIC_SetPriority(JPEG_IRQn, IRQ_PRI_DMA21);
+    HAL_NVIC_EnableIRQ(JPEG_IRQn);
+
+    jpeg_enc.streaming = true;
+    return false;
+}
+
+void jpeg_stream_band(int lines)
+{
+    if (!jpeg_enc.streaming) {
+        return;
+    }
+
+    jpeg_enc.lines = lines;
+
+    if (jpeg_enc.waiting && mcu_row_ready()) {
+        jpeg_enc.waiting = false;
+        if (!jpeg_enc.started) {
+            jpeg_enc.started = true;
+            if (HAL_JPEG_Encode_IT(&JPEG_Stream_Handle, get_mcu(), jpeg_enc.mcu_size,
+                        jpeg_enc.out_buf, jpeg_enc.out_len) != HAL_OK) {
+                jpeg_enc.overflow = true;
+            }
+        } else {
+            HAL_JPEG_ConfigInputBuffer(&JPEG_Stream_Handle, get_mcu(), jpeg_enc.mcu_size);
+            HAL_JPEG_Resume(&JPEG_Stream_Handle, JPEG_PAUSE_RESUME_INPUT);
+        }
+    }
+}
+
+bool jpeg_stream_end(image_t *dst, uint32_t timeout)
+{
+    if (!jpeg_enc.streaming) {
+        return true;
+    }
+
+    // All the lines are available, wait for the last MCUs to be compressed.
+    __disable_irq();
+    jpeg_stream_band(jpeg_enc.img_h);
+    __enable_irq();
+
+    for (uint32_t tick_start = HAL_GetTick(); !jpeg_enc.done && !jpeg_enc.overflow; ) {
+        if ((HAL_GetTick() - tick_start) >= timeout) {
+            jpeg_enc.overflow = true;
+            HAL_JPEG_Abort(&JPEG_Stream_Handle);
+            break;
+        }
+        __WFI();
+    }
+
+    HAL_NVIC_DisableIRQ(JPEG_IRQn);
+    HAL_JPEG_DeInit(&JPEG_Stream_Handle);
+    jpeg_enc.streaming = false;
+
+    // Set output size
+    dst->bpp = jpeg_enc.out_size;
+    return jpeg_enc.overflow;
+}
+
+void jpeg_stream_abort()
+{
+    if (jpeg_enc.streaming) {
+        HAL_NVIC_DisableIRQ(JPEG_IRQn);
+        HAL_JPEG_Abort(&JPEG_Stream_Handle);
+        HAL_JPEG_DeInit(&JPEG_Stream_Handle);
+        jpeg_enc.streaming = false;
+    }
+}
+
 #else
 // Software JPEG implementation.
 #define FIX_0_382683433  ((int32_t)   98)
@@ -376,17 +674,33 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
 #define DESCALE(x, y)   (x>>y)
 #define MULTIPLY(x, y)  DESCALE((x) * (y), 8)
 
+// Packs two 16-bit constants for the dual 16-bit multiply instructions (a in the bottom halfword).
+#define FIX_PACK(a, b)  ((((uint32_t) (b)) << 16) | (((uint32_t) (a)) & 0xFFFF))
+
+// The odd part rotator with t10 and t12 packed: z2 = t10 * (c2 - c6) + z5, z4 = t12 * (c2 + c6) + z5.
+#define FIX_Z2          FIX_PACK(FIX_0_541196100 + FIX_0_382683433, -FIX_0_382683433)
+#define FIX_Z4          FIX_PACK(FIX_0_382683433, FIX_1_306562965 - FIX_0_382683433)
+
+// RGB to YCbCr in integer math with 15-bit fractions, rg holds R8 and G8 packed with __PKHBT.
+#define JPEG_RGB_TO_Y(rg, b) (((int32_t) __SMLAD(rg, FIX_PACK(9770, 19182), (b) * 3736)) >> 15)
+#define JPEG_RGB_TO_U(rg, b) (((int32_t) __SMLAD(rg, FIX_PACK(-5529, -10855), (b) << 14)) >> 15)
+#define JPEG_RGB_TO_V(rg, b) (((int32_t) __SMLAD(rg, FIX_PACK(16384, -13682), (b) * -2664)) >> 15)
+
+// Worst case size of an encoded data unit (64 max length codes with stuffed bytes).
+#define JPEG_DU_MAX_SIZE    (512)
+
 typedef struct {
     int idx;
     int length;
     uint8_t *buf;
-    int bitc, bitb;
+    int bitc;
+    uint32_t bitb;
     bool realloc;
     bool overflow;
 } jpeg_buf_t;
 
-// Quantization tables
-static float fdtbl_Y[64], fdtbl_UV[64];
+// Quantization tables (reciprocals of the scaled quantizers with 16-bit fractions)
+static int32_t fdtbl_Y[64], fdtbl_UV[64];
 static uint8_t YTable[64], UVTable[64];
 
 static const uint8_t s_jpeg_ZigZag[] = {
@@ -558,19 +872,35 @@ static void jpeg_put_bytes(jpeg_buf_t *jpeg_buf, const void *data, int size)
     jpeg_buf->idx += size;
 }
 
-static void jpeg_writeBits(jpeg_buf_t *jpeg_buf, const uint16_t *bs)
+// Makes sure size bytes can be written to the buffer without checking each byte.
+static bool jpeg_reserve(jpeg_buf_t *jpeg_buf, int size)
 {
+    if ((jpeg_buf->idx+size) >= jpeg_buf->length) {
+        if (jpeg_buf->realloc == false) {
+            // Can't realloc buffer
+            jpeg_buf->overflow = true;
+            return false;
+        }
+        jpeg_buf->length += IM_MAX(size, 1024);
+        jpeg_buf->buf = xrealloc(jpeg_buf->buf, jpeg_buf->length);
+    }
+    return true;
+}
+
+// Note: The buffer space must be reserved before writing the bits (see jpeg_reserve).
+static inline void jpeg_writeBits(jpeg_buf_t *jpeg_buf, const uint16_t *bs)
+{
+    // The bits are shifted into the bottom of the bit buffer, at most 7 bits are pending.
+    jpeg_buf->bitb = (jpeg_buf->bitb << bs[1]) | bs[0];
     jpeg_buf->bitc += bs[1];
-    jpeg_buf->bitb |= bs[0] << (24 - jpeg_buf->bitc);
 
     while (jpeg_buf->bitc > 7) {
-        uint8_t c = (jpeg_buf->bitb >> 16) & 255;
-        jpeg_put_char(jpeg_buf, c);
+        jpeg_buf->bitc -= 8;
+        uint8_t c = jpeg_buf->bitb >> jpeg_buf->bitc;
+        jpeg_buf->buf[jpeg_buf->idx++] = c;
         if(c == 255) {
-            jpeg_put_char(jpeg_buf, 0);
+            jpeg_buf->buf[jpeg_buf->idx++] = 0;
         }
-        jpeg_buf->bitb <<= 8;
-        jpeg_buf->bitc -= 8;
     }
 }
 
@@ -585,15 +915,19 @@ static void jpeg_calcBits(int val, uint16_t bits[2]) {
     bits[0] = val & ((1<<bits[1])-1);
 }
 
-static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int DC, const uint16_t (*HTDC)[2], const uint16_t (*HTAC)[2])
+static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, int32_t *fdtbl, int DC, const uint16_t (*HTDC)[2], const uint16_t (*HTAC)[2])
 {
     int DU[64];
     int DUQ[64];
-    int z1, z2, z3, z4, z5, z11, z13;
+    int z1, z2, z3, z4, z11, z13;
     int t0, t1, t2, t3, t4, t5, t6, t7, t10, t11, t12, t13;
     const uint16_t EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
     const uint16_t M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
 
+    if (!jpeg_reserve(jpeg_buf, JPEG_DU_MAX_SIZE)) {
+        return DC;
+    }
+
     // DCT rows
     for (int i=8, *p=DU; i>0; i--, p+=8, CDU+=8) {
         t0 = CDU[0] + CDU[7];
@@ -624,9 +958,10 @@ static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int D
         t12 = t6 + t7;
 
         // The rotator is modified from fig 4-8 to avoid extra negations.
-        z5 = MULTIPLY(t10 - t12, FIX_0_382683433); // c6
-        z2 = MULTIPLY(t10, FIX_0_541196100) + z5; // 1.306562965f-c6
-        z4 = MULTIPLY(t12, FIX_1_306562965) + z5; // 1.306562965f+c6
+        // z5 = (t10 - t12) * c6 is merged into z2 and z4, which are computed with dual multiplies.
+        t10 = __PKHBT(t10, t12, 16);
+        z2 = DESCALE((int32_t) __SMUAD(t10, FIX_Z2), 8); // 1.306562965f-c6
+        z4 = DESCALE((int32_t) __SMUAD(t10, FIX_Z4), 8); // 1.306562965f+c6
         z3 = MULTIPLY(t11, FIX_0_707106781); // c4
         z11 = t7 + z3;    // phase 5
         z13 = t7 - z3;
@@ -667,9 +1002,10 @@ static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int D
         t12 = t6 + t7;
 
         // The rotator is modified from fig 4-8 to avoid extra negations.
-        z5 = MULTIPLY(t10 - t12, FIX_0_382683433); // c6
-        z2 = MULTIPLY(t10, FIX_0_541196100) + z5; // 1.306562965f-c6
-        z4 = MULTIPLY(t12, FIX_1_306562965) + z5; // 1.306562965f+c6
+        // z5 = (t10 - t12) * c6 is merged into z2 and z4, which are computed with dual multiplies.
+        t10 = __PKHBT(t10, t12, 16);
+        z2 = DESCALE((int32_t) __SMUAD(t10, FIX_Z2), 8); // 1.306562965f-c6
+        z4 = DESCALE((int32_t) __SMUAD(t10, FIX_Z4), 8); // 1.306562965f+c6
         z3 = MULTIPLY(t11, FIX_0_707106781); // c4
         z11 = t7 + z3;		// phase 5
         z13 = t7 - z3;
@@ -682,9 +1018,11 @@ static int jpeg_processDU(jpeg_buf_t *jpeg_buf, int8_t *CDU, float *fdtbl, int D
 
     // first non-zero element in reverse order
     int end0pos = 0;
-    // Quantize/descale/zigzag the coefficients
+    // Quantize/descale/zigzag the coefficients, rounding half away from zero.
+    // Note: The coefficients are saturated to the largest baseline Huffman category.
     for(int i=0; i<64; ++i) {
-		DUQ[s_jpeg_ZigZag[i]] = fast_roundf(DU[i]*fdtbl[i]);
+        int v = DU[i] * fdtbl[i];
+        DUQ[s_jpeg_ZigZag[i]] = __SSAT((v + 0x8000 + (v >> 31)) >> 16, 11);
         if (s_jpeg_ZigZag[i] > end0pos && DUQ[s_jpeg_ZigZag[i]]) {
             end0pos = s_jpeg_ZigZag[i];
         }
@@ -747,8 +1085,8 @@ static void jpeg_init(int quality)
 
         for(int r = 0, k = 0; r < 8; ++r) {
             for(int c = 0; c < 8; ++c, ++k) {
-                fdtbl_Y[k]  = 1.0f / (aasf[r] * aasf[c] * YTable [s_jpeg_ZigZag[k]] * 8.0f);
-                fdtbl_UV[k] = 1.0f / (aasf[r] * aasf[c] * UVTable[s_jpeg_ZigZag[k]] * 8.0f);
+                fdtbl_Y[k]  = fast_roundf(65536.0f / (aasf[r] * aasf[c] * YTable [s_jpeg_ZigZag[k]] * 8.0f));
+                fdtbl_UV[k] = fast_roundf(65536.0f / (aasf[r] * aasf[c] * UVTable[s_jpeg_ZigZag[k]] * 8.0f));
             }
         }
     }
@@ -1031,9 +1369,9 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                *pY++ = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15) -128; // .299*r + .587*g + .114*b
-                                *pU++ = (uint8_t)(((b << 14) - (r * 5529) - (g * 10855)) >> 15); // -0.168736*r + -0.331264*g + 0.5*b
-                                *pV++ = (uint8_t)(((r << 14) - (g * 13682) - (b * 2664)) >> 15); // 0.5*r + -0.418688*g + -0.081312*b
+                                *pY++ = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b) -128; // .299*r + .587*g + .114*b
+                                *pU++ = (uint8_t)JPEG_RGB_TO_U(__PKHBT(r, g, 16), b); // -0.168736*r + -0.331264*g + 0.5*b
+                                *pV++ = (uint8_t)JPEG_RGB_TO_V(__PKHBT(r, g, 16), b); // 0.5*r + -0.418688*g + -0.081312*b
                             } // for tx
                         } // for ty
 
@@ -1074,15 +1412,15 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                pY[0] = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15) -128; // .299*r + .587*g + .114*b
-                                *pU++ = (uint8_t)(((b << 14) - (r * 5529) - (g * 10855)) >> 15); // -0.168736*r + -0.331264*g + 0.5*b
-                                *pV++ = (uint8_t)(((r << 14) - (g * 13682) - (b * 2664)) >> 15); // 0.5*r + -0.418688*g + -0.081312*b
+                                pY[0] = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b) -128; // .299*r + .587*g + .114*b
+                                *pU++ = (uint8_t)JPEG_RGB_TO_U(__PKHBT(r, g, 16), b); // -0.168736*r + -0.331264*g + 0.5*b
+                                *pV++ = (uint8_t)JPEG_RGB_TO_V(__PKHBT(r, g, 16), b); // 0.5*r + -0.418688*g + -0.081312*b
                                 pixel = pRow[1]; // right
                                 r = rb528_table[(pixel >> 3) & 0x1f]; // extract R8/G8/B8
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                pY[1] = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15)-128; // .299*r + .587*g + .114*b
+                                pY[1] = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b)-128; // .299*r + .587*g + .114*b
 
 				pY += 2; pRow += 2;
                             } // for tx
@@ -1134,29 +1472,29 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                pY[0] = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15) -128; // .299*r + .587*g + .114*b
-                                pU[0] = (uint8_t)(((b << 14) - (r * 5529) - (g * 10855)) >> 15); // -0.168736*r + -0.331264*g + 0.5*b
-                                pV[0] = (uint8_t)(((r << 14) - (g * 13682) - (b * 2664)) >> 15); // 0.5*r + -0.418688*g + -0.081312*b
+                                pY[0] = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b) -128; // .299*r + .587*g + .114*b
+                                pU[0] = (uint8_t)JPEG_RGB_TO_U(__PKHBT(r, g, 16), b); // -0.168736*r + -0.331264*g + 0.5*b
+                                pV[0] = (uint8_t)JPEG_RGB_TO_V(__PKHBT(r, g, 16), b); // 0.5*r + -0.418688*g + -0.081312*b
                                 pixel = pRow[1]; // top right
                                 r = rb528_table[(pixel >> 3) & 0x1f]; // extract R8/G8/B8
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                pY[1] = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15)-128; // .299*r + .587*g + .114*b
+                                pY[1] = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b)-128; // .299*r + .587*g + .114*b
 
                                 pixel = pRow[src->w]; // bottom left
                                 r = rb528_table[(pixel >> 3) & 0x1f]; // extract R8/G8/B8
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                pY[8] = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15)-128; // .299*r + .587*g + .114*b
+                                pY[8] = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b)-128; // .299*r + .587*g + .114*b
                                 
                                 pixel = pRow[1+src->w]; // bottom right
                                 r = rb528_table[(pixel >> 3) & 0x1f]; // extract R8/G8/B8
                                 g = g628_table[((pixel & 7) << 3) | (pixel >> 13)];
                                 b = rb528_table[(pixel >> 8) & 0x1f];
                                 // faster to keep all calculations in integer math with 15-bit fractions
-                                pY[9] = (uint8_t)(((r * 9770) + (g * 19182) + (b * 3736)) >> 15)-128; // .299*r + .587*g + .114*b
+                                pY[9] = (uint8_t)JPEG_RGB_TO_Y(__PKHBT(r, g, 16), b)-128; // .299*r + .587*g + .114*b
 				pY += 2; pU++; pV++; pRow += 2;
                             } // for tx
                         } // for ty
@@ -1249,6 +1587,9 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc)
 
     // Do the bit alignment of the EOI marker
     static const uint16_t fillBits[] = {0x7F, 7};
+    if (!jpeg_reserve(&jpeg_buf, 2)) {
+        goto jpeg_overflow;
+    }
     jpeg_writeBits(&jpeg_buf, fillBits);
 
     // EOI
@@ -8,134 +8,205 @@
  *
  * Kmeans clustering.
  */
-#include <float.h>
 #include <limits.h>
-#include <arm_math.h>
-#include <stdio.h>
 #include "imlib.h"
 #include "array.h"
 #include "xalloc.h"
 
+#define KMEANS_MAX_ITERATIONS   (100)
+
 extern uint32_t rng_randint(uint32_t min, uint32_t max);
 
-static cluster_t *cluster_alloc(int cx, int cy)
+static inline uint32_t kmeans_dist(int x0, int y0, int x1, int y1)
 {
-    cluster_t *c=NULL;
-    c = xalloc(sizeof(*c));
-    if (c != NULL) {
-        c->x = cx;
-        c->y = cy;
-        c->w = 0;
-        c->h = 0;
-        array_alloc(&c->points, NULL);
-    }
-    return c;
+    int dx = x0 - x1, dy = y0 - y1;
+    return (dx * dx) + (dy * dy);
 }
 
-static void cluster_free(void *c)
+// k-means++ seeding: the first center is a random point and each following center is a point
+// picked with a probability proportional to its squared distance to the nearest center so far.
+static void kmeans_seed(kmeans_t *km, const uint16_t *x, const uint16_t *y, int n, int k, uint32_t *d2)
 {
-    cluster_t *cl = c;
-    array_free(cl->points);
-    xfree(cl);
-}
+    int p = rng_randint(0, n - 1);
+    uint64_t sum = 0;
 
-static void cluster_reset(array_t *clusters, array_t *points)
-{
-    // Reset all clusters
-    for (int j=0; j<array_length(clusters); j++) {
-         cluster_t *cl = array_at(clusters, j);
-         while (array_length(cl->points)) {
-             array_push_back(points, array_pop_back(cl->points));
-         }
-         array_free(cl->points);
-         array_alloc(&cl->points, NULL);
+    km->k = 1;
+    km->x[0] = x[p];
+    km->y[0] = y[p];
+
+    for (int i = 0; i < n; i++) {
+        d2[i] = kmeans_dist(x[i], y[i], km->x[0], km->y[0]);
+        sum += d2[i];
     }
-}
 
-static int cluster_update(array_t *clusters)
-{
-    // Update clusters
-    for (int j=0; j<array_length(clusters); j++) {
-        cluster_t *cl = array_at(clusters, j);
-        int cx = cl->x, cy = cl->y;
-        int cl_size = array_length(cl->points);
-
-        // Sum all points in this cluster
-        for (int i=0; i<cl_size; i++) {
-            kp_t *p = array_at(cl->points, i);
-            cl->x += p->x;
-            cl->y += p->y;
-            // Find out the max x and y while we're at it
-            if (p->x > cl->w) {
-                cl->w = p->x;
-            }
-            if (p->y > cl->h) {
-                cl->h = p->y;
+    while (km->k < k) {
+        if (!sum) {
+            break; // All the points are on a center already, more clusters would be empty.
+        }
+
+        uint64_t r = (uint64_t) (((float) sum) * (rng_randint(0, 65535) / 65536.0f));
+        uint64_t acc = 0;
+        p = -1;
+
+        for (int i = 0; i < n; i++) {
+            if (d2[i]) {
+                p = i;
+                acc += d2[i];
+                if (acc > r) {
+                    break;
+                }
             }
         }
 
-        // Update centroid
-        cl->x = cl->x/cl_size;
-        cl->y = cl->y/cl_size;
-        // Update cluster size
-        cl->w = (cl->w - cl->x) * 2;
-        cl->h = (cl->h - cl->y) * 2;
-        if (cl->x == cx && cl->y == cy) {
-            // Cluster centroid did not change
-            return 0;
+        int cx = km->x[km->k] = x[p];
+        int cy = km->y[km->k] = y[p];
+        km->k += 1;
+        sum = 0;
+
+        for (int i = 0; i < n; i++) {
+            uint32_t d = kmeans_dist(x[i], y[i], cx, cy);
+            if (d < d2[i]) {
+                d2[i] = d;
+            }
+            sum += d2[i];
         }
     }
-
-    return 1;
 }
 
-static void cluster_points(array_t *clusters, array_t *points, cluster_dist_t dist_func)
+int imlib_kmeans(kmeans_t *km, const uint16_t *x, const uint16_t *y, int n, int k, int max_iter,
+                 uint8_t *labels, uint32_t *d2)
 {
-    // Add objects to cluster
-    while (array_length(points)) {
-        float distance = FLT_MAX;
-        cluster_t *cl_nearest = NULL;
-        kp_t *p = array_pop_back(points);
-
-        for (int j=0; j<array_length(clusters); j++) {
-            cluster_t *cl = array_at(clusters, j);
-            float d = dist_func(cl->x, cl->y, p);
-            if (d < distance) {
-                distance = d;
-                cl_nearest = cl;
+    km->k = 0;
+
+    // Checked first, n is also used as the size of the labels memset below.
+    if ((n <= 0) || (k <= 0)) {
+        return 0;
+    }
+
+    k = IM_MIN(k, IM_MIN(n, KMEANS_MAX_K));
+
+    kmeans_seed(km, x, y, n, k, d2);
+    k = km->k;
+    memset(labels, 0xFF, n);
+
+    int iter = 0;
+
+    while (iter < max_iter) {
+        uint64_t sum_x[KMEANS_MAX_K] = {0}, sum_y[KMEANS_MAX_K] = {0};
+        uint32_t count[KMEANS_MAX_K] = {0};
+        int changed = 0;
+
+        iter += 1;
+
+        for (int i = 0; i < n; i++) {
+            int px = x[i], py = y[i];
+            uint32_t best_d = UINT_MAX;
+            int best = 0;
+
+            for (int j = 0; j < k; j++) {
+                uint32_t d = kmeans_dist(px, py, km->x[j], km->y[j]);
+                if (d < best_d) {
+                    best_d = d;
+                    best = j;
+                }
             }
+
+            changed += labels[i] != best;
+            labels[i] = best;
+            sum_x[best] += px;
+            sum_y[best] += py;
+            count[best] += 1;
         }
-        // Add pointer to point to cluster.
-        // Note: Objects in the cluster are not free'd
-        array_push_back(cl_nearest->points, p);
+
+        // Integer centroids only move if some point moved, so no change means convergence.
+        if (!changed) {
+            break;
+        }
+
+        for (int j = 0; j < k; j++) {
+            if (count[j]) { // An empty cluster keeps its center.
+                km->x[j] = (sum_x[j] + (count[j] / 2)) / count[j];
+                km->y[j] = (sum_y[j] + (count[j] / 2)) / count[j];
+            }
+        }
+    }
+
+    // Cluster sizes, twice the largest distance of a point from the centroid on each axis.
+    for (int j = 0; j < k; j++) {
+        km->w[j] = 0;
+        km->h[j] = 0;
+        km->count[j] = 0;
     }
+
+    for (int i = 0; i < n; i++) {
+        int j = labels[i];
+        km->w[j] = IM_MAX(km->w[j], abs(x[i] - km->x[j]) * 2);
+        km->h[j] = IM_MAX(km->h[j], abs(y[i] - km->y[j]) * 2);
+        km->count[j] += 1;
+    }
+
+    return iter;
+}
+
+static void cluster_free(void *c)
+{
+    cluster_t *cl = c;
+    array_free(cl->points);
+    xfree(cl);
 }
 
-array_t *cluster_kmeans(array_t *points, int k, cluster_dist_t dist_func)
+array_t *cluster_kmeans(array_t *points, int k)
 {
     // Alloc clusters array
-    array_t *clusters=NULL;
+    array_t *clusters = NULL;
     array_alloc(&clusters, cluster_free);
 
-    // Select K clusters randomly
-    for (int i=0; i<k; i++) {
-        int pidx = rng_randint(0, array_length(points)-1);
-        kp_t *p = array_at(points, pidx);
-        array_push_back(clusters, cluster_alloc(p->x, p->y));
+    int n = array_length(points);
+
+    if ((n <= 0) || (k <= 0)) {
+        return clusters;
+    }
+
+    kmeans_t km;
+    uint16_t *x = fb_alloc(n * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *y = fb_alloc(n * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint8_t *labels = fb_alloc(n * sizeof(uint8_t), FB_ALLOC_NO_HINT);
+    uint32_t *d2 = fb_alloc(n * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (int i = 0; i < n; i++) {
+        kp_t *p = array_at(points, i);
+        x[i] = p->x;
+        y[i] = p->y;
     }
 
-    int cl_changed = 1;
-    do {
-        // Reset clusters
-        cluster_reset(clusters, points);
+    imlib_kmeans(&km, x, y, n, k, KMEANS_MAX_ITERATIONS, labels, d2);
 
-        // Add points to clusters
-        cluster_points(clusters, points, dist_func);
+    for (int j = 0; j < km.k; j++) {
+        if (!km.count[j]) {
+            continue;
+        }
 
-        // Update centroids
-        cl_changed = cluster_update(clusters);
+        cluster_t *cl = xalloc(sizeof(cluster_t));
+        cl->x = km.x[j];
+        cl->y = km.y[j];
+        cl->w = km.w[j];
+        cl->h = km.h[j];
+        array_alloc(&cl->points, NULL);
 
-    } while (cl_changed);
+        // Add pointer to point to cluster.
+        // Note: Objects in the cluster are not free'd
+        for (int i = 0; i < n; i++) {
+            if (labels[i] == j) {
+                array_push_back(cl->points, array_at(points, i));
+            }
+        }
+
+        array_push_back(clusters, cl);
+    }
 
+    fb_free(); // d2
+    fb_free(); // labels
+    fb_free(); // y
+    fb_free(); // x
     return clusters;
 }
@@ -60,11 +60,11 @@ uint8_t *imlib_lbp_desc(image_t *image, rectangle_t *roi)
     uint8_t *desc = xalloc0(LBP_DESC_SIZE);
 
     for (int y=roi->y; y<(roi->y+roi->h)-3; y++) {
-        int y_idx = ((y-roi->y)/RY)*LBP_NUM_REGIONS;
+        int y_idx = IM_MIN((y-roi->y)/RY, LBP_NUM_REGIONS-1)*LBP_NUM_REGIONS;
         for (int x=roi->x; x<(roi->x+roi->w)-3; x++) {
             uint8_t lbp=0;
             uint8_t p = data[(y+1)*s+x+1];
-            int hist_idx = y_idx+(x-roi->x)/RX;
+            int hist_idx = y_idx+IM_MIN((x-roi->x)/RX, LBP_NUM_REGIONS-1);
 
             lbp |= (data[(y+0)*s+x+0] >= p) << 0;
             lbp |= (data[(y+0)*s+x+1] >= p) << 1;
@@ -81,16 +81,216 @@ uint8_t *imlib_lbp_desc(image_t *image, rectangle_t *roi)
         return desc;
 }
 
+// Same result as the plain loop over all the bins with lbp_weights[i/LBP_HIST_SIZE], but regions
+// with a weight of 0 are skipped and 4 bins are compared at once (most bins are equal, often 0).
 int imlib_lbp_desc_distance(uint8_t *d0, uint8_t *d1)
 {
     uint32_t sum = 0;
-    for (int i=0; i<LBP_DESC_SIZE; i++) {
-        int w = lbp_weights[i/LBP_HIST_SIZE];
-        sum += w * ((((d0[i] - d1[i]) * (d0[i] - d1[i]))/IM_MAX((d0[i] + d1[i]),1)));
+
+    for (int r = 0; r < (LBP_NUM_REGIONS * LBP_NUM_REGIONS); r++, d0 += LBP_HIST_SIZE, d1 += LBP_HIST_SIZE) {
+        int w = lbp_weights[r];
+
+        if (!w) {
+            continue;
+        }
+
+        uint32_t region_sum = 0;
+        int i = 0;
+
+        for (; (i + 4) <= LBP_HIST_SIZE; i += 4) {
+            if (*((uint32_t *) (d0 + i)) == *((uint32_t *) (d1 + i))) {
+                continue;
+            }
+
+            for (int j = i; j < (i + 4); j++) {
+                int a = d0[j], b = d1[j];
+                if (a != b) {
+                    region_sum += ((a - b) * (a - b)) / (a + b);
+                }
+            }
+        }
+
+        for (; i < LBP_HIST_SIZE; i++) {
+            int a = d0[i], b = d1[i];
+            if (a != b) {
+                region_sum += ((a - b) * (a - b)) / (a + b);
+            }
+        }
+
+        sum += w * region_sum;
     }
+
     return sum;
 }
 
+void imlib_lbp_map_alloc(lbp_map_t *map, int cell_size)
+{
+    memset(map, 0, sizeof(lbp_map_t));
+    map->cell_size = IM_MAX(cell_size, 1);
+}
+
+void imlib_lbp_map_free(lbp_map_t *map)
+{
+    if (map->hist) {
+        xfree(map->hist);
+    }
+
+    imlib_lbp_map_alloc(map, map->cell_size);
+}
+
+void imlib_lbp_map_reset(lbp_map_t *map)
+{
+    map->valid = false;
+}
+
+// Adds the codes of the pixels of a row (anchored at their top-left neighbor like imlib_lbp_desc())
+// to the histograms of the cells of the row. The 8 comparisons are done for 4 pixels at a time.
+static void lbp_map_row(uint8_t *row_0, uint8_t *row_1, uint8_t *row_2, int w, int cell_size, uint16_t *cell_hist)
+{
+    int x = 0;
+
+    for (; (x + 4) <= w; x += 4) {
+        uint32_t p = *((uint32_t *) (row_1 + x + 1)), lbp = 0;
+        __USUB8(*((uint32_t *) (row_0 + x + 0)), p); lbp |= __SEL(0x01010101, 0);
+        __USUB8(*((uint32_t *) (row_0 + x + 1)), p); lbp |= __SEL(0x02020202, 0);
+        __USUB8(*((uint32_t *) (row_0 + x + 2)), p); lbp |= __SEL(0x04040404, 0);
+        __USUB8(*((uint32_t *) (row_1 + x + 2)), p); lbp |= __SEL(0x08080808, 0);
+        __USUB8(*((uint32_t *) (row_2 + x + 2)), p); lbp |= __SEL(0x10101010, 0);
+        __USUB8(*((uint32_t *) (row_2 + x + 1)), p); lbp |= __SEL(0x20202020, 0);
+        __USUB8(*((uint32_t *) (row_2 + x + 0)), p); lbp |= __SEL(0x40404040, 0);
+        __USUB8(*((uint32_t *) (row_1 + x + 0)), p); lbp |= __SEL(0x80808080, 0);
+
+        for (int i = 0; i < 4; i++, lbp >>= 8) {
+            cell_hist[(((x + i) / cell_size) * LBP_HIST_SIZE) + uniform_tbl[lbp & 0xFF]]++;
+        }
+    }
+
+    for (; x < w; x++) {
+        uint8_t lbp = 0;
+        uint8_t p = row_1[x + 1];
+
+        lbp |= (row_0[x + 0] >= p) << 0;
+        lbp |= (row_0[x + 1] >= p) << 1;
+        lbp |= (row_0[x + 2] >= p) << 2;
+        lbp |= (row_1[x + 2] >= p) << 3;
+        lbp |= (row_2[x + 2] >= p) << 4;
+        lbp |= (row_2[x + 1] >= p) << 5;
+        lbp |= (row_2[x + 0] >= p) << 6;
+        lbp |= (row_1[x + 0] >= p) << 7;
+
+        cell_hist[((x / cell_size) * LBP_HIST_SIZE) + uniform_tbl[lbp]]++;
+    }
+}
+
+void imlib_lbp_map_update(lbp_map_t *map, image_t *ptr)
+{
+    uint32_t hash = image_rows_hash(ptr, 0, ptr->h);
+
+    if (map->valid
+    && (map->hash == hash)
+    && (map->img.data == ptr->data)
+    && (map->img.w == ptr->w)
+    && (map->img.h == ptr->h)
+    && (map->img.bpp == ptr->bpp)) {
+        return;
+    }
+
+    map->valid = false;
+
+    int cell_size = map->cell_size;
+    int cells_w = (ptr->w + cell_size - 1) / cell_size;
+    int cells_h = (ptr->h + cell_size - 1) / cell_size;
+    int stride = (cells_w + 1) * LBP_HIST_SIZE;
+    size_t size = (cells_h + 1) * stride;
+
+    if (map->size < size) {
+        if (map->hist) {
+            xfree(map->hist);
+        }
+
+        map->hist = NULL; // in case xalloc fails
+        map->size = 0;
+        map->hist = xalloc(size * sizeof(uint16_t));
+        map->size = size;
+    }
+
+    map->cells_w = cells_w;
+    map->cells_h = cells_h;
+    memset(map->hist, 0, stride * sizeof(uint16_t)); // first row
+
+    uint16_t *cell_hist = fb_alloc(cells_w * LBP_HIST_SIZE * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    int w = IM_MAX(ptr->w - 2, 0), h = IM_MAX(ptr->h - 2, 0);
+
+    for (int cy = 0; cy < cells_h; cy++) {
+        memset(cell_hist, 0, cells_w * LBP_HIST_SIZE * sizeof(uint16_t));
+
+        for (int y = cy * cell_size, yy = IM_MIN(y + cell_size, h); y < yy; y++) {
+            lbp_map_row(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y),
+                        IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y + 1),
+                        IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y + 2),
+                        w, cell_size, cell_hist);
+        }
+
+        // Counts are kept modulo 2^16, the counts of any area (at most 2^16-1 pixels) are still
+        // exact after the subtractions in imlib_lbp_map_desc().
+        uint16_t *prev = map->hist + (cy * stride), *curr = prev + stride;
+        uint16_t acc[LBP_HIST_SIZE] = {0};
+        memset(curr, 0, LBP_HIST_SIZE * sizeof(uint16_t));
+
+        for (int cx = 0; cx < cells_w; cx++) {
+            uint16_t *hist = cell_hist + (cx * LBP_HIST_SIZE);
+            uint16_t *prev_hist = prev + ((cx + 1) * LBP_HIST_SIZE);
+            uint16_t *curr_hist = curr + ((cx + 1) * LBP_HIST_SIZE);
+
+            for (int b = 0; b < LBP_HIST_SIZE; b++) {
+                acc[b] += hist[b];
+                curr_hist[b] = prev_hist[b] + acc[b];
+            }
+        }
+    }
+
+    fb_free(); // cell_hist
+
+    map->img = *ptr;
+    map->hash = hash;
+    map->valid = true;
+}
+
+// Region edges are rounded to the cell grid of the map (exact for a cell_size of 1).
+uint8_t *imlib_lbp_map_desc(lbp_map_t *map, rectangle_t *roi)
+{
+    int cell_size = map->cell_size;
+    int stride = (map->cells_w + 1) * LBP_HIST_SIZE;
+    uint8_t *desc = xalloc0(LBP_DESC_SIZE);
+
+    for (int ry = 0; ry < LBP_NUM_REGIONS; ry++) {
+        int y0 = roi->y + ((ry * roi->h) / LBP_NUM_REGIONS);
+        int y1 = roi->y + (((ry + 1) * roi->h) / LBP_NUM_REGIONS);
+        int cy0 = IM_MIN((y0 + (cell_size / 2)) / cell_size, map->cells_h);
+        int cy1 = IM_MIN((y1 + (cell_size / 2)) / cell_size, map->cells_h);
+
+        for (int rx = 0; rx < LBP_NUM_REGIONS; rx++) {
+            int x0 = roi->x + ((rx * roi->w) / LBP_NUM_REGIONS);
+            int x1 = roi->x + (((rx + 1) * roi->w) / LBP_NUM_REGIONS);
+            int cx0 = IM_MIN((x0 + (cell_size / 2)) / cell_size, map->cells_w);
+            int cx1 = IM_MIN((x1 + (cell_size / 2)) / cell_size, map->cells_w);
+
+            uint16_t *h00 = map->hist + (cy0 * stride) + (cx0 * LBP_HIST_SIZE);
+            uint16_t *h01 = map->hist + (cy0 * stride) + (cx1 * LBP_HIST_SIZE);
+            uint16_t *h10 = map->hist + (cy1 * stride) + (cx0 * LBP_HIST_SIZE);
+            uint16_t *h11 = map->hist + (cy1 * stride) + (cx1 * LBP_HIST_SIZE);
+            uint8_t *region = desc + (((ry * LBP_NUM_REGIONS) + rx) * LBP_HIST_SIZE);
+
+            for (int b = 0; b < LBP_HIST_SIZE; b++) {
+                uint16_t count = h11[b] - h01[b] - h10[b] + h00[b];
+                region[b] = IM_MIN(count, 255);
+            }
+        }
+    }
+
+    return desc;
+}
+
 int imlib_lbp_desc_save(FIL *fp, uint8_t *desc)
 {
     UINT bytes;
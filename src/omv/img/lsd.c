@@ -167,6 +167,11 @@
                        'reg_img' image, when asked for.
                        Suggested value: NULL
 
+    @param buf         Pointer to memory for 2 x X x Y points, used for the
+                       sorted pixel list and the region being grown. If NULL
+                       it is allocated (and freed) by LSD.
+                       Suggested value: NULL
+
     @return            A float array of size 7 x n_out, containing the list
                        of line segments detected. The array contains first
                        7 values of line segment number 1, then the 7 values
@@ -182,12 +187,15 @@
                        line segment number 'n+1' are obtained with
                        'out[7*n+0]' to 'out[7*n+6]'.
  */
+struct lsd_point;
+
 float * LineSegmentDetection( int * n_out,
                                unsigned char * img, int X, int Y,
                                float scale, float sigma_scale, float quant,
                                float ang_th, float log_eps, float density_th,
                                int n_bins,
-                               int ** reg_img, int * reg_x, int * reg_y );
+                               int ** reg_img, int * reg_x, int * reg_y,
+                               struct lsd_point * buf );
 
 /*----------------------------------------------------------------------------*/
 /** LSD Simple Interface with Scale and Region output.
@@ -448,6 +456,12 @@ float * lsd(int * n_out, unsigned char * img, int X, int Y);
 #define NOTDEF -512.0f // -1024.0f
 #define NOTDEF_INT -29335
 
+/** Largest gradient norm of a 2x2 window of 8-bit pixels: sqrt(2*510^2)/2. */
+#define LSD_NORM_MAX 360
+
+/** Resolution of the integer gradient angle table. */
+#define LSD_ATAN_RES 128
+
 /** 3/2 pi */
 #define M_3_2_PI 4.71238898038f
 
@@ -1098,6 +1112,41 @@ static image_double gaussian_sampler( image_double in, float scale,
 /*--------------------------------- Gradient ---------------------------------*/
 /*----------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------*/
+/** atan(i/LSD_ATAN_RES) in 1/64 degrees for i in [0,LSD_ATAN_RES].
+ */
+static const uint16_t ll_atan_table[LSD_ATAN_RES+1] = {
+     0,   29,   57,   86,  115,  143,  172,  200,  229,  257,  286,  314,
+   343,  371,  399,  428,  456,  484,  512,  540,  568,  596,  624,  652,
+   680,  707,  735,  762,  790,  817,  844,  871,  898,  925,  952,  979,
+  1005, 1032, 1058, 1085, 1111, 1137, 1163, 1188, 1214, 1240, 1265, 1290,
+  1316, 1341, 1366, 1390, 1415, 1440, 1464, 1488, 1512, 1536, 1560, 1584,
+  1607, 1631, 1654, 1677, 1700, 1723, 1746, 1768, 1791, 1813, 1835, 1857,
+  1879, 1901, 1922, 1944, 1965, 1986, 2007, 2028, 2048, 2069, 2089, 2109,
+  2130, 2150, 2169, 2189, 2209, 2228, 2247, 2266, 2285, 2304, 2323, 2341,
+  2360, 2378, 2396, 2414, 2432, 2450, 2467, 2485, 2502, 2519, 2536, 2553,
+  2570, 2587, 2603, 2620, 2636, 2652, 2668, 2684, 2700, 2715, 2731, 2746,
+  2762, 2777, 2792, 2807, 2822, 2837, 2851, 2866, 2880,
+};
+
+/*----------------------------------------------------------------------------*/
+/** Integer atan2(y,x) in degrees, in the range [-180,180].
+
+    The gradient components are integers, so the angle comes from an
+    octant reduction and a table lookup (accurate to a quarter degree)
+    instead of the float atan2. (x,y) must not be (0,0).
+ */
+static int ll_atan2( int y, int x )
+{
+  int ax = abs(x), ay = abs(y);
+  int a = (ay <= ax) ? ll_atan_table[((ay * LSD_ATAN_RES) + (ax / 2)) / ax]
+                     : (90 * 64) - ll_atan_table[((ax * LSD_ATAN_RES) + (ay / 2)) / ay];
+
+  if( x < 0 ) a = (180 * 64) - a;
+  a = (a + 32) >> 6;
+  return (y < 0) ? -a : a;
+}
+
 /*----------------------------------------------------------------------------*/
 /** Computes the direction of the level line of 'in' at each point.
 
@@ -1105,41 +1154,29 @@ static image_double gaussian_sampler( image_double in, float scale,
     - an image_int with the angle at each pixel, or NOTDEF if not defined.
     - the image_int 'modgrad' (a pointer is passed as argument)
       with the gradient magnitude at each point.
-    - a list of pixels 'list_p' roughly ordered by decreasing
-      gradient magnitude. (The order is made by classifying points
-      into bins by gradient magnitude. The parameters 'n_bins' and
-      'max_grad' specify the number of bins and the gradient modulus
-      at the highest bin. The pixels in the list would be in
-      decreasing gradient magnitude, up to a precision of the size of
-      the bins.)
-    - a pointer 'mem_p' to the memory used by 'list_p' to be able to
-      free the memory when it is not used anymore.
+    - a list of the pixels with a defined angle 'list' (of 'list_size'
+      points) ordered by decreasing gradient magnitude. The caller provides
+      the list memory, which must hold (in->xsize-1)*(in->ysize-1) points.
  */
 static image_int ll_angle( image_char in, float threshold,
-                           struct coorlist ** list_p, void ** mem_p,
-                           image_int * modgrad, unsigned int n_bins )
+                           struct lsd_point * list, int * list_size,
+                           image_int * modgrad )
 {
   image_int g;
   unsigned int n,p,x,y,adr,i;
-  float com1,com2,gx,gy,norm,norm2;
-  /* the rest of the variables are used for pseudo-ordering
+  int gx,gy,norm2,threshold2;
+  /* the rest of the variables are used for ordering
      the gradient magnitude values */
-  int list_count = 0;
-  struct coorlist * list;
-  struct coorlist ** range_l_s; /* array of pointers to start of bin list */
-  struct coorlist ** range_l_e; /* array of pointers to end of bin list */
-  struct coorlist * start;
-  struct coorlist * end;
-  float max_grad = 0.0;
+  uint32_t * bins; /* number of points, then next free slot, of each magnitude */
+  uint32_t sum;
 
   /* check parameters */
   if( in == NULL || in->data == NULL || in->xsize == 0 || in->ysize == 0 )
     error("ll_angle: invalid image.");
   if( threshold < 0.0 ) error("ll_angle: 'threshold' must be positive.");
-  if( list_p == NULL ) error("ll_angle: NULL pointer 'list_p'.");
-  if( mem_p == NULL ) error("ll_angle: NULL pointer 'mem_p'.");
+  if( list == NULL ) error("ll_angle: NULL pointer 'list'.");
+  if( list_size == NULL ) error("ll_angle: NULL pointer 'list_size'.");
   if( modgrad == NULL ) error("ll_angle: NULL pointer 'modgrad'.");
-  if( n_bins == 0 ) error("ll_angle: 'n_bins' must be positive.");
 
   /* image size shortcuts */
   n = in->ysize;
@@ -1148,30 +1185,23 @@ static image_int ll_angle( image_char in, float threshold,
   /* allocate output image */
   g = new_image_int(in->xsize,in->ysize);
 
-  /* get memory for the image of gradient modulus */
+  /* get memory for the image of gradient modulus (zeroed) */
   *modgrad = new_image_int(in->xsize,in->ysize);
 
-  /* get memory for "ordered" list of pixels */
-  list = (struct coorlist *) calloc( (size_t) (n*p), sizeof(struct coorlist) );
-  *mem_p = (void *) list;
-  range_l_s = (struct coorlist **) calloc( (size_t) n_bins,
-                                           sizeof(struct coorlist *) );
-  range_l_e = (struct coorlist **) calloc( (size_t) n_bins,
-                                           sizeof(struct coorlist *) );
-  if( list == NULL || range_l_s == NULL || range_l_e == NULL )
-    error("not enough memory.");
-  for(i=0;i<n_bins;i++) range_l_s[i] = range_l_e[i] = NULL;
+  /* get memory for the magnitude histogram */
+  bins = (uint32_t *) calloc( (size_t) (LSD_NORM_MAX+1), sizeof(uint32_t) );
+
+  /* norm <= threshold  <=>  gx^2 + gy^2 <= 4 * threshold^2 */
+  threshold2 = (int) (4.0f * threshold * threshold);
 
   /* 'undefined' on the down and right boundaries */
-  for(x=0;x<p;x++) g->data[(n-1)*p+x] = NOTDEF;
-  for(y=0;y<n;y++) g->data[p*y+p-1]   = NOTDEF;
+  for(x=0;x<p;x++) g->data[(n-1)*p+x] = NOTDEF_INT;
+  for(y=0;y<n;y++) g->data[p*y+p-1]   = NOTDEF_INT;
 
   /* compute gradient on the remaining pixels */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
+  for(y=0;y<n-1;y++)
+    for(x=0,adr=y*p;x<p-1;x++,adr++)
       {
-        adr = y*p+x;
-
         /*
            Norm 2 computation using 2x2 pixel window:
              A B
@@ -1183,72 +1213,50 @@ static image_int ll_angle( image_char in, float threshold,
              gy = C+D - (A+B)   vertical difference
            com1 and com2 are just to avoid 2 additions.
          */
-        com1 = in->data[adr+p+1] - in->data[adr];
-        com2 = in->data[adr+1]   - in->data[adr+p];
+        int com1 = in->data[adr+p+1] - in->data[adr];
+        int com2 = in->data[adr+1]   - in->data[adr+p];
 
         gx = com1+com2; /* gradient x component */
         gy = com1-com2; /* gradient y component */
         norm2 = gx*gx+gy*gy;
-        norm = sqrt( norm2 / 4.0 ); /* gradient norm */
 
-        (*modgrad)->data[adr] = norm; /* store gradient norm */
-
-        if( norm <= threshold ) /* norm too small, gradient no defined */
-          g->data[adr] = NOTDEF_INT; //radToDeg(NOTDEF); /* gradient angle not defined */
+        if( norm2 <= threshold2 ) /* norm too small, gradient no defined */
+          g->data[adr] = NOTDEF_INT; /* gradient angle not defined */
         else
           {
-            /* gradient angle computation */
-            g->data[adr] = radToDeg(atan2(gx,-gy));
+            int norm = fast_sqrtf(norm2) * 0.5f; /* gradient norm */
+            (*modgrad)->data[adr] = norm; /* store gradient norm */
+            bins[norm]++;
 
-            /* look for the maximum of the gradient */
-            if( norm > max_grad ) max_grad = norm;
+            /* gradient angle computation */
+            g->data[adr] = ll_atan2( gx, -gy );
           }
       }
 
-  /* compute histogram of gradient values */
-  for(x=0;x<p-1;x++)
-    for(y=0;y<n-1;y++)
-      {
-        norm = (*modgrad)->data[y*p+x];
-
-        /* store the point in the right bin according to its norm */
-        i = (unsigned int) (norm * (float) n_bins / max_grad);
-        if( i >= n_bins ) i = n_bins-1;
-        if( range_l_e[i] == NULL )
-          range_l_s[i] = range_l_e[i] = list+list_count++;
-        else
-          {
-            range_l_e[i]->next = list+list_count;
-            range_l_e[i] = list+list_count++;
-          }
-        range_l_e[i]->x = (int) x;
-        range_l_e[i]->y = (int) y;
-        range_l_e[i]->next = NULL;
-      }
+  /* The gradient norms are integers no larger than LSD_NORM_MAX, so a
+     bin per norm value sorts the pixels exactly by decreasing norm. This
+     is never coarser than the original pseudo-ordering of n_bins bins.
+     Only pixels with a defined angle can start a region, the others are
+     not stored. */
+  for(i=LSD_NORM_MAX+1,sum=0; i-->0;)
+    {
+      uint32_t count = bins[i];
+      bins[i] = sum;
+      sum += count;
+    }
+  *list_size = (int) sum;
 
-  /* Make the list of pixels (almost) ordered by norm value.
-     It starts by the larger bin, so the list starts by the
-     pixels with the highest gradient value. Pixels would be ordered
-     by norm value, up to a precision given by max_grad/n_bins.
-   */
-  for(i=n_bins-1; i>0 && range_l_s[i]==NULL; i--);
-  start = range_l_s[i];
-  end = range_l_e[i];
-  if( start != NULL )
-    while(i>0)
-      {
-        --i;
-        if( range_l_s[i] != NULL )
-          {
-            end->next = range_l_s[i];
-            end = range_l_e[i];
-          }
-      }
-  *list_p = start;
+  for(y=0;y<n-1;y++)
+    for(x=0,adr=y*p;x<p-1;x++,adr++)
+      if( g->data[adr] != NOTDEF_INT )
+        {
+          struct lsd_point * point = list + bins[(*modgrad)->data[adr]]++;
+          point->x = (int16_t) x;
+          point->y = (int16_t) y;
+        }
 
   /* free memory */
-  free( (void *) range_l_s );
-  free( (void *) range_l_e );
+  free( (void *) bins );
 
   return g;
 }
@@ -2512,7 +2520,8 @@ float * LineSegmentDetection( int * n_out,
                                float scale, float sigma_scale, float quant,
                                float ang_th, float log_eps, float density_th,
                                int n_bins,
-                               int ** reg_img, int * reg_x, int * reg_y )
+                               int ** reg_img, int * reg_x, int * reg_y,
+                               struct lsd_point * buf )
 {
   image_char image;
   ntuple_list out = new_ntuple_list(7);
@@ -2520,11 +2529,11 @@ float * LineSegmentDetection( int * n_out,
   image_int scaled_image,angles,modgrad;
   image_char used;
   image_int region = NULL;
-  struct coorlist * list_p;
-  void * mem_p;
-  struct rect rec;
+  struct lsd_point * list_p;
   struct lsd_point * reg;
-  int reg_size,min_reg_size,i;
+  struct rect rec;
+  int list_size,reg_size,min_reg_size,i;
+  int free_buf = (buf == NULL);
   unsigned int xsize,ysize;
   float rho,reg_angle,prec,p,log_nfa,logNT;
   int ls_count = 0;                   /* line segments are numbered 1,2,3,... */
@@ -2548,18 +2557,22 @@ float * LineSegmentDetection( int * n_out,
   rho = quant / sin(prec); /* gradient magnitude threshold */
 
 
+  /* the sorted pixel list and the region need X*Y points each */
+  if( free_buf )
+    buf = (struct lsd_point *) malloc( (size_t) (2*X*Y) * sizeof(struct lsd_point) );
+  list_p = buf;
+  reg = buf + (X*Y);
+
   /* load and scale image (if necessary) and compute angle at each pixel */
   image = new_image_char_ptr( (unsigned int) X, (unsigned int) Y, img );
 //  if( scale != 1.0 )
 //    {
 //      scaled_image = gaussian_sampler( image, scale, sigma_scale );
-//      angles = ll_angle( scaled_image, rho, &list_p, &mem_p,
-//                         &modgrad, (unsigned int) n_bins );
+//      angles = ll_angle( scaled_image, rho, list_p, &list_size, &modgrad );
 //      free_image_double(scaled_image);
 //    }
 //  else
-    angles = ll_angle( image, rho, &list_p, &mem_p, &modgrad,
-                       (unsigned int) n_bins );
+    angles = ll_angle( image, rho, list_p, &list_size, &modgrad );
   xsize = angles->xsize;
   ysize = angles->ysize;
 
@@ -2586,17 +2599,12 @@ float * LineSegmentDetection( int * n_out,
 //  if( reg_img != NULL && reg_x != NULL && reg_y != NULL ) /* save region data */
 //    region = new_image_int_ini(angles->xsize,angles->ysize,0);
   used = new_image_char_ini(xsize,ysize,NOTUSED);
-  reg = (struct lsd_point *) calloc( (size_t) (xsize*ysize), sizeof(struct lsd_point) );
-  if( reg == NULL ) error("not enough memory!");
 
 
   /* search for line segments */
-  for(; list_p != NULL; list_p = list_p->next )
-    if( used->data[ list_p->x + list_p->y * used->xsize ] == NOTUSED &&
-        angles->data[ list_p->x + list_p->y * angles->xsize ] != NOTDEF_INT )
-//        degToRad(angles->data[ list_p->x + list_p->y * angles->xsize ]) != NOTDEF )
-       /* there is no risk of float comparison problems here
-          because we are only interested in the exact NOTDEF value */
+  for(; list_size > 0; list_size--, list_p++ )
+    /* all the listed pixels have a defined angle */
+    if( used->data[ list_p->x + list_p->y * used->xsize ] == NOTUSED )
       {
         /* find the region of connected point and ~equal angle */
         region_grow( list_p->x, list_p->y, angles, reg, &reg_size,
@@ -2661,8 +2669,7 @@ float * LineSegmentDetection( int * n_out,
   free_image_int(angles);
   free_image_int(modgrad);
   free_image_char(used);
-  free( (void *) reg );
-  free( (void *) mem_p );
+  if( free_buf ) free( (void *) buf );
 
 //  /* return the result */
 //  if( reg_img != NULL && reg_x != NULL && reg_y != NULL )
@@ -2712,7 +2719,7 @@ float * lsd_scale_region( int * n_out,
 
   return LineSegmentDetection( n_out, img, X, Y, scale, sigma_scale, quant,
                                ang_th, log_eps, density_th, n_bins,
-                               reg_img, reg_x, reg_y );
+                               reg_img, reg_x, reg_y, NULL );
 }
 
 /*----------------------------------------------------------------------------*/
@@ -2743,6 +2750,8 @@ void imlib_lsd_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, u
 {
     uint8_t *grayscale_image = fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
     uint8_t *grayscale_image_tmp = grayscale_image;
+    // Sorted pixel list and region buffer, these are the largest LSD allocations.
+    struct lsd_point *points = fb_alloc(2 * roi->w * roi->h * sizeof(struct lsd_point), FB_ALLOC_NO_HINT);
     umm_init_x(fb_avail());
 
     switch(ptr->bpp) {
@@ -2780,7 +2789,7 @@ void imlib_lsd_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, u
     }
 
     int n_ls;
-    float *ls = LineSegmentDetection(&n_ls, grayscale_image_tmp, roi->w, roi->h, 0.8, 0.6, 2.0, 22.5, 0.0, 0.7, 1024, NULL, NULL, NULL);
+    float *ls = LineSegmentDetection(&n_ls, grayscale_image_tmp, roi->w, roi->h, 0.8, 0.6, 2.0, 22.5, 0.0, 0.7, 1024, NULL, NULL, NULL, points);
     list_init(out, sizeof(find_lines_list_lnk_data_t));
 
     for (int i = 0, j = n_ls; i < j; i++) {
@@ -2817,6 +2826,7 @@ void imlib_lsd_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, u
     }
 
     fb_free(); // umm_init_x();
+    fb_free(); // points;
     fb_free(); // grayscale_image;
 }
 
@@ -9,96 +9,141 @@
  * Image math operations.
  */
 #include "imlib.h"
+#include "common.h"
+#include "pixel_loop.h"
 
 #ifdef IMLIB_ENABLE_MATH_OPS
-void imlib_gamma_corr(image_t *img, float gamma, float contrast, float brightness)
+// The tables only change when the settings do, so they're kept for the next call (and the
+// sensor line callback uses a copy of them).
+static gamma_lut_t gamma_lut;
+static bool gamma_lut_valid = false;
+
+const gamma_lut_t *imlib_gamma_lut(float gamma, float contrast, float brightness)
 {
+    if (gamma_lut_valid && (gamma_lut.gamma == gamma)
+            && (gamma_lut.contrast == contrast) && (gamma_lut.brightness == brightness)) {
+        return &gamma_lut;
+    }
+
+    gamma_lut.gamma = gamma;
+    gamma_lut.contrast = contrast;
+    gamma_lut.brightness = brightness;
     gamma = IM_DIV(1.0, gamma);
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            float pScale = COLOR_BINARY_MAX - COLOR_BINARY_MIN;
-            float pDiv = 1 / pScale;
-            int *p_lut = fb_alloc((COLOR_BINARY_MAX - COLOR_BINARY_MIN + 1) * sizeof(int), FB_ALLOC_NO_HINT);
 
-            for (int i = COLOR_BINARY_MIN; i <= COLOR_BINARY_MAX; i++) {
-                int p = ((fast_powf(i * pDiv, gamma) * contrast) + brightness) * pScale;
-                p_lut[i] = IM_MIN(IM_MAX(p , COLOR_BINARY_MIN), COLOR_BINARY_MAX);
-            }
+    float pScale = COLOR_BINARY_MAX - COLOR_BINARY_MIN;
+    float pDiv = 1 / pScale;
+    for (int i = COLOR_BINARY_MIN; i <= COLOR_BINARY_MAX; i++) {
+        int p = ((fast_powf(i * pDiv, gamma) * contrast) + brightness) * pScale;
+        gamma_lut.binary[i] = IM_MIN(IM_MAX(p , COLOR_BINARY_MIN), COLOR_BINARY_MAX);
+    }
 
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint32_t *data = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, x);
-                    int p = p_lut[dataPixel];
-                    IMAGE_PUT_BINARY_PIXEL_FAST(data, x, p);
-                }
-            }
+    pScale = COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN;
+    pDiv = 1 / pScale;
+    for (int i = COLOR_GRAYSCALE_MIN; i <= COLOR_GRAYSCALE_MAX; i++) {
+        int p = ((fast_powf(i * pDiv, gamma) * contrast) + brightness) * pScale;
+        gamma_lut.grayscale[i] = IM_MIN(IM_MAX(p , COLOR_GRAYSCALE_MIN), COLOR_GRAYSCALE_MAX);
+    }
 
-            fb_free();
+    float rScale = COLOR_R5_MAX - COLOR_R5_MIN;
+    float gScale = COLOR_G6_MAX - COLOR_G6_MIN;
+    float bScale = COLOR_B5_MAX - COLOR_B5_MIN;
+    float rDiv = 1 / rScale;
+    float gDiv = 1 / gScale;
+    float bDiv = 1 / bScale;
+
+    for (int i = COLOR_R5_MIN; i <= COLOR_R5_MAX; i++) {
+        int r = ((fast_powf(i * rDiv, gamma) * contrast) + brightness) * rScale;
+        gamma_lut.r5[i] = IM_MIN(IM_MAX(r , COLOR_R5_MIN), COLOR_R5_MAX);
+    }
+
+    for (int i = COLOR_G6_MIN; i <= COLOR_G6_MAX; i++) {
+        int g = ((fast_powf(i * gDiv, gamma) * contrast) + brightness) * gScale;
+        gamma_lut.g6[i] = IM_MIN(IM_MAX(g , COLOR_G6_MIN), COLOR_G6_MAX);
+    }
+
+    for (int i = COLOR_B5_MIN; i <= COLOR_B5_MAX; i++) {
+        int b = ((fast_powf(i * bDiv, gamma) * contrast) + brightness) * bScale;
+        gamma_lut.b5[i] = IM_MIN(IM_MAX(b , COLOR_B5_MIN), COLOR_B5_MAX);
+    }
+
+    gamma_lut_valid = true;
+    return &gamma_lut;
+}
+
+void imlib_gamma_lut_line(const gamma_lut_t *lut, int bpp, void *line, int w)
+{
+    switch(bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *data = (uint32_t *) line;
+            for (int x = 0; x < w; x++) {
+                IMAGE_PUT_BINARY_PIXEL_FAST(data, x, lut->binary[IMAGE_GET_BINARY_PIXEL_FAST(data, x)]);
+            }
             break;
         }
         case IMAGE_BPP_GRAYSCALE: {
-            float pScale = COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN;
-            float pDiv = 1 / pScale;
-            int *p_lut = fb_alloc((COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1) * sizeof(int), FB_ALLOC_NO_HINT);
-
-            for (int i = COLOR_GRAYSCALE_MIN; i <= COLOR_GRAYSCALE_MAX; i++) {
-                int p = ((fast_powf(i * pDiv, gamma) * contrast) + brightness) * pScale;
-                p_lut[i] = IM_MIN(IM_MAX(p , COLOR_GRAYSCALE_MIN), COLOR_GRAYSCALE_MAX);
-            }
-
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *data = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, x);
-                    int p = p_lut[dataPixel];
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, x, p);
-                }
+            uint8_t *data = (uint8_t *) line;
+            for (int x = 0; x < w; x++) {
+                data[x] = lut->grayscale[data[x]];
             }
-
-            fb_free();
             break;
         }
         case IMAGE_BPP_RGB565: {
-            float rScale = COLOR_R5_MAX - COLOR_R5_MIN;
-            float gScale = COLOR_G6_MAX - COLOR_G6_MIN;
-            float bScale = COLOR_B5_MAX - COLOR_B5_MIN;
-            float rDiv = 1 / rScale;
-            float gDiv = 1 / gScale;
-            float bDiv = 1 / bScale;
-            int *r_lut = fb_alloc((COLOR_R5_MAX - COLOR_R5_MIN + 1) * sizeof(int), FB_ALLOC_NO_HINT);
-            int *g_lut = fb_alloc((COLOR_G6_MAX - COLOR_G6_MIN + 1) * sizeof(int), FB_ALLOC_NO_HINT);
-            int *b_lut = fb_alloc((COLOR_B5_MAX - COLOR_B5_MIN + 1) * sizeof(int), FB_ALLOC_NO_HINT);
-
-            for (int i = COLOR_R5_MIN; i <= COLOR_R5_MAX; i++) {
-                int r = ((fast_powf(i * rDiv, gamma) * contrast) + brightness) * rScale;
-                r_lut[i] = IM_MIN(IM_MAX(r , COLOR_R5_MIN), COLOR_R5_MAX);
+            uint16_t *data = (uint16_t *) line;
+            for (int x = 0; x < w; x++) {
+                int dataPixel = data[x];
+                int r = lut->r5[COLOR_RGB565_TO_R5(dataPixel)];
+                int g = lut->g6[COLOR_RGB565_TO_G6(dataPixel)];
+                int b = lut->b5[COLOR_RGB565_TO_B5(dataPixel)];
+                data[x] = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
             }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
 
-            for (int i = COLOR_G6_MIN; i <= COLOR_G6_MAX; i++) {
-                int g = ((fast_powf(i * gDiv, gamma) * contrast) + brightness) * gScale;
-                g_lut[i] = IM_MIN(IM_MAX(g , COLOR_G6_MIN), COLOR_G6_MAX);
-            }
+void imlib_gamma_corr(image_t *img, float gamma, float contrast, float brightness)
+{
+    const gamma_lut_t *lut = imlib_gamma_lut(gamma, contrast, brightness);
 
-            for (int i = COLOR_B5_MIN; i <= COLOR_B5_MAX; i++) {
-                int b = ((fast_powf(i * bDiv, gamma) * contrast) + brightness) * bScale;
-                b_lut[i] = IM_MIN(IM_MAX(b , COLOR_B5_MIN), COLOR_B5_MAX);
-            }
+    #if defined(IMLIB_ENABLE_GAMMA_LUT_RGB565)
+    // A table indexed by the whole pixel needs a single lookup per pixel, but it takes as long
+    // to build as correcting 64K pixels the other way, so only large images are worth it.
+    uint32_t size = (UINT16_MAX + 1) * sizeof(uint16_t);
+    if ((img->bpp == IMAGE_BPP_RGB565) && ((img->w * img->h) >= (UINT16_MAX + 1) * 2)
+            && (fb_avail() >= (size + 64))) {
+        uint16_t *rgb_lut = fb_alloc(size, FB_ALLOC_NO_HINT);
+
+        for (int i = 0; i <= UINT16_MAX; i++) {
+            rgb_lut[i] = i;
+        }
+
+        imlib_gamma_lut_line(lut, IMAGE_BPP_RGB565, rgb_lut, UINT16_MAX + 1);
+
+        for (uint16_t *start = (uint16_t *) img->data, *end = start + (img->w * img->h); start < end; start++) {
+            *start = rgb_lut[*start];
+        }
+
+        fb_free();
+        return;
+    }
+    #endif
 
+    switch(img->bpp) {
+        case IMAGE_BPP_BINARY: {
             for (int y = 0, yy = img->h; y < yy; y++) {
-                uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, x);
-                    int r = r_lut[COLOR_RGB565_TO_R5(dataPixel)];
-                    int g = g_lut[COLOR_RGB565_TO_G6(dataPixel)];
-                    int b = b_lut[COLOR_RGB565_TO_B5(dataPixel)];
-                    IMAGE_PUT_RGB565_PIXEL_FAST(data, x, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
-                }
+                imlib_gamma_lut_line(lut, img->bpp, IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y), img->w);
             }
-
-            fb_free();
-            fb_free();
-            fb_free();
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            imlib_gamma_lut_line(lut, img->bpp, img->data, img->w * img->h);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            imlib_gamma_lut_line(lut, img->bpp, img->data, img->w * img->h);
             break;
         }
         default: {
@@ -257,58 +302,162 @@ void imlib_replace(image_t *img, const char *path, image_t *other, int scalar, b
     }
 }
 
-static void imlib_add_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+typedef enum mathop_rgb565_op {
+    MATHOP_RGB565_ADD,
+    MATHOP_RGB565_SUB,
+    MATHOP_RGB565_RSUB,
+    MATHOP_RGB565_DIFFERENCE,
+    MATHOP_RGB565_MIN,
+    MATHOP_RGB565_MAX,
+} mathop_rgb565_op_t;
+
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+// RGB565 SIMD kernels keep each channel at the top of its own byte lane so that the saturating
+// byte instructions saturate at the channel max. Red and blue of two pixels share one word and
+// green gets a word of its own, or shares it with the next two pixels in the quad pixel loop.
+ALWAYS_INLINE static uint32_t mathop_rgb565_to_rb(uint32_t p)
 {
-    image_t *mask = (image_t *) data;
+    return (p & 0x00F800F8) | ((p & 0x1F001F00) << 3);
+}
 
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            uint32_t *data = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_BINARY_PIXEL_FAST(((uint32_t *) other), i);
-                    int p = dataPixel | otherPixel; //dataPixel + otherPixel;
-//                    p = IM_MIN(p, COLOR_BINARY_MAX);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(data, i, p);
-                }
-            }
-            break;
+ALWAYS_INLINE static uint32_t mathop_rgb565_to_g(uint32_t p)
+{
+    return ((p & 0x00070007) << 5) | ((p >> 11) & 0x001C001C);
+}
+
+ALWAYS_INLINE static uint32_t mathop_rgb565_from_lanes(uint32_t rb, uint32_t g)
+{
+    return (rb & 0x00F800F8) | ((rb >> 3) & 0x1F001F00) | ((g >> 5) & 0x00070007) | ((g << 11) & 0xE000E000);
+}
+
+ALWAYS_INLINE static uint32_t mathop_rgb565_lanes(uint32_t a, uint32_t b, mathop_rgb565_op_t op)
+{
+    switch (op) {
+        case MATHOP_RGB565_ADD: {
+            return __UQADD8(a, b);
         }
-        case IMAGE_BPP_GRAYSCALE: {
-            uint8_t *data = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(((uint8_t *) other), i);
-                    int p = dataPixel + otherPixel;
-                    p = IM_MIN(p, COLOR_GRAYSCALE_MAX);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, i, p);
-                }
-            }
-            break;
+        case MATHOP_RGB565_SUB: {
+            return __UQSUB8(a, b);
         }
-        case IMAGE_BPP_RGB565: {
-            uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_RGB565_PIXEL_FAST(((uint16_t *) other), i);
-                    int r = COLOR_RGB565_TO_R5(dataPixel) + COLOR_RGB565_TO_R5(otherPixel);
-                    int g = COLOR_RGB565_TO_G6(dataPixel) + COLOR_RGB565_TO_G6(otherPixel);
-                    int b = COLOR_RGB565_TO_B5(dataPixel) + COLOR_RGB565_TO_B5(otherPixel);
-                    r = IM_MIN(r, COLOR_R5_MAX);
-                    g = IM_MIN(g, COLOR_G6_MAX);
-                    b = IM_MIN(b, COLOR_B5_MAX);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(data, i, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
-                }
-            }
-            break;
+        case MATHOP_RGB565_RSUB: {
+            return __UQSUB8(b, a);
         }
-        default: {
-            break;
+        case MATHOP_RGB565_DIFFERENCE: {
+            return __UQSUB8(a, b) | __UQSUB8(b, a);
+        }
+        case MATHOP_RGB565_MIN: {
+            __USUB8(a, b);
+            return __SEL(b, a);
+        }
+        case MATHOP_RGB565_MAX: {
+            __USUB8(a, b);
+            return __SEL(a, b);
         }
     }
+    return a;
+}
+
+// Lanes hold up to 248, so the weighted sums still fit in the 16-bit halves.
+ALWAYS_INLINE static uint32_t mathop_rgb565_lanes_blend(uint32_t a, uint32_t b, uint32_t alpha)
+{
+    uint32_t beta = 256 - alpha;
+    uint32_t even = (((__UXTB16(a) * alpha) + (__UXTB16(b) * beta)) >> 8) & 0x00FF00FF;
+    uint32_t odd = (((__UXTB16(__ROR(a, 8)) * alpha) + (__UXTB16(__ROR(b, 8)) * beta)) >> 8) & 0x00FF00FF;
+    return even | (odd << 8);
+}
+
+// Returns the number of pixels done, the rest are left to the caller.
+ALWAYS_INLINE static int mathop_rgb565_line(uint16_t *data, const uint16_t *other, int w,
+                                            mathop_rgb565_op_t op, bool blend, uint32_t alpha)
+{
+    int x = 0;
+
+    for (; x < (w - 3); x += 4) {
+        uint32_t d0 = __UNALIGNED_UINT32_READ(data + x), d1 = __UNALIGNED_UINT32_READ(data + x + 2);
+        uint32_t o0 = __UNALIGNED_UINT32_READ(other + x), o1 = __UNALIGNED_UINT32_READ(other + x + 2);
+        uint32_t dg = mathop_rgb565_to_g(d0) | (mathop_rgb565_to_g(d1) << 8);
+        uint32_t og = mathop_rgb565_to_g(o0) | (mathop_rgb565_to_g(o1) << 8);
+        uint32_t rb0, rb1, g;
+        if (blend) {
+            rb0 = mathop_rgb565_lanes_blend(mathop_rgb565_to_rb(d0), mathop_rgb565_to_rb(o0), alpha);
+            rb1 = mathop_rgb565_lanes_blend(mathop_rgb565_to_rb(d1), mathop_rgb565_to_rb(o1), alpha);
+            g = mathop_rgb565_lanes_blend(dg, og, alpha);
+        } else {
+            rb0 = mathop_rgb565_lanes(mathop_rgb565_to_rb(d0), mathop_rgb565_to_rb(o0), op);
+            rb1 = mathop_rgb565_lanes(mathop_rgb565_to_rb(d1), mathop_rgb565_to_rb(o1), op);
+            g = mathop_rgb565_lanes(dg, og, op);
+        }
+        __UNALIGNED_UINT32_WRITE(data + x, mathop_rgb565_from_lanes(rb0, g));
+        __UNALIGNED_UINT32_WRITE(data + x + 2, mathop_rgb565_from_lanes(rb1, g >> 8));
+    }
+
+    if (x < (w - 1)) {
+        uint32_t d = __UNALIGNED_UINT32_READ(data + x), o = __UNALIGNED_UINT32_READ(other + x);
+        uint32_t rb, g;
+        if (blend) {
+            rb = mathop_rgb565_lanes_blend(mathop_rgb565_to_rb(d), mathop_rgb565_to_rb(o), alpha);
+            g = mathop_rgb565_lanes_blend(mathop_rgb565_to_g(d), mathop_rgb565_to_g(o), alpha);
+        } else {
+            rb = mathop_rgb565_lanes(mathop_rgb565_to_rb(d), mathop_rgb565_to_rb(o), op);
+            g = mathop_rgb565_lanes(mathop_rgb565_to_g(d), mathop_rgb565_to_g(o), op);
+        }
+        __UNALIGNED_UINT32_WRITE(data + x, mathop_rgb565_from_lanes(rb, g));
+        x += 2;
+    }
+
+    return x;
+}
+#endif
+
+// Channel ops of add(), sub(), min(), max() and difference(), binary pixels are a channel with a
+// max of 1 (so add is an or and difference a xor).
+ALWAYS_INLINE static int mathop_add(int a, int b, int max)
+{
+    return IM_MIN(a + b, max);
+}
+
+ALWAYS_INLINE static int mathop_sub(int a, int b, int max)
+{
+    return IM_MAX(a - b, 0);
+}
+
+ALWAYS_INLINE static int mathop_rsub(int a, int b, int max)
+{
+    return IM_MAX(b - a, 0);
+}
+
+ALWAYS_INLINE static int mathop_min(int a, int b, int max)
+{
+    return IM_MIN(a, b);
+}
+
+ALWAYS_INLINE static int mathop_max(int a, int b, int max)
+{
+    return IM_MAX(a, b);
+}
+
+ALWAYS_INLINE static int mathop_difference(int a, int b, int max)
+{
+    return abs(a - b);
+}
+
+// Unmasked RGB565 lines are done with the SIMD kernel first, the rest of the line and the other
+// formats with the specialized pixel loops.
+ALWAYS_INLINE static void mathop_channel_line_op(image_t *img, int line, void *other, image_t *mask,
+                                                 pixel_loop_channel_op_t op, mathop_rgb565_op_t rgb565_op)
+{
+    int x = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    if ((img->bpp == IMAGE_BPP_RGB565) && (!mask)) {
+        x = mathop_rgb565_line(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line), other, img->w, rgb565_op, false, 0);
+    }
+#endif
+    PIXEL_LOOP_DISPATCH(img->bpp, mask, pixel_loop_row_channel_op, img, line, x, img->w, other, mask, op);
+}
+
+static void imlib_add_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+{
+    mathop_channel_line_op(img, line, other, (image_t *) data, mathop_add, MATHOP_RGB565_ADD);
 }
 
 void imlib_add(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
@@ -323,62 +472,12 @@ typedef struct imlib_sub_line_op_state {
 
 static void imlib_sub_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
 {
-    bool reverse = ((imlib_sub_line_op_state_t *) data)->reverse;
     image_t *mask = ((imlib_sub_line_op_state_t *) data)->mask;
 
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            uint32_t *data = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_BINARY_PIXEL_FAST(((uint32_t *) other), i);
-                    int p = reverse ? (otherPixel - dataPixel) : (dataPixel - otherPixel);
-                    p = IM_MAX(p, COLOR_BINARY_MIN);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(data, i, p);
-                }
-            }
-            break;
-        }
-        case IMAGE_BPP_GRAYSCALE: {
-            uint8_t *data = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(((uint8_t *) other), i);
-                    int p = reverse ? (otherPixel - dataPixel) : (dataPixel - otherPixel);
-                    p = IM_MAX(p, COLOR_GRAYSCALE_MIN);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, i, p);
-                }
-            }
-            break;
-        }
-        case IMAGE_BPP_RGB565: {
-            uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_RGB565_PIXEL_FAST(((uint16_t *) other), i);
-                    int dR = COLOR_RGB565_TO_R5(dataPixel);
-                    int dG = COLOR_RGB565_TO_G6(dataPixel);
-                    int dB = COLOR_RGB565_TO_B5(dataPixel);
-                    int oR = COLOR_RGB565_TO_R5(otherPixel);
-                    int oG = COLOR_RGB565_TO_G6(otherPixel);
-                    int oB = COLOR_RGB565_TO_B5(otherPixel);
-                    int r = reverse ? (oR - dR) : (dR - oR);
-                    int g = reverse ? (oG - dG) : (dG - oG);
-                    int b = reverse ? (oB - dB) : (dB - oB);
-                    r = IM_MAX(r, COLOR_R5_MIN);
-                    g = IM_MAX(g, COLOR_G6_MIN);
-                    b = IM_MAX(b, COLOR_B5_MIN);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(data, i, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
-                }
-            }
-            break;
-        }
-        default: {
-            break;
-        }
+    if (((imlib_sub_line_op_state_t *) data)->reverse) {
+        mathop_channel_line_op(img, line, other, mask, mathop_rsub, MATHOP_RGB565_RSUB);
+    } else {
+        mathop_channel_line_op(img, line, other, mask, mathop_sub, MATHOP_RGB565_SUB);
     }
 }
 
@@ -567,7 +666,43 @@ void imlib_div(image_t *img, const char *path, image_t *other, int scalar, bool
 
 static void imlib_min_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
 {
-    image_t *mask = (image_t *) data;
+    mathop_channel_line_op(img, line, other, (image_t *) data, mathop_min, MATHOP_RGB565_MIN);
+}
+
+void imlib_min(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
+{
+    imlib_image_operation(img, path, other, scalar, imlib_min_line_op, mask);
+}
+
+static void imlib_max_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+{
+    mathop_channel_line_op(img, line, other, (image_t *) data, mathop_max, MATHOP_RGB565_MAX);
+}
+
+void imlib_max(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
+{
+    imlib_image_operation(img, path, other, scalar, imlib_max_line_op, mask);
+}
+
+static void imlib_difference_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+{
+    mathop_channel_line_op(img, line, other, (image_t *) data, mathop_difference, MATHOP_RGB565_DIFFERENCE);
+}
+
+void imlib_difference(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
+{
+    imlib_image_operation(img, path, other, scalar,imlib_difference_line_op,  mask);
+}
+
+typedef struct imlib_blend_line_op_state {
+    float alpha;
+    image_t *mask;
+} imlib_blend_line_op_t;
+
+static void imlib_blend_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+{
+    float alpha = ((imlib_blend_line_op_t *) data)->alpha, beta = 1 - alpha;
+    image_t *mask = ((imlib_blend_line_op_t *) data)->mask;
 
     switch(img->bpp) {
         case IMAGE_BPP_BINARY: {
@@ -576,7 +711,7 @@ static void imlib_min_line_op(image_t *img, int line, void *other, void *data, b
                 if ((!mask) || image_get_mask_pixel(mask, i, line)) {
                     int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, i);
                     int otherPixel = IMAGE_GET_BINARY_PIXEL_FAST(((uint32_t *) other), i);
-                    int p = IM_MIN(dataPixel, otherPixel);
+                    int p = (dataPixel * alpha) + (otherPixel * beta);
                     IMAGE_PUT_BINARY_PIXEL_FAST(data, i, p);
                 }
             }
@@ -588,7 +723,7 @@ static void imlib_min_line_op(image_t *img, int line, void *other, void *data, b
                 if ((!mask) || image_get_mask_pixel(mask, i, line)) {
                     int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, i);
                     int otherPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(((uint8_t *) other), i);
-                    int p = IM_MIN(dataPixel, otherPixel);
+                    int p = (dataPixel * alpha) + (otherPixel * beta);
                     IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, i, p);
                 }
             }
@@ -596,13 +731,21 @@ static void imlib_min_line_op(image_t *img, int line, void *other, void *data, b
         }
         case IMAGE_BPP_RGB565: {
             uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
+            int i = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+            // Only alphas that are a multiple of 1/256 give the same results in fixed point.
+            int alpha256 = alpha * 256;
+            if ((!mask) && (alpha256 == (alpha * 256))) {
+                i = mathop_rgb565_line(data, other, img->w, MATHOP_RGB565_ADD, true, alpha256);
+            }
+#endif
+            for (int j = img->w; i < j; i++) {
                 if ((!mask) || image_get_mask_pixel(mask, i, line)) {
                     int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, i);
                     int otherPixel = IMAGE_GET_RGB565_PIXEL_FAST(((uint16_t *) other), i);
-                    int r = IM_MIN(COLOR_RGB565_TO_R5(dataPixel), COLOR_RGB565_TO_R5(otherPixel));
-                    int g = IM_MIN(COLOR_RGB565_TO_G6(dataPixel), COLOR_RGB565_TO_G6(otherPixel));
-                    int b = IM_MIN(COLOR_RGB565_TO_B5(dataPixel), COLOR_RGB565_TO_B5(otherPixel));
+                    int r = (COLOR_RGB565_TO_R5(dataPixel) * alpha) + (COLOR_RGB565_TO_R5(otherPixel) * beta);
+                    int g = (COLOR_RGB565_TO_G6(dataPixel) * alpha) + (COLOR_RGB565_TO_G6(otherPixel) * beta);
+                    int b = (COLOR_RGB565_TO_B5(dataPixel) * alpha) + (COLOR_RGB565_TO_B5(otherPixel) * beta);
                     IMAGE_PUT_RGB565_PIXEL_FAST(data, i, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
                 }
             }
@@ -614,104 +757,132 @@ static void imlib_min_line_op(image_t *img, int line, void *other, void *data, b
     }
 }
 
-void imlib_min(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
+void imlib_blend(image_t *img, const char *path, image_t *other, int scalar, float alpha, image_t *mask)
 {
-    imlib_image_operation(img, path, other, scalar, imlib_min_line_op, mask);
+    imlib_blend_line_op_t state;
+    state.alpha = alpha;
+    state.mask = mask;
+    imlib_image_operation(img, path, other, scalar, imlib_blend_line_op, &state);
 }
 
-static void imlib_max_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+// Fused op chains: each row is run through every op while it's still in the cache instead of
+// streaming the whole frame buffer through memory once per op. On grayscale images runs of
+// scalar ops and binary steps are folded into one lookup table per run.
+typedef struct math_ops_stage {
+    const imlib_math_op_t *op;
+    uint8_t *lut;
+    color_thresholds_list_lnk_data_t *thresholds;
+    int thresholds_len;
+} math_ops_stage_t;
+
+ALWAYS_INLINE static int math_ops_mul(int d, int o, float scale, float div, bool invert)
 {
-    image_t *mask = (image_t *) data;
+    return invert ? (scale - ((scale - d) * (scale - o) * div)) : (d * o * div);
+}
 
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            uint32_t *data = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_BINARY_PIXEL_FAST(((uint32_t *) other), i);
-                    int p = IM_MAX(dataPixel, otherPixel);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(data, i, p);
-                }
-            }
-            break;
+static int math_ops_gs_pixel(const imlib_math_op_t *op, int d, int o)
+{
+    switch (op->type) {
+        case IMLIB_MATH_OP_ADD: {
+            return IM_MIN(d + o, COLOR_GRAYSCALE_MAX);
         }
-        case IMAGE_BPP_GRAYSCALE: {
-            uint8_t *data = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(((uint8_t *) other), i);
-                    int p = IM_MAX(dataPixel, otherPixel);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, i, p);
-                }
-            }
-            break;
+        case IMLIB_MATH_OP_SUB: {
+            return IM_MAX(op->invert ? (o - d) : (d - o), COLOR_GRAYSCALE_MIN);
         }
-        case IMAGE_BPP_RGB565: {
-            uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_RGB565_PIXEL_FAST(((uint16_t *) other), i);
-                    int r = IM_MAX(COLOR_RGB565_TO_R5(dataPixel), COLOR_RGB565_TO_R5(otherPixel));
-                    int g = IM_MAX(COLOR_RGB565_TO_G6(dataPixel), COLOR_RGB565_TO_G6(otherPixel));
-                    int b = IM_MAX(COLOR_RGB565_TO_B5(dataPixel), COLOR_RGB565_TO_B5(otherPixel));
-                    IMAGE_PUT_RGB565_PIXEL_FAST(data, i, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
-                }
-            }
-            break;
+        case IMLIB_MATH_OP_MUL: {
+            float pScale = COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN;
+            return math_ops_mul(d, o, pScale, 1 / pScale, op->invert);
+        }
+        case IMLIB_MATH_OP_DIFFERENCE: {
+            return abs(d - o);
+        }
+        case IMLIB_MATH_OP_BLEND: {
+            return ((d * op->alpha) + (o * (256 - op->alpha))) >> 8;
         }
         default: {
-            break;
+            return d;
         }
     }
 }
 
-void imlib_max(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
+static int math_ops_rgb565_pixel(const imlib_math_op_t *op, int d, int o)
 {
-    imlib_image_operation(img, path, other, scalar, imlib_max_line_op, mask);
+    int dR = COLOR_RGB565_TO_R5(d), dG = COLOR_RGB565_TO_G6(d), dB = COLOR_RGB565_TO_B5(d);
+    int oR = COLOR_RGB565_TO_R5(o), oG = COLOR_RGB565_TO_G6(o), oB = COLOR_RGB565_TO_B5(o);
+    int r, g, b;
+    switch (op->type) {
+        case IMLIB_MATH_OP_ADD: {
+            r = IM_MIN(dR + oR, COLOR_R5_MAX);
+            g = IM_MIN(dG + oG, COLOR_G6_MAX);
+            b = IM_MIN(dB + oB, COLOR_B5_MAX);
+            break;
+        }
+        case IMLIB_MATH_OP_SUB: {
+            r = IM_MAX(op->invert ? (oR - dR) : (dR - oR), COLOR_R5_MIN);
+            g = IM_MAX(op->invert ? (oG - dG) : (dG - oG), COLOR_G6_MIN);
+            b = IM_MAX(op->invert ? (oB - dB) : (dB - oB), COLOR_B5_MIN);
+            break;
+        }
+        case IMLIB_MATH_OP_MUL: {
+            float rScale = COLOR_R5_MAX - COLOR_R5_MIN;
+            float gScale = COLOR_G6_MAX - COLOR_G6_MIN;
+            float bScale = COLOR_B5_MAX - COLOR_B5_MIN;
+            r = math_ops_mul(dR, oR, rScale, 1 / rScale, op->invert);
+            g = math_ops_mul(dG, oG, gScale, 1 / gScale, op->invert);
+            b = math_ops_mul(dB, oB, bScale, 1 / bScale, op->invert);
+            break;
+        }
+        case IMLIB_MATH_OP_DIFFERENCE: {
+            r = abs(dR - oR);
+            g = abs(dG - oG);
+            b = abs(dB - oB);
+            break;
+        }
+        case IMLIB_MATH_OP_BLEND: {
+            r = ((dR * op->alpha) + (oR * (256 - op->alpha))) >> 8;
+            g = ((dG * op->alpha) + (oG * (256 - op->alpha))) >> 8;
+            b = ((dB * op->alpha) + (oB * (256 - op->alpha))) >> 8;
+            break;
+        }
+        default: {
+            return d;
+        }
+    }
+    return COLOR_R5_G6_B5_TO_RGB565(r, g, b);
 }
 
-static void imlib_difference_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+static void math_ops_gs_line(const imlib_math_op_t *op, uint8_t *data, uint8_t *other, int w)
 {
-    image_t *mask = (image_t *) data;
-
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            uint32_t *data = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_BINARY_PIXEL_FAST(((uint32_t *) other), i);
-                    int p = dataPixel ^ otherPixel; // abs(dataPixel - otherPixel);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(data, i, p);
-                }
+    int x = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+    switch (op->type) {
+        case IMLIB_MATH_OP_ADD: {
+            for (; x < (w - 3); x += 4) {
+                uint32_t d = *((uint32_t *) (data + x)), o = *((uint32_t *) (other + x));
+                *((uint32_t *) (data + x)) = __UQADD8(d, o);
             }
             break;
         }
-        case IMAGE_BPP_GRAYSCALE: {
-            uint8_t *data = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(((uint8_t *) other), i);
-                    int p = abs(dataPixel - otherPixel);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, i, p);
-                }
+        case IMLIB_MATH_OP_SUB: {
+            for (; x < (w - 3); x += 4) {
+                uint32_t d = *((uint32_t *) (data + x)), o = *((uint32_t *) (other + x));
+                *((uint32_t *) (data + x)) = op->invert ? __UQSUB8(o, d) : __UQSUB8(d, o);
             }
             break;
         }
-        case IMAGE_BPP_RGB565: {
-            uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_RGB565_PIXEL_FAST(((uint16_t *) other), i);
-                    int r = abs(COLOR_RGB565_TO_R5(dataPixel) - COLOR_RGB565_TO_R5(otherPixel));
-                    int g = abs(COLOR_RGB565_TO_G6(dataPixel) - COLOR_RGB565_TO_G6(otherPixel));
-                    int b = abs(COLOR_RGB565_TO_B5(dataPixel) - COLOR_RGB565_TO_B5(otherPixel));
-                    IMAGE_PUT_RGB565_PIXEL_FAST(data, i, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
+        case IMLIB_MATH_OP_DIFFERENCE: {
+            for (; x < (w - 3); x += 4) {
+                uint32_t d = *((uint32_t *) (data + x)), o = *((uint32_t *) (other + x));
+                *((uint32_t *) (data + x)) = __UQSUB8(d, o) | __UQSUB8(o, d);
+            }
+            break;
+        }
+        case IMLIB_MATH_OP_BLEND: {
+            // A 50/50 blend is a halving add.
+            if (op->alpha == 128) {
+                for (; x < (w - 3); x += 4) {
+                    uint32_t d = *((uint32_t *) (data + x)), o = *((uint32_t *) (other + x));
+                    *((uint32_t *) (data + x)) = __UHADD8(d, o);
                 }
             }
             break;
@@ -720,73 +891,188 @@ static void imlib_difference_line_op(image_t *img, int line, void *other, void *
             break;
         }
     }
+#endif
+    for (; x < w; x++) {
+        data[x] = math_ops_gs_pixel(op, data[x], other[x]);
+    }
 }
 
-void imlib_difference(image_t *img, const char *path, image_t *other, int scalar, image_t *mask)
+static void math_ops_gs_lut(uint8_t *lut, const imlib_math_op_t *op)
 {
-    imlib_image_operation(img, path, other, scalar,imlib_difference_line_op,  mask);
+    if (op->type != IMLIB_MATH_OP_BINARY) {
+        for (int i = 0; i <= COLOR_GRAYSCALE_MAX; i++) {
+            lut[i] = math_ops_gs_pixel(op, lut[i], op->scalar);
+        }
+        return;
+    }
+
+    uint8_t match[COLOR_GRAYSCALE_MAX + 1] = {0};
+    for (list_lnk_t *it = iterator_start_from_head(op->thresholds); it; it = iterator_next(it)) {
+        color_thresholds_list_lnk_data_t lnk_data;
+        iterator_get(op->thresholds, it, &lnk_data);
+        for (int i = 0; i <= COLOR_GRAYSCALE_MAX; i++) {
+            match[i] |= COLOR_THRESHOLD_GRAYSCALE(i, &lnk_data, op->invert);
+        }
+    }
+
+    for (int i = 0; i <= COLOR_GRAYSCALE_MAX; i++) {
+        lut[i] = COLOR_BINARY_TO_GRAYSCALE(match[lut[i]]);
+    }
 }
 
-typedef struct imlib_blend_line_op_state {
-    float alpha;
-    image_t *mask;
-} imlib_blend_line_op_t;
+static void math_ops_rgb565_line(const math_ops_stage_t *stage, uint16_t *data, uint16_t *other, int w)
+{
+    const imlib_math_op_t *op = stage->op;
+    if (op->type == IMLIB_MATH_OP_BINARY) {
+        int pixels[2] = {COLOR_BINARY_TO_RGB565(0), COLOR_BINARY_TO_RGB565(1)};
+        for (int x = 0; x < w; x++) {
+            int pixel = data[x];
+            bool match = false;
+            for (int i = 0; (i < stage->thresholds_len) && (!match); i++) {
+                match = COLOR_THRESHOLD_RGB565(pixel, &stage->thresholds[i], op->invert);
+            }
+            data[x] = pixels[match];
+        }
+    } else if (other) {
+        int x = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+        switch (op->type) {
+            case IMLIB_MATH_OP_ADD: {
+                x = mathop_rgb565_line(data, other, w, MATHOP_RGB565_ADD, false, 0);
+                break;
+            }
+            case IMLIB_MATH_OP_SUB: {
+                x = op->invert ? mathop_rgb565_line(data, other, w, MATHOP_RGB565_RSUB, false, 0)
+                               : mathop_rgb565_line(data, other, w, MATHOP_RGB565_SUB, false, 0);
+                break;
+            }
+            case IMLIB_MATH_OP_DIFFERENCE: {
+                x = mathop_rgb565_line(data, other, w, MATHOP_RGB565_DIFFERENCE, false, 0);
+                break;
+            }
+            case IMLIB_MATH_OP_BLEND: {
+                x = mathop_rgb565_line(data, other, w, MATHOP_RGB565_ADD, true, op->alpha);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+#endif
+        for (; x < w; x++) {
+            data[x] = math_ops_rgb565_pixel(op, data[x], other[x]);
+        }
+    } else {
+        for (int x = 0; x < w; x++) {
+            data[x] = math_ops_rgb565_pixel(op, data[x], op->scalar);
+        }
+    }
+}
 
-static void imlib_blend_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+void imlib_math_ops(image_t *img, imlib_math_op_t *ops, int ops_len)
 {
-    float alpha = ((imlib_blend_line_op_t *) data)->alpha, beta = 1 - alpha;
-    image_t *mask = ((imlib_blend_line_op_t *) data)->mask;
+    for (int i = 0; i < ops_len; i++) {
+        if (ops[i].other && (ops[i].type != IMLIB_MATH_OP_BINARY) && (!IM_EQUAL(img, ops[i].other))) {
+            ff_not_equal(NULL);
+        }
+    }
 
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            uint32_t *data = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_BINARY_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_BINARY_PIXEL_FAST(((uint32_t *) other), i);
-                    int p = (dataPixel * alpha) + (otherPixel * beta);
-                    IMAGE_PUT_BINARY_PIXEL_FAST(data, i, p);
+    if (img->bpp == IMAGE_BPP_BINARY) {
+        // Binary ops are bitwise already, so there's nothing to fuse.
+        for (int i = 0; i < ops_len; i++) {
+            imlib_math_op_t *op = &ops[i];
+            switch (op->type) {
+                case IMLIB_MATH_OP_ADD: {
+                    imlib_add(img, NULL, op->other, op->scalar, NULL);
+                    break;
+                }
+                case IMLIB_MATH_OP_SUB: {
+                    imlib_sub(img, NULL, op->other, op->scalar, op->invert, NULL);
+                    break;
+                }
+                case IMLIB_MATH_OP_MUL: {
+                    imlib_mul(img, NULL, op->other, op->scalar, op->invert, NULL);
+                    break;
+                }
+                case IMLIB_MATH_OP_DIFFERENCE: {
+                    imlib_difference(img, NULL, op->other, op->scalar, NULL);
+                    break;
+                }
+                case IMLIB_MATH_OP_BLEND: {
+                    imlib_blend(img, NULL, op->other, op->scalar, op->alpha / 256.0f, NULL);
+                    break;
+                }
+                case IMLIB_MATH_OP_BINARY: {
+                    imlib_binary(img, img, op->thresholds, op->invert, false, NULL);
+                    break;
                 }
             }
-            break;
         }
-        case IMAGE_BPP_GRAYSCALE: {
-            uint8_t *data = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(((uint8_t *) other), i);
-                    int p = (dataPixel * alpha) + (otherPixel * beta);
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(data, i, p);
+        return;
+    }
+
+    math_ops_stage_t *stages = fb_alloc(ops_len * sizeof(math_ops_stage_t), FB_ALLOC_NO_HINT);
+    int stages_len = 0;
+
+    for (int i = 0; i < ops_len; i++) {
+        math_ops_stage_t *stage = &stages[stages_len++];
+        stage->op = &ops[i];
+        stage->lut = NULL;
+        stage->thresholds = NULL;
+        stage->thresholds_len = 0;
+
+        if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+            if (ops[i].other && (ops[i].type != IMLIB_MATH_OP_BINARY)) {
+                continue;
+            }
+            // Extend the previous table if the previous op was also a table.
+            if ((stages_len > 1) && stages[stages_len - 2].lut) {
+                stages_len -= 1;
+                stage = &stages[stages_len - 1];
+            } else {
+                stage->lut = fb_alloc(COLOR_GRAYSCALE_MAX + 1, FB_ALLOC_NO_HINT);
+                for (int j = 0; j <= COLOR_GRAYSCALE_MAX; j++) {
+                    stage->lut[j] = j;
                 }
             }
-            break;
+            math_ops_gs_lut(stage->lut, &ops[i]);
+        } else if (ops[i].type == IMLIB_MATH_OP_BINARY) {
+            stage->thresholds_len = list_size(ops[i].thresholds);
+            stage->thresholds = fb_alloc(IM_MAX(stage->thresholds_len, 1) *
+                                         sizeof(color_thresholds_list_lnk_data_t), FB_ALLOC_NO_HINT);
+            int j = 0;
+            for (list_lnk_t *it = iterator_start_from_head(ops[i].thresholds); it; it = iterator_next(it)) {
+                iterator_get(ops[i].thresholds, it, &stage->thresholds[j++]);
+            }
         }
-        case IMAGE_BPP_RGB565: {
-            uint16_t *data = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            for (int i = 0, j = img->w; i < j; i++) {
-                if ((!mask) || image_get_mask_pixel(mask, i, line)) {
-                    int dataPixel = IMAGE_GET_RGB565_PIXEL_FAST(data, i);
-                    int otherPixel = IMAGE_GET_RGB565_PIXEL_FAST(((uint16_t *) other), i);
-                    int r = (COLOR_RGB565_TO_R5(dataPixel) * alpha) + (COLOR_RGB565_TO_R5(otherPixel) * beta);
-                    int g = (COLOR_RGB565_TO_G6(dataPixel) * alpha) + (COLOR_RGB565_TO_G6(otherPixel) * beta);
-                    int b = (COLOR_RGB565_TO_B5(dataPixel) * alpha) + (COLOR_RGB565_TO_B5(otherPixel) * beta);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(data, i, COLOR_R5_G6_B5_TO_RGB565(r, g, b));
+    }
+
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        for (int i = 0; i < stages_len; i++) {
+            math_ops_stage_t *stage = &stages[i];
+            image_t *other = stage->op->other;
+            if (img->bpp == IMAGE_BPP_GRAYSCALE) {
+                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+                if (stage->lut) {
+                    for (int x = 0, xx = img->w; x < xx; x++) {
+                        row_ptr[x] = stage->lut[row_ptr[x]];
+                    }
+                } else {
+                    math_ops_gs_line(stage->op, row_ptr, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y), img->w);
                 }
+            } else {
+                math_ops_rgb565_line(stage, IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y),
+                                     other ? IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y) : NULL, img->w);
             }
-            break;
         }
-        default: {
-            break;
+    }
+
+    for (int i = stages_len - 1; i >= 0; i--) {
+        if (stages[i].lut || stages[i].thresholds) {
+            fb_free();
         }
     }
-}
 
-void imlib_blend(image_t *img, const char *path, image_t *other, int scalar, float alpha, image_t *mask)
-{
-    imlib_blend_line_op_t state;
-    state.alpha = alpha;
-    state.mask = mask;
-    imlib_image_operation(img, path, other, scalar, imlib_blend_line_op, &state);
+    fb_free(); // stages
 }
 #endif //IMLIB_ENABLE_MATH_OPS
@@ -21,131 +21,201 @@
 #define LENGTH_1_OFFSET         (35*4)
 #define MOVI_OFFSET             (54*4)
 
-void mjpeg_open(FIL *fp, int width, int height)
+#define AVIF_HASINDEX           (0x10)
+#define AVIIF_KEYFRAME          (0x10)
+#define INDEX_INIT_SIZE         (64)
+
+// The header and frames go through a deferred writer so every f_write() starts on a chunk
+// aligned file offset and spans whole clusters, and the writes happen between frames.
+static void mjpeg_write_data(FIL *fp, mjpeg_t *mjpeg, const void *data, uint32_t size)
 {
-    write_data(fp, "RIFF", 4); // FOURCC fcc; - 0
-    write_long(fp, 0); // DWORD cb; size - updated on close - 1
-    write_data(fp, "AVI ", 4); // FOURCC fcc; - 2
-
-    write_data(fp, "LIST", 4); // FOURCC fcc; - 3
-    write_long(fp, 192); // DWORD cb; - 4
-    write_data(fp, "hdrl", 4); // FOURCC fcc; - 5
-
-    write_data(fp, "avih", 4); // FOURCC fcc; - 6
-    write_long(fp, 56); // DWORD cb; - 7
-    write_long(fp, 0); // DWORD dwMicroSecPerFrame; micros - updated on close - 8
-    write_long(fp, 0); // DWORD dwMaxBytesPerSec; updated on close - 9
-    write_long(fp, 4); // DWORD dwPaddingGranularity; - 10
-    write_long(fp, 0); // DWORD dwFlags; - 11
-    write_long(fp, 0); // DWORD dwTotalFrames; frames - updated on close - 12
-    write_long(fp, 0); // DWORD dwInitialFrames; - 13
-    write_long(fp, 1); // DWORD dwStreams; - 14
-    write_long(fp, 0); // DWORD dwSuggestedBufferSize; - 15
-    write_long(fp, width); // DWORD dwWidth; - 16
-    write_long(fp, height); // DWORD dwHeight; - 17
-    write_long(fp, 1000); // DWORD dwScale; - 18
-    write_long(fp, 0); // DWORD dwRate; rate - updated on close - 19
-    write_long(fp, 0); // DWORD dwStart; - 20
-    write_long(fp, 0); // DWORD dwLength; length - updated on close - 21
-
-    write_data(fp, "LIST", 4); // FOURCC fcc; - 22
-    write_long(fp, 116); // DWORD cb; - 23
-    write_data(fp, "strl", 4); // FOURCC fcc; - 24
-
-    write_data(fp, "strh", 4); // FOURCC fcc; - 25
-    write_long(fp, 56); // DWORD cb; - 26
-    write_data(fp, "vids", 4); // FOURCC fccType; - 27
-    write_data(fp, "MJPG", 4); // FOURCC fccHandler; - 28
-    write_long(fp, 0); // DWORD dwFlags; - 29
-    write_word(fp, 0); // WORD wPriority; - 30
-    write_word(fp, 0); // WORD wLanguage; - 30.5
-    write_long(fp, 0); // DWORD dwInitialFrames; - 31
-    write_long(fp, 1000); // DWORD dwScale; - 32
-    write_long(fp, 0); // DWORD dwRate; rate - updated on close - 33
-    write_long(fp, 0); // DWORD dwStart; - 34
-    write_long(fp, 0); // DWORD dwLength; length - updated on close - 35
-    write_long(fp, 0); // DWORD dwSuggestedBufferSize; - 36
-    write_long(fp, 10000); // DWORD dwQuality; - 37
-    write_long(fp, 0); // DWORD dwSampleSize; - 38
-    write_word(fp, 0); // short int left; - 39
-    write_word(fp, 0); // short int top; - 39.5
-    write_word(fp, 0); // short int right; - 40
-    write_word(fp, 0); // short int bottom; - 40.5
-
-    write_data(fp, "strf", 4); // FOURCC fcc; - 41
-    write_long(fp, 40); // DWORD cb; - 42
-    write_long(fp, 40); // DWORD biSize; - 43
-    write_long(fp, width); // LONG biWidth; - 44
-    write_long(fp, height); // LONG biHeight; - 45
-    write_word(fp, 1); // WORD biPlanes; - 46
-    write_word(fp, 24); // WORD biBitCount; - 46.5
-    write_data(fp, "MJPG", 4); // DWORD biCompression; - 47
-    write_long(fp, 0); // DWORD biSizeImage; - 48
-    write_long(fp, 0); // LONG biXPelsPerMeter; - 49
-    write_long(fp, 0); // LONG biYPelsPerMeter; - 50
-    write_long(fp, 0); // DWORD biClrUsed; - 51
-    write_long(fp, 0); // DWORD biClrImportant; - 52
-
-    write_data(fp, "LIST", 4); // FOURCC fcc; - 53
-    write_long(fp, 0); // DWORD cb; movi - updated on close - 54
-    write_data(fp, "movi", 4); // FOURCC fcc; - 55
+    file_ring_write(&mjpeg->ring, data, size);
+}
+
+static void mjpeg_write_long(FIL *fp, mjpeg_t *mjpeg, uint32_t value)
+{
+    mjpeg_write_data(fp, mjpeg, &value, sizeof(value));
+}
+
+static void mjpeg_write_word(FIL *fp, mjpeg_t *mjpeg, uint16_t value)
+{
+    mjpeg_write_data(fp, mjpeg, &value, sizeof(value));
+}
+
+void mjpeg_open(FIL *fp, mjpeg_t *mjpeg, int width, int height, uint32_t prealloc, uint32_t buf_size)
+{
+    mjpeg->frames = 0;
+    mjpeg->bytes = 0;
+    mjpeg->index_size = 0;
+    mjpeg->index = NULL;
+
+    if (prealloc) {
+        // Reserve a contiguous cluster run up front so writes never have to walk
+        // or extend the FAT. If the card is too fragmented just grow as usual.
+        file_expand(fp, prealloc);
+    }
+
+    file_ring_open(&mjpeg->ring, fp, buf_size);
+
+    mjpeg_write_data(fp, mjpeg, "RIFF", 4); // FOURCC fcc; - 0
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD cb; size - updated on close - 1
+    mjpeg_write_data(fp, mjpeg, "AVI ", 4); // FOURCC fcc; - 2
+
+    mjpeg_write_data(fp, mjpeg, "LIST", 4); // FOURCC fcc; - 3
+    mjpeg_write_long(fp, mjpeg, 192); // DWORD cb; - 4
+    mjpeg_write_data(fp, mjpeg, "hdrl", 4); // FOURCC fcc; - 5
+
+    mjpeg_write_data(fp, mjpeg, "avih", 4); // FOURCC fcc; - 6
+    mjpeg_write_long(fp, mjpeg, 56); // DWORD cb; - 7
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwMicroSecPerFrame; micros - updated on close - 8
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwMaxBytesPerSec; updated on close - 9
+    mjpeg_write_long(fp, mjpeg, 4); // DWORD dwPaddingGranularity; - 10
+    mjpeg_write_long(fp, mjpeg, AVIF_HASINDEX); // DWORD dwFlags; - 11
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwTotalFrames; frames - updated on close - 12
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwInitialFrames; - 13
+    mjpeg_write_long(fp, mjpeg, 1); // DWORD dwStreams; - 14
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwSuggestedBufferSize; - 15
+    mjpeg_write_long(fp, mjpeg, width); // DWORD dwWidth; - 16
+    mjpeg_write_long(fp, mjpeg, height); // DWORD dwHeight; - 17
+    mjpeg_write_long(fp, mjpeg, 1000); // DWORD dwScale; - 18
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwRate; rate - updated on close - 19
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwStart; - 20
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwLength; length - updated on close - 21
+
+    mjpeg_write_data(fp, mjpeg, "LIST", 4); // FOURCC fcc; - 22
+    mjpeg_write_long(fp, mjpeg, 116); // DWORD cb; - 23
+    mjpeg_write_data(fp, mjpeg, "strl", 4); // FOURCC fcc; - 24
+
+    mjpeg_write_data(fp, mjpeg, "strh", 4); // FOURCC fcc; - 25
+    mjpeg_write_long(fp, mjpeg, 56); // DWORD cb; - 26
+    mjpeg_write_data(fp, mjpeg, "vids", 4); // FOURCC fccType; - 27
+    mjpeg_write_data(fp, mjpeg, "MJPG", 4); // FOURCC fccHandler; - 28
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwFlags; - 29
+    mjpeg_write_word(fp, mjpeg, 0); // WORD wPriority; - 30
+    mjpeg_write_word(fp, mjpeg, 0); // WORD wLanguage; - 30.5
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwInitialFrames; - 31
+    mjpeg_write_long(fp, mjpeg, 1000); // DWORD dwScale; - 32
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwRate; rate - updated on close - 33
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwStart; - 34
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwLength; length - updated on close - 35
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwSuggestedBufferSize; - 36
+    mjpeg_write_long(fp, mjpeg, 10000); // DWORD dwQuality; - 37
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD dwSampleSize; - 38
+    mjpeg_write_word(fp, mjpeg, 0); // short int left; - 39
+    mjpeg_write_word(fp, mjpeg, 0); // short int top; - 39.5
+    mjpeg_write_word(fp, mjpeg, 0); // short int right; - 40
+    mjpeg_write_word(fp, mjpeg, 0); // short int bottom; - 40.5
+
+    mjpeg_write_data(fp, mjpeg, "strf", 4); // FOURCC fcc; - 41
+    mjpeg_write_long(fp, mjpeg, 40); // DWORD cb; - 42
+    mjpeg_write_long(fp, mjpeg, 40); // DWORD biSize; - 43
+    mjpeg_write_long(fp, mjpeg, width); // LONG biWidth; - 44
+    mjpeg_write_long(fp, mjpeg, height); // LONG biHeight; - 45
+    mjpeg_write_word(fp, mjpeg, 1); // WORD biPlanes; - 46
+    mjpeg_write_word(fp, mjpeg, 24); // WORD biBitCount; - 46.5
+    mjpeg_write_data(fp, mjpeg, "MJPG", 4); // DWORD biCompression; - 47
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD biSizeImage; - 48
+    mjpeg_write_long(fp, mjpeg, 0); // LONG biXPelsPerMeter; - 49
+    mjpeg_write_long(fp, mjpeg, 0); // LONG biYPelsPerMeter; - 50
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD biClrUsed; - 51
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD biClrImportant; - 52
+
+    mjpeg_write_data(fp, mjpeg, "LIST", 4); // FOURCC fcc; - 53
+    mjpeg_write_long(fp, mjpeg, 0); // DWORD cb; movi - updated on close - 54
+    mjpeg_write_data(fp, mjpeg, "movi", 4); // FOURCC fcc; - 55
 }
 
-void mjpeg_add_frame(FIL *fp, uint32_t *frames, uint32_t *bytes, image_t *img, int quality)
+void mjpeg_add_frame(FIL *fp, mjpeg_t *mjpeg, image_t *img, int quality)
 {
-    write_data(fp, "00dc", 4); // FOURCC fcc;
-    *frames += 1;
+    uint32_t size;
+    uint8_t *pixels;
+
     if (IM_IS_JPEG(img)) {
-        int pad = (((img->bpp + 3) / 4) * 4) - img->bpp;
-        write_long(fp, img->bpp + pad); // DWORD cb;
-        write_data(fp, img->pixels, img->bpp + pad); // reading past okay
-        *bytes += img->bpp + pad;
+        size = img->bpp;
+        pixels = img->pixels;
     } else {
-        uint32_t size;
-        uint8_t *buffer = fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE);
-        image_t out = { .w=img->w, .h=img->h, .bpp=size, .pixels=buffer };
+        uint32_t buffer_size;
+        uint8_t *buffer = fb_alloc_all(&buffer_size, FB_ALLOC_PREFER_SIZE);
+        image_t out = { .w=img->w, .h=img->h, .bpp=buffer_size, .pixels=buffer };
         // When jpeg_compress needs more memory than in currently allocated it
         // will try to realloc. MP will detect that the pointer is outside of
         // the heap and return NULL which will cause an out of memory error.
         jpeg_compress(img, &out, quality, true);
-        int pad = (((out.bpp + 3) / 4) * 4) - out.bpp;
-        write_long(fp, out.bpp + pad); // DWORD cb;
-        write_data(fp, out.pixels, out.bpp + pad); // reading past okay
-        *bytes += out.bpp + pad;
+        size = out.bpp;
+        pixels = out.pixels;
+    }
+
+    int pad = (((size + 3) / 4) * 4) - size;
+
+    if (mjpeg->frames == mjpeg->index_size) {
+        mjpeg->index_size = IM_MAX(mjpeg->index_size * 2, INDEX_INIT_SIZE);
+        mjpeg->index = xrealloc(mjpeg->index, mjpeg->index_size * sizeof(uint32_t));
+    }
+
+    mjpeg->index[mjpeg->frames++] = size + pad;
+    mjpeg->bytes += size + pad;
+
+    mjpeg_write_data(fp, mjpeg, "00dc", 4); // FOURCC fcc;
+    mjpeg_write_long(fp, mjpeg, size + pad); // DWORD cb;
+    mjpeg_write_data(fp, mjpeg, pixels, size + pad); // reading past okay
+
+    if (!IM_IS_JPEG(img)) {
         fb_free();
     }
 }
 
-void mjpeg_close(FIL *fp, uint32_t *frames, uint32_t *bytes, float fps)
+void mjpeg_close(FIL *fp, mjpeg_t *mjpeg, float fps)
 {
+    uint32_t frames = mjpeg->frames;
+    uint32_t bytes = mjpeg->bytes;
+
+    // The index lives in RAM while recording and is written out once here.
+    mjpeg_write_data(fp, mjpeg, "idx1", 4); // FOURCC fcc;
+    mjpeg_write_long(fp, mjpeg, frames * 16); // DWORD cb;
+    for (uint32_t i = 0, offset = 4; i < frames; i++) {
+        mjpeg_write_data(fp, mjpeg, "00dc", 4); // DWORD ckid;
+        mjpeg_write_long(fp, mjpeg, AVIIF_KEYFRAME); // DWORD dwFlags;
+        mjpeg_write_long(fp, mjpeg, offset); // DWORD dwChunkOffset; relative to movi
+        mjpeg_write_long(fp, mjpeg, mjpeg->index[i]); // DWORD dwChunkLength;
+        offset += 8 + mjpeg->index[i];
+    }
+
+    file_ring_close(&mjpeg->ring);
+
+    // Drop whatever is left of the preallocated space.
+    file_truncate(fp);
+
+    xfree(mjpeg->index);
+    mjpeg->index = NULL;
+
     // Needed
     file_seek(fp, SIZE_OFFSET);
-    write_long(fp, 216 + (*frames * 8) + *bytes);
+    write_long(fp, 216 + (frames * 8) + bytes + 8 + (frames * 16));
     // Needed
     file_seek(fp, MICROS_OFFSET);
     write_long(fp, (!fast_roundf(fps)) ? 0 :
             fast_roundf(1000000 / fps));
-    write_long(fp, (!(*frames)) ? 0 :
-            fast_roundf((((*frames * 8) + *bytes) * fps) / *frames));
+    write_long(fp, (!frames) ? 0 :
+            fast_roundf((((frames * 8) + bytes) * fps) / frames));
     // Needed
     file_seek(fp, FRAMES_OFFSET);
-    write_long(fp, *frames);
+    write_long(fp, frames);
     // Probably not needed but writing it just in case.
     file_seek(fp, RATE_0_OFFSET);
     write_long(fp, fast_roundf(fps * 1000));
     // Probably not needed but writing it just in case.
     file_seek(fp, LENGTH_0_OFFSET);
     write_long(fp, (!fast_roundf(fps)) ? 0 :
-            fast_roundf((*frames * 1000) / fps));
+            fast_roundf((frames * 1000) / fps));
     // Probably not needed but writing it just in case.
     file_seek(fp, RATE_1_OFFSET);
     write_long(fp, fast_roundf(fps * 1000));
     // Probably not needed but writing it just in case.
     file_seek(fp, LENGTH_1_OFFSET);
     write_long(fp, (!fast_roundf(fps)) ? 0 :
-            fast_roundf((*frames * 1000) / fps));
+            fast_roundf((frames * 1000) / fps));
     // Needed
     file_seek(fp, MOVI_OFFSET);
-    write_long(fp, 4 + (*frames * 8) + *bytes);
+    write_long(fp, 4 + (frames * 8) + bytes);
     file_close(fp);
 }
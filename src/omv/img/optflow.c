@@ -0,0 +1,333 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Sparse pyramidal Lucas-Kanade optical flow.
+ *
+ * "Pyramidal Implementation of the Lucas Kanade Feature Tracker" (Bouguet). The pyramid levels are
+ * 2x2 mean pools of the level below, the levels of the previous frame are kept by the tracker so
+ * each frame is pooled once. The windows are bilinearly sampled with 8-bit weights into 16-bit
+ * values scaled by 32 (and their gradients), the sums are done with integers.
+ */
+#include <stdlib.h>
+#include "imlib.h"
+#include "xalloc.h"
+#include "fb_alloc.h"
+
+#ifdef IMLIB_ENABLE_LK_TRACKER
+#define LK_PATCH_MAX        ((LK_TRACKER_MAX_WINDOW * 2) + 3)   // Window plus the gradient border.
+#define LK_MAX_ITERATIONS   (10)
+#define LK_EPSILON          (0.01f)     // Stop when the update is smaller than this (in pixels).
+#define LK_MIN_EIGEN        (4.0f)      // Smallest eigenvalue of the gradient matrix per pixel.
+#define LK_VALUE_SHIFT      (5)         // Sampled values are scaled by 32.
+
+// Samples the size x size patch centered on (x, y) from the grayscale image, (x, y) must be at
+// least (size / 2) + 1 pixels inside the image.
+static void lk_sample(image_t *img, float x, float y, int size, int16_t *patch)
+{
+    int r = size / 2;
+    int ix = fast_floorf(x), iy = fast_floorf(y);
+    int ax = fast_roundf((x - ix) * 256), ay = fast_roundf((y - iy) * 256);
+    int w00 = (256 - ax) * (256 - ay), w01 = ax * (256 - ay), w10 = (256 - ax) * ay, w11 = ax * ay;
+    const int shift = 16 - LK_VALUE_SHIFT, round = 1 << (shift - 1);
+
+    for (int j = 0; j < size; j++) {
+        uint8_t *row_0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, iy - r + j) + ix - r;
+        uint8_t *row_1 = row_0 + img->w;
+
+        for (int i = 0; i < size; i++) {
+            patch[(j * size) + i] = ((row_0[i] * w00) + (row_0[i + 1] * w01)
+                                  + (row_1[i] * w10) + (row_1[i + 1] * w11) + round) >> shift;
+        }
+    }
+}
+
+// True if the size x size patch centered on (x, y) can be sampled.
+static bool lk_inside(image_t *img, float x, float y, int size)
+{
+    int r = (size / 2) + 1;
+    return (r <= x) && (x < (img->w - r)) && (r <= y) && (y < (img->h - r));
+}
+
+// Tracks the point (x, y) of the prev pyramid into the next pyramid, returns false if it was lost.
+static bool lk_track(image_t *prev, image_t *next, int levels, int window, float x, float y, float *next_x, float *next_y)
+{
+    int size = (window * 2) + 1, patch_size = size + 2, n = size * size;
+    int16_t patch[LK_PATCH_MAX * LK_PATCH_MAX];
+    int16_t values[LK_PATCH_MAX * LK_PATCH_MAX], grad_x[LK_PATCH_MAX * LK_PATCH_MAX], grad_y[LK_PATCH_MAX * LK_PATCH_MAX];
+    float gx = 0, gy = 0; // Guess from the level above.
+
+    for (int level = levels - 1; level >= 0; level--) {
+        float scale = 1.0f / (1 << level);
+        float px = x * scale, py = y * scale;
+        image_t *I = &prev[level], *J = &next[level];
+
+        if (!lk_inside(I, px, py, patch_size)) {
+            if (!level) {
+                return false;
+            }
+            // Too close to the border of this level, continue with the guess on the next one.
+            gx *= 2;
+            gy *= 2;
+            continue;
+        }
+
+        // The window of the previous frame and its central difference gradients.
+        lk_sample(I, px, py, patch_size, patch);
+        int64_t gxx = 0, gxy = 0, gyy = 0;
+
+        for (int j = 0; j < size; j++) {
+            int16_t *p = patch + ((j + 1) * patch_size) + 1;
+
+            for (int i = 0; i < size; i++) {
+                int dx = (p[i + 1] - p[i - 1]) >> 1;
+                int dy = (p[i + patch_size] - p[i - patch_size]) >> 1;
+                int k = (j * size) + i;
+                values[k] = p[i];
+                grad_x[k] = dx;
+                grad_y[k] = dy;
+                gxx += dx * dx;
+                gxy += dx * dy;
+                gyy += dy * dy;
+            }
+        }
+
+        const float norm = 1.0f / (1 << (LK_VALUE_SHIFT * 2));
+        float Gxx = gxx * norm, Gxy = gxy * norm, Gyy = gyy * norm;
+        float det = (Gxx * Gyy) - (Gxy * Gxy);
+        float min_eigen = ((Gxx + Gyy) - fast_sqrtf(((Gxx - Gyy) * (Gxx - Gyy)) + (4 * Gxy * Gxy))) / 2;
+
+        if ((min_eigen < (LK_MIN_EIGEN * n)) || (det <= 0)) {
+            if (!level) {
+                return false;
+            }
+            gx *= 2;
+            gy *= 2;
+            continue;
+        }
+
+        float inv_det = 1.0f / det, vx = 0, vy = 0;
+
+        for (int iter = 0; iter < LK_MAX_ITERATIONS; iter++) {
+            float qx = px + gx + vx, qy = py + gy + vy;
+
+            if (!lk_inside(J, qx, qy, size)) {
+                if (!level) {
+                    return false;
+                }
+                break;
+            }
+
+            lk_sample(J, qx, qy, size, patch);
+            int64_t bx = 0, by = 0;
+
+            for (int k = 0; k < n; k++) {
+                int diff = values[k] - patch[k];
+                bx += diff * grad_x[k];
+                by += diff * grad_y[k];
+            }
+
+            float Bx = bx * norm, By = by * norm;
+            float dx = ((Gyy * Bx) - (Gxy * By)) * inv_det;
+            float dy = ((Gxx * By) - (Gxy * Bx)) * inv_det;
+            vx += dx;
+            vy += dy;
+
+            if (((dx * dx) + (dy * dy)) < (LK_EPSILON * LK_EPSILON)) {
+                break;
+            }
+        }
+
+        gx += vx;
+        gy += vy;
+
+        if (level) {
+            gx *= 2;
+            gy *= 2;
+        }
+    }
+
+    *next_x = x + gx;
+    *next_y = y + gy;
+    return true;
+}
+
+void imlib_lk_tracker_alloc(lk_tracker_t *tracker, size_t points_max, int levels, int window, int cell_size)
+{
+    memset(tracker, 0, sizeof(lk_tracker_t));
+    tracker->points = xalloc(points_max * sizeof(lk_point_t));
+    tracker->points_max = points_max;
+    tracker->levels = levels;
+    tracker->window = window;
+    tracker->cell_size = cell_size;
+    imlib_lk_tracker_reset(tracker);
+}
+
+void imlib_lk_tracker_free(lk_tracker_t *tracker)
+{
+    xfree(tracker->points);
+
+    if (tracker->pyramid_data) {
+        xfree(tracker->pyramid_data);
+    }
+
+    memset(tracker, 0, sizeof(lk_tracker_t));
+}
+
+void imlib_lk_tracker_reset(lk_tracker_t *tracker)
+{
+    tracker->points_len = 0;
+    tracker->next_id = 1;
+    tracker->valid = false;
+}
+
+// Number of pyramid levels (up to levels) that keep the tracking window inside the image.
+static int lk_pyramid_levels(image_t *img, int levels, int window)
+{
+    int n = 1;
+
+    while ((n < levels) && (((img->w >> n) > ((window * 2) + 4)) && ((img->h >> n) > ((window * 2) + 4)))) {
+        n++;
+    }
+
+    return n;
+}
+
+// Adds the corners found in the roi to the tracker, at most one per cell without a tracked point.
+static void lk_add_corners(lk_tracker_t *tracker, image_t *img, rectangle_t *roi, int threshold,
+                           corner_detector_t corner_detector)
+{
+    int cell_size = IM_MAX(tracker->cell_size, 1);
+    int cells_w = (img->w + cell_size - 1) / cell_size;
+    int cells_h = (img->h + cell_size - 1) / cell_size;
+    uint32_t *cells = fb_alloc0(((cells_w * cells_h) + UINT32_T_MASK) / 32 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (size_t i = 0; i < tracker->points_len; i++) {
+        int cell = ((((int) tracker->points[i].y) / cell_size) * cells_w) + (((int) tracker->points[i].x) / cell_size);
+        IMAGE_SET_BINARY_PIXEL_FAST(cells, cell);
+    }
+
+    array_t *corners;
+    array_alloc(&corners, xfree);
+
+    #ifdef IMLIB_ENABLE_FAST
+    if (corner_detector == CORNER_FAST) {
+        fast_detect(img, corners, threshold, roi, tracker->cell_size, 1);
+    } else
+    #endif
+    {
+        agast_detect(img, corners, threshold, roi, tracker->cell_size, 1);
+    }
+
+    for (int i = 0, ii = array_length(corners); (i < ii) && (tracker->points_len < tracker->points_max); i++) {
+        kp_t *kp = array_at(corners, i);
+        int cell = ((kp->y / cell_size) * cells_w) + (kp->x / cell_size);
+
+        if (!IMAGE_GET_BINARY_PIXEL_FAST(cells, cell)) {
+            IMAGE_SET_BINARY_PIXEL_FAST(cells, cell);
+            lk_point_t *point = &tracker->points[tracker->points_len++];
+            point->x = kp->x;
+            point->y = kp->y;
+            point->dx = 0;
+            point->dy = 0;
+            point->id = tracker->next_id++;
+            // 0 means untracked.
+            if (!tracker->next_id) {
+                tracker->next_id = 1;
+            }
+        }
+    }
+
+    array_free(corners);
+    fb_free(); // cells
+}
+
+int imlib_lk_tracker_update(lk_tracker_t *tracker, image_t *img, image_pyramid_t *pyr, rectangle_t *roi,
+                            int threshold, corner_detector_t corner_detector)
+{
+    int levels = lk_pyramid_levels(img, tracker->levels, tracker->window);
+    int pyr_levels = (pyr && (pyr->scale == 2.0f)) ? pyr->levels_len : 1;
+    int allocated = 0;
+    image_t next[LK_TRACKER_MAX_LEVELS];
+    size_t size = 0;
+
+    // Pool the new frame (or take the levels of the shared pyramid), level 0 is the frame itself.
+    next[0] = *img;
+    size += image_size(img);
+
+    for (int i = 1; i < levels; i++) {
+        if (i < pyr_levels) {
+            next[i] = pyr->levels[i];
+        } else {
+            next[i].w = next[i - 1].w / 2;
+            next[i].h = next[i - 1].h / 2;
+            next[i].bpp = IMAGE_BPP_GRAYSCALE;
+            next[i].data = fb_alloc(image_size(&next[i]), FB_ALLOC_NO_HINT);
+            imlib_decimate2(&next[i - 1], &next[i]);
+            allocated++;
+        }
+
+        size += image_size(&next[i]);
+    }
+
+    int tracked = 0;
+
+    if (tracker->valid && (tracker->pyramid_levels == levels)
+    && (tracker->pyramid[0].w == img->w) && (tracker->pyramid[0].h == img->h)) {
+        // Tracked points are moved to the front, lost points are dropped.
+        for (size_t i = 0; i < tracker->points_len; i++) {
+            lk_point_t *point = &tracker->points[i];
+            float x, y;
+
+            if (lk_track(tracker->pyramid, next, levels, tracker->window, point->x, point->y, &x, &y)) {
+                lk_point_t *out = &tracker->points[tracked++];
+                out->dx = x - point->x;
+                out->dy = y - point->y;
+                out->x = x;
+                out->y = y;
+                out->id = point->id;
+            }
+        }
+    }
+
+    tracker->points_len = tracked;
+
+    // Top up the points once a quarter of them were lost.
+    if (tracker->points_len < ((tracker->points_max * 3) / 4)) {
+        lk_add_corners(tracker, img, roi, threshold, corner_detector);
+    }
+
+    // Keep the pyramid for the next frame.
+    if (tracker->pyramid_size < size) {
+        if (tracker->pyramid_data) {
+            xfree(tracker->pyramid_data);
+        }
+
+        tracker->pyramid_data = NULL; // in case xalloc fails
+        tracker->pyramid_size = 0;
+        tracker->pyramid_data = xalloc(size);
+        tracker->pyramid_size = size;
+    }
+
+    uint8_t *data = tracker->pyramid_data;
+
+    for (int i = 0; i < levels; i++) {
+        tracker->pyramid[i] = next[i];
+        tracker->pyramid[i].data = data;
+        memcpy(data, next[i].data, image_size(&next[i]));
+        data += image_size(&next[i]);
+    }
+
+    for (int i = 0; i < allocated; i++) {
+        fb_free();
+    }
+
+    tracker->pyramid_levels = levels;
+    tracker->valid = true;
+    return tracked;
+}
+#endif // IMLIB_ENABLE_LK_TRACKER
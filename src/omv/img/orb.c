@@ -22,6 +22,9 @@
 #define PATCH_SIZE  (31) // 31x31 pixels
 #define KDESC_SIZE  (32) // 32 bytes
 #define MAX_KP_DIST (KDESC_SIZE*8)
+#define ORB_ANGLE_STEP      (15) // Keypoint angles are quantized to 15 degrees.
+#define ORB_ANGLES          (360/ORB_ANGLE_STEP)
+#define ORB_PATTERN_SIZE    (KDESC_SIZE*16)
 
 typedef struct {
     int x;
@@ -298,7 +301,7 @@ static int kpt_comp(const kp_t *kp1, const kp_t *kp2)
     return kp2->score - kp1->score;
 }
 
-static int comp_angle(image_t *img, kp_t *kp, float *a, float *b)
+static int comp_angle(image_t *img, kp_t *kp)
 {
     int step = img->w;
     int half_k = 31/2;
@@ -329,13 +332,32 @@ static int comp_angle(image_t *img, kp_t *kp, float *a, float *b)
     }
 
     // Quantize angle to 15 degrees
-    angle = angle - (angle % 15);
+    return angle - (angle % 15);
+}
+
+// The sample pattern rotated by each of the quantized angles, computed the first time an angle
+// is used and then shared by all the keypoints with that angle.
+static const int8_t *rotated_pattern(int8_t *patterns, bool *rotated, int angle)
+{
+    int8_t *pattern = patterns + ((angle / ORB_ANGLE_STEP) * ORB_PATTERN_SIZE * 2);
+
+    if (!rotated[angle / ORB_ANGLE_STEP]) {
+        const sample_point_t *points = (const sample_point_t *) sample_pattern;
+        float a = cos_table[angle];
+        float b = sin_table[angle];
+
+        for (int i = 0; i < ORB_PATTERN_SIZE; i++) {
+            pattern[(i * 2) + 0] = (int) roundf(points[i].x*a - points[i].y*b);
+            pattern[(i * 2) + 1] = (int) roundf(points[i].x*b + points[i].y*a);
+        }
+
+        rotated[angle / ORB_ANGLE_STEP] = true;
+    }
 
-    *a = cos_table[angle];
-    *b = sin_table[angle];
-    return angle;
+    return pattern;
 }
 
+
 static void image_scale(image_t *src, image_t *dst)
 {
     int x_ratio = (int)((src->w<<16)/dst->w) +1;
@@ -350,8 +372,9 @@ static void image_scale(image_t *src, image_t *dst)
 	}
 }
 
-array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
-        float scale_factor, int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi)
+array_t *orb_find_keypoints(image_t *img, image_pyramid_t *pyr, bool normalized, int threshold,
+        float scale_factor, int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi,
+        int cell_size, int cell_max)
 {
 	array_t *kpts;
 	array_alloc(&kpts, xfree);
@@ -360,11 +383,28 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
     int kpts_index = 0;
     rectangle_t roi_scaled;
 
+    bool rotated[ORB_ANGLES] = {false};
+    int8_t *patterns = fb_alloc(ORB_ANGLES * ORB_PATTERN_SIZE * 2, FB_ALLOC_NO_HINT);
+
+    // The levels of a shared pyramid are copied instead of scaling the image again.
+    if (pyr) {
+        scale_factor = pyr->scale;
+    }
+
     for(float scale=1.0f; ; scale*=scale_factor, octave++) {
+        if (pyr && ((octave - 1) >= pyr->levels_len)) {
+            break;
+        }
+
+        // Out of time, the keypoints of the finished scales are returned.
+        if (imlib_deadline_expired()) {
+            break;
+        }
+
         image_t img_scaled = {
             .bpp = 1,
-            .w = (int) roundf(img->w/scale),
-            .h = (int) roundf(img->h/scale),
+            .w = pyr ? pyr->levels[octave - 1].w : (int) roundf(img->w/scale),
+            .h = pyr ? pyr->levels[octave - 1].h : (int) roundf(img->h/scale),
             .pixels = NULL 
         };
  
@@ -381,20 +421,27 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
 
         img_scaled.pixels = fb_alloc(img_scaled.w * img_scaled.h, FB_ALLOC_NO_HINT);
         // Down scale image
-        image_scale(img, &img_scaled);
+        if (pyr) {
+            memcpy(img_scaled.pixels, pyr->levels[octave - 1].pixels, img_scaled.w * img_scaled.h);
+        } else {
+            image_scale(img, &img_scaled);
+        }
 
         // Gaussian smooth the image before extracting keypoints
         imlib_sepconv3(&img_scaled, kernel_gauss_3, 1.0f/16.0f, 0.0f);
 
+        // The cells cover the same area of the image at every scale.
+        int cell_size_scaled = cell_size ? IM_MAX((int) roundf(cell_size/scale), 1) : 0;
+
 		// Find kpts
         #ifdef IMLIB_ENABLE_FAST
         if (corner_detector == CORNER_FAST) {
-            fast_detect(&img_scaled, kpts, threshold, &roi_scaled);
+            fast_detect(&img_scaled, kpts, threshold, &roi_scaled, cell_size_scaled, cell_max);
         }
         else
         #endif
         {
-            agast_detect(&img_scaled, kpts, threshold, &roi_scaled);
+            agast_detect(&img_scaled, kpts, threshold, &roi_scaled, cell_size_scaled, cell_max);
         }
 
         for (int k=kpts_index; k<array_length(kpts); k++, kpts_index++) {
@@ -402,22 +449,14 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
             kp_t *kpt = array_at(kpts, k);
             kpt->octave = octave;
 
-            int x, y;
-            float a, b;
-            sample_point_t *pattern = (sample_point_t*) sample_pattern;
-            kpt->angle = comp_angle(&img_scaled, kpt, &a, &b);
+            kpt->angle = comp_angle(&img_scaled, kpt);
+            const int8_t *pattern = rotated_pattern(patterns, rotated, kpt->angle);
+            const uint8_t *center = img_scaled.pixels + (kpt->y*img_scaled.w) + kpt->x;
 
-            #if 1
-            #define GET_VALUE(idx) \
-                   (x = (int) roundf(pattern[idx].x*a - pattern[idx].y*b), \
-                    y = (int) roundf(pattern[idx].x*b + pattern[idx].y*a), \
-                    img_scaled.pixels[((kpt->y+y)*img_scaled.w)+(kpt->x+x)])
-            #else
             #define GET_VALUE(idx) \
-                   (img_scaled.pixels[((kpt->y+pattern[idx].y)*img_scaled.w)+(kpt->x+pattern[idx].x)])
-            #endif
+                   (center[(pattern[(idx)*2+1]*img_scaled.w)+pattern[(idx)*2]])
 
-            for (int i=0; i<KDESC_SIZE; ++i, pattern+=16) {
+            for (int i=0; i<KDESC_SIZE; ++i, pattern+=32) {
                 int t0, t1, t2, t3, u, v, k, val;
                 t0 = GET_VALUE(0); t1 = GET_VALUE(1);
                 t2 = GET_VALUE(2); t3 = GET_VALUE(3);
@@ -466,6 +505,8 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
         }
     }
 
+    fb_free(); // patterns
+
     // Sort keypoints by score and return top n keypoints
     array_sort(kpts, (array_comp_t) kpt_comp);
     if (array_length(kpts) > max_keypoints) {
@@ -475,47 +516,156 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
 	return kpts;
 }
 
-// This is a modifed popcount that counts every 2 different bits as 1.
-// This is what should actually be used with wta_k == 3 or 4.
 static inline uint32_t popcount(uint32_t i)
 {
      i = i - ((i >> 1) & 0x55555555);
-     i = ((i & 0xAAAAAAAA)>>1) | (i & 0x55555555);
      i = (i & 0x33333333) + ((i >> 2) & 0x33333333);
      return (((i + (i >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
 }
 
-static kp_t *find_best_match(kp_t *kp1, array_t *kpts, int *dist_out1, int *dist_out2, int *index)
+// Descriptors are compared as 128 2-bit values (WTA_K == 4), the distance is the number of
+// values that differ. The "any bit set" results of two words are packed in the even and odd
+// bits of one word so a single popcount covers 32 values.
+static inline int desc_dist(const uint32_t *d1, const uint32_t *d2, int max_dist)
 {
-    kp_t *min_kp=NULL;
+    int dist = 0;
+
+    for (int m=0; m<(KDESC_SIZE/4); m+=2) {
+        uint32_t a = d1[m] ^ d2[m], b = d1[m+1] ^ d2[m+1];
+        a = (a | (a >> 1)) & 0x55555555;
+        b = (b | (b >> 1)) & 0x55555555;
+        dist += popcount(a | (b << 1));
+
+        // The rest can't make it closer than the best match.
+        if (dist >= max_dist) {
+            break;
+        }
+    }
+
+    return dist;
+}
+
+typedef struct {
+    uint32_t *desc;     // KDESC_SIZE bytes per keypoint, contiguous.
+    uint8_t *matched;
+    int len;
+    // With a search radius the keypoints are bucketed in a grid of cells of at least the radius
+    // so only the 3x3 cells around a keypoint have to be searched.
+    int radius, cell_size, grid_w, grid_h;
+    int *cells;         // Start of each cell in order (grid_w * grid_h + 1).
+    int *order;         // Keypoint indices sorted by cell.
+    array_t *kpts;
+} desc_set_t;
+
+// Copies the descriptors out of the keypoints so the matcher reads them linearly.
+static void desc_set_alloc(desc_set_t *set, array_t *kpts, int radius)
+{
+    set->len = array_length(kpts);
+    set->desc = fb_alloc(set->len * KDESC_SIZE, FB_ALLOC_NO_HINT);
+    set->matched = fb_alloc(set->len, FB_ALLOC_NO_HINT);
+    set->radius = radius;
+    set->kpts = kpts;
+
+    int max_x = 0, max_y = 0;
+
+    for (int i=0; i<set->len; i++) {
+        kp_t *kp = array_at(kpts, i);
+        memcpy(set->desc + (i * (KDESC_SIZE/4)), kp->desc, KDESC_SIZE);
+        set->matched[i] = kp->matched;
+        max_x = IM_MAX(max_x, kp->x);
+        max_y = IM_MAX(max_y, kp->y);
+    }
+
+    if (radius > 0) {
+        set->cell_size = IM_MAX(radius, 16); // Bounds the size of the grid.
+        set->grid_w = (max_x / set->cell_size) + 1;
+        set->grid_h = (max_y / set->cell_size) + 1;
+        set->cells = fb_alloc0((set->grid_w * set->grid_h + 1) * sizeof(int), FB_ALLOC_NO_HINT);
+        set->order = fb_alloc(IM_MAX(set->len, 1) * sizeof(int), FB_ALLOC_NO_HINT);
+
+        // Counting sort of the keypoints by cell.
+        for (int i=0; i<set->len; i++) {
+            kp_t *kp = array_at(set->kpts, i);
+            set->cells[((kp->y / set->cell_size) * set->grid_w) + (kp->x / set->cell_size) + 1] += 1;
+        }
+
+        for (int i=0, ii=set->grid_w * set->grid_h; i<ii; i++) {
+            set->cells[i + 1] += set->cells[i];
+        }
+
+        int *fill = fb_alloc(set->grid_w * set->grid_h * sizeof(int), FB_ALLOC_NO_HINT);
+        memcpy(fill, set->cells, set->grid_w * set->grid_h * sizeof(int));
+
+        for (int i=0; i<set->len; i++) {
+            kp_t *kp = array_at(set->kpts, i);
+            set->order[fill[((kp->y / set->cell_size) * set->grid_w) + (kp->x / set->cell_size)]++] = i;
+        }
+
+        fb_free(); // fill
+    }
+}
+
+static void desc_set_free(desc_set_t *set)
+{
+    if (set->radius > 0) {
+        fb_free(); // set->order
+        fb_free(); // set->cells
+    }
+
+    fb_free(); // set->matched
+    fb_free(); // set->desc
+}
+
+static inline void find_best_match_test(const uint32_t *desc, desc_set_t *set, int i,
+                                        int *index, int *min_dist1, int *min_dist2)
+{
+    if (set->matched[i] == 0) {
+        int dist = desc_dist(desc, set->desc + (i * (KDESC_SIZE/4)), *min_dist1);
+
+        if (dist < *min_dist1) {
+            *index = i;
+            *min_dist2 = *min_dist1;
+            *min_dist1 = dist;
+        }
+    }
+}
+
+static int find_best_match(const uint32_t *desc, kp_t *kp, desc_set_t *set, int *dist_out1, int *dist_out2)
+{
+    int index = -1;
     int min_dist1 = MAX_KP_DIST;
     int min_dist2 = MAX_KP_DIST;
-    int kpts_size = array_length(kpts);
 
-    for (int i=0; i<kpts_size; i++) {
-        int dist = 0;
-        kp_t *kp2 = array_at(kpts, i);
+    if (set->radius > 0) {
+        int cell_x = kp->x / set->cell_size, cell_y = kp->y / set->cell_size;
 
-        if (kp2->matched == 0) {
-            for (int m=0; m<(KDESC_SIZE/4); m++) {
-                dist += popcount(((uint32_t*)(kp1->desc))[m] ^ ((uint32_t*)(kp2->desc))[m]);
-            }
+        for (int y = IM_MAX(cell_y - 1, 0), yy = IM_MIN(cell_y + 1, set->grid_h - 1); y <= yy; y++) {
+            for (int x = IM_MAX(cell_x - 1, 0), xx = IM_MIN(cell_x + 1, set->grid_w - 1); x <= xx; x++) {
+                int cell = (y * set->grid_w) + x;
+
+                for (int j=set->cells[cell]; j<set->cells[cell + 1]; j++) {
+                    int i = set->order[j];
+                    kp_t *kp2 = array_at(set->kpts, i);
 
-            if (dist < min_dist1) {
-                *index = i;
-                min_kp = kp2;
-                min_dist2 = min_dist1;
-                min_dist1 = dist;
+                    if ((abs(kp2->x - kp->x) <= set->radius) && (abs(kp2->y - kp->y) <= set->radius)) {
+                        find_best_match_test(desc, set, i, &index, &min_dist1, &min_dist2);
+                    }
+                }
             }
         }
+    } else {
+        for (int i=0; i<set->len; i++) {
+            find_best_match_test(desc, set, i, &index, &min_dist1, &min_dist2);
+        }
     }
 
     *dist_out1 = min_dist1;
     *dist_out2 = min_dist2;
-    return min_kp;
+    return index;
 }
 
-int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshold, rectangle_t *r, point_t *c, int *angle)
+int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshold, int radius,
+                        rectangle_t *r, point_t *c, int *angle)
 {
     int matches=0;
     int cx = 0, cy = 0;
@@ -525,36 +675,56 @@ int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshol
     r->w = r->h = 0;
     r->x = r->y = 20000;
 
+    desc_set_t set1, set2;
+    desc_set_alloc(&set1, kpts1, radius);
+    if (kpts1 == kpts2) {
+        set2 = set1;
+    } else {
+        desc_set_alloc(&set2, kpts2, radius);
+    }
+
+    // The cross-match of a keypoint of the second set doesn't change while the first set doesn't
+    // (-2 not computed yet, -1 failed the distance ratio test, else the index in the first set).
+    int *cross = fb_alloc(set2.len * sizeof(int), FB_ALLOC_NO_HINT);
+    for (int i=0; i<set2.len; i++) {
+        cross[i] = -2;
+    }
+
     // Match keypoints and find "good matches" This runs 2/3 tests found in the RobustMatcher from the OpenCV programming cookbook.
     // The first test is based on the distance ratio between the two best matches for a feature, to remove ambiguous matches.
     // Second test is the symmetry test (corss-matching) both points in a match must be the best matching feature of each other.
     for (int i=0; i<kpts1_size; i++) {
-        int kp_index1 = 0;
-        int kp_index2 = 0;
         int min_dist1 = 0;
         int min_dist2 = 0;
-        kp_t *min_kp = NULL;
+
         kp_t *kp1 = array_at(kpts1, i);
 
         // Find the best match in second set
-        min_kp = find_best_match(kp1, kpts2, &min_dist1, &min_dist2, &kp_index2);
+        int kp_index2 = find_best_match(set1.desc + (i * (KDESC_SIZE/4)), kp1, &set2, &min_dist1, &min_dist2);
         // Test the distance ratio between the best two matches
-        if ((min_dist1*100/min_dist2) > threshold) {
+        if ((kp_index2 < 0) || ((min_dist1*100/min_dist2) > threshold)) {
             continue;
         }
 
         // Cross-match the keypoint in the first set
-        kp_t *kp2 = find_best_match(min_kp, kpts1, &min_dist1, &min_dist2, &kp_index1);
-        // Test the distance ratio between the best two matches
-        if ((min_dist1*100/min_dist2) > threshold) {
-            continue;
+        int kp_index1 = (kpts1 == kpts2) ? -2 : cross[kp_index2];
+        if (kp_index1 == -2) {
+            kp_index1 = find_best_match(set2.desc + (kp_index2 * (KDESC_SIZE/4)), array_at(kpts2, kp_index2),
+                                        &set1, &min_dist1, &min_dist2);
+            // Test the distance ratio between the best two matches
+            if ((kp_index1 < 0) || ((min_dist1*100/min_dist2) > threshold)) {
+                kp_index1 = -1;
+            }
+            cross[kp_index2] = kp_index1;
         }
 
         // Cross-match test
-        if (kp1 == kp2) {
+        if (kp_index1 == i) {
             int x, y;
+            kp_t *min_kp = array_at(kpts2, kp_index2);
             matches++;
             min_kp->matched = 1;
+            set2.matched[kp_index2] = 1;
             cx += x = min_kp->x;
             cy += y = min_kp->y;
             rectangle_expand(r, x, y);
@@ -567,6 +737,12 @@ int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshol
         }
     }
 
+    fb_free(); // cross
+    if (kpts1 != kpts2) {
+        desc_set_free(&set2);
+    }
+    desc_set_free(&set1);
+
     if (matches == 0) {
         r->x = r->y = 0;
         return 0;
@@ -10,7 +10,63 @@
  */
 #include "imlib.h"
 #include "fft.h"
+#include "ff_wrapper.h"
 
+#define LOGPOLAR_RHO_SHIFT  (4)
+#define LOGPOLAR_TRIG_SHIFT (14)
+
+// Copies the left half of dst row y (and its mirror on the right) from the source coordinates of each pixel.
+static void imlib_logpolar_row(image_t *dst, image_t *src, int y, const int16_t *xs, const int16_t *ys, bool check)
+{
+    int w = dst->w, w_2 = w / 2, src_w = src->w, src_h = src->h;
+
+    switch (src->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y);
+            for (int x = 0; x < w_2; x++) {
+                int sourceX = xs[x], sourceY = ys[x];
+                if ((!check) || ((0 <= sourceX) && (0 <= sourceY) && (sourceY < src_h))) { // plot the 2 symmetrical pixels
+                    uint32_t *ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(src, sourceY);
+                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX));
+                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, w - 1 - x, IMAGE_GET_BINARY_PIXEL_FAST(ptr, src_w - 1 - sourceX));
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y);
+            for (int x = 0; x < w_2; x++) {
+                int sourceX = xs[x], sourceY = ys[x];
+                if ((!check) || ((0 <= sourceX) && (0 <= sourceY) && (sourceY < src_h))) { // plot the 2 symmetrical pixels
+                    uint8_t *ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, sourceY);
+                    row_ptr[x] = ptr[sourceX];
+                    row_ptr[w - 1 - x] = ptr[src_w - 1 - sourceX];
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y);
+            for (int x = 0; x < w_2; x++) {
+                int sourceX = xs[x], sourceY = ys[x];
+                if ((!check) || ((0 <= sourceX) && (0 <= sourceY) && (sourceY < src_h))) { // plot the 2 symmetrical pixels
+                    uint16_t *ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, sourceY);
+                    row_ptr[x] = ptr[sourceX];
+                    row_ptr[w - 1 - x] = ptr[src_w - 1 - sourceX];
+                }
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// The source coordinates are computed once per row (into xs and ys) and then the pixels of the row
+// are copied by imlib_logpolar_row(). The forward mapping is separable, rho only depends on the row
+// and the angle on the column, so it is done with fixed point multiplies of 2 small tables. The
+// reverse mapping is symmetric around the center row so each pair of rows is computed once.
 void imlib_logpolar_int(image_t *dst, image_t *src, rectangle_t *roi, bool linear, bool reverse)
 {
     int w = roi->w; // == dst_w
@@ -27,193 +83,71 @@ void imlib_logpolar_int(image_t *dst, image_t *src, rectangle_t *roi, bool linea
     float theta_scale_d = m_pi_2_0_d / (w - 2);
     float theta_scale_inv = w / m_pi_2_0;
 
+    if (!w_2) {
+        return;
+    }
+
+    int16_t *xs = fb_alloc(w_2 * sizeof(int16_t) * 3, FB_ALLOC_NO_HINT);
+    int16_t *ys = xs + w_2;
+
     if (!reverse) {
         rho_scale /= h;
+        int tmp_x = roi->x + w_2 - 1, tmp_y = roi->y + h_2;
+        int32_t *col_trig = fb_alloc(w_2 * sizeof(int32_t) * 2, FB_ALLOC_NO_HINT);
+
+        for (int x = 0; x < w_2; x++) {
+            int theta = fast_roundf(m_pi_1_5_d - (x * theta_scale_d));
+            if (theta < 0) theta += m_pi_2_0_d_i; // wrap for table access
+            col_trig[(x * 2) + 0] = fast_roundf(cos_table[theta] * (1 << LOGPOLAR_TRIG_SHIFT));
+            col_trig[(x * 2) + 1] = fast_roundf(sin_table[theta] * (1 << LOGPOLAR_TRIG_SHIFT));
+        }
 
-        switch (src->bpp) {
-            case IMAGE_BPP_BINARY: {
-                uint32_t *tmp = (uint32_t *) src->data;
-                int tmp_w = src->w, tmp_h = src->h, tmp_x = roi->x + w_2 - 1, tmp_y = roi->y + h_2;
-
-                for (int y = 0, yy = h; y < yy; y++) {
-                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y);
-                    float rho = y * rho_scale;
-                    if (!linear) rho = fast_expf(rho);
-                    for (int x = 0, xx = w_2; x < xx; x++) {
-
-                        int theta = fast_roundf(m_pi_1_5_d - (x * theta_scale_d));
-                        if (theta < 0) theta += m_pi_2_0_d_i; // wrap for table access
-                        int sourceX = tmp_x + fast_roundf(rho * cos_table[theta]); // rounding is necessary
-                        int sourceY = tmp_y + fast_roundf(rho * sin_table[theta]); // rounding is necessary
-
-                        if ((0 <= sourceX) && (0 <= sourceY) && (sourceY < tmp_h)) { // plot the 2 symmetrical pixels
-                            uint32_t *ptr, pixel;
-                            ptr = tmp + (((tmp_w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY);
-                            pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX);
-                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, pixel);
-                            pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, tmp_w-1-sourceX);
-                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, w-1-x, pixel);
-                        }
-                    }
-                }
-                break;
-            }
-            case IMAGE_BPP_GRAYSCALE: {
-                uint8_t *tmp = (uint8_t *) src->data;
-                int tmp_w = src->w, tmp_h = src->h, tmp_x = roi->x + w_2 - 1, tmp_y = roi->y + h_2;
-
-                for (int y = 0, yy = h; y < yy; y++) {
-                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y);
-                    float rho = y * rho_scale;
-                    if (!linear) rho = fast_expf(rho);
-                    for (int x = 0, xx = w_2; x < xx; x++) {
-
-                        int theta = fast_roundf(m_pi_1_5_d - (x * theta_scale_d));
-                        if (theta < 0) theta += m_pi_2_0_d_i; // wrap for table access
-                        int sourceX = tmp_x + fast_roundf(rho * cos_table[theta]); // rounding is necessary
-                        int sourceY = tmp_y + fast_roundf(rho * sin_table[theta]); // rounding is necessary
-
-                        if ((0 <= sourceX) && (0 <= sourceY) && (sourceY < tmp_h)) { // plot the 2 symmetrical pixels
-                            uint8_t *ptr, pixel;
-                            ptr = tmp + (tmp_w * sourceY);
-                            pixel = ptr[sourceX];
-                            row_ptr[x] = pixel;
-                            pixel = ptr[tmp_w - 1 - sourceX];
-                            row_ptr[w - 1 - x] = pixel;
-                        }
-                    }
-                }
-                break;
-            }
-            case IMAGE_BPP_RGB565: {
-                uint16_t *tmp = (uint16_t *) src->data;
-                int tmp_w = src->w, tmp_h = src->h, tmp_x = roi->x + w_2 - 1, tmp_y = roi->y + h_2;
-
-                for (int y = 0, yy = h; y < yy; y++) {
-                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y);
-                    float rho = y * rho_scale;
-                    if (!linear) rho = fast_expf(rho);
-                    for (int x = 0, xx = w_2; x < xx; x++) {
-
-                        int theta = fast_roundf(m_pi_1_5_d - (x * theta_scale_d));
-                        if (theta < 0) theta += m_pi_2_0_d_i; // wrap for table access
-                        int sourceX = tmp_x + fast_roundf(rho * cos_table[theta]); // rounding is necessary
-                        int sourceY = tmp_y + fast_roundf(rho * sin_table[theta]); // rounding is necessary
-
-                        if ((0 <= sourceX) && (0 <= sourceY) && (sourceY < tmp_h)) { // plot the 2 symmetrical pixels
-                            uint16_t *ptr, pixel;
-                            ptr = tmp + (tmp_w * sourceY);
-                            pixel = ptr[sourceX];
-                            row_ptr[x] = pixel;
-                            pixel = ptr[tmp_w - 1 - sourceX];
-                            row_ptr[w - 1 - x] = pixel;
-                        }
-                    }
-                }
-                break;
-            }
-            default: {
-                break;
+        const int shift = LOGPOLAR_RHO_SHIFT + LOGPOLAR_TRIG_SHIFT, round = 1 << (shift - 1);
+
+        for (int y = 0; y < h; y++) {
+            float rho_f = y * rho_scale;
+            if (!linear) rho_f = fast_expf(rho_f);
+            int rho = fast_roundf(rho_f * (1 << LOGPOLAR_RHO_SHIFT));
+
+            for (int x = 0; x < w_2; x++) {
+                xs[x] = tmp_x + (((rho * col_trig[(x * 2) + 0]) + round) >> shift); // rounding is necessary
+                ys[x] = tmp_y + (((rho * col_trig[(x * 2) + 1]) + round) >> shift); // rounding is necessary
             }
+
+            imlib_logpolar_row(dst, src, y, xs, ys, true);
         }
+
+        fb_free(); // col_trig
     } else {
         float rho_scale_inv = (h - 1) / rho_scale;
-        switch (src->bpp) {
-            case IMAGE_BPP_BINARY: {
-                uint32_t *tmp = (uint32_t *) src->data;
-                int tmp_w = src->w, tmp_x = roi->x, tmp_y = roi->y;
-
-                for (int y = 0, yy = h; y < yy; y++) {
-                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y);
-                    int y_2 = y - h_2;
-                    int y_2_2 = y_2 * y_2;
-
-                    for (int x = 0, xx = w_2; x < xx; x++) {
-                        int x_2 = x - w_2;
-                        int x_2_2 = x_2 * x_2;
-
-                        float rho = fast_sqrtf(x_2_2 + y_2_2);
-                        if (!linear) rho = fast_log(rho);
-                        float theta = m_pi_1_5 - fast_atan2f(y_2, x_2);
-                        int sourceX = tmp_x + fast_roundf(theta * theta_scale_inv); // rounding is necessary
-                        int sourceY = tmp_y + fast_roundf(rho * rho_scale_inv); // rounding is necessary
-
-                        // plot the 2 symmetrical pixels
-                        uint32_t *ptr, pixel;
-                        ptr = tmp + (((tmp_w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY);
-                        pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX);
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, pixel);
-                        pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, tmp_w-1-sourceX);
-                        IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, w-1-x, pixel);
-                    }
-                }
-                break;
+        int tmp_x = roi->x, tmp_y = roi->y;
+        // Row h_2 + i and row h_2 - i have the same rho and opposite angles.
+        int16_t *xs_2 = ys + w_2;
+
+        for (int i = 0; i <= h_2; i++) {
+            int i_2_2 = i * i;
+
+            for (int x = 0; x < w_2; x++) {
+                int x_2 = x - w_2;
+                float rho = fast_sqrtf((x_2 * x_2) + i_2_2);
+                if (!linear) rho = fast_log(rho);
+                float theta = fast_atan2f(i, x_2);
+                xs[x] = tmp_x + fast_roundf((m_pi_1_5 - theta) * theta_scale_inv); // rounding is necessary
+                xs_2[x] = tmp_x + fast_roundf((m_pi_1_5 + theta) * theta_scale_inv); // rounding is necessary
+                ys[x] = tmp_y + fast_roundf(rho * rho_scale_inv); // rounding is necessary
             }
-            case IMAGE_BPP_GRAYSCALE: {
-                uint8_t *tmp = (uint8_t *) src->data;
-                int tmp_w = src->w, tmp_x = roi->x, tmp_y = roi->y;
-
-                for (int y = 0, yy = h; y < yy; y++) {
-                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y);
-                    int y_2 = y - h_2;
-                    int y_2_2 = y_2 * y_2;
-
-                    for (int x = 0, xx = w_2; x < xx; x++) {
-                        int x_2 = x - w_2;
-                        int x_2_2 = x_2 * x_2;
-
-                        float rho = fast_sqrtf(x_2_2 + y_2_2);
-                        if (!linear) rho = fast_log(rho);
-                        float theta = m_pi_1_5 - fast_atan2f(y_2, x_2);
-                        int sourceX = tmp_x + fast_roundf(theta * theta_scale_inv); // rounding is necessary
-                        int sourceY = tmp_y + fast_roundf(rho * rho_scale_inv); // rounding is necessary
-
-                        // plot the 2 symmetrical pixels
-                        uint8_t *ptr, pixel;
-                        ptr = tmp + (tmp_w * sourceY);
-                        pixel = ptr[sourceX];
-                        row_ptr[x] = pixel;
-                        pixel = ptr[tmp_w - 1 - sourceX];
-                        row_ptr[w - 1 - x] = pixel;
-                    }
-                }
-                break;
-            }
-            case IMAGE_BPP_RGB565: {
-                uint16_t *tmp = (uint16_t *) src->data;
-                int tmp_w = src->w, tmp_x = roi->x, tmp_y = roi->y;
-
-                for (int y = 0, yy = h; y < yy; y++) {
-                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y);
-                    int y_2 = y - h_2;
-                    int y_2_2 = y_2 * y_2;
-
-                    for (int x = 0, xx = w_2; x < xx; x++) {
-                        int x_2 = x - w_2;
-                        int x_2_2 = x_2 * x_2;
-
-                        float rho = fast_sqrtf(x_2_2 + y_2_2);
-                        if (!linear) rho = fast_log(rho);
-                        float theta = m_pi_1_5 - fast_atan2f(y_2, x_2);
-                        int sourceX = tmp_x + fast_roundf(theta * theta_scale_inv); // rounding is necessary
-                        int sourceY = tmp_y + fast_roundf(rho * rho_scale_inv); // rounding is necessary
-
-                        // plot the 2 symmetrical pixels
-                        uint16_t *ptr, pixel;
-                        ptr = tmp + (tmp_w * sourceY);
-                        pixel = ptr[sourceX];
-                        row_ptr[x] = pixel;
-                        pixel = ptr[tmp_w - 1 - sourceX];
-                        row_ptr[w - 1 - x] = pixel;
-                    }
-                }
-                break;
+
+            if ((h_2 + i) < h) {
+                imlib_logpolar_row(dst, src, h_2 + i, xs, ys, false);
             }
-            default: {
-                break;
+
+            if (i) {
+                imlib_logpolar_row(dst, src, h_2 - i, xs_2, ys, false);
             }
         }
     }
+
+    fb_free(); // xs
 }
 
 #if defined(IMLIB_ENABLE_LOGPOLAR) || defined(IMLIB_ENABLE_LINPOLAR)
@@ -242,6 +176,139 @@ void imlib_logpolar(image_t *img, bool linear, bool reverse)
 #endif //defined(IMLIB_ENABLE_LOGPOLAR) || defined(IMLIB_ENABLE_LINPOLAR)
 
 #ifdef IMLIB_ENABLE_FIND_DISPLACEMENT
+// Finds the peak of the phase correlation surface (real values in the first w floats of each
+// row of w complex values) and refines it with the centroid of the 4x4 area around it.
+static void phasecorrelate_peak(float *data, int w, int h, float *x_translation, float *y_translation, float *response)
+{
+    float sum = 0;
+    float max = 0;
+    int off_x = 0;
+    int off_y = 0;
+
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++) {
+            // Note that the output of the FFT is packed with real data in both
+            // the real and imaginary parts... (right side of the array is zero).
+            float f_r = data[(i * w * 2) + j];
+            sum += f_r;
+            if (f_r > max) {
+                max = f_r;
+                off_x = j;
+                off_y = i;
+            }
+        }
+    }
+
+    *response = max / sum; // normalize this to [0:1].
+
+    float f_sum = 0;
+    float f_off_x = 0;
+    float f_off_y = 0;
+
+    for (int i = -2; i < 2; i++) {
+        for (int j = -2; j < 2; j++) {
+
+            // Wrap around
+            int new_x = off_x + j;
+            if (new_x < 0) new_x += w;
+            if (new_x >= w) new_x -= w;
+
+            // Wrap around
+            int new_y = off_y + i;
+            if (new_y < 0) new_y += h;
+            if (new_y >= h) new_y -= h;
+
+            // Compute centroid.
+            float f_r = data[(new_y * w * 2) + new_x];
+            f_off_x += (off_x + j) * f_r; // don't use new_x here
+            f_off_y += (off_y + i) * f_r; // don't use new_y here
+            f_sum += f_r;
+        }
+    }
+
+    f_off_x /= f_sum;
+    f_off_y /= f_sum;
+
+    // FFT Shift X
+    if (f_off_x >= (w/2.0f)) {
+        *x_translation = f_off_x - w;
+    } else {
+        *x_translation = f_off_x;
+    }
+
+    // FFT Shift Y
+    if (f_off_y >= (h/2.0f)) {
+        *y_translation = -(f_off_y - h);
+    } else {
+        *y_translation = -f_off_y;
+    }
+
+    if ((*x_translation < (-w/2.0f))
+    || ((w/2.0f) <= *x_translation)
+    || (*y_translation < (-h/2.0f))
+    || ((h/2.0f) <= *y_translation)
+    || isnanf(*x_translation)
+    || isinff(*x_translation)
+    || isnanf(*y_translation)
+    || isinff(*y_translation)
+    || isnanf(*response)
+    || isinff(*response)) { // Noise Filter
+        *x_translation = 0;
+        *y_translation = 0;
+        *response = 0;
+    }
+}
+
+// Normalized cross power spectrum of data and the conjugate of ref, stored in data.
+static void phasecorrelate_cross_power(float *data, const float *ref, int len)
+{
+    for (int i = 0, j = len * 2; i < j; i += 2) {
+        float ga_r = data[i+0];
+        float ga_i = data[i+1];
+        float gb_r = ref[i+0];
+        float gb_i = -ref[i+1]; // complex conjugate...
+        float hp_r = (ga_r * gb_r) - (ga_i * gb_i); // hadamard product
+        float hp_i = (ga_r * gb_i) + (ga_i * gb_r); // hadamard product
+        float mag = 1 / fast_sqrtf((hp_r*hp_r)+(hp_i*hp_i)); // magnitude
+        data[i+0] = hp_r * mag;
+        data[i+1] = hp_i * mag;
+    }
+}
+
+size_t imlib_phasecorrelate_template_size(rectangle_t *roi)
+{
+    return 2 * (1 << fft2d_fast_pow2(roi->w)) * (1 << fft2d_fast_pow2(roi->h)) * sizeof(float);
+}
+
+void imlib_phasecorrelate_template_init(phasecorrelate_template_t *t, image_t *img, rectangle_t *roi, float *buf)
+{
+    if (!rectangle_subimg(img, roi, &t->roi)) ff_no_intersection(NULL);
+    t->w_pow2 = fft2d_fast_pow2(t->roi.w);
+    t->h_pow2 = fft2d_fast_pow2(t->roi.h);
+    t->spectrum = buf;
+    fft2d_fast_run(img, &t->roi, t->w_pow2, t->h_pow2, t->spectrum);
+}
+
+// Translation only phase correlation against the precomputed spectrum of the template.
+// Note that the ROI width and height must be equal to the template ROI width and height.
+void imlib_phasecorrelate_template(image_t *img, rectangle_t *roi, phasecorrelate_template_t *t,
+                                   float *x_translation, float *y_translation, float *response)
+{
+    rectangle_t r;
+    if (!rectangle_subimg(img, roi, &r)) ff_no_intersection(NULL);
+
+    int w = 1 << t->w_pow2;
+    int h = 1 << t->h_pow2;
+    float *data = fb_alloc(2 * w * h * sizeof(float), FB_ALLOC_NO_HINT);
+
+    fft2d_fast_run(img, &r, t->w_pow2, t->h_pow2, data);
+    phasecorrelate_cross_power(data, t->spectrum, w * h);
+    ifft2d_fast_run(t->w_pow2, t->h_pow2, data);
+    phasecorrelate_peak(data, w, h, x_translation, y_translation, response);
+
+    fb_free(); // data
+}
+
 // Note that both ROI widths and heights must be equal.
 void imlib_phasecorrelate(image_t *img0, image_t *img1, rectangle_t *roi0, rectangle_t *roi1, bool logpolar, bool fix_rotation_scale,
                           float *x_translation, float *y_translation, float *rotation, float *scale, float *response)
@@ -271,98 +338,13 @@ void imlib_phasecorrelate(image_t *img0, image_t *img1, rectangle_t *roi0, recta
         int w = (1 << fft0.w_pow2);
         int h = (1 << fft0.h_pow2);
 
-        for (int i = 0, j = h * w * 2; i < j; i += 2) {
-            float ga_r = fft0.data[i+0];
-            float ga_i = fft0.data[i+1];
-            float gb_r = fft1.data[i+0];
-            float gb_i = -fft1.data[i+1]; // complex conjugate...
-            float hp_r = (ga_r * gb_r) - (ga_i * gb_i); // hadamard product
-            float hp_i = (ga_r * gb_i) + (ga_i * gb_r); // hadamard product
-            float mag = 1 / fast_sqrtf((hp_r*hp_r)+(hp_i*hp_i)); // magnitude
-            // Replace first fft with phase correlation...
-            fft0.data[i+0] = hp_r * mag;
-            fft0.data[i+1] = hp_i * mag;
-        }
+        // Replace first fft with phase correlation...
+        phasecorrelate_cross_power(fft0.data, fft1.data, w * h);
 
         ifft2d_run(&fft0);
 
-        float sum = 0;
-        float max = 0;
-        int off_x = 0;
-        int off_y = 0;
-
-        for (int i = 0; i < h; i++) {
-            for (int j = 0; j < w; j++) {
-                // Note that the output of the FFT is packed with real data in both
-                // the real and imaginary parts... (right side of the array is zero).
-                float f_r = fft0.data[(i * w * 2) + j];
-                sum += f_r;
-                if (f_r > max) {
-                    max = f_r;
-                    off_x = j;
-                    off_y = i;
-                }
-            }
-        }
-
-        float tmp_response = max / sum; // normalize this to [0:1].
-
-        float f_sum = 0;
-        float f_off_x = 0;
-        float f_off_y = 0;
-
-        for (int i = -2; i < 2; i++) {
-            for (int j = -2; j < 2; j++) {
-
-                // Wrap around
-                int new_x = off_x + j;
-                if (new_x < 0) new_x += w;
-                if (new_x >= w) new_x -= w;
-
-                // Wrap around
-                int new_y = off_y + i;
-                if (new_y < 0) new_y += h;
-                if (new_y >= h) new_y -= h;
-
-                // Compute centroid.
-                float f_r = fft0.data[(new_y * w * 2) + new_x];
-                f_off_x += (off_x + j) * f_r; // don't use new_x here
-                f_off_y += (off_y + i) * f_r; // don't use new_y here
-                f_sum += f_r;
-            }
-        }
-
-        f_off_x /= f_sum;
-        f_off_y /= f_sum;
-
-        // FFT Shift X
-        if (f_off_x >= (w/2.0f)) {
-            f_off_x = f_off_x - w;
-        } else {
-            f_off_x = f_off_x;
-        }
-
-        // FFT Shift Y
-        if (f_off_y >= (h/2.0f)) {
-            f_off_y = -(f_off_y - h);
-        } else {
-            f_off_y = -f_off_y;
-        }
-
-        if ((f_off_x < (-w/2.0f))
-        || ((w/2.0f) <= f_off_x)
-        || (f_off_y < (-h/2.0f))
-        || ((h/2.0f) <= f_off_y)
-        || isnanf(f_off_x)
-        || isinff(f_off_x)
-        || isnanf(f_off_y)
-        || isinff(f_off_y)
-        || isnanf(tmp_response)
-        || isinff(tmp_response)) { // Noise Filter
-            f_off_x = 0;
-            f_off_y = 0;
-            tmp_response = 0;
-        }
+        float f_off_x, f_off_y, tmp_response;
+        phasecorrelate_peak(fft0.data, w, h, &f_off_x, &f_off_y, &tmp_response);
 
         fft2d_dealloc(); // fft1
         fft2d_dealloc(); // fft0
@@ -462,111 +444,13 @@ void imlib_phasecorrelate(image_t *img0, image_t *img1, rectangle_t *roi0, recta
             roi1alt.h = roi1->h;
         }
 
-        fft2d_controller_t fft0, fft1;
-
-        fft2d_alloc(&fft0, logpolar ? &img0alt : &img0_fixed, logpolar ? &roi0alt : &roi0_fixed);
-        fft2d_alloc(&fft1, logpolar ? &img1alt : img1, logpolar ? &roi1alt : roi1);
-
-        fft2d_run(&fft0);
-        fft2d_run(&fft1);
-
-        int w = (1 << fft0.w_pow2);
-        int h = (1 << fft0.h_pow2);
-
-        for (int i = 0, j = h * w * 2; i < j; i += 2) {
-            float ga_r = fft0.data[i+0];
-            float ga_i = fft0.data[i+1];
-            float gb_r = fft1.data[i+0];
-            float gb_i = -fft1.data[i+1]; // complex conjugate...
-            float hp_r = (ga_r * gb_r) - (ga_i * gb_i); // hadamard product
-            float hp_i = (ga_r * gb_i) + (ga_i * gb_r); // hadamard product
-            float mag = 1 / fast_sqrtf((hp_r*hp_r)+(hp_i*hp_i)); // magnitude
-            fft0.data[i+0] = hp_r * mag;
-            fft0.data[i+1] = hp_i * mag;
-        }
-
-        ifft2d_run(&fft0);
-
-        float sum = 0;
-        float max = 0;
-        int off_x = 0;
-        int off_y = 0;
-
-        for (int i = 0; i < h; i++) {
-            for (int j = 0; j < w; j++) {
-                // Note that the output of the FFT is packed with real data in both
-                // the real and imaginary parts... (right side of the array is zero).
-                float f_r = fft0.data[(i * w * 2) + j];
-                sum += f_r;
-                if (f_r > max) {
-                    max = f_r;
-                    off_x = j;
-                    off_y = i;
-                }
-            }
-        }
-
-        *response = max / sum; // normalize this to [0:1].
-
-        float f_sum = 0;
-        float f_off_x = 0;
-        float f_off_y = 0;
-
-        for (int i = -2; i < 2; i++) {
-            for (int j = -2; j < 2; j++) {
-
-                // Wrap around
-                int new_x = off_x + j;
-                if (new_x < 0) new_x += w;
-                if (new_x >= w) new_x -= w;
-
-                // Wrap around
-                int new_y = off_y + i;
-                if (new_y < 0) new_y += h;
-                if (new_y >= h) new_y -= h;
-
-                // Compute centroid.
-                float f_r = fft0.data[(new_y * w * 2) + new_x];
-                f_off_x += (off_x + j) * f_r; // don't use new_x here
-                f_off_y += (off_y + i) * f_r; // don't use new_y here
-                f_sum += f_r;
-            }
-        }
-
-        f_off_x /= f_sum;
-        f_off_y /= f_sum;
-
-        // FFT Shift X
-        if (f_off_x >= (w/2.0f)) {
-            *x_translation = f_off_x - w;
-        } else {
-            *x_translation = f_off_x;
-        }
-
-        // FFT Shift Y
-        if (f_off_y >= (h/2.0f)) {
-            *y_translation = -(f_off_y - h);
-        } else {
-            *y_translation = -f_off_y;
-        }
-
-        if ((*x_translation < (-w/2.0f))
-        || ((w/2.0f) <= *x_translation)
-        || (*y_translation < (-h/2.0f))
-        || ((h/2.0f) <= *y_translation)
-        || isnanf(*x_translation)
-        || isinff(*x_translation)
-        || isnanf(*y_translation)
-        || isinff(*y_translation)
-        || isnanf(*response)
-        || isinff(*response)) { // Noise Filter
-            *x_translation = 0;
-            *y_translation = 0;
-            *response = 0;
-        }
-
-        fft2d_dealloc(); // fft1
-        fft2d_dealloc(); // fft0
+        phasecorrelate_template_t t;
+        rectangle_t *roi1t = logpolar ? &roi1alt : roi1;
+        imlib_phasecorrelate_template_init(&t, logpolar ? &img1alt : img1, roi1t,
+                                           fb_alloc(imlib_phasecorrelate_template_size(roi1t), FB_ALLOC_NO_HINT));
+        imlib_phasecorrelate_template(logpolar ? &img0alt : &img0_fixed, logpolar ? &roi0alt : &roi0_fixed, &t,
+                                      x_translation, y_translation, response);
+        fb_free(); // t.spectrum
 
         if (logpolar) {
             fb_free(); // img1alt
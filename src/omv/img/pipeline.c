@@ -0,0 +1,172 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Recorded chains of image ops.
+ */
+#include "imlib.h"
+
+void imlib_pipeline_init(pipeline_t *p)
+{
+    memset(p, 0, sizeof(pipeline_t));
+}
+
+pipeline_op_t *imlib_pipeline_add(pipeline_t *p, pipeline_op_type_t type)
+{
+    if (p->n >= PIPELINE_MAX_OPS) {
+        return NULL;
+    }
+
+    pipeline_op_t *op = p->ops + p->n++;
+    memset(op, 0, sizeof(pipeline_op_t));
+    op->type = type;
+    return op;
+}
+
+static bool pipeline_op_is_pointwise(pipeline_op_t *op)
+{
+    return (op->type == PIPELINE_OP_GAMMA_CORR) || (op->type == PIPELINE_OP_NEGATE);
+}
+
+// Runs ops [0, n) (all per pixel) on each row in turn so the row stays in the cache.
+static void pipeline_run_pointwise(pipeline_op_t *ops, int n, image_t *img)
+{
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        void *row = (img->bpp == IMAGE_BPP_BINARY) ? ((void *) IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y))
+                  : (img->bpp == IMAGE_BPP_RGB565) ? ((void *) IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y))
+                  : ((void *) IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y));
+
+        for (int i = 0; i < n; i++) {
+            switch (ops[i].type) {
+                #ifdef IMLIB_ENABLE_MATH_OPS
+                case PIPELINE_OP_GAMMA_CORR: {
+                    imlib_gamma_lut_line(ops[i].gamma_lut, img->bpp, row, img->w);
+                    break;
+                }
+                case PIPELINE_OP_NEGATE: {
+                    // The max of each channel is all ones so negating is a bitwise not.
+                    switch (img->bpp) {
+                        case IMAGE_BPP_BINARY: {
+                            uint32_t *data = (uint32_t *) row;
+                            int x = 0, xx = img->w;
+                            for (; x < (xx - 31); x += 32) {
+                                data[x / 32] = ~data[x / 32];
+                            }
+                            for (; x < xx; x++) {
+                                IMAGE_PUT_BINARY_PIXEL_FAST(data, x, !IMAGE_GET_BINARY_PIXEL_FAST(data, x));
+                            }
+                            break;
+                        }
+                        case IMAGE_BPP_GRAYSCALE: {
+                            uint8_t *data = (uint8_t *) row;
+                            for (int x = 0, xx = img->w; x < xx; x++) {
+                                data[x] = ~data[x];
+                            }
+                            break;
+                        }
+                        case IMAGE_BPP_RGB565: {
+                            uint16_t *data = (uint16_t *) row;
+                            for (int x = 0, xx = img->w; x < xx; x++) {
+                                data[x] = ~data[x];
+                            }
+                            break;
+                        }
+                        default: {
+                            break;
+                        }
+                    }
+                    break;
+                }
+                #endif // IMLIB_ENABLE_MATH_OPS
+                default: {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void pipeline_run_op(pipeline_op_t *op, image_t *img)
+{
+    switch (op->type) {
+        #ifdef IMLIB_ENABLE_LENS_CORR
+        case PIPELINE_OP_LENS_CORR: {
+            #ifdef IMLIB_ENABLE_REMAP
+            // The correction only depends on the image size so it's a gather after the first run.
+            if ((!op->remap.grid) || (op->remap.w != img->w) || (op->remap.h != img->h)) {
+                if (op->remap.grid) {
+                    imlib_remap_free(&op->remap);
+                    op->remap.grid = NULL;
+                }
+
+                imlib_remap_alloc(&op->remap, img->w, img->h);
+                imlib_remap_lens_corr(&op->remap, op->args[0], op->args[1], op->args[2], op->args[3]);
+            }
+
+            imlib_remap(img, &op->remap);
+            #else
+            imlib_lens_corr(img, op->args[0], op->args[1], op->args[2], op->args[3]);
+            #endif
+            break;
+        }
+        #endif // IMLIB_ENABLE_LENS_CORR
+        #ifdef IMLIB_ENABLE_BINARY_OPS
+        case PIPELINE_OP_BINARY: {
+            imlib_binary(img, img, &op->thresholds, op->invert, op->zero, NULL);
+            break;
+        }
+        case PIPELINE_OP_ERODE: {
+            imlib_erode(img, op->ksize, op->threshold, NULL);
+            break;
+        }
+        case PIPELINE_OP_DILATE: {
+            imlib_dilate(img, op->ksize, op->threshold, NULL);
+            break;
+        }
+        #endif // IMLIB_ENABLE_BINARY_OPS
+        #ifdef IMLIB_ENABLE_MEAN
+        case PIPELINE_OP_MEAN: {
+            imlib_mean_filter(img, op->ksize, op->threshold, op->offset, op->invert, NULL);
+            break;
+        }
+        #endif // IMLIB_ENABLE_MEAN
+        #ifdef IMLIB_ENABLE_MEDIAN
+        case PIPELINE_OP_MEDIAN: {
+            imlib_median_filter(img, op->ksize, op->args[0], op->threshold, op->offset, op->invert, NULL);
+            break;
+        }
+        #endif // IMLIB_ENABLE_MEDIAN
+        case PIPELINE_OP_MORPH: {
+            imlib_morph(img, op->ksize, op->krn, op->args[0], op->args[1], op->threshold, op->offset, op->invert, NULL);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void imlib_pipeline_run(pipeline_t *p, image_t *img)
+{
+    for (int i = 0; i < p->n;) {
+        if (pipeline_op_is_pointwise(p->ops + i)) {
+            int j = i + 1;
+
+            while ((j < p->n) && pipeline_op_is_pointwise(p->ops + j)) {
+                j++;
+            }
+
+            pipeline_run_pointwise(p->ops + i, j - i, img);
+            i = j;
+        } else {
+            fb_alloc_mark();
+            pipeline_run_op(p->ops + i, img);
+            fb_alloc_free_till_mark();
+            i++;
+        }
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2020 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2020 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Pixel format specialized row loops.
+ *
+ * Row kernels are written once as ALWAYS_INLINE functions whose first two arguments are the pixel
+ * format and whether a mask is used. PIXEL_LOOP_DISPATCH() calls the kernel with constants for
+ * both, so each (format, mask) pair gets its own copy of the loop with the format switches and the
+ * mask test folded away. Kernels take a pixel range, a roi costs nothing over the full row.
+ *
+ * A SIMD fast path is added once per format by handling the start of the row for that format
+ * before dispatching the rest (see mathop.c).
+ */
+#ifndef __PIXEL_LOOP_H__
+#define __PIXEL_LOOP_H__
+#include "imlib.h"
+#include "common.h"
+
+// Channel operation, a and b are channel values between 0 and max.
+typedef int (*pixel_loop_channel_op_t)(int a, int b, int max);
+
+ALWAYS_INLINE static void *pixel_loop_row_ptr(image_bpp_t bpp, image_t *img, int y)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            return IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            return IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+        }
+        case IMAGE_BPP_RGB565: {
+            return IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+ALWAYS_INLINE static int pixel_loop_get(image_bpp_t bpp, const void *row_ptr, int x)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            return IMAGE_GET_BINARY_PIXEL_FAST((const uint32_t *) row_ptr, x);
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            return IMAGE_GET_GRAYSCALE_PIXEL_FAST((const uint8_t *) row_ptr, x);
+        }
+        case IMAGE_BPP_RGB565: {
+            return IMAGE_GET_RGB565_PIXEL_FAST((const uint16_t *) row_ptr, x);
+        }
+        default: {
+            return 0;
+        }
+    }
+}
+
+ALWAYS_INLINE static void pixel_loop_put(image_bpp_t bpp, void *row_ptr, int x, int p)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) row_ptr, x, p);
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            IMAGE_PUT_GRAYSCALE_PIXEL_FAST((uint8_t *) row_ptr, x, p);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) row_ptr, x, p);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Applies op to each channel of the pixels a and b (the binary and grayscale value being one channel).
+ALWAYS_INLINE static int pixel_loop_channel_op(image_bpp_t bpp, int a, int b, pixel_loop_channel_op_t op)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            return op(a, b, COLOR_BINARY_MAX);
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            return op(a, b, COLOR_GRAYSCALE_MAX);
+        }
+        case IMAGE_BPP_RGB565: {
+            int r = op(COLOR_RGB565_TO_R5(a), COLOR_RGB565_TO_R5(b), COLOR_R5_MAX);
+            int g = op(COLOR_RGB565_TO_G6(a), COLOR_RGB565_TO_G6(b), COLOR_G6_MAX);
+            int bb = op(COLOR_RGB565_TO_B5(a), COLOR_RGB565_TO_B5(b), COLOR_B5_MAX);
+            return COLOR_R5_G6_B5_TO_RGB565(r, g, bb);
+        }
+        default: {
+            return a;
+        }
+    }
+}
+
+// Pixels x_start to x_end - 1 of line y of img = op(img, other) for each channel, other is a row
+// of the same format. Only the pixels set in mask are changed when masked.
+ALWAYS_INLINE static void pixel_loop_row_channel_op(image_bpp_t bpp, bool masked, image_t *img, int y,
+                                                    int x_start, int x_end, const void *other, image_t *mask,
+                                                    pixel_loop_channel_op_t op)
+{
+    void *row_ptr = pixel_loop_row_ptr(bpp, img, y);
+
+    for (int x = x_start; x < x_end; x++) {
+        if ((!masked) || image_get_mask_pixel(mask, x, y)) {
+            int p = pixel_loop_channel_op(bpp, pixel_loop_get(bpp, row_ptr, x), pixel_loop_get(bpp, other, x), op);
+            pixel_loop_put(bpp, row_ptr, x, p);
+        }
+    }
+}
+
+// Calls kernel(bpp, masked, ...) with bpp and masked as constants.
+#define PIXEL_LOOP_DISPATCH(bpp, masked, kernel, ...)                       \
+    do {                                                                    \
+        switch (bpp) {                                                      \
+            case IMAGE_BPP_BINARY: {                                        \
+                if (masked) kernel(IMAGE_BPP_BINARY, true, __VA_ARGS__);    \
+                else kernel(IMAGE_BPP_BINARY, false, __VA_ARGS__);          \
+                break;                                                      \
+            }                                                               \
+            case IMAGE_BPP_GRAYSCALE: {                                     \
+                if (masked) kernel(IMAGE_BPP_GRAYSCALE, true, __VA_ARGS__); \
+                else kernel(IMAGE_BPP_GRAYSCALE, false, __VA_ARGS__);       \
+                break;                                                      \
+            }                                                               \
+            case IMAGE_BPP_RGB565: {                                        \
+                if (masked) kernel(IMAGE_BPP_RGB565, true, __VA_ARGS__);    \
+                else kernel(IMAGE_BPP_RGB565, false, __VA_ARGS__);          \
+                break;                                                      \
+            }                                                               \
+            default: {                                                      \
+                break;                                                      \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+#endif // __PIXEL_LOOP_H__
@@ -36,13 +36,15 @@ void imlib_midpoint_pool(image_t *img_i, image_t *img_o, int x_div, int y_div, c
         }
         case IMAGE_BPP_GRAYSCALE:
         {
-            for (int y = 0, yy = img_i->h, yyy = (img_i->h % y_div) / 2 / y_div; y < yy; y++) {
+            for (int y = 0, yy = img_i->h / y_div, yyy = (img_i->h % y_div) / 2; y < yy; y++) {
                 uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img_o, y);
                 for (int x = 0, xx = img_i->w / x_div, xxx = (img_i->w % x_div) / 2; x < xx; x++) {
                     int min = COLOR_GRAYSCALE_MAX, max = COLOR_GRAYSCALE_MIN;
                     for (int i = 0; i < y_div; i++) {
+                        uint8_t *src_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img_i, yyy + (y * y_div) + i)
+                                             + xxx + (x * x_div);
                         for (int j = 0; j < x_div; j++) {
-                            int pixel = IMAGE_GET_GRAYSCALE_PIXEL(img_i, xxx + (x * x_div) + j, yyy + (y * y_div) + i);
+                            int pixel = src_row_ptr[j];
                             min = IM_MIN(min, pixel);
                             max = IM_MAX(max, pixel);
                         }
@@ -62,8 +64,10 @@ void imlib_midpoint_pool(image_t *img_i, image_t *img_o, int x_div, int y_div, c
                     int g_min = COLOR_G6_MAX, g_max = COLOR_G6_MIN;
                     int b_min = COLOR_B5_MAX, b_max = COLOR_B5_MIN;
                     for (int i = 0; i < y_div; i++) {
+                        uint16_t *src_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img_i, yyy + (y * y_div) + i)
+                                              + xxx + (x * x_div);
                         for (int j = 0; j < x_div; j++) {
-                            const uint16_t pixel = IM_GET_RGB565_PIXEL(img_i, xxx + (x * x_div) + j, yyy + (y * y_div) + i);
+                            const uint16_t pixel = src_row_ptr[j];
                             int r = COLOR_RGB565_TO_R5(pixel);
                             int g = COLOR_RGB565_TO_G6(pixel);
                             int b = COLOR_RGB565_TO_B5(pixel);
@@ -63,6 +63,13 @@ int quirc_resize(struct quirc *q, int w, int h);
 uint8_t *quirc_begin(struct quirc *q, int *w, int *h);
 void quirc_end(struct quirc *q);
 
+/* Like quirc_end(), but the input image is read from source (rows are
+ * stride bytes apart) instead of the buffer returned by quirc_begin(),
+ * which then only receives the thresholded image. This avoids copying
+ * the input when it already is a grayscale image.
+ */
+void quirc_end_source(struct quirc *q, const uint8_t *source, int stride);
+
 /* This structure describes a location in the input image buffer. */
 struct quirc_point {
     int x;
@@ -255,6 +262,10 @@ struct quirc {
     int                     w;
     int                     h;
 
+    /* Input read by threshold() when not NULL (see quirc_end_source()) */
+    const uint8_t           *source;
+    int                     source_stride;
+
     int                     num_regions;
     struct quirc_region     regions[QUIRC_MAX_REGIONS];
 
@@ -985,6 +996,7 @@ static void threshold(struct quirc *q)
     
     for (y = 0; y < q->h; y++) {
         int row_average[q->w];
+        const uint8_t *src = q->source ? (q->source + (y * q->source_stride)) : row;
 
         memset(row_average, 0, sizeof(row_average));
 
@@ -1003,8 +1015,8 @@ static void threshold(struct quirc *q)
 //            avg_u = (avg_u * (threshold_s - 1)) / threshold_s + row[u];
             // The original mul/div operation sought to reduce the average value by a small fraction (e.g. 1/79)
             // This mul/shift approximation achieves the same goal with only a small percentage difference
-            avg_w = ((avg_w * fracmul) >> 15) + row[w];
-            avg_u = ((avg_u * fracmul) >> 15) + row[u];
+            avg_w = ((avg_w * fracmul) >> 15) + src[w];
+            avg_u = ((avg_u * fracmul) >> 15) + src[u];
 
             row_average[w] += avg_w;
             row_average[u] += avg_u;
@@ -1012,7 +1024,7 @@ static void threshold(struct quirc *q)
 
         for (x = 0; x < width; x++) {
             //            if (row[x] < row_average[x] * (100 - THRESHOLD_T) / (200 * threshold_s))
-            if (row[x] < ((row_average[x] * fracmul2) >> 20))
+            if (src[x] < ((row_average[x] * fracmul2) >> 20))
                 row[x] = QUIRC_PIXEL_BLACK;
             else
                 row[x] = QUIRC_PIXEL_WHITE;
@@ -1909,10 +1921,18 @@ void quirc_end(struct quirc *q)
     for (i = 0; i < q->h; i++)
         finder_scan(q, i);
 
-    for (i = 0; i < q->num_capstones; i++)
+    for (i = 0; (i < q->num_capstones) && (!imlib_deadline_expired()); i++)
         test_grouping(q, i);
 }
 
+void quirc_end_source(struct quirc *q, const uint8_t *source, int stride)
+{
+    q->source = source;
+    q->source_stride = stride;
+    quirc_end(q);
+    q->source = NULL;
+}
+
 void quirc_extract(const struct quirc *q, int index,
                    struct quirc_code *code)
 {
@@ -2488,9 +2508,9 @@ static void read_bit(const struct quirc_code *code,
     ds->data_bits++;
 }
 
-static void read_data(const struct quirc_code *code,
-                      struct quirc_data *data,
-                      struct datastream *ds)
+static void quirc_read_data(const struct quirc_code *code,
+                            struct quirc_data *data,
+                            struct datastream *ds)
 {
     int y = code->size - 1;
     int x = code->size - 1;
@@ -2853,7 +2873,7 @@ quirc_decode_error_t quirc_decode(const struct quirc_code *code,
     if (err)
         { fb_free(); return err; }
 
-    read_data(code, data, ds);
+    quirc_read_data(code, data, ds);
     err = codestream_ecc(data, ds);
     if (err)
         { fb_free(); return err; }
@@ -2965,52 +2985,165 @@ const char *quirc_strerror(quirc_decode_error_t err)
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi)
+static void qrcode_get_row(image_t *ptr, rectangle_t *roi, int y, uint8_t *row)
 {
-    struct quirc *controller = quirc_new();
-    quirc_resize(controller, roi->w, roi->h);
-    uint8_t *grayscale_image = quirc_begin(controller, NULL, NULL);
-
     switch(ptr->bpp) {
         case IMAGE_BPP_BINARY: {
-            for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                }
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                *(row++) = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
             }
             break;
         }
         case IMAGE_BPP_GRAYSCALE: {
-            for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                memcpy(grayscale_image, &row_ptr[roi->x], roi->w);
-                grayscale_image += roi->w;
-//                for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-//                    *(grayscale_image++) = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-//                }
-            }
+            memcpy(row, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y) + roi->x, roi->w);
             break;
         }
         case IMAGE_BPP_RGB565: {
-            for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                    *(grayscale_image++) = RGB565_TO_Y_FAST(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                }
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                *(row++) = RGB565_TO_Y_FAST(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
             }
             break;
         }
         default: {
-            memset(grayscale_image, 0, roi->w * roi->h);
+            memset(row, 0, roi->w);
             break;
         }
     }
+}
+
+// Rows sampled by the finder pattern pre-pass. The center of a finder pattern is 3 modules tall.
+#define QRCODE_PREPASS_Y_STEP 2
+
+// Looks for 1:1:3:1:1 runs (a row through a finder pattern) in every other row of the roi,
+// thresholded like quirc does. Returns false if there are none, otherwise area is set to the
+// part of the roi the codes can be in. With no finder patterns in the image this takes a
+// fraction of the time quirc needs to threshold and segment the roi.
+static bool qrcode_finder_prepass(image_t *ptr, rectangle_t *roi, rectangle_t *area)
+{
+    int threshold_s = IM_MAX(roi->w / THRESHOLD_S_DEN, THRESHOLD_S_MIN);
+    int fracmul = (32768 * (threshold_s - 1)) / threshold_s;
+    int fracmul2 = (0x100000 * (100 - THRESHOLD_T)) / (200 * threshold_s);
+    int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN, max_size = 0;
+
+    uint8_t *row = (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? NULL : fb_alloc(roi->w, FB_ALLOC_NO_HINT);
+    int *row_average = fb_alloc(roi->w * sizeof(int), FB_ALLOC_NO_HINT);
+
+    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y += QRCODE_PREPASS_Y_STEP) {
+        uint8_t *src = row;
+
+        if (row) {
+            qrcode_get_row(ptr, roi, y, row);
+        } else {
+            src = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y) + roi->x;
+        }
+
+        int avg_w = 0, avg_u = 0;
+        memset(row_average, 0, roi->w * sizeof(int));
+
+        for (int x = 0; x < roi->w; x++) {
+            int w = roi->w - 1 - x;
+            avg_w = ((avg_w * fracmul) >> 15) + src[w];
+            avg_u = ((avg_u * fracmul) >> 15) + src[x];
+            row_average[w] += avg_w;
+            row_average[x] += avg_u;
+        }
+
+        int run_length = 1, run_count = 0, pb[5] = {0, 0, 0, 0, 0};
+        bool last_color = src[0] < ((row_average[0] * fracmul2) >> 20);
+
+        for (int x = 1; x < roi->w; x++) {
+            bool color = src[x] < ((row_average[x] * fracmul2) >> 20);
+
+            if (color != last_color) {
+                memmove(pb, pb + 1, sizeof(pb[0]) * 4);
+                pb[4] = run_length;
+                run_length = 0;
+                run_count++;
+
+                // Same test as finder_scan().
+                if ((!color) && (run_count >= 5)) {
+                    static const int check[5] = {1, 1, 3, 1, 1};
+                    int avg = (pb[0] + pb[1] + pb[3] + pb[4]) / 4;
+                    int err = avg * 3 / 4;
+                    bool ok = true;
+
+                    for (int i = 0; i < 5; i++) {
+                        if ((pb[i] < ((check[i] * avg) - err)) || (pb[i] > ((check[i] * avg) + err))) {
+                            ok = false;
+                        }
+                    }
+
+                    if (ok) {
+                        int size = pb[0] + pb[1] + pb[2] + pb[3] + pb[4];
+                        min_x = IM_MIN(min_x, x - size);
+                        max_x = IM_MAX(max_x, x);
+                        min_y = IM_MIN(min_y, y);
+                        max_y = IM_MAX(max_y, y);
+                        max_size = IM_MAX(max_size, size);
+                    }
+                }
+            }
+
+            run_length++;
+            last_color = color;
+        }
+    }
+
+    fb_free(); // row_average
+    if (row) fb_free(); // row
+
+    if (!max_size) {
+        return false;
+    }
+
+    // The finder patterns are in 3 corners of a (square) code. If they are spread over less than
+    // two pattern sizes only one of them was seen, so the whole roi is searched. Otherwise the
+    // area is squared up for the corner that is missing and grown by a pattern size (covering the
+    // quiet zone).
+    int span = IM_MAX(max_x - min_x, max_y - min_y);
+
+    if (span < (max_size * 2)) {
+        *area = *roi;
+        return true;
+    }
+
+    int grow_x = (span - (max_x - min_x)) + max_size;
+    int grow_y = (span - (max_y - min_y)) + max_size;
+    rectangle_init(area, roi->x + min_x - grow_x, min_y - grow_y,
+                   (max_x - min_x) + (grow_x * 2) + 1, (max_y - min_y) + (grow_y * 2) + 1);
+    rectangle_intersected(area, roi);
+    return true;
+}
+
+void imlib_find_qrcodes(list_t *out, image_t *ptr, rectangle_t *roi_in)
+{
+    rectangle_t area, *roi = &area;
+
+    if (!qrcode_finder_prepass(ptr, roi_in, roi)) {
+        list_init(out, sizeof(find_qrcodes_list_lnk_data_t));
+        return;
+    }
+
+    struct quirc *controller = quirc_new();
+    quirc_resize(controller, roi->w, roi->h);
+    uint8_t *grayscale_image = quirc_begin(controller, NULL, NULL);
+
+    if (ptr->bpp == IMAGE_BPP_GRAYSCALE) {
+        // Thresholded straight from the frame buffer.
+        quirc_end_source(controller, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, roi->y) + roi->x, ptr->w);
+    } else {
+        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++, grayscale_image += roi->w) {
+            qrcode_get_row(ptr, roi, y, grayscale_image);
+        }
+
+        quirc_end(controller);
+    }
 
-    quirc_end(controller);
     list_init(out, sizeof(find_qrcodes_list_lnk_data_t));
 
-    for (int i = 0, j = quirc_count(controller); i < j; i++) {
+    for (int i = 0, j = quirc_count(controller); (i < j) && (!imlib_deadline_expired()); i++) {
         struct quirc_code *code = fb_alloc(sizeof(struct quirc_code), FB_ALLOC_NO_HINT);
         struct quirc_data *data = fb_alloc(sizeof(struct quirc_data), FB_ALLOC_NO_HINT);
         quirc_extract(controller, i, code);
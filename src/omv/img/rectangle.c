@@ -8,6 +8,7 @@
  *
  * Rectangle functions.
  */
+#include <stdlib.h>
 #include "imlib.h"
 #include "array.h"
 #include "xalloc.h"
@@ -57,55 +58,195 @@ bool rectangle_subimg(image_t *img, rectangle_t *r, rectangle_t *r_out)
     return result;
 }
 
-// This isn't for actually combining the rects standardly, but, to instead
-// find the average rectangle between a bunch of overlapping rectangles.
-static void rectangle_add(rectangle_t *r1, rectangle_t *r2)
+// Sweep entry, the x and y extents of a rectangle grown by margin (on the right and bottom).
+typedef struct rectangle_sweep {
+    int x0, x1, y0, y1, index;
+} rectangle_sweep_t;
+
+static int rectangle_sweep_compare(const void *a, const void *b)
 {
-    r1->x += r2->x;
-    r1->y += r2->y;
-    r1->w += r2->w;
-    r1->h += r2->h;
+    int x0_a = ((rectangle_sweep_t *) a)->x0;
+    int x0_b = ((rectangle_sweep_t *) b)->x0;
+    return (x0_a > x0_b) - (x0_a < x0_b);
 }
 
-// This isn't for actually combining the rects standardly, but, to instead
-// find the average rectangle between a bunch of overlapping rectangles.
-static void rectangle_div(rectangle_t *r, int c)
+// Union-find root with path halving, the root of a group is its first rectangle.
+static int rectangle_cluster_find(int *set, int i)
 {
-    r->x /= c;
-    r->y /= c;
-    r->w /= c;
-    r->h /= c;
+    while (set[i] != i) {
+        set[i] = set[set[i]];
+        i = set[i];
+    }
+
+    return i;
+}
+
+// Groups the rectangles that overlap once grown by margin. The rectangles are sorted by x and each
+// one is only tested against the ones starting before it ends (sweep line), the groups are kept
+// with union-find. merge(arg, a, b) is called before the groups of a and b are joined (a < b are
+// the first rectangles of each group) and can refuse it, NULL joins all. On return set[i] is the
+// first rectangle of the group of rectangle i. Returns the number of joins.
+int rectangle_cluster(rectangle_t *rects, int n, int margin, int *set, bool (*merge)(void *, int, int), void *arg)
+{
+    rectangle_sweep_t *sweep = fb_alloc(n * sizeof(rectangle_sweep_t), FB_ALLOC_NO_HINT);
+    int joins = 0;
+
+    for (int i = 0; i < n; i++) {
+        sweep[i].x0 = rects[i].x;
+        sweep[i].x1 = rects[i].x + rects[i].w + margin;
+        sweep[i].y0 = rects[i].y;
+        sweep[i].y1 = rects[i].y + rects[i].h + margin;
+        sweep[i].index = i;
+        set[i] = i;
+    }
+
+    qsort(sweep, n, sizeof(rectangle_sweep_t), rectangle_sweep_compare);
+
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; (j < n) && (sweep[j].x0 < sweep[i].x1); j++) {
+            // x0 of j isn't less than x0 of i, so the x extents overlap if x1 of j is past x0 of i.
+            if ((sweep[i].x0 < sweep[j].x1) && (sweep[j].y0 < sweep[i].y1) && (sweep[i].y0 < sweep[j].y1)) {
+                int a = rectangle_cluster_find(set, sweep[i].index);
+                int b = rectangle_cluster_find(set, sweep[j].index);
+
+                if (a != b) {
+                    if (a > b) {
+                        int tmp = a;
+                        a = b;
+                        b = tmp;
+                    }
+
+                    if ((merge == NULL) || merge(arg, a, b)) {
+                        set[b] = a;
+                        joins += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        set[i] = rectangle_cluster_find(set, i);
+    }
+
+    fb_free(); // sweep
+    return joins;
 }
 
+// This isn't for actually combining the rects standardly, but, to instead
+// find the average rectangle between a bunch of overlapping rectangles.
+// Each rectangle left (in order) is averaged with all the rectangles left that overlap it. The
+// rectangles are sorted by x so only the ones starting less than the widest rectangle before it
+// ends are tested.
 array_t *rectangle_merge(array_t *rectangles)
 {
+    int n = array_length(rectangles);
+    rectangle_sweep_t *sweep = fb_alloc(n * sizeof(rectangle_sweep_t), FB_ALLOC_NO_HINT);
+    bool *merged = fb_alloc0(n * sizeof(bool), FB_ALLOC_NO_HINT);
+    int w_max = 0;
+
+    for (int i = 0; i < n; i++) {
+        rectangle_t *r = (rectangle_t *) array_at(rectangles, i);
+        sweep[i].x0 = r->x;
+        sweep[i].x1 = r->x + r->w;
+        sweep[i].y0 = r->y;
+        sweep[i].y1 = r->y + r->h;
+        sweep[i].index = i;
+        w_max = IM_MAX(w_max, r->w);
+    }
+
+    qsort(sweep, n, sizeof(rectangle_sweep_t), rectangle_sweep_compare);
+
     array_t *objects; array_alloc(&objects, xfree);
-    array_t *overlap; array_alloc(&overlap, xfree);
-    /* merge overlaping detections */
-    while (array_length(rectangles)) {
-        /* check for overlaping detections */
-        rectangle_t *rect = (rectangle_t *) array_take(rectangles, 0);
-        for (int j=0; j<array_length(rectangles); j++) { // do not cache bound
-            if (rectangle_intersects(rect, (rectangle_t *) array_at(rectangles, j))) {
-                array_push_back(overlap, array_take(rectangles, j--));
+    for (int i = 0; i < n; i++) {
+        if (merged[i]) {
+            continue;
+        }
+
+        rectangle_t *rect = (rectangle_t *) array_at(rectangles, i);
+        int x_start = rect->x - w_max, lo = 0, hi = n;
+        merged[i] = true;
+
+        // First rectangle that may reach rect.
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (sweep[mid].x0 <= x_start) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
             }
         }
+
         /* add the overlaping detections */
-        int count = array_length(overlap);
-        for (int i=0; i<count; i++) {
-            rectangle_t *overlap_rect = (rectangle_t *) array_pop_back(overlap);
-            rectangle_add(rect, overlap_rect);
-            xfree(overlap_rect);
+        int32_t x = rect->x, y = rect->y, w = rect->w, h = rect->h, count = 1;
+        for (int k = lo; (k < n) && (sweep[k].x0 < (rect->x + rect->w)); k++) {
+            int j = sweep[k].index;
+            if ((!merged[j]) && rectangle_intersects(rect, (rectangle_t *) array_at(rectangles, j))) {
+                x += sweep[k].x0;
+                y += sweep[k].y0;
+                w += sweep[k].x1 - sweep[k].x0;
+                h += sweep[k].y1 - sweep[k].y0;
+                count += 1;
+                merged[j] = true;
+            }
         }
+
         /* average the overlaping detections */
-        rectangle_div(rect, count + 1);
-        array_push_back(objects, rect);
+        array_push_back(objects, rectangle_alloc(x / count, y / count, w / count, h / count));
     }
+
+    fb_free(); // merged
+    fb_free(); // sweep
     array_free(rectangles);
-    array_free(overlap);
     return objects;
 }
 
+// Intersection over union of two rectangles.
+float rectangle_iou(rectangle_t *r0, rectangle_t *r1)
+{
+    if (!rectangle_overlap(r0, r1)) {
+        return 0.0f;
+    }
+
+    rectangle_t r;
+    rectangle_copy(&r, r0);
+    rectangle_intersected(&r, r1);
+    int intersection = r.w * r.h;
+    return intersection / ((float) ((r0->w * r0->h) + (r1->w * r1->h) - intersection));
+}
+
+static int rectangle_score_compare(const void *a, const void *b)
+{
+    float score_a = ((rectangle_score_t *) a)->score;
+    float score_b = ((rectangle_score_t *) b)->score;
+    return (score_a < score_b) - (score_a > score_b);
+}
+
+// Non-maximum suppression: the boxes are sorted by score and a box is dropped if it overlaps a
+// better box of the same class by more than iou_threshold. The boxes kept are moved to the start
+// of the array (best first) and their number is returned.
+int rectangle_nms(rectangle_score_t *boxes, int n, float iou_threshold)
+{
+    qsort(boxes, n, sizeof(rectangle_score_t), rectangle_score_compare);
+    int kept = 0;
+
+    for (int i = 0; i < n; i++) {
+        bool keep = true;
+        for (int j = 0; j < kept; j++) {
+            if ((boxes[j].index == boxes[i].index)
+            && (rectangle_iou(&boxes[j].rect, &boxes[i].rect) > iou_threshold)) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) {
+            boxes[kept++] = boxes[i];
+        }
+    }
+
+    return kept;
+}
+
 // Expands a bounding box with a point.
 // After adding all points sub x from w and y from h.
 void rectangle_expand(rectangle_t *r, int x, int y)
@@ -0,0 +1,206 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Precomputed pixel remapping (lens and rotation correction).
+ */
+#include "imlib.h"
+
+#ifdef IMLIB_ENABLE_REMAP
+// The map only stores the source coordinates of a sparse grid, the source coordinates of the
+// pixels in between are interpolated (which is exact for affine maps and within a fraction of a
+// pixel for the smooth lens and perspective maps), so applying a map is a gather with two adds
+// per pixel instead of the float math of lens_corr() and rotation_corr().
+#define REMAP_GRID_STEP     (1 << REMAP_GRID_SHIFT)
+#define REMAP_GRID_MASK     (REMAP_GRID_STEP - 1)
+#define REMAP_LIMIT         (8192) // Coordinates are clamped so that the fixed point math can't overflow.
+#define REMAP_INVALID       (INT32_MIN) // No source pixel, outside of the clamped range.
+#define REMAP_EPS           (1e-8f)
+
+static void remap_put(remap_t *map, int gx, int gy, float x, float y)
+{
+    int32_t *point = map->grid + (((gy * map->grid_w) + gx) * 2);
+    point[0] = fast_roundf(IM_MIN(IM_MAX(x, -REMAP_LIMIT), REMAP_LIMIT) * 65536);
+    point[1] = fast_roundf(IM_MIN(IM_MAX(y, -REMAP_LIMIT), REMAP_LIMIT) * 65536);
+}
+
+static void remap_put_invalid(remap_t *map, int gx, int gy)
+{
+    int32_t *point = map->grid + (((gy * map->grid_w) + gx) * 2);
+    point[0] = REMAP_INVALID;
+    point[1] = REMAP_INVALID;
+}
+
+void imlib_remap_alloc(remap_t *map, int w, int h)
+{
+    // The last row/column of grid points is at or past the last row/column of pixels.
+    map->w = w;
+    map->h = h;
+    map->grid_w = ((w - 1) >> REMAP_GRID_SHIFT) + 2;
+    map->grid_h = ((h - 1) >> REMAP_GRID_SHIFT) + 2;
+    map->grid = xalloc(map->grid_w * map->grid_h * 2 * sizeof(int32_t));
+
+    for (int gy = 0; gy < map->grid_h; gy++) {
+        for (int gx = 0; gx < map->grid_w; gx++) {
+            remap_put(map, gx, gy, gx << REMAP_GRID_SHIFT, gy << REMAP_GRID_SHIFT);
+        }
+    }
+}
+
+void imlib_remap_free(remap_t *map)
+{
+    xfree(map->grid);
+}
+
+// Same model as imlib_lens_corr(), but centered between the middle pixels.
+void imlib_remap_lens_corr(remap_t *map, float strength, float zoom, float x_corr, float y_corr)
+{
+    int w = map->w;
+    int h = map->h;
+    float lens_corr_diameter = strength / fast_sqrtf((w * w) + (h * h));
+    float cx = (w - 1) / 2.0f;
+    float cy = (h - 1) / 2.0f;
+    float x_off = (int) (w * x_corr);
+    float y_off = (int) (h * y_corr);
+    zoom = 1 / zoom;
+
+    for (int gy = 0; gy < map->grid_h; gy++) {
+        float newY = (gy << REMAP_GRID_SHIFT) - cy;
+
+        for (int gx = 0; gx < map->grid_w; gx++) {
+            float newX = (gx << REMAP_GRID_SHIFT) - cx;
+            float r = lens_corr_diameter * fast_sqrtf((newX * newX) + (newY * newY));
+            float precalculated = (r > 0.0f) ? ((fast_atanf(r) / r) * zoom) : zoom;
+            remap_put(map, gx, gy, cx + x_off + (precalculated * newX), cy + y_off + (precalculated * newY));
+        }
+    }
+}
+
+#ifdef IMLIB_ENABLE_ROTATION_CORR
+void imlib_remap_rotation_corr(remap_t *map, float x_rotation, float y_rotation,
+                               float z_rotation, float x_translation, float y_translation,
+                               float zoom, float fov, float *corners)
+{
+    float T[9];
+    bool valid = imlib_rotation_corr_transform(map->w, map->h, x_rotation, y_rotation, z_rotation,
+                                               x_translation, y_translation, zoom, fov, corners, T);
+
+    for (int gy = 0; gy < map->grid_h; gy++) {
+        int y = gy << REMAP_GRID_SHIFT;
+
+        for (int gx = 0; gx < map->grid_w; gx++) {
+            int x = gx << REMAP_GRID_SHIFT;
+            float zzz = valid ? (T[6]*x + T[7]*y + T[8]) : 0.0f;
+
+            // Like rotation_corr() the image is cleared if there's no transform.
+            if (fast_fabsf(zzz) < REMAP_EPS) {
+                remap_put_invalid(map, gx, gy);
+            } else {
+                remap_put(map, gx, gy, (T[0]*x + T[1]*y + T[2]) / zzz, (T[3]*x + T[4]*y + T[5]) / zzz);
+            }
+        }
+    }
+}
+#endif //IMLIB_ENABLE_ROTATION_CORR
+
+void imlib_remap(image_t *img, remap_t *map)
+{
+    int w = img->w;
+    int h = img->h;
+
+    // Create a tmp copy of the image to pull pixels from.
+    size_t size = image_size(img);
+    void *data = fb_alloc(size, FB_ALLOC_NO_HINT);
+    memcpy(data, img->data, size);
+    memset(img->data, 0, size);
+
+    // Grid row interpolated for the current line.
+    int32_t *line = fb_alloc(map->grid_w * 2 * sizeof(int32_t), FB_ALLOC_NO_HINT);
+
+    for (int y = 0; y < h; y++) {
+        int32_t *top = map->grid + ((y >> REMAP_GRID_SHIFT) * map->grid_w * 2);
+        int32_t *bottom = top + (map->grid_w * 2);
+        int fy = y & REMAP_GRID_MASK;
+
+        for (int i = 0, ii = map->grid_w * 2; i < ii; i += 2) {
+            if ((top[i] == REMAP_INVALID) || (bottom[i] == REMAP_INVALID)) {
+                line[i + 0] = REMAP_INVALID;
+                line[i + 1] = REMAP_INVALID;
+            } else {
+                line[i + 0] = top[i + 0] + ((((int64_t) (bottom[i + 0] - top[i + 0])) * fy) >> REMAP_GRID_SHIFT);
+                line[i + 1] = top[i + 1] + ((((int64_t) (bottom[i + 1] - top[i + 1])) * fy) >> REMAP_GRID_SHIFT);
+            }
+        }
+
+        for (int gx = 0, x = 0; x < w; gx++) {
+            int xx = IM_MIN(x + REMAP_GRID_STEP, w);
+
+            // Interpolating with an invalid grid point gives garbage coordinates, so the whole
+            // cell is left cleared instead.
+            if ((line[(gx * 2) + 0] == REMAP_INVALID) || (line[(gx * 2) + 2] == REMAP_INVALID)) {
+                x = xx;
+                continue;
+            }
+
+            int32_t sx = line[(gx * 2) + 0];
+            int32_t sy = line[(gx * 2) + 1];
+            int32_t dx = (line[(gx * 2) + 2] - sx) >> REMAP_GRID_SHIFT;
+            int32_t dy = (line[(gx * 2) + 3] - sy) >> REMAP_GRID_SHIFT;
+
+            switch(img->bpp) {
+                case IMAGE_BPP_BINARY: {
+                    uint32_t *tmp = (uint32_t *) data;
+                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                    for (; x < xx; x++, sx += dx, sy += dy) {
+                        int sourceX = (sx + 0x8000) >> 16;
+                        int sourceY = (sy + 0x8000) >> 16;
+
+                        if ((((unsigned) sourceX) < ((unsigned) w)) && (((unsigned) sourceY) < ((unsigned) h))) {
+                            uint32_t *ptr = tmp + (((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY);
+                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX));
+                        }
+                    }
+                    break;
+                }
+                case IMAGE_BPP_GRAYSCALE: {
+                    uint8_t *tmp = (uint8_t *) data;
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+                    for (; x < xx; x++, sx += dx, sy += dy) {
+                        int sourceX = (sx + 0x8000) >> 16;
+                        int sourceY = (sy + 0x8000) >> 16;
+
+                        if ((((unsigned) sourceX) < ((unsigned) w)) && (((unsigned) sourceY) < ((unsigned) h))) {
+                            row_ptr[x] = tmp[(w * sourceY) + sourceX];
+                        }
+                    }
+                    break;
+                }
+                case IMAGE_BPP_RGB565: {
+                    uint16_t *tmp = (uint16_t *) data;
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+                    for (; x < xx; x++, sx += dx, sy += dy) {
+                        int sourceX = (sx + 0x8000) >> 16;
+                        int sourceY = (sy + 0x8000) >> 16;
+
+                        if ((((unsigned) sourceX) < ((unsigned) w)) && (((unsigned) sourceY) < ((unsigned) h))) {
+                            row_ptr[x] = tmp[(w * sourceY) + sourceX];
+                        }
+                    }
+                    break;
+                }
+                default: {
+                    x = xx;
+                    break;
+                }
+            }
+        }
+    }
+
+    fb_free(); // line
+    fb_free(); // data
+}
+#endif //IMLIB_ENABLE_REMAP
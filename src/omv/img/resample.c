@@ -0,0 +1,497 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Fixed point image resampling (nearest neighbor, bilinear and area).
+ */
+#include "imlib.h"
+
+// RGB565 pixels are spread to 0x07E0F81F (G, R, B with gaps) so both bilinear taps of all
+// three channels are weighted with two multiplies. The weights are 5 bits (0-32), which
+// is enough for 5/6 bit channels and keeps every channel within its gap.
+#define RESAMPLE_RGB565_MASK    (0x07E0F81F)
+#define RESAMPLE_RGB565_ROUND   (0x02008010)
+
+static inline uint32_t resample_rgb565_spread(uint32_t pixel)
+{
+    pixel = ((pixel >> 8) | (pixel << 8)) & 0xFFFF;
+    return (pixel | (pixel << 16)) & RESAMPLE_RGB565_MASK;
+}
+
+static inline uint32_t resample_rgb565_blend(uint32_t a, uint32_t b, uint32_t w)
+{
+    return ((((a * (32 - w)) + (b * w)) + RESAMPLE_RGB565_ROUND) >> 5) & RESAMPLE_RGB565_MASK;
+}
+
+static inline uint16_t resample_rgb565_pack(uint32_t spread)
+{
+    uint32_t pixel = (spread | (spread >> 16)) & 0xFFFF;
+    return ((pixel >> 8) | (pixel << 8)) & 0xFFFF;
+}
+
+// Maps each of the n output pixels to the len source pixels starting at offset. The source
+// pixels per output pixel are in 16.16 fixed point, so there's no float math per pixel.
+static resample_tap_t *resample_taps(int offset, int len, int n, int hint)
+{
+    resample_tap_t *taps = fb_alloc(n * sizeof(resample_tap_t), FB_ALLOC_NO_HINT);
+    int step = (len << 16) / n;
+    int last = offset + len - 1;
+
+    for (int i = 0; i < n; i++) {
+        int start = offset + ((i * step) >> 16);
+
+        if (hint & IMAGE_HINT_AREA) {
+            int end = (i == (n - 1)) ? last : (offset + ((((i + 1) * step) >> 16) - 1));
+            taps[i].i0 = start;
+            taps[i].i1 = IM_MIN(IM_MAX(end, start), last);
+            taps[i].w = 0;
+        } else if (hint & IMAGE_HINT_BILINEAR) {
+            // Pixel centers are aligned, the edges are clamped.
+            int pos = (offset << 16) + (i * step) + (step / 2) - (1 << 15);
+            pos = IM_MIN(IM_MAX(pos, offset << 16), last << 16);
+            taps[i].i0 = pos >> 16;
+            taps[i].i1 = IM_MIN(taps[i].i0 + 1, last);
+            taps[i].w = (pos >> 8) & 0xFF;
+        } else {
+            taps[i].i0 = start;
+            taps[i].i1 = start;
+            taps[i].w = 0;
+        }
+    }
+
+    return taps;
+}
+
+static void resample_taps_reverse(resample_tap_t *taps, int n)
+{
+    for (int i = 0, j = n - 1; i < j; i++, j--) {
+        resample_tap_t tmp = taps[i];
+        taps[i] = taps[j];
+        taps[j] = tmp;
+    }
+}
+
+void imlib_resample_init(resample_t *r, image_t *src, rectangle_t *roi, int w, int h, int hint)
+{
+    imlib_resample_init_rotated(r, src, roi, w, h, hint, 0);
+}
+
+// Rotation is clockwise in multiples of 90 degrees. The output is w by h after rotating, so
+// for 90 and 270 degrees w pixels are taken from the roi height and h pixels from its width.
+void imlib_resample_init_rotated(resample_t *r, image_t *src, rectangle_t *roi, int w, int h, int hint, int rotation)
+{
+    // Binary images are always resampled with nearest neighbor.
+    if (src->bpp == IMAGE_BPP_BINARY) {
+        hint &= ~(IMAGE_HINT_BILINEAR | IMAGE_HINT_AREA);
+    }
+
+    rotation = ((rotation % 360) + 360) % 360;
+
+    r->src = src;
+    r->w = w;
+    r->h = h;
+    r->hint = hint;
+    r->transpose = (rotation == 90) || (rotation == 270);
+
+    if (r->transpose) {
+        r->x_taps = resample_taps(roi->y, roi->h, w, hint);
+        r->y_taps = resample_taps(roi->x, roi->w, h, hint);
+    } else {
+        r->x_taps = resample_taps(roi->x, roi->w, w, hint);
+        r->y_taps = resample_taps(roi->y, roi->h, h, hint);
+    }
+
+    // Mirroring the taps is all the rotation needs, the output still goes out row by row.
+    if ((rotation == 90) || (rotation == 180)) {
+        resample_taps_reverse(r->x_taps, w);
+    }
+
+    if ((rotation == 180) || (rotation == 270)) {
+        resample_taps_reverse(r->y_taps, h);
+    }
+}
+
+// Output row y is source column y_tap, output column x is source row x_taps[x].
+static void resample_line_transposed(resample_t *r, int y, void *line)
+{
+    image_t *src = r->src;
+    resample_tap_t *x_taps = r->x_taps;
+    resample_tap_t *y_tap = r->y_taps + y;
+    int c0 = y_tap->i0, c1 = y_tap->i1, wc = y_tap->w;
+
+    switch(src->bpp) {
+        case IMAGE_BPP_BINARY: {
+            for (int x = 0, xx = r->w; x < xx; x++) {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(src, x_taps[x].i0);
+                IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) line, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, c0));
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            uint8_t *out = (uint8_t *) line;
+
+            if (r->hint & IMAGE_HINT_AREA) {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    int i0 = x_taps[x].i0, i1 = x_taps[x].i1;
+                    int count = (i1 - i0 + 1) * (c1 - c0 + 1);
+                    uint32_t sum = 0;
+                    for (int i = i0; i <= i1; i++) {
+                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, i);
+                        for (int j = c0; j <= c1; j++) {
+                            sum += row_ptr[j];
+                        }
+                    }
+                    out[x] = (sum + (count / 2)) / count;
+                }
+            } else if (r->hint & IMAGE_HINT_BILINEAR) {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, x_taps[x].i0);
+                    uint8_t *row_ptr_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, x_taps[x].i1);
+                    int wr = x_taps[x].w;
+                    int top = (row_ptr[c0] << 8) + ((row_ptr[c1] - row_ptr[c0]) * wc);
+                    int bottom = (row_ptr_2[c0] << 8) + ((row_ptr_2[c1] - row_ptr_2[c0]) * wc);
+                    out[x] = ((top << 8) + ((bottom - top) * wr) + (1 << 15)) >> 16;
+                }
+            } else {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    out[x] = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, x_taps[x].i0)[c0];
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *out = (uint16_t *) line;
+
+            if (r->hint & IMAGE_HINT_AREA) {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    int i0 = x_taps[x].i0, i1 = x_taps[x].i1;
+                    int count = (i1 - i0 + 1) * (c1 - c0 + 1);
+                    uint32_t r_sum = 0, g_sum = 0, b_sum = 0;
+                    for (int i = i0; i <= i1; i++) {
+                        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, i);
+                        for (int j = c0; j <= c1; j++) {
+                            int pixel = row_ptr[j];
+                            r_sum += COLOR_RGB565_TO_R5(pixel);
+                            g_sum += COLOR_RGB565_TO_G6(pixel);
+                            b_sum += COLOR_RGB565_TO_B5(pixel);
+                        }
+                    }
+                    out[x] = COLOR_R5_G6_B5_TO_RGB565((r_sum + (count / 2)) / count,
+                                                      (g_sum + (count / 2)) / count,
+                                                      (b_sum + (count / 2)) / count);
+                }
+            } else if (r->hint & IMAGE_HINT_BILINEAR) {
+                uint32_t wy = (wc + 4) >> 3;
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, x_taps[x].i0);
+                    uint16_t *row_ptr_2 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, x_taps[x].i1);
+                    uint32_t wx = (x_taps[x].w + 4) >> 3;
+                    uint32_t top = resample_rgb565_blend(resample_rgb565_spread(row_ptr[c0]),
+                                                         resample_rgb565_spread(row_ptr[c1]), wy);
+                    uint32_t bottom = resample_rgb565_blend(resample_rgb565_spread(row_ptr_2[c0]),
+                                                            resample_rgb565_spread(row_ptr_2[c1]), wy);
+                    out[x] = resample_rgb565_pack(resample_rgb565_blend(top, bottom, wx));
+                }
+            } else {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    out[x] = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, x_taps[x].i0)[c0];
+                }
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+void imlib_resample_line(resample_t *r, int y, void *line)
+{
+    if (r->transpose) {
+        resample_line_transposed(r, y, line);
+        return;
+    }
+
+    image_t *src = r->src;
+    resample_tap_t *x_taps = r->x_taps;
+    resample_tap_t *y_tap = r->y_taps + y;
+
+    switch(src->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(src, y_tap->i0);
+            for (int x = 0, xx = r->w; x < xx; x++) {
+                IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) line, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x_taps[x].i0));
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            uint8_t *out = (uint8_t *) line;
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y_tap->i0);
+
+            if (r->hint & IMAGE_HINT_AREA) {
+                int rows = y_tap->i1 - y_tap->i0 + 1;
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    int i0 = x_taps[x].i0, i1 = x_taps[x].i1;
+                    int count = (i1 - i0 + 1) * rows;
+                    uint8_t *ptr = row_ptr;
+                    uint32_t sum = 0;
+                    for (int i = 0; i < rows; i++, ptr += src->w) {
+                        for (int j = i0; j <= i1; j++) {
+                            sum += ptr[j];
+                        }
+                    }
+                    out[x] = (sum + (count / 2)) / count;
+                }
+            } else if (r->hint & IMAGE_HINT_BILINEAR) {
+                uint8_t *row_ptr_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y_tap->i1);
+                int wy = y_tap->w;
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    int i0 = x_taps[x].i0, i1 = x_taps[x].i1, wx = x_taps[x].w;
+                    int top = (row_ptr[i0] << 8) + ((row_ptr[i1] - row_ptr[i0]) * wx);
+                    int bottom = (row_ptr_2[i0] << 8) + ((row_ptr_2[i1] - row_ptr_2[i0]) * wx);
+                    out[x] = ((top << 8) + ((bottom - top) * wy) + (1 << 15)) >> 16;
+                }
+            } else {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    out[x] = row_ptr[x_taps[x].i0];
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            uint16_t *out = (uint16_t *) line;
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y_tap->i0);
+
+            if (r->hint & IMAGE_HINT_AREA) {
+                int rows = y_tap->i1 - y_tap->i0 + 1;
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    int i0 = x_taps[x].i0, i1 = x_taps[x].i1;
+                    int count = (i1 - i0 + 1) * rows;
+                    uint16_t *ptr = row_ptr;
+                    uint32_t r_sum = 0, g_sum = 0, b_sum = 0;
+                    for (int i = 0; i < rows; i++, ptr += src->w) {
+                        for (int j = i0; j <= i1; j++) {
+                            int pixel = ptr[j];
+                            r_sum += COLOR_RGB565_TO_R5(pixel);
+                            g_sum += COLOR_RGB565_TO_G6(pixel);
+                            b_sum += COLOR_RGB565_TO_B5(pixel);
+                        }
+                    }
+                    out[x] = COLOR_R5_G6_B5_TO_RGB565((r_sum + (count / 2)) / count,
+                                                      (g_sum + (count / 2)) / count,
+                                                      (b_sum + (count / 2)) / count);
+                }
+            } else if (r->hint & IMAGE_HINT_BILINEAR) {
+                uint16_t *row_ptr_2 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y_tap->i1);
+                uint32_t wy = (y_tap->w + 4) >> 3;
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    int i0 = x_taps[x].i0, i1 = x_taps[x].i1;
+                    uint32_t wx = (x_taps[x].w + 4) >> 3;
+                    uint32_t top = resample_rgb565_blend(resample_rgb565_spread(row_ptr[i0]),
+                                                         resample_rgb565_spread(row_ptr[i1]), wx);
+                    uint32_t bottom = resample_rgb565_blend(resample_rgb565_spread(row_ptr_2[i0]),
+                                                            resample_rgb565_spread(row_ptr_2[i1]), wx);
+                    out[x] = resample_rgb565_pack(resample_rgb565_blend(top, bottom, wy));
+                }
+            } else {
+                for (int x = 0, xx = r->w; x < xx; x++) {
+                    out[x] = row_ptr[x_taps[x].i0];
+                }
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Copies the roi row by row when it's not scaled, so no tap tables are allocated.
+static void resample_copy(image_t *dst, image_t *src, rectangle_t *roi)
+{
+    for (int y = 0, yy = dst->h; y < yy; y++) {
+        switch(dst->bpp) {
+            case IMAGE_BPP_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(src, roi->y + y);
+                uint32_t *out = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y);
+                for (int x = 0, xx = dst->w; x < xx; x++) {
+                    IMAGE_PUT_BINARY_PIXEL_FAST(out, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, roi->x + x));
+                }
+                break;
+            }
+            case IMAGE_BPP_GRAYSCALE: {
+                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y),
+                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, roi->y + y) + roi->x,
+                       dst->w * sizeof(uint8_t));
+                break;
+            }
+            case IMAGE_BPP_RGB565: {
+                memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y),
+                       IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, roi->y + y) + roi->x,
+                       dst->w * sizeof(uint16_t));
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+void imlib_resample(image_t *dst, image_t *src, rectangle_t *roi, int hint)
+{
+    if ((dst->w == roi->w) && (dst->h == roi->h)) {
+        resample_copy(dst, src, roi);
+        return;
+    }
+
+    resample_t r;
+    fb_alloc_mark();
+    imlib_resample_init(&r, src, roi, dst->w, dst->h, hint);
+
+    for (int y = 0, yy = dst->h; y < yy; y++) {
+        switch(dst->bpp) {
+            case IMAGE_BPP_BINARY: {
+                imlib_resample_line(&r, y, IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(dst, y));
+                break;
+            }
+            case IMAGE_BPP_GRAYSCALE: {
+                imlib_resample_line(&r, y, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y));
+                break;
+            }
+            case IMAGE_BPP_RGB565: {
+                imlib_resample_line(&r, y, IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y));
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    fb_alloc_free_till_mark();
+}
+
+// Same as imlib_mean_pool(src, dst, 2, 2) for grayscale and RGB565 images, dst is src->w / 2 x
+// src->h / 2.
+void imlib_decimate2(image_t *src, image_t *dst)
+{
+    for (int y = 0, yy = dst->h; y < yy; y++) {
+        switch (src->bpp) {
+            case IMAGE_BPP_GRAYSCALE: {
+                uint8_t *row0 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y * 2);
+                uint8_t *row1 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, (y * 2) + 1);
+                uint8_t *out = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(dst, y);
+                int x = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+                // 8x2 source pixels per step, each halfword lane sums a 2x2 box.
+                for (; (x + 4) <= dst->w; x += 4) {
+                    uint32_t a0 = __UNALIGNED_UINT32_READ(row0 + (x * 2));
+                    uint32_t a1 = __UNALIGNED_UINT32_READ(row0 + (x * 2) + 4);
+                    uint32_t b0 = __UNALIGNED_UINT32_READ(row1 + (x * 2));
+                    uint32_t b1 = __UNALIGNED_UINT32_READ(row1 + (x * 2) + 4);
+                    uint32_t s0 = __UXTAB16(__UXTAB16(__UXTAB16(__UXTB16(a0), __ROR(a0, 8)), b0), __ROR(b0, 8));
+                    uint32_t s1 = __UXTAB16(__UXTAB16(__UXTAB16(__UXTB16(a1), __ROR(a1, 8)), b1), __ROR(b1, 8));
+                    s0 = (s0 >> 2) & 0x00FF00FF;
+                    s1 = (s1 >> 2) & 0x00FF00FF;
+                    __UNALIGNED_UINT32_WRITE(out + x, __PKHBT(s0 | (s0 >> 8), s1 | (s1 >> 8), 16));
+                }
+#endif
+                for (; x < dst->w; x++) {
+                    out[x] = (row0[x * 2] + row0[(x * 2) + 1] + row1[x * 2] + row1[(x * 2) + 1]) >> 2;
+                }
+                break;
+            }
+            case IMAGE_BPP_RGB565: {
+                uint16_t *row0 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y * 2);
+                uint16_t *row1 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, (y * 2) + 1);
+                uint16_t *out = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(dst, y);
+
+                // The spread channels have room for the sum of 4 pixels.
+                for (int x = 0, xx = dst->w; x < xx; x++) {
+                    uint32_t sum = resample_rgb565_spread(row0[x * 2]) + resample_rgb565_spread(row0[(x * 2) + 1])
+                                 + resample_rgb565_spread(row1[x * 2]) + resample_rgb565_spread(row1[(x * 2) + 1]);
+                    out[x] = resample_rgb565_pack((sum >> 2) & RESAMPLE_RGB565_MASK);
+                }
+                break;
+            }
+            default: {
+                return;
+            }
+        }
+    }
+}
+
+static void image_pyramid_level_size(image_t *prev, float scale, int *w, int *h)
+{
+    if (scale == 2.0f) {
+        *w = prev->w / 2;
+        *h = prev->h / 2;
+    } else {
+        *w = fast_roundf(prev->w / scale);
+        *h = fast_roundf(prev->h / scale);
+    }
+}
+
+// Returns the number of levels (up to levels) and the size of the levels after the first.
+static int image_pyramid_levels(image_t *img, int levels, float scale, size_t *size)
+{
+    image_t level = *img;
+    int len = 1;
+    *size = 0;
+
+    for (; len < IM_MIN(levels, IMAGE_PYRAMID_MAX_LEVELS); len++) {
+        int w, h;
+        image_pyramid_level_size(&level, scale, &w, &h);
+
+        if ((w < IMAGE_PYRAMID_MIN_SIZE) || (h < IMAGE_PYRAMID_MIN_SIZE)) {
+            break;
+        }
+
+        level.w = w;
+        level.h = h;
+        *size += image_size(&level);
+    }
+
+    return len;
+}
+
+size_t imlib_image_pyramid_size(image_t *img, int levels, float scale)
+{
+    size_t size;
+    image_pyramid_levels(img, levels, scale, &size);
+    return size;
+}
+
+void imlib_image_pyramid_init(image_pyramid_t *pyr, image_t *img, int levels, float scale, uint8_t *buf)
+{
+    size_t size;
+    pyr->levels_len = image_pyramid_levels(img, levels, scale, &size);
+    pyr->scale = scale;
+    pyr->levels[0] = *img;
+
+    for (int i = 1; i < pyr->levels_len; i++) {
+        image_t *prev = &pyr->levels[i - 1], *level = &pyr->levels[i];
+        *level = *prev;
+        image_pyramid_level_size(prev, scale, &level->w, &level->h);
+        level->data = buf;
+        buf += image_size(level);
+
+        if (scale == 2.0f) {
+            imlib_decimate2(prev, level);
+        } else {
+            rectangle_t roi = { .x = 0, .y = 0, .w = prev->w, .h = prev->h };
+            imlib_resample(level, prev, &roi, IMAGE_HINT_AREA);
+        }
+    }
+}
+
+bool imlib_image_pyramid_of(image_pyramid_t *pyr, image_t *img)
+{
+    return (pyr->levels_len > 0) && (pyr->levels[0].data == img->data)
+        && (pyr->levels[0].w == img->w) && (pyr->levels[0].h == img->h) && (pyr->levels[0].bpp == img->bpp);
+}
@@ -155,9 +155,67 @@ int comp (const void * elem1, const void * elem2)
     return 0;
 }
 
+// Edges are bucket sorted in place on their weight quantized to 1/8 (the weight is at most
+// sqrt(3 * 255^2) < 442), then each bucket is sorted on the exact weight.
+#define EDGE_BUCKET_SCALE   (8)
+#define EDGE_BUCKETS        ((442 * EDGE_BUCKET_SCALE) + 1)
+#define EDGE_BUCKET(w)      ((int) ((w) * EDGE_BUCKET_SCALE))
+#define EDGE_INSERTION_SORT (32)
+
+static void sort_edges(edge *edges, int num_edges)
+{
+    uint32_t *next = fb_alloc0(EDGE_BUCKETS * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *end = fb_alloc(EDGE_BUCKETS * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (int i=0; i<num_edges; i++) {
+        next[EDGE_BUCKET(edges[i].w)]++;
+    }
+
+    for (int i=0, sum=0; i<EDGE_BUCKETS; i++) {
+        int count = next[i];
+        next[i] = sum;
+        sum += count;
+        end[i] = sum;
+    }
+
+    // Move each edge into its bucket (each swap puts at least one edge in its final bucket).
+    for (int i=0; i<EDGE_BUCKETS; i++) {
+        while (next[i] < end[i]) {
+            edge e = edges[next[i]];
+            int bucket = EDGE_BUCKET(e.w);
+            if (bucket == i) {
+                next[i]++;
+            } else {
+                edges[next[i]] = edges[next[bucket]];
+                edges[next[bucket]++] = e;
+            }
+        }
+    }
+
+    for (int i=0, start=0; i<EDGE_BUCKETS; start=end[i++]) {
+        int len = end[i] - start;
+        edge *bucket = edges + start;
+        if (len > EDGE_INSERTION_SORT) {
+            qsort(bucket, len, sizeof(edge), comp);
+        } else {
+            for (int j=1; j<len; j++) {
+                edge e = bucket[j];
+                int k = j;
+                for (; (k > 0) && (bucket[k-1].w > e.w); k--) {
+                    bucket[k] = bucket[k-1];
+                }
+                bucket[k] = e;
+            }
+        }
+    }
+
+    fb_free(); // end
+    fb_free(); // next
+}
+
 static void segment_graph(universe *u, int num_vertices, int num_edges, edge *edges, float c)
 {
-    qsort (edges, num_edges, sizeof(edge), comp);
+    sort_edges(edges, num_edges);
 
     float *threshold = fb_alloc(num_vertices * sizeof(float), FB_ALLOC_NO_HINT);
     for (int i=0; i<num_vertices; i++) {
@@ -181,6 +239,60 @@ static void segment_graph(universe *u, int num_vertices, int num_edges, edge *ed
     fb_free();
 }
 
+#define ADJACENCY_GET(adj, words, a, b) ((adj)[((a) * (words)) + ((b) / 32)] & (1u << ((b) % 32)))
+#define ADJACENCY_SET(adj, words, a, b) ((adj)[((a) * (words)) + ((b) / 32)] |= (1u << ((b) % 32)))
+#define ADJACENCY_CLR(adj, words, a, b) ((adj)[((a) * (words)) + ((b) / 32)] &= ~(1u << ((b) % 32)))
+
+// Similarity of two adjacent regions (i < j) and the versions of the regions it was computed with.
+typedef struct {
+    float similarity;
+    uint16_t i, j;
+    uint16_t i_version, j_version;
+} pair;
+
+// Max heap on the similarity. Ties go to the smallest (i, j) like a raster scan of the pairs.
+static inline bool pair_better(pair *a, pair *b)
+{
+    if (a->similarity != b->similarity) return a->similarity > b->similarity;
+    if (a->i != b->i) return a->i < b->i;
+    return a->j < b->j;
+}
+
+static inline bool pair_valid(pair *p, uint32_t *adjacency, int adjacency_words, uint16_t *versions)
+{
+    return (p->i_version == versions[p->i]) && (p->j_version == versions[p->j])
+        && ADJACENCY_GET(adjacency, adjacency_words, p->i, p->j);
+}
+
+static void heap_sift_down(pair *heap, int len, int i)
+{
+    for (;;) {
+        int best = i, l = (i * 2) + 1, r = l + 1;
+        if ((l < len) && pair_better(heap + l, heap + best)) best = l;
+        if ((r < len) && pair_better(heap + r, heap + best)) best = r;
+        if (best == i) break;
+        pair tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
+}
+
+static void heap_push(pair *heap, int *len, pair p)
+{
+    int i = (*len)++;
+    for (; i && pair_better(&p, heap + ((i - 1) / 2)); i = (i - 1) / 2) {
+        heap[i] = heap[(i - 1) / 2];
+    }
+    heap[i] = p;
+}
+
+static void heap_pop(pair *heap, int *len)
+{
+    heap[0] = heap[--(*len)];
+    heap_sift_down(heap, *len, 0);
+}
+
 static void image_scale(image_t *src, image_t *dst)
 {
     int x_ratio = (int)((src->w<<16)/dst->w) +1;
@@ -281,25 +393,20 @@ array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, f
 
     int next_component = 0;
     int   *counts = (int*) fb_alloc0(num_ccs * sizeof(int), FB_ALLOC_NO_HINT);
-    int   *components= (int*) fb_alloc(num_ccs * sizeof(int), FB_ALLOC_NO_HINT);
     float *histogram = (float*) fb_alloc0(num_ccs * sizeof(float) * 75, FB_ALLOC_NO_HINT);
 
+    // Component id of each set (indexed by the set root), ids are given in raster scan order.
+    uint16_t *components = (uint16_t*) fb_alloc(width * height * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    memset(components, 0xFF, width * height * sizeof(uint16_t));
+
     // Calc histograms
     for (int y=0; y<height; y++) {
         for (int x = 0; x<width; x++) {
-            int component_id = -1;
             int comp = universe_find(u, y * width + x);
-            for (i=0; i<next_component; i++) {
-                if (components[i] == comp) {
-                    component_id = i;
-                    break;
-                }
-            }
-            if (i == next_component) {
-                components[next_component] = comp;
-                component_id = next_component;
-                ++next_component;
+            if (components[comp] == 0xFFFF) {
+                components[comp] = next_component++;
             }
+            int component_id = components[comp];
             universe_set_id(u, y * width + x, component_id);
             region * r = regions + component_id;
             r->y = min(r->y, y);
@@ -330,7 +437,9 @@ array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, f
         }
     }
 
-    uint8_t * adjacency = (uint8_t*) fb_alloc0(num_ccs * num_ccs * sizeof(uint8_t), FB_ALLOC_NO_HINT);
+    // Adjacency bit matrix.
+    int adjacency_words = (num_ccs + 31) / 32;
+    uint32_t *adjacency = (uint32_t*) fb_alloc0(num_ccs * adjacency_words * sizeof(uint32_t), FB_ALLOC_NO_HINT);
     for (int y=0; y<height-1; ++y) {
         for (int x=0; x<width-1; ++x) {
             int component1 = universe_get_id(u, y * width + x);
@@ -338,54 +447,63 @@ array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, f
             int component3 = universe_get_id(u, y * width + x + width);
 
             if (component1 != component2) {
-                adjacency[component1 * num_ccs + component2] = 1;
-                adjacency[component2 * num_ccs + component1] = 1;
+                ADJACENCY_SET(adjacency, adjacency_words, component1, component2);
+                ADJACENCY_SET(adjacency, adjacency_words, component2, component1);
             }
 
             if (component1 != component3) {
-                adjacency[component1 * num_ccs + component3] = 1;
-                adjacency[component3 * num_ccs + component1] = 1;
+                ADJACENCY_SET(adjacency, adjacency_words, component1, component3);
+                ADJACENCY_SET(adjacency, adjacency_words, component3, component1);
             }
         }
     }
 
+    // The number of adjacent pairs never grows while merging so the heap is compacted to the
+    // valid pairs when it's full (there are at most num_pairs pushes per merge).
+    int num_pairs = 0;
+    for (i=0; i<(num_ccs * adjacency_words); i++) {
+        num_pairs += __builtin_popcount(adjacency[i]);
+    }
+    num_pairs /= 2;
+
     int size = height * width;
-    float * similarity_table = (float*) fb_alloc(num_ccs * num_ccs * sizeof(float), FB_ALLOC_NO_HINT);
+    int heap_len = 0;
+    int heap_size = IM_MAX(num_pairs * 2, 1);
+    pair *heap = (pair*) fb_alloc(heap_size * sizeof(pair), FB_ALLOC_NO_HINT);
+    uint16_t *versions = (uint16_t*) fb_alloc0(num_ccs * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
     for (i = 0; i < num_ccs; ++i) {
         for (j = i + 1; j < num_ccs; ++j) {
-            float color_sim = a1 * color_similarity (histogram + 75 * i, histogram + 75 * j);
-            float size_sim  = a2 * size_similarity (counts[i], counts[j], size);
-            float fill_sim  = a3 * fill_similarity (regions + i, regions + j, counts[i], counts[j], size);
-            float similarity = color_sim + size_sim + fill_sim;
-            similarity_table[i * num_ccs + j] = similarity;
-            similarity_table[j * num_ccs + i] = similarity;
+            if (ADJACENCY_GET(adjacency, adjacency_words, i, j)) {
+                float color_sim = a1 * color_similarity (histogram + 75 * i, histogram + 75 * j);
+                float size_sim  = a2 * size_similarity (counts[i], counts[j], size);
+                float fill_sim  = a3 * fill_similarity (regions + i, regions + j, counts[i], counts[j], size);
+                heap[heap_len++] = (pair) {color_sim + size_sim + fill_sim, i, j, 0, 0};
+            }
         }
     }
 
+    for (i = (heap_len / 2) - 1; i >= 0; i--) {
+        heap_sift_down(heap, heap_len, i);
+    }
+
+    // Out of time, the proposals of the merges done so far are returned.
     int remaining = num_ccs;
-    while (remaining > 1) {
-        int best_i = -1;
-        int best_j = -1;
-        float best_similarity = 0;
-        for (i=0; i<num_ccs; i++) {
-            for (j=i+1; j<num_ccs; j++) {
-                if (adjacency[i * num_ccs + j] == 0) {
-                    continue;
-                }
-                float similarity = similarity_table[i * num_ccs + j];
-                if (similarity > best_similarity) {
-                    best_similarity = similarity;
-                    best_i = i;
-                    best_j = j;
-                }
-            }
+    while ((remaining > 1) && (!imlib_deadline_expired())) {
+        // Most similar adjacent regions, stale pairs are dropped.
+        while (heap_len && !pair_valid(heap, adjacency, adjacency_words, versions)) {
+            heap_pop(heap, &heap_len);
         }
 
-        if (best_i == -1) {
+        if ((!heap_len) || (heap[0].similarity <= 0)) {
             printf("failed to build tree\n");
             break;
         }
 
+        int best_i = heap[0].i;
+        int best_j = heap[0].j;
+        heap_pop(heap, &heap_len);
+
         // update regions, histograms, counts, adjacency, similarity
         regions[best_i].x = min(regions[best_i].x, regions[best_j].x);
         regions[best_i].y = min(regions[best_i].y, regions[best_j].y);
@@ -413,23 +531,48 @@ array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, f
         }
         counts[best_i] += counts[best_j];
 
-        for (i=0; i<num_ccs; i++) {
-            adjacency[best_i * num_ccs + i] |= adjacency[best_j * num_ccs + i];
-            adjacency[i * num_ccs + best_i] |= adjacency[i * num_ccs + best_j];
-            adjacency[best_j * num_ccs + i]  = adjacency[i * num_ccs + best_j] = 0;
+        // The neighbours of best_j become neighbours of best_i.
+        uint32_t *row_i = adjacency + (best_i * adjacency_words);
+        uint32_t *row_j = adjacency + (best_j * adjacency_words);
+        for (int w=0; w<adjacency_words; w++) {
+            for (uint32_t bits = row_j[w]; bits; bits &= bits - 1) {
+                int k = (w * 32) + __builtin_ctz(bits);
+                ADJACENCY_CLR(adjacency, adjacency_words, k, best_j);
+                ADJACENCY_SET(adjacency, adjacency_words, k, best_i);
+            }
+            row_i[w] |= row_j[w];
+            row_j[w] = 0;
+        }
+        ADJACENCY_CLR(adjacency, adjacency_words, best_i, best_i);
+        ADJACENCY_CLR(adjacency, adjacency_words, best_i, best_j);
+        ADJACENCY_CLR(adjacency, adjacency_words, best_j, best_i);
+
+        // The pairs of best_i and best_j in the heap are now stale.
+        versions[best_i]++;
+        versions[best_j]++;
+
+        if ((heap_len + num_pairs) > heap_size) {
+            int len = 0;
+            for (i=0; i<heap_len; i++) {
+                if (pair_valid(heap + i, adjacency, adjacency_words, versions)) {
+                    heap[len++] = heap[i];
+                }
+            }
+            heap_len = len;
+            for (i = (heap_len / 2) - 1; i >= 0; i--) {
+                heap_sift_down(heap, heap_len, i);
+            }
         }
-        adjacency[best_i * num_ccs + best_i]  = 0;
 
-        for (i=0; i<num_ccs; i++) {
-            if (adjacency[best_i * num_ccs + i] == 0) {
-                continue;
+        for (int w=0; w<adjacency_words; w++) {
+            for (uint32_t bits = row_i[w]; bits; bits &= bits - 1) {
+                int k = (w * 32) + __builtin_ctz(bits);
+                float color_sim = a1 * color_similarity (histogram + 75 * k, histogram + 75 * best_i);
+                float size_sim  = a2 * size_similarity (counts[k], counts[best_i], size);
+                float fill_sim  = a3 * fill_similarity (regions + k, regions + best_i, counts[k], counts[best_i], size);
+                int p_i = min(k, best_i), p_j = max(k, best_i);
+                heap_push(heap, &heap_len, (pair) {color_sim + size_sim + fill_sim, p_i, p_j, versions[p_i], versions[p_j]});
             }
-            float color_sim = a1 * color_similarity (histogram + 75 * i, histogram + 75 * best_i);
-            float size_sim  = a2 * size_similarity (counts[i], counts[best_i], size);
-            float fill_sim  = a3 * fill_similarity (regions + i, regions + best_i, counts[i], counts[best_i], size);
-            float similarity = color_sim + size_sim + fill_sim;
-            similarity_table[i * num_ccs + best_i] = similarity;
-            similarity_table[best_i * num_ccs + i] = similarity;
         }
         --remaining;
     }
@@ -9,6 +9,7 @@
  * Shadow removal.
  */
 #include "imlib.h"
+#include "omv_boardconfig.h"
 
 #ifdef IMLIB_ENABLE_REMOVE_SHADOWS
 // http://arma.sourceforge.net/shadows/
@@ -17,13 +18,68 @@
 #define imlib_remove_shadows_kernel_rank 1
 #define imlib_remove_shadows_kernel_size ((imlib_remove_shadows_kernel_rank * 2) + 1)
 
+// Hue is in [0:255] for [0:360) degrees and saturation in [0:255].
+#define imlib_remove_shadows_hue_threshold 34 // 48 degrees
+#define imlib_remove_shadows_sat_threshold 40
+
 typedef struct imlib_remove_shadows_line_op_state {
     uint16_t *img_lines[imlib_remove_shadows_kernel_size];
     uint16_t *other_lines[imlib_remove_shadows_kernel_size];
     uint16_t *out_lines[imlib_remove_shadows_kernel_size];
+    uint8_t *hue_diff_lines[imlib_remove_shadows_kernel_size];
+    int16_t *sat_diff_lines[imlib_remove_shadows_kernel_size];
+    uint16_t *recip; // 65535 / i
+    image_t *background;
+    int update;
+    bool difference;
     int lines_processed;
 } imlib_remove_shadows_line_op_state_t;
 
+static inline void imlib_remove_shadows_hue_sat(const uint16_t *recip, int pixel, int *hue, int *sat)
+{
+    int r = COLOR_RGB565_TO_R8(pixel);
+    int g = COLOR_RGB565_TO_G8(pixel);
+    int b = COLOR_RGB565_TO_B8(pixel);
+    int cmax = IM_MAX(IM_MAX(r, g), b);
+    int cmin = IM_MIN(IM_MIN(r, g), b);
+    int cdel = cmax - cmin;
+
+    if (!cdel) {
+        *hue = 0;
+        *sat = 0;
+        return;
+    }
+
+    int num, offset;
+
+    if (cmax == r) {
+        num = g - b;
+        offset = 0;
+    } else if (cmax == g) {
+        num = b - r;
+        offset = 85;
+    } else {
+        num = r - g;
+        offset = 171;
+    }
+
+    *hue = (offset + ((num * 43 * recip[cdel]) >> 16)) & 0xFF;
+    *sat = (cdel * 255 * recip[cmax]) >> 16;
+}
+
+// Computes the hue and saturation differences of a line once for all the windows using them.
+static void imlib_remove_shadows_diff_line(imlib_remove_shadows_line_op_state_t *state, int index, int w)
+{
+    for (int x = 0; x < w; x++) {
+        int img_h, img_s, other_h, other_s;
+        imlib_remove_shadows_hue_sat(state->recip, IMAGE_GET_RGB565_PIXEL_FAST(state->img_lines[index], x), &img_h, &img_s);
+        imlib_remove_shadows_hue_sat(state->recip, IMAGE_GET_RGB565_PIXEL_FAST(state->other_lines[index], x), &other_h, &other_s);
+        int h_diff = abs(img_h - other_h);
+        state->hue_diff_lines[index][x] = (h_diff > 128) ? (256 - h_diff) : h_diff;
+        state->sat_diff_lines[index][x] = img_s - other_s;
+    }
+}
+
 static void imlib_remove_shadows_sub_sub_line_op(image_t *img, int line, void *data, bool vflipped)
 {
     imlib_remove_shadows_line_op_state_t *state = (imlib_remove_shadows_line_op_state_t *) data;
@@ -44,23 +100,20 @@ static void imlib_remove_shadows_sub_line_op(image_t *img, int line, void *data,
     if (state->lines_processed >= imlib_remove_shadows_kernel_rank) {
         int y = vflipped ? (line + imlib_remove_shadows_kernel_rank) : (line - imlib_remove_shadows_kernel_rank);
         int index = y % imlib_remove_shadows_kernel_size;
+        int minY = IM_MAX(y - imlib_remove_shadows_kernel_rank, 0);
+        int maxY = IM_MIN(y + imlib_remove_shadows_kernel_rank, img->h - 1);
+        // The background row was copied into other_lines so it can be updated in place.
+        uint16_t *bg_row_ptr = state->background ? IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(state->background, y) : NULL;
 
         for (int x = 0, xx = img->w; x < xx; x++) {
             int img_pixel = IMAGE_GET_RGB565_PIXEL_FAST(state->img_lines[index], x);
-            int img_r = COLOR_RGB565_TO_R8(img_pixel);
-            int img_g = COLOR_RGB565_TO_G8(img_pixel);
-            int img_b = COLOR_RGB565_TO_B8(img_pixel);
-            float img_v = IM_MAX(IM_MAX(img_r, img_g), img_b);
             int other_pixel = IMAGE_GET_RGB565_PIXEL_FAST(state->other_lines[index], x);
-            int other_r = COLOR_RGB565_TO_R8(other_pixel);
-            int other_g = COLOR_RGB565_TO_G8(other_pixel);
-            int other_b = COLOR_RGB565_TO_B8(other_pixel);
-            float other_v = IM_MAX(IM_MAX(other_r, other_g), other_b);
-            float ratio = img_v / other_v;
-
-            if ((0.3f < ratio) && (ratio < 1.0f)) {
-                int minY = IM_MAX(y - imlib_remove_shadows_kernel_rank, 0);
-                int maxY = IM_MIN(y + imlib_remove_shadows_kernel_rank, img->h - 1);
+            int img_v = IM_MAX(IM_MAX(COLOR_RGB565_TO_R8(img_pixel), COLOR_RGB565_TO_G8(img_pixel)), COLOR_RGB565_TO_B8(img_pixel));
+            int other_v = IM_MAX(IM_MAX(COLOR_RGB565_TO_R8(other_pixel), COLOR_RGB565_TO_G8(other_pixel)), COLOR_RGB565_TO_B8(other_pixel));
+            int out_pixel = img_pixel;
+
+            // 0.3 < (img_v / other_v) < 1.0
+            if (((img_v * 10) > (other_v * 3)) && (img_v < other_v)) {
                 int minX = IM_MAX(x - imlib_remove_shadows_kernel_rank, 0);
                 int maxX = IM_MIN(x + imlib_remove_shadows_kernel_rank, img->w - 1);
                 int windowArea = (maxX - minX + 1) * (maxY - minY + 1);
@@ -71,61 +124,37 @@ static void imlib_remove_shadows_sub_line_op(image_t *img, int line, void *data,
                     int k_index = k_y % imlib_remove_shadows_kernel_size;
 
                     for (int k_x = minX; k_x <= maxX; k_x++) {
-                        int k_img_pixel = IMAGE_GET_RGB565_PIXEL_FAST(state->img_lines[k_index], k_x);
-                        int k_img_r = COLOR_RGB565_TO_R8(k_img_pixel);
-                        int k_img_g = COLOR_RGB565_TO_G8(k_img_pixel);
-                        int k_img_b = COLOR_RGB565_TO_B8(k_img_pixel);
-                        int k_img_cmax = IM_MAX(IM_MAX(k_img_r, k_img_g), k_img_b);
-                        int k_img_cmin = IM_MAX(IM_MAX(k_img_r, k_img_g), k_img_b);
-                        float k_img_cdel = k_img_cmax - k_img_cmin;
-                        float k_img_h = 0;
-                        float k_img_s = k_img_cmax ? (k_img_cdel / k_img_cmax) : 0;
-                        int k_other_pixel = IMAGE_GET_RGB565_PIXEL_FAST(state->other_lines[k_index], k_x);
-                        int k_other_r = COLOR_RGB565_TO_R8(k_other_pixel);
-                        int k_other_g = COLOR_RGB565_TO_G8(k_other_pixel);
-                        int k_other_b = COLOR_RGB565_TO_B8(k_other_pixel);
-                        int k_other_cmax = IM_MAX(IM_MAX(k_other_r, k_other_g), k_other_b);
-                        int k_other_cmin = IM_MAX(IM_MAX(k_other_r, k_other_g), k_other_b);
-                        float k_other_cdel = k_other_cmax - k_other_cmin;
-                        float k_other_h = 0;
-                        float k_other_s = k_other_cmax ? (k_other_cdel / k_other_cmax) : 0;
-
-                        if (k_img_cdel) {
-                            if (k_img_cmax == k_img_r) {
-                                k_img_h = ((k_img_g - k_img_b) / k_img_cdel) + 0;
-                            } else if (k_img_cmax == k_img_g) {
-                                k_img_h = ((k_img_b - k_img_r) / k_img_cdel) + 2;
-                            } else if (k_img_cmax == k_img_b) {
-                                k_img_h = ((k_img_r - k_img_g) / k_img_cdel) + 4;
-                            }
-                            k_img_h *= 60;
-                            if (k_img_h < 0) k_img_h += 360.0;
-                        }
-
-                        if (k_other_cdel) {
-                            if (k_other_cmax == k_other_r) {
-                                k_other_h = ((k_other_g - k_other_b) / k_other_cdel) + 0;
-                            } else if (k_other_cmax == k_other_g) {
-                                k_other_h = ((k_other_b - k_other_r) / k_other_cdel) + 2;
-                            } else if (k_other_cmax == k_other_b) {
-                                k_other_h = ((k_other_r - k_other_g) / k_other_cdel) + 4;
-                            }
-                            k_other_h *= 60;
-                            if (k_other_h < 0) k_other_h += 360.0;
-                        }
-
-                        int hDiff = abs(k_img_h - k_other_h);
-                        hDiffSum += (hDiff >= 90) ? (180 - hDiff) : hDiff;
-                        sDiffSum += k_img_s - k_other_s;
+                        hDiffSum += state->hue_diff_lines[k_index][k_x];
+                        sDiffSum += state->sat_diff_lines[k_index][k_x];
                     }
                 }
 
-                bool hIsShadow = (hDiffSum / windowArea) < 48;
-                bool sIsShadow = (sDiffSum / windowArea) < 40;
-                IMAGE_PUT_RGB565_PIXEL_FAST(state->out_lines[index], x, (hIsShadow && sIsShadow) ? other_pixel : img_pixel);
-            } else {
-                IMAGE_PUT_RGB565_PIXEL_FAST(state->out_lines[index], x, img_pixel);
+                bool hIsShadow = hDiffSum < (imlib_remove_shadows_hue_threshold * windowArea);
+                bool sIsShadow = sDiffSum < (imlib_remove_shadows_sat_threshold * windowArea);
+
+                if (hIsShadow && sIsShadow) {
+                    out_pixel = other_pixel;
+                }
             }
+
+            if (bg_row_ptr && state->update) {
+                // Moves the background towards the shadow free pixel, rounded to the nearest.
+                int bR = COLOR_RGB565_TO_R5(other_pixel), bG = COLOR_RGB565_TO_G6(other_pixel), bB = COLOR_RGB565_TO_B5(other_pixel);
+                int oR = COLOR_RGB565_TO_R5(out_pixel), oG = COLOR_RGB565_TO_G6(out_pixel), oB = COLOR_RGB565_TO_B5(out_pixel);
+                bR += (((oR - bR) * state->update) + 128) >> 8;
+                bG += (((oG - bG) * state->update) + 128) >> 8;
+                bB += (((oB - bB) * state->update) + 128) >> 8;
+                IMAGE_PUT_RGB565_PIXEL_FAST(bg_row_ptr, x, COLOR_R5_G6_B5_TO_RGB565(bR, bG, bB));
+            }
+
+            if (state->difference) {
+                int dR = abs(COLOR_RGB565_TO_R5(out_pixel) - COLOR_RGB565_TO_R5(other_pixel));
+                int dG = abs(COLOR_RGB565_TO_G6(out_pixel) - COLOR_RGB565_TO_G6(other_pixel));
+                int dB = abs(COLOR_RGB565_TO_B5(out_pixel) - COLOR_RGB565_TO_B5(other_pixel));
+                out_pixel = COLOR_R5_G6_B5_TO_RGB565(dR, dG, dB);
+            }
+
+            IMAGE_PUT_RGB565_PIXEL_FAST(state->out_lines[index], x, out_pixel);
         }
     }
 
@@ -135,13 +164,16 @@ static void imlib_remove_shadows_sub_line_op(image_t *img, int line, void *data,
 static void imlib_remove_shadows_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
 {
     imlib_remove_shadows_line_op_state_t *state = (imlib_remove_shadows_line_op_state_t *) data;
+    int index = line % imlib_remove_shadows_kernel_size;
 
-    memcpy(state->img_lines[line % imlib_remove_shadows_kernel_size],
+    memcpy(state->img_lines[index],
             IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line), img->w * sizeof(uint16_t));
 
-    memcpy(state->other_lines[line % imlib_remove_shadows_kernel_size],
+    memcpy(state->other_lines[index],
             (uint16_t *) other, img->w * sizeof(uint16_t));
 
+    imlib_remove_shadows_diff_line(state, index, img->w);
+
     imlib_remove_shadows_sub_line_op(img, line, data, vflipped);
 
     if (state->lines_processed == img->h) {
@@ -157,7 +189,7 @@ static void imlib_remove_shadows_line_op(image_t *img, int line, void *other, vo
     }
 }
 
-void imlib_remove_shadows(image_t *img, const char *path, image_t *other, int scalar, bool single)
+void imlib_remove_shadows(image_t *img, const char *path, image_t *other, int scalar, bool single, int update, bool difference)
 {
     if (!single) {
         imlib_remove_shadows_line_op_state_t state;
@@ -166,16 +198,32 @@ void imlib_remove_shadows(image_t *img, const char *path, image_t *other, int sc
             state.img_lines[i] = fb_alloc(img->w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
             state.other_lines[i] = fb_alloc(img->w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
             state.out_lines[i] = fb_alloc(img->w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+            state.hue_diff_lines[i] = fb_alloc(img->w * sizeof(uint8_t), FB_ALLOC_NO_HINT);
+            state.sat_diff_lines[i] = fb_alloc(img->w * sizeof(int16_t), FB_ALLOC_NO_HINT);
         }
 
+        state.recip = fb_alloc(256 * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+        state.recip[0] = 0;
+
+        for (int i = 1; i < 256; i++) {
+            state.recip[i] = 65535 / i;
+        }
+
+        state.background = other;
+        state.update = update;
+        state.difference = difference;
         state.lines_processed = 0;
 
         imlib_image_operation(img, path, other, scalar, imlib_remove_shadows_line_op, &state);
 
+        fb_free(); // recip
+
         for (int i = 0; i < imlib_remove_shadows_kernel_size; i++) {
             fb_free();
             fb_free();
             fb_free();
+            fb_free();
+            fb_free();
         }
     } else {
 
@@ -420,6 +468,145 @@ void imlib_chrominvar(image_t *img)
 #ifdef IMLIB_ENABLE_ILLUMINVAR
 extern const uint16_t invariant_table[65536];
 
+#if defined(OMV_INVARIANT_MEMORY) && !defined(IMLIB_ENABLE_INVARIANT_TABLE)
+// Generated on first use, one RGB565 output per RGB565 input.
+extern char _invariant_buf;
+static bool invariant_buf_ready = false;
+#endif
+
+// Grid (in 5/6/5-bit units) of the compact table, interpolated between grid points.
+#define INVARIANT_GRID_R_SHIFT  (1)
+#define INVARIANT_GRID_G_SHIFT  (2)
+#define INVARIANT_GRID_B_SHIFT  (1)
+#define INVARIANT_GRID_R        ((COLOR_R5_MAX >> INVARIANT_GRID_R_SHIFT) + 2)
+#define INVARIANT_GRID_G        ((COLOR_G6_MAX >> INVARIANT_GRID_G_SHIFT) + 2)
+#define INVARIANT_GRID_B        ((COLOR_B5_MAX >> INVARIANT_GRID_B_SHIFT) + 2)
+
+#if !defined(IMLIB_ENABLE_INVARIANT_TABLE)
+static void illuminvar_rgb888(int r8, int g8, int b8, uint8_t *out)
+{
+    float r_lin = xyz_table[r8] + 1.0;
+    float g_lin = xyz_table[g8] + 1.0;
+    float b_lin = xyz_table[b8] + 1.0;
+
+    float r_lin_sharp = (r_lin *  0.9968f) + (g_lin *  0.0228f) + (b_lin * 0.0015f);
+    float g_lin_sharp = (r_lin * -0.0071f) + (g_lin *  0.9933f) + (b_lin * 0.0146f);
+    float b_lin_sharp = (r_lin *  0.0103f) + (g_lin * -0.0161f) + (b_lin * 0.9839f);
+
+    float lin_sharp_avg = r_lin_sharp * g_lin_sharp * b_lin_sharp;
+    lin_sharp_avg = (lin_sharp_avg > 0.0f) ? fast_cbrtf(lin_sharp_avg) : 0.0f;
+
+    float r_lin_sharp_div = 0.0f;
+    float g_lin_sharp_div = 0.0f;
+    float b_lin_sharp_div = 0.0f;
+
+    if (lin_sharp_avg > 0.0f) {
+        lin_sharp_avg = 1.0f / lin_sharp_avg;
+        r_lin_sharp_div = r_lin_sharp * lin_sharp_avg;
+        g_lin_sharp_div = g_lin_sharp * lin_sharp_avg;
+        b_lin_sharp_div = b_lin_sharp * lin_sharp_avg;
+    }
+
+    float r_lin_sharp_div_log = (r_lin_sharp_div > 0.0f) ? fast_log(r_lin_sharp_div) : 0.0f;
+    float g_lin_sharp_div_log = (g_lin_sharp_div > 0.0f) ? fast_log(g_lin_sharp_div) : 0.0f;
+    float b_lin_sharp_div_log = (b_lin_sharp_div > 0.0f) ? fast_log(b_lin_sharp_div) : 0.0f;
+
+    float chi_x = (r_lin_sharp_div_log * 0.7071f) + (g_lin_sharp_div_log * -0.7071f) + (b_lin_sharp_div_log *  0.0000f);
+    float chi_y = (r_lin_sharp_div_log * 0.4082f) + (g_lin_sharp_div_log *  0.4082f) + (b_lin_sharp_div_log * -0.8164f);
+
+    float e_t_x =  0.9326f;
+    float e_t_y = -0.3609f;
+
+    float p_th_00 = e_t_x * e_t_x;
+    float p_th_01 = e_t_x * e_t_y;
+    float p_th_10 = e_t_y * e_t_x;
+    float p_th_11 = e_t_y * e_t_y;
+
+    float x_th_x = (p_th_00 * chi_x) + (p_th_01 * chi_y);
+    float x_th_y = (p_th_10 * chi_x) + (p_th_11 * chi_y);
+
+    float r_chi = (x_th_x *  0.7071f) + (x_th_y *  0.4082f);
+    float g_chi = (x_th_x * -0.7071f) + (x_th_y *  0.4082f);
+    float b_chi = (x_th_x *  0.0000f) + (x_th_y * -0.8164f);
+
+    float r_chi_invariant = fast_expf(r_chi);
+    float g_chi_invariant = fast_expf(g_chi);
+    float b_chi_invariant = fast_expf(b_chi);
+
+    float chi_invariant_sum = r_chi_invariant + g_chi_invariant + b_chi_invariant;
+
+    float r_chi_invariant_m = 0.0f;
+    float g_chi_invariant_m = 0.0f;
+    float b_chi_invariant_m = 0.0f;
+
+    if (chi_invariant_sum > 0.0f) {
+        chi_invariant_sum = 1.0f / chi_invariant_sum;
+        r_chi_invariant_m = r_chi_invariant * chi_invariant_sum;
+        g_chi_invariant_m = g_chi_invariant * chi_invariant_sum;
+        b_chi_invariant_m = b_chi_invariant * chi_invariant_sum;
+    }
+
+    out[0] = IM_MAX(IM_MIN(r_chi_invariant_m * 255.0f, COLOR_R8_MAX), COLOR_R8_MIN);
+    out[1] = IM_MAX(IM_MIN(g_chi_invariant_m * 255.0f, COLOR_G8_MAX), COLOR_G8_MIN);
+    out[2] = IM_MAX(IM_MIN(b_chi_invariant_m * 255.0f, COLOR_B8_MAX), COLOR_B8_MIN);
+
+}
+
+#if defined(OMV_INVARIANT_MEMORY)
+static int illuminvar_rgb565(int pixel)
+{
+    uint8_t out[3];
+    illuminvar_rgb888(COLOR_RGB565_TO_R8(pixel), COLOR_RGB565_TO_G8(pixel), COLOR_RGB565_TO_B8(pixel), out);
+    return COLOR_R8_G8_B8_TO_RGB565(out[0], out[1], out[2]);
+}
+#else
+// The invariant is smooth apart from the darkest colors, a 17x17x17 grid interpolated per channel
+// is close to the full table and takes 15KB.
+static uint8_t *illuminvar_grid_alloc()
+{
+    uint8_t *grid = fb_alloc(INVARIANT_GRID_R * INVARIANT_GRID_G * INVARIANT_GRID_B * 3, FB_ALLOC_NO_HINT);
+
+    for (int r = 0, i = 0; r < INVARIANT_GRID_R; r++) {
+        int r8 = COLOR_R5_TO_R8(IM_MIN(r << INVARIANT_GRID_R_SHIFT, COLOR_R5_MAX));
+        for (int g = 0; g < INVARIANT_GRID_G; g++) {
+            int g8 = COLOR_G6_TO_G8(IM_MIN(g << INVARIANT_GRID_G_SHIFT, COLOR_G6_MAX));
+            for (int b = 0; b < INVARIANT_GRID_B; b++, i += 3) {
+                illuminvar_rgb888(r8, g8, COLOR_B5_TO_B8(IM_MIN(b << INVARIANT_GRID_B_SHIFT, COLOR_B5_MAX)), grid + i);
+            }
+        }
+    }
+
+    return grid;
+}
+
+static inline int illuminvar_grid_lookup(const uint8_t *grid, int pixel)
+{
+    const int sb = 3, sg = INVARIANT_GRID_B * sb, sr = INVARIANT_GRID_G * sg;
+    const int wr_max = 1 << INVARIANT_GRID_R_SHIFT, wg_max = 1 << INVARIANT_GRID_G_SHIFT, wb_max = 1 << INVARIANT_GRID_B_SHIFT;
+    const int shift = INVARIANT_GRID_R_SHIFT + INVARIANT_GRID_G_SHIFT + INVARIANT_GRID_B_SHIFT;
+
+    int r5 = COLOR_RGB565_TO_R5(pixel), g6 = COLOR_RGB565_TO_G6(pixel), b5 = COLOR_RGB565_TO_B5(pixel);
+    int wr = r5 & (wr_max - 1), wg = g6 & (wg_max - 1), wb = b5 & (wb_max - 1);
+    const uint8_t *p = grid + ((r5 >> INVARIANT_GRID_R_SHIFT) * sr)
+                            + ((g6 >> INVARIANT_GRID_G_SHIFT) * sg)
+                            + ((b5 >> INVARIANT_GRID_B_SHIFT) * sb);
+    int out[3];
+
+    for (int c = 0; c < 3; c++, p++) {
+        int v00 = (p[0] * (wb_max - wb)) + (p[sb] * wb);
+        int v01 = (p[sg] * (wb_max - wb)) + (p[sg + sb] * wb);
+        int v10 = (p[sr] * (wb_max - wb)) + (p[sr + sb] * wb);
+        int v11 = (p[sr + sg] * (wb_max - wb)) + (p[sr + sg + sb] * wb);
+        int v0 = (v00 * (wg_max - wg)) + (v01 * wg);
+        int v1 = (v10 * (wg_max - wg)) + (v11 * wg);
+        out[c] = ((v0 * (wr_max - wr)) + (v1 * wr) + (1 << (shift - 1))) >> shift;
+    }
+
+    return COLOR_R8_G8_B8_TO_RGB565(out[0], out[1], out[2]);
+}
+#endif // OMV_INVARIANT_MEMORY
+#endif // IMLIB_ENABLE_INVARIANT_TABLE
+
 void imlib_illuminvar(image_t *img) // http://ai.stanford.edu/~alireza/publication/cic15.pdf
 {
     switch(img->bpp) {
@@ -430,84 +617,37 @@ void imlib_illuminvar(image_t *img) // http://ai.stanford.edu/~alireza/publicati
             break;
         }
         case IMAGE_BPP_RGB565: {
+#if defined(IMLIB_ENABLE_INVARIANT_TABLE) || defined(OMV_INVARIANT_MEMORY)
+#if defined(IMLIB_ENABLE_INVARIANT_TABLE)
+            const uint16_t *table = invariant_table;
+#else
+            uint16_t *table = (uint16_t *) &_invariant_buf;
+            if (!invariant_buf_ready) {
+                for (int i = 0; i < 65536; i++) {
+                    table[i] = illuminvar_rgb565(i);
+                }
+                invariant_buf_ready = true;
+            }
+#endif
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
                 for (int x = 0, xx = img->w; x < xx; x++) {
-                    int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
-#ifdef IMLIB_ENABLE_INVARIANT_TABLE
-                    int rgb565 = invariant_table[pixel];
+                    IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, table[IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x)]);
+                }
+            }
 #else
-                    float r_lin = xyz_table[COLOR_RGB565_TO_R8(pixel)] + 1.0;
-                    float g_lin = xyz_table[COLOR_RGB565_TO_G8(pixel)] + 1.0;
-                    float b_lin = xyz_table[COLOR_RGB565_TO_B8(pixel)] + 1.0;
-
-                    float r_lin_sharp = (r_lin *  0.9968f) + (g_lin *  0.0228f) + (b_lin * 0.0015f);
-                    float g_lin_sharp = (r_lin * -0.0071f) + (g_lin *  0.9933f) + (b_lin * 0.0146f);
-                    float b_lin_sharp = (r_lin *  0.0103f) + (g_lin * -0.0161f) + (b_lin * 0.9839f);
-
-                    float lin_sharp_avg = r_lin_sharp * g_lin_sharp * b_lin_sharp;
-                    lin_sharp_avg = (lin_sharp_avg > 0.0f) ? fast_cbrtf(lin_sharp_avg) : 0.0f;
-
-                    float r_lin_sharp_div = 0.0f;
-                    float g_lin_sharp_div = 0.0f;
-                    float b_lin_sharp_div = 0.0f;
-
-                    if (lin_sharp_avg > 0.0f) {
-                        lin_sharp_avg = 1.0f / lin_sharp_avg;
-                        r_lin_sharp_div = r_lin_sharp * lin_sharp_avg;
-                        g_lin_sharp_div = g_lin_sharp * lin_sharp_avg;
-                        b_lin_sharp_div = b_lin_sharp * lin_sharp_avg;
-                    }
-
-                    float r_lin_sharp_div_log = (r_lin_sharp_div > 0.0f) ? fast_log(r_lin_sharp_div) : 0.0f;
-                    float g_lin_sharp_div_log = (g_lin_sharp_div > 0.0f) ? fast_log(g_lin_sharp_div) : 0.0f;
-                    float b_lin_sharp_div_log = (b_lin_sharp_div > 0.0f) ? fast_log(b_lin_sharp_div) : 0.0f;
-
-                    float chi_x = (r_lin_sharp_div_log * 0.7071f) + (g_lin_sharp_div_log * -0.7071f) + (b_lin_sharp_div_log *  0.0000f);
-                    float chi_y = (r_lin_sharp_div_log * 0.4082f) + (g_lin_sharp_div_log *  0.4082f) + (b_lin_sharp_div_log * -0.8164f);
-
-                    float e_t_x =  0.9326f;
-                    float e_t_y = -0.3609f;
-
-                    float p_th_00 = e_t_x * e_t_x;
-                    float p_th_01 = e_t_x * e_t_y;
-                    float p_th_10 = e_t_y * e_t_x;
-                    float p_th_11 = e_t_y * e_t_y;
-
-                    float x_th_x = (p_th_00 * chi_x) + (p_th_01 * chi_y);
-                    float x_th_y = (p_th_10 * chi_x) + (p_th_11 * chi_y);
-
-                    float r_chi = (x_th_x *  0.7071f) + (x_th_y *  0.4082f);
-                    float g_chi = (x_th_x * -0.7071f) + (x_th_y *  0.4082f);
-                    float b_chi = (x_th_x *  0.0000f) + (x_th_y * -0.8164f);
+            fb_alloc_mark();
+            uint8_t *grid = illuminvar_grid_alloc();
 
-                    float r_chi_invariant = fast_expf(r_chi);
-                    float g_chi_invariant = fast_expf(g_chi);
-                    float b_chi_invariant = fast_expf(b_chi);
-
-                    float chi_invariant_sum = r_chi_invariant + g_chi_invariant + b_chi_invariant;
-
-                    float r_chi_invariant_m = 0.0f;
-                    float g_chi_invariant_m = 0.0f;
-                    float b_chi_invariant_m = 0.0f;
-
-                    if (chi_invariant_sum > 0.0f) {
-                        chi_invariant_sum = 1.0f / chi_invariant_sum;
-                        r_chi_invariant_m = r_chi_invariant * chi_invariant_sum;
-                        g_chi_invariant_m = g_chi_invariant * chi_invariant_sum;
-                        b_chi_invariant_m = b_chi_invariant * chi_invariant_sum;
-                    }
-
-                    int r_chi_invariant_m_int = IM_MAX(IM_MIN(r_chi_invariant_m * 255.0f, COLOR_R8_MAX), COLOR_R8_MIN);
-                    int g_chi_invariant_m_int = IM_MAX(IM_MIN(g_chi_invariant_m * 255.0f, COLOR_G8_MAX), COLOR_G8_MIN);
-                    int b_chi_invariant_m_int = IM_MAX(IM_MIN(b_chi_invariant_m * 255.0f, COLOR_B8_MAX), COLOR_B8_MIN);
-
-                    int rgb565 = COLOR_R8_G8_B8_TO_RGB565(r_chi_invariant_m_int, g_chi_invariant_m_int, b_chi_invariant_m_int);
-#endif
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, rgb565);
+            for (int y = 0, yy = img->h; y < yy; y++) {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+                for (int x = 0, xx = img->w; x < xx; x++) {
+                    IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, illuminvar_grid_lookup(grid, IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x)));
                 }
             }
 
+            fb_alloc_free_till_mark();
+#endif
             break;
         }
         default: {
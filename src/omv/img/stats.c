@@ -11,143 +11,217 @@
 #include "imlib.h"
 
 #ifdef IMLIB_ENABLE_GET_SIMILARITY
+// SSIM of the block_size x block_size windows placed every step pixels, the last window of a row
+// or column is clipped to the image (https://en.wikipedia.org/wiki/Structural_similarity).
+//
+// The rows arrive one at a time (from an image, a file or a compressed image) so the window sums
+// of x, y, x^2, y^2 and xy come from an integral image of the last block_size rows: the column
+// sums over those rows (the rows are kept to remove them again) are prefix summed along the row
+// when a row of windows is complete. SSIM is then computed from the sums in fixed point (Q16).
+#define SIMILARITY_Q    (16)
+#define SIMILARITY_ONE  (1 << SIMILARITY_Q)
+
+typedef struct similarity_sums {
+    uint32_t x, y, xx, yy, xy;
+} similarity_sums_t;
+
 typedef struct imlib_similatiry_line_op_state {
-    int *sumBucketsOfX, *sumBucketsOfY, *sum2BucketsOfX, *sum2BucketsOfY, *sum2Buckets;
-    float similarity_sum, similarity_sum_2, similarity_min, similarity_max;
+    int block_size, step;
+    uint8_t *rows; // The last block_size rows of both images (interleaved).
+    similarity_sums_t *sums, *prefix;
+    int windows, windows_done;
+    int64_t ssim_sum, ssim_sum_2, threshold;
+    int32_t ssim_min, ssim_max;
+    bool early_out;
     int lines_processed;
 } imlib_similatiry_line_op_state_t;
 
-void imlib_similarity_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+// Number of windows along an axis, the last one reaches the end.
+static int similarity_windows(int len, int block_size, int step)
 {
-    imlib_similatiry_line_op_state_t *state = (imlib_similatiry_line_op_state_t *) data; vflipped = vflipped;
-    float c1 = 0, c2 = 0;
+    int n = 1;
 
-    switch(img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line);
-            uint32_t *other_row_ptr = (uint32_t *) other;
-            for (int x = 0, xx = (img->w + 7) / 8; x < xx; x++) {
-                for (int i = 0, ii = IM_MIN((img->w - (x * 8)), 8); i < ii; i++) {
-                    int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + i);
-                    int other_pixel = IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr, x + i);
-                    state->sumBucketsOfX[x] += pixel;
-                    state->sumBucketsOfY[x] += other_pixel;
-                    state->sum2BucketsOfX[x] += pixel * pixel;
-                    state->sum2BucketsOfY[x] += other_pixel * other_pixel;
-                    state->sum2Buckets[x] += pixel * other_pixel;
-                }
-            }
-            c1 = COLOR_BINARY_MAX * 0.01f;
-            c2 = COLOR_BINARY_MAX * 0.03f;
-            break;
-        }
-        case IMAGE_BPP_GRAYSCALE: {
-            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line);
-            uint8_t *other_row_ptr = (uint8_t *) other;
-            for (int x = 0, xx = (img->w + 7) / 8; x < xx; x++) {
-                for (int i = 0, ii = IM_MIN((img->w - (x * 8)), 8); i < ii; i++) {
-                    int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + i);
-                    int other_pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr, x + i);
-                    state->sumBucketsOfX[x] += pixel;
-                    state->sumBucketsOfY[x] += other_pixel;
-                    state->sum2BucketsOfX[x] += pixel * pixel;
-                    state->sum2BucketsOfY[x] += other_pixel * other_pixel;
-                    state->sum2Buckets[x] += pixel * other_pixel;
-                }
-            }
-            c1 = COLOR_GRAYSCALE_MAX * 0.01f;
-            c2 = COLOR_GRAYSCALE_MAX * 0.03f;
-            break;
-        }
-        case IMAGE_BPP_RGB565: {
-            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line);
-            uint16_t *other_row_ptr = (uint16_t *) other;
-            for (int x = 0, xx = (img->w + 7) / 8; x < xx; x++) {
-                for (int i = 0, ii = IM_MIN((img->w - (x * 8)), 8); i < ii; i++) {
-                    int pixel = COLOR_RGB565_TO_L(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + i));
-                    int other_pixel = COLOR_RGB565_TO_L(IMAGE_GET_RGB565_PIXEL_FAST(other_row_ptr, x + i));
-                    state->sumBucketsOfX[x] += pixel;
-                    state->sumBucketsOfY[x] += other_pixel;
-                    state->sum2BucketsOfX[x] += pixel * pixel;
-                    state->sum2BucketsOfY[x] += other_pixel * other_pixel;
-                    state->sum2Buckets[x] += pixel * other_pixel;
-                }
-            }
-            c1 = COLOR_L_MAX * 0.01f;
-            c2 = COLOR_L_MAX * 0.03f;
-            break;
+    for (int i = 0; (i + block_size) < len; i += step) {
+        n++;
+    }
+
+    return n;
+}
+
+static inline int similarity_pixel(int bpp, void *row, int x)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: return COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST((uint32_t *) row, x));
+        case IMAGE_BPP_GRAYSCALE: return IMAGE_GET_GRAYSCALE_PIXEL_FAST((uint8_t *) row, x);
+        default: return COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST((uint16_t *) row, x));
+    }
+}
+
+// Adds (or removes) a row of pixel pairs to the column sums.
+static void similarity_sums_row(similarity_sums_t *sums, const uint8_t *pairs, int w, bool add)
+{
+    for (int x = 0; x < w; x++, pairs += 2) {
+        int px = pairs[0], py = pairs[1];
+        int sign = add ? 1 : -1;
+        sums[x].x += sign * px;
+        sums[x].y += sign * py;
+        sums[x].xx += sign * (px * px);
+        sums[x].yy += sign * (py * py);
+        sums[x].xy += sign * (px * py);
+    }
+}
+
+static int32_t similarity_ssim(similarity_sums_t *s, int n)
+{
+    // C1 = (0.01 * 255)^2 and C2 = (0.03 * 255)^2 scaled by n^2 like the products of the sums.
+    int64_t n2 = n * n;
+    int64_t c1 = IM_MAX(((n2 * 65025) + 5000) / 10000, 1);
+    int64_t c2 = IM_MAX(((n2 * 585225) + 5000) / 10000, 1);
+    int64_t sx = s->x, sy = s->y, sxsy = sx * sy;
+    int64_t a = (2 * sxsy) + c1;
+    int64_t b = (sx * sx) + (sy * sy) + c1;
+    int64_t c = (2 * ((n * ((int64_t) s->xy)) - sxsy)) + c2;
+    int64_t d = (n * (((int64_t) s->xx) + s->yy)) - (sx * sx) - (sy * sy) + c2;
+    return (((a << SIMILARITY_Q) / b) * ((c << SIMILARITY_Q) / d)) / SIMILARITY_ONE;
+}
+
+static void similarity_windows_row(imlib_similatiry_line_op_state_t *state, int w, int h)
+{
+    int block_size = state->block_size;
+    similarity_sums_t *p = state->prefix;
+    memset(p, 0, sizeof(similarity_sums_t));
+
+    for (int x = 0; x < w; x++) {
+        p[x + 1].x = p[x].x + state->sums[x].x;
+        p[x + 1].y = p[x].y + state->sums[x].y;
+        p[x + 1].xx = p[x].xx + state->sums[x].xx;
+        p[x + 1].yy = p[x].yy + state->sums[x].yy;
+        p[x + 1].xy = p[x].xy + state->sums[x].xy;
+    }
+
+    for (int x = 0; ; x += state->step) {
+        int ww = IM_MIN(block_size, w - x);
+        similarity_sums_t s = {
+            .x = p[x + ww].x - p[x].x,
+            .y = p[x + ww].y - p[x].y,
+            .xx = p[x + ww].xx - p[x].xx,
+            .yy = p[x + ww].yy - p[x].yy,
+            .xy = p[x + ww].xy - p[x].xy
+        };
+
+        int32_t ssim = similarity_ssim(&s, ww * h);
+        state->ssim_sum += ssim;
+        state->ssim_sum_2 += ((int64_t) ssim) * ssim;
+        state->ssim_min = IM_MIN(state->ssim_min, ssim);
+        state->ssim_max = IM_MAX(state->ssim_max, ssim);
+        state->windows_done += 1;
+
+        // Stop once the windows left can't bring the mean up to the threshold anymore.
+        if ((state->ssim_sum + (((int64_t) (state->windows - state->windows_done)) * SIMILARITY_ONE))
+            < state->threshold) {
+            state->early_out = true;
+            return;
         }
-        default: {
+
+        if ((x + block_size) >= w) {
             break;
         }
     }
+}
 
-    // https://en.wikipedia.org/wiki/Structural_similarity
-    if (((state->lines_processed + 1) == img->h) || (!((state->lines_processed + 1) % 8))) {
-        for (int x = 0, xx = (img->w + 7) / 8; x < xx; x++) {
-            int w = IM_MIN((img->w - (x * 8)), 8);
-            int h = IM_MIN((img->h - ((state->lines_processed / 8) * 8)), 8);
-            int size = w * h;
-
-            int mx = state->sumBucketsOfX[x] / size;
-            int my = state->sumBucketsOfY[x] / size;
-            int vx = state->sum2BucketsOfX[x] - ((mx * state->sumBucketsOfX[x]) + (mx * state->sumBucketsOfX[x])) + (size * mx * mx);
-            int vy = state->sum2BucketsOfY[x] - ((my * state->sumBucketsOfY[x]) + (my * state->sumBucketsOfY[x])) + (size * my * my);
-            int vxy = state->sum2Buckets[x] - ((mx * state->sumBucketsOfY[x]) + (my * state->sumBucketsOfX[x])) + (size * mx * my);
-
-            float ssim = ( ((2*mx*my) + c1) * ((2*vxy) + c2) ) / ( ((mx*mx) + (my*my) + c1) * (vx + vy + c2) );
-
-            state->similarity_sum += ssim;
-            state->similarity_sum_2 += ssim * ssim;
-            state->similarity_min = IM_MIN(state->similarity_min, ssim);
-            state->similarity_max = IM_MAX(state->similarity_max, ssim);
-
-            state->sumBucketsOfX[x] = 0;
-            state->sumBucketsOfY[x] = 0;
-            state->sum2BucketsOfX[x] = 0;
-            state->sum2BucketsOfY[x] = 0;
-            state->sum2Buckets[x] = 0;
-        }
+void imlib_similarity_line_op(image_t *img, int line, void *other, void *data, bool vflipped)
+{
+    imlib_similatiry_line_op_state_t *state = (imlib_similatiry_line_op_state_t *) data; vflipped = vflipped;
+    int block_size = state->block_size, step = state->step;
+    state->lines_processed += 1;
+
+    if (state->early_out) {
+        return;
     }
 
-    state->lines_processed += 1;
+    void *row_ptr = (img->bpp == IMAGE_BPP_BINARY) ? ((void *) IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, line))
+                  : (img->bpp == IMAGE_BPP_GRAYSCALE) ? ((void *) IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, line))
+                  : ((void *) IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, line));
+    uint8_t *pairs = state->rows + ((line % block_size) * img->w * 2);
+
+    // The slot of this row has the row block_size rows up, which leaves the windows.
+    if (line >= block_size) {
+        similarity_sums_row(state->sums, pairs, img->w, false);
+    }
+
+    for (int x = 0; x < img->w; x++) {
+        pairs[(x * 2) + 0] = similarity_pixel(img->bpp, row_ptr, x);
+        pairs[(x * 2) + 1] = similarity_pixel(img->bpp, other, x);
+    }
+
+    similarity_sums_row(state->sums, pairs, img->w, true);
+
+    int y = line - block_size + 1;
+
+    if ((y >= 0) && (!(y % step))) {
+        similarity_windows_row(state, img->w, block_size);
+    }
+
+    if ((!state->early_out) && (line == (img->h - 1))) {
+        // The last row of windows is clipped if the one before didn't reach the bottom.
+        for (y = 0; (y + block_size) < img->h; y += step);
+
+        if ((y + block_size) > img->h) {
+            for (int i = IM_MAX(img->h - block_size, 0); i < y; i++) {
+                similarity_sums_row(state->sums, state->rows + ((i % block_size) * img->w * 2), img->w, false);
+            }
+
+            similarity_windows_row(state, img->w, img->h - y);
+        }
+    }
 }
 
-void imlib_get_similarity(image_t *img, const char *path, image_t *other, int scalar, float *avg, float *std, float *min, float *max)
+void imlib_get_similarity(image_t *img, const char *path, image_t *other, int scalar, int block_size, int step,
+                          float threshold, float *avg, float *std, float *min, float *max)
 {
-    int h_blocks = (img->w + 7) / 8;
-    int v_blocks = (img->h + 7) / 8;
-    int blocks = h_blocks * v_blocks;
+    block_size = IM_MIN(block_size, IM_MAX(img->w, img->h));
+    step = IM_MIN(step, block_size);
 
-    int int_h_blocks = h_blocks * sizeof(int);
     imlib_similatiry_line_op_state_t state;
-    state.sumBucketsOfX = fb_alloc0(int_h_blocks, FB_ALLOC_NO_HINT);
-    state.sumBucketsOfY = fb_alloc0(int_h_blocks, FB_ALLOC_NO_HINT);
-    state.sum2BucketsOfX = fb_alloc0(int_h_blocks, FB_ALLOC_NO_HINT);
-    state.sum2BucketsOfY = fb_alloc0(int_h_blocks, FB_ALLOC_NO_HINT);
-    state.sum2Buckets = fb_alloc0(int_h_blocks, FB_ALLOC_NO_HINT);
-    state.similarity_sum = 0.0f;
-    state.similarity_sum_2 = 0.0f;
-    state.similarity_min = FLT_MAX;
-    state.similarity_max = FLT_MIN;
+    state.block_size = block_size;
+    state.step = step;
+    state.rows = fb_alloc(block_size * img->w * 2, FB_ALLOC_NO_HINT);
+    state.sums = fb_alloc0(img->w * sizeof(similarity_sums_t), FB_ALLOC_NO_HINT);
+    state.prefix = fb_alloc((img->w + 1) * sizeof(similarity_sums_t), FB_ALLOC_NO_HINT);
+    state.windows = similarity_windows(img->w, block_size, step) * similarity_windows(img->h, block_size, step);
+    state.windows_done = 0;
+    state.ssim_sum = 0;
+    state.ssim_sum_2 = 0;
+    state.threshold = ((int64_t) fast_roundf(threshold * SIMILARITY_ONE)) * state.windows;
+    state.ssim_min = INT32_MAX;
+    state.ssim_max = INT32_MIN;
+    state.early_out = false;
     state.lines_processed = 0;
 
     imlib_image_operation(img, path, other, scalar, imlib_similarity_line_op, &state);
-    *avg = state.similarity_sum / blocks;
-    *std = fast_sqrtf((state.similarity_sum_2 / blocks) - ((*avg) * (*avg)));
-    *min = state.similarity_min;
-    *max = state.similarity_max;
-
-    fb_free();
-    fb_free();
-    fb_free();
-    fb_free();
-    fb_free();
+
+    // After an early out the mean is the best one the image could still have had (< threshold).
+    float done_avg = state.ssim_sum / ((float) state.windows_done);
+    *avg = (state.ssim_sum + (((float) (state.windows - state.windows_done)) * SIMILARITY_ONE))
+         / (((float) state.windows) * SIMILARITY_ONE);
+    *std = fast_sqrtf(IM_MAX((state.ssim_sum_2 / ((float) state.windows_done)) - (done_avg * done_avg), 0.0f))
+         / SIMILARITY_ONE;
+    *min = state.ssim_min / ((float) SIMILARITY_ONE);
+    *max = state.ssim_max / ((float) SIMILARITY_ONE);
+
+    fb_free(); // prefix
+    fb_free(); // sums
+    fb_free(); // rows
 }
 #endif //IMLIB_ENABLE_GET_SIMILARITY
 
 void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_t *thresholds, bool invert, image_t *other)
 {
+    if (!other) {
+        imlib_get_histograms(out, ptr, roi, &thresholds, 1, invert);
+        return;
+    }
+
     switch(ptr->bpp) {
         case IMAGE_BPP_BINARY: {
             memset(out->LBins, 0, out->LBinCount * sizeof(uint32_t));
@@ -157,55 +231,27 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
 
             if ((!thresholds) || (!list_size(thresholds))) {
                 // Fast histogram code when no color thresholds list...
-                if (!other) {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++; // needs to be roundf
-                        }
-                    }
-                } else {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(other, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) ^ IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++; // needs to be roundf
-                        }
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(other, y);
+                    for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                        int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) ^ IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr, x);
+                        ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++; // needs to be roundf
                     }
                 }
             } else {
                 // Reset pixel count.
                 pixel_count = 0;
-                if (!other) {
-                    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-                        color_thresholds_list_lnk_data_t lnk_data;
-                        iterator_get(thresholds, it, &lnk_data);
+                for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
+                    color_thresholds_list_lnk_data_t lnk_data;
+                    iterator_get(thresholds, it, &lnk_data);
 
-                        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
-                                if (COLOR_THRESHOLD_BINARY(pixel, &lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++; // needs to be roundf
-                                    pixel_count++;
-                                }
-                            }
-                        }
-                    }
-                } else {
-                    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-                        color_thresholds_list_lnk_data_t lnk_data;
-                        iterator_get(thresholds, it, &lnk_data);
-
-                        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(other, y);
-                            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) ^ IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr, x);
-                                if (COLOR_THRESHOLD_BINARY(pixel, &lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++; // needs to be roundf
-                                    pixel_count++;
-                                }
+                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(other, y);
+                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                            int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) ^ IMAGE_GET_BINARY_PIXEL_FAST(other_row_ptr, x);
+                            if (COLOR_THRESHOLD_BINARY(pixel, &lnk_data, invert)) {
+                                ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_BINARY_MIN) * mult)]++; // needs to be roundf
+                                pixel_count++;
                             }
                         }
                     }
@@ -228,55 +274,27 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
 
             if ((!thresholds) || (!list_size(thresholds))) {
                 // Fast histogram code when no color thresholds list...
-                if (!other) {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++; // needs to be roundf
-                        }
-                    }
-                } else {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = abs(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x) - IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr, x));
-                            ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++; // needs to be roundf
-                        }
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y);
+                    for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                        int pixel = abs(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x) - IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr, x));
+                        ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++; // needs to be roundf
                     }
                 }
             } else {
                 // Reset pixel count.
                 pixel_count = 0;
-                if (!other) {
-                    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-                        color_thresholds_list_lnk_data_t lnk_data;
-                        iterator_get(thresholds, it, &lnk_data);
+                for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
+                    color_thresholds_list_lnk_data_t lnk_data;
+                    iterator_get(thresholds, it, &lnk_data);
 
-                        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                                int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                                if (COLOR_THRESHOLD_GRAYSCALE(pixel, &lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++; // needs to be roundf
-                                    pixel_count++;
-                                }
-                            }
-                        }
-                    }
-                } else {
-                    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-                        color_thresholds_list_lnk_data_t lnk_data;
-                        iterator_get(thresholds, it, &lnk_data);
-
-                        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y);
-                            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                                int pixel = abs(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x) - IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr, x));
-                                if (COLOR_THRESHOLD_GRAYSCALE(pixel, &lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++; // needs to be roundf
-                                    pixel_count++;
-                                }
+                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(other, y);
+                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                            int pixel = abs(IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x) - IMAGE_GET_GRAYSCALE_PIXEL_FAST(other_row_ptr, x));
+                            if (COLOR_THRESHOLD_GRAYSCALE(pixel, &lnk_data, invert)) {
+                                ((uint32_t *) out->LBins)[fast_roundf((pixel - COLOR_GRAYSCALE_MIN) * mult)]++; // needs to be roundf
+                                pixel_count++;
                             }
                         }
                     }
@@ -303,17 +321,26 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
 
             if ((!thresholds) || (!list_size(thresholds))) {
                 // Fast histogram code when no color thresholds list...
-                if (!other) {
-                    for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                        for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                            int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
-                            ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++; // needs to be roundf
-                            ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++; // needs to be roundf
-                            ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++; // needs to be roundf
-                        }
+                for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
+                    uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y);
+                    for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
+                        int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x), other_pixel = IMAGE_GET_RGB565_PIXEL_FAST(other_row_ptr, x);
+                        int r = abs(COLOR_RGB565_TO_R5(pixel) - COLOR_RGB565_TO_R5(other_pixel));
+                        int g = abs(COLOR_RGB565_TO_G6(pixel) - COLOR_RGB565_TO_G6(other_pixel));
+                        int b = abs(COLOR_RGB565_TO_B5(pixel) - COLOR_RGB565_TO_B5(other_pixel));
+                        pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+                        ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++; // needs to be roundf
+                        ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++; // needs to be roundf
+                        ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++; // needs to be roundf
                     }
-                } else {
+                }
+            } else {
+                // Reset pixel count.
+                pixel_count = 0;
+                for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
+                    color_thresholds_list_lnk_data_t lnk_data;
+                    iterator_get(thresholds, it, &lnk_data);
+
                     for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
                         uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y);
                         for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
@@ -322,52 +349,11 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
                             int g = abs(COLOR_RGB565_TO_G6(pixel) - COLOR_RGB565_TO_G6(other_pixel));
                             int b = abs(COLOR_RGB565_TO_B5(pixel) - COLOR_RGB565_TO_B5(other_pixel));
                             pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
-                            ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++; // needs to be roundf
-                            ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++; // needs to be roundf
-                            ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++; // needs to be roundf
-                        }
-                    }
-                }
-            } else {
-                // Reset pixel count.
-                pixel_count = 0;
-                if (!other) {
-                    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-                        color_thresholds_list_lnk_data_t lnk_data;
-                        iterator_get(thresholds, it, &lnk_data);
-
-                        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
-                                if (COLOR_THRESHOLD_RGB565(pixel, &lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++; // needs to be roundf
-                                    ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++; // needs to be roundf
-                                    ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++; // needs to be roundf
-                                    pixel_count++;
-                                }
-                            }
-                        }
-                    }
-                } else {
-                    for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
-                        color_thresholds_list_lnk_data_t lnk_data;
-                        iterator_get(thresholds, it, &lnk_data);
-
-                        for (int y = roi->y, yy = roi->y + roi->h; y < yy; y++) {
-                            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y), *other_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(other, y);
-                            for (int x = roi->x, xx = roi->x + roi->w; x < xx; x++) {
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x), other_pixel = IMAGE_GET_RGB565_PIXEL_FAST(other_row_ptr, x);
-                                int r = abs(COLOR_RGB565_TO_R5(pixel) - COLOR_RGB565_TO_R5(other_pixel));
-                                int g = abs(COLOR_RGB565_TO_G6(pixel) - COLOR_RGB565_TO_G6(other_pixel));
-                                int b = abs(COLOR_RGB565_TO_B5(pixel) - COLOR_RGB565_TO_B5(other_pixel));
-                                pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
-                                if (COLOR_THRESHOLD_RGB565(pixel, &lnk_data, invert)) {
-                                    ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++; // needs to be roundf
-                                    ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++; // needs to be roundf
-                                    ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++; // needs to be roundf
-                                    pixel_count++;
-                                }
+                            if (COLOR_THRESHOLD_RGB565(pixel, &lnk_data, invert)) {
+                                ((uint32_t *) out->LBins)[fast_roundf((COLOR_RGB565_TO_L(pixel) - COLOR_L_MIN) * l_mult)]++; // needs to be roundf
+                                ((uint32_t *) out->ABins)[fast_roundf((COLOR_RGB565_TO_A(pixel) - COLOR_A_MIN) * a_mult)]++; // needs to be roundf
+                                ((uint32_t *) out->BBins)[fast_roundf((COLOR_RGB565_TO_B(pixel) - COLOR_B_MIN) * b_mult)]++; // needs to be roundf
+                                pixel_count++;
                             }
                         }
                     }
@@ -396,6 +382,196 @@ void imlib_get_histogram(histogram_t *out, image_t *ptr, rectangle_t *roi, list_
     }
 }
 
+// Bin of each channel value, computed the same way as the per-pixel fast_roundf() above.
+static void histogram_bin_lut(uint16_t *lut, int bin_count, int min, int max)
+{
+    float mult = (bin_count - 1) / ((float) (max - min));
+
+    for (int i = 0, j = max - min; i <= j; i++) {
+        lut[i] = fast_roundf(i * mult); // needs to be roundf
+    }
+}
+
+static inline bool histogram_threshold(int l, int a, int b, color_thresholds_list_lnk_data_t *t, bool invert)
+{
+    return ((t->LMin <= l) && (l <= t->LMax) &&
+            (t->AMin <= a) && (a <= t->AMax) &&
+            (t->BMin <= b) && (b <= t->BMax)) ^ invert;
+}
+
+void imlib_get_histograms(histogram_t *out, image_t *ptr, rectangle_t *rois, list_t **thresholds, int n, bool invert)
+{
+    if ((ptr->bpp != IMAGE_BPP_BINARY) && (ptr->bpp != IMAGE_BPP_GRAYSCALE) && (ptr->bpp != IMAGE_BPP_RGB565)) {
+        return;
+    }
+
+    bool rgb = ptr->bpp == IMAGE_BPP_RGB565;
+    int l_min = rgb ? COLOR_L_MIN : ((ptr->bpp == IMAGE_BPP_BINARY) ? COLOR_BINARY_MIN : COLOR_GRAYSCALE_MIN);
+    int l_max = rgb ? COLOR_L_MAX : ((ptr->bpp == IMAGE_BPP_BINARY) ? COLOR_BINARY_MAX : COLOR_GRAYSCALE_MAX);
+    int l_size = l_max - l_min + 1, a_size = rgb ? (COLOR_A_MAX - COLOR_A_MIN + 1) : 0;
+    int b_size = rgb ? (COLOR_B_MAX - COLOR_B_MIN + 1) : 0, lut_size = l_size + a_size + b_size;
+
+    // Bins are counted as uint32_t in place in the float bins and normalized at the end.
+    uint16_t *luts = fb_alloc(n * lut_size * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    int *threshold_counts = fb_alloc(n * sizeof(int), FB_ALLOC_NO_HINT);
+    color_thresholds_list_lnk_data_t **threshold_arrays = fb_alloc(n * sizeof(color_thresholds_list_lnk_data_t *), FB_ALLOC_NO_HINT);
+    uint32_t *pixel_counts = fb_alloc0(n * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    int y_start = INT_MAX, y_end = 0, x_start = INT_MAX, x_end = 0;
+
+    for (int i = 0; i < n; i++) {
+        uint16_t *lut = luts + (i * lut_size);
+        histogram_bin_lut(lut, out[i].LBinCount, l_min, l_max);
+        memset(out[i].LBins, 0, out[i].LBinCount * sizeof(uint32_t));
+
+        if (rgb) {
+            histogram_bin_lut(lut + l_size, out[i].ABinCount, COLOR_A_MIN, COLOR_A_MAX);
+            histogram_bin_lut(lut + l_size + a_size, out[i].BBinCount, COLOR_B_MIN, COLOR_B_MAX);
+            memset(out[i].ABins, 0, out[i].ABinCount * sizeof(uint32_t));
+            memset(out[i].BBins, 0, out[i].BBinCount * sizeof(uint32_t));
+        }
+
+        list_t *list = thresholds ? thresholds[i] : NULL;
+        threshold_counts[i] = list ? list_size(list) : 0;
+        threshold_arrays[i] = NULL;
+
+        if (threshold_counts[i]) {
+            threshold_arrays[i] = fb_alloc(threshold_counts[i] * sizeof(color_thresholds_list_lnk_data_t), FB_ALLOC_NO_HINT);
+            int j = 0;
+
+            for (list_lnk_t *it = iterator_start_from_head(list); it; it = iterator_next(it)) {
+                iterator_get(list, it, threshold_arrays[i] + j++);
+            }
+        } else {
+            pixel_counts[i] = rois[i].w * rois[i].h;
+        }
+
+        y_start = IM_MIN(y_start, rois[i].y);
+        y_end = IM_MAX(y_end, rois[i].y + rois[i].h);
+        x_start = IM_MIN(x_start, rois[i].x);
+        x_end = IM_MAX(x_end, rois[i].x + rois[i].w);
+    }
+
+    // Each row is converted once (over the span of all the rois) and then binned for every roi
+    // containing it, binary and grayscale pixels only use the L row.
+    int span = IM_MAX(x_end - x_start, 0);
+    uint8_t *l_row = fb_alloc(span, FB_ALLOC_NO_HINT);
+    int8_t *a_row = rgb ? fb_alloc(span, FB_ALLOC_NO_HINT) : NULL;
+    int8_t *b_row = rgb ? fb_alloc(span, FB_ALLOC_NO_HINT) : NULL;
+
+    for (int y = y_start; y < y_end; y++) {
+        switch (ptr->bpp) {
+            case IMAGE_BPP_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
+                for (int x = 0; x < span; x++) {
+                    l_row[x] = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x_start + x);
+                }
+                break;
+            }
+            case IMAGE_BPP_GRAYSCALE: {
+                memcpy(l_row, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y) + x_start, span);
+                break;
+            }
+            default: {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
+                for (int x = 0; x < span; x++) {
+                    int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x_start + x);
+                    l_row[x] = COLOR_RGB565_TO_L(pixel);
+                    a_row[x] = COLOR_RGB565_TO_A(pixel);
+                    b_row[x] = COLOR_RGB565_TO_B(pixel);
+                }
+                break;
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            if ((y < rois[i].y) || ((rois[i].y + rois[i].h) <= y)) {
+                continue;
+            }
+
+            uint16_t *l_lut = luts + (i * lut_size) - l_min;
+            uint16_t *a_lut = luts + (i * lut_size) + l_size - COLOR_A_MIN;
+            uint16_t *b_lut = luts + (i * lut_size) + l_size + a_size - COLOR_B_MIN;
+            uint32_t *l_bins = (uint32_t *) out[i].LBins;
+            uint32_t *a_bins = (uint32_t *) out[i].ABins;
+            uint32_t *b_bins = (uint32_t *) out[i].BBins;
+            int x0 = rois[i].x - x_start, x1 = x0 + rois[i].w;
+
+            if (!threshold_counts[i]) {
+                if (rgb) {
+                    for (int x = x0; x < x1; x++) {
+                        l_bins[l_lut[l_row[x]]]++;
+                        a_bins[a_lut[a_row[x]]]++;
+                        b_bins[b_lut[b_row[x]]]++;
+                    }
+                } else {
+                    for (int x = x0; x < x1; x++) {
+                        l_bins[l_lut[l_row[x]]]++;
+                    }
+                }
+            } else {
+                // A pixel is counted once per threshold it matches, like imlib_get_histogram().
+                for (int t = 0; t < threshold_counts[i]; t++) {
+                    color_thresholds_list_lnk_data_t *threshold = threshold_arrays[i] + t;
+
+                    if (rgb) {
+                        for (int x = x0; x < x1; x++) {
+                            if (histogram_threshold(l_row[x], a_row[x], b_row[x], threshold, invert)) {
+                                l_bins[l_lut[l_row[x]]]++;
+                                a_bins[a_lut[a_row[x]]]++;
+                                b_bins[b_lut[b_row[x]]]++;
+                                pixel_counts[i]++;
+                            }
+                        }
+                    } else {
+                        for (int x = x0; x < x1; x++) {
+                            if (COLOR_THRESHOLD_GRAYSCALE(l_row[x], threshold, invert)) {
+                                l_bins[l_lut[l_row[x]]]++;
+                                pixel_counts[i]++;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        float pixels = IM_DIV(1, ((float) pixel_counts[i]));
+
+        for (int j = 0, jj = out[i].LBinCount; j < jj; j++) {
+            out[i].LBins[j] = ((uint32_t *) out[i].LBins)[j] * pixels;
+        }
+
+        if (rgb) {
+            for (int j = 0, jj = out[i].ABinCount; j < jj; j++) {
+                out[i].ABins[j] = ((uint32_t *) out[i].ABins)[j] * pixels;
+            }
+
+            for (int j = 0, jj = out[i].BBinCount; j < jj; j++) {
+                out[i].BBins[j] = ((uint32_t *) out[i].BBins)[j] * pixels;
+            }
+        }
+    }
+
+    if (rgb) {
+        fb_free(); // b_row
+        fb_free(); // a_row
+    }
+
+    fb_free(); // l_row
+
+    for (int i = n - 1; i >= 0; i--) {
+        if (threshold_counts[i]) {
+            fb_free(); // threshold_arrays[i]
+        }
+    }
+
+    fb_free(); // pixel_counts
+    fb_free(); // threshold_arrays
+    fb_free(); // threshold_counts
+    fb_free(); // luts
+}
+
 void imlib_get_percentile(percentile_t *out, image_bpp_t bpp, histogram_t *ptr, float percentile)
 {
     memset(out, 0, sizeof(percentile_t));
@@ -815,6 +991,29 @@ static int get_median_l(long long *array, long long array_sum, int array_len)
     return array_len - 1;
 }
 
+// The robust fit uses all pairs of points up to this many pairs and this many random pairs above it.
+#define REGRESSION_MAX_PAIRS 4096
+
+// Repeatable so the fit doesn't jitter between frames of the same scene.
+static uint32_t regression_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*state = x);
+}
+
+// Adds the delta between points i and j (in scan order) to the delta histograms.
+static inline void regression_add_pair(point_t *points, int i, int j, long long *x_delta_histogram,
+                                       long long *y_delta_histogram, int w, int h)
+{
+    point_t *p0 = &points[IM_MIN(i, j)];
+    point_t *p1 = &points[IM_MAX(i, j)];
+    x_delta_histogram[p0->x - p1->x + w]++; // Note we allocated 1 extra above so we can do ptr->w instead of (ptr->w-1).
+    y_delta_histogram[p0->y - p1->y + h]++; // Note we allocated 1 extra above so we can do ptr->h instead of (ptr->h-1).
+}
+
 bool imlib_get_regression(find_lines_list_lnk_data_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
                           list_t *thresholds, bool invert, unsigned int area_threshold, unsigned int pixels_threshold, bool robust)
 {
@@ -1071,15 +1270,25 @@ bool imlib_get_regression(find_lines_list_lnk_data_t *out, image_t *ptr, rectang
                 long long delta_sum = (points_count * (points_count - 1)) / 2;
 
                 if (delta_sum) {
-                    // The code below computes the average slope between all pairs of points.
-                    // This is a N^2 operation that can easily blow up if the image is not threshold carefully...
-
-                    for(int i = 0; i < points_count; i++) {
-                        point_t *p0 = &points[i];
-                        for(int j = i + 1; j < points_count; j++) {
-                            point_t *p1 = &points[j];
-                            x_delta_histogram[p0->x - p1->x + ptr->w]++; // Note we allocated 1 extra above so we can do ptr->w instead of (ptr->w-1).
-                            y_delta_histogram[p0->y - p1->y + ptr->h]++; // Note we allocated 1 extra above so we can do ptr->h instead of (ptr->h-1).
+                    // The code below computes the median slope between pairs of points. All pairs are used
+                    // for small point sets, else a fixed number of random pairs which bounds the N^2 cost.
+                    // The medians are then selected from the delta histograms in linear time.
+
+                    if (delta_sum <= REGRESSION_MAX_PAIRS) {
+                        for(int i = 0; i < points_count; i++) {
+                            for(int j = i + 1; j < points_count; j++) {
+                                regression_add_pair(points, i, j, x_delta_histogram, y_delta_histogram, ptr->w, ptr->h);
+                            }
+                        }
+                    } else {
+                        uint32_t state = 0x9E3779B9;
+                        delta_sum = REGRESSION_MAX_PAIRS;
+
+                        for(int k = 0; k < REGRESSION_MAX_PAIRS; k++) {
+                            int i = regression_rand(&state) % points_count;
+                            int j = regression_rand(&state) % (points_count - 1);
+                            // Skips i so the pair is always of two different points.
+                            regression_add_pair(points, i, j + (j >= i), x_delta_histogram, y_delta_histogram, ptr->w, ptr->h);
                         }
                     }
 
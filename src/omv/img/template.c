@@ -6,7 +6,7 @@
  *
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * Template matching with NCC (Normalized Cross Correlation) using exhaustive and diamond search.
+ * Template matching with NCC (Normalized Cross Correlation) using exhaustive, diamond and pyramid search.
  *
  * References:
  * Briechle, Kai, and Uwe D. Hanebeck. "Template matching using fast normalized cross correlation." Aerospace
@@ -18,6 +18,7 @@
 #include <limits.h>
 
 #include "imlib.h"
+#include "ff_wrapper.h"
 #include "xalloc.h"
 
 static void set_dsp(int cx, int cy, point_t *pts, bool sdsp, int step)
@@ -276,3 +277,435 @@ float imlib_template_match_ex(image_t *f, image_t *t, rectangle_t *roi, int step
     imlib_integral_image_free(&sumsq);
     return corr;
 }
+
+/* Same as imlib_template_match_ex() but the template is streamed from a file a band of lines
+ * at a time. The cross-correlation of every search position is accumulated band by band and
+ * the means are folded in at the end, so the template never has to fit in memory.
+ */
+float imlib_template_match_ex_file(image_t *f, const char *path, rectangle_t *roi, int step, rectangle_t *r)
+{
+    float corr=0.0f;
+
+    // Integral images
+    i_image_t sum;
+    i_image_t sumsq;
+
+    imlib_integral_image_alloc(&sum, f->w, f->h);
+    imlib_integral_image_alloc(&sumsq, f->w, f->h);
+
+    imlib_integral_image(f, &sum);
+    imlib_integral_image_sq(f, &sumsq);
+
+    FIL fp;
+    image_t t;
+    img_read_settings_t rs;
+    imlib_read_geometry(&fp, &t, path, &rs);
+    file_buffer_off(&fp);
+    file_close(&fp);
+    int t_w = t.w, t_h = t.h, t_n = t_w * t_h;
+
+    // Search positions, allocated before the band reader takes the rest of the frame buffer.
+    int u_count = ((roi->w - t_w) / step) + 1;
+    int v_count = ((roi->h - t_h) / step) + 1;
+    uint32_t *acc = fb_alloc0(u_count * v_count * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    // Sum of f*t for every position, plus the template sums for the means.
+    uint32_t t_sum = 0;
+    uint64_t t_sumsq = 0;
+
+    img_band_reader_t br;
+    imlib_band_reader_open(&br, path, 0);
+    for (int y, lines; (lines = imlib_band_reader_read(&br, &y)); ) {
+        for (int j=0; j<lines; j++) {
+            uint8_t *t_row = br.img.pixels + (j * t_w);
+
+            for (int x=0; x<t_w; x++) {
+                t_sum += t_row[x];
+                t_sumsq += t_row[x] * t_row[x];
+            }
+
+            for (int v=0; v<v_count; v++) {
+                uint8_t *f_row = f->data + (((roi->y + (v * step)) + (y + j)) * f->w) + roi->x;
+                uint32_t *acc_row = acc + (v * u_count);
+                for (int u=0; u<u_count; u++, f_row += step) {
+                    uint32_t num = 0;
+                    for (int x=0; x<t_w; x++) {
+                        num += f_row[x] * t_row[x];
+                    }
+                    acc_row[u] += num;
+                }
+            }
+        }
+    }
+    imlib_band_reader_close(&br);
+
+    // Normalized sum of squares of the template
+    int t_mean = t_sum / t_n;
+    int64_t den_b = t_sumsq - (2 * (int64_t) t_mean * t_sum) + ((int64_t) t_n * t_mean * t_mean);
+
+    for (int v=0; v<v_count; v++) {
+    for (int u=0; u<u_count; u++) {
+        int x = roi->x + (u * step);
+        int y = roi->y + (v * step);
+        // The mean of the current patch
+        uint32_t f_sum = imlib_integral_lookup(&sum, x, y, t_w, t_h);
+        uint32_t f_sumsq = imlib_integral_lookup(&sumsq, x, y, t_w, t_h);
+        uint32_t f_mean = f_sum / (float) t_n;
+
+        // sum((f - f_mean) * (t - t_mean)) expanded.
+        int64_t num = acc[(v * u_count) + u] - ((int64_t) t_mean * f_sum)
+                    - ((int64_t) f_mean * t_sum) + ((int64_t) t_n * f_mean * t_mean);
+
+        uint32_t den_a = f_sumsq - f_sum * (f_sum / (float) t_n);
+
+        // Find normalized cross-correlation
+        float c = num/(fast_sqrtf(den_a) * fast_sqrtf(den_b));
+
+        if (c > corr) {
+            corr = c;
+            r->x = x;
+            r->y = y;
+            r->w = t_w;
+            r->h = t_h;
+        }
+    }
+    }
+
+    fb_free(); // acc
+    imlib_integral_image_free(&sumsq);
+    imlib_integral_image_free(&sum);
+    return corr;
+}
+
+/* Coarse-to-fine search: every position is tried at the coarsest level of a mean pooled pyramid
+ * of the frame and of the template, and only the best few matches are refined level by level
+ * (a 4x4 neighbourhood per level). The per-window sums are computed in one pass with the SIMD
+ * instructions instead of with integral images, which cost more than the few windows tried
+ * at the finer levels.
+ */
+#define TEMPLATE_PYRAMID_MIN_SIZE   8 // Coarser levels don't have enough detail to match reliably.
+#define TEMPLATE_PYRAMID_CANDIDATES 4
+
+typedef struct template_pyramid_candidate {
+    int x, y;
+    float corr;
+} template_pyramid_candidate_t;
+
+static int template_pyramid_levels(image_t *t)
+{
+    int levels = 1;
+
+    while ((levels < TEMPLATE_PYRAMID_LEVELS)
+        && ((t->w >> levels) >= TEMPLATE_PYRAMID_MIN_SIZE)
+        && ((t->h >> levels) >= TEMPLATE_PYRAMID_MIN_SIZE)) {
+        levels++;
+    }
+
+    return levels;
+}
+
+size_t imlib_template_pyramid_size(image_t *t)
+{
+    size_t size = 0;
+
+    for (int i = 0, ii = template_pyramid_levels(t); i < ii; i++) {
+        size += (t->w >> i) * (t->h >> i);
+    }
+
+    return size;
+}
+
+void imlib_template_pyramid_init(template_pyramid_t *pyr, image_t *t, uint8_t *buf)
+{
+    pyr->levels_len = template_pyramid_levels(t);
+
+    for (int i = 0; i < pyr->levels_len; i++) {
+        image_t *level = &pyr->levels[i];
+        level->w = t->w >> i;
+        level->h = t->h >> i;
+        level->bpp = IMAGE_BPP_GRAYSCALE;
+        level->data = buf;
+        buf += level->w * level->h;
+
+        if (!i) {
+            memcpy(level->data, t->data, level->w * level->h);
+        } else {
+            imlib_decimate2(&pyr->levels[i - 1], level);
+        }
+
+        uint32_t sum = 0;
+        uint64_t sumsq = 0;
+
+        for (int j = 0, n = level->w * level->h; j < n; j++) {
+            sum += level->data[j];
+            sumsq += level->data[j] * level->data[j];
+        }
+
+        pyr->sum[i] = sum;
+        pyr->den[i] = (((int64_t) level->w * level->h) * sumsq) - ((int64_t) sum * sum);
+    }
+}
+
+static float template_pyramid_ncc(image_t *f, image_t *t, uint32_t t_sum, int64_t t_den, int u, int v)
+{
+    uint32_t f_sum = 0;
+    uint64_t f_sumsq = 0, ft_sum = 0;
+
+    for (int y = 0; y < t->h; y++) {
+        uint8_t *f_row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(f, v + y) + u;
+        uint8_t *t_row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(t, y);
+        // A row can't overflow 32-bits (65025 * width).
+        uint32_t row_sum = 0, row_sumsq = 0, row_ft = 0;
+        int x = 0;
+
+        for (; (x + 4) <= t->w; x += 4) {
+            uint32_t a = *((uint32_t *) (f_row + x)), b = *((uint32_t *) (t_row + x));
+            uint32_t a_even = __UXTB16(a), a_odd = __UXTB16(__ROR(a, 8));
+            uint32_t b_even = __UXTB16(b), b_odd = __UXTB16(__ROR(b, 8));
+            row_sum = __USADA8(a, 0, row_sum);
+            row_sumsq = __SMLAD(a_even, a_even, row_sumsq);
+            row_sumsq = __SMLAD(a_odd, a_odd, row_sumsq);
+            row_ft = __SMLAD(a_even, b_even, row_ft);
+            row_ft = __SMLAD(a_odd, b_odd, row_ft);
+        }
+
+        for (; x < t->w; x++) {
+            row_sum += f_row[x];
+            row_sumsq += f_row[x] * f_row[x];
+            row_ft += f_row[x] * t_row[x];
+        }
+
+        f_sum += row_sum;
+        f_sumsq += row_sumsq;
+        ft_sum += row_ft;
+    }
+
+    // Flat windows (and templates) don't correlate with anything.
+    int64_t n = t->w * t->h;
+    int64_t f_den = (n * f_sumsq) - ((int64_t) f_sum * f_sum);
+
+    if ((f_den <= 0) || (t_den <= 0)) {
+        return 0.0f;
+    }
+
+    // Both the numerator and the denominator are scaled by n.
+    int64_t num = (n * ft_sum) - ((int64_t) f_sum * t_sum);
+    return num / (fast_sqrtf(f_den) * fast_sqrtf(t_den));
+}
+
+// Keeps the best matches, a match next to a better one is the same match.
+static void template_pyramid_candidate(template_pyramid_candidate_t *list, int *len, int x, int y, float corr)
+{
+    int min = 0;
+
+    for (int i = 0; i < *len; i++) {
+        if ((abs(list[i].x - x) <= 1) && (abs(list[i].y - y) <= 1)) {
+            if (corr > list[i].corr) {
+                list[i].x = x;
+                list[i].y = y;
+                list[i].corr = corr;
+            }
+            return;
+        }
+
+        if (list[i].corr < list[min].corr) {
+            min = i;
+        }
+    }
+
+    if (*len < TEMPLATE_PYRAMID_CANDIDATES) {
+        min = (*len)++;
+    } else if (corr <= list[min].corr) {
+        return;
+    }
+
+    list[min].x = x;
+    list[min].y = y;
+    list[min].corr = corr;
+}
+
+float imlib_template_match_pyr(image_t *f, image_pyramid_t *f_pyr, template_pyramid_t *pyr, rectangle_t *roi,
+                              rectangle_t *r)
+{
+    // Use the coarsest level where the template still fits in the roi.
+    int levels = pyr->levels_len;
+
+    while ((levels > 1)
+       && (((((roi->x + roi->w) >> (levels - 1)) - (roi->x >> (levels - 1))) < pyr->levels[levels - 1].w)
+       || ((((roi->y + roi->h) >> (levels - 1)) - (roi->y >> (levels - 1))) < pyr->levels[levels - 1].h))) {
+        levels--;
+    }
+
+    // Level i of the frame is the frame mean pooled by 2^i (pixel x covers 2x and 2x+1 below),
+    // the levels of a shared pyramid with the same scale are used instead of computing them.
+    image_t f_levels[TEMPLATE_PYRAMID_LEVELS];
+    int f_pyr_levels = (f_pyr && (f_pyr->scale == 2.0f)) ? f_pyr->levels_len : 1;
+    int f_allocated = 0;
+    f_levels[0] = *f;
+
+    for (int i = 1; i < levels; i++) {
+        if (i < f_pyr_levels) {
+            f_levels[i] = f_pyr->levels[i];
+            continue;
+        }
+
+        f_levels[i].w = f_levels[i - 1].w / 2;
+        f_levels[i].h = f_levels[i - 1].h / 2;
+        f_levels[i].bpp = IMAGE_BPP_GRAYSCALE;
+        f_levels[i].data = fb_alloc(f_levels[i].w * f_levels[i].h, FB_ALLOC_PREFER_SPEED);
+        imlib_decimate2(&f_levels[i - 1], &f_levels[i]);
+        f_allocated++;
+    }
+
+    // Exhaustive search at the coarsest level.
+    template_pyramid_candidate_t list[TEMPLATE_PYRAMID_CANDIDATES];
+    int len = 0, l = levels - 1;
+
+    for (int v = roi->y >> l, vv = ((roi->y + roi->h) >> l) - pyr->levels[l].h; v <= vv; v++) {
+        for (int u = roi->x >> l, uu = ((roi->x + roi->w) >> l) - pyr->levels[l].w; u <= uu; u++) {
+            float corr = template_pyramid_ncc(&f_levels[l], &pyr->levels[l], pyr->sum[l], pyr->den[l], u, v);
+            template_pyramid_candidate(list, &len, u, v, corr);
+        }
+    }
+
+    // Refine the candidates down to the full resolution.
+    for (l = l - 1; l >= 0; l--) {
+        int u_min = roi->x >> l, u_max = ((roi->x + roi->w) >> l) - pyr->levels[l].w;
+        int v_min = roi->y >> l, v_max = ((roi->y + roi->h) >> l) - pyr->levels[l].h;
+
+        for (int i = 0; i < len; i++) {
+            int cx = list[i].x * 2, cy = list[i].y * 2;
+            list[i].corr = -FLT_MAX;
+
+            for (int v = IM_MAX(cy - 1, v_min), vv = IM_MIN(cy + 2, v_max); v <= vv; v++) {
+                for (int u = IM_MAX(cx - 1, u_min), uu = IM_MIN(cx + 2, u_max); u <= uu; u++) {
+                    float corr = template_pyramid_ncc(&f_levels[l], &pyr->levels[l], pyr->sum[l], pyr->den[l], u, v);
+
+                    if (corr > list[i].corr) {
+                        list[i].x = u;
+                        list[i].y = v;
+                        list[i].corr = corr;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < f_allocated; i++) {
+        fb_free(); // f_levels[i].data
+    }
+
+    float corr = 0.0f;
+
+    for (int i = 0; i < len; i++) {
+        if (list[i].corr > corr) {
+            corr = list[i].corr;
+            r->x = list[i].x;
+            r->y = list[i].y;
+            r->w = pyr->levels[0].w;
+            r->h = pyr->levels[0].h;
+        }
+    }
+
+    return corr;
+}
+
+#ifdef IMLIB_ENABLE_FIND_MOTION_VECTORS
+// SAD of the block at (x, y) of img and the block at (x + dx, y + dy) of prev, stops once it
+// reaches limit since the block can't be the best match anymore then.
+static uint32_t motion_block_sad(image_t *img, image_t *prev, int x, int y, int dx, int dy, int size, uint32_t limit)
+{
+    uint32_t sad = 0;
+
+    for (int j = 0; (j < size) && (sad < limit); j++) {
+        uint8_t *a = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j) + x;
+        uint8_t *b = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(prev, y + dy + j) + x + dx;
+        int i = 0;
+#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
+        for (; (i + 4) <= size; i += 4) {
+            sad = __USADA8(__UNALIGNED_UINT32_READ(a + i), __UNALIGNED_UINT32_READ(b + i), sad);
+        }
+#endif
+        for (; i < size; i++) {
+            sad += abs(a[i] - b[i]);
+        }
+    }
+
+    return sad;
+}
+
+// Moves the match to (dx, dy) if the block there is inside prev and the search range and has a
+// lower SAD.
+static bool motion_block_try(image_t *img, image_t *prev, int x, int y, int size, int range,
+                             int dx, int dy, motion_vector_t *v)
+{
+    if ((abs(dx) > range) || (abs(dy) > range)
+    || ((x + dx) < 0) || ((x + dx + size) > prev->w)
+    || ((y + dy) < 0) || ((y + dy + size) > prev->h)) {
+        return false;
+    }
+
+    uint32_t sad = motion_block_sad(img, prev, x, y, dx, dy, size, v->sad);
+
+    if (sad >= v->sad) {
+        return false;
+    }
+
+    v->dx = dx;
+    v->dy = dy;
+    v->sad = sad;
+    return true;
+}
+
+int imlib_find_motion_vectors(image_t *img, image_t *prev, rectangle_t *roi, int block_size, int range,
+                              int threshold, motion_vector_t *vectors)
+{
+    int cols = roi->w / block_size, len = 0;
+    uint32_t static_sad = threshold * block_size * block_size;
+    point_t pts[9];
+
+    // Vectors of the row of blocks above, used with the one on the left to start the search.
+    int8_t *above = fb_alloc0(IM_MAX(cols, 1) * 2 * sizeof(int8_t), FB_ALLOC_NO_HINT);
+
+    for (int y = roi->y, yy = roi->y + roi->h - block_size; y <= yy; y += block_size) {
+        int left_dx = 0, left_dy = 0;
+
+        for (int col = 0, x = roi->x; col < cols; col++, x += block_size) {
+            motion_vector_t v = { .x = x, .y = y, .dx = 0, .dy = 0,
+                                  .sad = motion_block_sad(img, prev, x, y, 0, 0, block_size, UINT32_MAX) };
+
+            // Blocks that didn't change aren't searched.
+            if (v.sad <= static_sad) {
+                above[col * 2] = above[(col * 2) + 1] = left_dx = left_dy = 0;
+                continue;
+            }
+
+            motion_block_try(img, prev, x, y, block_size, range, left_dx, left_dy, &v);
+            motion_block_try(img, prev, x, y, block_size, range, above[col * 2], above[(col * 2) + 1], &v);
+
+            // Large diamond steps until the center is the best match then one small diamond step.
+            for (bool moved = true; moved; ) {
+                moved = false;
+                set_dsp(v.dx, v.dy, pts, false, 2);
+
+                for (int i = 1; i < 9; i++) {
+                    moved |= motion_block_try(img, prev, x, y, block_size, range, pts[i].x, pts[i].y, &v);
+                }
+            }
+
+            set_dsp(v.dx, v.dy, pts, true, 2);
+
+            for (int i = 1; i < 5; i++) {
+                motion_block_try(img, prev, x, y, block_size, range, pts[i].x, pts[i].y, &v);
+            }
+
+            above[col * 2] = left_dx = v.dx;
+            above[(col * 2) + 1] = left_dy = v.dy;
+            vectors[len++] = v;
+        }
+    }
+
+    fb_free();
+    return len;
+}
+#endif // IMLIB_ENABLE_FIND_MOTION_VECTORS
@@ -0,0 +1,300 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Multi-object tracking of detections (blobs, tags, NN outputs...).
+ *
+ * Each track has a constant velocity Kalman filter per axis for its center (the size is smoothed),
+ * the predicted tracks are assigned the detections of the frame with the Hungarian method on the
+ * cost of each pair: 1 - IoU when the rects overlap enough, else 1 + distance / max_distance for
+ * centers close enough, else never. New tracks get an id once they were detected min_hits times
+ * and are dropped after max_misses frames without a detection.
+ */
+#include <float.h>
+#include "imlib.h"
+#include "xalloc.h"
+#include "fb_alloc.h"
+
+#ifdef IMLIB_ENABLE_OBJECT_TRACKER
+#define OBJECT_TRACKER_COST_MAX     (1000.0f)   // Pairs that can't be assigned.
+#define OBJECT_TRACKER_POS_NOISE    (1.0f)      // Process noise of the center (pixels^2 per frame).
+#define OBJECT_TRACKER_VEL_NOISE    (0.5f)      // Process noise of the velocity.
+#define OBJECT_TRACKER_MEAS_NOISE   (4.0f)      // Measurement noise of the detected center.
+#define OBJECT_TRACKER_VEL_INIT     (100.0f)    // Variance of the unknown velocity of new tracks.
+#define OBJECT_TRACKER_SIZE_ALPHA   (0.5f)      // Weight of the detected size.
+
+void imlib_object_tracker_alloc(object_tracker_t *tracker, size_t tracks_max, int min_hits, int max_misses,
+                                float iou_threshold, float max_distance)
+{
+    tracker->tracks = xalloc(tracks_max * sizeof(object_track_t));
+    tracker->tracks_max = tracks_max;
+    tracker->min_hits = min_hits;
+    tracker->max_misses = max_misses;
+    tracker->iou_threshold = iou_threshold;
+    tracker->max_distance = max_distance;
+    imlib_object_tracker_reset(tracker);
+}
+
+void imlib_object_tracker_free(object_tracker_t *tracker)
+{
+    xfree(tracker->tracks);
+}
+
+void imlib_object_tracker_reset(object_tracker_t *tracker)
+{
+    tracker->tracks_len = 0;
+    tracker->next_id = 1;
+}
+
+static void object_track_init(object_track_t *track, object_detection_t *detection)
+{
+    track->x = detection->rect.x + (detection->rect.w / 2.0f);
+    track->y = detection->rect.y + (detection->rect.h / 2.0f);
+    track->vx = track->vy = 0.0f;
+    track->w = detection->rect.w;
+    track->h = detection->rect.h;
+
+    for (int i = 0; i < 2; i++) {
+        track->p[i][0] = OBJECT_TRACKER_MEAS_NOISE;
+        track->p[i][1] = 0.0f;
+        track->p[i][2] = OBJECT_TRACKER_VEL_INIT;
+    }
+
+    track->code = detection->code;
+    track->id = 0;
+    track->hits = 1;
+    track->misses = 0;
+}
+
+// x' = x + v, P' = F * P * F^T + Q with F = [1 1; 0 1], p is P as (p00, p01, p11).
+static void object_track_predict_axis(float *x, float *v, float *p)
+{
+    *x += *v;
+    p[0] += (2.0f * p[1]) + p[2] + OBJECT_TRACKER_POS_NOISE;
+    p[1] += p[2];
+    p[2] += OBJECT_TRACKER_VEL_NOISE;
+}
+
+static void object_track_correct_axis(float *x, float *v, float *p, float z)
+{
+    float s = p[0] + OBJECT_TRACKER_MEAS_NOISE;
+    float k0 = p[0] / s, k1 = p[1] / s, y = z - *x;
+    *x += k0 * y;
+    *v += k1 * y;
+    p[2] -= k1 * p[1];
+    p[1] -= k0 * p[1];
+    p[0] -= k0 * p[0];
+}
+
+static void object_track_correct(object_track_t *track, object_detection_t *detection)
+{
+    object_track_correct_axis(&track->x, &track->vx, track->p[0], detection->rect.x + (detection->rect.w / 2.0f));
+    object_track_correct_axis(&track->y, &track->vy, track->p[1], detection->rect.y + (detection->rect.h / 2.0f));
+    track->w += OBJECT_TRACKER_SIZE_ALPHA * (detection->rect.w - track->w);
+    track->h += OBJECT_TRACKER_SIZE_ALPHA * (detection->rect.h - track->h);
+}
+
+static float object_tracker_cost(object_tracker_t *tracker, object_track_t *track, object_detection_t *detection)
+{
+    if (track->code != detection->code) {
+        return OBJECT_TRACKER_COST_MAX;
+    }
+
+    float x0 = track->x - (track->w / 2.0f), y0 = track->y - (track->h / 2.0f);
+    float x1 = detection->rect.x, y1 = detection->rect.y;
+    float iw = IM_MIN(x0 + track->w, x1 + detection->rect.w) - IM_MAX(x0, x1);
+    float ih = IM_MIN(y0 + track->h, y1 + detection->rect.h) - IM_MAX(y0, y1);
+
+    if ((iw > 0.0f) && (ih > 0.0f)) {
+        float i = iw * ih;
+        float iou = i / ((track->w * track->h) + (detection->rect.w * detection->rect.h) - i);
+
+        if (iou >= tracker->iou_threshold) {
+            return 1.0f - iou;
+        }
+    }
+
+    float dx = (x1 + (detection->rect.w / 2.0f)) - track->x;
+    float dy = (y1 + (detection->rect.h / 2.0f)) - track->y;
+    float d = fast_sqrtf((dx * dx) + (dy * dy));
+    return (d <= tracker->max_distance) ? (1.0f + (d / tracker->max_distance)) : OBJECT_TRACKER_COST_MAX;
+}
+
+// Hungarian method (Kuhn-Munkres with potentials) for the n x m cost matrix with n <= m, row i
+// is assigned the column assignment[i]. O(n^2 * m).
+static void object_tracker_assign(float *cost, int n, int m, int *assignment)
+{
+    float *u = fb_alloc0((n + 1) * sizeof(float), FB_ALLOC_NO_HINT);
+    float *v = fb_alloc0((m + 1) * sizeof(float), FB_ALLOC_NO_HINT);
+    float *minv = fb_alloc((m + 1) * sizeof(float), FB_ALLOC_NO_HINT);
+    int *p = fb_alloc0((m + 1) * sizeof(int), FB_ALLOC_NO_HINT); // Row (1 based) of each column.
+    int *way = fb_alloc0((m + 1) * sizeof(int), FB_ALLOC_NO_HINT);
+    bool *used = fb_alloc((m + 1) * sizeof(bool), FB_ALLOC_NO_HINT);
+
+    for (int i = 1; i <= n; i++) {
+        int j0 = 0;
+        p[0] = i;
+
+        for (int j = 0; j <= m; j++) {
+            minv[j] = FLT_MAX;
+            used[j] = false;
+        }
+
+        do {
+            int i0 = p[j0], j1 = 0;
+            float delta = FLT_MAX;
+            used[j0] = true;
+
+            for (int j = 1; j <= m; j++) {
+                if (!used[j]) {
+                    float cur = cost[((i0 - 1) * m) + (j - 1)] - u[i0] - v[j];
+
+                    if (cur < minv[j]) {
+                        minv[j] = cur;
+                        way[j] = j0;
+                    }
+
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+            }
+
+            for (int j = 0; j <= m; j++) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+
+            j0 = j1;
+        } while (p[j0]);
+
+        do {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0);
+    }
+
+    for (int j = 1; j <= m; j++) {
+        if (p[j]) {
+            assignment[p[j] - 1] = j - 1;
+        }
+    }
+
+    fb_free(); // used
+    fb_free(); // way
+    fb_free(); // p
+    fb_free(); // minv
+    fb_free(); // v
+    fb_free(); // u
+}
+
+void imlib_object_tracker_update(object_tracker_t *tracker, object_detection_t *detections, size_t len,
+                                 uint32_t *ids)
+{
+    size_t tracks_len = tracker->tracks_len;
+    // The assigned track of each detection, or -1.
+    int *track_of = fb_alloc(IM_MAX(len, 1) * sizeof(int), FB_ALLOC_NO_HINT);
+    bool *track_hit = fb_alloc0(IM_MAX(tracks_len, 1) * sizeof(bool), FB_ALLOC_NO_HINT);
+
+    for (size_t i = 0; i < len; i++) {
+        track_of[i] = -1;
+    }
+
+    for (size_t i = 0; i < tracks_len; i++) {
+        object_track_t *track = &tracker->tracks[i];
+        object_track_predict_axis(&track->x, &track->vx, track->p[0]);
+        object_track_predict_axis(&track->y, &track->vy, track->p[1]);
+    }
+
+    if (tracks_len && len) {
+        // The rows are the smaller of the tracks and the detections.
+        bool rows_are_tracks = tracks_len <= len;
+        int n = rows_are_tracks ? tracks_len : len, m = rows_are_tracks ? len : tracks_len;
+        float *cost = fb_alloc(n * m * sizeof(float), FB_ALLOC_NO_HINT);
+        int *assignment = fb_alloc(n * sizeof(int), FB_ALLOC_NO_HINT);
+
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < m; j++) {
+                int t = rows_are_tracks ? i : j, d = rows_are_tracks ? j : i;
+                cost[(i * m) + j] = object_tracker_cost(tracker, &tracker->tracks[t], &detections[d]);
+            }
+        }
+
+        object_tracker_assign(cost, n, m, assignment);
+
+        for (int i = 0; i < n; i++) {
+            int t = rows_are_tracks ? i : assignment[i], d = rows_are_tracks ? assignment[i] : i;
+
+            if (cost[(i * m) + assignment[i]] < OBJECT_TRACKER_COST_MAX) {
+                track_of[d] = t;
+                track_hit[t] = true;
+            }
+        }
+
+        fb_free(); // assignment
+        fb_free(); // cost
+    }
+
+    // Update the assigned tracks, age the others.
+    for (size_t i = 0; i < len; i++) {
+        if (track_of[i] >= 0) {
+            object_track_t *track = &tracker->tracks[track_of[i]];
+            object_track_correct(track, &detections[i]);
+            track->hits += (track->hits < UINT16_MAX);
+            track->misses = 0;
+
+            if ((!track->id) && (track->hits >= tracker->min_hits)) {
+                track->id = tracker->next_id++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < tracks_len; i++) {
+        if (!track_hit[i]) {
+            tracker->tracks[i].misses += 1;
+        }
+    }
+
+    // New tracks for the detections left, while there's room.
+    for (size_t i = 0; (i < len) && (tracker->tracks_len < tracker->tracks_max); i++) {
+        if (track_of[i] < 0) {
+            track_of[i] = tracker->tracks_len;
+            object_track_init(&tracker->tracks[tracker->tracks_len++], &detections[i]);
+
+            if (tracker->min_hits <= 1) {
+                tracker->tracks[track_of[i]].id = tracker->next_id++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        ids[i] = (track_of[i] >= 0) ? tracker->tracks[track_of[i]].id : 0;
+    }
+
+    // Drop the lost tracks (unconfirmed ones on their first miss), the order is kept.
+    size_t kept = 0;
+
+    for (size_t i = 0; i < tracker->tracks_len; i++) {
+        object_track_t *track = &tracker->tracks[i];
+
+        if ((track->misses <= tracker->max_misses) && (track->id || (!track->misses))) {
+            tracker->tracks[kept++] = *track;
+        }
+    }
+
+    tracker->tracks_len = kept;
+
+    fb_free(); // track_hit
+    fb_free(); // track_of
+}
+#endif // IMLIB_ENABLE_OBJECT_TRACKER
@@ -201,6 +201,8 @@ typedef enum zbar_config_e {
 
     ZBAR_CFG_X_DENSITY = 0x100, /**< image scanner vertical scan density */
     ZBAR_CFG_Y_DENSITY,         /**< image scanner horizontal scan density */
+    ZBAR_CFG_REFINE,            /**< lines rescanned around lines with symbols */
+    ZBAR_CFG_FIRST_ONLY,        /**< stop scanning after the first symbol */
 } zbar_config_t;
 
 /** decoder symbology modifier flags.
@@ -982,6 +984,10 @@ int zbar_parse_config (const char *cfgstr,
         *cfg = ZBAR_CFG_UNCERTAINTY;
     else if(!strncmp(cfgstr, "position", len))
         *cfg = ZBAR_CFG_POSITION;
+    else if(!strncmp(cfgstr, "refine", len))
+        *cfg = ZBAR_CFG_REFINE;
+    else if(!strncmp(cfgstr, "first-only", len))
+        *cfg = ZBAR_CFG_FIRST_ONLY;
     else
         return(1);
 
@@ -1279,6 +1285,8 @@ const char *zbar_get_config_name (zbar_config_t cfg)
     case ZBAR_CFG_POSITION: return("POSITION");
     case ZBAR_CFG_X_DENSITY: return("X_DENSITY");
     case ZBAR_CFG_Y_DENSITY: return("Y_DENSITY");
+    case ZBAR_CFG_REFINE: return("REFINE");
+    case ZBAR_CFG_FIRST_ONLY: return("FIRST_ONLY");
     default: return("");
     }
 }
@@ -1551,7 +1559,7 @@ extern void _zbar_image_scanner_recycle_syms(zbar_image_scanner_t*,
  */
 #define CACHE_TIMEOUT     (CACHE_HYSTERESIS * 2) /* ms */
 
-#define NUM_SCN_CFGS (ZBAR_CFG_Y_DENSITY - ZBAR_CFG_X_DENSITY + 1)
+#define NUM_SCN_CFGS (ZBAR_CFG_FIRST_ONLY - ZBAR_CFG_X_DENSITY + 1)
 
 #define CFG(iscn, cfg) ((iscn)->configs[(cfg) - ZBAR_CFG_X_DENSITY])
 #define TEST_CFG(iscn, cfg) (((iscn)->config >> ((cfg) - ZBAR_CFG_POSITION)) & 1)
@@ -1585,6 +1593,9 @@ struct zbar_image_scanner_s {
     unsigned long time;         /* scan start time */
     zbar_image_t *img;          /* currently scanning image *root* */
     int dx, dy, du, umin, v;    /* current scan direction */
+    int hits;                   /* symbols (or partials) seen this image */
+    int filter;                 /* EAN results need quality >= 4 */
+    int done;                   /* first symbol found (FIRST_ONLY) */
     zbar_symbol_set_t *syms;    /* previous decode results */
     /* recycled symbols in 4^n size buckets */
     recycle_bucket_t recycle[RECYCLE_BUCKETS];
@@ -1877,6 +1888,21 @@ static inline void qr_handler (zbar_image_scanner_t *iscn)
 }
 #endif
 
+/* whether sym survives the EAN/CODABAR quality filter at the end of
+ * zbar_scan_image() as it is now
+ */
+static inline int sym_reported (zbar_image_scanner_t *iscn,
+                                const zbar_symbol_t *sym)
+{
+    if((sym->type < ZBAR_COMPOSITE && sym->type > ZBAR_PARTIAL) ||
+       sym->type == ZBAR_DATABAR ||
+       sym->type == ZBAR_DATABAR_EXP ||
+       sym->type == ZBAR_CODABAR)
+        return(!(sym->type == ZBAR_CODABAR || iscn->filter) ||
+               sym->quality >= 4);
+    return(1);
+}
+
 static void symbol_handler (zbar_decoder_t *dcode)
 {
     zbar_image_scanner_t *iscn = zbar_decoder_get_userdata(dcode);
@@ -1909,6 +1935,8 @@ static void symbol_handler (zbar_decoder_t *dcode)
         }
     }
 
+    iscn->hits++;
+
     /* FIXME debug flag to save/display all PARTIALs */
     if(type <= ZBAR_PARTIAL) {
         zprintf(256, "partial symbol @(%d,%d)\n", x, y);
@@ -1930,6 +1958,8 @@ static void symbol_handler (zbar_decoder_t *dcode)
                 /* add new point to existing set */
                 /* FIXME should be polygon */
                 sym_add_point(sym, x, y);
+            if(CFG(iscn, ZBAR_CFG_FIRST_ONLY) && sym_reported(iscn, sym))
+                iscn->done = 1;
             return;
         }
 
@@ -1951,6 +1981,9 @@ static void symbol_handler (zbar_decoder_t *dcode)
         sym->orient = (iscn->dy != 0) + ((iscn->du ^ dir) & 2);
 
     _zbar_image_scanner_add_sym(iscn, sym);
+
+    if(CFG(iscn, ZBAR_CFG_FIRST_ONLY) && sym_reported(iscn, sym))
+        iscn->done = 1;
 }
 
 zbar_image_scanner_t *zbar_image_scanner_create ()
@@ -2077,7 +2110,7 @@ int zbar_image_scanner_set_config (zbar_image_scanner_t *iscn,
     if(sym > ZBAR_PARTIAL)
         return(1);
 
-    if(cfg >= ZBAR_CFG_X_DENSITY && cfg <= ZBAR_CFG_Y_DENSITY) {
+    if(cfg >= ZBAR_CFG_X_DENSITY && cfg <= ZBAR_CFG_FIRST_ONLY) {
         CFG(iscn, cfg) = val;
         return(0);
     }
@@ -2122,17 +2155,69 @@ static inline void quiet_border (zbar_image_scanner_t *iscn)
     zbar_scanner_new_scan(scn);
 }
 
-#define movedelta(dx, dy) do {                  \
-        x += (dx);                              \
-        y += (dy);                              \
-        p += (dx) + ((uintptr_t)(dy) * w);       \
-    } while(0);
+/* scan row y of the image left to right (dir > 0) or right to left */
+static void scan_row (zbar_image_scanner_t *iscn,
+                      int y,
+                      int dir)
+{
+    const zbar_image_t *img = iscn->img;
+    int cx0 = img->crop_x, cx1 = img->crop_x + img->crop_w;
+    const uint8_t *p = (const uint8_t*)img->data + (y * img->width);
+    int x;
+
+    zprintf(128, "img_x%c: %04d @%p\n", (dir > 0) ? '+' : '-', y, p);
+    svg_path_start("vedge", dir / 32., (dir > 0) ? 0 : img->width, y + 0.5);
+    iscn->dy = 0;
+    iscn->dx = iscn->du = dir;
+    iscn->v = y;
+    if(dir > 0) {
+        iscn->umin = cx0;
+        for(x = cx0; x < cx1; x++)
+            zbar_scan_y(iscn->scn, p[x]);
+    }
+    else {
+        iscn->umin = cx1;
+        for(x = cx1 - 1; x >= cx0; x--)
+            zbar_scan_y(iscn->scn, p[x]);
+    }
+    quiet_border(iscn);
+    svg_path_end();
+}
+
+/* scan column x of the image top to bottom (dir > 0) or bottom to top */
+static void scan_column (zbar_image_scanner_t *iscn,
+                         int x,
+                         int dir)
+{
+    const zbar_image_t *img = iscn->img;
+    int cy0 = img->crop_y, cy1 = img->crop_y + img->crop_h;
+    unsigned w = img->width;
+    const uint8_t *p = (const uint8_t*)img->data + x;
+    int y;
+
+    zprintf(128, "img_y%c: %04d @%p\n", (dir > 0) ? '+' : '-', x, p);
+    svg_path_start("vedge", dir / 32., (dir > 0) ? 0 : img->height, x + 0.5);
+    iscn->dx = 0;
+    iscn->dy = iscn->du = dir;
+    iscn->v = x;
+    if(dir > 0) {
+        iscn->umin = cy0;
+        for(y = cy0; y < cy1; y++)
+            zbar_scan_y(iscn->scn, p[y * w]);
+    }
+    else {
+        iscn->umin = cy1;
+        for(y = cy1 - 1; y >= cy0; y--)
+            zbar_scan_y(iscn->scn, p[y * w]);
+    }
+    quiet_border(iscn);
+    svg_path_end();
+}
 
 int zbar_scan_image (zbar_image_scanner_t *iscn,
                      zbar_image_t *img)
 {
     zbar_symbol_set_t *syms;
-    const uint8_t *data;
     zbar_scanner_t *scn = iscn->scn;
     unsigned w, h, cx1, cy1;
     int density;
@@ -2170,7 +2255,6 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
     assert(cx1 <= w);
     cy1 = img->crop_y + img->crop_h;
     assert(cy1 <= h);
-    data = img->data;
 
     zbar_image_write_png(img, "debug.png");
     svg_open("debug.svg", 0, 0, w, h);
@@ -2178,10 +2262,18 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
 
     zbar_scanner_new_scan(scn);
 
+    iscn->hits = 0;
+    iscn->done = 0;
+    iscn->filter = (!iscn->enable_cache &&
+                    (CFG(iscn, ZBAR_CFG_X_DENSITY) == 1 ||
+                     CFG(iscn, ZBAR_CFG_Y_DENSITY) == 1));
+
     density = CFG(iscn, ZBAR_CFG_Y_DENSITY);
     if(density > 0) {
-        const uint8_t *p = data;
-        int x = 0, y = 0;
+        int y, dir = 1, last_hit = 0;
+        int refine = CFG(iscn, ZBAR_CFG_REFINE);
+        if(refine > density - 1)
+            refine = density - 1;
 
         int border = (((img->crop_h - 1) % density) + 1) / 2;
         if(border > img->crop_h / 2)
@@ -2189,55 +2281,49 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
         border += img->crop_y;
         assert(border <= h);
         svg_group_start("scanner", 0, 1, 1, 0, 0);
-        iscn->dy = 0;
-
-        movedelta(img->crop_x, border);
-        iscn->v = y;
-
-        while(y < cy1) {
-            int cx0 = img->crop_x;;
-            zprintf(128, "img_x+: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", 1. / 32, 0, y + 0.5);
-            iscn->dx = iscn->du = 1;
-            iscn->umin = cx0;
-            while(x < cx1) {
-                uint8_t d = *p;
-                movedelta(1, 0);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
-
-            movedelta(-1, density);
-            iscn->v = y;
-            if(y >= cy1)
-                break;
-
-            zprintf(128, "img_x-: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", -1. / 32, w, y + 0.5);
-            iscn->dx = iscn->du = -1;
-            iscn->umin = cx1;
-            while(x >= cx0) {
-                uint8_t d = *p;
-                movedelta(-1, 0);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
 
-            movedelta(1, density);
-            iscn->v = y;
+        for(y = border; y < cy1 && !iscn->done; y += density) {
+            int hits = iscn->hits;
+            scan_row(iscn, y, dir);
+            dir = -dir;
+
+            /* the first line through a symbol may only decode (as a
+             * partial) in one direction
+             */
+            if(refine > 0 && iscn->hits == hits)
+                scan_row(iscn, y, dir);
+
+            /* a symbol (or part of one) was seen on this line: the
+             * skipped lines around it are scanned too, so barcodes
+             * found by a sparse scan get the same number of lines
+             * (quality) as with a full scan
+             */
+            if(refine > 0 && iscn->hits != hits) {
+                int y0 = (last_hit) ? (y + 1) : (y - refine);
+                int y1 = y + refine;
+                if(y0 < (int)img->crop_y)
+                    y0 = img->crop_y;
+                if(y0 == y)
+                    y0++;
+                for(; y0 <= y1 && y0 < cy1 && !iscn->done; y0++) {
+                    scan_row(iscn, y0, dir);
+                    dir = -dir;
+                }
+                last_hit = 1;
+            }
+            else
+                last_hit = 0;
         }
         svg_group_end();
     }
     iscn->dx = 0;
 
     density = CFG(iscn, ZBAR_CFG_X_DENSITY);
-    if(density > 0) {
-        const uint8_t *p = data;
-        int x = 0, y = 0;
+    if(density > 0 && !iscn->done) {
+        int x, dir = 1, last_hit = 0;
+        int refine = CFG(iscn, ZBAR_CFG_REFINE);
+        if(refine > density - 1)
+            refine = density - 1;
 
         int border = (((img->crop_w - 1) % density) + 1) / 2;
         if(border > img->crop_w / 2)
@@ -2245,44 +2331,30 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
         border += img->crop_x;
         assert(border <= w);
         svg_group_start("scanner", 90, 1, -1, 0, 0);
-        movedelta(border, img->crop_y);
-        iscn->v = x;
-
-        while(x < cx1) {
-            int cy0 = img->crop_y;
-            zprintf(128, "img_y+: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", 1. / 32, 0, x + 0.5);
-            iscn->dy = iscn->du = 1;
-            iscn->umin = cy0;
-            while(y < cy1) {
-                uint8_t d = *p;
-                movedelta(0, 1);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
-
-            movedelta(density, -1);
-            iscn->v = x;
-            if(x >= cx1)
-                break;
-
-            zprintf(128, "img_y-: %04d,%04d @%p\n", x, y, p);
-            svg_path_start("vedge", -1. / 32, h, x + 0.5);
-            iscn->dy = iscn->du = -1;
-            iscn->umin = cy1;
-            while(y >= cy0) {
-                uint8_t d = *p;
-                movedelta(0, -1);
-                zbar_scan_y(scn, d);
-            }
-            ASSERT_POS;
-            quiet_border(iscn);
-            svg_path_end();
 
-            movedelta(density, 1);
-            iscn->v = x;
+        for(x = border; x < cx1 && !iscn->done; x += density) {
+            int hits = iscn->hits;
+            scan_column(iscn, x, dir);
+            dir = -dir;
+
+            if(refine > 0 && iscn->hits == hits)
+                scan_column(iscn, x, dir);
+
+            if(refine > 0 && iscn->hits != hits) {
+                int x0 = (last_hit) ? (x + 1) : (x - refine);
+                int x1 = x + refine;
+                if(x0 < (int)img->crop_x)
+                    x0 = img->crop_x;
+                if(x0 == x)
+                    x0++;
+                for(; x0 <= x1 && x0 < cx1 && !iscn->done; x0++) {
+                    scan_column(iscn, x0, dir);
+                    dir = -dir;
+                }
+                last_hit = 1;
+            }
+            else
+                last_hit = 0;
         }
         svg_group_end();
     }
@@ -2295,8 +2367,7 @@ int zbar_scan_image (zbar_image_scanner_t *iscn,
 
     /* FIXME tmp hack to filter bad EAN results */
     /* FIXME tmp hack to merge simple case EAN add-ons */
-    char filter = (!iscn->enable_cache &&
-                   (density == 1 || CFG(iscn, ZBAR_CFG_Y_DENSITY) == 1));
+    char filter = iscn->filter;
     int nean = 0, naddon = 0;
     if(syms->nsyms) {
         zbar_symbol_t **symp;
@@ -8711,12 +8782,17 @@ void zbar_scanner_get_state (const zbar_scanner_t *scn,
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi)
+void imlib_find_barcodes(list_t *out, image_t *ptr, rectangle_t *roi, int x_stride, int y_stride, bool first_only)
 {
     uint8_t *grayscale_image = (ptr->bpp == IMAGE_BPP_GRAYSCALE) ? ptr->data : fb_alloc(roi->w * roi->h, FB_ALLOC_NO_HINT);
     umm_init_x(fb_avail());
     zbar_image_scanner_t *scanner = zbar_image_scanner_create();
     zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_ENABLE, 1);
+    // Columns (x_stride) and rows (y_stride) between scan lines, 0 disables that direction.
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_X_DENSITY, x_stride);
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_Y_DENSITY, y_stride);
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_REFINE, IM_MAX(x_stride, y_stride));
+    zbar_image_scanner_set_config(scanner, 0, ZBAR_CFG_FIRST_ONLY, first_only);
 
     zbar_image_t image;
     image.format = *((int *) "Y800");
@@ -8,6 +8,7 @@
  *
  * Lepton driver.
  */
+#include <limits.h>
 #include STM32_HAL_H
 #include "mp.h"
 #include "irq.h"
@@ -39,6 +40,7 @@
 #define VOSPI_HEADER_CRC(buf)   (((buf[2] << 8) | (buf[3] << 0)))
 #define VOSPI_FIRST_PACKET      (0)
 #define VOSPI_FIRST_SEGMENT     (1)
+#define VOSPI_BUFFERS           (3)
 #define LEPTON_TIMEOUT          (1000)
 #define DEFAULT_MIN_TEMP        (-17.7778f)
 #define DEFAULT_MAX_TEMP        (37.7778f)
@@ -52,18 +54,36 @@ static bool measurement_mode = false;
 static float min_temp = DEFAULT_MIN_TEMP;
 static float max_temp = DEFAULT_MAX_TEMP;
 
+// Temperature stats of the last frame read in measurement mode.
+static bool stats_valid = false;
+static float stats_min = 0.0f;
+static float stats_max = 0.0f;
+static int stats_x = 0;
+static int stats_y = 0;
+
 static SPI_HandleTypeDef SPIHandle;
 static DMA_HandleTypeDef DMAHandle;
 LEP_CAMERA_PORT_DESC_T   LEPHandle;
 extern uint8_t _line_buf;
 extern uint8_t _vospi_buf;
+extern uint8_t _vospi_buf_end;
 
-static bool vospi_resync = true;
+static volatile bool vospi_resync = true;
 static uint8_t *vospi_packet = &_line_buf;
 static uint8_t *vospi_buffer = &_vospi_buf;
 static volatile uint32_t vospi_pid = 0;
 static volatile uint32_t vospi_seg = 1;
 static uint32_t vospi_packets = 60;
+
+// Complete frames are queued in the VoSPI memory (as many as fit, up to VOSPI_BUFFERS).
+static uint32_t vospi_frame_size = 60 * VOSPI_LINE_SIZE;
+static int vospi_frames = 1;
+static volatile int vospi_fill = -1;      // Frame being received.
+static volatile int vospi_ready = -1;     // Latest complete frame.
+static volatile int vospi_locked = -1;    // Frame being read by snapshot().
+static uint32_t vospi_frame_count = 0;
+static volatile uint32_t vospi_frame_seq[VOSPI_BUFFERS];
+static uint32_t vospi_last_seq = 0;       // Last frame returned by snapshot().
 static int lepton_reset(sensor_t *sensor, bool measurement_mode);
 
 void LEPTON_SPI_IRQHandler(void)
@@ -78,22 +98,41 @@ void LEPTON_SPI_DMA_IRQHandler(void)
 
 static void lepton_sync()
 {
+    // The DMA is stopped so the ISR can't run until it's restarted.
     HAL_SPI_Abort(&SPIHandle);
 
-    // Disable DMA IRQ
-    HAL_NVIC_DisableIRQ(LEPTON_SPI_DMA_IRQn);
-
     debug_printf("resync...\n");
     systick_sleep(200);
 
-    vospi_resync = false;
+    vospi_fill = -1;
     vospi_pid = VOSPI_FIRST_PACKET;
     vospi_seg = VOSPI_FIRST_SEGMENT;
+    vospi_resync = false;
 
-    HAL_NVIC_EnableIRQ(LEPTON_SPI_DMA_IRQn);
     HAL_SPI_Receive_DMA(&SPIHandle, vospi_packet, VOSPI_PACKET_SIZE);
 }
 
+// Returns a frame buffer that isn't the latest frame or locked, if there's no such buffer
+// the latest frame is reused when it isn't locked. Returns -1 if no buffer is available.
+static int lepton_next_buffer()
+{
+    int ready = vospi_ready;
+    int locked = vospi_locked;
+
+    for (int i = 0; i < vospi_frames; i++) {
+        if ((i != ready) && (i != locked)) {
+            return i;
+        }
+    }
+
+    if ((ready >= 0) && (ready != locked)) {
+        vospi_ready = -1;
+        return ready;
+    }
+
+    return -1;
+}
+
 static uint16_t lepton_calc_crc(uint8_t *buf)
 {
     buf[0] &= 0x0F;
@@ -316,6 +355,21 @@ static int ioctl(sensor_t *sensor, int request, va_list ap)
             *ptr_max_temp = max_temp;
             break;
         }
+        case IOCTL_LEPTON_GET_MEASUREMENT_STATS: {
+            float *ptr_min = va_arg(ap, float *);
+            float *ptr_max = va_arg(ap, float *);
+            int *ptr_x = va_arg(ap, int *);
+            int *ptr_y = va_arg(ap, int *);
+            if (!stats_valid) {
+                ret = -1;
+                break;
+            }
+            *ptr_min = stats_min;
+            *ptr_max = stats_max;
+            *ptr_x = stats_x;
+            *ptr_y = stats_y;
+            break;
+        }
         default: {
             ret = -1;
             break;
@@ -396,14 +450,25 @@ static int lepton_reset(sensor_t *sensor, bool measurement_mode)
     v_res = roi.endRow + 1;
     radiometry = (rad == LEP_RAD_ENABLE);
 
+    // resync and enable DMA before the first snapshot.
+    vospi_resync = true;
+
     if (v_res > 60) {
         vospi_packets = 240;
     } else {
         vospi_packets = 60;
     }
 
-    // resync and enable DMA before the first snapshot.
-    vospi_resync = true;
+    vospi_frame_size = vospi_packets * VOSPI_LINE_SIZE;
+    vospi_frames = IM_MIN((int) ((&_vospi_buf_end - &_vospi_buf) / vospi_frame_size), VOSPI_BUFFERS);
+    vospi_fill = -1;
+    vospi_ready = -1;
+    vospi_locked = -1;
+
+    if (vospi_frames < 1) {
+        return -1;
+    }
+
     return 0;
 }
 
@@ -417,6 +482,7 @@ static int reset(sensor_t *sensor)
     measurement_mode = false;
     min_temp = DEFAULT_MIN_TEMP;
     max_temp = DEFAULT_MAX_TEMP;
+    stats_valid = false;
     return lepton_reset(sensor, false);
 }
 
@@ -428,33 +494,51 @@ void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
         return; // nothing to do here
     }
 
-    if (vospi_pid < vospi_packets && (vospi_packet[0] & 0xF) != 0xF) {
-        uint32_t pid = VOSPI_HEADER_PID(vospi_packet);
-        uint32_t seg = VOSPI_HEADER_SEG(vospi_packet);
-        if (pid != (vospi_pid % VOSPI_NUMBER_PACKETS)) {
-            if (vospi_pid == VOSPI_FIRST_PACKET) {
-                // Wait for the first packet of the first segement.
-                vospi_pid = VOSPI_FIRST_PACKET;
-                vospi_seg = VOSPI_FIRST_SEGMENT;
-            } else { // lost sync
-                vospi_resync = true;
-                debug_printf("lost sync, packet id:%lu expected id:%lu \n", pid, vospi_pid);
-            }
-        } else if (vospi_packets > 60 && pid == VOSPI_SPECIAL_PACKET && seg != vospi_seg ) {
-            if (vospi_seg == VOSPI_FIRST_SEGMENT) {
-                // Wait for the first packet of the first segement.
-                vospi_pid = VOSPI_FIRST_PACKET;
-                vospi_seg = VOSPI_FIRST_SEGMENT;
-            } else { // lost sync
-                vospi_resync = true;
-                debug_printf("lost sync, segment id:%lu expected id:%lu\n", seg, vospi_seg);
-            }
-        } else {
-            memcpy(vospi_buffer + vospi_pid * VOSPI_LINE_SIZE,
-                    vospi_packet + VOSPI_HEADER_SIZE, VOSPI_LINE_SIZE);
-            if ((++vospi_pid % VOSPI_NUMBER_PACKETS) == 0) {
-                vospi_seg++;
-            }
+    if ((vospi_packet[0] & 0xF) == 0xF) {
+        return; // discard packet
+    }
+
+    uint32_t pid = VOSPI_HEADER_PID(vospi_packet);
+    uint32_t seg = VOSPI_HEADER_SEG(vospi_packet);
+
+    if (vospi_fill < 0) {
+        // Wait for the first packet of the first segement.
+        if (pid != VOSPI_FIRST_PACKET) {
+            return;
+        }
+
+        int fill = lepton_next_buffer();
+
+        if (fill < 0) {
+            return; // snapshot() is still reading the only buffer.
+        }
+
+        vospi_fill = fill;
+        vospi_pid = VOSPI_FIRST_PACKET;
+        vospi_seg = VOSPI_FIRST_SEGMENT;
+    }
+
+    if (pid != (vospi_pid % VOSPI_NUMBER_PACKETS)) {
+        // lost sync
+        vospi_fill = -1;
+        vospi_resync = true;
+        debug_printf("lost sync, packet id:%lu expected id:%lu \n", pid, vospi_pid);
+    } else if (vospi_packets > 60 && pid == VOSPI_SPECIAL_PACKET && seg != vospi_seg ) {
+        vospi_fill = -1;
+        if (vospi_seg != VOSPI_FIRST_SEGMENT) { // lost sync
+            vospi_resync = true;
+            debug_printf("lost sync, segment id:%lu expected id:%lu\n", seg, vospi_seg);
+        }
+    } else {
+        memcpy(vospi_buffer + (vospi_fill * vospi_frame_size) + (vospi_pid * VOSPI_LINE_SIZE),
+                vospi_packet + VOSPI_HEADER_SIZE, VOSPI_LINE_SIZE);
+        if ((++vospi_pid % VOSPI_NUMBER_PACKETS) == 0) {
+            vospi_seg++;
+        }
+        if (vospi_pid == vospi_packets) {
+            vospi_frame_seq[vospi_fill] = ++vospi_frame_count;
+            vospi_ready = vospi_fill;
+            vospi_fill = -1;
         }
     }
 }
@@ -498,24 +582,28 @@ static int snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
     bool streaming = (streaming_cb != NULL); // Streaming mode.
 
     do {
-        // The SPI DMA device is always clocking the FLIR Lepton in the background.
-        // The code below resets the vospi control values to let data be pulled in.
-        // If we need to re-sync we do it. Otherwise, after we finish pulling data
-        // in we exit and let the SPI bus keep running. Then on the next call to
-        // snapshot we read in more data and pull in the next frame.
-        HAL_NVIC_DisableIRQ(LEPTON_SPI_DMA_IRQn);
-        vospi_pid = VOSPI_FIRST_PACKET;
-        vospi_seg = VOSPI_FIRST_SEGMENT;
-        HAL_NVIC_EnableIRQ(LEPTON_SPI_DMA_IRQn);
-
-        // Snapshot start tick
+        // The SPI DMA device is always clocking the FLIR Lepton in the background and the
+        // complete frames are queued. If a frame was completed since the last snapshot it's
+        // used right away, otherwise we wait for the next one (re-syncing if needed).
         uint32_t tick_start = HAL_GetTick();
         bool reset_tried = false;
+        int frame;
 
-        do {
+        for (;;) {
             if (vospi_resync == true) {
                 lepton_sync();
             }
+            frame = vospi_ready;
+            if ((frame >= 0) && (vospi_frame_seq[frame] != vospi_last_seq)) {
+                // The ISR may have started refilling the frame before it was locked.
+                vospi_locked = frame;
+                __DMB();
+                if (vospi_ready == frame) {
+                    break;
+                }
+                vospi_locked = -1;
+                continue;
+            }
             if (frame_ready == true && streaming_cb != NULL) {
                 // Start streaming the frame while a new one is captured.
                 streaming = streaming_cb(image);
@@ -531,6 +619,7 @@ static int snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
                 reset_tried = true;
 
                 // The FLIR lepton might have crashed so reset it (it does this).
+                // This also re-syncs the VOSPI interface.
                 bool temp_h_mirror = h_mirror;
                 bool temp_v_flip = v_flip;
                 int ret = lepton_reset(sensor, measurement_mode);
@@ -540,14 +629,10 @@ static int snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
                 if (ret < 0) {
                     return -1;
                 }
-
-                // Reset the VOSPI interface again.
-                HAL_NVIC_DisableIRQ(LEPTON_SPI_DMA_IRQn);
-                vospi_pid = VOSPI_FIRST_PACKET;
-                vospi_seg = VOSPI_FIRST_SEGMENT;
-                HAL_NVIC_EnableIRQ(LEPTON_SPI_DMA_IRQn);
             }
-        } while (vospi_pid < vospi_packets); // only checking one volatile var so atomic.
+        }
+
+        vospi_last_seq = vospi_frame_seq[frame];
 
         MAIN_FB()->w = MAIN_FB()->u;
         MAIN_FB()->h = MAIN_FB()->v;
@@ -571,7 +656,7 @@ static int snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
         image->bpp = MAIN_FB()->bpp; // invalid
         image->data = MAIN_FB()->pixels; // valid
 
-        uint16_t *src = (uint16_t*) vospi_buffer;
+        uint16_t *src = (uint16_t*) (vospi_buffer + (frame * vospi_frame_size));
 
         float x_scale = resolution[sensor->framesize][0] / ((float) h_res);
         float y_scale = resolution[sensor->framesize][1] / ((float) v_res);
@@ -585,54 +670,92 @@ static int snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
         LEP_SYS_FPA_TEMPERATURE_KELVIN_T kelvin;
         if (measurement_mode && (!radiometry)) {
             if (LEP_GetSysFpaTemperatureKelvin(&LEPHandle, &kelvin) != LEP_OK) {
+                vospi_locked = -1;
                 return -1;
             }
         }
 
-        for (int y = y_offset, yy = fast_ceilf(v_res * scale) + y_offset; y < yy; y++) {
-            if ((MAIN_FB()->y <= y) && (y < (MAIN_FB()->y + MAIN_FB()->v))) { // user window cropping
+        // Measurement mode maps the temperature range linearly to 0-255 (16.16 fixed point).
+        int lo_ck = fast_roundf((min_temp + 273.15f) * 100); // centi-kelvin
+        int hi_ck = IM_MAX(fast_roundf((max_temp + 273.15f) * 100), lo_ck);
+        int ck_scale = (hi_ck > lo_ck) ? fast_roundf((255 << 16) / ((float) (hi_ck - lo_ck))) : 0;
+        int stats_min_value = INT_MAX, stats_max_value = INT_MIN, stats_max_x = 0, stats_max_y = 0;
+
+        // Visible part of the upscaled image (user window cropping).
+        int y_start = IM_MAX(y_offset, MAIN_FB()->y);
+        int y_end = IM_MIN(fast_ceilf(v_res * scale) + y_offset, MAIN_FB()->y + MAIN_FB()->v);
+        int x_start = IM_MAX(x_offset, MAIN_FB()->x);
+        int x_end = IM_MIN(fast_ceilf(h_res * scale) + x_offset, MAIN_FB()->x + MAIN_FB()->u);
+        uint8_t line[VOSPI_LINE_PIXELS * 2];
+
+        // Each source row is converted once (and added to the stats) and then upscaled.
+        for (int src_y = 0, y = y_start; src_y < v_res; src_y++) {
+            uint16_t *row_ptr = src + (src_y * h_res);
+
+            for (int src_x = 0; src_x < h_res; src_x++) {
+                // Value is the 14/16-bit value from the FLIR IR camera.
+                // However, with AGC enabled only the bottom 8-bits are non-zero.
+                int value = __REV16(row_ptr[src_x]);
+
+                if (measurement_mode) {
+                    // Need to convert 14/16-bits to 8-bits ourselves...
+                    if (!radiometry) value = (value - 8192) + kelvin;
+
+                    if (value < stats_min_value) {
+                        stats_min_value = value;
+                    }
 
-                uint16_t *row_ptr = src + (fast_floorf(y * scale_inv) * h_res);
+                    if (value > stats_max_value) {
+                        stats_max_value = value;
+                        stats_max_x = src_x;
+                        stats_max_y = src_y;
+                    }
 
-                for (int x = x_offset, xx = fast_ceilf(h_res * scale) + x_offset; x < xx; x++) {
-                    if ((MAIN_FB()->x <= x) && (x < (MAIN_FB()->x + MAIN_FB()->u))) { // user window cropping
+                    value = ((IM_MIN(IM_MAX(value, lo_ck), hi_ck) - lo_ck) * ck_scale) >> 16;
+                }
 
-                        // Value is the 14/16-bit value from the FLIR IR camera.
-                        // However, with AGC enabled only the bottom 8-bits are non-zero.
-                        int value = __REV16(row_ptr[fast_floorf(x * scale_inv)]);
+                line[src_x] = value;
+            }
 
-                        if (measurement_mode) {
-                            // Need to convert 14/16-bits to 8-bits ourselves...
-                            if (!radiometry) value = (value - 8192) + kelvin;
-                            float celsius = (value * 0.01f) - 273.15f;
-                            celsius = IM_MAX(IM_MIN(celsius, max_temp), min_temp);
-                            value = IM_MAX(IM_MIN(IM_DIV(((celsius - min_temp) * 255), (max_temp - min_temp)), 255), 0);
+            for (; (y < y_end) && (fast_floorf(y * scale_inv) == src_y); y++) {
+                int t_y = y - MAIN_FB()->y;
+                if (v_flip) t_y = MAIN_FB()->v - t_y - 1;
+
+                switch (sensor->pixformat) {
+                    case PIXFORMAT_GRAYSCALE: {
+                        uint8_t *t_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(image, t_y);
+                        for (int x = x_start; x < x_end; x++) {
+                            int t_x = x - MAIN_FB()->x;
+                            if (h_mirror) t_x = MAIN_FB()->u - t_x - 1;
+                            IMAGE_PUT_GRAYSCALE_PIXEL_FAST(t_row_ptr, t_x, line[fast_floorf(x * scale_inv)]);
                         }
-
-                        int t_x = x - MAIN_FB()->x;
-                        int t_y = y - MAIN_FB()->y;
-
-                        if (h_mirror) t_x = MAIN_FB()->u - t_x - 1;
-                        if (v_flip) t_y = MAIN_FB()->v - t_y - 1;
-
-                        switch (sensor->pixformat) {
-                            case PIXFORMAT_GRAYSCALE: {
-                                IMAGE_PUT_GRAYSCALE_PIXEL(image, t_x, t_y, value & 0xFF);
-                                break;
-                            }
-                            case PIXFORMAT_RGB565: {
-                                IMAGE_PUT_RGB565_PIXEL(image, t_x, t_y, sensor->color_palette[value & 0xFF]);
-                                break;
-                            }
-                            default: {
-                                break;
-                            }
+                        break;
+                    }
+                    case PIXFORMAT_RGB565: {
+                        uint16_t *t_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(image, t_y);
+                        for (int x = x_start; x < x_end; x++) {
+                            int t_x = x - MAIN_FB()->x;
+                            if (h_mirror) t_x = MAIN_FB()->u - t_x - 1;
+                            IMAGE_PUT_RGB565_PIXEL_FAST(t_row_ptr, t_x, sensor->color_palette[line[fast_floorf(x * scale_inv)]]);
                         }
+                        break;
+                    }
+                    default: {
+                        break;
                     }
                 }
             }
         }
 
+        stats_valid = measurement_mode;
+        if (stats_valid) {
+            stats_min = (stats_min_value * 0.01f) - 273.15f;
+            stats_max = (stats_max_value * 0.01f) - 273.15f;
+            stats_x = h_mirror ? (h_res - stats_max_x - 1) : stats_max_x;
+            stats_y = v_flip ? (v_res - stats_max_y - 1) : stats_max_y;
+        }
+
+        vospi_locked = -1;
         frame_ready = true;
     } while (streaming && streaming_cb != NULL);
     return 0;
@@ -23,6 +23,7 @@
 #include "runtime.h"
 #include "obj.h"
 #include "objmodule.h"
+#include "frozenmod.h"
 #include "objstr.h"
 #include "gc.h"
 #include "stackctrl.h"
@@ -56,9 +57,16 @@
 #include "sensor.h"
 #include "usbdbg.h"
 #include "wifidbg.h"
+#include "wifistream.h"
 #include "sdram.h"
 #include "fb_alloc.h"
+#include "xalloc.h"
+#include "gc_stats.h"
+#include "trace.h"
+#include "frame_stats.h"
+#include "mpy_cache.h"
 #include "ff_wrapper.h"
+#include "assets.h"
 
 #include "usbd_core.h"
 #include "usbd_desc.h"
@@ -294,7 +302,29 @@ void NORETURN __stack_chk_fail(void)
 }
 #endif
 
+// Boot options that are needed before the filesystem is mounted are cached from openmv.config
+// in an RTC backup register (kept across resets), they take effect from the next boot.
+#define BOOT_FLAGS_BKP      (RTC->BKP18R)
+#define BOOT_FLAGS_MAGIC    (0xB0070000)
+#define BOOT_FLAGS_MASK     (0xFFFF0000)
+#define BOOT_FLAG_FASTBOOT  (1 << 0) // Don't mount the SD card at boot (scripts can mount it).
+
+static uint32_t boot_flags_get()
+{
+    uint32_t flags = BOOT_FLAGS_BKP;
+    return ((flags & BOOT_FLAGS_MASK) == BOOT_FLAGS_MAGIC) ? (flags & ~BOOT_FLAGS_MASK) : 0;
+}
+
+static void boot_flags_set(uint32_t flags)
+{
+    if (BOOT_FLAGS_BKP != (BOOT_FLAGS_MAGIC | flags)) {
+        HAL_PWR_EnableBkUpAccess();
+        BOOT_FLAGS_BKP = BOOT_FLAGS_MAGIC | flags;
+    }
+}
+
 typedef struct openmv_config {
+    bool fastboot;
     bool wifidbg;
     wifidbg_config_t wifidbg_config;
 } openmv_config_t;
@@ -315,6 +345,8 @@ int ini_handler_callback(void *user, const char *section, const char *name, cons
             MP_STATE_PORT(pyb_stdio_uart) = pyb_uart_type.make_new((mp_obj_t) &pyb_uart_type, MP_ARRAY_SIZE(args), 0, args);
             uart_attach_to_repl(MP_STATE_PORT(pyb_stdio_uart), true);
         }
+    } else if (MATCH("BoardConfig", "FastBoot")) {
+        openmv_config->fastboot = ini_is_true(value);
     } else if (MATCH("BoardConfig", "WiFiDebug")) {
         openmv_config->wifidbg = ini_is_true(value);
     } else if (MATCH("WiFiConfig", "Mode")) {
@@ -360,8 +392,8 @@ FRESULT exec_boot_script(const char *path, bool selftest, bool interruptible)
                 usbdbg_set_script_running(true);
             }
 
-            // Parse, compile and execute the script.
-            pyexec_file(path);
+            // Parse, compile (or load the cached bytecode) and execute the script.
+            mpy_cache_exec_file(path);
             nlr_pop();
         } else {
             interrupted = true;
@@ -437,6 +469,9 @@ int main(void)
     #endif
     #endif
 
+    // Map the asset store (if any), assets are accessed in place.
+    assets_init();
+
     // Basic sub-system init
     led_init();
     pendsv_init();
@@ -465,6 +500,7 @@ soft_reset:
 
     // GC init
     gc_init(&_heap_start, &_heap_end);
+    xalloc_init0();
 
     // Micro Python init
     mp_init();
@@ -484,8 +520,14 @@ soft_reset:
     spi_init0();
     uart_init0();
     sensor_init0();
+    wifistream_init0();
     fb_alloc_init0();
+    fb_init0();
+    gc_stats_init0();
+    trace_init();
+    frame_stats_init0();
     file_buffer_init0();
+    file_ring_init0();
     py_lcd_init0();
     py_fir_init0();
     py_tv_init0();
@@ -514,8 +556,9 @@ soft_reset:
     irq_set_base_priority(0);
 
     #if MICROPY_HW_ENABLE_SDCARD
-    // Initialize storage
-    if (sdcard_is_present()) {
+    // Initialize storage, in fast boot mode the SD card isn't mounted (it can take a while to
+    // initialize) and scripts run from the internal flash.
+    if (!(boot_flags_get() & BOOT_FLAG_FASTBOOT) && sdcard_is_present()) {
         // Init the vfs object
         vfs_fat->blockdev.flags = 0;
         sdcard_init_vfs(vfs_fat, 1);
@@ -581,6 +624,7 @@ soft_reset:
     memset(&openmv_config, 0, sizeof(openmv_config));
     // Parse config, and init wifi if enabled.
     ini_parse(&vfs_fat->fatfs, "/openmv.config", ini_handler_callback, &openmv_config);
+    boot_flags_set(openmv_config.fastboot ? BOOT_FLAG_FASTBOOT : 0);
     #if OMV_ENABLE_WIFIDBG && MICROPY_PY_WINC1500
     if (openmv_config.wifidbg == true &&
             wifidbg_init(&openmv_config.wifidbg_config) != 0) {
@@ -638,8 +682,21 @@ soft_reset:
     }
 
     // Run main script if it exists.
-    if (first_soft_reset) {
-        exec_boot_script("/main.py", false, true);
+    if (first_soft_reset && (exec_boot_script("/main.py", false, true) != FR_OK)) {
+        #if MICROPY_MODULE_FROZEN
+        // Otherwise run the main.py frozen into the firmware (if any).
+        if (mp_frozen_stat("main.py") == MP_IMPORT_STAT_FILE) {
+            nlr_buf_t nlr;
+            if (nlr_push(&nlr) == 0) {
+                usbdbg_set_irq_enabled(true);
+                usbdbg_set_script_running(true);
+                pyexec_frozen_module("main.py");
+                nlr_pop();
+            }
+            usbdbg_set_irq_enabled(false);
+            usbdbg_set_script_running(false);
+        }
+        #endif
     }
 
     do {
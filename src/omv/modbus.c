@@ -0,0 +1,210 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Modbus RTU/TCP slave.
+ *
+ * Serves read holding/input registers (3/4), write single register (6) and write multiple
+ * registers (16) from one register table. Nothing here allocates or blocks, so RTU requests
+ * can be answered from the UART interrupt.
+ */
+#include <string.h>
+#include "modbus.h"
+
+#define MODBUS_READ_HOLDING_REGISTERS   (0x03)
+#define MODBUS_READ_INPUT_REGISTERS     (0x04)
+#define MODBUS_WRITE_SINGLE_REGISTER    (0x06)
+#define MODBUS_WRITE_MULTIPLE_REGISTERS (0x10)
+
+#define MODBUS_ILLEGAL_FUNCTION         (0x01)
+#define MODBUS_ILLEGAL_DATA_ADDRESS     (0x02)
+#define MODBUS_ILLEGAL_DATA_VALUE       (0x03)
+
+#define MODBUS_MAX_READ_REGISTERS       (125)
+#define MODBUS_MAX_WRITE_REGISTERS      (123)
+#define MODBUS_BROADCAST_ID             (0)
+
+// CRC-16/MODBUS (reflected 0x8005) for each nibble.
+static const uint16_t crc16_tab[16] = {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+static inline uint16_t get_u16(const uint8_t *buf)
+{
+    return (buf[0] << 8) | buf[1];
+}
+
+static inline void put_u16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = value >> 8;
+    buf[1] = value;
+}
+
+uint16_t modbus_crc16(const uint8_t *buf, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ crc16_tab[(crc ^ buf[i]) & 0xF];
+        crc = (crc >> 4) ^ crc16_tab[(crc ^ (buf[i] >> 4)) & 0xF];
+    }
+    return crc;
+}
+
+static size_t modbus_exception(modbus_t *mb, uint8_t function, uint8_t code, uint8_t *out)
+{
+    mb->exceptions += 1;
+    out[0] = function | 0x80;
+    out[1] = code;
+    return 2;
+}
+
+// Processes the PDU (function code and data) and writes the response PDU to out.
+static size_t modbus_pdu_process(modbus_t *mb, const uint8_t *pdu, size_t len, uint8_t *out)
+{
+    uint8_t function = pdu[0];
+    mb->requests += 1;
+
+    switch (function) {
+        case MODBUS_READ_HOLDING_REGISTERS:
+        case MODBUS_READ_INPUT_REGISTERS: {
+            if (len != 5) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_VALUE, out);
+            }
+            uint32_t address = get_u16(pdu + 1);
+            uint32_t count = get_u16(pdu + 3);
+            if ((!count) || (count > MODBUS_MAX_READ_REGISTERS)) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_VALUE, out);
+            }
+            if ((address + count) > mb->regs_len) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_ADDRESS, out);
+            }
+            out[0] = function;
+            out[1] = count * 2;
+            for (uint32_t i = 0; i < count; i++) {
+                put_u16(out + 2 + (i * 2), mb->regs[address + i]);
+            }
+            return 2 + (count * 2);
+        }
+        case MODBUS_WRITE_SINGLE_REGISTER: {
+            if (len != 5) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_VALUE, out);
+            }
+            uint32_t address = get_u16(pdu + 1);
+            if (address >= mb->regs_len) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_ADDRESS, out);
+            }
+            mb->regs[address] = get_u16(pdu + 3);
+            mb->writes += 1;
+            // The response echoes the request.
+            memcpy(out, pdu, 5);
+            return 5;
+        }
+        case MODBUS_WRITE_MULTIPLE_REGISTERS: {
+            if (len < 6) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_VALUE, out);
+            }
+            uint32_t address = get_u16(pdu + 1);
+            uint32_t count = get_u16(pdu + 3);
+            if ((!count) || (count > MODBUS_MAX_WRITE_REGISTERS)
+                    || (pdu[5] != (count * 2)) || (len != (6 + (count * 2)))) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_VALUE, out);
+            }
+            if ((address + count) > mb->regs_len) {
+                return modbus_exception(mb, function, MODBUS_ILLEGAL_DATA_ADDRESS, out);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                mb->regs[address + i] = get_u16(pdu + 6 + (i * 2));
+            }
+            mb->writes += 1;
+            memcpy(out, pdu, 5);
+            return 5;
+        }
+        default: {
+            return modbus_exception(mb, function, MODBUS_ILLEGAL_FUNCTION, out);
+        }
+    }
+}
+
+int modbus_rtu_frame_size(const uint8_t *buf, size_t len)
+{
+    // Address, function code and CRC, plus the data of the functions we know the size of.
+    // Other functions are answered with an exception, the frame being what was received.
+    if (len < 2) {
+        return 0;
+    }
+
+    switch (buf[1]) {
+        case MODBUS_READ_HOLDING_REGISTERS:
+        case MODBUS_READ_INPUT_REGISTERS:
+        case MODBUS_WRITE_SINGLE_REGISTER: {
+            return (len < 8) ? 0 : 8;
+        }
+        case MODBUS_WRITE_MULTIPLE_REGISTERS: {
+            if (len < 7) {
+                return 0;
+            }
+            int size = 9 + buf[6];
+            if (size > MODBUS_RTU_MAX_ADU) {
+                return -1;
+            }
+            return (len < size) ? 0 : size;
+        }
+        default: {
+            return (len < 4) ? 0 : len;
+        }
+    }
+}
+
+size_t modbus_rtu_process(modbus_t *mb, const uint8_t *req, size_t len, uint8_t *resp)
+{
+    if ((len < 4) || (len > MODBUS_RTU_MAX_ADU)) {
+        return 0;
+    }
+
+    uint16_t crc = modbus_crc16(req, len - 2);
+    if ((req[len - 2] != (crc & 0xFF)) || (req[len - 1] != (crc >> 8))) {
+        mb->crc_errors += 1;
+        return 0;
+    }
+
+    if ((req[0] != mb->slave_id) && (req[0] != MODBUS_BROADCAST_ID)) {
+        return 0;
+    }
+
+    size_t size = 1 + modbus_pdu_process(mb, req + 1, len - 3, resp + 1);
+
+    // Broadcast writes are applied but never answered.
+    if (req[0] == MODBUS_BROADCAST_ID) {
+        return 0;
+    }
+
+    resp[0] = mb->slave_id;
+    crc = modbus_crc16(resp, size);
+    resp[size++] = crc & 0xFF;
+    resp[size++] = crc >> 8;
+    return size;
+}
+
+size_t modbus_tcp_process(modbus_t *mb, const uint8_t *req, size_t len, uint8_t *resp)
+{
+    // MBAP header: transaction id, protocol id (0), length (unit id and PDU), unit id.
+    if ((len < (MODBUS_TCP_MBAP_SIZE + 1)) || get_u16(req + 2)) {
+        return 0;
+    }
+
+    size_t pdu_len = get_u16(req + 4);
+    if ((pdu_len < 2) || ((MODBUS_TCP_MBAP_SIZE - 1 + pdu_len) > len)
+            || ((MODBUS_TCP_MBAP_SIZE - 1 + pdu_len) > MODBUS_TCP_MAX_ADU)) {
+        return 0;
+    }
+
+    size_t size = modbus_pdu_process(mb, req + MODBUS_TCP_MBAP_SIZE, pdu_len - 1, resp + MODBUS_TCP_MBAP_SIZE);
+    memcpy(resp, req, MODBUS_TCP_MBAP_SIZE);
+    put_u16(resp + 4, size + 1);
+    return MODBUS_TCP_MBAP_SIZE + size;
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Modbus RTU/TCP slave.
+ */
+#ifndef __MODBUS_H__
+#define __MODBUS_H__
+#include <stdint.h>
+#include <stddef.h>
+#define MODBUS_RTU_MAX_ADU      (256)
+#define MODBUS_TCP_MAX_ADU      (260)
+#define MODBUS_TCP_MBAP_SIZE    (7)
+#define MODBUS_MAX_REGISTERS    (65536)
+
+// Holding registers, also served as the input registers. The counters are updated by the slave.
+typedef struct modbus {
+    volatile uint16_t *regs;
+    uint32_t regs_len;
+    uint8_t slave_id;
+    uint32_t requests;
+    uint32_t crc_errors;
+    uint32_t exceptions;
+    uint32_t writes;
+} modbus_t;
+
+uint16_t modbus_crc16(const uint8_t *buf, size_t len);
+// Returns the size of the RTU frame at the start of buf, 0 if more bytes are needed
+// or -1 if buf can't be the start of a frame.
+int modbus_rtu_frame_size(const uint8_t *buf, size_t len);
+// Processes a request frame and returns the size of the response, 0 if there's none
+// (bad CRC, another slave or a broadcast). resp must hold MODBUS_RTU_MAX_ADU/MODBUS_TCP_MAX_ADU bytes.
+size_t modbus_rtu_process(modbus_t *mb, const uint8_t *req, size_t len, uint8_t *resp);
+size_t modbus_tcp_process(modbus_t *mb, const uint8_t *req, size_t len, uint8_t *resp);
+#endif // __MODBUS_H__
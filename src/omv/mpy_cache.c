@@ -0,0 +1,201 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Compiled script cache.
+ *
+ * The cache file has a header with the size and hash of the source it was compiled from,
+ * followed by the .mpy data. A cache that doesn't match (or can't be loaded, e.g. after a
+ * firmware update changes the .mpy version) is replaced with a fresh compile.
+ */
+#include <mp.h>
+#include "py/compile.h"
+#include "py/persistentcode.h"
+#include "py/emitglue.h"
+#include "py/reader.h"
+#include "lib/utils/pyexec.h"
+#include "lib/utils/interrupt_char.h"
+#include "readline.h"
+#include "ff_wrapper.h"
+#include "mpy_cache.h"
+
+#if MICROPY_PERSISTENT_CODE_SAVE && MICROPY_PERSISTENT_CODE_LOAD
+#define MPY_CACHE_MAGIC     (0x43564D4F) // "OMVC"
+#define MPY_CACHE_BUF_SIZE  (512)
+#define MPY_CACHE_PATH_LEN  (64)
+
+typedef struct mpy_cache_header {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t hash;
+} mpy_cache_header_t;
+
+typedef struct mpy_cache_reader {
+    FIL fp;
+    UINT pos;
+    UINT len;
+    uint8_t buf[MPY_CACHE_BUF_SIZE];
+} mpy_cache_reader_t;
+
+// FNV-1a of the source file.
+static bool mpy_cache_hash(const char *path, mpy_cache_header_t *header)
+{
+    FIL fp;
+    UINT n;
+    uint8_t buf[MPY_CACHE_BUF_SIZE];
+
+    if (f_open_helper(&fp, path, FA_READ|FA_OPEN_EXISTING) != FR_OK) {
+        return false;
+    }
+
+    header->magic = MPY_CACHE_MAGIC;
+    header->size = 0;
+    header->hash = 2166136261u;
+
+    do {
+        if (f_read(&fp, buf, sizeof(buf), &n) != FR_OK) {
+            f_close(&fp);
+            return false;
+        }
+        for (UINT i = 0; i < n; i++) {
+            header->hash = (header->hash ^ buf[i]) * 16777619u;
+        }
+        header->size += n;
+    } while (n == sizeof(buf));
+
+    f_close(&fp);
+    return true;
+}
+
+static mp_uint_t mpy_cache_readbyte(void *data)
+{
+    mpy_cache_reader_t *reader = data;
+    if (reader->pos == reader->len) {
+        if ((f_read(&reader->fp, reader->buf, sizeof(reader->buf), &reader->len) != FR_OK) || (!reader->len)) {
+            reader->len = reader->pos = 0;
+            return MP_READER_EOF;
+        }
+        reader->pos = 0;
+    }
+    return reader->buf[reader->pos++];
+}
+
+static void mpy_cache_close(void *data)
+{
+}
+
+// Returns the cached raw code, or NULL if the cache doesn't match the source.
+static mp_raw_code_t *mpy_cache_load(const char *cache_path, mpy_cache_header_t *header)
+{
+    nlr_buf_t nlr;
+    mp_raw_code_t *rc = NULL;
+    mpy_cache_header_t cache_header;
+    mpy_cache_reader_t *reader = m_new_obj(mpy_cache_reader_t);
+    UINT n;
+
+    if (f_open_helper(&reader->fp, cache_path, FA_READ|FA_OPEN_EXISTING) != FR_OK) {
+        m_del_obj(mpy_cache_reader_t, reader);
+        return NULL;
+    }
+
+    if ((f_read(&reader->fp, &cache_header, sizeof(cache_header), &n) == FR_OK)
+    && (n == sizeof(cache_header))
+    && (!memcmp(&cache_header, header, sizeof(cache_header)))) {
+        mp_reader_t mp_reader = { reader, mpy_cache_readbyte, mpy_cache_close };
+        reader->pos = reader->len = 0;
+        if (nlr_push(&nlr) == 0) {
+            rc = mp_raw_code_load(&mp_reader);
+            nlr_pop();
+        }
+    }
+
+    f_close(&reader->fp);
+    m_del_obj(mpy_cache_reader_t, reader);
+    return rc;
+}
+
+static void mpy_cache_print_strn(void *data, const char *str, size_t len)
+{
+    UINT n;
+    FIL *fp = data;
+    f_write(fp, str, len, &n);
+}
+
+static void mpy_cache_save(const char *cache_path, mpy_cache_header_t *header, mp_raw_code_t *rc)
+{
+    FIL fp;
+    UINT n;
+    nlr_buf_t nlr;
+
+    if (f_open_helper(&fp, cache_path, FA_WRITE|FA_CREATE_ALWAYS) != FR_OK) {
+        return;
+    }
+
+    // Write an invalid header first so that a partial cache is never used.
+    mpy_cache_header_t invalid = *header;
+    invalid.magic = 0;
+    bool ok = (f_write(&fp, &invalid, sizeof(invalid), &n) == FR_OK) && (n == sizeof(invalid));
+
+    if (ok && (nlr_push(&nlr) == 0)) {
+        mp_print_t print = { &fp, mpy_cache_print_strn };
+        mp_raw_code_save(rc, &print);
+        nlr_pop();
+        ok = (f_lseek(&fp, 0) == FR_OK) && (f_write(&fp, header, sizeof(*header), &n) == FR_OK);
+    }
+
+    f_close(&fp);
+
+    if (!ok) {
+        f_unlink_helper(cache_path);
+    }
+}
+
+int mpy_cache_exec_file(const char *path)
+{
+    nlr_buf_t nlr;
+    mpy_cache_header_t header;
+    char cache_path[MPY_CACHE_PATH_LEN];
+
+    if ((snprintf(cache_path, sizeof(cache_path), "%sc", path) >= sizeof(cache_path))
+    || (!mpy_cache_hash(path, &header))) {
+        return pyexec_file(path);
+    }
+
+    mp_raw_code_t *rc = mpy_cache_load(cache_path, &header);
+
+    if (nlr_push(&nlr) == 0) {
+        if (!rc) {
+            mp_lexer_t *lex = mp_lexer_new_from_file(path);
+            qstr source_name = lex->source_name;
+            mp_parse_tree_t parse_tree = mp_parse(lex, MP_PARSE_FILE_INPUT);
+            rc = mp_compile_to_raw_code(&parse_tree, source_name, false);
+            mpy_cache_save(cache_path, &header, rc);
+        }
+
+        // Same as pyexec_file(), errors are printed and SystemExit is ignored.
+        mp_obj_t module_fun = mp_make_function_from_raw_code(rc, MP_OBJ_NULL, MP_OBJ_NULL);
+        mp_hal_set_interrupt_char(CHAR_CTRL_C);
+        mp_call_function_0(module_fun);
+        mp_hal_set_interrupt_char(-1);
+        nlr_pop();
+        return 1;
+    } else {
+        mp_hal_set_interrupt_char(-1);
+        if (mp_obj_is_subclass_fast(MP_OBJ_FROM_PTR(((mp_obj_base_t *) nlr.ret_val)->type),
+                                    MP_OBJ_FROM_PTR(&mp_type_SystemExit))) {
+            return 1;
+        }
+        mp_obj_print_exception(&mp_plat_print, (mp_obj_t) nlr.ret_val);
+        return 0;
+    }
+}
+#else
+int mpy_cache_exec_file(const char *path)
+{
+    return pyexec_file(path);
+}
+#endif // MICROPY_PERSISTENT_CODE_SAVE && MICROPY_PERSISTENT_CODE_LOAD
@@ -0,0 +1,16 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Compiled script cache.
+ */
+#ifndef __MPY_CACHE_H__
+#define __MPY_CACHE_H__
+// Executes a script file like pyexec_file(), the compiled bytecode is saved next to it (path + "c")
+// and reused while the source doesn't change. Needs MICROPY_PERSISTENT_CODE_SAVE (MPY_CACHE=1 build).
+int mpy_cache_exec_file(const char *path);
+#endif // __MPY_CACHE_H__
@@ -45,11 +45,16 @@
 #define MT9V034_CHIP_CONTROL_SNAP_MODE          (3 << 3)
 #define MT9V034_CHIP_CONTROL_MODE_MASK          (3 << 3)
 #define MT9V034_CHIP_CONTROL_DOUT_ENABLE        (1 << 7)
-#define MT9V034_CHIP_CONTROL_SEQUENTIAL         (1 << 8)
+#define MT9V034_CHIP_CONTROL_SIMULTANEOUS       (1 << 8) // Exposure overlaps readout (else sequential).
 #define MT9V034_CHIP_CONTROL_RESERVED           (1 << 9)
 #define MT9V034_SHUTTER_WIDTH1                  (0x08)
 #define MT9V034_SHUTTER_WIDTH2                  (0x09)
 #define MT9V034_SHUTTER_WIDTH_CONTROL           (0x0A)
+#define MT9V034_SHUTTER_WIDTH_CONTROL_T2_MASK   (15 << 0)
+#define MT9V034_SHUTTER_WIDTH_CONTROL_T2_SHIFT  (0)
+#define MT9V034_SHUTTER_WIDTH_CONTROL_T3_MASK   (15 << 4)
+#define MT9V034_SHUTTER_WIDTH_CONTROL_T3_SHIFT  (4)
+#define MT9V034_SHUTTER_WIDTH_CONTROL_AUTO_KNEE (1 << 8)
 #define MT9V034_TOTAL_SHUTTER_WIDTH             (0x0B)
 #define MT9V034_TOTAL_SHUTTER_WIDTH_MIN         (1)
 #define MT9V034_TOTAL_SHUTTER_WIDTH_MAX         (32767)
@@ -66,6 +71,10 @@
 #define MT9V034_PIXEL_OPERATION_MODE            (0x0F)
 #define MT9V034_PIXEL_OPERATION_MODE_HDR        (1 << 0)
 #define MT9V034_PIXEL_OPERATION_MODE_COLOR      (1 << 1)
+#define MT9V034_ADC_RES_CTRL                    (0x1C)
+#define MT9V034_ADC_RES_CTRL_MASK               (3 << 0)
+#define MT9V034_ADC_RES_CTRL_LINEAR             (2 << 0)
+#define MT9V034_ADC_RES_CTRL_COMPANDED          (3 << 0) // 12-bit to 10-bit companding.
 #define MT9V034_ANALOG_GAIN                     (0x35)
 #define MT9V034_ANALOG_GAIN_MIN                 (16)
 #define MT9V034_ANALOG_GAIN_MAX                 (64)
@@ -109,8 +118,20 @@
 
 #define MICROSECOND_CLKS                        (1000000)
 
+static int16_t readout_x = 0;
+static int16_t readout_y = 0;
+
+static uint16_t readout_w = MT9V034_MAX_WIDTH;
+static uint16_t readout_h = MT9V034_MAX_HEIGHT;
+
 static int reset(sensor_t *sensor)
 {
+    readout_x = 0;
+    readout_y = 0;
+
+    readout_w = MT9V034_MAX_WIDTH;
+    readout_h = MT9V034_MAX_HEIGHT;
+
     DCMI_PWDN_HIGH();
     systick_sleep(1);
 
@@ -188,13 +209,23 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
         return -1;
     }
 
+    readout_w = IM_MAX(readout_w, width);
+    readout_h = IM_MAX(readout_h, height);
+
+    int readout_x_max = (MT9V034_MAX_WIDTH - readout_w) / 2;
+    int readout_y_max = (MT9V034_MAX_HEIGHT - readout_h) / 2;
+    readout_x = IM_MAX(IM_MIN(readout_x, readout_x_max), -readout_x_max);
+    readout_y = IM_MAX(IM_MIN(readout_y, readout_y_max), -readout_y_max);
+
+    // Bin the readout area down to the frame size, the sensor only reads out the window
+    // (frame size * binning) from the center of the readout area.
     int read_mode_mul = 1;
     read_mode &= 0xFFF0;
 
-    if ((width <= (MT9V034_MAX_WIDTH / 4)) && (height <= (MT9V034_MAX_HEIGHT / 4))) {
+    if ((width <= (readout_w / 4)) && (height <= (readout_h / 4))) {
         read_mode_mul = 4;
         read_mode |= MT9V034_READ_MODE_COL_BIN_4 | MT9V034_READ_MODE_ROW_BIN_4;
-    } else if ((width <= (MT9V034_MAX_WIDTH / 2)) && (height <= (MT9V034_MAX_HEIGHT / 2))) {
+    } else if ((width <= (readout_w / 2)) && (height <= (readout_h / 2))) {
         read_mode_mul = 2;
         read_mode |= MT9V034_READ_MODE_COL_BIN_2 | MT9V034_READ_MODE_ROW_BIN_2;
     }
@@ -202,9 +233,9 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     int ret = 0;
 
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_COL_START,
-            ((MT9V034_MAX_WIDTH - (width * read_mode_mul)) / 2) + MT9V034_COL_START_MIN);
+            ((MT9V034_MAX_WIDTH - (width * read_mode_mul)) / 2) + readout_x + MT9V034_COL_START_MIN);
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_ROW_START,
-            ((MT9V034_MAX_HEIGHT - (height * read_mode_mul)) / 2) + MT9V034_ROW_START_MIN);
+            ((MT9V034_MAX_HEIGHT - (height * read_mode_mul)) / 2) - readout_y + MT9V034_ROW_START_MIN);
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_WINDOW_WIDTH, width * read_mode_mul);
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_WINDOW_HEIGHT, height * read_mode_mul);
 
@@ -214,8 +245,10 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     // must be increased.
     //
     // The STM32H7 needs more than 94+(752-640) clocks between rows otherwise it can't keep up with the pixel rate.
+    //
+    // Small windows only need enough blanking for the minimum row time, which raises the frame rate.
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_HORIZONTAL_BLANKING,
-            MT9V034_HORIZONTAL_BLANKING_DEF + (MT9V034_MAX_WIDTH - IM_MIN(width * read_mode_mul, 640)));
+            IM_MAX(MT9V034_HORIZONTAL_BLANKING_DEF + (MT9V034_MAX_WIDTH - 640), 690 - (width * read_mode_mul)));
 
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_READ_MODE, read_mode);
     ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_PIXEL_COUNT, (width * height) / 8);
@@ -267,6 +300,32 @@ static int set_special_effect(sensor_t *sensor, sde_t sde)
     return 0;
 }
 
+static int write_analog_gain(sensor_t *sensor, float gain_db)
+{
+    uint16_t reg;
+    int gain = IM_MAX(IM_MIN(fast_roundf(fast_expf((gain_db / 20.0) * fast_log(10.0)) * 16.0), 127), 0);
+
+    int ret = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_ANALOG_GAIN, &reg);
+    ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_ANALOG_GAIN, (reg & 0xFF80) | gain);
+    return ret;
+}
+
+static int write_shutter_width(sensor_t *sensor, int exposure_us)
+{
+    uint16_t row_time_0, row_time_1;
+    int ret = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_WINDOW_WIDTH, &row_time_0);
+    ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_HORIZONTAL_BLANKING, &row_time_1);
+
+    int exposure = IM_MIN(exposure_us, MICROSECOND_CLKS / 2) * (MT9V034_XCLK_FREQ / MICROSECOND_CLKS);
+    int row_time = row_time_0 + row_time_1;
+    int coarse_time = exposure / row_time;
+    int fine_time = exposure % row_time;
+
+    ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_TOTAL_SHUTTER_WIDTH, coarse_time);
+    ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_FINE_SHUTTER_WIDTH_TOTAL, fine_time);
+    return ret;
+}
+
 static int set_auto_gain(sensor_t *sensor, int enable, float gain_db, float gain_db_ceiling)
 {
     uint16_t reg;
@@ -276,10 +335,7 @@ static int set_auto_gain(sensor_t *sensor, int enable, float gain_db, float gain
     ret |= sensor->snapshot(sensor, NULL, NULL); // Force shadow mode register to update...
 
     if ((enable == 0) && (!isnanf(gain_db)) && (!isinff(gain_db))) {
-        int gain = IM_MAX(IM_MIN(fast_roundf(fast_expf((gain_db / 20.0) * fast_log(10.0)) * 16.0), 127), 0);
-
-        ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_ANALOG_GAIN, &reg);
-        ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_ANALOG_GAIN, (reg & 0xFF80) | gain);
+        ret |= write_analog_gain(sensor, gain_db);
     } else if ((enable != 0) && (!isnanf(gain_db_ceiling)) && (!isinff(gain_db_ceiling))) {
         int gain_ceiling = IM_MAX(IM_MIN(fast_roundf(fast_expf((gain_db_ceiling / 20.0) * fast_log(10.0)) * 16.0), 127), 16);
 
@@ -309,16 +365,7 @@ static int set_auto_exposure(sensor_t *sensor, int enable, int exposure_us)
     ret |= sensor->snapshot(sensor, NULL, NULL); // Force shadow mode register to update...
 
     if ((enable == 0) && (exposure_us >= 0)) {
-        ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_WINDOW_WIDTH, &row_time_0);
-        ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_HORIZONTAL_BLANKING, &row_time_1);
-
-        int exposure = IM_MIN(exposure_us, MICROSECOND_CLKS / 2) * (MT9V034_XCLK_FREQ / MICROSECOND_CLKS);
-        int row_time = row_time_0 + row_time_1;
-        int coarse_time = exposure / row_time;
-        int fine_time = exposure % row_time;
-
-        ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_TOTAL_SHUTTER_WIDTH, coarse_time);
-        ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_FINE_SHUTTER_WIDTH_TOTAL, fine_time);
+        ret |= write_shutter_width(sensor, exposure_us);
     } else if ((enable != 0) && (exposure_us >= 0)) {
         ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_WINDOW_WIDTH, &row_time_0);
         ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_HORIZONTAL_BLANKING, &row_time_1);
@@ -346,6 +393,14 @@ static int get_exposure_us(sensor_t *sensor, int *exposure_us)
     return ret;
 }
 
+// Native AE, the shadow registers are latched at the start of the next frame (no forced update).
+static int set_exposure_gain(sensor_t *sensor, int exposure_us, float gain_db)
+{
+    int ret = write_shutter_width(sensor, exposure_us);
+    ret |= write_analog_gain(sensor, gain_db);
+    return ret;
+}
+
 static int set_auto_whitebal(sensor_t *sensor, int enable, float r_gain_db, float g_gain_db, float b_gain_db)
 {
     return 0;
@@ -387,6 +442,30 @@ static int ioctl(sensor_t *sensor, int request, va_list ap)
     uint16_t chip_control;
 
     switch (request) {
+        case IOCTL_SET_READOUT_WINDOW: {
+            int tmp_readout_x = va_arg(ap, int);
+            int tmp_readout_y = va_arg(ap, int);
+            int tmp_readout_w = IM_MAX(IM_MIN(va_arg(ap, int), MT9V034_MAX_WIDTH), resolution[sensor->framesize][0]);
+            int tmp_readout_h = IM_MAX(IM_MIN(va_arg(ap, int), MT9V034_MAX_HEIGHT), resolution[sensor->framesize][1]);
+            int readout_x_max = (MT9V034_MAX_WIDTH - tmp_readout_w) / 2;
+            int readout_y_max = (MT9V034_MAX_HEIGHT - tmp_readout_h) / 2;
+            tmp_readout_x = IM_MAX(IM_MIN(tmp_readout_x, readout_x_max), -readout_x_max);
+            tmp_readout_y = IM_MAX(IM_MIN(tmp_readout_y, readout_y_max), -readout_y_max);
+            bool changed = (tmp_readout_x != readout_x) || (tmp_readout_y != readout_y) || (tmp_readout_w != readout_w) || (tmp_readout_h != readout_h);
+            readout_x = tmp_readout_x;
+            readout_y = tmp_readout_y;
+            readout_w = tmp_readout_w;
+            readout_h = tmp_readout_h;
+            if (changed && (sensor->framesize != FRAMESIZE_INVALID)) ret = set_framesize(sensor, sensor->framesize);
+            break;
+        }
+        case IOCTL_GET_READOUT_WINDOW: {
+            *va_arg(ap, int *) = readout_x;
+            *va_arg(ap, int *) = readout_y;
+            *va_arg(ap, int *) = readout_w;
+            *va_arg(ap, int *) = readout_h;
+            break;
+        }
         case IOCTL_SET_TRIGGERED_MODE: {
             int enable = va_arg(ap, int);
             ret  = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_CHIP_CONTROL, &chip_control);
@@ -404,6 +483,81 @@ static int ioctl(sensor_t *sensor, int request, va_list ap)
             }
             break;
         }
+        case IOCTL_SET_PIPELINED_MODE: {
+            // Expose the next frame while the current frame is read out (master mode only,
+            // in triggered mode the exposure and the readout are always sequential).
+            int enable = va_arg(ap, int);
+            ret  = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_CHIP_CONTROL, &chip_control);
+            ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_CHIP_CONTROL,
+                    (chip_control & (~MT9V034_CHIP_CONTROL_SIMULTANEOUS))
+                    | ((enable != 0) ? MT9V034_CHIP_CONTROL_SIMULTANEOUS : 0));
+            ret |= sensor->snapshot(sensor, NULL, NULL); // Force shadow mode register to update...
+            break;
+        }
+        case IOCTL_GET_PIPELINED_MODE: {
+            int *enable = va_arg(ap, int *);
+            ret = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_CHIP_CONTROL, &chip_control);
+            if (ret >= 0) {
+                *enable = ((chip_control & MT9V034_CHIP_CONTROL_SIMULTANEOUS) != 0);
+            }
+            break;
+        }
+        case IOCTL_SET_HDR_MODE: {
+            // High dynamic range (piecewise linear response), the knee points are adjusted with
+            // the exposure. The T2 and T3 ratios (exposure divided by 2^ratio) are kept if < 0.
+            int enable = va_arg(ap, int);
+            int t2_ratio = va_arg(ap, int);
+            int t3_ratio = va_arg(ap, int);
+            uint16_t pixel_op, shutter_ctrl;
+            ret  = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_PIXEL_OPERATION_MODE, &pixel_op);
+            ret |= cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_SHUTTER_WIDTH_CONTROL, &shutter_ctrl);
+            if (ret != 0) {
+                break;
+            }
+            if (t2_ratio >= 0) {
+                shutter_ctrl = (shutter_ctrl & (~MT9V034_SHUTTER_WIDTH_CONTROL_T2_MASK))
+                             | ((IM_MIN(t2_ratio, 15) << MT9V034_SHUTTER_WIDTH_CONTROL_T2_SHIFT) & MT9V034_SHUTTER_WIDTH_CONTROL_T2_MASK);
+            }
+            if (t3_ratio >= 0) {
+                shutter_ctrl = (shutter_ctrl & (~MT9V034_SHUTTER_WIDTH_CONTROL_T3_MASK))
+                             | ((IM_MIN(t3_ratio, 15) << MT9V034_SHUTTER_WIDTH_CONTROL_T3_SHIFT) & MT9V034_SHUTTER_WIDTH_CONTROL_T3_MASK);
+            }
+            ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_SHUTTER_WIDTH_CONTROL,
+                    shutter_ctrl | MT9V034_SHUTTER_WIDTH_CONTROL_AUTO_KNEE);
+            ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_PIXEL_OPERATION_MODE,
+                    (pixel_op & (~MT9V034_PIXEL_OPERATION_MODE_HDR)) | ((enable != 0) ? MT9V034_PIXEL_OPERATION_MODE_HDR : 0));
+            ret |= sensor->snapshot(sensor, NULL, NULL); // Force shadow mode register to update...
+            break;
+        }
+        case IOCTL_GET_HDR_MODE: {
+            int *enable = va_arg(ap, int *);
+            uint16_t pixel_op;
+            ret = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_PIXEL_OPERATION_MODE, &pixel_op);
+            if (ret >= 0) {
+                *enable = ((pixel_op & MT9V034_PIXEL_OPERATION_MODE_HDR) != 0);
+            }
+            break;
+        }
+        case IOCTL_SET_COMPANDING: {
+            // 12-bit to 10-bit companding, more resolution for the dark pixels.
+            int enable = va_arg(ap, int);
+            uint16_t adc_ctrl;
+            ret  = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_ADC_RES_CTRL, &adc_ctrl);
+            ret |= cambus_writew(&sensor->i2c, sensor->slv_addr, MT9V034_ADC_RES_CTRL,
+                    (adc_ctrl & (~MT9V034_ADC_RES_CTRL_MASK))
+                    | ((enable != 0) ? MT9V034_ADC_RES_CTRL_COMPANDED : MT9V034_ADC_RES_CTRL_LINEAR));
+            ret |= sensor->snapshot(sensor, NULL, NULL); // Force shadow mode register to update...
+            break;
+        }
+        case IOCTL_GET_COMPANDING: {
+            int *enable = va_arg(ap, int *);
+            uint16_t adc_ctrl;
+            ret = cambus_readw(&sensor->i2c, sensor->slv_addr, MT9V034_ADC_RES_CTRL, &adc_ctrl);
+            if (ret >= 0) {
+                *enable = ((adc_ctrl & MT9V034_ADC_RES_CTRL_MASK) == MT9V034_ADC_RES_CTRL_COMPANDED);
+            }
+            break;
+        }
         default: {
             ret = -1;
             break;
@@ -434,6 +588,7 @@ int mt9v034_init(sensor_t *sensor)
     sensor->get_exposure_us     = get_exposure_us;
     sensor->set_auto_whitebal   = set_auto_whitebal;
     sensor->get_rgb_gain_db     = get_rgb_gain_db;
+    sensor->set_exposure_gain   = set_exposure_gain;
     sensor->set_hmirror         = set_hmirror;
     sensor->set_vflip           = set_vflip;
     sensor->set_special_effect  = set_special_effect;
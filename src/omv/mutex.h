@@ -13,6 +13,7 @@
 #include <stdint.h>
 #define MUTEX_TID_IDE (1<<0)
 #define MUTEX_TID_OMV (1<<1)
+#define MUTEX_TID_NET (1<<2)
 
 typedef volatile struct {
     uint32_t tid;
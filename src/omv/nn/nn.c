@@ -9,6 +9,7 @@
  * CNN code.
  */
 #include <stdio.h>
+#include STM32_HAL_H
 #include "nn.h"
 #include "imlib.h"
 #include "common.h"
@@ -18,12 +19,12 @@
 #include "omv_boardconfig.h"
 #ifdef IMLIB_ENABLE_CNN
 
-static const char *layer_to_str(layer_type_t type)
+const char *layer_to_str(layer_type_t type)
 {
     static const char *layers[] = {
-        "DATA", "CONV", "RELU", "POOL", "IP"
+        "DATA", "CONV", "RELU", "POOL", "IP", "DW_CONV", "PW_CONV", "QCONV", "QIP"
     };
-    if (type > sizeof(layers)/sizeof(layers[0])) {
+    if (type >= sizeof(layers)/sizeof(layers[0])) {
         return "Unknown layer";
     } else {
         return layers[type];
@@ -37,6 +38,11 @@ int nn_dump_network(nn_t *net)
     printf("Net type: %4s Num layers: %lu Max layer: %lu Max col buf: %lu Max scratch buf: %lu\n",
             net->type, net->n_layers, net->max_layer_size, net->max_colbuf_size, net->max_scrbuf_size);
 
+    if (net->tile_layer) {
+        printf("Tiled up to: %s Shape: [%lu, %lu, %lu, %lu] Scratch buf: %lu\n", layer_to_str(net->tile_layer->type),
+                net->tile_layer->n, net->tile_layer->c, net->tile_layer->h, net->tile_layer->w, net->tile_scrbuf_size);
+    }
+
     while (layer != NULL) {
         printf("Layer: %s Shape: [%lu, %lu, %lu, %lu] ",
                 layer_to_str(layer->type), layer->n, layer->c, layer->h, layer->w);
@@ -48,7 +54,9 @@ int nn_dump_network(nn_t *net)
                 break;
             }
 
-            case LAYER_TYPE_CONV: {
+            case LAYER_TYPE_CONV:
+            case LAYER_TYPE_DW_CONV:
+            case LAYER_TYPE_PW_CONV: {
                 conv_layer_t *conv_layer = (conv_layer_t *) layer;
                 printf("l_shift: %lu r_shift:%lu k_size: %lu k_stride: %lu k_padding: %lu\n",
                         conv_layer->l_shift, conv_layer->r_shift,
@@ -75,12 +83,145 @@ int nn_dump_network(nn_t *net)
                 printf("l_shift: %lu r_shift:%lu\n", ip_layer->l_shift, ip_layer->r_shift);
                 break;
             }
+
+            case LAYER_TYPE_QCONV:
+            case LAYER_TYPE_QIP: {
+                qlayer_t *qlayer = (qlayer_t *) layer;
+                printf("in_offset: %ld out_offset: %ld act: [%ld, %ld] k_size: %lu k_stride: %lu k_padding: %lu\n",
+                        qlayer->in_offset, qlayer->out_offset, qlayer->act_min, qlayer->act_max,
+                        qlayer->krn_dim, qlayer->krn_str, qlayer->krn_pad);
+                break;
+            }
         }
         layer = layer->next;
     }
     return 0;
 }
 
+// True if no other layer than ReLU follows, the layer's output is the network output.
+static bool nn_output_layer(layer_t *layer)
+{
+    for (layer = layer->next; layer != NULL; layer = layer->next) {
+        if (layer->type != LAYER_TYPE_RELU) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The output goes to the other end of the scratch buffer than the input.
+static q7_t *nn_output_buffer(nn_t *net, layer_t *layer, q7_t *scratch, uint32_t scratch_size, q7_t *input_buffer)
+{
+    if (layer->type == LAYER_TYPE_RELU) {
+        return input_buffer;
+    } else if (nn_output_layer(layer)) {
+        return net->output_data;
+    } else if (input_buffer == scratch) {
+        return scratch + scratch_size - (layer->c * layer->h * layer->w);
+    } else {
+        return scratch;
+    }
+}
+
+// Layers that only look at a few neighbouring rows can run on row tiles (pooling layers with
+// padding can't since the CMSIS-NN kernels pad both sides with the same padding).
+static bool nn_tile_layer_ok(layer_t *layer)
+{
+    switch (layer->type) {
+        case LAYER_TYPE_CONV:
+        case LAYER_TYPE_DW_CONV:
+        case LAYER_TYPE_PW_CONV:
+        case LAYER_TYPE_QCONV:
+        case LAYER_TYPE_RELU:
+            return true;
+        case LAYER_TYPE_POOL:
+            return !((pool_layer_t *) layer)->krn_pad;
+        default:
+            return false;
+    }
+}
+
+// Scratch buffer size of the layers after the tile layer, its output stays at the start of it.
+static uint32_t nn_tile_scrbuf_size(layer_t *tile_layer)
+{
+    uint32_t size = nn_output_layer(tile_layer) ? 0 : (tile_layer->c * tile_layer->h * tile_layer->w);
+    for (layer_t *layer = tile_layer->next; layer != NULL; layer = layer->next) {
+        if (layer->type != LAYER_TYPE_RELU) {
+            uint32_t buffer_size = nn_output_layer(layer) ? 0 : (layer->c * layer->h * layer->w);
+            buffer_size += layer->prev->c * layer->prev->h * layer->prev->w;
+            size = IM_MAX(size, buffer_size);
+        }
+    }
+    return size;
+}
+
+static void nn_krn_params(layer_t *layer, int *k, int *s, int *p)
+{
+    switch (layer->type) {
+        case LAYER_TYPE_CONV:
+        case LAYER_TYPE_DW_CONV:
+        case LAYER_TYPE_PW_CONV: {
+            conv_layer_t *conv_layer = (conv_layer_t *) layer;
+            *k = conv_layer->krn_dim, *s = conv_layer->krn_str, *p = conv_layer->krn_pad;
+            break;
+        }
+        case LAYER_TYPE_QCONV: {
+            qlayer_t *qlayer = (qlayer_t *) layer;
+            *k = qlayer->krn_dim, *s = qlayer->krn_str, *p = qlayer->krn_pad;
+            break;
+        }
+        case LAYER_TYPE_POOL: {
+            pool_layer_t *pool_layer = (pool_layer_t *) layer;
+            *k = pool_layer->krn_dim, *s = pool_layer->krn_str, *p = pool_layer->krn_pad;
+            break;
+        }
+        default: {
+            *k = 1, *s = 1, *p = 0;
+            break;
+        }
+    }
+}
+
+// Fills the output rows each layer up to the tile layer has to compute for rows [y, y_end) of
+// the tile layer output (rows[2*i] and rows[2*i+1] for the i-th layer, DATA is 0). The rows of
+// a tile overlap the rows of the next one by the kernel halo, those are computed twice. Returns
+// the scratch bytes needed by the tile (input and output of the largest layer).
+static uint32_t nn_tile_rows(nn_t *net, int n_layers, int y, int y_end, int *rows)
+{
+    uint32_t size = 0;
+    layer_t *layer = net->tile_layer;
+    rows[(2 * (n_layers - 1)) + 0] = y;
+    rows[(2 * (n_layers - 1)) + 1] = y_end;
+
+    for (int i = n_layers - 1; i > 0; i--, layer = layer->prev) {
+        int k, s, p;
+        nn_krn_params(layer, &k, &s, &p);
+        int a = rows[(2 * i) + 0], b = rows[(2 * i) + 1];
+        int in_a = IM_MAX((a * s) - p, 0);
+        int in_b = IM_MIN(((b - 1) * s) - p + k, (int) layer->prev->h);
+        rows[(2 * (i - 1)) + 0] = in_a;
+        rows[(2 * (i - 1)) + 1] = in_b;
+
+        // The tile layer writes its output straight to the tile layer output buffer.
+        if (layer->type != LAYER_TYPE_RELU) {
+            uint32_t buffer_size = (layer == net->tile_layer) ? 0 : ((b - a) * layer->w * layer->c);
+            buffer_size += (in_b - in_a) * layer->prev->w * layer->prev->c;
+            size = IM_MAX(size, buffer_size);
+        }
+    }
+
+    return size;
+}
+
+static uint32_t nn_tile_size(nn_t *net, int n_layers, int tile_h, int *rows)
+{
+    uint32_t size = 0;
+    for (int y = 0; y < net->tile_layer->h; y += tile_h) {
+        size = IM_MAX(size, nn_tile_rows(net, n_layers, y, IM_MIN(y + tile_h, net->tile_layer->h), rows));
+    }
+    return size;
+}
+
 int nn_load_network(nn_t *net, const char *path)
 {
     FIL fp;
@@ -107,6 +248,8 @@ int nn_load_network(nn_t *net, const char *path)
                 layer = xalloc0(sizeof(data_layer_t));
                 break;
             case LAYER_TYPE_CONV:
+            case LAYER_TYPE_DW_CONV:
+            case LAYER_TYPE_PW_CONV:
                 layer = xalloc0(sizeof(conv_layer_t));
                 break;
             case LAYER_TYPE_RELU:
@@ -118,6 +261,10 @@ int nn_load_network(nn_t *net, const char *path)
             case LAYER_TYPE_IP:
                 layer = xalloc0(sizeof(ip_layer_t));
                 break;
+            case LAYER_TYPE_QCONV:
+            case LAYER_TYPE_QIP:
+                layer = xalloc0(sizeof(qlayer_t));
+                break;
             default:
                 res = -1;
                 goto error;
@@ -151,7 +298,9 @@ int nn_load_network(nn_t *net, const char *path)
                 break;
             }
 
-            case LAYER_TYPE_CONV: {
+            case LAYER_TYPE_CONV:
+            case LAYER_TYPE_DW_CONV:
+            case LAYER_TYPE_PW_CONV: {
                 conv_layer_t *conv_layer = (conv_layer_t *) layer;
                 // Read layer l_shift, r_shift
                 read_data(&fp, &conv_layer->l_shift, 4);
@@ -206,6 +355,62 @@ int nn_load_network(nn_t *net, const char *path)
                 read_data(&fp, ip_layer->bias, ip_layer->b_size);
                 break;
             }
+
+            case LAYER_TYPE_QCONV:
+            case LAYER_TYPE_QIP: {
+                qlayer_t *qlayer = (qlayer_t *) layer;
+                // Read input/output offsets and the activation range
+                read_data(&fp, &qlayer->in_offset, 4);
+                read_data(&fp, &qlayer->out_offset, 4);
+                read_data(&fp, &qlayer->act_min, 4);
+                read_data(&fp, &qlayer->act_max, 4);
+
+                if (layer_type == LAYER_TYPE_QCONV) {
+                    // Read krnel dim, stride and padding
+                    read_data(&fp, &qlayer->krn_dim, 4);
+                    read_data(&fp, &qlayer->krn_pad, 4);
+                    read_data(&fp, &qlayer->krn_str, 4);
+                }
+
+                // Alloc and read weights array
+                read_data(&fp, &qlayer->w_size, 4);
+                qlayer->wt = xalloc(qlayer->w_size);
+                read_data(&fp, qlayer->wt, qlayer->w_size);
+
+                // Alloc and read int32 bias, multiplier and shift arrays (one per output channel)
+                read_data(&fp, &qlayer->b_size, 4);
+                qlayer->bias = xalloc(qlayer->b_size);
+                qlayer->mult = xalloc(qlayer->b_size);
+                qlayer->shift = xalloc(qlayer->b_size);
+                read_data(&fp, qlayer->bias, qlayer->b_size);
+                read_data(&fp, qlayer->mult, qlayer->b_size);
+                read_data(&fp, qlayer->shift, qlayer->b_size);
+                break;
+            }
+        }
+    }
+
+    // ReLU commutes with max pooling (relu(max(x)) == max(relu(x))), so CONV->RELU->MAXPOOL runs as
+    // CONV->MAXPOOL->RELU and the ReLU pass only touches the pooled output.
+    for (layer_t *layer = net->layers; layer != NULL; layer = layer->next) {
+        layer_t *relu_layer = layer->next;
+        layer_t *pool_layer = relu_layer ? relu_layer->next : NULL;
+        if (relu_layer && pool_layer
+        && (relu_layer->type == LAYER_TYPE_RELU)
+        && (pool_layer->type == LAYER_TYPE_POOL)
+        && (((pool_layer_t *) pool_layer)->ptype == POOL_TYPE_MAX)) {
+            layer->next = pool_layer;
+            pool_layer->prev = layer;
+            relu_layer->next = pool_layer->next;
+            if (pool_layer->next) {
+                pool_layer->next->prev = relu_layer;
+            }
+            pool_layer->next = relu_layer;
+            relu_layer->prev = pool_layer;
+            relu_layer->n = pool_layer->n;
+            relu_layer->c = pool_layer->c;
+            relu_layer->h = pool_layer->h;
+            relu_layer->w = pool_layer->w;
         }
     }
 
@@ -217,26 +422,53 @@ int nn_load_network(nn_t *net, const char *path)
         if (layer->type == LAYER_TYPE_IP) {
             uint32_t fc_buffer_size = 2 * prev_layer->c * prev_layer->w * prev_layer->h;
             net->max_colbuf_size = IM_MAX(net->max_colbuf_size, fc_buffer_size);
+            layer->scratch = fc_buffer_size;
         }
 
-        if (layer->type == LAYER_TYPE_CONV) {
+        if ((layer->type == LAYER_TYPE_QCONV) || (layer->type == LAYER_TYPE_QIP)) {
+            // The offset input (im2col rows for QCONV) is kept as q15.
+            qlayer_t *qlayer = (qlayer_t *) layer;
+            uint32_t buffer_size = (layer->type == LAYER_TYPE_QCONV)
+                ? (2 * prev_layer->c * qlayer->krn_dim * qlayer->krn_dim)
+                : (2 * prev_layer->c * prev_layer->h * prev_layer->w);
+            net->max_colbuf_size = IM_MAX(net->max_colbuf_size, buffer_size);
+            layer->scratch = buffer_size;
+        }
+
+        if (layer->type == LAYER_TYPE_PW_CONV) {
             conv_layer_t *conv_layer = (conv_layer_t *) layer;
-            uint32_t im2col_buffer_size = 2 * 2 * conv_layer->c * conv_layer->krn_dim * conv_layer->krn_dim;
-            net->max_colbuf_size = IM_MAX(net->max_colbuf_size, im2col_buffer_size);
+            // Pointwise layers the 1x1 kernel can't run are regular (1x1) convolutions.
+            if ((prev_layer->c % 4) || (conv_layer->c % 2) || (conv_layer->krn_dim != 1)
+            || conv_layer->krn_pad || (conv_layer->krn_str != 1)) {
+                layer->type = LAYER_TYPE_CONV;
+            }
         }
 
-        if (layer->type == LAYER_TYPE_IP) {
-            uint32_t buffer_size = layer->c;
-            if (prev_layer->type == LAYER_TYPE_IP) {
-                buffer_size = buffer_size + prev_layer->c;
-            } else if (prev_layer->type == LAYER_TYPE_CONV || prev_layer->type == LAYER_TYPE_POOL) {
-                buffer_size = buffer_size + prev_layer->c * prev_layer->h * prev_layer->w;
+        if (layer->type == LAYER_TYPE_DW_CONV) {
+            // Depthwise layers filter each channel on its own.
+            if ((prev_layer->c != layer->c) || (layer->c % 2)) {
+                printf("Depthwise layer channels must be even and match the input!\n");
+                res = -1;
+                goto error;
             }
-            net->max_scrbuf_size = IM_MAX(net->max_scrbuf_size, buffer_size);
         }
 
-        if (layer->type == LAYER_TYPE_CONV || layer->type == LAYER_TYPE_POOL) {
-            uint32_t buffer_size = layer->c * layer->h * layer->w + prev_layer->c * prev_layer->h * prev_layer->w;
+        if ((layer->type == LAYER_TYPE_CONV) || (layer->type == LAYER_TYPE_DW_CONV) || (layer->type == LAYER_TYPE_PW_CONV)) {
+            conv_layer_t *conv_layer = (conv_layer_t *) layer;
+            uint32_t channels = IM_MAX(conv_layer->c, prev_layer->c);
+            uint32_t im2col_buffer_size = 2 * 2 * channels * conv_layer->krn_dim * conv_layer->krn_dim;
+            net->max_colbuf_size = IM_MAX(net->max_colbuf_size, im2col_buffer_size);
+            layer->scratch = im2col_buffer_size;
+        }
+
+        // Activations are placed at alternating ends of the scratch buffer (see nn_output_buffer()),
+        // so it only has to hold the input and output of one layer at a time. ReLU runs in place
+        // and the output layer writes to output_data.
+        if (layer->type != LAYER_TYPE_RELU) {
+            uint32_t buffer_size = nn_output_layer(layer) ? 0 : (layer->c * layer->h * layer->w);
+            if (prev_layer) {
+                buffer_size += prev_layer->c * prev_layer->h * prev_layer->w;
+            }
             net->max_scrbuf_size = IM_MAX(net->max_scrbuf_size, buffer_size);
         }
 
@@ -248,6 +480,23 @@ int nn_load_network(nn_t *net, const char *path)
         layer = layer->next;
     }
 
+    // Pick the layer to tile up to, the one that leaves the smallest scratch buffer for the rest
+    // of the network. Going deeper only adds halo rows, so the first one is used on ties.
+    net->tile_layer = NULL;
+    for (layer = net->layers->next; (layer != NULL) && nn_tile_layer_ok(layer); layer = layer->next) {
+        if (layer->type != LAYER_TYPE_RELU) {
+            uint32_t size = nn_tile_scrbuf_size(layer);
+            if ((net->tile_layer == NULL) || (size < net->tile_scrbuf_size)) {
+                net->tile_layer = layer;
+                net->tile_scrbuf_size = size;
+            }
+        }
+    }
+
+    if (net->tile_layer && (net->tile_scrbuf_size >= net->max_scrbuf_size)) {
+        net->tile_layer = NULL;
+    }
+
     // Alloc output buffer.
     net->output_data = xalloc(net->output_size);
 error:
@@ -256,97 +505,286 @@ error:
     return res;
 }
 
-#ifndef __SSAT
-#define __SSAT(a, b) ({ __typeof__ (a) _a = (a); \
-                        __typeof__ (b) _b = (b); \
-                        _b = 1 << (_b - 1); \
-                        _a = _a < (_b - 1) ? _a : (_b - 1); \
-                        _a > (-_b) ? _a : (-_b); })
-#endif
+// The legacy data layer as a shared input description.
+static void nn_data_layer_input(data_layer_t *data_layer, nn_input_t *input)
+{
+    memset(input, 0, sizeof(nn_input_t));
+    input->w = data_layer->w;
+    input->h = data_layer->h;
+    input->c = data_layer->c;
+    input->type = NN_INPUT_Q7;
+    input->mean[0] = data_layer->r_mean;
+    input->mean[1] = data_layer->g_mean;
+    input->mean[2] = data_layer->b_mean;
+    input->shift = data_layer->scale;
+}
+
+// Converts rows [y_start, y_end) of the input, input_data points to the first of them.
+static void nn_transform_input_rows(data_layer_t *data_layer, image_t *img, q7_t *input_data,
+                                    rectangle_t *roi, int y_start, int y_end)
+{
+    nn_input_t input;
+    nn_data_layer_input(data_layer, &input);
+    nn_input_prepare(&input, img, roi, input_data, y_start, y_end);
+}
 
 void nn_transform_input(data_layer_t *data_layer, image_t *img, q7_t *input_data, rectangle_t *roi)
 {
-    int input_scale = data_layer->scale;
-    // Scale, convert and normalize input image.
-    int x_ratio = (int)((roi->w<<16)/data_layer->w)+1;
-    int y_ratio = (int)((roi->h<<16)/data_layer->h)+1;
-
-    if ((img->bpp == 2) && (data_layer->c == 3)) { // RGB565 to RGB888
-        for (int y=0, i=0; y<data_layer->h; y++) {
-            int sy = (y*y_ratio)>>16;
-            for (int x=0; x<data_layer->w; x++, i+=3) {
-                int sx = (x*x_ratio)>>16;
-                uint16_t p = IM_GET_RGB565_PIXEL(img, sx+roi->x, sy+roi->y);
-                input_data[i+0] = (q7_t)__SSAT((((((int) COLOR_RGB565_TO_R8(p))
-                                  - (int) data_layer->r_mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-                input_data[i+1] = (q7_t)__SSAT((((((int) COLOR_RGB565_TO_G8(p))
-                                  - (int) data_layer->g_mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-                input_data[i+2] = (q7_t)__SSAT((((((int) COLOR_RGB565_TO_B8(p))
-                                  - (int) data_layer->b_mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-            }
-        }
-    } else if ((img->bpp == 2) && (data_layer->c == 1)) { // RGB565 to GS
-        for (int y=0, i=0; y<data_layer->h; y++) {
-            int sy = (y*y_ratio)>>16;
-            for (int x=0; x<data_layer->w; x++, i++) {
-                int sx = (x*x_ratio)>>16;
-                uint16_t p = IM_GET_RGB565_PIXEL(img, sx+roi->x, sy+roi->y);
-                input_data[i] = (q7_t)__SSAT((((((int) COLOR_RGB565_TO_GRAYSCALE(p))
-                                - (int) data_layer->r_mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-            }
-        }
-    } else if ((img->bpp == 1) && (data_layer->c == 3)) { // GS to RGB88
-        int mean = (int) ((0.30f * data_layer->r_mean) +
-                          (0.59f * data_layer->g_mean) +
-                          (0.11f * data_layer->b_mean));
-        for (int y=0, i=0; y<data_layer->h; y++) {
-            int sy = (y*y_ratio)>>16;
-            for (int x=0; x<data_layer->w; x++, i+=3) {
-                int sx = (x*x_ratio)>>16;
-                int p = (int) IMAGE_GET_GRAYSCALE_PIXEL(img, sx+roi->x, sy+roi->y);
-                input_data[i+0] = (q7_t)__SSAT((((p - (int) mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-                input_data[i+1] = (q7_t)__SSAT((((p - (int) mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-                input_data[i+2] = (q7_t)__SSAT((((p - (int) mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-            }
-        }
-    } else if ((img->bpp == 1) && (data_layer->c == 1)) { // GS to GS
-        for (int y=0, i=0; y<data_layer->h; y++) {
-            int sy = (y*y_ratio)>>16;
-            for (int x=0; x<data_layer->w; x++, i++) {
-                int sx = (x*x_ratio)>>16;
-                int p = (int) IMAGE_GET_GRAYSCALE_PIXEL(img, sx+roi->x, sy+roi->y);
-                input_data[i] = (q7_t)__SSAT((((p - (int) data_layer->r_mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-            }
-        }
-    } else if ((img->bpp == 0) && (data_layer->c == 3)) { // BINARY to RGB88
-        int mean = (int) ((0.30f * data_layer->r_mean) +
-                          (0.59f * data_layer->g_mean) +
-                          (0.11f * data_layer->b_mean));
-        for (int y=0, i=0; y<data_layer->h; y++) {
-            int sy = (y*y_ratio)>>16;
-            for (int x=0; x<data_layer->w; x++, i+=3) {
-                int sx = (x*x_ratio)>>16;
-                int p = (int) COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL(img, sx+roi->x, sy+roi->y));
-                input_data[i+0] = (q7_t)__SSAT((((p - (int) mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-                input_data[i+1] = (q7_t)__SSAT((((p - (int) mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-                input_data[i+2] = (q7_t)__SSAT((((p - (int) mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
-            }
-        }
-    } else if ((img->bpp == 0) && (data_layer->c == 1)) { // BINARY to GS
-        for (int y=0, i=0; y<data_layer->h; y++) {
-            int sy = (y*y_ratio)>>16;
-            for (int x=0; x<data_layer->w; x++, i++) {
-                int sx = (x*x_ratio)>>16;
-                int p = (int) COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL(img, sx+roi->x, sy+roi->y));
-                input_data[i] = (q7_t)__SSAT((((p - (int) data_layer->r_mean)<<7) + (1<<(input_scale-1))) >> input_scale, 8);
+    nn_transform_input_rows(data_layer, img, input_data, roi, 0, data_layer->h);
+}
+
+// Picks the CMSIS-NN kernel for a convolution layer, one of the two functions is set.
+static void nn_conv_func(layer_t *prev_layer, conv_layer_t *conv_layer,
+                         conv_func_t *conv_func, conv_func_nonsquare_t *conv_func_nonsquare)
+{
+    *conv_func = NULL;
+    *conv_func_nonsquare = NULL;
+
+    if (conv_layer->type == LAYER_TYPE_DW_CONV) {
+        if (prev_layer->w == prev_layer->h) {
+            *conv_func = arm_depthwise_separable_conv_HWC_q7;
+        } else {
+            *conv_func_nonsquare = arm_depthwise_separable_conv_HWC_q7_nonsquare;
+        }
+    } else if (conv_layer->type == LAYER_TYPE_PW_CONV) {
+        *conv_func_nonsquare = arm_convolve_1x1_HWC_q7_fast_nonsquare;
+    } else if (prev_layer->c % 4 != 0 ||
+        conv_layer->n % 2 != 0 || prev_layer->h % 2 != 0) {
+        if (prev_layer->c == 3) {
+            *conv_func = arm_convolve_HWC_q7_RGB;
+        } else if (prev_layer->w == prev_layer->h) {
+            *conv_func = arm_convolve_HWC_q7_basic;
+        } else {
+            *conv_func_nonsquare = arm_convolve_HWC_q7_basic_nonsquare;
+        }
+    } else {
+        if (prev_layer->w == prev_layer->h) {
+            *conv_func = arm_convolve_HWC_q7_fast;
+        } else {
+            *conv_func_nonsquare = arm_convolve_HWC_q7_fast_nonsquare;
+        }
+    }
+}
+
+// TFLite's MultiplyByQuantizedMultiplier(), bit exact with the reference kernels.
+static inline int32_t nn_requantize(int32_t acc, int32_t mult, int32_t shift)
+{
+    int32_t left_shift = (shift > 0) ? shift : 0;
+    int32_t right_shift = (shift > 0) ? 0 : -shift;
+    int32_t a = acc * (1 << left_shift);
+
+    // Saturating rounding doubling high multiply.
+    int32_t x;
+    if ((a == INT32_MIN) && (mult == INT32_MIN)) {
+        x = INT32_MAX;
+    } else {
+        int64_t ab = ((int64_t) a) * mult;
+        x = (int32_t) ((ab + ((ab >= 0) ? (1 << 30) : (1 - (1 << 30)))) / (1ll << 31));
+    }
+
+    // Rounding divide by power of two.
+    int32_t mask = (1 << right_shift) - 1;
+    int32_t remainder = x & mask;
+    int32_t threshold = (mask >> 1) + (x < 0);
+    return (x >> right_shift) + (remainder > threshold);
+}
+
+static inline int32_t nn_qdot(const q15_t *in, const q7_t *wt, int len, int32_t acc)
+{
+    int i = 0;
+    for (; i < (len - 3); i += 4) {
+        acc += (in[i + 0] * wt[i + 0]) + (in[i + 1] * wt[i + 1]) + (in[i + 2] * wt[i + 2]) + (in[i + 3] * wt[i + 3]);
+    }
+    for (; i < len; i++) {
+        acc += in[i] * wt[i];
+    }
+    return acc;
+}
+
+static inline q7_t nn_qoutput(qlayer_t *qlayer, int32_t acc, int channel)
+{
+    int32_t out = nn_requantize(acc, qlayer->mult[channel], qlayer->shift[channel]) + qlayer->out_offset;
+    return IM_MIN(IM_MAX(out, qlayer->act_min), qlayer->act_max);
+}
+
+// Output pixels are computed from one im2col row of offset inputs, padding adds nothing since
+// it's the input zero point (like in TFLite). The input is in_h rows starting pad_y rows above
+// the first output row (a row tile of the input when tiled).
+static void nn_qconv(const q7_t *in, int in_w, int in_h, int in_c, int pad_y,
+                     qlayer_t *qlayer, q7_t *out, int out_h, q15_t *col_buffer)
+{
+    int k = qlayer->krn_dim, pad = qlayer->krn_pad, str = qlayer->krn_str;
+    int len = k * k * in_c;
+
+    for (int oy = 0; oy < out_h; oy++) {
+        for (int ox = 0; ox < qlayer->w; ox++) {
+            q15_t *col = col_buffer;
+            for (int ky = 0, iy = (oy * str) - pad_y; ky < k; ky++, iy++) {
+                for (int kx = 0, ix = (ox * str) - pad; kx < k; kx++, ix++) {
+                    if ((iy < 0) || (iy >= in_h) || (ix < 0) || (ix >= in_w)) {
+                        memset(col, 0, in_c * sizeof(q15_t));
+                    } else {
+                        const q7_t *ptr = in + (((iy * in_w) + ix) * in_c);
+                        for (int c = 0; c < in_c; c++) {
+                            col[c] = ptr[c] + qlayer->in_offset;
+                        }
+                    }
+                    col += in_c;
+                }
+            }
+
+            for (int oc = 0; oc < qlayer->c; oc++) {
+                *out++ = nn_qoutput(qlayer, nn_qdot(col_buffer, qlayer->wt + (oc * len), len, qlayer->bias[oc]), oc);
+            }
+        }
+    }
+}
+
+static void nn_qfully_connected(const q7_t *in, layer_t *prev_layer, qlayer_t *qlayer, q7_t *out, q15_t *col_buffer)
+{
+    int len = prev_layer->c * prev_layer->h * prev_layer->w;
+
+    for (int i = 0; i < len; i++) {
+        col_buffer[i] = in[i] + qlayer->in_offset;
+    }
+
+    for (int oc = 0; oc < qlayer->c; oc++) {
+        out[oc] = nn_qoutput(qlayer, nn_qdot(col_buffer, qlayer->wt + (oc * len), len, qlayer->bias[oc]), oc);
+    }
+}
+
+// The cycle counter is used to time each layer, reading it costs a couple of cycles.
+static void nn_cycles_init()
+{
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        #if (__CORTEX_M == 7U)
+        DWT->LAR = 0xC5ACCE55;
+        #endif
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+}
+
+// Runs one layer on a row tile, the input holds rows [in_y, in_y_end) of the previous layer
+// and rows [y, y_end) of the output are written. The nonsquare kernels are used since tiles
+// aren't square and the padding is only added to the image borders the tile touches.
+static void nn_run_tile_layer(layer_t *layer, q7_t *input_buffer, int in_y, int in_y_end,
+                              q7_t *output_buffer, int y, int y_end, q7_t *col_buffer)
+{
+    layer_t *prev_layer = layer->prev;
+    int k, s, p;
+    nn_krn_params(layer, &k, &s, &p);
+    int pad_top = IM_MAX(p - (y * s), 0);
+    int pad_bottom = IM_MAX(((y_end - 1) * s) - p + k - (int) prev_layer->h, 0);
+
+    switch (layer->type) {
+        case LAYER_TYPE_CONV:
+        case LAYER_TYPE_DW_CONV:
+        case LAYER_TYPE_PW_CONV: {
+            conv_func_nonsquare_t conv_func_nonsquare = NULL;
+            conv_layer_t *conv_layer = (conv_layer_t *) layer;
+            if (layer->type == LAYER_TYPE_DW_CONV) {
+                conv_func_nonsquare = arm_depthwise_separable_conv_HWC_q7_nonsquare;
+            } else if (layer->type == LAYER_TYPE_PW_CONV) {
+                conv_func_nonsquare = arm_convolve_1x1_HWC_q7_fast_nonsquare;
+            } else if ((prev_layer->c % 4 == 0) && (conv_layer->c % 2 == 0) && (pad_top == pad_bottom)) {
+                // The fast kernel only checks the borders in the padding rows, so it needs the
+                // same padding at the top and the bottom of the tile.
+                conv_func_nonsquare = arm_convolve_HWC_q7_fast_nonsquare;
+            } else {
+                conv_func_nonsquare = arm_convolve_HWC_q7_basic_nonsquare;
             }
+            conv_func_nonsquare(input_buffer, prev_layer->w, in_y_end - in_y, prev_layer->c, conv_layer->wt, conv_layer->c,
+                    conv_layer->krn_dim, conv_layer->krn_dim, conv_layer->krn_pad, pad_top, conv_layer->krn_str,
+                    conv_layer->krn_str, conv_layer->bias, conv_layer->l_shift, conv_layer->r_shift, output_buffer,
+                    conv_layer->w, y_end - y, (q15_t*)col_buffer, NULL);
+            break;
+        }
+
+        case LAYER_TYPE_QCONV: {
+            nn_qconv(input_buffer, prev_layer->w, in_y_end - in_y, prev_layer->c, pad_top,
+                    (qlayer_t *) layer, output_buffer, y_end - y, (q15_t *) col_buffer);
+            break;
+        }
+
+        case LAYER_TYPE_RELU: {
+            arm_relu_q7(input_buffer, (y_end - y) * layer->w * layer->c);
+            break;
+        }
+
+        case LAYER_TYPE_POOL: {
+            pool_layer_t *pool_layer = (pool_layer_t *) layer;
+            pool_func_nonsquare_t pool_func_nonsquare = (pool_layer->ptype == POOL_TYPE_MAX)
+                ? arm_maxpool_q7_HWC_nonsquare : arm_avepool_q7_HWC_nonsquare;
+            pool_func_nonsquare(input_buffer, prev_layer->w, in_y_end - in_y, prev_layer->c, pool_layer->krn_dim,
+                    0, pool_layer->krn_str, layer->w, y_end - y, col_buffer, output_buffer);
+            break;
         }
     }
 }
 
+// Runs the layers up to the tile layer in row tiles of tile_h output rows, each tile recomputes
+// the rows it needs from the input image. Returns the tile layer output.
+static q7_t *nn_run_tiles(nn_t *net, image_t *img, rectangle_t *roi, q7_t *scratch,
+                          q7_t *col_buffer, int n_layers, int tile_h, int *rows)
+{
+    layer_t *tile_layer = net->tile_layer;
+    q7_t *tile_output = nn_output_layer(tile_layer) ? net->output_data : scratch;
+    uint32_t tile_size = nn_tile_size(net, n_layers, tile_h, rows);
+    q7_t *tile_buffer = fb_alloc(tile_size, FB_ALLOC_NO_HINT);
+
+    for (layer_t *layer = net->layers; layer != tile_layer->next; layer = layer->next) {
+        layer->cycles = 0;
+    }
+
+    for (int y = 0; y < tile_layer->h; y += tile_h) {
+        nn_tile_rows(net, n_layers, y, IM_MIN(y + tile_h, tile_layer->h), rows);
+        q7_t *input_buffer = NULL;
+        layer_t *layer = net->layers;
+
+        for (int i = 0; i < n_layers; i++, layer = layer->next) {
+            uint32_t cycles = DWT->CYCCNT;
+            int y_start = rows[(2 * i) + 0], y_end = rows[(2 * i) + 1];
+            uint32_t row_size = layer->w * layer->c;
+            q7_t *output_buffer;
+
+            if (layer == tile_layer) {
+                output_buffer = tile_output + (y_start * row_size);
+            } else if (layer->type == LAYER_TYPE_RELU) {
+                output_buffer = input_buffer;
+            } else if (input_buffer == tile_buffer) {
+                output_buffer = tile_buffer + tile_size - ((y_end - y_start) * row_size);
+            } else {
+                output_buffer = tile_buffer;
+            }
+
+            if (layer->type == LAYER_TYPE_DATA) {
+                nn_transform_input_rows((data_layer_t *) layer, img, output_buffer, roi, y_start, y_end);
+            } else {
+                nn_run_tile_layer(layer, input_buffer, rows[(2 * i) - 2], rows[(2 * i) - 1],
+                                  output_buffer, y_start, y_end, col_buffer);
+            }
+
+            layer->cycles += DWT->CYCCNT - cycles;
+            input_buffer = output_buffer;
+        }
+    }
+
+    fb_free(); // tile_buffer
+    return tile_output;
+}
+
+// fb_alloc memory nn_transform_input() needs on top of the activations.
+static uint32_t nn_input_scratch(layer_t *data_layer)
+{
+    nn_input_t input;
+    nn_data_layer_input((data_layer_t *) data_layer, &input);
+    return nn_input_prepare_size(&input);
+}
+
 int nn_run_network(nn_t *net, image_t *img, rectangle_t *roi, bool softmax)
 {
-    uint32_t layer_idx = 0;
     layer_t *layer = net->layers;
 
     if (layer == NULL) {
@@ -359,50 +797,60 @@ int nn_run_network(nn_t *net, image_t *img, rectangle_t *roi, bool softmax)
         return -1;
     }
 
-    q7_t *input_data    = NULL;
     q7_t *input_buffer  = NULL;
     q7_t *output_buffer = NULL;
 
     fb_alloc_mark();
 
-    q7_t *buffer1     = fb_alloc(net->max_scrbuf_size, FB_ALLOC_NO_HINT);
-    q7_t *buffer2     = buffer1 + net->max_layer_size;
+    // Run the first layers in row tiles if the whole scratch buffer doesn't fit, the tiles are
+    // made as tall as the remaining memory allows.
+    int n_layers = 0, tile_h = 0, *rows = NULL;
+    uint32_t scratch_size = net->max_scrbuf_size;
+    uint32_t needed = net->max_scrbuf_size + net->max_colbuf_size + nn_input_scratch(layer);
+    if (net->tile_layer && (fb_avail() < needed)) {
+        for (layer_t *l = net->layers; l != net->tile_layer->next; l = l->next) {
+            n_layers += 1;
+        }
+
+        rows = fb_alloc(2 * n_layers * sizeof(int), FB_ALLOC_NO_HINT);
+        scratch_size = net->tile_scrbuf_size;
+        needed = scratch_size + net->max_colbuf_size + nn_input_scratch(layer) + 64;
+        for (tile_h = net->tile_layer->h; tile_h > 1; tile_h = (tile_h + 1) / 2) {
+            if ((nn_tile_size(net, n_layers, tile_h, rows) + needed) <= fb_avail()) {
+                break;
+            }
+        }
+    }
+
+    q7_t *scratch     = fb_alloc(scratch_size, FB_ALLOC_NO_HINT);
     q7_t *col_buffer  = fb_alloc(net->max_colbuf_size, FB_ALLOC_NO_HINT);
 
+    nn_cycles_init();
+
+    if (tile_h) {
+        input_buffer = nn_run_tiles(net, img, roi, scratch, col_buffer, n_layers, tile_h, rows);
+        layer = net->tile_layer->next;
+    }
+
     while (layer != NULL) {
         layer_t *prev_layer = layer->prev;
+        uint32_t cycles = DWT->CYCCNT;
+        output_buffer = nn_output_buffer(net, layer, scratch, scratch_size, input_buffer);
 
         switch (layer->type) {
             case LAYER_TYPE_DATA: {
                 data_layer_t *data_layer = (data_layer_t *) layer;
-                input_data = fb_alloc(data_layer->c * data_layer->h * data_layer->w, FB_ALLOC_NO_HINT);
-                nn_transform_input(data_layer, img, input_data, roi);
-                // Set image data as input buffer for the next layer.
-                input_buffer = input_data;
-                output_buffer = buffer1;
+                nn_transform_input(data_layer, img, output_buffer, roi);
                 break;
             }
 
-            case LAYER_TYPE_CONV: {
+            case LAYER_TYPE_CONV:
+            case LAYER_TYPE_DW_CONV:
+            case LAYER_TYPE_PW_CONV: {
                 conv_func_t conv_func = NULL;
                 conv_func_nonsquare_t conv_func_nonsquare = NULL;
                 conv_layer_t *conv_layer = (conv_layer_t *) layer;
-                if (prev_layer->c % 4 != 0 ||
-                    conv_layer->n % 2 != 0 || prev_layer->h % 2 != 0) {
-                    if (prev_layer->c == 3) {
-                        conv_func = arm_convolve_HWC_q7_RGB;
-                    } else if (prev_layer->w == prev_layer->h) {
-                        conv_func = arm_convolve_HWC_q7_basic;
-                    } else {
-                        conv_func_nonsquare = arm_convolve_HWC_q7_basic_nonsquare;
-                    }
-                } else {
-                    if (prev_layer->w == prev_layer->h) {
-                        conv_func = arm_convolve_HWC_q7_fast;
-                    } else {
-                        conv_func_nonsquare = arm_convolve_HWC_q7_fast_nonsquare;
-                    }
-                }
+                nn_conv_func(prev_layer, conv_layer, &conv_func, &conv_func_nonsquare);
                 if (conv_func) {
                     conv_func(input_buffer, prev_layer->h, prev_layer->c, conv_layer->wt, conv_layer->c,
                             conv_layer->krn_dim, conv_layer->krn_pad, conv_layer->krn_str, conv_layer->bias,
@@ -455,27 +903,21 @@ int nn_run_network(nn_t *net, image_t *img, rectangle_t *roi, bool softmax)
                         ip_layer->c, ip_layer->l_shift, ip_layer->r_shift, ip_layer->bias, output_buffer, (q15_t*)col_buffer);
                 break;
             }
-        }
 
-        if (layer_idx++ > 0) {
-            if (input_buffer == input_data) {
-                // Image data has been processed
-                input_buffer = buffer2;
-            }
-
-            if (layer->type != LAYER_TYPE_RELU) {
-                // Switch buffers
-                q7_t *tmp_buffer = input_buffer;
-                input_buffer  = output_buffer;
-                output_buffer = tmp_buffer;
+            case LAYER_TYPE_QCONV: {
+                nn_qconv(input_buffer, prev_layer->w, prev_layer->h, prev_layer->c, ((qlayer_t *) layer)->krn_pad,
+                        (qlayer_t *) layer, output_buffer, layer->h, (q15_t *) col_buffer);
+                break;
             }
 
-            // Last layer
-            if (layer->next && layer->next->next == NULL) {
-                output_buffer = net->output_data;
+            case LAYER_TYPE_QIP: {
+                nn_qfully_connected(input_buffer, prev_layer, (qlayer_t *) layer, output_buffer, (q15_t *) col_buffer);
+                break;
             }
         }
 
+        layer->cycles = DWT->CYCCNT - cycles;
+        input_buffer = output_buffer;
         layer = layer->next;
     }
 
@@ -489,20 +931,22 @@ int nn_run_network(nn_t *net, image_t *img, rectangle_t *roi, bool softmax)
 }
 
 #define BUFFER_2STR(buffer)\
-        (buffer == buffer1)     ? "buffer1":\
-        (buffer == buffer2)     ? "buffer2":\
-        (buffer == input_data)  ? "input_data":\
-        (buffer == net->output_data) ? "output_data": "???"
+        (buffer == scratch)     ? "scratch":\
+        (buffer == net->output_data) ? "output_data":\
+        (buffer != NULL)        ? "scratch_end": "???"
 
 #define CONV_FUNC_2STR(conv_func)\
         (conv_func == arm_convolve_HWC_q7_basic) ? "arm_convolve_HWC_q7_basic" :\
-        (conv_func == arm_convolve_HWC_q7_fast ) ? "arm_convolve_HWC_q7_fast":"arm_convolve_HWC_q7_RGB"
+        (conv_func == arm_convolve_HWC_q7_fast ) ? "arm_convolve_HWC_q7_fast" :\
+        (conv_func == arm_depthwise_separable_conv_HWC_q7) ? "arm_depthwise_separable_conv_HWC_q7":"arm_convolve_HWC_q7_RGB"
 
 #define POOL_FUNC_2STR(pool_func)\
         (pool_func == arm_maxpool_q7_HWC) ? "arm_maxpool_q7_HWC" : "arm_avepool_q7_HWC"
 
 #define CONV_FUNC_NONSQ_2STR(conv_func)\
         (conv_func == arm_convolve_HWC_q7_basic_nonsquare) ? "arm_convolve_HWC_q7_basic_nonsquare":\
+        (conv_func == arm_depthwise_separable_conv_HWC_q7_nonsquare) ? "arm_depthwise_separable_conv_HWC_q7_nonsquare":\
+        (conv_func == arm_convolve_1x1_HWC_q7_fast_nonsquare) ? "arm_convolve_1x1_HWC_q7_fast_nonsquare":\
         "arm_convolve_HWC_q7_fast_nonsquare"
 
 #define POOL_FUNC_NONSQ_2STR(pool_func)\
@@ -510,7 +954,6 @@ int nn_run_network(nn_t *net, image_t *img, rectangle_t *roi, bool softmax)
 
 int nn_dry_run_network(nn_t *net, image_t *img, bool softmax)
 {
-    uint32_t layer_idx = 0;
     layer_t *layer = net->layers;
 
     if (layer == NULL) {
@@ -523,46 +966,29 @@ int nn_dry_run_network(nn_t *net, image_t *img, bool softmax)
         return -1;
     }
 
-    q7_t *input_data    = NULL;
     q7_t *input_buffer  = NULL;
     q7_t *output_buffer = NULL;
 
     fb_alloc_mark();
 
-    q7_t *buffer1     = fb_alloc(net->max_scrbuf_size, FB_ALLOC_NO_HINT);
-    q7_t *buffer2     = buffer1 + net->max_layer_size;
+    q7_t *scratch     = fb_alloc(net->max_scrbuf_size, FB_ALLOC_NO_HINT);
 
     while (layer != NULL) {
         layer_t *prev_layer = layer->prev;
+        output_buffer = nn_output_buffer(net, layer, scratch, net->max_scrbuf_size, input_buffer);
         switch (layer->type) {
             case LAYER_TYPE_DATA: {
-                data_layer_t *data_layer = (data_layer_t *) layer;
-                // Set image data as input buffer for the next layer.
-                input_buffer = input_data = fb_alloc(data_layer->c * data_layer->h * data_layer->w, FB_ALLOC_NO_HINT);
-                output_buffer = buffer1;
+                // The image data is the output of this layer.
                 break;
             }
 
-            case LAYER_TYPE_CONV: {
+            case LAYER_TYPE_CONV:
+            case LAYER_TYPE_DW_CONV:
+            case LAYER_TYPE_PW_CONV: {
                 conv_func_t conv_func = NULL;
                 conv_func_nonsquare_t conv_func_nonsquare = NULL;
                 conv_layer_t *conv_layer = (conv_layer_t *) layer;
-                if (prev_layer->c % 4 != 0 ||
-                    conv_layer->n % 2 != 0 || prev_layer->h % 2 != 0) {
-                    if (prev_layer->c == 3) {
-                        conv_func = arm_convolve_HWC_q7_RGB;
-                    } else if (prev_layer->w == prev_layer->h) {
-                        conv_func = arm_convolve_HWC_q7_basic;
-                    } else {
-                        conv_func_nonsquare = arm_convolve_HWC_q7_basic_nonsquare;
-                    }
-                } else {
-                    if (prev_layer->w == prev_layer->h) {
-                        conv_func = arm_convolve_HWC_q7_fast;
-                    } else {
-                        conv_func_nonsquare = arm_convolve_HWC_q7_fast_nonsquare;
-                    }
-                }
+                nn_conv_func(prev_layer, conv_layer, &conv_func, &conv_func_nonsquare);
 
                 if (conv_func) {
                     printf("forward: %s(%s, %lu, %lu, %s, %lu, %lu, %lu, %lu, %s, %lu, %lu, %s, %lu, %s, %p);\n",
@@ -628,27 +1054,24 @@ int nn_dry_run_network(nn_t *net, image_t *img, bool softmax)
                         ip_layer->c, ip_layer->l_shift, ip_layer->r_shift, "ip_bias", BUFFER_2STR(output_buffer), "col_buffer");
                 break;
             }
-        }
-
-        if (layer_idx++ > 0) {
-            if (input_buffer == input_data) {
-                // Image data has been processed
-                input_buffer = buffer2;
-            }
 
-            if (layer->type != LAYER_TYPE_RELU) {
-                // Switch buffers
-                q7_t *tmp_buffer = input_buffer;
-                input_buffer  = output_buffer;
-                output_buffer = tmp_buffer;
+            case LAYER_TYPE_QCONV: {
+                printf("forward: nn_qconv(%s, %lu, %lu, %lu, %lu, %lu, %lu, %lu, %s);\n",
+                        BUFFER_2STR(input_buffer), prev_layer->w, prev_layer->h, prev_layer->c, layer->c,
+                        ((qlayer_t *) layer)->krn_dim, ((qlayer_t *) layer)->krn_pad, ((qlayer_t *) layer)->krn_str,
+                        BUFFER_2STR(output_buffer));
+                break;
             }
 
-            // Last layer
-            if (layer->next && layer->next->next == NULL) {
-                output_buffer = net->output_data;
+            case LAYER_TYPE_QIP: {
+                printf("forward: nn_qfully_connected(%s, %lu, %lu, %s);\n",
+                        BUFFER_2STR(input_buffer), prev_layer->c * prev_layer->h * prev_layer->w, layer->c,
+                        BUFFER_2STR(output_buffer));
+                break;
             }
         }
-        
+
+        input_buffer = output_buffer;
         layer = layer->next;
     }
 
@@ -656,4 +1079,22 @@ int nn_dry_run_network(nn_t *net, image_t *img, bool softmax)
     printf("\n");
     return 0;
 }
+
+// Runs an nn_t model, without softmax.
+static int nn_backend_run(void *model, image_t *img, rectangle_t *roi, nn_output_cb_t cb, void *arg)
+{
+    nn_t *net = (nn_t *) model;
+    int ret = nn_run_network(net, img, roi, false);
+
+    if (!ret) {
+        nn_output_t output = {
+            .data = net->output_data, .w = 1, .h = 1, .c = net->output_size, .is_float = false, .is_signed = true
+        };
+        cb(arg, roi, &output);
+    }
+
+    return ret;
+}
+
+const nn_backend_t nn_backend_cmsis = { "CMSIS-NN", 1, nn_backend_run };
 #endif //IMLIB_ENABLE_CNN
@@ -12,12 +12,17 @@
 #define __NN_H__
 #include <stdint.h>
 #include <imlib.h>
+#include "nn_backend.h"
 typedef enum {
     LAYER_TYPE_DATA = 0,
     LAYER_TYPE_CONV,
     LAYER_TYPE_RELU,
     LAYER_TYPE_POOL,
     LAYER_TYPE_IP,
+    LAYER_TYPE_DW_CONV, // Depthwise, the conv layer format with one filter per channel.
+    LAYER_TYPE_PW_CONV, // Pointwise, the conv layer format with 1x1 filters.
+    LAYER_TYPE_QCONV,   // TFLite int8 convolution with per-channel requantization.
+    LAYER_TYPE_QIP,     // TFLite int8 fully connected with per-channel requantization.
 } layer_type_t;
 
 typedef enum {
@@ -32,6 +37,8 @@ typedef enum {
 #define NN_LAYER_BASE   \
     uint32_t type;      \
     uint32_t n, c, h, w;\
+    uint32_t scratch;   \
+    uint32_t cycles;    \
     struct _layer *prev;\
     struct _layer *next \
 
@@ -80,6 +87,24 @@ typedef struct {
     int8_t *wt, *bias;
 } ip_layer_t;
 
+// Per-channel quantized (TFLite int8) layer, QIP layers have no kernel. Outputs are
+// ((sum((in + in_offset) * wt) + bias) * mult >> shift) + out_offset clamped to act_min/act_max,
+// where mult is Q31 and shift > 0 is a left shift (like TFLite's quantized multipliers).
+typedef struct {
+    NN_LAYER_BASE;
+    int32_t in_offset;
+    int32_t out_offset;
+    int32_t act_min;
+    int32_t act_max;
+    uint32_t krn_dim;
+    uint32_t krn_str;
+    uint32_t krn_pad;
+    uint32_t w_size;
+    uint32_t b_size;
+    int8_t *wt;
+    int32_t *bias, *mult, *shift;
+} qlayer_t;
+
 typedef struct {
     uint8_t  type[4];
     uint32_t n_layers;
@@ -88,6 +113,10 @@ typedef struct {
     uint32_t max_layer_size;
     uint32_t max_colbuf_size;
     uint32_t max_scrbuf_size;
+    // When the scratch buffer doesn't fit, the layers up to tile_layer run in row tiles and
+    // the rest of the network only needs tile_scrbuf_size bytes (NULL if tiling can't help).
+    layer_t *tile_layer;
+    uint32_t tile_scrbuf_size;
     layer_t *layers;
 } nn_t;
 
@@ -111,6 +140,8 @@ typedef void (*pool_func_nonsquare_t)(q7_t * Im_in, const uint16_t dim_im_in_x,
         const uint16_t dim_im_out_x, const uint16_t dim_im_out_y, q7_t * bufferA, q7_t * Im_out);
 
 
+// Layer scratch is the column buffer bytes it needs and cycles is its time in the last run.
+const char *layer_to_str(layer_type_t type);
 int nn_dump_network(nn_t *net);
 int nn_load_network(nn_t *net, const char *path);
 int nn_run_network(nn_t *net, image_t *img, rectangle_t *roi, bool softmax);
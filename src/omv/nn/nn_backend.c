@@ -0,0 +1,252 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Common interface of the inference backends.
+ */
+#include <math.h>
+#include "fb_alloc.h"
+#include "nn_backend.h"
+
+#ifndef __SSAT
+#define __SSAT(a, b) ({ __typeof__ (a) _a = (a); \
+                        __typeof__ (b) _b = (b); \
+                        _b = 1 << (_b - 1); \
+                        _a = _a < (_b - 1) ? _a : (_b - 1); \
+                        _a > (-_b) ? _a : (-_b); })
+#endif
+
+// Unpacks a resampled line to 8-bit grayscale or RGB888 channels.
+static void nn_input_unpack(int bpp, void *line, int w, int c, uint8_t *out)
+{
+    switch (bpp) {
+        case IMAGE_BPP_BINARY: {
+            for (int x = 0; x < w; x++, out += c) {
+                int p = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST((uint32_t *) line, x));
+                out[0] = p;
+                if (c == 3) {
+                    out[1] = out[2] = p;
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            if (c == 1) {
+                memcpy(out, line, w);
+            } else {
+                for (int x = 0; x < w; x++, out += 3) {
+                    out[0] = out[1] = out[2] = ((uint8_t *) line)[x];
+                }
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            if (c == 1) {
+                for (int x = 0; x < w; x++) {
+                    out[x] = COLOR_RGB565_TO_GRAYSCALE(((uint16_t *) line)[x]);
+                }
+            } else {
+                for (int x = 0; x < w; x++, out += 3) {
+                    int p = ((uint16_t *) line)[x];
+                    out[0] = COLOR_RGB565_TO_R8(p);
+                    out[1] = COLOR_RGB565_TO_G8(p);
+                    out[2] = COLOR_RGB565_TO_B8(p);
+                }
+            }
+            break;
+        }
+        default: {
+            memset(out, 0, w * c);
+            break;
+        }
+    }
+}
+
+uint32_t nn_input_prepare_size(const nn_input_t *input)
+{
+    return ((input->w + input->h) * sizeof(resample_tap_t))
+         + (input->w * sizeof(uint16_t)) + sizeof(uint32_t) + (input->w * input->c) + 64;
+}
+
+void nn_input_prepare(const nn_input_t *input, image_t *img, rectangle_t *roi, void *data, int y_start, int y_end)
+{
+    rectangle_t src = *roi;
+
+    if ((input->c != 1) && (input->c != 3)) {
+        return;
+    }
+
+    if (input->keep_aspect) {
+        // KeepAspectRatioByExpanding, the roi is cropped to the input aspect ratio.
+        float scale = IM_MAX(input->w / ((float) roi->w), input->h / ((float) roi->h));
+        src.w = IM_MIN(IM_MAX(fast_roundf(input->w / scale), 1), roi->w);
+        src.h = IM_MIN(IM_MAX(fast_roundf(input->h / scale), 1), roi->h);
+        src.x = roi->x + ((roi->w - src.w) / 2);
+        src.y = roi->y + ((roi->h - src.h) / 2);
+    }
+
+    // Grayscale sources are compared to the grayscale of the mean on all channels.
+    int mean[3];
+    if ((input->c == 3) && (img->bpp != IMAGE_BPP_RGB565)) {
+        mean[0] = mean[1] = mean[2] = (int) ((0.30f * input->mean[0]) + (0.59f * input->mean[1]) + (0.11f * input->mean[2]));
+    } else {
+        for (int i = 0; i < 3; i++) {
+            mean[i] = (int) input->mean[i];
+        }
+    }
+
+    fb_alloc_mark();
+
+    resample_t r;
+    imlib_resample_init(&r, img, &src, input->w, input->h, input->hint);
+    void *line = fb_alloc((input->w * sizeof(uint16_t)) + sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    int n = input->w * input->c;
+    // 8-bit inputs are unpacked in place.
+    uint8_t *chan = ((input->type == NN_INPUT_UINT8) || (input->type == NN_INPUT_INT8))
+        ? NULL : fb_alloc(n, FB_ALLOC_NO_HINT);
+
+    for (int y = y_start; y < y_end; y++) {
+        imlib_resample_line(&r, y, line);
+
+        switch (input->type) {
+            case NN_INPUT_UINT8: {
+                uint8_t *out = ((uint8_t *) data) + ((y - y_start) * n);
+                nn_input_unpack(img->bpp, line, input->w, input->c, out);
+                break;
+            }
+            case NN_INPUT_INT8: {
+                uint8_t *out = ((uint8_t *) data) + ((y - y_start) * n);
+                nn_input_unpack(img->bpp, line, input->w, input->c, out);
+                for (int i = 0; i < n; i++) {
+                    out[i] ^= 0x80;
+                }
+                break;
+            }
+            case NN_INPUT_FLOAT: {
+                float *out = ((float *) data) + ((y - y_start) * n);
+                float scale = input->scale;
+                nn_input_unpack(img->bpp, line, input->w, input->c, chan);
+                if (input->c == 1) {
+                    for (int i = 0; i < n; i++) {
+                        out[i] = (chan[i] - mean[0]) * scale;
+                    }
+                } else {
+                    for (int i = 0; i < n; i += 3) {
+                        out[i + 0] = (chan[i + 0] - mean[0]) * scale;
+                        out[i + 1] = (chan[i + 1] - mean[1]) * scale;
+                        out[i + 2] = (chan[i + 2] - mean[2]) * scale;
+                    }
+                }
+                break;
+            }
+            case NN_INPUT_Q7: {
+                int8_t *out = ((int8_t *) data) + ((y - y_start) * n);
+                int shift = input->shift, round = 1 << (shift - 1);
+                nn_input_unpack(img->bpp, line, input->w, input->c, chan);
+                if (input->c == 1) {
+                    for (int i = 0; i < n; i++) {
+                        out[i] = __SSAT((((chan[i] - mean[0]) << 7) + round) >> shift, 8);
+                    }
+                } else {
+                    for (int i = 0; i < n; i += 3) {
+                        out[i + 0] = __SSAT((((chan[i + 0] - mean[0]) << 7) + round) >> shift, 8);
+                        out[i + 1] = __SSAT((((chan[i + 1] - mean[1]) << 7) + round) >> shift, 8);
+                        out[i + 2] = __SSAT((((chan[i + 2] - mean[2]) << 7) + round) >> shift, 8);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    fb_alloc_free_till_mark();
+}
+
+float nn_output_value(const nn_output_t *output, int i)
+{
+    if (!output->is_float) {
+        return (((uint8_t *) output->data)[i] ^ (output->is_signed ? 0x80 : 0)) / 255.0f;
+    } else if (output->is_signed) {
+        return ((((float *) output->data)[i] * 127.0f) + 128.0f) / 255.0f;
+    } else {
+        return ((float *) output->data)[i];
+    }
+}
+
+int nn_output_argmax(const nn_output_t *output, int c, float threshold, float *score)
+{
+    int index = -1;
+    *score = -1.0f;
+
+    for (int i = 0; i < c; i++) {
+        float value = nn_output_value(output, i);
+        if ((value >= threshold) && (value > *score)) {
+            index = i;
+            *score = value;
+        }
+    }
+
+    return index;
+}
+
+nn_model_t *nn_model_pick(nn_model_t *models, int n)
+{
+    nn_model_t *model = NULL;
+
+    for (int i = 0; i < n; i++) {
+        if (models[i].backend && ((!model) || (models[i].backend->rank < model->backend->rank))) {
+            model = &models[i];
+        }
+    }
+
+    return model;
+}
+
+int nn_model_run(nn_model_t *model, image_t *img, rectangle_t *roi, nn_output_cb_t cb, void *arg)
+{
+    return model->backend->run(model->model, img, roi, cb, arg);
+}
+
+int nn_model_run_windows(nn_model_t *model, image_t *img, rectangle_t *roi, const nn_windows_t *windows,
+                         nn_output_cb_t cb, void *arg)
+{
+    float x_overlap = windows->x_overlap, y_overlap = windows->y_overlap;
+
+    for (float scale = 1.0f; scale >= windows->min_scale; scale *= windows->scale_mul) {
+        // Either provide a subtle offset to center multiple detection windows or center the only detection window.
+        for (int y = roi->y + ((y_overlap != -1.0f) ? (fmodf(roi->h, (roi->h * scale)) / 2.0f) : ((roi->h - (roi->h * scale)) / 2.0f));
+            // Finish when the detection window is outside of the ROI.
+            (y + (roi->h * scale)) <= (roi->y + roi->h);
+            // Step by an overlap amount accounting for scale or just terminate after one iteration.
+            y += ((y_overlap != -1.0f) ? (roi->h * scale * (1.0f - y_overlap)) : roi->h)) {
+            // Either provide a subtle offset to center multiple detection windows or center the only detection window.
+            for (int x = roi->x + ((x_overlap != -1.0f) ? (fmodf(roi->w, (roi->w * scale)) / 2.0f) : ((roi->w - (roi->w * scale)) / 2.0f));
+                // Finish when the detection window is outside of the ROI.
+                (x + (roi->w * scale)) <= (roi->x + roi->w);
+                // Step by an overlap amount accounting for scale or just terminate after one iteration.
+                x += ((x_overlap != -1.0f) ? (roi->w * scale * (1.0f - x_overlap)) : roi->w)) {
+
+                rectangle_t window;
+                rectangle_init(&window, x, y, roi->w * scale, roi->h * scale);
+
+                // Out of time, the windows run so far have been reported.
+                if (imlib_deadline_expired()) {
+                    return 0;
+                }
+
+                if (rectangle_overlap(roi, &window)) { // Check if window is null...
+                    int ret = nn_model_run(model, img, &window, cb, arg);
+                    if (ret) {
+                        return ret;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Common interface of the inference backends (CMSIS-NN, TensorFlow Lite and Cube.AI).
+ */
+#ifndef __NN_BACKEND_H__
+#define __NN_BACKEND_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <imlib.h>
+
+typedef enum {
+    NN_INPUT_UINT8,     // [0:255]
+    NN_INPUT_INT8,      // [0:255]->[-128:127]
+    NN_INPUT_FLOAT,     // (pixel - mean) * scale
+    NN_INPUT_Q7,        // ((pixel - mean) << 7) >> shift, rounded and saturated
+} nn_input_type_t;
+
+// Model input, laid out in [height][width][channel] order with 1 (grayscale) or 3 (RGB) channels.
+typedef struct nn_input {
+    int w, h, c;
+    nn_input_type_t type;
+    int hint;           // Resampling hint (IMAGE_HINT_BILINEAR/IMAGE_HINT_AREA) or 0 for nearest.
+    bool keep_aspect;   // Center crops the roi to the input aspect ratio instead of stretching it.
+    float mean[3];      // Per channel mean, 1 channel inputs use the first one.
+    float scale;        // NN_INPUT_FLOAT only.
+    int shift;          // NN_INPUT_Q7 only.
+} nn_input_t;
+
+// Model output, laid out in [height][width][channel] order.
+typedef struct nn_output {
+    const void *data;
+    int w, h, c;
+    bool is_float;
+    bool is_signed;     // int8_t ([-128:127]) or float ([-1.0f:+1.0f]) instead of uint8_t or float ([0.0f:1.0f]).
+} nn_output_t;
+
+// Called with the output of each run, the output is only valid during the call.
+typedef void (*nn_output_cb_t)(void *arg, rectangle_t *roi, const nn_output_t *output);
+
+typedef struct nn_backend {
+    const char *name;
+    int rank;           // Lower is faster, used to pick between formats of the same model.
+    // Prepares the input from the roi, runs the model and calls cb with the output. Returns 0 on success.
+    int (*run)(void *model, image_t *img, rectangle_t *roi, nn_output_cb_t cb, void *arg);
+} nn_backend_t;
+
+typedef struct nn_model {
+    const nn_backend_t *backend;
+    void *model;
+} nn_model_t;
+
+// Backends, each one runs the model objects of its module.
+extern const nn_backend_t nn_backend_st;    // stnn_t (nn_st module, compiled Cube.AI networks).
+extern const nn_backend_t nn_backend_cmsis; // nn_t (nn module).
+extern const nn_backend_t nn_backend_tf;    // py_tf_model_obj_t (tf module), needs the putchar buffer.
+
+// Sliding windows at decreasing scales, see nn_model_run_windows().
+typedef struct nn_windows {
+    float min_scale;
+    float scale_mul;
+    float x_overlap;    // -1 for a single centered window.
+    float y_overlap;    // -1 for a single centered window.
+} nn_windows_t;
+
+// fb_alloc memory nn_input_prepare() needs (with some slack for the fb_alloc alignment).
+uint32_t nn_input_prepare_size(const nn_input_t *input);
+// Writes rows [y_start, y_end) of the model input for the roi, data points to the first of them.
+void nn_input_prepare(const nn_input_t *input, image_t *img, rectangle_t *roi, void *data, int y_start, int y_end);
+// Output element i scaled to [0.0f:1.0f].
+float nn_output_value(const nn_output_t *output, int i);
+// Returns the index of the highest of the first c outputs at or above threshold, or -1.
+int nn_output_argmax(const nn_output_t *output, int c, float threshold, float *score);
+
+// Returns the fastest of the n models (the ones without a backend are skipped), or NULL.
+nn_model_t *nn_model_pick(nn_model_t *models, int n);
+int nn_model_run(nn_model_t *model, image_t *img, rectangle_t *roi, nn_output_cb_t cb, void *arg);
+// Runs the model on each window of the roi, stops at the first error.
+int nn_model_run_windows(nn_model_t *model, image_t *img, rectangle_t *roi, const nn_windows_t *windows,
+                         nn_output_cb_t cb, void *arg);
+#endif // __NN_BACKEND_H__
@@ -36,6 +36,14 @@
 #define HSYNC_TIME              252
 #define VYSNC_TIME              24
 
+#define AF_FW_CHUNK             256
+#define AF_FW_TIMEOUT           1000 // ms
+#define AF_CMD_TIMEOUT          100  // ms
+#define AF_ZONE_WIDTH           80
+#define AF_ZONE_HEIGHT          60
+
+static bool af_ready = false;
+
 static int16_t readout_x = 0;
 static int16_t readout_y = 0;
 
@@ -363,6 +371,9 @@ static const uint8_t saturation_regs[NUM_SATURATION_LEVELS][6] = {
 
 static int reset(sensor_t *sensor)
 {
+    // The AF MCU is reset too, the firmware has to be loaded again.
+    af_ready = false;
+
     readout_x = 0;
     readout_y = 0;
 
@@ -376,10 +387,8 @@ static int reset(sensor_t *sensor)
     // Delay 5 ms
     systick_sleep(5);
 
-    // Write default regsiters
-    for (int i = 0; default_regs[i][0]; i++) {
-        ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, (default_regs[i][0] << 8) | (default_regs[i][1] << 0), default_regs[i][2]);
-    }
+    // Write default regsiters (contiguous registers are written in bursts)
+    ret |= cambus_writeb2_table(&sensor->i2c, sensor->slv_addr, default_regs);
 
     // Delay 300 ms
     systick_sleep(300);
@@ -888,6 +897,75 @@ static int set_lens_correction(sensor_t *sensor, int enable, int radi, int coef)
     return cambus_writeb2(&sensor->i2c, sensor->slv_addr, ISP_CONTROL_00, (reg & 0x7F) | (enable ? 0x80 : 0x00)) | ret;
 }
 
+static int af_load_firmware(sensor_t *sensor, uint8_t *fw, int len)
+{
+    af_ready = false;
+
+    // Hold the AF MCU in reset while the firmware is written.
+    int ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, SYSTEM_RESET_00, 0x20);
+
+    for (int i = 0; (i < len) && (ret == 0); i += AF_FW_CHUNK) {
+        ret |= cambus_writew_bytes(&sensor->i2c, sensor->slv_addr, AF_FW_ADDR + i, fw + i, IM_MIN(len - i, AF_FW_CHUNK));
+    }
+
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_MAIN, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_ACK, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA0, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA1, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA2, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA3, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA4, 0x00);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_FW_STATUS, AF_STATUS_FW_LOADED);
+
+    // Start the AF MCU.
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, SYSTEM_RESET_00, 0x00);
+
+    if (ret != 0) {
+        return -1;
+    }
+
+    // Wait for the firmware to finish initializing.
+    for (uint32_t tick_start = HAL_GetTick(); ; systick_sleep(1)) {
+        uint8_t reg;
+        if (cambus_readb2(&sensor->i2c, sensor->slv_addr, AF_FW_STATUS, &reg) != 0) {
+            return -1;
+        }
+        if (reg == AF_STATUS_IDLE) {
+            break;
+        }
+        if ((HAL_GetTick() - tick_start) >= AF_FW_TIMEOUT) {
+            return -1;
+        }
+    }
+
+    af_ready = true;
+    return 0;
+}
+
+// Commands are only acknowledged, the focus runs in the background.
+static int af_command(sensor_t *sensor, uint8_t cmd)
+{
+    if (!af_ready) {
+        return -1;
+    }
+
+    int ret = cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_ACK, 0x01);
+    ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_MAIN, cmd);
+
+    for (uint32_t tick_start = HAL_GetTick(); ret == 0; systick_sleep(1)) {
+        uint8_t reg;
+        ret |= cambus_readb2(&sensor->i2c, sensor->slv_addr, AF_CMD_ACK, &reg);
+        if (reg == 0x00) {
+            break;
+        }
+        if ((HAL_GetTick() - tick_start) >= AF_CMD_TIMEOUT) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
 static int ioctl(sensor_t *sensor, int request, va_list ap)
 {
     int ret = 0;
@@ -917,6 +995,69 @@ static int ioctl(sensor_t *sensor, int request, va_list ap)
             *va_arg(ap, int *) = readout_h;
             break;
         }
+        case IOCTL_OV5640_AF_LOAD_FIRMWARE: {
+            uint8_t *fw = va_arg(ap, uint8_t *);
+            int len = va_arg(ap, int);
+            ret = af_load_firmware(sensor, fw, len);
+            break;
+        }
+        case IOCTL_OV5640_AF_TRIGGER: {
+            ret = af_command(sensor, AF_CMD_TRIGGER);
+            break;
+        }
+        case IOCTL_OV5640_AF_CONTINUOUS: {
+            ret = af_command(sensor, va_arg(ap, int) ? AF_CMD_CONTINUOUS : AF_CMD_PAUSE);
+            break;
+        }
+        case IOCTL_OV5640_AF_RELEASE: {
+            ret = af_command(sensor, AF_CMD_RELEASE);
+            break;
+        }
+        case IOCTL_OV5640_AF_ZONE: {
+            // The zone center is given in image coordinates, a negative x resets the default zones.
+            int x = va_arg(ap, int);
+            int y = va_arg(ap, int);
+            if ((x < 0) || (sensor->framesize == FRAMESIZE_INVALID)) {
+                ret = af_command(sensor, AF_CMD_ZONE_DEFAULT);
+                break;
+            }
+            x = IM_MIN((x * AF_ZONE_WIDTH) / resolution[sensor->framesize][0], AF_ZONE_WIDTH - 1);
+            y = IM_MIN((IM_MAX(y, 0) * AF_ZONE_HEIGHT) / resolution[sensor->framesize][1], AF_ZONE_HEIGHT - 1);
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA0, x);
+            ret |= cambus_writeb2(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA1, y);
+            ret |= af_command(sensor, AF_CMD_ZONE);
+            break;
+        }
+        case IOCTL_OV5640_AF_STATUS: {
+            // Returns the AF state and the number of zones in focus (the contrast peak was found).
+            int *state = va_arg(ap, int *);
+            int *zones = va_arg(ap, int *);
+            uint8_t reg, para[5];
+            if (!af_ready) {
+                return -1;
+            }
+            ret |= cambus_readb2(&sensor->i2c, sensor->slv_addr, AF_FW_STATUS, &reg);
+            ret |= cambus_readw_bytes(&sensor->i2c, sensor->slv_addr, AF_CMD_PARA0, para, sizeof(para));
+            switch (reg) {
+                case AF_STATUS_IDLE:
+                    *state = OV5640_AF_STATE_IDLE;
+                    break;
+                case AF_STATUS_FOCUSING:
+                    *state = OV5640_AF_STATE_FOCUSING;
+                    break;
+                case AF_STATUS_FOCUSED:
+                    *state = OV5640_AF_STATE_FOCUSED;
+                    break;
+                default:
+                    *state = OV5640_AF_STATE_ERROR;
+                    break;
+            }
+            *zones = 0;
+            for (int i = 0; i < sizeof(para); i++) {
+                *zones += (para[i] != 0);
+            }
+            break;
+        }
         default: {
             ret = -1;
             break;
@@ -11,12 +11,22 @@
 #ifndef __REG_REGS_H__
 #define __REG_REGS_H__
 
+#define SYSTEM_RESET_00     0x3000
 #define SYSTEM_RESET_02     0x3002
 
 #define CLOCK_ENABLE_02     0x3006
 
 #define SYSTEM_CTROL0       0x3008
 
+#define AF_CMD_MAIN         0x3022
+#define AF_CMD_ACK          0x3023
+#define AF_CMD_PARA0        0x3024
+#define AF_CMD_PARA1        0x3025
+#define AF_CMD_PARA2        0x3026
+#define AF_CMD_PARA3        0x3027
+#define AF_CMD_PARA4        0x3028
+#define AF_FW_STATUS        0x3029
+
 #define SC_PLL_CONTRL2      0x3036
 
 #define SCCB_SYSTEM_CTRL_1  0x3103
@@ -96,4 +106,21 @@
 
 #define PRE_ISP_TEST        0x503D
 
+#define AF_FW_ADDR          0x8000 // AF MCU program memory.
+
+/*
+ * AF firmware commands and status
+ */
+#define AF_CMD_TRIGGER      0x03 // Single shot auto focus.
+#define AF_CMD_CONTINUOUS   0x04 // Continuous auto focus.
+#define AF_CMD_PAUSE        0x06 // Stop and keep the lens position.
+#define AF_CMD_RELEASE      0x08 // Stop and move the lens to infinity.
+#define AF_CMD_ZONE         0x81 // Center the focus zone at CMD_PARA0/1 (80x60 grid).
+#define AF_CMD_ZONE_DEFAULT 0x12 // Relaunch the default focus zones.
+
+#define AF_STATUS_FOCUSING  0x00
+#define AF_STATUS_FOCUSED   0x10
+#define AF_STATUS_IDLE      0x70
+#define AF_STATUS_FW_LOADED 0x7F // Firmware downloaded, MCU not running yet.
+
 #endif //__REG_REGS_H__
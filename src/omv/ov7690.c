@@ -19,6 +19,12 @@
 #include "omv_boardconfig.h"
 
 #if (OMV_ENABLE_OV7690 == 1)
+// Night mode with auto frame rate (down to 1/8), the high FPS mode turns it off.
+#define OV7690_REG15_DEFAULT    (0xCC)
+#define OV7690_REG15_HIGH_FPS   (0x00)
+
+static bool high_fps_mode = false;
+
 static const uint8_t default_regs[][2] = {
 
 // From App Note.
@@ -148,7 +154,7 @@ static const uint8_t default_regs[][2] = {
 
     // Night Mode with Auto Frame Rate - For 24Mhz/26Mhz Clock Input - 30fps ~ 3.75 night mode for 60Hz light environment
     {0x11, 0x00},
-    {0x15, 0xcc},
+    {REG15, OV7690_REG15_DEFAULT},
 
     // Banding Filter Settings for 24MHz Input Clock - 30fps for 50/60Hz light frequency
     {0x13, 0xef}, // banding filter enable
@@ -183,6 +189,8 @@ static const uint8_t contrast_regs[NUM_CONTRAST_LEVELS][1] = {
 
 static int reset(sensor_t *sensor)
 {
+    high_fps_mode = false;
+
     // Reset all registers
     int ret = cambus_writeb(&sensor->i2c, sensor->slv_addr, REG12, 0x80);
 
@@ -307,6 +315,11 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, REGCE, h>>8);
     ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, REGCF, h);
 
+    // The QVGA readout is sub-sampled and runs at twice the VGA frame rate. In the high FPS mode
+    // the night mode is turned off, else the auto frame rate stretches the frame timing back.
+    bool high_fps = high_fps_mode && (w <= 320) && (h <= 240);
+    ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, REG15, high_fps ? OV7690_REG15_HIGH_FPS : OV7690_REG15_DEFAULT);
+
     return ret;
 }
 
@@ -581,6 +594,31 @@ static int set_lens_correction(sensor_t *sensor, int enable, int radi, int coef)
     return ret;
 }
 
+static int ioctl(sensor_t *sensor, int request, va_list ap)
+{
+    int ret = 0;
+
+    switch (request) {
+        case IOCTL_SET_HIGH_FPS_MODE: {
+            high_fps_mode = va_arg(ap, int);
+            if (sensor->framesize != FRAMESIZE_INVALID) {
+                ret = set_framesize(sensor, sensor->framesize);
+            }
+            break;
+        }
+        case IOCTL_GET_HIGH_FPS_MODE: {
+            *va_arg(ap, int *) = high_fps_mode;
+            break;
+        }
+        default: {
+            ret = -1;
+            break;
+        }
+    }
+
+    return ret;
+}
+
 int ov7690_init(sensor_t *sensor)
 {
     // Initialize sensor structure.
@@ -607,6 +645,7 @@ int ov7690_init(sensor_t *sensor)
     sensor->set_vflip           = set_vflip;
     sensor->set_special_effect  = set_special_effect;
     sensor->set_lens_correction = set_lens_correction;
+    sensor->ioctl               = ioctl;
 
     // Set sensor flags
     SENSOR_HW_FLAGS_SET(sensor, SENSOR_HW_FLAGS_VSYNC, 1);
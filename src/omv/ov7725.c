@@ -18,6 +18,9 @@
 #include "systick.h"
 #include "omv_boardconfig.h"
 
+// Auto frame rate control on, the high FPS mode turns it off to keep the frame timing fixed.
+#define OV7725_COM5_DEFAULT     (0xF5)
+
 static const uint8_t default_regs[][2] = {
 
 // From App Note.
@@ -97,7 +100,7 @@ static const uint8_t default_regs[][2] = {
     {LC_COEFR,      0x17},
     {LC_CTR,        0x01}, // {LC_CTR, 0x05},
 
-    {COM5,          0xf5}, // {COM5, 0x65},
+    {COM5,          OV7725_COM5_DEFAULT}, // {COM5, 0x65},
 
 // OpenMV Custom.
 
@@ -147,8 +150,55 @@ static const uint8_t saturation_regs[NUM_SATURATION_LEVELS][2] = {
     {0x80, 0x80}, /* +4 */
 };
 
+// Shadow copy of the registers written by set_pixformat/set_framesize. Writes that don't change
+// a register are skipped, so switching between modes only writes the registers that differ.
+static uint8_t mode_regs[256];
+static uint32_t mode_regs_valid[256 / 32];
+
+#define MODE_REG_VALID(r)       (mode_regs_valid[(r) / 32] & (1 << ((r) % 32)))
+#define MODE_REG_SET_VALID(r)   (mode_regs_valid[(r) / 32] |= (1 << ((r) % 32)))
+#define MODE_REG_CLR_VALID(r)   (mode_regs_valid[(r) / 32] &= ~(1 << ((r) % 32)))
+
+static bool high_fps_mode = false;
+
+static int mode_readb(sensor_t *sensor, uint8_t reg_addr, uint8_t *reg_data)
+{
+    if (MODE_REG_VALID(reg_addr)) {
+        *reg_data = mode_regs[reg_addr];
+        return 0;
+    }
+
+    if (cambus_readb(&sensor->i2c, sensor->slv_addr, reg_addr, reg_data) != 0) {
+        return -1;
+    }
+
+    mode_regs[reg_addr] = *reg_data;
+    MODE_REG_SET_VALID(reg_addr);
+    return 0;
+}
+
+static int mode_writeb(sensor_t *sensor, uint8_t reg_addr, uint8_t reg_data)
+{
+    if (MODE_REG_VALID(reg_addr) && (mode_regs[reg_addr] == reg_data)) {
+        return 0;
+    }
+
+    if (cambus_writeb(&sensor->i2c, sensor->slv_addr, reg_addr, reg_data) != 0) {
+        MODE_REG_CLR_VALID(reg_addr);
+        return -1;
+    }
+
+    mode_regs[reg_addr] = reg_data;
+    MODE_REG_SET_VALID(reg_addr);
+    return 0;
+}
+
 static int reset(sensor_t *sensor)
 {
+    // Invalidate the registers shadow copy.
+    memset(mode_regs_valid, 0, sizeof(mode_regs_valid));
+    high_fps_mode = false;
+
     // Reset all registers
     int ret = cambus_writeb(&sensor->i2c, sensor->slv_addr, COM7, COM7_RESET);
 
@@ -192,34 +242,35 @@ static int read_reg(sensor_t *sensor, uint16_t reg_addr)
 
 static int write_reg(sensor_t *sensor, uint16_t reg_addr, uint16_t reg_data)
 {
+    MODE_REG_CLR_VALID(reg_addr & 0xFF);
     return cambus_writeb(&sensor->i2c, sensor->slv_addr, reg_addr, reg_data);
 }
 
 static int set_pixformat(sensor_t *sensor, pixformat_t pixformat)
 {
     uint8_t reg;
-    int ret = cambus_readb(&sensor->i2c, sensor->slv_addr, COM7, &reg);
+    int ret = mode_readb(sensor, COM7, &reg);
 
     switch (pixformat) {
         case PIXFORMAT_RGB565:
             reg = COM7_SET_FMT(reg, COM7_FMT_RGB);
-            ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, DSP_CTRL4, DSP_CTRL4_YUV_RGB);
+            ret |= mode_writeb(sensor, DSP_CTRL4, DSP_CTRL4_YUV_RGB);
             break;
         case PIXFORMAT_YUV422:
         case PIXFORMAT_GRAYSCALE:
             reg = COM7_SET_FMT(reg, COM7_FMT_YUV);
-            ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, DSP_CTRL4, DSP_CTRL4_YUV_RGB);
+            ret |= mode_writeb(sensor, DSP_CTRL4, DSP_CTRL4_YUV_RGB);
             break;
         case PIXFORMAT_BAYER:
             reg = COM7_SET_FMT(reg, COM7_FMT_P_BAYER);
-            ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, DSP_CTRL4, DSP_CTRL4_RAW8);
+            ret |= mode_writeb(sensor, DSP_CTRL4, DSP_CTRL4_RAW8);
             break;
         default:
             return -1;
     }
 
     // Write back register
-    return cambus_writeb(&sensor->i2c, sensor->slv_addr, COM7, reg) | ret;
+    return mode_writeb(sensor, COM7, reg) | ret;
 }
 
 static int set_framesize(sensor_t *sensor, framesize_t framesize)
@@ -229,47 +280,56 @@ static int set_framesize(sensor_t *sensor, framesize_t framesize)
     uint16_t h = resolution[framesize][1];
 
     // Write MSBs
-    ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, HOUTSIZE, w>>2);
-    ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, VOUTSIZE, h>>1);
+    ret |= mode_writeb(sensor, HOUTSIZE, w>>2);
+    ret |= mode_writeb(sensor, VOUTSIZE, h>>1);
 
     // Write LSBs
-    ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, EXHCH, ((w&0x3) | ((h&0x1) << 2)));
+    ret |= mode_writeb(sensor, EXHCH, ((w&0x3) | ((h&0x1) << 2)));
 
     if ((w <= 320) && (h <= 240)) {
         // Set QVGA Resolution
         uint8_t reg;
-        int ret = cambus_readb(&sensor->i2c, sensor->slv_addr, COM7, &reg);
+        ret |= mode_readb(sensor, COM7, &reg);
         reg = COM7_SET_RES(reg, COM7_RES_QVGA);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, COM7, reg);
+        ret |= mode_writeb(sensor, COM7, reg);
 
         // Set QVGA Window Size
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, HSTART, 0x3F);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, HSIZE,  0x50);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, VSTART, 0x03);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, VSIZE,  0x78);
+        ret |= mode_writeb(sensor, HSTART, 0x3F);
+        ret |= mode_writeb(sensor, HSIZE,  0x50);
+        ret |= mode_writeb(sensor, VSTART, 0x03);
+        ret |= mode_writeb(sensor, VSIZE,  0x78);
 
         // Enable auto-scaling/zooming factors
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, DSPAUTO, 0xFF);
+        ret |= mode_writeb(sensor, DSPAUTO, 0xFF);
     } else {
         // Set VGA Resolution
         uint8_t reg;
-        int ret = cambus_readb(&sensor->i2c, sensor->slv_addr, COM7, &reg);
+        ret |= mode_readb(sensor, COM7, &reg);
         reg = COM7_SET_RES(reg, COM7_RES_VGA);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, COM7, reg);
+        ret |= mode_writeb(sensor, COM7, reg);
 
         // Set VGA Window Size
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, HSTART, 0x23);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, HSIZE,  0xA0);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, VSTART, 0x07);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, VSIZE,  0xF0);
+        ret |= mode_writeb(sensor, HSTART, 0x23);
+        ret |= mode_writeb(sensor, HSIZE,  0xA0);
+        ret |= mode_writeb(sensor, VSTART, 0x07);
+        ret |= mode_writeb(sensor, VSIZE,  0xF0);
 
         // Disable auto-scaling/zooming factors
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, DSPAUTO, 0xF3);
+        ret |= mode_writeb(sensor, DSPAUTO, 0xF3);
 
         // Clear auto-scaling/zooming factors
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, SCAL0, 0x00);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, SCAL1, 0x40);
-        ret |= cambus_writeb(&sensor->i2c, sensor->slv_addr, SCAL2, 0x40);
+        ret |= mode_writeb(sensor, SCAL0, 0x00);
+        ret |= mode_writeb(sensor, SCAL1, 0x40);
+        ret |= mode_writeb(sensor, SCAL2, 0x40);
+    }
+
+    // The QVGA readout is sub-sampled and runs at twice the VGA frame rate (up to 120+ FPS with a
+    // 48MHz internal clock). In the high FPS mode the auto frame rate control is turned off, else
+    // it adds dummy frames in low light and the smaller framesizes gain nothing.
+    if (high_fps_mode && (w <= 320) && (h <= 240)) {
+        ret |= mode_writeb(sensor, COM5, OV7725_COM5_DEFAULT & ~COM5_AFR);
+    } else {
+        ret |= mode_writeb(sensor, COM5, OV7725_COM5_DEFAULT);
     }
 
     return ret;
@@ -574,6 +634,31 @@ static int set_lens_correction(sensor_t *sensor, int enable, int radi, int coef)
     return ret;
 }
 
+static int ioctl(sensor_t *sensor, int request, va_list ap)
+{
+    int ret = 0;
+
+    switch (request) {
+        case IOCTL_SET_HIGH_FPS_MODE: {
+            high_fps_mode = va_arg(ap, int);
+            if (sensor->framesize != FRAMESIZE_INVALID) {
+                ret = set_framesize(sensor, sensor->framesize);
+            }
+            break;
+        }
+        case IOCTL_GET_HIGH_FPS_MODE: {
+            *va_arg(ap, int *) = high_fps_mode;
+            break;
+        }
+        default: {
+            ret = -1;
+            break;
+        }
+    }
+
+    return ret;
+}
+
 int ov7725_init(sensor_t *sensor)
 {
     // Initialize sensor structure.
@@ -599,6 +684,7 @@ int ov7725_init(sensor_t *sensor)
     sensor->set_vflip           = set_vflip;
     sensor->set_special_effect  = set_special_effect;
     sensor->set_lens_correction = set_lens_correction;
+    sensor->ioctl               = ioctl;
 
     // Set sensor flags
     SENSOR_HW_FLAGS_SET(sensor, SENSOR_HW_FLAGS_VSYNC, 1);
@@ -30,6 +30,17 @@ static const uint32_t cpufreq_latency[] = { // Flash latency (see table 11)
 };
 #endif
 
+#if defined(STM32H7)
+// 240MHz and 480MHz have the same bus clocks (only the core clock changes), so the governor
+// can switch between them without affecting the DCMI, timers (sensor clock), UARTs/SPI or USB.
+#define GOVERNOR_LOW    (1)
+#define GOVERNOR_HIGH   (2)
+static uint32_t governor_budget_us;
+static int governor_idx;
+#endif
+
+static bool governor_enabled;
+
 uint32_t cpufreq_get_cpuclk()
 {
     uint32_t cpuclk = HAL_RCC_GetSysClockFreq();
@@ -75,31 +86,18 @@ mp_obj_t py_cpufreq_get_supported_frequencies()
     return freq_list;
 }
 
-mp_obj_t py_cpufreq_set_frequency(mp_obj_t cpufreq_obj)
+// Switches the clocks, returns an error message on failure.
+static const char *cpufreq_set(int cpufreq_idx)
 {
     RCC_ClkInitTypeDef RCC_ClkInitStruct;
     #if defined(STM32F7)
     RCC_OscInitTypeDef RCC_OscInitStruct;
     #endif
-
-    // Check if frequency is supported
-    int cpufreq_idx = -1;
-    uint32_t cpufreq = mp_obj_get_int(cpufreq_obj);
-    for (int i=0; i<ARRAY_LENGTH(cpufreq_freqs); i++) {
-        if (cpufreq == cpufreq_freqs[i]) {
-            cpufreq_idx = i;
-            break;
-        }
-    }
-
-    // Frequency is Not supported.
-    if (cpufreq_idx == -1) {
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Unsupported frequency!"));
-    }
+    uint32_t cpufreq = cpufreq_freqs[cpufreq_idx];
 
     // Return if frequency hasn't changed.
     if (cpufreq == (cpufreq_get_cpuclk()/(1000000))) {
-        return mp_const_true;
+        return NULL;
     }
 
     #if defined(STM32H7)
@@ -137,8 +135,7 @@ mp_obj_t py_cpufreq_set_frequency(mp_obj_t cpufreq_obj)
             break;
 
         default:
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Unsupported frequency!"));
-            break;
+            return "Unsupported frequency!";
     }
 
     #elif defined(STM32F7)
@@ -152,7 +149,7 @@ mp_obj_t py_cpufreq_set_frequency(mp_obj_t cpufreq_obj)
     RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV2;
     if(HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_7) != HAL_OK) {
         // Initialization Error
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "RCC CLK Initialization Error!!"));
+        return "RCC CLK Initialization Error!!";
     }
 
     // Enable HSE Oscillator and activate PLL with HSE as source
@@ -167,7 +164,7 @@ mp_obj_t py_cpufreq_set_frequency(mp_obj_t cpufreq_obj)
 
     if(HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
         // Initialization Error
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "RCC OSC Initialization Error!!"));
+        return "RCC OSC Initialization Error!!";
     }
 
     // Select PLL as system clock source
@@ -178,24 +175,124 @@ mp_obj_t py_cpufreq_set_frequency(mp_obj_t cpufreq_obj)
 
     if(HAL_RCC_ClockConfig(&RCC_ClkInitStruct, flatency) != HAL_OK) {
         // Initialization Error
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "RCC CLK Initialization Error!!"));
+        return "RCC CLK Initialization Error!!";
+    }
+    return NULL;
+}
+
+
+mp_obj_t py_cpufreq_set_frequency(mp_obj_t cpufreq_obj)
+{
+    // Check if frequency is supported
+    int cpufreq_idx = -1;
+    uint32_t cpufreq = mp_obj_get_int(cpufreq_obj);
+    for (int i=0; i<ARRAY_LENGTH(cpufreq_freqs); i++) {
+        if (cpufreq == cpufreq_freqs[i]) {
+            cpufreq_idx = i;
+            break;
+        }
+    }
+
+    // Frequency is Not supported.
+    if (cpufreq_idx == -1) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Unsupported frequency!"));
+    }
+
+    // A fixed frequency replaces the governor.
+    governor_enabled = false;
+
+    const char *error = cpufreq_set(cpufreq_idx);
+    if (error) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, error));
     }
     return mp_const_true;
 }
 
+void cpufreq_governor_wait(bool waiting)
+{
+    #if defined(STM32H7)
+    if (governor_enabled) {
+        cpufreq_set(waiting ? GOVERNOR_LOW : governor_idx);
+    }
+    #endif
+}
+
+void cpufreq_governor_frame(uint32_t processing_us)
+{
+    #if defined(STM32H7)
+    if (!governor_enabled) {
+        return;
+    }
+
+    if (!governor_budget_us) {
+        // No budget, process frames as fast as possible and slow down while waiting.
+        governor_idx = GOVERNOR_HIGH;
+    } else if (governor_idx == GOVERNOR_LOW) {
+        if (processing_us > governor_budget_us) {
+            governor_idx = GOVERNOR_HIGH;
+        }
+    } else {
+        // Expected time at the low frequency, with a 10% margin so it doesn't toggle every frame.
+        uint64_t low_us = (((uint64_t) processing_us) * cpufreq_freqs[governor_idx]) / cpufreq_freqs[GOVERNOR_LOW];
+        if ((low_us * 10) <= (governor_budget_us * 9)) {
+            governor_idx = GOVERNOR_LOW;
+        }
+    }
+    #endif
+}
+
+mp_obj_t py_cpufreq_set_governor(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    // set_governor(enable, budget_us=0): lowers the CPU clock while waiting for the sensor in
+    // sensor.snapshot(), and while processing frames if the processing time of the last frame
+    // fits in budget_us at the lower clock. A budget of 0 always processes at the higher clock.
+    #if defined(STM32H7)
+    bool enable = mp_obj_is_true(args[0]);
+    int budget_us = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_budget_us), 0);
+    if (budget_us < 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid budget!"));
+    }
+
+    governor_budget_us = budget_us;
+    governor_idx = GOVERNOR_HIGH;
+    governor_enabled = enable;
+
+    const char *error = cpufreq_set(GOVERNOR_HIGH);
+    if (error) {
+        governor_enabled = false;
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, error));
+    }
+    return mp_const_none;
+    #else
+    // Every frequency has different bus clocks, which would change the sensor and USB clocks.
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Governor not supported!"));
+    #endif
+}
+
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_cpufreq_set_frequency_obj, py_cpufreq_set_frequency);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_cpufreq_set_governor_obj, 1, py_cpufreq_set_governor);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_cpufreq_get_current_frequencies_obj, py_cpufreq_get_current_frequencies);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_cpufreq_get_supported_frequencies_obj, py_cpufreq_get_supported_frequencies);
+#else
+void cpufreq_governor_wait(bool waiting)
+{
+}
+
+void cpufreq_governor_frame(uint32_t processing_us)
+{
+}
 #endif // defined(STM32F7) || defined(STM32H7)
 
 static const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__),                  MP_OBJ_NEW_QSTR(MP_QSTR_cpufreq) },
     #if defined(STM32F7) || defined(STM32H7)
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_frequency),             (mp_obj_t)&py_cpufreq_set_frequency_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_governor),              (mp_obj_t)&py_cpufreq_set_governor_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_current_frequencies),   (mp_obj_t)&py_cpufreq_get_current_frequencies_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_supported_frequencies), (mp_obj_t)&py_cpufreq_get_supported_frequencies_obj },
     #else
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_frequency),             (mp_obj_t)&py_func_unavailable_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_governor),              (mp_obj_t)&py_func_unavailable_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_current_frequencies),   (mp_obj_t)&py_func_unavailable_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_supported_frequencies), (mp_obj_t)&py_func_unavailable_obj },
     #endif
@@ -10,5 +10,11 @@
  */
 #ifndef __PY_CPUFREQ_H__
 #define __PY_CPUFREQ_H__
+#include <stdint.h>
+#include <stdbool.h>
 void py_cpufreq_init0();
+// Governor hooks called by sensor.snapshot() (no-ops unless cpufreq.set_governor() enabled it).
+void cpufreq_governor_wait(bool waiting);
+// Called at the frame boundary with the time spent processing the last frame.
+void cpufreq_governor_frame(uint32_t processing_us);
 #endif // __PY_CPUFREQ_H__
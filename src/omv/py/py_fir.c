@@ -93,12 +93,34 @@ static float *b_ij = NULL;
 static float *alpha_ij = NULL;
 static float v_th, k_t1, k_t2, tgc, emissivity, ksta, alpha_cp, ks4, a_cp, b_cp;
 
+// MLX90640 per pixel constants (computed once from the parameters at init).
+typedef struct mlx_pixel {
+    float offset;
+    float kta;
+    float kv;
+    float alpha;        // Scaled inverse of the sensitivity.
+    float il_chess;     // Correction when not in the calibration mode.
+    uint8_t il_pattern;
+    uint8_t chess_pattern;
+} mlx_pixel_t;
+
+static mlx_pixel_t *mlx_pixels = NULL;
+static float *mlx_to = NULL;        // Object temperatures of the last two subpages.
+static float mlx_ta = 0.0f;         // Ambient temperature of the last subpage.
+static uint8_t mlx_subpages = 0;    // Bit mask of the subpages read into mlx_to.
+
 static uint8_t width = 0;
 static uint8_t height = 0;
 static uint8_t IR_refresh_rate = 0;
 static uint8_t ADC_resolution = 0;
 
+#if defined(FIR_I2C_HANDLE)
+// The MicroPython handle of the bus, its interrupt handlers serve the DMA transfers.
+extern I2C_HandleTypeDef FIR_I2C_HANDLE;
+#define fir_i2c FIR_I2C_HANDLE
+#else
 static I2C_HandleTypeDef fir_i2c = {0};      // SCCB/I2C bus.
+#endif
 
 static enum {
     FIR_NONE,
@@ -183,18 +205,23 @@ static void calculate_To(float Ta, float *To)
     // (Ta+273.15f)^4
     float Tak4 = (Ta+273.15f)*(Ta+273.15f)*(Ta+273.15f)*(Ta+273.15f);
 
+    // The per pixel terms that only depend on Ta.
+    float tgc_comp = tgc*v_ir_cp_off_comp;
+    float inv_emissivity = 1/emissivity;
+    float alpha_ta_comp = 1+(ksta*(Ta-25));
+
     for (int i=0; i<64; i++) {
         // #1: Calculate Offset Compensation
         float v_ir_off_comp = v_ir[i]-(a_ij[i]+(b_ij[i]*(Ta-25)));
 
         // #2: Calculate Thermal Gradien Compensation (TGC)
-        float v_ir_tgc_comp = v_ir_off_comp-(tgc*v_ir_cp_off_comp);
+        float v_ir_tgc_comp = v_ir_off_comp-tgc_comp;
 
         // #3: Calculate Emissivity Compensation
-        float v_ir_comp = v_ir_tgc_comp/emissivity;
+        float v_ir_comp = v_ir_tgc_comp*inv_emissivity;
 
-        // #4: Calculate Sensitivity Compensation
-        float alpha_comp_ij = (1+(ksta*(Ta-25)))*(alpha_ij[i]-(tgc*alpha_cp));
+        // #4: Calculate Sensitivity Compensation (alpha_ij is already TGC compensated)
+        float alpha_comp_ij = alpha_ta_comp*alpha_ij[i];
 
         // Ks4=0 for BAB and BAD sensors.
         // float sx = ks4*sqrtf(sqrtf((powf(alpha_comp_ij,3)*v_ir_comp)+(powf(alpha_comp_ij,4)*Ta4)));
@@ -204,6 +231,129 @@ static void calculate_To(float Ta, float *To)
     fb_alloc_free_till_mark();
 }
 
+// Fills the per pixel constants table from the MLX90640 parameters.
+static void mlx90640_init_pixels(const paramsMLX90640 *params)
+{
+    float kta_scale = 1 << params->ktaScale;
+    float kv_scale = 1 << params->kvScale;
+    float alpha_scale = SCALEALPHA * (1 << params->alphaScale);
+
+    for (int i = 0; i < 768; i++) {
+        int il_pattern = i / 32 - (i / 64) * 2;
+        int chess_pattern = il_pattern ^ (i - (i / 2) * 2);
+        int conversion_pattern = ((i + 2) / 4 - (i + 3) / 4 + (i + 1) / 4 - i / 4) * (1 - 2 * il_pattern);
+
+        mlx_pixels[i].offset = params->offset[i];
+        mlx_pixels[i].kta = params->kta[i] / kta_scale;
+        mlx_pixels[i].kv = params->kv[i] / kv_scale;
+        mlx_pixels[i].alpha = alpha_scale / params->alpha[i];
+        mlx_pixels[i].il_chess = (params->ilChessC[2] * (2 * il_pattern - 1)) - (params->ilChessC[1] * conversion_pattern);
+        mlx_pixels[i].il_pattern = il_pattern;
+        mlx_pixels[i].chess_pattern = chess_pattern;
+    }
+}
+
+// Same as MLX90640_CalculateTo() using the per pixel constants computed at init.
+static void mlx90640_calculate_to(uint16_t *frame_data, const paramsMLX90640 *params, float emissivity, float tr, float *result)
+{
+    int sub_page = frame_data[833];
+    float vdd = MLX90640_GetVdd(frame_data, params);
+    float ta = MLX90640_GetTa(frame_data, params);
+
+    float ta4 = ta + 273.15f;
+    ta4 = ta4 * ta4;
+    ta4 = ta4 * ta4;
+    float tr4 = tr + 273.15f;
+    tr4 = tr4 * tr4;
+    tr4 = tr4 * tr4;
+    float ta_tr = tr4 - ((tr4 - ta4) / emissivity);
+
+    float alpha_corr_r[4];
+    alpha_corr_r[0] = 1 / (1 + (params->ksTo[0] * 40));
+    alpha_corr_r[1] = 1;
+    alpha_corr_r[2] = 1 + (params->ksTo[1] * params->ct[2]);
+    alpha_corr_r[3] = alpha_corr_r[2] * (1 + (params->ksTo[2] * (params->ct[3] - params->ct[2])));
+
+    // Gain calculation
+    float gain = params->gainEE / ((float) ((int16_t) frame_data[778]));
+
+    // Compensation pixels
+    int mode = (frame_data[832] & 0x1000) >> 5;
+    float dta = ta - 25, dvdd = vdd - 3.3f;
+    float cp_comp = (1 + (params->cpKta * dta)) * (1 + (params->cpKv * dvdd));
+    float ir_data_cp = (((int16_t) frame_data[sub_page ? 808 : 776]) * gain)
+                     - ((params->cpOffset[sub_page] + (((mode != params->calibrationModeEE) && sub_page) ? params->ilChessC[0] : 0)) * cp_comp);
+
+    // Per pixel terms that only depend on the frame.
+    float tgc_comp = params->tgc * ir_data_cp;
+    float inv_emissivity = 1 / emissivity;
+    float alpha_ta_comp = 1 + (params->KsTa * dta);
+    float ks_to_comp = 1 - (params->ksTo[1] * 273.15f);
+    bool il_chess_comp = mode != params->calibrationModeEE;
+
+    for (int i = 0; i < 768; i++) {
+        const mlx_pixel_t *pixel = mlx_pixels + i;
+        int pattern = mode ? pixel->chess_pattern : pixel->il_pattern;
+
+        if (pattern != sub_page) {
+            continue;
+        }
+
+        float ir_data = (((int16_t) frame_data[i]) * gain)
+                      - (pixel->offset * (1 + (pixel->kta * dta)) * (1 + (pixel->kv * dvdd)));
+
+        if (il_chess_comp) {
+            ir_data += pixel->il_chess;
+        }
+
+        ir_data = (ir_data - tgc_comp) * inv_emissivity;
+
+        float alpha_compensated = pixel->alpha * alpha_ta_comp;
+        float sx = alpha_compensated * alpha_compensated * alpha_compensated * (ir_data + (alpha_compensated * ta_tr));
+        sx = sqrtf(sqrtf(sx)) * params->ksTo[1];
+
+        float to = sqrtf(sqrtf((ir_data / ((alpha_compensated * ks_to_comp) + sx)) + ta_tr)) - 273.15f;
+        int range = (to < params->ct[1]) ? 0 : (to < params->ct[2]) ? 1 : (to < params->ct[3]) ? 2 : 3;
+
+        result[i] = sqrtf(sqrtf((ir_data / (alpha_compensated * alpha_corr_r[range] * (1 + (params->ksTo[range] * (to - params->ct[range]))))) + ta_tr)) - 273.15f;
+    }
+}
+
+// Reads the next subpage into mlx_to. If wait is false this returns right away when no
+// subpage is ready, the last frame stays valid (each subpage has half of the pixels).
+static void mlx90640_read_subpage(uint16_t *frame_data, bool wait)
+{
+    if (!wait) {
+        uint16_t status;
+        PY_ASSERT_TRUE_MSG(MLX90640_I2CRead(MLX90640_ADDR, 0x8000, 1, &status) == 0,
+                           "Failed to read the MLX90640 sensor data!");
+        if (!(status & 0x0008)) {
+            return; // No new subpage.
+        }
+    }
+
+    int sub_page = MLX90640_GetFrameData(MLX90640_ADDR, frame_data);
+    PY_ASSERT_TRUE_MSG(sub_page >= 0, "Failed to read the MLX90640 sensor data!");
+    mlx_ta = MLX90640_GetTa(frame_data, (paramsMLX90640 *) alpha_ij);
+    mlx90640_calculate_to(frame_data, (paramsMLX90640 *) alpha_ij, 0.95, mlx_ta - 8, mlx_to);
+    mlx_subpages |= 1 << sub_page;
+}
+
+// Updates mlx_to with a new subpage if one is ready, waits for the first full frame.
+static void mlx90640_update()
+{
+    fb_alloc_mark();
+    uint16_t *frame_data = fb_alloc(834 * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    mlx90640_read_subpage(frame_data, false);
+
+    while (mlx_subpages != 0x3) {
+        mlx90640_read_subpage(frame_data, true);
+    }
+
+    fb_alloc_free_till_mark();
+}
+
 static mp_obj_t py_fir_deinit()
 {
     width = 0;
@@ -219,6 +369,13 @@ static mp_obj_t py_fir_deinit()
     if (alpha_ij) {
         alpha_ij = NULL;
     }
+    if (mlx_pixels) {
+        mlx_pixels = NULL;
+    }
+    if (mlx_to) {
+        mlx_to = NULL;
+    }
+    mlx_subpages = 0;
 
     switch (fir_sensor) {
         case FIR_NONE:
@@ -348,6 +505,11 @@ mp_obj_t py_fir_init(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
             b_cp = ((int8_t)eeprom[CAL_BCP]) /
                 powf(2,b_i_scale+(3-ADC_resolution));
 
+            // The sensitivity is only used TGC compensated.
+            for (int i=0; i<64; i++) {
+                alpha_ij[i] -= tgc*alpha_cp;
+            }
+
             fb_alloc_free_till_mark();
             return mp_const_none;
         }
@@ -379,6 +541,10 @@ mp_obj_t py_fir_init(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
             error |= MLX90640_DumpEE(MLX90640_ADDR, eeprom);
             error |= MLX90640_ExtractParameters(eeprom, (paramsMLX90640 *) alpha_ij);
 
+            mlx_pixels = xalloc(768 * sizeof(mlx_pixel_t));
+            mlx_to = xalloc0(768 * sizeof(float));
+            mlx90640_init_pixels((paramsMLX90640 *) alpha_ij);
+
             // Switch to FAST speed
             cambus_deinit(&fir_i2c);
             cambus_init(&fir_i2c, FIR_I2C, I2C_TIMING_FAST);
@@ -456,13 +622,8 @@ mp_obj_t py_fir_read_ta()
         case FIR_NONE: return mp_const_none;
         case FIR_SHIELD: return mp_obj_new_float(calculate_Ta());
         case FIR_MLX90640: {
-            fb_alloc_mark();
-            uint16_t *data = fb_alloc(834 * sizeof(uint16_t), FB_ALLOC_NO_HINT);
-            PY_ASSERT_TRUE_MSG(MLX90640_GetFrameData(MLX90640_ADDR, data) >= 0,
-                               "Failed to read the MLX90640 sensor data!");
-            mp_obj_t result = mp_obj_new_float(MLX90640_GetTa(data, (paramsMLX90640 *) alpha_ij));
-            fb_alloc_free_till_mark();
-            return result;
+            mlx90640_update();
+            return mp_obj_new_float(mlx_ta);
         }
 
         case FIR_AMG8833: {
@@ -517,19 +678,10 @@ mp_obj_t py_fir_read_ir()
         }
 
         case FIR_MLX90640: {
-            fb_alloc_mark();
-            uint16_t *data = fb_alloc(834 * sizeof(uint16_t), FB_ALLOC_NO_HINT);
-            // Calculate 1st sub-frame...
-            PY_ASSERT_TRUE_MSG(MLX90640_GetFrameData(MLX90640_ADDR, data) >= 0,
-                               "Failed to read the MLX90640 sensor data!");
-            float Ta = MLX90640_GetTa(data, (paramsMLX90640 *) alpha_ij);
-            float *To = fb_alloc0(768 * sizeof(float), FB_ALLOC_NO_HINT);
-            MLX90640_CalculateTo(data, (paramsMLX90640 *) alpha_ij, 0.95, Ta - 8, To);
-            // Calculate 2nd sub-frame...
-            PY_ASSERT_TRUE_MSG(MLX90640_GetFrameData(MLX90640_ADDR, data) >= 0,
-                               "Failed to read the MLX90640 sensor data!");
-            Ta = MLX90640_GetTa(data, (paramsMLX90640 *) alpha_ij);
-            MLX90640_CalculateTo(data, (paramsMLX90640 *) alpha_ij, 0.95, Ta - 8, To);
+            // Only a new subpage (if any) is read, the other half of the frame is kept.
+            mlx90640_update();
+            float Ta = mlx_ta;
+            float *To = mlx_to;
             float min = FLT_MAX, max = FLT_MIN;
 
             for (int i=0; i<768; i++) {
@@ -549,7 +701,6 @@ mp_obj_t py_fir_read_ir()
                 }
             }
 
-            fb_alloc_free_till_mark();
             return mp_obj_new_tuple(4, tuple);
         }
 
@@ -773,18 +924,18 @@ mp_obj_t py_fir_snapshot(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
-        image.data = MAIN_FB()->pixels;
+        image.data = MAIN_FB_BUFFER();
     } else if (arg_other) {
         PY_ASSERT_TRUE_MSG((image_size(&image) <= image_size(arg_other)), "The new image won't fit in the target frame buffer!");
         image.data = arg_other->data;
     } else {
-        image.data = xalloc(image_size(&image));
+        image.data = xalloc_data(image_size(&image));
     }
 
     // Zero the image we are about to draw on.
     memset(image.data, 0, image_size(&image));
 
-    if (MAIN_FB()->pixels == image.data) {
+    if (MAIN_FB_BUFFER() == image.data) {
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
@@ -24,6 +24,8 @@ typedef struct py_gif_obj {
     int height;
     bool color;
     bool loop;
+    int decimate;
+    uint8_t *prev; // Last frame for frame differencing (NULL if disabled).
     FIL fp;
 } py_gif_obj_t;
 
@@ -34,10 +36,24 @@ static mp_obj_t py_gif_open(uint n_args, const mp_obj_t *args, mp_map_t *kw_args
     gif->height = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_height), MAIN_FB()->h);
     gif->color  = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_color), MAIN_FB()->bpp>=2);
     gif->loop   = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_loop), true);
+    bool diff   = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_diff), false);
+    gif->decimate = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_decimate), 1);
+    PY_ASSERT_TRUE_MSG((gif->decimate >= 1)
+                    && (gif->decimate <= IM_MIN(gif->width, gif->height)), "Invalid decimation!");
+    gif->prev = NULL;
     gif->base.type = &py_gif_type;
 
+    int w = gif->width / gif->decimate;
+    int h = gif->height / gif->decimate;
+
+    if (diff) {
+        // Palette indices never reach 0xFF so the first frame is sent in full.
+        gif->prev = xalloc_data(w * h);
+        memset(gif->prev, 0xFF, w * h);
+    }
+
     file_write_open(&gif->fp, mp_obj_str_get_str(args[0]));
-    gif_open(&gif->fp, gif->width, gif->height, gif->color, gif->loop);
+    gif_open(&gif->fp, w, h, gif->color, gif->loop, diff);
     return gif;
 }
 
@@ -82,7 +98,7 @@ static mp_obj_t py_gif_add_frame(uint n_args, const mp_obj_t *args, mp_map_t *kw
 
     int delay = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_delay), 10);
 
-    gif_add_frame(&arg_gif->fp, arg_img, delay);
+    gif_add_frame(&arg_gif->fp, arg_img, delay, arg_gif->decimate, arg_gif->prev);
     return mp_const_none;
 }
 
@@ -90,6 +106,8 @@ static mp_obj_t py_gif_close(mp_obj_t gif_obj)
 {
     py_gif_obj_t *arg_gif = gif_obj;
     gif_close(&arg_gif->fp);
+    xfree(arg_gif->prev);
+    arg_gif->prev = NULL;
     return mp_const_none;
 }
 
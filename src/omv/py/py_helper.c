@@ -79,41 +79,46 @@ image_t *py_helper_keyword_to_image_mutable_alpha_palette(uint n_args, const mp_
     return py_helper_keyword_to_image_mutable(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_alpha_palette), NULL);
 }
 
+static void py_helper_rectangle_clip(image_t *img, rectangle_t *r)
+{
+    PY_ASSERT_TRUE_MSG((r->w >= 1) && (r->h >= 1), "Invalid ROI dimensions!");
+    rectangle_t temp;
+    temp.x = 0;
+    temp.y = 0;
+    temp.w = img->w;
+    temp.h = img->h;
+
+    PY_ASSERT_TRUE_MSG(rectangle_overlap(r, &temp), "ROI does not overlap on the image!");
+    rectangle_intersected(r, &temp);
+}
+
+void py_helper_arg_to_rectangle_roi(image_t *img, const mp_obj_t arg, rectangle_t *r)
+{
+    mp_obj_t *arg_rectangle;
+    mp_obj_get_array_fixed_n(arg, 4, &arg_rectangle);
+    r->x = mp_obj_get_int(arg_rectangle[0]);
+    r->y = mp_obj_get_int(arg_rectangle[1]);
+    r->w = mp_obj_get_int(arg_rectangle[2]);
+    r->h = mp_obj_get_int(arg_rectangle[3]);
+    py_helper_rectangle_clip(img, r);
+}
+
 void py_helper_keyword_rectangle(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
                                  mp_map_t *kw_args, mp_obj_t kw, rectangle_t *r)
 {
     mp_map_elem_t *kw_arg = mp_map_lookup(kw_args, kw, MP_MAP_LOOKUP);
 
     if (kw_arg) {
-        mp_obj_t *arg_rectangle;
-        mp_obj_get_array_fixed_n(kw_arg->value, 4, &arg_rectangle);
-        r->x = mp_obj_get_int(arg_rectangle[0]);
-        r->y = mp_obj_get_int(arg_rectangle[1]);
-        r->w = mp_obj_get_int(arg_rectangle[2]);
-        r->h = mp_obj_get_int(arg_rectangle[3]);
+        py_helper_arg_to_rectangle_roi(img, kw_arg->value, r);
     } else if (n_args > arg_index) {
-        mp_obj_t *arg_rectangle;
-        mp_obj_get_array_fixed_n(args[arg_index], 4, &arg_rectangle);
-        r->x = mp_obj_get_int(arg_rectangle[0]);
-        r->y = mp_obj_get_int(arg_rectangle[1]);
-        r->w = mp_obj_get_int(arg_rectangle[2]);
-        r->h = mp_obj_get_int(arg_rectangle[3]);
+        py_helper_arg_to_rectangle_roi(img, args[arg_index], r);
     } else {
         r->x = 0;
         r->y = 0;
         r->w = img->w;
         r->h = img->h;
+        py_helper_rectangle_clip(img, r);
     }
-
-    PY_ASSERT_TRUE_MSG((r->w >= 1) && (r->h >= 1), "Invalid ROI dimensions!");
-    rectangle_t temp;
-    temp.x = 0;
-    temp.y = 0;
-    temp.w = img->w;
-    temp.h = img->h;
-
-    PY_ASSERT_TRUE_MSG(rectangle_overlap(r, &temp), "ROI does not overlap on the image!");
-    rectangle_intersected(r, &temp);
 }
 
 void py_helper_keyword_rectangle_roi(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
@@ -367,3 +372,11 @@ mp_obj_t py_helper_keyword_object(uint n_args, const mp_obj_t *args, uint arg_in
         return NULL;
     }
 }
+
+void py_helper_keyword_time_budget(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args, int default_val)
+{
+    int budget_us = py_helper_keyword_int(n_args, args, arg_index, kw_args,
+                                          MP_OBJ_NEW_QSTR(MP_QSTR_time_budget_us), default_val);
+    PY_ASSERT_TRUE_MSG(budget_us >= 0, "time_budget_us must not be negative!");
+    imlib_deadline_init(budget_us);
+}
@@ -25,6 +25,7 @@ image_t *py_helper_keyword_to_image_mutable_color_palette(uint n_args, const mp_
                                                           mp_map_t *kw_args);
 image_t *py_helper_keyword_to_image_mutable_alpha_palette(uint n_args, const mp_obj_t *args, uint arg_index,
                                                           mp_map_t *kw_args);
+void py_helper_arg_to_rectangle_roi(image_t *img, const mp_obj_t arg, rectangle_t *r);
 void py_helper_keyword_rectangle(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
                                  mp_map_t *kw_args, mp_obj_t kw, rectangle_t *r);
 void py_helper_keyword_rectangle_roi(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
@@ -50,4 +51,6 @@ void py_helper_keyword_thresholds(uint n_args, const mp_obj_t *args, uint arg_in
 int py_helper_arg_to_ksize(const mp_obj_t arg);
 int py_helper_ksize_to_n(int ksize);
 mp_obj_t py_helper_keyword_object(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args, mp_obj_t kw);
+// Starts the time budget of a detector (time_budget_us), see imlib_deadline_init().
+void py_helper_keyword_time_budget(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args, int default_val);
 #endif // __PY_HELPER__
@@ -137,6 +137,55 @@ static const mp_obj_type_t py_lbp_type = {
     .print = py_lbp_print,
 };
 
+// LBPMap Object //
+// Passed to find_lbp() with map= so that the LBP codes of a frame are computed once and the
+// descriptors of many regions (e.g. when scanning for faces) only cost a few lookups per bin.
+typedef struct py_lbp_map_obj {
+    mp_obj_base_t base;
+    lbp_map_t map;
+} py_lbp_map_obj_t;
+
+static void py_lbp_map_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_lbp_map_obj_t *self = self_in;
+    mp_printf(print, "{\"cell_size\":%d, \"w\":%d, \"h\":%d, \"valid\":%s}",
+              self->map.cell_size, self->map.img.w, self->map.img.h,
+              self->map.valid ? "True" : "False");
+}
+
+mp_obj_t py_lbp_map_reset(mp_obj_t self_in)
+{
+    imlib_lbp_map_reset(&((py_lbp_map_obj_t *) self_in)->map);
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_lbp_map_reset_obj, py_lbp_map_reset);
+
+STATIC const mp_rom_map_elem_t py_lbp_map_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_lbp_map_reset_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_lbp_map_locals_dict, py_lbp_map_locals_dict_table);
+
+static const mp_obj_type_t py_lbp_map_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_LBPMap,
+    .print = py_lbp_map_print,
+    .locals_dict = (mp_obj_t) &py_lbp_map_locals_dict
+};
+
+mp_obj_t py_image_lbp_map(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int cell_size = py_helper_keyword_int(n_args, args, 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cell_size), 4);
+    PY_ASSERT_TRUE_MSG(cell_size > 0, "cell_size must be > 0");
+
+    py_lbp_map_obj_t *obj = m_new_obj(py_lbp_map_obj_t);
+    obj->base.type = &py_lbp_map_type;
+    imlib_lbp_map_alloc(&obj->map, cell_size);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_lbp_map_obj, 0, py_image_lbp_map);
+
 #endif // IMLIB_ENABLE_FIND_LBP
 
 // Keypoints Match Object /////////////////////////////////////////////////////
@@ -344,6 +393,33 @@ STATIC mp_obj_t py_image_getiter(mp_obj_t o_in, mp_obj_iter_buf_t *iter_buf)
     return MP_OBJ_FROM_PTR(o);
 }
 
+// Returns the image named by a copy= argument (e.g. one from an ImagePool) to write into,
+// or NULL if the argument is missing or a bool.
+static image_t *py_image_arg_to_dest(mp_obj_t copy_obj, image_t *out)
+{
+    if ((!copy_obj) || mp_obj_is_integer(copy_obj)) {
+        return NULL;
+    }
+
+    image_t *dst = py_helper_arg_to_image_mutable(copy_obj);
+    PY_ASSERT_TRUE_MSG((image_size(out) <= image_size(dst)), "The new image won't fit in the target frame buffer!");
+    return dst;
+}
+
+// Gives the destination the shape of the result so the same object can be returned.
+static void py_image_update_dest(image_t *dst, image_t *out)
+{
+    dst->w = out->w;
+    dst->h = out->h;
+    dst->bpp = out->bpp;
+
+    if (MAIN_FB_BUFFER() == dst->data) {
+        MAIN_FB()->w = out->w;
+        MAIN_FB()->h = out->h;
+        MAIN_FB()->bpp = out->bpp;
+    }
+}
+
 static void py_image_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
 {
     py_image_obj_t *self = self_in;
@@ -585,18 +661,19 @@ static mp_obj_t py_image_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value
 
 static mp_int_t py_image_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags)
 {
+    // memoryview(img) indexes pixels: uint8 for grayscale/bayer, uint16 for RGB565 and uint32 words
+    // of 32 pixels for binary images. The view is writable like bytearray().
     py_image_obj_t *self = self_in;
-    if (flags == MP_BUFFER_READ) {
-        bufinfo->buf = self->_cobj.data;
-        bufinfo->len = image_size(&self->_cobj);
-        bufinfo->typecode = 'b';
-        return 0;
-    } else { // Can't write to an image!
-        bufinfo->buf = NULL;
-        bufinfo->len = 0;
-        bufinfo->typecode = -1;
-        return 1;
+    bufinfo->buf = self->_cobj.data;
+    bufinfo->len = image_size(&self->_cobj);
+
+    switch (self->_cobj.bpp) {
+        case IMAGE_BPP_BINARY: bufinfo->typecode = 'I'; break;
+        case IMAGE_BPP_RGB565: bufinfo->typecode = 'H'; break;
+        default: bufinfo->typecode = 'B'; break;
     }
+
+    return 0;
 }
 
 ////////////////
@@ -633,6 +710,22 @@ static mp_obj_t py_image_size(mp_obj_t img_obj)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_size_obj, py_image_size);
 
+static mp_obj_t py_image_timestamp(mp_obj_t img_obj)
+{
+    image_t *arg_img = (image_t *) py_image_cobj(img_obj);
+    PY_ASSERT_TRUE_MSG(MAIN_FB_BUFFER() == arg_img->data, "Image is not the frame buffer!");
+    return mp_obj_new_int_from_uint(MAIN_FB()->timestamp);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_timestamp_obj, py_image_timestamp);
+
+static mp_obj_t py_image_frame_count(mp_obj_t img_obj)
+{
+    image_t *arg_img = (image_t *) py_image_cobj(img_obj);
+    PY_ASSERT_TRUE_MSG(MAIN_FB_BUFFER() == arg_img->data, "Image is not the frame buffer!");
+    return mp_obj_new_int_from_uint(MAIN_FB()->frame_count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_frame_count_obj, py_image_frame_count);
+
 static mp_obj_t py_image_bytearray(mp_obj_t img_obj)
 {
     image_t *arg_img = (image_t *) py_image_cobj(img_obj);
@@ -747,6 +840,276 @@ STATIC mp_obj_t py_image_set_pixel(uint n_args, const mp_obj_t *args, mp_map_t *
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_set_pixel_obj, 2, py_image_set_pixel);
 
+// Returns buf_obj (which must be a writable buffer of at least len bytes) or a new bytearray.
+static mp_obj_t py_image_pixels_buffer(mp_obj_t buf_obj, size_t len, uint8_t **data)
+{
+    if (buf_obj && (buf_obj != mp_const_none)) {
+        mp_buffer_info_t bufinfo;
+        mp_get_buffer_raise(buf_obj, &bufinfo, MP_BUFFER_WRITE);
+        PY_ASSERT_TRUE_MSG(bufinfo.len >= len, "Buffer is too small!");
+        *data = bufinfo.buf;
+        return buf_obj;
+    }
+
+    *data = m_new(uint8_t, len);
+    return mp_obj_new_bytearray_by_ref(len, *data);
+}
+
+// Rows and columns are copied with one element per pixel: 1 byte for binary (0/1), grayscale and
+// bayer images and 2 bytes for RGB565 images (the same values get_pixel(rgbtuple=False) returns).
+STATIC mp_obj_t py_image_get_row(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable_bayer(args[0]);
+    int arg_y = mp_obj_get_int(args[1]);
+    PY_ASSERT_TRUE_MSG(IM_Y_INSIDE(arg_img, arg_y), "Row is outside the image!");
+
+    size_t len = arg_img->w * ((arg_img->bpp == IMAGE_BPP_RGB565) ? sizeof(uint16_t) : sizeof(uint8_t));
+    uint8_t *data;
+    mp_obj_t buf = py_image_pixels_buffer(py_helper_keyword_object(n_args, args, 2, kw_args,
+                                          MP_OBJ_NEW_QSTR(MP_QSTR_buffer)), len, &data);
+
+    switch (arg_img->bpp) {
+        case IMAGE_BPP_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(arg_img, arg_y);
+            for (int x = 0, xx = arg_img->w; x < xx; x++) {
+                data[x] = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE:
+        case IMAGE_BPP_BAYER: {
+            memcpy(data, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(arg_img, arg_y), len);
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            memcpy(data, IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(arg_img, arg_y), len);
+            break;
+        }
+        default: {
+            memset(data, 0, len);
+            break;
+        }
+    }
+
+    return buf;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_row_obj, 2, py_image_get_row);
+
+STATIC mp_obj_t py_image_get_column(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable_bayer(args[0]);
+    int arg_x = mp_obj_get_int(args[1]);
+    PY_ASSERT_TRUE_MSG(IM_X_INSIDE(arg_img, arg_x), "Column is outside the image!");
+
+    size_t len = arg_img->h * ((arg_img->bpp == IMAGE_BPP_RGB565) ? sizeof(uint16_t) : sizeof(uint8_t));
+    uint8_t *data;
+    mp_obj_t buf = py_image_pixels_buffer(py_helper_keyword_object(n_args, args, 2, kw_args,
+                                          MP_OBJ_NEW_QSTR(MP_QSTR_buffer)), len, &data);
+
+    switch (arg_img->bpp) {
+        case IMAGE_BPP_BINARY: {
+            for (int y = 0, yy = arg_img->h; y < yy; y++) {
+                data[y] = IMAGE_GET_BINARY_PIXEL_FAST(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(arg_img, y), arg_x);
+            }
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE:
+        case IMAGE_BPP_BAYER: {
+            for (int y = 0, yy = arg_img->h; y < yy; y++) {
+                data[y] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(arg_img, y), arg_x);
+            }
+            break;
+        }
+        case IMAGE_BPP_RGB565: {
+            // The buffer may not be 2 byte aligned.
+            for (int y = 0, yy = arg_img->h; y < yy; y++) {
+                uint16_t pixel = IMAGE_GET_RGB565_PIXEL_FAST(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(arg_img, y), arg_x);
+                memcpy(data + (y * sizeof(uint16_t)), &pixel, sizeof(uint16_t));
+            }
+            break;
+        }
+        default: {
+            memset(data, 0, len);
+            break;
+        }
+    }
+
+    return buf;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_column_obj, 2, py_image_get_column);
+
+// Sets every (x, y) of a sequence of points to one color, points outside the image are skipped.
+STATIC mp_obj_t py_image_set_pixels(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable_bayer(args[0]);
+
+    mp_uint_t arg_points_len;
+    mp_obj_t *arg_points;
+    mp_obj_get_array(args[1], &arg_points_len, &arg_points);
+
+    int arg_c =
+        py_helper_keyword_color(arg_img, n_args, args, 2, kw_args, -1); // White.
+
+    for (mp_uint_t i = 0; i < arg_points_len; i++) {
+        mp_obj_t *arg_point;
+        mp_obj_get_array_fixed_n(arg_points[i], 2, &arg_point);
+        int x = mp_obj_get_int(arg_point[0]);
+        int y = mp_obj_get_int(arg_point[1]);
+
+        if ((!IM_X_INSIDE(arg_img, x)) || (!IM_Y_INSIDE(arg_img, y))) {
+            continue;
+        }
+
+        switch (arg_img->bpp) {
+            case IMAGE_BPP_BINARY: {
+                IMAGE_PUT_BINARY_PIXEL(arg_img, x, y, arg_c);
+                break;
+            }
+            case IMAGE_BPP_GRAYSCALE:
+            case IMAGE_BPP_BAYER: {
+                IMAGE_PUT_GRAYSCALE_PIXEL(arg_img, x, y, arg_c);
+                break;
+            }
+            case IMAGE_BPP_RGB565: {
+                IMAGE_PUT_RGB565_PIXEL(arg_img, x, y, arg_c);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_set_pixels_obj, 2, py_image_set_pixels);
+
+// ImageView Object //
+// Zero copy typed view (uint8 for grayscale/bayer, uint16 for RGB565) of an image area with a
+// shape and a row stride. The buffer protocol makes it usable with ptr8()/ptr16() in viper code
+// (pixel (x, y) is at y * stride + x) and view[y, x] reads or writes the raw pixel values.
+typedef struct py_image_view_obj {
+    mp_obj_base_t base;
+    mp_obj_t img; // Keeps the image alive.
+    uint8_t *data;
+    int w, h, stride;
+    bool rgb565;
+} py_image_view_obj_t;
+
+static void py_image_view_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_image_view_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"stride\":%d, \"typecode\":\"%c\"}",
+              self->w, self->h, self->stride, self->rgb565 ? 'H' : 'B');
+}
+
+static mp_int_t py_image_view_get_buffer(mp_obj_t self_in, mp_buffer_info_t *bufinfo, mp_uint_t flags)
+{
+    py_image_view_obj_t *self = self_in;
+    bufinfo->buf = self->data;
+    bufinfo->len = (((self->h - 1) * self->stride) + self->w) * (self->rgb565 ? sizeof(uint16_t) : sizeof(uint8_t));
+    bufinfo->typecode = self->rgb565 ? 'H' : 'B';
+    return 0;
+}
+
+static mp_obj_t py_image_view_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value)
+{
+    py_image_view_obj_t *self = self_in;
+
+    if (value == MP_OBJ_NULL) { // delete
+        return MP_OBJ_NULL; // op not supported
+    }
+
+    mp_obj_t *arg_index;
+    mp_obj_get_array_fixed_n(index, 2, &arg_index);
+    int y = mp_obj_get_int(arg_index[0]);
+    int x = mp_obj_get_int(arg_index[1]);
+
+    if ((x < 0) || (self->w <= x) || (y < 0) || (self->h <= y)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_IndexError, "index out of range"));
+    }
+
+    size_t i = (y * self->stride) + x;
+
+    if (value == MP_OBJ_SENTINEL) { // load
+        return mp_obj_new_int(self->rgb565 ? ((uint16_t *) self->data)[i] : self->data[i]);
+    }
+
+    if (self->rgb565) {
+        ((uint16_t *) self->data)[i] = mp_obj_get_int(value);
+    } else {
+        self->data[i] = mp_obj_get_int(value);
+    }
+
+    return mp_const_none;
+}
+
+static mp_obj_t py_image_view_unary_op(mp_unary_op_t op, mp_obj_t self_in)
+{
+    py_image_view_obj_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_LEN:
+            return mp_obj_new_int(self->h);
+
+        default:
+            return MP_OBJ_NULL; // op not supported
+    }
+}
+
+static mp_obj_t py_image_view_shape(mp_obj_t self_in)
+{
+    py_image_view_obj_t *self = self_in;
+    return mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(self->h), mp_obj_new_int(self->w)});
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_view_shape_obj, py_image_view_shape);
+
+static mp_obj_t py_image_view_stride(mp_obj_t self_in)
+{
+    return mp_obj_new_int(((py_image_view_obj_t *) self_in)->stride);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_view_stride_obj, py_image_view_stride);
+
+STATIC const mp_rom_map_elem_t py_image_view_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_shape),  MP_ROM_PTR(&py_image_view_shape_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stride), MP_ROM_PTR(&py_image_view_stride_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_image_view_locals_dict, py_image_view_locals_dict_table);
+
+static const mp_obj_type_t py_image_view_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ImageView,
+    .print = py_image_view_print,
+    .buffer_p = { .get_buffer = py_image_view_get_buffer },
+    .subscr = py_image_view_subscr,
+    .unary_op = py_image_view_unary_op,
+    .locals_dict = (mp_obj_t) &py_image_view_locals_dict
+};
+
+STATIC mp_obj_t py_image_view(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable_bayer(args[0]);
+    PY_ASSERT_TRUE_MSG((arg_img->bpp == IMAGE_BPP_GRAYSCALE)
+                    || (arg_img->bpp == IMAGE_BPP_BAYER)
+                    || (arg_img->bpp == IMAGE_BPP_RGB565), "Image format is not supported.");
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    py_image_view_obj_t *obj = m_new_obj(py_image_view_obj_t);
+    obj->base.type = &py_image_view_type;
+    obj->img = args[0];
+    obj->w = roi.w;
+    obj->h = roi.h;
+    obj->stride = arg_img->w;
+    obj->rgb565 = arg_img->bpp == IMAGE_BPP_RGB565;
+    obj->data = obj->rgb565
+        ? ((uint8_t *) (IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(arg_img, roi.y) + roi.x))
+        : (IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(arg_img, roi.y) + roi.x);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_view_obj, 1, py_image_view);
+
 #ifdef IMLIB_ENABLE_MEAN_POOLING
 static mp_obj_t py_image_mean_pool(mp_obj_t img_obj, mp_obj_t x_div_obj, mp_obj_t y_div_obj)
 {
@@ -770,7 +1133,7 @@ static mp_obj_t py_image_mean_pool(mp_obj_t img_obj, mp_obj_t x_div_obj, mp_obj_
     arg_img->w = out_img.w;
     arg_img->h = out_img.h;
 
-    if (MAIN_FB()->pixels == arg_img->data) {
+    if (MAIN_FB_BUFFER() == arg_img->data) {
         MAIN_FB()->w = out_img.w;
         MAIN_FB()->h = out_img.h;
     }
@@ -779,14 +1142,14 @@ static mp_obj_t py_image_mean_pool(mp_obj_t img_obj, mp_obj_t x_div_obj, mp_obj_
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(py_image_mean_pool_obj, py_image_mean_pool);
 
-static mp_obj_t py_image_mean_pooled(mp_obj_t img_obj, mp_obj_t x_div_obj, mp_obj_t y_div_obj)
+static mp_obj_t py_image_mean_pooled(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
 
-    int arg_x_div = mp_obj_get_int(x_div_obj);
+    int arg_x_div = mp_obj_get_int(args[1]);
     PY_ASSERT_TRUE_MSG(arg_x_div >= 1, "Width divisor must be greater than >= 1");
     PY_ASSERT_TRUE_MSG(arg_x_div <= arg_img->w, "Width divisor must be less than <= img width");
-    int arg_y_div = mp_obj_get_int(y_div_obj);
+    int arg_y_div = mp_obj_get_int(args[2]);
     PY_ASSERT_TRUE_MSG(arg_y_div >= 1, "Height divisor must be greater than >= 1");
     PY_ASSERT_TRUE_MSG(arg_y_div <= arg_img->h, "Height divisor must be less than <= img height");
 
@@ -794,12 +1157,21 @@ static mp_obj_t py_image_mean_pooled(mp_obj_t img_obj, mp_obj_t x_div_obj, mp_ob
     out_img.w = arg_img->w / arg_x_div;
     out_img.h = arg_img->h / arg_y_div;
     out_img.bpp = arg_img->bpp;
-    out_img.pixels = xalloc(image_size(&out_img));
+
+    mp_obj_t copy_obj = py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy));
+    image_t *arg_dst = py_image_arg_to_dest(copy_obj, &out_img);
+    out_img.pixels = arg_dst ? arg_dst->pixels : xalloc_data(image_size(&out_img));
 
     imlib_mean_pool(arg_img, &out_img, arg_x_div, arg_y_div);
+
+    if (arg_dst) {
+        py_image_update_dest(arg_dst, &out_img);
+        return copy_obj;
+    }
+
     return py_image_from_struct(&out_img);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_3(py_image_mean_pooled_obj, py_image_mean_pooled);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_mean_pooled_obj, 3, py_image_mean_pooled);
 #endif // IMLIB_ENABLE_MEAN_POOLING
 
 #ifdef IMLIB_ENABLE_MIDPOINT_POOLING
@@ -828,7 +1200,7 @@ static mp_obj_t py_image_midpoint_pool(uint n_args, const mp_obj_t *args, mp_map
     arg_img->w = out_img.w;
     arg_img->h = out_img.h;
 
-    if (MAIN_FB()->pixels == arg_img->data) {
+    if (MAIN_FB_BUFFER() == arg_img->data) {
         MAIN_FB()->w = out_img.w;
         MAIN_FB()->h = out_img.h;
     }
@@ -855,7 +1227,7 @@ static mp_obj_t py_image_midpoint_pooled(uint n_args, const mp_obj_t *args, mp_m
     out_img.w = arg_img->w / arg_x_div;
     out_img.h = arg_img->h / arg_y_div;
     out_img.bpp = arg_img->bpp;
-    out_img.pixels = xalloc(image_size(&out_img));
+    out_img.pixels = xalloc_data(image_size(&out_img));
 
     imlib_midpoint_pool(arg_img, &out_img, arg_x_div, arg_y_div, arg_bias);
     return py_image_from_struct(&out_img);
@@ -873,7 +1245,7 @@ static mp_obj_t py_image_to_bitmap(uint n_args, const mp_obj_t *args, mp_map_t *
     out.w = arg_img->w;
     out.h = arg_img->h;
     out.bpp = IMAGE_BPP_BINARY;
-    out.data = copy ? xalloc(image_size(&out)) : arg_img->data;
+    out.data = copy ? xalloc_data(image_size(&out)) : arg_img->data;
 
     switch(arg_img->bpp) {
         case IMAGE_BPP_BINARY: {
@@ -940,7 +1312,7 @@ static mp_obj_t py_image_to_bitmap(uint n_args, const mp_obj_t *args, mp_map_t *
     if (!copy) {
         arg_img->bpp = IMAGE_BPP_BINARY;
 
-        if ((MAIN_FB()->pixels == out.data)) {
+        if ((MAIN_FB_BUFFER() == out.data)) {
             MAIN_FB()->bpp = out.bpp;
         }
     }
@@ -951,19 +1323,28 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_to_bitmap_obj, 1, py_image_to_bitmap)
 
 static mp_obj_t py_image_to_grayscale(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
-    bool copy = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy), false);
+    image_t *arg_img = py_helper_arg_to_image_mutable_bayer(args[0]);
+    mp_obj_t copy_obj = py_helper_keyword_object(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy));
     int channel = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rgb_channel), -1);
+    bool edge_aware = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_edge_aware), false);
 
     image_t out;
     out.w = arg_img->w;
     out.h = arg_img->h;
     out.bpp = IMAGE_BPP_GRAYSCALE;
-    out.data = copy ? xalloc(image_size(&out)) : arg_img->data;
+
+    image_t *arg_dst = py_image_arg_to_dest(copy_obj, &out);
+    bool copy = arg_dst ? (arg_dst->data != arg_img->data) : (copy_obj && mp_obj_get_int(copy_obj));
+    out.data = arg_dst ? arg_dst->data : (copy ? xalloc_data(image_size(&out)) : arg_img->data);
 
     switch(arg_img->bpp) {
+        case IMAGE_BPP_BAYER: {
+            PY_ASSERT_TRUE_MSG(copy, "Can't convert Bayer images in place!");
+            imlib_debayer_image(&out, arg_img, edge_aware);
+            break;
+        }
         case IMAGE_BPP_BINARY: {
-            if (copy || (MAIN_FB()->pixels != out.data)) {
+            if (copy || (MAIN_FB_BUFFER() != out.data)) {
                 PY_ASSERT_TRUE_MSG((out.w == 1) || copy,
                     "Can't convert to grayscale in place!");
                 for (int y = 0, yy = out.h; y < yy; y++) {
@@ -1043,30 +1424,41 @@ static mp_obj_t py_image_to_grayscale(uint n_args, const mp_obj_t *args, mp_map_
     if (!copy) {
         arg_img->bpp = IMAGE_BPP_GRAYSCALE;
 
-        if ((MAIN_FB()->pixels == out.data)) {
+        if ((MAIN_FB_BUFFER() == out.data)) {
             MAIN_FB()->bpp = out.bpp;
         }
     }
 
+    if (arg_dst) {
+        py_image_update_dest(arg_dst, &out);
+        return copy_obj;
+    }
+
     return py_image_from_struct(&out);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_to_grayscale_obj, 1, py_image_to_grayscale);
 
 static mp_obj_t py_image_to_rgb565(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+    image_t *arg_img = py_helper_arg_to_image_mutable_bayer(args[0]);
     bool copy = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy), false);
     int channel = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rgb_channel), -1);
+    bool edge_aware = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_edge_aware), false);
 
     image_t out;
     out.w = arg_img->w;
     out.h = arg_img->h;
     out.bpp = IMAGE_BPP_RGB565;
-    out.data = copy ? xalloc(image_size(&out)) : arg_img->data;
+    out.data = copy ? xalloc_data(image_size(&out)) : arg_img->data;
 
     switch(arg_img->bpp) {
+        case IMAGE_BPP_BAYER: {
+            PY_ASSERT_TRUE_MSG(copy, "Can't convert Bayer images in place!");
+            imlib_debayer_image(&out, arg_img, edge_aware);
+            break;
+        }
         case IMAGE_BPP_BINARY: {
-            if (copy || (MAIN_FB()->pixels != out.data)) {
+            if (copy || (MAIN_FB_BUFFER() != out.data)) {
                 PY_ASSERT_TRUE_MSG((out.w == 1) || copy,
                     "Can't convert to grayscale in place!");
                 for (int y = 0, yy = out.h; y < yy; y++) {
@@ -1106,7 +1498,7 @@ static mp_obj_t py_image_to_rgb565(uint n_args, const mp_obj_t *args, mp_map_t *
             break;
         }
         case IMAGE_BPP_GRAYSCALE: {
-            if (copy || (MAIN_FB()->pixels != out.data)) {
+            if (copy || (MAIN_FB_BUFFER() != out.data)) {
                 PY_ASSERT_TRUE_MSG(copy,
                     "Can't convert to rgb565 in place!");
                 for (int y = 0, yy = out.h; y < yy; y++) {
@@ -1181,7 +1573,7 @@ static mp_obj_t py_image_to_rgb565(uint n_args, const mp_obj_t *args, mp_map_t *
     if (!copy) {
         arg_img->bpp = IMAGE_BPP_RGB565;
 
-        if ((MAIN_FB()->pixels == out.data)) {
+        if ((MAIN_FB_BUFFER() == out.data)) {
             MAIN_FB()->bpp = out.bpp;
         }
     }
@@ -1210,11 +1602,11 @@ static mp_obj_t py_image_to_rainbow(uint n_args, const mp_obj_t *args, mp_map_t
     out.w = arg_img->w;
     out.h = arg_img->h;
     out.bpp = IMAGE_BPP_RGB565;
-    out.data = copy ? xalloc(image_size(&out)) : arg_img->data;
+    out.data = copy ? xalloc_data(image_size(&out)) : arg_img->data;
 
     switch(arg_img->bpp) {
         case IMAGE_BPP_BINARY: {
-            if (copy || (MAIN_FB()->pixels != out.data)) {
+            if (copy || (MAIN_FB_BUFFER() != out.data)) {
                 PY_ASSERT_TRUE_MSG((out.w == 1) || copy,
                     "Can't convert to rainbow in place!");
                 for (int y = 0, yy = out.h; y < yy; y++) {
@@ -1254,7 +1646,7 @@ static mp_obj_t py_image_to_rainbow(uint n_args, const mp_obj_t *args, mp_map_t
             break;
         }
         case IMAGE_BPP_GRAYSCALE: {
-            if (copy || (MAIN_FB()->pixels != out.data)) {
+            if (copy || (MAIN_FB_BUFFER() != out.data)) {
                 PY_ASSERT_TRUE_MSG(copy,
                     "Can't convert to rainbow in place!");
                 for (int y = 0, yy = out.h; y < yy; y++) {
@@ -1330,7 +1722,7 @@ static mp_obj_t py_image_to_rainbow(uint n_args, const mp_obj_t *args, mp_map_t
     if (!copy) {
         arg_img->bpp = IMAGE_BPP_RGB565;
 
-        if (MAIN_FB()->pixels == out.data) {
+        if (MAIN_FB_BUFFER() == out.data) {
             MAIN_FB()->bpp = out.bpp;
         }
     }
@@ -1343,7 +1735,7 @@ static mp_obj_t py_image_jpeg_encode_for_ide(mp_obj_t img_obj)
 {
     image_t *arg_img = py_image_cobj(img_obj);
     PY_ASSERT_TRUE_MSG(arg_img->bpp >= IMAGE_BPP_JPEG, "Image format is not supported!");
-    PY_ASSERT_TRUE_MSG(MAIN_FB()->pixels == arg_img->data, "Can't compress in place!");
+    PY_ASSERT_TRUE_MSG(MAIN_FB_BUFFER() == arg_img->data, "Can't compress in place!");
 
     int new_size = fb_encode_for_ide_new_size(arg_img);
     fb_alloc_mark();
@@ -1393,7 +1785,7 @@ static mp_obj_t py_image_compress(uint n_args, const mp_obj_t *args, mp_map_t *k
     arg_img->bpp = out.bpp;
     fb_alloc_free_till_mark();
 
-    if (MAIN_FB()->pixels == arg_img->data) {
+    if (MAIN_FB_BUFFER() == arg_img->data) {
         MAIN_FB()->bpp = arg_img->bpp;
     }
 
@@ -1422,7 +1814,7 @@ static mp_obj_t py_image_compress_for_ide(uint n_args, const mp_obj_t *args, mp_
     arg_img->bpp = out.bpp;
     fb_alloc_free_till_mark();
 
-    if (MAIN_FB()->pixels == arg_img->data) {
+    if (MAIN_FB_BUFFER() == arg_img->data) {
         MAIN_FB()->bpp = arg_img->bpp;
     }
 
@@ -1483,6 +1875,44 @@ static mp_obj_t py_image_compressed_for_ide(uint n_args, const mp_obj_t *args, m
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_compressed_for_ide_obj, 1, py_image_compressed_for_ide);
 
+#if (OMV_HARDWARE_JPEG == 1)
+static mp_obj_t py_image_decompressed(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_image_cobj(args[0]);
+    PY_ASSERT_TRUE_MSG(IM_IS_JPEG(arg_img), "Image is not JPEG compressed!");
+
+    float arg_scale =
+        py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale), 1.0f);
+    PY_ASSERT_TRUE_MSG((0.0f < arg_scale), "Error: 0.0 < scale!");
+    int div = fast_roundf(1.0f / arg_scale);
+    PY_ASSERT_TRUE_MSG((div == 1) || (div == 2) || (div == 4) || (div == 8), "Scale must be 1, 1/2, 1/4 or 1/8!");
+
+    bool arg_grayscale =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_grayscale), false);
+
+    image_t out;
+    out.w = (arg_img->w + div - 1) / div;
+    out.h = (arg_img->h + div - 1) / div;
+    out.bpp = arg_grayscale ? IMAGE_BPP_GRAYSCALE : IMAGE_BPP_RGB565;
+
+    mp_obj_t copy_obj = py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy));
+    image_t *arg_dst = py_image_arg_to_dest(copy_obj, &out);
+    out.pixels = arg_dst ? arg_dst->pixels : xalloc_data(image_size(&out));
+
+    fb_alloc_mark();
+    PY_ASSERT_FALSE_MSG(jpeg_decompress(arg_img, &out, div), "JPEG decoding failed!");
+    fb_alloc_free_till_mark();
+
+    if (arg_dst) {
+        py_image_update_dest(arg_dst, &out);
+        return copy_obj;
+    }
+
+    return py_image_from_struct(&out);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_decompressed_obj, 1, py_image_decompressed);
+#endif // OMV_HARDWARE_JPEG
+
 static mp_obj_t py_image_copy_int(uint n_args, const mp_obj_t *args, mp_map_t *kw_args, bool mode)
 {
     // mode == false -> copy behavior
@@ -1501,6 +1931,10 @@ static mp_obj_t py_image_copy_int(uint n_args, const mp_obj_t *args, mp_map_t *k
     PY_ASSERT_TRUE_MSG((0.0f <= arg_y_scale), "Error: 0.0 <= y_scale!");
 
     mp_obj_t copy_to_fb_obj = py_helper_keyword_object(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(mode ? MP_QSTR_copy : MP_QSTR_copy_to_fb));
+
+    // IMAGE_HINT_BILINEAR or IMAGE_HINT_AREA, nearest neighbor otherwise.
+    int arg_hint =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_hint), 0);
     bool copy_to_fb = false;
     image_t *arg_other = mode ? arg_img : NULL;
 
@@ -1536,12 +1970,12 @@ static mp_obj_t py_image_copy_int(uint n_args, const mp_obj_t *args, mp_map_t *k
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
-        image.data = MAIN_FB()->pixels;
+        image.data = MAIN_FB_BUFFER();
     } else if (arg_other) {
         PY_ASSERT_TRUE_MSG((image_size(&image) <= image_size(arg_other)), "The new image won't fit in the target frame buffer!");
         image.data = arg_other->data;
     } else {
-        image.data = xalloc(image_size(&image));
+        image.data = xalloc_data(image_size(&image));
     }
 
     bool in_place = arg_img->data == image.data;
@@ -1564,52 +1998,13 @@ static mp_obj_t py_image_copy_int(uint n_args, const mp_obj_t *args, mp_map_t *k
         }
     }
 
-    float over_xscale = IM_DIV(1.0, arg_x_scale), over_yscale = IM_DIV(1.0f, arg_y_scale);
-
-    switch(arg_img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            for (int y = 0, yy = image.h; y < yy; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(arg_img, fast_floorf(y * over_yscale) + roi.y);
-                uint32_t *row_ptr_2 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&image, y);
-                for (int x = 0, xx = image.w; x < xx; x++) {
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr_2, x,
-                        IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, fast_floorf(x * over_xscale) + roi.x));
-                }
-            }
-            break;
-        }
-        case IMAGE_BPP_GRAYSCALE: {
-            for (int y = 0, yy = image.h; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(arg_img, fast_floorf(y * over_yscale) + roi.y);
-                uint8_t *row_ptr_2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&image, y);
-                for (int x = 0, xx = image.w; x < xx; x++) {
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr_2, x,
-                        IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, fast_floorf(x * over_xscale) + roi.x));
-                }
-            }
-            break;
-        }
-        case IMAGE_BPP_RGB565: {
-            for (int y = 0, yy = image.h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(arg_img, fast_floorf(y * over_yscale) + roi.y);
-                uint16_t *row_ptr_2 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&image, y);
-                for (int x = 0, xx = image.w; x < xx; x++) {
-                    IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr_2, x,
-                        IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, fast_floorf(x * over_xscale) + roi.x));
-                }
-            }
-            break;
-        }
-        default: {
-            break;
-        }
-    }
+    imlib_resample(&image, arg_img, &roi, arg_hint);
 
     if (in_place) {
         fb_alloc_free_till_mark();
     }
 
-    if (MAIN_FB()->pixels == image.data) {
+    if (MAIN_FB_BUFFER() == image.data) {
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
@@ -1618,7 +2013,7 @@ static mp_obj_t py_image_copy_int(uint n_args, const mp_obj_t *args, mp_map_t *k
     if (copy_to_fb) {
         image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
 
-        if (MAIN_FB()->pixels == arg_img->data) {
+        if (MAIN_FB_BUFFER() == arg_img->data) {
             arg_img->w = image.w;
             arg_img->h = image.h;
             arg_img->bpp = image.bpp;
@@ -1629,6 +2024,11 @@ static mp_obj_t py_image_copy_int(uint n_args, const mp_obj_t *args, mp_map_t *k
             arg_other->h = image.h;
             arg_other->bpp = image.bpp;
         }
+
+        // Writing into a caller provided image (e.g. from an ImagePool) allocates nothing.
+        if (copy_to_fb_obj && (!mp_obj_is_integer(copy_to_fb_obj))) {
+            return copy_to_fb_obj;
+        }
     }
 
     return py_image_from_struct(&image);
@@ -2233,6 +2633,14 @@ STATIC mp_obj_t py_image_binary(uint n_args, const mp_obj_t *args, mp_map_t *kw_
         py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_to_bitmap), false);
     bool arg_copy =
         py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy), false);
+    // adaptive=ksize compares each pixel with the mean of its window instead (thresholds are ignored).
+    int arg_adaptive =
+        py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_adaptive), 0);
+    PY_ASSERT_TRUE_MSG(arg_adaptive >= 0, "Adaptive kernel size must be >= 0!");
+    PY_ASSERT_TRUE_MSG((!arg_adaptive) || (arg_img->bpp != IMAGE_BPP_BINARY),
+                       "Adaptive thresholding needs a grayscale or RGB565 image!");
+    int arg_offset =
+        py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_offset), 0);
 
     if (arg_to_bitmap && (!arg_copy)) {
         switch(arg_img->bpp) {
@@ -2256,10 +2664,14 @@ STATIC mp_obj_t py_image_binary(uint n_args, const mp_obj_t *args, mp_map_t *kw_
     out.w = arg_img->w;
     out.h = arg_img->h;
     out.bpp = arg_to_bitmap ? IMAGE_BPP_BINARY : arg_img->bpp;
-    out.data = arg_copy ? xalloc(image_size(&out)) : arg_img->data;
+    out.data = arg_copy ? xalloc_data(image_size(&out)) : arg_img->data;
 
     fb_alloc_mark();
-    imlib_binary(&out, arg_img, &arg_thresholds, arg_invert, arg_zero, arg_msk);
+    if (arg_adaptive) {
+        imlib_adaptive_binary(&out, arg_img, arg_adaptive, arg_offset, arg_invert, arg_zero, arg_msk);
+    } else {
+        imlib_binary(&out, arg_img, &arg_thresholds, arg_invert, arg_zero, arg_msk);
+    }
     fb_alloc_free_till_mark();
 
     list_free(&arg_thresholds);
@@ -2267,7 +2679,7 @@ STATIC mp_obj_t py_image_binary(uint n_args, const mp_obj_t *args, mp_map_t *kw_
     if (arg_to_bitmap && (!arg_copy)) {
         arg_img->bpp = IMAGE_BPP_BINARY;
 
-        if ((MAIN_FB()->pixels == out.data)) {
+        if ((MAIN_FB_BUFFER() == out.data)) {
             MAIN_FB()->bpp = out.bpp;
         }
     }
@@ -2283,19 +2695,142 @@ STATIC mp_obj_t py_image_invert(mp_obj_t img_obj)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_invert_obj, py_image_invert);
 
-STATIC mp_obj_t py_image_b_and(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+#ifdef IMLIB_ENABLE_COMPRESSED_IMAGES
+// CompressedImage Object //
+// A lossless compressed copy of a binary or grayscale image (a background, reference frame or
+// mask) which the image operations (b_and(), sub(), difference()...) decode a row at a time, so
+// it only needs a fraction of the RAM of the image.
+typedef struct py_compressed_image_obj {
+    mp_obj_base_t base;
+    image_t img;
+    size_t len, size; // Compressed bytes and buffer size.
+} py_compressed_image_obj_t;
+
+static void py_compressed_image_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
 {
-    image_t *arg_img =
-        py_helper_arg_to_image_mutable(args[0]);
-    image_t *arg_msk =
-        py_helper_keyword_to_image_mutable_mask(n_args, args, 2, kw_args);
+    py_compressed_image_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"type\":\"%s\", \"size\":%d}",
+              self->img.w, self->img.h, (self->img.bpp == IMAGE_BPP_RLE_BINARY) ? "binary" : "grayscale",
+              self->len);
+}
 
-    fb_alloc_mark();
+mp_obj_t py_compressed_image_update(mp_obj_t self_in, mp_obj_t img_obj)
+{
+    py_compressed_image_obj_t *self = self_in;
+    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
+    PY_ASSERT_TRUE_MSG((arg_img->bpp == IMAGE_BPP_BINARY) || (arg_img->bpp == IMAGE_BPP_GRAYSCALE),
+                       "Image must be binary or grayscale!");
+
+    size_t len = imlib_compress_image(arg_img, NULL);
+
+    // The buffer is kept for the next frames.
+    if (self->size < len) {
+        if (self->img.data) {
+            xfree(self->img.data);
+        }
+
+        self->img.data = NULL; // in case xalloc fails
+        self->size = 0;
+        self->img.data = xalloc_data(len);
+        self->size = len;
+    }
+
+    self->img.w = arg_img->w;
+    self->img.h = arg_img->h;
+    self->img.bpp = (arg_img->bpp == IMAGE_BPP_BINARY) ? IMAGE_BPP_RLE_BINARY : IMAGE_BPP_RICE_GRAYSCALE;
+    self->len = imlib_compress_image(arg_img, self->img.data);
+    return self_in;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_compressed_image_update_obj, py_compressed_image_update);
+
+mp_obj_t py_compressed_image_decompress(mp_obj_t self_in, mp_obj_t img_obj)
+{
+    py_compressed_image_obj_t *self = self_in;
+    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
+    PY_ASSERT_TRUE_MSG((arg_img->w == self->img.w) && (arg_img->h == self->img.h)
+                       && (arg_img->bpp == ((self->img.bpp == IMAGE_BPP_RLE_BINARY) ? IMAGE_BPP_BINARY : IMAGE_BPP_GRAYSCALE)),
+                       "The image must have the size and type of the CompressedImage!");
+
+    fb_alloc_mark();
+    imlib_decompress_image(arg_img, &self->img);
+    fb_alloc_free_till_mark();
+    return img_obj;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_compressed_image_decompress_obj, py_compressed_image_decompress);
+
+mp_obj_t py_compressed_image_width(mp_obj_t self_in) { return mp_obj_new_int(((py_compressed_image_obj_t *) self_in)->img.w); }
+mp_obj_t py_compressed_image_height(mp_obj_t self_in) { return mp_obj_new_int(((py_compressed_image_obj_t *) self_in)->img.h); }
+mp_obj_t py_compressed_image_size(mp_obj_t self_in) { return mp_obj_new_int(((py_compressed_image_obj_t *) self_in)->len); }
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_compressed_image_width_obj, py_compressed_image_width);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_compressed_image_height_obj, py_compressed_image_height);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_compressed_image_size_obj, py_compressed_image_size);
+
+STATIC const mp_rom_map_elem_t py_compressed_image_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&py_compressed_image_update_obj) },
+    { MP_ROM_QSTR(MP_QSTR_decompress), MP_ROM_PTR(&py_compressed_image_decompress_obj) },
+    { MP_ROM_QSTR(MP_QSTR_width), MP_ROM_PTR(&py_compressed_image_width_obj) },
+    { MP_ROM_QSTR(MP_QSTR_height), MP_ROM_PTR(&py_compressed_image_height_obj) },
+    { MP_ROM_QSTR(MP_QSTR_size), MP_ROM_PTR(&py_compressed_image_size_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_compressed_image_locals_dict, py_compressed_image_locals_dict_table);
+
+static const mp_obj_type_t py_compressed_image_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_CompressedImage,
+    .print = py_compressed_image_print,
+    .locals_dict = (mp_obj_t) &py_compressed_image_locals_dict
+};
+
+mp_obj_t py_image_compressed_image(mp_obj_t img_obj)
+{
+    py_compressed_image_obj_t *obj = m_new_obj(py_compressed_image_obj_t);
+    obj->base.type = &py_compressed_image_type;
+    obj->img.data = NULL;
+    obj->len = 0;
+    obj->size = 0;
+    return py_compressed_image_update(obj, img_obj);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_compressed_image_obj, py_image_compressed_image);
+#endif // IMLIB_ENABLE_COMPRESSED_IMAGES
+
+// True for the image (or CompressedImage) arguments of the image operations.
+static bool py_image_is_other(mp_obj_t arg)
+{
+    #ifdef IMLIB_ENABLE_COMPRESSED_IMAGES
+    if (MP_OBJ_IS_TYPE(arg, &py_compressed_image_type)) {
+        return true;
+    }
+    #endif
+    return MP_OBJ_IS_TYPE(arg, &py_image_type);
+}
+
+static image_t *py_image_arg_to_other(mp_obj_t arg)
+{
+    #ifdef IMLIB_ENABLE_COMPRESSED_IMAGES
+    if (MP_OBJ_IS_TYPE(arg, &py_compressed_image_type)) {
+        return &((py_compressed_image_obj_t *) arg)->img;
+    }
+    #endif
+    return py_helper_arg_to_image_mutable(arg);
+}
+
+STATIC mp_obj_t py_image_b_and(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img =
+        py_helper_arg_to_image_mutable(args[0]);
+    image_t *arg_msk =
+        py_helper_keyword_to_image_mutable_mask(n_args, args, 2, kw_args);
+
+    fb_alloc_mark();
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_b_and(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_b_and(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_b_and(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_b_and(arg_img, NULL, NULL,
                     py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2319,8 +2854,8 @@ STATIC mp_obj_t py_image_b_nand(uint n_args, const mp_obj_t *args, mp_map_t *kw_
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_b_nand(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_b_nand(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_b_nand(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_b_nand(arg_img, NULL, NULL,
                      py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2344,8 +2879,8 @@ STATIC mp_obj_t py_image_b_or(uint n_args, const mp_obj_t *args, mp_map_t *kw_ar
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_b_or(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_b_or(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_b_or(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_b_or(arg_img, NULL, NULL,
                    py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2369,8 +2904,8 @@ STATIC mp_obj_t py_image_b_nor(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_b_nor(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_b_nor(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_b_nor(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_b_nor(arg_img, NULL, NULL,
                     py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2394,8 +2929,8 @@ STATIC mp_obj_t py_image_b_xor(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_b_xor(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_b_xor(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_b_xor(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_b_xor(arg_img, NULL, NULL,
                     py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2419,8 +2954,8 @@ STATIC mp_obj_t py_image_b_xnor(uint n_args, const mp_obj_t *args, mp_map_t *kw_
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_b_xnor(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_b_xnor(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_b_xnor(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_b_xnor(arg_img, NULL, NULL,
                      py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2606,7 +3141,7 @@ STATIC mp_obj_t py_image_replace(uint n_args, const mp_obj_t *args, mp_map_t *kw
 
     fb_alloc_free_till_mark();
 
-    if (MAIN_FB()->pixels == arg_img->data) {
+    if (MAIN_FB_BUFFER() == arg_img->data) {
         MAIN_FB()->w = arg_img->w;
         MAIN_FB()->h = arg_img->h;
     }
@@ -2626,8 +3161,8 @@ STATIC mp_obj_t py_image_add(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_add(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_add(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_add(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_add(arg_img, NULL, NULL,
                   py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2653,8 +3188,8 @@ STATIC mp_obj_t py_image_sub(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_sub(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_reverse, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_sub(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_reverse, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_sub(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_reverse, arg_msk);
     } else {
         imlib_sub(arg_img, NULL, NULL,
                   py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2680,8 +3215,8 @@ STATIC mp_obj_t py_image_mul(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_mul(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_invert, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_mul(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_invert, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_mul(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_invert, arg_msk);
     } else {
         imlib_mul(arg_img, NULL, NULL,
                   py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2710,8 +3245,8 @@ STATIC mp_obj_t py_image_div(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_div(arg_img, mp_obj_str_get_str(args[1]), NULL, 0,
                   arg_invert, arg_mod, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_div(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0,
+    } else if (py_image_is_other(args[1])) {
+        imlib_div(arg_img, NULL, py_image_arg_to_other(args[1]), 0,
                   arg_invert, arg_mod, arg_msk);
     } else {
         imlib_div(arg_img, NULL, NULL,
@@ -2736,8 +3271,8 @@ STATIC mp_obj_t py_image_min(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_min(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_min(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_min(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_min(arg_img, NULL, NULL,
                   py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2761,8 +3296,8 @@ STATIC mp_obj_t py_image_max(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_max(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_max(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_max(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_max(arg_img, NULL, NULL,
                   py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2786,8 +3321,8 @@ STATIC mp_obj_t py_image_difference(uint n_args, const mp_obj_t *args, mp_map_t
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_difference(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_difference(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_difference(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_msk);
     } else {
         imlib_difference(arg_img, NULL, NULL,
                          py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2814,8 +3349,8 @@ STATIC mp_obj_t py_image_blend(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
 
     if (MP_OBJ_IS_STR(args[1])) {
         imlib_blend(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, arg_alpha, arg_msk);
-    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_blend(arg_img, NULL, py_helper_arg_to_image_mutable(args[1]), 0, arg_alpha, arg_msk);
+    } else if (py_image_is_other(args[1])) {
+        imlib_blend(arg_img, NULL, py_image_arg_to_other(args[1]), 0, arg_alpha, arg_msk);
     } else {
         imlib_blend(arg_img, NULL, NULL,
                     py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
@@ -2827,6 +3362,162 @@ STATIC mp_obj_t py_image_blend(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_blend_obj, 2, py_image_blend);
+
+// Op chains, e.g. img.ops().sub(bg).difference(fg).binary(thresholds).run(), run in one pass.
+#define PY_OPS_MAX (16)
+
+typedef struct py_ops_obj {
+    mp_obj_base_t base;
+    mp_obj_t img;
+    int len;
+    struct {
+        imlib_math_op_t op;
+        mp_obj_t other, thresholds;
+    } ops[PY_OPS_MAX];
+} py_ops_obj_t;
+
+static void py_ops_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_ops_obj_t *self = self_in;
+    mp_printf(print, "{\"ops\":%d}", self->len);
+}
+
+static mp_obj_t py_ops_push(uint n_args, const mp_obj_t *args, imlib_math_op_type_t type, bool invert, int alpha)
+{
+    py_ops_obj_t *self = args[0];
+    PY_ASSERT_TRUE_MSG(self->len < PY_OPS_MAX, "Too many ops!");
+    PY_ASSERT_FALSE_MSG(MP_OBJ_IS_STR(args[1]), "Ops can't read images from files!");
+
+    imlib_math_op_t *op = &self->ops[self->len].op;
+    op->type = type;
+    op->other = NULL;
+    op->scalar = 0;
+    op->alpha = alpha;
+    op->invert = invert;
+    op->thresholds = NULL;
+    self->ops[self->len].other = MP_OBJ_NULL;
+    self->ops[self->len].thresholds = MP_OBJ_NULL;
+
+    if (type == IMLIB_MATH_OP_BINARY) {
+        self->ops[self->len].thresholds = args[1];
+    } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
+        self->ops[self->len].other = args[1];
+    } else {
+        op->scalar = py_helper_keyword_color(py_helper_arg_to_image_mutable(self->img), n_args, args, 1, NULL, 0);
+    }
+
+    self->len += 1;
+    return self;
+}
+
+STATIC mp_obj_t py_ops_add(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    return py_ops_push(n_args, args, IMLIB_MATH_OP_ADD, false, 0);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_ops_add_obj, 2, py_ops_add);
+
+STATIC mp_obj_t py_ops_sub(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    bool arg_reverse =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_reverse), false);
+    return py_ops_push(n_args, args, IMLIB_MATH_OP_SUB, arg_reverse, 0);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_ops_sub_obj, 2, py_ops_sub);
+
+STATIC mp_obj_t py_ops_mul(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    return py_ops_push(n_args, args, IMLIB_MATH_OP_MUL, arg_invert, 0);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_ops_mul_obj, 2, py_ops_mul);
+
+STATIC mp_obj_t py_ops_difference(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    return py_ops_push(n_args, args, IMLIB_MATH_OP_DIFFERENCE, false, 0);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_ops_difference_obj, 2, py_ops_difference);
+
+STATIC mp_obj_t py_ops_blend(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_alpha =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_alpha), 128);
+    PY_ASSERT_TRUE_MSG((0 <= arg_alpha) && (arg_alpha <= 256), "Error: 0 <= alpha <= 256!");
+    return py_ops_push(n_args, args, IMLIB_MATH_OP_BLEND, false, arg_alpha);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_ops_blend_obj, 2, py_ops_blend);
+
+STATIC mp_obj_t py_ops_binary(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    return py_ops_push(n_args, args, IMLIB_MATH_OP_BINARY, arg_invert, 0);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_ops_binary_obj, 2, py_ops_binary);
+
+STATIC mp_obj_t py_ops_run(mp_obj_t self_in)
+{
+    py_ops_obj_t *self = self_in;
+    image_t *arg_img = py_helper_arg_to_image_mutable(self->img);
+    list_t thresholds[PY_OPS_MAX];
+    imlib_math_op_t ops[PY_OPS_MAX];
+
+    for (int i = 0; i < self->len; i++) {
+        ops[i] = self->ops[i].op;
+        if (self->ops[i].other != MP_OBJ_NULL) {
+            ops[i].other = py_helper_arg_to_image_mutable(self->ops[i].other);
+        }
+        if (self->ops[i].thresholds != MP_OBJ_NULL) {
+            list_init(&thresholds[i], sizeof(color_thresholds_list_lnk_data_t));
+            py_helper_arg_to_thresholds(self->ops[i].thresholds, &thresholds[i]);
+            ops[i].thresholds = &thresholds[i];
+        }
+    }
+
+    fb_alloc_mark();
+    imlib_math_ops(arg_img, ops, self->len);
+    fb_alloc_free_till_mark();
+
+    for (int i = 0; i < self->len; i++) {
+        if (self->ops[i].thresholds != MP_OBJ_NULL) {
+            list_free(&thresholds[i]);
+        }
+    }
+
+    return self->img;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_ops_run_obj, py_ops_run);
+
+STATIC const mp_rom_map_elem_t py_ops_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_add), MP_ROM_PTR(&py_ops_add_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sub), MP_ROM_PTR(&py_ops_sub_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mul), MP_ROM_PTR(&py_ops_mul_obj) },
+    { MP_ROM_QSTR(MP_QSTR_difference), MP_ROM_PTR(&py_ops_difference_obj) },
+    { MP_ROM_QSTR(MP_QSTR_blend), MP_ROM_PTR(&py_ops_blend_obj) },
+    { MP_ROM_QSTR(MP_QSTR_binary), MP_ROM_PTR(&py_ops_binary_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&py_ops_run_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_ops_locals_dict, py_ops_locals_dict_table);
+
+static const mp_obj_type_t py_ops_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ops,
+    .print = py_ops_print,
+    .locals_dict = (mp_obj_t) &py_ops_locals_dict
+};
+
+// The chain keeps its ops after run() so it can be run again on every new frame.
+STATIC mp_obj_t py_image_ops(mp_obj_t img_obj)
+{
+    py_helper_arg_to_image_mutable(img_obj);
+    py_ops_obj_t *o = m_new_obj(py_ops_obj_t);
+    o->base.type = &py_ops_type;
+    o->img = img_obj;
+    o->len = 0;
+    return o;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_ops_obj, py_image_ops);
 #endif//IMLIB_ENABLE_MATH_OPS
 
 ////////////////////
@@ -3133,9 +3824,15 @@ STATIC mp_obj_t py_image_bilateral(uint n_args, const mp_obj_t *args, mp_map_t *
         py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
     image_t *arg_msk =
         py_helper_keyword_to_image_mutable_mask(n_args, args, 7, kw_args);
+    bool arg_grid =
+        py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_grid), false);
 
     fb_alloc_mark();
-    imlib_bilateral_filter(arg_img, arg_ksize, arg_color_sigma, arg_space_sigma, arg_threshold, arg_offset, arg_invert, arg_msk);
+    if (arg_grid) {
+        imlib_bilateral_grid_filter(arg_img, arg_ksize, arg_color_sigma, arg_space_sigma, arg_threshold, arg_offset, arg_invert, arg_msk);
+    } else {
+        imlib_bilateral_filter(arg_img, arg_ksize, arg_color_sigma, arg_space_sigma, arg_threshold, arg_offset, arg_invert, arg_msk);
+    }
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -3171,30 +3868,38 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_cartoon_obj, 1, py_image_cartoon);
 /////////////////////////
 
 #ifdef IMLIB_ENABLE_REMOVE_SHADOWS
-STATIC mp_obj_t py_image_remove_shadows(uint n_args, const mp_obj_t *args)
+STATIC mp_obj_t py_image_remove_shadows(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img =
         py_helper_arg_to_image_color(args[0]);
+    int arg_update =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_update), 0);
+    PY_ASSERT_TRUE_MSG((0 <= arg_update) && (arg_update <= 256), "Error: 0 <= update <= 256!");
+    bool arg_difference =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_difference), false);
 
     fb_alloc_mark();
 
     if (n_args < 2) {
-        imlib_remove_shadows(arg_img, NULL, NULL, 0, true);
-    } else if (MP_OBJ_IS_STR(args[1])) {
-        imlib_remove_shadows(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, false);
+        imlib_remove_shadows(arg_img, NULL, NULL, 0, true, 0, false);
     } else if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
-        imlib_remove_shadows(arg_img, NULL, py_helper_arg_to_image_color(args[1]), 0, false);
+        imlib_remove_shadows(arg_img, NULL, py_helper_arg_to_image_color(args[1]), 0, false, arg_update, arg_difference);
     } else {
-        imlib_remove_shadows(arg_img, NULL, NULL,
-                             py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
-                             false);
+        PY_ASSERT_FALSE_MSG(arg_update, "Updating the background needs an image!");
+        if (MP_OBJ_IS_STR(args[1])) {
+            imlib_remove_shadows(arg_img, mp_obj_str_get_str(args[1]), NULL, 0, false, 0, arg_difference);
+        } else {
+            imlib_remove_shadows(arg_img, NULL, NULL,
+                                 py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
+                                 false, 0, arg_difference);
+        }
     }
 
     fb_alloc_free_till_mark();
 
     return args[0];
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_image_remove_shadows_obj, 1, 2, py_image_remove_shadows);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_remove_shadows_obj, 1, py_image_remove_shadows);
 #endif // IMLIB_ENABLE_REMOVE_SHADOWS
 
 #ifdef IMLIB_ENABLE_CHROMINVAR
@@ -3320,126 +4025,592 @@ STATIC mp_obj_t py_image_rotation_corr(uint n_args, const mp_obj_t *args, mp_map
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_rotation_corr_obj, 1, py_image_rotation_corr);
 #endif // IMLIB_ENABLE_ROTATION_CORR
 
-//////////////
-// Get Methods
-//////////////
-
-#ifdef IMLIB_ENABLE_GET_SIMILARITY
-// Similarity Object //
-#define py_similarity_obj_size 4
-typedef struct py_similarity_obj {
+#ifdef IMLIB_ENABLE_REMAP
+// Remap Object //
+// Keeps the source coordinates of a lens_corr() or rotation_corr() so the correction of every
+// frame is only a gather, rebuilt by calling lens_corr() or rotation_corr() on the map.
+typedef struct py_remap_obj {
     mp_obj_base_t base;
-    mp_obj_t avg, std, min, max;
-} py_similarity_obj_t;
+    remap_t map;
+} py_remap_obj_t;
 
-static void py_similarity_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+static void py_remap_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
 {
-    py_similarity_obj_t *self = self_in;
-    mp_printf(print,
-              "{\"mean\":%f, \"stdev\":%f, \"min\":%f, \"max\":%f}",
-              (double) mp_obj_get_float(self->avg),
-              (double) mp_obj_get_float(self->std),
-              (double) mp_obj_get_float(self->min),
-              (double) mp_obj_get_float(self->max));
+    py_remap_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d}", self->map.w, self->map.h);
 }
 
-static mp_obj_t py_similarity_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value)
+mp_obj_t py_remap_lens_corr(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    if (value == MP_OBJ_SENTINEL) { // load
-        py_similarity_obj_t *self = self_in;
-        if (MP_OBJ_IS_TYPE(index, &mp_type_slice)) {
-            mp_bound_slice_t slice;
-            if (!mp_seq_get_fast_slice_indexes(py_similarity_obj_size, index, &slice)) {
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "only slices with step=1 (aka None) are supported"));
-            }
-            mp_obj_tuple_t *result = mp_obj_new_tuple(slice.stop - slice.start, NULL);
-            mp_seq_copy(result->items, &(self->avg) + slice.start, result->len, mp_obj_t);
-            return result;
-        }
-        switch (mp_get_index(self->base.type, py_similarity_obj_size, index, false)) {
-            case 0: return self->avg;
-            case 1: return self->std;
-            case 2: return self->min;
-            case 3: return self->max;
-        }
-    }
-    return MP_OBJ_NULL; // op not supported
+    py_remap_obj_t *self = args[0];
+    float arg_strength =
+        py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_strength), 1.8f);
+    PY_ASSERT_TRUE_MSG(arg_strength > 0.0f, "Strength must be > 0!");
+    float arg_zoom =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zoom), 1.0f);
+    PY_ASSERT_TRUE_MSG(arg_zoom > 0.0f, "Zoom must be > 0!");
+
+    float arg_x_corr =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_corr), 0.0f);
+    float arg_y_corr =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_corr), 0.0f);
+
+    imlib_remap_lens_corr(&self->map, arg_strength, arg_zoom, arg_x_corr, arg_y_corr);
+    return self;
 }
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_remap_lens_corr_obj, 1, py_remap_lens_corr);
 
-mp_obj_t py_similarity_mean(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->avg; }
-mp_obj_t py_similarity_stdev(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->std; }
-mp_obj_t py_similarity_min(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->min; }
-mp_obj_t py_similarity_max(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->max; }
+#ifdef IMLIB_ENABLE_ROTATION_CORR
+mp_obj_t py_remap_rotation_corr(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    py_remap_obj_t *self = args[0];
+    float arg_x_rotation =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_rotation), 0.0f));
+    float arg_y_rotation =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_rotation), 0.0f));
+    float arg_z_rotation =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_z_rotation), 0.0f));
+    float arg_x_translation =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_translation), 0.0f);
+    float arg_y_translation =
+        py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_translation), 0.0f);
+    float arg_zoom =
+        py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zoom), 1.0f);
+    PY_ASSERT_TRUE_MSG(arg_zoom > 0.0f, "Zoom must be > 0!");
+    float arg_fov =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fov), 60.0f));
+    PY_ASSERT_TRUE_MSG((0.0f < arg_fov) && (arg_fov < 180.0f), "FOV must be > 0 and < 180!");
+    float *arg_corners = py_helper_keyword_corner_array(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_corners));
 
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_mean_obj, py_similarity_mean);
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_stdev_obj, py_similarity_stdev);
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_min_obj, py_similarity_min);
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_max_obj, py_similarity_max);
+    fb_alloc_mark();
+    imlib_remap_rotation_corr(&self->map,
+                              arg_x_rotation, arg_y_rotation, arg_z_rotation,
+                              arg_x_translation, arg_y_translation,
+                              arg_zoom, arg_fov, arg_corners);
+    fb_alloc_free_till_mark();
+    return self;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_remap_rotation_corr_obj, 1, py_remap_rotation_corr);
+#endif // IMLIB_ENABLE_ROTATION_CORR
 
-STATIC const mp_rom_map_elem_t py_similarity_locals_dict_table[] = {
-    { MP_ROM_QSTR(MP_QSTR_mean), MP_ROM_PTR(&py_similarity_mean_obj) },
-    { MP_ROM_QSTR(MP_QSTR_stdev), MP_ROM_PTR(&py_similarity_stdev_obj) },
-    { MP_ROM_QSTR(MP_QSTR_min), MP_ROM_PTR(&py_similarity_min_obj) },
-    { MP_ROM_QSTR(MP_QSTR_max), MP_ROM_PTR(&py_similarity_max_obj) }
+STATIC const mp_rom_map_elem_t py_remap_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_lens_corr), MP_ROM_PTR(&py_remap_lens_corr_obj) },
+#ifdef IMLIB_ENABLE_ROTATION_CORR
+    { MP_ROM_QSTR(MP_QSTR_rotation_corr), MP_ROM_PTR(&py_remap_rotation_corr_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_rotation_corr), MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
 };
 
-STATIC MP_DEFINE_CONST_DICT(py_similarity_locals_dict, py_similarity_locals_dict_table);
+STATIC MP_DEFINE_CONST_DICT(py_remap_locals_dict, py_remap_locals_dict_table);
 
-static const mp_obj_type_t py_similarity_type = {
+static const mp_obj_type_t py_remap_type = {
     { &mp_type_type },
-    .name  = MP_QSTR_similarity,
-    .print = py_similarity_print,
-    .subscr = py_similarity_subscr,
-    .locals_dict = (mp_obj_t) &py_similarity_locals_dict
+    .name  = MP_QSTR_Remap,
+    .print = py_remap_print,
+    .locals_dict = (mp_obj_t) &py_remap_locals_dict
 };
 
-static mp_obj_t py_image_get_similarity(mp_obj_t img_obj, mp_obj_t other_obj)
+mp_obj_t py_image_remap_new(mp_obj_t w_obj, mp_obj_t h_obj)
 {
-    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
-    float avg, std, min, max;
+    int w = mp_obj_get_int(w_obj);
+    PY_ASSERT_TRUE_MSG(w > 0, "Width must be > 0");
+    int h = mp_obj_get_int(h_obj);
+    PY_ASSERT_TRUE_MSG(h > 0, "Height must be > 0");
 
-    fb_alloc_mark();
+    py_remap_obj_t *obj = m_new_obj(py_remap_obj_t);
+    obj->base.type = &py_remap_type;
+    imlib_remap_alloc(&obj->map, w, h);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_image_remap_new_obj, py_image_remap_new);
 
-    if (MP_OBJ_IS_STR(other_obj)) {
-        imlib_get_similarity(arg_img, mp_obj_str_get_str(other_obj), NULL, 0, &avg, &std, &min, &max);
-    } else if (MP_OBJ_IS_TYPE(other_obj, &py_image_type)) {
-        imlib_get_similarity(arg_img, NULL, py_helper_arg_to_image_mutable(other_obj), 0, &avg, &std, &min, &max);
-    } else {
-        imlib_get_similarity(arg_img, NULL, NULL,
-                             py_helper_keyword_color(arg_img, 1, &other_obj, 0, NULL, 0),
-                             &avg, &std, &min, &max);
-    }
+STATIC mp_obj_t py_image_remap(mp_obj_t img_obj, mp_obj_t map_obj)
+{
+    image_t *arg_img =
+        py_helper_arg_to_image_mutable(img_obj);
+    PY_ASSERT_TYPE(map_obj, &py_remap_type);
+    remap_t *arg_map = &((py_remap_obj_t *) map_obj)->map;
+    PY_ASSERT_TRUE_MSG((arg_img->w == arg_map->w) && (arg_img->h == arg_map->h),
+                       "Image size doesn't match the map!");
 
+    fb_alloc_mark();
+    imlib_remap(arg_img, arg_map);
     fb_alloc_free_till_mark();
-
-    py_similarity_obj_t *o = m_new_obj(py_similarity_obj_t);
-    o->base.type = &py_similarity_type;
-    o->avg = mp_obj_new_float(avg);
-    o->std = mp_obj_new_float(std);
-    o->min = mp_obj_new_float(min);
-    o->max = mp_obj_new_float(max);
-    return o;
+    return img_obj;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_image_get_similarity_obj, py_image_get_similarity);
-#endif // IMLIB_ENABLE_GET_SIMILARITY
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_image_remap_obj, py_image_remap);
+#endif // IMLIB_ENABLE_REMAP
 
-// Statistics Object //
-#define py_statistics_obj_size 24
-typedef struct py_statistics_obj {
+// Pipeline Object //
+// Records a chain of in place ops with their arguments parsed once (e.g. lens_corr(), gamma_corr(),
+// gaussian(), binary()), run() then applies the whole chain to an image with a single call.
+typedef struct py_pipeline_obj {
     mp_obj_base_t base;
-    image_bpp_t bpp;
-    mp_obj_t LMean, LMedian, LMode, LSTDev, LMin, LMax, LLQ, LUQ,
-        AMean, AMedian, AMode, ASTDev, AMin, AMax, ALQ, AUQ,
-        BMean, BMedian, BMode, BSTDev, BMin, BMax, BLQ, BUQ;
-} py_statistics_obj_t;
+    pipeline_t pipeline;
+} py_pipeline_obj_t;
 
-static void py_statistics_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+static void py_pipeline_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
 {
-    py_statistics_obj_t *self = self_in;
-    switch(self->bpp) {
-        case IMAGE_BPP_BINARY: {
-            mp_printf(print, "{\"mean\":%d, \"median\":%d, \"mode\":%d, \"stdev\":%d, \"min\":%d, \"max\":%d, \"lq\":%d, \"uq\":%d}",
-                      mp_obj_get_int(self->LMean),
+    py_pipeline_obj_t *self = self_in;
+    mp_printf(print, "{\"ops\":%d}", self->pipeline.n);
+}
+
+static pipeline_op_t *py_pipeline_add(mp_obj_t self_in, pipeline_op_type_t type)
+{
+    pipeline_op_t *op = imlib_pipeline_add(&((py_pipeline_obj_t *) self_in)->pipeline, type);
+    PY_ASSERT_TRUE_MSG(op, "Pipeline is full!");
+    return op;
+}
+
+#ifdef IMLIB_ENABLE_LENS_CORR
+static mp_obj_t py_pipeline_lens_corr(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    float arg_strength =
+        py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_strength), 1.8f);
+    PY_ASSERT_TRUE_MSG(arg_strength > 0.0f, "Strength must be > 0!");
+    float arg_zoom =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zoom), 1.0f);
+    PY_ASSERT_TRUE_MSG(arg_zoom > 0.0f, "Zoom must be > 0!");
+    float arg_x_corr =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_corr), 0.0f);
+    float arg_y_corr =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_corr), 0.0f);
+
+    pipeline_op_t *op = py_pipeline_add(args[0], PIPELINE_OP_LENS_CORR);
+    op->args[0] = arg_strength;
+    op->args[1] = arg_zoom;
+    op->args[2] = arg_x_corr;
+    op->args[3] = arg_y_corr;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_lens_corr_obj, 1, py_pipeline_lens_corr);
+#endif // IMLIB_ENABLE_LENS_CORR
+
+#ifdef IMLIB_ENABLE_MATH_OPS
+static mp_obj_t py_pipeline_gamma_corr(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    float arg_gamma =
+        py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_gamma), 1.0f);
+    float arg_contrast =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_contrast), 1.0f);
+    float arg_brightness =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_brightness), 0.0f);
+
+    // imlib_gamma_lut() only caches the last table, each op keeps its own copy.
+    gamma_lut_t *lut = xalloc(sizeof(gamma_lut_t));
+    memcpy(lut, imlib_gamma_lut(arg_gamma, arg_contrast, arg_brightness), sizeof(gamma_lut_t));
+
+    pipeline_op_t *op = py_pipeline_add(args[0], PIPELINE_OP_GAMMA_CORR);
+    op->gamma_lut = lut;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_gamma_corr_obj, 1, py_pipeline_gamma_corr);
+
+static mp_obj_t py_pipeline_negate(mp_obj_t self_in)
+{
+    py_pipeline_add(self_in, PIPELINE_OP_NEGATE);
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_pipeline_negate_obj, py_pipeline_negate);
+#endif // IMLIB_ENABLE_MATH_OPS
+
+#ifdef IMLIB_ENABLE_BINARY_OPS
+static mp_obj_t py_pipeline_binary(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    list_t arg_thresholds;
+    list_init(&arg_thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    py_helper_arg_to_thresholds(args[1], &arg_thresholds);
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    bool arg_zero =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zero), false);
+
+    pipeline_op_t *op = py_pipeline_add(args[0], PIPELINE_OP_BINARY);
+    op->thresholds = arg_thresholds;
+    op->invert = arg_invert;
+    op->zero = arg_zero;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_binary_obj, 2, py_pipeline_binary);
+
+static mp_obj_t py_pipeline_morph_op(uint n_args, const mp_obj_t *args, mp_map_t *kw_args, pipeline_op_type_t type)
+{
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    int arg_threshold =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold),
+            (type == PIPELINE_OP_ERODE) ? (py_helper_ksize_to_n(arg_ksize) - 1) : 0);
+
+    pipeline_op_t *op = py_pipeline_add(args[0], type);
+    op->ksize = arg_ksize;
+    op->threshold = arg_threshold;
+    return args[0];
+}
+
+static mp_obj_t py_pipeline_erode(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    return py_pipeline_morph_op(n_args, args, kw_args, PIPELINE_OP_ERODE);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_erode_obj, 2, py_pipeline_erode);
+
+static mp_obj_t py_pipeline_dilate(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    return py_pipeline_morph_op(n_args, args, kw_args, PIPELINE_OP_DILATE);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_dilate_obj, 2, py_pipeline_dilate);
+#endif // IMLIB_ENABLE_BINARY_OPS
+
+#ifdef IMLIB_ENABLE_MEAN
+static mp_obj_t py_pipeline_mean(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    bool arg_threshold =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), false);
+    int arg_offset =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_offset), 0);
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+
+    pipeline_op_t *op = py_pipeline_add(args[0], PIPELINE_OP_MEAN);
+    op->ksize = arg_ksize;
+    op->threshold = arg_threshold;
+    op->offset = arg_offset;
+    op->invert = arg_invert;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_mean_obj, 2, py_pipeline_mean);
+#endif // IMLIB_ENABLE_MEAN
+
+#ifdef IMLIB_ENABLE_MEDIAN
+static mp_obj_t py_pipeline_median(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    float arg_percentile =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_percentile), 0.5f);
+    PY_ASSERT_TRUE_MSG((0 <= arg_percentile) && (arg_percentile <= 1), "Error: 0 <= percentile <= 1!");
+    bool arg_threshold =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), false);
+    int arg_offset =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_offset), 0);
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+
+    pipeline_op_t *op = py_pipeline_add(args[0], PIPELINE_OP_MEDIAN);
+    op->ksize = arg_ksize;
+    op->args[0] = arg_percentile;
+    op->threshold = arg_threshold;
+    op->offset = arg_offset;
+    op->invert = arg_invert;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_median_obj, 2, py_pipeline_median);
+#endif // IMLIB_ENABLE_MEDIAN
+
+// Shared by gaussian() and morph(), krn has (2 * ksize + 1)^2 entries and m is their sum.
+static mp_obj_t py_pipeline_add_morph(uint n_args, const mp_obj_t *args, mp_map_t *kw_args,
+                                      uint offset, int ksize, int *krn, int m)
+{
+    float arg_mul =
+        py_helper_keyword_float(n_args, args, offset, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mul), 1.0f / m);
+    float arg_add =
+        py_helper_keyword_float(n_args, args, offset + 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_add), 0.0f);
+    bool arg_threshold =
+        py_helper_keyword_int(n_args, args, offset + 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), false);
+    int arg_offset =
+        py_helper_keyword_int(n_args, args, offset + 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_offset), 0);
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, offset + 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+
+    pipeline_op_t *op = py_pipeline_add(args[0], PIPELINE_OP_MORPH);
+    op->ksize = ksize;
+    op->krn = krn;
+    op->args[0] = arg_mul;
+    op->args[1] = arg_add;
+    op->threshold = arg_threshold;
+    op->offset = arg_offset;
+    op->invert = arg_invert;
+    return args[0];
+}
+
+#ifdef IMLIB_ENABLE_GAUSSIAN
+static mp_obj_t py_pipeline_gaussian(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+
+    int k_2 = arg_ksize * 2;
+    int n = k_2 + 1;
+    int *krn = xalloc(n * n * sizeof(int));
+    int m = 0;
+
+    // The outer product of a row of pascal's triangle (kept in the first row).
+    krn[0] = 1;
+
+    for (int i = 0; i < k_2; i++) {
+        krn[i + 1] = (krn[i] * (k_2 - i)) / (i + 1);
+    }
+
+    for (int i = n - 1; i >= 0; i--) {
+        for (int j = n - 1; j >= 0; j--) {
+            int temp = krn[i] * krn[j];
+            krn[(i * n) + j] = temp;
+            m += temp;
+        }
+    }
+
+    if (py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_unsharp), false)) {
+        krn[((n/2)*n)+(n/2)] -= m * 2;
+        m = -m;
+    }
+
+    return py_pipeline_add_morph(n_args, args, kw_args, 3, arg_ksize, krn, m);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_gaussian_obj, 2, py_pipeline_gaussian);
+#endif // IMLIB_ENABLE_GAUSSIAN
+
+#ifdef IMLIB_ENABLE_MORPH
+static mp_obj_t py_pipeline_morph(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+
+    int n = py_helper_ksize_to_n(arg_ksize);
+
+    mp_obj_t *arg_krn;
+    mp_obj_get_array_fixed_n(args[2], n, &arg_krn);
+
+    int *krn = xalloc(n * sizeof(int));
+    int m = 0;
+
+    for (int i = 0; i < n; i++) {
+        krn[i] = mp_obj_get_int(arg_krn[i]);
+        m += krn[i];
+    }
+
+    if (m == 0) {
+        m = 1;
+    }
+
+    return py_pipeline_add_morph(n_args, args, kw_args, 3, arg_ksize, krn, m);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_morph_obj, 3, py_pipeline_morph);
+#endif // IMLIB_ENABLE_MORPH
+
+static mp_obj_t py_pipeline_run(mp_obj_t self_in, mp_obj_t img_obj)
+{
+    pipeline_t *pipeline = &((py_pipeline_obj_t *) self_in)->pipeline;
+    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
+
+    for (int i = 0; i < pipeline->n; i++) {
+        if (pipeline->ops[i].type == PIPELINE_OP_LENS_CORR) {
+            PY_ASSERT_FALSE_MSG(arg_img->w % 2, "Width must be even!");
+            PY_ASSERT_FALSE_MSG(arg_img->h % 2, "Height must be even!");
+        }
+    }
+
+    fb_alloc_mark();
+    imlib_pipeline_run(pipeline, arg_img);
+    fb_alloc_free_till_mark();
+    return img_obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_pipeline_run_obj, py_pipeline_run);
+
+STATIC const mp_rom_map_elem_t py_pipeline_locals_dict_table[] = {
+#ifdef IMLIB_ENABLE_LENS_CORR
+    { MP_ROM_QSTR(MP_QSTR_lens_corr),  MP_ROM_PTR(&py_pipeline_lens_corr_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_lens_corr),  MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+#ifdef IMLIB_ENABLE_MATH_OPS
+    { MP_ROM_QSTR(MP_QSTR_gamma_corr), MP_ROM_PTR(&py_pipeline_gamma_corr_obj) },
+    { MP_ROM_QSTR(MP_QSTR_negate),     MP_ROM_PTR(&py_pipeline_negate_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_gamma_corr), MP_ROM_PTR(&py_func_unavailable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_negate),     MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+#ifdef IMLIB_ENABLE_BINARY_OPS
+    { MP_ROM_QSTR(MP_QSTR_binary),     MP_ROM_PTR(&py_pipeline_binary_obj) },
+    { MP_ROM_QSTR(MP_QSTR_erode),      MP_ROM_PTR(&py_pipeline_erode_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dilate),     MP_ROM_PTR(&py_pipeline_dilate_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_binary),     MP_ROM_PTR(&py_func_unavailable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_erode),      MP_ROM_PTR(&py_func_unavailable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dilate),     MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+#ifdef IMLIB_ENABLE_MEAN
+    { MP_ROM_QSTR(MP_QSTR_mean),       MP_ROM_PTR(&py_pipeline_mean_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_mean),       MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+#ifdef IMLIB_ENABLE_MEDIAN
+    { MP_ROM_QSTR(MP_QSTR_median),     MP_ROM_PTR(&py_pipeline_median_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_median),     MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+#ifdef IMLIB_ENABLE_GAUSSIAN
+    { MP_ROM_QSTR(MP_QSTR_gaussian),   MP_ROM_PTR(&py_pipeline_gaussian_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_gaussian),   MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+#ifdef IMLIB_ENABLE_MORPH
+    { MP_ROM_QSTR(MP_QSTR_morph),      MP_ROM_PTR(&py_pipeline_morph_obj) },
+#else
+    { MP_ROM_QSTR(MP_QSTR_morph),      MP_ROM_PTR(&py_func_unavailable_obj) },
+#endif
+    { MP_ROM_QSTR(MP_QSTR_run),        MP_ROM_PTR(&py_pipeline_run_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_pipeline_locals_dict, py_pipeline_locals_dict_table);
+
+static const mp_obj_type_t py_pipeline_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_Pipeline,
+    .print = py_pipeline_print,
+    .locals_dict = (mp_obj_t) &py_pipeline_locals_dict
+};
+
+mp_obj_t py_image_pipeline_new()
+{
+    py_pipeline_obj_t *obj = m_new_obj(py_pipeline_obj_t);
+    obj->base.type = &py_pipeline_type;
+    imlib_pipeline_init(&obj->pipeline);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_image_pipeline_new_obj, py_image_pipeline_new);
+
+//////////////
+// Get Methods
+//////////////
+
+#ifdef IMLIB_ENABLE_GET_SIMILARITY
+// Similarity Object //
+#define py_similarity_obj_size 4
+typedef struct py_similarity_obj {
+    mp_obj_base_t base;
+    mp_obj_t avg, std, min, max;
+} py_similarity_obj_t;
+
+static void py_similarity_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_similarity_obj_t *self = self_in;
+    mp_printf(print,
+              "{\"mean\":%f, \"stdev\":%f, \"min\":%f, \"max\":%f}",
+              (double) mp_obj_get_float(self->avg),
+              (double) mp_obj_get_float(self->std),
+              (double) mp_obj_get_float(self->min),
+              (double) mp_obj_get_float(self->max));
+}
+
+static mp_obj_t py_similarity_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value)
+{
+    if (value == MP_OBJ_SENTINEL) { // load
+        py_similarity_obj_t *self = self_in;
+        if (MP_OBJ_IS_TYPE(index, &mp_type_slice)) {
+            mp_bound_slice_t slice;
+            if (!mp_seq_get_fast_slice_indexes(py_similarity_obj_size, index, &slice)) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "only slices with step=1 (aka None) are supported"));
+            }
+            mp_obj_tuple_t *result = mp_obj_new_tuple(slice.stop - slice.start, NULL);
+            mp_seq_copy(result->items, &(self->avg) + slice.start, result->len, mp_obj_t);
+            return result;
+        }
+        switch (mp_get_index(self->base.type, py_similarity_obj_size, index, false)) {
+            case 0: return self->avg;
+            case 1: return self->std;
+            case 2: return self->min;
+            case 3: return self->max;
+        }
+    }
+    return MP_OBJ_NULL; // op not supported
+}
+
+mp_obj_t py_similarity_mean(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->avg; }
+mp_obj_t py_similarity_stdev(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->std; }
+mp_obj_t py_similarity_min(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->min; }
+mp_obj_t py_similarity_max(mp_obj_t self_in) { return ((py_similarity_obj_t *) self_in)->max; }
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_mean_obj, py_similarity_mean);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_stdev_obj, py_similarity_stdev);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_min_obj, py_similarity_min);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_similarity_max_obj, py_similarity_max);
+
+STATIC const mp_rom_map_elem_t py_similarity_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_mean), MP_ROM_PTR(&py_similarity_mean_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stdev), MP_ROM_PTR(&py_similarity_stdev_obj) },
+    { MP_ROM_QSTR(MP_QSTR_min), MP_ROM_PTR(&py_similarity_min_obj) },
+    { MP_ROM_QSTR(MP_QSTR_max), MP_ROM_PTR(&py_similarity_max_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_similarity_locals_dict, py_similarity_locals_dict_table);
+
+static const mp_obj_type_t py_similarity_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_similarity,
+    .print = py_similarity_print,
+    .subscr = py_similarity_subscr,
+    .locals_dict = (mp_obj_t) &py_similarity_locals_dict
+};
+
+static mp_obj_t py_image_get_similarity(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+    int arg_block_size =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_block_size), 8);
+    PY_ASSERT_TRUE_MSG((2 <= arg_block_size) && (arg_block_size <= 64), "Error: 2 <= block_size <= 64!");
+    int arg_step =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_step), arg_block_size);
+    PY_ASSERT_TRUE_MSG((1 <= arg_step) && (arg_step <= arg_block_size), "Error: 1 <= step <= block_size!");
+    float arg_threshold =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), -1.0f);
+    float avg, std, min, max;
+
+    fb_alloc_mark();
+
+    if (MP_OBJ_IS_STR(args[1])) {
+        imlib_get_similarity(arg_img, mp_obj_str_get_str(args[1]), NULL, 0,
+                             arg_block_size, arg_step, arg_threshold, &avg, &std, &min, &max);
+    } else if (py_image_is_other(args[1])) {
+        imlib_get_similarity(arg_img, NULL, py_image_arg_to_other(args[1]), 0,
+                             arg_block_size, arg_step, arg_threshold, &avg, &std, &min, &max);
+    } else {
+        imlib_get_similarity(arg_img, NULL, NULL,
+                             py_helper_keyword_color(arg_img, n_args, args, 1, NULL, 0),
+                             arg_block_size, arg_step, arg_threshold, &avg, &std, &min, &max);
+    }
+
+    fb_alloc_free_till_mark();
+
+    py_similarity_obj_t *o = m_new_obj(py_similarity_obj_t);
+    o->base.type = &py_similarity_type;
+    o->avg = mp_obj_new_float(avg);
+    o->std = mp_obj_new_float(std);
+    o->min = mp_obj_new_float(min);
+    o->max = mp_obj_new_float(max);
+    return o;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_similarity_obj, 2, py_image_get_similarity);
+#endif // IMLIB_ENABLE_GET_SIMILARITY
+
+// Statistics Object //
+#define py_statistics_obj_size 24
+typedef struct py_statistics_obj {
+    mp_obj_base_t base;
+    image_bpp_t bpp;
+    mp_obj_t LMean, LMedian, LMode, LSTDev, LMin, LMax, LLQ, LUQ,
+        AMean, AMedian, AMode, ASTDev, AMin, AMax, ALQ, AUQ,
+        BMean, BMedian, BMode, BSTDev, BMin, BMax, BLQ, BUQ;
+} py_statistics_obj_t;
+
+static void py_statistics_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_statistics_obj_t *self = self_in;
+    switch(self->bpp) {
+        case IMAGE_BPP_BINARY: {
+            mp_printf(print, "{\"mean\":%d, \"median\":%d, \"mode\":%d, \"stdev\":%d, \"min\":%d, \"max\":%d, \"lq\":%d, \"uq\":%d}",
+                      mp_obj_get_int(self->LMean),
                       mp_obj_get_int(self->LMedian),
                       mp_obj_get_int(self->LMode),
                       mp_obj_get_int(self->LSTDev),
@@ -4055,6 +5226,40 @@ static const mp_obj_type_t py_histogram_type = {
     .locals_dict = (mp_obj_t) &py_histogram_locals_dict
 };
 
+static mp_obj_t py_statistics_new(image_bpp_t bpp, statistics_t *stats)
+{
+    py_statistics_obj_t *o = m_new_obj(py_statistics_obj_t);
+    o->base.type = &py_statistics_type;
+    o->bpp = bpp;
+
+    o->LMean = mp_obj_new_int(stats->LMean);
+    o->LMedian = mp_obj_new_int(stats->LMedian);
+    o->LMode= mp_obj_new_int(stats->LMode);
+    o->LSTDev = mp_obj_new_int(stats->LSTDev);
+    o->LMin = mp_obj_new_int(stats->LMin);
+    o->LMax = mp_obj_new_int(stats->LMax);
+    o->LLQ = mp_obj_new_int(stats->LLQ);
+    o->LUQ = mp_obj_new_int(stats->LUQ);
+    o->AMean = mp_obj_new_int(stats->AMean);
+    o->AMedian = mp_obj_new_int(stats->AMedian);
+    o->AMode= mp_obj_new_int(stats->AMode);
+    o->ASTDev = mp_obj_new_int(stats->ASTDev);
+    o->AMin = mp_obj_new_int(stats->AMin);
+    o->AMax = mp_obj_new_int(stats->AMax);
+    o->ALQ = mp_obj_new_int(stats->ALQ);
+    o->AUQ = mp_obj_new_int(stats->AUQ);
+    o->BMean = mp_obj_new_int(stats->BMean);
+    o->BMedian = mp_obj_new_int(stats->BMedian);
+    o->BMode= mp_obj_new_int(stats->BMode);
+    o->BSTDev = mp_obj_new_int(stats->BSTDev);
+    o->BMin = mp_obj_new_int(stats->BMin);
+    o->BMax = mp_obj_new_int(stats->BMax);
+    o->BLQ = mp_obj_new_int(stats->BLQ);
+    o->BUQ = mp_obj_new_int(stats->BUQ);
+
+    return o;
+}
+
 static mp_obj_t py_image_get_histogram(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
@@ -4237,38 +5442,213 @@ static mp_obj_t py_image_get_statistics(uint n_args, const mp_obj_t *args, mp_ma
     imlib_get_statistics(&stats, arg_img->bpp, &hist);
     fb_alloc_free_till_mark();
 
-    py_statistics_obj_t *o = m_new_obj(py_statistics_obj_t);
-    o->base.type = &py_statistics_type;
-    o->bpp = arg_img->bpp;
+    return py_statistics_new(arg_img->bpp, &stats);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_statistics_obj, 1, py_image_get_statistics);
 
-    o->LMean = mp_obj_new_int(stats.LMean);
-    o->LMedian = mp_obj_new_int(stats.LMedian);
-    o->LMode= mp_obj_new_int(stats.LMode);
-    o->LSTDev = mp_obj_new_int(stats.LSTDev);
-    o->LMin = mp_obj_new_int(stats.LMin);
-    o->LMax = mp_obj_new_int(stats.LMax);
-    o->LLQ = mp_obj_new_int(stats.LLQ);
-    o->LUQ = mp_obj_new_int(stats.LUQ);
-    o->AMean = mp_obj_new_int(stats.AMean);
-    o->AMedian = mp_obj_new_int(stats.AMedian);
-    o->AMode= mp_obj_new_int(stats.AMode);
-    o->ASTDev = mp_obj_new_int(stats.ASTDev);
-    o->AMin = mp_obj_new_int(stats.AMin);
-    o->AMax = mp_obj_new_int(stats.AMax);
-    o->ALQ = mp_obj_new_int(stats.ALQ);
-    o->AUQ = mp_obj_new_int(stats.AUQ);
-    o->BMean = mp_obj_new_int(stats.BMean);
-    o->BMedian = mp_obj_new_int(stats.BMedian);
-    o->BMode= mp_obj_new_int(stats.BMode);
-    o->BSTDev = mp_obj_new_int(stats.BSTDev);
-    o->BMin = mp_obj_new_int(stats.BMin);
-    o->BMax = mp_obj_new_int(stats.BMax);
-    o->BLQ = mp_obj_new_int(stats.BLQ);
-    o->BUQ = mp_obj_new_int(stats.BUQ);
+// Statistics of many rois (each with its own optional thresholds) computed in one pass over the
+// image. Small bin counts (e.g. bins=16) make this cheap enough for exposure/white balance loops.
+static mp_obj_t py_image_get_statistics_list(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+    PY_ASSERT_TRUE_MSG((arg_img->bpp == IMAGE_BPP_BINARY)
+                    || (arg_img->bpp == IMAGE_BPP_GRAYSCALE)
+                    || (arg_img->bpp == IMAGE_BPP_RGB565), "Image format is not supported.");
 
-    return o;
+    mp_uint_t arg_rois_len;
+    mp_obj_t *arg_rois;
+    mp_obj_get_array(args[1], &arg_rois_len, &arg_rois);
+    PY_ASSERT_TRUE_MSG(arg_rois_len > 0, "rois must not be empty");
+
+    mp_obj_t arg_thresholds = py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_thresholds));
+    mp_uint_t arg_thresholds_len = 0;
+    mp_obj_t *arg_thresholds_list = NULL;
+
+    if (arg_thresholds && (arg_thresholds != mp_const_none)) {
+        mp_obj_get_array(arg_thresholds, &arg_thresholds_len, &arg_thresholds_list);
+        PY_ASSERT_TRUE_MSG(arg_thresholds_len == arg_rois_len, "thresholds must have one entry per roi");
+    }
+
+    bool invert = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+
+    int l_bins = 0, a_bins = 0, b_bins = 0;
+
+    switch(arg_img->bpp) {
+        case IMAGE_BPP_BINARY: {
+            l_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bins),
+                                           (COLOR_BINARY_MAX-COLOR_BINARY_MIN+1));
+            break;
+        }
+        case IMAGE_BPP_GRAYSCALE: {
+            l_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bins),
+                                           (COLOR_GRAYSCALE_MAX-COLOR_GRAYSCALE_MIN+1));
+            break;
+        }
+        default: {
+            l_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bins),
+                                           (COLOR_L_MAX-COLOR_L_MIN+1));
+            a_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bins),
+                                           (COLOR_A_MAX-COLOR_A_MIN+1));
+            b_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bins),
+                                           (COLOR_B_MAX-COLOR_B_MIN+1));
+            PY_ASSERT_TRUE_MSG((a_bins >= 2) && (b_bins >= 2), "bins must be >= 2");
+            a_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a_bins), a_bins);
+            PY_ASSERT_TRUE_MSG(a_bins >= 2, "a_bins must be >= 2");
+            b_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_b_bins), b_bins);
+            PY_ASSERT_TRUE_MSG(b_bins >= 2, "b_bins must be >= 2");
+            break;
+        }
+    }
+
+    PY_ASSERT_TRUE_MSG(l_bins >= 2, "bins must be >= 2");
+    l_bins = py_helper_keyword_int(n_args, args, n_args, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_l_bins), l_bins);
+    PY_ASSERT_TRUE_MSG(l_bins >= 2, "l_bins must be >= 2");
+
+    statistics_t *stats = m_new(statistics_t, arg_rois_len);
+    mp_obj_t list = mp_obj_new_list(arg_rois_len, NULL);
+
+    fb_alloc_mark();
+    rectangle_t *rois = fb_alloc(arg_rois_len * sizeof(rectangle_t), FB_ALLOC_NO_HINT);
+    histogram_t *hists = fb_alloc(arg_rois_len * sizeof(histogram_t), FB_ALLOC_NO_HINT);
+    list_t *thresholds = fb_alloc(arg_rois_len * sizeof(list_t), FB_ALLOC_NO_HINT);
+    list_t **thresholds_ptrs = fb_alloc(arg_rois_len * sizeof(list_t *), FB_ALLOC_NO_HINT);
+
+    for (mp_uint_t i = 0; i < arg_rois_len; i++) {
+        py_helper_arg_to_rectangle_roi(arg_img, arg_rois[i], rois + i);
+        list_init(thresholds + i, sizeof(color_thresholds_list_lnk_data_t));
+        thresholds_ptrs[i] = thresholds + i;
+
+        if (arg_thresholds_len && (arg_thresholds_list[i] != mp_const_none)) {
+            py_helper_arg_to_thresholds(arg_thresholds_list[i], thresholds + i);
+        }
+
+        hists[i].LBinCount = l_bins;
+        hists[i].ABinCount = a_bins;
+        hists[i].BBinCount = b_bins;
+        hists[i].LBins = fb_alloc(l_bins * sizeof(float), FB_ALLOC_NO_HINT);
+        hists[i].ABins = a_bins ? fb_alloc(a_bins * sizeof(float), FB_ALLOC_NO_HINT) : NULL;
+        hists[i].BBins = b_bins ? fb_alloc(b_bins * sizeof(float), FB_ALLOC_NO_HINT) : NULL;
+    }
+
+    imlib_get_histograms(hists, arg_img, rois, thresholds_ptrs, arg_rois_len, invert);
+
+    for (mp_uint_t i = 0; i < arg_rois_len; i++) {
+        imlib_get_statistics(stats + i, arg_img->bpp, hists + i);
+        list_free(thresholds + i);
+    }
+
+    fb_alloc_free_till_mark();
+
+    for (mp_uint_t i = 0; i < arg_rois_len; i++) {
+        ((mp_obj_list_t *) list)->items[i] = py_statistics_new(arg_img->bpp, stats + i);
+    }
+
+    return list;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_statistics_obj, 1, py_image_get_statistics);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_statistics_list_obj, 2, py_image_get_statistics_list);
+
+// Integral Object //
+// Summed area tables of the grayscale values of an image area so that the sum, mean and variance
+// of any rectangle inside it are O(1). Pass the object back with map= to rebuild it in place.
+typedef struct py_integral_obj {
+    mp_obj_base_t base;
+    integral_map_t map;
+} py_integral_obj_t;
+
+static void py_integral_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_integral_obj_t *self = self_in;
+    mp_printf(print, "{\"x\":%d, \"y\":%d, \"w\":%d, \"h\":%d, \"squared\":%s}",
+              self->map.roi.x, self->map.roi.y, self->map.roi.w, self->map.roi.h,
+              self->map.sum_sq ? "True" : "False");
+}
+
+// Rectangles are in image coordinates and are clipped to the area the tables cover.
+static void py_integral_arg_to_rectangle(py_integral_obj_t *self, mp_obj_t arg, rectangle_t *r)
+{
+    mp_obj_t *arg_rectangle;
+    mp_obj_get_array_fixed_n(arg, 4, &arg_rectangle);
+    r->x = mp_obj_get_int(arg_rectangle[0]);
+    r->y = mp_obj_get_int(arg_rectangle[1]);
+    r->w = mp_obj_get_int(arg_rectangle[2]);
+    r->h = mp_obj_get_int(arg_rectangle[3]);
+    PY_ASSERT_TRUE_MSG((r->w > 0) && (r->h > 0), "Invalid rectangle!");
+    PY_ASSERT_TRUE_MSG(rectangle_overlap(r, &self->map.roi), "Rectangle is outside the integral image!");
+    rectangle_intersected(r, &self->map.roi);
+}
+
+static mp_obj_t py_integral_box_sum(mp_obj_t self_in, mp_obj_t rect_obj)
+{
+    py_integral_obj_t *self = self_in;
+    rectangle_t r;
+    py_integral_arg_to_rectangle(self, rect_obj, &r);
+    return mp_obj_new_int_from_uint(imlib_integral_map_sum(&self->map, &r));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_integral_box_sum_obj, py_integral_box_sum);
+
+static mp_obj_t py_integral_mean(mp_obj_t self_in, mp_obj_t rect_obj)
+{
+    py_integral_obj_t *self = self_in;
+    rectangle_t r;
+    py_integral_arg_to_rectangle(self, rect_obj, &r);
+    return mp_obj_new_float(imlib_integral_map_mean(&self->map, &r));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_integral_mean_obj, py_integral_mean);
+
+static mp_obj_t py_integral_variance(mp_obj_t self_in, mp_obj_t rect_obj)
+{
+    py_integral_obj_t *self = self_in;
+    PY_ASSERT_TRUE_MSG(self->map.sum_sq, "The integral image was computed without squared=True!");
+    rectangle_t r;
+    py_integral_arg_to_rectangle(self, rect_obj, &r);
+    return mp_obj_new_float(imlib_integral_map_variance(&self->map, &r));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_integral_variance_obj, py_integral_variance);
+
+STATIC const mp_rom_map_elem_t py_integral_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_box_sum),  MP_ROM_PTR(&py_integral_box_sum_obj) },
+    { MP_ROM_QSTR(MP_QSTR_mean),     MP_ROM_PTR(&py_integral_mean_obj) },
+    { MP_ROM_QSTR(MP_QSTR_variance), MP_ROM_PTR(&py_integral_variance_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_integral_locals_dict, py_integral_locals_dict_table);
+
+static const mp_obj_type_t py_integral_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_Integral,
+    .print = py_integral_print,
+    .locals_dict = (mp_obj_t) &py_integral_locals_dict
+};
+
+static mp_obj_t py_image_integral(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+    PY_ASSERT_TRUE_MSG((arg_img->bpp == IMAGE_BPP_BINARY)
+                    || (arg_img->bpp == IMAGE_BPP_GRAYSCALE)
+                    || (arg_img->bpp == IMAGE_BPP_RGB565), "Image format is not supported.");
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    bool arg_squared = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_squared), false);
+    mp_obj_t arg_map = py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_map));
+    py_integral_obj_t *obj;
+
+    if (arg_map && (arg_map != mp_const_none)) {
+        PY_ASSERT_TRUE_MSG(MP_OBJ_IS_TYPE(arg_map, &py_integral_type), "Expected an Integral!");
+        obj = arg_map;
+    } else {
+        obj = m_new_obj(py_integral_obj_t);
+        obj->base.type = &py_integral_type;
+        imlib_integral_map_alloc(&obj->map);
+    }
+
+    fb_alloc_mark();
+    imlib_integral_map_update(&obj->map, arg_img, &roi, arg_squared);
+    fb_alloc_free_till_mark();
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_integral_obj, 1, py_image_integral);
 
 // Line Object //
 #define py_line_obj_size 8
@@ -4411,13 +5791,143 @@ static mp_obj_t py_image_get_regression(uint n_args, const mp_obj_t *args, mp_ma
     o->theta = mp_obj_new_int(out.theta);
     o->rho = mp_obj_new_int(out.rho);
 
-    return o;
-}
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_regression_obj, 2, py_image_get_regression);
+    return o;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_regression_obj, 2, py_image_get_regression);
+
+///////////////
+// Find Methods
+///////////////
+
+// ResultArray Object //
+// Holds find_*() results as packed C structs. Python objects are only created on access, and
+// passing the same array back with results= refills it without allocating in steady state.
+typedef struct py_result_array_obj {
+    mp_obj_base_t base;
+    mp_obj_t (*make)(void *data); // builds the Python object of one entry
+    void (*clear)(void *data); // releases heap memory owned by one entry
+    size_t len, size, data_len;
+    char *data;
+} py_result_array_obj_t;
+
+static const mp_obj_type_t py_result_array_type;
+
+static mp_obj_t py_result_array_get(py_result_array_obj_t *self, size_t index)
+{
+    return self->make(self->data + (index * self->data_len));
+}
+
+static void py_result_array_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_result_array_obj_t *self = self_in;
+    mp_print_str(print, "[");
+    for (size_t i = 0; i < self->len; i++) {
+        if (i) mp_print_str(print, ", ");
+        mp_obj_print_helper(print, py_result_array_get(self, i), kind);
+    }
+    mp_print_str(print, "]");
+}
+
+static mp_obj_t py_result_array_unary_op(mp_unary_op_t op, mp_obj_t self_in)
+{
+    py_result_array_obj_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_BOOL: return mp_obj_new_bool(self->len != 0);
+        case MP_UNARY_OP_LEN: return mp_obj_new_int(self->len);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+static mp_obj_t py_result_array_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value)
+{
+    if (value == MP_OBJ_SENTINEL) { // load
+        py_result_array_obj_t *self = self_in;
+        return py_result_array_get(self, mp_get_index(self->base.type, self->len, index, false));
+    }
+    return MP_OBJ_NULL; // op not supported
+}
+
+typedef struct _mp_obj_py_result_array_it_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_t py_result_array;
+    size_t cur;
+} mp_obj_py_result_array_it_t;
+
+STATIC mp_obj_t py_result_array_it_iternext(mp_obj_t self_in)
+{
+    mp_obj_py_result_array_it_t *self = MP_OBJ_TO_PTR(self_in);
+    py_result_array_obj_t *arr = MP_OBJ_TO_PTR(self->py_result_array);
+    if (self->cur >= arr->len) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    return py_result_array_get(arr, self->cur++);
+}
+
+STATIC mp_obj_t py_result_array_getiter(mp_obj_t o_in, mp_obj_iter_buf_t *iter_buf)
+{
+    assert(sizeof(mp_obj_py_result_array_it_t) <= sizeof(mp_obj_iter_buf_t));
+    mp_obj_py_result_array_it_t *o = (mp_obj_py_result_array_it_t*)iter_buf;
+    o->base.type = &mp_type_polymorph_iter;
+    o->iternext = py_result_array_it_iternext;
+    o->py_result_array = o_in;
+    o->cur = 0;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+static const mp_obj_type_t py_result_array_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ResultArray,
+    .print = py_result_array_print,
+    .unary_op = py_result_array_unary_op,
+    .subscr = py_result_array_subscr,
+    .getiter = py_result_array_getiter,
+};
+
+// Moves the list contents into the results array, or returns a list of objects if there is none.
+static mp_obj_t py_result_array_fill(mp_obj_t results, list_t *out,
+                                     mp_obj_t (*make)(void *), void (*clear)(void *))
+{
+    if (!results) {
+        mp_obj_list_t *objects_list = mp_obj_new_list(list_size(out), NULL);
+        char data[out->data_len];
+
+        for (size_t i = 0; list_size(out); i++) {
+            list_pop_front(out, data);
+            objects_list->items[i] = make(data);
+            if (clear) clear(data);
+        }
+
+        return objects_list;
+    }
+
+    PY_ASSERT_TYPE(results, &py_result_array_type);
+    py_result_array_obj_t *arr = results;
+
+    if (arr->clear) {
+        for (size_t i = 0; i < arr->len; i++) {
+            arr->clear(arr->data + (i * arr->data_len));
+        }
+    }
+
+    size_t size = list_size(out) * out->data_len;
+
+    if (size > arr->size) {
+        arr->data = xrealloc(arr->data, size);
+        arr->size = size;
+    }
+
+    arr->make = make;
+    arr->clear = clear;
+    arr->data_len = out->data_len;
+    arr->len = 0;
 
-///////////////
-// Find Methods
-///////////////
+    while (list_size(out)) {
+        list_pop_front(out, arr->data + (arr->len++ * arr->data_len));
+    }
+
+    return arr;
+}
 
 // Blob Object //
 #define py_blob_obj_size 12
@@ -4428,6 +5938,7 @@ typedef struct py_blob_obj {
     mp_obj_t x, y, w, h, pixels, cx, cy, rotation, code, count, perimeter, roundness;
     mp_obj_t x_hist_bins;
     mp_obj_t y_hist_bins;
+    mp_obj_t id;
 } py_blob_obj_t;
 
 static void py_blob_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
@@ -4580,6 +6091,7 @@ mp_obj_t py_blob_convexity(mp_obj_t self_in) {
 // Min rect-perimeter versus perimeter -> Above
 mp_obj_t py_blob_x_hist_bins(mp_obj_t self_in) { return ((py_blob_obj_t *) self_in)->x_hist_bins; }
 mp_obj_t py_blob_y_hist_bins(mp_obj_t self_in) { return ((py_blob_obj_t *) self_in)->y_hist_bins; }
+mp_obj_t py_blob_id(mp_obj_t self_in) { return ((py_blob_obj_t *) self_in)->id; }
 mp_obj_t py_blob_major_axis_line(mp_obj_t self_in) {
     mp_obj_t *corners, *p0, *p1, *p2, *p3;
     mp_obj_get_array_fixed_n(((py_blob_obj_t *) self_in)->min_corners, 4, &corners);
@@ -4777,6 +6289,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_solidity_obj, py_blob_solidity);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_convexity_obj, py_blob_convexity);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_x_hist_bins_obj, py_blob_x_hist_bins);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_y_hist_bins_obj, py_blob_y_hist_bins);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_id_obj, py_blob_id);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_major_axis_line_obj, py_blob_major_axis_line);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_minor_axis_line_obj, py_blob_minor_axis_line);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_enclosing_circle_obj, py_blob_enclosing_circle);
@@ -4811,6 +6324,7 @@ STATIC const mp_rom_map_elem_t py_blob_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_convexity), MP_ROM_PTR(&py_blob_convexity_obj) },
     { MP_ROM_QSTR(MP_QSTR_x_hist_bins), MP_ROM_PTR(&py_blob_x_hist_bins_obj) },
     { MP_ROM_QSTR(MP_QSTR_y_hist_bins), MP_ROM_PTR(&py_blob_y_hist_bins_obj) },
+    { MP_ROM_QSTR(MP_QSTR_id), MP_ROM_PTR(&py_blob_id_obj) },
     { MP_ROM_QSTR(MP_QSTR_major_axis_line), MP_ROM_PTR(&py_blob_major_axis_line_obj) },
     { MP_ROM_QSTR(MP_QSTR_minor_axis_line), MP_ROM_PTR(&py_blob_minor_axis_line_obj) },
     { MP_ROM_QSTR(MP_QSTR_enclosing_circle), MP_ROM_PTR(&py_blob_enclosing_circle_obj) },
@@ -4861,6 +6375,7 @@ static bool py_image_find_blobs_threshold_cb(void *fun_obj, find_blobs_list_lnk_
     o->roundness = mp_obj_new_float(blob->roundness);
     o->x_hist_bins = mp_obj_new_list(blob->x_hist_bins_count, NULL);
     o->y_hist_bins = mp_obj_new_list(blob->y_hist_bins_count, NULL);
+    o->id = blob->id ? mp_obj_new_int(blob->id) : mp_const_none;
 
     for (int i = 0; i < blob->x_hist_bins_count; i++) {
         ((mp_obj_list_t *) o->x_hist_bins)->items[i] = mp_obj_new_int(blob->x_hist_bins[i]);
@@ -4907,6 +6422,7 @@ static bool py_image_find_blobs_merge_cb(void *fun_obj, find_blobs_list_lnk_data
     o0->roundness = mp_obj_new_float(blob0->roundness);
     o0->x_hist_bins = mp_obj_new_list(blob0->x_hist_bins_count, NULL);
     o0->y_hist_bins = mp_obj_new_list(blob0->y_hist_bins_count, NULL);
+    o0->id = blob0->id ? mp_obj_new_int(blob0->id) : mp_const_none;
 
     for (int i = 0; i < blob0->x_hist_bins_count; i++) {
         ((mp_obj_list_t *) o0->x_hist_bins)->items[i] = mp_obj_new_int(blob0->x_hist_bins[i]);
@@ -4948,6 +6464,7 @@ static bool py_image_find_blobs_merge_cb(void *fun_obj, find_blobs_list_lnk_data
     o1->roundness = mp_obj_new_float(blob1->roundness);
     o1->x_hist_bins = mp_obj_new_list(blob1->x_hist_bins_count, NULL);
     o1->y_hist_bins = mp_obj_new_list(blob1->y_hist_bins_count, NULL);
+    o1->id = blob1->id ? mp_obj_new_int(blob1->id) : mp_const_none;
 
     for (int i = 0; i < blob1->x_hist_bins_count; i++) {
         ((mp_obj_list_t *) o1->x_hist_bins)->items[i] = mp_obj_new_int(blob1->x_hist_bins[i]);
@@ -4960,6 +6477,132 @@ static bool py_image_find_blobs_merge_cb(void *fun_obj, find_blobs_list_lnk_data
     return mp_obj_is_true(mp_call_function_2(fun_obj, o0, o1));
 }
 
+static mp_obj_t py_blob_make(void *data)
+{
+    find_blobs_list_lnk_data_t *lnk_data = data;
+
+    py_blob_obj_t *o = m_new_obj(py_blob_obj_t);
+    o->base.type = &py_blob_type;
+    o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
+        {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*0)/4].x),
+                                            mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*0)/4].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*1)/4].x),
+                                            mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*1)/4].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*2)/4].x),
+                                            mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*2)/4].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*3)/4].x),
+                                            mp_obj_new_int(lnk_data->corners[(FIND_BLOBS_CORNERS_RESOLUTION*3)/4].y)})});
+    point_t min_corners[4];
+    point_min_area_rectangle(lnk_data->corners, min_corners, FIND_BLOBS_CORNERS_RESOLUTION);
+    o->min_corners = mp_obj_new_tuple(4, (mp_obj_t [])
+        {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[0].x), mp_obj_new_int(min_corners[0].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[1].x), mp_obj_new_int(min_corners[1].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[2].x), mp_obj_new_int(min_corners[2].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[3].x), mp_obj_new_int(min_corners[3].y)})});
+    o->x = mp_obj_new_int(lnk_data->rect.x);
+    o->y = mp_obj_new_int(lnk_data->rect.y);
+    o->w = mp_obj_new_int(lnk_data->rect.w);
+    o->h = mp_obj_new_int(lnk_data->rect.h);
+    o->pixels = mp_obj_new_int(lnk_data->pixels);
+    o->cx = mp_obj_new_float(lnk_data->centroid_x);
+    o->cy = mp_obj_new_float(lnk_data->centroid_y);
+    o->rotation = mp_obj_new_float(lnk_data->rotation);
+    o->code = mp_obj_new_int(lnk_data->code);
+    o->count = mp_obj_new_int(lnk_data->count);
+    o->perimeter = mp_obj_new_int(lnk_data->perimeter);
+    o->roundness = mp_obj_new_float(lnk_data->roundness);
+    o->x_hist_bins = mp_obj_new_list(lnk_data->x_hist_bins_count, NULL);
+    o->y_hist_bins = mp_obj_new_list(lnk_data->y_hist_bins_count, NULL);
+    o->id = lnk_data->id ? mp_obj_new_int(lnk_data->id) : mp_const_none;
+
+    for (int i = 0; i < lnk_data->x_hist_bins_count; i++) {
+        ((mp_obj_list_t *) o->x_hist_bins)->items[i] = mp_obj_new_int(lnk_data->x_hist_bins[i]);
+    }
+
+    for (int i = 0; i < lnk_data->y_hist_bins_count; i++) {
+        ((mp_obj_list_t *) o->y_hist_bins)->items[i] = mp_obj_new_int(lnk_data->y_hist_bins[i]);
+    }
+
+    return o;
+}
+
+static void py_blob_clear(void *data)
+{
+    find_blobs_list_lnk_data_t *lnk_data = data;
+    if (lnk_data->x_hist_bins) xfree(lnk_data->x_hist_bins);
+    if (lnk_data->y_hist_bins) xfree(lnk_data->y_hist_bins);
+}
+
+// BlobTracker Object //
+// Passed to find_blobs() with tracker= to search only around the blobs found in the previous
+// frame (with a full search every rescan frames) and to give the blobs ids that stay the same
+// while they are tracked.
+typedef struct py_blob_tracker_obj {
+    mp_obj_base_t base;
+    blob_tracker_t tracker;
+} py_blob_tracker_obj_t;
+
+static void py_blob_tracker_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_blob_tracker_obj_t *self = self_in;
+    mp_printf(print, "{\"margin\":%d, \"rescan\":%d, \"max_blobs\":%d, \"tracked\":%d}",
+              self->tracker.margin, self->tracker.rescan, self->tracker.tracks_max, self->tracker.tracks_len);
+}
+
+mp_obj_t py_blob_tracker_reset(mp_obj_t self_in)
+{
+    imlib_blob_tracker_reset(&((py_blob_tracker_obj_t *) self_in)->tracker);
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_blob_tracker_reset_obj, py_blob_tracker_reset);
+
+STATIC const mp_rom_map_elem_t py_blob_tracker_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_blob_tracker_reset_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_blob_tracker_locals_dict, py_blob_tracker_locals_dict_table);
+
+static const mp_obj_type_t py_blob_tracker_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_BlobTracker,
+    .print = py_blob_tracker_print,
+    .locals_dict = (mp_obj_t) &py_blob_tracker_locals_dict
+};
+
+mp_obj_t py_image_blob_tracker(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_margin =
+        py_helper_keyword_int(n_args, args, 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_margin), 20);
+    PY_ASSERT_TRUE_MSG(arg_margin >= 0, "Margin must be >= 0");
+    int arg_rescan =
+        py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rescan), 10);
+    PY_ASSERT_TRUE_MSG(arg_rescan > 0, "Rescan must be > 0");
+    int arg_max_blobs =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_blobs), 256);
+    PY_ASSERT_TRUE_MSG((0 < arg_max_blobs) && (arg_max_blobs <= 65535), "Error: 0 < max_blobs <= 65535!");
+
+    py_blob_tracker_obj_t *obj = m_new_obj(py_blob_tracker_obj_t);
+    obj->base.type = &py_blob_tracker_type;
+    imlib_blob_tracker_alloc(&obj->tracker, arg_max_blobs, arg_margin, arg_rescan);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_blob_tracker_obj, 0, py_image_blob_tracker);
+
+static void py_image_find_blobs_filter_range(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args, mp_obj_t kw,
+                                             find_blobs_filter_t *filter, find_blobs_filter_property_t property)
+{
+    mp_obj_t range = py_helper_keyword_object(n_args, args, arg_index, kw_args, kw);
+
+    if (range && (range != mp_const_none)) {
+        mp_obj_t *arg_range;
+        mp_obj_get_array_fixed_n(range, 2, &arg_range);
+        float min = (arg_range[0] == mp_const_none) ? -INFINITY : mp_obj_get_float(arg_range[0]);
+        float max = (arg_range[1] == mp_const_none) ? INFINITY : mp_obj_get_float(arg_range[1]);
+        imlib_find_blobs_filter_range(filter, property, min, max);
+    }
+}
+
 static mp_obj_t py_image_find_blobs(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
@@ -4967,7 +6610,15 @@ static mp_obj_t py_image_find_blobs(uint n_args, const mp_obj_t *args, mp_map_t
     list_t thresholds;
     list_init(&thresholds, sizeof(color_thresholds_list_lnk_data_t));
     py_helper_arg_to_thresholds(args[1], &thresholds);
-    if (!list_size(&thresholds)) return mp_obj_new_list(0, NULL);
+    mp_obj_t results =
+        py_helper_keyword_object(n_args, args, 14, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_results));
+    list_t out;
+
+    if (!list_size(&thresholds)) {
+        list_init(&out, sizeof(find_blobs_list_lnk_data_t));
+        return py_result_array_fill(results, &out, py_blob_make, py_blob_clear);
+    }
+
     bool invert = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
 
     rectangle_t roi;
@@ -4995,69 +6646,115 @@ static mp_obj_t py_image_find_blobs(uint n_args, const mp_obj_t *args, mp_map_t
         py_helper_keyword_int(n_args, args, 12, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_hist_bins_max), 0);
     unsigned int y_hist_bins_max =
         py_helper_keyword_int(n_args, args, 13, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_hist_bins_max), 0);
+    bool rle =
+        py_helper_keyword_int(n_args, args, 15, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rle), false);
+    mp_obj_t tracker =
+        py_helper_keyword_object(n_args, args, 16, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_tracker));
+    PY_ASSERT_TRUE_MSG((!tracker) || (tracker == mp_const_none) || MP_OBJ_IS_TYPE(tracker, &py_blob_tracker_type),
+                       "Expected a BlobTracker!");
+
+    // The native filter runs before threshold_cb so no Python objects are made for rejected blobs.
+    find_blobs_filter_t filter;
+    imlib_find_blobs_filter_init(&filter, py_image_find_blobs_threshold_cb, threshold_cb);
+    py_image_find_blobs_filter_range(n_args, args, 17, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_area_range),
+                                     &filter, FIND_BLOBS_FILTER_AREA);
+    py_image_find_blobs_filter_range(n_args, args, 18, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_pixels_range),
+                                     &filter, FIND_BLOBS_FILTER_PIXELS);
+    py_image_find_blobs_filter_range(n_args, args, 19, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_density_range),
+                                     &filter, FIND_BLOBS_FILTER_DENSITY);
+    py_image_find_blobs_filter_range(n_args, args, 20, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_elongation_range),
+                                     &filter, FIND_BLOBS_FILTER_ELONGATION);
+    py_image_find_blobs_filter_range(n_args, args, 21, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_roundness_range),
+                                     &filter, FIND_BLOBS_FILTER_ROUNDNESS);
+    py_image_find_blobs_filter_range(n_args, args, 22, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rotation_range),
+                                     &filter, FIND_BLOBS_FILTER_ROTATION);
+    py_image_find_blobs_filter_range(n_args, args, 23, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_aspect_ratio_range),
+                                     &filter, FIND_BLOBS_FILTER_ASPECT_RATIO);
+    py_helper_keyword_float_array(n_args, args, 24, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_score_weights),
+                                  filter.weights, FIND_BLOBS_FILTER_SCORE);
+    py_image_find_blobs_filter_range(n_args, args, 25, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_score_range),
+                                     &filter, FIND_BLOBS_FILTER_SCORE);
 
-    list_t out;
     fb_alloc_mark();
-    imlib_find_blobs(&out, arg_img, &roi, x_stride, y_stride, &thresholds, invert,
-            area_threshold, pixels_threshold, merge, margin,
-            py_image_find_blobs_threshold_cb, threshold_cb, py_image_find_blobs_merge_cb, merge_cb, x_hist_bins_max, y_hist_bins_max);
+    if (tracker && (tracker != mp_const_none)) {
+        imlib_blob_tracker_update(&((py_blob_tracker_obj_t *) tracker)->tracker, &out, arg_img, &roi, x_stride, y_stride, &thresholds, invert,
+                area_threshold, pixels_threshold, merge, margin,
+                imlib_find_blobs_filter, &filter, py_image_find_blobs_merge_cb, merge_cb, x_hist_bins_max, y_hist_bins_max, rle);
+    } else {
+        imlib_find_blobs(&out, arg_img, &roi, x_stride, y_stride, &thresholds, invert,
+                area_threshold, pixels_threshold, merge, margin,
+                imlib_find_blobs_filter, &filter, py_image_find_blobs_merge_cb, merge_cb, x_hist_bins_max, y_hist_bins_max, rle);
+    }
     fb_alloc_free_till_mark();
     list_free(&thresholds);
 
-    mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
-    for (size_t i = 0; list_size(&out); i++) {
-        find_blobs_list_lnk_data_t lnk_data;
-        list_pop_front(&out, &lnk_data);
+    mp_obj_t objects_list = py_result_array_fill(results, &out, py_blob_make, py_blob_clear);
 
-        py_blob_obj_t *o = m_new_obj(py_blob_obj_t);
-        o->base.type = &py_blob_type;
-        o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
-            {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*0)/4].x),
-                                                mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*0)/4].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*1)/4].x),
-                                                mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*1)/4].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*2)/4].x),
-                                                mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*2)/4].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*3)/4].x),
-                                                mp_obj_new_int(lnk_data.corners[(FIND_BLOBS_CORNERS_RESOLUTION*3)/4].y)})});
-        point_t min_corners[4];
-        point_min_area_rectangle(lnk_data.corners, min_corners, FIND_BLOBS_CORNERS_RESOLUTION);
-        o->min_corners = mp_obj_new_tuple(4, (mp_obj_t [])
-            {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[0].x), mp_obj_new_int(min_corners[0].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[1].x), mp_obj_new_int(min_corners[1].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[2].x), mp_obj_new_int(min_corners[2].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(min_corners[3].x), mp_obj_new_int(min_corners[3].y)})});
-        o->x = mp_obj_new_int(lnk_data.rect.x);
-        o->y = mp_obj_new_int(lnk_data.rect.y);
-        o->w = mp_obj_new_int(lnk_data.rect.w);
-        o->h = mp_obj_new_int(lnk_data.rect.h);
-        o->pixels = mp_obj_new_int(lnk_data.pixels);
-        o->cx = mp_obj_new_float(lnk_data.centroid_x);
-        o->cy = mp_obj_new_float(lnk_data.centroid_y);
-        o->rotation = mp_obj_new_float(lnk_data.rotation);
-        o->code = mp_obj_new_int(lnk_data.code);
-        o->count = mp_obj_new_int(lnk_data.count);
-        o->perimeter = mp_obj_new_int(lnk_data.perimeter);
-        o->roundness = mp_obj_new_float(lnk_data.roundness);
-        o->x_hist_bins = mp_obj_new_list(lnk_data.x_hist_bins_count, NULL);
-        o->y_hist_bins = mp_obj_new_list(lnk_data.y_hist_bins_count, NULL);
+    xfree(out.pool);
 
-        for (int i = 0; i < lnk_data.x_hist_bins_count; i++) {
-            ((mp_obj_list_t *) o->x_hist_bins)->items[i] = mp_obj_new_int(lnk_data.x_hist_bins[i]);
-        }
+    return objects_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_blobs_obj, 2, py_image_find_blobs);
 
-        for (int i = 0; i < lnk_data.y_hist_bins_count; i++) {
-            ((mp_obj_list_t *) o->y_hist_bins)->items[i] = mp_obj_new_int(lnk_data.y_hist_bins[i]);
-        }
+#if defined(IMLIB_ENABLE_FIND_LINES) || defined(IMLIB_ENABLE_FIND_CIRCLES)
+// GradientMap Object //
+// Passed to find_lines() and find_circles() with gradient= so that the Sobel gradients of a frame
+// are computed once and shared by all the calls on the same roi (until the image changes).
+typedef struct py_gradient_map_obj {
+    mp_obj_base_t base;
+    gradient_map_t map;
+} py_gradient_map_obj_t;
 
-        objects_list->items[i] = o;
-        if (lnk_data.x_hist_bins) xfree(lnk_data.x_hist_bins);
-        if (lnk_data.y_hist_bins) xfree(lnk_data.y_hist_bins);
+static void py_gradient_map_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_gradient_map_obj_t *self = self_in;
+    mp_printf(print, "{\"x\":%d, \"y\":%d, \"w\":%d, \"h\":%d, \"valid\":%s}",
+              self->map.roi.x, self->map.roi.y, self->map.roi.w, self->map.roi.h,
+              self->map.valid ? "True" : "False");
+}
+
+mp_obj_t py_gradient_map_reset(mp_obj_t self_in)
+{
+    imlib_gradient_map_reset(&((py_gradient_map_obj_t *) self_in)->map);
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_gradient_map_reset_obj, py_gradient_map_reset);
+
+STATIC const mp_rom_map_elem_t py_gradient_map_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_gradient_map_reset_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_gradient_map_locals_dict, py_gradient_map_locals_dict_table);
+
+static const mp_obj_type_t py_gradient_map_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_GradientMap,
+    .print = py_gradient_map_print,
+    .locals_dict = (mp_obj_t) &py_gradient_map_locals_dict
+};
+
+mp_obj_t py_image_gradient_map()
+{
+    py_gradient_map_obj_t *obj = m_new_obj(py_gradient_map_obj_t);
+    obj->base.type = &py_gradient_map_type;
+    imlib_gradient_map_alloc(&obj->map);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_image_gradient_map_obj, py_image_gradient_map);
+
+static gradient_map_t *py_helper_keyword_gradient_map(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args)
+{
+    mp_obj_t map = py_helper_keyword_object(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_gradient));
+
+    if ((!map) || (map == mp_const_none)) {
+        return NULL;
     }
 
-    return objects_list;
+    PY_ASSERT_TRUE_MSG(MP_OBJ_IS_TYPE(map, &py_gradient_map_type), "Expected a GradientMap!");
+    return &((py_gradient_map_obj_t *) map)->map;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_blobs_obj, 2, py_image_find_blobs);
+#endif // IMLIB_ENABLE_FIND_LINES || IMLIB_ENABLE_FIND_CIRCLES
 
 #ifdef IMLIB_ENABLE_FIND_LINES
 static mp_obj_t py_image_find_lines(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
@@ -5074,10 +6771,11 @@ static mp_obj_t py_image_find_lines(uint n_args, const mp_obj_t *args, mp_map_t
     uint32_t threshold = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 1000);
     unsigned int theta_margin = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_theta_margin), 25);
     unsigned int rho_margin = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rho_margin), 25);
+    gradient_map_t *map = py_helper_keyword_gradient_map(n_args, args, 7, kw_args);
 
     list_t out;
     fb_alloc_mark();
-    imlib_find_lines(&out, arg_img, &roi, x_stride, y_stride, threshold, theta_margin, rho_margin);
+    imlib_find_lines(&out, arg_img, &roi, x_stride, y_stride, threshold, theta_margin, rho_margin, map);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -5101,6 +6799,8 @@ static mp_obj_t py_image_find_lines(uint n_args, const mp_obj_t *args, mp_map_t
         objects_list->items[i] = o;
     }
 
+    xfree(out.pool);
+
     return objects_list;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_lines_obj, 1, py_image_find_lines);
@@ -5246,11 +6946,13 @@ static mp_obj_t py_image_find_circles(uint n_args, const mp_obj_t *args, mp_map_
     unsigned int r_max = IM_MIN(py_helper_keyword_int(n_args, args, 9, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_r_max),
             IM_MIN((roi.w / 2), (roi.h / 2))), IM_MIN((roi.w / 2), (roi.h / 2)));
     unsigned int r_step = py_helper_keyword_int(n_args, args, 10, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_r_step), 2);
+    bool two_stage = py_helper_keyword_int(n_args, args, 11, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_two_stage), false);
+    gradient_map_t *map = py_helper_keyword_gradient_map(n_args, args, 12, kw_args);
 
     list_t out;
     fb_alloc_mark();
     imlib_find_circles(&out, arg_img, &roi, x_stride, y_stride, threshold, x_margin, y_margin, r_margin,
-                       r_min, r_max, r_step);
+                       r_min, r_max, r_step, two_stage, map);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -5268,6 +6970,8 @@ static mp_obj_t py_image_find_circles(uint n_args, const mp_obj_t *args, mp_map_
         objects_list->items[i] = o;
     }
 
+    xfree(out.pool);
+
     return objects_list;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_circles_obj, 1, py_image_find_circles);
@@ -5527,46 +7231,52 @@ static const mp_obj_type_t py_qrcode_type = {
     .locals_dict = (mp_obj_t) &py_qrcode_locals_dict
 };
 
+static mp_obj_t py_qrcode_make(void *data)
+{
+    find_qrcodes_list_lnk_data_t *lnk_data = data;
+
+    py_qrcode_obj_t *o = m_new_obj(py_qrcode_obj_t);
+    o->base.type = &py_qrcode_type;
+    o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
+        {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[0].x), mp_obj_new_int(lnk_data->corners[0].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[1].x), mp_obj_new_int(lnk_data->corners[1].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[2].x), mp_obj_new_int(lnk_data->corners[2].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[3].x), mp_obj_new_int(lnk_data->corners[3].y)})});
+    o->x = mp_obj_new_int(lnk_data->rect.x);
+    o->y = mp_obj_new_int(lnk_data->rect.y);
+    o->w = mp_obj_new_int(lnk_data->rect.w);
+    o->h = mp_obj_new_int(lnk_data->rect.h);
+    o->payload = mp_obj_new_str(lnk_data->payload, lnk_data->payload_len);
+    o->version = mp_obj_new_int(lnk_data->version);
+    o->ecc_level = mp_obj_new_int(lnk_data->ecc_level);
+    o->mask = mp_obj_new_int(lnk_data->mask);
+    o->data_type = mp_obj_new_int(lnk_data->data_type);
+    o->eci = mp_obj_new_int(lnk_data->eci);
+
+    return o;
+}
+
+static void py_qrcode_clear(void *data)
+{
+    find_qrcodes_list_lnk_data_t *lnk_data = data;
+    xfree(lnk_data->payload);
+}
+
 static mp_obj_t py_image_find_qrcodes(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
 
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+    mp_obj_t results = py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_results));
+    py_helper_keyword_time_budget(n_args, args, 3, kw_args, 0);
 
     list_t out;
     fb_alloc_mark();
     imlib_find_qrcodes(&out, arg_img, &roi);
     fb_alloc_free_till_mark();
 
-    mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
-    for (size_t i = 0; list_size(&out); i++) {
-        find_qrcodes_list_lnk_data_t lnk_data;
-        list_pop_front(&out, &lnk_data);
-
-        py_qrcode_obj_t *o = m_new_obj(py_qrcode_obj_t);
-        o->base.type = &py_qrcode_type;
-        o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
-            {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[0].x), mp_obj_new_int(lnk_data.corners[0].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[1].x), mp_obj_new_int(lnk_data.corners[1].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[2].x), mp_obj_new_int(lnk_data.corners[2].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[3].x), mp_obj_new_int(lnk_data.corners[3].y)})});
-        o->x = mp_obj_new_int(lnk_data.rect.x);
-        o->y = mp_obj_new_int(lnk_data.rect.y);
-        o->w = mp_obj_new_int(lnk_data.rect.w);
-        o->h = mp_obj_new_int(lnk_data.rect.h);
-        o->payload = mp_obj_new_str(lnk_data.payload, lnk_data.payload_len);
-        o->version = mp_obj_new_int(lnk_data.version);
-        o->ecc_level = mp_obj_new_int(lnk_data.ecc_level);
-        o->mask = mp_obj_new_int(lnk_data.mask);
-        o->data_type = mp_obj_new_int(lnk_data.data_type);
-        o->eci = mp_obj_new_int(lnk_data.eci);
-
-        objects_list->items[i] = o;
-        xfree(lnk_data.payload);
-    }
-
-    return objects_list;
+    return py_result_array_fill(results, &out, py_qrcode_make, py_qrcode_clear);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_qrcodes_obj, 1, py_image_find_qrcodes);
 #endif // IMLIB_ENABLE_QRCODES
@@ -5729,17 +7439,119 @@ static const mp_obj_type_t py_apriltag_type = {
     .locals_dict = (mp_obj_t) &py_apriltag_locals_dict
 };
 
+static mp_obj_t py_apriltag_make(void *data)
+{
+    find_apriltags_list_lnk_data_t *lnk_data = data;
+
+    py_apriltag_obj_t *o = m_new_obj(py_apriltag_obj_t);
+    o->base.type = &py_apriltag_type;
+    o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
+        {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[0].x), mp_obj_new_int(lnk_data->corners[0].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[1].x), mp_obj_new_int(lnk_data->corners[1].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[2].x), mp_obj_new_int(lnk_data->corners[2].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[3].x), mp_obj_new_int(lnk_data->corners[3].y)})});
+    o->x = mp_obj_new_int(lnk_data->rect.x);
+    o->y = mp_obj_new_int(lnk_data->rect.y);
+    o->w = mp_obj_new_int(lnk_data->rect.w);
+    o->h = mp_obj_new_int(lnk_data->rect.h);
+    o->id = mp_obj_new_int(lnk_data->id);
+    o->family = mp_obj_new_int(lnk_data->family);
+    o->cx = mp_obj_new_int(lnk_data->centroid.x);
+    o->cy = mp_obj_new_int(lnk_data->centroid.y);
+    o->rotation = mp_obj_new_float(lnk_data->z_rotation);
+    o->decision_margin = mp_obj_new_float(lnk_data->decision_margin);
+    o->hamming = mp_obj_new_int(lnk_data->hamming);
+    o->goodness = mp_obj_new_float(lnk_data->goodness);
+    o->x_translation = mp_obj_new_float(lnk_data->x_translation);
+    o->y_translation = mp_obj_new_float(lnk_data->y_translation);
+    o->z_translation = mp_obj_new_float(lnk_data->z_translation);
+    o->x_rotation = mp_obj_new_float(lnk_data->x_rotation);
+    o->y_rotation = mp_obj_new_float(lnk_data->y_rotation);
+    o->z_rotation = mp_obj_new_float(lnk_data->z_rotation);
+
+    return o;
+}
+
+// AprilTagTracker Object //
+// Passed to find_apriltags() with tracker= to decode the tags found in the previous frame where
+// they are predicted to be (with a full search every rescan frames or when a tag is lost).
+typedef struct py_apriltag_tracker_obj {
+    mp_obj_base_t base;
+    apriltag_tracker_t tracker;
+} py_apriltag_tracker_obj_t;
+
+static void py_apriltag_tracker_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_apriltag_tracker_obj_t *self = self_in;
+    mp_printf(print, "{\"margin\":%d, \"rescan\":%d, \"max_tags\":%d, \"tracked\":%d}",
+              self->tracker.margin, self->tracker.rescan, self->tracker.tracks_max, self->tracker.tracks_len);
+}
+
+mp_obj_t py_apriltag_tracker_reset(mp_obj_t self_in)
+{
+    imlib_apriltag_tracker_reset(&((py_apriltag_tracker_obj_t *) self_in)->tracker);
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_apriltag_tracker_reset_obj, py_apriltag_tracker_reset);
+
+STATIC const mp_rom_map_elem_t py_apriltag_tracker_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_apriltag_tracker_reset_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_apriltag_tracker_locals_dict, py_apriltag_tracker_locals_dict_table);
+
+static const mp_obj_type_t py_apriltag_tracker_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_AprilTagTracker,
+    .print = py_apriltag_tracker_print,
+    .locals_dict = (mp_obj_t) &py_apriltag_tracker_locals_dict
+};
+
+mp_obj_t py_image_apriltag_tracker(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_margin =
+        py_helper_keyword_int(n_args, args, 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_margin), 20);
+    PY_ASSERT_TRUE_MSG(arg_margin >= 0, "Margin must be >= 0");
+    int arg_rescan =
+        py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rescan), 30);
+    PY_ASSERT_TRUE_MSG(arg_rescan > 0, "Rescan must be > 0");
+    int arg_max_tags =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_tags), 16);
+    PY_ASSERT_TRUE_MSG((0 < arg_max_tags) && (arg_max_tags <= 255), "Error: 0 < max_tags <= 255!");
+
+    py_apriltag_tracker_obj_t *obj = m_new_obj(py_apriltag_tracker_obj_t);
+    obj->base.type = &py_apriltag_tracker_type;
+    imlib_apriltag_tracker_alloc(&obj->tracker, arg_max_tags, arg_margin, arg_rescan);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_apriltag_tracker_obj, 0, py_image_apriltag_tracker);
+
 static mp_obj_t py_image_find_apriltags(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
 
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+    int quad_decimate = py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_quad_decimate), 1);
+    PY_ASSERT_TRUE_MSG((1 <= quad_decimate) && (quad_decimate <= 4), "quad_decimate must be between 1 and 4!");
 #ifndef IMLIB_ENABLE_HIGH_RES_APRILTAGS
-    PY_ASSERT_TRUE_MSG((roi.w * roi.h) < 65536, "The maximum supported resolution for find_apriltags() is < 64K pixels.");
+    // Larger rois are processed in bands of less than 64K (decimated) pixels.
+    PY_ASSERT_TRUE_MSG(((roi.w / quad_decimate) * 8) < 65536, "The roi is too wide for find_apriltags()!");
 #endif
+    int max_tags = py_helper_keyword_int(n_args, args, 9, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_tags), 0);
+    PY_ASSERT_TRUE_MSG(max_tags >= 0, "max_tags must be >= 0!");
+    mp_obj_t tracker =
+        py_helper_keyword_object(n_args, args, 10, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_tracker));
+    PY_ASSERT_TRUE_MSG((!tracker) || (tracker == mp_const_none) || MP_OBJ_IS_TYPE(tracker, &py_apriltag_tracker_type),
+                       "Expected an AprilTagTracker!");
+    mp_obj_t results = py_helper_keyword_object(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_results));
+    py_helper_keyword_time_budget(n_args, args, 11, kw_args, 0);
+    list_t out;
+
     if ((roi.w < 4) || (roi.h < 4)) {
-        return mp_obj_new_list(0, NULL);
+        list_init(&out, sizeof(find_apriltags_list_lnk_data_t));
+        return py_result_array_fill(results, &out, py_apriltag_make, NULL);
     }
 
     apriltag_families_t families = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_families), TAG36H11);
@@ -5752,46 +7564,16 @@ static mp_obj_t py_image_find_apriltags(uint n_args, const mp_obj_t *args, mp_ma
     // Use the image versus the roi here since the image should be projected from the camera center.
     float cy = py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cy), arg_img->h * 0.5);
 
-    list_t out;
     fb_alloc_mark();
-    imlib_find_apriltags(&out, arg_img, &roi, families, fx, fy, cx, cy);
-    fb_alloc_free_till_mark();
-
-    mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
-    for (size_t i = 0; list_size(&out); i++) {
-        find_apriltags_list_lnk_data_t lnk_data;
-        list_pop_front(&out, &lnk_data);
-
-        py_apriltag_obj_t *o = m_new_obj(py_apriltag_obj_t);
-        o->base.type = &py_apriltag_type;
-        o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
-            {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[0].x), mp_obj_new_int(lnk_data.corners[0].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[1].x), mp_obj_new_int(lnk_data.corners[1].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[2].x), mp_obj_new_int(lnk_data.corners[2].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[3].x), mp_obj_new_int(lnk_data.corners[3].y)})});
-        o->x = mp_obj_new_int(lnk_data.rect.x);
-        o->y = mp_obj_new_int(lnk_data.rect.y);
-        o->w = mp_obj_new_int(lnk_data.rect.w);
-        o->h = mp_obj_new_int(lnk_data.rect.h);
-        o->id = mp_obj_new_int(lnk_data.id);
-        o->family = mp_obj_new_int(lnk_data.family);
-        o->cx = mp_obj_new_int(lnk_data.centroid.x);
-        o->cy = mp_obj_new_int(lnk_data.centroid.y);
-        o->rotation = mp_obj_new_float(lnk_data.z_rotation);
-        o->decision_margin = mp_obj_new_float(lnk_data.decision_margin);
-        o->hamming = mp_obj_new_int(lnk_data.hamming);
-        o->goodness = mp_obj_new_float(lnk_data.goodness);
-        o->x_translation = mp_obj_new_float(lnk_data.x_translation);
-        o->y_translation = mp_obj_new_float(lnk_data.y_translation);
-        o->z_translation = mp_obj_new_float(lnk_data.z_translation);
-        o->x_rotation = mp_obj_new_float(lnk_data.x_rotation);
-        o->y_rotation = mp_obj_new_float(lnk_data.y_rotation);
-        o->z_rotation = mp_obj_new_float(lnk_data.z_rotation);
-
-        objects_list->items[i] = o;
+    if (tracker && (tracker != mp_const_none)) {
+        imlib_apriltag_tracker_update(&((py_apriltag_tracker_obj_t *) tracker)->tracker, &out, arg_img, &roi, families,
+                                      fx, fy, cx, cy, quad_decimate);
+    } else {
+        imlib_find_apriltags(&out, arg_img, &roi, families, fx, fy, cx, cy, quad_decimate, max_tags);
     }
+    fb_alloc_free_till_mark();
 
-    return objects_list;
+    return py_result_array_fill(results, &out, py_apriltag_make, NULL);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_apriltags_obj, 1, py_image_find_apriltags);
 #endif // IMLIB_ENABLE_APRILTAGS
@@ -5910,6 +7692,37 @@ static const mp_obj_type_t py_datamatrix_type = {
     .locals_dict = (mp_obj_t) &py_datamatrix_locals_dict
 };
 
+static mp_obj_t py_datamatrix_make(void *data)
+{
+    find_datamatrices_list_lnk_data_t *lnk_data = data;
+
+    py_datamatrix_obj_t *o = m_new_obj(py_datamatrix_obj_t);
+    o->base.type = &py_datamatrix_type;
+    o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
+        {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[0].x), mp_obj_new_int(lnk_data->corners[0].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[1].x), mp_obj_new_int(lnk_data->corners[1].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[2].x), mp_obj_new_int(lnk_data->corners[2].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[3].x), mp_obj_new_int(lnk_data->corners[3].y)})});
+    o->x = mp_obj_new_int(lnk_data->rect.x);
+    o->y = mp_obj_new_int(lnk_data->rect.y);
+    o->w = mp_obj_new_int(lnk_data->rect.w);
+    o->h = mp_obj_new_int(lnk_data->rect.h);
+    o->payload = mp_obj_new_str(lnk_data->payload, lnk_data->payload_len);
+    o->rotation = mp_obj_new_float(IM_DEG2RAD(lnk_data->rotation));
+    o->rows = mp_obj_new_int(lnk_data->rows);
+    o->columns = mp_obj_new_int(lnk_data->columns);
+    o->capacity = mp_obj_new_int(lnk_data->capacity);
+    o->padding = mp_obj_new_int(lnk_data->padding);
+
+    return o;
+}
+
+static void py_datamatrix_clear(void *data)
+{
+    find_datamatrices_list_lnk_data_t *lnk_data = data;
+    xfree(lnk_data->payload);
+}
+
 static mp_obj_t py_image_find_datamatrices(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
@@ -5918,40 +7731,16 @@ static mp_obj_t py_image_find_datamatrices(uint n_args, const mp_obj_t *args, mp
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
 
     int effort = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_effort), 200);
+    // timeout_us is the old name of time_budget_us.
+    int timeout_us = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_timeout_us), 0);
+    py_helper_keyword_time_budget(n_args, args, 4, kw_args, timeout_us);
 
     list_t out;
     fb_alloc_mark();
     imlib_find_datamatrices(&out, arg_img, &roi, effort);
     fb_alloc_free_till_mark();
 
-    mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
-    for (size_t i = 0; list_size(&out); i++) {
-        find_datamatrices_list_lnk_data_t lnk_data;
-        list_pop_front(&out, &lnk_data);
-
-        py_datamatrix_obj_t *o = m_new_obj(py_datamatrix_obj_t);
-        o->base.type = &py_datamatrix_type;
-        o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
-            {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[0].x), mp_obj_new_int(lnk_data.corners[0].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[1].x), mp_obj_new_int(lnk_data.corners[1].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[2].x), mp_obj_new_int(lnk_data.corners[2].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[3].x), mp_obj_new_int(lnk_data.corners[3].y)})});
-        o->x = mp_obj_new_int(lnk_data.rect.x);
-        o->y = mp_obj_new_int(lnk_data.rect.y);
-        o->w = mp_obj_new_int(lnk_data.rect.w);
-        o->h = mp_obj_new_int(lnk_data.rect.h);
-        o->payload = mp_obj_new_str(lnk_data.payload, lnk_data.payload_len);
-        o->rotation = mp_obj_new_float(IM_DEG2RAD(lnk_data.rotation));
-        o->rows = mp_obj_new_int(lnk_data.rows);
-        o->columns = mp_obj_new_int(lnk_data.columns);
-        o->capacity = mp_obj_new_int(lnk_data.capacity);
-        o->padding = mp_obj_new_int(lnk_data.padding);
-
-        objects_list->items[i] = o;
-        xfree(lnk_data.payload);
-    }
-
-    return objects_list;
+    return py_result_array_fill(NULL, &out, py_datamatrix_make, py_datamatrix_clear);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_datamatrices_obj, 1, py_image_find_datamatrices);
 #endif // IMLIB_ENABLE_DATAMATRICES
@@ -6060,6 +7849,35 @@ static const mp_obj_type_t py_barcode_type = {
     .locals_dict = (mp_obj_t) &py_barcode_locals_dict
 };
 
+static mp_obj_t py_barcode_make(void *data)
+{
+    find_barcodes_list_lnk_data_t *lnk_data = data;
+
+    py_barcode_obj_t *o = m_new_obj(py_barcode_obj_t);
+    o->base.type = &py_barcode_type;
+    o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
+        {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[0].x), mp_obj_new_int(lnk_data->corners[0].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[1].x), mp_obj_new_int(lnk_data->corners[1].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[2].x), mp_obj_new_int(lnk_data->corners[2].y)}),
+         mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data->corners[3].x), mp_obj_new_int(lnk_data->corners[3].y)})});
+    o->x = mp_obj_new_int(lnk_data->rect.x);
+    o->y = mp_obj_new_int(lnk_data->rect.y);
+    o->w = mp_obj_new_int(lnk_data->rect.w);
+    o->h = mp_obj_new_int(lnk_data->rect.h);
+    o->payload = mp_obj_new_str(lnk_data->payload, lnk_data->payload_len);
+    o->type = mp_obj_new_int(lnk_data->type);
+    o->rotation = mp_obj_new_float(IM_DEG2RAD(lnk_data->rotation));
+    o->quality = mp_obj_new_int(lnk_data->quality);
+
+    return o;
+}
+
+static void py_barcode_clear(void *data)
+{
+    find_barcodes_list_lnk_data_t *lnk_data = data;
+    xfree(lnk_data->payload);
+}
+
 static mp_obj_t py_image_find_barcodes(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
@@ -6067,40 +7885,107 @@ static mp_obj_t py_image_find_barcodes(uint n_args, const mp_obj_t *args, mp_map
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
 
+    int x_stride = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_stride), 1);
+    PY_ASSERT_TRUE_MSG(x_stride >= 0, "x_stride must not be negative!");
+    int y_stride = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_stride), 1);
+    PY_ASSERT_TRUE_MSG(y_stride >= 0, "y_stride must not be negative!");
+    PY_ASSERT_TRUE_MSG(x_stride || y_stride, "x_stride and y_stride can't both be 0!");
+    bool first_only = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_first_only), false);
+
     list_t out;
     fb_alloc_mark();
-    imlib_find_barcodes(&out, arg_img, &roi);
+    imlib_find_barcodes(&out, arg_img, &roi, x_stride, y_stride, first_only);
     fb_alloc_free_till_mark();
 
-    mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
-    for (size_t i = 0; list_size(&out); i++) {
-        find_barcodes_list_lnk_data_t lnk_data;
-        list_pop_front(&out, &lnk_data);
+    return py_result_array_fill(NULL, &out, py_barcode_make, py_barcode_clear);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_barcodes_obj, 1, py_image_find_barcodes);
+#endif // IMLIB_ENABLE_BARCODES
 
-        py_barcode_obj_t *o = m_new_obj(py_barcode_obj_t);
-        o->base.type = &py_barcode_type;
-        o->corners = mp_obj_new_tuple(4, (mp_obj_t [])
-            {mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[0].x), mp_obj_new_int(lnk_data.corners[0].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[1].x), mp_obj_new_int(lnk_data.corners[1].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[2].x), mp_obj_new_int(lnk_data.corners[2].y)}),
-             mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(lnk_data.corners[3].x), mp_obj_new_int(lnk_data.corners[3].y)})});
-        o->x = mp_obj_new_int(lnk_data.rect.x);
-        o->y = mp_obj_new_int(lnk_data.rect.y);
-        o->w = mp_obj_new_int(lnk_data.rect.w);
-        o->h = mp_obj_new_int(lnk_data.rect.h);
-        o->payload = mp_obj_new_str(lnk_data.payload, lnk_data.payload_len);
-        o->type = mp_obj_new_int(lnk_data.type);
-        o->rotation = mp_obj_new_float(IM_DEG2RAD(lnk_data.rotation));
-        o->quality = mp_obj_new_int(lnk_data.quality);
+#if defined(IMLIB_ENABLE_QRCODES) || defined(IMLIB_ENABLE_DATAMATRICES) || \
+    defined(IMLIB_ENABLE_BARCODES) || defined(IMLIB_ENABLE_APRILTAGS)
+// Moves the objects made from out to the end of objects_list.
+static void py_find_codes_append(mp_obj_t objects_list, list_t *out,
+                                 mp_obj_t (*make)(void *), void (*clear)(void *))
+{
+    char data[out->data_len];
 
-        objects_list->items[i] = o;
-        xfree(lnk_data.payload);
+    while (list_size(out)) {
+        list_pop_front(out, data);
+        mp_obj_list_append(objects_list, make(data));
+        if (clear) clear(data);
+    }
+}
+
+static mp_obj_t py_image_find_codes(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    list_t qrcodes, datamatrices, barcodes, apriltags;
+    list_t *qrcodes_ptr = NULL, *datamatrices_ptr = NULL, *barcodes_ptr = NULL, *apriltags_ptr = NULL;
+    #ifdef IMLIB_ENABLE_QRCODES
+    if (py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_qrcodes), true)) {
+        qrcodes_ptr = &qrcodes;
+    }
+    #endif
+    #ifdef IMLIB_ENABLE_DATAMATRICES
+    if (py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_datamatrices), true)) {
+        datamatrices_ptr = &datamatrices;
+    }
+    #endif
+    #ifdef IMLIB_ENABLE_BARCODES
+    if (py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_barcodes), true)) {
+        barcodes_ptr = &barcodes;
+    }
+    #endif
+    #ifdef IMLIB_ENABLE_APRILTAGS
+    if (py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_apriltags), true)
+    && (roi.w >= 4) && (roi.h >= 4)) {
+        #ifndef IMLIB_ENABLE_HIGH_RES_APRILTAGS
+        PY_ASSERT_TRUE_MSG((roi.w * 8) < 65536, "The roi is too wide for find_apriltags()!");
+        #endif
+        apriltags_ptr = &apriltags;
     }
+    #endif
+
+    apriltag_families_t families = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_families), TAG36H11);
+    // 2.8mm Focal Length w/ OV7725 sensor for reference.
+    float fx = py_helper_keyword_float(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fx), (2.8 / 3.984) * arg_img->w);
+    // 2.8mm Focal Length w/ OV7725 sensor for reference.
+    float fy = py_helper_keyword_float(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fy), (2.8 / 2.952) * arg_img->h);
+    // Use the image versus the roi here since the image should be projected from the camera center.
+    float cx = py_helper_keyword_float(n_args, args, 9, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cx), arg_img->w * 0.5);
+    // Use the image versus the roi here since the image should be projected from the camera center.
+    float cy = py_helper_keyword_float(n_args, args, 10, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cy), arg_img->h * 0.5);
+    int effort = py_helper_keyword_int(n_args, args, 11, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_effort), 200);
+    py_helper_keyword_time_budget(n_args, args, 12, kw_args, 0);
+
+    fb_alloc_mark();
+    imlib_find_codes(arg_img, &roi, qrcodes_ptr, datamatrices_ptr, effort, barcodes_ptr, apriltags_ptr, families,
+                     fx, fy, cx, cy);
+    fb_alloc_free_till_mark();
+
+    mp_obj_t objects_list = mp_obj_new_list(0, NULL);
+    #ifdef IMLIB_ENABLE_QRCODES
+    if (qrcodes_ptr) py_find_codes_append(objects_list, qrcodes_ptr, py_qrcode_make, py_qrcode_clear);
+    #endif
+    #ifdef IMLIB_ENABLE_DATAMATRICES
+    if (datamatrices_ptr) py_find_codes_append(objects_list, datamatrices_ptr, py_datamatrix_make, py_datamatrix_clear);
+    #endif
+    #ifdef IMLIB_ENABLE_BARCODES
+    if (barcodes_ptr) py_find_codes_append(objects_list, barcodes_ptr, py_barcode_make, py_barcode_clear);
+    #endif
+    #ifdef IMLIB_ENABLE_APRILTAGS
+    if (apriltags_ptr) py_find_codes_append(objects_list, apriltags_ptr, py_apriltag_make, NULL);
+    #endif
 
     return objects_list;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_barcodes_obj, 1, py_image_find_barcodes);
-#endif // IMLIB_ENABLE_BARCODES
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_codes_obj, 1, py_image_find_codes);
+#endif // IMLIB_ENABLE_QRCODES || IMLIB_ENABLE_DATAMATRICES || IMLIB_ENABLE_BARCODES || IMLIB_ENABLE_APRILTAGS
 
 #ifdef IMLIB_ENABLE_FIND_DISPLACEMENT
 // Displacement Object //
@@ -6176,26 +8061,81 @@ static const mp_obj_type_t py_displacement_type = {
     .locals_dict = (mp_obj_t) &py_displacement_locals_dict
 };
 
+// DisplacementTemplate Object //
+// Passed to find_displacement() instead of the template so that the spectrum of the template is
+// computed once and reused for every frame (translation only).
+typedef struct py_displacement_template_obj {
+    mp_obj_base_t base;
+    phasecorrelate_template_t t;
+} py_displacement_template_obj_t;
+
+static void py_displacement_template_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_displacement_template_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"fft_w\":%d, \"fft_h\":%d}",
+              self->t.roi.w, self->t.roi.h, 1 << self->t.w_pow2, 1 << self->t.h_pow2);
+}
+
+static const mp_obj_type_t py_displacement_template_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_DisplacementTemplate,
+    .print = py_displacement_template_print
+};
+
+static mp_obj_t py_image_displacement_template(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_template_img = py_helper_arg_to_image_mutable(args[0]);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_template_img, n_args, args, 1, kw_args, &roi);
+
+    py_displacement_template_obj_t *obj = m_new_obj(py_displacement_template_obj_t);
+    obj->base.type = &py_displacement_template_type;
+    float *buf = xalloc(imlib_phasecorrelate_template_size(&roi));
+
+    fb_alloc_mark();
+    imlib_phasecorrelate_template_init(&obj->t, arg_template_img, &roi, buf);
+    fb_alloc_free_till_mark();
+
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_displacement_template_obj, 1, py_image_displacement_template);
+
 static mp_obj_t py_image_find_displacement(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
-    image_t *arg_template_img = py_helper_arg_to_image_mutable(args[1]);
 
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
 
-    rectangle_t template_roi;
-    py_helper_keyword_rectangle(arg_template_img, n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_template_roi), &template_roi);
-
-    PY_ASSERT_FALSE_MSG((roi.w != template_roi.w) || (roi.h != template_roi.h), "ROI(w,h) != TEMPLATE_ROI(w,h)");
-
     bool logpolar = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_logpolar), false);
     bool fix_rotation_scale = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fix_rotation_scale), false);
 
     float x, y, r, s, response;
-    fb_alloc_mark();
-    imlib_phasecorrelate(arg_img, arg_template_img, &roi, &template_roi, logpolar, fix_rotation_scale, &x, &y, &r, &s, &response);
-    fb_alloc_free_till_mark();
+
+    if (MP_OBJ_IS_TYPE(args[1], &py_displacement_template_type)) {
+        phasecorrelate_template_t *t = &((py_displacement_template_obj_t *) args[1])->t;
+
+        PY_ASSERT_FALSE_MSG((roi.w != t->roi.w) || (roi.h != t->roi.h), "ROI(w,h) != TEMPLATE_ROI(w,h)");
+        PY_ASSERT_FALSE_MSG(logpolar || fix_rotation_scale, "A DisplacementTemplate only supports translation!");
+
+        fb_alloc_mark();
+        imlib_phasecorrelate_template(arg_img, &roi, t, &x, &y, &response);
+        fb_alloc_free_till_mark();
+        r = 0;
+        s = 0;
+    } else {
+        image_t *arg_template_img = py_helper_arg_to_image_mutable(args[1]);
+
+        rectangle_t template_roi;
+        py_helper_keyword_rectangle(arg_template_img, n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_template_roi), &template_roi);
+
+        PY_ASSERT_FALSE_MSG((roi.w != template_roi.w) || (roi.h != template_roi.h), "ROI(w,h) != TEMPLATE_ROI(w,h)");
+
+        fb_alloc_mark();
+        imlib_phasecorrelate(arg_img, arg_template_img, &roi, &template_roi, logpolar, fix_rotation_scale, &x, &y, &r, &s, &response);
+        fb_alloc_free_till_mark();
+    }
 
     py_displacement_obj_t *o = m_new_obj(py_displacement_obj_t);
     o->base.type = &py_displacement_type;
@@ -6210,13 +8150,236 @@ static mp_obj_t py_image_find_displacement(uint n_args, const mp_obj_t *args, mp
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_displacement_obj, 2, py_image_find_displacement);
 #endif // IMLIB_ENABLE_FIND_DISPLACEMENT
 
+#ifdef IMLIB_ENABLE_FIND_MOTION_VECTORS
+// Returns (x, y, dx, dy, sad) for each block_size x block_size block of roi that changed since
+// prev, (x, y) is the top left corner of the block which moved by (dx, dy).
+static mp_obj_t py_image_find_motion_vectors(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    image_t *arg_prev = py_helper_arg_to_image_grayscale(args[1]);
+    PY_ASSERT_TRUE_MSG((arg_img->w == arg_prev->w) && (arg_img->h == arg_prev->h), "Images must be the same size!");
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
+
+    int block_size = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_block_size), 16);
+    PY_ASSERT_TRUE_MSG((4 <= block_size) && (block_size <= 64), "Error: 4 <= block_size <= 64!");
+    int search_range = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_search_range), 8);
+    PY_ASSERT_TRUE_MSG((0 < search_range) && (search_range <= 32), "Error: 0 < search_range <= 32!");
+    int threshold = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 4);
+    PY_ASSERT_TRUE_MSG((0 <= threshold) && (threshold <= 255), "Error: 0 <= threshold <= 255!");
+
+    int blocks = (roi.w / block_size) * (roi.h / block_size);
+    mp_obj_t vectors_list = mp_obj_new_list(0, NULL);
+
+    if (blocks) {
+        fb_alloc_mark();
+        motion_vector_t *vectors = fb_alloc(blocks * sizeof(motion_vector_t), FB_ALLOC_NO_HINT);
+        int len = imlib_find_motion_vectors(arg_img, arg_prev, &roi, block_size, search_range, threshold, vectors);
+
+        for (int i = 0; i < len; i++) {
+            mp_obj_list_append(vectors_list, mp_obj_new_tuple(5, (mp_obj_t []) {mp_obj_new_int(vectors[i].x),
+                                                                                mp_obj_new_int(vectors[i].y),
+                                                                                mp_obj_new_int(vectors[i].dx),
+                                                                                mp_obj_new_int(vectors[i].dy),
+                                                                                mp_obj_new_int(vectors[i].sad)}));
+        }
+
+        fb_alloc_free_till_mark();
+    }
+
+    return vectors_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_motion_vectors_obj, 2, py_image_find_motion_vectors);
+#endif // IMLIB_ENABLE_FIND_MOTION_VECTORS
+
+// ImagePyramid Object //
+// Built once per frame with update() and passed (pyramid=) to the multi-scale detectors so they
+// don't scale the frame again, the levels are also images for the other methods. Level 0 is the
+// frame itself so the pyramid is only valid until the frame changes.
+typedef struct py_image_pyramid_obj {
+    mp_obj_base_t base;
+    image_pyramid_t pyr;
+    int levels;
+    uint32_t frame_count; // Frame the pyramid was built from if level 0 is the frame buffer.
+    uint8_t *data;
+    size_t size;
+} py_image_pyramid_obj_t;
+
+// The frame buffer is reused by every snapshot, so the frame sequence number tells the frames apart.
+static uint32_t py_image_pyramid_frame_count(image_t *img)
+{
+    return (MAIN_FB_BUFFER() == img->data) ? MAIN_FB()->frame_count : 0;
+}
+
+static void py_image_pyramid_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_image_pyramid_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"levels\":%d, \"scale\":%f}",
+              self->pyr.levels[0].w, self->pyr.levels[0].h, self->pyr.levels_len, (double) self->pyr.scale);
+}
+
+static mp_obj_t py_image_pyramid_unary_op(mp_unary_op_t op, mp_obj_t self_in)
+{
+    py_image_pyramid_obj_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_LEN: return mp_obj_new_int(self->pyr.levels_len);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+static mp_obj_t py_image_pyramid_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value)
+{
+    if (value == MP_OBJ_SENTINEL) { // load
+        py_image_pyramid_obj_t *self = self_in;
+        int i = mp_get_index(self->base.type, self->pyr.levels_len, index, false);
+        return py_image_from_struct(&self->pyr.levels[i]);
+    }
+    return MP_OBJ_NULL; // op not supported
+}
+
+mp_obj_t py_image_pyramid_update(mp_obj_t self_in, mp_obj_t img_obj)
+{
+    py_image_pyramid_obj_t *self = self_in;
+    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
+    PY_ASSERT_TRUE_MSG((arg_img->bpp == IMAGE_BPP_GRAYSCALE) || (arg_img->bpp == IMAGE_BPP_RGB565),
+                       "Image must be grayscale or RGB565!");
+
+    size_t size = imlib_image_pyramid_size(arg_img, self->levels, self->pyr.scale);
+
+    // The buffer is kept for the next frames.
+    if (self->size < size) {
+        if (self->data) {
+            xfree(self->data);
+        }
+
+        self->data = NULL; // in case xalloc fails
+        self->size = 0;
+        self->data = xalloc_data(size);
+        self->size = size;
+    }
+
+    imlib_image_pyramid_init(&self->pyr, arg_img, self->levels, self->pyr.scale, self->data);
+    self->frame_count = py_image_pyramid_frame_count(arg_img);
+    return self_in;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_image_pyramid_update_obj, py_image_pyramid_update);
+
+STATIC const mp_rom_map_elem_t py_image_pyramid_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&py_image_pyramid_update_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_image_pyramid_locals_dict, py_image_pyramid_locals_dict_table);
+
+static const mp_obj_type_t py_image_pyramid_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ImagePyramid,
+    .print = py_image_pyramid_print,
+    .unary_op = py_image_pyramid_unary_op,
+    .subscr = py_image_pyramid_subscr,
+    .locals_dict = (mp_obj_t) &py_image_pyramid_locals_dict
+};
+
+mp_obj_t py_image_image_pyramid(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_levels =
+        py_helper_keyword_int(n_args, args, 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_levels), 4);
+    PY_ASSERT_TRUE_MSG((0 < arg_levels) && (arg_levels <= IMAGE_PYRAMID_MAX_LEVELS), "Error: 0 < levels <= 8!");
+    float arg_scale =
+        py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale), 2.0f);
+    PY_ASSERT_TRUE_MSG(arg_scale > 1.0f, "Error: scale > 1!");
+
+    py_image_pyramid_obj_t *obj = m_new_obj(py_image_pyramid_obj_t);
+    obj->base.type = &py_image_pyramid_type;
+    obj->pyr.levels_len = 0;
+    obj->pyr.scale = arg_scale;
+    obj->levels = arg_levels;
+    obj->frame_count = 0;
+    obj->data = NULL;
+    obj->size = 0;
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_image_pyramid_obj, 0, py_image_image_pyramid);
+
+// Returns the pyramid= keyword argument, which must have been built from img, or NULL.
+static image_pyramid_t *py_image_pyramid_arg(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
+                                              mp_map_t *kw_args)
+{
+    mp_obj_t arg = py_helper_keyword_object(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_pyramid));
+
+    if ((!arg) || (arg == mp_const_none)) {
+        return NULL;
+    }
+
+    PY_ASSERT_TRUE_MSG(MP_OBJ_IS_TYPE(arg, &py_image_pyramid_type), "Expected an ImagePyramid!");
+    py_image_pyramid_obj_t *obj = arg;
+    PY_ASSERT_TRUE_MSG(imlib_image_pyramid_of(&obj->pyr, img)
+                       && (obj->frame_count == py_image_pyramid_frame_count(img)),
+                       "The ImagePyramid wasn't updated with this image!");
+    return &obj->pyr;
+}
+
 #ifdef IMLIB_FIND_TEMPLATE
+// TemplatePyramid Object //
+// Passed to find_template() instead of the template so that the pyramid of the template used by
+// SEARCH_PYR is built once and reused for every frame.
+typedef struct py_template_pyramid_obj {
+    mp_obj_base_t base;
+    template_pyramid_t pyr;
+} py_template_pyramid_obj_t;
+
+static void py_template_pyramid_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_template_pyramid_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"levels\":%d}",
+              self->pyr.levels[0].w, self->pyr.levels[0].h, self->pyr.levels_len);
+}
+
+static const mp_obj_type_t py_template_pyramid_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_TemplatePyramid,
+    .print = py_template_pyramid_print
+};
+
+mp_obj_t py_image_template_pyramid(mp_obj_t template_obj)
+{
+    image_t *arg_template = py_helper_arg_to_image_grayscale(template_obj);
+    py_template_pyramid_obj_t *obj = m_new_obj(py_template_pyramid_obj_t);
+    obj->base.type = &py_template_pyramid_type;
+    imlib_template_pyramid_init(&obj->pyr, arg_template, xalloc(imlib_template_pyramid_size(arg_template)));
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_template_pyramid_obj, py_image_template_pyramid);
+
 static mp_obj_t py_image_find_template(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
-    image_t *arg_template = py_helper_arg_to_image_grayscale(args[1]);
+    image_t *arg_template = NULL;
+    template_pyramid_t *arg_pyr = NULL;
+    const char *arg_path = NULL;
+    image_t template_geometry;
     float arg_thresh = mp_obj_get_float(args[2]);
 
+    if (MP_OBJ_IS_TYPE(args[1], &py_template_pyramid_type)) {
+        arg_pyr = &((py_template_pyramid_obj_t *) args[1])->pyr;
+        arg_template = &arg_pyr->levels[0];
+    } else if (MP_OBJ_IS_STR(args[1])) {
+        // The template is streamed from the file only a band of lines at a time.
+        arg_path = mp_obj_str_get_str(args[1]);
+        fb_alloc_mark();
+        FIL fp;
+        img_read_settings_t rs;
+        imlib_read_geometry(&fp, &template_geometry, arg_path, &rs);
+        file_buffer_off(&fp);
+        file_close(&fp);
+        fb_alloc_free_till_mark();
+        PY_ASSERT_TRUE_MSG(template_geometry.bpp == IMAGE_BPP_GRAYSCALE, "Image is not grayscale!");
+        arg_template = &template_geometry;
+    } else {
+        arg_template = py_helper_arg_to_image_grayscale(args[1]);
+    }
+
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 3, kw_args, &roi);
 
@@ -6229,13 +8392,28 @@ static mp_obj_t py_image_find_template(uint n_args, const mp_obj_t *args, mp_map
             "Region of interest is bigger than image!");
 
     int step = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_step), 2);
-    int search = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_search), SEARCH_EX);
+    int search = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_search),
+                                       arg_pyr ? SEARCH_PYR : SEARCH_EX);
+    image_pyramid_t *arg_img_pyr = py_image_pyramid_arg(arg_img, n_args, args, 6, kw_args);
 
     // Find template
     rectangle_t r;
     float corr;
+    PY_ASSERT_FALSE_MSG(arg_path && (search != SEARCH_EX), "Only SEARCH_EX is supported with a template file!");
+    PY_ASSERT_FALSE_MSG(arg_pyr && (search != SEARCH_PYR), "Only SEARCH_PYR is supported with a TemplatePyramid!");
+
     fb_alloc_mark();
-    if (search == SEARCH_DS) {
+    if (arg_path) {
+        corr = imlib_template_match_ex_file(arg_img, arg_path, &roi, step, &r);
+    } else if (search == SEARCH_PYR) {
+        template_pyramid_t pyr;
+        if (!arg_pyr) {
+            arg_pyr = &pyr;
+            imlib_template_pyramid_init(arg_pyr, arg_template,
+                                        fb_alloc(imlib_template_pyramid_size(arg_template), FB_ALLOC_NO_HINT));
+        }
+        corr = imlib_template_match_pyr(arg_img, arg_img_pyr, arg_pyr, &roi, &r);
+    } else if (search == SEARCH_DS) {
         corr = imlib_template_match_ds(arg_img, arg_template, &r);
     } else {
         corr = imlib_template_match_ex(arg_img, arg_template, &roi, step, &r);
@@ -6311,63 +8489,333 @@ static mp_obj_t py_image_find_eye(uint n_args, const mp_obj_t *args, mp_map_t *k
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_eye_obj, 2, py_image_find_eye);
 
-#ifdef IMLIB_ENABLE_FIND_LBP
-static mp_obj_t py_image_find_lbp(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+#ifdef IMLIB_ENABLE_FIND_LBP
+static mp_obj_t py_image_find_lbp(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    mp_obj_t arg_map = py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_map));
+    lbp_map_t *map = NULL;
+
+    if (arg_map && (arg_map != mp_const_none)) {
+        PY_ASSERT_TRUE_MSG(MP_OBJ_IS_TYPE(arg_map, &py_lbp_map_type), "Expected a LBPMap!");
+        map = &((py_lbp_map_obj_t *) arg_map)->map;
+    }
+
+    py_lbp_obj_t *lbp_obj = m_new_obj(py_lbp_obj_t);
+    lbp_obj->base.type = &py_lbp_type;
+
+    if (map) {
+        imlib_lbp_map_update(map, arg_img);
+        lbp_obj->hist = imlib_lbp_map_desc(map, &roi);
+    } else {
+        lbp_obj->hist = imlib_lbp_desc(arg_img, &roi);
+    }
+
+    return lbp_obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_lbp_obj, 2, py_image_find_lbp);
+#endif // IMLIB_ENABLE_FIND_LBP
+
+#ifdef IMLIB_ENABLE_FIND_KEYPOINTS
+static mp_obj_t py_image_find_keypoints(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    int threshold =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 20);
+    bool normalized =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_normalized), false);
+    float scale_factor =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale_factor), 1.5f);
+    int max_keypoints =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_keypoints), 100);
+    corner_detector_t corner_detector =
+        py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_corner_detector), CORNER_AGAST);
+    int cell_size =
+        py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cell_size), 0);
+    PY_ASSERT_TRUE_MSG(cell_size >= 0, "cell_size must not be negative.");
+    int cell_max =
+        py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cell_max), 4);
+    PY_ASSERT_TRUE_MSG(cell_max > 0, "cell_max must be greater than zero.");
+    image_pyramid_t *pyr = py_image_pyramid_arg(arg_img, n_args, args, 9, kw_args);
+    PY_ASSERT_FALSE_MSG(pyr && (arg_img->bpp != IMAGE_BPP_GRAYSCALE), "The ImagePyramid must be grayscale!");
+    py_helper_keyword_time_budget(n_args, args, 10, kw_args, 0);
+
+    #ifndef IMLIB_ENABLE_FAST
+    // Force AGAST when FAST is disabled.
+    corner_detector = CORNER_AGAST;
+    #endif
+
+    // Find keypoints
+    fb_alloc_mark();
+    array_t *kpts = orb_find_keypoints(arg_img, pyr, normalized, threshold, scale_factor, max_keypoints, corner_detector, &roi,
+                                       cell_size, cell_max);
+    fb_alloc_free_till_mark();
+
+    if (array_length(kpts)) {
+        py_kp_obj_t *kp_obj = m_new_obj(py_kp_obj_t);
+        kp_obj->base.type = &py_kp_type;
+        kp_obj->kpts = kpts;
+        kp_obj->threshold = threshold;
+        kp_obj->normalized = normalized;
+        return kp_obj;
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_keypoints_obj, 1, py_image_find_keypoints);
+#endif // IMLIB_ENABLE_FIND_KEYPOINTS
+
+#ifdef IMLIB_ENABLE_LK_TRACKER
+// LKTracker Object //
+// Passed to track_keypoints() to follow corners across frames with pyramidal Lucas-Kanade optical
+// flow, it keeps the points and the image pyramid of the previous frame.
+typedef struct py_lk_tracker_obj {
+    mp_obj_base_t base;
+    lk_tracker_t tracker;
+} py_lk_tracker_obj_t;
+
+static void py_lk_tracker_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_lk_tracker_obj_t *self = self_in;
+    mp_printf(print, "{\"max_points\":%d, \"levels\":%d, \"window\":%d, \"cell_size\":%d, \"points\":%d}",
+              self->tracker.points_max, self->tracker.levels, self->tracker.window, self->tracker.cell_size,
+              self->tracker.points_len);
+}
+
+mp_obj_t py_lk_tracker_reset(mp_obj_t self_in)
+{
+    imlib_lk_tracker_reset(&((py_lk_tracker_obj_t *) self_in)->tracker);
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_lk_tracker_reset_obj, py_lk_tracker_reset);
+
+STATIC const mp_rom_map_elem_t py_lk_tracker_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_lk_tracker_reset_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_lk_tracker_locals_dict, py_lk_tracker_locals_dict_table);
+
+static const mp_obj_type_t py_lk_tracker_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_LKTracker,
+    .print = py_lk_tracker_print,
+    .locals_dict = (mp_obj_t) &py_lk_tracker_locals_dict
+};
+
+mp_obj_t py_image_lk_tracker(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_max_points =
+        py_helper_keyword_int(n_args, args, 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_points), 128);
+    PY_ASSERT_TRUE_MSG((0 < arg_max_points) && (arg_max_points <= 1024), "Error: 0 < max_points <= 1024!");
+    int arg_levels =
+        py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_levels), 3);
+    PY_ASSERT_TRUE_MSG((0 < arg_levels) && (arg_levels <= LK_TRACKER_MAX_LEVELS), "Error: 0 < levels <= 4!");
+    int arg_window =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_window), 4);
+    PY_ASSERT_TRUE_MSG((0 < arg_window) && (arg_window <= LK_TRACKER_MAX_WINDOW), "Error: 0 < window <= 7!");
+    int arg_cell_size =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cell_size), 16);
+    PY_ASSERT_TRUE_MSG(arg_cell_size > 0, "cell_size must be greater than zero.");
+
+    py_lk_tracker_obj_t *obj = m_new_obj(py_lk_tracker_obj_t);
+    obj->base.type = &py_lk_tracker_type;
+    imlib_lk_tracker_alloc(&obj->tracker, arg_max_points, arg_levels, arg_window, arg_cell_size);
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_lk_tracker_obj, 0, py_image_lk_tracker);
+
+// Returns (x, y, dx, dy, id) for each point tracked from the previous frame, the corners added
+// to replace lost points are returned once they have been tracked.
+static mp_obj_t py_image_track_keypoints(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    PY_ASSERT_TRUE_MSG(MP_OBJ_IS_TYPE(args[1], &py_lk_tracker_type), "Expected an LKTracker!");
+    lk_tracker_t *tracker = &((py_lk_tracker_obj_t *) args[1])->tracker;
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
+
+    int threshold =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 20);
+    corner_detector_t corner_detector =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_corner_detector), CORNER_AGAST);
+    image_pyramid_t *pyr = py_image_pyramid_arg(arg_img, n_args, args, 5, kw_args);
+
+    fb_alloc_mark();
+    int tracked = imlib_lk_tracker_update(tracker, arg_img, pyr, &roi, threshold, corner_detector);
+    fb_alloc_free_till_mark();
+
+    mp_obj_t points_list = mp_obj_new_list(tracked, NULL);
+
+    for (int i = 0; i < tracked; i++) {
+        lk_point_t *point = &tracker->points[i];
+        ((mp_obj_list_t *) points_list)->items[i] = mp_obj_new_tuple(5, (mp_obj_t []) {mp_obj_new_float(point->x),
+                                                                                       mp_obj_new_float(point->y),
+                                                                                       mp_obj_new_float(point->dx),
+                                                                                       mp_obj_new_float(point->dy),
+                                                                                       mp_obj_new_int(point->id)});
+    }
+
+    return points_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_track_keypoints_obj, 2, py_image_track_keypoints);
+#endif // IMLIB_ENABLE_LK_TRACKER
+
+#ifdef IMLIB_ENABLE_OBJECT_TRACKER
+// ObjectTracker Object //
+// Gives stable ids to detections across frames, update() takes a list of blobs, apriltags, tf
+// classifications or (x, y, w, h[, code]) tuples.
+typedef struct py_object_tracker_obj {
+    mp_obj_base_t base;
+    object_tracker_t tracker;
+} py_object_tracker_obj_t;
+
+static void py_object_tracker_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_object_tracker_obj_t *self = self_in;
+    mp_printf(print, "{\"max_tracks\":%d, \"min_hits\":%d, \"max_misses\":%d, \"tracks\":%d}",
+              self->tracker.tracks_max, self->tracker.min_hits, self->tracker.max_misses, self->tracker.tracks_len);
+}
+
+// Blobs are matched by color code, apriltags by family and id and tuples by their 5th value.
+static int32_t py_object_tracker_code(mp_obj_t obj)
+{
+    if (MP_OBJ_IS_TYPE(obj, &py_blob_type)) {
+        return mp_obj_get_int(mp_obj_subscr(obj, MP_OBJ_NEW_SMALL_INT(8), MP_OBJ_SENTINEL));
+    }
+    #ifdef IMLIB_ENABLE_APRILTAGS
+    if (MP_OBJ_IS_TYPE(obj, &py_apriltag_type)) {
+        int id = mp_obj_get_int(mp_obj_subscr(obj, MP_OBJ_NEW_SMALL_INT(4), MP_OBJ_SENTINEL));
+        int family = mp_obj_get_int(mp_obj_subscr(obj, MP_OBJ_NEW_SMALL_INT(5), MP_OBJ_SENTINEL));
+        return (family << 16) | id;
+    }
+    #endif
+    if ((MP_OBJ_IS_TYPE(obj, &mp_type_tuple) || MP_OBJ_IS_TYPE(obj, &mp_type_list))
+    && (mp_obj_get_int(mp_obj_len(obj)) > 4)) {
+        return mp_obj_get_int(mp_obj_subscr(obj, MP_OBJ_NEW_SMALL_INT(4), MP_OBJ_SENTINEL));
+    }
+    return 0;
+}
+
+mp_obj_t py_object_tracker_update(mp_obj_t self_in, mp_obj_t detections_obj)
+{
+    object_tracker_t *tracker = &((py_object_tracker_obj_t *) self_in)->tracker;
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(detections_obj, &len, &items);
+    size_t n = IM_MIN(len, tracker->tracks_max);
+
+    fb_alloc_mark();
+    object_detection_t *detections = fb_alloc(IM_MAX(n, 1) * sizeof(object_detection_t), FB_ALLOC_NO_HINT);
+    uint32_t *ids = fb_alloc(IM_MAX(n, 1) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (size_t i = 0; i < n; i++) {
+        detections[i].rect.x = mp_obj_get_int(mp_obj_subscr(items[i], MP_OBJ_NEW_SMALL_INT(0), MP_OBJ_SENTINEL));
+        detections[i].rect.y = mp_obj_get_int(mp_obj_subscr(items[i], MP_OBJ_NEW_SMALL_INT(1), MP_OBJ_SENTINEL));
+        detections[i].rect.w = mp_obj_get_int(mp_obj_subscr(items[i], MP_OBJ_NEW_SMALL_INT(2), MP_OBJ_SENTINEL));
+        detections[i].rect.h = mp_obj_get_int(mp_obj_subscr(items[i], MP_OBJ_NEW_SMALL_INT(3), MP_OBJ_SENTINEL));
+        detections[i].code = py_object_tracker_code(items[i]);
+    }
+
+    imlib_object_tracker_update(tracker, detections, n, ids);
+
+    // Detections past max_tracks aren't tracked.
+    mp_obj_t ids_list = mp_obj_new_list(len, NULL);
+
+    for (size_t i = 0; i < len; i++) {
+        ((mp_obj_list_t *) ids_list)->items[i] = mp_obj_new_int((i < n) ? ids[i] : 0);
+    }
+
+    fb_alloc_free_till_mark();
+    return ids_list;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_object_tracker_update_obj, py_object_tracker_update);
+
+// Returns (x, y, w, h, vx, vy, id) of the confirmed tracks, including the ones not detected in
+// the last update (at their predicted position).
+mp_obj_t py_object_tracker_tracks(mp_obj_t self_in)
 {
-    image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    object_tracker_t *tracker = &((py_object_tracker_obj_t *) self_in)->tracker;
+    mp_obj_t tracks_list = mp_obj_new_list(0, NULL);
 
-    rectangle_t roi;
-    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+    for (size_t i = 0; i < tracker->tracks_len; i++) {
+        object_track_t *track = &tracker->tracks[i];
 
-    py_lbp_obj_t *lbp_obj = m_new_obj(py_lbp_obj_t);
-    lbp_obj->base.type = &py_lbp_type;
-    lbp_obj->hist = imlib_lbp_desc(arg_img, &roi);
-    return lbp_obj;
+        if (track->id) {
+            mp_obj_list_append(tracks_list, mp_obj_new_tuple(7, (mp_obj_t []) {
+                mp_obj_new_int(fast_roundf(track->x - (track->w / 2.0f))),
+                mp_obj_new_int(fast_roundf(track->y - (track->h / 2.0f))),
+                mp_obj_new_int(fast_roundf(track->w)),
+                mp_obj_new_int(fast_roundf(track->h)),
+                mp_obj_new_float(track->vx),
+                mp_obj_new_float(track->vy),
+                mp_obj_new_int(track->id)}));
+        }
+    }
+
+    return tracks_list;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_lbp_obj, 2, py_image_find_lbp);
-#endif // IMLIB_ENABLE_FIND_LBP
 
-#ifdef IMLIB_ENABLE_FIND_KEYPOINTS
-static mp_obj_t py_image_find_keypoints(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_object_tracker_tracks_obj, py_object_tracker_tracks);
+
+mp_obj_t py_object_tracker_reset(mp_obj_t self_in)
 {
-    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+    imlib_object_tracker_reset(&((py_object_tracker_obj_t *) self_in)->tracker);
+    return mp_const_none;
+}
 
-    rectangle_t roi;
-    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_object_tracker_reset_obj, py_object_tracker_reset);
 
-    int threshold =
-        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 20);
-    bool normalized =
-        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_normalized), false);
-    float scale_factor =
-        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale_factor), 1.5f);
-    int max_keypoints =
-        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_keypoints), 100);
-    corner_detector_t corner_detector =
-        py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_corner_detector), CORNER_AGAST);
+STATIC const mp_rom_map_elem_t py_object_tracker_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&py_object_tracker_update_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tracks), MP_ROM_PTR(&py_object_tracker_tracks_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_object_tracker_reset_obj) }
+};
 
-    #ifndef IMLIB_ENABLE_FAST
-    // Force AGAST when FAST is disabled.
-    corner_detector = CORNER_AGAST;
-    #endif
+STATIC MP_DEFINE_CONST_DICT(py_object_tracker_locals_dict, py_object_tracker_locals_dict_table);
 
-    // Find keypoints
-    fb_alloc_mark();
-    array_t *kpts = orb_find_keypoints(arg_img, normalized, threshold, scale_factor, max_keypoints, corner_detector, &roi);
-    fb_alloc_free_till_mark();
+static const mp_obj_type_t py_object_tracker_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ObjectTracker,
+    .print = py_object_tracker_print,
+    .locals_dict = (mp_obj_t) &py_object_tracker_locals_dict
+};
 
-    if (array_length(kpts)) {
-        py_kp_obj_t *kp_obj = m_new_obj(py_kp_obj_t);
-        kp_obj->base.type = &py_kp_type;
-        kp_obj->kpts = kpts;
-        kp_obj->threshold = threshold;
-        kp_obj->normalized = normalized;
-        return kp_obj;
-    }
-    return mp_const_none;
+mp_obj_t py_image_object_tracker(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int arg_max_tracks =
+        py_helper_keyword_int(n_args, args, 0, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_tracks), 32);
+    PY_ASSERT_TRUE_MSG((0 < arg_max_tracks) && (arg_max_tracks <= 256), "Error: 0 < max_tracks <= 256!");
+    int arg_min_hits =
+        py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_min_hits), 3);
+    PY_ASSERT_TRUE_MSG(arg_min_hits > 0, "min_hits must be greater than zero.");
+    int arg_max_misses =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_misses), 5);
+    PY_ASSERT_TRUE_MSG(arg_max_misses >= 0, "max_misses must not be negative.");
+    float arg_iou_threshold =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_iou_threshold), 0.3f);
+    PY_ASSERT_TRUE_MSG((0.0f < arg_iou_threshold) && (arg_iou_threshold <= 1.0f), "Error: 0 < iou_threshold <= 1!");
+    float arg_max_distance =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_distance), 32.0f);
+    PY_ASSERT_TRUE_MSG(arg_max_distance > 0.0f, "max_distance must be greater than zero.");
+
+    py_object_tracker_obj_t *obj = m_new_obj(py_object_tracker_obj_t);
+    obj->base.type = &py_object_tracker_type;
+    imlib_object_tracker_alloc(&obj->tracker, arg_max_tracks, arg_min_hits, arg_max_misses,
+                               arg_iou_threshold, arg_max_distance);
+    return obj;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_keypoints_obj, 1, py_image_find_keypoints);
-#endif // IMLIB_ENABLE_FIND_KEYPOINTS
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_object_tracker_obj, 0, py_image_object_tracker);
+#endif // IMLIB_ENABLE_OBJECT_TRACKER
 
 #ifdef IMLIB_ENABLE_BINARY_OPS
 static mp_obj_t py_image_find_edges(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
@@ -6426,6 +8874,96 @@ static mp_obj_t py_image_find_hog(uint n_args, const mp_obj_t *args, mp_map_t *k
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_hog_obj, 1, py_image_find_hog);
+
+static mp_obj_t py_image_get_hog_descriptor(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
+
+    int cell_size = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cell_size), 8);
+    PY_ASSERT_TRUE_MSG(cell_size > 0, "Cell size must be > 0!");
+    PY_ASSERT_TRUE_MSG((roi.w >= (cell_size * 2)) && (roi.h >= (cell_size * 2)),
+            "Region of interest must be at least 2x2 cells!");
+
+    fb_alloc_mark();
+    hog_cells_t cells;
+    imlib_hog_cells_init(&cells, arg_img, &roi, cell_size);
+
+    int len = imlib_hog_descriptor_len(&cells, cells.cells_w, cells.cells_h);
+    float *desc = fb_alloc(len * sizeof(float), FB_ALLOC_NO_HINT);
+    imlib_hog_descriptor(&cells, 0, 0, cells.cells_w, cells.cells_h, desc);
+
+    mp_obj_t desc_list = mp_obj_new_list(len, NULL);
+    for (int i = 0; i < len; i++) {
+        ((mp_obj_list_t *) desc_list)->items[i] = mp_obj_new_float(desc[i]);
+    }
+
+    fb_alloc_free_till_mark();
+    return desc_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_get_hog_descriptor_obj, 1, py_image_get_hog_descriptor);
+
+static mp_obj_t py_image_find_hog_objects(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    size_t weights_len;
+    mp_obj_t *weights_obj;
+    mp_obj_get_array(args[1], &weights_len, &weights_obj);
+
+    mp_obj_t *window_obj;
+    mp_obj_get_array_fixed_n(args[2], 2, &window_obj);
+
+    float threshold = py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0.0f);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 4, kw_args, &roi);
+
+    int cell_size = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_cell_size), 8);
+    PY_ASSERT_TRUE_MSG(cell_size > 0, "Cell size must be > 0!");
+    int stride = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_stride), 1);
+    PY_ASSERT_TRUE_MSG(stride > 0, "Stride must be > 0!");
+    float bias = py_helper_keyword_float(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bias), 0.0f);
+
+    // The window is in pixels, the detector works in cells.
+    int win_w = mp_obj_get_int(window_obj[0]) / cell_size;
+    int win_h = mp_obj_get_int(window_obj[1]) / cell_size;
+    PY_ASSERT_TRUE_MSG((win_w >= 2) && (win_h >= 2), "Window must be at least 2x2 cells!");
+    PY_ASSERT_TRUE_MSG(weights_len == ((win_w - 1) * (win_h - 1) * HOG_BLOCK_LEN),
+            "Weights length does not match the window descriptor length!");
+
+    list_t out;
+    fb_alloc_mark();
+    float *weights = fb_alloc(weights_len * sizeof(float), FB_ALLOC_NO_HINT);
+    for (size_t i = 0; i < weights_len; i++) {
+        weights[i] = mp_obj_get_float(weights_obj[i]);
+    }
+
+    hog_cells_t cells;
+    imlib_hog_cells_init(&cells, arg_img, &roi, cell_size);
+    imlib_find_hog_objects(&out, &cells, win_w, win_h, stride, weights, bias, threshold);
+    fb_alloc_free_till_mark();
+
+    mp_obj_t objects_list = mp_obj_new_list(0, NULL);
+    while (list_size(&out)) {
+        find_hog_objects_list_lnk_data_t lnk_data;
+        list_pop_front(&out, &lnk_data);
+
+        mp_obj_t rec_obj[5] = {
+            mp_obj_new_int(lnk_data.rect.x),
+            mp_obj_new_int(lnk_data.rect.y),
+            mp_obj_new_int(lnk_data.rect.w),
+            mp_obj_new_int(lnk_data.rect.h),
+            mp_obj_new_float(lnk_data.score),
+        };
+        mp_obj_list_append(objects_list, mp_obj_new_tuple(5, rec_obj));
+    }
+
+    return objects_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_hog_objects_obj, 3, py_image_find_hog_objects);
 #endif // IMLIB_ENABLE_HOG
 
 #ifdef IMLIB_ENABLE_SELECTIVE_SEARCH
@@ -6437,6 +8975,7 @@ static mp_obj_t py_image_selective_search(uint n_args, const mp_obj_t *args, mp_
     float a1 = py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a1), 1.0f);
     float a2 = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a1), 1.0f);
     float a3 = py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_a1), 1.0f);
+    py_helper_keyword_time_budget(n_args, args, 6, kw_args, 0);
     array_t *proposals_array = imlib_selective_search(img, t, s, a1, a2, a3);
 
     // Add proposals to a new Python list...
@@ -6464,9 +9003,15 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_height),              MP_ROM_PTR(&py_image_height_obj)},
     {MP_ROM_QSTR(MP_QSTR_format),              MP_ROM_PTR(&py_image_format_obj)},
     {MP_ROM_QSTR(MP_QSTR_size),                MP_ROM_PTR(&py_image_size_obj)},
+    {MP_ROM_QSTR(MP_QSTR_timestamp),           MP_ROM_PTR(&py_image_timestamp_obj)},
+    {MP_ROM_QSTR(MP_QSTR_frame_count),         MP_ROM_PTR(&py_image_frame_count_obj)},
     {MP_ROM_QSTR(MP_QSTR_bytearray),           MP_ROM_PTR(&py_image_bytearray_obj)},
     {MP_ROM_QSTR(MP_QSTR_get_pixel),           MP_ROM_PTR(&py_image_get_pixel_obj)},
     {MP_ROM_QSTR(MP_QSTR_set_pixel),           MP_ROM_PTR(&py_image_set_pixel_obj)},
+    {MP_ROM_QSTR(MP_QSTR_set_pixels),          MP_ROM_PTR(&py_image_set_pixels_obj)},
+    {MP_ROM_QSTR(MP_QSTR_get_row),             MP_ROM_PTR(&py_image_get_row_obj)},
+    {MP_ROM_QSTR(MP_QSTR_get_column),          MP_ROM_PTR(&py_image_get_column_obj)},
+    {MP_ROM_QSTR(MP_QSTR_view),                MP_ROM_PTR(&py_image_view_obj)},
 #ifdef IMLIB_ENABLE_MEAN_POOLING
     {MP_ROM_QSTR(MP_QSTR_mean_pool),           MP_ROM_PTR(&py_image_mean_pool_obj)},
     {MP_ROM_QSTR(MP_QSTR_mean_pooled),         MP_ROM_PTR(&py_image_mean_pooled_obj)},
@@ -6489,6 +9034,11 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_compress_for_ide),    MP_ROM_PTR(&py_image_compress_for_ide_obj)},
     {MP_ROM_QSTR(MP_QSTR_compressed),          MP_ROM_PTR(&py_image_compressed_obj)},
     {MP_ROM_QSTR(MP_QSTR_compressed_for_ide),  MP_ROM_PTR(&py_image_compressed_for_ide_obj)},
+#if (OMV_HARDWARE_JPEG == 1)
+    {MP_ROM_QSTR(MP_QSTR_decompressed),        MP_ROM_PTR(&py_image_decompressed_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_decompressed),        MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
     {MP_ROM_QSTR(MP_QSTR_jpeg_encode_for_ide), MP_ROM_PTR(&py_image_jpeg_encode_for_ide_obj)},
     {MP_ROM_QSTR(MP_QSTR_jpeg_encoded_for_ide),MP_ROM_PTR(&py_image_jpeg_encoded_for_ide_obj)},
     {MP_ROM_QSTR(MP_QSTR_copy),                MP_ROM_PTR(&py_image_copy_obj)},
@@ -6572,6 +9122,7 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_max),                 MP_ROM_PTR(&py_image_max_obj)},
     {MP_ROM_QSTR(MP_QSTR_difference),          MP_ROM_PTR(&py_image_difference_obj)},
     {MP_ROM_QSTR(MP_QSTR_blend),               MP_ROM_PTR(&py_image_blend_obj)},
+    {MP_ROM_QSTR(MP_QSTR_ops),                 MP_ROM_PTR(&py_image_ops_obj)},
 #else
     {MP_ROM_QSTR(MP_QSTR_top_hat),             MP_ROM_PTR(&py_func_unavailable_obj)},
     {MP_ROM_QSTR(MP_QSTR_black_hat),           MP_ROM_PTR(&py_func_unavailable_obj)},
@@ -6587,6 +9138,7 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_max),                 MP_ROM_PTR(&py_func_unavailable_obj)},
     {MP_ROM_QSTR(MP_QSTR_difference),          MP_ROM_PTR(&py_func_unavailable_obj)},
     {MP_ROM_QSTR(MP_QSTR_blend),               MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_ops),                 MP_ROM_PTR(&py_func_unavailable_obj)},
 #endif
     /* Filtering Methods */
     {MP_ROM_QSTR(MP_QSTR_histeq),              MP_ROM_PTR(&py_image_histeq_obj)},
@@ -6675,6 +9227,11 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_rotation_corr),       MP_ROM_PTR(&py_image_rotation_corr_obj)},
 #else
     {MP_ROM_QSTR(MP_QSTR_rotation_corr),       MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_REMAP
+    {MP_ROM_QSTR(MP_QSTR_remap),               MP_ROM_PTR(&py_image_remap_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_remap),               MP_ROM_PTR(&py_func_unavailable_obj)},
 #endif
     /* Get Methods */
 #ifdef IMLIB_ENABLE_GET_SIMILARITY
@@ -6688,6 +9245,8 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_get_stats),           MP_ROM_PTR(&py_image_get_statistics_obj)},
     {MP_ROM_QSTR(MP_QSTR_get_statistics),      MP_ROM_PTR(&py_image_get_statistics_obj)},
     {MP_ROM_QSTR(MP_QSTR_statistics),          MP_ROM_PTR(&py_image_get_statistics_obj)},
+    {MP_ROM_QSTR(MP_QSTR_get_statistics_list), MP_ROM_PTR(&py_image_get_statistics_list_obj)},
+    {MP_ROM_QSTR(MP_QSTR_integral),            MP_ROM_PTR(&py_image_integral_obj)},
     {MP_ROM_QSTR(MP_QSTR_get_regression),      MP_ROM_PTR(&py_image_get_regression_obj)},
     /* Find Methods */
     {MP_ROM_QSTR(MP_QSTR_find_blobs),          MP_ROM_PTR(&py_image_find_blobs_obj)},
@@ -6731,11 +9290,22 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
 #else
     {MP_ROM_QSTR(MP_QSTR_find_barcodes),       MP_ROM_PTR(&py_func_unavailable_obj)},
 #endif
+#if defined(IMLIB_ENABLE_QRCODES) || defined(IMLIB_ENABLE_DATAMATRICES) || \
+    defined(IMLIB_ENABLE_BARCODES) || defined(IMLIB_ENABLE_APRILTAGS)
+    {MP_ROM_QSTR(MP_QSTR_find_codes),          MP_ROM_PTR(&py_image_find_codes_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_find_codes),          MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
 #ifdef IMLIB_ENABLE_FIND_DISPLACEMENT
     {MP_ROM_QSTR(MP_QSTR_find_displacement),   MP_ROM_PTR(&py_image_find_displacement_obj)},
 #else
     {MP_ROM_QSTR(MP_QSTR_find_displacement),   MP_ROM_PTR(&py_func_unavailable_obj)},
 #endif
+#ifdef IMLIB_ENABLE_FIND_MOTION_VECTORS
+    {MP_ROM_QSTR(MP_QSTR_find_motion_vectors), MP_ROM_PTR(&py_image_find_motion_vectors_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_find_motion_vectors), MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
 #ifdef IMLIB_FIND_TEMPLATE
     {MP_ROM_QSTR(MP_QSTR_find_template),       MP_ROM_PTR(&py_image_find_template_obj)},
 #else
@@ -6753,6 +9323,11 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
 #else
     {MP_ROM_QSTR(MP_QSTR_find_keypoints),      MP_ROM_PTR(&py_func_unavailable_obj)},
 #endif
+#ifdef IMLIB_ENABLE_LK_TRACKER
+    {MP_ROM_QSTR(MP_QSTR_track_keypoints),     MP_ROM_PTR(&py_image_track_keypoints_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_track_keypoints),     MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
 #ifdef IMLIB_ENABLE_BINARY_OPS
     {MP_ROM_QSTR(MP_QSTR_find_edges),          MP_ROM_PTR(&py_image_find_edges_obj)},
 #else
@@ -6760,8 +9335,12 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
 #endif
 #ifdef IMLIB_ENABLE_HOG
     {MP_ROM_QSTR(MP_QSTR_find_hog),            MP_ROM_PTR(&py_image_find_hog_obj)},
+    {MP_ROM_QSTR(MP_QSTR_get_hog_descriptor),  MP_ROM_PTR(&py_image_get_hog_descriptor_obj)},
+    {MP_ROM_QSTR(MP_QSTR_find_hog_objects),    MP_ROM_PTR(&py_image_find_hog_objects_obj)},
 #else
     {MP_ROM_QSTR(MP_QSTR_find_hog),            MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_get_hog_descriptor),  MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_find_hog_objects),    MP_ROM_PTR(&py_func_unavailable_obj)},
 #endif
 #ifdef IMLIB_ENABLE_SELECTIVE_SEARCH
     {MP_ROM_QSTR(MP_QSTR_selective_search),    MP_ROM_PTR(&py_image_selective_search_obj)},
@@ -6783,61 +9362,122 @@ static const mp_obj_type_t py_image_type = {
     .locals_dict = (mp_obj_t) &locals_dict
 };
 
+// Image stream files start with "OMV IMG STR V1.0" followed by the frames, each is a header of the
+// elapsed ms, w, h and bpp followed by the image padded to a multiple of 16 bytes. V2.0 streams pad
+// the file header and the frames to whole sectors and end with an index of the frame offsets in
+// sectors and a trailer of "IDX ", the frame count, the index offset and "V2.0", for seeking.
+#define IMAGE_STREAM_HEADER_SIZE    (16)
+#define IMAGE_STREAM_V1_ALIGN       (16)
+#define IMAGE_STREAM_V2_ALIGN       (512)
+#define IMAGE_STREAM_INDEX_INIT     (64)
+
+static const uint8_t image_stream_zeros[IMAGE_STREAM_HEADER_SIZE] = {0};
+
 // ImageWriter Object //
 typedef struct py_imagewriter_obj {
     mp_obj_base_t base;
     FIL fp;
+    file_ring_t ring;
     uint32_t ms;
+    uint32_t align;
+    uint32_t *index; // Frame offsets in sectors (V2.0 only).
+    uint32_t frames, index_size;
 } py_imagewriter_obj_t;
 
+static void py_imagewriter_pad(py_imagewriter_obj_t *self)
+{
+    for (uint32_t pad = (self->align - (file_ring_tell(&self->ring) % self->align)) % self->align; pad; ) {
+        uint32_t size = IM_MIN(pad, sizeof(image_stream_zeros));
+        file_ring_write(&self->ring, image_stream_zeros, size);
+        pad -= size;
+    }
+}
+
 static void py_imagewriter_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
 {
     py_imagewriter_obj_t *self = self_in;
-    mp_printf(print, "{\"size\":%d}", f_size(&self->fp));
+    mp_printf(print, "{\"size\":%d}", file_ring_tell(&self->ring));
 }
 
 mp_obj_t py_imagewriter_size(mp_obj_t self_in)
 {
-    return mp_obj_new_int(f_size(&((py_imagewriter_obj_t *) self_in)->fp));
+    return mp_obj_new_int(file_ring_tell(&((py_imagewriter_obj_t *) self_in)->ring));
 }
 
 mp_obj_t py_imagewriter_add_frame(mp_obj_t self_in, mp_obj_t img_obj)
 {
     // Don't use the file buffer here...
+    // Frames are queued and written out between frames (see file_ring_poll).
 
-    FIL *fp = &((py_imagewriter_obj_t *) self_in)->fp;
+    py_imagewriter_obj_t *self = self_in;
+    file_ring_t *ring = &self->ring;
     PY_ASSERT_TYPE(img_obj, &py_image_type);
     image_t *arg_img = &((py_image_obj_t *) img_obj)->_cobj;
 
-    uint32_t ms = systick_current_millis(); // Write out elapsed ms.
-    write_long(fp, ms - ((py_imagewriter_obj_t *) self_in)->ms);
-    ((py_imagewriter_obj_t *) self_in)->ms = ms;
+    if (self->align == IMAGE_STREAM_V2_ALIGN) {
+        if (self->frames == self->index_size) {
+            self->index_size = IM_MAX(self->index_size * 2, IMAGE_STREAM_INDEX_INIT);
+            self->index = xrealloc(self->index, self->index_size * sizeof(uint32_t));
+        }
+
+        self->index[self->frames] = file_ring_tell(ring) / IMAGE_STREAM_V2_ALIGN;
+    }
+
+    self->frames += 1;
 
-    write_long(fp, arg_img->w);
-    write_long(fp, arg_img->h);
-    write_long(fp, arg_img->bpp);
+    uint32_t header[4];
+    uint32_t ms = systick_current_millis(); // Write out elapsed ms.
+    header[0] = ms - self->ms;
+    self->ms = ms;
 
-    uint32_t size = image_size(arg_img);
+    header[1] = arg_img->w;
+    header[2] = arg_img->h;
+    header[3] = arg_img->bpp;
+    file_ring_write(ring, header, sizeof(header));
 
-    write_data(fp, arg_img->data, size);
-    if (size % 16) write_data(fp, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16 - (size % 16)); // Pad to multiple of 16 bytes.
+    file_ring_write(ring, arg_img->data, image_size(arg_img));
+    py_imagewriter_pad(self); // Pad to multiple of 16 bytes (or sectors).
     return self_in;
 }
 
 mp_obj_t py_imagewriter_close(mp_obj_t self_in)
 {
-    file_close(&((py_imagewriter_obj_t *) self_in)->fp);
+    py_imagewriter_obj_t *self = self_in;
+
+    if (self->align == IMAGE_STREAM_V2_ALIGN) {
+        uint32_t trailer[4];
+        memcpy(&trailer[0], "IDX ", 4);
+        trailer[1] = self->frames;
+        trailer[2] = file_ring_tell(&self->ring);
+        memcpy(&trailer[3], "V2.0", 4);
+        file_ring_write(&self->ring, self->index, self->frames * sizeof(uint32_t));
+        file_ring_write(&self->ring, trailer, sizeof(trailer));
+        xfree(self->index);
+        self->index = NULL;
+    }
+
+    file_ring_close(&self->ring);
+    file_close(&self->fp);
     return self_in;
 }
 
+mp_obj_t py_imagewriter_del(mp_obj_t self_in)
+{
+    // Stop servicing the writer if it's collected without being closed.
+    file_ring_abort(&((py_imagewriter_obj_t *) self_in)->ring);
+    return mp_const_none;
+}
+
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagewriter_size_obj, py_imagewriter_size);
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_imagewriter_add_frame_obj, py_imagewriter_add_frame);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagewriter_close_obj, py_imagewriter_close);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagewriter_del_obj, py_imagewriter_del);
 
 STATIC const mp_rom_map_elem_t py_imagewriter_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_size), MP_ROM_PTR(&py_imagewriter_size_obj) },
     { MP_ROM_QSTR(MP_QSTR_add_frame), MP_ROM_PTR(&py_imagewriter_add_frame_obj) },
-    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&py_imagewriter_close_obj) }
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&py_imagewriter_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&py_imagewriter_del_obj) }
 };
 
 STATIC MP_DEFINE_CONST_DICT(py_imagewriter_locals_dict, py_imagewriter_locals_dict_table);
@@ -6849,27 +9489,43 @@ static const mp_obj_type_t py_imagewriter_type = {
     .locals_dict = (mp_obj_t) &py_imagewriter_locals_dict
 };
 
-mp_obj_t py_image_imagewriter(mp_obj_t path)
+mp_obj_t py_image_imagewriter(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    py_imagewriter_obj_t *obj = m_new_obj(py_imagewriter_obj_t);
-    obj->base.type = &py_imagewriter_type;
-    file_write_open(&obj->fp, mp_obj_str_get_str(path));
+    int buf_size = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_buffer_size), FILE_RING_CHUNK_SIZE * 2);
+    PY_ASSERT_TRUE_MSG(buf_size > 0, "Buffer size must be > 0");
+    bool index = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_index), false);
 
-    write_long(&obj->fp, *((uint32_t *) "OMV ")); // OpenMV
-    write_long(&obj->fp, *((uint32_t *) "IMG ")); // Image
-    write_long(&obj->fp, *((uint32_t *) "STR ")); // Stream
-    write_long(&obj->fp, *((uint32_t *) "V1.0")); // v1.0
+    py_imagewriter_obj_t *obj = m_new_obj_with_finaliser(py_imagewriter_obj_t);
+    obj->base.type = &py_imagewriter_type;
+    obj->align = index ? IMAGE_STREAM_V2_ALIGN : IMAGE_STREAM_V1_ALIGN;
+    obj->index = NULL;
+    obj->frames = 0;
+    obj->index_size = 0;
+    file_write_open(&obj->fp, mp_obj_str_get_str(args[0]));
+    file_ring_open(&obj->ring, &obj->fp, buf_size);
+
+    file_ring_write(&obj->ring, "OMV ", 4); // OpenMV
+    file_ring_write(&obj->ring, "IMG ", 4); // Image
+    file_ring_write(&obj->ring, "STR ", 4); // Stream
+    file_ring_write(&obj->ring, index ? "V2.0" : "V1.0", 4); // v1.0 or v2.0
+    py_imagewriter_pad(obj);
 
     obj->ms = systick_current_millis();
     return obj;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_imagewriter_obj, py_image_imagewriter);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_imagewriter_obj, 1, py_image_imagewriter);
 
 // ImageReader Object //
 typedef struct py_imagereader_obj {
     mp_obj_base_t base;
     FIL fp;
+    file_ring_t ring;
     uint32_t ms;
+    uint32_t align;
+    uint32_t start, end; // Offsets of the first frame and past the last one.
+    uint32_t *index; // Frame offsets in sectors, NULL if the stream isn't indexed.
+    uint32_t frames, frame;
+    bool real_time;
 } py_imagereader_obj_t;
 
 static void py_imagereader_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
@@ -6886,7 +9542,9 @@ mp_obj_t py_imagereader_size(mp_obj_t self_in)
 mp_obj_t py_imagereader_next_frame(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     // Don't use the file buffer here...
+    // The next frames are read ahead into the ring while waiting (see file_ring_poll).
 
+    py_imagereader_obj_t *self = args[0];
     mp_obj_t copy_to_fb_obj = py_helper_keyword_object(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy_to_fb));
     bool copy_to_fb = true;
     image_t *arg_other = NULL;
@@ -6903,37 +9561,40 @@ mp_obj_t py_imagereader_next_frame(uint n_args, const mp_obj_t *args, mp_map_t *
         fb_update_jpeg_buffer();
     }
 
-    FIL *fp = &((py_imagereader_obj_t *) args[0])->fp;
+    file_ring_t *ring = &self->ring;
 
-    if (f_eof(fp)) {
+    if (file_ring_tell(ring) >= self->end) {
         if (!py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_loop), true)) {
             return mp_const_none;
         }
 
-        file_seek(fp, 16); // skip past the header
+        file_ring_seek(ring, self->start); // skip past the header
+        self->frame = 0;
 
-        if (f_eof(fp)) { // empty file
+        if (self->start >= self->end) { // empty file
             return mp_const_none;
         }
     }
 
-    uint32_t ms_tmp;
-    read_long(fp, &ms_tmp);
+    uint32_t header[4];
+    file_ring_read(ring, header, sizeof(header));
 
-    uint32_t ms; // Wait for elapsed ms.
-    for (ms = systick_current_millis();
-         ((ms - ((py_imagewriter_obj_t *) args[0])->ms) < ms_tmp);
-         ms = systick_current_millis()) {
-        __WFI();
+    uint32_t ms = systick_current_millis(); // Wait for elapsed ms.
+    if (self->real_time) {
+        for (; ((ms - self->ms) < header[0]); ms = systick_current_millis()) {
+            if (!file_ring_poll()) {
+                __WFI();
+            }
+        }
     }
 
-    ((py_imagewriter_obj_t *) args[0])->ms = ms;
+    self->ms = ms;
+    self->frame += 1;
 
     image_t image = {0};
-
-    read_long(fp, (uint32_t *) &image.w);
-    read_long(fp, (uint32_t *) &image.h);
-    read_long(fp, (uint32_t *) &image.bpp);
+    image.w = header[1];
+    image.h = header[2];
+    image.bpp = header[3];
 
     uint32_t size = image_size(&image);
 
@@ -6945,19 +9606,19 @@ mp_obj_t py_imagereader_next_frame(uint n_args, const mp_obj_t *args, mp_map_t *
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
-        image.data = MAIN_FB()->pixels;
+        image.data = MAIN_FB_BUFFER();
     } else if (arg_other) {
         PY_ASSERT_TRUE_MSG((size <= image_size(arg_other)), "The new image won't fit in the target frame buffer!");
         image.data = arg_other->data;
     } else {
-        image.data = xalloc(size);
+        image.data = xalloc_data(size);
     }
 
-    char ignore[15];
-    read_data(fp, image.data, size);
-    if (size % 16) read_data(fp, ignore, 16 - (size % 16)); // Read in to multiple of 16 bytes.
+    file_ring_read(ring, image.data, size);
+    // Read in to multiple of 16 bytes (or sectors).
+    file_ring_skip(ring, (self->align - ((IMAGE_STREAM_HEADER_SIZE + size) % self->align)) % self->align);
 
-    if (MAIN_FB()->pixels == image.data) {
+    if (MAIN_FB_BUFFER() == image.data) {
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
@@ -6972,20 +9633,63 @@ mp_obj_t py_imagereader_next_frame(uint n_args, const mp_obj_t *args, mp_map_t *
     return py_image_from_struct(&image);
 }
 
+mp_obj_t py_imagereader_count(mp_obj_t self_in)
+{
+    py_imagereader_obj_t *self = self_in;
+    PY_ASSERT_TRUE_MSG(self->index, "The stream isn't indexed!");
+    return mp_obj_new_int(self->frames);
+}
+
+mp_obj_t py_imagereader_tell(mp_obj_t self_in)
+{
+    return mp_obj_new_int(((py_imagereader_obj_t *) self_in)->frame);
+}
+
+mp_obj_t py_imagereader_seek(mp_obj_t self_in, mp_obj_t frame_obj)
+{
+    py_imagereader_obj_t *self = self_in;
+    PY_ASSERT_TRUE_MSG(self->index, "The stream isn't indexed!");
+    int frame = mp_obj_get_int(frame_obj);
+    PY_ASSERT_TRUE_MSG((0 <= frame) && (frame < self->frames), "Frame out of range!");
+    file_ring_seek(&self->ring, self->index[frame] * IMAGE_STREAM_V2_ALIGN);
+    self->frame = frame;
+    self->ms = systick_current_millis();
+    return self_in;
+}
+
 mp_obj_t py_imagereader_close(mp_obj_t self_in)
 {
-    file_close(&((py_imagereader_obj_t *) self_in)->fp);
+    py_imagereader_obj_t *self = self_in;
+    file_ring_close(&self->ring);
+    file_close(&self->fp);
+    xfree(self->index);
+    self->index = NULL;
     return self_in;
 }
 
+mp_obj_t py_imagereader_del(mp_obj_t self_in)
+{
+    // Stop servicing the reader if it's collected without being closed.
+    file_ring_abort(&((py_imagereader_obj_t *) self_in)->ring);
+    return mp_const_none;
+}
+
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagereader_size_obj, py_imagereader_size);
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_imagereader_next_frame_obj, 1, py_imagereader_next_frame);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagereader_count_obj, py_imagereader_count);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagereader_tell_obj, py_imagereader_tell);
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_imagereader_seek_obj, py_imagereader_seek);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagereader_close_obj, py_imagereader_close);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagereader_del_obj, py_imagereader_del);
 
 STATIC const mp_rom_map_elem_t py_imagereader_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_size), MP_ROM_PTR(&py_imagereader_size_obj) },
     { MP_ROM_QSTR(MP_QSTR_next_frame), MP_ROM_PTR(&py_imagereader_next_frame_obj) },
-    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&py_imagereader_close_obj) }
+    { MP_ROM_QSTR(MP_QSTR_count), MP_ROM_PTR(&py_imagereader_count_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tell), MP_ROM_PTR(&py_imagereader_tell_obj) },
+    { MP_ROM_QSTR(MP_QSTR_seek), MP_ROM_PTR(&py_imagereader_seek_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&py_imagereader_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&py_imagereader_del_obj) }
 };
 
 STATIC MP_DEFINE_CONST_DICT(py_imagereader_locals_dict, py_imagereader_locals_dict_table);
@@ -6997,21 +9701,268 @@ static const mp_obj_type_t py_imagereader_type = {
     .locals_dict = (mp_obj_t) &py_imagereader_locals_dict
 };
 
-mp_obj_t py_image_imagereader(mp_obj_t path)
+mp_obj_t py_image_imagereader(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    py_imagereader_obj_t *obj = m_new_obj(py_imagereader_obj_t);
+    int buf_size = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_buffer_size), FILE_RING_CHUNK_SIZE * 2);
+    PY_ASSERT_TRUE_MSG(buf_size > 0, "Buffer size must be > 0");
+
+    py_imagereader_obj_t *obj = m_new_obj_with_finaliser(py_imagereader_obj_t);
     obj->base.type = &py_imagereader_type;
-    file_read_open(&obj->fp, mp_obj_str_get_str(path));
+    obj->real_time = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_real_time), true);
+    obj->index = NULL;
+    obj->frames = 0;
+    obj->frame = 0;
+    file_read_open(&obj->fp, mp_obj_str_get_str(args[0]));
+    file_fast_seek_on(&obj->fp);
 
     read_long_expect(&obj->fp, *((uint32_t *) "OMV ")); // OpenMV
     read_long_expect(&obj->fp, *((uint32_t *) "IMG ")); // Image
     read_long_expect(&obj->fp, *((uint32_t *) "STR ")); // Stream
-    read_long_expect(&obj->fp, *((uint32_t *) "V1.0")); // v1.0
+
+    uint32_t version;
+    read_long(&obj->fp, &version);
+    obj->end = f_size(&obj->fp);
+
+    if (version == *((uint32_t *) "V1.0")) { // v1.0
+        obj->align = IMAGE_STREAM_V1_ALIGN;
+        obj->start = IMAGE_STREAM_HEADER_SIZE;
+    } else if (version == *((uint32_t *) "V2.0")) { // v2.0
+        obj->align = IMAGE_STREAM_V2_ALIGN;
+        obj->start = IMAGE_STREAM_V2_ALIGN;
+
+        // Streams that weren't closed have no index, they're still read in order.
+        uint32_t trailer[4];
+        if (obj->end >= (obj->start + sizeof(trailer))) {
+            file_seek(&obj->fp, obj->end - sizeof(trailer));
+            read_data(&obj->fp, trailer, sizeof(trailer));
+
+            if ((trailer[0] == *((uint32_t *) "IDX ")) && (trailer[3] == *((uint32_t *) "V2.0"))
+                    && (trailer[2] >= obj->start)
+                    && ((trailer[2] + (trailer[1] * sizeof(uint32_t)) + sizeof(trailer)) == obj->end)) {
+                obj->frames = trailer[1];
+                obj->end = trailer[2];
+                obj->index = xalloc(IM_MAX(obj->frames, 1) * sizeof(uint32_t));
+                file_seek(&obj->fp, obj->end);
+                read_data(&obj->fp, obj->index, obj->frames * sizeof(uint32_t));
+            }
+        }
+    } else {
+        ff_file_corrupted(&obj->fp);
+    }
+
+    file_seek(&obj->fp, obj->start);
+    file_ring_open_read(&obj->ring, &obj->fp, buf_size);
 
     obj->ms = systick_current_millis();
     return obj;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_imagereader_obj, py_image_imagereader);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_imagereader_obj, 1, py_image_imagereader);
+
+mp_obj_t py_image_result_array()
+{
+    py_result_array_obj_t *obj = m_new_obj(py_result_array_obj_t);
+    obj->base.type = &py_result_array_type;
+    obj->make = NULL;
+    obj->clear = NULL;
+    obj->len = 0;
+    obj->size = 0;
+    obj->data_len = 0;
+    obj->data = NULL;
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_image_result_array_obj, py_image_result_array);
+
+// ImagePool Object //
+// A fixed set of image buffers allocated once and handed out round robin, to be passed as the
+// destination (copy=/copy_to_fb=) of copy(), crop(), mean_pooled() and to_grayscale().
+typedef struct py_imagepool_obj {
+    mp_obj_base_t base;
+    int w, h, bpp;
+    size_t len, next;
+    mp_obj_t *images;
+} py_imagepool_obj_t;
+
+static void py_imagepool_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_imagepool_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"bpp\":%d, \"size\":%d}",
+              self->w, self->h, self->bpp, self->len);
+}
+
+static mp_obj_t py_imagepool_unary_op(mp_unary_op_t op, mp_obj_t self_in)
+{
+    py_imagepool_obj_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_LEN: return mp_obj_new_int(self->len);
+        default: return MP_OBJ_NULL; // op not supported
+    }
+}
+
+mp_obj_t py_imagepool_get(mp_obj_t self_in)
+{
+    py_imagepool_obj_t *self = self_in;
+    mp_obj_t image = self->images[self->next];
+    image_t *img = py_image_cobj(image);
+    self->next = (self->next + 1) % self->len;
+
+    // Undo any resize done by the last user of this buffer.
+    img->w = self->w;
+    img->h = self->h;
+    img->bpp = self->bpp;
+    return image;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imagepool_get_obj, py_imagepool_get);
+
+STATIC const mp_rom_map_elem_t py_imagepool_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&py_imagepool_get_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_imagepool_locals_dict, py_imagepool_locals_dict_table);
+
+static const mp_obj_type_t py_imagepool_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ImagePool,
+    .print = py_imagepool_print,
+    .unary_op = py_imagepool_unary_op,
+    .locals_dict = (mp_obj_t) &py_imagepool_locals_dict
+};
+
+mp_obj_t py_image_imagepool(uint n_args, const mp_obj_t *args)
+{
+    int w = mp_obj_get_int(args[0]);
+    PY_ASSERT_TRUE_MSG(w > 0, "Width must be > 0");
+    int h = mp_obj_get_int(args[1]);
+    PY_ASSERT_TRUE_MSG(h > 0, "Height must be > 0");
+    int n = (n_args > 3) ? mp_obj_get_int(args[3]) : 2;
+    PY_ASSERT_TRUE_MSG(n > 0, "Size must be > 0");
+
+    image_t image = {0};
+    image.w = w;
+    image.h = h;
+
+    switch(mp_obj_get_int(args[2])) {
+        case PIXFORMAT_BINARY:
+            image.bpp = IMAGE_BPP_BINARY;
+            break;
+        case PIXFORMAT_GRAYSCALE:
+            image.bpp = IMAGE_BPP_GRAYSCALE;
+            break;
+        case PIXFORMAT_RGB565:
+            image.bpp = IMAGE_BPP_RGB565;
+            break;
+        default:
+            PY_ASSERT_TRUE_MSG(false, "Unsupported type");
+            break;
+    }
+
+    py_imagepool_obj_t *obj = m_new_obj(py_imagepool_obj_t);
+    obj->base.type = &py_imagepool_type;
+    obj->w = image.w;
+    obj->h = image.h;
+    obj->bpp = image.bpp;
+    obj->len = n;
+    obj->next = 0;
+    obj->images = m_new(mp_obj_t, n);
+
+    for (int i = 0; i < n; i++) {
+        image.data = xalloc0_data(image_size(&image));
+        obj->images[i] = py_image_from_struct(&image);
+    }
+
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_image_imagepool_obj, 3, 4, py_image_imagepool);
+
+#ifdef IMLIB_ENABLE_BACKGROUND_MODEL
+// BackgroundModel Object //
+// Keeps a per pixel background and returns the foreground of every frame passed to update() as
+// a bitmap, which is reused by the next update().
+typedef struct py_background_model_obj {
+    mp_obj_base_t base;
+    background_model_t model;
+    float alpha, threshold;
+    mp_obj_t mask;
+} py_background_model_obj_t;
+
+static void py_background_model_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_background_model_obj_t *self = self_in;
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"gaussian\":%d, \"alpha\":%f, \"threshold\":%f}",
+              self->model.w, self->model.h, self->model.gaussian,
+              (double) self->alpha, (double) self->threshold);
+}
+
+mp_obj_t py_background_model_update(mp_obj_t self_in, mp_obj_t img_obj)
+{
+    py_background_model_obj_t *self = self_in;
+    image_t *arg_img = py_helper_arg_to_image_mutable(img_obj);
+    PY_ASSERT_TRUE_MSG((arg_img->w == self->model.w) && (arg_img->h == self->model.h),
+                       "Image size doesn't match the model!");
+
+    fb_alloc_mark();
+    imlib_background_model_update(&self->model, arg_img, py_image_cobj(self->mask), self->alpha, self->threshold);
+    fb_alloc_free_till_mark();
+
+    return self->mask;
+}
+
+mp_obj_t py_background_model_reset(mp_obj_t self_in)
+{
+    imlib_background_model_reset(&((py_background_model_obj_t *) self_in)->model);
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_background_model_update_obj, py_background_model_update);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_background_model_reset_obj, py_background_model_reset);
+
+STATIC const mp_rom_map_elem_t py_background_model_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&py_background_model_update_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&py_background_model_reset_obj) }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_background_model_locals_dict, py_background_model_locals_dict_table);
+
+static const mp_obj_type_t py_background_model_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_BackgroundModel,
+    .print = py_background_model_print,
+    .locals_dict = (mp_obj_t) &py_background_model_locals_dict
+};
+
+mp_obj_t py_image_background_model(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    int w = mp_obj_get_int(args[0]);
+    PY_ASSERT_TRUE_MSG(w > 0, "Width must be > 0");
+    int h = mp_obj_get_int(args[1]);
+    PY_ASSERT_TRUE_MSG(h > 0, "Height must be > 0");
+    bool arg_gaussian =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_gaussian), false);
+    float arg_alpha =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_alpha), 0.05f);
+    PY_ASSERT_TRUE_MSG((0 < arg_alpha) && (arg_alpha <= 1), "Error: 0 < alpha <= 1!");
+    // Standard deviations for the gaussian model, gray levels otherwise.
+    float arg_threshold =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), arg_gaussian ? 2.5f : 20.0f);
+    PY_ASSERT_TRUE_MSG(arg_threshold >= 0, "Threshold must be >= 0");
+
+    py_background_model_obj_t *obj = m_new_obj(py_background_model_obj_t);
+    obj->base.type = &py_background_model_type;
+    obj->alpha = arg_alpha;
+    obj->threshold = arg_threshold;
+    imlib_background_model_alloc(&obj->model, w, h, arg_gaussian);
+
+    image_t mask = {0};
+    mask.w = w;
+    mask.h = h;
+    mask.bpp = IMAGE_BPP_BINARY;
+    mask.data = xalloc0_data(image_size(&mask));
+    obj->mask = py_image_from_struct(&mask);
+
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_background_model_obj, 2, py_image_background_model);
+#endif // IMLIB_ENABLE_BACKGROUND_MODEL
 
 mp_obj_t py_image_binary_to_grayscale(mp_obj_t arg)
 {
@@ -7339,12 +10290,12 @@ mp_obj_t py_image_load_image(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
-        image.data = MAIN_FB()->pixels;
+        image.data = MAIN_FB_BUFFER();
     } else if (arg_other) {
         PY_ASSERT_TRUE_MSG((image_size(&image) <= image_size(arg_other)), "The new image won't fit in the target frame buffer!");
         image.data = arg_other->data;
     } else if (mode) {
-        image.data = xalloc(image_size(&image));
+        image.data = xalloc_data(image_size(&image));
     }
 
     if (mode) {
@@ -7354,7 +10305,7 @@ mp_obj_t py_image_load_image(uint n_args, const mp_obj_t *args, mp_map_t *kw_arg
         fb_alloc_free_till_mark();
     }
 
-    if (MAIN_FB()->pixels == image.data) {
+    if (MAIN_FB_BUFFER() == image.data) {
         MAIN_FB()->w = image.w;
         MAIN_FB()->h = image.h;
         MAIN_FB()->bpp = image.bpp;
@@ -7396,6 +10347,13 @@ mp_obj_t py_image_load_cascade(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_load_cascade_obj, 1, py_image_load_cascade);
 
+static mp_obj_t py_image_truncated()
+{
+    // True if the last detector ran out of its time_budget_us and returned what it found so far.
+    return mp_obj_new_bool(imlib_deadline_truncated());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_image_truncated_obj, py_image_truncated);
+
 #ifdef IMLIB_ENABLE_DESCRIPTOR
 mp_obj_t py_image_load_descriptor(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
@@ -7535,6 +10493,7 @@ static mp_obj_t py_image_match_descriptor(uint n_args, const mp_obj_t *args, mp_
         py_kp_obj_t *kpts2 = ((py_kp_obj_t*)args[1]);
         int threshold = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 85);
         int filter_outliers = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_filter_outliers), false);
+        int radius = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_radius), 0);
 
         // Sanity checks
         PY_ASSERT_TYPE(kpts1, &py_kp_type);
@@ -7553,7 +10512,7 @@ static mp_obj_t py_image_match_descriptor(uint n_args, const mp_obj_t *args, mp_
             int *match = fb_alloc(array_length(kpts1->kpts) * sizeof(int) * 2, FB_ALLOC_NO_HINT);
 
             // Match the two keypoint sets
-            count = orb_match_keypoints(kpts1->kpts, kpts2->kpts, match, threshold, &r, &c, &theta);
+            count = orb_match_keypoints(kpts1->kpts, kpts2->kpts, match, threshold, radius, &r, &c, &theta);
 
             // Add matching keypoints to Python list.
             for (int i=0; i<count*2; i+=2) {
@@ -7599,7 +10558,8 @@ int py_image_descriptor_from_roi(image_t *img, const char *path, rectangle_t *ro
     FRESULT res = FR_OK;
 
     printf("Save Descriptor: ROI(%d %d %d %d)\n", roi->x, roi->y, roi->w, roi->h);
-    array_t *kpts = orb_find_keypoints(img, false, 20, 1.5f, 100, CORNER_AGAST, roi);
+    imlib_deadline_init(0);
+    array_t *kpts = orb_find_keypoints(img, NULL, false, 20, 1.5f, 100, CORNER_AGAST, roi, 0, 0);
     printf("Save Descriptor: KPTS(%d)\n", array_length(kpts));
 
     if (array_length(kpts)) {
@@ -7620,6 +10580,7 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
 #ifdef IMLIB_FIND_TEMPLATE
     {MP_ROM_QSTR(MP_QSTR_SEARCH_EX),           MP_ROM_INT(SEARCH_EX)},
     {MP_ROM_QSTR(MP_QSTR_SEARCH_DS),           MP_ROM_INT(SEARCH_DS)},
+    {MP_ROM_QSTR(MP_QSTR_SEARCH_PYR),          MP_ROM_INT(SEARCH_PYR)},
 #endif
     {MP_ROM_QSTR(MP_QSTR_EDGE_CANNY),          MP_ROM_INT(EDGE_CANNY)},
     {MP_ROM_QSTR(MP_QSTR_EDGE_SIMPLE),         MP_ROM_INT(EDGE_SIMPLE)},
@@ -7653,9 +10614,65 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_CODE128),             MP_ROM_INT(BARCODE_CODE128)},
 #endif
     {MP_ROM_QSTR(MP_QSTR_IMAGE_HINT_BILINEAR),MP_ROM_INT(IMAGE_HINT_BILINEAR)},
+    {MP_ROM_QSTR(MP_QSTR_IMAGE_HINT_AREA),     MP_ROM_INT(IMAGE_HINT_AREA)},
     {MP_ROM_QSTR(MP_QSTR_IMAGE_HINT_CENTER),        MP_ROM_INT(IMAGE_HINT_CENTER)},
     {MP_ROM_QSTR(MP_QSTR_ImageWriter),         MP_ROM_PTR(&py_image_imagewriter_obj)},
     {MP_ROM_QSTR(MP_QSTR_ImageReader),         MP_ROM_PTR(&py_image_imagereader_obj)},
+    {MP_ROM_QSTR(MP_QSTR_ResultArray),         MP_ROM_PTR(&py_image_result_array_obj)},
+    {MP_ROM_QSTR(MP_QSTR_ImagePool),           MP_ROM_PTR(&py_image_imagepool_obj)},
+    {MP_ROM_QSTR(MP_QSTR_ImagePyramid),        MP_ROM_PTR(&py_image_image_pyramid_obj)},
+    {MP_ROM_QSTR(MP_QSTR_BlobTracker),         MP_ROM_PTR(&py_image_blob_tracker_obj)},
+#ifdef IMLIB_ENABLE_LK_TRACKER
+    {MP_ROM_QSTR(MP_QSTR_LKTracker),           MP_ROM_PTR(&py_image_lk_tracker_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_LKTracker),           MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_OBJECT_TRACKER
+    {MP_ROM_QSTR(MP_QSTR_ObjectTracker),       MP_ROM_PTR(&py_image_object_tracker_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_ObjectTracker),       MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_COMPRESSED_IMAGES
+    {MP_ROM_QSTR(MP_QSTR_CompressedImage),     MP_ROM_PTR(&py_image_compressed_image_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_CompressedImage),     MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_APRILTAGS
+    {MP_ROM_QSTR(MP_QSTR_AprilTagTracker),     MP_ROM_PTR(&py_image_apriltag_tracker_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_AprilTagTracker),     MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#if defined(IMLIB_ENABLE_FIND_LINES) || defined(IMLIB_ENABLE_FIND_CIRCLES)
+    {MP_ROM_QSTR(MP_QSTR_GradientMap),         MP_ROM_PTR(&py_image_gradient_map_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_GradientMap),         MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_FIND_LBP
+    {MP_ROM_QSTR(MP_QSTR_LBPMap),              MP_ROM_PTR(&py_image_lbp_map_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_LBPMap),              MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_FIND_DISPLACEMENT
+    {MP_ROM_QSTR(MP_QSTR_DisplacementTemplate), MP_ROM_PTR(&py_image_displacement_template_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_DisplacementTemplate), MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_FIND_TEMPLATE
+    {MP_ROM_QSTR(MP_QSTR_TemplatePyramid),     MP_ROM_PTR(&py_image_template_pyramid_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_TemplatePyramid),     MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_BACKGROUND_MODEL
+    {MP_ROM_QSTR(MP_QSTR_BackgroundModel),     MP_ROM_PTR(&py_image_background_model_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_BackgroundModel),     MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+#ifdef IMLIB_ENABLE_REMAP
+    {MP_ROM_QSTR(MP_QSTR_Remap),               MP_ROM_PTR(&py_image_remap_new_obj)},
+#else
+    {MP_ROM_QSTR(MP_QSTR_Remap),               MP_ROM_PTR(&py_func_unavailable_obj)},
+#endif
+    {MP_ROM_QSTR(MP_QSTR_Pipeline),            MP_ROM_PTR(&py_image_pipeline_new_obj)},
     {MP_ROM_QSTR(MP_QSTR_binary_to_grayscale), MP_ROM_PTR(&py_image_binary_to_grayscale_obj)},
     {MP_ROM_QSTR(MP_QSTR_binary_to_rgb),       MP_ROM_PTR(&py_image_binary_to_rgb_obj)},
     {MP_ROM_QSTR(MP_QSTR_binary_to_lab),       MP_ROM_PTR(&py_image_binary_to_lab_obj)},
@@ -7678,6 +10695,7 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_yuv_to_lab),          MP_ROM_PTR(&py_image_yuv_to_lab_obj)},
     {MP_ROM_QSTR(MP_QSTR_Image),               MP_ROM_PTR(&py_image_load_image_obj)},
     {MP_ROM_QSTR(MP_QSTR_HaarCascade),         MP_ROM_PTR(&py_image_load_cascade_obj)},
+    {MP_ROM_QSTR(MP_QSTR_truncated),           MP_ROM_PTR(&py_image_truncated_obj)},
 #ifdef IMLIB_ENABLE_DESCRIPTOR
     {MP_ROM_QSTR(MP_QSTR_load_descriptor),     MP_ROM_PTR(&py_image_load_descriptor_obj)},
     {MP_ROM_QSTR(MP_QSTR_save_descriptor),     MP_ROM_PTR(&py_image_save_descriptor_obj)},
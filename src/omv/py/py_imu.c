@@ -9,6 +9,7 @@
  * IMU Python module.
  */
 #include STM32_HAL_H
+#include "py/mphal.h"
 #include "lsm6ds3tr_c_reg.h"
 #include "omv_boardconfig.h"
 #include "py_helper.h"
@@ -26,6 +27,25 @@ typedef union {
   uint8_t u8bit[2];
 } axis1bit16_t;
 
+// FIFO samples, the gyro and accel are batched at the same rate so the FIFO pattern is 6 words.
+#define IMU_FIFO_PATTERN_WORDS  (6)
+#define IMU_FIFO_READ_SAMPLES   (32)    // Samples read per SPI burst.
+#define IMU_FIFO_SIZE           (512)   // Samples buffered (~1.2s at 416Hz).
+
+typedef struct imu_sample {
+    uint32_t ts;        // Sample time in microseconds, same clock as the frame timestamps.
+    int16_t gy[3];
+    int16_t xl[3];
+} imu_sample_t;
+
+// The FIFO rates (same codes as the gyro and accel data rates).
+STATIC const float imu_fifo_rates[] = {12.5f, 26.0f, 52.0f, 104.0f, 208.0f, 416.0f, 833.0f, 1660.0f, 3330.0f, 6660.0f};
+
+STATIC imu_sample_t imu_fifo[IMU_FIFO_SIZE];
+STATIC size_t imu_fifo_head = 0, imu_fifo_len = 0;
+STATIC int imu_fifo_odr = 0;            // FIFO rate code, 0 when the FIFO is disabled.
+STATIC uint32_t imu_fifo_period = 0;    // Sample period in microseconds.
+
 STATIC int32_t platform_write(void *handle, uint8_t Reg, uint8_t *Bufp,
                               uint16_t len)
 {
@@ -177,8 +197,9 @@ STATIC mp_obj_t py_imu_sleep(mp_obj_t enable)
     error_on_not_ready();
 
     bool en = mp_obj_get_int(enable);
-    lsm6ds3tr_c_xl_data_rate_set(&dev_ctx, en ? LSM6DS3TR_C_XL_ODR_OFF : LSM6DS3TR_C_XL_ODR_52Hz);
-    lsm6ds3tr_c_gy_data_rate_set(&dev_ctx, en ? LSM6DS3TR_C_GY_ODR_OFF : LSM6DS3TR_C_GY_ODR_52Hz);
+    int odr = imu_fifo_odr ? imu_fifo_odr : LSM6DS3TR_C_XL_ODR_52Hz;
+    lsm6ds3tr_c_xl_data_rate_set(&dev_ctx, en ? LSM6DS3TR_C_XL_ODR_OFF : (lsm6ds3tr_c_odr_xl_t) odr);
+    lsm6ds3tr_c_gy_data_rate_set(&dev_ctx, en ? LSM6DS3TR_C_GY_ODR_OFF : (lsm6ds3tr_c_odr_g_t) odr);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imu_sleep_obj, py_imu_sleep);
@@ -203,6 +224,166 @@ STATIC mp_obj_t py_imu_read_reg(mp_obj_t addr)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imu_read_reg_obj, py_imu_read_reg);
 
+STATIC void imu_fifo_push(uint32_t ts, int16_t *words)
+{
+    if (imu_fifo_len == IMU_FIFO_SIZE) {
+        // Full, drop the oldest sample.
+        imu_fifo_head = (imu_fifo_head + 1) % IMU_FIFO_SIZE;
+        imu_fifo_len -= 1;
+    }
+
+    imu_sample_t *sample = &imu_fifo[(imu_fifo_head + imu_fifo_len) % IMU_FIFO_SIZE];
+    sample->ts = ts;
+
+    for (int i = 0; i < 3; i++) {
+        sample->gy[i] = words[i];
+        sample->xl[i] = words[3 + i];
+    }
+
+    imu_fifo_len += 1;
+}
+
+STATIC void imu_fifo_pop(size_t n)
+{
+    imu_fifo_head = (imu_fifo_head + n) % IMU_FIFO_SIZE;
+    imu_fifo_len -= n;
+}
+
+// Moves the samples batched by the IMU FIFO into the sample buffer, in bursts. The samples are
+// timestamped from the read time, the last one was taken less than a period before it.
+void py_imu_fifo_drain()
+{
+    if ((!imu_fifo_odr) || test_not_ready()) {
+        return;
+    }
+
+    uint16_t level = 0, pattern = 0;
+    lsm6ds3tr_c_fifo_data_level_get(&dev_ctx, &level);
+    lsm6ds3tr_c_fifo_pattern_get(&dev_ctx, &pattern);
+    uint32_t ts = mp_hal_ticks_us();
+
+    // Skip to the start of the next sample (a gyro x word).
+    for (; pattern && level; pattern = (pattern + 1) % IMU_FIFO_PATTERN_WORDS, level--) {
+        uint8_t word[2];
+        lsm6ds3tr_c_fifo_raw_data_get(&dev_ctx, word, sizeof(word));
+    }
+
+    int16_t words[IMU_FIFO_READ_SAMPLES * IMU_FIFO_PATTERN_WORDS];
+
+    for (uint32_t i = 0, n = level / IMU_FIFO_PATTERN_WORDS; i < n; ) {
+        uint32_t count = IM_MIN(n - i, IMU_FIFO_READ_SAMPLES);
+        lsm6ds3tr_c_read_reg(&dev_ctx, LSM6DS3TR_C_FIFO_DATA_OUT_L, (uint8_t *) words,
+                             count * IMU_FIFO_PATTERN_WORDS * sizeof(int16_t));
+
+        for (uint32_t j = 0; j < count; j++, i++) {
+            imu_fifo_push(ts - ((n - 1 - i) * imu_fifo_period), words + (j * IMU_FIFO_PATTERN_WORDS));
+        }
+    }
+}
+
+STATIC mp_obj_t py_imu_fifo_enable(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    error_on_not_ready();
+
+    bool enable = mp_obj_is_true(args[0]);
+    float rate = py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rate), 104.0f);
+    int odr = 0;
+
+    if (enable) {
+        while ((odr < MP_ARRAY_SIZE(imu_fifo_rates)) && (imu_fifo_rates[odr] < rate)) {
+            odr++;
+        }
+
+        PY_ASSERT_TRUE_MSG(odr < MP_ARRAY_SIZE(imu_fifo_rates), "Rate is too high!");
+        odr += 1;
+    }
+
+    // Bypass mode empties the FIFO.
+    lsm6ds3tr_c_fifo_mode_set(&dev_ctx, LSM6DS3TR_C_BYPASS_MODE);
+    imu_fifo_head = imu_fifo_len = 0;
+    imu_fifo_odr = odr;
+
+    if (enable) {
+        imu_fifo_period = fast_roundf(1000000.0f / imu_fifo_rates[odr - 1]);
+        lsm6ds3tr_c_xl_data_rate_set(&dev_ctx, (lsm6ds3tr_c_odr_xl_t) odr);
+        lsm6ds3tr_c_gy_data_rate_set(&dev_ctx, (lsm6ds3tr_c_odr_g_t) odr);
+        lsm6ds3tr_c_fifo_gy_batch_set(&dev_ctx, LSM6DS3TR_C_FIFO_GY_NO_DEC);
+        lsm6ds3tr_c_fifo_xl_batch_set(&dev_ctx, LSM6DS3TR_C_FIFO_XL_NO_DEC);
+        lsm6ds3tr_c_fifo_data_rate_set(&dev_ctx, (lsm6ds3tr_c_odr_fifo_t) odr);
+        lsm6ds3tr_c_fifo_mode_set(&dev_ctx, LSM6DS3TR_C_STREAM_MODE);
+    } else {
+        lsm6ds3tr_c_fifo_data_rate_set(&dev_ctx, LSM6DS3TR_C_FIFO_DISABLE);
+        lsm6ds3tr_c_xl_data_rate_set(&dev_ctx, LSM6DS3TR_C_XL_ODR_52Hz);
+        lsm6ds3tr_c_gy_data_rate_set(&dev_ctx, LSM6DS3TR_C_GY_ODR_52Hz);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_imu_fifo_enable_obj, 1, py_imu_fifo_enable);
+
+// Returns and removes the buffered samples as (timestamp_us, acceleration_mg, angular_rate_mdps).
+STATIC mp_obj_t py_imu_fifo_read()
+{
+    error_on_not_ready();
+    PY_ASSERT_TRUE_MSG(imu_fifo_odr, "FIFO is not enabled!");
+
+    py_imu_fifo_drain();
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+
+    for (size_t i = 0; i < imu_fifo_len; i++) {
+        imu_sample_t *sample = &imu_fifo[(imu_fifo_head + i) % IMU_FIFO_SIZE];
+        mp_obj_t tuple[3] = {
+            mp_obj_new_int_from_uint(sample->ts),
+            py_imu_tuple(lsm6ds3tr_c_from_fs8g_to_mg(sample->xl[0]),
+                         lsm6ds3tr_c_from_fs8g_to_mg(sample->xl[1]),
+                         lsm6ds3tr_c_from_fs8g_to_mg(sample->xl[2])),
+            py_imu_tuple(lsm6ds3tr_c_from_fs2000dps_to_mdps(sample->gy[0]),
+                         lsm6ds3tr_c_from_fs2000dps_to_mdps(sample->gy[1]),
+                         lsm6ds3tr_c_from_fs2000dps_to_mdps(sample->gy[2]))
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(3, tuple));
+    }
+
+    imu_fifo_pop(imu_fifo_len);
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_imu_fifo_read_obj, py_imu_fifo_read);
+
+// Integrates the angular rate of the samples taken between start and end (e.g. the timestamps of
+// two frames) into the rotation in degrees, the samples taken before end are removed.
+STATIC mp_obj_t py_imu_fifo_rotation(mp_obj_t start_obj, mp_obj_t end_obj)
+{
+    error_on_not_ready();
+    PY_ASSERT_TRUE_MSG(imu_fifo_odr, "FIFO is not enabled!");
+
+    py_imu_fifo_drain();
+    uint32_t start = mp_obj_get_int_truncated(start_obj);
+    uint32_t end = mp_obj_get_int_truncated(end_obj);
+    float rotation[3] = {0.0f, 0.0f, 0.0f};
+    size_t i = 0;
+
+    for (; i < imu_fifo_len; i++) {
+        imu_sample_t *sample = &imu_fifo[(imu_fifo_head + i) % IMU_FIFO_SIZE];
+
+        if (((int32_t) (sample->ts - end)) >= 0) {
+            break;
+        }
+
+        if (((int32_t) (sample->ts - start)) >= 0) {
+            for (int j = 0; j < 3; j++) {
+                rotation[j] += lsm6ds3tr_c_from_fs2000dps_to_mdps(sample->gy[j]);
+            }
+        }
+    }
+
+    imu_fifo_pop(i);
+
+    // mdps * us -> degrees.
+    float scale = imu_fifo_period / 1000000000.0f;
+    return py_imu_tuple(rotation[0] * scale, rotation[1] * scale, rotation[2] * scale);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_imu_fifo_rotation_obj, py_imu_fifo_rotation);
+
 STATIC const mp_rom_map_elem_t globals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),            MP_OBJ_NEW_QSTR(MP_QSTR_imu) },
     { MP_ROM_QSTR(MP_QSTR_acceleration_mg),     MP_ROM_PTR(&py_imu_acceleration_mg_obj) },
@@ -211,6 +392,9 @@ STATIC const mp_rom_map_elem_t globals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_roll),                MP_ROM_PTR(&py_imu_roll_obj) },
     { MP_ROM_QSTR(MP_QSTR_pitch),               MP_ROM_PTR(&py_imu_pitch_obj) },
     { MP_ROM_QSTR(MP_QSTR_sleep),               MP_ROM_PTR(&py_imu_sleep_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fifo_enable),         MP_ROM_PTR(&py_imu_fifo_enable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fifo_read),           MP_ROM_PTR(&py_imu_fifo_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fifo_rotation),       MP_ROM_PTR(&py_imu_fifo_rotation_obj) },
     { MP_ROM_QSTR(MP_QSTR___write_reg),         MP_ROM_PTR(&py_imu_write_reg_obj) },
     { MP_ROM_QSTR(MP_QSTR___read_reg),          MP_ROM_PTR(&py_imu_read_reg_obj) },
 };
@@ -224,6 +408,9 @@ const mp_obj_module_t imu_module = {
 
 void py_imu_init()
 {
+    imu_fifo_odr = 0;
+    imu_fifo_head = imu_fifo_len = 0;
+
     HAL_SPI_Init(&SPIHandle);
 
     uint8_t whoamI = 0, rst = 1;
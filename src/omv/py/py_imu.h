@@ -13,4 +13,5 @@
 void py_imu_init();
 float py_imu_roll_rotation(); // in degrees
 float py_imu_pitch_rotation(); // in degrees
+void py_imu_fifo_drain(); // Buffers the samples in the IMU FIFO.
 #endif // __PY_IMU_H__
@@ -11,9 +11,11 @@
 #include <mp.h>
 #include <objstr.h>
 #include <spi.h>
+#include <dma.h>
 #include <systick.h>
 #include "imlib.h"
 #include "fb_alloc.h"
+#include "framebuffer.h"
 #include "ff_wrapper.h"
 #include "py_assert.h"
 #include "py_helper.h"
@@ -35,96 +37,184 @@
 #define LED_PIN             GPIO_PIN_5
 #define LED_PIN_WRITE(bit)  HAL_GPIO_WritePin(LED_PORT, LED_PIN, bit);
 
-extern mp_obj_t pyb_spi_send(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args);
+#define LCD_MAX_WIDTH       (128)
+#define LCD_WAIT_TIMEOUT    (1000)
+
 extern mp_obj_t pyb_spi_make_new(mp_obj_t type_in, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *args);
 extern mp_obj_t pyb_spi_deinit(mp_obj_t self_in);
 
 static mp_obj_t spi_port = NULL;
+static const spi_t *spi = &spi_obj[1]; // SPI2
+static DMA_HandleTypeDef DMAHandle;
 static int width = 0;
 static int height = 0;
 static enum { LCD_NONE, LCD_SHIELD } type = LCD_NONE;
 static bool backlight_init = false;
 
-// Send out 8-bit data using the SPI object.
+// Frame transfer state, lines are prepared in one buffer while the other one is sent out.
+static uint16_t line_buf[2][LCD_MAX_WIDTH] __attribute__((aligned(32), section(".dma_buffer")));
+static volatile bool busy = false;
+static int line = 0;
+static image_t frame_img;
+static rectangle_t frame_rect;
+static rectangle_t frame_win; // Panel area being written.
+static int frame_w, frame_h, frame_l_pad, frame_t_pad;
+static resample_t *frame_resample = NULL;
+static uint8_t *frame_gs_line = NULL;
+
+// Send out 8-bit data using the SPI bus.
 static void lcd_write_command_byte(uint8_t data_byte)
 {
-    mp_map_t arg_map;
-    arg_map.all_keys_are_qstrs = true;
-    arg_map.is_fixed = true;
-    arg_map.is_ordered = true;
-    arg_map.used = 0;
-    arg_map.alloc = 0;
-    arg_map.table = NULL;
-
     CS_PIN_WRITE(false);
     RS_PIN_WRITE(false); // command
-    pyb_spi_send(
-        2, (mp_obj_t []) {
-            spi_port,
-            mp_obj_new_int(data_byte)
-        },
-        &arg_map
-    );
+    spi_transfer(spi, 1, &data_byte, NULL, SPI_TRANSFER_TIMEOUT(1));
     CS_PIN_WRITE(true);
 }
 
-// Send out 8-bit data using the SPI object.
+// Send out 8-bit data using the SPI bus.
 static void lcd_write_data_byte(uint8_t data_byte)
 {
-    mp_map_t arg_map;
-    arg_map.all_keys_are_qstrs = true;
-    arg_map.is_fixed = true;
-    arg_map.is_ordered = true;
-    arg_map.used = 0;
-    arg_map.alloc = 0;
-    arg_map.table = NULL;
-
     CS_PIN_WRITE(false);
     RS_PIN_WRITE(true); // data
-    pyb_spi_send(
-        2, (mp_obj_t []) {
-            spi_port,
-            mp_obj_new_int(data_byte)
-        },
-        &arg_map
-    );
+    spi_transfer(spi, 1, &data_byte, NULL, SPI_TRANSFER_TIMEOUT(1));
     CS_PIN_WRITE(true);
 }
 
-// Send out 8-bit data using the SPI object.
+// Send out 8-bit data using the SPI bus.
 static void lcd_write_command(uint8_t data_byte, uint32_t len, uint8_t *dat)
 {
     lcd_write_command_byte(data_byte);
     for (uint32_t i=0; i<len; i++) lcd_write_data_byte(dat[i]);
 }
 
-// Send out 8-bit data using the SPI object.
-static void lcd_write_data(uint32_t len, uint8_t *dat)
+// Fills an output line (padding included) from the frame being sent.
+static void lcd_fill_line(int y, uint16_t *buf)
+{
+    int i = y - frame_t_pad;
+
+    if ((!frame_img.pixels) || (i < 0) || (i >= frame_h)) {
+        memset(buf, 0, width * sizeof(uint16_t));
+        return;
+    }
+
+    uint16_t *dst = buf + frame_l_pad;
+    memset(buf, 0, frame_l_pad * sizeof(uint16_t));
+    memset(dst + frame_w, 0, (width - frame_l_pad - frame_w) * sizeof(uint16_t));
+
+    // RGB565 pixels are already stored in the LCD byte order, grayscale is expanded.
+    if (frame_resample && IM_IS_GS(&frame_img)) {
+        imlib_resample_line(frame_resample, i, frame_gs_line);
+        for (int j=0; j<frame_w; j++) {
+            uint8_t pixel = frame_gs_line[j];
+            dst[j] = IM_RGB565(IM_R825(pixel),IM_G826(pixel),IM_B825(pixel));
+        }
+    } else if (frame_resample) {
+        imlib_resample_line(frame_resample, i, dst);
+    } else if (IM_IS_GS(&frame_img)) {
+        uint8_t *src = frame_img.pixels + ((frame_rect.y + i) * frame_img.w) + frame_rect.x;
+        for (int j=0; j<frame_w; j++) {
+            uint8_t pixel = src[j];
+            dst[j] = IM_RGB565(IM_R825(pixel),IM_G826(pixel),IM_B825(pixel));
+        }
+    } else {
+        memcpy(dst, ((uint16_t *) frame_img.pixels) + ((frame_rect.y + i) * frame_img.w) + frame_rect.x,
+               frame_w * sizeof(uint16_t));
+    }
+}
+
+// Fills a line of the panel window, lines are filled at full width and shifted to the window.
+static void lcd_fill_window_line(int y, uint16_t *buf)
+{
+    lcd_fill_line(frame_win.y + y, buf);
+
+    if (frame_win.x) {
+        memmove(buf, buf + frame_win.x, frame_win.w * sizeof(uint16_t));
+    }
+}
+
+static void lcd_frame_done()
+{
+    CS_PIN_WRITE(true);
+    dma_deinit(spi->tx_dma_descr);
+    spi->spi->hdmatx = NULL;
+    busy = false;
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
 {
-    mp_obj_str_t arg_str;
-    arg_str.base.type = &mp_type_bytes;
-    arg_str.hash = 0;
-    arg_str.len = len;
-    arg_str.data = dat;
-
-    mp_map_t arg_map;
-    arg_map.all_keys_are_qstrs = true;
-    arg_map.is_fixed = true;
-    arg_map.is_ordered = true;
-    arg_map.used = 0;
-    arg_map.alloc = 0;
-    arg_map.table = NULL;
+    if ((!busy) || (hspi != spi->spi)) {
+        return;
+    }
+
+    if (++line >= frame_win.h) {
+        lcd_frame_done();
+        return;
+    }
+
+    // Send the line prepared while the last one was going out and prepare the next one.
+    HAL_SPI_Transmit_DMA(spi->spi, (uint8_t *) line_buf[line % 2], frame_win.w * sizeof(uint16_t));
+
+    if ((line + 1) < frame_win.h) {
+        lcd_fill_window_line(line + 1, line_buf[(line + 1) % 2]);
+    }
+}
+
+// Waits for the frame being sent to finish.
+static void lcd_wait()
+{
+    for (mp_uint_t tick_start = HAL_GetTick(); busy; ) {
+        if ((HAL_GetTick() - tick_start) >= LCD_WAIT_TIMEOUT) {
+            HAL_SPI_Abort(spi->spi);
+            lcd_frame_done();
+            break;
+        }
+
+        __WFI();
+    }
+}
+
+// Starts sending a frame (a NULL image sends a blank frame) in the background. Only the
+// window part of the panel is written if a window is passed.
+static void lcd_start_frame(image_t *img, rectangle_t *rect, int w, int h, int x_pad, int y_pad, rectangle_t *win)
+{
+    lcd_wait();
+
+    if (win) {
+        frame_win = *win;
+    } else {
+        rectangle_init(&frame_win, 0, 0, width, height);
+    }
+
+    if (img) {
+        frame_img = *img;
+        frame_rect = *rect;
+    } else {
+        memset(&frame_img, 0, sizeof(image_t));
+    }
+
+    frame_w = w;
+    frame_h = h;
+    frame_l_pad = x_pad;
+    frame_t_pad = y_pad;
+    line = 0;
+
+    // Column and row address window.
+    lcd_write_command(0x2A, 4, (uint8_t []) {0, frame_win.x, 0, frame_win.x + frame_win.w - 1});
+    lcd_write_command(0x2B, 4, (uint8_t []) {0, frame_win.y, 0, frame_win.y + frame_win.h - 1});
+
+    lcd_write_command_byte(0x2C);
+    lcd_fill_window_line(0, line_buf[0]);
+    if (frame_win.h > 1) {
+        lcd_fill_window_line(1, line_buf[1]);
+    }
+
+    dma_init(&DMAHandle, spi->tx_dma_descr, DMA_MEMORY_TO_PERIPH, spi->spi);
+    spi->spi->hdmatx = &DMAHandle;
+    busy = true;
 
     CS_PIN_WRITE(false);
     RS_PIN_WRITE(true); // data
-    pyb_spi_send(
-        2, (mp_obj_t []) {
-            spi_port,
-            &arg_str
-        },
-        &arg_map
-    );
-    CS_PIN_WRITE(true);
+    HAL_SPI_Transmit_DMA(spi->spi, (uint8_t *) line_buf[0], frame_win.w * sizeof(uint16_t));
 }
 
 static mp_obj_t py_lcd_deinit()
@@ -133,6 +223,7 @@ static mp_obj_t py_lcd_deinit()
         case LCD_NONE:
             return mp_const_none;
         case LCD_SHIELD:
+            lcd_wait();
             HAL_GPIO_DeInit(RST_PORT, RST_PIN);
             HAL_GPIO_DeInit(RS_PORT, RS_PIN);
             HAL_GPIO_DeInit(CS_PORT, CS_PIN);
@@ -285,65 +376,105 @@ static mp_obj_t py_lcd_display(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
     rectangle_t rect;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &rect);
 
+    float arg_x_scale =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_scale), 1.0f);
+    PY_ASSERT_TRUE_MSG((0.0f < arg_x_scale), "Error: 0.0 < x_scale!");
+    float arg_y_scale =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_scale), 1.0f);
+    PY_ASSERT_TRUE_MSG((0.0f < arg_y_scale), "Error: 0.0 < y_scale!");
+    int arg_hint =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_hint), 0);
+    int arg_rotation =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rotation), 0);
+    PY_ASSERT_TRUE_MSG((arg_rotation % 90) == 0, "Rotation must be a multiple of 90 degrees!");
+    arg_rotation = ((arg_rotation % 360) + 360) % 360;
+    mp_obj_t arg_dirty =
+        py_helper_keyword_object(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dirty));
+
+    // For 90/270 degrees LCD columns come from roi rows and the other way around.
+    bool transpose = (arg_rotation == 90) || (arg_rotation == 270);
+    int16_t *src_x = transpose ? &rect.y : &rect.x, *src_w = transpose ? &rect.h : &rect.w;
+    int16_t *src_y = transpose ? &rect.x : &rect.y, *src_h = transpose ? &rect.w : &rect.h;
+
+    // Scaled size.
+    int w = IM_MAX(fast_floorf(*src_w * arg_x_scale), 1);
+    int h = IM_MAX(fast_floorf(*src_h * arg_y_scale), 1);
+
     // Fit X.
-    int l_pad = 0, r_pad = 0;
-    if (rect.w > width) {
-        int adjust = rect.w - width;
-        rect.w -= adjust;
-        rect.x += adjust / 2;
-    } else if (rect.w < width) {
-        int adjust = width - rect.w;
+    int l_pad = 0;
+    if (w > width) {
+        int adjust = *src_w - IM_MIN(IM_MAX(fast_floorf(width / arg_x_scale), 1), *src_w);
+        *src_w -= adjust;
+        *src_x += adjust / 2;
+        w = width;
+    } else if (w < width) {
+        int adjust = width - w;
         l_pad = adjust / 2;
-        r_pad = (adjust + 1) / 2;
     }
 
     // Fit Y.
-    int t_pad = 0, b_pad = 0;
-    if (rect.h > height) {
-        int adjust = rect.h - height;
-        rect.h -= adjust;
-        rect.y += adjust / 2;
-    } else if (rect.h < height) {
-        int adjust = height - rect.h;
+    int t_pad = 0;
+    if (h > height) {
+        int adjust = *src_h - IM_MIN(IM_MAX(fast_floorf(height / arg_y_scale), 1), *src_h);
+        *src_h -= adjust;
+        *src_y += adjust / 2;
+        h = height;
+    } else if (h < height) {
+        int adjust = height - h;
         t_pad = adjust / 2;
-        b_pad = (adjust + 1) / 2;
     }
 
     switch (type) {
         case LCD_NONE:
             return mp_const_none;
-        case LCD_SHIELD:
-            lcd_write_command_byte(0x2C);
-            fb_alloc_mark();
-            uint8_t *zero = fb_alloc0(width*2, FB_ALLOC_NO_HINT);
-            uint16_t *line = fb_alloc(width*2, FB_ALLOC_NO_HINT);
-            for (int i=0; i<t_pad; i++) {
-                lcd_write_data(width*2, zero);
+        case LCD_SHIELD: {
+            // Lines are resampled if scaling or rotating, otherwise they're sent as is.
+            bool scaled = (w != rect.w) || (h != rect.h) || arg_rotation;
+            if (scaled) {
+                // The resampler lives in fb_alloc memory so the frame must be sent before returning.
+                lcd_wait();
+                fb_alloc_mark();
+                frame_resample = fb_alloc(sizeof(resample_t), FB_ALLOC_NO_HINT);
+                frame_gs_line = fb_alloc(width, FB_ALLOC_NO_HINT);
+                imlib_resample_init_rotated(frame_resample, arg_img, &rect, w, h, arg_hint, arg_rotation);
             }
-            for (int i=0; i<rect.h; i++) {
-                if (l_pad) {
-                    lcd_write_data(l_pad*2, zero); // l_pad < width
-                }
-                if (IM_IS_GS(arg_img)) {
-                    for (int j=0; j<rect.w; j++) {
-                        uint8_t pixel = IM_GET_GS_PIXEL(arg_img, (rect.x + j), (rect.y + i));
-                        line[j] = IM_RGB565(IM_R825(pixel),IM_G826(pixel),IM_B825(pixel));
+            if (arg_dirty) {
+                // Dirty rects are in image coordinates, only the parts of the panel they cover are sent.
+                PY_ASSERT_FALSE_MSG(scaled, "Dirty rects need an unscaled and unrotated display!");
+                mp_uint_t arg_dirty_len;
+                mp_obj_t *arg_dirty_items;
+                mp_obj_get_array(arg_dirty, &arg_dirty_len, &arg_dirty_items);
+
+                for (mp_uint_t i = 0; i < arg_dirty_len; i++) {
+                    mp_obj_t *arg_rect;
+                    mp_obj_get_array_fixed_n(arg_dirty_items[i], 4, &arg_rect);
+                    rectangle_t win;
+                    rectangle_init(&win, mp_obj_get_int(arg_rect[0]), mp_obj_get_int(arg_rect[1]),
+                                   mp_obj_get_int(arg_rect[2]), mp_obj_get_int(arg_rect[3]));
+
+                    if ((win.w < 1) || (win.h < 1) || (!rectangle_overlap(&win, &rect))) {
+                        continue;
                     }
-                    lcd_write_data(rect.w*2, (uint8_t *) line);
-                } else {
-                    lcd_write_data(rect.w*2, (uint8_t *)
-                        (((uint16_t *) arg_img->pixels) +
-                        ((rect.y + i) * arg_img->w) + rect.x));
-                }
-                if (r_pad) {
-                    lcd_write_data(r_pad*2, zero); // r_pad < width
+
+                    rectangle_intersected(&win, &rect);
+                    win.x += l_pad - rect.x;
+                    win.y += t_pad - rect.y;
+                    lcd_start_frame(arg_img, &rect, w, h, l_pad, t_pad, &win);
                 }
+            } else {
+                lcd_start_frame(arg_img, &rect, w, h, l_pad, t_pad, NULL);
             }
-            for (int i=0; i<b_pad; i++) {
-                lcd_write_data(width*2, zero);
+            // Only the frame buffer is sent in the background, other images may be freed by the GC.
+            if (scaled || (arg_img->pixels < MAIN_FB()->pixels) || (arg_img->pixels >= MAIN_FB_PIXELS())) {
+                lcd_wait();
+            }
+            if (scaled) {
+                frame_resample = NULL;
+                frame_gs_line = NULL;
+                fb_alloc_free_till_mark();
             }
-            fb_alloc_free_till_mark();
             return mp_const_none;
+        }
     }
     return mp_const_none;
 }
@@ -354,18 +485,18 @@ static mp_obj_t py_lcd_clear()
         case LCD_NONE:
             return mp_const_none;
         case LCD_SHIELD:
-            lcd_write_command_byte(0x2C);
-            fb_alloc_mark();
-            uint8_t *zero = fb_alloc0(width*2, FB_ALLOC_NO_HINT);
-            for (int i=0; i<height; i++) {
-                lcd_write_data(width*2, zero);
-            }
-            fb_alloc_free_till_mark();
+            lcd_start_frame(NULL, NULL, 0, 0, 0, 0, NULL);
             return mp_const_none;
     }
     return mp_const_none;
 }
 
+static mp_obj_t py_lcd_wait()
+{
+    lcd_wait();
+    return mp_const_none;
+}
+
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_lcd_init_obj, 0, py_lcd_init);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_lcd_deinit_obj, py_lcd_deinit);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_lcd_width_obj, py_lcd_width);
@@ -375,6 +506,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_lcd_set_backlight_obj, py_lcd_set_backlight)
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_lcd_get_backlight_obj, py_lcd_get_backlight);
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_lcd_display_obj, 1, py_lcd_display);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_lcd_clear_obj, py_lcd_clear);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_lcd_wait_obj, py_lcd_wait);
 static const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__),        MP_OBJ_NEW_QSTR(MP_QSTR_lcd) },
     { MP_OBJ_NEW_QSTR(MP_QSTR_init),            (mp_obj_t)&py_lcd_init_obj          },
@@ -386,6 +518,7 @@ static const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_backlight),   (mp_obj_t)&py_lcd_get_backlight_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_display),         (mp_obj_t)&py_lcd_display_obj       },
     { MP_OBJ_NEW_QSTR(MP_QSTR_clear),           (mp_obj_t)&py_lcd_clear_obj         },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_wait),            (mp_obj_t)&py_lcd_wait_obj          },
     { NULL, NULL },
 };
 STATIC MP_DEFINE_CONST_DICT(globals_dict, globals_dict_table);
@@ -22,22 +22,31 @@ typedef struct py_mjpeg_obj {
     mp_obj_base_t base;
     int width;
     int height;
-    uint32_t frames;
-    uint32_t bytes;
+    mjpeg_t mjpeg;
     FIL fp;
 } py_mjpeg_obj_t;
 
+// The writer state is torn down by close(), the ring buffer is freed then.
+static void py_mjpeg_check_open(py_mjpeg_obj_t *mjpeg)
+{
+    if (!mjpeg->mjpeg.ring.buf) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "I/O operation on closed file"));
+    }
+}
+
 static mp_obj_t py_mjpeg_open(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
-    py_mjpeg_obj_t *mjpeg = m_new_obj(py_mjpeg_obj_t);
+    py_mjpeg_obj_t *mjpeg = m_new_obj_with_finaliser(py_mjpeg_obj_t);
     mjpeg->width  = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_width), MAIN_FB()->w);
     mjpeg->height = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_height), MAIN_FB()->h);
-    mjpeg->frames = 0; // private
-    mjpeg->bytes = 0; // private
+    int prealloc  = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_prealloc), 0);
+    int buf_size  = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_buffer_size), FILE_RING_CHUNK_SIZE * 2);
+    PY_ASSERT_TRUE_MSG(prealloc >= 0, "Preallocation size must be >= 0");
+    PY_ASSERT_TRUE_MSG(buf_size > 0, "Buffer size must be > 0");
     mjpeg->base.type = &py_mjpeg_type;
 
     file_write_open(&mjpeg->fp, mp_obj_str_get_str(args[0]));
-    mjpeg_open(&mjpeg->fp, mjpeg->width, mjpeg->height);
+    mjpeg_open(&mjpeg->fp, &mjpeg->mjpeg, mjpeg->width, mjpeg->height, prealloc, buf_size);
     return mjpeg;
 }
 
@@ -56,12 +65,13 @@ static mp_obj_t py_mjpeg_height(mp_obj_t mjpeg_obj)
 static mp_obj_t py_mjpeg_size(mp_obj_t mjpeg_obj)
 {
     py_mjpeg_obj_t *arg_mjpeg = mjpeg_obj;
-    return mp_obj_new_int(f_size(&arg_mjpeg->fp));
+    return mp_obj_new_int(file_ring_tell(&arg_mjpeg->mjpeg.ring));
 }
 
 static mp_obj_t py_mjpeg_add_frame(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     py_mjpeg_obj_t *arg_mjpeg = args[0];
+    py_mjpeg_check_open(arg_mjpeg);
     image_t *arg_img = py_image_cobj(args[1]);
     PY_ASSERT_FALSE_MSG((arg_mjpeg->width != arg_img->w)
                      || (arg_mjpeg->height != arg_img->h),
@@ -69,14 +79,23 @@ static mp_obj_t py_mjpeg_add_frame(uint n_args, const mp_obj_t *args, mp_map_t *
 
     int arg_q = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_quality), 50);
     arg_q = IM_MIN(IM_MAX(arg_q, 1), 100);
-    mjpeg_add_frame(&arg_mjpeg->fp, &arg_mjpeg->frames, &arg_mjpeg->bytes, arg_img, arg_q);
+    mjpeg_add_frame(&arg_mjpeg->fp, &arg_mjpeg->mjpeg, arg_img, arg_q);
     return mp_const_none;
 }
 
 static mp_obj_t py_mjpeg_close(mp_obj_t mjpeg_obj, mp_obj_t fps_obj)
 {
     py_mjpeg_obj_t *arg_mjpeg = mjpeg_obj;
-    mjpeg_close(&arg_mjpeg->fp, &arg_mjpeg->frames, &arg_mjpeg->bytes, mp_obj_get_float(fps_obj));
+    py_mjpeg_check_open(arg_mjpeg);
+    mjpeg_close(&arg_mjpeg->fp, &arg_mjpeg->mjpeg, mp_obj_get_float(fps_obj));
+    return mp_const_none;
+}
+
+static mp_obj_t py_mjpeg_del(mp_obj_t mjpeg_obj)
+{
+    py_mjpeg_obj_t *arg_mjpeg = mjpeg_obj;
+    // Stop servicing the writer if it's collected without being closed.
+    file_ring_abort(&arg_mjpeg->mjpeg.ring);
     return mp_const_none;
 }
 
@@ -91,12 +110,14 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_height_obj, py_mjpeg_height);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_size_obj, py_mjpeg_size);
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_mjpeg_add_frame_obj, 2, py_mjpeg_add_frame);
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_mjpeg_close_obj, py_mjpeg_close);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_del_obj, py_mjpeg_del);
 static const mp_map_elem_t locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_width),       (mp_obj_t)&py_mjpeg_width_obj     },
     { MP_OBJ_NEW_QSTR(MP_QSTR_height),      (mp_obj_t)&py_mjpeg_height_obj    },
     { MP_OBJ_NEW_QSTR(MP_QSTR_size),        (mp_obj_t)&py_mjpeg_size_obj      },
     { MP_OBJ_NEW_QSTR(MP_QSTR_add_frame),   (mp_obj_t)&py_mjpeg_add_frame_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_close),       (mp_obj_t)&py_mjpeg_close_obj     },
+    { MP_OBJ_NEW_QSTR(MP_QSTR___del__),     (mp_obj_t)&py_mjpeg_del_obj       },
     { NULL, NULL },
 };
 STATIC MP_DEFINE_CONST_DICT(locals_dict, locals_dict_table);
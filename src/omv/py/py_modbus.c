@@ -0,0 +1,279 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Modbus slave Python object.
+ *
+ * RTU requests are answered from the UART idle line interrupt: the slave installs itself as the
+ * UART's hard IRQ handler, takes the received bytes from the UART's RX buffer and writes the
+ * response before returning, so the response time doesn't depend on what the script is doing.
+ */
+#include <string.h>
+#include "mp.h"
+#include STM32_HAL_H
+#include "uart.h"
+#include "xalloc.h"
+#include "modbus.h"
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_modbus.h"
+
+// Bytes received this long (in ms) before the current ones are dropped as a partial frame.
+#define MODBUS_RTU_FRAME_TIMEOUT    (5)
+
+static const mp_obj_type_t py_modbus_slave_type; // forward declare
+typedef struct py_modbus_slave_obj {
+    mp_obj_base_t base;
+    mp_obj_t uart; // None if TCP only.
+    modbus_t mb;
+    uint32_t max_us; // Longest RTU response time, from the idle line to the last byte written.
+    uint32_t rx_ticks;
+    uint32_t rx_len;
+    uint8_t rx_buf[MODBUS_RTU_MAX_ADU];
+    uint8_t tx_buf[MODBUS_RTU_MAX_ADU];
+} py_modbus_slave_obj_t;
+
+static void py_modbus_uart_tx(USART_TypeDef *uartx, const uint8_t *buf, size_t len)
+{
+    // The port's UART driver has no interrupt driven TX, the data register is written directly.
+    for (size_t i = 0; i < len; i++) {
+        #if defined(MCU_SERIES_F4)
+        while (!(uartx->SR & USART_SR_TXE));
+        uartx->DR = buf[i];
+        #elif defined(MCU_SERIES_H7)
+        while (!(uartx->ISR & USART_ISR_TXE_TXFNF));
+        uartx->TDR = buf[i];
+        #else
+        while (!(uartx->ISR & USART_ISR_TXE));
+        uartx->TDR = buf[i];
+        #endif
+    }
+}
+
+// Runs in the UART interrupt, it must not allocate.
+static mp_obj_t py_modbus_slave_irq(mp_obj_t self_in, mp_obj_t uart_in)
+{
+    py_modbus_slave_obj_t *self = self_in;
+    pyb_uart_obj_t *uart = uart_in;
+    uint32_t cycles = DWT->CYCCNT;
+    uint32_t ticks = HAL_GetTick();
+
+    if (self->rx_len && ((ticks - self->rx_ticks) > MODBUS_RTU_FRAME_TIMEOUT)) {
+        self->rx_len = 0;
+    }
+
+    self->rx_ticks = ticks;
+
+    while (uart_rx_any(uart)) {
+        int c = uart_rx_char(uart);
+        if (self->rx_len < MODBUS_RTU_MAX_ADU) {
+            self->rx_buf[self->rx_len++] = c;
+        }
+    }
+
+    int size = modbus_rtu_frame_size(self->rx_buf, self->rx_len);
+
+    // Wait for the rest of the frame.
+    if (!size) {
+        return mp_const_none;
+    }
+
+    if (size > 0) {
+        size_t len = modbus_rtu_process(&self->mb, self->rx_buf, size, self->tx_buf);
+        if (len && uart->is_enabled) {
+            py_modbus_uart_tx(uart->uartx, self->tx_buf, len);
+            uint32_t us = (DWT->CYCCNT - cycles) / (SystemCoreClock / 1000000);
+            if (us > self->max_us) {
+                self->max_us = us;
+            }
+        }
+    }
+
+    // The master waits for the response, anything after the frame is noise.
+    self->rx_len = 0;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_modbus_slave_irq_obj, py_modbus_slave_irq);
+
+static void py_modbus_slave_attach(py_modbus_slave_obj_t *self, bool enable)
+{
+    // uart.irq(handler, trigger, hard)
+    mp_obj_t args[5];
+    mp_load_method(self->uart, MP_QSTR_irq, args);
+    args[2] = enable ? mp_obj_new_bound_meth(MP_OBJ_FROM_PTR(&py_modbus_slave_irq_obj), self) : mp_const_none;
+    args[3] = enable ? mp_load_attr(self->uart, MP_QSTR_IRQ_RXIDLE) : MP_OBJ_NEW_SMALL_INT(0);
+    args[4] = mp_const_true;
+    mp_call_method_n_kw(3, 0, args);
+}
+
+static void py_modbus_slave_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    py_modbus_slave_obj_t *self = self_in;
+    mp_printf(print, "{\"slave_id\":%d, \"register_num\":%d, \"requests\":%d}",
+              self->mb.slave_id, self->mb.regs_len, self->mb.requests);
+}
+
+static mp_obj_t py_modbus_slave_unary_op(mp_unary_op_t op, mp_obj_t self_in)
+{
+    py_modbus_slave_obj_t *self = self_in;
+    switch (op) {
+        case MP_UNARY_OP_LEN:
+            return MP_OBJ_NEW_SMALL_INT(self->mb.regs_len);
+
+        default:
+            return MP_OBJ_NULL; // op not supported
+    }
+}
+
+static mp_obj_t py_modbus_slave_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value)
+{
+    // Registers read back as signed 16-bit values, like the Python ModbusRTU class.
+    py_modbus_slave_obj_t *self = self_in;
+    if (value == MP_OBJ_SENTINEL) { // load
+        if (MP_OBJ_IS_TYPE(index, &mp_type_slice)) {
+            mp_bound_slice_t slice;
+            if (!mp_seq_get_fast_slice_indexes(self->mb.regs_len, index, &slice)) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "only slices with step=1 (aka None) are supported"));
+            }
+            mp_obj_tuple_t *result = mp_obj_new_tuple(slice.stop - slice.start, NULL);
+            for (mp_uint_t i = 0; i < result->len; i++) {
+                result->items[i] = mp_obj_new_int((int16_t) self->mb.regs[slice.start + i]);
+            }
+            return result;
+        }
+        mp_uint_t i = mp_get_index(self->base.type, self->mb.regs_len, index, false);
+        return mp_obj_new_int((int16_t) self->mb.regs[i]);
+    } else if (value != MP_OBJ_NULL) { // store
+        mp_uint_t i = mp_get_index(self->base.type, self->mb.regs_len, index, false);
+        self->mb.regs[i] = mp_obj_get_int(value);
+        return mp_const_none;
+    }
+
+    return MP_OBJ_NULL; // op not supported
+}
+
+static mp_obj_t py_modbus_slave_set(mp_obj_t self_in, mp_obj_t address_obj, mp_obj_t values_obj)
+{
+    // set(address, values): writes the registers from address on with the UART interrupt held off,
+    // so the master can't read half of them updated.
+    py_modbus_slave_obj_t *self = self_in;
+    mp_uint_t address = mp_get_index(self->base.type, self->mb.regs_len, address_obj, false);
+    size_t len = 1;
+    mp_obj_t *values = &values_obj;
+
+    if (!mp_obj_is_int(values_obj)) {
+        mp_obj_get_array(values_obj, &len, &values);
+    }
+
+    PY_ASSERT_TRUE_MSG((address + len) <= self->mb.regs_len, "Too many values!");
+
+    // Convert before disabling interrupts, mp_obj_get_int() raises on non-integers.
+    for (size_t i = 0; i < len; i++) {
+        mp_obj_get_int(values[i]);
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (size_t i = 0; i < len; i++) {
+        self->mb.regs[address + i] = mp_obj_get_int(values[i]);
+    }
+    __set_PRIMASK(primask);
+    return mp_const_none;
+}
+
+static mp_obj_t py_modbus_slave_clear(mp_obj_t self_in)
+{
+    py_modbus_slave_obj_t *self = self_in;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset((uint16_t *) self->mb.regs, 0, self->mb.regs_len * sizeof(uint16_t));
+    __set_PRIMASK(primask);
+    return mp_const_none;
+}
+
+static mp_obj_t py_modbus_slave_tcp(mp_obj_t self_in, mp_obj_t request_obj)
+{
+    // tcp(request): returns the response to a Modbus TCP request (MBAP header included) or None.
+    py_modbus_slave_obj_t *self = self_in;
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(request_obj, &bufinfo, MP_BUFFER_READ);
+
+    uint8_t resp[MODBUS_TCP_MAX_ADU];
+    size_t len = modbus_tcp_process(&self->mb, bufinfo.buf, bufinfo.len, resp);
+    return len ? mp_obj_new_bytes(resp, len) : mp_const_none;
+}
+
+static mp_obj_t py_modbus_slave_stats(mp_obj_t self_in)
+{
+    // Returns (requests, crc_errors, exceptions, writes, max_us).
+    py_modbus_slave_obj_t *self = self_in;
+    return mp_obj_new_tuple(5, (mp_obj_t []) {mp_obj_new_int_from_uint(self->mb.requests),
+                                              mp_obj_new_int_from_uint(self->mb.crc_errors),
+                                              mp_obj_new_int_from_uint(self->mb.exceptions),
+                                              mp_obj_new_int_from_uint(self->mb.writes),
+                                              mp_obj_new_int_from_uint(self->max_us)});
+}
+
+static mp_obj_t py_modbus_slave_deinit(mp_obj_t self_in)
+{
+    py_modbus_slave_obj_t *self = self_in;
+    if (self->uart != mp_const_none) {
+        py_modbus_slave_attach(self, false);
+        self->uart = mp_const_none;
+    }
+    return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(py_modbus_slave_set_obj, py_modbus_slave_set);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_modbus_slave_clear_obj, py_modbus_slave_clear);
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_modbus_slave_tcp_obj, py_modbus_slave_tcp);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_modbus_slave_stats_obj, py_modbus_slave_stats);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_modbus_slave_deinit_obj, py_modbus_slave_deinit);
+static const mp_map_elem_t locals_dict_table[] = {
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set),         (mp_obj_t)&py_modbus_slave_set_obj    },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_clear),       (mp_obj_t)&py_modbus_slave_clear_obj  },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_tcp),         (mp_obj_t)&py_modbus_slave_tcp_obj    },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stats),       (mp_obj_t)&py_modbus_slave_stats_obj  },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_deinit),      (mp_obj_t)&py_modbus_slave_deinit_obj },
+    { NULL, NULL },
+};
+STATIC MP_DEFINE_CONST_DICT(locals_dict, locals_dict_table);
+
+static const mp_obj_type_t py_modbus_slave_type = {
+    { &mp_type_type },
+    .name  = MP_QSTR_ModbusSlave,
+    .print = py_modbus_slave_print,
+    .unary_op = py_modbus_slave_unary_op,
+    .subscr = py_modbus_slave_subscr,
+    .locals_dict = (mp_obj_t)&locals_dict,
+};
+
+static mp_obj_t py_modbus_slave(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    // ModbusSlave(uart, slave_id=1, register_num=30): uart may be None to only serve TCP requests.
+    mp_obj_t uart = args[0];
+    int slave_id = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_slave_id), 1);
+    int register_num = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_register_num), 30);
+    PY_ASSERT_TRUE_MSG((uart == mp_const_none) || MP_OBJ_IS_TYPE(uart, &pyb_uart_type), "Expected a UART!");
+    PY_ASSERT_TRUE_MSG((1 <= slave_id) && (slave_id <= 247), "Slave id must be between 1 and 247!");
+    PY_ASSERT_TRUE_MSG((1 <= register_num) && (register_num <= MODBUS_MAX_REGISTERS), "Invalid register number!");
+
+    py_modbus_slave_obj_t *self = m_new_obj(py_modbus_slave_obj_t);
+    memset(self, 0, sizeof(py_modbus_slave_obj_t));
+    self->base.type = &py_modbus_slave_type;
+    self->uart = uart;
+    self->mb.slave_id = slave_id;
+    self->mb.regs_len = register_num;
+    self->mb.regs = xalloc0_data(register_num * sizeof(uint16_t));
+
+    if (uart != mp_const_none) {
+        py_modbus_slave_attach(self, true);
+    }
+
+    return self;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(py_modbus_slave_obj, 1, py_modbus_slave);
@@ -0,0 +1,15 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Modbus slave Python object.
+ */
+#ifndef __PY_MODBUS_H__
+#define __PY_MODBUS_H__
+// omv.ModbusSlave(uart, slave_id=1, register_num=30)
+MP_DECLARE_CONST_FUN_OBJ_KW(py_modbus_slave_obj);
+#endif // __PY_MODBUS_H__
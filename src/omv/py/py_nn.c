@@ -364,9 +364,29 @@ STATIC mp_obj_t py_net_search(uint n_args, const mp_obj_t *args, mp_map_t *kw_ar
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_net_search_obj, 2, py_net_search);
 
+// Returns (type, (c, h, w), cycles, scratch bytes) for each layer of the last forward() or search().
+STATIC mp_obj_t py_net_profile(mp_obj_t self_in)
+{
+    nn_t *net = py_net_cobj(self_in);
+    mp_obj_t layers_list = mp_obj_new_list(0, NULL);
+
+    for (layer_t *layer = net->layers; layer != NULL; layer = layer->next) {
+        mp_obj_t shape[3] = {mp_obj_new_int(layer->c), mp_obj_new_int(layer->h), mp_obj_new_int(layer->w)};
+        mp_obj_t tuple[4] = {mp_obj_new_str(layer_to_str(layer->type), strlen(layer_to_str(layer->type))),
+                             mp_obj_new_tuple(3, shape),
+                             mp_obj_new_int_from_uint(layer->cycles),
+                             mp_obj_new_int(layer->scratch)};
+        mp_obj_list_append(layers_list, mp_obj_new_tuple(4, tuple));
+    }
+
+    return layers_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_net_profile_obj, py_net_profile);
+
 STATIC const mp_rom_map_elem_t locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_forward), MP_ROM_PTR(&py_net_forward_obj) },
-    { MP_ROM_QSTR(MP_QSTR_search), MP_ROM_PTR(&py_net_search_obj) }
+    { MP_ROM_QSTR(MP_QSTR_search), MP_ROM_PTR(&py_net_search_obj) },
+    { MP_ROM_QSTR(MP_QSTR_profile), MP_ROM_PTR(&py_net_profile_obj) }
 };
 
 STATIC MP_DEFINE_CONST_DICT(locals_dict, locals_dict_table);
@@ -383,7 +403,7 @@ static mp_obj_t py_nn_load(mp_obj_t path_obj)
     const char *path = mp_obj_str_get_str(path_obj);
     py_net_obj_t *net = m_new_obj(py_net_obj_t);
     net->base.type = &py_net_type;
-    nn_load_network(py_net_cobj(net), path);
+    PY_ASSERT_FALSE_MSG(nn_load_network(py_net_cobj(net), path), "Failed to load network!");
     return net;
 }
 
@@ -9,8 +9,14 @@
  * OMV Python module.
  */
 #include <mp.h>
+#include STM32_HAL_H
 #include "usbdbg.h"
 #include "framebuffer.h"
+#include "fb_alloc.h"
+#include "gc_stats.h"
+#include "xalloc.h"
+#include "frame_stats.h"
+#include "py_modbus.h"
 #include "omv_boardconfig.h"
 
 static mp_obj_t py_omv_version_string()
@@ -59,6 +65,172 @@ static mp_obj_t py_omv_disable_fb(uint n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_omv_disable_fb_obj, 0, 1, py_omv_disable_fb);
 
+static mp_obj_t py_omv_fb_alloc_profile(uint n_args, const mp_obj_t *args)
+{
+    if (!n_args) {
+        return mp_obj_new_bool(fb_alloc_profile_enabled());
+    }
+    fb_alloc_profile_enable(mp_obj_is_true(args[0]));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_omv_fb_alloc_profile_obj, 0, 1, py_omv_fb_alloc_profile);
+
+static mp_obj_t py_omv_fb_alloc_stats()
+{
+    // Returns a list of (caller, calls, allocs, peak, time_us) tuples, one per fb_alloc_mark call site.
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    const fb_alloc_profile_t *entries = fb_alloc_profile_entries();
+    for (int i = 0; i < FB_ALLOC_PROFILE_ENTRIES && entries[i].caller; i++) {
+        mp_obj_t tuple[5] = {
+            mp_obj_new_int_from_uint(entries[i].caller),
+            mp_obj_new_int_from_uint(entries[i].calls),
+            mp_obj_new_int_from_uint(entries[i].allocs),
+            mp_obj_new_int_from_uint(entries[i].peak),
+            mp_obj_new_int_from_uint(entries[i].time_us)
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(5, tuple));
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_omv_fb_alloc_stats_obj, py_omv_fb_alloc_stats);
+
+static mp_obj_t py_omv_fb_alloc_peak()
+{
+    return mp_obj_new_int_from_uint(fb_alloc_profile_peak());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_omv_fb_alloc_peak_obj, py_omv_fb_alloc_peak);
+
+static mp_obj_t py_omv_gc_stats(uint n_args, const mp_obj_t *args)
+{
+    // Returns (count, frame_count, total_us, max_us, last_us, pause_hist, frame_hist), reset=True clears them.
+    const gc_stats_t *stats = gc_stats_get();
+    mp_obj_t pause_hist = mp_obj_new_list(GC_STATS_BINS, NULL);
+    mp_obj_t frame_hist = mp_obj_new_list(GC_STATS_BINS, NULL);
+    for (int i = 0; i < GC_STATS_BINS; i++) {
+        ((mp_obj_list_t *) pause_hist)->items[i] = mp_obj_new_int_from_uint(stats->pause_hist[i]);
+        ((mp_obj_list_t *) frame_hist)->items[i] = mp_obj_new_int_from_uint(stats->frame_hist[i]);
+    }
+    mp_obj_t tuple[7] = {
+        mp_obj_new_int_from_uint(stats->count),
+        mp_obj_new_int_from_uint(stats->frame_count),
+        mp_obj_new_int_from_uint(stats->total_us),
+        mp_obj_new_int_from_uint(stats->max_us),
+        mp_obj_new_int_from_uint(stats->last_us),
+        pause_hist,
+        frame_hist
+    };
+    mp_obj_t ret = mp_obj_new_tuple(7, tuple);
+    if (n_args && mp_obj_is_true(args[0])) {
+        gc_stats_reset();
+    }
+    return ret;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_omv_gc_stats_obj, 0, 1, py_omv_gc_stats);
+
+static mp_obj_t py_omv_gc_budget(uint n_args, const mp_obj_t *args)
+{
+    // gc_budget(budget_us, threshold=50): collect between frames when less than threshold percent
+    // of the heap is free and the expected pause fits in budget_us. gc_budget(0) disables it.
+    int budget_us = mp_obj_get_int(args[0]);
+    int threshold = (n_args > 1) ? mp_obj_get_int(args[1]) : 50;
+    if ((budget_us < 0) || (threshold < 0) || (threshold > 100)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid GC budget!"));
+    }
+    gc_stats_set_budget(budget_us, threshold);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_omv_gc_budget_obj, 1, 2, py_omv_gc_budget);
+
+static mp_obj_t py_omv_large_heap_info()
+{
+    // Returns (total, free, max_free) bytes of the large buffer heap, all 0 if the board has none.
+    uint32_t total, free, max_free;
+    xalloc_large_info(&total, &free, &max_free);
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(total),
+        mp_obj_new_int_from_uint(free),
+        mp_obj_new_int_from_uint(max_free)
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_omv_large_heap_info_obj, py_omv_large_heap_info);
+
+// CRC-16/CCITT (poly 0x1021), the CRC unit is used if it has a programmable polynomial.
+static uint16_t omv_crc16(const uint8_t *buf, size_t len, uint16_t crc)
+{
+    #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+    __HAL_RCC_CRC_CLK_ENABLE();
+    CRC->POL = 0x1021;
+    CRC->INIT = crc;
+    // 16-bit polynomial, reset loads the initial value.
+    CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_RESET;
+    for (size_t i = 0; i < len; i++) {
+        *((__IO uint8_t *) &CRC->DR) = buf[i];
+    }
+    return CRC->DR;
+    #else
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i] << 8;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+    #endif
+}
+
+static mp_obj_t py_omv_crc16(uint n_args, const mp_obj_t *args)
+{
+    // crc16(data, size=len(data), crc=0xFFFF): reads any buffer (including images) in place,
+    // pass the previous result as crc to continue over another buffer.
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+    size_t size = bufinfo.len;
+    if (n_args > 1) {
+        mp_int_t arg_size = mp_obj_get_int(args[1]);
+        if ((arg_size < 0) || (arg_size > bufinfo.len)) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid size!"));
+        }
+        size = arg_size;
+    }
+    uint16_t crc = (n_args > 2) ? mp_obj_get_int(args[2]) : 0xFFFF;
+    return mp_obj_new_int(omv_crc16(bufinfo.buf, size, crc));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_omv_crc16_obj, 1, 3, py_omv_crc16);
+
+static mp_obj_t py_omv_cycles()
+{
+    // Returns the CPU cycle counter (wraps around every 2^32 cycles), for timing code down to the cycle.
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        #if (__CORTEX_M == 7U)
+        DWT->LAR = 0xC5ACCE55;
+        #endif
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    return mp_obj_new_int_from_uint(DWT->CYCCNT);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_omv_cycles_obj, py_omv_cycles);
+
+static mp_obj_t py_omv_frame_stats()
+{
+    // Returns (frame_us, capture_us, line_us, jpeg_us, gc_us, python_us, lines) for the last frame,
+    // frames are counted between sensor.snapshot() calls (line ISRs run during capture).
+    const frame_stats_t *stats = frame_stats_get();
+    mp_obj_t tuple[7] = {
+        mp_obj_new_int_from_uint(stats->frame_us),
+        mp_obj_new_int_from_uint(stats->capture_us),
+        mp_obj_new_int_from_uint(stats->line_us),
+        mp_obj_new_int_from_uint(stats->jpeg_us),
+        mp_obj_new_int_from_uint(stats->gc_us),
+        mp_obj_new_int_from_uint(stats->python_us),
+        mp_obj_new_int_from_uint(stats->lines)
+    };
+    return mp_obj_new_tuple(7, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_omv_frame_stats_obj, py_omv_frame_stats);
+
 static const mp_rom_map_elem_t globals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),        MP_OBJ_NEW_QSTR(MP_QSTR_omv) },
     { MP_ROM_QSTR(MP_QSTR_version_major),   MP_ROM_INT(FIRMWARE_VERSION_MAJOR) },
@@ -68,7 +240,17 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_arch),            MP_ROM_PTR(&py_omv_arch_obj) },
     { MP_ROM_QSTR(MP_QSTR_board_type),      MP_ROM_PTR(&py_omv_board_type_obj) },
     { MP_ROM_QSTR(MP_QSTR_board_id),        MP_ROM_PTR(&py_omv_board_id_obj) },
-    { MP_ROM_QSTR(MP_QSTR_disable_fb),      MP_ROM_PTR(&py_omv_disable_fb_obj) }
+    { MP_ROM_QSTR(MP_QSTR_disable_fb),      MP_ROM_PTR(&py_omv_disable_fb_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fb_alloc_profile),MP_ROM_PTR(&py_omv_fb_alloc_profile_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fb_alloc_stats),  MP_ROM_PTR(&py_omv_fb_alloc_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_fb_alloc_peak),   MP_ROM_PTR(&py_omv_fb_alloc_peak_obj) },
+    { MP_ROM_QSTR(MP_QSTR_gc_stats),        MP_ROM_PTR(&py_omv_gc_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_gc_budget),       MP_ROM_PTR(&py_omv_gc_budget_obj) },
+    { MP_ROM_QSTR(MP_QSTR_large_heap_info), MP_ROM_PTR(&py_omv_large_heap_info_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ModbusSlave),     MP_ROM_PTR(&py_modbus_slave_obj) },
+    { MP_ROM_QSTR(MP_QSTR_crc16),           MP_ROM_PTR(&py_omv_crc16_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cycles),          MP_ROM_PTR(&py_omv_cycles_obj) },
+    { MP_ROM_QSTR(MP_QSTR_frame_stats),     MP_ROM_PTR(&py_omv_frame_stats_obj) }
 };
 
 STATIC MP_DEFINE_CONST_DICT(globals_dict, globals_dict_table);
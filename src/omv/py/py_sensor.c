@@ -10,6 +10,7 @@
  */
 #include <stdarg.h>
 #include "mp.h"
+#include "py/mphal.h"
 #include "pin.h"
 #include "sensor.h"
 #include "imlib.h"
@@ -20,6 +21,9 @@
 #include "omv_boardconfig.h"
 #include "py_helper.h"
 #include "framebuffer.h"
+#include "frame_stats.h"
+#include "gc_stats.h"
+#include "py_cpufreq.h"
 #include "systick.h"
 
 extern sensor_t sensor;
@@ -76,13 +80,49 @@ static mp_obj_t py_sensor_snapshot(uint n_args, const mp_obj_t *args, mp_map_t *
 
     mp_obj_t image = py_image(0, 0, 0, 0);
 
-    if (sensor.snapshot(&sensor, (image_t *) py_image_cobj(image), NULL) == -1) {
+    // Frame boundary for omv.frame_stats(). JPEG compression and GC done while waiting for
+    // the sensor are not counted as capture time.
+    frame_stats_frame();
+    const frame_stats_t *stats = frame_stats_get();
+    cpufreq_governor_frame(stats->python_us + stats->jpeg_us + stats->gc_us);
+
+    uint32_t start = mp_hal_ticks_us();
+    uint32_t other = frame_stats_us(FRAME_STATS_JPEG) + frame_stats_us(FRAME_STATS_GC);
+
+    cpufreq_governor_wait(true);
+    int ret = sensor.snapshot(&sensor, (image_t *) py_image_cobj(image), NULL);
+    cpufreq_governor_wait(false);
+
+    other = frame_stats_us(FRAME_STATS_JPEG) + frame_stats_us(FRAME_STATS_GC) - other;
+    uint32_t us = mp_hal_ticks_us() - start;
+    frame_stats_add_us(FRAME_STATS_CAPTURE, (us > other) ? (us - other) : 0);
+
+#if MICROPY_PY_IMU
+    // Buffer the IMU samples up to this frame, so they don't have to be polled.
+    py_imu_fifo_drain();
+#endif // MICROPY_PY_IMU
+
+    if (ret == -1) {
         nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, "Sensor Timeout"));
     }
 
     return image;
 }
 
+static mp_obj_t py_sensor_snapshot_async()
+{
+    if (sensor_snapshot_async() == -1) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Requires 2 or more frame buffers!"));
+    }
+
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_frame_ready()
+{
+    return mp_obj_new_bool(sensor_frame_ready());
+}
+
 static mp_obj_t py_sensor_skip_frames(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     mp_map_elem_t *kw_arg = mp_map_lookup(kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_time), MP_MAP_LOOKUP);
@@ -131,7 +171,7 @@ static mp_obj_t py_sensor_get_fb()
         .w      = MAIN_FB()->w,
         .h      = MAIN_FB()->h,
         .bpp    = MAIN_FB()->bpp,
-        .pixels = MAIN_FB()->pixels
+        .pixels = MAIN_FB_BUFFER()
     };
 
     return py_image_from_struct(&image);
@@ -218,6 +258,13 @@ static mp_obj_t py_sensor_get_framesize() {
     return mp_obj_new_int(sensor.framesize);
 }
 
+static mp_obj_t py_sensor_set_mode(mp_obj_t pixformat, mp_obj_t framesize) {
+    if (sensor_set_mode(mp_obj_get_int(pixformat), mp_obj_get_int(framesize)) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Failed to set mode!"));
+    }
+    return mp_const_none;
+}
+
 static mp_obj_t py_sensor_set_windowing(mp_obj_t roi_obj)
 {
     int x, y, w, h;
@@ -439,6 +486,110 @@ static mp_obj_t py_sensor_get_auto_rotation() {
     return mp_obj_new_bool(sensor_get_auto_rotation());
 }
 
+static mp_obj_t py_sensor_set_framebuffers(mp_obj_t count) {
+    if (sensor_set_framebuffers(mp_obj_get_int(count)) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid number of frame buffers!"));
+    }
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_get_framebuffers() {
+    return mp_obj_new_int(sensor_get_framebuffers());
+}
+
+static mp_obj_t py_sensor_set_capture_plane(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int mode = mp_obj_get_int(args[0]);
+    image_t *plane = (n_args > 1 && args[1] != mp_const_none) ? py_image_cobj(args[1]) : NULL;
+    bool invert = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+
+    list_t thresholds;
+    list_init(&thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    py_helper_keyword_thresholds(n_args, args, 2, kw_args, &thresholds);
+
+    int ret = sensor_set_plane(mode, plane, &thresholds, invert);
+    list_free(&thresholds);
+
+    if (ret != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid capture plane!"));
+    }
+
+    // The line callback writes to the plane, keep it alive while it's set.
+    gc_stats_set_root(GC_STATS_ROOT_SENSOR_PLANE, (mode != PLANE_NONE) ? args[1] : NULL);
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_set_motion_detection(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int threshold = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 16);
+    if (sensor_set_motion(mp_obj_is_true(args[0]), threshold) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid motion detection settings!"));
+    }
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_set_gamma_corr(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    float gamma = py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_gamma), 1.0f);
+    float contrast = py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_contrast), 1.0f);
+    float brightness = py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_brightness), 0.0f);
+    if (sensor_set_gamma_corr(mp_obj_is_true(args[0]), gamma, contrast, brightness) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid gamma correction settings!"));
+    }
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_get_motion_score() {
+    return mp_obj_new_int(sensor_get_motion(NULL));
+}
+
+static mp_obj_t py_sensor_get_motion_map() {
+    // Binary image with one bit per grid cell.
+    uint32_t *bitmap = xalloc(SENSOR_MOTION_GRID_H * sizeof(uint32_t));
+    sensor_get_motion(bitmap);
+    return py_image(SENSOR_MOTION_GRID_W, SENSOR_MOTION_GRID_H, IMAGE_BPP_BINARY, bitmap);
+}
+
+static mp_obj_t py_sensor_set_native_ae(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int target = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_target), 96);
+    float speed = py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_speed), 0.5f);
+    int max_exposure_us = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_exposure_us), 33333);
+    float max_gain_db = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_gain_db), 18.0f);
+    bool awb = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_awb), false);
+    if (sensor_set_native_ae(mp_obj_is_true(args[0]), target, speed, max_exposure_us, max_gain_db, awb) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Invalid native auto exposure settings!"));
+    }
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_get_native_ae() {
+    int mean, exposure_us;
+    float gain_db;
+    if (sensor_get_native_ae(&mean, &exposure_us, &gain_db) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, "Native auto exposure is not enabled!"));
+    }
+    return mp_obj_new_tuple(3, (mp_obj_t []) {mp_obj_new_int(mean),
+                                              mp_obj_new_int(exposure_us),
+                                              mp_obj_new_float(gain_db)});
+}
+
+static mp_obj_t py_sensor_set_jpeg_stream(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int quality = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_quality), 90);
+    if (sensor_set_jpeg_stream(mp_obj_is_true(args[0]), quality) != 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "JPEG streaming is not supported!"));
+    }
+    return mp_const_none;
+}
+
+static mp_obj_t py_sensor_get_jpeg_stream() {
+    image_t image;
+    if (sensor_get_jpeg_stream(&image) != 0) {
+        return mp_const_none;
+    }
+    return py_image_from_struct(&image);
+}
+
+static mp_obj_t py_sensor_get_dropped_frames() {
+    return mp_obj_new_int_from_uint(sensor_get_dropped_frames());
+}
+
 static mp_obj_t py_sensor_set_special_effect(mp_obj_t sde) {
     if (sensor_set_special_effect(mp_obj_get_int(sde)) != 0) {
         return mp_const_false;
@@ -460,6 +611,35 @@ static mp_obj_t py_sensor_set_vsync_output(mp_obj_t pin_obj) {
     return mp_const_true;
 }
 
+// Sync input pin (see set_sync_input), its EXTI callback runs in the interrupt.
+static pin_obj_t *sync_pin = NULL;
+
+static mp_obj_t py_sensor_sync_input_callback(mp_obj_t line_obj) {
+    if (sync_pin) {
+        sensor_sync_input_callback(HAL_GPIO_ReadPin(sync_pin->gpio, sync_pin->pin_mask));
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_sync_input_callback_obj, py_sensor_sync_input_callback);
+
+static mp_obj_t py_sensor_set_sync_input(mp_obj_t pin_obj) {
+    if (sync_pin) {
+        extint_register(MP_OBJ_FROM_PTR(sync_pin), GPIO_MODE_IT_RISING_FALLING, GPIO_NOPULL, mp_const_none, true);
+        sync_pin = NULL;
+        sensor_set_sync_input(false);
+    }
+
+    if (pin_obj != mp_const_none) {
+        if (sensor_set_sync_input(true) != 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, "Sensor doesn't support a sync input!"));
+        }
+        sync_pin = pin_obj;
+        extint_register(pin_obj, GPIO_MODE_IT_RISING_FALLING, GPIO_NOPULL,
+                        (mp_obj_t) &py_sensor_sync_input_callback_obj, true);
+    }
+    return mp_const_none;
+}
+
 static mp_obj_t py_sensor_ioctl(uint n_args, const mp_obj_t *args)
 {
     mp_obj_t ret_obj = mp_const_none;
@@ -511,14 +691,31 @@ static mp_obj_t py_sensor_ioctl(uint n_args, const mp_obj_t *args)
             break;
         }
 
-        case IOCTL_SET_TRIGGERED_MODE: {
+        case IOCTL_SET_TRIGGERED_MODE:
+        case IOCTL_SET_PIPELINED_MODE:
+        case IOCTL_SET_COMPANDING:
+        case IOCTL_SET_HIGH_FPS_MODE: {
             if (n_args < 2 || sensor_ioctl(request, mp_obj_get_int(args[1])) != 0) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
             }
             break;
         }
 
-        case IOCTL_GET_TRIGGERED_MODE: {
+        case IOCTL_SET_HDR_MODE: {
+            // sensor.ioctl(sensor.IOCTL_SET_HDR_MODE, enable[, t2_ratio[, t3_ratio]])
+            int t2_ratio = (n_args > 2) ? mp_obj_get_int(args[2]) : -1;
+            int t3_ratio = (n_args > 3) ? mp_obj_get_int(args[3]) : -1;
+            if (n_args < 2 || sensor_ioctl(request, mp_obj_get_int(args[1]), t2_ratio, t3_ratio) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
+        case IOCTL_GET_TRIGGERED_MODE:
+        case IOCTL_GET_PIPELINED_MODE:
+        case IOCTL_GET_HDR_MODE:
+        case IOCTL_GET_COMPANDING:
+        case IOCTL_GET_HIGH_FPS_MODE: {
             int enabled;
             if (sensor_ioctl(request, &enabled) != 0) {
                 nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
@@ -648,6 +845,93 @@ static mp_obj_t py_sensor_ioctl(uint n_args, const mp_obj_t *args)
             break;
         }
 
+        case IOCTL_LEPTON_GET_MEASUREMENT_STATS: {
+            float min, max;
+            int x, y;
+            if (sensor_ioctl(request, &min, &max, &x, &y) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            ret_obj = mp_obj_new_tuple(4, (mp_obj_t []) {mp_obj_new_float(min), mp_obj_new_float(max),
+                                                          mp_obj_new_int(x), mp_obj_new_int(y)});
+            break;
+        }
+
+        case IOCTL_HIMAX_MD_ENABLE:
+        case IOCTL_HIMAX_MD_THRESHOLD:
+        case IOCTL_HIMAX_OSC_ENABLE: {
+            if (n_args < 2 || sensor_ioctl(request, mp_obj_get_int(args[1])) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
+        case IOCTL_HIMAX_MD_WINDOW: {
+            // sensor.ioctl(sensor.IOCTL_HIMAX_MD_WINDOW, (x, y, w, h))
+            if (n_args < 2) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            mp_obj_t *array;
+            mp_obj_get_array_fixed_n(args[1], 4, &array);
+            if (sensor_ioctl(request, mp_obj_get_int(array[0]), mp_obj_get_int(array[1]),
+                                      mp_obj_get_int(array[2]), mp_obj_get_int(array[3])) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
+        case IOCTL_OV5640_AF_LOAD_FIRMWARE: {
+            // sensor.ioctl(sensor.IOCTL_OV5640_AF_LOAD_FIRMWARE, firmware)
+            mp_buffer_info_t bufinfo;
+            if (n_args < 2) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_READ);
+            if (sensor_ioctl(request, bufinfo.buf, bufinfo.len) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
+        case IOCTL_OV5640_AF_CONTINUOUS: {
+            if (n_args < 2 || sensor_ioctl(request, mp_obj_get_int(args[1])) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
+        case IOCTL_OV5640_AF_ZONE: {
+            // sensor.ioctl(sensor.IOCTL_OV5640_AF_ZONE[, (x, y)]), no zone restores the defaults.
+            int x = -1, y = -1;
+            if (n_args > 1) {
+                mp_obj_t *array;
+                mp_obj_get_array_fixed_n(args[1], 2, &array);
+                x = mp_obj_get_int(array[0]);
+                y = mp_obj_get_int(array[1]);
+            }
+            if (sensor_ioctl(request, x, y) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
+        case IOCTL_OV5640_AF_STATUS: {
+            int state, zones;
+            if (sensor_ioctl(request, &state, &zones) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            ret_obj = mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(state), mp_obj_new_int(zones)});
+            break;
+        }
+
+        case IOCTL_OV5640_AF_TRIGGER:
+        case IOCTL_OV5640_AF_RELEASE:
+        case IOCTL_HIMAX_MD_CLEAR: {
+            if (sensor_ioctl(request) != 0) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Sensor control failed!"));
+            }
+            break;
+        }
+
         default: {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "Operation not supported!"));
             break;
@@ -696,6 +980,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_sleep_obj,               py_sensor_sl
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_shutdown_obj,            py_sensor_shutdown);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_flush_obj,               py_sensor_flush);
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_snapshot_obj, 0,        py_sensor_snapshot);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_snapshot_async_obj,      py_sensor_snapshot_async);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_frame_ready_obj,         py_sensor_frame_ready);
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_skip_frames_obj, 0,     py_sensor_skip_frames);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_width_obj,               py_sensor_width);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_height_obj,              py_sensor_height);
@@ -707,6 +993,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_pixformat_obj,       py_sensor_se
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_pixformat_obj,       py_sensor_get_pixformat);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_framesize_obj,       py_sensor_set_framesize);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_framesize_obj,       py_sensor_get_framesize);
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_sensor_set_mode_obj,            py_sensor_set_mode);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_windowing_obj,       py_sensor_set_windowing);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_windowing_obj,       py_sensor_get_windowing);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_gainceiling_obj,     py_sensor_set_gainceiling);
@@ -729,9 +1016,22 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_transpose_obj,       py_sensor_se
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_transpose_obj,       py_sensor_get_transpose);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_auto_rotation_obj,   py_sensor_set_auto_rotation);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_auto_rotation_obj,   py_sensor_get_auto_rotation);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_framebuffers_obj,    py_sensor_set_framebuffers);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_framebuffers_obj,    py_sensor_get_framebuffers);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_set_capture_plane_obj,1,py_sensor_set_capture_plane);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_set_motion_detection_obj,1,py_sensor_set_motion_detection);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_set_gamma_corr_obj,1,py_sensor_set_gamma_corr);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_motion_score_obj,    py_sensor_get_motion_score);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_motion_map_obj,      py_sensor_get_motion_map);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_set_native_ae_obj,1,py_sensor_set_native_ae);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_native_ae_obj,       py_sensor_get_native_ae);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_sensor_set_jpeg_stream_obj,1,  py_sensor_set_jpeg_stream);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_jpeg_stream_obj,     py_sensor_get_jpeg_stream);
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_dropped_frames_obj,  py_sensor_get_dropped_frames);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_special_effect_obj,  py_sensor_set_special_effect);
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(py_sensor_set_lens_correction_obj, py_sensor_set_lens_correction);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_vsync_output_obj,    py_sensor_set_vsync_output);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_sync_input_obj,      py_sensor_set_sync_input);
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_sensor_ioctl_obj, 1, 5, py_sensor_ioctl);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_sensor_set_color_palette_obj,   py_sensor_set_color_palette);
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_sensor_get_color_palette_obj,   py_sensor_get_color_palette);
@@ -755,6 +1055,16 @@ STATIC const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_LEPTON),              MP_OBJ_NEW_SMALL_INT(LEPTON_ID)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_HM01B0),              MP_OBJ_NEW_SMALL_INT(HM01B0_ID)},
 
+    // Frame buffers
+    { MP_OBJ_NEW_QSTR(MP_QSTR_SINGLE_BUFFER),       MP_OBJ_NEW_SMALL_INT(1)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_DOUBLE_BUFFER),       MP_OBJ_NEW_SMALL_INT(2)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_TRIPLE_BUFFER),       MP_OBJ_NEW_SMALL_INT(3)},
+
+    // Capture planes
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PLANE_NONE),          MP_OBJ_NEW_SMALL_INT(PLANE_NONE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PLANE_L),             MP_OBJ_NEW_SMALL_INT(PLANE_L)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_PLANE_BINARY),        MP_OBJ_NEW_SMALL_INT(PLANE_BINARY)},
+
     // Special effects
     { MP_OBJ_NEW_QSTR(MP_QSTR_NORMAL),              MP_OBJ_NEW_SMALL_INT(SDE_NORMAL)},          /* Normal/No SDE */
     { MP_OBJ_NEW_QSTR(MP_QSTR_NEGATIVE),            MP_OBJ_NEW_SMALL_INT(SDE_NEGATIVE)},        /* Negative image */
@@ -805,6 +1115,14 @@ STATIC const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_GET_READOUT_WINDOW),            MP_OBJ_NEW_SMALL_INT(IOCTL_GET_READOUT_WINDOW)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_SET_TRIGGERED_MODE),            MP_OBJ_NEW_SMALL_INT(IOCTL_SET_TRIGGERED_MODE)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_GET_TRIGGERED_MODE),            MP_OBJ_NEW_SMALL_INT(IOCTL_GET_TRIGGERED_MODE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_SET_PIPELINED_MODE),            MP_OBJ_NEW_SMALL_INT(IOCTL_SET_PIPELINED_MODE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_GET_PIPELINED_MODE),            MP_OBJ_NEW_SMALL_INT(IOCTL_GET_PIPELINED_MODE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_SET_HDR_MODE),                  MP_OBJ_NEW_SMALL_INT(IOCTL_SET_HDR_MODE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_GET_HDR_MODE),                  MP_OBJ_NEW_SMALL_INT(IOCTL_GET_HDR_MODE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_SET_COMPANDING),                MP_OBJ_NEW_SMALL_INT(IOCTL_SET_COMPANDING)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_GET_COMPANDING),                MP_OBJ_NEW_SMALL_INT(IOCTL_GET_COMPANDING)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_SET_HIGH_FPS_MODE),             MP_OBJ_NEW_SMALL_INT(IOCTL_SET_HIGH_FPS_MODE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_GET_HIGH_FPS_MODE),             MP_OBJ_NEW_SMALL_INT(IOCTL_GET_HIGH_FPS_MODE)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_GET_WIDTH),              MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_GET_WIDTH)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_GET_HEIGHT),             MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_GET_HEIGHT)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_GET_RADIOMETRY),         MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_GET_RADIOMETRY)},
@@ -819,6 +1137,21 @@ STATIC const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_GET_MEASUREMENT_MODE),   MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_GET_MEASUREMENT_MODE)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_SET_MEASUREMENT_RANGE),  MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_SET_MEASUREMENT_RANGE)},
     { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_GET_MEASUREMENT_RANGE),  MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_GET_MEASUREMENT_RANGE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_LEPTON_GET_MEASUREMENT_STATS),  MP_OBJ_NEW_SMALL_INT(IOCTL_LEPTON_GET_MEASUREMENT_STATS)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_HIMAX_MD_ENABLE),               MP_OBJ_NEW_SMALL_INT(IOCTL_HIMAX_MD_ENABLE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_HIMAX_MD_WINDOW),               MP_OBJ_NEW_SMALL_INT(IOCTL_HIMAX_MD_WINDOW)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_HIMAX_MD_THRESHOLD),            MP_OBJ_NEW_SMALL_INT(IOCTL_HIMAX_MD_THRESHOLD)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_HIMAX_MD_CLEAR),                MP_OBJ_NEW_SMALL_INT(IOCTL_HIMAX_MD_CLEAR)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_HIMAX_OSC_ENABLE),              MP_OBJ_NEW_SMALL_INT(IOCTL_HIMAX_OSC_ENABLE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_OV5640_AF_LOAD_FIRMWARE),       MP_OBJ_NEW_SMALL_INT(IOCTL_OV5640_AF_LOAD_FIRMWARE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_OV5640_AF_TRIGGER),             MP_OBJ_NEW_SMALL_INT(IOCTL_OV5640_AF_TRIGGER)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_OV5640_AF_CONTINUOUS),          MP_OBJ_NEW_SMALL_INT(IOCTL_OV5640_AF_CONTINUOUS)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_OV5640_AF_RELEASE),             MP_OBJ_NEW_SMALL_INT(IOCTL_OV5640_AF_RELEASE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_OV5640_AF_ZONE),                MP_OBJ_NEW_SMALL_INT(IOCTL_OV5640_AF_ZONE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_IOCTL_OV5640_AF_STATUS),              MP_OBJ_NEW_SMALL_INT(IOCTL_OV5640_AF_STATUS)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_OV5640_AF_IDLE),                      MP_OBJ_NEW_SMALL_INT(OV5640_AF_STATE_IDLE)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_OV5640_AF_FOCUSING),                  MP_OBJ_NEW_SMALL_INT(OV5640_AF_STATE_FOCUSING)},
+    { MP_OBJ_NEW_QSTR(MP_QSTR_OV5640_AF_FOCUSED),                   MP_OBJ_NEW_SMALL_INT(OV5640_AF_STATE_FOCUSED)},
 
     // Sensor functions
     { MP_OBJ_NEW_QSTR(MP_QSTR_reset),               (mp_obj_t)&py_sensor_reset_obj },
@@ -826,6 +1159,8 @@ STATIC const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_shutdown),            (mp_obj_t)&py_sensor_shutdown_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_flush),               (mp_obj_t)&py_sensor_flush_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_snapshot),            (mp_obj_t)&py_sensor_snapshot_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_snapshot_async),      (mp_obj_t)&py_sensor_snapshot_async_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_frame_ready),         (mp_obj_t)&py_sensor_frame_ready_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_skip_frames),         (mp_obj_t)&py_sensor_skip_frames_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_width),               (mp_obj_t)&py_sensor_width_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_height),              (mp_obj_t)&py_sensor_height_obj },
@@ -837,6 +1172,7 @@ STATIC const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_pixformat),       (mp_obj_t)&py_sensor_get_pixformat_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_framesize),       (mp_obj_t)&py_sensor_set_framesize_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_framesize),       (mp_obj_t)&py_sensor_get_framesize_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_mode),            (mp_obj_t)&py_sensor_set_mode_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_windowing),       (mp_obj_t)&py_sensor_set_windowing_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_windowing),       (mp_obj_t)&py_sensor_get_windowing_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_gainceiling),     (mp_obj_t)&py_sensor_set_gainceiling_obj },
@@ -859,9 +1195,22 @@ STATIC const mp_map_elem_t globals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_transpose),       (mp_obj_t)&py_sensor_get_transpose_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_auto_rotation),   (mp_obj_t)&py_sensor_set_auto_rotation_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_auto_rotation),   (mp_obj_t)&py_sensor_get_auto_rotation_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_framebuffers),    (mp_obj_t)&py_sensor_set_framebuffers_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_framebuffers),    (mp_obj_t)&py_sensor_get_framebuffers_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_capture_plane),   (mp_obj_t)&py_sensor_set_capture_plane_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_motion_detection),(mp_obj_t)&py_sensor_set_motion_detection_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_gamma_corr),      (mp_obj_t)&py_sensor_set_gamma_corr_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_motion_score),    (mp_obj_t)&py_sensor_get_motion_score_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_motion_map),      (mp_obj_t)&py_sensor_get_motion_map_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_native_ae),       (mp_obj_t)&py_sensor_set_native_ae_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_native_ae),       (mp_obj_t)&py_sensor_get_native_ae_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_jpeg_stream),     (mp_obj_t)&py_sensor_set_jpeg_stream_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_jpeg_stream),     (mp_obj_t)&py_sensor_get_jpeg_stream_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_dropped_frames),  (mp_obj_t)&py_sensor_get_dropped_frames_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_special_effect),  (mp_obj_t)&py_sensor_set_special_effect_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_lens_correction), (mp_obj_t)&py_sensor_set_lens_correction_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_vsync_output),    (mp_obj_t)&py_sensor_set_vsync_output_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_sync_input),      (mp_obj_t)&py_sensor_set_sync_input_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_ioctl),               (mp_obj_t)&py_sensor_ioctl_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_color_palette),   (mp_obj_t)&py_sensor_set_color_palette_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_color_palette),   (mp_obj_t)&py_sensor_get_color_palette_obj },
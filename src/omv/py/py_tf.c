@@ -7,7 +7,10 @@
 #include "py_helper.h"
 #include "py_image.h"
 #include "ff_wrapper.h"
+#include "framebuffer.h"
+#include "assets.h"
 #include "libtf.h"
+#include "nn_backend.h"
 #include "libtf_person_detect_model_data.h"
 
 #ifdef IMLIB_ENABLE_TF
@@ -49,7 +52,7 @@ STATIC void py_tf_model_print(const mp_print_t *print, mp_obj_t self_in, mp_prin
 #define py_tf_classification_obj_size 5
 typedef struct py_tf_classification_obj {
     mp_obj_base_t base;
-    mp_obj_t x, y, w, h, output;
+    mp_obj_t x, y, w, h, output, frame;
 } py_tf_classification_obj_t;
 
 STATIC void py_tf_classification_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
@@ -62,6 +65,8 @@ STATIC void py_tf_classification_print(const mp_print_t *print, mp_obj_t self_in
               mp_obj_get_int(self->w),
               mp_obj_get_int(self->h));
     mp_obj_print_helper(print, self->output, kind);
+    mp_printf(print, ", \"frame\":");
+    mp_obj_print_helper(print, self->frame, kind);
     mp_printf(print, "}");
 }
 
@@ -102,6 +107,7 @@ mp_obj_t py_tf_classification_y(mp_obj_t self_in) { return ((py_tf_classificatio
 mp_obj_t py_tf_classification_w(mp_obj_t self_in) { return ((py_tf_classification_obj_t *) self_in)->w; }
 mp_obj_t py_tf_classification_h(mp_obj_t self_in) { return ((py_tf_classification_obj_t *) self_in)->h; }
 mp_obj_t py_tf_classification_output(mp_obj_t self_in) { return ((py_tf_classification_obj_t *) self_in)->output; }
+mp_obj_t py_tf_classification_frame(mp_obj_t self_in) { return ((py_tf_classification_obj_t *) self_in)->frame; }
 
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_rect_obj, py_tf_classification_rect);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_x_obj, py_tf_classification_x);
@@ -109,6 +115,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_y_obj, py_tf_classificatio
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_w_obj, py_tf_classification_w);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_h_obj, py_tf_classification_h);
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_output_obj, py_tf_classification_output);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_tf_classification_frame_obj, py_tf_classification_frame);
 
 STATIC const mp_rom_map_elem_t py_tf_classification_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_rect), MP_ROM_PTR(&py_tf_classification_rect_obj) },
@@ -116,7 +123,8 @@ STATIC const mp_rom_map_elem_t py_tf_classification_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_y), MP_ROM_PTR(&py_tf_classification_y_obj) },
     { MP_ROM_QSTR(MP_QSTR_w), MP_ROM_PTR(&py_tf_classification_w_obj) },
     { MP_ROM_QSTR(MP_QSTR_h), MP_ROM_PTR(&py_tf_classification_h_obj) },
-    { MP_ROM_QSTR(MP_QSTR_output), MP_ROM_PTR(&py_tf_classification_output_obj) }
+    { MP_ROM_QSTR(MP_QSTR_output), MP_ROM_PTR(&py_tf_classification_output_obj) },
+    { MP_ROM_QSTR(MP_QSTR_frame), MP_ROM_PTR(&py_tf_classification_frame_obj) }
 };
 
 STATIC MP_DEFINE_CONST_DICT(py_tf_classification_locals_dict, py_tf_classification_locals_dict_table);
@@ -131,6 +139,61 @@ static const mp_obj_type_t py_tf_classification_type = {
 
 static const mp_obj_type_t py_tf_model_type;
 
+// Results are tagged with the sequence number of the frame they were computed from (None if the
+// image isn't a frame buffer). With sensor.set_framebuffers(2) or more the next frame is captured
+// while the model runs, so results can be matched with frames that were captured meanwhile.
+static mp_obj_t py_tf_frame(image_t *img)
+{
+    if ((img->data >= MAIN_FB()->pixels) && (img->data < (uint8_t *) MAIN_FB_PIXELS())) {
+        return mp_obj_new_int_from_uint(MAIN_FB()->frame_count);
+    }
+
+    return mp_const_none;
+}
+
+// Getting the input shape sets up the whole interpreter, so the shape of the last model loaded is
+// kept. Built-in and asset store models are matched by their data, files by path, size and date.
+#define PY_TF_SHAPE_CACHE_PATH_LEN 63
+typedef struct py_tf_shape_cache {
+    bool valid;
+    const unsigned char *model_data;
+    char path[PY_TF_SHAPE_CACHE_PATH_LEN + 1];
+    uint32_t size, date;
+    unsigned int height, width, channels;
+    bool signed_or_unsigned;
+    bool is_float;
+} py_tf_shape_cache_t;
+
+static py_tf_shape_cache_t py_tf_shape_cache;
+
+// Fills in the key of the model, returns false if the model can't be cached.
+STATIC bool py_tf_shape_cache_key(py_tf_shape_cache_t *key, const char *path, const unsigned char *model_data)
+{
+    memset(key, 0, sizeof(py_tf_shape_cache_t));
+    key->model_data = model_data;
+
+    if (!model_data) {
+        FILINFO fno;
+        if ((strlen(path) > PY_TF_SHAPE_CACHE_PATH_LEN) || (f_stat_helper(path, &fno) != FR_OK)) {
+            return false;
+        }
+        strcpy(key->path, path);
+        key->size = fno.fsize;
+        key->date = (fno.fdate << 16) | fno.ftime;
+    }
+
+    return true;
+}
+
+STATIC bool py_tf_shape_cache_match(py_tf_shape_cache_t *key)
+{
+    return py_tf_shape_cache.valid
+        && (py_tf_shape_cache.model_data == key->model_data)
+        && (py_tf_shape_cache.size == key->size)
+        && (py_tf_shape_cache.date == key->date)
+        && (!strcmp(py_tf_shape_cache.path, key->path));
+}
+
 STATIC mp_obj_t int_py_tf_load(mp_obj_t path_obj, bool alloc_mode, bool helper_mode)
 {
     if (!helper_mode) {
@@ -141,38 +204,79 @@ STATIC mp_obj_t int_py_tf_load(mp_obj_t path_obj, bool alloc_mode, bool helper_m
     py_tf_model_obj_t *tf_model = m_new_obj(py_tf_model_obj_t);
     tf_model->base.type = &py_tf_model_type;
 
+    const void *asset_data;
+    uint32_t asset_size;
+    py_tf_shape_cache_t key;
+    bool cacheable, in_flash = true;
+
     if (!strcmp(path, "person_detection")) {
         tf_model->model_data = (unsigned char *) g_person_detect_model_data;
         tf_model->model_data_len = g_person_detect_model_data_len;
+        cacheable = py_tf_shape_cache_key(&key, path, tf_model->model_data);
+    } else if (assets_find(path, &asset_data, &asset_size)) {
+        // Run the model in place from the asset store.
+        tf_model->model_data = (unsigned char *) asset_data;
+        tf_model->model_data_len = asset_size;
+        cacheable = py_tf_shape_cache_key(&key, path, tf_model->model_data);
     } else {
+        cacheable = py_tf_shape_cache_key(&key, path, NULL);
+        in_flash = false;
         FIL fp;
         file_read_open(&fp, path);
+        file_fast_seek_on(&fp);
         tf_model->model_data_len = f_size(&fp);
         tf_model->model_data = alloc_mode
-            ? fb_alloc(tf_model->model_data_len, FB_ALLOC_NO_HINT)
-            : xalloc(tf_model->model_data_len);
+            ? fb_alloc(tf_model->model_data_len, FB_ALLOC_PREFER_SPEED)
+            : xalloc_data(tf_model->model_data_len);
         read_data(&fp, tf_model->model_data, tf_model->model_data_len);
         file_close(&fp);
     }
 
+    // Models in flash run in place, load_to_fb copies them to the frame buffer instead, which is
+    // internal SRAM first (FB_ALLOC_PREFER_SPEED) so the weights aren't fetched from the QSPI flash
+    // on every cache miss. Helper loads are only used for one call so copying them isn't worth it.
+    if (alloc_mode && (!helper_mode) && in_flash) {
+        unsigned char *model_data = fb_alloc(tf_model->model_data_len, FB_ALLOC_PREFER_SPEED);
+        memcpy(model_data, tf_model->model_data, tf_model->model_data_len);
+        tf_model->model_data = model_data;
+    }
+
     if (!helper_mode) {
         alloc_putchar_buffer();
     }
 
-    uint32_t tensor_arena_size;
-    uint8_t *tensor_arena = fb_alloc_all(&tensor_arena_size, FB_ALLOC_PREFER_SIZE);
-
-    PY_ASSERT_FALSE_MSG(libtf_get_input_data_hwc(tf_model->model_data,
-                                                 tensor_arena,
-                                                 tensor_arena_size,
-                                                 &tf_model->height,
-                                                 &tf_model->width,
-                                                 &tf_model->channels,
-                                                 &tf_model->signed_or_unsigned,
-                                                 &tf_model->is_float),
-                        py_tf_putchar_buffer - (PY_TF_PUTCHAR_BUFFER_LEN - py_tf_putchar_buffer_len));
+    if (cacheable && py_tf_shape_cache_match(&key)) {
+        tf_model->height = py_tf_shape_cache.height;
+        tf_model->width = py_tf_shape_cache.width;
+        tf_model->channels = py_tf_shape_cache.channels;
+        tf_model->signed_or_unsigned = py_tf_shape_cache.signed_or_unsigned;
+        tf_model->is_float = py_tf_shape_cache.is_float;
+    } else {
+        uint32_t tensor_arena_size;
+        uint8_t *tensor_arena = fb_alloc_all(&tensor_arena_size, FB_ALLOC_PREFER_SIZE);
 
-    fb_free(); // free fb_alloc_all()
+        PY_ASSERT_FALSE_MSG(libtf_get_input_data_hwc(tf_model->model_data,
+                                                     tensor_arena,
+                                                     tensor_arena_size,
+                                                     &tf_model->height,
+                                                     &tf_model->width,
+                                                     &tf_model->channels,
+                                                     &tf_model->signed_or_unsigned,
+                                                     &tf_model->is_float),
+                            py_tf_putchar_buffer - (PY_TF_PUTCHAR_BUFFER_LEN - py_tf_putchar_buffer_len));
+
+        fb_free(); // free fb_alloc_all()
+
+        if (cacheable) {
+            key.valid = true;
+            key.height = tf_model->height;
+            key.width = tf_model->width;
+            key.channels = tf_model->channels;
+            key.signed_or_unsigned = tf_model->signed_or_unsigned;
+            key.is_float = tf_model->is_float;
+            py_tf_shape_cache = key;
+        }
+    }
 
     if (!helper_mode) {
         fb_free(); // free alloc_putchar_buffer()
@@ -216,6 +320,7 @@ typedef struct py_tf_input_data_callback_data {
     rectangle_t *roi;
 } py_tf_input_data_callback_data_t;
 
+// Needs nn_input_prepare_size() bytes of fb_alloc memory on top of the tensor arena.
 STATIC void py_tf_input_data_callback(void *callback_data,
                                       void *model_input,
                                       const unsigned int input_height,
@@ -225,134 +330,34 @@ STATIC void py_tf_input_data_callback(void *callback_data,
                                       const bool is_float)
 {
     py_tf_input_data_callback_data_t *arg = (py_tf_input_data_callback_data_t *) callback_data;
-    int shift = signed_or_unsigned ? 128 : 0;
-    float fscale = 1.0f / (signed_or_unsigned ? 128.0f: 255.0f);
-
-    float xscale = input_width / ((float) arg->roi->w);
-    float yscale = input_height / ((float) arg->roi->h);
-    // MAX == KeepAspectRationByExpanding - MIN == KeepAspectRatio
-    float scale = IM_MAX(xscale, yscale), scale_inv = 1 / scale;
-    float x_offset = ((arg->roi->w * scale) - input_width) / 2;
-    float y_offset = ((arg->roi->h * scale) - input_height) / 2;
-
-    switch (arg->img->bpp) {
-        case IMAGE_BPP_BINARY: {
-            for (int y = 0, yy = input_height; y < yy; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(arg->img, fast_floorf((y + y_offset) * scale_inv) + arg->roi->y);
-                int row = input_width * y;
-                for (int x = 0, xx = input_width; x < xx; x++) {
-                    int pixel = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, fast_floorf((x + x_offset) * scale_inv) + arg->roi->x);
-                    int index = row + x;
-                    switch (input_channels) {
-                        case 1: {
-                            if (!is_float) {
-                                ((uint8_t *) model_input)[index] = COLOR_BINARY_TO_GRAYSCALE(pixel) ^ shift;
-                            } else {
-                                ((float *) model_input)[index] = (COLOR_BINARY_TO_GRAYSCALE(pixel) - shift) * fscale;
-                            }
-                            break;
-                        }
-                        case 3: {
-                            int index_3 = index * 3;
-                            pixel = COLOR_BINARY_TO_RGB565(pixel);
-                            if (!is_float) {
-                                ((uint8_t *) model_input)[index_3 + 0] = COLOR_RGB565_TO_R8(pixel) ^ shift;
-                                ((uint8_t *) model_input)[index_3 + 1] = COLOR_RGB565_TO_G8(pixel) ^ shift;
-                                ((uint8_t *) model_input)[index_3 + 2] = COLOR_RGB565_TO_B8(pixel) ^ shift;
-                            } else {
-                                ((float *) model_input)[index_3 + 0] = (COLOR_RGB565_TO_R8(pixel) - shift) * fscale;
-                                ((float *) model_input)[index_3 + 1] = (COLOR_RGB565_TO_G8(pixel) - shift) * fscale;
-                                ((float *) model_input)[index_3 + 2] = (COLOR_RGB565_TO_B8(pixel) - shift) * fscale;
-                            }
-                            break;
-                        }
-                        default: {
-                            break;
-                        }
-                    }
-                }
-            }
-            break;
-        }
-        case IMAGE_BPP_GRAYSCALE: {
-            for (int y = 0, yy = input_height; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(arg->img, fast_floorf((y + y_offset) * scale_inv) + arg->roi->y);
-                int row = input_width * y;
-                for (int x = 0, xx = input_width; x < xx; x++) {
-                    int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, fast_floorf((x + x_offset) * scale_inv) + arg->roi->x);
-                    int index = row + x;
-                    switch (input_channels) {
-                        case 1: {
-                            if (!is_float) {
-                                ((uint8_t *) model_input)[index] = pixel ^ shift;
-                            } else {
-                                ((float *) model_input)[index] = (pixel - shift) * fscale;
-                            }
-                            break;
-                        }
-                        case 3: {
-                            int index_3 = index * 3;
-                            pixel = COLOR_GRAYSCALE_TO_RGB565(pixel);
-                            if (!is_float) {
-                                ((uint8_t *) model_input)[index_3 + 0] = COLOR_RGB565_TO_R8(pixel) ^ shift;
-                                ((uint8_t *) model_input)[index_3 + 1] = COLOR_RGB565_TO_G8(pixel) ^ shift;
-                                ((uint8_t *) model_input)[index_3 + 2] = COLOR_RGB565_TO_B8(pixel) ^ shift;
-                            } else {
-                                ((float *) model_input)[index_3 + 0] = (COLOR_RGB565_TO_R8(pixel) - shift) * fscale;
-                                ((float *) model_input)[index_3 + 1] = (COLOR_RGB565_TO_G8(pixel) - shift) * fscale;
-                                ((float *) model_input)[index_3 + 2] = (COLOR_RGB565_TO_B8(pixel) - shift) * fscale;
-                            }
-                            break;
-                        }
-                        default: {
-                            break;
-                        }
-                    }
-                }
-            }
-            break;
-        }
-        case IMAGE_BPP_RGB565: {
-            for (int y = 0, yy = input_height; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(arg->img, fast_floorf((y + y_offset) * scale_inv) + arg->roi->y);
-                int row = input_width * y;
-                for (int x = 0, xx = input_width; x < xx; x++) {
-                    int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, fast_floorf((x + x_offset) * scale_inv) + arg->roi->x);
-                    int index = row + x;
-                    switch (input_channels) {
-                        case 1: {
-                            if (!is_float) {
-                                ((uint8_t *) model_input)[index] = COLOR_RGB565_TO_GRAYSCALE(pixel) ^ shift;
-                            } else {
-                                ((float *) model_input)[index] = (COLOR_RGB565_TO_GRAYSCALE(pixel) - shift) * fscale;
-                            }
-                            break;
-                        }
-                        case 3: {
-                            int index_3 = index * 3;
-                            if (!is_float) {
-                                ((uint8_t *) model_input)[index_3 + 0] = COLOR_RGB565_TO_R8(pixel) ^ shift;
-                                ((uint8_t *) model_input)[index_3 + 1] = COLOR_RGB565_TO_G8(pixel) ^ shift;
-                                ((uint8_t *) model_input)[index_3 + 2] = COLOR_RGB565_TO_B8(pixel) ^ shift;
-                            } else {
-                                ((float *) model_input)[index_3 + 0] = (COLOR_RGB565_TO_R8(pixel) - shift) * fscale;
-                                ((float *) model_input)[index_3 + 1] = (COLOR_RGB565_TO_G8(pixel) - shift) * fscale;
-                                ((float *) model_input)[index_3 + 2] = (COLOR_RGB565_TO_B8(pixel) - shift) * fscale;
-                            }
-                            break;
-                        }
-                        default: {
-                            break;
-                        }
-                    }
-                }
-            }
-            break;
-        }
-        default: {
-            break;
-        }
-    }
+    float shift = signed_or_unsigned ? 128.0f : 0.0f;
+
+    nn_input_t input = {
+        .w = input_width,
+        .h = input_height,
+        .c = input_channels,
+        .type = is_float ? NN_INPUT_FLOAT : (signed_or_unsigned ? NN_INPUT_INT8 : NN_INPUT_UINT8),
+        .keep_aspect = true,
+        .mean = { shift, shift, shift },
+        .scale = 1.0f / (signed_or_unsigned ? 128.0f: 255.0f)
+    };
+
+    nn_input_prepare(&input, arg->img, arg->roi, model_input, 0, input_height);
+}
+
+// Allocates the tensor arena from the rest of the frame buffer, leaving the memory the input
+// callback needs for the model input.
+STATIC uint8_t *py_tf_tensor_arena(py_tf_model_obj_t *model, uint32_t *tensor_arena_size)
+{
+    nn_input_t input = { .w = model->width, .h = model->height, .c = model->channels };
+    uint32_t reserve = nn_input_prepare_size(&input);
+
+    fb_alloc_all(tensor_arena_size, FB_ALLOC_PREFER_SIZE);
+    fb_free();
+
+    PY_ASSERT_TRUE_MSG(*tensor_arena_size > reserve, "Out of memory for the tensor arena!");
+    *tensor_arena_size -= reserve;
+    return fb_alloc(*tensor_arena_size, FB_ALLOC_PREFER_SIZE);
 }
 
 typedef struct py_tf_classify_output_data_callback_data {
@@ -384,6 +389,97 @@ STATIC void py_tf_classify_output_data_callback(void *callback_data,
     }
 }
 
+typedef struct py_tf_backend_data {
+    rectangle_t *roi;
+    nn_output_cb_t cb;
+    void *arg;
+} py_tf_backend_data_t;
+
+STATIC void py_tf_backend_output_data_callback(void *callback_data,
+                                               void *model_output,
+                                               const unsigned int output_height,
+                                               const unsigned int output_width,
+                                               const unsigned int output_channels,
+                                               const bool signed_or_unsigned,
+                                               const bool is_float)
+{
+    py_tf_backend_data_t *arg = (py_tf_backend_data_t *) callback_data;
+
+    nn_output_t output = {
+        .data = model_output,
+        .w = output_width,
+        .h = output_height,
+        .c = output_channels,
+        .is_float = is_float,
+        .is_signed = signed_or_unsigned
+    };
+
+    arg->cb(arg->arg, arg->roi, &output);
+}
+
+// Runs a py_tf_model_obj_t, the putchar buffer must be allocated.
+STATIC int py_tf_backend_run(void *model, image_t *img, rectangle_t *roi, nn_output_cb_t cb, void *arg)
+{
+    py_tf_model_obj_t *tf_model = (py_tf_model_obj_t *) model;
+    py_tf_input_data_callback_data_t input_data = { .img = img, .roi = roi };
+    py_tf_backend_data_t output_data = { .roi = roi, .cb = cb, .arg = arg };
+
+    fb_alloc_mark();
+    uint32_t tensor_arena_size;
+    uint8_t *tensor_arena = py_tf_tensor_arena(tf_model, &tensor_arena_size);
+
+    int ret = libtf_invoke(tf_model->model_data,
+                           tensor_arena,
+                           tensor_arena_size,
+                           py_tf_input_data_callback,
+                           &input_data,
+                           py_tf_backend_output_data_callback,
+                           &output_data);
+
+    fb_alloc_free_till_mark();
+    return ret;
+}
+
+const nn_backend_t nn_backend_tf = { "TensorFlow Lite", 2, py_tf_backend_run };
+
+STATIC void py_tf_windows_args(uint n_args, const mp_obj_t *args, mp_map_t *kw_args, nn_windows_t *windows)
+{
+    windows->min_scale = py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_min_scale), 1.0f);
+    PY_ASSERT_TRUE_MSG((0.0f < windows->min_scale) && (windows->min_scale <= 1.0f), "0 < min_scale <= 1");
+
+    windows->scale_mul = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale_mul), 0.5f);
+    PY_ASSERT_TRUE_MSG((0.0f <= windows->scale_mul) && (windows->scale_mul < 1.0f), "0 <= scale_mul < 1");
+
+    windows->x_overlap = py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_overlap), 0.0f);
+    PY_ASSERT_TRUE_MSG(((0.0f <= windows->x_overlap) && (windows->x_overlap < 1.0f)) || (windows->x_overlap == -1.0f), "0 <= x_overlap < 1");
+
+    windows->y_overlap = py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_overlap), 0.0f);
+    PY_ASSERT_TRUE_MSG(((0.0f <= windows->y_overlap) && (windows->y_overlap < 1.0f)) || (windows->y_overlap == -1.0f), "0 <= y_overlap < 1");
+}
+
+typedef struct py_tf_classify_window_data {
+    mp_obj_t objects_list;
+    mp_obj_t frame;
+} py_tf_classify_window_data_t;
+
+STATIC void py_tf_classify_window_callback(void *arg, rectangle_t *roi, const nn_output_t *output)
+{
+    py_tf_classify_window_data_t *data = (py_tf_classify_window_data_t *) arg;
+    py_tf_classify_output_data_callback_data_t classify;
+    py_tf_classify_output_data_callback(&classify, (void *) output->data, output->h, output->w, output->c,
+                                        output->is_signed, output->is_float);
+
+    py_tf_classification_obj_t *o = m_new_obj(py_tf_classification_obj_t);
+    o->base.type = &py_tf_classification_type;
+    o->x = mp_obj_new_int(roi->x);
+    o->y = mp_obj_new_int(roi->y);
+    o->w = mp_obj_new_int(roi->w);
+    o->h = mp_obj_new_int(roi->h);
+    o->output = classify.out;
+    o->frame = data->frame;
+    mp_obj_list_append(data->objects_list, o);
+}
+
 STATIC mp_obj_t py_tf_classify(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     fb_alloc_mark();
@@ -395,80 +491,297 @@ STATIC mp_obj_t py_tf_classify(uint n_args, const mp_obj_t *args, mp_map_t *kw_a
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
 
-    float arg_min_scale = py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_min_scale), 1.0f);
-    PY_ASSERT_TRUE_MSG((0.0f < arg_min_scale) && (arg_min_scale <= 1.0f), "0 < min_scale <= 1");
+    nn_windows_t windows;
+    py_tf_windows_args(n_args, args, kw_args, &windows);
+    py_helper_keyword_time_budget(n_args, args, 7, kw_args, 0);
 
-    float arg_scale_mul = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale_mul), 0.5f);
-    PY_ASSERT_TRUE_MSG((0.0f <= arg_scale_mul) && (arg_scale_mul < 1.0f), "0 <= scale_mul < 1");
+    nn_model_t model = { .backend = &nn_backend_tf, .model = arg_model };
+    py_tf_classify_window_data_t data = { .objects_list = mp_obj_new_list(0, NULL), .frame = py_tf_frame(arg_img) };
 
-    float arg_x_overlap = py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_overlap), 0.0f);
-    PY_ASSERT_TRUE_MSG(((0.0f <= arg_x_overlap) && (arg_x_overlap < 1.0f)) || (arg_x_overlap == -1.0f), "0 <= x_overlap < 1");
+    PY_ASSERT_FALSE_MSG(nn_model_run_windows(&model, arg_img, &roi, &windows, py_tf_classify_window_callback, &data),
+                        py_tf_putchar_buffer - (PY_TF_PUTCHAR_BUFFER_LEN - py_tf_putchar_buffer_len));
 
-    float arg_y_overlap = py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_overlap), 0.0f);
-    PY_ASSERT_TRUE_MSG(((0.0f <= arg_y_overlap) && (arg_y_overlap < 1.0f)) || (arg_y_overlap == -1.0f), "0 <= y_overlap < 1");
+    fb_alloc_free_till_mark();
 
-    uint32_t tensor_arena_size;
-    uint8_t *tensor_arena = fb_alloc_all(&tensor_arena_size, FB_ALLOC_PREFER_SIZE);
+    return data.objects_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_tf_classify_obj, 2, py_tf_classify);
 
+// Non-maximum suppression of the detections in the list (see rectangle_nms()), the data of each
+// detection is its output object, or NULL for a (class, score) tuple. The list is freed.
+STATIC mp_obj_t py_tf_nms_objects(list_t *out, float iou_threshold, mp_obj_t frame)
+{
+    int n = list_size(out);
+    rectangle_score_t *boxes = n ? xalloc(n * sizeof(rectangle_score_t)) : NULL;
+
+    for (int i = 0; i < n; i++) {
+        list_pop_front(out, &boxes[i]);
+    }
+
+    n = rectangle_nms(boxes, n, iou_threshold);
     mp_obj_t objects_list = mp_obj_new_list(0, NULL);
 
-    for (float scale = 1.0f; scale >= arg_min_scale; scale *= arg_scale_mul) {
-        // Either provide a subtle offset to center multiple detection windows or center the only detection window.
-        for (int y = roi.y + ((arg_y_overlap != -1.0f) ? (fmodf(roi.h, (roi.h * scale)) / 2.0f) : ((roi.h - (roi.h * scale)) / 2.0f));
-            // Finish when the detection window is outside of the ROI.
-            (y + (roi.h * scale)) <= (roi.y + roi.h);
-            // Step by an overlap amount accounting for scale or just terminate after one iteration.
-            y += ((arg_y_overlap != -1.0f) ? (roi.h * scale * (1.0f - arg_y_overlap)) : roi.h)) {
-            // Either provide a subtle offset to center multiple detection windows or center the only detection window.
-            for (int x = roi.x + ((arg_x_overlap != -1.0f) ? (fmodf(roi.w, (roi.w * scale)) / 2.0f) : ((roi.w - (roi.w * scale)) / 2.0f));
-                // Finish when the detection window is outside of the ROI.
-                (x + (roi.w * scale)) <= (roi.x + roi.w);
-                // Step by an overlap amount accounting for scale or just terminate after one iteration.
-                x += ((arg_x_overlap != -1.0f) ? (roi.w * scale * (1.0f - arg_x_overlap)) : roi.w)) {
+    for (int i = 0; i < n; i++) {
+        py_tf_classification_obj_t *o = m_new_obj(py_tf_classification_obj_t);
+        o->base.type = &py_tf_classification_type;
+        o->x = mp_obj_new_int(boxes[i].rect.x);
+        o->y = mp_obj_new_int(boxes[i].rect.y);
+        o->w = mp_obj_new_int(boxes[i].rect.w);
+        o->h = mp_obj_new_int(boxes[i].rect.h);
+        o->output = boxes[i].data ? boxes[i].data
+            : mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_int(boxes[i].index), mp_obj_new_float(boxes[i].score)});
+        o->frame = frame;
+        mp_obj_list_append(objects_list, o);
+    }
 
-                rectangle_t new_roi;
-                rectangle_init(&new_roi, x, y, roi.w * scale, roi.h * scale);
+    if (boxes) {
+        xfree(boxes);
+    }
 
-                if (rectangle_overlap(&roi, &new_roi)) { // Check if new_roi is null...
+    return objects_list;
+}
 
-                    py_tf_input_data_callback_data_t py_tf_input_data_callback_data;
-                    py_tf_input_data_callback_data.img = arg_img;
-                    py_tf_input_data_callback_data.roi = &new_roi;
+typedef struct py_tf_detect_window_data {
+    float threshold;
+    list_t *out;
+} py_tf_detect_window_data_t;
 
-                    py_tf_classify_output_data_callback_data_t py_tf_classify_output_data_callback_data;
+STATIC void py_tf_detect_window_callback(void *arg, rectangle_t *roi, const nn_output_t *output)
+{
+    py_tf_detect_window_data_t *data = (py_tf_detect_window_data_t *) arg;
+    rectangle_score_t lnk_data;
+    lnk_data.index = nn_output_argmax(output, output->c, data->threshold, &lnk_data.score);
+
+    // Only windows with a detection allocate an output list.
+    if (lnk_data.index != -1) {
+        py_tf_classify_output_data_callback_data_t classify;
+        py_tf_classify_output_data_callback(&classify, (void *) output->data, output->h, output->w, output->c,
+                                            output->is_signed, output->is_float);
+        rectangle_copy(&lnk_data.rect, roi);
+        lnk_data.data = classify.out;
+        list_push_back(data->out, &lnk_data);
+    }
+}
 
-                    PY_ASSERT_FALSE_MSG(libtf_invoke(arg_model->model_data,
-                                                     tensor_arena,
-                                                     tensor_arena_size,
-                                                     py_tf_input_data_callback,
-                                                     &py_tf_input_data_callback_data,
-                                                     py_tf_classify_output_data_callback,
-                                                     &py_tf_classify_output_data_callback_data),
-                                        py_tf_putchar_buffer - (PY_TF_PUTCHAR_BUFFER_LEN - py_tf_putchar_buffer_len));
-
-                    py_tf_classification_obj_t *o = m_new_obj(py_tf_classification_obj_t);
-                    o->base.type = &py_tf_classification_type;
-                    o->x = mp_obj_new_int(new_roi.x);
-                    o->y = mp_obj_new_int(new_roi.y);
-                    o->w = mp_obj_new_int(new_roi.w);
-                    o->h = mp_obj_new_int(new_roi.h);
-                    o->output = py_tf_classify_output_data_callback_data.out;
-                    mp_obj_list_append(objects_list, o);
+STATIC mp_obj_t py_tf_detect(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    fb_alloc_mark();
+    alloc_putchar_buffer();
+
+    py_tf_model_obj_t *arg_model = py_tf_load_alloc(args[0]);
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[1]);
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
+
+    nn_windows_t windows;
+    py_tf_windows_args(n_args, args, kw_args, &windows);
+
+    float arg_threshold = py_helper_keyword_float(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0.6f);
+    PY_ASSERT_TRUE_MSG((0.0f <= arg_threshold) && (arg_threshold <= 1.0f), "0 <= threshold <= 1");
+
+    float arg_iou_threshold = py_helper_keyword_float(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_iou_threshold), 0.5f);
+    PY_ASSERT_TRUE_MSG((0.0f <= arg_iou_threshold) && (arg_iou_threshold <= 1.0f), "0 <= iou_threshold <= 1");
+    py_helper_keyword_time_budget(n_args, args, 9, kw_args, 0);
+
+    list_t out;
+    list_init(&out, sizeof(rectangle_score_t));
+
+    nn_model_t model = { .backend = &nn_backend_tf, .model = arg_model };
+    py_tf_detect_window_data_t data = { .threshold = arg_threshold, .out = &out };
+
+    PY_ASSERT_FALSE_MSG(nn_model_run_windows(&model, arg_img, &roi, &windows, py_tf_detect_window_callback, &data),
+                        py_tf_putchar_buffer - (PY_TF_PUTCHAR_BUFFER_LEN - py_tf_putchar_buffer_len));
+
+    fb_alloc_free_till_mark();
+
+    return py_tf_nms_objects(&out, arg_iou_threshold, py_tf_frame(arg_img));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_tf_detect_obj, 2, py_tf_detect);
+
+typedef struct py_tf_find_objects_output_data_callback_data {
+    float *anchors;
+    int n_anchors;
+    int model_w, model_h;
+    float threshold;
+    rectangle_t *roi;
+    list_t *out;
+} py_tf_find_objects_output_data_callback_data_t;
+
+// Decodes a YOLO style grid head, output_channels is anchors * (x, y, w, h, objectness, classes...)
+// with the sigmoid applied by the model (YOLOv5 box parametrization). 8-bit outputs go through
+// a table, only the boxes above the threshold are decoded and kept.
+STATIC void py_tf_find_objects_output_data_callback(void *callback_data,
+                                                    void *model_output,
+                                                    const unsigned int output_height,
+                                                    const unsigned int output_width,
+                                                    const unsigned int output_channels,
+                                                    const bool signed_or_unsigned,
+                                                    const bool is_float)
+{
+    py_tf_find_objects_output_data_callback_data_t *arg = (py_tf_find_objects_output_data_callback_data_t *) callback_data;
+    int shift = signed_or_unsigned ? 128 : 0;
+    float fscale = signed_or_unsigned ? 127.0f: 255.0f;
+    int stride = output_channels / arg->n_anchors;
+    int n_classes = stride - 5;
+
+    PY_ASSERT_TRUE_MSG(!(output_channels % arg->n_anchors) && (n_classes >= 0),
+                       "Expected model output channels to be anchors * (5 + classes)!");
+
+    float lut[256];
+    if (!is_float) {
+        for (int i = 0; i < 256; i++) {
+            lut[i] = (i ^ shift) / 255.0f;
+        }
+    }
+
+    #define PY_TF_OUTPUT(i) ((!is_float) \
+        ? lut[((uint8_t *) model_output)[i]] \
+        : (((((float *) model_output)[i] * fscale) + shift) / 255.0f))
+
+    for (unsigned int gy = 0; gy < output_height; gy++) {
+        for (unsigned int gx = 0; gx < output_width; gx++) {
+            for (int a = 0; a < arg->n_anchors; a++) {
+                int index = (((gy * output_width) + gx) * output_channels) + (a * stride);
+                float objectness = PY_TF_OUTPUT(index + 4);
+
+                // The score is at most the objectness.
+                if (objectness < arg->threshold) {
+                    continue;
+                }
+
+                int class_index = 0;
+                float class_score = 1.0f;
+                for (int c = 0; c < n_classes; c++) {
+                    float value = PY_TF_OUTPUT(index + 5 + c);
+                    if ((c == 0) || (value > class_score)) {
+                        class_index = c;
+                        class_score = value;
+                    }
+                }
+
+                float score = objectness * class_score;
+                if (score < arg->threshold) {
+                    continue;
+                }
+
+                float sx = PY_TF_OUTPUT(index + 0), sy = PY_TF_OUTPUT(index + 1);
+                float sw = PY_TF_OUTPUT(index + 2), sh = PY_TF_OUTPUT(index + 3);
+                float cx = (gx + (2.0f * sx) - 0.5f) / output_width;
+                float cy = (gy + (2.0f * sy) - 0.5f) / output_height;
+                float bw = (4.0f * sw * sw * arg->anchors[(a * 2) + 0]) / arg->model_w;
+                float bh = (4.0f * sh * sh * arg->anchors[(a * 2) + 1]) / arg->model_h;
+
+                rectangle_score_t box;
+                rectangle_init(&box.rect,
+                               arg->roi->x + fast_roundf((cx - (bw / 2.0f)) * arg->roi->w),
+                               arg->roi->y + fast_roundf((cy - (bh / 2.0f)) * arg->roi->h),
+                               fast_roundf(bw * arg->roi->w),
+                               fast_roundf(bh * arg->roi->h));
+
+                if (rectangle_overlap(&box.rect, arg->roi)) {
+                    rectangle_intersected(&box.rect, arg->roi);
+                    box.index = class_index;
+                    box.score = score;
+                    box.data = NULL;
+                    list_push_back(arg->out, &box);
                 }
             }
         }
     }
 
+    #undef PY_TF_OUTPUT
+}
+
+STATIC mp_obj_t py_tf_find_objects(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
+{
+    fb_alloc_mark();
+    alloc_putchar_buffer();
+
+    py_tf_model_obj_t *arg_model = py_tf_load_alloc(args[0]);
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[1]);
+
+    mp_obj_t *arg_anchors;
+    size_t arg_anchors_len;
+    mp_obj_get_array(args[2], &arg_anchors_len, &arg_anchors);
+    PY_ASSERT_TRUE_MSG(arg_anchors_len, "Expected at least one anchor!");
+
+    float *anchors = fb_alloc(arg_anchors_len * 2 * sizeof(float), FB_ALLOC_NO_HINT);
+    for (size_t i = 0; i < arg_anchors_len; i++) {
+        mp_obj_t *anchor;
+        mp_obj_get_array_fixed_n(arg_anchors[i], 2, &anchor);
+        anchors[(i * 2) + 0] = mp_obj_get_float(anchor[0]);
+        anchors[(i * 2) + 1] = mp_obj_get_float(anchor[1]);
+    }
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(arg_img, n_args, args, 3, kw_args, &roi);
+
+    float arg_threshold = py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0.6f);
+    PY_ASSERT_TRUE_MSG((0.0f <= arg_threshold) && (arg_threshold <= 1.0f), "0 <= threshold <= 1");
+
+    float arg_iou_threshold = py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_iou_threshold), 0.5f);
+    PY_ASSERT_TRUE_MSG((0.0f <= arg_iou_threshold) && (arg_iou_threshold <= 1.0f), "0 <= iou_threshold <= 1");
+
+    uint32_t tensor_arena_size;
+    uint8_t *tensor_arena = py_tf_tensor_arena(arg_model, &tensor_arena_size);
+
+    list_t out;
+    list_init(&out, sizeof(rectangle_score_t));
+
+    py_tf_input_data_callback_data_t py_tf_input_data_callback_data;
+    py_tf_input_data_callback_data.img = arg_img;
+    py_tf_input_data_callback_data.roi = &roi;
+
+    py_tf_find_objects_output_data_callback_data_t py_tf_find_objects_output_data_callback_data;
+    py_tf_find_objects_output_data_callback_data.anchors = anchors;
+    py_tf_find_objects_output_data_callback_data.n_anchors = arg_anchors_len;
+    py_tf_find_objects_output_data_callback_data.model_w = arg_model->width;
+    py_tf_find_objects_output_data_callback_data.model_h = arg_model->height;
+    py_tf_find_objects_output_data_callback_data.threshold = arg_threshold;
+    py_tf_find_objects_output_data_callback_data.roi = &roi;
+    py_tf_find_objects_output_data_callback_data.out = &out;
+
+    PY_ASSERT_FALSE_MSG(libtf_invoke(arg_model->model_data,
+                                     tensor_arena,
+                                     tensor_arena_size,
+                                     py_tf_input_data_callback,
+                                     &py_tf_input_data_callback_data,
+                                     py_tf_find_objects_output_data_callback,
+                                     &py_tf_find_objects_output_data_callback_data),
+                        py_tf_putchar_buffer - (PY_TF_PUTCHAR_BUFFER_LEN - py_tf_putchar_buffer_len));
+
     fb_alloc_free_till_mark();
 
-    return objects_list;
+    return py_tf_nms_objects(&out, arg_iou_threshold, py_tf_frame(arg_img));
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_tf_classify_obj, 2, py_tf_classify);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_tf_find_objects_obj, 3, py_tf_find_objects);
 
 typedef struct py_tf_segment_output_data_callback_data {
-    mp_obj_t out;
+    bool argmax;
+    mp_obj_t out; // The images to write to (or NULL to allocate them), then the output.
 } py_tf_segment_output_data_callback_data_t;
 
+STATIC image_t *py_tf_segment_image(mp_obj_t *image, const unsigned int output_width, const unsigned int output_height)
+{
+    if (*image == MP_OBJ_NULL) {
+        image_t img = {
+            .w = output_width,
+            .h = output_height,
+            .bpp = IMAGE_BPP_GRAYSCALE,
+            .pixels = xalloc_data(output_width * output_height * sizeof(uint8_t))
+        };
+        *image = py_image_from_struct(&img);
+    }
+
+    image_t *img = py_helper_arg_to_image_mutable(*image);
+    PY_ASSERT_TRUE_MSG((img->bpp == IMAGE_BPP_GRAYSCALE) && (img->w == output_width) && (img->h == output_height),
+                       "Expected grayscale images the size of the model output!");
+    return img;
+}
+
+// Writes one grayscale image per class (or the class index with the highest score per pixel in
+// argmax mode) in a single pass over the output tensor, 8-bit outputs are copied as is.
 STATIC void py_tf_segment_output_data_callback(void *callback_data,
                                                void *model_output,
                                                const unsigned int output_height,
@@ -480,26 +793,43 @@ STATIC void py_tf_segment_output_data_callback(void *callback_data,
     py_tf_segment_output_data_callback_data_t *arg = (py_tf_segment_output_data_callback_data_t *) callback_data;
     int shift = signed_or_unsigned ? 128 : 0;
     float fscale = signed_or_unsigned ? 127.0f: 255.0f;
+    unsigned int n_images = arg->argmax ? 1 : output_channels;
+    uint8_t *pixels[n_images];
 
-    arg->out = mp_obj_new_list(output_channels, NULL);
-    for (unsigned int i = 0; i < output_channels; i++) {
-        image_t img = {
-            .w = output_width,
-            .h = output_height,
-            .bpp = IMAGE_BPP_GRAYSCALE,
-            .pixels = xalloc(output_width * output_height * sizeof(uint8_t))
-        };
-        ((mp_obj_list_t *) arg->out)->items[i] = py_image_from_struct(&img);
-        for (unsigned int y = 0; i < output_height; y++) {
-            unsigned int row = y * output_width * output_channels;
-            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&img, y);
-            for (unsigned int x = 0; i < output_width; x++) {
-                unsigned int col = x * output_channels;
-                if (!is_float) {
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, ((uint8_t *) model_output)[row + col + i] ^ shift);
-                } else {
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, ((((float *) model_output)[i] * fscale) + shift));
-                }
+    if (arg->argmax) {
+        pixels[0] = py_tf_segment_image(&arg->out, output_width, output_height)->pixels;
+    } else {
+        if (arg->out == MP_OBJ_NULL) {
+            arg->out = mp_obj_new_list(output_channels, NULL);
+            for (unsigned int i = 0; i < output_channels; i++) {
+                ((mp_obj_list_t *) arg->out)->items[i] = MP_OBJ_NULL;
+            }
+        }
+
+        mp_obj_t *images;
+        size_t images_len;
+        mp_obj_get_array(arg->out, &images_len, &images);
+        PY_ASSERT_TRUE_MSG(images_len == output_channels, "Expected one image per model output channel!");
+
+        for (unsigned int i = 0; i < output_channels; i++) {
+            pixels[i] = py_tf_segment_image(&images[i], output_width, output_height)->pixels;
+        }
+    }
+
+    for (unsigned int i = 0, ii = output_width * output_height; i < ii; i++) {
+        unsigned int index = i * output_channels;
+        int best_value = -1;
+
+        for (unsigned int c = 0; c < output_channels; c++) {
+            int value = (!is_float)
+                ? (((uint8_t *) model_output)[index + c] ^ shift)
+                : IM_MIN(IM_MAX(fast_roundf((((float *) model_output)[index + c] * fscale) + shift), 0), 255);
+
+            if (!arg->argmax) {
+                pixels[c][i] = value;
+            } else if (value > best_value) {
+                pixels[0][i] = c;
+                best_value = value;
             }
         }
     }
@@ -517,13 +847,17 @@ STATIC mp_obj_t py_tf_segment(uint n_args, const mp_obj_t *args, mp_map_t *kw_ar
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 2, kw_args, &roi);
 
     uint32_t tensor_arena_size;
-    uint8_t *tensor_arena = fb_alloc_all(&tensor_arena_size, FB_ALLOC_PREFER_SIZE);
+    uint8_t *tensor_arena = py_tf_tensor_arena(arg_model, &tensor_arena_size);
 
     py_tf_input_data_callback_data_t py_tf_input_data_callback_data;
     py_tf_input_data_callback_data.img = arg_img;
     py_tf_input_data_callback_data.roi = &roi;
 
     py_tf_segment_output_data_callback_data_t py_tf_segment_output_data_callback_data;
+    py_tf_segment_output_data_callback_data.argmax =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_argmax), false);
+    py_tf_segment_output_data_callback_data.out =
+        py_helper_keyword_object(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_images));
 
     PY_ASSERT_FALSE_MSG(libtf_invoke(arg_model->model_data,
                                      tensor_arena,
@@ -562,6 +896,8 @@ STATIC const mp_rom_map_elem_t locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_signed), MP_ROM_PTR(&py_tf_signed_obj) },
     { MP_ROM_QSTR(MP_QSTR_is_float), MP_ROM_PTR(&py_tf_is_float_obj) },
     { MP_ROM_QSTR(MP_QSTR_classify), MP_ROM_PTR(&py_tf_classify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_detect), MP_ROM_PTR(&py_tf_detect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_find_objects), MP_ROM_PTR(&py_tf_find_objects_obj) },
     { MP_ROM_QSTR(MP_QSTR_segment), MP_ROM_PTR(&py_tf_segment_obj) }
 };
 
@@ -576,18 +912,31 @@ STATIC const mp_obj_type_t py_tf_model_type = {
 
 #endif // IMLIB_ENABLE_TF
 
+STATIC mp_obj_t py_tf_truncated()
+{
+    // True if the last classify() or detect() ran out of its time_budget_us.
+    return mp_obj_new_bool(imlib_deadline_truncated());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(py_tf_truncated_obj, py_tf_truncated);
+
 STATIC const mp_rom_map_elem_t globals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_tf) },
 #ifdef IMLIB_ENABLE_TF
     { MP_ROM_QSTR(MP_QSTR_load),            MP_ROM_PTR(&py_tf_load_obj) },
     { MP_ROM_QSTR(MP_QSTR_free_from_fb),    MP_ROM_PTR(&py_tf_free_from_fb_obj) },
     { MP_ROM_QSTR(MP_QSTR_classify),        MP_ROM_PTR(&py_tf_classify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_detect),          MP_ROM_PTR(&py_tf_detect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_find_objects),    MP_ROM_PTR(&py_tf_find_objects_obj) },
     { MP_ROM_QSTR(MP_QSTR_segment),         MP_ROM_PTR(&py_tf_segment_obj) },
+    { MP_ROM_QSTR(MP_QSTR_truncated),       MP_ROM_PTR(&py_tf_truncated_obj) },
 #else
     { MP_ROM_QSTR(MP_QSTR_load),            MP_ROM_PTR(&py_func_unavailable_obj) },
     { MP_ROM_QSTR(MP_QSTR_free_from_fb),    MP_ROM_PTR(&py_func_unavailable_obj) },
     { MP_ROM_QSTR(MP_QSTR_classify),        MP_ROM_PTR(&py_func_unavailable_obj) },
-    { MP_ROM_QSTR(MP_QSTR_segment),         MP_ROM_PTR(&py_func_unavailable_obj) }
+    { MP_ROM_QSTR(MP_QSTR_detect),          MP_ROM_PTR(&py_func_unavailable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_find_objects),    MP_ROM_PTR(&py_func_unavailable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_segment),         MP_ROM_PTR(&py_func_unavailable_obj) },
+    { MP_ROM_QSTR(MP_QSTR_truncated),       MP_ROM_PTR(&py_func_unavailable_obj) }
 #endif // IMLIB_ENABLE_TF
 };
 
@@ -9,6 +9,7 @@
 #include <mp.h>
 #include <objstr.h>
 #include <spi.h>
+#include <dma.h>
 #include <systick.h>
 #include "imlib.h"
 #include "fb_alloc.h"
@@ -238,69 +239,28 @@
 #define CS_PIN              GPIO_PIN_12
 #define CS_PIN_WRITE(bit)   HAL_GPIO_WritePin(CS_PORT, CS_PIN, bit);
 
-extern mp_obj_t pyb_spi_send(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args);
-//extern mp_obj_t pyb_spi_send_recv(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args);
+#define TV_LINE_TIMEOUT (100)
+
 extern mp_obj_t pyb_spi_make_new(mp_obj_t type_in, mp_uint_t n_args, mp_uint_t n_kw, const mp_obj_t *args);
 extern mp_obj_t pyb_spi_deinit(mp_obj_t self_in);
 
 static mp_obj_t spi_port = NULL;
+static const spi_t *spi = &spi_obj[1]; // SPI2
+static DMA_HandleTypeDef DMAHandle;
 static enum { TV_NONE, TV_SHIELD } type = TV_NONE;
 
+// SRAM write bursts, the WRITE opcode and address are followed by a whole converted line.
+static uint8_t line_buf[2][4 + (XPIXELS * 2)] __attribute__((aligned(32), section(".dma_buffer")));
+
 static mp_obj_t SpiSendByte(register uint16_t b) {
-    mp_map_t arg_map;
-    arg_map.all_keys_are_qstrs = true;
-    arg_map.is_fixed = true;
-    arg_map.is_ordered = true;
-    arg_map.used = 0;
-    arg_map.alloc = 0;
-    arg_map.table = NULL;
-    mp_obj_t result;
-    result = pyb_spi_send(
-        2, (mp_obj_t []) {
-            spi_port,
-            mp_obj_new_int(b)
-        },
-        &arg_map
-    );
-    return result;
-}
-static mp_obj_t SpiSendLine(uint8_t *line, uint16_t length) {
-    mp_map_t arg_map;
-    arg_map.all_keys_are_qstrs = true;
-    arg_map.is_fixed = true;
-    arg_map.is_ordered = true;
-    arg_map.used = 0;
-    arg_map.alloc = 0;
-    arg_map.table = NULL;
-    pyb_spi_send(
-        2, (mp_obj_t []) {
-            spi_port,
-            mp_obj_new_bytes(line, length)
-        },
-        &arg_map
-    );
+    uint8_t data = b;
+    spi_transfer(spi, 1, &data, NULL, SPI_TRANSFER_TIMEOUT(1));
     return mp_const_none;
 }
 static mp_obj_t SpiSendWord(register uint16_t b) {
-    mp_map_t arg_map;
-    arg_map.all_keys_are_qstrs = true;
-    arg_map.is_fixed = true;
-    arg_map.is_ordered = true;
-    arg_map.used = 0;
-    arg_map.alloc = 0;
-    arg_map.table = NULL;
-    mp_obj_t result;
-
     uint8_t data[2] = {b >> 8, b & 0xff};
-
-    result = pyb_spi_send(
-        2, (mp_obj_t []) {
-            spi_port,
-            mp_obj_new_bytes(data, 2)
-        },
-        &arg_map
-    );
-    return result;
+    spi_transfer(spi, 2, data, NULL, SPI_TRANSFER_TIMEOUT(2));
+    return mp_const_none;
 }
 // SpiWrite uses SPI to write the VS23 registers, and to write VS23 SRAM
 // addresses.
@@ -537,6 +497,97 @@ static mp_obj_t py_tv_channel(mp_obj_t c)
     SpiWrite(GPIOCTL, 0, data, 0);
     return mp_const_none;
 }
+// Converts an RGB565 pixel to the VS23 (U/V nibbles, luminance) word.
+static inline void tv_rgb565_to_word(uint16_t pixel, uint8_t *word)
+{
+    #ifdef IMLIB_ENABLE_YUV_LUT
+    // The Y, U and V of a pixel are next to each other in yuv_table.
+    const int8_t *yuv = yuv_table + (pixel * 3);
+    int y = yuv[0], u = yuv[1], v = yuv[2];
+    #else
+    // Same math as imlib_rgb565_to_y/u/v() with the channels only unpacked once.
+    int r = COLOR_RGB565_TO_R8(pixel);
+    int g = COLOR_RGB565_TO_G8(pixel);
+    int b = COLOR_RGB565_TO_B8(pixel);
+    int y = (int8_t) ((((r * 9770) + (g * 19182) + (b * 3736)) >> 15) - 128);
+    int u = (int8_t) (((b << 14) - (r * 5529) - (g * 10855)) >> 15);
+    int v = (int8_t) (((r << 14) - (g * 13682) - (b * 2664)) >> 15);
+    #endif
+    // b=>u
+    // a=>v
+    // y=>luminance
+    word[0] = (u & 0xF0) | (((-v) >> 4) & 0x0F);
+    word[1] = y + 128;
+}
+
+// Fills a SRAM write burst for w pixels of screen line y, starting at x1.
+static void tv_fill_line(image_t *img, resample_t *resample, void *src_line, uint8_t *buf,
+                         uint16_t x1, uint16_t y1, uint16_t y, uint16_t w)
+{
+    uint32_t address = PICLINE_BYTE_ADDRESS(y) + x1;
+    uint8_t *line = buf + 4;
+    buf[0] = WRITE;
+    buf[1] = address >> 16;
+    buf[2] = address >> 8;
+    buf[3] = address;
+
+    if (resample) {
+        imlib_resample_line(resample, y - y1, src_line);
+    }
+
+    if (IM_IS_GS(img)) {
+        uint8_t *row = resample ? ((uint8_t *) src_line) : (img->pixels + (y * img->w) + x1);
+        for (int i = 0; i < w; i++) {
+            line[2*i] = 0;
+            line[2*i + 1] = row[i];
+        }
+    } else {
+        uint16_t *row = resample ? ((uint16_t *) src_line) : (((uint16_t *) img->pixels) + (y * img->w) + x1);
+        for (int i = 0; i < w; i++) {
+            tv_rgb565_to_word(row[i], line + (2*i));
+        }
+    }
+}
+
+static void tv_wait_line()
+{
+    for (mp_uint_t tick_start = HAL_GetTick(); HAL_SPI_GetState(spi->spi) != HAL_SPI_STATE_READY; ) {
+        if ((HAL_GetTick() - tick_start) >= TV_LINE_TIMEOUT) {
+            HAL_SPI_Abort(spi->spi);
+            break;
+        }
+    }
+
+    CS_PIN_WRITE(true);
+}
+
+// Writes w by h pixels to the screen at x1, y1. They're read from the same place in the image,
+// or from the resampler (which starts at line 0) if there's one. Each line is one DMA burst and
+// the next line is converted while the current one is sent.
+static void tv_write_rect(image_t *img, resample_t *resample, void *src_line,
+                          uint16_t x1, uint16_t y1, uint16_t w, uint16_t h)
+{
+    const uint16_t y2 = y1 + h;
+
+    dma_init(&DMAHandle, spi->tx_dma_descr, DMA_MEMORY_TO_PERIPH, spi->spi);
+    spi->spi->hdmatx = &DMAHandle;
+
+    tv_fill_line(img, resample, src_line, line_buf[0], x1, y1, y1, w);
+
+    for (uint16_t y = y1; y < y2; y++) {
+        CS_PIN_WRITE(false);
+        HAL_SPI_Transmit_DMA(spi->spi, line_buf[(y - y1) % 2], 4 + (w * 2));
+
+        if ((y + 1) < y2) {
+            tv_fill_line(img, resample, src_line, line_buf[(y - y1 + 1) % 2], x1, y1, y + 1, w);
+        }
+
+        tv_wait_line();
+    }
+
+    dma_deinit(spi->tx_dma_descr);
+    spi->spi->hdmatx = NULL;
+}
 static mp_obj_t py_tv_display(uint n_args, const mp_obj_t *args, mp_map_t *kw_args)
 {
     image_t *arg_img = py_image_cobj(args[0]);
@@ -545,47 +596,84 @@ static mp_obj_t py_tv_display(uint n_args, const mp_obj_t *args, mp_map_t *kw_ar
     rectangle_t rect;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &rect);
 
-    const uint16_t x1 = rect.x;
-    const uint16_t y1 = rect.y;
-    const uint16_t w = rect.w < XPIXELS? rect.w : XPIXELS;
-    const uint16_t h = rect.h < YPIXELS? rect.h : YPIXELS;
-    const uint16_t y2 = y1 + h;
-
-    uint32_t address;
-    uint16_t x = x1;
-    uint16_t y = y1;
+    float arg_x_scale =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_scale), 1.0f);
+    PY_ASSERT_TRUE_MSG((0.0f < arg_x_scale), "Error: 0.0 < x_scale!");
+    float arg_y_scale =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_scale), 1.0f);
+    PY_ASSERT_TRUE_MSG((0.0f < arg_y_scale), "Error: 0.0 < y_scale!");
+    int arg_hint =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_hint), 0);
+    int arg_rotation =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rotation), 0);
+    PY_ASSERT_TRUE_MSG((arg_rotation % 90) == 0, "Rotation must be a multiple of 90 degrees!");
+    arg_rotation = ((arg_rotation % 360) + 360) % 360;
+    mp_obj_t arg_dirty =
+        py_helper_keyword_object(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dirty));
+
+    bool transpose = (arg_rotation == 90) || (arg_rotation == 270);
+    bool scaled = (arg_x_scale != 1.0f) || (arg_y_scale != 1.0f) || arg_rotation;
+
+    uint16_t x1 = rect.x;
+    uint16_t y1 = rect.y;
+    uint16_t w = rect.w < XPIXELS? rect.w : XPIXELS;
+    uint16_t h = rect.h < YPIXELS? rect.h : YPIXELS;
 
     fb_alloc_mark();
-    uint8_t *line = fb_alloc(w*2, FB_ALLOC_NO_HINT);
+    resample_t resample;
+
+    if (scaled) {
+        // Resampled frames are drawn from the top left corner, lines are resampled on the fly.
+        int src_w = transpose ? rect.h : rect.w, src_h = transpose ? rect.w : rect.h;
+        int scaled_w = IM_MAX(fast_floorf(src_w * arg_x_scale), 1);
+        int scaled_h = IM_MAX(fast_floorf(src_h * arg_y_scale), 1);
+
+        if (scaled_w > XPIXELS) {
+            int adjust = src_w - IM_MIN(IM_MAX(fast_floorf(XPIXELS / arg_x_scale), 1), src_w);
+            if (transpose) { rect.h -= adjust; rect.y += adjust / 2; } else { rect.w -= adjust; rect.x += adjust / 2; }
+            scaled_w = XPIXELS;
+        }
 
-    while (y < y2) {
-        address = PICLINE_BYTE_ADDRESS(y) + x1;
-        CS_PIN_WRITE(false);
-        SpiSendByte(WRITE);
-        SpiSendByte(address >> 16);
-        SpiSendWord(address);
-        for(int i = 0; i < w; i++)
-        {
-            x = x1 + i;
-            if (IM_IS_GS(arg_img)) {
-                line[2*i] = 0;
-                line[2*i + 1] = IM_GET_GS_PIXEL(arg_img, x, y);;
-            } else {
-                // b=>u
-                // a=>v
-                // y=>luminance
-                uint16_t pixel = IM_GET_RGB565_PIXEL(arg_img, x, y);
-                uint8_t b4 = (COLOR_RGB565_TO_U(pixel)) & 0xF0;
-                uint8_t a4 = ((-COLOR_RGB565_TO_V(pixel))>>4) & 0x0F;
-                uint8_t y8 = ((COLOR_RGB565_TO_Y(pixel)+128));
-                line[2*i] = b4 | a4;
-                line[2*i + 1] = y8;
+        if (scaled_h > YPIXELS) {
+            int adjust = src_h - IM_MIN(IM_MAX(fast_floorf(YPIXELS / arg_y_scale), 1), src_h);
+            if (transpose) { rect.w -= adjust; rect.x += adjust / 2; } else { rect.h -= adjust; rect.y += adjust / 2; }
+            scaled_h = YPIXELS;
+        }
+
+        imlib_resample_init_rotated(&resample, arg_img, &rect, scaled_w, scaled_h, arg_hint, arg_rotation);
+        x1 = 0;
+        y1 = 0;
+        w = scaled_w;
+        h = scaled_h;
+    }
+
+    void *src_line = scaled ? fb_alloc(w*2, FB_ALLOC_NO_HINT) : NULL;
+
+    if (arg_dirty) {
+        // Dirty rects are in image coordinates, only the lines and pixels they cover are sent.
+        PY_ASSERT_FALSE_MSG(scaled, "Dirty rects need an unscaled and unrotated display!");
+        rectangle_t shown;
+        rectangle_init(&shown, x1, y1, w, h);
+        mp_uint_t arg_dirty_len;
+        mp_obj_t *arg_dirty_items;
+        mp_obj_get_array(arg_dirty, &arg_dirty_len, &arg_dirty_items);
+
+        for (mp_uint_t i = 0; i < arg_dirty_len; i++) {
+            mp_obj_t *arg_rect;
+            mp_obj_get_array_fixed_n(arg_dirty_items[i], 4, &arg_rect);
+            rectangle_t win;
+            rectangle_init(&win, mp_obj_get_int(arg_rect[0]), mp_obj_get_int(arg_rect[1]),
+                           mp_obj_get_int(arg_rect[2]), mp_obj_get_int(arg_rect[3]));
+
+            if ((win.w >= 1) && (win.h >= 1) && rectangle_overlap(&win, &shown)) {
+                rectangle_intersected(&win, &shown);
+                tv_write_rect(arg_img, NULL, NULL, win.x, win.y, win.w, win.h);
             }
         }
-        SpiSendLine(line, w*2);
-        CS_PIN_WRITE(true);
-        y++;
+    } else {
+        tv_write_rect(arg_img, scaled ? &resample : NULL, src_line, x1, y1, w, h);
     }
+
     fb_alloc_free_till_mark();
     return mp_const_none;
 }
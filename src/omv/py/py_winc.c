@@ -24,7 +24,10 @@
 #include "spi.h"
 #include "common.h"
 #include "py_helper.h"
+#include "py_image.h"
+#include "fb_alloc.h"
 #include "ff_wrapper.h"
+#include "wifistream.h"
 
 #include "winc.h"
 #include "socket/include/socket.h"
@@ -357,6 +360,37 @@ static mp_obj_t py_winc_fw_update(mp_obj_t self_in, mp_obj_t path_in)
     return mp_const_none;
 }
 
+static mp_obj_t py_winc_start_stream(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_port,     MP_ARG_INT, {.u_int = WIFISTREAM_DEFAULT_PORT} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    // Serve the frame buffer as an MJPEG stream, frames are sent while the camera captures.
+    int error = wifistream_start(args[0].u_int);
+    if (error != 0) {
+        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError,
+                    "Failed to start the stream server: %d\n", error));
+    }
+
+    return mp_const_none;
+}
+
+static mp_obj_t py_winc_stop_stream(mp_obj_t self_in)
+{
+    wifistream_stop();
+    return mp_const_none;
+}
+
+static mp_obj_t py_winc_stream_clients(mp_obj_t self_in)
+{
+    return mp_obj_new_int(wifistream_clients());
+}
+
 static int py_winc_gethostbyname(mp_obj_t nic, const char *name, mp_uint_t len, uint8_t *out_ip)
 {
     return winc_gethostbyname(name, out_ip);
@@ -567,6 +601,50 @@ static int py_winc_socket_ioctl(mod_network_socket_obj_t *socket, mp_uint_t requ
     return -1;
 }
 
+// Sends an image on a WINC socket straight from memory: JPEG images are sent as they are, others
+// are compressed to a frame buffer scratch buffer, which is sent without any Python objects and
+// without changing the image. Returns the number of bytes sent.
+static mp_obj_t py_winc_send_image(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_socket,   MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_image,    MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_quality,  MP_ARG_KW_ONLY  | MP_ARG_INT, {.u_int = 50} },
+    };
+
+    // parse args
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    mod_network_socket_obj_t *socket = args[0].u_obj;
+    PY_ASSERT_TRUE_MSG((mp_obj_get_type(socket)->name == MP_QSTR_socket)
+            && (socket->nic_type == &mod_network_nic_type_winc), "Expected a WINC socket!");
+
+    image_t *img = py_image_cobj(args[1].u_obj);
+    int quality = args[2].u_int;
+    PY_ASSERT_TRUE_MSG((1 <= quality) && (quality <= 100), "Error: 1 <= quality <= 100!");
+
+    fb_alloc_mark();
+    image_t out = *img;
+
+    if (!IM_IS_JPEG(img)) {
+        uint32_t size;
+        out.data = fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE);
+        out.bpp = size;
+        PY_ASSERT_FALSE_MSG(jpeg_compress(img, &out, quality, false), "Out of Memory!");
+    }
+
+    int _errno = 0;
+    mp_uint_t ret = py_winc_socket_send(socket, out.data, out.bpp, &_errno);
+    fb_alloc_free_till_mark();
+
+    if (_errno) {
+        mp_raise_OSError(_errno);
+    }
+
+    return mp_obj_new_int(ret);
+}
+
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_winc_connect_obj, 1,   py_winc_connect);
 static MP_DEFINE_CONST_FUN_OBJ_KW(py_winc_start_ap_obj,1,   py_winc_start_ap);
 static MP_DEFINE_CONST_FUN_OBJ_1(py_winc_disconnect_obj,    py_winc_disconnect);
@@ -580,6 +658,10 @@ static MP_DEFINE_CONST_FUN_OBJ_1(py_winc_get_rssi_obj,      py_winc_get_rssi);
 static MP_DEFINE_CONST_FUN_OBJ_1(py_winc_fw_version_obj,    py_winc_fw_version);
 static MP_DEFINE_CONST_FUN_OBJ_2(py_winc_fw_dump_obj,       py_winc_fw_dump);
 static MP_DEFINE_CONST_FUN_OBJ_2(py_winc_fw_update_obj,     py_winc_fw_update);
+static MP_DEFINE_CONST_FUN_OBJ_KW(py_winc_start_stream_obj, 1, py_winc_start_stream);
+static MP_DEFINE_CONST_FUN_OBJ_1(py_winc_stop_stream_obj,   py_winc_stop_stream);
+static MP_DEFINE_CONST_FUN_OBJ_1(py_winc_stream_clients_obj,py_winc_stream_clients);
+static MP_DEFINE_CONST_FUN_OBJ_KW(py_winc_send_image_obj, 3, py_winc_send_image);
 
 static const mp_map_elem_t winc_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_connect),       (mp_obj_t)&py_winc_connect_obj },
@@ -595,6 +677,10 @@ static const mp_map_elem_t winc_locals_dict_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR_fw_version),    (mp_obj_t)&py_winc_fw_version_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_fw_dump),       (mp_obj_t)&py_winc_fw_dump_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_fw_update),     (mp_obj_t)&py_winc_fw_update_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_start_stream),  (mp_obj_t)&py_winc_start_stream_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stop_stream),   (mp_obj_t)&py_winc_stop_stream_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stream_clients),(mp_obj_t)&py_winc_stream_clients_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_image),    (mp_obj_t)&py_winc_send_image_obj },
 
     { MP_OBJ_NEW_QSTR(MP_QSTR_OPEN),          MP_OBJ_NEW_SMALL_INT(M2M_WIFI_SEC_OPEN) },   // Network is not secured.
     { MP_OBJ_NEW_QSTR(MP_QSTR_WEP),           MP_OBJ_NEW_SMALL_INT(M2M_WIFI_SEC_WEP) },    // Security type WEP (40 or 104) OPEN OR SHARED.
@@ -19,6 +19,25 @@ Q(arch)
 Q(board_type)
 Q(board_id)
 Q(disable_fb)
+Q(fb_alloc_profile)
+Q(fb_alloc_stats)
+Q(fb_alloc_peak)
+Q(gc_stats)
+Q(gc_budget)
+Q(large_heap_info)
+Q(ModbusSlave)
+Q(slave_id)
+Q(register_num)
+Q(irq)
+Q(IRQ_RXIDLE)
+// duplicate Q(set)
+// duplicate Q(clear)
+Q(tcp)
+Q(stats)
+Q(deinit)
+Q(crc16)
+Q(cycles)
+Q(frame_stats)
 
 // Image module
 Q(image)
@@ -46,6 +65,7 @@ Q(HaarCascade)
 Q(search)
 Q(SEARCH_EX)
 Q(SEARCH_DS)
+Q(SEARCH_PYR)
 Q(EDGE_CANNY)
 Q(EDGE_SIMPLE)
 Q(CORNER_FAST)
@@ -53,6 +73,7 @@ Q(CORNER_AGAST)
 Q(load_descriptor)
 Q(save_descriptor)
 Q(match_descriptor)
+Q(truncated)
 
 // Image class
 Q(find_template)
@@ -66,11 +87,18 @@ Q(find_lbp)
 Q(find_eye)
 Q(find_edges)
 Q(find_hog)
+Q(get_hog_descriptor)
+Q(find_hog_objects)
+Q(stride)
+// duplicate Q(bias)
 Q(normalized)
 Q(filter_outliers)
+Q(radius)
 Q(scale_factor)
 Q(max_keypoints)
 Q(corner_detector)
+Q(cell_size)
+Q(cell_max)
 Q(kptmatch)
 Q(selective_search)
 Q(a1)
@@ -85,6 +113,8 @@ Q(get_backlight)
 Q(display)
 Q(clear)
 Q(bgr)
+Q(wait)
+Q(dirty)
 
 // tv Module
 Q(tv)
@@ -99,10 +129,14 @@ Q(Gif)
 Q(open)
 Q(add_frame)
 Q(loop)
+Q(diff)
+Q(decimate)
 
 // Mjpeg module
 Q(mjpeg)
 Q(Mjpeg)
+Q(prealloc)
+Q(buffer_size)
 
 // Led Module
 Q(led)
@@ -166,6 +200,10 @@ Q(x_overlap)
 Q(y_overlap)
 Q(contrast_threshold)
 // duplicate Q(softmax)
+
+// Profile
+Q(profile)
+
 // NN Class
 Q(nn_class)
 // duplicate Q(x)
@@ -221,6 +259,14 @@ Q(IOCTL_SET_READOUT_WINDOW)
 Q(IOCTL_GET_READOUT_WINDOW)
 Q(IOCTL_SET_TRIGGERED_MODE)
 Q(IOCTL_GET_TRIGGERED_MODE)
+Q(IOCTL_SET_PIPELINED_MODE)
+Q(IOCTL_GET_PIPELINED_MODE)
+Q(IOCTL_SET_HDR_MODE)
+Q(IOCTL_GET_HDR_MODE)
+Q(IOCTL_SET_COMPANDING)
+Q(IOCTL_GET_COMPANDING)
+Q(IOCTL_SET_HIGH_FPS_MODE)
+Q(IOCTL_GET_HIGH_FPS_MODE)
 Q(IOCTL_LEPTON_GET_WIDTH)
 Q(IOCTL_LEPTON_GET_HEIGHT)
 Q(IOCTL_LEPTON_GET_RADIOMETRY)
@@ -235,6 +281,21 @@ Q(IOCTL_LEPTON_SET_MEASUREMENT_MODE)
 Q(IOCTL_LEPTON_GET_MEASUREMENT_MODE)
 Q(IOCTL_LEPTON_SET_MEASUREMENT_RANGE)
 Q(IOCTL_LEPTON_GET_MEASUREMENT_RANGE)
+Q(IOCTL_LEPTON_GET_MEASUREMENT_STATS)
+Q(IOCTL_HIMAX_MD_ENABLE)
+Q(IOCTL_HIMAX_MD_WINDOW)
+Q(IOCTL_HIMAX_MD_THRESHOLD)
+Q(IOCTL_HIMAX_MD_CLEAR)
+Q(IOCTL_HIMAX_OSC_ENABLE)
+Q(IOCTL_OV5640_AF_LOAD_FIRMWARE)
+Q(IOCTL_OV5640_AF_TRIGGER)
+Q(IOCTL_OV5640_AF_CONTINUOUS)
+Q(IOCTL_OV5640_AF_RELEASE)
+Q(IOCTL_OV5640_AF_ZONE)
+Q(IOCTL_OV5640_AF_STATUS)
+Q(OV5640_AF_IDLE)
+Q(OV5640_AF_FOCUSING)
+Q(OV5640_AF_FOCUSED)
 
 // Color Palettes
 Q(PALETTE_RAINBOW)
@@ -243,6 +304,8 @@ Q(PALETTE_IRONBOW)
 Q(reset)
 Q(flush)
 Q(snapshot)
+Q(snapshot_async)
+Q(frame_ready)
 Q(skip_frames)
 Q(get_fb)
 Q(get_id)
@@ -252,7 +315,9 @@ Q(set_pixformat)
 Q(get_pixformat)
 Q(set_framesize)
 Q(get_framesize)
+Q(set_mode)
 Q(set_vsync_output)
+Q(set_sync_input)
 Q(set_windowing)
 Q(get_windowing)
 Q(set_gainceiling)
@@ -279,6 +344,29 @@ Q(set_transpose)
 Q(get_transpose)
 Q(set_auto_rotation)
 Q(get_auto_rotation)
+Q(set_framebuffers)
+Q(get_framebuffers)
+Q(SINGLE_BUFFER)
+Q(DOUBLE_BUFFER)
+Q(TRIPLE_BUFFER)
+Q(set_capture_plane)
+Q(PLANE_NONE)
+Q(PLANE_L)
+Q(PLANE_BINARY)
+Q(set_motion_detection)
+Q(set_gamma_corr)
+Q(get_motion_score)
+Q(get_motion_map)
+Q(set_native_ae)
+Q(get_native_ae)
+Q(target)
+Q(speed)
+Q(max_exposure_us)
+Q(max_gain_db)
+Q(awb)
+Q(set_jpeg_stream)
+Q(get_jpeg_stream)
+Q(get_dropped_frames)
 Q(set_special_effect)
 Q(set_lens_correction)
 Q(ioctl)
@@ -372,6 +460,14 @@ Q(netinfo)
 Q(fw_version)
 Q(fw_dump)
 Q(fw_update)
+Q(start_stream)
+Q(port)
+Q(stop_stream)
+Q(stream_clients)
+Q(send_image)
+// duplicate Q(socket)
+// duplicate Q(image)
+// duplicate Q(quality)
 Q(scan)
 Q(rssi)
 Q(OPEN)
@@ -391,6 +487,8 @@ Q(bssid)
 // cpufreq Module
 Q(cpufreq)
 Q(set_frequency)
+Q(set_governor)
+Q(budget_us)
 Q(get_current_frequencies)
 Q(get_supported_frequencies)
 
@@ -410,6 +508,10 @@ Q(format)
 // Size
 Q(size)
 
+// Timestamp/Frame Count
+Q(timestamp)
+Q(frame_count)
+
 // Get Pixel
 Q(get_pixel)
 Q(rgbtuple)
@@ -418,6 +520,22 @@ Q(rgbtuple)
 Q(set_pixel)
 Q(color)
 
+// Set Pixels
+Q(set_pixels)
+// duplicate Q(color)
+
+// Get Row/Column
+Q(get_row)
+Q(get_column)
+Q(buffer)
+
+// Image View
+Q(ImageView)
+Q(view)
+// duplicate Q(roi)
+Q(shape)
+// duplicate Q(stride)
+
 // Mean Pool
 Q(mean_pool)
 
@@ -436,6 +554,7 @@ Q(midpoint_pooled)
 Q(to_bitmap)
 Q(copy)
 Q(rgb_channel)
+Q(edge_aware)
 
 // To Grayscale
 Q(to_grayscale)
@@ -470,6 +589,12 @@ Q(compressed)
 Q(compressed_for_ide)
 // duplicate Q(quality)
 
+// Decompressed (out of place)
+Q(decompressed)
+// duplicate Q(scale)
+Q(grayscale)
+// duplicate Q(copy)
+
 // Encode for IDE (in place)
 Q(jpeg_encode_for_ide)
 
@@ -556,6 +681,7 @@ Q(alpha)
 // duplicate Q(mask)
 Q(hint)
 Q(IMAGE_HINT_BILINEAR)
+Q(IMAGE_HINT_AREA)
 Q(IMAGE_HINT_CENTER)
 
 // Draw Keypoints
@@ -709,6 +835,16 @@ Q(blend)
 // duplicate Q(alpha)
 // duplicate Q(mask)
 
+// Ops
+Q(ops)
+Q(run)
+// duplicate Q(add)
+// duplicate Q(sub)
+// duplicate Q(mul)
+// duplicate Q(difference)
+// duplicate Q(blend)
+// duplicate Q(binary)
+
 // Histogram Equalization
 Q(histeq)
 Q(adaptive)
@@ -780,6 +916,7 @@ Q(sharpen)
 Q(bilateral)
 Q(color_sigma)
 Q(space_sigma)
+Q(grid)
 // duplicate Q(threshold)
 // duplicate Q(offset)
 // duplicate Q(invert)
@@ -828,6 +965,9 @@ Q(corners)
 
 // Structural Similarity
 Q(get_similarity)
+// duplicate Q(block_size)
+// duplicate Q(step)
+// duplicate Q(threshold)
 // Similarity Object
 Q(similarity)
 // duplicate Q(mean)
@@ -872,6 +1012,7 @@ Q(b_value)
 // Get Statistics
 // duplicate Q(get_stats)
 // duplicate Q(get_statistics)
+Q(get_statistics_list)
 // duplicate Q(roi)
 // duplicate Q(bins)
 // duplicate Q(l_bins)
@@ -879,6 +1020,15 @@ Q(b_value)
 // duplicate Q(b_bins)
 // duplicate Q(thresholds)
 // duplicate Q(invert)
+// Integral Object
+Q(Integral)
+Q(integral)
+// duplicate Q(roi)
+Q(squared)
+// duplicate Q(map)
+Q(box_sum)
+// duplicate Q(mean)
+Q(variance)
 // Statistics Object
 // duplicate Q(statistics)
 // duplicate Q(mean)
@@ -949,6 +1099,17 @@ Q(threshold_cb)
 Q(merge_cb)
 Q(x_hist_bins_max)
 Q(y_hist_bins_max)
+Q(rle)
+Q(tracker)
+Q(area_range)
+Q(pixels_range)
+Q(density_range)
+Q(elongation_range)
+Q(roundness_range)
+Q(rotation_range)
+Q(aspect_ratio_range)
+Q(score_weights)
+Q(score_range)
 // Blob Object
 Q(blob)
 // duplicate Q(corners)
@@ -979,6 +1140,7 @@ Q(solidity)
 Q(convexity)
 Q(x_hist_bins)
 Q(y_hist_bins)
+// duplicate Q(id)
 Q(major_axis_line)
 Q(minor_axis_line)
 Q(enclosing_circle)
@@ -992,6 +1154,7 @@ Q(find_lines)
 // duplicate Q(threshold)
 Q(theta_margin)
 Q(rho_margin)
+Q(gradient)
 
 // Find Line Segments
 Q(find_line_segments)
@@ -1011,6 +1174,8 @@ Q(r_margin)
 Q(r_min)
 Q(r_max)
 Q(r_step)
+Q(two_stage)
+// duplicate Q(gradient)
 // Circle Object
 Q(circle)
 // duplicate Q(circle)
@@ -1063,6 +1228,9 @@ Q(fx)
 Q(fy)
 // duplicate Q(cx)
 // duplicate Q(cy)
+Q(quad_decimate)
+Q(max_tags)
+// duplicate Q(tracker)
 // AprilTag Object
 Q(apriltag)
 // duplicate Q(corners)
@@ -1097,6 +1265,8 @@ Q(ARTOOLKIT)
 Q(find_datamatrices)
 // duplicate Q(roi)
 Q(effort)
+Q(timeout_us)
+Q(time_budget_us)
 // DataMatrix Object
 Q(datamatrix)
 // duplicate Q(corners)
@@ -1115,6 +1285,9 @@ Q(padding)
 // Find BarCodes
 Q(find_barcodes)
 // duplicate Q(roi)
+// duplicate Q(x_stride)
+// duplicate Q(y_stride)
+Q(first_only)
 // BarCode Object
 Q(barcode)
 // duplicate Q(corners)
@@ -1144,6 +1317,20 @@ Q(PDF417)
 Q(CODE93)
 Q(CODE128)
 
+// Find Codes
+Q(find_codes)
+// duplicate Q(roi)
+Q(qrcodes)
+Q(datamatrices)
+Q(barcodes)
+Q(apriltags)
+// duplicate Q(families)
+// duplicate Q(fx)
+// duplicate Q(fy)
+// duplicate Q(cx)
+// duplicate Q(cy)
+// duplicate Q(effort)
+
 // Find Displacement
 Q(find_displacement)
 // duplicate Q(roi)
@@ -1156,6 +1343,21 @@ Q(displacement)
 // duplicate Q(rotation)
 // duplicate Q(scale)
 Q(response)
+Q(DisplacementTemplate)
+
+// Image Pyramid
+Q(ImagePyramid)
+Q(pyramid)
+// duplicate Q(levels)
+// duplicate Q(scale)
+// duplicate Q(update)
+
+// Find Motion Vectors
+Q(find_motion_vectors)
+// duplicate Q(roi)
+Q(block_size)
+Q(search_range)
+// duplicate Q(threshold)
 
 // Image Writer
 Q(ImageWriter)
@@ -1164,16 +1366,109 @@ Q(imagewriter)
 // duplicate Q(size)
 // duplicate Q(add_frame)
 // duplicate Q(close)
+// duplicate Q(buffer_size)
+// duplicate Q(index)
 
 // Image Reader
 Q(ImageReader)
+Q(ResultArray)
+Q(ImagePool)
+Q(results)
 // Image Reader Object
 Q(imagereader)
 // duplicate Q(size)
 Q(next_frame)
 // duplicate Q(copy_to_fb)
 // duplicate Q(loop)
+// duplicate Q(count)
+// duplicate Q(tell)
+// duplicate Q(seek)
 // duplicate Q(close)
+// duplicate Q(buffer_size)
+Q(real_time)
+
+// Blob Tracker
+Q(BlobTracker)
+// duplicate Q(margin)
+Q(rescan)
+Q(max_blobs)
+// duplicate Q(reset)
+
+// Object Tracker
+Q(ObjectTracker)
+Q(max_tracks)
+Q(min_hits)
+Q(max_misses)
+// duplicate Q(iou_threshold)
+Q(max_distance)
+Q(tracks)
+// duplicate Q(update)
+// duplicate Q(reset)
+
+// Compressed Image
+Q(CompressedImage)
+Q(decompress)
+// duplicate Q(update)
+// duplicate Q(width)
+// duplicate Q(height)
+// duplicate Q(size)
+
+// LK Tracker
+Q(LKTracker)
+Q(track_keypoints)
+Q(max_points)
+Q(levels)
+Q(window)
+// duplicate Q(cell_size)
+// duplicate Q(corner_detector)
+
+// AprilTag Tracker
+Q(AprilTagTracker)
+// duplicate Q(margin)
+// duplicate Q(rescan)
+// duplicate Q(max_tags)
+// duplicate Q(reset)
+
+// Gradient Map
+Q(GradientMap)
+// duplicate Q(reset)
+
+// Template Pyramid
+Q(TemplatePyramid)
+
+// LBP Map
+Q(LBPMap)
+// duplicate Q(cell_size)
+// duplicate Q(map)
+// duplicate Q(reset)
+
+// Background Model
+Q(BackgroundModel)
+// duplicate Q(gaussian)
+// duplicate Q(alpha)
+// duplicate Q(threshold)
+Q(update)
+// duplicate Q(reset)
+
+// Remap
+Q(Remap)
+Q(remap)
+// duplicate Q(lens_corr)
+// duplicate Q(rotation_corr)
+
+// Pipeline
+Q(Pipeline)
+// duplicate Q(run)
+// duplicate Q(lens_corr)
+// duplicate Q(gamma_corr)
+// duplicate Q(negate)
+// duplicate Q(binary)
+// duplicate Q(erode)
+// duplicate Q(dilate)
+// duplicate Q(mean)
+// duplicate Q(median)
+// duplicate Q(gaussian)
+// duplicate Q(morph)
 
 // FIR Module
 Q(fir)
@@ -1210,7 +1505,9 @@ Q(tf)
 Q(load_to_fb)
 Q(free_from_fb)
 Q(classify)
+Q(detect)
 Q(segment)
+// duplicate Q(truncated)
 
 // Model Object
 Q(tf_model)
@@ -1228,6 +1525,16 @@ Q(is_float)
 // duplicate Q(scale_mul)
 // duplicate Q(x_overlap)
 // duplicate Q(y_overlap)
+// duplicate Q(time_budget_us)
+
+// Detect
+// duplicate Q(detect)
+// duplicate Q(threshold)
+Q(iou_threshold)
+// duplicate Q(time_budget_us)
+
+// Find Objects
+Q(find_objects)
 
 // Class Object
 Q(tf_classification)
@@ -1236,10 +1543,13 @@ Q(tf_classification)
 // duplicate Q(w)
 // duplicate Q(h)
 Q(output)
+Q(frame)
 
 // Segment
 // duplicate Q(segment)
 // duplicate Q(roi)
+Q(argmax)
+Q(images)
 
 // IMU Module
 Q(imu)
@@ -1248,3 +1558,7 @@ Q(angular_rate_mdps)
 Q(temperature_c)
 Q(roll)
 Q(pitch)
+Q(fifo_enable)
+Q(fifo_read)
+Q(fifo_rotation)
+Q(rate)
@@ -0,0 +1,232 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * QSPI Flash driver (memory-mapped read only).
+ *
+ * The flash is programmed by the bootloader, the firmware only maps it at
+ * QSPI_BASE so that assets stored in it can be accessed in place.
+ */
+#include STM32_HAL_H
+#include "qspif.h"
+#include "omv_boardconfig.h"
+
+#if defined(OMV_QSPIF_LAYOUT)
+
+#define HAL_QSPI_TIMEOUT                (5000)
+
+#define CMD_RESET_ENABLE                (0x66)
+#define CMD_RESET_MEMORY                (0x99)
+
+#define CMD_READ_QUADIO                 (0xEC)
+
+#define CMD_4BYTE_ADDR_ENABLE           (0xB7)
+
+#define CMD_WRITE_ENABLE                (0x06)
+
+#define CMD_READ_STATUS_REG             (0x05)
+
+static QSPI_HandleTypeDef QSPIHandle = {0};
+static int qspif_write_enable();
+static int qspif_4byte_addr_mode_enable();
+static int qspif_poll_status_flag(uint32_t mask, uint32_t match, uint32_t timeout);
+
+int qspif_init()
+{
+    QSPIHandle.Instance = QUADSPI;
+    QSPIHandle.Init.ClockPrescaler     = 1; // clock = 200MHz / (1+1) = 100MHz
+    QSPIHandle.Init.FifoThreshold      = 3;
+    QSPIHandle.Init.SampleShifting     = QSPI_SAMPLE_SHIFTING_HALFCYCLE;
+    QSPIHandle.Init.FlashSize          = QSPIF_SIZE_BITS - 1;
+    QSPIHandle.Init.ChipSelectHighTime = QSPI_CS_HIGH_TIME_2_CYCLE;
+    QSPIHandle.Init.ClockMode          = QSPI_CLOCK_MODE_0;
+    QSPIHandle.Init.FlashID            = QSPI_FLASH_ID_1;
+    QSPIHandle.Init.DualFlash          = QSPI_DUALFLASH_DISABLE;
+
+    // Initialize the QSPI
+    HAL_QSPI_DeInit(&QSPIHandle);
+    if (HAL_QSPI_Init(&QSPIHandle) != HAL_OK) {
+        // Initialization Error
+        QSPIHandle.Instance = NULL;
+        return -1;
+    }
+
+    // Reset the QSPI
+    if (qspif_reset() != 0) {
+        return -1;
+    }
+
+    // Enable 4-byte address mode.
+    if (qspif_4byte_addr_mode_enable() != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int qspif_deinit()
+{
+    if (QSPIHandle.Instance != NULL &&
+            HAL_QSPI_DeInit(&QSPIHandle) != HAL_OK) {
+        return -1;
+    }
+    QSPIHandle.Instance = NULL;
+    return 0;
+}
+
+int qspif_reset()
+{
+    QSPI_CommandTypeDef command = {
+        .InstructionMode   = QSPI_INSTRUCTION_1_LINE,
+        .AddressMode       = QSPI_ADDRESS_NONE,
+        .AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE,
+        .DataMode          = QSPI_DATA_NONE,
+        .DummyCycles       = 0,
+        .DdrMode           = QSPI_DDR_MODE_DISABLE,
+        .DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY,
+        .SIOOMode          = QSPI_SIOO_INST_EVERY_CMD,
+    };
+
+    if (QSPIHandle.Instance == NULL) {
+        return -1;
+    }
+
+    command.Instruction = CMD_RESET_ENABLE;
+    if (HAL_QSPI_Command(&QSPIHandle, &command, HAL_QSPI_TIMEOUT) != HAL_OK) {
+        return -1;
+    }
+
+    command.Instruction = CMD_RESET_MEMORY;
+    if (HAL_QSPI_Command(&QSPIHandle, &command, HAL_QSPI_TIMEOUT) != HAL_OK) {
+        return -1;
+    }
+
+    if (qspif_poll_status_flag(QSPIF_SR_WIP_MASK, 0, HAL_QSPI_TIMEOUT) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int qspif_memory_map()
+{
+    QSPI_CommandTypeDef command = {
+        .InstructionMode   = QSPI_INSTRUCTION_1_LINE,
+        .Instruction       = CMD_READ_QUADIO,
+        .AddressMode       = QSPI_ADDRESS_4_LINES,
+        .AddressSize       = QSPI_ADDRESS_32_BITS,
+        .AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE,
+        .DataMode          = QSPI_DATA_4_LINES,
+        .DummyCycles       = QSPIF_READ_QUADIO_DCYC,
+        .DdrMode           = QSPI_DDR_MODE_DISABLE,
+        .DdrHoldHalfCycle  = QSPI_DDR_HHC_HALF_CLK_DELAY,
+        .SIOOMode          = QSPI_SIOO_INST_EVERY_CMD
+    };
+
+    // Keep CS low between cache line fills, the flash is never written
+    // by the firmware so there's no need to release it.
+    QSPI_MemoryMappedTypeDef config = {
+        .TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE,
+        .TimeOutPeriod     = 0,
+    };
+
+    if (QSPIHandle.Instance == NULL) {
+        return -1;
+    }
+
+    if (HAL_QSPI_MemoryMapped(&QSPIHandle, &command, &config) != HAL_OK) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int qspif_write_enable()
+{
+    QSPI_CommandTypeDef command = {
+        .InstructionMode   = QSPI_INSTRUCTION_1_LINE,
+        .Instruction       = CMD_WRITE_ENABLE,
+        .AddressMode       = QSPI_ADDRESS_NONE,
+        .AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE,
+        .DataMode          = QSPI_DATA_NONE,
+        .DummyCycles       = 0,
+        .DdrMode           = QSPI_DDR_MODE_DISABLE,
+        .DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY,
+        .SIOOMode          = QSPI_SIOO_INST_EVERY_CMD,
+    };
+
+    if (HAL_QSPI_Command(&QSPIHandle, &command, HAL_QSPI_TIMEOUT) != HAL_OK) {
+        return -1;
+    }
+
+    if (qspif_poll_status_flag(QSPIF_SR_WEL_MASK, QSPIF_SR_WEL_MASK, HAL_QSPI_TIMEOUT) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int qspif_4byte_addr_mode_enable()
+{
+    QSPI_CommandTypeDef command = {
+        .InstructionMode   = QSPI_INSTRUCTION_1_LINE,
+        .Instruction       = CMD_4BYTE_ADDR_ENABLE,
+        .AddressMode       = QSPI_ADDRESS_NONE,
+        .AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE,
+        .DataMode          = QSPI_DATA_NONE,
+        .DummyCycles       = 0,
+        .DdrMode           = QSPI_DDR_MODE_DISABLE,
+        .DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY,
+        .SIOOMode          = QSPI_SIOO_INST_EVERY_CMD,
+    };
+
+    if (qspif_write_enable() != 0) {
+        return -1;
+    }
+
+    if (HAL_QSPI_Command(&QSPIHandle, &command, HAL_QSPI_TIMEOUT) != HAL_OK) {
+        return -1;
+    }
+
+    if (qspif_poll_status_flag(QSPIF_SR_WIP_MASK, 0, HAL_QSPI_TIMEOUT) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int qspif_poll_status_flag(uint32_t mask, uint32_t match, uint32_t timeout)
+{
+    QSPI_AutoPollingTypeDef config = {
+        .Mask               = mask,
+        .Match              = match,
+        .MatchMode          = QSPI_MATCH_MODE_AND,
+        .Interval           = 0x10,
+        .AutomaticStop      = QSPI_AUTOMATIC_STOP_ENABLE,
+        .StatusBytesSize    = 1
+    };
+
+    QSPI_CommandTypeDef     command = {
+        .InstructionMode   = QSPI_INSTRUCTION_1_LINE,
+        .Instruction       = CMD_READ_STATUS_REG,
+        .AddressMode       = QSPI_ADDRESS_NONE,
+        .AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE,
+        .DataMode          = QSPI_DATA_1_LINE,
+        .DummyCycles       = 0,
+        .DdrMode           = QSPI_DDR_MODE_DISABLE,
+        .DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY,
+        .SIOOMode          = QSPI_SIOO_INST_EVERY_CMD
+    };
+
+    if (HAL_QSPI_AutoPolling(&QSPIHandle, &command, &config, timeout) != HAL_OK) {
+        return -1;
+    }
+
+    return 0;
+}
+
+#endif // OMV_QSPIF_LAYOUT
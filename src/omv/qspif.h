@@ -0,0 +1,17 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * QSPI Flash driver (memory-mapped read only).
+ */
+#ifndef __QSPIF_H__
+#define __QSPIF_H__
+int qspif_init();
+int qspif_deinit();
+int qspif_reset();
+int qspif_memory_map();
+#endif //__QSPIF_H__
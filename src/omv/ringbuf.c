@@ -6,11 +6,16 @@
  *
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * Simple Ring Buffer implementation.
+ * Single producer single consumer lock-free ring buffer.
+ *
+ * The data is copied in and out in at most two contiguous spans, and the barrier before each index
+ * update makes sure the other side sees the data before the index that publishes (or frees) it.
  */
 #include <string.h>
 #include "ringbuf.h"
 
+#define RING_BUF_MIN(x, y) ((x) < (y) ? (x) : (y))
+
 void ring_buf_init(ring_buf_t *buf)
 {
     memset(buf, 0, sizeof(*buf));
@@ -21,26 +26,69 @@ int ring_buf_empty(ring_buf_t *buf)
     return (buf->head == buf->tail);
 }
 
-void ring_buf_put(ring_buf_t *buf, uint8_t c)
+size_t ring_buf_size(ring_buf_t *buf)
 {
-   if ((buf->tail + 1) % BUFFER_SIZE == buf->head) {
-      /*buffer is full*/
-      return;
-   }
+    return buf->tail - buf->head;
+}
 
-   buf->data[buf->tail] = c;
-   buf->tail = (buf->tail + 1) % BUFFER_SIZE;
+size_t ring_buf_free(ring_buf_t *buf)
+{
+    return BUFFER_SIZE - ring_buf_size(buf);
+}
+
+void ring_buf_put(ring_buf_t *buf, uint8_t c)
+{
+    ring_buf_put_n(buf, &c, 1);
 }
 
 uint8_t ring_buf_get(ring_buf_t *buf)
 {
-   uint8_t c;
-   if (buf->head == buf->tail) {
-       /*buffer is empty*/
-       return 0;
-   }
+    uint8_t c = 0; // 0 if the buffer is empty.
+    ring_buf_get_n(buf, &c, 1);
+    return c;
+}
+
+size_t ring_buf_put_n(ring_buf_t *buf, const uint8_t *data, size_t len)
+{
+    uint32_t tail = buf->tail;
+    len = RING_BUF_MIN(len, ring_buf_free(buf));
+
+    size_t n = RING_BUF_MIN(len, BUFFER_SIZE - (tail & BUFFER_MASK));
+    memcpy(buf->data + (tail & BUFFER_MASK), data, n);
+    memcpy(buf->data, data + n, len - n);
 
-   c = buf->data[buf->head];
-   buf->head = (buf->head + 1) % BUFFER_SIZE;
-   return c;
+    __sync_synchronize();
+    buf->tail = tail + len;
+    return len;
+}
+
+size_t ring_buf_get_n(ring_buf_t *buf, uint8_t *data, size_t len)
+{
+    uint32_t head = buf->head;
+    len = RING_BUF_MIN(len, ring_buf_size(buf));
+    __sync_synchronize();
+
+    size_t n = RING_BUF_MIN(len, BUFFER_SIZE - (head & BUFFER_MASK));
+    memcpy(data, buf->data + (head & BUFFER_MASK), n);
+    memcpy(data + n, buf->data, len - n);
+
+    __sync_synchronize();
+    buf->head = head + len;
+    return len;
+}
+
+size_t ring_buf_peek(ring_buf_t *buf, uint8_t **data)
+{
+    uint32_t head = buf->head;
+    size_t len = RING_BUF_MIN(ring_buf_size(buf), BUFFER_SIZE - (head & BUFFER_MASK));
+    __sync_synchronize();
+
+    *data = buf->data + (head & BUFFER_MASK);
+    return len;
+}
+
+void ring_buf_consume(ring_buf_t *buf, size_t len)
+{
+    __sync_synchronize();
+    buf->head += RING_BUF_MIN(len, ring_buf_size(buf));
 }
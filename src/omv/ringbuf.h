@@ -6,13 +6,17 @@
  *
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * Simple Ring Buffer implementation.
+ * Single producer single consumer lock-free ring buffer.
  */
 #ifndef __RING_BUFFER_H__
 #define __RING_BUFFER_H__
 #include <stdint.h>
-#define BUFFER_SIZE (1024)
+#include <stddef.h>
+#define BUFFER_SIZE (1024) // Must be a power of 2.
+#define BUFFER_MASK (BUFFER_SIZE - 1)
 
+// The indices run freely (wrapping at 2^32) and are masked on access, head is only written by
+// the consumer and tail by the producer, so one of each (e.g. an ISR and a thread) needs no lock.
 typedef struct ring_buffer {
    volatile uint32_t head;
    volatile uint32_t tail;
@@ -21,6 +25,14 @@ typedef struct ring_buffer {
 
 void ring_buf_init(ring_buf_t *buf);
 int ring_buf_empty(ring_buf_t *buf);
+size_t ring_buf_size(ring_buf_t *buf);
+size_t ring_buf_free(ring_buf_t *buf);
 void ring_buf_put(ring_buf_t *buf, uint8_t c);
 uint8_t ring_buf_get(ring_buf_t *buf);
+// Copy up to len bytes in or out (what fits/what's there) and return the count.
+size_t ring_buf_put_n(ring_buf_t *buf, const uint8_t *data, size_t len);
+size_t ring_buf_get_n(ring_buf_t *buf, uint8_t *data, size_t len);
+// Zero-copy reads (e.g. to DMA from the ring): the contiguous bytes at the head, then release them.
+size_t ring_buf_peek(ring_buf_t *buf, uint8_t **data);
+void ring_buf_consume(ring_buf_t *buf, size_t len);
 #endif /* __RING_BUFFER_H__ */
@@ -26,7 +26,10 @@
 
 #include "mp.h"
 #include <stdbool.h>
+#include <string.h>
 #include STM32_HAL_H
+#include "irq.h"
+#include "dma.h"
 #include "ffconf.h"
 #include "diskio.h"
 #include "pincfg.h"
@@ -61,6 +64,16 @@
 
 #define SD_TIMEOUT          (100000)
 #define SPI_TIMEOUT         (100)  /* in ms */
+#define SPI_DMA_MIN_SIZE    (64)   /* Smaller transfers are polled */
+
+/* Number of blocks read at once with CMD18 when the host reads sequentially (FatFS reads
+   files one sector at a time when they are not read in whole clusters) */
+#ifndef SD_READ_AHEAD_BLOCKS
+#define SD_READ_AHEAD_BLOCKS (4)
+#endif
+
+/* The DMA can't access the CCM memory */
+#define CCM_BUFFER(p)       (!(((uint32_t) p) & (1u<<29)))
 
 /*--------------------------------------------------------------------------
   Module Private Functions and Variables
@@ -70,8 +83,15 @@ static const DWORD socket_state_mask_cp = (1 << 0);
 static volatile DSTATUS Stat = STA_NOINIT;    /* Disk status */
 
 static SPI_HandleTypeDef SPIHandle;
+static DMA_HandleTypeDef SPITxDMAHandle, SPIRxDMAHandle;
 DRESULT sdcard_ioctl(BYTE drv, BYTE ctrl, void *buff);
 
+/* Read-ahead cache, CacheCount blocks starting at CacheSector */
+static BYTE ReadCache[SD_READ_AHEAD_BLOCKS * SDCARD_BLOCK_SIZE] __attribute__((aligned(4)));
+static DWORD CacheSector, CacheCount;
+static DWORD NextSector;        /* Sector following the last read */
+static DWORD SectorCount;       /* Card size in sectors, reads ahead stop there */
+
 bool sdcard_is_present(void)
 {
     return (HAL_GPIO_ReadPin(SD_CD_PORT, SD_CD_PIN)==GPIO_PIN_RESET);
@@ -88,24 +108,69 @@ static BYTE spi_send(BYTE out)
     return out;
 }
 
-static bool spi_send_buff(const BYTE *buff, uint32_t size)
+#define spi_recv() spi_send(0xFF)
+
+static bool spi_dma_wait(void)
+{
+    for (mp_uint_t tick_start = HAL_GetTick(); HAL_SPI_GetState(&SPIHandle) != HAL_SPI_STATE_READY; __WFI()) {
+        if ((HAL_GetTick() - tick_start) >= SPI_TIMEOUT) {
+            HAL_SPI_Abort(&SPIHandle);
+            return false;
+        }
+    }
+
+    return (SPIHandle.ErrorCode == HAL_SPI_ERROR_NONE);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Transmit (rx == NULL) or receive a buffer, data blocks use DMA and    */
+/* the CPU sleeps until the transfer is done                             */
+/*-----------------------------------------------------------------------*/
+static bool spi_xfer_buff(BYTE *tx, BYTE *rx, uint32_t size)
 {
-    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
-    bool res = (HAL_SPI_Transmit(&SPIHandle, (void*)buff, size, SPI_TIMEOUT) == HAL_OK);
-    MICROPY_END_ATOMIC_SECTION(atomic_state);
+    bool res;
+
+    /* Keep the USB MSC out of the transfer, the DMA IRQs have a higher priority */
+    uint32_t basepri = raise_irq_pri(IRQ_PRI_OTG_FS);
+
+    if ((size < SPI_DMA_MIN_SIZE) || CCM_BUFFER(tx) || (rx && CCM_BUFFER(rx))) {
+        res = (rx ? HAL_SPI_TransmitReceive(&SPIHandle, tx, rx, size, SPI_TIMEOUT)
+                  : HAL_SPI_Transmit(&SPIHandle, tx, size, SPI_TIMEOUT)) == HAL_OK;
+    } else {
+        dma_init(&SPITxDMAHandle, SD_SPI_TX_DMA, DMA_MEMORY_TO_PERIPH, &SPIHandle);
+        SPIHandle.hdmatx = &SPITxDMAHandle;
+
+        if (rx) {
+            dma_init(&SPIRxDMAHandle, SD_SPI_RX_DMA, DMA_PERIPH_TO_MEMORY, &SPIHandle);
+            SPIHandle.hdmarx = &SPIRxDMAHandle;
+        }
+
+        res = ((rx ? HAL_SPI_TransmitReceive_DMA(&SPIHandle, tx, rx, size)
+                   : HAL_SPI_Transmit_DMA(&SPIHandle, tx, size)) == HAL_OK) && spi_dma_wait();
+
+        dma_deinit(SD_SPI_TX_DMA);
+        SPIHandle.hdmatx = NULL;
+
+        if (rx) {
+            dma_deinit(SD_SPI_RX_DMA);
+            SPIHandle.hdmarx = NULL;
+        }
+    }
+
+    restore_irq_pri(basepri);
     return res;
 }
 
-#define spi_recv() spi_send(0xFF)
+static bool spi_send_buff(const BYTE *buff, uint32_t size)
+{
+    return spi_xfer_buff((BYTE *) buff, NULL, size);
+}
 
 static bool spi_recv_buff(BYTE *buff, uint32_t size)
 {
-    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
-    do {
-        *buff++ = spi_recv();
-    } while (--size);
-    MICROPY_END_ATOMIC_SECTION(atomic_state);
-    return true;
+    /* The card must see 0xFF on MOSI while sending, the buffer is sent while it's filled */
+    memset(buff, 0xFF, size);
+    return spi_xfer_buff(buff, buff, size);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -148,7 +213,9 @@ static bool rcvr_datablock(BYTE *buff, UINT btr)
         return false;    /* If not valid data token, return with error */
     }
 
-    spi_recv_buff(buff, btr);
+    if (!spi_recv_buff(buff, btr)) {
+        return false;
+    }
 
     /* Discard CRC */
     spi_recv();
@@ -171,7 +238,9 @@ static bool xmit_datablock(const BYTE *buff, BYTE token)
     spi_send(token);
 
     if (token != 0xFD) { /* Is data token */
-        spi_send_buff(buff, SDCARD_BLOCK_SIZE);
+        if (!spi_send_buff(buff, SDCARD_BLOCK_SIZE)) {
+            return false;
+        }
 
         /* CRC (Dummy) */
         spi_send(0xFF);
@@ -299,10 +368,17 @@ void sdcard_init(void)
     CardType = ty;
     release_spi();
 
+    CacheCount = 0;
+    NextSector = 0;
+    SectorCount = 0;
+
     if (ty) {
         /* Initialization succeeded */
         Stat &= ~STA_NOINIT; /* Clear STA_NOINIT */
         sdcard_hw_init(SPI_BAUDRATEPRESCALER_2);
+        if (sdcard_ioctl(0, GET_SECTOR_COUNT, &SectorCount) != RES_OK) {
+            SectorCount = 0;    /* No read-ahead */
+        }
     } else {
         /* Initialization failed */
         BREAK();
@@ -319,12 +395,8 @@ void sdcard_power_off(void)
 
 }
 
-mp_uint_t sdcard_read_blocks(uint8_t *buff, uint32_t sector, uint32_t count)
+static mp_uint_t read_blocks(uint8_t *buff, uint32_t sector, uint32_t count)
 {
-    if (Stat & STA_NOINIT) {
-        return false;
-    }
-
     if (!(CardType & CT_BLOCK)) {
         sector *= SDCARD_BLOCK_SIZE;    /* Convert to byte address if needed */
     }
@@ -350,12 +422,53 @@ mp_uint_t sdcard_read_blocks(uint8_t *buff, uint32_t sector, uint32_t count)
     return count ? true: false;
 }
 
+mp_uint_t sdcard_read_blocks(uint8_t *buff, uint32_t sector, uint32_t count)
+{
+    if (Stat & STA_NOINIT) {
+        return false;
+    }
+
+    bool sequential = (sector == NextSector);
+    NextSector = sector + count;
+
+    /* Blocks already read ahead */
+    while (count && (sector >= CacheSector) && (sector < (CacheSector + CacheCount))) {
+        memcpy(buff, ReadCache + ((sector - CacheSector) * SDCARD_BLOCK_SIZE), SDCARD_BLOCK_SIZE);
+        buff += SDCARD_BLOCK_SIZE;
+        sector++;
+        count--;
+    }
+
+    if (!count) {
+        return false;
+    }
+
+    /* Small sequential reads fetch the following blocks too with a single CMD18 */
+    if (sequential && (count < SD_READ_AHEAD_BLOCKS) && ((sector + SD_READ_AHEAD_BLOCKS) <= SectorCount)) {
+        CacheCount = 0;
+        if (read_blocks(ReadCache, sector, SD_READ_AHEAD_BLOCKS)) {
+            return true;
+        }
+        CacheSector = sector;
+        CacheCount = SD_READ_AHEAD_BLOCKS;
+        memcpy(buff, ReadCache, count * SDCARD_BLOCK_SIZE);
+        return false;
+    }
+
+    return read_blocks(buff, sector, count);
+}
+
 mp_uint_t sdcard_write_blocks(const uint8_t *buff, uint32_t sector, uint32_t count)
 {
     if (Stat & STA_NOINIT) {
         return false;
     }
 
+    /* Drop the read-ahead blocks that are overwritten */
+    if ((sector < (CacheSector + CacheCount)) && ((sector + count) > CacheSector)) {
+        CacheCount = 0;
+    }
+
     if (!(CardType & CT_BLOCK)) {
         sector *= SDCARD_BLOCK_SIZE;    /* Convert to byte address if needed */
     }
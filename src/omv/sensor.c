@@ -12,6 +12,7 @@
 #include <string.h>
 #include "mp.h"
 #include "irq.h"
+#include "py/mphal.h"
 #include "cambus.h"
 #include "ov9650.h"
 #include "ov2640.h"
@@ -24,10 +25,22 @@
 #include "sensor.h"
 #include "systick.h"
 #include "framebuffer.h"
+#include "ff_wrapper.h"
+#include "wifistream.h"
+#include "gc_stats.h"
+#include "trace.h"
+#include "frame_stats.h"
 #include "omv_boardconfig.h"
 
 #define MAX_XFER_SIZE   (0xFFFF*4)
 
+// The probe result (slave address, chip ID and line polarities) is kept in an RTC backup
+// register, which survives resets (and power cycles with a backup battery), so that the next
+// boot doesn't have to scan the bus with each polarity.
+#define PROBE_CACHE_BKP     (RTC->BKP19R)
+#define PROBE_CACHE_MAGIC   (0x5E000000)
+#define PROBE_CACHE_MASK    (0xFF000000)
+
 sensor_t           sensor     = {0};
 TIM_HandleTypeDef  TIMHandle  = {0};
 DMA_HandleTypeDef  DMAHandle  = {0};
@@ -36,6 +49,98 @@ DCMI_HandleTypeDef DCMIHandle = {0};
 static volatile int line = 0;
 extern uint8_t _line_buf;
 static uint8_t *dest_fb = NULL;
+// Zero-copy mode state, the size of each DMA transfer in bytes (0 == disabled).
+static volatile uint32_t direct_xfer_size = 0;
+static uint32_t direct_xfer_end = 0;
+#if defined(MCU_SERIES_H7)
+// MDMA state, the MDMA copies (and transposes or extracts Y from) the lines in the line callback.
+static MDMA_HandleTypeDef MDMAHandle = {0};
+static bool mdma_enabled = false;
+static uint32_t mdma_src_bpp = 0;       // Source bytes per pixel.
+static uint32_t mdma_line_size = 0;     // Destination bytes per line (1 pixel if transposed).
+static uint32_t mdma_block_size = 0;    // MDMA block size (bytes).
+static uint32_t mdma_block_count = 0;   // MDMA blocks per line.
+#endif
+// Capture plane state.
+static plane_t plane_mode = PLANE_NONE;
+static image_t plane_image = {0};
+static color_thresholds_list_lnk_data_t plane_thresholds[SENSOR_PLANE_MAX_THRESHOLDS];
+static int plane_n_thresholds = 0;
+static bool plane_invert = false;
+static bool plane_active = false; // The plane is computed for the current frame.
+#ifdef IMLIB_ENABLE_MATH_OPS
+// Gamma correction state.
+static gamma_lut_t gamma_lut;
+static bool gamma_enabled = false;
+static bool gamma_active = false; // The lines of the current frame are corrected.
+#else
+#define gamma_active    (false)
+#endif
+// Motion detector state.
+#define MOTION_STEP     (4) // Sample every 4th pixel of every 4th line.
+static bool motion_enabled = false;
+static bool motion_active = false; // The motion detector runs for the current frame.
+static bool motion_bg_valid = false;
+static int motion_threshold = 0;
+static int motion_bpp = 0;
+static int motion_cell_w = 0, motion_cell_h = 0, motion_samples = 0;
+static int motion_cells = 0;
+static int motion_score = 0;
+static uint8_t motion_bg[SENSOR_MOTION_GRID_H][SENSOR_MOTION_GRID_W];
+static uint32_t motion_acc[SENSOR_MOTION_GRID_W];
+static uint32_t motion_map[SENSOR_MOTION_GRID_H];
+static uint32_t motion_result[SENSOR_MOTION_GRID_H];
+
+// Native auto exposure state.
+#define AE_STEP         (4)     // Sample every 4th pixel of every 4th line.
+#define AE_BINS         (64)    // Luminance histogram bins.
+#define AE_DEADBAND     (0.05f) // Errors (in stops) below this don't write the sensor.
+#define AE_STOP_DB      (6.0206f) // 20 * log10(2)
+#define AE_AWB_MAX_DB   (12.0f)
+static bool ae_enabled = false;
+static bool ae_active = false; // The statistics are collected for the current frame.
+static volatile bool ae_ready = false; // The statistics of a new frame are ready.
+static bool ae_awb = false;
+static int ae_bpp = 0;
+static int ae_target = 0;
+static float ae_speed = 0.0f;
+static int ae_max_exposure_us = 0;
+static float ae_max_gain_db = 0.0f;
+static float ae_ev = 0.0f; // Exposure and gain in stops (log2 of the exposure in us).
+static int ae_mean = 0;
+static int ae_exposure_us = 0;
+static float ae_gain_db = 0.0f;
+static float ae_rgb_gain_db[3];
+static uint32_t ae_acc[AE_BINS], ae_hist[AE_BINS];
+static uint32_t ae_rgb_acc[3], ae_rgb[3];
+// Frame timestamps and counters (per frame buffer).
+static volatile uint32_t vsync_count = 0;
+static volatile bool vsync_pending = false;
+static uint32_t frame_ts[3] = {0};
+static uint32_t frame_seq[3] = {0};
+static uint32_t dropped_frames = 0;
+// External frame sync input (see sensor_set_sync_input), frames are numbered and timestamped by trigger.
+static volatile bool sync_input = false;
+static volatile uint32_t sync_count = 0;
+static volatile uint32_t sync_ts = 0;
+// Number of frames to drop before the sensor output is valid after a mode switch.
+static uint32_t settle_count = 0;
+// Retained state in shutdown mode (see sensor_shutdown).
+static bool shutdown_state = false;
+static uint32_t dcmi_regs[6];
+static uint32_t dma_regs[2];
+// Hardware JPEG compression while capturing (see sensor_set_jpeg_stream).
+static bool jpeg_stream_enabled = false;
+static bool jpeg_stream_active = false; // The current frame is compressed while it's captured.
+static bool jpeg_stream_ready = false;  // The JPEG frame buffer holds the last captured frame.
+static jpegbuffer_frame_t *jpeg_stream_frame = NULL; // The JPEG frame buffer slot of the stream.
+static int jpeg_stream_quality = 0;
+// Multi-buffer (continuous capture) mode state.
+static volatile bool continuous = false;
+static volatile int32_t ready_buf = -1;
+
+// Returns a pointer to a frame buffer in multi-buffer mode.
+#define FB_SLOT(i)      (MAIN_FB()->pixels + ((i) * MAIN_FB()->buf_size))
 
 const int resolution[][2] = {
     {0,    0   },
@@ -194,10 +299,194 @@ static int dma_config()
     return 0;
 }
 
+#if defined(MCU_SERIES_H7)
+// Configures the MDMA to copy lines from the line buffer to the frame buffer, using the
+// current pixel format and window. Returns 0 if the line copy can be offloaded to the MDMA.
+static int mdma_config(sensor_t *sensor)
+{
+    uint32_t dst_bpp;
+
+    mdma_enabled = false;
+
+    switch (sensor->pixformat) {
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_YUV422:
+            mdma_src_bpp = dst_bpp = 2;
+            break;
+        case PIXFORMAT_BAYER:
+            mdma_src_bpp = dst_bpp = 1;
+            break;
+        case PIXFORMAT_GRAYSCALE:
+            // Note: In 2BPP mode, the source is incremented by 2 to extract the Y channel.
+            mdma_src_bpp = sensor->gs_bpp;
+            dst_bpp = 1;
+            break;
+        default:
+            return -1;
+    }
+
+    if (sensor->transpose) {
+        // Each pixel is a block, and each block is written to the next line of the frame buffer.
+        mdma_line_size   = dst_bpp;
+        mdma_block_size  = dst_bpp;
+        mdma_block_count = MAIN_FB()->u;
+    } else {
+        mdma_line_size   = MAIN_FB()->u * dst_bpp;
+        mdma_block_size  = MAIN_FB()->u * dst_bpp;
+        mdma_block_count = 1;
+    }
+
+    MDMAHandle.Instance                      = MDMA_Channel0;
+    MDMAHandle.Init.Request                  = MDMA_REQUEST_SW;
+    MDMAHandle.Init.TransferTriggerMode      = MDMA_REPEAT_BLOCK_TRANSFER;
+    MDMAHandle.Init.Priority                 = MDMA_PRIORITY_HIGH;
+    MDMAHandle.Init.Endianness               = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+    MDMAHandle.Init.SourceInc                = (mdma_src_bpp == 2) ? MDMA_SRC_INC_HALFWORD : MDMA_SRC_INC_BYTE;
+    MDMAHandle.Init.DestinationInc           = (dst_bpp == 2) ? MDMA_DEST_INC_HALFWORD : MDMA_DEST_INC_BYTE;
+    MDMAHandle.Init.SourceDataSize           = (dst_bpp == 2) ? MDMA_SRC_DATASIZE_HALFWORD : MDMA_SRC_DATASIZE_BYTE;
+    MDMAHandle.Init.DestDataSize             = (dst_bpp == 2) ? MDMA_DEST_DATASIZE_HALFWORD : MDMA_DEST_DATASIZE_BYTE;
+    MDMAHandle.Init.DataAlignment            = MDMA_DATAALIGN_PACKENABLE;
+    MDMAHandle.Init.BufferTransferLength     = IM_MIN(mdma_block_size, 128);
+    MDMAHandle.Init.SourceBurst              = MDMA_SOURCE_BURST_SINGLE;
+    MDMAHandle.Init.DestBurst                = MDMA_DEST_BURST_SINGLE;
+    MDMAHandle.Init.SourceBlockAddressOffset = 0;
+    MDMAHandle.Init.DestBlockAddressOffset   = sensor->transpose ? ((MAIN_FB()->v - 1) * dst_bpp) : 0;
+
+    if (HAL_MDMA_Init(&MDMAHandle) != HAL_OK) {
+        return -1;
+    }
+
+    mdma_enabled = true;
+    return 0;
+}
+
+// Waits for the MDMA to finish copying the last line.
+static void mdma_wait()
+{
+    if (mdma_enabled) {
+        HAL_MDMA_PollForTransfer(&MDMAHandle, HAL_MDMA_FULL_TRANSFER, 10);
+    }
+}
+
+// Stops the MDMA and returns to CPU line copy.
+static void mdma_abort()
+{
+    if (mdma_enabled) {
+        HAL_MDMA_Abort(&MDMAHandle);
+        mdma_enabled = false;
+    }
+}
+#endif
+
+// Starts compressing the current frame to the JPEG frame buffer, the lines are fed to the
+// hardware encoder from the line callback as they're captured.
+static void jpeg_stream_config(sensor_t *sensor)
+{
+    jpeg_stream_active = false;
+
+    #if (OMV_HARDWARE_JPEG == 1)
+    if (!jpeg_stream_enabled || sensor->transpose
+            || (sensor->pixformat != PIXFORMAT_RGB565 && sensor->pixformat != PIXFORMAT_GRAYSCALE)) {
+        return;
+    }
+
+    // The JPEG frame buffer slot is kept until the frame is compressed.
+    if (!(jpeg_stream_frame = fb_begin_jpeg_frame())) {
+        return;
+    }
+
+    image_t src = {.w=MAIN_FB()->u, .h=MAIN_FB()->v,
+        .bpp=(sensor->pixformat == PIXFORMAT_RGB565) ? 2 : 1, .pixels=MAIN_FB()->pixels};
+    image_t dst = {.w=MAIN_FB()->u, .h=MAIN_FB()->v, .bpp=JPEG_FB_FRAME_SIZE, .pixels=jpeg_stream_frame->pixels};
+
+    if (jpeg_stream_start(&src, &dst, jpeg_stream_quality)) {
+        jpeg_stream_frame->size = 0;
+        fb_end_jpeg_frame(jpeg_stream_frame);
+        return;
+    }
+
+    jpeg_stream_active = true;
+    #endif
+}
+
+// Waits for the last lines of the frame to be compressed, or aborts the compression.
+static void jpeg_stream_finish(bool abort)
+{
+    if (!jpeg_stream_active) {
+        return;
+    }
+
+    jpeg_stream_active = false;
+
+    #if (OMV_HARDWARE_JPEG == 1)
+    image_t dst = {.w=MAIN_FB()->u, .h=MAIN_FB()->v, .bpp=0};
+    if (abort) {
+        jpeg_stream_abort();
+    } else {
+        jpeg_stream_ready = !jpeg_stream_end(&dst, 100);
+    }
+
+    jpeg_stream_frame->bpp = 0;
+    if (jpeg_stream_ready) {
+        jpeg_stream_frame->w = dst.w; jpeg_stream_frame->h = dst.h; jpeg_stream_frame->size = dst.bpp;
+    } else {
+        jpeg_stream_frame->w = 0; jpeg_stream_frame->h = 0; jpeg_stream_frame->size = 0;
+    }
+
+    fb_end_jpeg_frame(jpeg_stream_frame);
+    #endif
+}
+
+// Stops a continuous capture (if any) and returns to single buffer mode.
+// Note: This must be called before changing anything that affects the frame size.
+static void dcmi_abort()
+{
+    if (continuous) {
+        // Stop the DCMI from generating DMA requests first, then stop the DMA.
+        DCMI->CR &= ~DCMI_CR_CAPTURE;
+        HAL_DMA_Abort(&DMAHandle);
+        HAL_NVIC_DisableIRQ(DMA2_Stream1_IRQn);
+
+        #if defined(MCU_SERIES_H7)
+        mdma_abort();
+        #endif
+
+        #if defined(DCMI_FSYNC_PIN)
+        if (SENSOR_HW_FLAGS_GET(&sensor, SENSOR_HW_FLAGS_FSYNC) && !sync_input) {
+            DCMI_FSYNC_LOW();
+        }
+        #endif
+
+        __disable_irq();
+        continuous = false;
+        ready_buf = -1;
+        dest_fb = NULL;
+        __enable_irq();
+
+        if (MAIN_FB()->head != 0 && MAIN_FB()->bpp >= 0) {
+            // Move the user frame to the first buffer, which is where it's expected.
+            memmove(MAIN_FB()->pixels, MAIN_FB_BUFFER(), fb_buffer_size());
+        }
+
+        MAIN_FB()->buf_size = 0;
+        MAIN_FB()->head = 0;
+        MAIN_FB()->tail = -1;
+    }
+}
+
 void sensor_init0()
 {
-    // Save fb_enabled flag state
+    // Stop any running continuous capture.
+    dcmi_abort();
+
+    // The capture plane was a heap image of the previous session.
+    plane_mode = PLANE_NONE;
+    plane_active = false;
+
+    // Save fb_enabled flag state, and the other IDE controlled settings.
     int fb_enabled = JPEG_FB()->enabled;
+    int fb_budget = JPEG_FB()->budget;
+    int fb_raw = JPEG_FB()->raw;
 
     // Clear framebuffers
     memset(MAIN_FB(), 0, sizeof(*MAIN_FB()));
@@ -206,6 +495,10 @@ void sensor_init0()
     // Skip the first frame.
     MAIN_FB()->bpp = -1;
 
+    // Single buffer mode.
+    MAIN_FB()->n_buffers = 1;
+    MAIN_FB()->tail = -1;
+
     // Enable streaming.
     MAIN_FB()->streaming_enabled = true; // controlled by the OpenMV Cam.
 
@@ -214,6 +507,57 @@ void sensor_init0()
 
     // Set fb_enabled
     JPEG_FB()->enabled = fb_enabled; // controlled by the IDE.
+    JPEG_FB()->budget = fb_budget; // controlled by the IDE.
+    JPEG_FB()->raw = fb_raw; // controlled by the IDE.
+}
+
+// Uses the cached probe result, returns false if there's none or the sensor doesn't answer.
+// Expects the sensor to be out of reset and powered up for active high pins (like the probe).
+static bool sensor_probe_cached()
+{
+    uint32_t cache = PROBE_CACHE_BKP;
+    if ((cache & PROBE_CACHE_MASK) != PROBE_CACHE_MAGIC) {
+        return false;
+    }
+
+    sensor.slv_addr = cache & 0xFF;
+    sensor.reset_pol = (cache & (1 << 16)) ? ACTIVE_HIGH : ACTIVE_LOW;
+    sensor.pwdn_pol = (cache & (1 << 17)) ? ACTIVE_HIGH : ACTIVE_LOW;
+
+    if (sensor.reset_pol == ACTIVE_LOW) {
+        DCMI_RESET_HIGH();
+        systick_sleep(10);
+    }
+
+    if (sensor.pwdn_pol == ACTIVE_LOW) {
+        DCMI_PWDN_HIGH();
+        systick_sleep(10);
+    }
+
+    if (cambus_probe(&sensor.i2c, sensor.slv_addr) != 0) {
+        // Restore the line state for the full probe.
+        DCMI_PWDN_LOW();
+        DCMI_RESET_LOW();
+        systick_sleep(10);
+        sensor.slv_addr = 0;
+        sensor.reset_pol = ACTIVE_HIGH;
+        sensor.pwdn_pol = ACTIVE_HIGH;
+        return false;
+    }
+
+    return true;
+}
+
+static void sensor_probe_cache_update()
+{
+    uint32_t cache = PROBE_CACHE_MAGIC | sensor.slv_addr
+                   | ((sensor.reset_pol == ACTIVE_HIGH) ? (1 << 16) : 0)
+                   | ((sensor.pwdn_pol == ACTIVE_HIGH) ? (1 << 17) : 0);
+
+    if (PROBE_CACHE_BKP != cache) {
+        HAL_PWR_EnableBkUpAccess();
+        PROBE_CACHE_BKP = cache;
+    }
 }
 
 int sensor_init()
@@ -282,8 +626,9 @@ int sensor_init()
     systick_sleep(10);
 
     /* Probe the sensor */
-    sensor.slv_addr = cambus_scan(&sensor.i2c);
-    if (sensor.slv_addr == 0) {
+    if (sensor_probe_cached()) {
+        // Found at the cached address.
+    } else if ((sensor.slv_addr = cambus_scan(&sensor.i2c)) == 0) {
         /* Sensor has been held in reset,
            so the reset line is active low */
         sensor.reset_pol = ACTIVE_LOW;
@@ -321,6 +666,9 @@ int sensor_init()
     // Set default snapshot function.
     sensor.snapshot = sensor_snapshot;
 
+    // Drop the first frame after a mode switch by default (drivers may override this).
+    sensor.settle_frames = 1;
+
     switch (sensor.slv_addr) {
     case OV2640_SLV_ADDR:
         cambus_readb(&sensor.i2c, sensor.slv_addr, OV_CHIP_ID, &sensor.chip_id);
@@ -414,9 +762,14 @@ int sensor_init()
     // Disable VSYNC EXTI IRQ
     HAL_NVIC_DisableIRQ(DCMI_VSYNC_IRQN);
 
+    // Probe this sensor directly on the next boot.
+    sensor_probe_cache_update();
+
     // Clear fb_enabled flag
     // This is executed only once to initialize the FB enabled flag.
     JPEG_FB()->enabled = 0;
+    JPEG_FB()->budget = 0;
+    JPEG_FB()->raw = 0;
 
     // Set default color palette.
     sensor.color_palette = rainbow_table;
@@ -448,6 +801,9 @@ int sensor_reset()
     // Restore shutdown state on reset.
     sensor_shutdown(false);
 
+    // Stop continuous capture before resetting the sensor.
+    dcmi_abort();
+
     // Call sensor-specific reset function
     if (sensor.reset(&sensor) != 0) {
         return -1;
@@ -456,6 +812,18 @@ int sensor_reset()
     // Just in case there's a running DMA request.
     HAL_DMA_Abort(&DMAHandle);
 
+    // Restore single buffer mode.
+    MAIN_FB()->n_buffers = 1;
+
+    // The sensor's own AE is back on after a reset.
+    ae_enabled = false;
+    ae_active = false;
+
+    // Reset the frame counters.
+    MAIN_FB()->frame_count = 0;
+    dropped_frames = 0;
+    settle_count = 0;
+
     // Disable VSYNC EXTI IRQ
     HAL_NVIC_DisableIRQ(DCMI_VSYNC_IRQN);
     return 0;
@@ -476,11 +844,65 @@ int sensor_sleep(int enable)
     return 0;
 }
 
+// The sensor keeps its registers in power-down mode, so waking up only needs the sensor clock and
+// the DCMI/DMA configuration restored (in case the MCU low-power mode didn't retain it) without a reset.
 int sensor_shutdown(int enable)
 {
     if (enable) {
+        if (!shutdown_state) {
+            // Stop capturing before powering down the sensor.
+            dcmi_abort();
+
+            // Save the DCMI/DMA configuration.
+            dcmi_regs[0] = DCMI->CR;
+            dcmi_regs[1] = DCMI->IER;
+            dcmi_regs[2] = DCMI->ESCR;
+            dcmi_regs[3] = DCMI->ESUR;
+            dcmi_regs[4] = DCMI->CWSTRTR;
+            dcmi_regs[5] = DCMI->CWSIZER;
+            dma_regs[0] = DMA2_Stream1->CR;
+            dma_regs[1] = DMA2_Stream1->FCR;
+            shutdown_state = true;
+        }
+
         DCMI_PWDN_HIGH();
+
+        #if (OMV_XCLK_SOURCE == OMV_XCLK_TIM)
+        // Stop the sensor clock.
+        if (TIMHandle.Instance != NULL) {
+            HAL_TIM_PWM_Stop(&TIMHandle, DCMI_TIM_CHANNEL);
+        }
+        #endif
     } else {
+        if (shutdown_state) {
+            #if (OMV_XCLK_SOURCE == OMV_XCLK_TIM)
+            // Restart the sensor clock.
+            if (TIMHandle.Instance != NULL) {
+                HAL_TIM_PWM_Start(&TIMHandle, DCMI_TIM_CHANNEL);
+            }
+            #endif
+
+            // Restore the DCMI/DMA configuration.
+            if (DCMI->CR != dcmi_regs[0]) {
+                DCMI->CR = 0;
+                DCMI->IER = dcmi_regs[1];
+                DCMI->ESCR = dcmi_regs[2];
+                DCMI->ESUR = dcmi_regs[3];
+                DCMI->CWSTRTR = dcmi_regs[4];
+                DCMI->CWSIZER = dcmi_regs[5];
+                DCMI->CR = dcmi_regs[0];
+            }
+
+            if ((DMA2_Stream1->CR & ~DMA_SxCR_EN) != (dma_regs[0] & ~DMA_SxCR_EN)) {
+                DMA2_Stream1->CR = dma_regs[0] & ~DMA_SxCR_EN;
+                DMA2_Stream1->FCR = dma_regs[1];
+            }
+
+            // Drop the frames output while the sensor wakes up.
+            settle_count = sensor.settle_frames;
+            shutdown_state = false;
+        }
+
         DCMI_PWDN_LOW();
     }
 
@@ -519,6 +941,9 @@ int sensor_set_pixformat(pixformat_t pixformat)
         return -1;
     }
 
+    // Stop continuous capture.
+    dcmi_abort();
+
     if (sensor.set_pixformat == NULL
         || sensor.set_pixformat(&sensor, pixformat) != 0) {
         // Operation not supported
@@ -528,6 +953,9 @@ int sensor_set_pixformat(pixformat_t pixformat)
     // Set pixel format
     sensor.pixformat = pixformat;
 
+    // Drop the frames output while the sensor settles.
+    settle_count = sensor.settle_frames;
+
     // Set JPEG mode
     if (pixformat == PIXFORMAT_JPEG) {
         jpeg_mode = DCMI_JPEG_ENABLE;
@@ -546,6 +974,9 @@ int sensor_set_framesize(framesize_t framesize)
         return 0;
     }
 
+    // Stop continuous capture.
+    dcmi_abort();
+
     // Call the sensor specific function
     if (sensor.set_framesize == NULL
         || sensor.set_framesize(&sensor, framesize) != 0) {
@@ -556,6 +987,9 @@ int sensor_set_framesize(framesize_t framesize)
     // Set framebuffer size
     sensor.framesize = framesize;
 
+    // Drop the frames output while the sensor settles.
+    settle_count = sensor.settle_frames;
+
     // Skip the first frame.
     MAIN_FB()->bpp = -1;
 
@@ -573,8 +1007,23 @@ int sensor_set_framesize(framesize_t framesize)
     return 0;
 }
 
+int sensor_set_mode(pixformat_t pixformat, framesize_t framesize)
+{
+    // Only the registers that differ are written, and the settle frames are not accumulated
+    // so the sensor settles once after both changes.
+    if (sensor_set_pixformat(pixformat) != 0
+        || sensor_set_framesize(framesize) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
 int sensor_set_windowing(int x, int y, int w, int h)
 {
+    // Stop continuous capture.
+    dcmi_abort();
+
     MAIN_FB()->x = x;
     MAIN_FB()->y = y;
     MAIN_FB()->w = MAIN_FB()->u = w;
@@ -764,6 +1213,11 @@ int sensor_set_transpose(bool enable)
         return -1;
     }
 
+    if (sensor.transpose != enable) {
+        // Stop continuous capture.
+        dcmi_abort();
+    }
+
     sensor.transpose = enable;
     return 0;
 }
@@ -831,98 +1285,727 @@ int sensor_ioctl(int request, ... /* arg */)
     return ret;
 }
 
-int sensor_set_vsync_output(GPIO_TypeDef *gpio, uint32_t pin)
+int sensor_set_framebuffers(int count)
 {
-    sensor.vsync_pin  = pin;
-    sensor.vsync_gpio = gpio;
-    // Enable VSYNC EXTI IRQ
-    NVIC_SetPriority(DCMI_VSYNC_IRQN, IRQ_PRI_EXTINT);
-    HAL_NVIC_EnableIRQ(DCMI_VSYNC_IRQN);
+    if (count < 1 || count > 3) {
+        return -1;
+    }
+
+    // Stop continuous capture, it's restarted on the next snapshot.
+    dcmi_abort();
+
+    MAIN_FB()->n_buffers = count;
     return 0;
 }
 
-int sensor_set_color_palette(const uint16_t *color_palette)
+int sensor_get_framebuffers()
 {
-    sensor.color_palette = color_palette;
+    return IM_MAX(MAIN_FB()->n_buffers, 1);
+}
+
+int sensor_set_plane(plane_t mode, image_t *plane, list_t *thresholds, bool invert)
+{
+    plane_active = false;
+
+    if (mode == PLANE_NONE) {
+        plane_mode = PLANE_NONE;
+        return 0;
+    }
+
+    if (plane == NULL || sensor.transpose
+            || plane->w != MAIN_FB()->u || plane->h != MAIN_FB()->v) {
+        return -1;
+    }
+
+    switch (mode) {
+        case PLANE_L:
+            if (sensor.pixformat != PIXFORMAT_RGB565 || !IM_IS_GS(plane)) {
+                return -1;
+            }
+            break;
+        case PLANE_BINARY:
+            if ((sensor.pixformat != PIXFORMAT_RGB565 && sensor.pixformat != PIXFORMAT_GRAYSCALE)
+                    || !IM_IS_BINARY(plane) || thresholds == NULL || list_size(thresholds) == 0
+                    || list_size(thresholds) > SENSOR_PLANE_MAX_THRESHOLDS) {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+    }
+
+    // Stop continuous capture, the plane is only computed in single buffer mode.
+    dcmi_abort();
+
+    plane_n_thresholds = 0;
+    if (mode == PLANE_BINARY) {
+        for (list_lnk_t *it = iterator_start_from_head(thresholds); it; it = iterator_next(it)) {
+            iterator_get(thresholds, it, &plane_thresholds[plane_n_thresholds++]);
+        }
+    }
+
+    plane_mode = mode;
+    plane_image = *plane;
+    plane_invert = invert;
     return 0;
 }
 
-const uint16_t *sensor_get_color_palette()
+int sensor_set_gamma_corr(bool enable, float gamma, float contrast, float brightness)
 {
-    return sensor.color_palette;
+    #ifdef IMLIB_ENABLE_MATH_OPS
+    if (enable && (sensor.transpose || gamma <= 0.0f)) {
+        return -1;
+    }
+
+    // Build the tables first, the copy used by the line callback is only updated with the irqs off.
+    const gamma_lut_t *lut = enable ? imlib_gamma_lut(gamma, contrast, brightness) : NULL;
+
+    // Stop continuous capture, it's restarted with the new setting on the next snapshot.
+    dcmi_abort();
+
+    __disable_irq();
+    gamma_active = false;
+    gamma_enabled = enable;
+    if (enable) {
+        gamma_lut = *lut;
+    }
+    __enable_irq();
+    return 0;
+    #else
+    return enable ? -1 : 0;
+    #endif
 }
 
-void DCMI_VsyncExtiCallback()
+int sensor_set_motion(bool enable, int threshold)
 {
-    __HAL_GPIO_EXTI_CLEAR_FLAG(1 << DCMI_VSYNC_IRQ_LINE);
-    if (sensor.vsync_gpio != NULL) {
-        HAL_GPIO_WritePin(sensor.vsync_gpio, sensor.vsync_pin,
-                !HAL_GPIO_ReadPin(DCMI_VSYNC_PORT, DCMI_VSYNC_PIN));
+    if (enable && (sensor.transpose || threshold < 0 || threshold > 255)) {
+        return -1;
     }
+
+    __disable_irq();
+    motion_active = false;
+    motion_enabled = enable;
+    motion_threshold = threshold;
+    motion_bg_valid = false;
+    motion_score = 0;
+    motion_cell_w = 0;
+    memset(motion_result, 0, sizeof(motion_result));
+    __enable_irq();
+    return 0;
 }
 
-static void sensor_check_buffsize()
+int sensor_get_motion(uint32_t *bitmap)
 {
-    int bpp=0;
-    switch (sensor.pixformat) {
-        case PIXFORMAT_BAYER:
-        case PIXFORMAT_GRAYSCALE:
-            bpp = 1;
-            break;
-        case PIXFORMAT_YUV422:
-        case PIXFORMAT_RGB565:
-            bpp = 2;
-            break;
-        default:
-            break;
+    __disable_irq();
+    int score = motion_score;
+    if (bitmap != NULL) {
+        memcpy(bitmap, motion_result, sizeof(motion_result));
     }
+    __enable_irq();
+    return score;
+}
 
-    if ((MAIN_FB()->w * MAIN_FB()->h * bpp) > OMV_RAW_BUF_SIZE) {
-        if (sensor.pixformat == PIXFORMAT_GRAYSCALE) {
-            // Crop higher GS resolutions to QVGA
-            sensor_set_windowing(190, 120, 320, 240);
-        } else if (sensor.pixformat == PIXFORMAT_RGB565) {
-            // Switch to BAYER if the frame is too big to fit in RAM.
-            sensor_set_pixformat(PIXFORMAT_BAYER);
+int sensor_set_native_ae(bool enable, int target, float speed, int max_exposure_us, float max_gain_db, bool awb)
+{
+    if (enable && ((target < 1) || (target > 255) || !(speed > 0.0f) || (speed > 1.0f)
+            || (max_exposure_us < 1) || !(max_gain_db >= 0.0f)
+            || ((sensor.set_exposure_gain == NULL) && (sensor.set_auto_exposure == NULL))
+            || (awb && (sensor.set_auto_whitebal == NULL)))) {
+        return -1;
+    }
+
+    __disable_irq();
+    ae_active = false;
+    ae_enabled = false;
+    ae_ready = false;
+    __enable_irq();
+
+    if (!enable) {
+        return 0;
+    }
+
+    // Start from the current exposure and gain, with the sensor's own controllers off.
+    int exposure_us = max_exposure_us / 4;
+    float gain_db = 0.0f;
+    if ((sensor.get_exposure_us == NULL) || (sensor.get_exposure_us(&sensor, &exposure_us) != 0)) {
+        exposure_us = max_exposure_us / 4;
+    }
+    if ((sensor.get_gain_db == NULL) || (sensor.get_gain_db(&sensor, &gain_db) != 0)) {
+        gain_db = 0.0f;
+    }
+
+    exposure_us = IM_MAX(IM_MIN(exposure_us, max_exposure_us), 1);
+    gain_db = IM_MAX(IM_MIN(gain_db, max_gain_db), 0.0f);
+
+    if (sensor.set_auto_exposure != NULL) {
+        sensor.set_auto_exposure(&sensor, 0, exposure_us);
+    }
+    if (sensor.set_auto_gain != NULL) {
+        sensor.set_auto_gain(&sensor, 0, gain_db, max_gain_db);
+    }
+
+    if (awb) {
+        if ((sensor.get_rgb_gain_db == NULL)
+                || (sensor.get_rgb_gain_db(&sensor, &ae_rgb_gain_db[0], &ae_rgb_gain_db[1], &ae_rgb_gain_db[2]) != 0)) {
+            memset(ae_rgb_gain_db, 0, sizeof(ae_rgb_gain_db));
         }
+        sensor.set_auto_whitebal(&sensor, 0, ae_rgb_gain_db[0], ae_rgb_gain_db[1], ae_rgb_gain_db[2]);
     }
+
+    ae_awb = awb;
+    ae_target = target;
+    ae_speed = speed;
+    ae_max_exposure_us = max_exposure_us;
+    ae_max_gain_db = max_gain_db;
+    ae_ev = fast_log2(exposure_us) + (gain_db / AE_STOP_DB);
+    ae_exposure_us = exposure_us;
+    ae_gain_db = gain_db;
+    ae_mean = 0;
+    ae_enabled = true;
+    return 0;
 }
 
-// This function is called back after each line transfer is complete,
-// with a pointer to the line buffer that was used. At this point the
-// DMA transfers the next line to the other half of the line buffer.
-// Note:  For JPEG this function is called once (and ignored) at the end of the transfer.
-void DCMI_DMAConvCpltUser(uint32_t addr)
+int sensor_get_native_ae(int *mean, int *exposure_us, float *gain_db)
 {
-    uint8_t *src = (uint8_t*) addr;
-    uint8_t *dst = dest_fb;
+    if (!ae_enabled) {
+        return -1;
+    }
 
-    uint16_t *src16 = (uint16_t*) addr;
-    uint16_t *dst16 = (uint16_t*) dest_fb;
+    *mean = ae_mean;
+    *exposure_us = ae_exposure_us;
+    *gain_db = ae_gain_db;
+    return 0;
+}
 
-    // Skip lines outside the window.
-    if (line >= MAIN_FB()->y && line <= (MAIN_FB()->y + MAIN_FB()->h)) {
-        if (!sensor.transpose) {
-            switch (sensor.pixformat) {
-                case PIXFORMAT_BAYER:
-                    dst += (line - MAIN_FB()->y) * MAIN_FB()->w;
-                    src += MAIN_FB()->x;
-                    memcpy(dst, src, MAIN_FB()->w);
-                    break;
-                case PIXFORMAT_GRAYSCALE:
-                    dst += (line - MAIN_FB()->y) * MAIN_FB()->w;
-                    if (sensor.gs_bpp == 1) {
-                        // 1BPP GRAYSCALE.
-                        src += MAIN_FB()->x;
-                        memcpy(dst, src, MAIN_FB()->w);
-                    } else {
-                        uint32_t tmp1, tmp2, pix, *s, *d;
-                        src16 += MAIN_FB()->x;
-                        s = (uint32_t *)src16;
-                        d = (uint32_t *)dst;
-                        // Extract Y channel from YUV.
-                        if (((uint32_t)dst & 3) == 0 && ((uint32_t)src16 & 3) == 0) {
-                            for (int i = MAIN_FB()->w; i>=4; i-=4) {
+int sensor_set_jpeg_stream(bool enable, int quality)
+{
+    #if (OMV_HARDWARE_JPEG == 1)
+    if (enable && (sensor.transpose || quality < 1 || quality > 100)) {
+        return -1;
+    }
+
+    jpeg_stream_enabled = enable;
+    jpeg_stream_quality = quality;
+    return 0;
+    #else
+    return -1;
+    #endif
+}
+
+int sensor_get_jpeg_stream(image_t *image)
+{
+    if (!jpeg_stream_ready) {
+        return -1;
+    }
+
+    image->w = jpeg_stream_frame->w;
+    image->h = jpeg_stream_frame->h;
+    image->bpp = jpeg_stream_frame->size;
+    image->pixels = jpeg_stream_frame->pixels;
+    return 0;
+}
+
+uint32_t sensor_get_dropped_frames()
+{
+    return dropped_frames;
+}
+
+int sensor_set_vsync_output(GPIO_TypeDef *gpio, uint32_t pin)
+{
+    // Frames are counted from here, so a camera synced to this output (see sensor_set_sync_input)
+    // gets the same frame numbers if it's set up first.
+    __disable_irq();
+    vsync_count = 0;
+    MAIN_FB()->frame_count = 0;
+    __enable_irq();
+
+    sensor.vsync_pin  = pin;
+    sensor.vsync_gpio = gpio;
+    // Enable VSYNC EXTI IRQ
+    NVIC_SetPriority(DCMI_VSYNC_IRQN, IRQ_PRI_EXTINT);
+    HAL_NVIC_EnableIRQ(DCMI_VSYNC_IRQN);
+    return 0;
+}
+
+int sensor_set_sync_input(bool enable)
+{
+    #if defined(DCMI_FSYNC_PIN)
+    // Needs a sensor with a trigger input wired to FSYNC that can be put in triggered mode.
+    if (!SENSOR_HW_FLAGS_GET(&sensor, SENSOR_HW_FLAGS_FSYNC)) {
+        return -1;
+    }
+
+    if (!enable) {
+        sync_input = false;
+    }
+
+    if (sensor_ioctl(IOCTL_SET_TRIGGERED_MODE, enable) != 0) {
+        return -1;
+    }
+
+    __disable_irq();
+    DCMI_FSYNC_LOW();
+    sync_count = 0;
+    MAIN_FB()->frame_count = 0;
+    sync_input = enable;
+    __enable_irq();
+    return 0;
+    #else
+    return -1;
+    #endif
+}
+
+void sensor_sync_input_callback(bool level)
+{
+    #if defined(DCMI_FSYNC_PIN)
+    if (!sync_input) {
+        return;
+    }
+
+    // The sensor trigger follows the sync input, the rising edge starts the exposure.
+    if (level) {
+        sync_ts = mp_hal_ticks_us();
+        sync_count++;
+        DCMI_FSYNC_HIGH();
+    } else {
+        DCMI_FSYNC_LOW();
+    }
+    #endif
+}
+
+int sensor_set_color_palette(const uint16_t *color_palette)
+{
+    sensor.color_palette = color_palette;
+    return 0;
+}
+
+const uint16_t *sensor_get_color_palette()
+{
+    return sensor.color_palette;
+}
+
+// In continuous capture mode the DMA keeps transferring lines, so the line counter is reset
+// on VSYNC and the frame buffer for the next frame (if any is free) is selected here.
+// The frame start time and sequence number are also recorded here, for the frame buffer being written.
+void HAL_DCMI_VsyncEventCallback(DCMI_HandleTypeDef *hdcmi)
+{
+    uint32_t ts = mp_hal_ticks_us();
+    vsync_count++;
+
+    if (sync_input) {
+        // The frame was started by the last trigger.
+        ts = sync_ts;
+    }
+
+    if (continuous) {
+        line = 0;
+        dest_fb = (MAIN_FB()->tail >= 0) ? FB_SLOT(MAIN_FB()->tail) : NULL;
+        if (MAIN_FB()->tail >= 0) {
+            frame_ts[MAIN_FB()->tail] = ts;
+            frame_seq[MAIN_FB()->tail] = sync_input ? sync_count : vsync_count;
+        }
+    } else if (vsync_pending) {
+        vsync_pending = false;
+        frame_ts[0] = ts;
+        frame_seq[0] = sync_input ? sync_count : vsync_count;
+    }
+}
+
+// Sets the timestamp and sequence number of the user frame, and counts the frames dropped since the last one.
+static void snapshot_set_frame_info(int index)
+{
+    uint32_t frame_count = frame_seq[index];
+
+    if (MAIN_FB()->frame_count && (frame_count - MAIN_FB()->frame_count) > 1) {
+        dropped_frames += frame_count - MAIN_FB()->frame_count - 1;
+    }
+
+    MAIN_FB()->timestamp = frame_ts[index];
+    MAIN_FB()->frame_count = frame_count;
+}
+
+// Called from the line callback when the last line of the window is written in continuous capture
+// mode. The new frame replaces the previous ready frame (if it wasn't collected), and the next free
+// buffer is selected, if there are no free buffers the capture pauses until the next snapshot.
+static void sensor_frame_complete()
+{
+    ready_buf = MAIN_FB()->tail;
+    MAIN_FB()->tail = -1;
+    dest_fb = NULL;
+
+    for (int i = 0; i < MAIN_FB()->n_buffers; i++) {
+        if (i != MAIN_FB()->head && i != ready_buf) {
+            MAIN_FB()->tail = i;
+            break;
+        }
+    }
+}
+
+// Computes a capture plane line from a frame buffer line, while it's still in the cache.
+static void plane_line(int y)
+{
+    int w = MAIN_FB()->u;
+
+    if (plane_mode == PLANE_L) {
+        uint16_t *src = ((uint16_t *) dest_fb) + (y * w);
+        uint8_t *dst = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&plane_image, y);
+        for (int x = 0; x < w; x++) {
+            dst[x] = COLOR_RGB565_TO_L(src[x]);
+        }
+    } else if (sensor.pixformat == PIXFORMAT_RGB565) {
+        uint16_t *src = ((uint16_t *) dest_fb) + (y * w);
+        uint32_t *dst = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&plane_image, y);
+        for (int x = 0; x < w; x++) {
+            int value = 0;
+            for (int i = 0; i < plane_n_thresholds && !value; i++) {
+                value = COLOR_THRESHOLD_RGB565(src[x], &plane_thresholds[i], plane_invert);
+            }
+            IMAGE_PUT_BINARY_PIXEL_FAST(dst, x, value);
+        }
+    } else {
+        uint8_t *src = dest_fb + (y * w);
+        uint32_t *dst = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&plane_image, y);
+        for (int x = 0; x < w; x++) {
+            int value = 0;
+            for (int i = 0; i < plane_n_thresholds && !value; i++) {
+                value = COLOR_THRESHOLD_GRAYSCALE(src[x], &plane_thresholds[i], plane_invert);
+            }
+            IMAGE_PUT_BINARY_PIXEL_FAST(dst, x, value);
+        }
+    }
+}
+
+#ifdef IMLIB_ENABLE_MATH_OPS
+// Applies the gamma correction tables to a frame buffer line, while it's still in the cache.
+static void gamma_line(int y)
+{
+    int w = MAIN_FB()->u;
+
+    if (sensor.pixformat == PIXFORMAT_RGB565) {
+        imlib_gamma_lut_line(&gamma_lut, IMAGE_BPP_RGB565, ((uint16_t *) dest_fb) + (y * w), w);
+    } else {
+        imlib_gamma_lut_line(&gamma_lut, IMAGE_BPP_GRAYSCALE, dest_fb + (y * w), w);
+    }
+}
+#endif
+
+// Sets up the motion detector for the current frame, the background is reset if the window changed.
+static void motion_config(sensor_t *sensor)
+{
+    motion_active = motion_enabled && !sensor->transpose && (sensor->pixformat != PIXFORMAT_JPEG);
+    if (!motion_active) {
+        return;
+    }
+
+    int cell_w = IM_MAX(MAIN_FB()->u / SENSOR_MOTION_GRID_W, 1);
+    int cell_h = IM_MAX(MAIN_FB()->v / SENSOR_MOTION_GRID_H, 1);
+
+    if (cell_w != motion_cell_w || cell_h != motion_cell_h) {
+        motion_cell_w = cell_w;
+        motion_cell_h = cell_h;
+        motion_samples = ((cell_w + MOTION_STEP - 1) / MOTION_STEP) * ((cell_h + MOTION_STEP - 1) / MOTION_STEP);
+        motion_bg_valid = false;
+    }
+
+    switch (sensor->pixformat) {
+        case PIXFORMAT_GRAYSCALE:
+            motion_bpp = sensor->gs_bpp;
+            break;
+        case PIXFORMAT_BAYER:
+            motion_bpp = 1;
+            break;
+        default:
+            motion_bpp = 2;
+            break;
+    }
+
+    motion_cells = 0;
+    memset(motion_acc, 0, sizeof(motion_acc));
+    memset(motion_map, 0, sizeof(motion_map));
+}
+
+// Accumulates a decimated line (from the DCMI line buffer) into the motion detector cells, and compares
+// the cells against the background at the end of each row of cells.
+static void motion_line(uint8_t *src, int y)
+{
+    if (y >= (motion_cell_h * SENSOR_MOTION_GRID_H)) {
+        return;
+    }
+
+    if ((y % motion_cell_h) % MOTION_STEP == 0) {
+        for (int cx = 0, x = 0; cx < SENSOR_MOTION_GRID_W; cx++, x += motion_cell_w) {
+            uint32_t sum = 0;
+            if (sensor.pixformat == PIXFORMAT_RGB565) {
+                uint16_t *src16 = ((uint16_t *) src) + x;
+                for (int i = 0; i < motion_cell_w; i += MOTION_STEP) {
+                    sum += COLOR_RGB565_TO_Y(src16[i]) + 128;
+                }
+            } else {
+                // Grayscale/Bayer or the Y channel of YUV.
+                uint8_t *src8 = src + (x * motion_bpp);
+                for (int i = 0; i < motion_cell_w; i += MOTION_STEP) {
+                    sum += src8[i * motion_bpp];
+                }
+            }
+            motion_acc[cx] += sum;
+        }
+    }
+
+    if ((y % motion_cell_h) == (motion_cell_h - 1)) {
+        int cy = y / motion_cell_h;
+        for (int cx = 0; cx < SENSOR_MOTION_GRID_W; cx++) {
+            int mean = motion_acc[cx] / motion_samples;
+            if (motion_bg_valid) {
+                if (abs(mean - motion_bg[cy][cx]) > motion_threshold) {
+                    motion_map[cy] |= 1 << cx;
+                    motion_cells++;
+                }
+                // Slowly update the background to follow lighting changes.
+                motion_bg[cy][cx] = ((motion_bg[cy][cx] * 3) + mean) >> 2;
+            } else {
+                motion_bg[cy][cx] = mean;
+            }
+            motion_acc[cx] = 0;
+        }
+
+        if (cy == (SENSOR_MOTION_GRID_H - 1)) {
+            // The last row of cells, publish the frame results.
+            memcpy(motion_result, motion_map, sizeof(motion_map));
+            memset(motion_map, 0, sizeof(motion_map));
+            motion_score = motion_cells;
+            motion_cells = 0;
+            motion_bg_valid = true;
+        }
+    }
+}
+
+// Sets up the native AE statistics for the current frame.
+static void ae_config(sensor_t *sensor)
+{
+    ae_active = ae_enabled && (sensor->pixformat != PIXFORMAT_JPEG);
+    if (!ae_active) {
+        return;
+    }
+
+    switch (sensor->pixformat) {
+        case PIXFORMAT_GRAYSCALE:
+            ae_bpp = sensor->gs_bpp;
+            break;
+        case PIXFORMAT_BAYER:
+            ae_bpp = 1;
+            break;
+        default:
+            ae_bpp = 2;
+            break;
+    }
+
+    memset(ae_acc, 0, sizeof(ae_acc));
+    memset(ae_rgb_acc, 0, sizeof(ae_rgb_acc));
+}
+
+// Accumulates a decimated line (from the DCMI line buffer) into the luminance histogram (and the
+// color sums for the AWB), the statistics are handed over to ae_update() after the last line.
+static void ae_line(uint8_t *src, int y)
+{
+    if ((y % AE_STEP) == 0) {
+        if (sensor.pixformat == PIXFORMAT_RGB565) {
+            uint16_t *src16 = (uint16_t *) src;
+            for (int i = 0, w = MAIN_FB()->u; i < w; i += AE_STEP) {
+                int pixel = src16[i];
+                ae_acc[(COLOR_RGB565_TO_Y(pixel) + 128) / (256 / AE_BINS)]++;
+                if (ae_awb) {
+                    ae_rgb_acc[0] += COLOR_RGB565_TO_R8(pixel);
+                    ae_rgb_acc[1] += COLOR_RGB565_TO_G8(pixel);
+                    ae_rgb_acc[2] += COLOR_RGB565_TO_B8(pixel);
+                }
+            }
+        } else {
+            // Grayscale/Bayer or the Y channel of YUV.
+            for (int i = 0, w = MAIN_FB()->u; i < w; i += AE_STEP) {
+                ae_acc[src[i * ae_bpp] / (256 / AE_BINS)]++;
+            }
+        }
+    }
+
+    if (y == (MAIN_FB()->v - 1)) {
+        memcpy(ae_hist, ae_acc, sizeof(ae_acc));
+        memcpy(ae_rgb, ae_rgb_acc, sizeof(ae_rgb_acc));
+        memset(ae_acc, 0, sizeof(ae_acc));
+        memset(ae_rgb_acc, 0, sizeof(ae_rgb_acc));
+        ae_ready = true;
+    }
+}
+
+// Runs the native AE (and AWB) controller on the statistics of the last frame, called between frames.
+static void ae_update(sensor_t *sensor)
+{
+    if (!ae_enabled || !ae_ready) {
+        return;
+    }
+
+    uint32_t hist[AE_BINS], rgb[3];
+    __disable_irq();
+    memcpy(hist, ae_hist, sizeof(hist));
+    memcpy(rgb, ae_rgb, sizeof(rgb));
+    ae_ready = false;
+    __enable_irq();
+
+    uint32_t count = 0, sum = 0;
+    for (int i = 0; i < AE_BINS; i++) {
+        count += hist[i];
+        sum += hist[i] * i;
+    }
+
+    if (!count) {
+        return;
+    }
+
+    // Mean of the bin centers.
+    ae_mean = ((sum * (256 / AE_BINS)) / count) + (128 / AE_BINS);
+    float error = fast_log2(ae_target) - fast_log2(ae_mean);
+
+    // Don't raise the exposure while more than 1/8 of the frame is clipped.
+    if ((hist[AE_BINS - 1] > (count / 8)) && (error > 0.0f)) {
+        error = 0.0f;
+    }
+
+    // Errors writing the sensor are ignored, the next frame retries.
+    if (fast_fabsf(error) >= AE_DEADBAND) {
+        float max_exposure_ev = fast_log2(ae_max_exposure_us);
+        ae_ev = IM_MAX(IM_MIN(ae_ev + (error * ae_speed), max_exposure_ev + (ae_max_gain_db / AE_STOP_DB)), 0.0f);
+
+        // Raise the exposure first and the gain once the exposure is at its maximum.
+        float exposure_ev = IM_MIN(ae_ev, max_exposure_ev);
+        ae_exposure_us = IM_MAX(fast_roundf(fast_powf(2.0f, exposure_ev)), 1);
+        ae_gain_db = (ae_ev - exposure_ev) * AE_STOP_DB;
+
+        if (sensor->set_exposure_gain != NULL) {
+            sensor->set_exposure_gain(sensor, ae_exposure_us, ae_gain_db);
+        } else {
+            sensor->set_auto_exposure(sensor, 0, ae_exposure_us);
+            if (sensor->set_auto_gain != NULL) {
+                sensor->set_auto_gain(sensor, 0, ae_gain_db, ae_max_gain_db);
+            }
+        }
+    }
+
+    // Gray world white balance, the red and blue gains are moved towards the green channel.
+    if (ae_awb && rgb[1]) {
+        float r_error = fast_log2(rgb[1]) - fast_log2(IM_MAX(rgb[0], 1));
+        float b_error = fast_log2(rgb[1]) - fast_log2(IM_MAX(rgb[2], 1));
+
+        if ((fast_fabsf(r_error) >= AE_DEADBAND) || (fast_fabsf(b_error) >= AE_DEADBAND)) {
+            float r_gain_db = ae_rgb_gain_db[0] + (r_error * ae_speed * AE_STOP_DB);
+            float b_gain_db = ae_rgb_gain_db[2] + (b_error * ae_speed * AE_STOP_DB);
+            ae_rgb_gain_db[0] = IM_MAX(IM_MIN(r_gain_db, ae_rgb_gain_db[1] + AE_AWB_MAX_DB), ae_rgb_gain_db[1] - AE_AWB_MAX_DB);
+            ae_rgb_gain_db[2] = IM_MAX(IM_MIN(b_gain_db, ae_rgb_gain_db[1] + AE_AWB_MAX_DB), ae_rgb_gain_db[1] - AE_AWB_MAX_DB);
+            sensor->set_auto_whitebal(sensor, 0, ae_rgb_gain_db[0], ae_rgb_gain_db[1], ae_rgb_gain_db[2]);
+        }
+    }
+}
+
+void DCMI_VsyncExtiCallback()
+{
+    __HAL_GPIO_EXTI_CLEAR_FLAG(1 << DCMI_VSYNC_IRQ_LINE);
+    if (sensor.vsync_gpio != NULL) {
+        HAL_GPIO_WritePin(sensor.vsync_gpio, sensor.vsync_pin,
+                !HAL_GPIO_ReadPin(DCMI_VSYNC_PORT, DCMI_VSYNC_PIN));
+    }
+}
+
+static void sensor_check_buffsize()
+{
+    int bpp=0;
+    switch (sensor.pixformat) {
+        case PIXFORMAT_BAYER:
+        case PIXFORMAT_GRAYSCALE:
+            bpp = 1;
+            break;
+        case PIXFORMAT_YUV422:
+        case PIXFORMAT_RGB565:
+            bpp = 2;
+            break;
+        default:
+            break;
+    }
+
+    if ((MAIN_FB()->w * MAIN_FB()->h * bpp) > OMV_RAW_BUF_SIZE) {
+        if (sensor.pixformat == PIXFORMAT_GRAYSCALE) {
+            // Crop higher GS resolutions to QVGA
+            sensor_set_windowing(190, 120, 320, 240);
+        } else if (sensor.pixformat == PIXFORMAT_RGB565) {
+            // Switch to BAYER if the frame is too big to fit in RAM.
+            sensor_set_pixformat(PIXFORMAT_BAYER);
+        }
+    }
+}
+
+// This function is called back after each line transfer is complete,
+// with a pointer to the line buffer that was used. At this point the
+// DMA transfers the next line to the other half of the line buffer.
+// Note:  For JPEG this function is called once (and ignored) at the end of the transfer.
+void DCMI_DMAConvCpltUser(uint32_t addr)
+{
+    uint32_t start = frame_stats_start();
+    uint8_t *src = (uint8_t*) addr;
+    uint8_t *dst = dest_fb;
+
+    uint16_t *src16 = (uint16_t*) addr;
+    uint16_t *dst16 = (uint16_t*) dest_fb;
+
+    if (direct_xfer_size) {
+        // In zero-copy mode the DMA writes to the frame buffer directly, and the buffer that
+        // just completed is moved forward two transfers (the DMA is writing to the other one).
+        DMA_Stream_TypeDef *stream = (DMA_Stream_TypeDef *) DMAHandle.Instance;
+        uint32_t next = addr + (direct_xfer_size * 2);
+        if (next < direct_xfer_end) {
+            if (stream->M0AR == addr) {
+                stream->M0AR = next;
+            } else {
+                stream->M1AR = next;
+            }
+        }
+        frame_stats_add(FRAME_STATS_LINE, start);
+        return;
+    }
+
+    TRACE_BEGIN(TRACE_EVENT_LINE, line);
+
+    // Note: The window size is read from u/v (not w/h) which the user can't change while
+    // capturing in continuous mode.
+    if (dest_fb == NULL) {
+        // No free frame buffer in continuous mode, drop the line.
+    } else if (line >= MAIN_FB()->y && line < (MAIN_FB()->y + MAIN_FB()->v)) {
+        #if defined(MCU_SERIES_H7)
+        if (mdma_enabled) {
+            // Offload the line copy to the MDMA, the previous line should be done by now.
+            mdma_wait();
+            HAL_MDMA_Start(&MDMAHandle, addr + (MAIN_FB()->x * mdma_src_bpp),
+                    (uint32_t) (dest_fb + ((line - MAIN_FB()->y) * mdma_line_size)),
+                    mdma_block_size, mdma_block_count);
+        } else
+        #endif
+        if (!sensor.transpose) {
+            switch (sensor.pixformat) {
+                case PIXFORMAT_BAYER:
+                    dst += (line - MAIN_FB()->y) * MAIN_FB()->u;
+                    src += MAIN_FB()->x;
+                    memcpy(dst, src, MAIN_FB()->u);
+                    break;
+                case PIXFORMAT_GRAYSCALE:
+                    dst += (line - MAIN_FB()->y) * MAIN_FB()->u;
+                    if (sensor.gs_bpp == 1) {
+                        // 1BPP GRAYSCALE.
+                        src += MAIN_FB()->x;
+                        memcpy(dst, src, MAIN_FB()->u);
+                    } else {
+                        uint32_t tmp1, tmp2, pix, *s, *d;
+                        src16 += MAIN_FB()->x;
+                        s = (uint32_t *)src16;
+                        d = (uint32_t *)dst;
+                        // Extract Y channel from YUV.
+                        if (((uint32_t)dst & 3) == 0 && ((uint32_t)src16 & 3) == 0) {
+                            for (int i = MAIN_FB()->u; i>=4; i-=4) {
                             // destination mem is cached; coalesce the writes to improve throughput
                                tmp1 = *s++;
                                tmp2 = *s++;
@@ -933,7 +2016,7 @@ void DCMI_DMAConvCpltUser(uint32_t addr)
                                *d++ = pix;
                             }
                         } else {
-                            for (int i = MAIN_FB()->w; i; i--) {
+                            for (int i = MAIN_FB()->u; i; i--) {
                                 *dst++ = (uint8_t)*src16++; // low byte is Y channel
                             }
                         }
@@ -941,9 +2024,9 @@ void DCMI_DMAConvCpltUser(uint32_t addr)
                     break;
                 case PIXFORMAT_YUV422:
                 case PIXFORMAT_RGB565:
-                    dst16 += (line - MAIN_FB()->y) * MAIN_FB()->w;
+                    dst16 += (line - MAIN_FB()->y) * MAIN_FB()->u;
                     src16 += MAIN_FB()->x;
-                    memcpy(dst16, src16, MAIN_FB()->w * sizeof(uint16_t));
+                    memcpy(dst16, src16, MAIN_FB()->u * sizeof(uint16_t));
                     break;
                 case PIXFORMAT_JPEG:
                 default:
@@ -954,7 +2037,7 @@ void DCMI_DMAConvCpltUser(uint32_t addr)
                 case PIXFORMAT_BAYER:
                     dst += line - MAIN_FB()->y;
                     src += MAIN_FB()->x;
-                    for (int i = MAIN_FB()->w, h = MAIN_FB()->h; i; i--) {
+                    for (int i = MAIN_FB()->u, h = MAIN_FB()->v; i; i--) {
                         *dst = *src++;
                         dst += h;
                     }
@@ -964,14 +2047,14 @@ void DCMI_DMAConvCpltUser(uint32_t addr)
                     if (sensor.gs_bpp == 1) {
                         src += MAIN_FB()->x;
                         // 1BPP GRAYSCALE.
-                        for (int i = MAIN_FB()->w, h = MAIN_FB()->h; i; i--) {
+                        for (int i = MAIN_FB()->u, h = MAIN_FB()->v; i; i--) {
                             *dst = *src++;
                             dst += h;
                         }
                     } else {
                         src16 += MAIN_FB()->x;
                         // Extract Y channel from YUV.
-                        for (int i = MAIN_FB()->w, h = MAIN_FB()->h; i; i--) {
+                        for (int i = MAIN_FB()->u, h = MAIN_FB()->v; i; i--) {
                             *dst = *src16++;
                             dst += h;
                         }
@@ -981,7 +2064,7 @@ void DCMI_DMAConvCpltUser(uint32_t addr)
                 case PIXFORMAT_RGB565:
                     dst16 += line - MAIN_FB()->y;
                     src16 += MAIN_FB()->x;
-                    for (int i = MAIN_FB()->w, h = MAIN_FB()->h; i; i--) {
+                    for (int i = MAIN_FB()->u, h = MAIN_FB()->v; i; i--) {
                         *dst16 = *src16++;
                         dst16 += h;
                     }
@@ -991,14 +2074,322 @@ void DCMI_DMAConvCpltUser(uint32_t addr)
                     break;
             }
         }
+
+        #ifdef IMLIB_ENABLE_MATH_OPS
+        if (gamma_active) {
+            gamma_line(line - MAIN_FB()->y);
+        }
+        #endif
+
+        if (plane_active) {
+            plane_line(line - MAIN_FB()->y);
+        }
+
+        if (motion_active) {
+            motion_line(((uint8_t *) addr) + (MAIN_FB()->x * motion_bpp), line - MAIN_FB()->y);
+        }
+
+        if (ae_active) {
+            ae_line(((uint8_t *) addr) + (MAIN_FB()->x * ae_bpp), line - MAIN_FB()->y);
+        }
+
+        #if (OMV_HARDWARE_JPEG == 1)
+        if (jpeg_stream_active) {
+            jpeg_stream_band(line - MAIN_FB()->y + 1);
+        }
+        #endif
+
+        if (continuous && line == (MAIN_FB()->y + MAIN_FB()->v - 1)) {
+            #if defined(MCU_SERIES_H7)
+            mdma_wait();
+            #endif
+            sensor_frame_complete();
+        }
     }
 
+    TRACE_END(TRACE_EVENT_LINE, line);
+    frame_stats_add(FRAME_STATS_LINE, start);
     line++;
 }
 
-// This is the default snapshot function, which can be replaced in sensor_init functions. This function
-// uses the DCMI and DMA to capture frames and each line is processed in the DCMI_DMAConvCpltUser function.
-int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_cb)
+#if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+// Cache maintenance of the DMA targets (the frame buffer is in a cacheable region).
+#define DMA_BUFFER_DCACHE_SIZE  (16 * 1024)
+
+// Makes sure no dirty cache lines are written back over the DMA data. Ranges bigger than the D-cache
+// are cleaned and invalidated by set/way, which costs the same for any size, instead of by address.
+static void dma_buffer_prepare(void *addr, uint32_t size)
+{
+    if (size > DMA_BUFFER_DCACHE_SIZE) {
+        SCB_CleanInvalidateDCache();
+    } else {
+        SCB_CleanInvalidateDCache_by_Addr((uint32_t *) addr, size);
+    }
+}
+
+// Invalidates the bytes the DMA wrote (rounded up to cache lines and capped to the DMA target
+// size) so the CPU reads them from memory, the buffer must have been prepared before the transfer.
+static void dma_buffer_complete(void *addr, uint32_t written, uint32_t size)
+{
+    SCB_InvalidateDCache_by_Addr((uint32_t *) addr, IM_MIN((written + 31) & ~31, size));
+}
+#endif
+
+// Fixes the MAIN_FB BPP and resolution after a frame is captured.
+static void snapshot_fix_fb(sensor_t *sensor)
+{
+    // Fix the BPP
+    switch (sensor->pixformat) {
+        case PIXFORMAT_GRAYSCALE:
+            MAIN_FB()->bpp = 1;
+            break;
+        case PIXFORMAT_YUV422:
+        case PIXFORMAT_RGB565:
+            MAIN_FB()->bpp = 2;
+            break;
+        case PIXFORMAT_BAYER:
+            MAIN_FB()->bpp = 3;
+            break;
+        case PIXFORMAT_JPEG:
+            // Read the number of data items transferred
+            MAIN_FB()->bpp = ((MAX_XFER_SIZE/4) - __HAL_DMA_GET_COUNTER(&DMAHandle))*4;
+            #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+            // In JPEG mode, the DMA uses the frame buffer memory directly instead of the line buffer, which is
+            // located in a cacheable region and therefore must be invalidated before the CPU can access it again.
+            // Only the JPEG data is invalidated, the buffer was prepared when the transfer started.
+            // Note: The frame buffer address is 32-byte aligned.
+            dma_buffer_complete(MAIN_FB()->pixels, MAIN_FB()->bpp, MAX_XFER_SIZE);
+            #endif
+            break;
+        default:
+            break;
+    }
+
+    // Fix resolution if transposed.
+    if (sensor->transpose) {
+        MAIN_FB()->w = MAIN_FB()->v; // v==h -> w
+        MAIN_FB()->h = MAIN_FB()->u; // u==w -> h
+    }
+}
+
+// Returns the number of DMA transfers needed to capture the frame directly to the frame buffer,
+// or 0 if the frame can't be captured directly (i.e. it needs cropping, transposing or Y extraction).
+static uint32_t snapshot_direct_xfers(sensor_t *sensor, uint32_t w, uint32_t h, uint32_t length)
+{
+    if (sensor->transpose || MAIN_FB()->x != 0 || MAIN_FB()->y != 0
+            || MAIN_FB()->u != w || MAIN_FB()->v != h || length > OMV_RAW_BUF_SIZE) {
+        return 0;
+    }
+
+    switch (sensor->pixformat) {
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_YUV422:
+        case PIXFORMAT_BAYER:
+            break;
+        case PIXFORMAT_GRAYSCALE:
+            if (sensor->gs_bpp != 1) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+    // The frame buffer must be invalidated without touching the memory after the frame.
+    if (length % 32) {
+        return 0;
+    }
+    #endif
+
+    // Transfer as many lines as possible at once, the DMA counter is limited to 0xFFFF words.
+    uint32_t line_size = length / h;
+    for (uint32_t lines = (MAX_XFER_SIZE / line_size); lines; lines--) {
+        if ((h % lines) == 0 && ((lines * line_size) % 4) == 0 && (h / lines) >= 2) {
+            return h / lines;
+        }
+    }
+
+    return 0;
+}
+
+// Continuous capture mode, the DCMI/DMA keep capturing frames to the free frame buffers while the
+// user processes the current frame. This function hands the newest complete frame to the user and
+// releases the previous one, so the capture of the next frame overlaps with processing.
+static int sensor_snapshot_mb(sensor_t *sensor, image_t *image, uint32_t addr, uint32_t length, uint32_t size)
+{
+    uint32_t h = resolution[sensor->framesize][1];
+
+    if (!continuous) {
+        // The user owns the first frame buffer and the first frame is written to the second.
+        MAIN_FB()->buf_size = size;
+        MAIN_FB()->head = 0;
+        MAIN_FB()->tail = 1;
+        ready_buf = -1;
+        dest_fb = FB_SLOT(1);
+        line = 0;
+        continuous = true;
+        motion_config(sensor);
+        ae_config(sensor);
+
+        #if defined(MCU_SERIES_H7)
+        // The CPU corrects the lines in place, so it copies them itself if gamma is enabled.
+        if (!gamma_active && mdma_config(sensor) == 0) {
+            // The MDMA writes to memory directly, so make sure no dirty cache lines are written back.
+            dma_buffer_prepare(MAIN_FB()->pixels, MAIN_FB()->n_buffers * size);
+        }
+        #endif
+
+        // Enable DMA IRQ
+        HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+
+        #if defined(DCMI_FSYNC_PIN)
+        if (SENSOR_HW_FLAGS_GET(sensor, SENSOR_HW_FLAGS_FSYNC) && !sync_input) {
+            DCMI_FSYNC_HIGH();
+        }
+        #endif
+
+        // The VSYNC interrupt is disabled at the end of a snapshot mode frame.
+        __HAL_DCMI_ENABLE_IT(&DCMIHandle, DCMI_IT_VSYNC);
+
+        // Start a multibuffer transfer (line by line) in continuous mode.
+        HAL_DCMI_Start_DMA_MB(&DCMIHandle,
+                DCMI_MODE_CONTINUOUS, addr, length/4, h);
+    }
+
+    // Wait for a new frame.
+    for (uint32_t tick_start = HAL_GetTick(); ready_buf < 0; ) {
+        // Compress the IDE preview, write out queued file data (see file_ring_poll)
+        // and stream frames to network clients while the frame is captured,
+        // otherwise wait for interrupt.
+        if (!fb_poll_jpeg_buffer() && !file_ring_poll() && !wifistream_poll()) {
+            __WFI();
+        }
+
+        if ((HAL_GetTick() - tick_start) >= 3000) {
+            // Sensor timeout, most likely a HW issue.
+            dcmi_abort();
+            return -1;
+        }
+    }
+
+    #if defined(MCU_SERIES_H7)
+    if (mdma_enabled) {
+        // The user frame buffer will be written by the MDMA once released.
+        dma_buffer_prepare(MAIN_FB_BUFFER(), size);
+    }
+    #endif
+
+    __disable_irq();
+    int32_t prev_buf = MAIN_FB()->head;
+    MAIN_FB()->head = ready_buf;
+    ready_buf = -1;
+    if (MAIN_FB()->tail < 0) {
+        // The capture is paused (no free buffers), resume on the next frame with the old buffer.
+        MAIN_FB()->tail = prev_buf;
+    }
+    snapshot_set_frame_info(MAIN_FB()->head);
+    __enable_irq();
+
+    #if defined(MCU_SERIES_H7)
+    if (mdma_enabled) {
+        // The new frame was written by the MDMA, invalidate the cache.
+        SCB_InvalidateDCache_by_Addr((uint32_t*)MAIN_FB_BUFFER(), size);
+    }
+    #endif
+
+    // Fix the BPP and resolution.
+    snapshot_fix_fb(sensor);
+
+    // Set the user image.
+    if (image != NULL) {
+        image->w = MAIN_FB()->w;
+        image->h = MAIN_FB()->h;
+        image->bpp = MAIN_FB()->bpp;
+        image->pixels = MAIN_FB_BUFFER();
+    }
+
+    return 0;
+}
+
+// Waits for the single buffer capture started at tick_start to finish, and fixes the frame buffer.
+static int snapshot_wait(sensor_t *sensor, uint32_t tick_start, uint32_t length)
+{
+    while ((DCMI->CR & DCMI_CR_CAPTURE) != 0) {
+        // Compress the IDE preview, write out queued file data (see file_ring_poll)
+        // and stream frames to network clients while the frame is captured,
+        // otherwise wait for interrupt.
+        if (!fb_poll_jpeg_buffer() && !file_ring_poll() && !wifistream_poll()) {
+            __WFI();
+        }
+
+        if ((HAL_GetTick() - tick_start) >= 3000) {
+            // Sensor timeout, most likely a HW issue.
+            // Abort the DMA request.
+            HAL_DMA_Abort(&DMAHandle);
+            direct_xfer_size = 0;
+            #if defined(MCU_SERIES_H7)
+            mdma_abort();
+            #endif
+            jpeg_stream_finish(true);
+            return -1;
+        }
+    }
+
+    #if defined(DCMI_FSYNC_PIN)
+    if (SENSOR_HW_FLAGS_GET(sensor, SENSOR_HW_FLAGS_FSYNC) && !sync_input) {
+        DCMI_FSYNC_LOW();
+    }
+    #endif
+
+    // Abort DMA transfer.
+    // Note: In JPEG mode the DMA will still be waiting for data since
+    // the max frame size is set, so we need to abort the DMA transfer.
+    HAL_DMA_Abort(&DMAHandle);
+
+    // Disable DMA IRQ
+    HAL_NVIC_DisableIRQ(DMA2_Stream1_IRQn);
+
+    // Keep counting frames between snapshots to detect dropped frames.
+    __HAL_DCMI_ENABLE_IT(&DCMIHandle, DCMI_IT_VSYNC);
+
+    if (vsync_pending) {
+        // Missed the VSYNC interrupt, use the end of the frame instead.
+        vsync_pending = false;
+        frame_ts[0] = sync_input ? sync_ts : mp_hal_ticks_us();
+        frame_seq[0] = sync_input ? sync_count : ++vsync_count;
+    }
+
+    snapshot_set_frame_info(0);
+
+    #if defined(MCU_SERIES_H7)
+    uint32_t fb_size = MAIN_FB()->u * MAIN_FB()->v * 2; // Max frame size (2 bytes per pixel).
+    if (mdma_enabled) {
+        // Wait for the last line and invalidate the cache (the MDMA wrote the frame buffer).
+        mdma_wait();
+        mdma_enabled = false;
+        SCB_InvalidateDCache_by_Addr((uint32_t*)MAIN_FB()->pixels, fb_size);
+    }
+    #endif
+
+    if (direct_xfer_size) {
+        direct_xfer_size = 0;
+        #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+        // The DMA wrote the frame buffer directly, invalidate the cache (see the JPEG note above).
+        SCB_InvalidateDCache_by_Addr((uint32_t*)MAIN_FB()->pixels, length);
+        #endif
+    }
+
+    // Fix the BPP and resolution.
+    snapshot_fix_fb(sensor);
+
+    // Only the last band of lines is left to compress.
+    jpeg_stream_finish(false);
+    return 0;
+}
+
+// Captures a frame using the DCMI and DMA.
+static int snapshot_capture(sensor_t *sensor, image_t *image, streaming_cb_t streaming_cb)
 {
     uint32_t frame = 0;
     bool streaming = (streaming_cb != NULL); // Streaming mode.
@@ -1008,16 +2399,22 @@ int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
     // Compress the framebuffer for the IDE preview, only if it's not the first frame,
     // the framebuffer is enabled and the image sensor does not support JPEG encoding.
     // Note: This doesn't run unless the IDE is connected and the framebuffer is enabled.
-    fb_update_jpeg_buffer();
+    // Note: If the last frame was compressed while captured the JPEG framebuffer is already updated.
+    // Note: The frame is compressed while waiting for the next one, unless the JPEG framebuffer
+    // is used by the hardware JPEG stream (which would overwrite the staged frame).
+    if (!jpeg_stream_ready) {
+        if (jpeg_stream_enabled) {
+            fb_update_jpeg_buffer();
+        } else {
+            fb_defer_jpeg_buffer();
+        }
+    }
+    jpeg_stream_ready = false;
 
     // Make sure the raw frame fits into the FB. If it doesn't it will be cropped if
     // the format is set to GS, otherwise the pixel format will be swicthed to BAYER.
     sensor_check_buffsize();
 
-    // Set the current frame buffer target used in the DMA line callback
-    // (DCMI_DMAConvCpltUser function), in both snapshot and streaming modes.
-    dest_fb = MAIN_FB()->pixels;
-
     // The user may have changed the MAIN_FB width or height on the last image so we need
     // to restore that here. We don't have to restore bpp because that's taken care of
     // already in the code below. Note that we do the JPEG compression above first to save
@@ -1057,6 +2454,28 @@ int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
             return -1;
     }
 
+    // The lines are gamma corrected in both single buffer and continuous capture modes.
+    #ifdef IMLIB_ENABLE_MATH_OPS
+    gamma_active = gamma_enabled && !sensor->transpose
+        && (sensor->pixformat == PIXFORMAT_RGB565 || sensor->pixformat == PIXFORMAT_GRAYSCALE);
+    #endif
+
+    // Use continuous capture if multiple frame buffers are enabled and they fit in RAM.
+    // Note: The frame buffers are 32-byte aligned (cache line size).
+    if (streaming_cb == NULL && sensor->pixformat != PIXFORMAT_JPEG
+            && MAIN_FB()->n_buffers > 1 && plane_mode == PLANE_NONE) {
+        uint32_t size = MAIN_FB()->u * MAIN_FB()->v * ((sensor->pixformat == PIXFORMAT_RGB565
+                    || sensor->pixformat == PIXFORMAT_YUV422) ? 2 : 1);
+        size = (size + 31) & ~31;
+        if ((MAIN_FB()->n_buffers * size) <= OMV_RAW_BUF_SIZE) {
+            return sensor_snapshot_mb(sensor, image, addr, length, size);
+        }
+    }
+
+    // Set the current frame buffer target used in the DMA line callback
+    // (DCMI_DMAConvCpltUser function), in both snapshot and streaming modes.
+    dest_fb = MAIN_FB()->pixels;
+
     if (streaming_cb) {
         image->pixels = NULL;
     }
@@ -1064,6 +2483,42 @@ int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
     // If two frames fit in ram, use double buffering in streaming mode.
     doublebuf = ((length*2) <= OMV_RAW_BUF_SIZE);
 
+    // Compute the capture plane only if it still matches the frame.
+    plane_active = (plane_mode != PLANE_NONE) && !sensor->transpose
+        && (plane_image.w == MAIN_FB()->u) && (plane_image.h == MAIN_FB()->v)
+        && ((plane_mode == PLANE_L) ? (sensor->pixformat == PIXFORMAT_RGB565) :
+            (sensor->pixformat == PIXFORMAT_RGB565 || sensor->pixformat == PIXFORMAT_GRAYSCALE));
+
+    motion_config(sensor);
+    ae_config(sensor);
+
+    if (streaming_cb == NULL) {
+        jpeg_stream_config(sensor);
+    }
+
+    // Capture directly to the frame buffer if the lines don't need any processing.
+    uint32_t xfers = (streaming_cb == NULL && !plane_active && !gamma_active && !motion_active && !ae_active && !jpeg_stream_active)
+        ? snapshot_direct_xfers(sensor, w, h, length) : 0;
+    if (xfers) {
+        addr = (uint32_t) (MAIN_FB()->pixels);
+        direct_xfer_size = length / xfers;
+        direct_xfer_end = addr + length;
+        #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+        // Make sure no dirty cache lines are written back over the DMA data.
+        dma_buffer_prepare(MAIN_FB()->pixels, length);
+        #endif
+    }
+
+    #if defined(MCU_SERIES_H7)
+    // Offload the line copy to the MDMA, except in streaming mode where the frame buffers are
+    // switched and read while capturing, or if the CPU needs the lines for the capture plane or gamma.
+    uint32_t fb_size = MAIN_FB()->u * MAIN_FB()->v * 2; // Max frame size (2 bytes per pixel).
+    if (xfers == 0 && streaming_cb == NULL && !plane_active && !gamma_active && !jpeg_stream_active && mdma_config(sensor) == 0) {
+        // The MDMA writes to memory directly, so make sure no dirty cache lines are written back.
+        dma_buffer_prepare(MAIN_FB()->pixels, fb_size);
+    }
+    #endif
+
     do {
         // Clear line counter
         line = 0;
@@ -1075,15 +2530,27 @@ int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
         HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
 
         #if defined(DCMI_FSYNC_PIN)
-        if (SENSOR_HW_FLAGS_GET(sensor, SENSOR_HW_FLAGS_FSYNC)) {
+        if (SENSOR_HW_FLAGS_GET(sensor, SENSOR_HW_FLAGS_FSYNC) && !sync_input) {
             DCMI_FSYNC_HIGH();
         }
         #endif
 
+        // Record the start of the next frame (the VSYNC interrupt is disabled at the end of a frame).
+        vsync_pending = true;
+        __HAL_DCMI_ENABLE_IT(&DCMIHandle, DCMI_IT_VSYNC);
+
         if (sensor->pixformat == PIXFORMAT_JPEG) {
+            #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
+            // The DMA writes to the frame buffer directly (see snapshot_fix_fb).
+            dma_buffer_prepare(MAIN_FB()->pixels, length);
+            #endif
             // Start a regular transfer
             HAL_DCMI_Start_DMA(&DCMIHandle,
                     DCMI_MODE_SNAPSHOT, addr, length/4);
+        } else if (xfers) {
+            // Start a multibuffer transfer (multiple lines at a time, directly to the frame buffer)
+            HAL_DCMI_Start_DMA_MB(&DCMIHandle,
+                    DCMI_MODE_SNAPSHOT, addr, length/4, xfers);
         } else {
             // Start a multibuffer transfer (line by line)
             HAL_DCMI_Start_DMA_MB(&DCMIHandle,
@@ -1097,62 +2564,8 @@ int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
         }
 
         // Wait for frame
-        while ((DCMI->CR & DCMI_CR_CAPTURE) != 0) {
-            // Wait for interrupt
-            __WFI();
-
-            if ((HAL_GetTick() - tick_start) >= 3000) {
-                // Sensor timeout, most likely a HW issue.
-                // Abort the DMA request.
-                HAL_DMA_Abort(&DMAHandle);
-                return -1;
-            }
-        }
-
-        #if defined(DCMI_FSYNC_PIN)
-        if (SENSOR_HW_FLAGS_GET(sensor, SENSOR_HW_FLAGS_FSYNC)) {
-            DCMI_FSYNC_LOW();
-        }
-        #endif
-
-        // Abort DMA transfer.
-        // Note: In JPEG mode the DMA will still be waiting for data since
-        // the max frame size is set, so we need to abort the DMA transfer.
-        HAL_DMA_Abort(&DMAHandle);
-
-        // Disable DMA IRQ
-        HAL_NVIC_DisableIRQ(DMA2_Stream1_IRQn);
-
-        // Fix the BPP
-        switch (sensor->pixformat) {
-            case PIXFORMAT_GRAYSCALE:
-                MAIN_FB()->bpp = 1;
-                break;
-            case PIXFORMAT_YUV422:
-            case PIXFORMAT_RGB565:
-                MAIN_FB()->bpp = 2;
-                break;
-            case PIXFORMAT_BAYER:
-                MAIN_FB()->bpp = 3;
-                break;
-            case PIXFORMAT_JPEG:
-                // Read the number of data items transferred
-                MAIN_FB()->bpp = ((MAX_XFER_SIZE/4) - __HAL_DMA_GET_COUNTER(&DMAHandle))*4;
-                #if defined(MCU_SERIES_F7) || defined(MCU_SERIES_H7)
-                // In JPEG mode, the DMA uses the frame buffer memory directly instead of the line buffer, which is
-                // located in a cacheable region and therefore must be invalidated before the CPU can access it again.
-                // Note: The frame buffer address is 32-byte aligned, and the size is a multiple of 32-bytes for all boards.
-                SCB_InvalidateDCache_by_Addr((uint32_t*)MAIN_FB()->pixels, OMV_RAW_BUF_SIZE);
-                #endif
-                break;
-            default:
-                break;
-        }
-
-        // Fix resolution if transposed.
-        if (sensor->transpose) {
-            MAIN_FB()->w = MAIN_FB()->v; // v==h -> w
-            MAIN_FB()->h = MAIN_FB()->u; // u==w -> h
+        if (snapshot_wait(sensor, tick_start, length) != 0) {
+            return -1;
         }
 
         // Set the user image.
@@ -1187,3 +2600,52 @@ int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_c
 
     return 0;
 }
+
+// This is the default snapshot function, which can be replaced in sensor_init functions. This function
+// uses the DCMI and DMA to capture frames and each line is processed in the DCMI_DMAConvCpltUser function.
+int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_cb)
+{
+    // Frame boundary, the previous frame has been processed.
+    gc_stats_frame();
+    TRACE_INSTANT(TRACE_EVENT_FRAME, 0);
+
+    // Drop the frames output by the sensor while it settles after a mode switch.
+    for (; settle_count; settle_count--) {
+        if (snapshot_capture(sensor, NULL, NULL) != 0) {
+            return -1;
+        }
+    }
+
+    TRACE_BEGIN(TRACE_EVENT_CAPTURE, 0);
+    int ret = snapshot_capture(sensor, image, streaming_cb);
+    TRACE_END(TRACE_EVENT_CAPTURE, ret);
+
+    if (ret == 0) {
+        // The exposure is updated while the frame is processed.
+        ae_update(sensor);
+    }
+    return ret;
+}
+
+int sensor_snapshot_async()
+{
+    // Only the default snapshot function captures in the background, and only in continuous capture
+    // mode (multiple frame buffers) where the next frame goes to a buffer the script doesn't hold.
+    // A single buffer capture would overwrite the frame the script is still processing.
+    // Other sensors capture on the next snapshot call.
+    if (sensor.snapshot == sensor_snapshot && MAIN_FB()->n_buffers <= 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+bool sensor_frame_ready()
+{
+    if (sensor.snapshot != sensor_snapshot || settle_count) {
+        return false;
+    }
+
+    // A frame is waiting in the ring.
+    return continuous && (ready_buf >= 0);
+}
@@ -101,6 +101,18 @@ typedef enum {
     SDE_NEGATIVE,
 } sde_t;
 
+typedef enum {
+    PLANE_NONE,         // No capture plane.
+    PLANE_L,            // L channel (RGB565 only).
+    PLANE_BINARY,       // Binary mask from color thresholds.
+} plane_t;
+
+#define SENSOR_PLANE_MAX_THRESHOLDS (4)
+
+// Motion detector grid size (the change bitmap has one 32-bit word per grid row).
+#define SENSOR_MOTION_GRID_W        (32)
+#define SENSOR_MOTION_GRID_H        (24)
+
 typedef enum {
     ATTR_CONTRAST=0,
     ATTR_BRIGHTNESS,
@@ -118,6 +130,14 @@ typedef enum {
     IOCTL_GET_READOUT_WINDOW,
     IOCTL_SET_TRIGGERED_MODE,
     IOCTL_GET_TRIGGERED_MODE,
+    IOCTL_SET_PIPELINED_MODE,
+    IOCTL_GET_PIPELINED_MODE,
+    IOCTL_SET_HDR_MODE,
+    IOCTL_GET_HDR_MODE,
+    IOCTL_SET_COMPANDING,
+    IOCTL_GET_COMPANDING,
+    IOCTL_SET_HIGH_FPS_MODE,
+    IOCTL_GET_HIGH_FPS_MODE,
     IOCTL_LEPTON_GET_WIDTH,
     IOCTL_LEPTON_GET_HEIGHT,
     IOCTL_LEPTON_GET_RADIOMETRY,
@@ -131,9 +151,29 @@ typedef enum {
     IOCTL_LEPTON_SET_MEASUREMENT_MODE,
     IOCTL_LEPTON_GET_MEASUREMENT_MODE,
     IOCTL_LEPTON_SET_MEASUREMENT_RANGE,
-    IOCTL_LEPTON_GET_MEASUREMENT_RANGE
+    IOCTL_LEPTON_GET_MEASUREMENT_RANGE,
+    IOCTL_LEPTON_GET_MEASUREMENT_STATS,
+    IOCTL_HIMAX_MD_ENABLE,
+    IOCTL_HIMAX_MD_WINDOW,
+    IOCTL_HIMAX_MD_THRESHOLD,
+    IOCTL_HIMAX_MD_CLEAR,
+    IOCTL_HIMAX_OSC_ENABLE,
+    IOCTL_OV5640_AF_LOAD_FIRMWARE,
+    IOCTL_OV5640_AF_TRIGGER,
+    IOCTL_OV5640_AF_CONTINUOUS,
+    IOCTL_OV5640_AF_RELEASE,
+    IOCTL_OV5640_AF_ZONE,
+    IOCTL_OV5640_AF_STATUS
 } ioctl_t;
 
+// IOCTL_OV5640_AF_STATUS states.
+typedef enum {
+    OV5640_AF_STATE_ERROR = -1,
+    OV5640_AF_STATE_IDLE,
+    OV5640_AF_STATE_FOCUSING,
+    OV5640_AF_STATE_FOCUSED
+} ov5640_af_state_t;
+
 #define SENSOR_HW_FLAGS_VSYNC        (0) // vertical sync polarity.
 #define SENSOR_HW_FLAGS_HSYNC        (1) // horizontal sync polarity.
 #define SENSOR_HW_FLAGS_PIXCK        (2) // pixel clock edge.
@@ -151,6 +191,7 @@ typedef struct _sensor {
     uint8_t  slv_addr;          // Sensor I2C slave address.
     uint16_t gs_bpp;            // Grayscale bytes per pixel.
     uint32_t hw_flags;          // Hardware flags (clock polarities/hw capabilities)
+    uint32_t settle_frames;     // Number of invalid frames output after a mode switch.
     const uint16_t *color_palette;    // Color palette used for color lookup.
 
     uint32_t vsync_pin;         // VSYNC GPIO output pin.
@@ -195,6 +236,7 @@ typedef struct _sensor {
     int  (*set_special_effect)  (sensor_t *sensor, sde_t sde);
     int  (*set_lens_correction) (sensor_t *sensor, int enable, int radi, int coef);
     int  (*ioctl)               (sensor_t *sensor, int request, va_list ap);
+    int  (*set_exposure_gain)   (sensor_t *sensor, int exposure_us, float gain_db); // For the native AE (optional).
     int  (*snapshot)            (sensor_t *sensor, image_t *image, streaming_cb_t streaming_cb);
 } sensor_t;
 
@@ -217,6 +259,7 @@ int sensor_get_id();
 int sensor_sleep(int enable);
 
 // Shutdown mode.
+// Note: The sensor state is retained, there's no need to reset the sensor after waking up.
 int sensor_shutdown(int enable);
 
 // Read a sensor register.
@@ -231,6 +274,10 @@ int sensor_set_pixformat(pixformat_t pixformat);
 // Set the sensor frame size.
 int sensor_set_framesize(framesize_t framesize);
 
+// Set the pixel format and frame size at once.
+// Note: The frames output by the sensor while settling are dropped by the next snapshot call.
+int sensor_set_mode(pixformat_t pixformat, framesize_t framesize);
+
 // Set window size.
 int sensor_set_windowing(int x, int y, int w, int h);
 
@@ -304,15 +351,73 @@ int sensor_set_lens_correction(int enable, int radi, int coef);
 // IOCTL function
 int sensor_ioctl(int request, ...);
 
+// Get the number of frames dropped (captured by the sensor but not returned by snapshot).
+uint32_t sensor_get_dropped_frames();
+
 // Set vsync output pin
 int sensor_set_vsync_output(GPIO_TypeDef *gpio, uint32_t pin);
 
+// Trigger the capture from an external sync input (e.g. another camera's vsync output).
+int sensor_set_sync_input(bool enable);
+
+// Called on both edges of the sync input.
+void sensor_sync_input_callback(bool level);
+
 // Set color palette
 int sensor_set_color_palette(const uint16_t *color_palette);
 
 // Get color palette
 const uint16_t *sensor_get_color_palette();
 
+// Set the number of frame buffers (1 == single buffer, 2 == double buffer, 3 == triple buffer).
+int sensor_set_framebuffers(int count);
+
+// Get the number of frame buffers.
+int sensor_get_framebuffers();
+
+// Set the capture plane, an image (of the same size as the window) computed from each line while it's captured.
+// Note: The capture plane is only computed in single buffer mode and it's not supported with transpose.
+int sensor_set_plane(plane_t mode, image_t *plane, list_t *thresholds, bool invert);
+
+// Enable gamma correction of each captured line (GRAYSCALE and RGB565), with the same tables as image.gamma_corr().
+// Note: Gamma correction is not supported with transpose, and it disables the direct and MDMA line transfers.
+int sensor_set_gamma_corr(bool enable, float gamma, float contrast, float brightness);
+
+// Enable the motion detector, which compares a decimated copy of each captured frame against a background
+// in a grid of cells. A cell is changed if its average luminance differs from the background by more than threshold.
+// Note: The motion detector is not supported with transpose.
+int sensor_set_motion(bool enable, int threshold);
+
+// Get the number of changed cells in the last frame, and copy the change bitmap (SENSOR_MOTION_GRID_H words).
+int sensor_get_motion(uint32_t *bitmap);
+
+// Enable the native auto exposure, which runs from a decimated histogram of each captured frame and
+// writes the exposure and gain between frames to bring the mean luminance to target (0-255). speed
+// (0-1] is the fraction of the error (in stops) corrected per frame. The exposure is raised up to
+// max_exposure_us before the gain is raised up to max_gain_db. If awb is true the red and blue gains
+// are also balanced against the green gain (gray world, RGB565 only). The sensor's own AE/AGC/AWB are
+// turned off while it's enabled and it's disabled by a sensor reset.
+// Note: The native AE isn't supported with JPEG, and it disables the direct line transfers.
+int sensor_set_native_ae(bool enable, int target, float speed, int max_exposure_us, float max_gain_db, bool awb);
+
+// Get the mean luminance of the last frame and the exposure and gain set by the native AE.
+int sensor_get_native_ae(int *mean, int *exposure_us, float *gain_db);
+
+// Compress each captured frame to the JPEG frame buffer while it's captured (hardware JPEG only), the
+// JPEG frame is ready when the snapshot returns and it's also sent to the IDE instead of the processed frame.
+// Note: Only RGB565 and GRAYSCALE frames in single buffer mode are compressed, and transpose is not supported.
+int sensor_set_jpeg_stream(bool enable, int quality);
+
+// Get the JPEG compressed copy of the last frame, returns -1 if the frame wasn't compressed.
+int sensor_get_jpeg_stream(image_t *image);
+
 // Default snapshot function.
 int sensor_snapshot(sensor_t *sensor, image_t *image, streaming_cb_t streaming_cb);
+
+// Start capturing a frame in the background, the frame is returned by the next snapshot call.
+// Returns -1 in single buffer mode, there's no spare frame buffer to capture to.
+int sensor_snapshot_async();
+
+// Returns true if the next snapshot call returns a frame without waiting.
+bool sensor_frame_ready();
 #endif /* __SENSOR_H__ */
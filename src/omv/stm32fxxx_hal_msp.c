@@ -301,6 +301,71 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi)
     #endif
 }
 
+#if defined(OMV_QSPIF_LAYOUT)
+void HAL_QSPI_MspInit(QSPI_HandleTypeDef *hqspi)
+{
+    /* Enable QSPI clock */
+    QSPIF_CLK_ENABLE();
+
+    /* Reset the QSPI memory interface */
+    QSPIF_FORCE_RESET();
+    QSPIF_RELEASE_RESET();
+
+    /* Enable GPIO clocks */
+    QSPIF_CLK_GPIO_CLK_ENABLE();
+    QSPIF_CS_GPIO_CLK_ENABLE();
+    QSPIF_D0_GPIO_CLK_ENABLE();
+    QSPIF_D1_GPIO_CLK_ENABLE();
+    QSPIF_D2_GPIO_CLK_ENABLE();
+    QSPIF_D3_GPIO_CLK_ENABLE();
+
+    /* Configure QSPI GPIOs */
+    GPIO_InitTypeDef GPIO_InitStructure;
+    GPIO_InitStructure.Mode      = GPIO_MODE_AF_PP;
+    GPIO_InitStructure.Speed     = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStructure.Pull      = GPIO_NOPULL;
+
+    GPIO_InitStructure.Pin       = QSPIF_CLK_PIN;
+    GPIO_InitStructure.Alternate = QSPIF_CLK_ALT;
+    HAL_GPIO_Init(QSPIF_CLK_PORT, &GPIO_InitStructure);
+
+    GPIO_InitStructure.Pin       = QSPIF_D0_PIN;
+    GPIO_InitStructure.Alternate = QSPIF_D0_ALT;
+    HAL_GPIO_Init(QSPIF_D0_PORT, &GPIO_InitStructure);
+
+    GPIO_InitStructure.Pin       = QSPIF_D1_PIN;
+    GPIO_InitStructure.Alternate = QSPIF_D1_ALT;
+    HAL_GPIO_Init(QSPIF_D1_PORT, &GPIO_InitStructure);
+
+    GPIO_InitStructure.Pin       = QSPIF_D2_PIN;
+    GPIO_InitStructure.Alternate = QSPIF_D2_ALT;
+    HAL_GPIO_Init(QSPIF_D2_PORT, &GPIO_InitStructure);
+
+    GPIO_InitStructure.Pin       = QSPIF_D3_PIN;
+    GPIO_InitStructure.Alternate = QSPIF_D3_ALT;
+    HAL_GPIO_Init(QSPIF_D3_PORT, &GPIO_InitStructure);
+
+    GPIO_InitStructure.Pin       = QSPIF_CS_PIN;
+    GPIO_InitStructure.Pull      = GPIO_PULLUP;
+    GPIO_InitStructure.Alternate = QSPIF_CS_ALT;
+    HAL_GPIO_Init(QSPIF_CS_PORT, &GPIO_InitStructure);
+}
+
+void HAL_QSPI_MspDeInit(QSPI_HandleTypeDef *hqspi)
+{
+    HAL_GPIO_DeInit(QSPIF_CLK_PORT, QSPIF_CLK_PIN);
+    HAL_GPIO_DeInit(QSPIF_CS_PORT, QSPIF_CS_PIN);
+    HAL_GPIO_DeInit(QSPIF_D0_PORT, QSPIF_D0_PIN);
+    HAL_GPIO_DeInit(QSPIF_D1_PORT, QSPIF_D1_PIN);
+    HAL_GPIO_DeInit(QSPIF_D2_PORT, QSPIF_D2_PIN);
+    HAL_GPIO_DeInit(QSPIF_D3_PORT, QSPIF_D3_PIN);
+
+    QSPIF_FORCE_RESET();
+    QSPIF_RELEASE_RESET();
+    QSPIF_CLK_DISABLE();
+}
+#endif // OMV_QSPIF_LAYOUT
+
 void HAL_MspDeInit(void)
 {
 
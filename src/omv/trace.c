@@ -7,32 +7,106 @@
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
  * Trace buffer.
+ *
+ * A ring of timestamped records written from threads and ISRs without disabling IRQs: a
+ * writer claims a slot by incrementing the head with LDREX/STREX, fills it, then publishes
+ * it by writing its sequence number. The oldest records are overwritten when the ring is
+ * full, the host drops those it reads while they're being rewritten (sequence mismatch).
  */
-#include "trace.h"
-#include <stdint.h>
+#include <string.h>
 #include STM32_HAL_H
+#include "trace.h"
 
-#define TRACEBUF_SIZE   (256)
-typedef struct _tracebuf_t {
-    uint8_t idx;
-    uint8_t buf[TRACEBUF_SIZE];
-} tracebuf_t;
+#define TRACE_BUF_MASK  (TRACE_BUF_SIZE - 1)
 
-static tracebuf_t tracebuf;
+volatile uint32_t trace_mask;
+static volatile uint32_t trace_head;
+static uint32_t trace_tail;
+static uint32_t drain_tail;
+static uint32_t drain_count;
+static trace_record_t tracebuf[TRACE_BUF_SIZE];
 
 void trace_init()
 {
-    tracebuf.idx = 0;
-    for (int i=0; i<TRACEBUF_SIZE; i++) {
-        tracebuf.buf[i] = 0;
+    trace_mask = 0;
+    trace_head = 0;
+    trace_tail = 0;
+    drain_count = 0;
+    memset(tracebuf, 0, sizeof(tracebuf));
+}
+
+void trace_set_mask(uint32_t mask)
+{
+    if (mask && !(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        // Enable the cycle counter used for timestamps.
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        #if (__CORTEX_M == 7U)
+        DWT->LAR = 0xC5ACCE55;
+        #endif
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
     }
+    trace_mask = mask;
 }
 
-void trace_insert(uint32_t x)
+void trace_insert(uint32_t event, uint32_t phase, uint32_t arg)
 {
-    __disable_irq();
-    if (tracebuf.idx < TRACEBUF_SIZE) {
-        tracebuf.buf[tracebuf.idx++] = x;
+    uint32_t seq;
+
+    do {
+        seq = __LDREXW(&trace_head);
+    } while (__STREXW(seq + 1, &trace_head));
+
+    trace_record_t *record = tracebuf + (seq & TRACE_BUF_MASK);
+    record->seq = 0;
+    __DMB();
+    record->cycles = DWT->CYCCNT;
+    record->event = event;
+    record->phase = phase;
+    record->arg = arg;
+    __DMB();
+    record->seq = seq + 1;
+}
+
+uint32_t trace_drain_start()
+{
+    uint32_t head = trace_head;
+
+    // Skip records that have been overwritten.
+    if ((head - trace_tail) > TRACE_BUF_SIZE) {
+        trace_tail = head - TRACE_BUF_SIZE;
     }
-    __enable_irq();
+
+    drain_tail = trace_tail;
+    drain_count = head - trace_tail;
+    return drain_count;
+}
+
+void trace_drain_copy(void *buffer, uint32_t offset, uint32_t length)
+{
+    uint8_t *dst = buffer;
+    uint32_t size = drain_count * sizeof(trace_record_t);
+
+    while (length) {
+        if (offset >= size) {
+            memset(dst, 0, length);
+            break;
+        }
+
+        uint32_t index = offset / sizeof(trace_record_t);
+        uint32_t record_offset = offset % sizeof(trace_record_t);
+        uint32_t n = sizeof(trace_record_t) - record_offset;
+        n = (n < length) ? n : length;
+
+        uint8_t *src = (uint8_t *) (tracebuf + ((drain_tail + index) & TRACE_BUF_MASK));
+        memcpy(dst, src + record_offset, n);
+        dst += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+void trace_drain_end()
+{
+    trace_tail = drain_tail + drain_count;
+    drain_count = 0;
 }
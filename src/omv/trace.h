@@ -11,6 +11,55 @@
 #ifndef __TRACE_H__
 #define __TRACE_H__
 #include <stdint.h>
+#include <stdbool.h>
+
+// Number of records, must be a power of 2.
+#ifndef TRACE_BUF_SIZE
+#define TRACE_BUF_SIZE      (256)
+#endif
+
+typedef enum {
+    TRACE_EVENT_CAPTURE     = 0,    // sensor_snapshot() frame capture, arg = 0/-1 result.
+    TRACE_EVENT_LINE        = 1,    // DCMI line ISR, arg = line.
+    TRACE_EVENT_JPEG        = 2,    // IDE preview JPEG encode, arg = compressed size.
+    TRACE_EVENT_FB_ALLOC    = 3,    // fb_alloc_mark() to fb_alloc_free_till_mark(), arg = caller.
+    TRACE_EVENT_GC          = 4,    // gc_collect().
+    TRACE_EVENT_FRAME       = 5,    // Script frame boundary (sensor.snapshot() call).
+    TRACE_EVENT_USER        = 6,    // Reserved for scripts/debugging.
+    TRACE_EVENT_MAX
+} trace_event_t;
+
+typedef enum {
+    TRACE_PHASE_INSTANT     = 0,
+    TRACE_PHASE_BEGIN       = 1,
+    TRACE_PHASE_END         = 2,
+} trace_phase_t;
+
+// Records are read as-is by the host (tools/pyopenmv.py).
+typedef struct _trace_record_t {
+    uint32_t seq;       // Sequence number + 1, written last (0 = record being written).
+    uint32_t cycles;    // DWT cycle counter.
+    uint16_t event;
+    uint16_t phase;
+    uint32_t arg;
+} trace_record_t;
+
+extern volatile uint32_t trace_mask;
+
+// Events are only recorded if their bit is set in the mask (set from the IDE, all off by
+// default), so disabled events just cost a load and a branch.
+#define TRACE_ENABLED(event)        (trace_mask & (1 << (event)))
+#define TRACE_INSTANT(event, arg)   do { if (TRACE_ENABLED(event)) trace_insert(event, TRACE_PHASE_INSTANT, arg); } while (0)
+#define TRACE_BEGIN(event, arg)     do { if (TRACE_ENABLED(event)) trace_insert(event, TRACE_PHASE_BEGIN, arg); } while (0)
+#define TRACE_END(event, arg)       do { if (TRACE_ENABLED(event)) trace_insert(event, TRACE_PHASE_END, arg); } while (0)
+
 void trace_init();
-void trace_insert(uint32_t x);
+void trace_set_mask(uint32_t mask);
+void trace_insert(uint32_t event, uint32_t phase, uint32_t arg);
+// Returns the number of records available and starts a drain at the oldest one.
+uint32_t trace_drain_start();
+// Copies length bytes at offset of the records returned by trace_drain_start().
+void trace_drain_copy(void *buffer, uint32_t offset, uint32_t length);
+// Releases the records returned by trace_drain_start().
+void trace_drain_end();
 #endif /* __TRACE_H__ */
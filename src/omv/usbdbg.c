@@ -12,9 +12,11 @@
 #include "imlib.h"
 #include "sensor.h"
 #include "framebuffer.h"
+#include "fb_alloc.h"
 #include "ff.h"
 #include "usb.h"
 #include "usbdbg.h"
+#include "trace.h"
 #include "nlr.h"
 #include "lexer.h"
 #include "parse.h"
@@ -29,6 +31,7 @@ static enum usbdbg_cmd cmd;
 static volatile bool script_ready;
 static volatile bool script_running;
 static vstr_t script_buf;
+static jpegbuffer_frame_t *ide_frame = NULL; // The preview frame being dumped.
 static mp_obj_t mp_const_ide_interrupt = MP_OBJ_NULL;
 extern const char *ffs_strerror(FRESULT res);
 
@@ -91,6 +94,39 @@ void usbdbg_data_in(void *buffer, int length)
             break;
         }
 
+        case USBDBG_FB_ALLOC_STATS: {
+            // Send the fb_alloc profiler entries (unused entries are zero).
+            const uint8_t *stats = (const uint8_t *) fb_alloc_profile_entries();
+            int stats_size = FB_ALLOC_PROFILE_ENTRIES * sizeof(fb_alloc_profile_t);
+            memset(buffer, 0, length);
+            if (xfer_bytes < stats_size) {
+                memcpy(buffer, stats + xfer_bytes, IM_MIN(length, stats_size - xfer_bytes));
+            }
+            xfer_bytes += length;
+            if (xfer_bytes >= xfer_length) {
+                cmd = USBDBG_NONE;
+            }
+            break;
+        }
+
+        case USBDBG_TRACE_LEN: {
+            // Number of trace records the next USBDBG_TRACE_DUMP returns.
+            uint32_t trace_len = trace_drain_start();
+            memcpy(buffer, &trace_len, sizeof(trace_len));
+            cmd = USBDBG_NONE;
+            break;
+        }
+
+        case USBDBG_TRACE_DUMP: {
+            trace_drain_copy(buffer, xfer_bytes, length);
+            xfer_bytes += length;
+            if (xfer_bytes >= xfer_length) {
+                trace_drain_end();
+                cmd = USBDBG_NONE;
+            }
+            break;
+        }
+
         case USBDBG_TX_BUF: {
             uint8_t *tx_buf = usb_cdc_tx_buf(length);
             memcpy(buffer, tx_buf, length);
@@ -101,32 +137,28 @@ void usbdbg_data_in(void *buffer, int length)
         }
 
         case USBDBG_FRAME_SIZE:
-            // Return 0 if FB is locked or not ready.
+            // Return 0 if there's no new frame.
             ((uint32_t*)buffer)[0] = 0;
-            // Try to lock FB. If header size == 0 frame is not ready
-            if (mutex_try_lock(&JPEG_FB()->lock, MUTEX_TID_IDE)) {
-                // If header size == 0 frame is not ready
-                if (JPEG_FB()->size == 0) {
-                    // unlock FB
-                    mutex_unlock(&JPEG_FB()->lock, MUTEX_TID_IDE);
-                } else {
-                    // Return header w, h and size/bpp
-                    ((uint32_t*)buffer)[0] = JPEG_FB()->w;
-                    ((uint32_t*)buffer)[1] = JPEG_FB()->h;
-                    ((uint32_t*)buffer)[2] = JPEG_FB()->size;
-                }
+            // The newest frame is held until it's dumped (or the next frame size request).
+            if ((ide_frame = fb_acquire_jpeg_frame(JPEG_FB_READER_IDE))) {
+                // Return header w, h and size/bpp (raw frames are w*h*bpp bytes, bayer is 1 byte).
+                ((uint32_t*)buffer)[0] = ide_frame->w;
+                ((uint32_t*)buffer)[1] = ide_frame->h;
+                ((uint32_t*)buffer)[2] = ide_frame->bpp ? ide_frame->bpp : ide_frame->size;
             }
             cmd = USBDBG_NONE;
             break;
 
         case USBDBG_FRAME_DUMP:
             if (xfer_bytes < xfer_length) {
-                memcpy(buffer, JPEG_FB()->pixels+xfer_bytes, length);
+                if (ide_frame) {
+                    memcpy(buffer, ide_frame->pixels+xfer_bytes, length);
+                }
                 xfer_bytes += length;
                 if (xfer_bytes == xfer_length) {
                     cmd = USBDBG_NONE;
-                    JPEG_FB()->w = 0; JPEG_FB()->h = 0; JPEG_FB()->size = 0;
-                    mutex_unlock(&JPEG_FB()->lock, MUTEX_TID_IDE);
+                    fb_release_jpeg_frame(JPEG_FB_READER_IDE);
+                    ide_frame = NULL;
                 }
             }
             break;
@@ -161,14 +193,35 @@ void usbdbg_data_out(void *buffer, int length)
             uint32_t enable = *((int32_t*)buffer);
             JPEG_FB()->enabled = enable;
             if (enable == 0) {
-                // When disabling framebuffer, the IDE might still be holding FB lock.
-                // If the IDE is not the current lock owner, this operation is ignored.
-                mutex_unlock(&JPEG_FB()->lock, MUTEX_TID_IDE);
+                // When disabling framebuffer, the IDE might still be holding a frame.
+                fb_release_jpeg_frame(JPEG_FB_READER_IDE);
+                ide_frame = NULL;
             }
             cmd = USBDBG_NONE;
             break;
         }
 
+        case USBDBG_FB_BUDGET: {
+            // Preview bandwidth budget in bytes per second, 0 disables it.
+            JPEG_FB()->budget = IM_MAX(0, *((int32_t*)buffer));
+            cmd = USBDBG_NONE;
+            break;
+        }
+
+        case USBDBG_TRACE_ENABLE: {
+            // Mask of trace events to record (1 << trace_event_t), 0 stops tracing.
+            trace_set_mask(*((uint32_t*)buffer));
+            cmd = USBDBG_NONE;
+            break;
+        }
+
+        case USBDBG_FB_RAW: {
+            // Send lossless frames instead of JPEG previews.
+            JPEG_FB()->raw = *((int32_t*)buffer) != 0;
+            cmd = USBDBG_NONE;
+            break;
+        }
+
         case USBDBG_SCRIPT_EXEC:
             // check if GC is locked before allocating memory for vstr. If GC was locked
             // at least once before the script is fully uploaded xfer_bytes will be less
@@ -201,7 +254,7 @@ void usbdbg_data_out(void *buffer, int length)
                 .w = MAIN_FB()->w,
                 .h = MAIN_FB()->h,
                 .bpp = MAIN_FB()->bpp,
-                .pixels = MAIN_FB()->pixels
+                .pixels = MAIN_FB_BUFFER()
             };
 
             // null terminate the path
@@ -222,7 +275,7 @@ void usbdbg_data_out(void *buffer, int length)
                 .w = MAIN_FB()->w,
                 .h = MAIN_FB()->h,
                 .bpp = MAIN_FB()->bpp,
-                .pixels = MAIN_FB()->pixels
+                .pixels = MAIN_FB_BUFFER()
             };
 
             // null terminate the path
@@ -342,6 +395,13 @@ void usbdbg_control(void *buffer, uint8_t request, uint32_t length)
             break;
         }
 
+        case USBDBG_FB_BUDGET:
+        case USBDBG_FB_RAW: {
+            xfer_bytes = 0;
+            xfer_length = length;
+            break;
+        }
+
         case USBDBG_TX_BUF:
         case USBDBG_TX_BUF_LEN:
             xfer_bytes = 0;
@@ -353,6 +413,18 @@ void usbdbg_control(void *buffer, uint8_t request, uint32_t length)
             xfer_length = length;
             break;
 
+        case USBDBG_FB_ALLOC_STATS:
+            xfer_bytes = 0;
+            xfer_length = length;
+            break;
+
+        case USBDBG_TRACE_ENABLE:
+        case USBDBG_TRACE_LEN:
+        case USBDBG_TRACE_DUMP:
+            xfer_bytes = 0;
+            xfer_length = length;
+            break;
+
         default: /* error */
             cmd = USBDBG_NONE;
             break;
@@ -20,8 +20,8 @@
   * the IDE will Not connect if the major version number is different.
   */
 #define FIRMWARE_VERSION_MAJOR      (3)
-#define FIRMWARE_VERSION_MINOR      (6)
-#define FIRMWARE_VERSION_PATCH      (4)
+#define FIRMWARE_VERSION_MINOR      (9)
+#define FIRMWARE_VERSION_PATCH      (0)
 
 /**
   * To add a new debugging command, increment the last command value used.
@@ -49,7 +49,13 @@ enum usbdbg_cmd {
     USBDBG_FB_ENABLE        =0x0D,
     USBDBG_TX_BUF_LEN       =0x8E,
     USBDBG_TX_BUF           =0x8F,
-    USBDBG_SENSOR_ID        =0x90
+    USBDBG_SENSOR_ID        =0x90,
+    USBDBG_FB_ALLOC_STATS   =0x91,
+    USBDBG_FB_BUDGET        =0x12,
+    USBDBG_FB_RAW           =0x13,
+    USBDBG_TRACE_ENABLE     =0x14,
+    USBDBG_TRACE_LEN        =0x95,
+    USBDBG_TRACE_DUMP       =0x96
 };
 void usbdbg_init();
 bool usbdbg_script_ready();
@@ -41,50 +41,145 @@
 
 #define OPENMVCAM_BROADCAST_ADDR ((uint8_t [5]){255, 255, 255, 255})
 #define OPENMVCAM_BROADCAST_PORT (0xABD1)
+#define OPENMVCAM_BROADCAST_TIME (1000) // ms
 #define SERVER_ADDR              ((uint8_t [5]){192, 168, 1, 1})
 #define SERVER_PORT              (9000)
-#define BUFFER_SIZE              (512)
+#define BUFFER_SIZE              (SOCKET_BUFFER_MAX_LENGTH * 4)
 
 #define UDPCAST_STRING           "%d.%d.%d.%d:%d:%s"
 #define UDPCAST_STRING_SIZE      4+4+4+4+6+WINC_MAX_BOARD_NAME_LEN+1
 
-#define close_all_sockets()             \
-    do {                                \
-        winc_socket_close(client_fd);   \
-        winc_socket_close(server_fd);   \
-        winc_socket_close(udpbcast_fd); \
-        client_fd = -1;                 \
-        server_fd = -1;                 \
-        udpbcast_fd = -1;               \
-    } while (0)
-
-#define close_server_socket()           \
-    do {                                \
-        winc_socket_close(server_fd);   \
-        server_fd = -1;                 \
-    } while (0)
-
-#define close_udpbcast_socket()         \
-    do {                                \
-        winc_socket_close(udpbcast_fd); \
-        udpbcast_fd = -1;               \
-    } while (0)
-
-#define TIMEDOUT(x) (x == -ETIMEDOUT || x == SOCK_ERR_TIMEOUT)
-
-static int client_fd = -1;
+// The sockets are driven by the WINC socket event callback, which only updates the state
+// below, and wifidbg_dispatch() moves the state machine forward without ever waiting.
+typedef enum {
+    WIFIDBG_STATE_CLOSED,       // Sockets need to be created.
+    WIFIDBG_STATE_BIND,         // Waiting for the server socket to be bound.
+    WIFIDBG_STATE_BOUND,        // Server socket bound, listen next.
+    WIFIDBG_STATE_LISTEN,       // Waiting for the server socket to listen.
+    WIFIDBG_STATE_ACCEPT,       // Waiting for the IDE to connect.
+    WIFIDBG_STATE_CONNECTED,    // The IDE is connected.
+    WIFIDBG_STATE_ERROR,        // Close all sockets and start over.
+} wifidbg_state_t;
+
+static volatile wifidbg_state_t state = WIFIDBG_STATE_CLOSED;
+static volatile int client_fd = -1;
 static int server_fd = -1;
 static int udpbcast_fd = -1;
-static int udpbcast_time = 0;
+static uint32_t udpbcast_ticks = 0;
 static uint8_t ip_addr[WINC_IPV4_ADDR_LEN] = {};
 static char udpbcast_string[UDPCAST_STRING_SIZE] = {};
+
+// The WINC copies received packets straight into the socket buffer, which is consumed in place.
 static winc_socket_buf_t sockbuf;
+static volatile bool recv_pending = false;
+static volatile bool client_closed = false;
+
+// Current command, header bytes may be split across packets.
+static uint8_t header[6];
+static int header_size = 0;
+static uint8_t request = 0;
+static uint32_t xfer_length = 0;
+
+// Device-to-host data is sent from here, the WINC takes up to SOCKET_BUFFER_MAX_LENGTH per send.
+static uint8_t tx_buf[BUFFER_SIZE] __attribute__((aligned(4)));
+static int tx_idx = 0;
+static int tx_size = 0;
+
+static void close_client_socket()
+{
+    if (client_fd >= 0) {
+        winc_socket_close(client_fd);
+        client_fd = -1;
+    }
+
+    client_closed = false;
+    recv_pending = false;
+    sockbuf.size = sockbuf.idx = 0;
+    header_size = 0;
+    xfer_length = 0;
+    tx_idx = tx_size = 0;
+}
+
+static void close_all_sockets()
+{
+    close_client_socket();
+
+    if (server_fd >= 0) {
+        winc_socket_close(server_fd);
+        server_fd = -1;
+    }
+
+    if (udpbcast_fd >= 0) {
+        winc_socket_close(udpbcast_fd);
+        udpbcast_fd = -1;
+    }
+
+    state = WIFIDBG_STATE_CLOSED;
+}
+
+static void wifidbg_socket_callback(int fd, uint8_t msg_type, void *msg)
+{
+    switch (msg_type) {
+        case SOCKET_MSG_BIND:
+            if (fd == server_fd && state == WIFIDBG_STATE_BIND) {
+                state = (((tstrSocketBindMsg *) msg)->status == 0) ?
+                    WIFIDBG_STATE_BOUND : WIFIDBG_STATE_ERROR;
+            }
+            break;
+
+        case SOCKET_MSG_LISTEN:
+            if (fd == server_fd && state == WIFIDBG_STATE_LISTEN) {
+                state = (((tstrSocketListenMsg *) msg)->status == 0) ?
+                    WIFIDBG_STATE_ACCEPT : WIFIDBG_STATE_ERROR;
+            }
+            break;
+
+        case SOCKET_MSG_ACCEPT: {
+            int sock = ((tstrSocketAcceptMsg *) msg)->sock;
+            if (sock < 0) {
+                state = WIFIDBG_STATE_ERROR;
+            } else if (client_fd >= 0) {
+                // Only one IDE connection at a time.
+                winc_socket_close(sock);
+            } else {
+                client_fd = sock;
+                winc_socket_set_callback(sock, wifidbg_socket_callback);
+                state = WIFIDBG_STATE_CONNECTED;
+            }
+            break;
+        }
+
+        case SOCKET_MSG_RECV:
+            if (fd == client_fd) {
+                int size = ((tstrSocketRecvMsg *) msg)->s16BufferSize;
+                recv_pending = false;
+                if (size > 0) {
+                    sockbuf.idx = 0;
+                    sockbuf.size = size;
+                } else {
+                    client_closed = true;
+                }
+            }
+            break;
+
+        case SOCKET_MSG_SEND:
+            // The WINC closes the socket on send errors.
+            if (fd == client_fd && (*((int16_t *) msg)) < 0) {
+                client_closed = true;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
 
 int wifidbg_init(wifidbg_config_t *config)
 {
     client_fd = -1;
     server_fd = -1;
     udpbcast_fd = -1;
+    state = WIFIDBG_STATE_CLOSED;
 
     if(!config->mode) { // STA Mode
 
@@ -134,115 +229,147 @@ int wifidbg_init(wifidbg_config_t *config)
     return 0;
 }
 
-void wifidbg_dispatch()
+static void wifidbg_open_sockets()
 {
-    int ret;
-    uint8_t buf[BUFFER_SIZE];
-    sockaddr client_sockaddr;
-
-    if (client_fd < 0 && udpbcast_fd < 0) {
-        // Create broadcast socket.
-        MAKE_SOCKADDR(udpbcast_sockaddr, OPENMVCAM_BROADCAST_ADDR, OPENMVCAM_BROADCAST_PORT)
-
-        if ((udpbcast_fd = winc_socket_socket(SOCK_DGRAM)) < 0) {
-            return;
-        }
-
-        if ((ret = winc_socket_bind(udpbcast_fd, &udpbcast_sockaddr)) < 0) {
-            close_udpbcast_socket();
-            return;
-        }
+    MAKE_SOCKADDR(udpbcast_sockaddr, OPENMVCAM_BROADCAST_ADDR, OPENMVCAM_BROADCAST_PORT)
+    MAKE_SOCKADDR(server_sockaddr, ip_addr, SERVER_PORT)
 
+    // The broadcast socket is only used to send, its bind result doesn't matter.
+    if ((udpbcast_fd = winc_socket_socket(SOCK_DGRAM)) < 0 ||
+            (server_fd = winc_socket_socket(SOCK_STREAM)) < 0) {
+        close_all_sockets();
         return;
     }
 
-    if (client_fd < 0 && (udpbcast_fd >= 0) && (!(udpbcast_time++ % 100))) {
-        // Broadcast message to the IDE.
-        MAKE_SOCKADDR(udpbcast_sockaddr, OPENMVCAM_BROADCAST_ADDR, OPENMVCAM_BROADCAST_PORT)
-
-        if ((ret = winc_socket_sendto(udpbcast_fd, (uint8_t *) udpbcast_string,
-                        strlen(udpbcast_string) + 1, &udpbcast_sockaddr, 500)) < 0) {
-            close_udpbcast_socket();
-            return;
-        }
+    winc_socket_set_callback(udpbcast_fd, wifidbg_socket_callback);
+    winc_socket_set_callback(server_fd, wifidbg_socket_callback);
+    WINC1500_EXPORT(bind)(udpbcast_fd, &udpbcast_sockaddr, sizeof(udpbcast_sockaddr));
 
-        return;
+    state = WIFIDBG_STATE_BIND;
+    if (WINC1500_EXPORT(bind)(server_fd, &server_sockaddr, sizeof(server_sockaddr)) != SOCK_ERR_NO_ERROR) {
+        close_all_sockets();
     }
+}
 
-    if (server_fd < 0) {
-        // Create server socket
-        MAKE_SOCKADDR(server_sockaddr, ip_addr, SERVER_PORT)
+static void wifidbg_broadcast()
+{
+    // Broadcast message to the IDE, a full buffer just skips this one.
+    if ((HAL_GetTick() - udpbcast_ticks) >= OPENMVCAM_BROADCAST_TIME) {
+        MAKE_SOCKADDR(udpbcast_sockaddr, OPENMVCAM_BROADCAST_ADDR, OPENMVCAM_BROADCAST_PORT)
+        WINC1500_EXPORT(sendto)(udpbcast_fd, udpbcast_string, strlen(udpbcast_string) + 1,
+                0, &udpbcast_sockaddr, sizeof(udpbcast_sockaddr));
+        udpbcast_ticks = HAL_GetTick();
+    }
+}
 
-        if ((server_fd = winc_socket_socket(SOCK_STREAM)) < 0) {
-            return;
-        }
+// Returns false if the client socket failed.
+static bool wifidbg_client_dispatch()
+{
+    // Bound the time spent here by sending at most one buffer per dispatch.
+    int sent = 0;
+
+    while (true) {
+        if (xfer_length == 0 && tx_idx == tx_size) {
+            // Command phase.
+            int bytes = MIN(sizeof(header) - header_size, sockbuf.size);
+            memcpy(header + header_size, sockbuf.buf + sockbuf.idx, bytes);
+            header_size += bytes;
+            sockbuf.idx += bytes;
+            sockbuf.size -= bytes;
+
+            if (header_size < sizeof(header)) {
+                break; // Wait for the rest of the header.
+            }
 
-        if ((ret = winc_socket_bind(server_fd, &server_sockaddr)) < 0) {
-            close_all_sockets();
-            return;
-        }
+            header_size = 0;
+            if (header[0] != 0x30) {
+                continue;
+            }
 
-        if ((ret = winc_socket_listen(server_fd, 1)) < 0) {
-            close_all_sockets();
-            return;
-        }
+            request = header[1];
+            xfer_length = *((uint32_t*)(header+2));
+            usbdbg_control(header+6, request, xfer_length);
+        } else if (request & 0x80) {
+            // Device-to-host data phase
+            if (tx_idx == tx_size) {
+                if (sent >= BUFFER_SIZE) {
+                    return true;
+                }
+                tx_size = MIN(xfer_length, BUFFER_SIZE);
+                tx_idx = 0;
+                xfer_length -= tx_size;
+                usbdbg_data_in(tx_buf, tx_size);
+            }
 
-        return;
-    }
+            int bytes = MIN(tx_size - tx_idx, SOCKET_BUFFER_MAX_LENGTH);
+            int ret = WINC1500_EXPORT(send)(client_fd, tx_buf + tx_idx, bytes, 0);
+            if (ret == SOCK_ERR_BUFFER_FULL) {
+                return true; // Resume on the next dispatch.
+            } else if (ret != SOCK_ERR_NO_ERROR) {
+                return false;
+            }
 
-    if (client_fd < 0) {
-        sockbuf.size = sockbuf.idx = 0;
-        // Call accept.
-        if ((ret = winc_socket_accept(server_fd,
-                        &client_sockaddr, &client_fd, 10)) < 0) {
-            if (TIMEDOUT(ret)) {
-                client_fd = -1;
-            } else {
-                close_all_sockets();
+            tx_idx += bytes;
+            sent += bytes;
+        } else {
+            // Host-to-device data phase, the data is passed straight from the socket buffer.
+            int bytes = MIN(xfer_length, sockbuf.size);
+            if (bytes == 0) {
+                break; // Wait for more data.
             }
-            return;
-        }
 
-        return;
+            usbdbg_data_out(sockbuf.buf + sockbuf.idx, bytes);
+            xfer_length -= bytes;
+            sockbuf.idx += bytes;
+            sockbuf.size -= bytes;
+        }
     }
 
-    if ((ret = winc_socket_recv(client_fd, buf, 6, &sockbuf, 10)) < 0) {
-        if (TIMEDOUT(ret)) {
-            return;
-        } else {
-            close_all_sockets();
-            return;
+    // All received data has been consumed, queue the next receive.
+    if (sockbuf.size == 0 && !recv_pending) {
+        recv_pending = true;
+        if (WINC1500_EXPORT(recv)(client_fd, sockbuf.buf, WINC_SOCKBUF_MAX_SIZE, 0) != SOCK_ERR_NO_ERROR) {
+            return false;
         }
     }
 
-    if (ret != 6 || buf[0] != 0x30) {
-        return;
-    }
+    return true;
+}
 
-    uint8_t request = buf[1];
-    uint32_t xfer_length = *((uint32_t*)(buf+2));
-    usbdbg_control(buf+6, request, xfer_length);
+void wifidbg_dispatch()
+{
+    // Deliver pending socket events, this never waits.
+    winc_socket_poll();
 
-    while (xfer_length) {
-        if (request & 0x80) {
-            // Device-to-host data phase
-            int bytes = MIN(xfer_length, BUFFER_SIZE);
-            xfer_length -= bytes;
-            usbdbg_data_in(buf, bytes);
-            if ((ret = winc_socket_send(client_fd, buf, bytes, 500)) < 0) {
+    switch (state) {
+        case WIFIDBG_STATE_CLOSED:
+            wifidbg_open_sockets();
+            break;
+
+        case WIFIDBG_STATE_BOUND:
+            state = WIFIDBG_STATE_LISTEN;
+            if (WINC1500_EXPORT(listen)(server_fd, 1) != SOCK_ERR_NO_ERROR) {
                 close_all_sockets();
-                return;
             }
-        } else {
-            // Host-to-device data phase
-            int bytes = MIN(xfer_length, BUFFER_SIZE);
-            if ((ret = winc_socket_recv(client_fd, buf, bytes, &sockbuf, 500)) < 0) {
-                close_all_sockets();
-                return;
+            break;
+
+        case WIFIDBG_STATE_ACCEPT:
+            wifidbg_broadcast();
+            break;
+
+        case WIFIDBG_STATE_CONNECTED:
+            if (client_closed || !wifidbg_client_dispatch()) {
+                close_client_socket();
+                state = WIFIDBG_STATE_ACCEPT;
             }
-            xfer_length -= ret;
-            usbdbg_data_out(buf, ret);
-        }
+            break;
+
+        case WIFIDBG_STATE_ERROR:
+            close_all_sockets();
+            break;
+
+        default:
+            break;
     }
 }
 #else
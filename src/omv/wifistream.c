@@ -0,0 +1,392 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * WiFi MJPEG stream server.
+ *
+ * Serves the JPEG frame buffer (the IDE preview) as an HTTP multipart stream. A frame is
+ * locked and sent to all the clients waiting for one, while it's locked the camera keeps
+ * capturing and simply doesn't update the JPEG frame buffer, so slow clients skip frames.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mp.h"
+#include "framebuffer.h"
+#include "wifistream.h"
+#include "omv_boardconfig.h"
+
+#include STM32_HAL_H
+
+#if MICROPY_PY_WINC1500
+#include "winc.h"
+#include "socket/include/socket.h"
+
+#ifndef MIN
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+#endif
+
+#define WIFISTREAM_MAX_CLIENTS      (4)     // TCP_SOCK_MAX is 7, leave some for wifidbg and scripts.
+#define WIFISTREAM_CLIENT_TIMEOUT   (1000)  // ms, clients that don't make any progress are dropped.
+#define WIFISTREAM_BOUNDARY         "openmvframe"
+
+static const char http_response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: OpenMV\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" WIFISTREAM_BOUNDARY "\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n\r\n";
+
+static const char part_trailer[] = "\r\n";
+
+// Each frame is sent as the part header, the JPEG image and the part trailer,
+// the HTTP response is sent before the first frame.
+typedef enum {
+    WIFISTREAM_SEG_RESPONSE,
+    WIFISTREAM_SEG_HEADER,
+    WIFISTREAM_SEG_FRAME,
+    WIFISTREAM_SEG_TRAILER,
+    WIFISTREAM_SEG_DONE,
+} wifistream_seg_t;
+
+typedef enum {
+    WIFISTREAM_CLIENT_FREE,     // Slot not used.
+    WIFISTREAM_CLIENT_REQUEST,  // Waiting for the HTTP request.
+    WIFISTREAM_CLIENT_READY,    // Waiting for the next frame.
+    WIFISTREAM_CLIENT_SENDING,  // Sending the locked frame.
+} wifistream_client_state_t;
+
+typedef struct {
+    volatile wifistream_client_state_t state;
+    volatile bool closed;
+    volatile bool recv_pending;
+    bool started;
+    int fd;
+    wifistream_seg_t seg;
+    uint32_t seg_idx;
+    uint32_t ticks;
+} wifistream_client_t;
+
+static int server_fd = -1;
+static int fb_enabled = 0;
+static wifistream_client_t clients[WIFISTREAM_MAX_CLIENTS];
+
+// The frame being sent, it's held until all clients are done with it.
+static jpegbuffer_frame_t *frame = NULL;
+static uint32_t frame_size = 0;
+static char part_header[96];
+static int part_header_size = 0;
+
+// The HTTP requests (and anything else the clients send) are received here and ignored.
+static uint8_t recv_buf[64];
+
+static void close_client(wifistream_client_t *client)
+{
+    if (client->state != WIFISTREAM_CLIENT_FREE) {
+        winc_socket_close(client->fd);
+    }
+
+    client->state = WIFISTREAM_CLIENT_FREE;
+    client->closed = false;
+    client->recv_pending = false;
+    client->fd = -1;
+}
+
+static wifistream_client_t *find_client(int fd)
+{
+    for (int i=0; i<WIFISTREAM_MAX_CLIENTS; i++) {
+        if (clients[i].state != WIFISTREAM_CLIENT_FREE && clients[i].fd == fd) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+static void wifistream_socket_callback(int fd, uint8_t msg_type, void *msg)
+{
+    switch (msg_type) {
+        case SOCKET_MSG_ACCEPT: {
+            int sock = ((tstrSocketAcceptMsg *) msg)->sock;
+            if (fd != server_fd || sock < 0) {
+                break;
+            }
+
+            wifistream_client_t *client = NULL;
+            for (int i=0; i<WIFISTREAM_MAX_CLIENTS && client == NULL; i++) {
+                if (clients[i].state == WIFISTREAM_CLIENT_FREE) {
+                    client = &clients[i];
+                }
+            }
+
+            if (client == NULL) {
+                // Too many clients.
+                winc_socket_close(sock);
+                break;
+            }
+
+            client->fd = sock;
+            client->closed = false;
+            client->recv_pending = false;
+            client->started = false;
+            client->ticks = HAL_GetTick();
+            client->state = WIFISTREAM_CLIENT_REQUEST;
+            winc_socket_set_callback(sock, wifistream_socket_callback);
+            break;
+        }
+
+        case SOCKET_MSG_RECV: {
+            wifistream_client_t *client = find_client(fd);
+            if (client != NULL) {
+                tstrSocketRecvMsg *recv_msg = (tstrSocketRecvMsg *) msg;
+                if (recv_msg->s16BufferSize <= 0) {
+                    client->closed = true;
+                } else if (client->state == WIFISTREAM_CLIENT_REQUEST) {
+                    // Any request gets the stream.
+                    client->state = WIFISTREAM_CLIENT_READY;
+                }
+                if (recv_msg->u16RemainingSize == 0) {
+                    client->recv_pending = false;
+                }
+            }
+            break;
+        }
+
+        case SOCKET_MSG_SEND: {
+            // The WINC closes the socket on send errors.
+            wifistream_client_t *client = find_client(fd);
+            if (client != NULL && (*((int16_t *) msg)) < 0) {
+                client->closed = true;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// Returns the rest of the client's current segment.
+static const uint8_t *client_segment(wifistream_client_t *client, uint32_t *size)
+{
+    const uint8_t *buf;
+
+    switch (client->seg) {
+        case WIFISTREAM_SEG_RESPONSE:
+            buf = (const uint8_t *) http_response;
+            *size = sizeof(http_response) - 1;
+            break;
+        case WIFISTREAM_SEG_HEADER:
+            buf = (const uint8_t *) part_header;
+            *size = part_header_size;
+            break;
+        case WIFISTREAM_SEG_FRAME:
+            buf = frame->pixels;
+            *size = frame_size;
+            break;
+        case WIFISTREAM_SEG_TRAILER:
+            buf = (const uint8_t *) part_trailer;
+            *size = sizeof(part_trailer) - 1;
+            break;
+        default:
+            *size = 0;
+            return NULL;
+    }
+
+    *size -= client->seg_idx;
+    return buf + client->seg_idx;
+}
+
+// Sends the next chunk of the frame, returns true if any data was sent.
+static bool client_send(wifistream_client_t *client)
+{
+    uint32_t size;
+    const uint8_t *buf;
+
+    while ((buf = client_segment(client, &size)) != NULL && size == 0) {
+        client->seg++;
+        client->seg_idx = 0;
+    }
+
+    if (buf == NULL) {
+        client->started = true;
+        client->state = WIFISTREAM_CLIENT_READY;
+        return false;
+    }
+
+    size = MIN(size, SOCKET_BUFFER_MAX_LENGTH);
+    int ret = WINC1500_EXPORT(send)(client->fd, (void *) buf, size, 0);
+    if (ret == SOCK_ERR_BUFFER_FULL) {
+        return false; // Retry on the next poll.
+    } else if (ret != SOCK_ERR_NO_ERROR) {
+        client->closed = true;
+        return false;
+    }
+
+    client->seg_idx += size;
+    client->ticks = HAL_GetTick();
+    return true;
+}
+
+static void end_frame()
+{
+    fb_release_jpeg_frame(JPEG_FB_READER_NET);
+    frame = NULL;
+}
+
+// Takes the next JPEG frame and starts sending it to the clients waiting for a frame.
+static void start_frame()
+{
+    bool ready = false;
+    for (int i=0; i<WIFISTREAM_MAX_CLIENTS; i++) {
+        ready |= (clients[i].state == WIFISTREAM_CLIENT_READY);
+    }
+
+    if (!ready || !(frame = fb_acquire_jpeg_frame(JPEG_FB_READER_NET))) {
+        return;
+    }
+
+    // Raw (lossless) IDE frames are not JPEG images.
+    if (frame->bpp != 0) {
+        end_frame();
+        return;
+    }
+
+    frame_size = frame->size;
+    part_header_size = snprintf(part_header, sizeof(part_header),
+            "--" WIFISTREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\n\r\n",
+            (unsigned long) frame_size);
+
+    for (int i=0; i<WIFISTREAM_MAX_CLIENTS; i++) {
+        wifistream_client_t *client = &clients[i];
+        if (client->state == WIFISTREAM_CLIENT_READY) {
+            client->seg = client->started ? WIFISTREAM_SEG_HEADER : WIFISTREAM_SEG_RESPONSE;
+            client->seg_idx = 0;
+            client->ticks = HAL_GetTick();
+            client->state = WIFISTREAM_CLIENT_SENDING;
+        }
+    }
+}
+
+void wifistream_init0()
+{
+    // The JPEG frame buffer (and the held frames) is reset by sensor_init0().
+    frame = NULL;
+    wifistream_stop();
+}
+
+int wifistream_start(int port)
+{
+    int ret;
+    uint8_t ip_addr[WINC_IPV4_ADDR_LEN] = {0, 0, 0, 0};
+    MAKE_SOCKADDR(server_sockaddr, ip_addr, port)
+
+    wifistream_stop();
+
+    if ((server_fd = winc_socket_socket(SOCK_STREAM)) < 0) {
+        ret = server_fd;
+        server_fd = -1;
+        return ret;
+    }
+
+    if ((ret = winc_socket_bind(server_fd, &server_sockaddr)) != 0 ||
+            (ret = winc_socket_listen(server_fd, WIFISTREAM_MAX_CLIENTS)) != 0) {
+        winc_socket_close(server_fd);
+        server_fd = -1;
+        return ret;
+    }
+
+    // The clients are accepted from the socket callback from now on.
+    winc_socket_set_callback(server_fd, wifistream_socket_callback);
+
+    // Make the camera update the JPEG frame buffer.
+    fb_enabled = JPEG_FB()->enabled;
+    JPEG_FB()->enabled = 1;
+    return 0;
+}
+
+void wifistream_stop()
+{
+    if (server_fd < 0) {
+        return;
+    }
+
+    for (int i=0; i<WIFISTREAM_MAX_CLIENTS; i++) {
+        close_client(&clients[i]);
+    }
+
+    winc_socket_close(server_fd);
+    server_fd = -1;
+
+    if (frame) {
+        end_frame();
+    }
+
+    JPEG_FB()->enabled = fb_enabled;
+}
+
+int wifistream_clients()
+{
+    int n = 0;
+    for (int i=0; i<WIFISTREAM_MAX_CLIENTS; i++) {
+        n += (clients[i].state != WIFISTREAM_CLIENT_FREE);
+    }
+    return n;
+}
+
+bool wifistream_poll()
+{
+    if (server_fd < 0) {
+        return false;
+    }
+
+    // Deliver pending socket events, this never waits.
+    winc_socket_poll();
+
+    if (!frame) {
+        start_frame();
+    }
+
+    bool busy = false;
+    bool sending = false;
+    for (int i=0; i<WIFISTREAM_MAX_CLIENTS; i++) {
+        wifistream_client_t *client = &clients[i];
+
+        if (client->state == WIFISTREAM_CLIENT_SENDING) {
+            busy |= client_send(client);
+            if ((HAL_GetTick() - client->ticks) >= WIFISTREAM_CLIENT_TIMEOUT) {
+                client->closed = true;
+            }
+        }
+
+        if (client->state != WIFISTREAM_CLIENT_FREE && !client->closed && !client->recv_pending) {
+            client->recv_pending = true;
+            if (WINC1500_EXPORT(recv)(client->fd, recv_buf, sizeof(recv_buf), 0) != SOCK_ERR_NO_ERROR) {
+                client->closed = true;
+            }
+        }
+
+        if (client->closed) {
+            close_client(client);
+        }
+
+        sending |= (client->state == WIFISTREAM_CLIENT_SENDING);
+    }
+
+    if (frame && !sending) {
+        end_frame();
+    }
+
+    return busy;
+}
+#else
+void wifistream_init0() {}
+int wifistream_start(int port) { return -1; }
+void wifistream_stop() {}
+int wifistream_clients() { return 0; }
+bool wifistream_poll() { return false; }
+#endif // MICROPY_PY_WINC1500
@@ -0,0 +1,23 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * WiFi MJPEG stream server.
+ */
+#ifndef __WIFISTREAM_H__
+#define __WIFISTREAM_H__
+#include <stdbool.h>
+
+#define WIFISTREAM_DEFAULT_PORT     (8080)
+
+void wifistream_init0();
+int wifistream_start(int port); // returns 0 or a WINC error
+void wifistream_stop();
+int wifistream_clients(); // number of connected clients
+bool wifistream_poll(); // sends at most one chunk per client, returns false if idle
+
+#endif /* __WIFISTREAM_H__ */
@@ -7,8 +7,20 @@
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
  * Memory allocation functions.
+ *
+ * Boards with a large heap (OMV_XALLOC_LARGE_MEMORY) put the xalloc_data() blocks of
+ * OMV_XALLOC_LARGE_THRESHOLD bytes or more there, so big buffers don't fragment the GC heap and
+ * aren't scanned by the GC. The large heap is a list of blocks in address order, each one starting
+ * with its header. Its blocks hold no pointers and are freed by xfree() or, after a collection, if
+ * no pointer to them is left on the stack, in the MicroPython state or in the GC heap.
+ *
+ * The sweep runs from __wrap_gc_collect() (see gc_stats.c), so only collections that go through
+ * the linker wrap free large blocks. A collection started from inside py/gc.c doesn't, and the
+ * unreferenced large blocks just stay allocated until the next wrapped collection. That is always
+ * safe, and xalloc_data() runs a wrapped collection itself before it gives up on the large heap.
  */
 #include <mp.h>
+#include "omv_boardconfig.h"
 #include "xalloc.h"
 
 NORETURN static void xalloc_fail()
@@ -17,6 +29,158 @@ NORETURN static void xalloc_fail()
         " Please reduce the resolution of the image you are running this algorithm on to bypass this issue!"));
 }
 
+#if defined(OMV_XALLOC_LARGE_MEMORY)
+#define XALLOC_LARGE_ALIGN      (32) // Cache line, the header takes one as well.
+#define XALLOC_LARGE_USED       (1 << 0)
+#define XALLOC_LARGE_MARK       (1 << 1)
+
+typedef struct xalloc_large_block {
+    uint32_t size; // Including the header.
+    uint32_t flags;
+} xalloc_large_block_t;
+
+extern char _xalloc_large_start;
+extern char _xalloc_large_end;
+static xalloc_large_block_t *large_start = (xalloc_large_block_t *) &_xalloc_large_start;
+static xalloc_large_block_t *large_end = (xalloc_large_block_t *) &_xalloc_large_end;
+
+uintptr_t gc_helper_get_regs_and_sp(uintptr_t *regs);
+
+static inline xalloc_large_block_t *xalloc_large_next(xalloc_large_block_t *block)
+{
+    return (xalloc_large_block_t *) (((char *) block) + block->size);
+}
+
+static inline bool xalloc_large_contains(void *mem)
+{
+    return (((char *) large_start) < ((char *) mem)) && (((char *) mem) < ((char *) large_end));
+}
+
+static void *xalloc_large_alloc(uint32_t size)
+{
+    uint32_t need = XALLOC_LARGE_ALIGN + ((size + XALLOC_LARGE_ALIGN - 1) & ~(XALLOC_LARGE_ALIGN - 1));
+
+    for (xalloc_large_block_t *block = large_start; block < large_end; block = xalloc_large_next(block)) {
+        if (block->flags & XALLOC_LARGE_USED) {
+            continue;
+        }
+
+        // Merge the free blocks that follow.
+        for (xalloc_large_block_t *next = xalloc_large_next(block);
+             (next < large_end) && (!(next->flags & XALLOC_LARGE_USED)); next = xalloc_large_next(next)) {
+            block->size += next->size;
+        }
+
+        if (block->size >= need) {
+            if ((block->size - need) >= (XALLOC_LARGE_ALIGN * 2)) {
+                xalloc_large_block_t *rest = (xalloc_large_block_t *) (((char *) block) + need);
+                rest->size = block->size - need;
+                rest->flags = 0;
+                block->size = need;
+            }
+
+            block->flags = XALLOC_LARGE_USED;
+            return ((char *) block) + XALLOC_LARGE_ALIGN;
+        }
+    }
+
+    return NULL;
+}
+
+static void xalloc_large_free(void *mem)
+{
+    ((xalloc_large_block_t *) (((char *) mem) - XALLOC_LARGE_ALIGN))->flags = 0;
+}
+
+static void xalloc_large_mark(void **ptrs, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        char *ptr = ptrs[i];
+
+        if (xalloc_large_contains(ptr)) {
+            for (xalloc_large_block_t *block = large_start; block < large_end; block = xalloc_large_next(block)) {
+                if (ptr < ((char *) xalloc_large_next(block))) {
+                    if ((block->flags & XALLOC_LARGE_USED) && (ptr >= (((char *) block) + XALLOC_LARGE_ALIGN))) {
+                        block->flags |= XALLOC_LARGE_MARK;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void xalloc_large_collect()
+{
+    for (xalloc_large_block_t *block = large_start; block < large_end; block = xalloc_large_next(block)) {
+        block->flags &= ~XALLOC_LARGE_MARK;
+    }
+
+    uintptr_t regs[10];
+    uintptr_t sp = gc_helper_get_regs_and_sp(regs);
+    xalloc_large_mark((void **) regs, sizeof(regs) / sizeof(void *));
+    xalloc_large_mark((void **) sp, (((uintptr_t) MP_STATE_THREAD(stack_top)) - sp) / sizeof(void *));
+    xalloc_large_mark((void **) &mp_state_ctx, sizeof(mp_state_ctx) / sizeof(void *));
+
+    // The allocated (head and tail) blocks of the GC heap, there are 4 2-bit entries per byte of
+    // the allocation table and 0 is a free block.
+    for (size_t i = 0, j = MP_STATE_MEM(gc_alloc_table_byte_len) * 4; i < j; i++) {
+        if ((MP_STATE_MEM(gc_alloc_table_start)[i / 4] >> ((i % 4) * 2)) & 3) {
+            xalloc_large_mark((void **) (MP_STATE_MEM(gc_pool_start) + (i * MICROPY_BYTES_PER_GC_BLOCK)),
+                              MICROPY_BYTES_PER_GC_BLOCK / sizeof(void *));
+        }
+    }
+
+    for (xalloc_large_block_t *block = large_start; block < large_end; block = xalloc_large_next(block)) {
+        if ((block->flags & (XALLOC_LARGE_USED | XALLOC_LARGE_MARK)) == XALLOC_LARGE_USED) {
+            block->flags = 0;
+        }
+    }
+}
+
+#else
+
+void xalloc_large_collect()
+{
+}
+
+#endif // OMV_XALLOC_LARGE_MEMORY
+
+void xalloc_large_info(uint32_t *total, uint32_t *free, uint32_t *max_free)
+{
+    #if defined(OMV_XALLOC_LARGE_MEMORY)
+    *total = ((char *) large_end) - ((char *) large_start);
+    *free = 0;
+    *max_free = 0;
+
+    for (xalloc_large_block_t *block = large_start; block < large_end; ) {
+        uint32_t size = 0;
+        for (; (block < large_end) && (!(block->flags & XALLOC_LARGE_USED)); block = xalloc_large_next(block)) {
+            size += block->size;
+        }
+        *free += size;
+        if (size > *max_free) {
+            *max_free = size;
+        }
+        if (block < large_end) {
+            block = xalloc_large_next(block);
+        }
+    }
+    #else
+    *total = 0;
+    *free = 0;
+    *max_free = 0;
+    #endif
+}
+
+void xalloc_init0()
+{
+    #if defined(OMV_XALLOC_LARGE_MEMORY)
+    large_start->size = ((char *) large_end) - ((char *) large_start);
+    large_start->flags = 0;
+    #endif
+}
+
 // returns null pointer without error if size==0
 void *xalloc(uint32_t size)
 {
@@ -44,9 +208,42 @@ void *xalloc0(uint32_t size)
     return mem;
 }
 
+// returns null pointer without error if size==0
+void *xalloc_data(uint32_t size)
+{
+    #if defined(OMV_XALLOC_LARGE_MEMORY)
+    if (size >= OMV_XALLOC_LARGE_THRESHOLD) {
+        void *mem = xalloc_large_alloc(size);
+        if (mem == NULL) {
+            // Frees the large blocks that are no longer referenced.
+            gc_collect();
+            mem = xalloc_large_alloc(size);
+        }
+        if (mem != NULL) {
+            return mem;
+        }
+    }
+    #endif
+    return xalloc(size);
+}
+
+// returns null pointer without error if size==0
+void *xalloc0_data(uint32_t size)
+{
+    void *mem = xalloc_data(size);
+    memset(mem, 0, size);
+    return mem;
+}
+
 // returns without error if mem==null
 void xfree(void *mem)
 {
+    #if defined(OMV_XALLOC_LARGE_MEMORY)
+    if (xalloc_large_contains(mem)) {
+        xalloc_large_free(mem);
+        return;
+    }
+    #endif
     gc_free(mem);
 }
 
@@ -55,6 +252,15 @@ void xfree(void *mem)
 // frees if mem!=null and size==0
 void *xrealloc(void *mem, uint32_t size)
 {
+    #if defined(OMV_XALLOC_LARGE_MEMORY)
+    if (xalloc_large_contains(mem)) {
+        xalloc_large_block_t *block = (xalloc_large_block_t *) (((char *) mem) - XALLOC_LARGE_ALIGN);
+        void *new_mem = size ? xalloc_data(size) : NULL;
+        memcpy(new_mem, mem, (size < (block->size - XALLOC_LARGE_ALIGN)) ? size : (block->size - XALLOC_LARGE_ALIGN));
+        xalloc_large_free(mem);
+        return new_mem;
+    }
+    #endif
     mem = gc_realloc(mem, size, true);
     if (size && (mem == NULL)) {
         xalloc_fail();
@@ -16,4 +16,10 @@ void *xalloc_try_alloc(uint32_t size);
 void *xalloc0(uint32_t size);
 void xfree(void *mem);
 void *xrealloc(void *mem, uint32_t size);
+// Pixel and other buffers that never hold pointers to GC objects, these may be put in the large heap.
+void *xalloc_data(uint32_t size);
+void *xalloc0_data(uint32_t size);
+void xalloc_init0();
+void xalloc_large_collect();
+void xalloc_large_info(uint32_t *total, uint32_t *free, uint32_t *max_free);
 #endif // __XALLOC_H__
@@ -9,7 +9,10 @@
 
 /* System headers */
 #include "nn_st.h"
+#include "nn_backend.h"
 #include "ai_platform_interface.h"
+#include "omv_boardconfig.h"
+#include "xalloc.h"
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,9 +31,31 @@ static void crc_init(void) {
   HAL_CRC_Init(&hcrc);
 }
 
-AI_ALIGNED(4)
-static ai_float out_data[AI_NETWORK_OUT_1_SIZE];
-ai_network_exec_ctx network_handle;
+#define AI_NETWORK_PARAMS(name, NAME)                                         \
+  static ai_network_params ai_##name##_make_params(ai_handle activations) {   \
+    const ai_network_params params = {                                        \
+        AI_##NAME##_DATA_WEIGHTS(ai_##name##_data_weights_get()),             \
+        AI_##NAME##_DATA_ACTIVATIONS(activations)};                           \
+    return params;                                                            \
+  }
+AI_NETWORKS(AI_NETWORK_PARAMS)
+
+#define AI_NETWORK_ENTRY(name, NAME)                                          \
+  {AI_##NAME##_MODEL_NAME,     ai_##name##_create,                            \
+   ai_##name##_destroy,        ai_##name##_get_info,                          \
+   ai_##name##_get_error,      ai_##name##_init,                              \
+   ai_##name##_run,            ai_##name##_make_params,                       \
+   AI_##NAME##_DATA_ACTIVATIONS_SIZE, AI_##NAME##_IN_1_SIZE_BYTES},
+
+static const ai_network_entry ai_networks[] = {AI_NETWORKS(AI_NETWORK_ENTRY)};
+#define AI_NETWORKS_COUNT (sizeof(ai_networks) / sizeof(ai_networks[0]))
+
+static ai_network_exec_ctx network_handles[AI_NETWORKS_COUNT];
+
+#if defined(OMV_CUBEAI_MEMORY)
+/* Each network has a fixed slice of the region, in the order of AI_NETWORKS */
+extern char _cubeai_buf, _cubeai_buf_end;
+#endif
 
 #define AI_BUFFER_NULL(ptr_)                                                   \
   AI_BUFFER_OBJ_INIT(AI_BUFFER_FORMAT_NONE | AI_BUFFER_FMT_FLAG_CONST, 0, 0,   \
@@ -122,33 +147,40 @@ void aiLogErr(const ai_error err, const char *fct) {
 /**
  * @brief Intitialization code for the network
  *
- * @param nn_name the name of the network
+ * @param ctx the context of the network to create
  * @return int error code, 0 if it's ok, anything else is error
  */
-static int aiBootstrap(const char *nn_name) {
+static int aiBootstrap(ai_network_exec_ctx *ctx) {
   crc_init();
   ai_error err;
 
+  // The runtime has a single instance of each network, reuse it
+  if (ctx->network != AI_HANDLE_NULL) {
+    ctx->bound = AI_HANDLE_NULL;
+    return 0;
+  }
+
   // Creating the network
-  printf("Creating the network \"%s\"..\r\n", nn_name);
-  err = ai_network_create(&network_handle.network, NULL);
+  printf("Creating the network \"%s\"..\r\n", ctx->entry->name);
+  err = ctx->entry->create(&ctx->network, NULL);
   if (err.type) {
     aiLogErr(err, "ai_network_create");
+    ctx->network = AI_HANDLE_NULL;
     return -1;
   }
 
   // Query the created network to get relevant info from it
-  if (ai_network_get_info(network_handle.network, &network_handle.report)) {
-    aiPrintNetworkInfo(&network_handle.report);
+  if (ctx->entry->get_info(ctx->network, &ctx->report)) {
+    aiPrintNetworkInfo(&ctx->report);
   } else {
-    err = ai_network_get_error(network_handle.network);
+    err = ctx->entry->get_error(ctx->network);
     aiLogErr(err, "ai_network_get_info");
-    ai_network_destroy(network_handle.network);
-    network_handle.network = AI_HANDLE_NULL;
+    ctx->entry->destroy(ctx->network);
+    ctx->network = AI_HANDLE_NULL;
     return -2;
   }
-  // Initialize the instance
-  printf("Initializing the network\r\n");
+
+  ctx->bound = AI_HANDLE_NULL;
   return 0;
 }
 
@@ -161,93 +193,245 @@ ai_bool ai_mnetwork_is_valid(const char *network_name, const char *name) {
   return false;
 }
 
+/**
+ * @brief Places the resident buffers of a network
+ *
+ * @param net stnn_t structure
+ * @param idx index of the network in AI_NETWORKS
+ * @return int error code, 0 if it's ok, anything else is error
+ */
+static int aiPlaceBuffers(stnn_t *net, int idx) {
+  const ai_network_entry *entry = &ai_networks[idx];
+  ai_u32 size = ((entry->activations_size + 3) & ~3) + entry->in_size;
+
+  switch (net->mem) {
+  case AI_MEM_FB_ALLOC:
+    net->activations = NULL;
+    net->in_data = NULL;
+    return 0;
+  case AI_MEM_HEAP:
+    net->activations = xalloc(size);
+    break;
+  case AI_MEM_TCM: {
+#if defined(OMV_CUBEAI_MEMORY)
+    char *buf = &_cubeai_buf;
+    for (int i = 0; i < idx; i++) {
+      buf += ((ai_networks[i].activations_size + 3) & ~3) +
+             ((ai_networks[i].in_size + 3) & ~3);
+    }
+    if ((buf + size) > &_cubeai_buf_end) {
+      return -1;
+    }
+    net->activations = (ai_u8 *)buf;
+    break;
+#else
+    return -1;
+#endif
+  }
+  default:
+    return -1;
+  }
+
+  net->in_data = net->activations + ((entry->activations_size + 3) & ~3);
+  return 0;
+}
+
 /**
  * @brief Network initialziation
  *
  * @param network_name name of the network
  * @param net stnn_t structure
+ * @param mem placement of the activation and input buffers
+ * @return int error code, 0 if it's ok, anything else is error
  */
-void aiInit(const char *network_name, stnn_t *net) {
-  const char *name;
+int aiInit(const char *network_name, stnn_t *net, ai_mem_t mem) {
   printf("\r\nAI platform (API %d.%d.%d - RUNTIME %d.%d.%d)\r\n",
          AI_PLATFORM_API_MAJOR, AI_PLATFORM_API_MINOR, AI_PLATFORM_API_MICRO,
          AI_PLATFORM_RUNTIME_MAJOR, AI_PLATFORM_RUNTIME_MINOR,
          AI_PLATFORM_RUNTIME_MICRO);
 
-  // Discover and init the embedded network
-  name = (const char *)AI_NETWORK_MODEL_NAME;
-  if (ai_mnetwork_is_valid(network_name, name)) {
-    printf("\r\nFound network \"%s\"\r\n", name);
-    aiBootstrap(name);
+  memset(net, 0, sizeof(stnn_t));
+  net->mem = mem;
 
-  } else {
-    printf("\r\error network name!, please enter the right name \"%s\"\r\n",
-           name);
+  // Discover and init the embedded network
+  for (int i = 0; i < AI_NETWORKS_COUNT; i++) {
+    const char *name = (const char *)ai_networks[i].name;
+    if (ai_mnetwork_is_valid(network_name, name)) {
+      printf("\r\nFound network \"%s\"\r\n", name);
+      ai_network_exec_ctx *ctx = &network_handles[i];
+      ctx->entry = &ai_networks[i];
+
+      if (aiPlaceBuffers(net, i)) {
+        printf("\r\nerror no memory to place the network \"%s\"\r\n", name);
+        return -3;
+      }
+
+      int ret = aiBootstrap(ctx);
+      if (ret) {
+        return ret;
+      }
+
+      net->out_size = aiBufferSize(&ctx->report.outputs[0]);
+      net->out_data = xalloc(net->out_size * sizeof(ai_float));
+      net->nn_exec_ctx_ptr = ctx;
+      return 0;
+    }
   }
-  net->nn_exec_ctx_ptr = &network_handle;
+
+  printf("\r\nerror network name!, please enter the right name \"%s\"\r\n",
+         network_name);
+  return -4;
 }
 
 /**
- * @brief Runs the inference of the network. Calls preprocessing function on the
- * img before running the inference
+ * @brief Runs the inference of the network on already transformed input data
  *
  * @param net Python object
- * @param img input image
- * @param roi region of interest
+ * @param activations activations buffer
+ * @param in_data input buffer
  * @return int error code
  */
-int aiRun(stnn_t *net, image_t *img, rectangle_t *roi) {
+static int aiRunData(stnn_t *net, ai_u8 *activations, ai_u8 *in_data) {
+  ai_network_exec_ctx *ctx = net->nn_exec_ctx_ptr;
   ai_i32 nbatch;
   ai_error err;
 
-  fb_alloc_mark();
-  AI_ALIGNED(4)
-  ai_u8 *activations = fb_alloc(AI_NETWORK_DATA_ACTIVATIONS_SIZE, FB_ALLOC_NO_HINT);
-  AI_ALIGNED(4)
-  ai_u8 *in_data = fb_alloc(AI_NETWORK_IN_1_SIZE_BYTES, FB_ALLOC_NO_HINT);
-
-  // build params structure to provide the reference of the
-  // activation and weight buffers
-  const ai_network_params params = {
-      AI_NETWORK_DATA_WEIGHTS(ai_network_data_weights_get()),
-      AI_NETWORK_DATA_ACTIVATIONS(activations)};
-
-  if (!ai_network_init(net->nn_exec_ctx_ptr->network, &params)) {
-    err = ai_network_get_error(net->nn_exec_ctx_ptr->network);
-    aiLogErr(err, "ai_network_init");
-    ai_network_destroy(net->nn_exec_ctx_ptr->network);
-    net->nn_exec_ctx_ptr->network = AI_HANDLE_NULL;
+  if (ctx->network == AI_HANDLE_NULL) {
+    return -3;
   }
 
-  ai_transform_input(net->nn_exec_ctx_ptr->report.inputs, img, in_data, roi);
+  // Only re-initialize when the network was bound to other activations
+  // (another instance or another fb_alloc'd buffer)
+  if (ctx->bound != activations) {
+    const ai_network_params params = ctx->entry->params(activations);
+
+    if (!ctx->entry->init(ctx->network, &params)) {
+      err = ctx->entry->get_error(ctx->network);
+      aiLogErr(err, "ai_network_init");
+      ctx->bound = AI_HANDLE_NULL;
+      return -1;
+    }
+    ctx->bound = activations;
+  }
 
   /* Create the AI buffer IO handlers */
   ai_buffer ai_input[1];
   ai_buffer ai_output[1];
 
-  ai_input[0] = net->nn_exec_ctx_ptr->report.inputs[0];
-  ai_output[0] = net->nn_exec_ctx_ptr->report.outputs[0];
+  ai_input[0] = ctx->report.inputs[0];
+  ai_output[0] = ctx->report.outputs[0];
 
   /* Initialize input/output buffer handlers */
   ai_input[0].n_batches = 1;
   ai_input[0].data = AI_HANDLE_PTR(in_data);
 
   ai_output[0].n_batches = 1;
-  ai_output[0].data = AI_HANDLE_PTR(out_data);
+  ai_output[0].data = AI_HANDLE_PTR(net->out_data);
 
   /* Perform the inference */
-  nbatch = ai_network_run(net->nn_exec_ctx_ptr->network, &ai_input[0],
-                          &ai_output[0]);
+  nbatch = ctx->entry->run(ctx->network, &ai_input[0], &ai_output[0]);
   if (nbatch != 1) {
-    err = ai_network_get_error(net->nn_exec_ctx_ptr->network);
+    err = ctx->entry->get_error(ctx->network);
     printf("AI error (ai_network_run) code= %d\n", err.code);
+    return -2;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Runs the inference of the network. Calls preprocessing function on the
+ * img before running the inference
+ *
+ * @param net Python object
+ * @param img input image
+ * @param roi region of interest
+ * @return int error code
+ */
+int aiRun(stnn_t *net, image_t *img, rectangle_t *roi) {
+  ai_network_exec_ctx *ctx = net->nn_exec_ctx_ptr;
+  ai_u8 *activations = net->activations;
+  ai_u8 *in_data = net->in_data;
+
+  fb_alloc_mark();
+  if (net->mem == AI_MEM_FB_ALLOC) {
+    activations = fb_alloc(ctx->entry->activations_size, FB_ALLOC_NO_HINT);
+    in_data = fb_alloc(ctx->entry->in_size, FB_ALLOC_NO_HINT);
   }
 
-  net->nn_exec_ctx_ptr->report.outputs->data = out_data;
+  ai_transform_input(ctx->report.inputs, img, in_data, roi);
+  int ret = aiRunData(net, activations, in_data);
 
   fb_alloc_free_till_mark();
 
-  return 0;
+  return ret;
+}
+
+/**
+ * @brief Runs the detector network on the roi, then the classifier network on
+ * the roi of each output cell of the detector scoring above threshold
+ *
+ * The detector output is a HWC grid of scores covering the roi.
+ *
+ * @param detector detector network
+ * @param classifier classifier network
+ * @param img input image
+ * @param roi region of interest
+ * @param threshold minimum detector score
+ * @param channel detector output channel with the scores
+ * @param cb called with each detection after running the classifier
+ * @param arg passed to cb
+ * @return int error code
+ */
+int aiCascade(stnn_t *detector, stnn_t *classifier, image_t *img,
+              rectangle_t *roi, float threshold, int channel,
+              ai_cascade_cb_t cb, void *arg) {
+  int ret = aiRun(detector, img, roi);
+  if (ret) {
+    return ret;
+  }
+
+  ai_buffer *grid = &detector->nn_exec_ctx_ptr->report.outputs[0];
+  int grid_w = grid->width, grid_h = grid->height, grid_c = grid->channels;
+  if ((channel < 0) || (channel >= grid_c)) {
+    return -3;
+  }
+
+  // The classifier stays bound to the same buffers for all the detections
+  ai_network_exec_ctx *ctx = classifier->nn_exec_ctx_ptr;
+  ai_u8 *activations = classifier->activations;
+  ai_u8 *in_data = classifier->in_data;
+
+  fb_alloc_mark();
+  if (classifier->mem == AI_MEM_FB_ALLOC) {
+    activations = fb_alloc(ctx->entry->activations_size, FB_ALLOC_NO_HINT);
+    in_data = fb_alloc(ctx->entry->in_size, FB_ALLOC_NO_HINT);
+  }
+
+  for (int y = 0; (y < grid_h) && (!ret); y++) {
+    for (int x = 0; (x < grid_w) && (!ret); x++) {
+      float score = detector->out_data[(((y * grid_w) + x) * grid_c) + channel];
+      if (score < threshold) {
+        continue;
+      }
+
+      rectangle_t cell;
+      cell.x = roi->x + ((x * roi->w) / grid_w);
+      cell.y = roi->y + ((y * roi->h) / grid_h);
+      cell.w = IM_MAX(roi->x + (((x + 1) * roi->w) / grid_w) - cell.x, 1);
+      cell.h = IM_MAX(roi->y + (((y + 1) * roi->h) / grid_h) - cell.y, 1);
+
+      ai_transform_input(ctx->report.inputs, img, in_data, &cell);
+      ret = aiRunData(classifier, activations, in_data);
+      if (!ret) {
+        cb(arg, &cell, score, classifier);
+      }
+    }
+  }
+
+  fb_alloc_free_till_mark();
+
+  return ret;
 }
 
 /**
@@ -262,68 +446,67 @@ int aiRun(stnn_t *net, image_t *img, rectangle_t *roi) {
 void ai_transform_input(ai_buffer *input_net, image_t *img, ai_u8 *input_data,
                         rectangle_t *roi) {
 
-  // Example for MNIST CNN
-  // Cast to float pointer
-  ai_float *_input_data = (ai_float *)input_data;
-  int x_ratio = (int)((roi->w << 16) / input_net->width) + 1;
-  int y_ratio = (int)((roi->h << 16) / input_net->height) + 1;
-
-  for (int y = 0, i = 0; y < input_net->height; y++) {
-    int sy = (y * y_ratio) >> 16;
-    for (int x = 0; x < input_net->width; x++, i++) {
-      int sx = (x * x_ratio) >> 16;
-      uint8_t p = IM_GET_GS_PIXEL(img, sx + roi->x, sy + roi->y);
-      _input_data[i] = (float)(p / 255.0f);
-    }
-  }
+  // Example for MNIST CNN, the pixels are scaled from [0,255] to [0,1]. A
+  // quantized model takes NN_INPUT_UINT8 or NN_INPUT_INT8 inputs instead.
+  nn_input_t input = {.w = input_net->width,
+                      .h = input_net->height,
+                      .c = input_net->channels,
+                      .type = NN_INPUT_FLOAT,
+                      .scale = 1.0f / 255.0f};
 
-  ///////////////////////////////////////////////////////////////////////////
-  // Below is an example code for a quantized model expecting a RGB565 image
-
-  /*
-// Scale, convert and normalize input image.
-int q_input_shift = 1;
-int x_ratio = (int)((roi->w << 16) / input_net->width) + 1;
-int y_ratio = (int)((roi->h << 16) / input_net->height) + 1;
-
-if ((img->bpp == 2) && (input_net->channels == 3)) {
-
-for (int y = 0, i = 0; y < input_net->height; y++) {
-int sy = (y * y_ratio) >> 16;
-for (int x = 0; x < input_net->width; x++, i += 3) {
-  int sx = (x * x_ratio) >> 16;
-  uint16_t p = IM_GET_RGB565_PIXEL(img, sx + roi->x, sy + roi->y);
-  input_data[i + 0] =
-      (ai_u8)__USAT((COLOR_RGB565_TO_R8(p) + (1 << q_input_shift)) >>
-                        (q_input_shift + 1),
-                    8);
-  input_data[i + 1] =
-      (ai_u8)__USAT((COLOR_RGB565_TO_G8(p) + (1 << q_input_shift)) >>
-                        (q_input_shift + 1),
-                    8);
-  input_data[i + 2] =
-      (ai_u8)__USAT((COLOR_RGB565_TO_B8(p) + (1 << q_input_shift)) >>
-                        (q_input_shift + 1),
-                    8);
-}
-}
+  nn_input_prepare(&input, img, roi, input_data, 0, input.h);
 }
-  */
+
+/**
+ * @brief Runs a stnn_t network for the common inference backend interface
+ */
+static int aiBackendRun(void *model, image_t *img, rectangle_t *roi,
+                        nn_output_cb_t cb, void *arg) {
+  stnn_t *net = (stnn_t *)model;
+  int ret = aiRun(net, img, roi);
+
+  if (!ret) {
+    ai_buffer *out = &net->nn_exec_ctx_ptr->report.outputs[0];
+    nn_output_t output = {.data = net->out_data,
+                          .w = out->width,
+                          .h = out->height,
+                          .c = out->channels,
+                          .is_float = true,
+                          .is_signed = false};
+    cb(arg, roi, &output);
+  }
+
+  return ret;
 }
 
+const nn_backend_t nn_backend_st = {"Cube.AI", 0, aiBackendRun};
+
 /**
  * @brief Free network memory
  *
+ * @param net stnn_t structure
  */
-void aiDeInit(void) {
+void aiDeInit(stnn_t *net) {
+  ai_network_exec_ctx *ctx = net->nn_exec_ctx_ptr;
   ai_error err;
 
-  printf("Releasing the network(s)...\r\n");
+  printf("Releasing the network...\r\n");
 
-  if (network_handle.network != AI_HANDLE_NULL) {
-    if (ai_network_destroy(network_handle.network) != AI_HANDLE_NULL) {
-      err = ai_network_get_error(network_handle.network);
+  if (ctx && (ctx->network != AI_HANDLE_NULL)) {
+    if (ctx->entry->destroy(ctx->network) != AI_HANDLE_NULL) {
+      err = ctx->entry->get_error(ctx->network);
       aiLogErr(err, "ai_network_destroy");
     }
+    ctx->network = AI_HANDLE_NULL;
+    ctx->bound = AI_HANDLE_NULL;
+  }
+
+  if (net->mem == AI_MEM_HEAP) {
+    xfree(net->activations);
   }
+  if (net->out_data) {
+    xfree(net->out_data);
+  }
+
+  memset(net, 0, sizeof(stnn_t));
 }
@@ -17,31 +17,75 @@
 #include "ai_datatypes_defines.h"
 #include "ai_platform.h"
 #include "core_datatypes.h" /* AI_PLATFORM_RUNTIME_xxx definition */
+
+/* Networks linked into the firmware. Each network is generated into data/ with
+ * "stm32ai generate --name <name>", several networks are listed (with their
+ * headers) in data/ai_networks.h as AI_NETWORKS(X) X(name, NAME) entries. */
+#if defined(__has_include) && __has_include("ai_networks.h")
+#include "ai_networks.h"
+#else
 #include "network.h"
 #include "network_data.h"
+#define AI_NETWORKS(X) X(network, NETWORK)
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Where the activation (and input) buffers of a network are placed */
+typedef enum {
+  AI_MEM_FB_ALLOC, /* fb_alloc'd for each run */
+  AI_MEM_HEAP,     /* resident in the heap */
+  AI_MEM_TCM,      /* resident in the OMV_CUBEAI_MEMORY region */
+} ai_mem_t;
+
 typedef struct {
+  const char *name;
+  ai_error (*create)(ai_handle *network, const ai_buffer *network_config);
+  ai_handle (*destroy)(ai_handle network);
+  ai_bool (*get_info)(ai_handle network, ai_network_report *report);
+  ai_error (*get_error)(ai_handle network);
+  ai_bool (*init)(ai_handle network, const ai_network_params *params);
+  ai_i32 (*run)(ai_handle network, const ai_buffer *input, ai_buffer *output);
+  ai_network_params (*params)(ai_handle activations);
+  ai_u32 activations_size;
+  ai_u32 in_size;
+} ai_network_entry;
+
+/* One context per generated network (the runtime has a single instance of each) */
+typedef struct {
+  const ai_network_entry *entry;
   ai_handle network;
   ai_network_report report;
+  ai_handle bound; /* activations the network was initialized with */
 } ai_network_exec_ctx;
 
 typedef struct {
   ai_network_exec_ctx *nn_exec_ctx_ptr;
+  ai_mem_t mem;
+  ai_u8 *activations; /* NULL with AI_MEM_FB_ALLOC */
+  ai_u8 *in_data;     /* NULL with AI_MEM_FB_ALLOC */
+  ai_float *out_data;
+  ai_u32 out_size;
 } stnn_t;
 
+/* Called by aiCascade() for each detection with the classifier output */
+typedef void (*ai_cascade_cb_t)(void *arg, rectangle_t *roi, float score,
+                                stnn_t *classifier);
+
 void aiLogErr(const ai_error err, const char *fct);
 ai_u32 aiBufferSize(const ai_buffer *buffer);
 void aiPrintNetworkInfo(const ai_network_report *report);
 
-void aiInit(const char *nn_name, stnn_t *net);
+int aiInit(const char *nn_name, stnn_t *net, ai_mem_t mem);
 int aiRun(stnn_t *net, image_t *img, rectangle_t *roi);
+int aiCascade(stnn_t *detector, stnn_t *classifier, image_t *img,
+              rectangle_t *roi, float threshold, int channel,
+              ai_cascade_cb_t cb, void *arg);
 void ai_transform_input(ai_buffer *input_net, image_t *img, ai_u8 *input_data,
                         rectangle_t *roi);
-void aiDeInit(void);
+void aiDeInit(stnn_t *net);
 
 #ifdef __cplusplus
 }
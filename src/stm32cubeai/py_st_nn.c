@@ -31,6 +31,16 @@ STATIC void py_net_print(const mp_print_t *print, mp_obj_t self_in,
   // nn_dump_network(py_st_net_cobj(self));
 }
 
+/* Returns the output of the last run of a NN as a list of floats */
+static mp_obj_t py_net_output(stnn_t *net) {
+  mp_obj_t output_list = mp_obj_new_list(0, NULL);
+
+  for (int i = 0; i < net->out_size; i++) {
+    mp_obj_list_append(output_list, mp_obj_new_float(net->out_data[i]));
+  }
+  return output_list;
+}
+
 /*Function in charge of running a NN referenced to by args[0]. Raw input data is
  * pointed to by args[1]*/
 STATIC mp_obj_t __attribute__((optimize("O0")))
@@ -41,22 +51,68 @@ py_net_predict(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
   rectangle_t roi;
   py_helper_keyword_rectangle_roi(img, n_args, args, 2, kw_args, &roi);
 
-  mp_obj_t output_list = mp_obj_new_list(0, NULL);
+  if (aiRun(net, img, &roi)) {
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError,
+                                       "Network run failed!"));
+  }
+
+  return py_net_output(net);
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_net_predict_obj, 2, py_net_predict);
 
-  aiRun(net, img, &roi);
+static void py_net_cascade_cb(void *arg, rectangle_t *roi, float score,
+                              stnn_t *classifier) {
+  mp_obj_t rect =
+      mp_obj_new_tuple(4, (mp_obj_t[]){mp_obj_new_int(roi->x),
+                                       mp_obj_new_int(roi->y),
+                                       mp_obj_new_int(roi->w),
+                                       mp_obj_new_int(roi->h)});
+  mp_obj_list_append(
+      arg, mp_obj_new_tuple(3, (mp_obj_t[]){rect, mp_obj_new_float(score),
+                                            py_net_output(classifier)}));
+}
+
+/*Runs the detector NN referenced to by args[0] on args[2], then the classifier
+ * NN args[1] on each detection. Returns a list of (rect, score, output)*/
+STATIC mp_obj_t py_net_cascade(uint n_args, const mp_obj_t *args,
+                               mp_map_t *kw_args) {
+  stnn_t *detector = py_st_net_cobj(args[0]);
+  stnn_t *classifier = py_st_net_cobj(args[1]);
+  image_t *img = py_helper_arg_to_image_mutable(args[2]);
+
+  rectangle_t roi;
+  py_helper_keyword_rectangle_roi(img, n_args, args, 3, kw_args, &roi);
+
+  float threshold = py_helper_keyword_float(
+      n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0.5f);
+  int channel = py_helper_keyword_int(n_args, args, 5, kw_args,
+                                      MP_OBJ_NEW_QSTR(MP_QSTR_channel), 0);
 
-  float *out_data = (float *)(net->nn_exec_ctx_ptr->report.outputs->data);
+  mp_obj_t detections = mp_obj_new_list(0, NULL);
 
-  for (int i = 0; i < AI_NETWORK_OUT_1_SIZE; i++) {
-    mp_obj_list_append(output_list, mp_obj_new_float(*(out_data + i)));
+  if (aiCascade(detector, classifier, img, &roi, threshold, channel,
+                py_net_cascade_cb, detections)) {
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError,
+                                       "Network run failed!"));
   }
-  return output_list;
+
+  return detections;
 }
 
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_net_predict_obj, 2, py_net_predict);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_net_cascade_obj, 3, py_net_cascade);
+
+STATIC mp_obj_t py_net_deinit(mp_obj_t self_in) {
+  aiDeInit(py_st_net_cobj(self_in));
+  return mp_const_none;
+}
+
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_net_deinit_obj, py_net_deinit);
 
 STATIC const mp_rom_map_elem_t locals_dict_table[] = {
-    {MP_ROM_QSTR(MP_QSTR_predict), MP_ROM_PTR(&py_net_predict_obj)}};
+    {MP_ROM_QSTR(MP_QSTR_predict), MP_ROM_PTR(&py_net_predict_obj)},
+    {MP_ROM_QSTR(MP_QSTR_cascade), MP_ROM_PTR(&py_net_cascade_obj)},
+    {MP_ROM_QSTR(MP_QSTR_deinit), MP_ROM_PTR(&py_net_deinit_obj)}};
 
 STATIC MP_DEFINE_CONST_DICT(locals_dict, locals_dict_table);
 
@@ -67,21 +123,30 @@ static const mp_obj_type_t py_st_net_type = {{&mp_type_type},
                                                  (mp_obj_t)&locals_dict};
 
 /* Function in charge of creating an instance of "ST NN" class and initializing
- * the NN named nn_name */
-static mp_obj_t py_nn_st_load(mp_obj_t nn_name) {
-  const char *network_name = mp_obj_str_get_str(nn_name);
+ * the NN named nn_name, with its buffers placed in args[1] (mem) */
+static mp_obj_t py_nn_st_load(uint n_args, const mp_obj_t *args,
+                              mp_map_t *kw_args) {
+  const char *network_name = mp_obj_str_get_str(args[0]);
+  ai_mem_t mem = py_helper_keyword_int(n_args, args, 1, kw_args,
+                                       MP_OBJ_NEW_QSTR(MP_QSTR_mem),
+                                       AI_MEM_FB_ALLOC);
   py_st_net_obj_t *net = m_new_obj(py_st_net_obj_t);
   net->base.type = &py_st_net_type;
-  aiDeInit();
-  aiInit(network_name, py_st_net_cobj(net));
+  if (aiInit(network_name, py_st_net_cobj(net), mem)) {
+    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError,
+                                       "Failed to load the network!"));
+  }
   return net;
 }
 
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_nn_st_load_obj, py_nn_st_load);
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_nn_st_load_obj, 1, py_nn_st_load);
 
 STATIC const mp_rom_map_elem_t globals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_nn_st)},
     {MP_ROM_QSTR(MP_QSTR_loadnnst), MP_ROM_PTR(&py_nn_st_load_obj)},
+    {MP_ROM_QSTR(MP_QSTR_FB_ALLOC), MP_ROM_INT(AI_MEM_FB_ALLOC)},
+    {MP_ROM_QSTR(MP_QSTR_HEAP), MP_ROM_INT(AI_MEM_HEAP)},
+    {MP_ROM_QSTR(MP_QSTR_TCM), MP_ROM_INT(AI_MEM_TCM)},
 };
 
 STATIC MP_DEFINE_CONST_DICT(globals_dict, globals_dict_table);
@@ -13,3 +13,9 @@
 Q(nn_st)
 Q(loadnnst)
 Q(predict)
+Q(cascade)
+Q(deinit)
+Q(mem)
+Q(FB_ALLOC)
+Q(HEAP)
+Q(TCM)
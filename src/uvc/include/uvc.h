@@ -518,5 +518,35 @@ struct UVC_FRAMES_FORMAT_UNCOMPRESSED(n) { \
 	struct uvc_color_matching_descriptor uvc_vs_color; \
 } __attribute__ ((packed));
 
+/* MJPEG Payload - 3.1.1. MJPEG Video Format Descriptor */
+struct uvc_format_mjpeg {
+	uint8_t  bLength;
+	uint8_t  bDescriptorType;
+	uint8_t  bDescriptorSubType;
+	uint8_t  bFormatIndex;
+	uint8_t  bNumFrameDescriptors;
+	uint8_t  bmFlags;
+	uint8_t  bDefaultFrameIndex;
+	uint8_t  bAspectRatioX;
+	uint8_t  bAspectRatioY;
+	uint8_t  bmInterlaceFlags;
+	uint8_t  bCopyProtect;
+} __attribute__((__packed__));
+
+#define UVC_DT_FORMAT_MJPEG_SIZE			11
+
+/* MJPEG Payload - 3.1.2. MJPEG Video Frame Descriptor (same layout as uncompressed) */
+#define UVC_DT_FRAME_MJPEG_SIZE(n)			(26+4*(n))
+
+#define UVC_FRAMES_FORMAT_MJPEG(n) \
+		uvc_vs_frame_format_mjpeg_desc_##n
+
+#define DECLARE_UVC_FRAMES_FORMAT_MJPEG(n) \
+struct UVC_FRAMES_FORMAT_MJPEG(n) { \
+	struct uvc_format_mjpeg uvc_vs_format; \
+	struct UVC_FRAME_UNCOMPRESSED(1) uvc_vs_frame[n]; \
+	struct uvc_color_matching_descriptor uvc_vs_color; \
+} __attribute__ ((packed));
+
 #endif /* __UVC_H */
 
@@ -14,6 +14,8 @@
 
 // consistent macro expansion of VS_NUM_FORMATS
 #define _UVC_INPUT_HEADER_DESCRIPTOR(n, p) UVC_INPUT_HEADER_DESCRIPTOR(n, p)
+// consistent macro expansion of VS_MJPEG_NUM_FRAMES
+#define _UVC_FRAMES_FORMAT_MJPEG(n) UVC_FRAMES_FORMAT_MJPEG(n)
 
 DECLARE_UVC_HEADER_DESCRIPTOR(1);
 DECLARE_UVC_FRAME_UNCOMPRESSED(1);
@@ -22,11 +24,13 @@ DECLARE_UVC_EXTENSION_UNIT_DESCRIPTOR(1, 8);
 DECLARE_UVC_INPUT_HEADER_DESCRIPTOR(1, VS_NUM_FORMATS);
 DECLARE_UVC_FRAMES_FORMAT_UNCOMPRESSED(3);
 DECLARE_UVC_FRAMES_FORMAT_UNCOMPRESSED(4);
+DECLARE_UVC_FRAMES_FORMAT_MJPEG(VS_MJPEG_NUM_FRAMES);
 
 struct uvc_vs_frames_formats_descriptor {
   struct UVC_FRAMES_FORMAT_UNCOMPRESSED(4) uvc_vs_frames_format_1;
   struct UVC_FRAMES_FORMAT_UNCOMPRESSED(3) uvc_vs_frames_format_2;
   struct UVC_FRAMES_FORMAT_UNCOMPRESSED(3) uvc_vs_frames_format_3;
+  struct _UVC_FRAMES_FORMAT_MJPEG(VS_MJPEG_NUM_FRAMES) uvc_vs_frames_format_4;
 };
 
 struct usbd_uvc_cfg {
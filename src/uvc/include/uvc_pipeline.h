@@ -0,0 +1,39 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * UVC imlib processing stages.
+ */
+#ifndef __UVC_PIPELINE_H__
+#define __UVC_PIPELINE_H__
+#include "sensor.h"
+#include "imlib.h"
+
+// Stages applied (in this order) to grayscale/RGB565 frames before they're streamed.
+#define UVC_PIPELINE_BINNING    (1 << 0) // Capture at twice the size and 2x2 mean pool.
+#define UVC_PIPELINE_LENS_CORR  (1 << 1) // Lens distortion correction.
+#define UVC_PIPELINE_HISTEQ     (1 << 2) // Histogram equalization.
+#define UVC_PIPELINE_OVERLAY    (1 << 3) // Frame rate overlay.
+
+// Set with make UVC_PIPELINE="UVC_PIPELINE_LENS_CORR|UVC_PIPELINE_HISTEQ"
+#ifndef UVC_PIPELINE_STAGES
+#define UVC_PIPELINE_STAGES     (0)
+#endif
+
+#ifndef UVC_LENS_CORR_STRENGTH
+#define UVC_LENS_CORR_STRENGTH  (1.8f)
+#endif
+
+#ifndef UVC_LENS_CORR_ZOOM
+#define UVC_LENS_CORR_ZOOM      (1.0f)
+#endif
+
+// Returns the frame size to capture to stream frames of the given size.
+framesize_t uvc_pipeline_framesize(framesize_t framesize, pixformat_t pixformat);
+// Runs the enabled stages on the frame, which ends up being w x h.
+void uvc_pipeline_run(image_t *image, int w, int h);
+#endif // __UVC_PIPELINE_H__
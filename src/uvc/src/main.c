@@ -10,6 +10,7 @@
  */
 #include STM32_HAL_H
 #include <stdbool.h>
+#include <string.h>
 #include "sdram.h"
 #include "usbd_core.h"
 #include "usbd_desc.h"
@@ -17,6 +18,8 @@
 #include "usbd_uvc_if.h"
 #include "sensor.h"
 #include "framebuffer.h"
+#include "imlib.h"
+#include "uvc_pipeline.h"
 #include "omv_boardconfig.h"
 
 extern sensor_t sensor;
@@ -76,19 +79,96 @@ const void *mp_type_MemoryError = NULL;
 
 const void *mp_sys_stdout_print = NULL;
 
+// No file system or network writes to poll while waiting for frames.
+bool file_ring_poll()
+{
+    return false;
+}
+
+bool wifistream_poll()
+{
+    return false;
+}
+
+// There's no GC heap, nothing to collect between frames.
+void gc_stats_frame()
+{
+}
+
 static uint8_t frame_index = 0;
 static uint8_t format_index = 0;
+static framesize_t frame_size = FRAMESIZE_INVALID;
 
 static uint8_t uvc_header[2] = { 2, 0 };
 static uint8_t packet[VIDEO_PACKET_SIZE];
 uint32_t packet_size = VIDEO_PACKET_SIZE-2;
 
+// MJPEG quality, lowered when a frame overflows the JPEG buffer and raised back
+// slowly while the frames are small enough.
+#define MJPEG_QUALITY_MAX   (50)
+#define MJPEG_QUALITY_MIN   (10)
+static int mjpeg_quality = MJPEG_QUALITY_MAX;
+
+static bool streaming_status()
+{
+    if (g_uvc_stream_status != 2 ||
+            frame_index != videoCommitControl.bFrameIndex ||
+            format_index != videoCommitControl.bFormatIndex) {
+        return false;
+    }
+
+    return true;
+}
+
+// Compresses the frame into the JPEG buffer (with the hardware encoder on the H7)
+// and sends it out, the last packet of the payload is a short one.
+static bool streaming_mjpeg(image_t *image)
+{
+    uint32_t buf_size = OMV_JPEG_BUF_SIZE-64;
+    image_t dst = {.w=image->w, .h=image->h, .bpp=buf_size, .pixels=JPEG_FB()->pixels};
+
+    if (jpeg_compress(image, &dst, mjpeg_quality, false)) {
+        // Frame didn't fit, drop it and lower the quality for the next one.
+        mjpeg_quality = IM_MAX(mjpeg_quality - 5, MJPEG_QUALITY_MIN);
+        return streaming_status();
+    }
+
+    if (dst.bpp < (buf_size / 2)) {
+        mjpeg_quality = IM_MIN(mjpeg_quality + 1, MJPEG_QUALITY_MAX);
+    }
+
+    for (uint32_t xfer_bytes = 0; xfer_bytes < dst.bpp; ) {
+        uint32_t size = IM_MIN(packet_size, dst.bpp - xfer_bytes);
+        packet[0] = uvc_header[0];
+        packet[1] = uvc_header[1];
+        memcpy(packet + 2, dst.pixels + xfer_bytes, size);
+        xfer_bytes += size;
+
+        if (xfer_bytes == dst.bpp) {
+            packet[1] |= 0x2;    // Flag end of frame
+            uvc_header[1] ^= 1;  // Toggle bit 0 for next new frame
+        }
+
+        while (UVC_Transmit_FS(packet, size + 2) != USBD_OK) {
+            __WFI();
+        }
+    }
+
+    return streaming_status();
+}
+
 bool streaming_cb(image_t *image)
 {
     uint32_t xfer_size = 0;
     uint32_t xfer_bytes = 0;
     uint8_t *dst = packet + 2;
 
+    uvc_pipeline_run(image, resolution[frame_size][0], resolution[frame_size][1]);
+
+    if (videoCommitControl.bFormatIndex == VS_FMT_INDEX(MJPEG)) {
+        return streaming_mjpeg(image);
+    }
+
     xfer_size = image->w * image->h * image->bpp;
 
     while (xfer_bytes < xfer_size) {
@@ -124,13 +204,7 @@ bool streaming_cb(image_t *image)
         }
     }
 
-    if (g_uvc_stream_status != 2 ||
-            frame_index != videoCommitControl.bFrameIndex ||
-            format_index != videoCommitControl.bFormatIndex) {
-        return false;
-    }
-
-    return true;
+    return streaming_status();
 }
 
 int main()
@@ -195,27 +269,54 @@ int main()
                     case VS_FMT_INDEX(RGB565):
                         sensor_set_pixformat(PIXFORMAT_RGB565);
                         break;
+                    case VS_FMT_INDEX(MJPEG):
+                        // The MT9V034 is a mono sensor, compress its grayscale frames.
+                        sensor_set_pixformat((sensor_get_id() == MT9V034_ID) ?
+                                PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB565);
+                        break;
                     default:
                         break;
                 }
 
-                switch (videoCommitControl.bFrameIndex) {
-                    case VS_FRAME_INDEX_1:
-                        sensor_set_framesize(FRAMESIZE_QQQVGA);
-                        break;
-                    case VS_FRAME_INDEX_2:
-                        sensor_set_framesize(FRAMESIZE_QQVGA);
-                        break;
-                    case VS_FRAME_INDEX_3:
-                        sensor_set_framesize(FRAMESIZE_QVGA);
-                        break;
-                    case VS_FRAME_INDEX_4:
-                        sensor_set_framesize(FRAMESIZE_VGA);
-                        break;
-                    default:
-                        break;
+                if (videoCommitControl.bFormatIndex == VS_FMT_INDEX(MJPEG)) {
+                    switch (videoCommitControl.bFrameIndex) {
+                        case VS_FRAME_INDEX_1:
+                            frame_size = FRAMESIZE_QQVGA;
+                            break;
+                        case VS_FRAME_INDEX_2:
+                            frame_size = FRAMESIZE_QVGA;
+                            break;
+                        case VS_FRAME_INDEX_3:
+                            frame_size = FRAMESIZE_VGA;
+                            break;
+                        case VS_FRAME_INDEX_4:
+                            frame_size = FRAMESIZE_HD;
+                            break;
+                        default:
+                            break;
+                    }
+                } else {
+                    switch (videoCommitControl.bFrameIndex) {
+                        case VS_FRAME_INDEX_1:
+                            frame_size = FRAMESIZE_QQQVGA;
+                            break;
+                        case VS_FRAME_INDEX_2:
+                            frame_size = FRAMESIZE_QQVGA;
+                            break;
+                        case VS_FRAME_INDEX_3:
+                            frame_size = FRAMESIZE_QVGA;
+                            break;
+                        case VS_FRAME_INDEX_4:
+                            frame_size = FRAMESIZE_VGA;
+                            break;
+                        default:
+                            break;
+                    }
                 }
 
+                // Binning captures a larger frame that's pooled down to the streamed size.
+                sensor_set_framesize(uvc_pipeline_framesize(frame_size, sensor.pixformat));
+
                 frame_index = videoCommitControl.bFrameIndex;
                 format_index = videoCommitControl.bFormatIndex;
             }
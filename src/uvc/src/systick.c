@@ -18,3 +18,22 @@ uint32_t systick_current_millis()
 bool sys_tick_has_passed(uint32_t start_tick, uint32_t delay_ms) {
     return HAL_GetTick() - start_tick >= delay_ms;
 }
+
+// The MicroPython HAL microsecond tick used by the shared sensor/framebuffer code.
+uint32_t mp_hal_ticks_us()
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t counter = SysTick->VAL;
+    uint32_t milliseconds = HAL_GetTick();
+    uint32_t status = SysTick->CTRL;
+    __set_PRIMASK(primask);
+
+    // The millisecond tick wasn't counted yet if the counter wrapped while interrupts were off.
+    if ((status & SysTick_CTRL_COUNTFLAG_Msk) && (counter > 50)) {
+        milliseconds++;
+    }
+
+    uint32_t load = SysTick->LOAD;
+    return (milliseconds * 1000) + (((load - counter) * 1000) / load);
+}
@@ -305,6 +305,9 @@ static int8_t UVC_VS_ControlGet(uint8_t cmd, uint8_t* pbuf, uint16_t length, uin
         case VS_FMT_INDEX(RGB565):
           frame = frames_formats->uvc_vs_frames_format_3.uvc_vs_frame;
           break;
+        case VS_FMT_INDEX(MJPEG):
+          frame = frames_formats->uvc_vs_frames_format_4.uvc_vs_frame;
+          break;
         default:
           return USBD_FAIL;
         }
@@ -0,0 +1,114 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * UVC imlib processing stages.
+ */
+#include STM32_HAL_H
+#include "fb_alloc.h"
+#include "uvc_pipeline.h"
+#include "omv_boardconfig.h"
+
+extern sensor_t sensor;
+static uint32_t overlay_ticks = 0;
+
+// In double buffering mode the other frame sits right above the current one, below the
+// fb_alloc stack, so a stage only runs if its scratch memory doesn't reach that frame.
+static bool uvc_pipeline_fits(uint32_t reserved, uint32_t size)
+{
+    return (reserved + size + 64) <= fb_avail();
+}
+
+framesize_t uvc_pipeline_framesize(framesize_t framesize, pixformat_t pixformat)
+{
+    framesize_t binned;
+
+    if (!(UVC_PIPELINE_STAGES & UVC_PIPELINE_BINNING)
+            || (pixformat != PIXFORMAT_GRAYSCALE && pixformat != PIXFORMAT_RGB565)) {
+        return framesize;
+    }
+
+    switch (framesize) {
+        case FRAMESIZE_QQQVGA:
+            binned = FRAMESIZE_QQVGA;
+            break;
+        case FRAMESIZE_QQVGA:
+            binned = FRAMESIZE_QVGA;
+            break;
+        case FRAMESIZE_QVGA:
+            binned = FRAMESIZE_VGA;
+            break;
+        default:
+            return framesize;
+    }
+
+    int bpp = (pixformat == PIXFORMAT_GRAYSCALE) ? 1 : 2;
+    if ((resolution[binned][0] * resolution[binned][1] * bpp) > OMV_RAW_BUF_SIZE) {
+        return framesize;
+    }
+
+    return binned;
+}
+
+static void uvc_pipeline_overlay(image_t *image)
+{
+    char str[16] = "FPS: ";
+    uint32_t ticks = HAL_GetTick();
+    uint32_t fps = (ticks != overlay_ticks) ? (1000 / (ticks - overlay_ticks)) : 0;
+    overlay_ticks = ticks;
+
+    // No printf in this firmware.
+    int len = 5;
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + (fps % 10);
+        fps /= 10;
+    } while (fps);
+    while (n) {
+        str[len++] = digits[--n];
+    }
+    str[len] = 0;
+
+    int fg = IM_IS_GS(image) ? COLOR_GRAYSCALE_MAX : COLOR_R8_G8_B8_TO_RGB565(255, 255, 255);
+    imlib_draw_rectangle(image, 0, 0, (len * 8) + 4, 14, 0, 1, true);
+    imlib_draw_string(image, 2, 2, str, fg, 1.0f, 0, 0, false, 0, false, false, 0, false, false);
+}
+
+void uvc_pipeline_run(image_t *image, int w, int h)
+{
+    if (UVC_PIPELINE_STAGES == 0
+            || (sensor.pixformat != PIXFORMAT_GRAYSCALE && sensor.pixformat != PIXFORMAT_RGB565)) {
+        return;
+    }
+
+    uint32_t size = image_size(image);
+    uint32_t reserved = ((size * 2) <= OMV_RAW_BUF_SIZE) ? size : 0;
+
+    if ((UVC_PIPELINE_STAGES & UVC_PIPELINE_BINNING)
+            && (image->w == (w * 2)) && (image->h == (h * 2))) {
+        // The output is written behind the input, so this can be done in place.
+        image_t out = {.w=w, .h=h, .bpp=image->bpp, .pixels=image->pixels};
+        imlib_mean_pool(image, &out, 2, 2);
+        image->w = w;
+        image->h = h;
+    }
+
+    if ((UVC_PIPELINE_STAGES & UVC_PIPELINE_LENS_CORR)
+            && uvc_pipeline_fits(reserved, image_size(image) + (image->w + image->h) * sizeof(float))) {
+        imlib_lens_corr(image, UVC_LENS_CORR_STRENGTH, UVC_LENS_CORR_ZOOM, 0.0f, 0.0f);
+    }
+
+    if ((UVC_PIPELINE_STAGES & UVC_PIPELINE_HISTEQ)
+            && uvc_pipeline_fits(reserved, IM_G_HIST_SIZE * sizeof(uint32_t))) {
+        imlib_histeq(image, NULL);
+    }
+
+    if (UVC_PIPELINE_STAGES & UVC_PIPELINE_OVERLAY) {
+        uvc_pipeline_overlay(image);
+    }
+}
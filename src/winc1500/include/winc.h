@@ -82,6 +82,8 @@ typedef struct {
 } winc_netinfo_t;
 
 typedef int (*winc_scan_callback_t) (winc_scan_result_t *, void *);
+// Socket event callback, called with the WINC socket messages (SOCKET_MSG_xxx).
+typedef void (*winc_socket_callback_t) (int fd, uint8_t msg_type, void *msg);
 
 typedef struct {
     uint8_t fw_major;       // Firmware version major number.
@@ -137,5 +139,7 @@ int winc_socket_recv(int fd, uint8_t *buf, uint32_t len, winc_socket_buf_t *sock
 int winc_socket_sendto(int fd, const uint8_t *buf, uint32_t len, sockaddr *addr, uint32_t timeout);
 int winc_socket_recvfrom(int fd, uint8_t *buf, uint32_t len, sockaddr *addr, uint32_t timeout);
 int winc_socket_setsockopt(int fd, uint32_t level, uint32_t opt, const void *optval, uint32_t optlen);
+void winc_socket_set_callback(int fd, winc_socket_callback_t cb);
+void winc_socket_poll();
 
 #endif //__WINC_H__
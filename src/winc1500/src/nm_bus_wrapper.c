@@ -52,6 +52,8 @@
 #include "pin.h"
 #include "genhdr/pins.h"
 #include "extint.h"
+#include "dma.h"
+#include "spi.h"
 #include "omv_boardconfig.h"
 
 extern SPI_HandleTypeDef SPIHandle2;
@@ -92,12 +94,107 @@ static sint8 nm_i2c_write_special(uint8 *wb1, uint16 sz1, uint8 *wb2, uint16 sz2
 #endif
 
 #ifdef CONF_WINC_USE_SPI
+// Transfers of at least SPI_DMA_MIN_SIZE bytes (socket payloads) use DMA, the smaller commands and
+// responses are polled. The DMA goes through two bounce buffers in DMA memory (the driver's buffers
+// can be anywhere, e.g. DTCM on the H7), the next chunk is copied (or the last one copied back) while
+// one is in flight, and the CPU sleeps until the transfer is done instead of polling the SPI.
+#define SPI_DMA_MIN_SIZE    (64)
+#define SPI_DMA_CHUNK_SIZE  (1024)
+
+static DMA_HandleTypeDef spi_tx_dma, spi_rx_dma;
+static uint8_t spi_dma_buf[2][SPI_DMA_CHUNK_SIZE] __attribute__((aligned(32), section(".dma_buffer")));
+
+static inline uint16 spi_dma_chunk(uint16 offset, uint16 u16Sz)
+{
+    return ((u16Sz - offset) < SPI_DMA_CHUNK_SIZE) ? (u16Sz - offset) : SPI_DMA_CHUNK_SIZE;
+}
+
+static bool spi_dma_wait(void)
+{
+    for (mp_uint_t tick_start = HAL_GetTick(); HAL_SPI_GetState(&SPI_HANDLE) != HAL_SPI_STATE_READY; __WFI()) {
+        if ((HAL_GetTick() - tick_start) >= WINC_SPI_TIMEOUT) {
+            HAL_SPI_Abort(&SPI_HANDLE);
+            return false;
+        }
+    }
+
+    return (SPI_HANDLE.ErrorCode == HAL_SPI_ERROR_NONE);
+}
+
+static sint8 spi_rw_dma(uint8 *tx_buf, uint8 *rx_buf, uint16 u16Sz)
+{
+    const spi_t *spi = &spi_obj[1]; // SPI2
+    sint8 result = M2M_SUCCESS;
+
+    dma_init(&spi_tx_dma, spi->tx_dma_descr, DMA_MEMORY_TO_PERIPH, spi->spi);
+    spi->spi->hdmatx = &spi_tx_dma;
+
+    if (tx_buf != 0) {
+        memcpy(spi_dma_buf[0], tx_buf, spi_dma_chunk(0, u16Sz));
+    } else {
+        dma_init(&spi_rx_dma, spi->rx_dma_descr, DMA_PERIPH_TO_MEMORY, spi->spi);
+        spi->spi->hdmarx = &spi_rx_dma;
+        memset(spi_dma_buf[0], 0, SPI_DMA_CHUNK_SIZE);
+    }
+
+    for (uint16 offset = 0, i = 0; offset < u16Sz; offset += SPI_DMA_CHUNK_SIZE, i ^= 1) {
+        uint16 size = spi_dma_chunk(offset, u16Sz);
+        uint16 next = offset + size;
+        uint8 *buf = spi_dma_buf[i], *other = spi_dma_buf[i ^ 1];
+        HAL_StatusTypeDef status = (tx_buf != 0)
+            ? HAL_SPI_Transmit_DMA(&SPI_HANDLE, buf, size)
+            : HAL_SPI_TransmitReceive_DMA(&SPI_HANDLE, buf, buf, size);
+
+        if (status != HAL_OK) {
+            result = M2M_ERR_BUS_FAIL;
+            break;
+        }
+
+        if (tx_buf != 0) {
+            if (next < u16Sz) {
+                memcpy(other, tx_buf + next, spi_dma_chunk(next, u16Sz));
+            }
+        } else if (offset) {
+            memcpy(rx_buf + offset - SPI_DMA_CHUNK_SIZE, other, SPI_DMA_CHUNK_SIZE);
+            memset(other, 0, SPI_DMA_CHUNK_SIZE);
+        }
+
+        if (!spi_dma_wait()) {
+            result = M2M_ERR_BUS_FAIL;
+            break;
+        }
+
+        if ((tx_buf == 0) && (next == u16Sz)) {
+            memcpy(rx_buf + offset, buf, size);
+        }
+    }
+
+    dma_deinit(spi->tx_dma_descr);
+    spi->spi->hdmatx = NULL;
+
+    if (tx_buf == 0) {
+        dma_deinit(spi->rx_dma_descr);
+        spi->spi->hdmarx = NULL;
+    }
+
+    return result;
+}
 
 static sint8 spi_rw(uint8 *tx_buf, uint8 *rx_buf, uint16 u16Sz)
 {
     uint32_t basepri;
 	sint8 result = M2M_SUCCESS;
 
+    if (u16Sz >= SPI_DMA_MIN_SIZE) {
+        // The DMA interrupts have a higher priority than USB.
+        basepri = raise_irq_pri(IRQ_PRI_OTG_FS);
+        WINC_CS_LOW();
+        result = spi_rw_dma(tx_buf, rx_buf, u16Sz);
+        WINC_CS_HIGH();
+        restore_irq_pri(basepri);
+        return result;
+    }
+
     // Allow systick to run.
     basepri = raise_irq_pri(IRQ_PRI_UART);
     WINC_CS_LOW();
@@ -31,6 +31,7 @@ static void *async_request_data;
 static uint8_t async_request_type=0;
 static volatile bool async_request_done = false;
 static winc_ifconfig_t ifconfig;
+static winc_socket_callback_t socket_callbacks[MAX_SOCKET];
 
 typedef struct {
     int size;
@@ -90,6 +91,12 @@ static void socket_callback(SOCKET sock, uint8_t msg_type, void *msg)
         WINC1500_EXPORT(close)(sock);
     }
 
+    // Sockets driven by their own event callback don't use async requests.
+    if (sock >= 0 && sock < MAX_SOCKET && socket_callbacks[sock] != NULL) {
+        socket_callbacks[sock](sock, msg_type, msg);
+        return;
+    }
+
     if (async_request_type != msg_type) {
         debug_printf("spurious message received!"
                 " expected: (%d) received: (%d)\n", async_request_type, msg_type);
@@ -779,9 +786,25 @@ int winc_socket_socket(uint8_t type)
 
 void winc_socket_close(int fd)
 {
+    if (fd >= 0 && fd < MAX_SOCKET) {
+        socket_callbacks[fd] = NULL;
+    }
     WINC1500_EXPORT(close)(fd);
 }
 
+void winc_socket_set_callback(int fd, winc_socket_callback_t cb)
+{
+    if (fd >= 0 && fd < MAX_SOCKET) {
+        socket_callbacks[fd] = cb;
+    }
+}
+
+void winc_socket_poll()
+{
+    // Handle pending events from network controller, returns immediately if there's none.
+    m2m_wifi_handle_events(NULL);
+}
+
 int winc_socket_bind(int fd, sockaddr *addr)
 {
     // Call bind and check HIF errors.
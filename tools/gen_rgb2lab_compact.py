@@ -0,0 +1,51 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+# This file is part of the OpenMV project.
+#
+# Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+# Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+#
+# This work is licensed under the MIT license, see the file LICENSE for details.
+#
+# This script generates the compact RGB565 to LAB tables (about 3KB instead of the 192KB
+# lab_table). X/Xn, Y/Yn and Z/Zn are the sums of per channel contributions (Q15) and the
+# CIELAB f() function is linearly interpolated from a 1025 entry table (Q15).
+# See gen_rgb2lab.py for the reference conversion.
+
+import sys
+
+def lin(c):
+    return 100 * ((c/12.92) if (c<=0.04045) else pow((c+0.055)/1.055, 2.4))
+
+def f(t):
+    return pow(t, (1/3.0)) if (t>0.008856) else ((7.787037*t)+0.137931)
+
+# sRGB to XYZ matrix rows divided by the D65 white point.
+xyz = [[0.4124 / 095.047, 0.3576 / 095.047, 0.1805 / 095.047],
+       [0.2126 / 100.000, 0.7152 / 100.000, 0.0722 / 100.000],
+       [0.0193 / 108.883, 0.1192 / 108.883, 0.9505 / 108.883]]
+
+def write_table(name, values, per_line):
+    sys.stdout.write("const uint16_t %s[%d] = {\n" % (name, len(values)))
+    for i, v in enumerate(values):
+        if not (i % per_line):
+            sys.stdout.write("    ")
+        sys.stdout.write("%5d" % v)
+        if (i + 1) == len(values):
+            sys.stdout.write("\n};\n")
+        elif (i + 1) % per_line:
+            sys.stdout.write(", ")
+        else:
+            sys.stdout.write(",\n")
+
+sys.stdout.write("#include <stdint.h>\n")
+
+for channel, name, bits in [(0, "r", 5), (1, "g", 6), (2, "b", 5)]:
+    n = (1 << bits) - 1
+    values = []
+    for i in range(n + 1):
+        c_lin = lin((((i * 255) + (n / 2.0)) // n) / 255.0)
+        values += [int(round(c_lin * xyz[k][channel] * 32768)) for k in range(3)]
+    write_table("lab_compact_%s_table" % name, values, 12)
+
+write_table("lab_compact_f_table", [int(round(f(i / 1024.0) * 32768)) for i in range(1025)], 12)
@@ -0,0 +1,111 @@
+#!/usr/bin/env python
+# This file is part of the OpenMV project.
+#
+# Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+# Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+#
+# This work is licensed under the MIT license, see the file LICENSE for details.
+#
+# This script packs models, cascades and other assets into a QSPI flash asset
+# store image (see src/omv/assets.h), and optionally writes it with the bootloader.
+#
+# Assets are accessed in place by name, e.g. tf.load("mobilenet"), so the name
+# defaults to the file name without the extension, or can be set with name=path.
+#
+# Usage: mkassets.py [--port /dev/ttyACM0] output.bin [name=]path ...
+
+import os
+import sys
+import time
+import struct
+import argparse
+
+ASSETS_MAGIC        = 0x41564D4F # "OMVA"
+ASSETS_VERSION      = 1
+ASSETS_ALIGN        = 32
+ASSETS_NAME_SIZE    = 32
+ASSETS_HEADER_SIZE  = 16
+ASSETS_ENTRY_SIZE   = ASSETS_NAME_SIZE + 8
+
+QSPIF_SIZE          = 32*1024*1024
+QSPIF_BLOCK_SIZE    = 64*1024
+BOOTLDR_PACKET_SIZE = 60
+
+def align(n):
+    return (n + ASSETS_ALIGN - 1) & ~(ASSETS_ALIGN - 1)
+
+def pack(assets):
+    offset = align(ASSETS_HEADER_SIZE + len(assets) * ASSETS_ENTRY_SIZE)
+    entries = b""
+    data = b""
+    for name, buf in assets:
+        entries += struct.pack("<%dsII"%ASSETS_NAME_SIZE, name.encode(), offset + len(data), len(buf))
+        data += buf + b"\xFF" * (align(len(buf)) - len(buf))
+
+    header = struct.pack("<IIII", ASSETS_MAGIC, ASSETS_VERSION, len(assets), offset + len(data))
+    table = header + entries
+    return table + b"\xFF" * (offset - len(table)) + data
+
+def flash(port, image):
+    import pyopenmv
+    print("Waiting for the bootloader (reset the camera)...")
+    pyopenmv.init(port, timeout=0.1)
+    while True:
+        try:
+            if pyopenmv.bootloader_start():
+                break
+        except Exception:
+            pyopenmv.disconnect()
+            time.sleep(0.1)
+            pyopenmv.init(port, timeout=0.1)
+
+    pyopenmv.set_timeout(1.0)
+    for block in range((len(image) + QSPIF_BLOCK_SIZE - 1) // QSPIF_BLOCK_SIZE):
+        print("Erasing block %d..."%(block))
+        pyopenmv.qspif_erase(block)
+        time.sleep(0.5)
+
+    for i in range(0, len(image), BOOTLDR_PACKET_SIZE):
+        pyopenmv.qspif_write(image[i:i + BOOTLDR_PACKET_SIZE])
+        time.sleep(0.001)
+
+    # Flushes the last page and jumps to the firmware.
+    pyopenmv.bootloader_reset()
+    pyopenmv.disconnect()
+
+def main():
+    parser = argparse.ArgumentParser(description="OpenMV asset store packer")
+    parser.add_argument("--port", default=None, help="write the image with the bootloader on this port")
+    parser.add_argument("output", help="output image file")
+    parser.add_argument("assets", nargs="+", help="asset files, optionally prefixed with name=")
+    args = parser.parse_args()
+
+    assets = []
+    for arg in args.assets:
+        if "=" in arg:
+            name, path = arg.split("=", 1)
+        else:
+            name, path = os.path.splitext(os.path.basename(arg))[0], arg
+        if len(name) >= ASSETS_NAME_SIZE:
+            sys.exit("Asset name too long: %s"%(name))
+        if name in (n for n, _ in assets):
+            sys.exit("Duplicate asset name: %s"%(name))
+        with open(path, "rb") as f:
+            assets.append((name, f.read()))
+
+    image = pack(assets)
+    if len(image) > QSPIF_SIZE:
+        sys.exit("Asset store too large: %d bytes"%(len(image)))
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+
+    for name, buf in assets:
+        print("%-32s %d bytes"%(name, len(buf)))
+    print("Total: %d bytes"%(len(image)))
+
+    if args.port:
+        flash(args.port, image)
+
+if __name__ == "__main__":
+    main()
@@ -12,9 +12,16 @@ import struct
 import sys,time
 import serial
 import platform
+import threading
+import heapq
 import numpy as np
 from PIL import Image
 
+try:
+    import queue
+except ImportError: # Python 2
+    import Queue as queue
+
 __serial = None
 __FB_HDR_SIZE   =12
 
@@ -36,6 +43,12 @@ __USBDBG_SYS_RESET      = 0x0C
 __USBDBG_FB_ENABLE      = 0x0D
 __USBDBG_TX_BUF_LEN     = 0x8E
 __USBDBG_TX_BUF         = 0x8F
+__USBDBG_FB_ALLOC_STATS = 0x91
+__USBDBG_FB_BUDGET      = 0x12
+__USBDBG_FB_RAW         = 0x13
+__USBDBG_TRACE_ENABLE   = 0x14
+__USBDBG_TRACE_LEN      = 0x95
+__USBDBG_TRACE_DUMP     = 0x96
 
 ATTR_CONTRAST   =0
 ATTR_BRIGHTNESS =1
@@ -46,6 +59,9 @@ __BOOTLDR_START         = 0xABCD0001
 __BOOTLDR_RESET         = 0xABCD0002
 __BOOTLDR_ERASE         = 0xABCD0004
 __BOOTLDR_WRITE         = 0xABCD0008
+__BOOTLDR_STREAM        = 0xABCD0020
+__BOOTLDR_QSPIF_ERASE   = 0xABCD1004
+__BOOTLDR_QSPIF_WRITE   = 0xABCD1008
 
 def init(port, baudrate=921600, timeout=0.3):
     global __serial
@@ -76,18 +92,29 @@ def fb_dump():
         # frame not ready
         return None
 
-    if (size[2] > 2): #JPEG
-        num_bytes = size[2]
-    else:
-        num_bytes = size[0]*size[1]*size[2]
+    num_bytes = fb_num_bytes(size)
 
     # read fb data
     __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FRAME_DUMP, num_bytes))
-    buff = __serial.read(num_bytes)
+    return fb_decode(size, __serial.read(num_bytes))
+
+def fb_num_bytes(size):
+    # Number of bytes to read for the (w, h, bpp/JPEG size) frame header.
+    if (size[2] > 3): #JPEG
+        return size[2]
+    elif (size[2] == 3): # Bayer
+        return size[0]*size[1]
+    else:
+        return size[0]*size[1]*size[2]
 
+def fb_decode(size, buff):
+    # Returns (w, h, RGB array) for the frame data read for the (w, h, bpp/JPEG size) frame header.
     if size[2] == 1:  # Grayscale
         y = np.fromstring(buff, dtype=np.uint8)
         buff = np.column_stack((y, y, y))
+    elif size[2] == 3: # Bayer (shown as grayscale)
+        y = np.fromstring(buff, dtype=np.uint8)
+        buff = np.column_stack((y, y, y))
     elif size[2] == 2: # RGB565
         arr = np.fromstring(buff, dtype=np.uint16).newbyteorder('S')
         r = (((arr & 0xF800) >>11)*255.0/31.0).astype(np.uint8)
@@ -145,12 +172,83 @@ def bootloader_start():
 def bootloader_reset():
     __serial.write(struct.pack("<I", __BOOTLDR_RESET))
 
+def bootloader_version():
+    # Returns the bootloader version (e.g. 0xABCD0004), or 0 if the bootloader didn't answer.
+    __serial.write(struct.pack("<I", __BOOTLDR_START))
+    buf = __serial.read(4)
+    return struct.unpack("I", buf)[0] if len(buf) == 4 else 0
+
+def lz4_compress(data):
+    # LZ4 block compressor for flash_stream(), uses the lz4 module if it's installed.
+    try:
+        import lz4.block
+        return lz4.block.compress(bytes(data), store_size=False)
+    except ImportError:
+        pass
+
+    data = bytearray(data)
+    out = bytearray()
+
+    def put_len(n):
+        while n >= 255:
+            out.append(255)
+            n -= 255
+        out.append(n)
+
+    def put_seq(literals, offset=0, match_len=0):
+        token = (min(len(literals), 15) << 4) | (min(match_len - 4, 15) if offset else 0)
+        out.append(token)
+        if len(literals) >= 15:
+            put_len(len(literals) - 15)
+        out.extend(literals)
+        if offset:
+            out.extend(struct.pack("<H", offset))
+            if match_len - 4 >= 15:
+                put_len(match_len - 4 - 15)
+
+    # Greedy matching, the last match has to start 12 bytes before the end and the last
+    # 5 bytes have to be literals.
+    table = {}
+    anchor, i, n = 0, 0, len(data)
+    while i < n - 12:
+        key = bytes(data[i:i+4])
+        ref = table.get(key)
+        table[key] = i
+        if ref is None or (i - ref) > 0xFFFF:
+            i += 1
+            continue
+        match_len = 4
+        while (i + match_len) < (n - 5) and data[ref + match_len] == data[i + match_len]:
+            match_len += 1
+        put_seq(data[anchor:i], i - ref, match_len)
+        i += match_len
+        anchor = i
+    put_seq(data[anchor:])
+    return bytes(out)
+
+def flash_stream(data, compressed=False, progress=None):
+    # Writes a firmware image from the start of the app (bootloader v4), data is either the image
+    # or the lz4_compress()ed image. The bootloader erases the sectors as the image reaches them,
+    # so no flash_erase() calls are needed. Use bootloader_reset() to finish.
+    __serial.write(struct.pack("<III", __BOOTLDR_STREAM, 1 if compressed else 0, len(data)))
+    chunk = 16*1024
+    for i in range(0, len(data), chunk):
+        __serial.write(data[i:i+chunk])
+        if progress:
+            progress(min(i + chunk, len(data)), len(data))
+
 def flash_erase(sector):
     __serial.write(struct.pack("<II", __BOOTLDR_ERASE, sector))
 
 def flash_write(buf):
     __serial.write(struct.pack("<I", __BOOTLDR_WRITE) + buf)
 
+def qspif_erase(block):
+    __serial.write(struct.pack("<II", __BOOTLDR_QSPIF_ERASE, block))
+
+def qspif_write(buf):
+    __serial.write(struct.pack("<I", __BOOTLDR_QSPIF_WRITE) + buf)
+
 def tx_buf_len():
     __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_TX_BUF_LEN, 4))
     return struct.unpack("I", __serial.read(4))[0]
@@ -163,14 +261,209 @@ def fw_version():
     __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FW_VERSION, 12))
     return struct.unpack("III", __serial.read(12))
 
+def fb_alloc_stats():
+    # Returns a list of (caller, calls, allocs, peak, time_us) tuples (see omv.fb_alloc_profile()).
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FB_ALLOC_STATS, 16*20))
+    buf = __serial.read(16*20)
+    entries = [struct.unpack("<IIIII", buf[i:i+20]) for i in range(0, len(buf), 20)]
+    return [e for e in entries if e[0]]
+
+def trace_enable(mask):
+    # Mask of trace events to record (see src/omv/trace.h), 0 stops tracing.
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_TRACE_ENABLE, 4))
+    __serial.write(struct.pack("<I", mask))
+
+def trace_dump():
+    # Returns the (seq, cycles, event, phase, arg) trace records recorded since the last call.
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_TRACE_LEN, 4))
+    num_records = struct.unpack("I", __serial.read(4))[0]
+    if num_records == 0:
+        return []
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_TRACE_DUMP, num_records*16))
+    buf = __serial.read(num_records*16)
+    return [struct.unpack("<IIHHI", buf[i:i+16]) for i in range(0, len(buf), 16)]
+
 def enable_fb(enable):
     __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FB_ENABLE, 4))
     __serial.write(struct.pack("<I", enable))
 
+def fb_raw_dump():
+    # Returns (w, h, bpp, bytes) with the unmodified frame (bpp: 1 == Grayscale, 2 == RGB565 (big-endian),
+    # 3 == Bayer) or a JPEG image (bpp == 0), use with enable_fb_raw(True).
+    size = fb_size()
+
+    if (not size[0]):
+        # frame not ready
+        return None
+
+    if (size[2] > 3): #JPEG
+        bpp, num_bytes = 0, size[2]
+    else:
+        bpp, num_bytes = size[2], size[0]*size[1]*(size[2] if size[2] < 3 else 1)
+
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FRAME_DUMP, num_bytes))
+    return (size[0], size[1], bpp, __serial.read(num_bytes))
+
+def enable_fb_raw(enable):
+    # Lossless frames are sent if they fit in the camera's JPEG buffer, see fb_raw_dump().
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FB_RAW, 4))
+    __serial.write(struct.pack("<I", enable))
+
+def fb_budget(bytes_per_second):
+    # Limits the preview bandwidth, the camera lowers the preview quality/resolution to fit (0 == unlimited).
+    __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FB_BUDGET, 4))
+    __serial.write(struct.pack("<I", bytes_per_second))
+
 def arch_str():
     __serial.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_ARCH_STR, 64))
     return __serial.read(64).split('\0', 1)[0]
 
+# FrameCapture helpers (module level so the command names aren't mangled inside the class).
+def _capture_config(ser, raw):
+    ser.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FB_ENABLE, 4))
+    ser.write(struct.pack("<I", 1))
+    ser.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FB_RAW, 4))
+    ser.write(struct.pack("<I", 1 if raw else 0))
+
+def _capture_read(ser):
+    # Returns (size, bytes), bytes is None if no frame is ready, or None after a short read.
+    ser.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FRAME_SIZE, __FB_HDR_SIZE))
+    hdr = ser.read(__FB_HDR_SIZE)
+    if len(hdr) != __FB_HDR_SIZE:
+        return None
+    size = struct.unpack("III", hdr)
+    if not size[0]:
+        return size, None
+    num_bytes = fb_num_bytes(size)
+    ser.write(struct.pack("<BBI", __USBDBG_CMD, __USBDBG_FRAME_DUMP, num_bytes))
+    buff = ser.read(num_bytes)
+    if len(buff) != num_bytes:
+        return None
+    return size, buff
+
+class FrameCapture(object):
+    # Streams frames from a camera at full rate: an I/O thread keeps the link busy requesting and reading
+    # frames while a pool of worker threads decodes them, so JPEG decoding never stalls the transfer. Frames
+    # are returned in capture order by get(). Nothing else should use the serial port while it's running.
+    #
+    # ser      - An open serial.Serial (see init(), or pyopenmv_multi.capture_start() for several cameras).
+    # workers  - Number of decoding threads (0 returns the frame data undecoded).
+    # raw      - Requests lossless frames (see enable_fb_raw()).
+    # depth    - Frames that may be waiting to be decoded or read by get() before new ones are dropped.
+
+    def __init__(self, ser, workers=2, raw=False, depth=8):
+        self.ser = ser
+        self.raw = raw
+        self.depth = depth
+        self.dropped = 0
+        self.frames = 0
+        self.bytes = 0
+        self.__workers = workers
+        self.__running = False
+        self.__threads = []
+        self.__work = queue.Queue()
+        self.__done = []
+        self.__cond = threading.Condition()
+        self.__next_seq = 0  # Next frame returned by get().
+        self.__pending = 0   # Frames read but not yet returned by get().
+
+        # Large kernel buffers so the camera isn't throttled between reads (only supported on Windows).
+        if hasattr(ser, "set_buffer_size"):
+            ser.set_buffer_size(rx_size=1<<20, tx_size=1<<12)
+
+    def start(self):
+        _capture_config(self.ser, self.raw)
+        self.__running = True
+        self.__threads = [threading.Thread(target=self.__io_loop)]
+        self.__threads += [threading.Thread(target=self.__decode_loop) for i in range(self.__workers)]
+        for t in self.__threads:
+            t.daemon = True
+            t.start()
+        return self
+
+    def stop(self):
+        self.__running = False
+        for i in range(self.__workers):
+            self.__work.put(None)
+        for t in self.__threads:
+            t.join()
+        self.__threads = []
+        with self.__cond:
+            self.__cond.notify_all()
+        if self.raw:
+            _capture_config(self.ser, False)
+
+    def get(self, timeout=None):
+        # Returns the next (seq, timestamp, w, h, frame) tuple, frame is an RGB array (or the undecoded
+        # (bpp/JPEG size, bytes) if there are no workers). Returns None on timeout or after stop().
+        deadline = None if timeout is None else time.time() + timeout
+        with self.__cond:
+            while True:
+                while self.__done and self.__done[0][0] < self.__next_seq:
+                    heapq.heappop(self.__done) # Duplicate sequence number, can't happen.
+                if self.__done and self.__done[0][0] == self.__next_seq:
+                    seq, result = heapq.heappop(self.__done)
+                    self.__next_seq += 1
+                    self.__pending -= 1
+                    if result is None: # Dropped or failed to decode.
+                        continue
+                    return result
+                if not self.__running:
+                    return None
+                wait = None if deadline is None else deadline - time.time()
+                if wait is not None and wait <= 0:
+                    return None
+                self.__cond.wait(wait if wait is not None else 0.1)
+
+    def __finish(self, seq, result):
+        with self.__cond:
+            heapq.heappush(self.__done, (seq, result))
+            self.__cond.notify_all()
+
+    def __io_loop(self):
+        seq = 0
+        while self.__running:
+            try:
+                frame = _capture_read(self.ser)
+            except serial.SerialException:
+                break
+            if frame is None:
+                # Short read, drop whatever is left of the transfer to get back in sync.
+                time.sleep(0.01)
+                self.ser.reset_input_buffer()
+                continue
+            size, buff = frame
+            if buff is None:
+                time.sleep(0.001)
+                continue
+            timestamp = time.time()
+            self.frames += 1
+            self.bytes += len(buff)
+            with self.__cond:
+                drop = self.__pending >= self.depth
+                self.__pending += 1
+            if drop:
+                # The consumer (or the decoders) can't keep up.
+                self.dropped += 1
+                self.__finish(seq, None)
+            elif self.__workers:
+                self.__work.put((seq, timestamp, size, buff))
+            else:
+                self.__finish(seq, (seq, timestamp, size[0], size[1], (size[2], buff)))
+            seq += 1
+        self.__running = False
+        with self.__cond:
+            self.__cond.notify_all()
+
+    def __decode_loop(self):
+        while True:
+            work = self.__work.get()
+            if work is None:
+                break
+            seq, timestamp, size, buff = work
+            image = fb_decode(size, buff)
+            self.__finish(seq, None if image is None else (seq, timestamp, image[0], image[1], image[2]))
+
 if __name__ == '__main__':
     if len(sys.argv)!= 3:
         print ('usage: pyopenmv.py <port> <script>')
@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+# This file is part of the OpenMV project.
+#
+# Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+# Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+#
+# This work is licensed under the MIT license, see the file LICENSE for details.
+#
+# Writes a firmware image with the bootloader, compressed and streamed (bootloader v4).
+# The image is compressed once and written to each camera in turn.
+#
+# Usage: pyopenmv_flash.py [--no-compress] firmware.bin /dev/ttyACM0 [/dev/ttyACM1 ...]
+
+import sys
+import time
+import argparse
+import pyopenmv
+
+BOOTLDR_STREAM_VERSION = 0xABCD0004
+
+def connect(port):
+    print("%s: waiting for the bootloader (reset the camera)..."%(port))
+    pyopenmv.init(port, timeout=0.1)
+    while True:
+        try:
+            version = pyopenmv.bootloader_version()
+            if version:
+                return version
+        except Exception:
+            pyopenmv.disconnect()
+            time.sleep(0.1)
+            pyopenmv.init(port, timeout=0.1)
+
+def progress(done, total):
+    sys.stdout.write("\r%3d%%"%(done * 100 // total))
+    sys.stdout.flush()
+
+def main():
+    parser = argparse.ArgumentParser(description="OpenMV firmware writer")
+    parser.add_argument("--no-compress", action="store_true", help="send the image uncompressed")
+    parser.add_argument("firmware", help="firmware image (firmware.bin)")
+    parser.add_argument("ports", nargs="+", help="serial ports of the cameras")
+    args = parser.parse_args()
+
+    with open(args.firmware, "rb") as f:
+        image = f.read()
+
+    data = image if args.no_compress else pyopenmv.lz4_compress(image)
+    print("Image: %d bytes, sent: %d bytes"%(len(image), len(data)))
+
+    for port in args.ports:
+        version = connect(port)
+        if version < BOOTLDR_STREAM_VERSION:
+            print("%s: bootloader version 0x%08X doesn't support streaming, skipped"%(port, version))
+            pyopenmv.disconnect()
+            continue
+
+        start = time.time()
+        pyopenmv.set_timeout(5.0)
+        pyopenmv.flash_stream(data, compressed=not args.no_compress, progress=progress)
+        # Flushes the last block and jumps to the firmware.
+        pyopenmv.bootloader_reset()
+        pyopenmv.disconnect()
+        print("\r%s: done in %.1fs"%(port, time.time() - start))
+
+if __name__ == "__main__":
+    main()
@@ -14,9 +14,11 @@ import serial
 import platform
 import numpy as np
 from PIL import Image
+from pyopenmv import FrameCapture
 
 __serial = []
 __port = []
+__capture = {}
 
 __FB_HDR_SIZE   =12
 
@@ -60,6 +62,8 @@ def disconnect(port):
     global __serial
     global __port
 
+    capture_stop(port)
+
     try:
         idx = __port.index(port)
         __serial[idx].close()
@@ -260,6 +264,30 @@ def arch_str():
     except:
         return None
 
+def capture_start(port, workers=2, raw=False, depth=8):
+    # Streams frames from the camera on its own threads (see pyopenmv.FrameCapture), so several
+    # cameras can run at full frame rate. Use capture_get() to read the frames.
+    try:
+        idx = __port.index(port)
+        capture_stop(port)
+        __capture[port] = FrameCapture(__serial[idx], workers=workers, raw=raw, depth=depth).start()
+        return __capture[port]
+    except:
+        return None
+
+def capture_get(port, timeout=None):
+    # Returns the next (seq, timestamp, w, h, frame) tuple from capture_start() or None.
+    try:
+        return __capture[port].get(timeout)
+    except:
+        return None
+
+def capture_stop(port):
+    try:
+        __capture.pop(port).stop()
+    except:
+        pass
+
 if __name__ == '__main__':
     if len(sys.argv)!= 3:
         print ('usage: pyopenmv.py <port> <script>')
@@ -6,14 +6,62 @@
 #
 # This work is licensed under the MIT license, see the file LICENSE for details.
 #
-# This script stress-tests script execution.
+# This script stress-tests script execution, or runs the imlib benchmarks (--benchmark) and
+# compares them against a baseline.
 
 import sys, os
 import pyopenmv
 import argparse
+import json
 from time import sleep
 from random import randint
 
+def run_benchmark(script, timeout):
+    results = {}
+    output = ""
+    pyopenmv.exec_script(script)
+    sleep(0.100)
+
+    start = 0
+    while True:
+        running = pyopenmv.script_running()
+        size = pyopenmv.tx_buf_len()
+        if size:
+            output += pyopenmv.tx_buf(size).decode("ascii", "ignore")
+            start = 0
+        elif not running:
+            break
+        else:
+            start += 1
+            if start * 0.010 > timeout:
+                pyopenmv.stop_script()
+                print(">>>Benchmark timed out")
+                break
+        sleep(0.010)
+
+    for line in output.splitlines():
+        words = line.split()
+        if len(words) == 5 and words[0] == "Benchmark":
+            results[words[1]] = {"cycles" : int(words[2]), "fb_peak" : int(words[3]), "heap" : int(words[4])}
+        if words:
+            print(line)
+    return results
+
+def compare_benchmark(results, baseline, tolerance):
+    regressions = 0
+    for key in sorted(baseline.keys()):
+        if not key in results:
+            print(">>>%s: missing" %(key))
+            regressions += 1
+            continue
+        for field in ("cycles", "fb_peak", "heap"):
+            old = baseline[key][field]
+            new = results[key][field]
+            if new > (old * (1.0 + tolerance)):
+                print(">>>%s %s: %d -> %d (+%.1f%%)" %(key, field, old, new, ((new - old) * 100.0) / max(old, 1)))
+                regressions += 1
+    return regressions
+
 def main():
     # CMD args parser
     parser = argparse.ArgumentParser(description='openmv stress test')
@@ -22,10 +70,17 @@ def main():
     parser.add_argument("-t", "--time",   action = "store", default = 100, help = "Max time before stopping the script")
     parser.add_argument("-s", "--script", action = "store",\
             default="../scripts/examples/01-Basics/helloworld.py", help = "OpenMV script file")
+    parser.add_argument("-b", "--benchmark", action = "store_true", help = "Run the benchmark script once and collect the results")
+    parser.add_argument("--baseline",  action = "store", help = "Baseline benchmark results (JSON) to compare against")
+    parser.add_argument("--output",    action = "store", help = "Write the benchmark results (JSON) to this file")
+    parser.add_argument("--tolerance", action = "store", default = 0.05, help = "Allowed relative increase over the baseline")
 
     # Parse CMD args
     args = parser.parse_args()
 
+    if args.benchmark and args.script == parser.get_default("script"):
+        args.script = "../scripts/examples/99-Tests/benchmarks.py"
+
     # init openmv
     if (args.port):
         portname = args.port
@@ -67,6 +122,21 @@ def main():
 
     # Interrupt running script.
     pyopenmv.stop_script()
+
+    if args.benchmark:
+        results = run_benchmark(script, int(args.time))
+        if args.output:
+            with open(args.output, "w") as f:
+                json.dump(results, f, indent=4, sort_keys=True)
+        if args.baseline:
+            with open(args.baseline, "r") as f:
+                baseline = json.load(f)
+            regressions = compare_benchmark(results, baseline, float(args.tolerance))
+            print(">>>%d regression(s) over %.1f%%" %(regressions, float(args.tolerance) * 100.0))
+            if regressions:
+                sys.exit(1)
+        return
+
     max_timeout = int(args.time)
     for i in xrange(1000):
         pyopenmv.exec_script(script)
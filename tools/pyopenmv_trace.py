@@ -0,0 +1,113 @@
+#!/usr/bin/env python2
+# This file is part of the OpenMV project.
+#
+# Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+# Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+#
+# This work is licensed under the MIT license, see the file LICENSE for details.
+#
+# This script records the firmware trace buffer (src/omv/trace.h) and saves it in the Chrome
+# trace event format, which can be opened with chrome://tracing or https://ui.perfetto.dev.
+
+import sys, os
+import pyopenmv
+import argparse
+import json
+from time import sleep, time
+
+# Same order as trace_event_t.
+EVENTS = ["capture", "line", "jpeg", "fb_alloc", "gc", "frame", "user"]
+PHASES = ["i", "B", "E"]
+
+def to_chrome_trace(records, cpu_freq):
+    events = []
+    dropped = 0
+    expected = None
+    last_cycles = None
+    ts = 0
+
+    for seq, cycles, event, phase, arg in records:
+        # seq is 0 for records that were being written and jumps for overwritten ones.
+        if seq == 0 or event >= len(EVENTS) or phase >= len(PHASES):
+            dropped += 1
+            continue
+        if expected is not None and seq != expected:
+            dropped += (seq - expected) & 0xFFFFFFFF
+        expected = (seq + 1) & 0xFFFFFFFF
+
+        # Unwrap the 32-bit cycle counter (records from ISRs can be slightly out of order).
+        if last_cycles is not None:
+            delta = (cycles - last_cycles) & 0xFFFFFFFF
+            ts += delta - (1 << 32) if delta & 0x80000000 else delta
+        last_cycles = cycles
+
+        e = {"name": EVENTS[event], "ph": PHASES[phase], "ts": ts / cpu_freq, "pid": 0, "tid": event, "args": {"arg": arg}}
+        if phase == 0:
+            e["s"] = "t"
+        events.append(e)
+
+    for i, name in enumerate(EVENTS):
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": i, "args": {"name": name}})
+
+    return {"traceEvents": events, "displayTimeUnit": "ms"}, dropped
+
+def main():
+    # CMD args parser
+    parser = argparse.ArgumentParser(description='openmv trace recorder')
+    parser.add_argument("-p", "--port",   action = "store", help = "OpenMV serial port")
+    parser.add_argument("-s", "--script", action = "store", help = "OpenMV script file to run while tracing")
+    parser.add_argument("-t", "--time",   action = "store", default = 5, help = "Seconds to record")
+    parser.add_argument("-e", "--events", action = "store", default = ",".join(EVENTS), help = "Comma separated events to record")
+    parser.add_argument("-f", "--freq",   action = "store", default = 480, help = "CPU frequency in MHz")
+    parser.add_argument("-o", "--output", action = "store", default = "trace.json", help = "Chrome trace file")
+
+    # Parse CMD args
+    args = parser.parse_args()
+
+    # init openmv
+    if (args.port):
+        portname = args.port
+    elif 'darwin' in sys.platform:
+        portname = "/dev/cu.usbmodem14221"
+    else:
+        portname = "/dev/openmvcam"
+
+    mask = 0
+    for name in args.events.split(","):
+        if not name in EVENTS:
+            print("Unknown event %s, events: %s" %(name, ", ".join(EVENTS)))
+            sys.exit(1)
+        mask |= 1 << EVENTS.index(name)
+
+    pyopenmv.init(portname, baudrate=921600, timeout=0.500)
+
+    # Discard old records.
+    pyopenmv.trace_enable(0)
+    pyopenmv.trace_dump()
+
+    if args.script:
+        with open(args.script, "r") as f:
+            pyopenmv.stop_script()
+            pyopenmv.exec_script(f.read())
+
+    # The ring is small, so it's drained often.
+    records = []
+    pyopenmv.trace_enable(mask)
+    start = time()
+    while (time() - start) < float(args.time):
+        records += pyopenmv.trace_dump()
+        sleep(0.010)
+    pyopenmv.trace_enable(0)
+    records += pyopenmv.trace_dump()
+
+    if args.script:
+        pyopenmv.stop_script()
+
+    trace, dropped = to_chrome_trace(records, float(args.freq))
+    with open(args.output, "w") as f:
+        json.dump(trace, f)
+
+    print("%d records (%d dropped) saved to %s" %(len(records), dropped, args.output))
+
+if __name__ == '__main__':
+    main()
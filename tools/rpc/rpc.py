@@ -5,7 +5,7 @@
 #
 # This work is licensed under the MIT license, see the file LICENSE for details.
 
-import gc, serial, socket, struct, time
+import binascii, gc, serial, socket, struct, time
 
 class rpc:
 
@@ -15,11 +15,8 @@ class rpc:
     _RESULT_DATA_PACKET_MAGIC = 0x1DBA
 
     def __def_crc_16(self, data, size): # private
-        crc = 0xFFFF
-        for i in range(size):
-            crc ^= data[i] << 8
-            for j in range(8): crc = (crc << 1) ^ (0x1021 if crc & 0x8000 else 0)
-        return crc & 0xFFFF
+        # binascii.crc_hqx() is CRC-16/CCITT (poly 0x1021) implemented in C.
+        return binascii.crc_hqx(memoryview(data)[:size], 0xFFFF)
 
     def _zero(self, buff, size): # private
         for i in range(size): buff[i] = 0
@@ -0,0 +1,55 @@
+#!/usr/bin/env python
+# This file is part of the OpenMV project.
+#
+# Copyright (c) 2013-2019 Ibrahim Abdelkader <iabdalkader@openmv.io>
+# Copyright (c) 2013-2019 Kwabena W. Agyeman <kwagyeman@openmv.io>
+#
+# This work is licensed under the MIT license, see the file LICENSE for details.
+#
+# This script reorders the buffers of a TFLite model in the order the operators first use
+# them, so the weights of each layer (and of the early layers together) are contiguous in
+# the file. Models run in place from flash (or copied to RAM with tf.load(load_to_fb=True))
+# then fetch whole cache lines of weights instead of lines shared with unrelated tensors.
+#
+# Usage: tf_reorder.py input.tflite output.tflite
+
+import sys
+import argparse
+from tensorflow.lite.tools import flatbuffer_utils
+
+def reorder(model):
+    # Buffer 0 is always the empty sentinel buffer.
+    order = [0]
+    for subgraph in model.subgraphs:
+        tensors = [t for op in subgraph.operators for t in list(op.inputs) + list(op.outputs)]
+        tensors += list(range(len(subgraph.tensors))) # Tensors not used by any operator.
+        for t in tensors:
+            if t >= 0 and subgraph.tensors[t].buffer not in order:
+                order.append(subgraph.tensors[t].buffer)
+
+    # Buffers not referenced by any tensor (metadata) go last.
+    order += [b for b in range(len(model.buffers)) if b not in order]
+    remap = {old: new for new, old in enumerate(order)}
+
+    model.buffers = [model.buffers[b] for b in order]
+    for subgraph in model.subgraphs:
+        for tensor in subgraph.tensors:
+            tensor.buffer = remap[tensor.buffer]
+    for metadata in (model.metadata or []):
+        metadata.buffer = remap[metadata.buffer]
+
+def main():
+    parser = argparse.ArgumentParser(description="TFLite model buffer reordering")
+    parser.add_argument("input", help="input tflite model")
+    parser.add_argument("output", help="output tflite model")
+    args = parser.parse_args()
+
+    model = flatbuffer_utils.read_model(args.input)
+    if len(model.subgraphs) != 1:
+        sys.exit("Only models with one subgraph are supported.")
+
+    reorder(model)
+    flatbuffer_utils.write_model(model, args.output)
+
+if __name__ == "__main__":
+    main()